@@ -34,3 +34,8 @@ COMPONENT_ADD_INCLUDEDIRS := cores/esp32 variants/esp32 $(ARDUINO_LIBRARY_SRCDIR
 COMPONENT_PRIV_INCLUDEDIRS := cores/esp32/libb64
 COMPONENT_SRCDIRS := cores/esp32/libb64 cores/esp32 variants/esp32 $(ARDUINO_LIBRARY_SRCDIRS)
 CXXFLAGS += -fno-rtti
+ifdef CONFIG_ARDUINO_CXX_STD_17
+CXXFLAGS += -std=gnu++1z
+else ifdef CONFIG_ARDUINO_CXX_STD_14
+CXXFLAGS += -std=gnu++14
+endif
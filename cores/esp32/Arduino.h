@@ -133,8 +133,18 @@ void initArduino(void);
 unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout);
 
+// pulseIn() without busy waiting: RMT times every pulse of state up to maxPulseUs long,
+// pulseInAsync() returns the next one, or 0 after timeout_ms (0 does not wait)
+typedef struct pulse_in_s pulse_in_t;
+pulse_in_t * pulseInAsyncBegin(uint8_t pin, uint8_t state, unsigned long maxPulseUs);
+unsigned long pulseInAsync(pulse_in_t * pulse, uint32_t timeout_ms);
+void pulseInAsyncEnd(pulse_in_t * pulse);
+
 uint8_t shiftIn(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder);
 void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
+// shiftIn()/shiftOut() of a buffer at freq Hz by the SPI host SHIFT_SPI_HOST (HSPI)
+void shiftInFast(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t * buf, size_t len, uint32_t freq);
+void shiftOutFast(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, const uint8_t * buf, size_t len, uint32_t freq);
 
 #ifdef __cplusplus
 }
@@ -144,6 +154,7 @@ void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
 
 #include "WCharacter.h"
 #include "WString.h"
+#include "StringView.h"
 #include "Stream.h"
 #include "Printable.h"
 #include "Print.h"
@@ -177,6 +188,15 @@ extern "C" void configTzTime(const char* tz,
 
 // WMath prototypes
 long random(long);
+
+// The task running setup() and loop(), a sketch overrides the defaults with the macros below
+size_t getArduinoLoopTaskStackSize(void);
+BaseType_t getArduinoLoopTaskCore(void);
+UBaseType_t getArduinoLoopTaskPriority(void);
+
+#define SET_LOOP_TASK_STACK_SIZE(sz) size_t getArduinoLoopTaskStackSize() { return sz;}
+#define SET_LOOP_TASK_CORE(core) BaseType_t getArduinoLoopTaskCore() { return core;}
+#define SET_LOOP_TASK_PRIORITY(prio) UBaseType_t getArduinoLoopTaskPriority() { return prio;}
 #endif /* __cplusplus */
 
 #define _min(a,b) ((a)<(b)?(a):(b))
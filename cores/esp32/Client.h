@@ -39,6 +39,15 @@ public:
     virtual uint8_t connected() = 0;
     virtual operator bool() = 0;
 protected:
+    int readAvailable(uint8_t *buf, size_t size) override
+    {
+        int avail = available();
+        if(avail <= 0) {
+            return 0;
+        }
+        int n = read(buf, ((size_t) avail < size) ? (size_t) avail : size);
+        return (n > 0) ? n : 0;
+    }
     uint8_t* rawIPAddress(IPAddress& addr)
     {
         return addr.raw_address();
@@ -21,11 +21,14 @@
 #include <soc/soc.h>
 #include <soc/efuse_reg.h>
 #include <esp_partition.h>
+#include "esp_flash_encrypt.h"
 extern "C" {
 #include "esp_ota_ops.h"
 #include "esp_image_format.h"
+#include "esp_freertos_hooks.h"
 }
 #include <MD5Builder.h>
+#include <SHA256Builder.h>
 
 /**
  * User-defined Literals
@@ -84,6 +87,8 @@ EspClass ESP;
 
 void EspClass::deepSleep(uint32_t time_us)
 {
+    // what was registered with rtcStateRegister() as it is now
+    rtcStateCommit();
     esp_deep_sleep(time_us);
 }
 
@@ -114,6 +119,111 @@ uint32_t EspClass::getMaxAllocHeap(void)
     return heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
 }
 
+uint8_t EspClass::getHeapFragmentation(void)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+    if(!info.total_free_bytes){
+        return 0;
+    }
+    return 100 - (uint8_t)((uint64_t)info.largest_free_block * 100 / info.total_free_bytes);
+}
+
+heap_snapshot_t EspClass::heapSnapshot(void)
+{
+    heap_snapshot_t snap;
+    memset(&snap, 0, sizeof(snap));
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+    snap.timestamp = millis();
+    snap.freeBytes = info.total_free_bytes;
+    snap.allocatedBytes = info.total_allocated_bytes;
+    snap.minFreeBytes = info.minimum_free_bytes;
+    snap.largestFreeBlock = info.largest_free_block;
+    snap.freeBlocks = info.free_blocks;
+    snap.allocatedBlocks = info.allocated_blocks;
+    if(info.total_free_bytes){
+        snap.fragmentation = 100 - (uint8_t)((uint64_t)info.largest_free_block * 100 / info.total_free_bytes);
+    }
+    if(::heapTraceActive()){
+        snap.tracedCount = heapTraceGetRecords(NULL, 0);
+        snap.tracedDropped = heapTraceDropped();
+        snap.tagCount = heapTraceGetTags(snap.tags, HEAP_SNAPSHOT_MAX_TAGS);
+    }
+    return snap;
+}
+
+static const char * _heapTagName(const char * tag)
+{
+    // call-site tags carry the full source path
+    const char * base = strrchr(tag, '/');
+    return base ? base + 1 : tag;
+}
+
+static const heap_trace_tag_t * _heapFindTag(const heap_snapshot_t & s, const char * tag)
+{
+    for(uint8_t i = 0; i < s.tagCount; i++){
+        if(s.tags[i].tag == tag || !strcmp(s.tags[i].tag, tag)){
+            return &s.tags[i];
+        }
+    }
+    return NULL;
+}
+
+size_t EspClass::heapDiff(const heap_snapshot_t & a, const heap_snapshot_t & b, Print & out)
+{
+    size_t n = out.printf("heap diff over %u ms: free %+d, allocated %+d, largest %+d, min free %+d\n",
+            b.timestamp - a.timestamp, (int)(b.freeBytes - a.freeBytes), (int)(b.allocatedBytes - a.allocatedBytes),
+            (int)(b.largestFreeBlock - a.largestFreeBlock), (int)(b.minFreeBytes - a.minFreeBytes));
+    n += out.printf("  blocks: allocated %+d, free %+d, fragmentation %u%% -> %u%%\n",
+            (int)(b.allocatedBlocks - a.allocatedBlocks), (int)(b.freeBlocks - a.freeBlocks), a.fragmentation, b.fragmentation);
+    if(!a.tagCount && !b.tagCount){
+        return n;
+    }
+    n += out.printf("  traced: %+d allocations, %+u dropped\n", (int)(b.tracedCount - a.tracedCount), b.tracedDropped - a.tracedDropped);
+    for(uint8_t i = 0; i < b.tagCount; i++){
+        const heap_trace_tag_t * t = _heapFindTag(a, b.tags[i].tag);
+        int count = (int)b.tags[i].count - (t ? (int)t->count : 0);
+        int bytes = (int)b.tags[i].bytes - (t ? (int)t->bytes : 0);
+        if(count || bytes){
+            n += out.printf("  %+6d bytes %+4d allocs  %s\n", bytes, count, _heapTagName(b.tags[i].tag));
+        }
+    }
+    // sites that were released completely
+    for(uint8_t i = 0; i < a.tagCount; i++){
+        if(!_heapFindTag(b, a.tags[i].tag)){
+            n += out.printf("  %+6d bytes %+4d allocs  %s\n", -(int)a.tags[i].bytes, -(int)a.tags[i].count, _heapTagName(a.tags[i].tag));
+        }
+    }
+    return n;
+}
+
+size_t EspClass::heapDump(Print & out)
+{
+    heap_snapshot_t s = heapSnapshot();
+    size_t n = out.printf("heap at %u ms: free %u, allocated %u, largest %u, min free %u, fragmentation %u%%\n",
+            s.timestamp, s.freeBytes, s.allocatedBytes, s.largestFreeBlock, s.minFreeBytes, s.fragmentation);
+    if(!::heapTraceActive()){
+        return n;
+    }
+    n += out.printf("traced: %u allocations, %u dropped\n", s.tracedCount, s.tracedDropped);
+    // print from a copy, out may be slow (HTTP) and allocate itself
+    size_t used = s.tracedCount;
+    heap_trace_record_t * r = (heap_trace_record_t *)malloc(used * sizeof(heap_trace_record_t));
+    if(!r){
+        return n;
+    }
+    used = heapTraceGetRecords(r, used);
+    if(used > s.tracedCount){
+        used = s.tracedCount;
+    }
+    for(size_t i = 0; i < used; i++){
+        n += out.printf("  %p %6u bytes  %8u ms  %s\n", r[i].ptr, r[i].size, r[i].timestamp, _heapTagName(r[i].tag));
+    }
+    free(r);
+    return n;
+}
+
 uint32_t EspClass::getPsramSize(void)
 {
     multi_heap_info_t info;
@@ -136,20 +246,26 @@ uint32_t EspClass::getMaxAllocPsram(void)
     return heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
 }
 
+// the running image does not change, it is verified once
 static uint32_t sketchSize(sketchSize_t response) {
-    esp_image_metadata_t data;
+    static uint32_t imageLen = 0;
     const esp_partition_t *running = esp_ota_get_running_partition();
     if (!running) return 0;
-    const esp_partition_pos_t running_pos  = {
-        .offset = running->address,
-        .size = running->size,
-    };
-    data.start_addr = running_pos.offset;
-    esp_image_verify(ESP_IMAGE_VERIFY, &running_pos, &data);
+    if (!imageLen) {
+        esp_image_metadata_t data;
+        const esp_partition_pos_t running_pos  = {
+            .offset = running->address,
+            .size = running->size,
+        };
+        data.start_addr = running_pos.offset;
+        if (esp_image_verify(ESP_IMAGE_VERIFY, &running_pos, &data) == ESP_OK) {
+            imageLen = data.image_len;
+        }
+    }
     if (response) {
-        return running_pos.size - data.image_len;
+        return running->size - imageLen;
     } else {
-        return data.image_len;
+        return imageLen;
     }
 }
     
@@ -157,44 +273,162 @@ uint32_t EspClass::getSketchSize () {
     return sketchSize(SKETCH_SIZE_TOTAL);
 }
 
-String EspClass::getSketchMD5()
-{
-    static String result;
-    if (result.length()) {
-        return result;
-    }
-    uint32_t lengthLeft = getSketchSize();
+/**
+ * Sketch MD5
+ * MD5 has no hardware engine, so hashing a large image takes a while; it is
+ * done once, by the caller or by a task of its own for getSketchMD5(false).
+ */
+#ifndef SKETCH_MD5_TASK_STACK_SIZE
+#define SKETCH_MD5_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef SKETCH_MD5_TASK_PRIORITY
+#define SKETCH_MD5_TASK_PRIORITY 1 // below loop(), it only has to be done by the time it is asked for again
+#endif
 
+static char _sketchMD5[33];
+static volatile bool _sketchMD5Ready = false;
+static volatile bool _sketchMD5Busy = false;
+static portMUX_TYPE _sketchMD5Mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void _sketchMD5Run()
+{
+    uint32_t lengthLeft = ESP.getSketchSize();
     const esp_partition_t *running = esp_ota_get_running_partition();
-    if (!running) {
+    const size_t bufSize = SPI_FLASH_SEC_SIZE;
+    std::unique_ptr<uint8_t[]> buf(new (std::nothrow) uint8_t[bufSize]);
+    if (!running || !lengthLeft) {
         log_e("Partition could not be found");
+    } else if (!buf.get()) {
+        log_e("Not enough memory to allocate buffer");
+    } else {
+        MD5Builder md5;
+        md5.begin();
+        uint32_t offset = 0;
+        while (lengthLeft > 0) {
+            size_t readBytes = (lengthLeft < bufSize) ? lengthLeft : bufSize;
+            if (!ESP.partitionReadBytes(running, offset, buf.get(), readBytes)) {
+                log_e("Could not read buffer from flash");
+                break;
+            }
+            md5.add(buf.get(), readBytes);
+            lengthLeft -= readBytes;
+            offset += readBytes;
+        }
+        ESP.partitionReadRelease();
+        if (!lengthLeft) {
+            md5.calculate();
+            md5.getChars(_sketchMD5);
+            _sketchMD5Ready = true;
+        }
+    }
+    _sketchMD5Busy = false;
+}
 
-        return String();
+static void _sketchMD5Task(void *)
+{
+    _sketchMD5Run();
+    vTaskDelete(NULL);
+}
+
+String EspClass::getSketchMD5(bool wait)
+{
+    for (;;) {
+        if (_sketchMD5Ready) {
+            return String(_sketchMD5);
+        }
+        bool mine = false;
+        portENTER_CRITICAL(&_sketchMD5Mux);
+        if (!_sketchMD5Busy) {
+            _sketchMD5Busy = mine = true;
+        }
+        portEXIT_CRITICAL(&_sketchMD5Mux);
+        if (mine && wait) {
+            _sketchMD5Run();
+            return _sketchMD5Ready ? String(_sketchMD5) : String();
+        }
+        if (mine && xTaskCreate(_sketchMD5Task, "sketch_md5", SKETCH_MD5_TASK_STACK_SIZE, NULL, SKETCH_MD5_TASK_PRIORITY, NULL) != pdPASS) {
+            log_e("MD5 task not created");
+            _sketchMD5Busy = false;
+        }
+        if (!wait) {
+            return String();
+        }
+        // someone else is at it
+        delay(10);
     }
-    const size_t bufSize = SPI_FLASH_SEC_SIZE;
-    std::unique_ptr<uint8_t[]> buf(new uint8_t[bufSize]);
-    uint32_t offset = 0;
-    if(!buf.get()) {
-        log_e("Not enough memory to allocate buffer");
+}
 
-        return String();
+static String _sha256Hex(const uint8_t *sha)
+{
+    char hex[65];
+    for (int i = 0; i < 32; i++) {
+        sprintf(hex + i * 2, "%02x", sha[i]);
     }
-    MD5Builder md5;
-    md5.begin();
-    while( lengthLeft > 0) {
-        size_t readBytes = (lengthLeft < bufSize) ? lengthLeft : bufSize;
-        if (!ESP.flashRead(running->address + offset, reinterpret_cast<uint32_t*>(buf.get()), (readBytes + 3) & ~3)) {
-            log_e("Could not read buffer from flash");
+    return String(hex);
+}
 
+String EspClass::getSketchSHA256()
+{
+    static uint8_t sha[32];
+    static bool ready = false;
+    if (!ready) {
+        ready = getPartitionSHA256(esp_ota_get_running_partition(), sha);
+        if (!ready) {
             return String();
         }
-        md5.add(buf.get(), readBytes);
-        lengthLeft -= readBytes;
-        offset += readBytes;
     }
-    md5.calculate();
-    result = md5.toString();
-    return result;
+    return _sha256Hex(sha);
+}
+
+bool EspClass::getPartitionSHA256(const esp_partition_t *partition, uint8_t *sha256)
+{
+    if (!partition || !sha256) {
+        return false;
+    }
+    // the IDF reads the digest appended to an image, or hashes it whole
+    if (partition->type == ESP_PARTITION_TYPE_APP) {
+        esp_err_t err = esp_partition_get_sha256(partition, sha256);
+        if (err != ESP_OK) {
+            log_e("esp_partition_get_sha256 of '%s' failed: 0x%x", partition->label, err);
+            return false;
+        }
+        return true;
+    }
+    // through the read window, the IDF would map all of the partition at once
+    const size_t bufSize = SPI_FLASH_SEC_SIZE;
+    std::unique_ptr<uint8_t[]> buf(new (std::nothrow) uint8_t[bufSize]);
+    if (!buf.get()) {
+        log_e("Not enough memory to allocate buffer");
+        return false;
+    }
+    SHA256Builder sha;
+    sha.begin();
+    bool ok = true;
+    for (uint32_t offset = 0; ok && offset < partition->size; offset += bufSize) {
+        size_t readBytes = min((size_t)(partition->size - offset), bufSize);
+        ok = partitionReadBytes(partition, offset, buf.get(), readBytes);
+        if (ok) {
+            sha.add(buf.get(), readBytes);
+        }
+    }
+    partitionReadRelease();
+    if (!ok) {
+        log_e("Could not read '%s'", partition->label);
+        return false;
+    }
+    sha.calculate();
+    sha.getBytes(sha256);
+    return true;
+}
+
+String EspClass::getPartitionSHA256(const esp_partition_t *partition)
+{
+    uint8_t sha[32];
+    if (!getPartitionSHA256(partition, sha)) {
+        return String();
+    }
+    return _sha256Hex(sha);
 }
 
 uint32_t EspClass::getFreeSketchSpace () {
@@ -346,9 +580,273 @@ bool EspClass::partitionRead(const esp_partition_t *partition, uint32_t offset,
     return esp_partition_read(partition, offset, data, size) == ESP_OK;
 }
 
+const void * EspClass::partitionMmap(const char * label, uint32_t offset, size_t len, spi_flash_mmap_handle_t * handle)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if(!partition) {
+        log_e("no data partition '%s'", label);
+        return NULL;
+    }
+    return partitionMmap(partition, offset, len, handle);
+}
+
+const void * EspClass::partitionMmap(const esp_partition_t *partition, uint32_t offset, size_t len, spi_flash_mmap_handle_t * handle)
+{
+    if(!partition || !handle || offset > partition->size) {
+        return NULL;
+    }
+    if(!len) {
+        len = partition->size - offset;
+    }
+    const void *ptr = NULL;
+    esp_err_t err = esp_partition_mmap(partition, offset, len, SPI_FLASH_MMAP_DATA, &ptr, handle);
+    if(err != ESP_OK) {
+        log_e("esp_partition_mmap failed: 0x%x", err);
+        return NULL;
+    }
+    return ptr;
+}
+
+void EspClass::partitionMunmap(spi_flash_mmap_handle_t handle)
+{
+    spi_flash_munmap(handle);
+}
+
+/**
+ * Byte reads through one mapped window
+ * spi_flash_read() turns the cache off for each call, a mapped window is read
+ * by memcpy. The IDF flushes the cache over what it writes or erases, so the
+ * window does not need dropping on writes.
+ */
+#ifndef PARTITION_READ_WINDOW
+#define PARTITION_READ_WINDOW SPI_FLASH_MMU_PAGE_SIZE
+#endif
+
+static SemaphoreHandle_t _readLock = NULL;
+static const esp_partition_t * _readPartition = NULL;
+static uint32_t _readWindow = 0;       // window offset in the partition
+static size_t _readWindowSize = 0;
+static const uint8_t * _readPtr = NULL;
+static spi_flash_mmap_handle_t _readHandle;
+
+static void _readUnmap()
+{
+    if(_readPtr) {
+        spi_flash_munmap(_readHandle);
+        _readPtr = NULL;
+        _readPartition = NULL;
+    }
+}
+
+// the cache decrypts every mapped read once encryption is on
+static bool _readMappable(const esp_partition_t *partition)
+{
+    return partition->encrypted || !esp_flash_encryption_enabled();
+}
+
+static bool _readBytes(const esp_partition_t *partition, uint32_t offset, uint8_t *data, size_t size)
+{
+    if(!_readMappable(partition)) {
+        return esp_partition_read(partition, offset, data, size) == ESP_OK;
+    }
+    while(size) {
+        if(_readPartition != partition || offset < _readWindow || offset >= _readWindow + _readWindowSize) {
+            _readUnmap();
+            // window offsets are page aligned in flash, so a window is one MMU page
+            uint32_t start = (partition->address + offset) & ~(SPI_FLASH_MMU_PAGE_SIZE - 1);
+            uint32_t window = start > partition->address ? start - partition->address : 0;
+            size_t windowSize = min((size_t)(partition->size - window), (size_t)PARTITION_READ_WINDOW - (partition->address + window - start));
+            const void *ptr = NULL;
+            if(esp_partition_mmap(partition, window, windowSize, SPI_FLASH_MMAP_DATA, &ptr, &_readHandle) != ESP_OK) {
+                // out of MMU pages
+                return esp_partition_read(partition, offset, data, size) == ESP_OK;
+            }
+            _readPtr = (const uint8_t *)ptr;
+            _readPartition = partition;
+            _readWindow = window;
+            _readWindowSize = windowSize;
+        }
+        size_t n = min(size, (size_t)(_readWindow + _readWindowSize - offset));
+        memcpy(data, _readPtr + offset - _readWindow, n);
+        offset += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool EspClass::partitionReadBytes(const esp_partition_t *partition, uint32_t offset, void *data, size_t size)
+{
+    flash_read_t read = { offset, data, size };
+    return partitionReadBytes(partition, &read, 1);
+}
+
+bool EspClass::partitionReadBytes(const esp_partition_t *partition, const flash_read_t *reads, size_t count)
+{
+    if(!partition || (!reads && count)) {
+        return false;
+    }
+    for(size_t i = 0; i < count; i++) {
+        if((!reads[i].data && reads[i].size) || reads[i].offset > partition->size || reads[i].size > partition->size - reads[i].offset) {
+            log_e("read %u: 0x%x+%u is outside '%s'", i, reads[i].offset, reads[i].size, partition->label);
+            return false;
+        }
+    }
+    if(!_readLock) {
+        _readLock = xSemaphoreCreateMutex();
+        if(!_readLock) {
+            return false;
+        }
+    }
+    xSemaphoreTake(_readLock, portMAX_DELAY);
+    bool ok = true;
+    for(size_t i = 0; ok && i < count; i++) {
+        ok = _readBytes(partition, reads[i].offset, (uint8_t *)reads[i].data, reads[i].size);
+    }
+    xSemaphoreGive(_readLock);
+    return ok;
+}
+
+void EspClass::partitionReadRelease()
+{
+    if(!_readLock) {
+        return;
+    }
+    xSemaphoreTake(_readLock, portMAX_DELAY);
+    _readUnmap();
+    xSemaphoreGive(_readLock);
+}
+
 uint64_t EspClass::getEfuseMac(void)
 {
     uint64_t _chipmacid = 0LL;
     esp_efuse_mac_get_default((uint8_t*) (&_chipmacid));
     return _chipmacid;
 }
+
+/**
+ * Task statistics
+ * A tick hook on each core charges the tick to whichever task it interrupted.
+ * The stack of the interrupted task is measured every TASK_STATS_STACK_CHECK_TICKS.
+ */
+#ifndef TASK_STATS_MAX_TASKS
+#define TASK_STATS_MAX_TASKS 32
+#endif
+
+#ifndef TASK_STATS_STACK_CHECK_TICKS
+#define TASK_STATS_STACK_CHECK_TICKS 100
+#endif
+
+static task_stats_t * _task_stats = NULL;
+static size_t _task_stats_count = 0;
+static uint32_t _task_stats_ticks[portNUM_PROCESSORS];
+static TaskHandle_t _task_stats_last[portNUM_PROCESSORS];
+static portMUX_TYPE _task_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR _taskStatsTickHook()
+{
+    BaseType_t core = xPortGetCoreID();
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL_ISR(&_task_stats_mux);
+    if(!_task_stats){
+        portEXIT_CRITICAL_ISR(&_task_stats_mux);
+        return;
+    }
+    uint32_t tick = _task_stats_ticks[core]++;
+    task_stats_t * t = NULL;
+    for(size_t i = 0; i < _task_stats_count; i++){
+        if(_task_stats[i].handle == current){
+            t = &_task_stats[i];
+            break;
+        }
+    }
+    if(!t && _task_stats_count < TASK_STATS_MAX_TASKS){
+        t = &_task_stats[_task_stats_count++];
+        memset(t, 0, sizeof(task_stats_t));
+        t->handle = current;
+        strncpy(t->name, pcTaskGetTaskName(NULL), configMAX_TASK_NAME_LEN - 1);
+        t->name[configMAX_TASK_NAME_LEN - 1] = 0;
+        BaseType_t affinity = xTaskGetAffinity(NULL);
+        t->affinity = (affinity == tskNO_AFFINITY) ? -1 : affinity;
+        t->stackHighWater = uxTaskGetStackHighWaterMark(NULL);
+    }
+    if(t){
+        t->samples++;
+        t->core = core;
+        if(_task_stats_last[core] != current){
+            t->switches++;
+        }
+        if(!(tick % TASK_STATS_STACK_CHECK_TICKS)){
+            t->stackHighWater = uxTaskGetStackHighWaterMark(NULL);
+        }
+    }
+    _task_stats_last[core] = current;
+    portEXIT_CRITICAL_ISR(&_task_stats_mux);
+}
+
+bool EspClass::beginTaskStats()
+{
+    if(_task_stats){
+        return true;
+    }
+    task_stats_t * stats = (task_stats_t *)calloc(TASK_STATS_MAX_TASKS, sizeof(task_stats_t));
+    if(!stats){
+        return false;
+    }
+    portENTER_CRITICAL(&_task_stats_mux);
+    _task_stats = stats;
+    _task_stats_count = 0;
+    memset(_task_stats_ticks, 0, sizeof(_task_stats_ticks));
+    memset(_task_stats_last, 0, sizeof(_task_stats_last));
+    portEXIT_CRITICAL(&_task_stats_mux);
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        esp_register_freertos_tick_hook_for_cpu(_taskStatsTickHook, core);
+    }
+    return true;
+}
+
+void EspClass::endTaskStats()
+{
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        esp_deregister_freertos_tick_hook_for_cpu(_taskStatsTickHook, core);
+    }
+    portENTER_CRITICAL(&_task_stats_mux);
+    task_stats_t * stats = _task_stats;
+    _task_stats = NULL;
+    _task_stats_count = 0;
+    portEXIT_CRITICAL(&_task_stats_mux);
+    free(stats);
+}
+
+void EspClass::resetTaskStats()
+{
+    portENTER_CRITICAL(&_task_stats_mux);
+    _task_stats_count = 0;
+    memset(_task_stats_ticks, 0, sizeof(_task_stats_ticks));
+    memset(_task_stats_last, 0, sizeof(_task_stats_last));
+    portEXIT_CRITICAL(&_task_stats_mux);
+}
+
+size_t EspClass::getTaskStats(task_stats_t * stats, size_t max)
+{
+    if(!_task_stats || !stats){
+        return 0;
+    }
+    portENTER_CRITICAL(&_task_stats_mux);
+    uint32_t ticks = 0;
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        if(_task_stats_ticks[core] > ticks){
+            ticks = _task_stats_ticks[core];
+        }
+    }
+    size_t count = _task_stats_count;
+    if(max > count){
+        max = count;
+    }
+    memcpy(stats, _task_stats, max * sizeof(task_stats_t));
+    portEXIT_CRITICAL(&_task_stats_mux);
+    for(size_t i = 0; i < max; i++){
+        stats[i].cpuPercent = ticks ? (100.0f * stats[i].samples / ticks) : 0;
+    }
+    return count;
+}
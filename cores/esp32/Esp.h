@@ -51,6 +51,50 @@ typedef enum {
     SKETCH_SIZE_FREE = 1
 } sketchSize_t;
 
+/**
+ * Per-task CPU usage, sampled on every FreeRTOS tick on each core
+ * (cpuPercent is the share of one core, switches counts sampled task changes)
+ */
+typedef struct {
+    TaskHandle_t handle;   // may have been deleted since it was last seen
+    char name[configMAX_TASK_NAME_LEN];
+    int8_t affinity;       // pinned core or -1
+    uint8_t core;          // core it was last seen on
+    uint32_t stackHighWater; // bytes of stack never used
+    uint32_t samples;
+    uint32_t switches;
+    float cpuPercent;
+} task_stats_t;
+
+/**
+ * Internal heap state at one point in time, tags holds the largest
+ * traced allocation sites when the heap tracer is running
+ */
+#ifndef HEAP_SNAPSHOT_MAX_TAGS
+#define HEAP_SNAPSHOT_MAX_TAGS 8
+#endif
+
+typedef struct {
+    uint32_t timestamp;      // millis()
+    uint32_t freeBytes;
+    uint32_t allocatedBytes;
+    uint32_t minFreeBytes;
+    uint32_t largestFreeBlock;
+    uint32_t freeBlocks;
+    uint32_t allocatedBlocks;
+    uint8_t fragmentation;   // 0 = all free memory in one block, 100 = fully fragmented
+    uint32_t tracedCount;    // live traced allocations
+    uint32_t tracedDropped;
+    uint8_t tagCount;
+    heap_trace_tag_t tags[HEAP_SNAPSHOT_MAX_TAGS];
+} heap_snapshot_t;
+
+typedef struct {
+    uint32_t offset;         // in the partition
+    void * data;
+    size_t size;
+} flash_read_t;
+
 class EspClass
 {
 public:
@@ -63,6 +107,15 @@ public:
     uint32_t getFreeHeap(); //available heap
     uint32_t getMinFreeHeap(); //lowest level of free heap since boot
     uint32_t getMaxAllocHeap(); //largest block of heap that can be allocated at once
+    uint8_t getHeapFragmentation(); //0-100, how much of the free heap is outside the largest block
+
+    bool heapTraceBegin(size_t maxRecords = 0){ return ::heapTraceBegin(maxRecords); }
+    void heapTraceEnd(){ ::heapTraceEnd(); }
+    heap_snapshot_t heapSnapshot();
+    // prints what changed from a to b, returns the bytes written
+    size_t heapDiff(const heap_snapshot_t & a, const heap_snapshot_t & b, Print & out);
+    // prints the snapshot and, when tracing, every live traced allocation
+    size_t heapDump(Print & out);
 
     //SPI RAM
     uint32_t getPsramSize();
@@ -88,7 +141,10 @@ public:
     FlashMode_t magicFlashChipMode(uint8_t byte);
 
     uint32_t getSketchSize();
-    String getSketchMD5();
+    // computed once; with wait false it is worked out by a task meanwhile, and "" returned until it is done
+    String getSketchMD5(bool wait = true);
+    // the digest the build appended to the image when it has one, so no hashing on the ESP32
+    String getSketchSHA256();
     uint32_t getFreeSketchSpace();
 
     bool flashEraseSector(uint32_t sector);
@@ -98,9 +154,30 @@ public:
     bool partitionEraseRange(const esp_partition_t *partition, uint32_t offset, size_t size);
     bool partitionWrite(const esp_partition_t *partition, uint32_t offset, uint32_t *data, size_t size);
     bool partitionRead(const esp_partition_t *partition, uint32_t offset, uint32_t *data, size_t size);
+    // maps len bytes (0 for the rest) of a data partition into the flash data cache, read-only;
+    // NULL on failure, release with partitionMunmap(handle)
+    const void * partitionMmap(const char * label, uint32_t offset, size_t len, spi_flash_mmap_handle_t * handle);
+    const void * partitionMmap(const esp_partition_t *partition, uint32_t offset, size_t len, spi_flash_mmap_handle_t * handle);
+    void partitionMunmap(spi_flash_mmap_handle_t handle);
+    // any offset, size and buffer alignment; served by memcpy from a mapped 64K window when
+    // the flash cache reads the partition right (plain, or encrypted and decrypted by the cache)
+    bool partitionReadBytes(const esp_partition_t *partition, uint32_t offset, void *data, size_t size);
+    // the reads in list order, adjacent ones from the same window
+    bool partitionReadBytes(const esp_partition_t *partition, const flash_read_t *reads, size_t count);
+    // unmaps the window partitionReadBytes() keeps
+    void partitionReadRelease();
+    // app partitions hash their image, data partitions all of it, on the SHA engine
+    bool getPartitionSHA256(const esp_partition_t *partition, uint8_t *sha256);
+    String getPartitionSHA256(const esp_partition_t *partition);
 
     uint64_t getEfuseMac();
 
+    bool beginTaskStats();
+    void endTaskStats();
+    void resetTaskStats();
+    // fills up to max entries, returns the number of tasks seen since begin/reset
+    size_t getTaskStats(task_stats_t * stats, size_t max);
+
 };
 
 uint32_t IRAM_ATTR EspClass::getCycleCount()
@@ -20,6 +20,7 @@
 
 #include "FunctionalInterrupt.h"
 #include "Arduino.h"
+#include "soc/gpio_pins.h"
 
 typedef void (*voidFuncPtr)(void);
 typedef void (*voidFuncPtrArg)(void*);
@@ -29,29 +30,44 @@ extern "C"
 	extern void __attachInterruptFunctionalArg(uint8_t pin, voidFuncPtrArg userFunc, void * arg, int intr_type, bool functional);
 }
 
-void IRAM_ATTR interruptFunctional(void* arg)
+static_assert(InterruptCallableFits<std::function<void(void)> >::value, "FUNCTIONAL_INTERRUPT_STORAGE must hold a std::function");
+
+static DRAM_ATTR InterruptArgStructure __functionalInterrupts[GPIO_PIN_COUNT];
+
+void* __functionalInterruptStorage(uint8_t pin)
 {
-    InterruptArgStructure* localArg = (InterruptArgStructure*)arg;
-	if (localArg->interruptFunction)
-	{
-	  localArg->interruptFunction();
+	if (pin >= GPIO_PIN_COUNT) {
+		log_e("invalid pin %u", pin);
+		return NULL;
 	}
+	// the storage is free only once the previous callable was destroyed
+	detachInterrupt(pin);
+	return __functionalInterrupts[pin].storage;
+}
+
+void __functionalInterruptAttach(uint8_t pin, void (*invoke)(void*), void (*destroy)(void*), int mode)
+{
+	__functionalInterrupts[pin].destroy = destroy;
+	__attachInterruptFunctionalArg(pin, invoke, &__functionalInterrupts[pin], mode, true);
 }
 
 void attachInterrupt(uint8_t pin, std::function<void(void)> intRoutine, int mode)
 {
-	// use the local interrupt routine which takes the ArgStructure as argument
-	__attachInterruptFunctionalArg (pin, (voidFuncPtrArg)interruptFunctional, new InterruptArgStructure{intRoutine}, mode, true);
+	if (!intRoutine) {
+		detachInterrupt(pin);
+		return;
+	}
+	__attachFunctionalInterrupt<std::function<void(void)> >(pin, std::move(intRoutine), mode);
 }
 
 extern "C"
 {
    void cleanupFunctional(void* arg)
    {
-	 delete (InterruptArgStructure*)arg;
+	 InterruptArgStructure* callable = (InterruptArgStructure*)arg;
+	 if (callable->destroy) {
+		 callable->destroy(callable->storage);
+		 callable->destroy = NULL;
+	 }
    }
 }
-
-
-
-
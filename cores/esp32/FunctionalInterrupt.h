@@ -22,11 +22,71 @@
 #define CORE_CORE_FUNCTIONALINTERRUPT_H_
 
 #include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+#include "esp_attr.h"
 
+#ifndef FUNCTIONAL_INTERRUPT_STORAGE
+#define FUNCTIONAL_INTERRUPT_STORAGE (4 * sizeof(void*)) // bytes a callable may take to be held per pin without the heap, a std::function fits
+#endif
+
+// storage for the callable of one pin, statically allocated in DRAM for every pin
 struct InterruptArgStructure {
-	std::function<void(void)> interruptFunction;
+	alignas(void*) uint8_t storage[FUNCTIONAL_INTERRUPT_STORAGE];
+	void (*destroy)(void*);
 };
 
+template<typename T>
+struct InterruptCallableFits : std::integral_constant<bool,
+	std::is_class<T>::value && sizeof(T) <= FUNCTIONAL_INTERRUPT_STORAGE && alignof(T) <= alignof(void*)> {};
+
+// detaches pin and returns its storage, NULL for a pin without interrupts
+void* __functionalInterruptStorage(uint8_t pin);
+void __functionalInterruptAttach(uint8_t pin, void (*invoke)(void*), void (*destroy)(void*), int mode);
+
+// flatten pulls the body of the callable into this IRAM function
+template<typename T>
+void IRAM_ATTR __attribute__((flatten)) __functionalInterruptInvoke(void* arg)
+{
+	(*static_cast<T*>(arg))();
+}
+
+template<typename T>
+void __functionalInterruptDestroy(void* arg)
+{
+	static_cast<T*>(arg)->~T();
+}
+
+template<typename T, typename F>
+void __attachFunctionalInterrupt(uint8_t pin, F&& intRoutine, int mode)
+{
+	void* storage = __functionalInterruptStorage(pin);
+	if (!storage) {
+		return;
+	}
+	new (storage) T(std::forward<F>(intRoutine));
+	__functionalInterruptAttach(pin, __functionalInterruptInvoke<T>,
+		std::is_trivially_destructible<T>::value ? nullptr : __functionalInterruptDestroy<T>, mode);
+}
+
+/*
+ * Lambdas, std::bind() and other callables of up to FUNCTIONAL_INTERRUPT_STORAGE bytes
+ * are stored in place for the pin, and the interrupt calls the invoker made for their
+ * type directly:
+ *
+ *   attachInterrupt(pin, [this]() { count++; }, FALLING);
+ *
+ * Larger ones go through std::function below, which may allocate.
+ */
+template<typename F, typename T = typename std::decay<F>::type,
+	typename std::enable_if<InterruptCallableFits<T>::value && !std::is_same<T, std::function<void(void)> >::value, int>::type = 0>
+void attachInterrupt(uint8_t pin, F&& intRoutine, int mode)
+{
+	__attachFunctionalInterrupt<T>(pin, std::forward<F>(intRoutine), mode);
+}
+
 void attachInterrupt(uint8_t pin, std::function<void(void)> intRoutine, int mode);
 
 
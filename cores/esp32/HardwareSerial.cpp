@@ -20,6 +20,18 @@
 #include "pins_arduino.h"
 #include "HardwareSerial.h"
 
+#ifndef ARDUINO_SERIAL_EVENT_TASK_STACK_SIZE
+#define ARDUINO_SERIAL_EVENT_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef ARDUINO_SERIAL_EVENT_TASK_PRIORITY
+#define ARDUINO_SERIAL_EVENT_TASK_PRIORITY 2
+#endif
+
+#ifndef ARDUINO_SERIAL_EVENT_TASK_RUNNING_CORE
+#define ARDUINO_SERIAL_EVENT_TASK_RUNNING_CORE -1
+#endif
+
 #ifndef RX1
 #define RX1 9
 #endif
@@ -42,7 +54,110 @@ HardwareSerial Serial1(1);
 HardwareSerial Serial2(2);
 #endif
 
-HardwareSerial::HardwareSerial(int uart_nr) : _uart_nr(uart_nr), _uart(NULL) {}
+HardwareSerial::HardwareSerial(int uart_nr) :
+    _uart_nr(uart_nr), _uart(NULL), _tx_buffer_size(256), _frame_discard(0),
+    _eventTask(NULL), _eventTaskStop(false), _frameDelimiter('\n'), _maxFrameLen(0), _frameBuffer(NULL), _rxTimeoutSymbols(0)
+{
+}
+
+HardwareSerial::~HardwareSerial()
+{
+    _destroyEventTask();
+    free(_frameBuffer);
+}
+
+static void copyView(const uart_rx_view_t * view, uint8_t * dst, size_t len)
+{
+    size_t first = (len < view->len[0]) ? len : view->len[0];
+    memcpy(dst, view->data[0], first);
+    memcpy(dst + first, view->data[1], len - first);
+}
+
+void HardwareSerial::_uartEventTask(void *args)
+{
+    HardwareSerial * serial = (HardwareSerial *)args;
+    size_t pending = 0;
+    size_t count;
+    int64_t timestamp;
+    while(!serial->_eventTaskStop) {
+        // sleep until something beyond the incomplete frame we already looked at arrives
+        size_t avail = uartWaitRx(serial->_uart, pending + 1, 1000);
+        if(serial->_eventTaskStop) {
+            break;
+        }
+        if(serial->_onFrameCb) {
+            if(avail > pending) {
+                pending = serial->_dispatchFrames();
+            }
+        } else {
+            pending = avail;
+        }
+        if(uartGetRxTimeoutEvent(serial->_uart, &count, &timestamp) && serial->_onReceiveCb && !serial->_eventTaskStop) {
+            serial->_onReceiveCb(count, timestamp);
+            if(!serial->_onFrameCb) {
+                pending = uartAvailable(serial->_uart);
+            }
+        }
+    }
+    serial->_eventTask = NULL;
+    vTaskDelete(NULL);
+}
+
+size_t HardwareSerial::_dispatchFrames()
+{
+    uart_rx_view_t view;
+    while(!_eventTaskStop) {
+        size_t avail = uartPeekView(_uart, &view);
+        size_t len = uartFindByte(_uart, _frameDelimiter, _maxFrameLen);
+        if(!len) {
+            if(avail < _maxFrameLen) {
+                return avail;
+            }
+            log_w("Dropping %u bytes without frame delimiter", _maxFrameLen);
+            uartConsume(_uart, _maxFrameLen);
+            continue;
+        }
+        if(len <= view.len[0]) {
+            _onFrameCb(view.data[0], len - 1);
+        } else {
+            copyView(&view, _frameBuffer, len);
+            _onFrameCb(_frameBuffer, len - 1);
+        }
+        if(_eventTaskStop) {
+            break;
+        }
+        uartConsume(_uart, len);
+    }
+    return 0;
+}
+
+void HardwareSerial::_createEventTask()
+{
+    if(_eventTask != NULL || _uart == NULL || (!_onFrameCb && !_onReceiveCb)) {
+        return;
+    }
+    _eventTaskStop = false;
+    xTaskCreateUniversal(_uartEventTask, "uart_event", ARDUINO_SERIAL_EVENT_TASK_STACK_SIZE, this, ARDUINO_SERIAL_EVENT_TASK_PRIORITY, &_eventTask, ARDUINO_SERIAL_EVENT_TASK_RUNNING_CORE);
+    if(_eventTask == NULL) {
+        log_e("Could not create UART event task");
+    }
+}
+
+void HardwareSerial::_destroyEventTask()
+{
+    if(_eventTask == NULL) {
+        return;
+    }
+    _eventTaskStop = true;
+    if(xTaskGetCurrentTaskHandle() == _eventTask) {
+        // called from a callback, the task exits once it returns
+        return;
+    }
+    xTaskNotifyGive(_eventTask);
+    while(_eventTask != NULL) {
+        delay(1);
+    }
+}
 
 void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin, bool invert, unsigned long timeout_ms)
 {
@@ -90,6 +205,11 @@ void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, in
             _rx_pin = 255;
         }
     }
+    uartResizeTxBuffer(_uart, _tx_buffer_size);
+    if(_rxTimeoutSymbols) {
+        uartSetRxTimeout(_uart, _rxTimeoutSymbols);
+    }
+    _createEventTask();
 }
 
 void HardwareSerial::updateBaudRate(unsigned long baud)
@@ -103,6 +223,7 @@ void HardwareSerial::end()
         uartSetDebug(0);
     }
     log_v("pins %d %d",_tx_pin, _rx_pin);
+    _destroyEventTask();
     uartEnd(_uart, _tx_pin, _rx_pin);
     _uart = 0;
 }
@@ -111,6 +232,15 @@ size_t HardwareSerial::setRxBufferSize(size_t new_size) {
     return uartResizeRxBuffer(_uart, new_size);
 }
 
+// 0 disables TX buffering, write() then blocks until the data is in the hardware FIFO
+size_t HardwareSerial::setTxBufferSize(size_t new_size) {
+    _tx_buffer_size = new_size;
+    if(_uart == NULL) {
+        return new_size;
+    }
+    return uartResizeTxBuffer(_uart, new_size);
+}
+
 void HardwareSerial::setDebugOutput(bool en)
 {
     if(_uart == 0) {
@@ -142,10 +272,31 @@ int HardwareSerial::peek(void)
     return -1;
 }
 
+size_t HardwareSerial::peekAvailable()
+{
+    uart_rx_view_t view;
+    uartPeekView(_uart, &view);
+    return view.len[0];
+}
+
+const uint8_t * HardwareSerial::peekBuffer()
+{
+    uart_rx_view_t view;
+    uartPeekView(_uart, &view);
+    return view.data[0];
+}
+
+void HardwareSerial::peekConsume(size_t len)
+{
+    uartConsume(_uart, len);
+}
+
 int HardwareSerial::read(void)
 {
-    if(available()) {
-        return uartRead(_uart);
+    // one pass through the RX ring, available() and uartRead() would each look at it
+    uint8_t c;
+    if(uartReadBytes(_uart, &c, 1, 0)) {
+        return c;
     }
     return -1;
 }
@@ -156,16 +307,13 @@ int HardwareSerial::read(void)
 // the buffer is NOT null terminated.
 size_t HardwareSerial::read(uint8_t *buffer, size_t size)
 {
-    size_t avail = available();
-    if (size < avail) {
-        avail = size;
-    }
-    size_t count = 0;
-    while(count < avail) {
-        *buffer++ = uartRead(_uart);
-        count++;
-    }
-    return count;
+    return uartReadBytes(_uart, buffer, size, 0);
+}
+
+// as read(buffer, size) but waits up to the stream timeout for the remaining characters
+size_t HardwareSerial::readBytes(uint8_t *buffer, size_t length)
+{
+    return uartReadBytes(_uart, buffer, length, _timeout);
 }
 
 void HardwareSerial::flush(void)
@@ -203,3 +351,109 @@ void HardwareSerial::setRxInvert(bool invert)
 {
     uartSetRxInvert(_uart, invert);
 }
+
+void HardwareSerial::setRxFIFOFull(uint8_t numBytesFIFOFull)
+{
+    uartSetRxFIFOFull(_uart, numBytesFIFOFull);
+}
+
+void HardwareSerial::setRxTimeout(uint8_t numSymbTimeout)
+{
+    uartSetRxTimeout(_uart, numSymbTimeout);
+}
+
+void HardwareSerial::setInterruptCore(int8_t core)
+{
+    uartSetInterruptCore(_uart, core);
+}
+
+size_t HardwareSerial::peekFrame(uint8_t delimiter, uart_rx_view_t * view)
+{
+    size_t len = uartFindByte(_uart, delimiter, SIZE_MAX);
+    uartPeekView(_uart, view);
+    return len;
+}
+
+void HardwareSerial::consume(size_t len)
+{
+    uartConsume(_uart, len);
+}
+
+size_t HardwareSerial::readFrame(uint8_t delimiter, uint8_t *buffer, size_t size)
+{
+    uart_rx_view_t view;
+    size_t len = peekFrame(delimiter, &view);
+    if(!len) {
+        return 0;
+    }
+    size_t copy = (len - 1 < size) ? len - 1 : size;
+    copyView(&view, buffer, copy);
+    uartConsume(_uart, len);
+    return copy;
+}
+
+size_t HardwareSerial::readLengthPrefixedFrame(uint8_t *buffer, size_t size, uint8_t lengthBytes)
+{
+    if(lengthBytes < 1 || lengthBytes > 2) {
+        return 0;
+    }
+    uart_rx_view_t view;
+    size_t avail = uartPeekView(_uart, &view);
+    if(_frame_discard) {
+        // finish dropping an oversized frame before looking for the next header
+        size_t drop = (_frame_discard < avail) ? _frame_discard : avail;
+        uartConsume(_uart, drop);
+        _frame_discard -= drop;
+        if(_frame_discard) {
+            return 0;
+        }
+        avail = uartPeekView(_uart, &view);
+    }
+    if(avail < lengthBytes) {
+        return 0;
+    }
+    uint8_t header[2];
+    copyView(&view, header, lengthBytes);
+    size_t frame_len = lengthBytes + ((lengthBytes == 2) ? ((header[0] << 8) | header[1]) : header[0]);
+    if(frame_len > size) {
+        log_w("Dropping %u byte frame, buffer holds only %u", frame_len, size);
+        _frame_discard = frame_len;
+        return readLengthPrefixedFrame(buffer, size, lengthBytes);
+    }
+    if(avail < frame_len) {
+        return 0;
+    }
+    copyView(&view, buffer, frame_len);
+    uartConsume(_uart, frame_len);
+    return frame_len;
+}
+
+void HardwareSerial::onFrame(uint8_t delimiter, OnFrameCb cb, size_t maxFrameLen)
+{
+    _destroyEventTask();
+    if(maxFrameLen != _maxFrameLen) {
+        free(_frameBuffer);
+        _frameBuffer = (uint8_t *)malloc(maxFrameLen);
+        if(_frameBuffer == NULL) {
+            log_e("Could not allocate %u byte frame buffer", maxFrameLen);
+            _maxFrameLen = 0;
+            _onFrameCb = NULL;
+            return;
+        }
+        _maxFrameLen = maxFrameLen;
+    }
+    _frameDelimiter = delimiter;
+    _onFrameCb = cb;
+    _createEventTask();
+}
+
+void HardwareSerial::onReceive(OnReceiveCb cb, uint8_t timeoutSymbols)
+{
+    _destroyEventTask();
+    _onReceiveCb = cb;
+    if(timeoutSymbols) {
+        _rxTimeoutSymbols = timeoutSymbols;
+        uartSetRxTimeout(_uart, timeoutSymbols);
+    }
+    _createEventTask();
+}
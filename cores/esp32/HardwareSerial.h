@@ -46,6 +46,7 @@
 #define HardwareSerial_h
 
 #include <inttypes.h>
+#include <functional>
 
 #include "Stream.h"
 #include "esp32-hal.h"
@@ -53,7 +54,11 @@
 class HardwareSerial: public Stream
 {
 public:
+    typedef std::function<void(const uint8_t * frame, size_t len)> OnFrameCb;
+    typedef std::function<void(size_t count, int64_t timestamp_us)> OnReceiveCb;
+
     HardwareSerial(int uart_nr);
+    ~HardwareSerial();
 
     void begin(unsigned long baud, uint32_t config=SERIAL_8N1, int8_t rxPin=-1, int8_t txPin=-1, bool invert=false, unsigned long timeout_ms = 20000UL);
     void end();
@@ -61,12 +66,21 @@ public:
     int available(void);
     int availableForWrite(void);
     int peek(void);
+    // the received bytes up to where the RX buffer wraps, in place
+    size_t peekAvailable() override;
+    const uint8_t * peekBuffer() override;
+    void peekConsume(size_t len) override;
     int read(void);
     size_t read(uint8_t *buffer, size_t size);
     inline size_t read(char * buffer, size_t size)
     {
         return read((uint8_t*) buffer, size);
     }
+    size_t readBytes(uint8_t *buffer, size_t length);
+    inline size_t readBytes(char *buffer, size_t length)
+    {
+        return readBytes((uint8_t*) buffer, length);
+    }
     void flush(void);
     void flush( bool txOnly);
     size_t write(uint8_t);
@@ -99,15 +113,58 @@ public:
     operator bool() const;
 
     size_t setRxBufferSize(size_t);
+    size_t setTxBufferSize(size_t);
     void setDebugOutput(bool);
     
     void setRxInvert(bool);
 
+    // RX interrupt tuning, call after begin()
+    void setRxFIFOFull(uint8_t numBytesFIFOFull);
+    void setRxTimeout(uint8_t numSymbTimeout);
+    void setInterruptCore(int8_t core);
+
+    // Frame readers working in place on the RX buffer. The reader must be the only consumer of this port.
+    // Returns the length of the first complete frame (delimiter included) and maps it into view, 0 if there is none yet
+    size_t peekFrame(uint8_t delimiter, uart_rx_view_t * view);
+    void consume(size_t len);
+    // Copies one complete frame without its delimiter, longer frames are truncated to size
+    size_t readFrame(uint8_t delimiter, uint8_t *buffer, size_t size);
+    // Copies one frame led by a big endian payload length of lengthBytes (1 or 2), header included.
+    // Frames that do not fit into size are dropped.
+    size_t readLengthPrefixedFrame(uint8_t *buffer, size_t size, uint8_t lengthBytes = 1);
+    // Calls cb from a dedicated task for every delimited frame, without the delimiter.
+    // Frames are passed in place unless they wrap around the RX buffer, data longer than maxFrameLen is dropped.
+    void onFrame(uint8_t delimiter, OnFrameCb cb, size_t maxFrameLen = 256);
+    // Calls cb from the event task whenever the line went idle for timeoutSymbols after receiving data,
+    // with the number of bytes waiting and the esp_timer_get_time() stamp of the RX timeout interrupt.
+    // timeoutSymbols 0 keeps the current RX timeout.
+    void onReceive(OnReceiveCb cb, uint8_t timeoutSymbols = 0);
+
 protected:
     int _uart_nr;
     uart_t* _uart;
     uint8_t _tx_pin;
     uint8_t _rx_pin;
+    size_t _tx_buffer_size;
+    size_t _frame_discard;
+
+    TaskHandle_t _eventTask;
+    volatile bool _eventTaskStop;
+    OnFrameCb _onFrameCb;
+    uint8_t _frameDelimiter;
+    size_t _maxFrameLen;
+    uint8_t * _frameBuffer;
+    OnReceiveCb _onReceiveCb;
+    uint8_t _rxTimeoutSymbols;
+
+    void _createEventTask();
+    void _destroyEventTask();
+    size_t _dispatchFrames();
+    static void _uartEventTask(void *args);
+    int readAvailable(uint8_t *buffer, size_t size) override
+    {
+        return read(buffer, size);
+    }
 };
 
 extern void serialEventRun(void) __attribute__((weak));
@@ -0,0 +1,97 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <Arduino.h>
+#include "HashBuilder.h"
+
+static uint8_t hex_char_to_byte(uint8_t c)
+{
+    return  (c >= 'a' && c <= 'f') ? (c - ((uint8_t)'a' - 0xa)) :
+            (c >= 'A' && c <= 'F') ? (c - ((uint8_t)'A' - 0xA)) :
+            (c >= '0' &&  c<= '9') ? (c - (uint8_t)'0') : 0;
+}
+
+void HashBuilder::addHexString(const char * data)
+{
+    // a stack chunk at a time, no allocation
+    uint8_t tmp[32];
+    size_t len = strlen(data) / 2;
+    while(len) {
+        size_t n = (len > sizeof(tmp)) ? sizeof(tmp) : len;
+        for(size_t i = 0; i < n; i++, data += 2) {
+            tmp[i] = (hex_char_to_byte(data[0]) & 0x0F) << 4 | (hex_char_to_byte(data[1]) & 0x0F);
+        }
+        add(tmp, n);
+        len -= n;
+    }
+}
+
+bool HashBuilder::addStream(Stream & stream, const size_t maxLen)
+{
+    const int buf_size = 512;
+    size_t maxLengthLeft = maxLen;
+    uint8_t * buf = (uint8_t*) malloc(buf_size);
+
+    if(!buf) {
+        return false;
+    }
+
+    int bytesAvailable = stream.available();
+    while((bytesAvailable > 0) && (maxLengthLeft > 0)) {
+
+        // determine number of bytes to read
+        size_t readBytes = bytesAvailable;
+        if(readBytes > maxLengthLeft) {
+            readBytes = maxLengthLeft ;    // read only until max_len
+        }
+        if(readBytes > buf_size) {
+            readBytes = buf_size;    // not read more the buffer can handle
+        }
+
+        // read data and check if we got something
+        int numBytesRead = stream.readBytes(buf, readBytes);
+        if(numBytesRead< 1) {
+            free(buf);
+            return false;
+        }
+
+        add(buf, numBytesRead);
+
+        // update available number of bytes
+        maxLengthLeft -= numBytesRead;
+        bytesAvailable = stream.available();
+    }
+    free(buf);
+    return true;
+}
+
+void HashBuilder::getChars(char * output)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint8_t digest[HASH_BUILDER_MAX_SIZE];
+    size_t size = getSize();
+    getBytes(digest);
+    for(size_t i = 0; i < size; i++) {
+        *output++ = hex[digest[i] >> 4];
+        *output++ = hex[digest[i] & 0x0f];
+    }
+    *output = 0;
+}
+
+String HashBuilder::toString(void)
+{
+    char out[2 * HASH_BUILDER_MAX_SIZE + 1];
+    getChars(out);
+    return String(out);
+}
@@ -0,0 +1,63 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HASHBUILDER_H_
+#define HASHBUILDER_H_
+
+#include <WString.h>
+#include <Stream.h>
+
+#define HASH_BUILDER_MAX_SIZE 32
+
+// Common streaming interface of MD5Builder and SHA256Builder
+class HashBuilder
+{
+public:
+    virtual ~HashBuilder() {}
+
+    virtual void begin(void) = 0;
+    virtual void add(const uint8_t * data, size_t len) = 0;
+    void add(const char * data)
+    {
+        add((const uint8_t*)data, strlen(data));
+    }
+    void add(char * data)
+    {
+        add((const char*)data);
+    }
+    void add(const String & data)
+    {
+        add((const uint8_t*)data.c_str(), data.length());
+    }
+    void addHexString(const char * data);
+    void addHexString(char * data)
+    {
+        addHexString((const char*)data);
+    }
+    void addHexString(const String & data)
+    {
+        addHexString(data.c_str());
+    }
+    bool addStream(Stream & stream, const size_t maxLen);
+    virtual void calculate(void) = 0;
+
+    // digest length in bytes
+    virtual size_t getSize(void) = 0;
+    virtual void getBytes(uint8_t * output) = 0;
+    // lower case hex and a NUL, output holds 2 * getSize() + 1
+    void getChars(char * output);
+    String toString(void);
+};
+
+#endif /* HASHBUILDER_H_ */
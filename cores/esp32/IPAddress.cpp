@@ -63,35 +63,58 @@ bool IPAddress::operator==(const uint8_t* addr) const
 
 size_t IPAddress::printTo(Print& p) const
 {
-    size_t n = 0;
-    for(int i = 0; i < 3; i++) {
-        n += p.print(_address.bytes[i], DEC);
-        n += p.print('.');
-    }
-    n += p.print(_address.bytes[3], DEC);
-    return n;
+    char buf[IPADDRESS_STR_LEN];
+    size_t n = toChars(buf, sizeof(buf));
+    return p.write((const uint8_t *)buf, n);
 }
 
 String IPAddress::toString() const
 {
-    char szRet[16];
-    sprintf(szRet,"%u.%u.%u.%u", _address.bytes[0], _address.bytes[1], _address.bytes[2], _address.bytes[3]);
-    return String(szRet);
+    char buf[IPADDRESS_STR_LEN];
+    toChars(buf, sizeof(buf));
+    return String(buf);
+}
+
+size_t IPAddress::toChars(char *buf, size_t size) const
+{
+    char text[IPADDRESS_STR_LEN];
+    size_t n = 0;
+    for(int i = 0; i < 4; i++) {
+        uint8_t b = _address.bytes[i];
+        if(b >= 100) {
+            text[n++] = '0' + b / 100;
+        }
+        if(b >= 10) {
+            text[n++] = '0' + b / 10 % 10;
+        }
+        text[n++] = '0' + b % 10;
+        text[n++] = '.';
+    }
+    n--;
+    if(size) {
+        size_t copy = (n < size) ? n : size - 1;
+        memcpy(buf, text, copy);
+        buf[copy] = 0;
+    }
+    return n;
 }
 
-bool IPAddress::fromString(const char *address)
+bool IPAddress::fromString(const char *address, size_t len)
 {
     // TODO: add support for "a", "a.b", "a.b.c" formats
 
+    uint8_t bytes[4];
     uint16_t acc = 0; // Accumulator
     uint8_t dots = 0;
+    bool digits = false;
 
-    while (*address)
+    for (size_t i = 0; i < len; i++)
     {
-        char c = *address++;
+        char c = address[i];
         if (c >= '0' && c <= '9')
         {
             acc = acc * 10 + (c - '0');
+            digits = true;
             if (acc > 255) {
                 // Value out of [0..255] range
                 return false;
@@ -99,12 +122,13 @@ bool IPAddress::fromString(const char *address)
         }
         else if (c == '.')
         {
-            if (dots == 3) {
-                // Too much dots (there must be 3 dots)
+            if (dots == 3 || !digits) {
+                // Too much dots (there must be 3 dots), or an empty octet
                 return false;
             }
-            _address.bytes[dots++] = acc;
+            bytes[dots++] = acc;
             acc = 0;
+            digits = false;
         }
         else
         {
@@ -113,10 +137,11 @@ bool IPAddress::fromString(const char *address)
         }
     }
 
-    if (dots != 3) {
+    if (dots != 3 || !digits) {
         // Too few dots (there must be 3 dots)
         return false;
     }
-    _address.bytes[3] = acc;
+    bytes[3] = acc;
+    memcpy(_address.bytes, bytes, sizeof(bytes));
     return true;
 }
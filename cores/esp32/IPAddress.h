@@ -21,9 +21,12 @@
 #define IPAddress_h
 
 #include <stdint.h>
+#include <string.h>
 #include <WString.h>
 #include <Printable.h>
 
+#define IPADDRESS_STR_LEN 16 // "255.255.255.255" and its terminator
+
 // A class to make it easier to handle and pass around IP addresses
 
 class IPAddress: public Printable
@@ -51,8 +54,10 @@ public:
     IPAddress(const uint8_t *address);
     virtual ~IPAddress() {}
 
-    bool fromString(const char *address);
-    bool fromString(const String &address) { return fromString(address.c_str()); }
+    bool fromString(const char *address) { return fromString(address, strlen(address)); }
+    bool fromString(const String &address) { return fromString(address.c_str(), address.length()); }
+    // the first len characters, a buffer needs no terminator
+    bool fromString(const char *address, size_t len);
 
     // Overloaded cast operator to allow IPAddress objects to be used where a pointer
     // to a four-byte uint8_t array is expected
@@ -82,6 +87,8 @@ public:
 
     virtual size_t printTo(Print& p) const;
     String toString() const;
+    // the dotted form into buf, terminated and cut to size; returns its full length as snprintf() does
+    size_t toChars(char *buf, size_t size) const;
 
     friend class EthernetClass;
     friend class UDP;
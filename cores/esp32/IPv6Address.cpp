@@ -44,42 +44,128 @@ bool IPv6Address::operator==(const uint8_t* addr) const
 
 size_t IPv6Address::printTo(Print& p) const
 {
+    char buf[IPV6ADDRESS_STR_LEN];
+    size_t n = toChars(buf, sizeof(buf));
+    return p.write((const uint8_t *)buf, n);
+}
+
+String IPv6Address::toString() const
+{
+    char buf[IPV6ADDRESS_STR_LEN];
+    toChars(buf, sizeof(buf));
+    return String(buf);
+}
+
+size_t IPv6Address::toChars(char *buf, size_t size) const
+{
+    static const char hex[] = "0123456789abcdef";
+    char text[IPV6ADDRESS_STR_LEN];
     size_t n = 0;
-    for(int i = 0; i < 16; i+=2) {
-        if(i){
-            n += p.print(':');
+    for(int i = 0; i < 16; i++) {
+        if(i && !(i & 1)) {
+            text[n++] = ':';
         }
-        n += p.printf("%02x", _address.bytes[i]);
-        n += p.printf("%02x", _address.bytes[i+1]);
-
+        text[n++] = hex[_address.bytes[i] >> 4];
+        text[n++] = hex[_address.bytes[i] & 0x0f];
+    }
+    if(size) {
+        size_t copy = (n < size) ? n : size - 1;
+        memcpy(buf, text, copy);
+        buf[copy] = 0;
     }
     return n;
 }
 
-String IPv6Address::toString() const
+static int hexValue(char c)
 {
-    char szRet[40];
-    sprintf(szRet,"%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x",
-            _address.bytes[0], _address.bytes[1], _address.bytes[2], _address.bytes[3],
-            _address.bytes[4], _address.bytes[5], _address.bytes[6], _address.bytes[7],
-            _address.bytes[8], _address.bytes[9], _address.bytes[10], _address.bytes[11],
-            _address.bytes[12], _address.bytes[13], _address.bytes[14], _address.bytes[15]);
-    return String(szRet);
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
 }
 
-bool IPv6Address::fromString(const char *address)
+bool IPv6Address::fromString(const char *address, size_t len)
 {
-    //format 0011:2233:4455:6677:8899:aabb:ccdd:eeff
-    if(strlen(address) != 39){
-        return false;
-    }
-    char * pos = (char *)address;
+    uint16_t groups[8];
+    int count = 0;
+    int gap = -1;           // group the :: stands before
     size_t i = 0;
-    for(i = 0; i < 16; i+=2) {
-        if(!sscanf(pos, "%2hhx", &_address.bytes[i]) || !sscanf(pos+2, "%2hhx", &_address.bytes[i+1])){
+    if(len >= 2 && address[0] == ':' && address[1] == ':') {
+        gap = 0;
+        i = 2;
+    }
+    while(i < len) {
+        if(count == 8) {
+            return false;
+        }
+        size_t end = i;
+        uint32_t value = 0;
+        int digit;
+        while(end < len && (digit = hexValue(address[end])) >= 0) {
+            value = (value << 4) | digit;
+            end++;
+        }
+        if(end < len && address[end] == '.') {
+            // a dotted IPv4 address ends it, in place of two groups
+            IPAddress v4;
+            if(count > 6 || !v4.fromString(address + i, len - i)) {
+                return false;
+            }
+            groups[count++] = (v4[0] << 8) | v4[1];
+            groups[count++] = (v4[2] << 8) | v4[3];
+            break;
+        }
+        if(end == i || end - i > 4) {
             return false;
         }
-        pos += 5;
+        groups[count++] = value;
+        i = end;
+        if(i == len) {
+            break;
+        }
+        if(address[i++] != ':' || i == len) {
+            return false;
+        }
+        if(address[i] == ':') {
+            if(gap >= 0) {
+                return false;
+            }
+            gap = count;
+            i++;
+        }
+    }
+    if(gap < 0 ? count != 8 : count > 7) {
+        return false;
+    }
+    // the groups after the :: go to the end
+    memset(_address.bytes, 0, sizeof(_address.bytes));
+    int tail = (gap < 0) ? 0 : count - gap;
+    for(int g = 0; g < count; g++) {
+        int at = (g < count - tail) ? g : 8 - (count - g);
+        _address.bytes[at * 2] = groups[g] >> 8;
+        _address.bytes[at * 2 + 1] = groups[g] & 0xff;
     }
     return true;
 }
+
+IPv6Address::IPv6Address(const IPAddress &address)
+{
+    memset(_address.bytes, 0, 10);
+    _address.bytes[10] = 0xff;
+    _address.bytes[11] = 0xff;
+    for(int i = 0; i < 4; i++) {
+        _address.bytes[12 + i] = address[i];
+    }
+}
+
+bool IPv6Address::isV4Mapped() const
+{
+    return !_address.dword[0] && !_address.dword[1] && _address.bytes[8] == 0 && _address.bytes[9] == 0
+        && _address.bytes[10] == 0xff && _address.bytes[11] == 0xff;
+}
+
+IPAddress IPv6Address::toV4() const
+{
+    return isV4Mapped() ? IPAddress(&_address.bytes[12]) : IPAddress();
+}
@@ -16,8 +16,12 @@
 #define IPv6Address_h
 
 #include <stdint.h>
+#include <string.h>
 #include <WString.h>
 #include <Printable.h>
+#include <IPAddress.h>
+
+#define IPV6ADDRESS_STR_LEN 40 // eight groups of four digits, the colons and the terminator
 
 // A class to make it easier to handle and pass around IP addresses
 
@@ -25,7 +29,7 @@ class IPv6Address: public Printable
 {
 private:
     union {
-        uint8_t bytes[16];  // IPv4 address
+        uint8_t bytes[16];  // IPv6 address
         uint32_t dword[4];
     } _address;
 
@@ -43,10 +47,18 @@ public:
     IPv6Address();
     IPv6Address(const uint8_t *address);
     IPv6Address(const uint32_t *address);
+    // ::ffff:a.b.c.d, the form a socket of both families gives an IPv4 peer
+    explicit IPv6Address(const IPAddress &address);
     virtual ~IPv6Address() {}
 
-    bool fromString(const char *address);
-    bool fromString(const String &address) { return fromString(address.c_str()); }
+    // the full and the compressed form ("fe80::1"), with a dotted IPv4 tail or not
+    bool fromString(const char *address) { return fromString(address, strlen(address)); }
+    bool fromString(const String &address) { return fromString(address.c_str(), address.length()); }
+    bool fromString(const char *address, size_t len);
+
+    bool isV4Mapped() const;
+    // the IPv4 address of a mapped one, 0.0.0.0 for the others
+    IPAddress toV4() const;
 
     operator const uint8_t*() const
     {
@@ -80,6 +92,8 @@ public:
 
     virtual size_t printTo(Print& p) const;
     String toString() const;
+    // the full form into buf, terminated and cut to size; returns its full length as snprintf() does
+    size_t toChars(char *buf, size_t size) const;
 
     friend class UDP;
     friend class Client;
@@ -0,0 +1,267 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LOCKFREEQUEUE_H_
+#define LOCKFREEQUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <new>
+#include "esp_attr.h"
+
+/*
+ * Queues without a lock for the hot paths between one task or interrupt and
+ * another. Nothing blocks: a full queue refuses, an empty one returns nothing,
+ * a consumer that has to sleep pairs the queue with a notification.
+ *
+ * SpscRing<T, N> is for one producer and one consumer, on either core or in an
+ * interrupt, N a power of two; with N of 0 the size is given to begin(). The
+ * bulk push()/pop() copy all they can in one pass. The *FromISR() calls are the
+ * same kept in IRAM, for interrupts that run while the flash cache is off.
+ *
+ * MpscQueue<T> takes any number of producers, tasks and interrupts alike, and
+ * one consumer. A producer interrupted between taking its slot and filling it
+ * holds up the ones after it until it is done, pop() returns false meanwhile.
+ * T has to be cheap to copy for both, items are copied in and out of the slots.
+ */
+template<typename T, size_t N>
+struct SpscRingStorage {
+    static_assert((N & (N - 1)) == 0, "SpscRing size has to be a power of two");
+    T data[N];
+    T * alloc(size_t) { return data; }
+    void release(T *) {}
+};
+
+template<typename T>
+struct SpscRingStorage<T, 0> {
+    T * alloc(size_t size) { return new (std::nothrow) T[size]; }
+    void release(T * buf) { delete[] buf; }
+};
+
+template<typename T, size_t N = 0>
+class SpscRing
+{
+public:
+    SpscRing() : _buf(NULL), _mask(0), _head(0), _tail(0)
+    {
+        if(N) {
+            _buf = _storage.alloc(N);
+            _mask = N - 1;
+        }
+    }
+    ~SpscRing() { end(); }
+    SpscRing(const SpscRing &) = delete;
+    SpscRing & operator=(const SpscRing &) = delete;
+
+    // for N of 0, size rounded up to a power of two
+    bool begin(size_t size)
+    {
+        if(N) {
+            return true;
+        }
+        end();
+        size_t cells = 1;
+        while(cells < size) {
+            cells <<= 1;
+        }
+        _buf = _storage.alloc(cells);
+        if(!_buf) {
+            return false;
+        }
+        _mask = cells - 1;
+        _head.store(0);
+        _tail.store(0);
+        return true;
+    }
+
+    void end()
+    {
+        if(!N && _buf) {
+            _storage.release(_buf);
+            _buf = NULL;
+            _mask = 0;
+        }
+    }
+
+    size_t capacity() const { return _buf ? _mask + 1 : 0; }
+    size_t available() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    size_t space() const { return capacity() - available(); }
+
+    // producer
+    bool push(const T & item) { return _push(&item, 1) == 1; }
+    size_t push(const T * items, size_t count) { return _push(items, count); }
+    bool IRAM_ATTR pushFromISR(const T & item) { return _push(&item, 1) == 1; }
+    size_t IRAM_ATTR pushFromISR(const T * items, size_t count) { return _push(items, count); }
+
+    // consumer
+    bool pop(T & item) { return _pop(&item, 1) == 1; }
+    size_t pop(T * items, size_t count) { return _pop(items, count); }
+    bool IRAM_ATTR popFromISR(T & item) { return _pop(&item, 1) == 1; }
+    size_t IRAM_ATTR popFromISR(T * items, size_t count) { return _pop(items, count); }
+
+    bool peek(T & item) const
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if(!_buf || _head.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        item = _buf[tail & _mask];
+        return true;
+    }
+
+    // consumer only, drops what is in it
+    void clear() { _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release); }
+
+private:
+    SpscRingStorage<T, N> _storage;
+    T * _buf;
+    uint32_t _mask;
+    std::atomic<uint32_t> _head;    // written by the producer only
+    std::atomic<uint32_t> _tail;    // written by the consumer only
+
+    inline __attribute__((always_inline)) size_t _push(const T * items, size_t count)
+    {
+        if(!_buf) {
+            return 0;
+        }
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        size_t space = _mask + 1 - (head - _tail.load(std::memory_order_acquire));
+        if(count > space) {
+            count = space;
+        }
+        for(size_t i = 0; i < count; i++) {
+            _buf[(head + i) & _mask] = items[i];
+        }
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    inline __attribute__((always_inline)) size_t _pop(T * items, size_t count)
+    {
+        if(!_buf) {
+            return 0;
+        }
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        size_t used = _head.load(std::memory_order_acquire) - tail;
+        if(count > used) {
+            count = used;
+        }
+        for(size_t i = 0; i < count; i++) {
+            items[i] = _buf[(tail + i) & _mask];
+        }
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+};
+
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : _cells(NULL), _mask(0), _head(0), _tail(0) {}
+    explicit MpscQueue(size_t size) : MpscQueue() { begin(size); }
+    ~MpscQueue() { end(); }
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue & operator=(const MpscQueue &) = delete;
+
+    // rounded up to a power of two
+    bool begin(size_t size)
+    {
+        end();
+        size_t cells = 1;
+        while(cells < size) {
+            cells <<= 1;
+        }
+        _cells = new (std::nothrow) Cell[cells];
+        if(!_cells) {
+            return false;
+        }
+        for(size_t i = 0; i < cells; i++) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        _mask = cells - 1;
+        _head.store(0);
+        _tail = 0;
+        return true;
+    }
+
+    void end()
+    {
+        delete[] _cells;
+        _cells = NULL;
+        _mask = 0;
+    }
+
+    size_t capacity() const { return _cells ? _mask + 1 : 0; }
+    size_t available() const { return _head.load(std::memory_order_acquire) - _tail; }
+
+    // any task or interrupt
+    bool push(const T & item) { return _push(item); }
+    bool IRAM_ATTR pushFromISR(const T & item) { return _push(item); }
+
+    // the one consumer
+    bool pop(T & item)
+    {
+        if(!_cells) {
+            return false;
+        }
+        Cell & cell = _cells[_tail & _mask];
+        if(cell.seq.load(std::memory_order_acquire) != _tail + 1) {
+            return false;
+        }
+        item = cell.item;
+        cell.seq.store(_tail + _mask + 1, std::memory_order_release);
+        _tail++;
+        return true;
+    }
+
+private:
+    // free for position pos when seq is pos, filled when it is pos + 1
+    struct Cell {
+        std::atomic<uint32_t> seq;
+        T item;
+    };
+    Cell * _cells;
+    uint32_t _mask;
+    std::atomic<uint32_t> _head;
+    uint32_t _tail;
+
+    inline __attribute__((always_inline)) bool _push(const T & item)
+    {
+        if(!_cells) {
+            return false;
+        }
+        Cell * cell;
+        uint32_t pos = _head.load(std::memory_order_relaxed);
+        for(;;) {
+            cell = &_cells[pos & _mask];
+            int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+            if(diff == 0) {
+                if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif /* LOCKFREEQUEUE_H_ */
@@ -25,6 +25,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <wchar.h>
 #include "Arduino.h"
 
 #include "Print.h"
@@ -35,7 +38,7 @@ extern "C" {
 // Public Methods //////////////////////////////////////////////////////////////
 
 /* default implementation: may be overridden */
-size_t Print::write(const uint8_t *buffer, size_t size)
+size_t ARDUINO_HOT Print::write(const uint8_t *buffer, size_t size)
 {
     size_t n = 0;
     while(size--) {
@@ -44,33 +47,328 @@ size_t Print::write(const uint8_t *buffer, size_t size)
     return n;
 }
 
+#ifndef PRINTF_CHUNK_SIZE
+#define PRINTF_CHUNK_SIZE 64
+#endif
+
+#ifndef PRINTF_FIELD_SIZE
+#define PRINTF_FIELD_SIZE 48
+#endif
+
+// Collects the formatted text and hands it to write() one chunk at a time
+class PrintfSink
+{
+public:
+    explicit PrintfSink(Print *out) : _out(out), _len(0), _count(0), _written(0) {}
+
+    void put(const char *s, size_t n)
+    {
+        _count += n;
+        while(n) {
+            if(!_len && n >= sizeof(_buf)) {
+                _written += _out->write((const uint8_t *) s, n);
+                return;
+            }
+            size_t c = sizeof(_buf) - _len;
+            if(c > n) {
+                c = n;
+            }
+            memcpy(_buf + _len, s, c);
+            _len += c;
+            s += c;
+            n -= c;
+            if(_len == sizeof(_buf)) {
+                flush();
+            }
+        }
+    }
+
+    void pad(char c, size_t n)
+    {
+        _count += n;
+        while(n) {
+            size_t l = sizeof(_buf) - _len;
+            if(l > n) {
+                l = n;
+            }
+            memset(_buf + _len, c, l);
+            _len += l;
+            n -= l;
+            if(_len == sizeof(_buf)) {
+                flush();
+            }
+        }
+    }
+
+    // one converted field, padded to width; zero pads after the sign and 0x
+    void field(const char *s, size_t n, int width, bool left, bool zero)
+    {
+        size_t fill = (width > 0 && (size_t) width > n) ? width - n : 0;
+        if(!fill) {
+            put(s, n);
+        } else if(left) {
+            put(s, n);
+            pad(' ', fill);
+        } else if(zero) {
+            size_t prefix = (n && strchr("+- ", s[0])) ? 1 : 0;
+            if(n >= prefix + 2 && s[prefix] == '0' && (s[prefix + 1] == 'x' || s[prefix + 1] == 'X')) {
+                prefix += 2;
+            }
+            if(prefix < n && strchr("iInN", s[prefix])) {
+                // inf and nan are never zero padded
+                pad(' ', fill);
+                put(s, n);
+                return;
+            }
+            put(s, prefix);
+            pad('0', fill);
+            put(s + prefix, n - prefix);
+        } else {
+            pad(' ', fill);
+            put(s, n);
+        }
+    }
+
+    void flush()
+    {
+        if(_len) {
+            _written += _out->write((const uint8_t *) _buf, _len);
+            _len = 0;
+        }
+    }
+
+    size_t count() const { return _count; }
+    size_t written() const { return _written; }
+
+private:
+    Print *_out;
+    char _buf[PRINTF_CHUNK_SIZE];
+    size_t _len;
+    size_t _count;
+    size_t _written;
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+// Width is applied by the sink, so a field only grows past the stack buffer
+// for a huge precision or float; that rare case formats into the heap
+template<typename T>
+static void printfValue(PrintfSink &out, const char *spec, T value, int width, bool left, bool zero)
+{
+    char tmp[PRINTF_FIELD_SIZE];
+    int n = snprintf(tmp, sizeof(tmp), spec, value);
+    if(n < 0) {
+        return;
+    }
+    char *s = tmp;
+    if((size_t) n >= sizeof(tmp)) {
+        s = (char *) malloc(n + 1);
+        if(!s) {
+            return;
+        }
+        snprintf(s, n + 1, spec, value);
+    }
+    out.field(s, n, width, left, zero);
+    if(s != tmp) {
+        free(s);
+    }
+}
+#pragma GCC diagnostic pop
+
+size_t Print::vprintf(const char *format, va_list arg)
+{
+    PrintfSink out(this);
+    const char *p = format;
+    while(*p) {
+        const char *pct = strchr(p, '%');
+        if(!pct) {
+            out.put(p, strlen(p));
+            break;
+        }
+        out.put(p, pct - p);
+        p = pct + 1;
+        if(*p == '%') {
+            out.put(p++, 1);
+            continue;
+        }
+
+        // rebuild the conversion without its width, with * resolved
+        char spec[24];
+        size_t sl = 0;
+        spec[sl++] = '%';
+        bool left = false;
+        bool zero = false;
+        while(*p && strchr("-+ #0", *p)) {
+            if(*p == '-') {
+                left = true;
+            } else if(*p == '0') {
+                zero = true;
+            } else if(sl < 6) {
+                spec[sl++] = *p;
+            }
+            p++;
+        }
+        int width = 0;
+        if(*p == '*') {
+            width = va_arg(arg, int);
+            if(width < 0) {
+                left = true;
+                width = -width;
+            }
+            p++;
+        } else {
+            while(isdigit((unsigned char) *p)) {
+                width = width * 10 + (*p++ - '0');
+            }
+        }
+        int prec = -1;
+        if(*p == '.') {
+            p++;
+            prec = 0;
+            if(*p == '*') {
+                prec = va_arg(arg, int);
+                p++;
+            } else {
+                while(isdigit((unsigned char) *p)) {
+                    prec = prec * 10 + (*p++ - '0');
+                }
+            }
+        }
+        if(prec >= 0) {
+            sl += snprintf(spec + sl, 12, ".%d", prec);
+        }
+        char len1 = 0;
+        char len2 = 0;
+        if(*p == 'h' || *p == 'l') {
+            len1 = *p++;
+            if(*p == len1) {
+                len2 = *p++;
+            }
+        } else if(*p && strchr("zjtL", *p)) {
+            len1 = *p++;
+        }
+        if(len1) {
+            spec[sl++] = len1;
+        }
+        if(len2) {
+            spec[sl++] = len2;
+        }
+        char conv = *p;
+        if(!conv) {
+            break;
+        }
+        p++;
+        spec[sl++] = conv;
+        spec[sl] = 0;
+
+        switch(conv) {
+        case 's':
+            if(len1 == 'l') {
+                printfValue(out, spec, va_arg(arg, const wchar_t *), width, left, false);
+            } else {
+                // streamed as is, however long
+                const char *s = va_arg(arg, const char *);
+                if(!s) {
+                    s = "(null)";
+                }
+                size_t n = (prec >= 0) ? strnlen(s, prec) : strlen(s);
+                out.field(s, n, width, left, false);
+            }
+            break;
+        case 'c':
+            if(len1 == 'l') {
+                printfValue(out, spec, va_arg(arg, wint_t), width, left, false);
+            } else {
+                char c = (char) va_arg(arg, int);
+                out.field(&c, 1, width, left, false);
+            }
+            break;
+        case 'd':
+        case 'i':
+            zero = zero && prec < 0;
+            if(len1 == 'l' && len2) {
+                printfValue(out, spec, va_arg(arg, long long), width, left, zero);
+            } else if(len1 == 'l') {
+                printfValue(out, spec, va_arg(arg, long), width, left, zero);
+            } else if(len1 == 'z') {
+                printfValue(out, spec, va_arg(arg, ssize_t), width, left, zero);
+            } else if(len1 == 'j') {
+                printfValue(out, spec, va_arg(arg, intmax_t), width, left, zero);
+            } else if(len1 == 't') {
+                printfValue(out, spec, va_arg(arg, ptrdiff_t), width, left, zero);
+            } else {
+                printfValue(out, spec, va_arg(arg, int), width, left, zero);
+            }
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            zero = zero && prec < 0;
+            if(len1 == 'l' && len2) {
+                printfValue(out, spec, va_arg(arg, unsigned long long), width, left, zero);
+            } else if(len1 == 'l') {
+                printfValue(out, spec, va_arg(arg, unsigned long), width, left, zero);
+            } else if(len1 == 'z') {
+                printfValue(out, spec, va_arg(arg, size_t), width, left, zero);
+            } else if(len1 == 'j') {
+                printfValue(out, spec, va_arg(arg, uintmax_t), width, left, zero);
+            } else if(len1 == 't') {
+                printfValue(out, spec, va_arg(arg, ptrdiff_t), width, left, zero);
+            } else {
+                printfValue(out, spec, va_arg(arg, unsigned int), width, left, zero);
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if(len1 == 'L') {
+                printfValue(out, spec, va_arg(arg, long double), width, left, zero);
+            } else {
+                printfValue(out, spec, va_arg(arg, double), width, left, zero);
+            }
+            break;
+        case 'p':
+            printfValue(out, spec, va_arg(arg, void *), width, left, false);
+            break;
+        case 'n': {
+            size_t count = out.count();
+            if(len1 == 'h' && len2) {
+                *va_arg(arg, signed char *) = count;
+            } else if(len1 == 'h') {
+                *va_arg(arg, short *) = count;
+            } else if(len1 == 'l' && len2) {
+                *va_arg(arg, long long *) = count;
+            } else if(len1 == 'l') {
+                *va_arg(arg, long *) = count;
+            } else if(len1 == 'z') {
+                *va_arg(arg, size_t *) = count;
+            } else {
+                *va_arg(arg, int *) = count;
+            }
+            break;
+        }
+        default:
+            // not a conversion we know, print it as written
+            out.put(pct, p - pct);
+            break;
+        }
+    }
+    out.flush();
+    return out.written();
+}
+
 size_t Print::printf(const char *format, ...)
 {
-    char loc_buf[64];
-    char * temp = loc_buf;
     va_list arg;
-    va_list copy;
     va_start(arg, format);
-    va_copy(copy, arg);
-    int len = vsnprintf(temp, sizeof(loc_buf), format, copy);
-    va_end(copy);
-    if(len < 0) {
-        va_end(arg);
-        return 0;
-    };
-    if(len >= sizeof(loc_buf)){
-        temp = (char*) malloc(len+1);
-        if(temp == NULL) {
-            va_end(arg);
-            return 0;
-        }
-        len = vsnprintf(temp, len+1, format, arg);
-    }
+    size_t len = vprintf(format, arg);
     va_end(arg);
-    len = write((uint8_t*)temp, len);
-    if(temp != loc_buf){
-        free(temp);
-    }
     return len;
 }
 
@@ -111,12 +409,13 @@ size_t Print::print(unsigned int n, int base)
 
 size_t Print::print(long n, int base)
 {
-    int t = 0;
     if (base == 10 && n < 0) {
-        t = print('-');
-        n = -n;
+        // sign and digits in one write
+        char buf[2 + 3 * sizeof(long)];
+        buf[0] = '-';
+        return write(buf, 1 + u64toa(-static_cast<unsigned long>(n), buf + 1));
     }
-    return printNumber(static_cast<unsigned long>(n), base) + t;
+    return printNumber(static_cast<unsigned long>(n), base);
 }
 
 size_t Print::print(unsigned long n, int base)
@@ -130,12 +429,12 @@ size_t Print::print(unsigned long n, int base)
 
 size_t Print::print(long long n, int base)
 {
-    int t = 0;
     if (base == 10 && n < 0) {
-        t = print('-');
-        n = -n;
+        char buf[2 + 3 * sizeof(long long)];
+        buf[0] = '-';
+        return write(buf, 1 + u64toa(-static_cast<unsigned long long>(n), buf + 1));
     }
-    return printNumber(static_cast<unsigned long long>(n), base) + t;
+    return printNumber(static_cast<unsigned long long>(n), base);
 }
 
 size_t Print::print(unsigned long long n, int base)
@@ -149,6 +448,10 @@ size_t Print::print(unsigned long long n, int base)
 
 size_t Print::print(double n, int digits)
 {
+    if(digits < 0) {
+        char buf[16];
+        return write(buf, ftostr(n, buf));
+    }
     return printFloat(n, digits);
 }
 
@@ -278,6 +581,11 @@ size_t Print::println(struct tm * timeinfo, const char * format)
 
 size_t Print::printNumber(unsigned long n, uint8_t base)
 {
+    if(base == 10) {
+        char buf[1 + 3 * sizeof(n)];
+        return write(buf, u64toa(n, buf));
+    }
+
     char buf[8 * sizeof(n) + 1]; // Assumes 8-bit chars plus zero byte.
     char *str = &buf[sizeof(buf) - 1];
 
@@ -300,6 +608,11 @@ size_t Print::printNumber(unsigned long n, uint8_t base)
 
 size_t Print::printNumber(unsigned long long n, uint8_t base)
 {
+    if(base == 10) {
+        char buf[1 + 3 * sizeof(n)];
+        return write(buf, u64toa(n, buf));
+    }
+
     char buf[8 * sizeof(n) + 1]; // Assumes 8-bit chars plus zero byte.
     char* str = &buf[sizeof(buf) - 1];
 
@@ -338,6 +651,13 @@ size_t Print::printFloat(double number, uint8_t digits)
         return print("ovf");    // constant determined empirically
     }
 
+    if(digits < 10) {
+        // the whole number in one write
+        char buf[24];
+        dtostrf(number, 0, digits, buf);
+        return write(buf, strlen(buf));
+    }
+
     // Handle negative numbers
     if(number < 0.0) {
         n += print('-');
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
 
 #include "WString.h"
 #include "Printable.h"
@@ -72,7 +73,9 @@ public:
         return write((const uint8_t *) buffer, size);
     }
 
+    // formats in small chunks straight to write(), without a heap buffer
     size_t printf(const char * format, ...)  __attribute__ ((format (printf, 2, 3)));
+    size_t vprintf(const char * format, va_list arg)  __attribute__ ((format (printf, 2, 0)));
 
     // add availableForWrite to make compatible with Arduino Print.h
     // default to zero, meaning "a single write may block"
@@ -0,0 +1,59 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <Arduino.h>
+#include "SHA256Builder.h"
+#include "hwcrypto/sha.h"
+
+SHA256Builder::SHA256Builder()
+{
+    memset(_buf, 0x00, sizeof(_buf));
+    mbedtls_sha256_init(&_ctx);
+}
+
+SHA256Builder::~SHA256Builder()
+{
+    mbedtls_sha256_free(&_ctx);
+}
+
+void SHA256Builder::begin(void)
+{
+    // also gives back the engine if the last run was never calculated
+    mbedtls_sha256_free(&_ctx);
+    mbedtls_sha256_init(&_ctx);
+    memset(_buf, 0x00, sizeof(_buf));
+    mbedtls_sha256_starts_ret(&_ctx, 0);
+}
+
+void SHA256Builder::add(const uint8_t * data, size_t len)
+{
+    mbedtls_sha256_update_ret(&_ctx, data, len);
+}
+
+void SHA256Builder::calculate(void)
+{
+    mbedtls_sha256_finish_ret(&_ctx, _buf);
+    mbedtls_sha256_free(&_ctx);
+    mbedtls_sha256_init(&_ctx);
+}
+
+void SHA256Builder::getBytes(uint8_t * output)
+{
+    memcpy(output, _buf, sizeof(_buf));
+}
+
+void SHA256Builder::hash(const uint8_t * data, size_t len, uint8_t * output)
+{
+    esp_sha(SHA2_256, data, len, output);
+}
@@ -0,0 +1,50 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHA256BUILDER_H_
+#define SHA256BUILDER_H_
+
+#include "HashBuilder.h"
+#include "mbedtls/sha256.h"
+
+/*
+ * Streaming uses mbedtls, which runs on the SHA engine when the SDK is built
+ * with CONFIG_MBEDTLS_HARDWARE_SHA (software otherwise). hash() always uses
+ * the engine, waiting for it while a TLS session holds it.
+ */
+class SHA256Builder : public HashBuilder
+{
+private:
+    mbedtls_sha256_context _ctx;
+    uint8_t _buf[32];
+public:
+    SHA256Builder();
+    ~SHA256Builder();
+    SHA256Builder(const SHA256Builder &) = delete;
+    SHA256Builder & operator=(const SHA256Builder &) = delete;
+
+    void begin(void) override;
+    using HashBuilder::add;
+    void add(const uint8_t * data, size_t len) override;
+    void calculate(void) override;
+    size_t getSize(void) override
+    {
+        return sizeof(_buf);
+    }
+    void getBytes(uint8_t * output) override;
+
+    static void hash(const uint8_t * data, size_t len, uint8_t * output);
+};
+
+#endif /* SHA256BUILDER_H_ */
@@ -26,6 +26,7 @@
 
 #define PARSE_TIMEOUT 1000  // default number of milli-seconds to wait
 #define NO_SKIP_CHAR  1  // a magic char not found in a valid ASCII numeric field
+#define FIND_SKIP_TARGETS 4 // findMulti() skips ahead with memchr() for up to this many targets
 
 // private method to read stream with timeout
 int Stream::timedRead()
@@ -61,6 +62,21 @@ int Stream::peekNextDigit()
 {
     int c;
     while(1) {
+        // what is buffered is skipped in one go
+        size_t avail = peekAvailable();
+        const char *buf = avail ? (const char *) peekBuffer() : NULL;
+        if(buf) {
+            size_t i = 0;
+            while(i < avail && buf[i] != '-' && (buf[i] < '0' || buf[i] > '9')) {
+                i++;
+            }
+            c = (i < avail) ? (uint8_t) buf[i] : -1;
+            peekConsume(i);
+            if(c >= 0) {
+                return c;
+            }
+            continue;
+        }
         c = timedPeek();
         if(c < 0) {
             return c;    // timeout
@@ -75,6 +91,25 @@ int Stream::peekNextDigit()
     }
 }
 
+// length of the number at the start of buf when all of it is there and it
+// reads the same with parseIntBuffer()/parseFloatBuffer(), else 0
+static size_t bufferedNumberLength(const char *buf, size_t avail, char skipChar, bool fraction)
+{
+    size_t i = (buf[0] == '-') ? 1 : 0;
+    bool point = false;
+    for(; i < avail; i++) {
+        if(fraction && buf[i] == '.' && !point) {
+            point = true;
+        } else if(buf[i] < '0' || buf[i] > '9') {
+            break;
+        }
+    }
+    if(i == avail || buf[i] == skipChar || (fraction && buf[i] == '.')) {
+        return 0;
+    }
+    return i;
+}
+
 // Public Methods
 //////////////////////////////////////////////////////////////
 
@@ -128,59 +163,104 @@ int Stream::findMulti( struct Stream::MultiTarget *targets, int tCount) {
   }
 
   while (1) {
+    size_t avail = peekAvailable();
+    const char *buf = avail ? (const char *) peekBuffer() : NULL;
+    if (buf) {
+      // where the first character of each target is next, SIZE_MAX while not searched
+      size_t starts[FIND_SKIP_TARGETS];
+      for (int i = 0; i < FIND_SKIP_TARGETS; i++) {
+        starts[i] = SIZE_MAX;
+      }
+      size_t used = 0;
+      int found = -1;
+      while (used < avail && found < 0) {
+        // while no target is part way, skip to the next character that could start one
+        bool partial = tCount > FIND_SKIP_TARGETS;
+        for (struct MultiTarget *t = targets; t < targets+tCount && !partial; ++t) {
+          partial = t->index != 0;
+        }
+        if (!partial) {
+          size_t next = avail;
+          for (int i = 0; i < tCount; i++) {
+            if (starts[i] == SIZE_MAX || starts[i] < used) {
+              const char *p = (const char *) memchr(buf + used, targets[i].str[0], avail - used);
+              starts[i] = p ? p - buf : avail;
+            }
+            if (starts[i] < next) {
+              next = starts[i];
+            }
+          }
+          used = next;
+          if (used == avail)
+            break;
+        }
+        found = findMultiStep(targets, tCount, buf[used++]);
+      }
+      peekConsume(used);
+      if (found >= 0)
+        return found;
+      continue;
+    }
+
     int c = timedRead();
     if (c < 0)
       return -1;
+    int found = findMultiStep(targets, tCount, c);
+    if (found >= 0)
+      return found;
+  }
+  // unreachable
+  return -1;
+}
 
-    for (struct MultiTarget *t = targets; t < targets+tCount; ++t) {
-      // the simple case is if we match, deal with that first.
-      if (c == t->str[t->index]) {
-        if (++t->index == t->len)
-          return t - targets;
-        else
-          continue;
-      }
-
-      // if not we need to walk back and see if we could have matched further
-      // down the stream (ie '1112' doesn't match the first position in '11112'
-      // but it will match the second position so we can't just reset the current
-      // index to 0 when we find a mismatch.
-      if (t->index == 0)
+int Stream::findMultiStep( struct Stream::MultiTarget *targets, int tCount, char c) {
+  for (struct MultiTarget *t = targets; t < targets+tCount; ++t) {
+    // the simple case is if we match, deal with that first.
+    if (c == t->str[t->index]) {
+      if (++t->index == t->len)
+        return t - targets;
+      else
         continue;
+    }
 
-      int origIndex = t->index;
-      do {
-        --t->index;
-        // first check if current char works against the new current index
-        if (c != t->str[t->index])
-          continue;
+    // if not we need to walk back and see if we could have matched further
+    // down the stream (ie '1112' doesn't match the first position in '11112'
+    // but it will match the second position so we can't just reset the current
+    // index to 0 when we find a mismatch.
+    if (t->index == 0)
+      continue;
 
-        // if it's the only char then we're good, nothing more to check
-        if (t->index == 0) {
-          t->index++;
-          break;
-        }
+    int origIndex = t->index;
+    do {
+      --t->index;
+      // first check if current char works against the new current index
+      if (c != t->str[t->index])
+        continue;
 
-        // otherwise we need to check the rest of the found string
-        int diff = origIndex - t->index;
-        size_t i;
-        for (i = 0; i < t->index; ++i) {
-          if (t->str[i] != t->str[i + diff])
-            break;
-        }
+      // if it's the only char then we're good, nothing more to check
+      if (t->index == 0) {
+        t->index++;
+        break;
+      }
 
-        // if we successfully got through the previous loop then our current
-        // index is good.
-        if (i == t->index) {
-          t->index++;
+      // otherwise we need to check the rest of the found string
+      int diff = origIndex - t->index;
+      size_t i;
+      for (i = 0; i < t->index; ++i) {
+        if (t->str[i] != t->str[i + diff])
           break;
-        }
+      }
 
-        // otherwise we just try the next index
-      } while (t->index);
-    }
+      // if we successfully got through the previous loop then our current
+      // index is good.
+      if (i == t->index) {
+        t->index++;
+        break;
+      }
+
+      // otherwise we just try the next index
+    } while (t->index);
   }
-  // unreachable
   return -1;
 }
 
@@ -206,6 +286,14 @@ long Stream::parseInt(char skipChar)
         return 0;    // zero returned if timeout
     }
 
+    size_t avail = peekAvailable();
+    const char *buf = avail ? (const char *) peekBuffer() : NULL;
+    size_t len = buf ? bufferedNumberLength(buf, avail, skipChar, false) : 0;
+    if(len && parseIntBuffer(buf, len, &value) == len) {
+        peekConsume(len);
+        return value;
+    }
+
     do {
         if(c == skipChar) {
         } // ignore this charactor
@@ -246,6 +334,15 @@ float Stream::parseFloat(char skipChar)
         return 0;    // zero returned if timeout
     }
 
+    size_t avail = peekAvailable();
+    const char *buf = avail ? (const char *) peekBuffer() : NULL;
+    size_t len = buf ? bufferedNumberLength(buf, avail, skipChar, true) : 0;
+    float result;
+    if(len && parseFloatBuffer(buf, len, &result) == len) {
+        peekConsume(len);
+        return result;
+    }
+
     do {
         if(c == skipChar) {
         } // ignore
@@ -278,10 +375,17 @@ float Stream::parseFloat(char skipChar)
 // returns the number of characters placed in the buffer
 // the buffer is NOT null terminated.
 //
-size_t Stream::readBytes(char *buffer, size_t length)
+size_t ARDUINO_HOT Stream::readBytes(char *buffer, size_t length)
 {
     size_t count = 0;
     while(count < length) {
+        int n = readAvailable((uint8_t *) buffer, length - count);
+        if(n > 0) {
+            buffer += n;
+            count += n;
+            continue;
+        }
+        // nothing there yet, wait for the next one
         int c = timedRead();
         if(c < 0) {
             break;
@@ -43,6 +43,9 @@ protected:
     int timedRead();    // private method to read stream with timeout
     int timedPeek();    // private method to peek stream with timeout
     int peekNextDigit(); // returns the next numeric digit in the stream or -1 if timeout
+    // copies up to size of the characters already received without waiting, -1 when the stream can
+    // only read one at a time; readBytes() takes whole blocks through it
+    virtual int readAvailable(uint8_t *buffer, size_t size) { return -1; }
 
 public:
     virtual int available() = 0;
@@ -50,6 +53,13 @@ public:
     virtual int peek() = 0;
     virtual void flush() = 0;
 
+    // received bytes in place, for streams that buffer them: peekBuffer() points at peekAvailable()
+    // bytes that stay valid until the next read, peekConsume() drops them once used.
+    // find() and findUntil() search through them instead of reading one at a time
+    virtual size_t peekAvailable() { return 0; }
+    virtual const uint8_t * peekBuffer() { return NULL; }
+    virtual void peekConsume(size_t len) {}
+
     Stream():_startMillis(0)
     {
         _timeout = 1000;
@@ -134,6 +144,8 @@ protected:
   // This allows you to search for an arbitrary number of strings.
   // Returns index of the target that is found first or -1 if timeout occurs.
   int findMulti(struct MultiTarget *targets, int tCount);
+  // advances the targets by one character, returns the index of the one it completes or -1
+  int findMultiStep(struct MultiTarget *targets, int tCount, char c);
 
 };
 
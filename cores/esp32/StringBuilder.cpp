@@ -0,0 +1,74 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "StringBuilder.h"
+#include <stdarg.h>
+
+StringBuilder::StringBuilder(unsigned int hint)
+{
+    if(hint) {
+        reserve(hint);
+    }
+}
+
+size_t StringBuilder::write(const uint8_t *data, size_t size)
+{
+    if(!size || !data) {
+        return 0;
+    }
+    // data is not NUL terminated, so no concat() here
+    const unsigned int newlen = length() + size;
+    if(!reserve(newlen)) {
+        return 0;
+    }
+    memcpy(wbuffer() + len(), data, size);
+    setLen(newlen);
+    wbuffer()[newlen] = 0;
+    return size;
+}
+
+size_t StringBuilder::write(uint8_t data)
+{
+    return concat((char) data);
+}
+
+size_t StringBuilder::printf(const char *format, ...)
+{
+    if(!reserve(length())) {
+        return 0;
+    }
+    unsigned int oldLen = len();
+    va_list arg;
+    va_list copy;
+    va_start(arg, format);
+    va_copy(copy, arg);
+    int n = vsnprintf(wbuffer() + oldLen, capacity() - oldLen + 1, format, copy);
+    va_end(copy);
+    if(n < 0) {
+        wbuffer()[oldLen] = 0;
+        va_end(arg);
+        return 0;
+    }
+    if(oldLen + n > capacity()) {
+        if(!reserve(oldLen + n)) {
+            wbuffer()[oldLen] = 0;
+            va_end(arg);
+            return 0;
+        }
+        vsnprintf(wbuffer() + oldLen, n + 1, format, arg);
+    }
+    va_end(arg);
+    setLen(oldLen + n);
+    return n;
+}
@@ -0,0 +1,38 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STRINGBUILDER_H_
+#define STRINGBUILDER_H_
+
+#include <Arduino.h>
+
+/*
+ * A String that can be printed to. print()/printf() append in place: printf()
+ * formats straight into the spare capacity and only reallocates when the result
+ * does not fit. Pass a size hint to get one allocation for the whole text, and
+ * move the result out (String s = std::move(builder)) to keep the buffer.
+ */
+class StringBuilder: public Print, public String
+{
+public:
+    explicit StringBuilder(unsigned int hint = 0);
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t write(uint8_t data) override;
+    size_t printf(const char * format, ...) __attribute__ ((format (printf, 2, 3)));
+
+    using Print::write;
+};
+
+#endif /* STRINGBUILDER_H_ */
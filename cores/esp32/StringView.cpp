@@ -0,0 +1,151 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "StringView.h"
+#include "StringBuilder.h"
+#include <ctype.h>
+
+int StringView::compareTo(StringView s) const
+{
+    size_t n = (_len < s._len) ? _len : s._len;
+    int r = memcmp(_ptr, s._ptr, n);
+    if(r || _len == s._len) {
+        return r;
+    }
+    return (_len < s._len) ? -1 : 1;
+}
+
+bool StringView::equalsIgnoreCase(StringView s) const
+{
+    if(_len != s._len) {
+        return false;
+    }
+    for(size_t i = 0; i < _len; i++) {
+        if(tolower((unsigned char) _ptr[i]) != tolower((unsigned char) s._ptr[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int StringView::indexOf(char ch, size_t fromIndex) const
+{
+    if(fromIndex >= _len) {
+        return -1;
+    }
+    const char *p = (const char *) memchr(_ptr + fromIndex, ch, _len - fromIndex);
+    return p ? p - _ptr : -1;
+}
+
+int StringView::indexOf(StringView str, size_t fromIndex) const
+{
+    if(fromIndex > _len || str._len > _len - fromIndex) {
+        return -1;
+    }
+    if(!str._len) {
+        return fromIndex;
+    }
+    const char *last = _ptr + _len - str._len;
+    for(const char *p = _ptr + fromIndex; p <= last; p++) {
+        p = (const char *) memchr(p, str._ptr[0], last - p + 1);
+        if(!p) {
+            break;
+        }
+        if(!memcmp(p, str._ptr, str._len)) {
+            return p - _ptr;
+        }
+    }
+    return -1;
+}
+
+int StringView::lastIndexOf(char ch) const
+{
+    for(size_t i = _len; i--; ) {
+        if(_ptr[i] == ch) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+StringView StringView::substring(size_t beginIndex, size_t endIndex) const
+{
+    if(endIndex > _len) {
+        endIndex = _len;
+    }
+    if(beginIndex > endIndex) {
+        beginIndex = endIndex;
+    }
+    return StringView(_ptr + beginIndex, endIndex - beginIndex);
+}
+
+StringView StringView::trim() const
+{
+    size_t b = 0;
+    size_t e = _len;
+    while(b < e && isspace((unsigned char) _ptr[b])) {
+        b++;
+    }
+    while(e > b && isspace((unsigned char) _ptr[e - 1])) {
+        e--;
+    }
+    return StringView(_ptr + b, e - b);
+}
+
+bool StringView::split(char delim, StringView &head, StringView &tail) const
+{
+    int i = indexOf(delim);
+    if(i < 0) {
+        head = *this;
+        tail = StringView(_ptr + _len, 0);
+        return false;
+    }
+    // copy first, head or tail may be *this
+    StringView all = *this;
+    head = StringView(all._ptr, i);
+    tail = StringView(all._ptr + i + 1, all._len - i - 1);
+    return true;
+}
+
+StringView StringView::nextToken(char delim)
+{
+    StringView head;
+    split(delim, head, *this);
+    return head;
+}
+
+long StringView::toInt() const
+{
+    // same leading whitespace and sign handling as atol(), without a NUL
+    size_t i = 0;
+    while(i < _len && isspace((unsigned char) _ptr[i])) {
+        i++;
+    }
+    bool negative = false;
+    if(i < _len && (_ptr[i] == '-' || _ptr[i] == '+')) {
+        negative = _ptr[i++] == '-';
+    }
+    long value = 0;
+    while(i < _len && _ptr[i] >= '0' && _ptr[i] <= '9') {
+        value = value * 10 + (_ptr[i++] - '0');
+    }
+    return negative ? -value : value;
+}
+
+String StringView::toString() const
+{
+    StringBuilder s(_len);
+    s.write((const uint8_t *) _ptr, _len);
+    return String(static_cast<String &&>(s));
+}
@@ -0,0 +1,88 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STRINGVIEW_H_
+#define STRINGVIEW_H_
+
+#ifdef __cplusplus
+
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<string_view>)
+#include <string_view>
+#define STRINGVIEW_HAS_STD 1
+#endif
+#endif
+
+/*
+ * Non-owning view of characters: a pointer and a length, not NUL terminated.
+ * The viewed String or buffer must outlive the view and must not be modified
+ * while the view is used. Nothing here allocates except toString().
+ */
+class StringView {
+    public:
+        static const size_t npos = (size_t) -1;
+
+        StringView() : _ptr(""), _len(0) {}
+        StringView(const char *cstr) : _ptr(cstr ? cstr : ""), _len(cstr ? strlen(cstr) : 0) {}
+        StringView(const char *data, size_t length) : _ptr(data ? data : ""), _len(data ? length : 0) {}
+        StringView(const String &str) : _ptr(str.c_str() ? str.c_str() : ""), _len(str.length()) {}
+#ifdef STRINGVIEW_HAS_STD
+        StringView(std::string_view sv) : _ptr(sv.data() ? sv.data() : ""), _len(sv.data() ? sv.size() : 0) {}
+        operator std::string_view() const { return std::string_view(_ptr, _len); }
+#endif
+
+        const char *data() const { return _ptr; }
+        size_t length() const { return _len; }
+        bool isEmpty() const { return _len == 0; }
+        char operator [](size_t index) const { return _ptr[index]; }
+        const char *begin() const { return _ptr; }
+        const char *end() const { return _ptr + _len; }
+
+        // comparison
+        int compareTo(StringView s) const;
+        bool equals(StringView s) const { return _len == s._len && !memcmp(_ptr, s._ptr, _len); }
+        bool equalsIgnoreCase(StringView s) const;
+        bool startsWith(StringView prefix) const { return _len >= prefix._len && !memcmp(_ptr, prefix._ptr, prefix._len); }
+        bool endsWith(StringView suffix) const { return _len >= suffix._len && !memcmp(_ptr + _len - suffix._len, suffix._ptr, suffix._len); }
+        bool operator ==(StringView s) const { return equals(s); }
+        bool operator !=(StringView s) const { return !equals(s); }
+
+        // search, returns -1 when not found
+        int indexOf(char ch, size_t fromIndex = 0) const;
+        int indexOf(StringView str, size_t fromIndex = 0) const;
+        int lastIndexOf(char ch) const;
+
+        // endIndex is exclusive, both are clamped to the view
+        StringView substring(size_t beginIndex, size_t endIndex = npos) const;
+        StringView trim() const;
+
+        // split at the first delim: head gets the part before it, tail the rest.
+        // Without delim, head gets everything and false is returned.
+        bool split(char delim, StringView &head, StringView &tail) const;
+        // returns the part before the next delim (or all of it) and advances past it
+        StringView nextToken(char delim);
+
+        long toInt() const;
+        String toString() const;
+
+    private:
+        const char *_ptr;
+        size_t _len;
+};
+
+#endif  // __cplusplus
+#endif  // STRINGVIEW_H_
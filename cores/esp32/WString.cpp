@@ -76,7 +76,7 @@ String::String(int value, unsigned char base) {
     init();
     char buf[2 + 8 * sizeof(int)];
     if (base == 10) {
-        sprintf(buf, "%d", value);
+        ltoa(value, buf, 10);
     } else {
         itoa(value, buf, base);
     }
@@ -94,7 +94,7 @@ String::String(long value, unsigned char base) {
     init();
     char buf[2 + 8 * sizeof(long)];
     if (base==10) {
-        sprintf(buf, "%ld", value);
+        ltoa(value, buf, 10);
     } else {
         ltoa(value, buf, base);
     }
@@ -111,12 +111,20 @@ String::String(unsigned long value, unsigned char base) {
 String::String(float value, unsigned char decimalPlaces) {
     init();
     char buf[33];
+    if (decimalPlaces == (unsigned char) FLOAT_SHORTEST) {
+        copy(buf, ftostr(value, buf));
+        return;
+    }
     *this = dtostrf(value, (decimalPlaces + 2), decimalPlaces, buf);
 }
 
 String::String(double value, unsigned char decimalPlaces) {
     init();
     char buf[33];
+    if (decimalPlaces == (unsigned char) FLOAT_SHORTEST) {
+        copy(buf, ftostr(value, buf));
+        return;
+    }
     *this = dtostrf(value, (decimalPlaces + 2), decimalPlaces, buf);
 }
 
@@ -179,8 +187,19 @@ unsigned char String::changeBuffer(unsigned int maxStrLen) {
     if (newSize > CAPACITY_MAX) {
         return false;
     }
+    // A heap buffer that has to grow again grows by half, so appending in a loop
+    // reallocates O(log n) times. The first allocation is sized exactly.
+    if (!isSSO() && buffer() && maxStrLen > capacity()) {
+        size_t geometric = ((capacity() + 1) * 3 / 2 + 15) & (~0xf);
+        if (geometric > CAPACITY_MAX) {
+            geometric = CAPACITY_MAX;
+        }
+        if (geometric > newSize) {
+            newSize = geometric;
+        }
+    }
     uint16_t oldLen = len();
-    char *newbuffer = (char *) realloc(isSSO() ? nullptr : wbuffer(), newSize);
+    char *newbuffer = (char *) heap_policy_realloc(HEAP_USER_STRING, isSSO() ? nullptr : wbuffer(), newSize);
     if (newbuffer) {
         size_t oldSize = capacity() + 1; // include NULL.
         if (isSSO()) {
@@ -355,32 +374,29 @@ unsigned char String::concat(char c) {
 
 unsigned char String::concat(unsigned char num) {
     char buf[1 + 3 * sizeof(unsigned char)];
-    sprintf(buf, "%d", num);
-    return concat(buf, strlen(buf));
+    return concat(buf, u32toa(num, buf));
 }
 
 unsigned char String::concat(int num) {
     char buf[2 + 3 * sizeof(int)];
-    sprintf(buf, "%d", num);
+    ltoa(num, buf, 10);
     return concat(buf, strlen(buf));
 }
 
 unsigned char String::concat(unsigned int num) {
     char buf[1 + 3 * sizeof(unsigned int)];
-    utoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concat(buf, u32toa(num, buf));
 }
 
 unsigned char String::concat(long num) {
     char buf[2 + 3 * sizeof(long)];
-    sprintf(buf, "%ld", num);
+    ltoa(num, buf, 10);
     return concat(buf, strlen(buf));
 }
 
 unsigned char String::concat(unsigned long num) {
     char buf[1 + 3 * sizeof(unsigned long)];
-    ultoa(num, buf, 10);
-    return concat(buf, strlen(buf));
+    return concat(buf, u64toa(num, buf));
 }
 
 unsigned char String::concat(float num) {
@@ -849,6 +865,13 @@ float String::toFloat(void) const {
     return 0;
 }
 
+float String::toFloatFast(void) const {
+    float value = 0;
+    if (buffer())
+        parseFloatBuffer(buffer(), len(), &value);
+    return value;
+}
+
 double String::toDouble(void) const
 {
     if (buffer())
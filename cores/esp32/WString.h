@@ -39,6 +39,9 @@ class __FlashStringHelper;
 #define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
 #define F(string_literal) (FPSTR(PSTR(string_literal)))
 
+// decimalPlaces/digits value for the shortest text that reads back as the same float
+#define FLOAT_SHORTEST -1
+
 // The string class
 class String {
         // use a function pointer to allow for "if (s)" without the
@@ -275,6 +278,8 @@ class String {
         // parsing/conversion
         long toInt(void) const;
         float toFloat(void) const;
+        // as toFloat(), correctly rounded and without atof(); no leading whitespace
+        float toFloatFast(void) const;
 	double toDouble(void) const;
 
     protected:
@@ -327,6 +332,12 @@ class StringSumHelper: public String {
         StringSumHelper(const String &s) :
                 String(s) {
         }
+#ifdef __GXX_EXPERIMENTAL_CXX0X__
+        // a temporary left operand (or std::move(s) + ...) hands over its buffer
+        StringSumHelper(String &&s) :
+                String(static_cast<String &&>(s)) {
+        }
+#endif
         StringSumHelper(const char *p) :
                 String(p) {
         }
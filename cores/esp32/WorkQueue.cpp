@@ -0,0 +1,316 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "WorkQueue.h"
+#include <new>
+
+WorkFuture::WorkFuture()
+    : _done(xSemaphoreCreateBinary())
+    , _ready(false)
+{
+}
+
+WorkFuture::~WorkFuture()
+{
+    if(_done) {
+        vSemaphoreDelete(_done);
+    }
+}
+
+bool WorkFuture::wait(uint32_t timeout_ms)
+{
+    if(_ready || !_done) {
+        return _ready;
+    }
+    TickType_t ticks = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    if(xSemaphoreTake(_done, ticks) == pdTRUE) {
+        // for the next one waiting
+        xSemaphoreGive(_done);
+    }
+    return _ready;
+}
+
+void WorkFuture::_complete()
+{
+    _ready = true;
+    if(_done) {
+        xSemaphoreGive(_done);
+    }
+}
+
+bool WorkQueue::Ring::init(size_t size)
+{
+    size_t cells = 1;
+    while(cells < size) {
+        cells <<= 1;
+    }
+    _cells = new (std::nothrow) Cell[cells];
+    if(!_cells) {
+        return false;
+    }
+    for(size_t i = 0; i < cells; i++) {
+        _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    _mask = cells - 1;
+    _enqueue.store(0);
+    _dequeue.store(0);
+    return true;
+}
+
+void WorkQueue::Ring::deinit()
+{
+    delete[] _cells;
+    _cells = NULL;
+}
+
+// a cell is free for position pos when its seq is pos, and taken when it is pos + 1
+bool WorkQueue::Ring::push(Job & job)
+{
+    Cell * cell;
+    uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+    for(;;) {
+        cell = &_cells[pos & _mask];
+        int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+        if(diff == 0) {
+            if(_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            return false;
+        } else {
+            pos = _enqueue.load(std::memory_order_relaxed);
+        }
+    }
+    cell->job = std::move(job);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool WorkQueue::Ring::pop(Job & job)
+{
+    Cell * cell;
+    uint32_t pos = _dequeue.load(std::memory_order_relaxed);
+    for(;;) {
+        cell = &_cells[pos & _mask];
+        int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - (pos + 1));
+        if(diff == 0) {
+            if(_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            return false;
+        } else {
+            pos = _dequeue.load(std::memory_order_relaxed);
+        }
+    }
+    job = std::move(cell->job);
+    cell->seq.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+WorkQueue::WorkQueue(uint8_t workersCore0, uint8_t workersCore1, size_t queueSize)
+    : _queueSize(queueSize ? queueSize : 1)
+    , _pool(NULL)
+    , _count(0)
+    , _idle(0)
+    , _run(false)
+    , _steal(true)
+    , _stolen(0)
+    , _exited(NULL)
+{
+    _workers[0] = workersCore0;
+    _workers[1] = workersCore1;
+#if CONFIG_FREERTOS_UNICORE
+    _workers[0] += _workers[1];
+    _workers[1] = 0;
+#endif
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+WorkQueue::~WorkQueue()
+{
+    end();
+}
+
+bool WorkQueue::begin(uint32_t stackSize, UBaseType_t priority)
+{
+    if(_pool) {
+        return true;
+    }
+    size_t count = _workers[0] + _workers[1];
+    if(!count || count > 32) {
+        log_e("%u workers, 1 to 32 are supported", count);
+        return false;
+    }
+    _exited = xSemaphoreCreateCounting(count, 0);
+    _pool = new (std::nothrow) Worker[count];
+    if(!_exited || !_pool || !_rings[0].init(_queueSize) || !_rings[1].init(_queueSize)) {
+        log_e("out of memory");
+        end();
+        return false;
+    }
+    _run = true;
+    for(uint8_t core = 0; core < 2; core++) {
+        for(uint8_t i = 0; i < _workers[core]; i++) {
+            Worker & worker = _pool[_count];
+            worker.queue = this;
+            worker.core = core;
+            worker.index = _count;
+            worker.task = NULL;
+            if(xTaskCreateUniversal(_task, "work", stackSize, &worker, priority, &worker.task, core) != pdPASS) {
+                log_e("worker task not created");
+                end();
+                return false;
+            }
+            _count++;
+        }
+    }
+    return true;
+}
+
+void WorkQueue::end()
+{
+    _run = false;
+    for(uint8_t i = 0; i < _count; i++) {
+        xTaskNotifyGive(_pool[i].task);
+    }
+    for(uint8_t i = 0; i < _count; i++) {
+        xSemaphoreTake(_exited, portMAX_DELAY);
+    }
+    _count = 0;
+    _idle = 0;
+    delete[] _pool;
+    _pool = NULL;
+    _rings[0].deinit();
+    _rings[1].deinit();
+    if(_exited) {
+        vSemaphoreDelete(_exited);
+        _exited = NULL;
+    }
+}
+
+WorkQueue::Future WorkQueue::submit(WorkFn work, int8_t core, WorkFn done)
+{
+    if(!_run || !work) {
+        return nullptr;
+    }
+    // to a core that has workers, the one with less waiting when any will do
+    if(core < 0 || core > 1 || !_workers[core]) {
+        if(!_workers[0]) {
+            core = 1;
+        } else if(!_workers[1]) {
+            core = 0;
+        } else {
+            core = (_rings[1].count() < _rings[0].count()) ? 1 : 0;
+        }
+    }
+    Job job;
+    job.work = std::move(work);
+    job.done = std::move(done);
+    job.future = std::make_shared<WorkFuture>();
+    Future future = job.future;
+    if(!_rings[core].push(job)) {
+        return nullptr;
+    }
+    _wake(core);
+    return future;
+}
+
+size_t WorkQueue::pending(int8_t core)
+{
+    if(!_pool) {
+        return 0;
+    }
+    if(core == 0 || core == 1) {
+        return _rings[core].count();
+    }
+    return _rings[0].count() + _rings[1].count();
+}
+
+// an idle worker of core, else one of the other core to steal it
+void WorkQueue::_wake(uint8_t core)
+{
+    TaskHandle_t task = NULL;
+    portENTER_CRITICAL(&_mux);
+    for(int pass = 0; pass < 2 && !task; pass++) {
+        for(uint8_t i = 0; i < _count; i++) {
+            if((_idle & BIT(i)) && (_pool[i].core == core) == (pass == 0)) {
+                _idle &= ~BIT(i);
+                task = _pool[i].task;
+                break;
+            }
+        }
+        if(!_steal) {
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+    if(task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool WorkQueue::_take(Worker & worker, Job & job)
+{
+    if(_rings[worker.core].pop(job)) {
+        return true;
+    }
+    if(_steal && _rings[worker.core ^ 1].pop(job)) {
+        _stolen++;
+        return true;
+    }
+    return false;
+}
+
+void WorkQueue::_loop(Worker & worker)
+{
+    Job job;
+    for(;;) {
+        if(!_take(worker, job)) {
+            portENTER_CRITICAL(&_mux);
+            _idle |= BIT(worker.index);
+            portEXIT_CRITICAL(&_mux);
+            // a submit() just before the bit was set did not wake anyone
+            bool found = _take(worker, job);
+            if(!found) {
+                if(!_run) {
+                    return;
+                }
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            portENTER_CRITICAL(&_mux);
+            _idle &= ~BIT(worker.index);
+            portEXIT_CRITICAL(&_mux);
+            if(!found) {
+                continue;
+            }
+        }
+        job.work();
+        if(job.done) {
+            job.done();
+        }
+        job.future->_complete();
+        // the captures go now, not with the next job
+        job = Job();
+    }
+}
+
+void WorkQueue::_task(void * arg)
+{
+    Worker * worker = (Worker *)arg;
+    WorkQueue * queue = worker->queue;
+    queue->_loop(*worker);
+    xSemaphoreGive(queue->_exited);
+    vTaskDelete(NULL);
+}
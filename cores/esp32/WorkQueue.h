@@ -0,0 +1,137 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef WORKQUEUE_H_
+#define WORKQUEUE_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#ifndef WORK_QUEUE_TASK_STACK_SIZE
+#define WORK_QUEUE_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef WORK_QUEUE_TASK_PRIORITY
+#define WORK_QUEUE_TASK_PRIORITY 1 // the same as loop(), raise it for work that has to keep up
+#endif
+
+#define WORK_ANY_CORE -1
+
+/*
+ * A pool of worker tasks pinned to the cores, to take work off the loop:
+ *
+ *   WorkQueue work(1, 0);              // one worker on core 0, none on core 1
+ *   work.begin();
+ *   auto job = work.submit([&]() { parse(doc, text); });
+ *   ...
+ *   job->wait();
+ *
+ * Every core has its own queue, submit() takes a lock-free slot in the one of
+ * the core asked for, or of the one with less waiting. An idle worker takes from
+ * the queue of its core first and then from the other; with stealing turned off
+ * it only runs work submitted to its core. The completion callback runs in the
+ * worker right after the work, the WorkFuture can be waited on from any task.
+ */
+class WorkFuture
+{
+public:
+    WorkFuture();
+    ~WorkFuture();
+
+    bool ready() const { return _ready; }
+    // false on timeout
+    bool wait(uint32_t timeout_ms = portMAX_DELAY);
+
+private:
+    friend class WorkQueue;
+    SemaphoreHandle_t _done;
+    volatile bool _ready;
+    void _complete();
+};
+
+class WorkQueue
+{
+public:
+    typedef std::function<void(void)> WorkFn;
+    typedef std::shared_ptr<WorkFuture> Future;
+
+    // queueSize per core, rounded up to a power of two
+    WorkQueue(uint8_t workersCore0 = 1, uint8_t workersCore1 = 1, size_t queueSize = 16);
+    ~WorkQueue();
+
+    bool begin(uint32_t stackSize = WORK_QUEUE_TASK_STACK_SIZE, UBaseType_t priority = WORK_QUEUE_TASK_PRIORITY);
+    // waits for the workers to finish what was submitted
+    void end();
+
+    // NULL when the queue of the core is full
+    Future submit(WorkFn work, int8_t core = WORK_ANY_CORE, WorkFn done = nullptr);
+
+    void setStealing(bool steal) { _steal = steal; }
+    size_t pending(int8_t core = WORK_ANY_CORE);
+    uint32_t stolen() const { return _stolen; } // work run by a worker of the other core
+
+private:
+    struct Job {
+        WorkFn work;
+        WorkFn done;
+        Future future;
+    };
+
+    // bounded MPMC queue, every cell has a sequence telling whether it is free or taken
+    class Ring {
+    public:
+        bool init(size_t size);
+        void deinit();
+        bool push(Job & job);
+        bool pop(Job & job);
+        size_t count() const { return _enqueue.load() - _dequeue.load(); }
+    private:
+        struct Cell {
+            std::atomic<uint32_t> seq;
+            Job job;
+        };
+        Cell * _cells = NULL;
+        uint32_t _mask = 0;
+        std::atomic<uint32_t> _enqueue;
+        std::atomic<uint32_t> _dequeue;
+    };
+
+    struct Worker {
+        WorkQueue * queue;
+        TaskHandle_t task;
+        uint8_t core;
+        uint8_t index;
+    };
+
+    uint8_t _workers[2];
+    size_t _queueSize;
+    Ring _rings[2];
+    Worker * _pool;
+    uint8_t _count;
+    uint32_t _idle;             // bits of _pool waiting for work
+    portMUX_TYPE _mux;
+    volatile bool _run;
+    volatile bool _steal;
+    std::atomic<uint32_t> _stolen;
+    SemaphoreHandle_t _exited;
+
+    bool _take(Worker & worker, Job & job);
+    void _wake(uint8_t core);
+    void _loop(Worker & worker);
+    static void _task(void * arg);
+};
+
+#endif /* WORKQUEUE_H_ */
@@ -23,10 +23,6 @@
  */
 
 #include "Arduino.h"
-extern "C" {
-#include "libb64/cdecode.h"
-#include "libb64/cencode.h"
-}
 #include "base64.h"
 
 /**
@@ -35,28 +31,128 @@ extern "C" {
  * @param length size_t
  * @return String
  */
-String base64::encode(const uint8_t * data, size_t length)
+static const char _b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const int8_t _b64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+size_t base64::encode(const uint8_t * data, size_t length, char * out, size_t outSize)
 {
-    size_t size = base64_encode_expected_len(length) + 1;
-    char * buffer = (char *) malloc(size);
-    if(buffer) {
-        base64_encodestate _state;
-        base64_init_encodestate(&_state);
-        int len = base64_encode_block((const char *) &data[0], length, &buffer[0], &_state);
-        len = base64_encode_blockend((buffer + len), &_state);
+    const size_t need = encodedLength(length);
+    if(outSize < need) {
+        return 0;
+    }
+    char * o = out;
+    // three bytes make one 24 bit word, four table lookups
+    size_t i = 0;
+    for(; i + 3 <= length; i += 3) {
+        const uint32_t w = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        o[0] = _b64_alphabet[w >> 18];
+        o[1] = _b64_alphabet[(w >> 12) & 0x3f];
+        o[2] = _b64_alphabet[(w >> 6) & 0x3f];
+        o[3] = _b64_alphabet[w & 0x3f];
+        o += 4;
+    }
+    if(i < length) {
+        uint32_t w = data[i] << 16;
+        if(i + 1 < length) {
+            w |= data[i + 1] << 8;
+        }
+        o[0] = _b64_alphabet[w >> 18];
+        o[1] = _b64_alphabet[(w >> 12) & 0x3f];
+        o[2] = (i + 1 < length) ? _b64_alphabet[(w >> 6) & 0x3f] : '=';
+        o[3] = '=';
+        o += 4;
+    }
+    if(outSize > need) {
+        *o = 0;
+    }
+    return need;
+}
 
-        String base64 = String(buffer);
-        free(buffer);
-        return base64;
+size_t base64::decodedLength(const char * text, size_t length)
+{
+    for(int pad = 0; pad < 2 && length && text[length - 1] == '='; pad++) {
+        length--;
     }
-    return String("-FAIL-");
+    return length * 3 / 4;
+}
+
+int base64::decode(const char * text, size_t length, uint8_t * out, size_t outSize)
+{
+    for(int pad = 0; pad < 2 && length && text[length - 1] == '='; pad++) {
+        length--;
+    }
+    if((length & 3) == 1 || outSize < length * 3 / 4) {
+        return -1;
+    }
+    const uint8_t * t = (const uint8_t *) text;
+    uint8_t * o = out;
+    size_t i = 0;
+    for(; i + 4 <= length; i += 4) {
+        const int32_t a = _b64_values[t[i]];
+        const int32_t b = _b64_values[t[i + 1]];
+        const int32_t c = _b64_values[t[i + 2]];
+        const int32_t d = _b64_values[t[i + 3]];
+        if((a | b | c | d) < 0) {
+            return -1;
+        }
+        const uint32_t w = (a << 18) | (b << 12) | (c << 6) | d;
+        o[0] = w >> 16;
+        o[1] = w >> 8;
+        o[2] = w;
+        o += 3;
+    }
+    if(i < length) {
+        const int32_t a = _b64_values[t[i]];
+        const int32_t b = _b64_values[t[i + 1]];
+        const int32_t c = (i + 2 < length) ? _b64_values[t[i + 2]] : 0;
+        if((a | b | c) < 0) {
+            return -1;
+        }
+        const uint32_t w = (a << 18) | (b << 12) | (c << 6);
+        *o++ = w >> 16;
+        if(i + 2 < length) {
+            *o++ = w >> 8;
+        }
+    }
+    return o - out;
+}
+
+String base64::encode(const uint8_t * data, size_t length)
+{
+    String base64;
+    if(!base64.reserve(encodedLength(length))) {
+        return String("-FAIL-");
+    }
+    // a stack chunk at a time into the one reserved buffer
+    char chunk[65];
+    while(length) {
+        size_t n = (length > 48) ? 48 : length;
+        encode(data, n, chunk, sizeof(chunk));
+        base64 += chunk;
+        data += n;
+        length -= n;
+    }
+    return base64;
 }
 
-/**
- * convert input data to base64
- * @param text const String&
- * @return String
- */
 String base64::encode(const String& text)
 {
     return base64::encode((uint8_t *) text.c_str(), text.length());
@@ -20,6 +20,20 @@ class base64
 public:
     static String encode(const uint8_t * data, size_t length);
     static String encode(const String& text);
+
+    static size_t encodedLength(size_t length)
+    {
+        return ((length + 2) / 3) * 4;
+    }
+    // into a caller buffer, NUL terminated when there is room for it;
+    // returns the characters written or 0 when out is too small
+    static size_t encode(const uint8_t * data, size_t length, char * out, size_t outSize);
+
+    // bytes decode() will produce, trailing '=' padding is optional
+    static size_t decodedLength(const char * text, size_t length);
+    // returns the bytes written or -1 on a character outside the alphabet
+    // (whitespace included) or when out is too small
+    static int decode(const char * text, size_t length, uint8_t * out, size_t outSize);
 private:
 };
 
@@ -19,6 +19,7 @@
  */
 
 #include "cbuf.h"
+#include "esp32-hal.h"
 
 cbuf::cbuf(size_t size) :
     next(NULL), _size(size+1), _buf(new char[size+1]), _bufend(_buf + size + 1), _begin(_buf), _end(_begin)
@@ -69,7 +70,7 @@ size_t cbuf::resize(size_t newSize)
     return _size;
 }
 
-size_t cbuf::available() const
+size_t ARDUINO_HOT cbuf::available() const
 {
     if(_end >= _begin) {
         return _end - _begin;
@@ -90,7 +91,7 @@ size_t cbuf::room() const
     return _begin - _end - 1;
 }
 
-int cbuf::peek()
+int ARDUINO_HOT cbuf::peek()
 {
     if(empty()) {
         return -1;
@@ -99,7 +100,7 @@ int cbuf::peek()
     return static_cast<int>(*_begin);
 }
 
-size_t cbuf::peek(char *dst, size_t size)
+size_t ARDUINO_HOT cbuf::peek(char *dst, size_t size)
 {
     size_t bytes_available = available();
     size_t size_to_read = (size < bytes_available) ? size : bytes_available;
@@ -116,7 +117,7 @@ size_t cbuf::peek(char *dst, size_t size)
     return size_read;
 }
 
-int cbuf::read()
+int ARDUINO_HOT cbuf::read()
 {
     if(empty()) {
         return -1;
@@ -127,7 +128,7 @@ int cbuf::read()
     return static_cast<int>(result);
 }
 
-size_t cbuf::read(char* dst, size_t size)
+size_t ARDUINO_HOT cbuf::read(char* dst, size_t size)
 {
     size_t bytes_available = available();
     size_t size_to_read = (size < bytes_available) ? size : bytes_available;
@@ -144,7 +145,7 @@ size_t cbuf::read(char* dst, size_t size)
     return size_read;
 }
 
-size_t cbuf::write(char c)
+size_t ARDUINO_HOT cbuf::write(char c)
 {
     if(full()) {
         return 0;
@@ -155,7 +156,7 @@ size_t cbuf::write(char c)
     return 1;
 }
 
-size_t cbuf::write(const char* src, size_t size)
+size_t ARDUINO_HOT cbuf::write(const char* src, size_t size)
 {
     size_t bytes_available = room();
     size_t size_to_write = (size < bytes_available) ? size : bytes_available;
@@ -194,3 +195,52 @@ size_t cbuf::remove(size_t size)
     _begin = wrap_if_bufend(_begin + size_to_remove);
     return available();
 }
+
+char* cbuf::writeSpan(size_t* len)
+{
+    size_t span;
+    if(_end >= _begin) {
+        // up to the end of the buffer, one slot stays free ahead of _begin
+        span = _bufend - _end - ((_begin == _buf) ? 1 : 0);
+    } else {
+        span = _begin - _end - 1;
+    }
+    if(len) {
+        *len = span;
+    }
+    return _end;
+}
+
+size_t cbuf::commitWrite(size_t size)
+{
+    size_t span;
+    writeSpan(&span);
+    if(size > span) {
+        size = span;
+    }
+    _end = wrap_if_bufend(_end + size);
+    return size;
+}
+
+const char* cbuf::readSpan(size_t* len) const
+{
+    if(len) {
+        *len = (_end >= _begin) ? (size_t) (_end - _begin) : (size_t) (_bufend - _begin);
+    }
+    return _begin;
+}
+
+size_t cbuf::consume(size_t size)
+{
+    size_t bytes_available = available();
+    if(size > bytes_available) {
+        size = bytes_available;
+    }
+    size_t size_to_remove = size;
+    if(_end < _begin && size_to_remove >= (size_t) (_bufend - _begin)) {
+        size_to_remove -= _bufend - _begin;
+        _begin = _buf;
+    }
+    _begin = wrap_if_bufend(_begin + size_to_remove);
+    return size;
+}
@@ -60,6 +60,14 @@ public:
     void flush();
     size_t remove(size_t size);
 
+    // Zero-copy access for DMA or recv(): the largest contiguous free (write)
+    // or filled (read) region. Fill or drain it, then commit what was used.
+    // A wrapped buffer needs two rounds.
+    char* writeSpan(size_t* len);
+    size_t commitWrite(size_t size);
+    const char* readSpan(size_t* len) const;
+    size_t consume(size_t size);
+
     cbuf *next;
 
 private:
@@ -23,22 +23,76 @@
 #include "soc/sens_reg.h"
 
 #include "driver/adc.h"
+#include "driver/i2s.h"
+#include "soc/apb_ctrl_reg.h"
 #include "esp_adc_cal.h"
 
 #define DEFAULT_VREF    1100
-static esp_adc_cal_characteristics_t *__analogCharacteristics[2] = {NULL, NULL};
+static uint16_t *__analogCalTable[2][4];//raw to mV per unit and attenuation, for the current width
+static uint8_t __analogChannelAttenuation[20];//as configured per channel, 0xFF when never set
 static uint8_t __analogAttenuation = 3;//11db
 static uint8_t __analogWidth = 3;//12 bits
 static uint8_t __analogClockDiv = 1;
 static uint16_t __analogVRef = 0;
 static uint8_t __analogVRefPin = 0;
 
+#ifndef ADC_MULTI_SAMPLE_RATE
+#define ADC_MULTI_SAMPLE_RATE 100000
+#endif
+
+#ifndef ADC_CONTINUOUS_DMA_BUFFERS
+#define ADC_CONTINUOUS_DMA_BUFFERS 2
+#endif
+
+#ifndef ADC_CONTINUOUS_TASK_STACK_SIZE
+#define ADC_CONTINUOUS_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef ADC_CONTINUOUS_TASK_PRIORITY
+#define ADC_CONTINUOUS_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#endif
+
+#ifndef ADC_CONTINUOUS_TASK_RUNNING_CORE
+#define ADC_CONTINUOUS_TASK_RUNNING_CORE -1
+#endif
+
+typedef struct {
+    TaskHandle_t task;
+    volatile bool stop;
+    adc_continuous_cb_t cb;
+    void * arg;
+    uint16_t * frame;
+    size_t frameSamples;
+} adc_continuous_t;
+
+static adc_continuous_t * __analogContinuousState = NULL;
+void __analogContinuousStop(void);
+
+static void __analogResetCalibration(){
+    for(int u=0; u<2; u++){
+        for(int a=0; a<4; a++){
+            free(__analogCalTable[u][a]);
+            __analogCalTable[u][a] = NULL;
+        }
+    }
+}
+
+static uint8_t __analogChannelAtten(int8_t channel){
+    if(__analogChannelAttenuation[channel]){
+        return __analogChannelAttenuation[channel] - 1;
+    }
+    return __analogAttenuation;
+}
+
 void __analogSetWidth(uint8_t bits){
     if(bits < 9){
         bits = 9;
     } else if(bits > 12){
         bits = 12;
     }
+    if(__analogWidth != bits - 9){
+        __analogResetCalibration();
+    }
     __analogWidth = bits - 9;
     adc1_config_width(__analogWidth);
 }
@@ -77,6 +131,7 @@ void __analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation)
     } else {
         adc1_config_channel_atten(channel, attenuation);
     }
+    __analogChannelAttenuation[channel] = attenuation + 1;
     __analogInit();
 }
 
@@ -137,68 +192,316 @@ uint16_t __analogRead(uint8_t pin)
             log_e("GPIO%u: %s", pin, esp_err_to_name(r));
         }
     } else {
+        if(__analogContinuousState){
+            log_e("GPIO%u: ADC1 is in use by analogContinuous()", pin);
+            return value;
+        }
         return adc1_get_raw(channel);
     }
     return value;
 }
 
+static void __analogContinuousTask(void * arg)
+{
+    adc_continuous_t * adc = (adc_continuous_t *)arg;
+    size_t bytes = 0;
+    while(!adc->stop){
+        // returns once a DMA buffer completed
+        if(i2s_read(I2S_NUM_0, adc->frame, adc->frameSamples * sizeof(uint16_t), &bytes, 100 / portTICK_PERIOD_MS) != ESP_OK || !bytes){
+            continue;
+        }
+        adc->cb(adc->frame, bytes / sizeof(uint16_t), adc->arg);
+    }
+    adc->task = NULL;
+    vTaskDelete(NULL);
+}
+
+/*
+ * Puts I2S0 in ADC mode scanning the pins in order through the SAR1 pattern table.
+ * Attenuation and width are programmed once per entry, not per conversion.
+ */
+static bool __analogScanStart(const uint8_t pins[], size_t pinCount, uint32_t sampleRate, size_t bufferFrames)
+{
+    uint32_t patterns[4] = {0, 0, 0, 0};
+    int8_t firstChannel = -1;
+
+    __analogInit();
+    for(size_t i = 0; i < pinCount; i++){
+        int8_t channel = digitalPinToAnalogChannel(pins[i]);
+        if(channel < 0 || channel > 7){
+            log_e("GPIO%u: only ADC1 pins can be scanned", pins[i]);
+            return false;
+        }
+        if(!__adcAttachPin(pins[i])){
+            return false;
+        }
+        if(firstChannel < 0){
+            firstChannel = channel;
+        }
+        // pattern table entry: channel, bit width, attenuation; entry 0 is the MSB of TAB1
+        patterns[i / 4] |= ((channel << 4) | (__analogWidth << 2) | __analogChannelAtten(channel)) << (24 - (i % 4) * 8);
+    }
+
+    i2s_config_t config = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN,
+        .sample_rate = sampleRate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT,
+        .communication_format = I2S_COMM_FORMAT_I2S_MSB,
+        .intr_alloc_flags = 0,
+        .dma_buf_count = ADC_CONTINUOUS_DMA_BUFFERS,
+        .dma_buf_len = bufferFrames,
+        .use_apll = false,
+        .tx_desc_auto_clear = false,
+        .fixed_mclk = 0
+    };
+    esp_err_t err = i2s_driver_install(I2S_NUM_0, &config, 0, NULL);
+    if(err != ESP_OK){
+        log_e("I2S driver install failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)firstChannel);
+    i2s_adc_enable(I2S_NUM_0);
+
+    // i2s_adc_enable() programs a single channel, replace it with the scan list
+    WRITE_PERI_REG(APB_CTRL_APB_SARADC_SAR1_PATT_TAB1_REG, patterns[0]);
+    WRITE_PERI_REG(APB_CTRL_APB_SARADC_SAR1_PATT_TAB2_REG, patterns[1]);
+    WRITE_PERI_REG(APB_CTRL_APB_SARADC_SAR1_PATT_TAB3_REG, patterns[2]);
+    WRITE_PERI_REG(APB_CTRL_APB_SARADC_SAR1_PATT_TAB4_REG, patterns[3]);
+    SET_PERI_REG_BITS(APB_CTRL_APB_SARADC_CTRL_REG, APB_CTRL_SARADC_SAR1_PATT_LEN, pinCount - 1, APB_CTRL_SARADC_SAR1_PATT_LEN_S);
+    return true;
+}
+
+static void __analogScanStop()
+{
+    i2s_adc_disable(I2S_NUM_0);
+    i2s_driver_uninstall(I2S_NUM_0);
+}
+
+bool __analogContinuous(const uint8_t pins[], size_t pinCount, uint32_t sampleRate, size_t bufferFrames, adc_continuous_cb_t cb, void * arg)
+{
+    if(__analogContinuousState){
+        log_e("analogContinuous already running");
+        return false;
+    }
+    if(!pins || !pinCount || pinCount > 16 || !sampleRate || !cb){
+        return false;
+    }
+    if(bufferFrames < 8){
+        bufferFrames = 8;
+    } else if(bufferFrames > 1024){
+        bufferFrames = 1024; // DMA buffer length limit
+    }
+
+    adc_continuous_t * adc = (adc_continuous_t *)calloc(1, sizeof(adc_continuous_t));
+    if(!adc){
+        return false;
+    }
+    adc->cb = cb;
+    adc->arg = arg;
+    adc->frameSamples = bufferFrames;
+    adc->frame = (uint16_t *)malloc(bufferFrames * sizeof(uint16_t));
+    if(!adc->frame){
+        free(adc);
+        return false;
+    }
+    if(!__analogScanStart(pins, pinCount, sampleRate, bufferFrames)){
+        free(adc->frame);
+        free(adc);
+        return false;
+    }
+
+    __analogContinuousState = adc;
+    if(xTaskCreateUniversal(__analogContinuousTask, "adc_continuous", ADC_CONTINUOUS_TASK_STACK_SIZE, adc, ADC_CONTINUOUS_TASK_PRIORITY, &adc->task, ADC_CONTINUOUS_TASK_RUNNING_CORE) != pdPASS){
+        log_e("ADC task create failed");
+        __analogContinuousStop();
+        return false;
+    }
+    return true;
+}
+
+void __analogContinuousStop(void)
+{
+    adc_continuous_t * adc = __analogContinuousState;
+    if(!adc){
+        return;
+    }
+    if(adc->task){
+        adc->stop = true;
+        while(adc->task){
+            vTaskDelay(1);
+        }
+    }
+    __analogScanStop();
+    __analogContinuousState = NULL;
+    free(adc->frame);
+    free(adc);
+}
+
+bool __analogReadMulti(const uint8_t pins[], size_t n, uint16_t out[], uint16_t oversample)
+{
+    uint32_t sum[8] = {0};
+    uint16_t count[8] = {0};
+
+    if(!pins || !n || n > 16 || !out){
+        return false;
+    }
+    if(__analogContinuousState){
+        log_e("ADC1 is in use by analogContinuous()");
+        return false;
+    }
+    if(!oversample){
+        oversample = 1;
+    }
+    size_t total = n * oversample;
+    if(total > 1024){
+        log_e("%u samples requested, 1024 max", (unsigned)total);
+        return false;
+    }
+    uint16_t * samples = (uint16_t *)malloc(total * sizeof(uint16_t));
+    if(!samples){
+        return false;
+    }
+    if(!__analogScanStart(pins, n, ADC_MULTI_SAMPLE_RATE, total)){
+        free(samples);
+        return false;
+    }
+    // one DMA buffer holds the whole burst
+    size_t bytes = 0;
+    TickType_t timeout = ((total * 1000) / ADC_MULTI_SAMPLE_RATE + 10) / portTICK_PERIOD_MS + 1;
+    esp_err_t err = i2s_read(I2S_NUM_0, samples, total * sizeof(uint16_t), &bytes, timeout);
+    __analogScanStop();
+    if(err != ESP_OK || !bytes){
+        log_e("ADC scan read failed");
+        free(samples);
+        return false;
+    }
+    // samples are tagged with their channel, so the scan phase does not matter
+    for(size_t i = 0; i < bytes / sizeof(uint16_t); i++){
+        uint8_t channel = ADC_CONTINUOUS_CHANNEL(samples[i]);
+        if(channel < 8){
+            sum[channel] += ADC_CONTINUOUS_VALUE(samples[i]);
+            count[channel]++;
+        }
+    }
+    free(samples);
+    for(size_t i = 0; i < n; i++){
+        uint8_t channel = digitalPinToAnalogChannel(pins[i]);
+        out[i] = count[channel] ? (sum[channel] + count[channel] / 2) / count[channel] : 0;
+    }
+    return true;
+}
+
 void __analogSetVRefPin(uint8_t pin){
     if(pin <25 || pin > 27){
         pin = 0;
     }
+    if(__analogVRefPin != pin){
+        __analogVRef = 0;
+        __analogResetCalibration();
+    }
     __analogVRefPin = pin;
 }
 
+static void __analogInitVRef(){
+    if(__analogVRef){
+        return;
+    }
+    if (esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_TP) == ESP_OK) {
+        log_d("eFuse Two Point: Supported");
+        __analogVRef = DEFAULT_VREF;
+    }
+    if (esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_VREF) == ESP_OK) {
+        log_d("eFuse Vref: Supported");
+        __analogVRef = DEFAULT_VREF;
+    }
+    if(!__analogVRef){
+        __analogVRef = DEFAULT_VREF;
+        if(__analogVRefPin){
+            esp_adc_cal_characteristics_t chars;
+            if(adc2_vref_to_gpio(__analogVRefPin) == ESP_OK){
+                __analogVRef = __analogRead(__analogVRefPin);
+                esp_adc_cal_characterize(1, __analogAttenuation, __analogWidth, DEFAULT_VREF, &chars);
+                __analogVRef = esp_adc_cal_raw_to_voltage(__analogVRef, &chars);
+                log_d("Vref to GPIO%u: %u", __analogVRefPin, __analogVRef);
+            }
+        }
+    }
+}
+
+/*
+ * The characterization curve is evaluated once for every raw code of the current
+ * width, so conversions after that are a single table load.
+ * The table is dropped when the width or the Vref pin change.
+ */
+static uint16_t * __analogGetCalTable(uint8_t unit, uint8_t atten){
+    uint16_t * table = __analogCalTable[unit - 1][atten];
+    if(table){
+        return table;
+    }
+    __analogInitVRef();
+    size_t codes = 1 << (__analogWidth + 9);
+    esp_adc_cal_characteristics_t chars;
+    table = (uint16_t *)malloc(codes * sizeof(uint16_t));
+    if(table == NULL){
+        log_e("ADC%u: calibration table alloc failed", unit);
+        return NULL;
+    }
+    esp_adc_cal_value_t val_type = esp_adc_cal_characterize(unit, atten, __analogWidth, __analogVRef, &chars);
+    if (val_type == ESP_ADC_CAL_VAL_EFUSE_TP) {
+        log_i("ADC%u: Characterized using Two Point Value: %u\n", unit, chars.vref);
+    } else if (val_type == ESP_ADC_CAL_VAL_EFUSE_VREF) {
+        log_i("ADC%u: Characterized using eFuse Vref: %u\n", unit, chars.vref);
+    } else if(__analogVRef != DEFAULT_VREF){
+        log_i("ADC%u: Characterized using Vref to GPIO%u: %u\n", unit, __analogVRefPin, chars.vref);
+    } else {
+        log_i("ADC%u: Characterized using Default Vref: %u\n", unit, chars.vref);
+    }
+    for(size_t raw = 0; raw < codes; raw++){
+        table[raw] = esp_adc_cal_raw_to_voltage(raw, &chars);
+    }
+    __analogCalTable[unit - 1][atten] = table;
+    return table;
+}
+
 uint32_t __analogReadMilliVolts(uint8_t pin){
     int8_t channel = digitalPinToAnalogChannel(pin);
     if(channel < 0){
         log_e("Pin %u is not ADC pin!", pin);
         return 0;
     }
-    if(!__analogVRef){
-        if (esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_TP) == ESP_OK) {
-            log_d("eFuse Two Point: Supported");
-            __analogVRef = DEFAULT_VREF;
-        }
-        if (esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_VREF) == ESP_OK) {
-            log_d("eFuse Vref: Supported");
-            __analogVRef = DEFAULT_VREF;
-        }
-        if(!__analogVRef){
-            __analogVRef = DEFAULT_VREF;
-            if(__analogVRefPin){
-                esp_adc_cal_characteristics_t chars;
-                if(adc2_vref_to_gpio(__analogVRefPin) == ESP_OK){
-                    __analogVRef = __analogRead(__analogVRefPin);
-                    esp_adc_cal_characterize(1, __analogAttenuation, __analogWidth, DEFAULT_VREF, &chars);
-                    __analogVRef = esp_adc_cal_raw_to_voltage(__analogVRef, &chars);
-                    log_d("Vref to GPIO%u: %u", __analogVRefPin, __analogVRef);
-                }
-            }
-        }
-    }
     uint8_t unit = 1;
     if(channel > 9){
         unit = 2;
     }
     uint16_t adc_reading = __analogRead(pin);
-    if(__analogCharacteristics[unit - 1] == NULL){
-        __analogCharacteristics[unit - 1] = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-        if(__analogCharacteristics[unit - 1] == NULL){
-            return 0;
+    uint16_t * table = __analogGetCalTable(unit, __analogChannelAtten(channel));
+    if(table == NULL){
+        return 0;
+    }
+    return table[adc_reading & ((1 << (__analogWidth + 9)) - 1)];
+}
+
+void __analogRawToMilliVoltsBuffer(const uint16_t * in, uint16_t * out, size_t n){
+    uint16_t * tables[10] = {NULL};
+    uint16_t mask = (1 << (__analogWidth + 9)) - 1;
+    for(size_t i = 0; i < n; i++){
+        uint16_t sample = in[i];
+        uint8_t channel = ADC_CONTINUOUS_CHANNEL(sample);
+        if(channel > 9){
+            out[i] = 0;
+            continue;
         }
-        esp_adc_cal_value_t val_type = esp_adc_cal_characterize(unit, __analogAttenuation, __analogWidth, __analogVRef, __analogCharacteristics[unit - 1]);
-        if (val_type == ESP_ADC_CAL_VAL_EFUSE_TP) {
-            log_i("ADC%u: Characterized using Two Point Value: %u\n", unit, __analogCharacteristics[unit - 1]->vref);
-        } else if (val_type == ESP_ADC_CAL_VAL_EFUSE_VREF) {
-            log_i("ADC%u: Characterized using eFuse Vref: %u\n", unit, __analogCharacteristics[unit - 1]->vref);
-        } else if(__analogVRef != DEFAULT_VREF){
-            log_i("ADC%u: Characterized using Vref to GPIO%u: %u\n", unit, __analogVRefPin, __analogCharacteristics[unit - 1]->vref);
-        } else {
-            log_i("ADC%u: Characterized using Default Vref: %u\n", unit, __analogCharacteristics[unit - 1]->vref);
+        uint16_t * table = tables[channel];
+        if(table == NULL){
+            table = tables[channel] = __analogGetCalTable(1, __analogChannelAtten(channel));
+            if(table == NULL){
+                out[i] = 0;
+                continue;
+            }
         }
+        out[i] = table[ADC_CONTINUOUS_VALUE(sample) & mask];
     }
-    return esp_adc_cal_raw_to_voltage(adc_reading, __analogCharacteristics[unit - 1]);
 }
 
 int __hallRead()    //hall sensor without LNA
@@ -237,3 +540,7 @@ extern bool adcAttachPin(uint8_t pin) __attribute__ ((weak, alias("__adcAttachPi
 
 extern void analogSetVRefPin(uint8_t pin) __attribute__ ((weak, alias("__analogSetVRefPin")));
 extern uint32_t analogReadMilliVolts(uint8_t pin) __attribute__ ((weak, alias("__analogReadMilliVolts")));
+extern bool analogContinuous(const uint8_t pins[], size_t pinCount, uint32_t sampleRate, size_t bufferFrames, adc_continuous_cb_t cb, void * arg) __attribute__ ((weak, alias("__analogContinuous")));
+extern void analogContinuousStop(void) __attribute__ ((weak, alias("__analogContinuousStop")));
+extern bool analogReadMulti(const uint8_t pins[], size_t n, uint16_t out[], uint16_t oversample) __attribute__ ((weak, alias("__analogReadMulti")));
+extern void analogRawToMilliVoltsBuffer(const uint16_t * in, uint16_t * out, size_t n) __attribute__ ((weak, alias("__analogRawToMilliVoltsBuffer")));
@@ -89,6 +89,33 @@ void analogSetVRefPin(uint8_t pin);
  * */
 uint32_t analogReadMilliVolts(uint8_t pin);
 
+/*
+ * Read up to 16 ADC1 pins in one DMA burst, scanned through the digital controller
+ * pattern table, each result averaged over oversample conversions (n * oversample <= 1024).
+ * Needs I2S0 and fails while analogContinuous() runs
+ * */
+bool analogReadMulti(const uint8_t pins[], size_t n, uint16_t out[], uint16_t oversample);
+
+/*
+ * Continuous sampling through I2S0 DMA, ADC1 pins only, scanned in the given order
+ * cb runs in a driver task with up to bufferFrames samples per DMA buffer;
+ * each sample carries the channel in bits 15-12 and the value in bits 11-0.
+ * analogRead() on ADC1 pins is unavailable until analogContinuousStop()
+ * */
+typedef void (*adc_continuous_cb_t)(uint16_t * samples, size_t count, void * arg);
+
+#define ADC_CONTINUOUS_CHANNEL(sample)  ((sample) >> 12)
+#define ADC_CONTINUOUS_VALUE(sample)    ((sample) & 0x0FFF)
+
+bool analogContinuous(const uint8_t pins[], size_t pinCount, uint32_t sampleRate, size_t bufferFrames, adc_continuous_cb_t cb, void * arg);
+void analogContinuousStop(void);
+
+/*
+ * Convert analogContinuous() samples to MilliVolts, in and out may be the same buffer
+ * uses the calibration of each sample's ADC1 channel at its configured attenuation
+ * */
+void analogRawToMilliVoltsBuffer(const uint16_t * in, uint16_t * out, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,16 +32,37 @@ bool btStarted(){
 }
 
 bool btStart(){
+    return btStartMode(BT_MODE_DEFAULT);
+}
+
+bool btStartMode(bt_mode mode){
     esp_bt_controller_config_t cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
+    esp_bt_mode_t bt_mode = BT_MODE;
+    switch(mode){
+        case BT_MODE_BLE:        bt_mode = ESP_BT_MODE_BLE; break;
+        case BT_MODE_CLASSIC_BT: bt_mode = ESP_BT_MODE_CLASSIC_BT; break;
+        case BT_MODE_BTDM:       bt_mode = ESP_BT_MODE_BTDM; break;
+        default: break;
+    }
     if(esp_bt_controller_get_status() == ESP_BT_CONTROLLER_STATUS_ENABLED){
         return true;
     }
     if(esp_bt_controller_get_status() == ESP_BT_CONTROLLER_STATUS_IDLE){
-        esp_bt_controller_init(&cfg);
+        // the controller only enables the mode it was initialised with, the other one can be given back
+        cfg.mode = bt_mode;
+        if(bt_mode == ESP_BT_MODE_BLE){
+            esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT);
+        } else if(bt_mode == ESP_BT_MODE_CLASSIC_BT){
+            esp_bt_controller_mem_release(ESP_BT_MODE_BLE);
+        }
+        if(esp_bt_controller_init(&cfg) != ESP_OK){
+            log_e("BT Init failed");
+            return false;
+        }
         while(esp_bt_controller_get_status() == ESP_BT_CONTROLLER_STATUS_IDLE){}
     }
     if(esp_bt_controller_get_status() == ESP_BT_CONTROLLER_STATUS_INITED){
-        if (esp_bt_controller_enable(BT_MODE)) {
+        if (esp_bt_controller_enable(bt_mode)) {
             log_e("BT Enable failed");
             return false;
         }
@@ -90,6 +111,11 @@ bool btStart()
     return false;
 }
 
+bool btStartMode(bt_mode mode)
+{
+    return false;
+}
+
 bool btStop()
 {
     return false;
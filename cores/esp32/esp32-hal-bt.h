@@ -21,8 +21,16 @@
 extern "C" {
 #endif
 
+typedef enum {
+    BT_MODE_DEFAULT,    // what the SDK was built with, Classic and BLE
+    BT_MODE_BLE,        // BLE only, the Classic controller memory goes back to the heap until restart
+    BT_MODE_CLASSIC_BT, // Classic only, the same for the BLE controller memory
+    BT_MODE_BTDM        // both
+} bt_mode;
+
 bool btStarted();
 bool btStart();
+bool btStartMode(bt_mode mode);
 bool btStop();
 
 #ifdef __cplusplus
@@ -26,19 +26,70 @@
 #include "soc/efuse_reg.h"
 #include "esp32-hal.h"
 #include "esp32-hal-cpu.h"
+#include "esp_freertos_hooks.h"
 
-typedef struct apb_change_cb_s {
-        struct apb_change_cb_s * prev;
-        struct apb_change_cb_s * next;
+#ifndef CPU_GOVERNOR_PERIOD_MS
+#define CPU_GOVERNOR_PERIOD_MS 100
+#endif
+
+#ifndef CPU_GOVERNOR_UP_LOAD
+#define CPU_GOVERNOR_UP_LOAD 70     // percent, jump to the highest step above this
+#endif
+
+#ifndef CPU_GOVERNOR_DOWN_LOAD
+#define CPU_GOVERNOR_DOWN_LOAD 30   // percent, one step down after CPU_GOVERNOR_DOWN_PERIODS below this
+#endif
+
+#ifndef CPU_GOVERNOR_DOWN_PERIODS
+#define CPU_GOVERNOR_DOWN_PERIODS 5
+#endif
+
+#ifndef CPU_GOVERNOR_TASK_STACK_SIZE
+#define CPU_GOVERNOR_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef CPU_GOVERNOR_TASK_PRIORITY
+#define CPU_GOVERNOR_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#endif
+
+#ifndef CPU_GOVERNOR_TASK_RUNNING_CORE
+#define CPU_GOVERNOR_TASK_RUNNING_CORE -1
+#endif
+
+#define CPU_GOVERNOR_MAX_STEPS 6
+
+#ifndef APB_CHANGE_MAX_CALLBACKS
+#define APB_CHANGE_MAX_CALLBACKS 16
+#endif
+
+#ifndef APB_CHANGE_MAX_REG_WRITES
+#define APB_CHANGE_MAX_REG_WRITES 32
+#endif
+
+typedef struct {
         void * arg;
         apb_change_cb_t cb;
 } apb_change_t;
 
+typedef struct {
+        volatile uint32_t * reg;
+        uint32_t mask;
+        uint32_t value;
+} apb_reg_write_t;
+
 const uint32_t MHZ = 1000000;
 
-static apb_change_t * apb_change_callbacks = NULL;
+// kept in registration order
+static apb_change_t apb_change_callbacks[APB_CHANGE_MAX_CALLBACKS];
+static uint8_t apb_change_count = 0;
 static xSemaphoreHandle apb_change_lock = NULL;
 
+// register values for the new APB, written right after the clock switch
+static apb_reg_write_t apb_reg_writes[APB_CHANGE_MAX_REG_WRITES];
+static uint8_t apb_reg_write_count = 0;
+static bool apb_reg_writes_open = false;
+static portMUX_TYPE apb_change_mux = portMUX_INITIALIZER_UNLOCKED;
+
 static void initApbChangeCallback(){
     static volatile bool initialized = false;
     if(!initialized){
@@ -50,57 +101,55 @@ static void initApbChangeCallback(){
     }
 }
 
+// must be called with apb_change_lock taken
 static void triggerApbChangeCallback(apb_change_ev_t ev_type, uint32_t old_apb, uint32_t new_apb){
-    initApbChangeCallback();
-    xSemaphoreTake(apb_change_lock, portMAX_DELAY);
-    apb_change_t * r = apb_change_callbacks;
-    if( r != NULL ){
-        if(ev_type == APB_BEFORE_CHANGE )
-            while(r != NULL){
-                r->cb(r->arg, ev_type, old_apb, new_apb);
-                r=r->next;
-            }
-        else { // run backwards through chain
-            while(r->next != NULL) r = r->next; // find first added
-            while( r != NULL){
-                r->cb(r->arg, ev_type, old_apb, new_apb);
-                r=r->prev;
-            }
+    if(ev_type == APB_BEFORE_CHANGE){
+        // newest first
+        for(int i = apb_change_count - 1; i >= 0; i--){
+            apb_change_callbacks[i].cb(apb_change_callbacks[i].arg, ev_type, old_apb, new_apb);
+        }
+    } else {
+        for(int i = 0; i < apb_change_count; i++){
+            apb_change_callbacks[i].cb(apb_change_callbacks[i].arg, ev_type, old_apb, new_apb);
         }
     }
-    xSemaphoreGive(apb_change_lock);
 }
 
-bool addApbChangeCallback(void * arg, apb_change_cb_t cb){
-    initApbChangeCallback();
-    apb_change_t * c = (apb_change_t*)malloc(sizeof(apb_change_t));
-    if(!c){
-        log_e("Callback Object Malloc Failed");
+bool apbChangeQueueWrite(volatile void * reg, uint32_t mask, uint32_t value){
+    if(!apb_reg_writes_open){
+        log_e("register writes can only be queued from APB_BEFORE_CHANGE");
+        return false;
+    }
+    if(apb_reg_write_count >= APB_CHANGE_MAX_REG_WRITES){
+        log_e("too many register writes, %u max", APB_CHANGE_MAX_REG_WRITES);
         return false;
     }
-    c->next = NULL;
-    c->prev = NULL;
-    c->arg = arg;
-    c->cb = cb;
+    apb_reg_write_t * w = &apb_reg_writes[apb_reg_write_count++];
+    w->reg = (volatile uint32_t *)reg;
+    w->mask = mask;
+    w->value = value & mask;
+    return true;
+}
+
+bool addApbChangeCallback(void * arg, apb_change_cb_t cb){
+    initApbChangeCallback();
     xSemaphoreTake(apb_change_lock, portMAX_DELAY);
-    if(apb_change_callbacks == NULL){
-        apb_change_callbacks = c;
-    } else {
-        apb_change_t * r = apb_change_callbacks;
-        // look for duplicate callbacks
-        while( (r != NULL ) && !((r->cb == cb) && ( r->arg == arg))) r = r->next;
-        if (r) {
-            log_e("duplicate func=%08X arg=%08X",c->cb,c->arg);
-            free(c);
+    // look for duplicate callbacks
+    for(int i = 0; i < apb_change_count; i++){
+        if(apb_change_callbacks[i].cb == cb && apb_change_callbacks[i].arg == arg){
+            log_e("duplicate func=%08X arg=%08X",cb,arg);
             xSemaphoreGive(apb_change_lock);
             return false;
         }
-        else {
-            c->next = apb_change_callbacks;
-            apb_change_callbacks-> prev = c;
-            apb_change_callbacks = c;
-        }
     }
+    if(apb_change_count >= APB_CHANGE_MAX_CALLBACKS){
+        log_e("no free callback slot, %u max", APB_CHANGE_MAX_CALLBACKS);
+        xSemaphoreGive(apb_change_lock);
+        return false;
+    }
+    apb_change_callbacks[apb_change_count].arg = arg;
+    apb_change_callbacks[apb_change_count].cb = cb;
+    apb_change_count++;
     xSemaphoreGive(apb_change_lock);
     return true;
 }
@@ -108,25 +157,18 @@ bool addApbChangeCallback(void * arg, apb_change_cb_t cb){
 bool removeApbChangeCallback(void * arg, apb_change_cb_t cb){
     initApbChangeCallback();
     xSemaphoreTake(apb_change_lock, portMAX_DELAY);
-    apb_change_t * r = apb_change_callbacks;
     // look for matching callback
-    while( (r != NULL ) && !((r->cb == cb) && ( r->arg == arg))) r = r->next;
-    if ( r == NULL ) {
-        log_e("not found func=%08X arg=%08X",cb,arg);
-        xSemaphoreGive(apb_change_lock);
-        return false;
-        }
-    else {
-        // patch links
-        if(r->prev) r->prev->next = r->next;
-        else { // this is first link
-           apb_change_callbacks = r->next;
+    for(int i = 0; i < apb_change_count; i++){
+        if(apb_change_callbacks[i].cb == cb && apb_change_callbacks[i].arg == arg){
+            apb_change_count--;
+            memmove(&apb_change_callbacks[i], &apb_change_callbacks[i + 1], (apb_change_count - i) * sizeof(apb_change_t));
+            xSemaphoreGive(apb_change_lock);
+            return true;
         }
-        if(r->next) r->next->prev = r->prev;
-        free(r);
     }
+    log_e("not found func=%08X arg=%08X",cb,arg);
     xSemaphoreGive(apb_change_lock);
-    return true;
+    return false;
 }
 
 static uint32_t calculateApb(rtc_cpu_freq_config_t * conf){
@@ -138,6 +180,11 @@ static uint32_t calculateApb(rtc_cpu_freq_config_t * conf){
 
 void esp_timer_impl_update_apb_freq(uint32_t apb_ticks_per_us); //private in IDF
 
+static bool cpuIsRated160(){
+    return REG_GET_BIT(EFUSE_BLK0_RDATA3_REG, EFUSE_RD_CHIP_CPU_FREQ_RATED) &&
+           REG_GET_BIT(EFUSE_BLK0_RDATA3_REG, EFUSE_RD_CHIP_CPU_FREQ_LOW);
+}
+
 bool setCpuFrequencyMhz(uint32_t cpu_freq_mhz){
     rtc_cpu_freq_config_t conf, cconf;
     uint32_t capb, apb;
@@ -165,8 +212,7 @@ bool setCpuFrequencyMhz(uint32_t cpu_freq_mhz){
     //check if cpu supports the frequency
     if(cpu_freq_mhz == 240){
         //Check if ESP32 is rated for a CPU frequency of 160MHz only
-        if (REG_GET_BIT(EFUSE_BLK0_RDATA3_REG, EFUSE_RD_CHIP_CPU_FREQ_RATED) &&
-            REG_GET_BIT(EFUSE_BLK0_RDATA3_REG, EFUSE_RD_CHIP_CPU_FREQ_LOW)) {
+        if (cpuIsRated160()) {
             log_e("Can not switch to 240 MHz! Chip CPU frequency rated for 160MHz.");
             cpu_freq_mhz = 160;
         }
@@ -187,11 +233,15 @@ bool setCpuFrequencyMhz(uint32_t cpu_freq_mhz){
     //New APB
     apb = calculateApb(&conf);
     log_d("%s: %u / %u = %u Mhz, APB: %u Hz", (conf.source == RTC_CPU_FREQ_SRC_PLL)?"PLL":((conf.source == RTC_CPU_FREQ_SRC_APLL)?"APLL":((conf.source == RTC_CPU_FREQ_SRC_XTAL)?"XTAL":"8M")), conf.source_freq_mhz, conf.div, conf.freq_mhz, apb);
-    //Call peripheral functions before the APB change
-    if(apb_change_callbacks){
-        triggerApbChangeCallback(APB_BEFORE_CHANGE, capb, apb);
-    }
-    //Make the frequency change
+    initApbChangeCallback();
+    xSemaphoreTake(apb_change_lock, portMAX_DELAY);
+    //Call peripheral functions before the APB change, they may queue register writes for the new APB
+    apb_reg_write_count = 0;
+    apb_reg_writes_open = true;
+    triggerApbChangeCallback(APB_BEFORE_CHANGE, capb, apb);
+    apb_reg_writes_open = false;
+    //Make the frequency change and reprogram the peripherals in one go
+    portENTER_CRITICAL(&apb_change_mux);
     rtc_clk_cpu_freq_set_config_fast(&conf);
     if(capb != apb){
         //Update REF_TICK (uncomment if REF_TICK is different than 1MHz)
@@ -206,10 +256,14 @@ bool setCpuFrequencyMhz(uint32_t cpu_freq_mhz){
     //Update FreeRTOS Tick Divisor
     uint32_t fcpu = (conf.freq_mhz >= 80)?(conf.freq_mhz * MHZ):(apb);
     _xt_tick_divisor = fcpu / XT_TICK_PER_SEC;
-    //Call peripheral functions after the APB change
-    if(apb_change_callbacks){
-        triggerApbChangeCallback(APB_AFTER_CHANGE, capb, apb);
+    for(int i = 0; i < apb_reg_write_count; i++){
+        apb_reg_write_t * w = &apb_reg_writes[i];
+        *w->reg = (*w->reg & ~w->mask) | w->value;
     }
+    portEXIT_CRITICAL(&apb_change_mux);
+    //Call peripheral functions after the APB change
+    triggerApbChangeCallback(APB_AFTER_CHANGE, capb, apb);
+    xSemaphoreGive(apb_change_lock);
     return true;
 }
 
@@ -228,3 +282,201 @@ uint32_t getApbFrequency(){
     rtc_clk_cpu_freq_get_config(&conf);
     return calculateApb(&conf);
 }
+
+/*
+ * Frequency governor
+ * On every tick each core records whether its idle task was the one running,
+ * the load of the busier core over a period picks the next frequency step.
+ */
+typedef struct {
+    TaskHandle_t task;
+    volatile bool stop;
+    xSemaphoreHandle lock;
+    uint8_t stepCount;
+    uint8_t step;                                // index into steps, 0 = fastest
+    uint8_t lowPeriods;
+    uint8_t load;
+    uint32_t steps[CPU_GOVERNOR_MAX_STEPS];      // descending MHz
+    uint16_t locks[CPU_GOVERNOR_MAX_STEPS];      // cpuFreqLock() count per step
+    volatile uint32_t ticks[portNUM_PROCESSORS];
+    volatile uint32_t idleTicks[portNUM_PROCESSORS];
+} cpu_governor_t;
+
+static cpu_governor_t * cpu_governor = NULL;
+
+static void IRAM_ATTR cpuGovernorTickHook(){
+    cpu_governor_t * g = cpu_governor;
+    if(!g){
+        return;
+    }
+    BaseType_t core = xPortGetCoreID();
+    g->ticks[core]++;
+    if(xTaskGetCurrentTaskHandleForCPU(core) == xTaskGetIdleTaskHandleForCPU(core)){
+        g->idleTicks[core]++;
+    }
+}
+
+// fastest step that satisfies the active locks, steps are sorted fastest first
+static uint8_t cpuGovernorLockedStep(cpu_governor_t * g){
+    for(int i = 0; i < g->stepCount; i++){
+        if(g->locks[i]){
+            return i;
+        }
+    }
+    return g->stepCount - 1;
+}
+
+static void cpuGovernorApply(cpu_governor_t * g, uint8_t step){
+    uint8_t locked = cpuGovernorLockedStep(g);
+    if(step > locked){
+        step = locked;
+    }
+    if(step != g->step && setCpuFrequencyMhz(g->steps[step])){
+        g->step = step;
+        g->lowPeriods = 0;
+    }
+}
+
+static void cpuGovernorTask(void * arg){
+    cpu_governor_t * g = (cpu_governor_t *)arg;
+    uint32_t lastTicks[portNUM_PROCESSORS] = {0};
+    uint32_t lastIdle[portNUM_PROCESSORS] = {0};
+    TickType_t wake = xTaskGetTickCount();
+    while(!g->stop){
+        vTaskDelayUntil(&wake, CPU_GOVERNOR_PERIOD_MS / portTICK_PERIOD_MS);
+        uint8_t load = 0;
+        for(int core = 0; core < portNUM_PROCESSORS; core++){
+            uint32_t ticks = g->ticks[core], idle = g->idleTicks[core];
+            uint32_t total = ticks - lastTicks[core];
+            if(total){
+                uint32_t coreLoad = 100 - ((idle - lastIdle[core]) * 100) / total;
+                if(coreLoad > load){
+                    load = coreLoad;
+                }
+            }
+            lastTicks[core] = ticks;
+            lastIdle[core] = idle;
+        }
+        g->load = load;
+        xSemaphoreTake(g->lock, portMAX_DELAY);
+        if(load >= CPU_GOVERNOR_UP_LOAD){
+            g->lowPeriods = 0;
+            cpuGovernorApply(g, 0);
+        } else if(load <= CPU_GOVERNOR_DOWN_LOAD && g->step < g->stepCount - 1){
+            if(g->lowPeriods < CPU_GOVERNOR_DOWN_PERIODS){
+                g->lowPeriods++;
+            }
+            if(g->lowPeriods >= CPU_GOVERNOR_DOWN_PERIODS){
+                cpuGovernorApply(g, g->step + 1);
+            }
+        } else {
+            g->lowPeriods = 0;
+        }
+        xSemaphoreGive(g->lock);
+    }
+    g->task = NULL;
+    vTaskDelete(NULL);
+}
+
+bool cpuFreqGovernorBegin(uint32_t min_mhz, uint32_t max_mhz){
+    uint32_t xtal = rtc_clk_xtal_freq_get();
+    uint32_t candidates[CPU_GOVERNOR_MAX_STEPS] = {240, 160, 80, xtal, xtal / 2, (xtal >= RTC_XTAL_FREQ_40M)?(xtal / 4):0};
+    if(cpu_governor){
+        log_e("CPU governor already running");
+        return false;
+    }
+    if(max_mhz > 160 && cpuIsRated160()){
+        max_mhz = 160;
+    }
+    cpu_governor_t * g = (cpu_governor_t *)calloc(1, sizeof(cpu_governor_t));
+    if(!g){
+        return false;
+    }
+    for(int i = 0; i < CPU_GOVERNOR_MAX_STEPS; i++){
+        if(candidates[i] && candidates[i] <= max_mhz && candidates[i] >= min_mhz){
+            g->steps[g->stepCount++] = candidates[i];
+        }
+    }
+    if(!g->stepCount){
+        log_e("No CPU frequency between %u and %u MHz", min_mhz, max_mhz);
+        free(g);
+        return false;
+    }
+    g->lock = xSemaphoreCreateMutex();
+    if(!g->lock){
+        free(g);
+        return false;
+    }
+    // start from the fastest step, it goes down once the load allows it
+    g->step = 0;
+    setCpuFrequencyMhz(g->steps[0]);
+    cpu_governor = g;
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        esp_register_freertos_tick_hook_for_cpu(cpuGovernorTickHook, core);
+    }
+    if(xTaskCreateUniversal(cpuGovernorTask, "cpu_governor", CPU_GOVERNOR_TASK_STACK_SIZE, g, CPU_GOVERNOR_TASK_PRIORITY, &g->task, CPU_GOVERNOR_TASK_RUNNING_CORE) != pdPASS){
+        log_e("CPU governor task create failed");
+        cpuFreqGovernorEnd();
+        return false;
+    }
+    return true;
+}
+
+void cpuFreqGovernorEnd(){
+    cpu_governor_t * g = cpu_governor;
+    if(!g){
+        return;
+    }
+    if(g->task){
+        g->stop = true;
+        while(g->task){
+            vTaskDelay(1);
+        }
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        esp_deregister_freertos_tick_hook_for_cpu(cpuGovernorTickHook, core);
+    }
+    cpu_governor = NULL;
+    vSemaphoreDelete(g->lock);
+    free(g);
+}
+
+uint8_t cpuFreqGovernorLoad(){
+    return cpu_governor ? cpu_governor->load : 0;
+}
+
+bool cpuFreqLock(uint32_t min_mhz){
+    cpu_governor_t * g = cpu_governor;
+    if(!g){
+        return getCpuFrequencyMhz() >= min_mhz || setCpuFrequencyMhz(min_mhz);
+    }
+    xSemaphoreTake(g->lock, portMAX_DELAY);
+    int step = g->stepCount - 1;
+    while(step > 0 && g->steps[step] < min_mhz){
+        step--;
+    }
+    g->locks[step]++;
+    // raise right away, the caller is about to run its critical section
+    if(g->step > step){
+        cpuGovernorApply(g, step);
+    }
+    bool ok = g->steps[g->step] >= min_mhz;
+    xSemaphoreGive(g->lock);
+    return ok;
+}
+
+void cpuFreqUnlock(uint32_t min_mhz){
+    cpu_governor_t * g = cpu_governor;
+    if(!g){
+        return;
+    }
+    xSemaphoreTake(g->lock, portMAX_DELAY);
+    int step = g->stepCount - 1;
+    while(step > 0 && g->steps[step] < min_mhz){
+        step--;
+    }
+    if(g->locks[step]){
+        g->locks[step]--;
+    }
+    xSemaphoreGive(g->lock);
+}
@@ -29,6 +29,9 @@ typedef void (* apb_change_cb_t)(void * arg, apb_change_ev_t ev_type, uint32_t o
 
 bool addApbChangeCallback(void * arg, apb_change_cb_t cb);
 bool removeApbChangeCallback(void * arg, apb_change_cb_t cb);
+//From APB_BEFORE_CHANGE only: write (reg & ~mask) | value right after the clock switch,
+//inside the same critical section, in the order queued
+bool apbChangeQueueWrite(volatile void * reg, uint32_t mask, uint32_t value);
 
 //function takes the following frequencies as valid values:
 //  240, 160, 80    <<< For all XTAL types
@@ -41,6 +44,17 @@ uint32_t getCpuFrequencyMhz();  // In MHz
 uint32_t getXtalFrequencyMhz(); // In MHz
 uint32_t getApbFrequency();     // In Hz
 
+//Governor: switches between the valid frequencies within [min_mhz, max_mhz] from the
+//per-tick CPU load, fastest step above CPU_GOVERNOR_UP_LOAD, one step down after
+//CPU_GOVERNOR_DOWN_PERIODS periods below CPU_GOVERNOR_DOWN_LOAD
+bool cpuFreqGovernorBegin(uint32_t min_mhz, uint32_t max_mhz);
+void cpuFreqGovernorEnd();
+uint8_t cpuFreqGovernorLoad();  // In percent, busier core over the last period
+
+//Keep the CPU at min_mhz or above until the matching cpuFreqUnlock(), locks nest
+bool cpuFreqLock(uint32_t min_mhz);
+void cpuFreqUnlock(uint32_t min_mhz);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,23 @@
 #include "soc/rtc_io_reg.h"
 #include "soc/rtc_cntl_reg.h"
 #include "soc/sens_reg.h"
+#include "soc/rtc.h"
+#include "driver/i2s.h"
+
+#ifndef DAC_TASK_STACK_SIZE
+#define DAC_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef DAC_TASK_PRIORITY
+#define DAC_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#endif
+
+#ifndef DAC_TASK_RUNNING_CORE
+#define DAC_TASK_RUNNING_CORE -1
+#endif
+
+#define DAC_I2S_PORT        0   // the only one wired to the DAC
+#define DAC_WRITE_WAIT_MS   100 // for the DMA buffers, between checks whether to stop
 
 void IRAM_ATTR __dacWrite(uint8_t pin, uint8_t value)
 {
@@ -31,9 +48,6 @@ void IRAM_ATTR __dacWrite(uint8_t pin, uint8_t value)
     uint8_t channel = pin - 25;
 
 
-    //Disable Tone
-    CLEAR_PERI_REG_MASK(SENS_SAR_DAC_CTRL1_REG, SENS_SW_TONE_EN);
-
     if (channel) {
         //Disable Channel Tone
         CLEAR_PERI_REG_MASK(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_CW_EN2_M);
@@ -49,6 +63,159 @@ void IRAM_ATTR __dacWrite(uint8_t pin, uint8_t value)
         //Channel output enable
         SET_PERI_REG_MASK(RTC_IO_PAD_DAC1_REG, RTC_IO_PDAC1_XPD_DAC | RTC_IO_PDAC1_DAC_XPD_FORCE);
     }
+    //Disable Tone, unless the other channel still uses it
+    if (!GET_PERI_REG_MASK(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_CW_EN1_M | SENS_DAC_CW_EN2_M)) {
+        CLEAR_PERI_REG_MASK(SENS_SAR_DAC_CTRL1_REG, SENS_SW_TONE_EN);
+    }
+}
+
+bool __dacCosine(uint8_t pin, uint32_t freq, uint8_t amplitude, uint16_t phase)
+{
+    if(pin < 25 || pin > 26){
+        return false;//not dac pin
+    }
+    // freq = RTC8M * step / 65536, shared by both channels
+    uint32_t step = (uint32_t)(((uint64_t)freq * 65536 + RTC_FAST_CLK_FREQ_APPROX / 2) / RTC_FAST_CLK_FREQ_APPROX);
+    if(!step || step > SENS_SW_FSTEP_V || amplitude > 3){
+        log_e("cosine of %u Hz / %u not possible", freq, 1 << amplitude);
+        return false;
+    }
+    pinMode(pin, ANALOG);
+    uint8_t channel = pin - 25;
+    // inverting the MSB makes the wave unsigned, inverting the rest too shifts it by 180 degrees
+    uint32_t inv = (phase >= 90 && phase < 270) ? 3 : 2;
+
+    SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL1_REG, SENS_SW_FSTEP, step, SENS_SW_FSTEP_S);
+    SET_PERI_REG_MASK(SENS_SAR_DAC_CTRL1_REG, SENS_SW_TONE_EN);
+    if (channel) {
+        SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_SCALE2, amplitude, SENS_DAC_SCALE2_S);
+        SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_INV2, inv, SENS_DAC_INV2_S);
+        SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_DC2, 0, SENS_DAC_DC2_S);
+        SET_PERI_REG_MASK(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_CW_EN2_M);
+        SET_PERI_REG_MASK(RTC_IO_PAD_DAC2_REG, RTC_IO_PDAC2_XPD_DAC | RTC_IO_PDAC2_DAC_XPD_FORCE);
+    } else {
+        SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_SCALE1, amplitude, SENS_DAC_SCALE1_S);
+        SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_INV1, inv, SENS_DAC_INV1_S);
+        SET_PERI_REG_BITS(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_DC1, 0, SENS_DAC_DC1_S);
+        SET_PERI_REG_MASK(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_CW_EN1_M);
+        SET_PERI_REG_MASK(RTC_IO_PAD_DAC1_REG, RTC_IO_PDAC1_XPD_DAC | RTC_IO_PDAC1_DAC_XPD_FORCE);
+    }
+    return true;
+}
+
+typedef struct {
+    i2s_t * bus;
+    TaskHandle_t task;
+    const uint8_t * samples;
+    size_t len;
+    bool loop;
+    volatile bool stop;
+    uint8_t pin;
+} dac_buffer_t;
+
+static dac_buffer_t __dacBuffer = { 0 };
+
+static void __dacTask(void * arg)
+{
+    dac_buffer_t * d = (dac_buffer_t *)arg;
+    size_t frames = i2sBufferSize(d->bus) / sizeof(uint32_t);
+    uint32_t * chunk = (uint32_t *)malloc(frames * sizeof(uint32_t));
+    size_t pos = 0;
+    while(chunk && !d->stop) {
+        size_t n = (d->len - pos < frames) ? d->len - pos : frames;
+        for(size_t i = 0; i < n; i++) {
+            // the DAC takes the upper byte of each 16 bit sample, the same one on both channels
+            uint32_t s = d->samples[pos + i];
+            chunk[i] = (s << 24) | (s << 8);
+        }
+        const uint8_t * data = (const uint8_t *)chunk;
+        size_t left = n * sizeof(uint32_t);
+        while(left && !d->stop) {
+            size_t written = i2sWrite(d->bus, data, left, DAC_WRITE_WAIT_MS);
+            data += written;
+            left -= written;
+        }
+        pos += n;
+        if(pos >= d->len) {
+            if(!d->loop) {
+                break;
+            }
+            pos = 0;
+        }
+    }
+    if(!chunk) {
+        log_e("no memory for the DAC buffer");
+    }
+    free(chunk);
+    d->task = NULL;
+    vTaskDelete(NULL);
+}
+
+void __dacStop(uint8_t pin)
+{
+    dac_buffer_t * d = &__dacBuffer;
+    if(d->bus && d->pin == pin) {
+        d->stop = true;
+        while(d->task) {
+            vTaskDelay(1);
+        }
+        i2s_set_dac_mode(I2S_DAC_CHANNEL_DISABLE);
+        i2sEnd(d->bus);
+        d->bus = NULL;
+    }
+    if(pin == 25 || pin == 26) {
+        CLEAR_PERI_REG_MASK(SENS_SAR_DAC_CTRL2_REG, (pin == 25) ? SENS_DAC_CW_EN1_M : SENS_DAC_CW_EN2_M);
+        if (!GET_PERI_REG_MASK(SENS_SAR_DAC_CTRL2_REG, SENS_DAC_CW_EN1_M | SENS_DAC_CW_EN2_M)) {
+            CLEAR_PERI_REG_MASK(SENS_SAR_DAC_CTRL1_REG, SENS_SW_TONE_EN);
+        }
+    }
+}
+
+bool __dacWriteBuffer(uint8_t pin, const uint8_t * samples, size_t len, uint32_t rate, bool loop)
+{
+    if(pin < 25 || pin > 26 || !samples || !len){
+        return false;
+    }
+    dac_buffer_t * d = &__dacBuffer;
+    if(d->bus) {
+        // one buffer at a time, on either pin
+        __dacStop(d->pin);
+    }
+    __dacStop(pin);
+    i2s_hal_config_t config;
+    i2sDefaultConfig(&config);
+    config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_DAC_BUILT_IN);
+    config.sampleRate = rate;
+    config.bitsPerSample = I2S_BITS_PER_SAMPLE_16BIT;
+    config.channelFormat = I2S_CHANNEL_FMT_RIGHT_LEFT;
+    config.commFormat = I2S_COMM_FORMAT_I2S_MSB;
+    d->bus = i2sBegin(DAC_I2S_PORT, &config);
+    if(!d->bus) {
+        log_e("I2S%u for the DAC failed", DAC_I2S_PORT);
+        return false;
+    }
+    i2s_set_dac_mode((pin == 25) ? I2S_DAC_CHANNEL_RIGHT_EN : I2S_DAC_CHANNEL_LEFT_EN);
+    d->pin = pin;
+    d->samples = samples;
+    d->len = len;
+    d->loop = loop;
+    d->stop = false;
+    if(xTaskCreateUniversal(__dacTask, "dac", DAC_TASK_STACK_SIZE, d, DAC_TASK_PRIORITY, &d->task, DAC_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("DAC task create failed");
+        d->task = NULL;
+        __dacStop(pin);
+        return false;
+    }
+    return true;
+}
+
+bool __dacBufferBusy(uint8_t pin)
+{
+    return __dacBuffer.task && __dacBuffer.pin == pin;
 }
 
 extern void dacWrite(uint8_t pin, uint8_t value) __attribute__ ((weak, alias("__dacWrite")));
+extern bool dacCosine(uint8_t pin, uint32_t freq, uint8_t amplitude, uint16_t phase) __attribute__ ((weak, alias("__dacCosine")));
+extern bool dacWriteBuffer(uint8_t pin, const uint8_t * samples, size_t len, uint32_t rate, bool loop) __attribute__ ((weak, alias("__dacWriteBuffer")));
+extern bool dacBufferBusy(uint8_t pin) __attribute__ ((weak, alias("__dacBufferBusy")));
+extern void dacStop(uint8_t pin) __attribute__ ((weak, alias("__dacStop")));
@@ -24,6 +24,22 @@ extern "C" {
 
 void dacWrite(uint8_t pin, uint8_t value);
 
+/*
+ * The cosine generator: freq (130 Hz and up, one for both pins) at
+ * full scale >> amplitude (0 - 3), phase 0 or 180 degrees
+ * */
+bool dacCosine(uint8_t pin, uint32_t freq, uint8_t amplitude, uint16_t phase);
+
+/*
+ * Play the 8 bit samples at rate by I2S0 DMA, once or in a loop
+ * until dacStop(); samples have to stay valid while it plays.
+ * One buffer at a time, and I2S0 is taken for it
+ * */
+bool dacWriteBuffer(uint8_t pin, const uint8_t * samples, size_t len, uint32_t rate, bool loop);
+bool dacBufferBusy(uint8_t pin);
+// ends the buffer or cosine on the pin, dacWrite() works again after
+void dacStop(uint8_t pin);
+
 #ifdef __cplusplus
 }
 #endif
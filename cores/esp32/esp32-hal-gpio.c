@@ -18,6 +18,7 @@
 #include "rom/ets_sys.h"
 #include "esp_attr.h"
 #include "esp_intr.h"
+#include "esp_ipc.h"
 #include "rom/gpio.h"
 #include "soc/gpio_reg.h"
 #include "soc/io_mux_reg.h"
@@ -72,11 +73,12 @@ const DRAM_ATTR esp32_gpioMux_t esp32_gpioMux[GPIO_PIN_COUNT]={
 typedef void (*voidFuncPtr)(void);
 typedef void (*voidFuncPtrArg)(void*);
 typedef struct {
-    voidFuncPtr fn;
+    voidFuncPtrArg fn;
     void* arg;
-    bool functional;
 } InterruptHandle_t;
-static InterruptHandle_t __pinInterruptHandlers[GPIO_PIN_COUNT] = {0,};
+// Two words per pin and kept in DRAM, so dispatching a pin never touches flash
+static DRAM_ATTR InterruptHandle_t __pinInterruptHandlers[GPIO_PIN_COUNT] = {0,};
+static uint64_t __pinInterruptFunctional = 0;
 
 #include "driver/rtc_io.h"
 
@@ -197,76 +199,140 @@ extern int IRAM_ATTR __digitalRead(uint8_t pin)
     return 0;
 }
 
-static intr_handle_t gpio_intr_handle = NULL;
+extern void IRAM_ATTR __digitalWritePort(uint8_t bank, uint32_t mask, uint32_t values)
+{
+    if(bank == 0) {
+        GPIO.out_w1ts = values & mask;
+        GPIO.out_w1tc = ~values & mask;
+    } else if(bank == 1) {
+        mask &= 0x3; //only GPIO32 and GPIO33 can output
+        GPIO.out1_w1ts.val = values & mask;
+        GPIO.out1_w1tc.val = ~values & mask;
+    }
+}
+
+extern uint32_t IRAM_ATTR __digitalReadPort(uint8_t bank)
+{
+    if(bank == 0) {
+        return GPIO.in;
+    } else if(bank == 1) {
+        return GPIO.in1.data;
+    }
+    return 0;
+}
+
+// One GPIO interrupt per core, allocated on demand. Every pin is routed to exactly one of them.
+static intr_handle_t gpio_intr_handle[portNUM_PROCESSORS] = {NULL,};
+static int8_t gpio_intr_default_core = -1;
+
+static inline void IRAM_ATTR __dispatchPinInterrupts(uint32_t status, uint8_t base)
+{
+    while(status) {
+        InterruptHandle_t * handler = &__pinInterruptHandlers[base + __builtin_ctz(status)];
+        status &= status - 1;
+        if(handler->fn) {
+            // handlers attached without an argument simply ignore it
+            handler->fn(handler->arg);
+        }
+    }
+}
 
-static void IRAM_ATTR __onPinInterrupt()
+static void IRAM_ATTR __onPinInterrupt(void * arg)
 {
     uint32_t gpio_intr_status_l=0;
     uint32_t gpio_intr_status_h=0;
 
-    gpio_intr_status_l = GPIO.status;
-    gpio_intr_status_h = GPIO.status1.val;
+    // only the pins routed to this core, the other core services its own
+    if(xPortGetCoreID()) {
+        gpio_intr_status_l = GPIO.acpu_int;
+        gpio_intr_status_h = GPIO.acpu_int1.intr;
+    } else {
+        gpio_intr_status_l = GPIO.pcpu_int;
+        gpio_intr_status_h = GPIO.pcpu_int1.intr;
+    }
     GPIO.status_w1tc = gpio_intr_status_l;//Clear intr for gpio0-gpio31
     GPIO.status1_w1tc.val = gpio_intr_status_h;//Clear intr for gpio32-39
 
-    uint8_t pin=0;
-    if(gpio_intr_status_l) {
-        do {
-            if(gpio_intr_status_l & ((uint32_t)1 << pin)) {
-                if(__pinInterruptHandlers[pin].fn) {
-                    if(__pinInterruptHandlers[pin].arg){
-                        ((voidFuncPtrArg)__pinInterruptHandlers[pin].fn)(__pinInterruptHandlers[pin].arg);
-                    } else {
-                        __pinInterruptHandlers[pin].fn();
-                    }
-                }
-            }
-        } while(++pin<32);
+    __dispatchPinInterrupts(gpio_intr_status_l, 0);
+    __dispatchPinInterrupts(gpio_intr_status_h, 32);
+}
+
+static void __gpioIntrAllocCb(void * arg)
+{
+    esp_intr_alloc(ETS_GPIO_INTR_SOURCE, (int)ESP_INTR_FLAG_IRAM, __onPinInterrupt, NULL, &gpio_intr_handle[xPortGetCoreID()]);
+}
+
+// esp_intr_alloc() binds the interrupt to the calling core, so hop over to the requested one if needed
+static void __gpioIntrAlloc(int8_t core)
+{
+    if(gpio_intr_handle[core]) {
+        return;
     }
-    if(gpio_intr_status_h) {
-        pin=32;
-        do {
-            if(gpio_intr_status_h & ((uint32_t)1 << (pin - 32))) {
-                if(__pinInterruptHandlers[pin].fn) {
-                    if(__pinInterruptHandlers[pin].arg){
-                        ((voidFuncPtrArg)__pinInterruptHandlers[pin].fn)(__pinInterruptHandlers[pin].arg);
-                    } else {
-                        __pinInterruptHandlers[pin].fn();
-                    }
-                }
+    if(core != xPortGetCoreID()) {
+        esp_ipc_call_blocking(core, __gpioIntrAllocCb, NULL);
+    } else {
+        __gpioIntrAllocCb(NULL);
+    }
+}
+
+static void __gpioIntrEnable(bool enable)
+{
+    for(int i=0; i<portNUM_PROCESSORS; i++) {
+        if(gpio_intr_handle[i]) {
+            if(enable) {
+                esp_intr_enable(gpio_intr_handle[i]);
+            } else {
+                esp_intr_disable(gpio_intr_handle[i]);
             }
-        } while(++pin<GPIO_PIN_COUNT);
+        }
     }
 }
 
 extern void cleanupFunctional(void* arg);
 
-extern void __attachInterruptFunctionalArg(uint8_t pin, voidFuncPtrArg userFunc, void * arg, int intr_type, bool functional)
+static void __releasePinInterrupt(uint8_t pin)
 {
-    static bool interrupt_initialized = false;
+    if ((__pinInterruptFunctional & (1ULL << pin)) && __pinInterruptHandlers[pin].arg)
+    {
+    	cleanupFunctional(__pinInterruptHandlers[pin].arg);
+    }
+    __pinInterruptHandlers[pin].fn = NULL;
+    __pinInterruptHandlers[pin].arg = NULL;
+    __pinInterruptFunctional &= ~(1ULL << pin);
+}
 
-    if(!interrupt_initialized) {
-        interrupt_initialized = true;
-        esp_intr_alloc(ETS_GPIO_INTR_SOURCE, (int)ESP_INTR_FLAG_IRAM, __onPinInterrupt, NULL, &gpio_intr_handle);
+static void __attachInterruptOnCore(uint8_t pin, voidFuncPtrArg userFunc, void * arg, int intr_type, bool functional, int8_t core)
+{
+    if(core < 0 || core >= portNUM_PROCESSORS) {
+        // all regular pins share the interrupt of the core that attached the first one
+        if(gpio_intr_default_core < 0) {
+            gpio_intr_default_core = xPortGetCoreID();
+        }
+        core = gpio_intr_default_core;
     }
+    __gpioIntrAlloc(core);
 
+    __gpioIntrEnable(false);
     // if new attach without detach remove old info
-    if (__pinInterruptHandlers[pin].functional && __pinInterruptHandlers[pin].arg)
-    {
-    	cleanupFunctional(__pinInterruptHandlers[pin].arg);
-    }
-    __pinInterruptHandlers[pin].fn = (voidFuncPtr)userFunc;
+    __releasePinInterrupt(pin);
+    __pinInterruptHandlers[pin].fn = userFunc;
     __pinInterruptHandlers[pin].arg = arg;
-    __pinInterruptHandlers[pin].functional = functional;
+    if(functional) {
+        __pinInterruptFunctional |= (1ULL << pin);
+    }
 
-    esp_intr_disable(gpio_intr_handle);
-    if(esp_intr_get_cpu(gpio_intr_handle)) { //APP_CPU
+    if(core) { //APP_CPU
         GPIO.pin[pin].int_ena = 1;
     } else { //PRO_CPU
         GPIO.pin[pin].int_ena = 4;
     }
     GPIO.pin[pin].int_type = intr_type;
-    esp_intr_enable(gpio_intr_handle);
+    __gpioIntrEnable(true);
+}
+
+extern void __attachInterruptFunctionalArg(uint8_t pin, voidFuncPtrArg userFunc, void * arg, int intr_type, bool functional)
+{
+    __attachInterruptOnCore(pin, userFunc, arg, intr_type, functional, -1);
 }
 
 extern void __attachInterruptArg(uint8_t pin, voidFuncPtrArg userFunc, void * arg, int intr_type)
@@ -274,31 +340,33 @@ extern void __attachInterruptArg(uint8_t pin, voidFuncPtrArg userFunc, void * ar
 	__attachInterruptFunctionalArg(pin, userFunc, arg, intr_type, false);
 }
 
+extern void __attachInterruptArgOnCore(uint8_t pin, voidFuncPtrArg userFunc, void * arg, int intr_type, int8_t core)
+{
+    __attachInterruptOnCore(pin, userFunc, arg, intr_type, false, core);
+}
+
 extern void __attachInterrupt(uint8_t pin, voidFuncPtr userFunc, int intr_type) {
     __attachInterruptFunctionalArg(pin, (voidFuncPtrArg)userFunc, NULL, intr_type, false);
 }
 
 extern void __detachInterrupt(uint8_t pin)
 {
-    esp_intr_disable(gpio_intr_handle);
-    if (__pinInterruptHandlers[pin].functional && __pinInterruptHandlers[pin].arg)
-    {
-    	cleanupFunctional(__pinInterruptHandlers[pin].arg);
-    }
-    __pinInterruptHandlers[pin].fn = NULL;
-    __pinInterruptHandlers[pin].arg = NULL;
-    __pinInterruptHandlers[pin].functional = false;
+    __gpioIntrEnable(false);
+    __releasePinInterrupt(pin);
 
     GPIO.pin[pin].int_ena = 0;
     GPIO.pin[pin].int_type = 0;
-    esp_intr_enable(gpio_intr_handle);
+    __gpioIntrEnable(true);
 }
 
 
 extern void pinMode(uint8_t pin, uint8_t mode) __attribute__ ((weak, alias("__pinMode")));
 extern void digitalWrite(uint8_t pin, uint8_t val) __attribute__ ((weak, alias("__digitalWrite")));
 extern int digitalRead(uint8_t pin) __attribute__ ((weak, alias("__digitalRead")));
+extern void digitalWritePort(uint8_t bank, uint32_t mask, uint32_t values) __attribute__ ((weak, alias("__digitalWritePort")));
+extern uint32_t digitalReadPort(uint8_t bank) __attribute__ ((weak, alias("__digitalReadPort")));
 extern void attachInterrupt(uint8_t pin, voidFuncPtr handler, int mode) __attribute__ ((weak, alias("__attachInterrupt")));
 extern void attachInterruptArg(uint8_t pin, voidFuncPtrArg handler, void * arg, int mode) __attribute__ ((weak, alias("__attachInterruptArg")));
+extern void attachInterruptArgOnCore(uint8_t pin, voidFuncPtrArg handler, void * arg, int mode, int8_t core) __attribute__ ((weak, alias("__attachInterruptArgOnCore")));
 extern void detachInterrupt(uint8_t pin) __attribute__ ((weak, alias("__detachInterrupt")));
 
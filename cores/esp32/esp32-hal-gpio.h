@@ -73,12 +73,73 @@ void pinMode(uint8_t pin, uint8_t mode);
 void digitalWrite(uint8_t pin, uint8_t val);
 int digitalRead(uint8_t pin);
 
+/*
+ * Port access: bank 0 is GPIO0-31, bank 1 is GPIO32-39 (bit 0 = GPIO32).
+ * digitalWritePort() drives every pin in mask to its bit in values, set
+ * pins first and then cleared ones, with one register store each.
+ * */
+void digitalWritePort(uint8_t bank, uint32_t mask, uint32_t values);
+uint32_t digitalReadPort(uint8_t bank);
+
 void attachInterrupt(uint8_t pin, void (*)(void), int mode);
 void attachInterruptArg(uint8_t pin, void (*)(void*), void * arg, int mode);
+/*
+ * Route the pin to the GPIO interrupt of the given core instead of the shared one.
+ * A pin that is alone on its core gets the interrupt entry to itself, which keeps
+ * its latency independent of the other attached pins.
+ * */
+void attachInterruptArgOnCore(uint8_t pin, void (*)(void*), void * arg, int mode, int8_t core);
 void detachInterrupt(uint8_t pin);
 
 #ifdef __cplusplus
 }
+
+#include "soc/gpio_struct.h"
+
+/*
+ * Compile time pin variants of digitalWrite()/digitalRead().
+ * The bank and bit are resolved by the compiler, leaving a single register access.
+ * This header may be pulled in from inside an extern "C" block, hence the explicit linkage.
+ * */
+extern "C++" {
+template<uint8_t pin> inline void digitalSetFast()
+{
+    static_assert(pin < 34, "pin can not output");
+    if(pin < 32) {
+        GPIO.out_w1ts = ((uint32_t)1 << (pin & 31));
+    } else {
+        GPIO.out1_w1ts.val = ((uint32_t)1 << (pin & 31));
+    }
+}
+
+template<uint8_t pin> inline void digitalClearFast()
+{
+    static_assert(pin < 34, "pin can not output");
+    if(pin < 32) {
+        GPIO.out_w1tc = ((uint32_t)1 << (pin & 31));
+    } else {
+        GPIO.out1_w1tc.val = ((uint32_t)1 << (pin & 31));
+    }
+}
+
+template<uint8_t pin> inline void digitalWriteFast(uint8_t val)
+{
+    if(val) {
+        digitalSetFast<pin>();
+    } else {
+        digitalClearFast<pin>();
+    }
+}
+
+template<uint8_t pin> inline int digitalReadFast()
+{
+    static_assert(pin < 40, "invalid pin");
+    if(pin < 32) {
+        return (GPIO.in >> (pin & 31)) & 0x1;
+    }
+    return (GPIO.in1.val >> (pin & 31)) & 0x1;
+}
+}
 #endif
 
 #endif /* MAIN_ESP32_HAL_GPIO_H_ */
@@ -0,0 +1,197 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "esp32-hal-heap-trace.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static heap_trace_record_t * _records = NULL;
+static size_t _records_max = 0;
+static size_t _records_used = 0;
+static uint32_t _records_dropped = 0;
+static portMUX_TYPE _trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+bool heapTraceBegin(size_t maxRecords)
+{
+    if(!maxRecords){
+        maxRecords = HEAP_TRACE_MAX_RECORDS;
+    }
+    if(_records){
+        log_w("heap trace already running");
+        return false;
+    }
+    heap_trace_record_t * records = (heap_trace_record_t *)heap_caps_calloc(maxRecords, sizeof(heap_trace_record_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if(!records){
+        log_e("could not allocate %u trace records", maxRecords);
+        return false;
+    }
+    portENTER_CRITICAL(&_trace_mux);
+    _records_max = maxRecords;
+    _records_used = 0;
+    _records_dropped = 0;
+    _records = records;
+    portEXIT_CRITICAL(&_trace_mux);
+    return true;
+}
+
+void heapTraceEnd(void)
+{
+    portENTER_CRITICAL(&_trace_mux);
+    heap_trace_record_t * records = _records;
+    _records = NULL;
+    _records_max = 0;
+    _records_used = 0;
+    portEXIT_CRITICAL(&_trace_mux);
+    free(records);
+}
+
+bool heapTraceActive(void)
+{
+    return _records != NULL;
+}
+
+void heapTraceRecord(const char * tag, void * ptr, size_t size)
+{
+    if(!ptr || !_records){
+        return;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_trace_mux);
+    if(_records && _records_used < _records_max){
+        heap_trace_record_t * r = &_records[_records_used++];
+        r->ptr = ptr;
+        r->size = size;
+        r->tag = tag ? tag : "?";
+        r->timestamp = now;
+    } else if(_records){
+        _records_dropped++;
+    }
+    portEXIT_CRITICAL(&_trace_mux);
+}
+
+void heapTraceForget(void * ptr)
+{
+    if(!ptr || !_records){
+        return;
+    }
+    portENTER_CRITICAL(&_trace_mux);
+    // records are unordered, the last one fills the hole
+    for(size_t i = _records_used; _records && i--; ){
+        if(_records[i].ptr == ptr){
+            _records[i] = _records[--_records_used];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_trace_mux);
+}
+
+void * heapTraceMalloc(const char * tag, size_t size)
+{
+    void * ptr = malloc(size);
+    heapTraceRecord(tag, ptr, size);
+    return ptr;
+}
+
+void * heapTraceCalloc(const char * tag, size_t n, size_t size)
+{
+    void * ptr = calloc(n, size);
+    heapTraceRecord(tag, ptr, n * size);
+    return ptr;
+}
+
+void * heapTraceRealloc(const char * tag, void * ptr, size_t size)
+{
+    void * nptr = realloc(ptr, size);
+    if(nptr || !size){
+        heapTraceForget(ptr);
+        heapTraceRecord(tag, nptr, size);
+    }
+    return nptr;
+}
+
+void heapTraceFree(void * ptr)
+{
+    heapTraceForget(ptr);
+    free(ptr);
+}
+
+uint32_t heapTraceDropped(void)
+{
+    return _records_dropped;
+}
+
+size_t heapTraceGetRecords(heap_trace_record_t * records, size_t max)
+{
+    portENTER_CRITICAL(&_trace_mux);
+    size_t used = _records ? _records_used : 0;
+    if(records && max){
+        memcpy(records, _records, ((used < max) ? used : max) * sizeof(heap_trace_record_t));
+    }
+    portEXIT_CRITICAL(&_trace_mux);
+    return used;
+}
+
+size_t heapTraceGetTags(heap_trace_tag_t * tags, size_t max)
+{
+    if(!tags || !max || !_records){
+        return 0;
+    }
+    // group a copy, so the table is only locked for the memcpy
+    size_t slots = _records_max;
+    heap_trace_record_t * records = (heap_trace_record_t *)malloc(slots * (sizeof(heap_trace_record_t) + sizeof(heap_trace_tag_t)));
+    if(!records){
+        return 0;
+    }
+    heap_trace_tag_t * all = (heap_trace_tag_t *)(records + slots);
+    size_t used = heapTraceGetRecords(records, slots);
+    if(used > slots){
+        used = slots;
+    }
+    size_t count = 0;
+    for(size_t i = 0; i < used; i++){
+        const heap_trace_record_t * r = &records[i];
+        size_t t = 0;
+        // the same literal is usually the same pointer, strcmp catches the rest
+        while(t < count && all[t].tag != r->tag && strcmp(all[t].tag, r->tag)){
+            t++;
+        }
+        if(t == count){
+            all[count].tag = r->tag;
+            all[count].count = 0;
+            all[count].bytes = 0;
+            count++;
+        }
+        all[t].count++;
+        all[t].bytes += r->size;
+    }
+
+    if(max > count){
+        max = count;
+    }
+    for(size_t i = 0; i < max; i++){
+        size_t best = i;
+        for(size_t j = i + 1; j < count; j++){
+            if(all[j].bytes > all[best].bytes){
+                best = j;
+            }
+        }
+        tags[i] = all[best];
+        all[best] = all[i];
+    }
+    free(records);
+    return max;
+}
@@ -0,0 +1,82 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_HEAP_TRACE_H_
+#define _ESP32_HAL_HEAP_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Opt-in allocation tracer. Only allocations made through the heapTrace* calls
+ * (or registered with heapTraceRecord()) are tracked, each under a call-site tag.
+ * While tracing is off the calls fall through to plain malloc/free.
+ */
+#ifndef HEAP_TRACE_MAX_RECORDS
+#define HEAP_TRACE_MAX_RECORDS 256
+#endif
+
+#define HEAP_TRACE_STR_(x) #x
+#define HEAP_TRACE_STR(x) HEAP_TRACE_STR_(x)
+#define HEAP_TRACE_SITE (__FILE__ ":" HEAP_TRACE_STR(__LINE__))
+
+#define TRACE_MALLOC(size)          heapTraceMalloc(HEAP_TRACE_SITE, (size))
+#define TRACE_CALLOC(n, size)       heapTraceCalloc(HEAP_TRACE_SITE, (n), (size))
+#define TRACE_REALLOC(ptr, size)    heapTraceRealloc(HEAP_TRACE_SITE, (ptr), (size))
+#define TRACE_FREE(ptr)             heapTraceFree(ptr)
+
+typedef struct {
+    const char * tag;
+    uint32_t count;     // live allocations
+    uint32_t bytes;     // live bytes
+} heap_trace_tag_t;
+
+typedef struct {
+    void * ptr;
+    uint32_t size;
+    const char * tag;
+    uint32_t timestamp; // millis() at allocation
+} heap_trace_record_t;
+
+// maxRecords 0 uses HEAP_TRACE_MAX_RECORDS, the table lives in internal RAM
+bool heapTraceBegin(size_t maxRecords);
+void heapTraceEnd(void);
+bool heapTraceActive(void);
+
+void * heapTraceMalloc(const char * tag, size_t size);
+void * heapTraceCalloc(const char * tag, size_t n, size_t size);
+void * heapTraceRealloc(const char * tag, void * ptr, size_t size);
+void heapTraceFree(void * ptr);
+
+// track memory allocated elsewhere, forget it before it is released
+void heapTraceRecord(const char * tag, void * ptr, size_t size);
+void heapTraceForget(void * ptr);
+
+// live allocations that did not fit in the table since begin
+uint32_t heapTraceDropped(void);
+// fill up to max entries, return the number available
+size_t heapTraceGetRecords(heap_trace_record_t * records, size_t max);
+// totals per tag, largest first; returns the number of tags filled
+size_t heapTraceGetTags(heap_trace_tag_t * tags, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_HEAP_TRACE_H_ */
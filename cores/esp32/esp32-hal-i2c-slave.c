@@ -0,0 +1,510 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-i2c-slave.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "soc/i2c_reg.h"
+#include "soc/i2c_struct.h"
+#include "soc/dport_reg.h"
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
+
+#define I2C_SLAVE_SCL_IDX(p) ((p==0)?I2CEXT0_SCL_OUT_IDX:I2CEXT1_SCL_OUT_IDX)
+#define I2C_SLAVE_SDA_IDX(p) ((p==0)?I2CEXT0_SDA_OUT_IDX:I2CEXT1_SDA_OUT_IDX)
+
+// same FIFO access address as the master code
+#define DR_REG_I2C_EXT_BASE_FIXED               0x60013000
+#define DR_REG_I2C1_EXT_BASE_FIXED              0x60027000
+
+#define I2C_SLAVE_FIFO_LEN           32
+#define I2C_SLAVE_RX_FIFO_THRESHOLD  28 // drain before the 32 byte FIFO overflows at 400kHz+
+#define I2C_SLAVE_TX_FIFO_THRESHOLD  5
+#define I2C_SLAVE_TIMEOUT_DEFAULT    32000
+#define I2C_SLAVE_EVENT_QUEUE_LEN    16
+
+#ifndef I2C_SLAVE_TASK_STACK_SIZE
+#define I2C_SLAVE_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef I2C_SLAVE_TASK_PRIORITY
+#define I2C_SLAVE_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#endif
+
+#ifndef I2C_SLAVE_TASK_RUNNING_CORE
+#define I2C_SLAVE_TASK_RUNNING_CORE -1
+#endif
+
+enum {
+    I2C_SLAVE_EVT_RX,
+    I2C_SLAVE_EVT_TX,
+    I2C_SLAVE_EVT_STOP_TASK
+};
+
+typedef struct {
+    uint8_t event;
+    bool stop;
+    uint32_t len;
+} i2c_slave_event_t;
+
+// single producer / single consumer byte ring, one slot is kept free
+typedef struct {
+    uint8_t * buf;
+    size_t size;
+    volatile size_t head; // next write
+    volatile size_t tail; // next read
+} i2c_slave_ring_t;
+
+typedef struct {
+    i2c_dev_t * dev;
+    uint8_t num;
+    int8_t sda;
+    int8_t scl;
+    i2c_slave_request_cb_t request_callback;
+    i2c_slave_receive_cb_t receive_callback;
+    void * arg;
+    intr_handle_t intr_handle;
+    TaskHandle_t task_handle;
+    QueueHandle_t event_queue;
+    i2c_slave_ring_t rx; // filled by the ISR, emptied by the task
+    i2c_slave_ring_t tx; // filled by i2cSlaveWrite(), emptied into the TX FIFO
+    uint8_t * rx_data;   // contiguous copy handed to receive_callback
+    uint32_t rx_data_count; // bytes of the running write
+    uint32_t rx_overflow;
+    volatile bool tx_written; // i2cSlaveWrite() ran since the task last cleared it
+    portMUX_TYPE tx_spinlock;
+} i2c_slave_struct_t;
+
+static i2c_slave_struct_t _i2c_slave_array[2] = {
+    {(volatile i2c_dev_t *)(DR_REG_I2C_EXT_BASE_FIXED), 0, -1, -1, NULL, NULL, NULL, NULL, NULL, NULL, {0}, {0}, NULL, 0, 0, false, portMUX_INITIALIZER_UNLOCKED},
+    {(volatile i2c_dev_t *)(DR_REG_I2C1_EXT_BASE_FIXED), 1, -1, -1, NULL, NULL, NULL, NULL, NULL, NULL, {0}, {0}, NULL, 0, 0, false, portMUX_INITIALIZER_UNLOCKED}
+};
+
+static inline size_t IRAM_ATTR i2cSlaveRingUsed(i2c_slave_ring_t * r)
+{
+    size_t head = r->head, tail = r->tail;
+    return (head >= tail) ? (head - tail) : (r->size - tail + head);
+}
+
+static bool IRAM_ATTR i2cSlaveRingPut(i2c_slave_ring_t * r, uint8_t d)
+{
+    size_t next = r->head + 1;
+    if(next == r->size) {
+        next = 0;
+    }
+    if(next == r->tail) {
+        return false;
+    }
+    r->buf[r->head] = d;
+    r->head = next;
+    return true;
+}
+
+static size_t i2cSlaveRingGet(i2c_slave_ring_t * r, uint8_t * data, size_t len)
+{
+    size_t count = i2cSlaveRingUsed(r);
+    if(len > count) {
+        len = count;
+    }
+    size_t tail = r->tail;
+    size_t first = r->size - tail;
+    if(first > len) {
+        first = len;
+    }
+    memcpy(data, &r->buf[tail], first);
+    memcpy(data + first, r->buf, len - first);
+    tail += len;
+    if(tail >= r->size) {
+        tail -= r->size;
+    }
+    r->tail = tail;
+    return len;
+}
+
+static bool i2cSlaveRingAlloc(i2c_slave_ring_t * r, size_t len)
+{
+    r->size = len + 1;
+    r->head = 0;
+    r->tail = 0;
+    r->buf = (uint8_t *)malloc(r->size);
+    return r->buf != NULL;
+}
+
+static void i2cSlaveRingFree(i2c_slave_ring_t * r)
+{
+    free(r->buf);
+    r->buf = NULL;
+    r->size = 0;
+    r->head = 0;
+    r->tail = 0;
+}
+
+// call with tx_spinlock held
+static void IRAM_ATTR i2cSlaveFillTxFifo(i2c_slave_struct_t * i2c)
+{
+    i2c_slave_ring_t * r = &i2c->tx;
+    uint32_t room = I2C_SLAVE_FIFO_LEN - i2c->dev->status_reg.tx_fifo_cnt;
+    while(room && r->tail != r->head) {
+        i2c->dev->fifo_data.val = r->buf[r->tail];
+        r->tail = (r->tail + 1 == r->size) ? 0 : (r->tail + 1);
+        room--;
+    }
+    i2c->dev->int_ena.tx_fifo_empty = (r->tail != r->head);
+}
+
+// call with tx_spinlock held
+static void IRAM_ATTR i2cSlaveResetTx(i2c_slave_struct_t * i2c)
+{
+    i2c->tx.tail = i2c->tx.head;
+    i2c->dev->int_ena.tx_fifo_empty = 0;
+    i2c->dev->fifo_conf.tx_fifo_rst = 1;
+    i2c->dev->fifo_conf.tx_fifo_rst = 0;
+}
+
+static void IRAM_ATTR i2cSlaveDrainRxFifo(i2c_slave_struct_t * i2c)
+{
+    uint32_t cnt = i2c->dev->status_reg.rx_fifo_cnt;
+    while(cnt--) {
+        uint8_t d = i2c->dev->fifo_data.val;
+        if(i2cSlaveRingPut(&i2c->rx, d)) {
+            i2c->rx_data_count++;
+        } else {
+            i2c->rx_overflow++;
+        }
+    }
+}
+
+static void IRAM_ATTR i2c_slave_isr_handler(void * arg)
+{
+    i2c_slave_struct_t * i2c = (i2c_slave_struct_t *)arg;
+    portBASE_TYPE HPTaskAwoken = pdFALSE;
+    i2c_slave_event_t evt;
+    uint32_t activeInt = i2c->dev->int_status.val;
+    bool slave_rw = i2c->dev->status_reg.slave_rw; // 1: master reads
+
+    if(activeInt & (I2C_RXFIFO_FULL_INT_ST_M | I2C_TRANS_COMPLETE_INT_ST_M)) {
+        i2cSlaveDrainRxFifo(i2c);
+    }
+
+    if(activeInt & I2C_TXFIFO_EMPTY_INT_ST_M) {
+        portENTER_CRITICAL_ISR(&i2c->tx_spinlock);
+        i2cSlaveFillTxFifo(i2c);
+        portEXIT_CRITICAL_ISR(&i2c->tx_spinlock);
+    }
+
+    if(activeInt & I2C_TRANS_COMPLETE_INT_ST_M) {
+        if(i2c->rx_data_count) { // write, ended by STOP or by a ReSTART into a read
+            evt.event = I2C_SLAVE_EVT_RX;
+            evt.stop = !slave_rw;
+            evt.len = i2c->rx_data_count;
+            i2c->rx_data_count = 0;
+            xQueueSendFromISR(i2c->event_queue, &evt, &HPTaskAwoken);
+        }
+        if(slave_rw && i2c->dev->status_reg.scl_main_state_last == 6) { // a read ended (SCL_WAIT_ACK)
+            // whatever the master did not clock out is stale for the next read
+            portENTER_CRITICAL_ISR(&i2c->tx_spinlock);
+            i2cSlaveResetTx(i2c);
+            portEXIT_CRITICAL_ISR(&i2c->tx_spinlock);
+            evt.event = I2C_SLAVE_EVT_TX;
+            evt.stop = true;
+            evt.len = 0;
+            xQueueSendFromISR(i2c->event_queue, &evt, &HPTaskAwoken);
+        }
+    }
+
+    i2c->dev->int_clr.val = activeInt;
+
+    if(HPTaskAwoken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void i2c_slave_task(void * arg)
+{
+    i2c_slave_struct_t * i2c = (i2c_slave_struct_t *)arg;
+    i2c_slave_event_t evt;
+    uint32_t overflow = 0;
+
+    for(;;) {
+        if(xQueueReceive(i2c->event_queue, &evt, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if(evt.event == I2C_SLAVE_EVT_STOP_TASK) {
+            break;
+        }
+        if(i2c->rx_overflow != overflow) {
+            overflow = i2c->rx_overflow;
+            log_w("i2c slave %u rx ring overflow, %u bytes lost", i2c->num, overflow);
+        }
+        if(evt.event == I2C_SLAVE_EVT_RX) {
+            size_t len = i2cSlaveRingGet(&i2c->rx, i2c->rx_data, evt.len);
+            i2c->tx_written = false;
+            if(i2c->receive_callback) {
+                i2c->receive_callback(i2c->num, i2c->rx_data, len, evt.stop, i2c->arg);
+            }
+            // ReSTART: the master reads right away, queue the answer now unless
+            // the receive callback already did
+            if(evt.stop || i2c->tx_written) {
+                continue;
+            }
+        }
+        if(i2c->request_callback) {
+            i2c->request_callback(i2c->num, i2c->arg);
+        }
+    }
+    i2c->task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+static void i2cSlaveAttachPins(i2c_slave_struct_t * i2c)
+{
+    digitalWrite(i2c->sda, HIGH);
+    pinMode(i2c->sda, OPEN_DRAIN | PULLUP | INPUT | OUTPUT);
+    pinMatrixOutAttach(i2c->sda, I2C_SLAVE_SDA_IDX(i2c->num), false, false);
+    pinMatrixInAttach(i2c->sda, I2C_SLAVE_SDA_IDX(i2c->num), false);
+
+    digitalWrite(i2c->scl, HIGH);
+    pinMode(i2c->scl, OPEN_DRAIN | PULLUP | INPUT | OUTPUT);
+    pinMatrixOutAttach(i2c->scl, I2C_SLAVE_SCL_IDX(i2c->num), false, false);
+    pinMatrixInAttach(i2c->scl, I2C_SLAVE_SCL_IDX(i2c->num), false);
+}
+
+static void i2cSlaveDetachPins(i2c_slave_struct_t * i2c)
+{
+    if(i2c->sda >= 0) {
+        pinMatrixOutDetach(i2c->sda, false, false);
+        pinMatrixInDetach(I2C_SLAVE_SDA_IDX(i2c->num), false, false);
+        pinMode(i2c->sda, INPUT | PULLUP);
+        i2c->sda = -1;
+    }
+    if(i2c->scl >= 0) {
+        pinMatrixOutDetach(i2c->scl, false, false);
+        pinMatrixInDetach(I2C_SLAVE_SCL_IDX(i2c->num), false, false);
+        pinMode(i2c->scl, INPUT | PULLUP);
+        i2c->scl = -1;
+    }
+}
+
+static void i2cSlaveFreeResources(i2c_slave_struct_t * i2c)
+{
+    if(i2c->event_queue) {
+        vQueueDelete(i2c->event_queue);
+        i2c->event_queue = NULL;
+    }
+    i2cSlaveRingFree(&i2c->rx);
+    i2cSlaveRingFree(&i2c->tx);
+    free(i2c->rx_data);
+    i2c->rx_data = NULL;
+}
+
+/*
+ * PUBLIC API
+ * */
+i2c_err_t i2cSlaveInit(uint8_t num, int8_t sda, int8_t scl, uint16_t slaveID, uint32_t frequency, size_t rx_len, size_t tx_len)
+{
+    if(num > 1 || sda < 0 || scl < 0 || !rx_len || !tx_len) {
+        return I2C_ERROR_DEV;
+    }
+    if(slaveID > 0x3FF) {
+        log_e("invalid slave address 0x%x", slaveID);
+        return I2C_ERROR_DEV;
+    }
+    if(frequency == 0) {
+        frequency = 100000L;
+    }
+
+    i2c_slave_struct_t * i2c = &_i2c_slave_array[num];
+    i2cSlaveDeinit(num);
+
+    if(!i2cSlaveRingAlloc(&i2c->rx, rx_len) || !i2cSlaveRingAlloc(&i2c->tx, tx_len)) {
+        log_e("ring buffer alloc failed");
+        i2cSlaveFreeResources(i2c);
+        return I2C_ERROR_MEMORY;
+    }
+    i2c->rx_data = (uint8_t *)malloc(rx_len);
+    i2c->event_queue = xQueueCreate(I2C_SLAVE_EVENT_QUEUE_LEN, sizeof(i2c_slave_event_t));
+    if(!i2c->rx_data || !i2c->event_queue) {
+        log_e("event queue alloc failed");
+        i2cSlaveFreeResources(i2c);
+        return I2C_ERROR_MEMORY;
+    }
+    i2c->rx_data_count = 0;
+    i2c->rx_overflow = 0;
+
+    TaskHandle_t task = NULL;
+    if(xTaskCreateUniversal(i2c_slave_task, "i2c_slave", I2C_SLAVE_TASK_STACK_SIZE, i2c, I2C_SLAVE_TASK_PRIORITY, &task, I2C_SLAVE_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("slave task create failed");
+        i2cSlaveFreeResources(i2c);
+        return I2C_ERROR_MEMORY;
+    }
+    i2c->task_handle = task;
+
+    if(num == 0) {
+        DPORT_SET_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_I2C_EXT0_RST);
+        DPORT_SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_I2C_EXT0_CLK_EN);
+        DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_I2C_EXT0_RST);
+    } else {
+        DPORT_SET_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_I2C_EXT1_RST);
+        DPORT_SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_I2C_EXT1_CLK_EN);
+        DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_I2C_EXT1_RST);
+    }
+
+    i2c->dev->int_ena.val = 0;
+    i2c->dev->int_clr.val = 0x1FFF;
+    i2c->dev->ctr.val = 0;
+    i2c->dev->ctr.sda_force_out = 1;
+    i2c->dev->ctr.scl_force_out = 1;
+    i2c->dev->ctr.clk_en = 1;
+    i2c->dev->ctr.ms_mode = 0;
+
+    i2c->dev->slave_addr.val = 0;
+    i2c->dev->slave_addr.addr = slaveID;
+    i2c->dev->slave_addr.en_10bit = (slaveID > 0x7F);
+
+    i2c->dev->fifo_conf.nonfifo_en = 0;
+    i2c->dev->fifo_conf.fifo_addr_cfg_en = 0;
+    i2c->dev->fifo_conf.rx_fifo_full_thrhd = I2C_SLAVE_RX_FIFO_THRESHOLD;
+    i2c->dev->fifo_conf.tx_fifo_empty_thrhd = I2C_SLAVE_TX_FIFO_THRESHOLD;
+    i2c->dev->fifo_conf.rx_fifo_rst = 1;
+    i2c->dev->fifo_conf.rx_fifo_rst = 0;
+    i2c->dev->fifo_conf.tx_fifo_rst = 1;
+    i2c->dev->fifo_conf.tx_fifo_rst = 0;
+
+    // sample and change SDA a quarter SCL period after the edges
+    uint32_t timing = getApbFrequency() / frequency / 4;
+    if(timing < 10) {
+        timing = 10;
+    } else if(timing > 1023) {
+        timing = 1023;
+    }
+    i2c->dev->sda_hold.time = timing;
+    i2c->dev->sda_sample.time = timing;
+    i2c->dev->timeout.tout = I2C_SLAVE_TIMEOUT_DEFAULT;
+    i2c->dev->scl_filter_cfg.thres = 7;
+    i2c->dev->scl_filter_cfg.en = 1;
+    i2c->dev->sda_filter_cfg.thres = 7;
+    i2c->dev->sda_filter_cfg.en = 1;
+
+    uint32_t interruptsEnabled = I2C_RXFIFO_FULL_INT_ENA_M | I2C_TRANS_COMPLETE_INT_ENA_M;
+    esp_err_t ret = esp_intr_alloc_intrstatus((num)?ETS_I2C_EXT1_INTR_SOURCE:ETS_I2C_EXT0_INTR_SOURCE, ESP_INTR_FLAG_IRAM | ESP_INTR_FLAG_LOWMED,
+                    (uint32_t)&i2c->dev->int_status.val, interruptsEnabled, &i2c_slave_isr_handler, i2c, &i2c->intr_handle);
+    if(ret != ESP_OK) {
+        log_e("install interrupt handler Failed=%d", ret);
+        i2cSlaveDeinit(num);
+        return I2C_ERROR_MEMORY;
+    }
+
+    i2c->sda = sda;
+    i2c->scl = scl;
+    i2cSlaveAttachPins(i2c);
+    i2c->dev->int_ena.val = interruptsEnabled;
+    return I2C_ERROR_OK;
+}
+
+// must not be called from a slave callback
+i2c_err_t i2cSlaveDeinit(uint8_t num)
+{
+    if(num > 1) {
+        return I2C_ERROR_DEV;
+    }
+    i2c_slave_struct_t * i2c = &_i2c_slave_array[num];
+    if(!i2c->task_handle && !i2c->event_queue) {
+        return I2C_ERROR_OK;
+    }
+
+    i2c->dev->int_ena.val = 0;
+    if(i2c->intr_handle) {
+        esp_intr_free(i2c->intr_handle);
+        i2c->intr_handle = NULL;
+    }
+    i2cSlaveDetachPins(i2c);
+
+    if(i2c->task_handle) {
+        i2c_slave_event_t evt = {I2C_SLAVE_EVT_STOP_TASK, true, 0};
+        xQueueSend(i2c->event_queue, &evt, portMAX_DELAY);
+        while(i2c->task_handle) {
+            vTaskDelay(1);
+        }
+    }
+    i2cSlaveFreeResources(i2c);
+
+    if(num == 0) {
+        DPORT_SET_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_I2C_EXT0_RST);
+        DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_I2C_EXT0_CLK_EN);
+    } else {
+        DPORT_SET_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_I2C_EXT1_RST);
+        DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_I2C_EXT1_CLK_EN);
+    }
+    return I2C_ERROR_OK;
+}
+
+i2c_err_t i2cSlaveAttachCallbacks(uint8_t num, i2c_slave_request_cb_t request_callback, i2c_slave_receive_cb_t receive_callback, void * arg)
+{
+    if(num > 1) {
+        return I2C_ERROR_DEV;
+    }
+    i2c_slave_struct_t * i2c = &_i2c_slave_array[num];
+    i2c->request_callback = request_callback;
+    i2c->receive_callback = receive_callback;
+    i2c->arg = arg;
+    return I2C_ERROR_OK;
+}
+
+size_t i2cSlaveWrite(uint8_t num, const uint8_t * buf, uint32_t len, uint32_t timeout_ms)
+{
+    if(num > 1 || !buf) {
+        return 0;
+    }
+    i2c_slave_struct_t * i2c = &_i2c_slave_array[num];
+    if(!i2c->tx.buf) {
+        return 0;
+    }
+    portTickType start = xTaskGetTickCount();
+    size_t written = 0;
+    i2c->tx_written = true;
+    while(written < len) {
+        portENTER_CRITICAL(&i2c->tx_spinlock);
+        while(written < len && i2cSlaveRingPut(&i2c->tx, buf[written])) {
+            written++;
+        }
+        i2cSlaveFillTxFifo(i2c);
+        portEXIT_CRITICAL(&i2c->tx_spinlock);
+        if(written == len || (xTaskGetTickCount() - start) >= (timeout_ms / portTICK_PERIOD_MS)) {
+            break;
+        }
+        vTaskDelay(1); // wait for the master to read some
+    }
+    return written;
+}
+
+void i2cSlaveFlushTx(uint8_t num)
+{
+    if(num > 1) {
+        return;
+    }
+    i2c_slave_struct_t * i2c = &_i2c_slave_array[num];
+    if(!i2c->tx.buf) {
+        return;
+    }
+    portENTER_CRITICAL(&i2c->tx_spinlock);
+    i2cSlaveResetTx(i2c);
+    portEXIT_CRITICAL(&i2c->tx_spinlock);
+}
+
+bool i2cSlaveIsActive(uint8_t num)
+{
+    return (num < 2) && (_i2c_slave_array[num].task_handle != NULL);
+}
@@ -0,0 +1,51 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_I2C_SLAVE_H_
+#define _ESP32_HAL_I2C_SLAVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp32-hal-i2c.h"
+
+/*
+ * The peripheral can not stretch SCL while it waits for data, so a master read is
+ * answered from the bytes already queued with i2cSlaveWrite(). The request callback
+ * runs when a write ends in a ReSTART (master is about to read) and the receive
+ * callback did not queue an answer itself, and after every read, to queue the next
+ * answer. Callbacks run in the slave task, not in the ISR.
+ */
+typedef void (*i2c_slave_request_cb_t)(uint8_t num, void * arg);
+typedef void (*i2c_slave_receive_cb_t)(uint8_t num, uint8_t * data, size_t len, bool stop, void * arg);
+
+// the peripheral must not be in use by i2cInit() (master) at the same time
+i2c_err_t i2cSlaveInit(uint8_t num, int8_t sda, int8_t scl, uint16_t slaveID, uint32_t frequency, size_t rx_len, size_t tx_len);
+i2c_err_t i2cSlaveDeinit(uint8_t num);
+i2c_err_t i2cSlaveAttachCallbacks(uint8_t num, i2c_slave_request_cb_t request_callback, i2c_slave_receive_cb_t receive_callback, void * arg);
+// queue data for the next master read, returns the bytes accepted
+size_t i2cSlaveWrite(uint8_t num, const uint8_t * buf, uint32_t len, uint32_t timeout_ms);
+// drop queued answer bytes, TX FIFO included
+void i2cSlaveFlushTx(uint8_t num);
+bool i2cSlaveIsActive(uint8_t num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_I2C_SLAVE_H_ */
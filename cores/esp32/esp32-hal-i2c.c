@@ -187,6 +187,19 @@ struct i2c_struct_t {
     uint16_t errorQueue; // errorByteCnt is in this queue,(for error locus)
     uint32_t exitCode;
     uint32_t debugFlags;
+    // i2cProcQueueAsync()
+    volatile bool asyncActive;
+    i2c_async_cb_t asyncCb;
+    void * asyncArg;
+    TaskHandle_t asyncTask;
+    portTickType asyncStart;
+    portTickType asyncTimeOut;
+    i2c_err_t asyncResult;
+    uint32_t asyncReadCount;
+    // i2cGetStats()
+    i2c_stats_t stats;
+    uint32_t statStart; // micros() at trans_start
+    uint32_t statEnd;   // micros() at ISR exit
 };
 
 enum {
@@ -800,6 +813,23 @@ static void IRAM_ATTR emptyRxFifo(i2c_t * i2c)
 #endif
 }
 
+static i2c_err_t IRAM_ATTR i2cErrorReason(I2C_ERROR_t error)
+{
+    switch(error) {
+    case I2C_OK :
+        return I2C_ERROR_OK;
+    case I2C_ADDR_NAK:
+    case I2C_DATA_NAK:
+        return I2C_ERROR_ACK;
+    case I2C_ARBITRATION:
+        return I2C_ERROR_BUS;
+    case I2C_TIMEOUT:
+        return I2C_ERROR_TIMEOUT;
+    default :
+        return I2C_ERROR_DEV;
+    }
+}
+
 static void IRAM_ATTR i2cIsrExit(i2c_t * i2c,const uint32_t eventCode,bool Fatal)
 {
 
@@ -829,18 +859,29 @@ static void IRAM_ATTR i2cIsrExit(i2c_t * i2c,const uint32_t eventCode,bool Fatal
     i2c->dev->int_ena.val = 0; // shut down interrupts
     i2c->dev->int_clr.val = 0x1FFF;
     i2c->stage = I2C_DONE;
+    i2c->statEnd = micros();
     i2c->exitCode = exitCode; //true eventcode
 
-    portBASE_TYPE HPTaskAwoken = pdFALSE,xResult;
+    portBASE_TYPE HPTaskAwoken = pdFALSE;
+    if(i2c->asyncActive) { // i2cProcQueueAsync(), report straight from here
+        if(i2c->asyncCb) {
+            uint32_t readCount = 0;
+            for(uint16_t b = 0; b < i2c->queueCount; b++) {
+                if(i2c->dq[b].ctrl.mode == 1) {
+                    readCount += i2c->dq[b].position;
+                }
+            }
+            i2c->asyncCb(i2c->asyncArg, i2cErrorReason(i2c->error), readCount);
+        } else if(i2c->asyncTask) {
+            vTaskNotifyGiveFromISR(i2c->asyncTask, &HPTaskAwoken);
+        }
+    }
     // try to notify Dispatch we are done,
     // else the 50ms time out will recover the APP, just a little slower
-    HPTaskAwoken = pdFALSE;
-    xResult = xEventGroupSetBitsFromISR(i2c->i2c_event, exitCode, &HPTaskAwoken);
-    if(xResult == pdPASS) {
-        if(HPTaskAwoken==pdTRUE) {
-            portYIELD_FROM_ISR();
-            //      log_e("Yield to Higher");
-        }
+    xEventGroupSetBitsFromISR(i2c->i2c_event, exitCode, &HPTaskAwoken);
+    if(HPTaskAwoken==pdTRUE) {
+        portYIELD_FROM_ISR();
+        //      log_e("Yield to Higher");
     }
 
 }
@@ -1024,21 +1065,13 @@ static void IRAM_ATTR i2c_isr_handler_default(void* arg)
 /* Stickbreaker added for ISR 11/2017
 functional with Silicon date=0x16042000
  */
-static i2c_err_t i2cAddQueue(i2c_t * i2c,uint8_t mode, uint16_t i2cDeviceAddr, uint8_t *dataPtr, uint16_t dataLen,bool sendStop, bool dataOnly, EventGroupHandle_t event)
+static void i2cInitQueueEntry(I2C_DATA_QUEUE_t * dqx, uint8_t mode, uint16_t i2cDeviceAddr, uint8_t *dataPtr, uint16_t dataLen,bool sendStop, bool dataOnly, EventGroupHandle_t event)
 {
-    // need to grab a MUTEX for exclusive Queue,
-    // what about if ISR is running?
-
-    if(i2c==NULL) {
-        return I2C_ERROR_DEV;
-    }
-
-    I2C_DATA_QUEUE_t dqx;
-    dqx.data = dataPtr;
-    dqx.length = dataLen;
-    dqx.position = 0;
-    dqx.cmdBytesNeeded = dataLen;
-    dqx.ctrl.val = 0;
+    dqx->data = dataPtr;
+    dqx->length = dataLen;
+    dqx->position = 0;
+    dqx->cmdBytesNeeded = dataLen;
+    dqx->ctrl.val = 0;
     if( dataOnly) {
      /* special case to add a queue data only element.
         START and devAddr will not be sent, this dq element can have a STOP.
@@ -1046,15 +1079,31 @@ static i2c_err_t i2cAddQueue(i2c_t * i2c,uint8_t mode, uint16_t i2cDeviceAddr, u
         sequence: normal transaction(sendStop==false), [dataonly(sendStop==false)],dataOnly(sendStop==true)
        *** Currently only works with WRITE, final byte NAK an READ will cause a fail between dq buffer elements.  (in progress 30JUL2018)
         */
-        dqx.ctrl.startCmdSent = 1; // mark as already sent
-        dqx.ctrl.addrCmdSent = 1;
+        dqx->ctrl.startCmdSent = 1; // mark as already sent
+        dqx->ctrl.addrCmdSent = 1;
     } else {
-        dqx.ctrl.addrReq = ((i2cDeviceAddr&0xFC00)==0x7800)?2:1; // 10bit or 7bit address
+        dqx->ctrl.addrReq = ((i2cDeviceAddr&0xFC00)==0x7800)?2:1; // 10bit or 7bit address
+    }
+    dqx->ctrl.addr = i2cDeviceAddr;
+    dqx->ctrl.mode = mode;
+    dqx->ctrl.stop= sendStop;
+    dqx->queueEvent = event;
+}
+
+static i2c_err_t i2cAddQueue(i2c_t * i2c,uint8_t mode, uint16_t i2cDeviceAddr, uint8_t *dataPtr, uint16_t dataLen,bool sendStop, bool dataOnly, EventGroupHandle_t event)
+{
+    // need to grab a MUTEX for exclusive Queue,
+    // what about if ISR is running?
+
+    if(i2c==NULL) {
+        return I2C_ERROR_DEV;
+    }
+    if(i2c->asyncActive) { // the ISR still works on the queue
+        i2cWaitAsync(i2c, NULL);
     }
-    dqx.ctrl.addr = i2cDeviceAddr;
-    dqx.ctrl.mode = mode;
-    dqx.ctrl.stop= sendStop;
-    dqx.queueEvent = event;
+
+    I2C_DATA_QUEUE_t dqx;
+    i2cInitQueueEntry(&dqx, mode, i2cDeviceAddr, dataPtr, dataLen, sendStop, dataOnly, event);
 
     if(event) { // an eventGroup exist, so, initialize it
         xEventGroupClearBits(event, EVENT_MASK); // all of them
@@ -1110,36 +1159,9 @@ i2c_err_t i2cAddQueueRead(i2c_t * i2c, uint16_t i2cDeviceAddr, uint8_t *dataPtr,
     return i2cAddQueue(i2c,1,i2cDeviceAddr,dataPtr,dataLen,sendStop,false,event);
 }
 
-i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
+// everything up to trans_start, called with the mutex held
+static i2c_err_t i2cStartQueue(i2c_t * i2c, uint16_t timeOutMillis, portTickType * ticksTimeOut)
 {
-    /* do the hard stuff here
-    install ISR if necessary
-    setup EventGroup
-    handle bus busy?
-     */
-    //log_e("procQueue i2c=%p",&i2c);
-    if(readCount){ //total reads accomplished in all queue elements
-        *readCount = 0;
-    }
-    if(i2c == NULL) {
-        return I2C_ERROR_DEV;
-    }
-    if(i2c->debugFlags & 0xff000000) i2cTriggerDumps(i2c,(i2c->debugFlags>>24),"before ProcQueue");
-    if (i2c->dev->status_reg.bus_busy) { // return error, let TwoWire() handle resetting the hardware.
-        /* if multi master then this if should be changed to this 03/12/2018
-        if(multiMaster){// try to let the bus clear by its self
-            uint32_t timeOutTick = millis();
-            while((i2c->dev->status_reg.bus_busy)&&(millis()-timeOutTick<timeOutMillis())){
-              delay(2); // allow task switch
-            }
-        }
-        if(i2c->dev->status_reg.bus_busy){ // still busy, so die
-             */
-        log_i("Bus busy, reinit");
-        return I2C_ERROR_BUSY;
-    }
-
-    I2C_MUTEX_LOCK();
     /* what about co-existence with SLAVE mode?
     Should I check if a slaveMode xfer is in progress and hang
     until it completes?
@@ -1167,11 +1189,9 @@ i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
         xEventGroupClearBits(i2c->i2c_event, 0xFF);
     } else { // failed to create EventGroup
         log_e("eventCreate failed=%p",i2c->i2c_event);
-        I2C_MUTEX_UNLOCK();
         return I2C_ERROR_MEMORY;
     }
 
-    i2c_err_t reason = I2C_ERROR_OK;
     i2c->mode = I2C_MASTER;
     i2c->dev->ctr.trans_start=0; // Pause Machine
     i2c->dev->timeout.tout = 0xFFFFF; // max 13ms
@@ -1259,12 +1279,10 @@ i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
 
         if(ret!=ESP_OK) {
             log_e("install interrupt handler Failed=%d",ret);
-            I2C_MUTEX_UNLOCK();
             return I2C_ERROR_MEMORY;
         }
         if( !addApbChangeCallback( i2c, i2cApbChangeCallback)) {
             log_e("install apb Callback failed");
-            I2C_MUTEX_UNLOCK();
             return I2C_ERROR_DEV;
         }
 
@@ -1274,17 +1292,65 @@ i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
     // how many ticks should it take to transfer totalBytes through the I2C hardware,
     // add user supplied timeOutMillis to Calculated Value
 
-    portTickType ticksTimeOut = ((totalBytes*10*1000)/(i2cGetFrequency(i2c))+timeOutMillis)/portTICK_PERIOD_MS;
+    *ticksTimeOut = ((totalBytes*10*1000)/(i2cGetFrequency(i2c))+timeOutMillis)/portTICK_PERIOD_MS;
 
+    i2c->statStart = micros();
     i2c->dev->ctr.trans_start=1; // go for it
+    return I2C_ERROR_OK;
+}
 
+static void i2cUpdateStats(i2c_t * i2c, i2c_err_t reason)
+{
+    i2c_stats_t * st = &i2c->stats;
+    uint32_t us = (i2c->exitCode ? i2c->statEnd : micros()) - i2c->statStart;
+    uint8_t bucket = 31 - __builtin_clz(us | 1);
+    if(bucket >= I2C_STATS_LATENCY_BUCKETS) {
+        bucket = I2C_STATS_LATENCY_BUCKETS - 1;
+    }
+    st->latency[bucket]++;
+    if(us > st->latencyMaxUs) {
+        st->latencyMaxUs = us;
+    }
+    st->transactions++;
+    for(uint16_t b = 0; b < i2c->queueCount; b++) {
+        if(i2c->dq[b].ctrl.mode == 1) {
+            st->bytesRead += i2c->dq[b].position;
+        } else {
+            st->bytesWritten += i2c->dq[b].position;
+        }
+    }
+    switch(reason) {
+    case I2C_ERROR_ACK:
+        st->nacks++;
+        break;
+    case I2C_ERROR_BUS:
+        st->arbitrationLost++;
+        break;
+    case I2C_ERROR_TIMEOUT:
+        st->timeouts++;
+        break;
+    case I2C_ERROR_BUSY:
+        st->busBusy++;
+        break;
+    default:
+        break;
+    }
+}
+
+// wait for the ISR and hand out the results, called with the mutex held
+static i2c_err_t i2cFinishQueue(i2c_t * i2c, uint32_t *readCount, portTickType ticksTimeOut)
+{
+
+    i2c_err_t reason = I2C_ERROR_OK;
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
     portTickType tBefore=xTaskGetTickCount();
 #endif
     
     // wait for ISR to complete the transfer, or until timeOut in case of bus fault, hardware problem
     
+    TRACE_BEGIN(TRACE_ID_I2C_WAIT);
     uint32_t eBits = xEventGroupWaitBits(i2c->i2c_event,EVENT_DONE,pdFALSE,pdTRUE,ticksTimeOut);
+    TRACE_END(TRACE_ID_I2C_WAIT);
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
     portTickType tAfter=xTaskGetTickCount();
@@ -1310,28 +1376,7 @@ i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
     }
 
     if(eBits&EVENT_DONE) { // no gross timeout
-        switch(i2c->error) {
-        case I2C_OK :
-            reason = I2C_ERROR_OK;
-            break;
-        case I2C_ERROR :
-            reason = I2C_ERROR_DEV;
-            break;
-        case I2C_ADDR_NAK:
-            reason = I2C_ERROR_ACK;
-            break;
-        case I2C_DATA_NAK:
-            reason = I2C_ERROR_ACK;
-            break;
-        case I2C_ARBITRATION:
-            reason = I2C_ERROR_BUS;
-            break;
-        case I2C_TIMEOUT:
-            reason = I2C_ERROR_TIMEOUT;
-            break;
-        default :
-            reason = I2C_ERROR_DEV;
-        }
+        reason = i2cErrorReason(i2c->error);
     } else { // GROSS timeout, shutdown ISR , report Timeout
         i2c->stage = I2C_DONE;
         i2c->dev->int_ena.val =0;
@@ -1388,12 +1433,263 @@ i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
         }
         b++;
     }
+    i2cUpdateStats(i2c, reason);
     if(i2c->debugFlags & 0x00ff0000) i2cTriggerDumps(i2c,(i2c->debugFlags>>16),"after ProcQueue");
 
+    return reason;
+}
+
+i2c_err_t i2cProcQueue(i2c_t * i2c, uint32_t *readCount, uint16_t timeOutMillis)
+{
+    /* do the hard stuff here
+    install ISR if necessary
+    setup EventGroup
+    handle bus busy?
+     */
+    //log_e("procQueue i2c=%p",&i2c);
+    if(readCount){ //total reads accomplished in all queue elements
+        *readCount = 0;
+    }
+    if(i2c == NULL) {
+        return I2C_ERROR_DEV;
+    }
+    if(i2c->asyncActive) { // the bus is still owned by an i2cProcQueueAsync()
+        i2cWaitAsync(i2c, NULL);
+        if(i2c->queueCount == 0) {
+            return I2C_ERROR_OK;
+        }
+    }
+    if(i2c->debugFlags & 0xff000000) i2cTriggerDumps(i2c,(i2c->debugFlags>>24),"before ProcQueue");
+    if (i2c->dev->status_reg.bus_busy) { // return error, let TwoWire() handle resetting the hardware.
+        /* if multi master then this if should be changed to this 03/12/2018
+        if(multiMaster){// try to let the bus clear by its self
+            uint32_t timeOutTick = millis();
+            while((i2c->dev->status_reg.bus_busy)&&(millis()-timeOutTick<timeOutMillis())){
+              delay(2); // allow task switch
+            }
+        }
+        if(i2c->dev->status_reg.bus_busy){ // still busy, so die
+             */
+        log_i("Bus busy, reinit");
+        i2c->stats.busBusy++;
+        return I2C_ERROR_BUSY;
+    }
+
+    I2C_MUTEX_LOCK();
+    TRACE_BEGIN(TRACE_ID_I2C_QUEUE);
+    portTickType ticksTimeOut = 0;
+    i2c_err_t reason = i2cStartQueue(i2c, timeOutMillis, &ticksTimeOut);
+    if(reason == I2C_ERROR_OK) {
+        reason = i2cFinishQueue(i2c, readCount, ticksTimeOut);
+    }
+    TRACE_END(TRACE_ID_I2C_QUEUE);
+    I2C_MUTEX_UNLOCK();
+    return reason;
+}
+
+i2c_err_t i2cProcQueueAsync(i2c_t * i2c, uint16_t timeOutMillis, i2c_async_cb_t cb, void * arg)
+{
+    if(i2c == NULL) {
+        return I2C_ERROR_DEV;
+    }
+    if(i2c->asyncActive) {
+        i2cWaitAsync(i2c, NULL);
+    }
+    if(i2c->debugFlags & 0xff000000) i2cTriggerDumps(i2c,(i2c->debugFlags>>24),"before ProcQueue");
+    if (i2c->dev->status_reg.bus_busy) { // return error, let TwoWire() handle resetting the hardware.
+        log_i("Bus busy, reinit");
+        i2c->stats.busBusy++;
+        return I2C_ERROR_BUSY;
+    }
+
+    I2C_MUTEX_LOCK();
+    i2c->asyncCb = cb;
+    i2c->asyncArg = arg;
+    i2c->asyncTask = cb ? NULL : xTaskGetCurrentTaskHandle();
+    i2c->asyncResult = I2C_ERROR_OK;
+    i2c->asyncReadCount = 0;
+    i2c->asyncStart = xTaskGetTickCount();
+    i2c->exitCode = 0;
+    i2c->asyncActive = true; // before trans_start, the ISR checks it on exit
+    i2c_err_t reason = i2cStartQueue(i2c, timeOutMillis, &i2c->asyncTimeOut);
+    if(reason != I2C_ERROR_OK) {
+        i2c->asyncActive = false;
+    }
+    I2C_MUTEX_UNLOCK();
+    return reason;
+}
+
+i2c_err_t i2cWaitAsync(i2c_t * i2c, uint32_t *readCount)
+{
+    if(readCount) {
+        *readCount = 0;
+    }
+    if(i2c == NULL) {
+        return I2C_ERROR_DEV;
+    }
+    I2C_MUTEX_LOCK();
+    if(i2c->asyncActive) {
+        portTickType elapsed = xTaskGetTickCount() - i2c->asyncStart;
+        portTickType ticksTimeOut = (elapsed < i2c->asyncTimeOut) ? (i2c->asyncTimeOut - elapsed) : 0;
+        i2c->asyncResult = i2cFinishQueue(i2c, &i2c->asyncReadCount, ticksTimeOut);
+        i2c->asyncActive = false;
+        i2cFlush(i2c);
+    }
+    if(readCount) {
+        *readCount = i2c->asyncReadCount;
+    }
+    i2c_err_t reason = i2c->asyncResult;
     I2C_MUTEX_UNLOCK();
     return reason;
 }
 
+bool i2cAsyncBusy(i2c_t * i2c)
+{
+    return i2c && i2c->asyncActive && !i2c->exitCode;
+}
+
+/* Prebuilt transactions
+   The dq elements are prepared once, each run only copies them over the working
+   set that i2cProcQueue() and the ISR modify, so no allocation happens per poll.
+ */
+struct i2c_batch_struct_t {
+    I2C_DATA_QUEUE_t * tpl;  // elements as added
+    I2C_DATA_QUEUE_t * dq;   // working copy handed to i2cProcQueue()
+    uint16_t count;
+    uint16_t size;
+    uint16_t errorSegment;
+};
+
+i2c_batch_t * i2cBatchCreate(uint16_t segments)
+{
+    i2c_batch_t * batch = (i2c_batch_t *)calloc(1, sizeof(i2c_batch_t));
+    if(!batch) {
+        log_e("malloc failure");
+        return NULL;
+    }
+    if(segments) {
+        batch->tpl = (I2C_DATA_QUEUE_t *)malloc(sizeof(I2C_DATA_QUEUE_t) * segments);
+        batch->dq = (I2C_DATA_QUEUE_t *)malloc(sizeof(I2C_DATA_QUEUE_t) * segments);
+        if(!batch->tpl || !batch->dq) {
+            log_e("malloc failure");
+            i2cBatchFree(batch);
+            return NULL;
+        }
+        batch->size = segments;
+    }
+    return batch;
+}
+
+void i2cBatchFree(i2c_batch_t * batch)
+{
+    if(!batch) {
+        return;
+    }
+    free(batch->tpl);
+    free(batch->dq);
+    free(batch);
+}
+
+void i2cBatchClear(i2c_batch_t * batch)
+{
+    if(batch) {
+        batch->count = 0;
+        batch->errorSegment = 0;
+    }
+}
+
+static i2c_err_t i2cBatchAdd(i2c_batch_t * batch, uint8_t mode, uint16_t i2cDeviceAddr, uint8_t *dataPtr, uint16_t dataLen, bool sendStop)
+{
+    if(batch->count == batch->size) { // expand
+        uint16_t size = batch->size ? (batch->size * 2) : 4;
+        I2C_DATA_QUEUE_t * tpl = (I2C_DATA_QUEUE_t *)realloc(batch->tpl, sizeof(I2C_DATA_QUEUE_t) * size);
+        if(tpl == NULL) {
+            log_e("realloc Failure");
+            return I2C_ERROR_MEMORY;
+        }
+        batch->tpl = tpl;
+        I2C_DATA_QUEUE_t * dq = (I2C_DATA_QUEUE_t *)realloc(batch->dq, sizeof(I2C_DATA_QUEUE_t) * size);
+        if(dq == NULL) {
+            log_e("realloc Failure");
+            return I2C_ERROR_MEMORY;
+        }
+        batch->dq = dq;
+        batch->size = size;
+    }
+    i2cInitQueueEntry(&batch->tpl[batch->count++], mode, i2cDeviceAddr, dataPtr, dataLen, sendStop, false, NULL);
+    return I2C_ERROR_OK;
+}
+
+i2c_err_t i2cBatchAddWrite(i2c_batch_t * batch, uint16_t address, uint8_t* buff, uint16_t size, bool sendStop)
+{
+    if((batch==NULL)||((size>0)&&(buff==NULL))) {
+        return I2C_ERROR_DEV;
+    }
+    return i2cBatchAdd(batch, 0, address, buff, size, sendStop);
+}
+
+i2c_err_t i2cBatchAddRead(i2c_batch_t * batch, uint16_t address, uint8_t* buff, uint16_t size, bool sendStop)
+{
+    if((batch==NULL)||(size == 0)||(buff==NULL)) { // hardware will hang if no data requested on READ
+        return I2C_ERROR_DEV;
+    }
+    if((address &0xFC00)==0x7800) { // ten bit read, see i2cAddQueueRead()
+        i2c_err_t err = i2cBatchAdd(batch, 0, address, NULL, 0, false);
+        if(err != I2C_ERROR_OK) {
+            return err;
+        }
+        address >>= 8;
+    }
+    return i2cBatchAdd(batch, 1, address, buff, size, sendStop);
+}
+
+i2c_err_t i2cBatchRun(i2c_t * i2c, i2c_batch_t * batch, uint16_t timeOutMillis, uint32_t *readCount)
+{
+    if(readCount) {
+        *readCount = 0;
+    }
+    if((i2c==NULL)||(batch==NULL)||(batch->count==0)) {
+        return I2C_ERROR_DEV;
+    }
+    if(!batch->tpl[batch->count - 1].ctrl.stop) {
+        log_e("last segment must send STOP");
+        return I2C_ERROR_DEV;
+    }
+
+    I2C_MUTEX_LOCK();
+    if(i2c->asyncActive) {
+        i2cWaitAsync(i2c, NULL);
+    }
+    if(i2c->dq != NULL) { // a ReSTART transmission is still queued
+        I2C_MUTEX_UNLOCK();
+        log_e("transmission pending");
+        return I2C_ERROR_BUSY;
+    }
+    memcpy(batch->dq, batch->tpl, sizeof(I2C_DATA_QUEUE_t) * batch->count);
+    i2c->dq = batch->dq;
+    i2c->queueCount = batch->count;
+
+    i2c_err_t last_error = i2cProcQueue(i2c, readCount, timeOutMillis);
+    if(last_error == I2C_ERROR_BUSY) { // try to clear the bus
+        if(i2cInit(i2c->num, i2c->sda, i2c->scl, 0)) {
+            last_error = i2cProcQueue(i2c, readCount, timeOutMillis);
+        }
+    }
+    batch->errorSegment = (last_error == I2C_ERROR_OK) ? batch->count : i2c->queuePos;
+
+    // the elements belong to the batch, detach them instead of i2cFlush()
+    i2c->dq = NULL;
+    i2c->queueCount = 0;
+    i2c->queuePos = 0;
+    I2C_MUTEX_UNLOCK();
+    return last_error;
+}
+
+uint16_t i2cBatchErrorSegment(i2c_batch_t * batch)
+{
+    return batch ? batch->errorSegment : 0;
+}
+
 static void i2cReleaseISR(i2c_t * i2c)
 {
     if(i2c->intr_handle) {
@@ -1405,7 +1701,7 @@ static void i2cReleaseISR(i2c_t * i2c)
     }
 }
 
-static bool i2cCheckLineState(int8_t sda, int8_t scl){
+static bool i2cCheckLineState(i2c_t * i2c, int8_t sda, int8_t scl){
      if(sda < 0 || scl < 0){
         return false;//return false since there is nothing to do
     }
@@ -1417,6 +1713,7 @@ static bool i2cCheckLineState(int8_t sda, int8_t scl){
 
     if(!digitalRead(sda) || !digitalRead(scl)) { // bus in busy state
         log_w("invalid state sda(%d)=%d, scl(%d)=%d", sda, digitalRead(sda), scl, digitalRead(scl));
+        i2c->stats.busClears++;
         digitalWrite(scl, HIGH);
         for(uint8_t a=0; a<9; a++) {
             delayMicroseconds(5);
@@ -1432,6 +1729,7 @@ static bool i2cCheckLineState(int8_t sda, int8_t scl){
 
     if(!digitalRead(sda) || !digitalRead(scl)) { // bus in busy state
         log_e("Bus Invalid State, TwoWire() Can't init sda=%d, scl=%d",digitalRead(sda),digitalRead(scl));
+        i2c->stats.busClearFailures++;
         return false; // bus is busy
     }
     return true;
@@ -1551,7 +1849,7 @@ i2c_t * i2cInit(uint8_t i2c_num, int8_t sda, int8_t scl, uint32_t frequency) {
 
     i2cSetFrequency(i2c, frequency);    // reconfigure
 
-    if(!i2cCheckLineState(i2c->sda, i2c->scl)){
+    if(!i2cCheckLineState(i2c, i2c->sda, i2c->scl)){
         return NULL;
     }
 
@@ -1567,6 +1865,9 @@ i2c_t * i2cInit(uint8_t i2c_num, int8_t sda, int8_t scl, uint32_t frequency) {
 void i2cRelease(i2c_t *i2c)  // release all resources, power down peripheral
 {
     I2C_MUTEX_LOCK();
+    if(i2c->asyncActive) {
+        i2cWaitAsync(i2c, NULL);
+    }
 
     if(i2c->sda >= 0){
         i2cDetachSDA(i2c, i2c->sda);
@@ -1602,6 +1903,9 @@ i2c_err_t i2cFlush(i2c_t * i2c)
         return I2C_ERROR_DEV;
     }
     i2cTriggerDumps(i2c,i2c->debugFlags & 0xff, "FLUSH");
+    if(i2c->asyncActive) {
+        i2cWaitAsync(i2c, NULL);
+    }
 
     // need to grab a MUTEX for exclusive Queue,
     // what out if ISR is running?
@@ -1759,6 +2063,27 @@ uint32_t i2cDebug(i2c_t * i2c, uint32_t setBits, uint32_t resetBits){
     
  }
  
+i2c_err_t i2cGetStats(i2c_t * i2c, i2c_stats_t * stats)
+{
+    if(i2c == NULL || stats == NULL) {
+        return I2C_ERROR_DEV;
+    }
+    I2C_MUTEX_LOCK();
+    *stats = i2c->stats;
+    I2C_MUTEX_UNLOCK();
+    return I2C_ERROR_OK;
+}
+
+void i2cResetStats(i2c_t * i2c)
+{
+    if(i2c == NULL) {
+        return;
+    }
+    I2C_MUTEX_LOCK();
+    memset(&i2c->stats, 0, sizeof(i2c_stats_t));
+    I2C_MUTEX_UNLOCK();
+}
+
 uint32_t i2cGetStatus(i2c_t * i2c){
     if(i2c != NULL){
         return i2c->dev->status_reg.val;
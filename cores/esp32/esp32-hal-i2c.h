@@ -40,6 +40,9 @@ typedef enum {
 struct i2c_struct_t;
 typedef struct i2c_struct_t i2c_t;
 
+// called from the ISR when an i2cProcQueueAsync() completes, must be IRAM_ATTR
+typedef void (*i2c_async_cb_t)(void * arg, i2c_err_t err, uint32_t readCount);
+
 i2c_t * i2cInit(uint8_t i2c_num, int8_t sda, int8_t scl, uint32_t clk_speed);
 void i2cRelease(i2c_t *i2c); // free ISR, Free DQ, Power off peripheral clock.  Must call i2cInit() to recover
 i2c_err_t i2cWrite(i2c_t * i2c, uint16_t address, uint8_t* buff, uint16_t size, bool sendStop, uint16_t timeOutMillis);
@@ -61,6 +64,46 @@ i2c_err_t i2cProcQueue(i2c_t *i2c, uint32_t *readCount, uint16_t timeOutMillis);
 i2c_err_t i2cAddQueueWrite(i2c_t *i2c, uint16_t i2cDeviceAddr, uint8_t *dataPtr, uint16_t dataLen, bool SendStop, EventGroupHandle_t event);
 i2c_err_t i2cAddQueueRead(i2c_t *i2c, uint16_t i2cDeviceAddr, uint8_t *dataPtr, uint16_t dataLen, bool SendStop, EventGroupHandle_t event);
 
+//Start the queue and return. Completion calls cb from the ISR, or with cb NULL notifies the calling task.
+//i2cWaitAsync() collects the result and frees the queue; any later call on the bus does so implicitly.
+//On a gross timeout only i2cWaitAsync() reports it.
+i2c_err_t i2cProcQueueAsync(i2c_t *i2c, uint16_t timeOutMillis, i2c_async_cb_t cb, void * arg);
+i2c_err_t i2cWaitAsync(i2c_t *i2c, uint32_t *readCount);
+bool i2cAsyncBusy(i2c_t *i2c);
+
+//Prebuilt transactions: write/read segments for any number of devices, run in one i2cProcQueue() pass
+//The last segment must send STOP. A 10bit read uses two segments.
+struct i2c_batch_struct_t;
+typedef struct i2c_batch_struct_t i2c_batch_t;
+
+i2c_batch_t * i2cBatchCreate(uint16_t segments); // initial capacity, grows when needed
+void i2cBatchFree(i2c_batch_t * batch);
+void i2cBatchClear(i2c_batch_t * batch);
+i2c_err_t i2cBatchAddWrite(i2c_batch_t * batch, uint16_t address, uint8_t* buff, uint16_t size, bool sendStop);
+i2c_err_t i2cBatchAddRead(i2c_batch_t * batch, uint16_t address, uint8_t* buff, uint16_t size, bool sendStop);
+i2c_err_t i2cBatchRun(i2c_t * i2c, i2c_batch_t * batch, uint16_t timeOutMillis, uint32_t *readCount);
+uint16_t i2cBatchErrorSegment(i2c_batch_t * batch); // segment that failed in the last run, segment count if none
+
+//Always-on bus statistics, kept across i2cInit()/i2cRelease()
+#define I2C_STATS_LATENCY_BUCKETS 16
+
+typedef struct {
+    uint32_t transactions;    // i2cProcQueue() passes, async and batch included
+    uint32_t bytesWritten;
+    uint32_t bytesRead;
+    uint32_t nacks;           // address or data NAK
+    uint32_t arbitrationLost;
+    uint32_t timeouts;
+    uint32_t busBusy;         // bus busy at start, or nothing moved before timeout
+    uint32_t busClears;       // SCL cycling recoveries in i2cInit()
+    uint32_t busClearFailures;
+    uint32_t latencyMaxUs;
+    uint32_t latency[I2C_STATS_LATENCY_BUCKETS]; // [n]: 2^n <= us < 2^(n+1), [0] below 2us, last one open ended
+} i2c_stats_t;
+
+i2c_err_t i2cGetStats(i2c_t * i2c, i2c_stats_t * stats);
+void i2cResetStats(i2c_t * i2c);
+
 //stickbreaker debug support
 uint32_t i2cDebug(i2c_t *, uint32_t setBits, uint32_t resetBits);
 //  Debug actions have 3 currently defined locus 
@@ -0,0 +1,324 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-i2s.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+
+#ifndef I2S_TASK_STACK_SIZE
+#define I2S_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef I2S_TASK_PRIORITY
+#define I2S_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#endif
+
+#ifndef I2S_TASK_RUNNING_CORE
+#define I2S_TASK_RUNNING_CORE -1
+#endif
+
+typedef struct {
+    uint8_t * data;
+    size_t len;
+} i2s_block_t;
+
+struct i2s_s {
+    i2s_port_t port;
+    i2s_mode_t mode;
+    size_t bufferSize;
+    TaskHandle_t task;
+    QueueHandle_t events;       // i2s_event_t from the driver, I2S_EVENT_MAX stops the task
+    QueueHandle_t rxQueue;      // i2s_block_t received
+    pool_t * rxPool;
+    i2s_buffer_cb_t cb;
+    void * arg;
+    i2s_hal_stats_t stats;
+};
+
+static i2s_t * _i2s_bus[I2S_NUM_MAX] = { NULL };
+
+void i2sDefaultConfig(i2s_hal_config_t * config)
+{
+    config->mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX);
+    config->sampleRate = 44100;
+    config->bitsPerSample = I2S_BITS_PER_SAMPLE_16BIT;
+    config->channelFormat = I2S_CHANNEL_FMT_RIGHT_LEFT;
+    config->commFormat = (i2s_comm_format_t)(I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB);
+    config->dmaBufCount = 8;
+    config->dmaBufLen = 256;
+    config->rxBlocks = 0;
+    config->useApll = false;
+    config->bckPin = -1;
+    config->wsPin = -1;
+    config->doutPin = -1;
+    config->dinPin = -1;
+    config->adcPin = -1;
+}
+
+// take everything the DMA completed, events the driver could not queue included
+static void _i2sReceive(i2s_t * bus)
+{
+    while(true) {
+        uint8_t * block = (uint8_t *)poolAlloc(bus->rxPool);
+        if(!block) {
+            bus->stats.rxOverruns++;
+            return;
+        }
+        size_t len = 0;
+        i2s_read(bus->port, block, bus->bufferSize, &len, 0);
+        if(!len) {
+            poolFree(bus->rxPool, block);
+            return;
+        }
+        bus->stats.rxBuffers++;
+        i2s_buffer_cb_t cb = bus->cb;
+        if(cb) {
+            cb(bus->arg, I2S_EVENT_RX_DONE, block, len);
+            poolFree(bus->rxPool, block);
+            continue;
+        }
+        i2s_block_t item = { block, len };
+        if(xQueueSend(bus->rxQueue, &item, 0) != pdTRUE) {
+            poolFree(bus->rxPool, block);
+            bus->stats.rxOverruns++;
+            return;
+        }
+    }
+}
+
+static void _i2sTask(void * arg)
+{
+    i2s_t * bus = (i2s_t *)arg;
+    i2s_event_t event;
+    while(xQueueReceive(bus->events, &event, portMAX_DELAY) == pdTRUE && event.type != I2S_EVENT_MAX) {
+        i2s_buffer_cb_t cb = bus->cb;
+        switch(event.type) {
+        case I2S_EVENT_RX_DONE:
+            _i2sReceive(bus);
+            break;
+        case I2S_EVENT_TX_DONE:
+            bus->stats.txBuffers++;
+            if(cb) {
+                cb(bus->arg, I2S_EVENT_TX_DONE, NULL, bus->bufferSize);
+            }
+            break;
+        case I2S_EVENT_DMA_ERROR:
+            bus->stats.dmaErrors++;
+            if(cb) {
+                cb(bus->arg, I2S_EVENT_DMA_ERROR, NULL, 0);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    bus->task = NULL;
+    vTaskDelete(NULL);
+}
+
+static void _i2sFree(i2s_t * bus)
+{
+    if(bus->rxQueue) {
+        i2s_block_t item;
+        while(xQueueReceive(bus->rxQueue, &item, 0) == pdTRUE) {
+            poolFree(bus->rxPool, item.data);
+        }
+        vQueueDelete(bus->rxQueue);
+    }
+    if(bus->rxPool) {
+        poolDelete(bus->rxPool);
+    }
+    free(bus);
+}
+
+i2s_t * i2sBegin(uint8_t port, const i2s_hal_config_t * config)
+{
+    if(port >= I2S_NUM_MAX || !config) {
+        return NULL;
+    }
+    if(_i2s_bus[port]) {
+        log_e("I2S%u already started", port);
+        return NULL;
+    }
+    if(config->dmaBufCount < 2 || config->dmaBufCount > 128 || config->dmaBufLen < 8 || config->dmaBufLen > 1024) {
+        log_e("DMA buffers out of range: %u of %u frames", config->dmaBufCount, config->dmaBufLen);
+        return NULL;
+    }
+    i2s_t * bus = (i2s_t *)calloc(1, sizeof(i2s_t));
+    if(!bus) {
+        return NULL;
+    }
+    bus->port = (i2s_port_t)port;
+    bus->mode = config->mode;
+    uint8_t channels = (config->channelFormat == I2S_CHANNEL_FMT_RIGHT_LEFT || config->channelFormat == I2S_CHANNEL_FMT_ALL_RIGHT
+                        || config->channelFormat == I2S_CHANNEL_FMT_ALL_LEFT) ? 2 : 1;
+    bus->bufferSize = (size_t)config->dmaBufLen * channels * (config->bitsPerSample / 8);
+
+    if(config->mode & I2S_MODE_RX) {
+        uint8_t blocks = config->rxBlocks ? config->rxBlocks : config->dmaBufCount;
+        // one more than can be queued, the task fills it while the queue is full
+        bus->rxPool = poolCreate(bus->bufferSize, blocks + 1, MALLOC_CAP_8BIT);
+        bus->rxQueue = xQueueCreate(blocks, sizeof(i2s_block_t));
+        if(!bus->rxPool || !bus->rxQueue) {
+            log_e("no memory for %u receive blocks of %u bytes", blocks, bus->bufferSize);
+            _i2sFree(bus);
+            return NULL;
+        }
+    }
+
+    i2s_config_t i2s_config = {
+        .mode = config->mode,
+        .sample_rate = (int)config->sampleRate,
+        .bits_per_sample = config->bitsPerSample,
+        .channel_format = config->channelFormat,
+        .communication_format = config->commFormat,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = config->dmaBufCount,
+        .dma_buf_len = config->dmaBufLen,
+        .use_apll = config->useApll,
+        .tx_desc_auto_clear = true,
+        .fixed_mclk = 0
+    };
+    esp_err_t err = i2s_driver_install(bus->port, &i2s_config, config->dmaBufCount, &bus->events);
+    if(err != ESP_OK) {
+        log_e("i2s_driver_install failed: %d", err);
+        _i2sFree(bus);
+        return NULL;
+    }
+
+    if(config->mode & I2S_MODE_ADC_BUILT_IN) {
+        int8_t channel = (config->adcPin >= 0) ? digitalPinToAnalogChannel(config->adcPin) : -1;
+        if(channel < 0 || channel > 7) {
+            log_e("pin %d is not an ADC1 pin", config->adcPin);
+            err = ESP_ERR_INVALID_ARG;
+        } else {
+            err = i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channel);
+            if(err == ESP_OK) {
+                err = i2s_adc_enable(bus->port);
+            }
+        }
+    } else if(config->mode & I2S_MODE_DAC_BUILT_IN) {
+        err = i2s_set_pin(bus->port, NULL);
+    } else {
+        i2s_pin_config_t pins = {
+            .bck_io_num = config->bckPin,
+            .ws_io_num = config->wsPin,
+            .data_out_num = config->doutPin,
+            .data_in_num = config->dinPin
+        };
+        err = i2s_set_pin(bus->port, &pins);
+    }
+    if(err != ESP_OK) {
+        log_e("I2S%u pin setup failed: %d", port, err);
+        i2s_driver_uninstall(bus->port);
+        _i2sFree(bus);
+        return NULL;
+    }
+
+    if(xTaskCreateUniversal(_i2sTask, "i2s", I2S_TASK_STACK_SIZE, bus, I2S_TASK_PRIORITY, &bus->task, I2S_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("I2S task create failed");
+        i2s_driver_uninstall(bus->port);
+        _i2sFree(bus);
+        return NULL;
+    }
+    _i2s_bus[port] = bus;
+    return bus;
+}
+
+void i2sEnd(i2s_t * bus)
+{
+    if(!bus) {
+        return;
+    }
+    if(bus->task) {
+        i2s_event_t stop = { .type = I2S_EVENT_MAX, .size = 0 };
+        xQueueSendToFront(bus->events, &stop, portMAX_DELAY);
+        while(bus->task) {
+            delay(1);
+        }
+    }
+    if(bus->mode & I2S_MODE_ADC_BUILT_IN) {
+        i2s_adc_disable(bus->port);
+    }
+    i2s_driver_uninstall(bus->port);
+    _i2s_bus[bus->port] = NULL;
+    _i2sFree(bus);
+}
+
+size_t i2sBufferSize(i2s_t * bus)
+{
+    return bus ? bus->bufferSize : 0;
+}
+
+bool i2sSetSampleRate(i2s_t * bus, uint32_t rate)
+{
+    return bus && i2s_set_sample_rates(bus->port, rate) == ESP_OK;
+}
+
+void i2sOnBuffer(i2s_t * bus, i2s_buffer_cb_t cb, void * arg)
+{
+    if(!bus) {
+        return;
+    }
+    // cleared first so the task never calls the new cb with the old arg
+    bus->cb = NULL;
+    bus->arg = arg;
+    bus->cb = cb;
+}
+
+const uint8_t * i2sReadBuffer(i2s_t * bus, size_t * len, uint32_t timeout_ms)
+{
+    i2s_block_t item;
+    if(!bus || !bus->rxQueue || xQueueReceive(bus->rxQueue, &item, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        if(len) {
+            *len = 0;
+        }
+        return NULL;
+    }
+    if(len) {
+        *len = item.len;
+    }
+    return item.data;
+}
+
+void i2sReleaseBuffer(i2s_t * bus, const uint8_t * buffer)
+{
+    if(bus && buffer && !poolFree(bus->rxPool, (void *)buffer)) {
+        log_e("%p is not an I2S receive block", buffer);
+    }
+}
+
+size_t i2sBuffersAvailable(i2s_t * bus)
+{
+    return (bus && bus->rxQueue) ? uxQueueMessagesWaiting(bus->rxQueue) : 0;
+}
+
+size_t i2sWrite(i2s_t * bus, const void * data, size_t len, uint32_t timeout_ms)
+{
+    size_t written = 0;
+    if(bus && (bus->mode & I2S_MODE_TX)) {
+        i2s_write(bus->port, data, len, &written, pdMS_TO_TICKS(timeout_ms));
+    }
+    return written;
+}
+
+void i2sGetStats(i2s_t * bus, i2s_hal_stats_t * stats)
+{
+    if(bus && stats) {
+        *stats = bus->stats;
+    }
+}
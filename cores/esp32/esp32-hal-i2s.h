@@ -0,0 +1,91 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_I2S_H_
+#define _ESP32_HAL_I2S_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/i2s.h"
+
+/*
+ * I2S on top of the IDF driver, with a task per port that takes every DMA buffer
+ * as it completes. Received buffers are copied once, into blocks of a pool, and
+ * either handed to the buffer callback (valid until it returns) or queued for
+ * i2sReadBuffer(), which gives out the block itself; i2sReleaseBuffer() returns
+ * it. When all blocks are taken the driver drops the oldest DMA buffer and an
+ * overrun is counted. The callback also sees every sent DMA buffer, so a stream
+ * can be refilled from it with i2sWrite(bus, data, len, 0).
+ */
+typedef struct i2s_s i2s_t;
+
+typedef void (*i2s_buffer_cb_t)(void * arg, i2s_event_type_t event, const uint8_t * data, size_t len);
+
+typedef struct {
+    i2s_mode_t mode;                    // I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_RX ...
+    uint32_t sampleRate;
+    i2s_bits_per_sample_t bitsPerSample;
+    i2s_channel_fmt_t channelFormat;
+    i2s_comm_format_t commFormat;
+    uint8_t dmaBufCount;                // 2 - 128
+    uint16_t dmaBufLen;                 // frames per DMA buffer, 8 - 1024
+    uint8_t rxBlocks;                   // received buffers that can wait to be read, 0 for dmaBufCount
+    bool useApll;
+    int8_t bckPin;                      // -1 for unused
+    int8_t wsPin;
+    int8_t doutPin;
+    int8_t dinPin;
+    int8_t adcPin;                      // an ADC1 pin for I2S_MODE_ADC_BUILT_IN
+} i2s_hal_config_t;
+
+typedef struct {
+    uint32_t rxBuffers;                 // DMA buffers received
+    uint32_t rxOverruns;                // received while every block was taken
+    uint32_t txBuffers;                 // DMA buffers sent
+    uint32_t dmaErrors;
+} i2s_hal_stats_t;
+
+// 44.1 kHz 16 bit stereo master transmitter, 8 buffers of 256 frames
+void i2sDefaultConfig(i2s_hal_config_t * config);
+
+i2s_t * i2sBegin(uint8_t port, const i2s_hal_config_t * config);
+void i2sEnd(i2s_t * bus);
+
+// bytes in one DMA buffer, the size of the blocks i2sReadBuffer() gives out
+size_t i2sBufferSize(i2s_t * bus);
+bool i2sSetSampleRate(i2s_t * bus, uint32_t rate);
+
+// runs in the I2S task, NULL queues received buffers again
+void i2sOnBuffer(i2s_t * bus, i2s_buffer_cb_t cb, void * arg);
+
+const uint8_t * i2sReadBuffer(i2s_t * bus, size_t * len, uint32_t timeout_ms);
+void i2sReleaseBuffer(i2s_t * bus, const uint8_t * buffer);
+// received blocks waiting to be read
+size_t i2sBuffersAvailable(i2s_t * bus);
+
+size_t i2sWrite(i2s_t * bus, const void * data, size_t len, uint32_t timeout_ms);
+
+void i2sGetStats(i2s_t * bus, i2s_hal_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_I2S_H_ */
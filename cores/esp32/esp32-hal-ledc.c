@@ -21,6 +21,7 @@
 #include "soc/dport_reg.h"
 #include "soc/ledc_reg.h"
 #include "soc/ledc_struct.h"
+#include "esp_intr_alloc.h"
 
 #if CONFIG_DISABLE_HAL_LOCKS
 #define LEDC_MUTEX_LOCK()
@@ -53,30 +54,54 @@ xSemaphoreHandle _ledc_sys_lock = NULL;
 #define LEDC_CHAN(g,c) LEDC.channel_group[(g)].channel[(c)]
 #define LEDC_TIMER(g,t) LEDC.timer_group[(g)].timer[(t)]
 
+// duty_chng_end interrupt bits follow the ledc channel numbering
+#define LEDC_FADE_END_INT(chan) (1 << (8 + (chan)))
+
+typedef struct {
+    ledc_fade_cb_t cb;
+    void * arg;
+} ledc_fade_handler_t;
+
+static ledc_fade_handler_t _ledc_fade_handlers[16];
+static intr_handle_t _ledc_intr_handle = NULL;
+
+// timer conf register fields
+#define LEDC_TIMER_DIV_S        5
+#define LEDC_TIMER_DIV_M        (LEDC_DIV_NUM_HSTIMER0_V << LEDC_TIMER_DIV_S)
+#define LEDC_TIMER_TICK_SEL_M   (1 << 25)
+#define LEDC_TIMER_LS_UPDATE_M  (1 << 26)
+
 static void _on_apb_change(void * arg, apb_change_ev_t ev_type, uint32_t old_apb, uint32_t new_apb){
-    if(ev_type == APB_AFTER_CHANGE && old_apb != new_apb){
+    if(ev_type == APB_BEFORE_CHANGE && old_apb != new_apb){
         uint16_t iarg = *(uint16_t*)arg;
         uint8_t chan = 0;
+        uint8_t done = 0;
         old_apb /= 1000000;
         new_apb /= 1000000;
+        LEDC_MUTEX_LOCK();
         while(iarg){ // run though all active channels, adjusting timing configurations
-            if(iarg & 1) {// this channel is active
-                uint8_t group=(chan/8), timer=((chan/2)%4);
+            uint8_t group=(chan/8), timer=((chan/2)%4);
+            // channel pairs share a timer, compute it once
+            if((iarg & 1) && !(done & (1 << (group * 4 + timer)))) {// this channel is active
+                done |= 1 << (group * 4 + timer);
                 if(LEDC_TIMER(group, timer).conf.tick_sel){
-                    LEDC_MUTEX_LOCK();
                     uint32_t old_div = LEDC_TIMER(group, timer).conf.clock_divider;
                     uint32_t div_num = (new_apb * old_div) / old_apb;
+                    uint32_t tick_sel = LEDC_TIMER_TICK_SEL_M;
                     if(div_num > LEDC_DIV_NUM_HSTIMER0_V){
                         div_num = ((REF_CLK_FREQ /1000000) * old_div) / old_apb;
                         if(div_num > LEDC_DIV_NUM_HSTIMER0_V) {
                             div_num = LEDC_DIV_NUM_HSTIMER0_V;//lowest clock possible
                         }
-                        LEDC_TIMER(group, timer).conf.tick_sel = 0;
+                        tick_sel = 0;
                     } else if(div_num < 256) {
                         div_num = 256;//highest clock possible
                     }
-                    LEDC_TIMER(group, timer).conf.clock_divider = div_num;
-                    LEDC_MUTEX_UNLOCK();
+                    // applied with the clock switch
+                    apbChangeQueueWrite(&LEDC_TIMER(group, timer).conf.val, LEDC_TIMER_DIV_M | LEDC_TIMER_TICK_SEL_M, (div_num << LEDC_TIMER_DIV_S) | tick_sel);
+                    if(group) {
+                        apbChangeQueueWrite(&LEDC_TIMER(group, timer).conf.val, LEDC_TIMER_LS_UPDATE_M, LEDC_TIMER_LS_UPDATE_M);
+                    }
                 }
                 else {
                     log_d("using REF_CLK chan=%d",chan);
@@ -85,6 +110,7 @@ static void _on_apb_change(void * arg, apb_change_ev_t ev_type, uint32_t old_apb
             iarg = iarg >> 1;
             chan++;
         }
+        LEDC_MUTEX_UNLOCK();
     }
 }
 
@@ -202,6 +228,12 @@ void ledcWrite(uint8_t chan, uint32_t duty)
     uint8_t group=(chan/8), channel=(chan%8);
     LEDC_MUTEX_LOCK();
     LEDC_CHAN(group, channel).duty.duty = duty << 4;//25 bit (21.4)
+    // a single step of no size, so a previous fade setup does not run again
+    LEDC_CHAN(group, channel).conf1.duty_inc = 1;
+    LEDC_CHAN(group, channel).conf1.duty_num = 1;
+    LEDC_CHAN(group, channel).conf1.duty_cycle = 1;
+    LEDC_CHAN(group, channel).conf1.duty_scale = 0;
+    LEDC.int_ena.val &= ~LEDC_FADE_END_INT(chan);
     if(duty) {
         LEDC_CHAN(group, channel).conf0.sig_out_en = 1;//This is the output enable control bit for channel
         LEDC_CHAN(group, channel).conf1.duty_start = 1;//When duty_num duty_cycle and duty_scale has been configured. these register won't take effect until set duty_start. this bit is automatically cleared by hardware.
@@ -222,6 +254,217 @@ void ledcWrite(uint8_t chan, uint32_t duty)
     LEDC_MUTEX_UNLOCK();
 }
 
+static void IRAM_ATTR _ledc_isr(void * arg)
+{
+    uint32_t status = LEDC.int_st.val;
+    LEDC.int_clr.val = status;
+    LEDC.int_ena.val &= ~status;//one callback per fade
+    for(uint8_t chan = 0; chan < 16; chan++){
+        if((status & LEDC_FADE_END_INT(chan)) && _ledc_fade_handlers[chan].cb){
+            _ledc_fade_handlers[chan].cb(chan, _ledc_fade_handlers[chan].arg);
+        }
+    }
+}
+
+bool ledcOnFadeEnd(uint8_t chan, ledc_fade_cb_t cb, void * arg)
+{
+    if(chan > 15) {
+        return false;
+    }
+    if(cb && !_ledc_intr_handle){
+        if(esp_intr_alloc(ETS_LEDC_INTR_SOURCE, (int)ESP_INTR_FLAG_IRAM, _ledc_isr, NULL, &_ledc_intr_handle) != ESP_OK){
+            log_e("LEDC interrupt alloc failed");
+            return false;
+        }
+    }
+    portDISABLE_INTERRUPTS();
+    _ledc_fade_handlers[chan].cb = cb;
+    _ledc_fade_handlers[chan].arg = arg;
+    portENABLE_INTERRUPTS();
+    return true;
+}
+
+/*
+ * The duty moves by scale every cycles PWM periods until it reaches targetDuty.
+ * The start point is shifted by the remainder so the fade ends exactly on target.
+ */
+bool ledcFadeWithStep(uint8_t chan, uint32_t targetDuty, uint16_t scale, uint16_t cycles)
+{
+    if(chan > 15 || scale > LEDC_DUTY_SCALE_HSCH0_V || cycles > LEDC_DUTY_CYCLE_HSCH0_V) {
+        return false;
+    }
+    uint8_t group=(chan/8), channel=(chan%8);
+    uint32_t duty = LEDC_CHAN(group, channel).duty_rd.duty_read >> 4;
+    bool increase = targetDuty >= duty;
+    uint32_t delta = increase ? (targetDuty - duty) : (duty - targetDuty);
+    uint32_t steps = scale ? (delta / scale) : 0;
+    if(steps > LEDC_DUTY_NUM_HSCH0_V) {
+        steps = LEDC_DUTY_NUM_HSCH0_V;
+    }
+    if(!steps || !cycles) {
+        ledcWrite(chan, targetDuty);
+        if(_ledc_fade_handlers[chan].cb){
+            _ledc_fade_handlers[chan].cb(chan, _ledc_fade_handlers[chan].arg);
+        }
+        return true;
+    }
+    duty = increase ? (targetDuty - steps * scale) : (targetDuty + steps * scale);
+
+    LEDC_MUTEX_LOCK();
+    if(_ledc_fade_handlers[chan].cb){
+        LEDC.int_clr.val = LEDC_FADE_END_INT(chan);
+        LEDC.int_ena.val |= LEDC_FADE_END_INT(chan);
+    } else {
+        LEDC.int_ena.val &= ~LEDC_FADE_END_INT(chan);
+    }
+    LEDC_CHAN(group, channel).duty.duty = duty << 4;//25 bit (21.4)
+    LEDC_CHAN(group, channel).conf1.duty_inc = increase;
+    LEDC_CHAN(group, channel).conf1.duty_num = steps;
+    LEDC_CHAN(group, channel).conf1.duty_cycle = cycles;
+    LEDC_CHAN(group, channel).conf1.duty_scale = scale;
+    LEDC_CHAN(group, channel).conf0.sig_out_en = 1;
+    LEDC_CHAN(group, channel).conf1.duty_start = 1;
+    if(group) {
+        LEDC_CHAN(group, channel).conf0.low_speed_update = 1;
+    } else {
+        LEDC_CHAN(group, channel).conf0.clk_en = 1;
+    }
+    LEDC_MUTEX_UNLOCK();
+    return true;
+}
+
+bool ledcFade(uint8_t chan, uint32_t targetDuty, uint32_t durationMs)
+{
+    if(chan > 15) {
+        return false;
+    }
+    uint32_t duty = LEDC.channel_group[chan/8].channel[chan%8].duty_rd.duty_read >> 4;
+    uint32_t delta = (targetDuty > duty) ? (targetDuty - duty) : (duty - targetDuty);
+    uint32_t periods = (uint32_t)(_ledcTimerRead(chan) * durationMs / 1000);
+    if(!delta || !periods) {
+        return ledcFadeWithStep(chan, targetDuty, 0, 0);
+    }
+    // smallest step that fits the step counter, then spread the periods over the steps
+    uint32_t scale = (delta + LEDC_DUTY_NUM_HSCH0_V - 1) / LEDC_DUTY_NUM_HSCH0_V;
+    uint32_t steps = delta / scale;
+    if(periods < steps) {
+        scale = (delta + periods - 1) / periods;
+        steps = delta / scale;
+    }
+    uint32_t cycles = periods / steps;
+    if(cycles > LEDC_DUTY_CYCLE_HSCH0_V) {
+        cycles = LEDC_DUTY_CYCLE_HSCH0_V;
+    } else if(!cycles) {
+        cycles = 1;
+    }
+    if(scale > LEDC_DUTY_SCALE_HSCH0_V) {
+        scale = LEDC_DUTY_SCALE_HSCH0_V;
+    }
+    return ledcFadeWithStep(chan, targetDuty, scale, cycles);
+}
+
+// duty update without the HAL lock, latched by the hardware at the next timer overflow
+static inline void IRAM_ATTR _ledcWriteDutyNL(uint8_t group, uint8_t channel, uint32_t duty)
+{
+    LEDC_CHAN(group, channel).duty.duty = duty << 4;//25 bit (21.4)
+    LEDC_CHAN(group, channel).conf0.sig_out_en = (duty != 0);
+    // single step of no size, also cancels a fade
+    LEDC_CHAN(group, channel).conf1.val = (1 << 30) | (1 << 20) | (1 << 10) | ((uint32_t)(duty != 0) << 31);
+    if(group) {
+        LEDC_CHAN(group, channel).conf0.low_speed_update = 1;
+    } else {
+        LEDC_CHAN(group, channel).conf0.clk_en = (duty != 0);
+    }
+}
+
+void IRAM_ATTR ledcWriteFast(uint8_t chan, uint32_t duty)
+{
+    if(chan > 15) {
+        return;
+    }
+    _ledcWriteDutyNL(chan/8, chan%8, duty);
+}
+
+// stay clear of the overflow so all channels of the timer latch in the same period
+static inline void IRAM_ATTR _ledcWaitClearOfOverflow(uint8_t group, uint8_t timer)
+{
+    uint32_t period = 1 << LEDC_TIMER(group, timer).conf.duty_resolution;
+    if(!LEDC_TIMER(group, timer).conf.pause && LEDC_TIMER(group, timer).value.timer_cnt >= period - period / 4) {
+        while(LEDC_TIMER(group, timer).value.timer_cnt >= period / 2);
+    }
+}
+
+bool IRAM_ATTR ledcWriteMulti(const uint8_t * chans, const uint32_t * duties, uint8_t count)
+{
+    if(!chans || !duties || !count || chans[0] > 15) {
+        return false;
+    }
+    uint8_t group = chans[0]/8, timer = (chans[0]/2)%4;
+    for(uint8_t i = 1; i < count; i++) {
+        if(chans[i] > 15 || chans[i]/8 != group) {
+            return false;
+        }
+    }
+    _ledcWaitClearOfOverflow(group, timer);
+    for(uint8_t i = 0; i < count; i++) {
+        _ledcWriteDutyNL(group, chans[i]%8, duties[i]);
+    }
+    return true;
+}
+
+void IRAM_ATTR ledcUpdateStage(ledc_update_t * update, uint8_t chan, uint32_t duty)
+{
+    if(!update || chan > 15) {
+        return;
+    }
+    update->duty[chan] = duty;
+    update->mask |= (1 << chan);
+}
+
+static DRAM_ATTR portMUX_TYPE _ledc_update_mux = portMUX_INITIALIZER_UNLOCKED;
+
+bool IRAM_ATTR ledcUpdateCommit(ledc_update_t * update)
+{
+    if(!update || !update->mask) {
+        return false;
+    }
+    uint16_t mask = update->mask;
+    uint8_t timers = 0;
+    // the duties go into the channels' shadow registers, no start or update yet
+    for(uint8_t chan = 0; chan < 16; chan++) {
+        if(!(mask & (1 << chan))) {
+            continue;
+        }
+        uint8_t group = chan/8, channel = chan%8;
+        LEDC_CHAN(group, channel).duty.duty = update->duty[chan] << 4;//25 bit (21.4)
+        LEDC_CHAN(group, channel).conf1.val = (1 << 30) | (1 << 20) | (1 << 10);
+        timers |= 1 << (group * 4 + (chan/2)%4);
+    }
+    for(uint8_t t = 0; t < 8; t++) {
+        if(timers & (1 << t)) {
+            _ledcWaitClearOfOverflow(t / 4, t % 4);
+        }
+    }
+    // then the latches, back to back; each timer's channels take them at its next overflow
+    portENTER_CRITICAL_SAFE(&_ledc_update_mux);
+    for(uint8_t chan = 0; chan < 16; chan++) {
+        if(mask & (1 << chan)) {
+            uint32_t duty = update->duty[chan];
+            uint8_t group = chan/8, channel = chan%8;
+            LEDC_CHAN(group, channel).conf0.sig_out_en = (duty != 0);
+            LEDC_CHAN(group, channel).conf1.val = (1 << 30) | (1 << 20) | (1 << 10) | ((uint32_t)(duty != 0) << 31);
+            if(group) {
+                LEDC_CHAN(group, channel).conf0.low_speed_update = 1;
+            } else {
+                LEDC_CHAN(group, channel).conf0.clk_en = (duty != 0);
+            }
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&_ledc_update_mux);
+    update->mask = 0;
+    return true;
+}
+
 uint32_t ledcRead(uint8_t chan)
 {
     if(chan > 15) {
@@ -36,6 +36,29 @@ double      ledcReadFreq(uint8_t channel);
 void        ledcAttachPin(uint8_t pin, uint8_t channel);
 void        ledcDetachPin(uint8_t pin);
 
+//lock-free and ISR safe, the caller owns the channel(s); the new duty applies from the next PWM period
+void        ledcWriteFast(uint8_t channel, uint32_t duty);
+//channels must be in the same group (0-7 or 8-15); the write is timed against the first channel's timer
+bool        ledcWriteMulti(const uint8_t * channels, const uint32_t * duties, uint8_t count);
+
+//duties staged for any channels, then latched together: the channels of a timer switch in the same period;
+//start from a zeroed ledc_update_t, ledcUpdateCommit() empties it again. Lock-free and ISR safe like ledcWriteFast()
+typedef struct {
+    uint16_t mask;
+    uint32_t duty[16];
+} ledc_update_t;
+
+void        ledcUpdateStage(ledc_update_t * update, uint8_t channel, uint32_t duty);
+bool        ledcUpdateCommit(ledc_update_t * update);
+
+//hardware fade from the current duty, no CPU involved while it runs
+typedef void (*ledc_fade_cb_t)(uint8_t channel, void * arg);
+
+bool        ledcFade(uint8_t channel, uint32_t targetDuty, uint32_t durationMs);
+bool        ledcFadeWithStep(uint8_t channel, uint32_t targetDuty, uint16_t scale, uint16_t cycles);
+//cb runs in the LEDC ISR (must be IRAM safe) when a fade on channel ends, NULL to detach
+bool        ledcOnFadeEnd(uint8_t channel, ledc_fade_cb_t cb, void * arg);
+
 
 #ifdef __cplusplus
 }
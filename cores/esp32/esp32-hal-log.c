@@ -0,0 +1,441 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "soc/soc_memory_layout.h"
+
+#ifndef ARDUHAL_LOG_TASK_STACK_SIZE
+#define ARDUHAL_LOG_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef ARDUHAL_LOG_TASK_PRIORITY
+#define ARDUHAL_LOG_TASK_PRIORITY 1
+#endif
+
+#ifndef ARDUHAL_LOG_TASK_RUNNING_CORE
+#define ARDUHAL_LOG_TASK_RUNNING_CORE -1
+#endif
+
+/*
+ * Multi producer / single consumer record ring.
+ * Writers reserve space by moving reserve with compare-and-set, fill the record and then publish it
+ * by setting LOG_REC_COMMITTED in its header. The log task consumes committed records in order,
+ * zeroes their header and moves tail. Records never wrap, the unused end of the ring is skipped
+ * with a padding record. Indexes are free running and the size is a power of two.
+ */
+#define LOG_REC_LEN_MASK    0x0000FFFF
+#define LOG_REC_TYPE_S      24
+#define LOG_REC_TYPE_MASK   (0x0F << LOG_REC_TYPE_S)
+#define LOG_REC_COMMITTED   0x80000000
+#define LOG_REC_HEADER_LEN  sizeof(uint32_t)
+#define LOG_REC_ALIGN(l)    (((l) + 3) & ~3)
+
+// Binary records hold the format pointer followed by the raw arguments in 32 bit words.
+// Strings in flash are kept as pointers, any other string is copied inline behind a length word.
+#define LOG_BIN_MAX_LEN     256
+#define LOG_BIN_INLINE_STR  0x80000000
+#define LOG_BIN_MAX_SPEC    24
+
+typedef struct {
+    uint8_t * buf;
+    uint32_t size;
+    volatile uint32_t reserve;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+    uint32_t reported;
+    TaskHandle_t task;
+    log_buffer_sink_t sink;
+} log_buffer_t;
+
+static log_buffer_t s_log_buffer = {0};
+
+static inline uint32_t IRAM_ATTR log_compare_set(volatile uint32_t * addr, uint32_t compare, uint32_t set)
+{
+    uxPortCompareSet(addr, compare, &set);
+    return set;
+}
+
+static void IRAM_ATTR log_count_drop()
+{
+    uint32_t dropped;
+    do {
+        dropped = s_log_buffer.dropped;
+    } while(log_compare_set(&s_log_buffer.dropped, dropped, dropped + 1) != dropped);
+}
+
+void * IRAM_ATTR logBufferReserve(size_t len, uint8_t type)
+{
+    log_buffer_t * log = &s_log_buffer;
+    uint8_t * buf = log->buf;
+    if(buf == NULL || len > LOG_REC_LEN_MASK) {
+        return NULL;
+    }
+    uint32_t need = LOG_REC_HEADER_LEN + LOG_REC_ALIGN(len);
+    uint32_t head, offset, pad, total;
+    do {
+        head = log->reserve;
+        offset = head & (log->size - 1);
+        pad = (need > log->size - offset) ? log->size - offset : 0;
+        total = pad + need;
+        if(head + total - log->tail > log->size) {
+            log_count_drop();
+            return NULL;
+        }
+    } while(log_compare_set(&log->reserve, head, head + total) != head);
+
+    if(pad) {
+        *(volatile uint32_t *)(buf + offset) = LOG_REC_COMMITTED | (LOG_RECORD_PAD << LOG_REC_TYPE_S) | (pad - LOG_REC_HEADER_LEN);
+        offset = 0;
+    }
+    *(uint32_t *)(buf + offset) = ((uint32_t)type << LOG_REC_TYPE_S) | len;
+    return buf + offset + LOG_REC_HEADER_LEN;
+}
+
+void IRAM_ATTR logBufferCommit(void * record)
+{
+    volatile uint32_t * header = (volatile uint32_t *)((uint8_t *)record - LOG_REC_HEADER_LEN);
+    *header |= LOG_REC_COMMITTED;
+    if(s_log_buffer.task != NULL) {
+        if(xPortInIsrContext()) {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(s_log_buffer.task, &woken);
+            if(woken) {
+                portYIELD_FROM_ISR();
+            }
+        } else {
+            xTaskNotifyGive(s_log_buffer.task);
+        }
+    }
+}
+
+size_t logBufferWrite(const char * data, size_t len)
+{
+    char * record = (char *)logBufferReserve(len, LOG_RECORD_TEXT);
+    if(record == NULL) {
+        return 0;
+    }
+    memcpy(record, data, len);
+    logBufferCommit(record);
+    return len;
+}
+
+static void log_buffer_emit(const char * data, size_t len)
+{
+    if(s_log_buffer.sink != NULL) {
+        s_log_buffer.sink(data, len);
+    } else {
+        uartWriteDebug((const uint8_t *)data, len);
+    }
+}
+
+typedef enum {
+    LOG_ARG_NONE, LOG_ARG_INT, LOG_ARG_INT64, LOG_ARG_DOUBLE, LOG_ARG_PTR, LOG_ARG_STR
+} log_arg_t;
+
+/*
+ * Parses one conversion specification starting after '%'.
+ * Returns the argument kind, *end points behind the conversion character and
+ * *stars tells how many '*' width/precision arguments come first.
+ */
+static log_arg_t log_parse_spec(const char * p, const char ** end, int * stars)
+{
+    bool wide = false;
+    *stars = 0;
+    while(*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    if(*p == '*') {
+        (*stars)++;
+        p++;
+    }
+    while(*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if(*p == '.') {
+        p++;
+        if(*p == '*') {
+            (*stars)++;
+            p++;
+        }
+        while(*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    while(*p && strchr("hlLqjzt", *p)) {
+        if((*p == 'l' && p[1] == 'l') || *p == 'q' || *p == 'j') {
+            wide = true;
+        }
+        p++;
+    }
+    *end = *p ? p + 1 : p;
+    switch(*p) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        return wide ? LOG_ARG_INT64 : LOG_ARG_INT;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        return LOG_ARG_DOUBLE;
+    case 's':
+        return LOG_ARG_STR;
+    case 'p': case 'n':
+        return LOG_ARG_PTR;
+    default:
+        return LOG_ARG_NONE;
+    }
+}
+
+int log_printf_deferred(const char *format, ...)
+{
+    va_list arg;
+    if(!logBufferActive() || !esp_ptr_in_drom(format)) {
+        // only literals outlive the call, anything else is formatted right away
+        va_start(arg, format);
+        int len = log_vprintf(format, arg);
+        va_end(arg);
+        return len;
+    }
+
+    uint32_t words[LOG_BIN_MAX_LEN / sizeof(uint32_t)];
+    size_t n = 0;
+    size_t max = sizeof(words) / sizeof(words[0]);
+    const char * p = format;
+    words[n++] = (uint32_t)format;
+    va_start(arg, format);
+    while((p = strchr(p, '%')) != NULL) {
+        int stars;
+        if(p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        log_arg_t kind = log_parse_spec(p + 1, &p, &stars);
+        while(stars-- && n < max) {
+            words[n++] = va_arg(arg, int);
+        }
+        if(kind == LOG_ARG_INT64 || kind == LOG_ARG_DOUBLE) {
+            uint64_t v = (kind == LOG_ARG_DOUBLE) ? 0 : va_arg(arg, uint64_t);
+            if(kind == LOG_ARG_DOUBLE) {
+                double d = va_arg(arg, double);
+                memcpy(&v, &d, sizeof(v));
+            }
+            if(n + 2 > max) {
+                break;
+            }
+            memcpy(&words[n], &v, sizeof(v));
+            n += 2;
+        } else if(kind == LOG_ARG_STR) {
+            const char * str = va_arg(arg, const char *);
+            if(str == NULL || esp_ptr_in_drom(str)) {
+                if(n >= max) {
+                    break;
+                }
+                words[n++] = (uint32_t)str;
+            } else {
+                size_t len = strlen(str);
+                size_t room = (max - n - 1) * sizeof(uint32_t);
+                if(n + 1 >= max) {
+                    break;
+                }
+                if(len >= room) {
+                    len = room - 1;
+                }
+                words[n++] = LOG_BIN_INLINE_STR | len;
+                memcpy(&words[n], str, len);
+                ((char *)&words[n])[len] = 0;
+                n += (len + sizeof(uint32_t)) / sizeof(uint32_t);
+            }
+        } else if(kind != LOG_ARG_NONE) {
+            if(n >= max) {
+                break;
+            }
+            words[n++] = (kind == LOG_ARG_PTR) ? (uint32_t)va_arg(arg, void *) : va_arg(arg, uint32_t);
+        }
+    }
+    va_end(arg);
+
+    void * record = logBufferReserve(n * sizeof(uint32_t), LOG_RECORD_BINARY);
+    if(record == NULL) {
+        return 0;
+    }
+    memcpy(record, words, n * sizeof(uint32_t));
+    logBufferCommit(record);
+    return n * sizeof(uint32_t);
+}
+
+// Formats a binary record in the log task, one conversion at a time.
+static void log_binary_decode(const uint32_t * words, size_t count)
+{
+    char out[LOG_BIN_MAX_LEN];
+    char spec[LOG_BIN_MAX_SPEC];
+    size_t len = 0;
+    size_t n = 1;
+    const char * p = (const char *)words[0];
+
+    while(*p && len < sizeof(out) - 1) {
+        const char * next = strchr(p, '%');
+        size_t literal = next ? (size_t)(next - p) : strlen(p);
+        if(literal > sizeof(out) - 1 - len) {
+            literal = sizeof(out) - 1 - len;
+        }
+        memcpy(out + len, p, literal);
+        len += literal;
+        if(next == NULL || len >= sizeof(out) - 1) {
+            break;
+        }
+        if(next[1] == '%') {
+            out[len++] = '%';
+            p = next + 2;
+            continue;
+        }
+        int stars;
+        const char * end;
+        log_arg_t kind = log_parse_spec(next + 1, &end, &stars);
+        // rebuild the specification with any '*' replaced by the recorded value
+        size_t s = 0;
+        const char * c;
+        for(c = next; c < end && s < sizeof(spec) - 12; c++) {
+            if(*c == '*' && n < count) {
+                s += snprintf(spec + s, sizeof(spec) - s, "%d", (int)words[n++]);
+            } else {
+                spec[s++] = *c;
+            }
+        }
+        spec[s] = 0;
+        size_t room = sizeof(out) - len;
+        int w = 0;
+        if(kind == LOG_ARG_INT64 && n + 2 <= count) {
+            uint64_t v;
+            memcpy(&v, &words[n], sizeof(v));
+            n += 2;
+            w = snprintf(out + len, room, spec, v);
+        } else if(kind == LOG_ARG_DOUBLE && n + 2 <= count) {
+            double d;
+            memcpy(&d, &words[n], sizeof(d));
+            n += 2;
+            w = snprintf(out + len, room, spec, d);
+        } else if(kind == LOG_ARG_STR && n < count) {
+            uint32_t v = words[n++];
+            const char * str = (const char *)v;
+            if(v & LOG_BIN_INLINE_STR) {
+                str = (const char *)&words[n];
+                n += ((v & ~LOG_BIN_INLINE_STR) + sizeof(uint32_t)) / sizeof(uint32_t);
+            }
+            w = snprintf(out + len, room, spec, str);
+        } else if(kind == LOG_ARG_PTR && n < count) {
+            w = snprintf(out + len, room, spec, (void *)words[n++]);
+        } else if(kind == LOG_ARG_INT && n < count) {
+            w = snprintf(out + len, room, spec, words[n++]);
+        }
+        if(w > 0) {
+            len += ((size_t)w < room) ? (size_t)w : room - 1;
+        }
+        p = end;
+    }
+    log_buffer_emit(out, len);
+}
+
+// Hands every committed record to the sink, returns false once it reaches one that is still being written.
+static bool log_buffer_drain()
+{
+    log_buffer_t * log = &s_log_buffer;
+    while(log->tail != log->reserve) {
+        uint32_t tail = log->tail;
+        volatile uint32_t * header = (volatile uint32_t *)(log->buf + (tail & (log->size - 1)));
+        uint32_t rec = *header;
+        if(!(rec & LOG_REC_COMMITTED)) {
+            return false;
+        }
+        uint32_t len = rec & LOG_REC_LEN_MASK;
+        uint8_t type = (rec & LOG_REC_TYPE_MASK) >> LOG_REC_TYPE_S;
+        if(type == LOG_RECORD_TEXT) {
+            const char * text = (const char *)(header + 1);
+            // log_printf() reserves room for the terminator of vsnprintf()
+            log_buffer_emit(text, (len && !text[len - 1]) ? len - 1 : len);
+        } else if(type == LOG_RECORD_BINARY) {
+            log_binary_decode((const uint32_t *)(header + 1), len / sizeof(uint32_t));
+        }
+        *header = 0;
+        log->tail = tail + LOG_REC_HEADER_LEN + LOG_REC_ALIGN(len);
+    }
+    uint32_t dropped = log->dropped;
+    if(dropped != log->reported) {
+        char msg[48];
+        int len = snprintf(msg, sizeof(msg), "[log] %u messages dropped\r\n", dropped - log->reported);
+        log->reported = dropped;
+        log_buffer_emit(msg, len);
+    }
+    return true;
+}
+
+static void log_buffer_task(void * arg)
+{
+    for(;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while(!log_buffer_drain()) {
+            // a writer was preempted in the middle of its record
+            vTaskDelay(1);
+        }
+    }
+}
+
+bool logBufferBegin(size_t size)
+{
+    if(s_log_buffer.buf != NULL) {
+        return true;
+    }
+    uint32_t rounded = 64;
+    while(rounded < size) {
+        rounded <<= 1;
+    }
+    uint8_t * buf = (uint8_t *)calloc(1, rounded);
+    if(buf == NULL) {
+        return false;
+    }
+    s_log_buffer.size = rounded;
+    s_log_buffer.reserve = 0;
+    s_log_buffer.tail = 0;
+    s_log_buffer.dropped = 0;
+    s_log_buffer.reported = 0;
+    if(xTaskCreateUniversal(log_buffer_task, "log", ARDUHAL_LOG_TASK_STACK_SIZE, NULL, ARDUHAL_LOG_TASK_PRIORITY, &s_log_buffer.task, ARDUHAL_LOG_TASK_RUNNING_CORE) != pdPASS) {
+        free(buf);
+        s_log_buffer.task = NULL;
+        return false;
+    }
+    s_log_buffer.buf = buf;
+    return true;
+}
+
+bool logBufferActive()
+{
+    return s_log_buffer.buf != NULL;
+}
+
+void logBufferSetSink(log_buffer_sink_t sink)
+{
+    s_log_buffer.sink = sink;
+}
+
+uint32_t logBufferDropped()
+{
+    return s_log_buffer.dropped;
+}
+
+void logBufferFlush(uint32_t timeout_ms)
+{
+    uint32_t start = millis();
+    while(s_log_buffer.buf != NULL && s_log_buffer.tail != s_log_buffer.reserve && (millis() - start) < timeout_ms) {
+        xTaskNotifyGive(s_log_buffer.task);
+        delay(1);
+    }
+}
@@ -20,6 +20,10 @@ extern "C"
 {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
 #include "sdkconfig.h"
 
 #define ARDUHAL_LOG_LEVEL_NONE       (0)
@@ -74,12 +78,50 @@ extern "C"
 
 const char * pathToFileName(const char * path);
 int log_printf(const char *fmt, ...);
+int log_vprintf(const char *fmt, va_list args);
+
+/*
+ * Deferred logging: once logBufferBegin() has been called, log_printf() only appends to a lock-free
+ * ring buffer and a low priority task writes the messages out to the sink (the debug UART by default).
+ * Messages that do not fit are dropped and counted.
+ */
+#define LOG_RECORD_TEXT   0
+#define LOG_RECORD_PAD    1
+#define LOG_RECORD_BINARY 2
+
+typedef void (*log_buffer_sink_t)(const char * data, size_t len);
+
+bool logBufferBegin(size_t size);
+bool logBufferActive();
+void logBufferSetSink(log_buffer_sink_t sink);
+uint32_t logBufferDropped();
+void logBufferFlush(uint32_t timeout_ms);
+size_t logBufferWrite(const char * data, size_t len);
+void * logBufferReserve(size_t len, uint8_t type);
+void logBufferCommit(void * record);
+
+/*
+ * With ARDUHAL_LOG_BINARY set the log_x() macros do not format in the caller. The format pointer and the raw
+ * arguments are stored in the log buffer and the log task formats them later. Without an active log buffer,
+ * or for formats that are not literals, it falls back to log_printf().
+ */
+#ifndef ARDUHAL_LOG_BINARY
+#define ARDUHAL_LOG_BINARY 0
+#endif
+
+int log_printf_deferred(const char *fmt, ...);
+
+#if ARDUHAL_LOG_BINARY
+#define ARDUHAL_LOG_PRINTF log_printf_deferred
+#else
+#define ARDUHAL_LOG_PRINTF log_printf
+#endif
 
 #define ARDUHAL_SHORT_LOG_FORMAT(letter, format)  ARDUHAL_LOG_COLOR_ ## letter format ARDUHAL_LOG_RESET_COLOR "\r\n"
 #define ARDUHAL_LOG_FORMAT(letter, format)  ARDUHAL_LOG_COLOR_ ## letter "[" #letter "][%s:%u] %s(): " format ARDUHAL_LOG_RESET_COLOR "\r\n", pathToFileName(__FILE__), __LINE__, __FUNCTION__
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_VERBOSE
-#define log_v(format, ...) log_printf(ARDUHAL_LOG_FORMAT(V, format), ##__VA_ARGS__)
+#define log_v(format, ...) ARDUHAL_LOG_PRINTF(ARDUHAL_LOG_FORMAT(V, format), ##__VA_ARGS__)
 #define isr_log_v(format, ...) ets_printf(ARDUHAL_LOG_FORMAT(V, format), ##__VA_ARGS__)
 #else
 #define log_v(format, ...)
@@ -87,7 +129,7 @@ int log_printf(const char *fmt, ...);
 #endif
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
-#define log_d(format, ...) log_printf(ARDUHAL_LOG_FORMAT(D, format), ##__VA_ARGS__)
+#define log_d(format, ...) ARDUHAL_LOG_PRINTF(ARDUHAL_LOG_FORMAT(D, format), ##__VA_ARGS__)
 #define isr_log_d(format, ...) ets_printf(ARDUHAL_LOG_FORMAT(D, format), ##__VA_ARGS__)
 #else
 #define log_d(format, ...)
@@ -95,7 +137,7 @@ int log_printf(const char *fmt, ...);
 #endif
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-#define log_i(format, ...) log_printf(ARDUHAL_LOG_FORMAT(I, format), ##__VA_ARGS__)
+#define log_i(format, ...) ARDUHAL_LOG_PRINTF(ARDUHAL_LOG_FORMAT(I, format), ##__VA_ARGS__)
 #define isr_log_i(format, ...) ets_printf(ARDUHAL_LOG_FORMAT(I, format), ##__VA_ARGS__)
 #else
 #define log_i(format, ...)
@@ -103,7 +145,7 @@ int log_printf(const char *fmt, ...);
 #endif
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_WARN
-#define log_w(format, ...) log_printf(ARDUHAL_LOG_FORMAT(W, format), ##__VA_ARGS__)
+#define log_w(format, ...) ARDUHAL_LOG_PRINTF(ARDUHAL_LOG_FORMAT(W, format), ##__VA_ARGS__)
 #define isr_log_w(format, ...) ets_printf(ARDUHAL_LOG_FORMAT(W, format), ##__VA_ARGS__)
 #else
 #define log_w(format, ...)
@@ -111,7 +153,7 @@ int log_printf(const char *fmt, ...);
 #endif
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_ERROR
-#define log_e(format, ...) log_printf(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
+#define log_e(format, ...) ARDUHAL_LOG_PRINTF(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
 #define isr_log_e(format, ...) ets_printf(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
 #else
 #define log_e(format, ...)
@@ -119,7 +161,7 @@ int log_printf(const char *fmt, ...);
 #endif
 
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_NONE
-#define log_n(format, ...) log_printf(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
+#define log_n(format, ...) ARDUHAL_LOG_PRINTF(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
 #define isr_log_n(format, ...) ets_printf(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
 #else
 #define log_n(format, ...)
@@ -0,0 +1,203 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal.h"
+#include "lwip/sockets.h"
+#include "esp_task_wdt.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define LOOP_WATCH_SLICE_MS 100 // select() runs this long before the watched sockets are read again
+
+static SemaphoreHandle_t _loop_event = NULL;
+static portMUX_TYPE _loop_mux = portMUX_INITIALIZER_UNLOCKED;
+static int _loop_fds[LOOP_WATCH_MAX_FDS];
+static uint8_t _loop_fd_count = 0;
+static TaskHandle_t _loop_watch_task = NULL;
+static volatile bool _loop_waiting = false;
+
+static bool _loop_event_init(void)
+{
+    if(_loop_event) {
+        return true;
+    }
+    SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+    if(!sem) {
+        log_e("no memory for the loop event");
+        return false;
+    }
+    portENTER_CRITICAL(&_loop_mux);
+    if(!_loop_event) {
+        _loop_event = sem;
+        sem = NULL;
+    }
+    portEXIT_CRITICAL(&_loop_mux);
+    if(sem) {
+        vSemaphoreDelete(sem);
+    }
+    return true;
+}
+
+void loopSignalEvent(void)
+{
+    if(_loop_event_init()) {
+        xSemaphoreGive(_loop_event);
+    }
+}
+
+void IRAM_ATTR loopSignalEventFromISR(void)
+{
+    // nothing waits before the first loopWaitForEvent() created it
+    if(!_loop_event) {
+        return;
+    }
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(_loop_event, &woken);
+    if(woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+bool loopWaitForEvent(uint32_t timeout_ms)
+{
+    if(!_loop_event_init()) {
+        if(timeout_ms != LOOP_WAIT_FOREVER) {
+            delay(timeout_ms);
+        }
+        return false;
+    }
+    // a task on the watchdog would be reset by it during a long wait
+    bool feed = esp_task_wdt_status(NULL) == ESP_OK;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t total = (timeout_ms == LOOP_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+    _loop_waiting = true;
+    if(_loop_watch_task) {
+        xTaskNotifyGive(_loop_watch_task);
+    }
+    bool signalled = false;
+    while(true) {
+        TickType_t wait = total;
+        if(total != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            wait = (elapsed < total) ? total - elapsed : 0;
+        }
+        if(feed && wait > pdMS_TO_TICKS(1000)) {
+            wait = pdMS_TO_TICKS(1000);
+        }
+        if(xSemaphoreTake(_loop_event, wait) == pdTRUE) {
+            signalled = true;
+            break;
+        }
+        if(feed) {
+            esp_task_wdt_reset();
+        }
+        if(total != portMAX_DELAY && (xTaskGetTickCount() - start) >= total) {
+            break;
+        }
+    }
+    _loop_waiting = false;
+    return signalled;
+}
+
+static void _loop_watch_fn(void * arg)
+{
+    for(;;) {
+        if(!_loop_waiting) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        fd_set set;
+        FD_ZERO(&set);
+        int maxfd = -1;
+        portENTER_CRITICAL(&_loop_mux);
+        for(uint8_t i = 0; i < _loop_fd_count; i++) {
+            FD_SET(_loop_fds[i], &set);
+            if(_loop_fds[i] > maxfd) {
+                maxfd = _loop_fds[i];
+            }
+        }
+        portEXIT_CRITICAL(&_loop_mux);
+        if(maxfd < 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        struct timeval tv = { 0, LOOP_WATCH_SLICE_MS * 1000 };
+        int res = select(maxfd + 1, &set, NULL, NULL, &tv);
+        if(!res || !_loop_waiting) {
+            continue;
+        }
+        if(res < 0) {
+            // a socket was closed before it was unwatched, let the library look at it, but not too often
+            vTaskDelay(pdMS_TO_TICKS(LOOP_WATCH_SLICE_MS));
+        }
+        loopSignalEvent();
+        // until the next wait, a socket that was not read yet would only signal again
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+/*
+ * Have loopWaitForEvent() return when fd has something to read
+ * For sockets a library reads from loop(), it has to read them empty each time or
+ * the wait will return at once.
+ */
+bool loopWatchFd(int fd)
+{
+    if(fd < 0 || !_loop_event_init()) {
+        return false;
+    }
+    bool added = false;
+    portENTER_CRITICAL(&_loop_mux);
+    bool found = false;
+    for(uint8_t i = 0; i < _loop_fd_count; i++) {
+        if(_loop_fds[i] == fd) {
+            found = true;
+            break;
+        }
+    }
+    if(!found && _loop_fd_count < LOOP_WATCH_MAX_FDS) {
+        _loop_fds[_loop_fd_count++] = fd;
+        added = true;
+    }
+    portEXIT_CRITICAL(&_loop_mux);
+    if(!found && !added) {
+        log_w("no room to watch socket %d", fd);
+        return false;
+    }
+    if(!_loop_watch_task
+        && xTaskCreateUniversal(_loop_watch_fn, "loop_watch", 2048, NULL, 2, &_loop_watch_task, CONFIG_ARDUINO_RUNNING_CORE) != pdPASS) {
+        log_e("loop watch task could not be started");
+        _loop_watch_task = NULL;
+        loopUnwatchFd(fd);
+        return false;
+    }
+    if(_loop_waiting) {
+        xTaskNotifyGive(_loop_watch_task);
+    }
+    return true;
+}
+
+void loopUnwatchFd(int fd)
+{
+    portENTER_CRITICAL(&_loop_mux);
+    for(uint8_t i = 0; i < _loop_fd_count; i++) {
+        if(_loop_fds[i] == fd) {
+            _loop_fds[i] = _loop_fds[--_loop_fd_count];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_loop_mux);
+}
@@ -0,0 +1,59 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_LOOP_H_
+#define _ESP32_HAL_LOOP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef LOOP_WATCH_MAX_FDS
+#define LOOP_WATCH_MAX_FDS 16 // sockets libraries may have watched for loopWaitForEvent()
+#endif
+
+#define LOOP_WAIT_FOREVER 0xFFFFFFFF
+
+/*
+ * Lets loop() sleep until there is work instead of spinning:
+ *
+ *   void loop() {
+ *       server.handleClient();
+ *       ArduinoOTA.handle();
+ *       loopWaitForEvent(1000);
+ *   }
+ *
+ * Libraries call loopSignalEvent() when something arrived that loop() has to
+ * handle: the UART when it received, WiFi after an event, WiFiServer and
+ * AsyncUDP on a connection or packet. Libraries that poll sockets from loop()
+ * (WebServer, ArduinoOTA) have them watched with loopWatchFd(), a task then
+ * waits on them with select() while loop() sleeps. Signals do not queue, one
+ * wakes the next wait and the ones before it are folded into it.
+ */
+void loopSignalEvent(void);
+void loopSignalEventFromISR(void);
+// true when woken by a signal, false on timeout; feeds the loop task watchdog while waiting
+bool loopWaitForEvent(uint32_t timeout_ms);
+
+bool loopWatchFd(int fd);
+void loopUnwatchFd(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_LOOP_H_ */
@@ -0,0 +1,420 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-mcpwm.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/mcpwm.h"
+#include "driver/periph_ctrl.h"
+#include "soc/mcpwm_struct.h"
+#include "soc/gpio_sig_map.h"
+#include "esp_attr.h"
+
+// int_st/int_ena/int_clr
+#define MCPWM_INT_FAULT_SHIFT   9
+#define MCPWM_INT_CAP_SHIFT     27
+
+#define MCPWM_DEADTIME_NS       100
+#define MCPWM_DEADTIME_MAX      0xFFFF
+
+typedef struct {
+    uint32_t ticks;
+    uint32_t delta;
+    uint8_t edges;              // seen so far, up to 2
+    mcpwm_capture_cb_t cb;
+    void * arg;
+} mcpwm_capture_t;
+
+typedef struct {
+    mcpwm_dev_t * dev;
+    intr_handle_t isr;
+    uint8_t timers;             // attached, a bit each
+    uint8_t centered;
+    uint8_t faults;
+    uint8_t captures;
+    int8_t pins[MCPWM_TIMERS][2];
+    mcpwm_capture_t capture[MCPWM_TIMERS];
+    mcpwm_fault_cb_t faultCb;
+    void * faultArg;
+} mcpwm_unit_state_t;
+
+static DRAM_ATTR mcpwm_unit_state_t _mcpwm[MCPWM_UNITS] = {
+    { .dev = &MCPWM0 },
+    { .dev = &MCPWM1 }
+};
+static portMUX_TYPE _mcpwm_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR _mcpwmIsr(void * arg)
+{
+    mcpwm_unit_state_t * s = (mcpwm_unit_state_t *)arg;
+    uint32_t status = s->dev->int_st.val;
+    s->dev->int_clr.val = status;
+    for(uint8_t ch = 0; ch < MCPWM_TIMERS; ch++) {
+        if(!(status & BIT(MCPWM_INT_CAP_SHIFT + ch))) {
+            continue;
+        }
+        mcpwm_capture_t * c = &s->capture[ch];
+        uint32_t ticks = s->dev->cap_val_ch[ch];
+        bool rising = !(s->dev->cap_status.val & BIT(ch));
+        portENTER_CRITICAL_ISR(&_mcpwm_mux);
+        c->delta = ticks - c->ticks;
+        c->ticks = ticks;
+        if(c->edges < 2) {
+            c->edges++;
+        }
+        mcpwm_capture_cb_t cb = c->cb;
+        void * cbArg = c->arg;
+        portEXIT_CRITICAL_ISR(&_mcpwm_mux);
+        if(cb) {
+            cb(cbArg, ch, ticks, rising);
+        }
+    }
+    mcpwm_fault_cb_t cb = s->faultCb;
+    for(uint8_t f = 0; cb && f < MCPWM_TIMERS; f++) {
+        if(status & BIT(MCPWM_INT_FAULT_SHIFT + f)) {
+            cb(s->faultArg, f);
+        }
+    }
+}
+
+static mcpwm_unit_state_t * _mcpwmUnit(uint8_t unit, uint8_t index)
+{
+    if(unit >= MCPWM_UNITS || index >= MCPWM_TIMERS) {
+        log_e("no MCPWM%u timer, fault, sync or capture %u", unit, index);
+        return NULL;
+    }
+    return &_mcpwm[unit];
+}
+
+static void _mcpwmEnable(uint8_t unit)
+{
+    periph_module_enable(unit ? PERIPH_PWM1_MODULE : PERIPH_PWM0_MODULE);
+}
+
+// allocated with the first capture or fault callback, and kept like the module
+static bool _mcpwmIsrInstall(uint8_t unit, mcpwm_unit_state_t * s)
+{
+    if(s->isr) {
+        return true;
+    }
+    _mcpwmEnable(unit);
+    esp_err_t err = mcpwm_isr_register((mcpwm_unit_t)unit, _mcpwmIsr, s, ESP_INTR_FLAG_IRAM, &s->isr);
+    if(err != ESP_OK) {
+        log_e("MCPWM%u interrupt failed: %d", unit, err);
+        s->isr = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool mcpwmAttach(uint8_t unit, uint8_t timer, int8_t pinA, int8_t pinB, uint32_t frequency, bool centerAligned)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || !frequency) {
+        return false;
+    }
+    if(s->timers & BIT(timer)) {
+        mcpwmDetach(unit, timer);
+    }
+    _mcpwmEnable(unit);
+    int8_t pins[2] = { pinA, pinB };
+    for(uint8_t o = 0; o < 2; o++) {
+        if(pins[o] >= 0 && mcpwm_gpio_init((mcpwm_unit_t)unit, (mcpwm_io_signals_t)(MCPWM0A + timer * 2 + o), pins[o]) != ESP_OK) {
+            log_e("MCPWM%u timer %u: pin %d failed", unit, timer, pins[o]);
+            return false;
+        }
+        s->pins[timer][o] = pins[o];
+    }
+    // up-down counting takes two counts per period
+    mcpwm_config_t config = {
+        .frequency = centerAligned ? frequency * 2 : frequency,
+        .cmpr_a = 0,
+        .cmpr_b = 0,
+        .duty_mode = MCPWM_DUTY_MODE_0,
+        .counter_mode = centerAligned ? MCPWM_UP_DOWN_COUNTER : MCPWM_UP_COUNTER
+    };
+    esp_err_t err = mcpwm_init((mcpwm_unit_t)unit, (mcpwm_timer_t)timer, &config);
+    if(err != ESP_OK) {
+        log_e("MCPWM%u timer %u init failed: %d", unit, timer, err);
+        return false;
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    s->timers |= BIT(timer);
+    if(centerAligned) {
+        s->centered |= BIT(timer);
+    } else {
+        s->centered &= ~BIT(timer);
+    }
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    return true;
+}
+
+void mcpwmDetach(uint8_t unit, uint8_t timer)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || !(s->timers & BIT(timer))) {
+        return;
+    }
+    mcpwm_stop((mcpwm_unit_t)unit, (mcpwm_timer_t)timer);
+    mcpwm_deadtime_disable((mcpwm_unit_t)unit, (mcpwm_timer_t)timer);
+    mcpwmSync(unit, timer, MCPWM_SYNC_NONE, 0);
+    for(uint8_t o = 0; o < 2; o++) {
+        if(s->pins[timer][o] >= 0) {
+            pinMatrixOutDetach(s->pins[timer][o], false, false);
+        }
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    s->timers &= ~BIT(timer);
+    // no fault trips it once it is attached again
+    s->dev->channel[timer].tz_cfg0.val = 0;
+    portEXIT_CRITICAL(&_mcpwm_mux);
+}
+
+bool mcpwmSetFrequency(uint8_t unit, uint8_t timer, uint32_t frequency)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || !frequency || !(s->timers & BIT(timer))) {
+        return false;
+    }
+    if(s->centered & BIT(timer)) {
+        frequency *= 2;
+    }
+    return mcpwm_set_frequency((mcpwm_unit_t)unit, (mcpwm_timer_t)timer, frequency) == ESP_OK;
+}
+
+bool mcpwmWrite(uint8_t unit, uint8_t timer, uint8_t output, float duty)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || output > 1 || !(s->timers & BIT(timer))) {
+        return false;
+    }
+    if(duty < 0) {
+        duty = 0;
+    } else if(duty > 100) {
+        duty = 100;
+    }
+    return mcpwm_set_duty((mcpwm_unit_t)unit, (mcpwm_timer_t)timer, (mcpwm_operator_t)output, duty) == ESP_OK;
+}
+
+bool mcpwmSetComplementary(uint8_t unit, uint8_t timer, uint32_t riseNs, uint32_t fallNs)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || !(s->timers & BIT(timer))) {
+        return false;
+    }
+    if(!riseNs && !fallNs) {
+        return mcpwm_deadtime_disable((mcpwm_unit_t)unit, (mcpwm_timer_t)timer) == ESP_OK;
+    }
+    // rounded up, a shorter dead-time than asked for may short the bridge
+    uint32_t red = (riseNs + MCPWM_DEADTIME_NS - 1) / MCPWM_DEADTIME_NS;
+    uint32_t fed = (fallNs + MCPWM_DEADTIME_NS - 1) / MCPWM_DEADTIME_NS;
+    if(red > MCPWM_DEADTIME_MAX || fed > MCPWM_DEADTIME_MAX) {
+        log_e("dead-time above %u ns", MCPWM_DEADTIME_MAX * MCPWM_DEADTIME_NS);
+        return false;
+    }
+    return mcpwm_deadtime_enable((mcpwm_unit_t)unit, (mcpwm_timer_t)timer, MCPWM_ACTIVE_HIGH_COMPLIMENT_MODE, red, fed) == ESP_OK;
+}
+
+bool mcpwmSync(uint8_t unit, uint8_t timer, mcpwm_sync_source_t source, uint16_t phase)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || source > MCPWM_SYNC_PIN2 || phase > 1000) {
+        return false;
+    }
+    mcpwm_dev_t * dev = s->dev;
+    portENTER_CRITICAL(&_mcpwm_mux);
+    if(source >= MCPWM_SYNC_TIMER0 && source <= MCPWM_SYNC_TIMER2) {
+        // the driver only syncs to the inputs, a timer gives its sync out when it passes zero
+        dev->timer[source - MCPWM_SYNC_TIMER0].sync.out_sel = 1;
+    }
+    uint32_t sel = dev->timer_synci_cfg.val & ~(0x7 << (timer * 3));
+    dev->timer_synci_cfg.val = sel | ((uint32_t)source << (timer * 3));
+    dev->timer[timer].sync.timer_phase = (uint32_t)dev->timer[timer].period.period * phase / 1000;
+    dev->timer[timer].sync.in_en = (source != MCPWM_SYNC_NONE);
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    return true;
+}
+
+bool mcpwmAttachSync(uint8_t unit, uint8_t sync, uint8_t pin)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, sync);
+    if(!s) {
+        return false;
+    }
+    _mcpwmEnable(unit);
+    return mcpwm_gpio_init((mcpwm_unit_t)unit, (mcpwm_io_signals_t)(MCPWM_SYNC_0 + sync), pin) == ESP_OK;
+}
+
+bool mcpwmAttachFault(uint8_t unit, uint8_t fault, uint8_t pin, bool activeHigh)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, fault);
+    if(!s) {
+        return false;
+    }
+    _mcpwmEnable(unit);
+    if(mcpwm_gpio_init((mcpwm_unit_t)unit, (mcpwm_io_signals_t)(MCPWM_FAULT_0 + fault), pin) != ESP_OK) {
+        log_e("MCPWM%u fault %u: pin %u failed", unit, fault, pin);
+        return false;
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    // f0_en..f2_en then f0_pole..f2_pole; the driver only takes active high
+    uint32_t detect = s->dev->fault_detect.val & ~BIT(3 + fault);
+    s->dev->fault_detect.val = detect | BIT(fault) | (activeHigh ? BIT(3 + fault) : 0);
+    s->faults |= BIT(fault);
+    if(s->isr) {
+        s->dev->int_ena.val |= BIT(MCPWM_INT_FAULT_SHIFT + fault);
+    }
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    return true;
+}
+
+void mcpwmDetachFault(uint8_t unit, uint8_t fault)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, fault);
+    if(!s || !(s->faults & BIT(fault))) {
+        return;
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    s->dev->int_ena.val &= ~BIT(MCPWM_INT_FAULT_SHIFT + fault);
+    s->dev->fault_detect.val &= ~BIT(fault);
+    for(uint8_t t = 0; t < MCPWM_TIMERS; t++) {
+        // f0_cbc is bit 3 and f0_ost bit 7, f1 and f2 below them
+        s->dev->channel[t].tz_cfg0.val &= ~(BIT(3 - fault) | BIT(7 - fault));
+    }
+    s->faults &= ~BIT(fault);
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    pinMatrixInDetach((unit ? PWM1_F0_IN_IDX : PWM0_F0_IN_IDX) + fault, false, false);
+}
+
+bool mcpwmSetFaultAction(uint8_t unit, uint8_t timer, uint8_t fault, bool oneShot, mcpwm_fault_action_t actionA, mcpwm_fault_action_t actionB)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s || fault >= MCPWM_TIMERS || !(s->faults & BIT(fault))) {
+        return false;
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    mcpwm_dev_t * dev = s->dev;
+    // the same action counting up and down
+    if(oneShot) {
+        dev->channel[timer].tz_cfg0.a_ost_u = dev->channel[timer].tz_cfg0.a_ost_d = actionA;
+        dev->channel[timer].tz_cfg0.b_ost_u = dev->channel[timer].tz_cfg0.b_ost_d = actionB;
+    } else {
+        dev->channel[timer].tz_cfg0.a_cbc_u = dev->channel[timer].tz_cfg0.a_cbc_d = actionA;
+        dev->channel[timer].tz_cfg0.b_cbc_u = dev->channel[timer].tz_cfg0.b_cbc_d = actionB;
+        // a cycle-by-cycle trip ends when the timer passes zero
+        dev->channel[timer].tz_cfg1.cbcpulse = 1;
+    }
+    uint32_t cfg = dev->channel[timer].tz_cfg0.val & ~(BIT(3 - fault) | BIT(7 - fault));
+    dev->channel[timer].tz_cfg0.val = cfg | (oneShot ? BIT(7 - fault) : BIT(3 - fault));
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    return true;
+}
+
+void mcpwmClearFault(uint8_t unit, uint8_t timer)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, timer);
+    if(!s) {
+        return;
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    // a toggle clears it
+    s->dev->channel[timer].tz_cfg1.clr_ost = !s->dev->channel[timer].tz_cfg1.clr_ost;
+    portEXIT_CRITICAL(&_mcpwm_mux);
+}
+
+bool mcpwmFaultActive(uint8_t unit, uint8_t fault)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, fault);
+    // event_f0..event_f2
+    return s && (s->dev->fault_detect.val & BIT(6 + fault));
+}
+
+void mcpwmOnFault(uint8_t unit, mcpwm_fault_cb_t cb, void * arg)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, 0);
+    if(!s || (cb && !_mcpwmIsrInstall(unit, s))) {
+        return;
+    }
+    portENTER_CRITICAL(&_mcpwm_mux);
+    s->faultCb = cb;
+    s->faultArg = arg;
+    uint32_t ena = s->dev->int_ena.val & ~(0x7 << MCPWM_INT_FAULT_SHIFT);
+    s->dev->int_ena.val = ena | ((uint32_t)s->faults << MCPWM_INT_FAULT_SHIFT);
+    portEXIT_CRITICAL(&_mcpwm_mux);
+}
+
+bool mcpwmAttachCapture(uint8_t unit, uint8_t channel, uint8_t pin, mcpwm_capture_edge_t edge, uint8_t prescale,
+                        mcpwm_capture_cb_t cb, void * arg)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, channel);
+    if(!s || edge < MCPWM_CAPTURE_FALLING || edge > MCPWM_CAPTURE_BOTH || !_mcpwmIsrInstall(unit, s)) {
+        return false;
+    }
+    mcpwmDetachCapture(unit, channel);
+    if(mcpwm_gpio_init((mcpwm_unit_t)unit, (mcpwm_io_signals_t)(MCPWM_CAP_0 + channel), pin) != ESP_OK
+        || mcpwm_capture_enable((mcpwm_unit_t)unit, (mcpwm_capture_signal_t)channel, MCPWM_POS_EDGE, 0) != ESP_OK) {
+        log_e("MCPWM%u capture %u on pin %u failed", unit, channel, pin);
+        return false;
+    }
+    mcpwm_capture_t * c = &s->capture[channel];
+    portENTER_CRITICAL(&_mcpwm_mux);
+    c->edges = 0;
+    c->cb = cb;
+    c->arg = arg;
+    s->captures |= BIT(channel);
+    // bit0 falling, bit1 rising: the driver takes only one of them
+    s->dev->cap_cfg_ch[channel].mode = edge;
+    // captures on every (prescale + 1)th rising edge
+    s->dev->cap_cfg_ch[channel].prescale = prescale ? prescale - 1 : 0;
+    s->dev->int_clr.val = BIT(MCPWM_INT_CAP_SHIFT + channel);
+    s->dev->int_ena.val |= BIT(MCPWM_INT_CAP_SHIFT + channel);
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    return true;
+}
+
+void mcpwmDetachCapture(uint8_t unit, uint8_t channel)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, channel);
+    if(!s || !(s->captures & BIT(channel))) {
+        return;
+    }
+    mcpwm_capture_t * c = &s->capture[channel];
+    portENTER_CRITICAL(&_mcpwm_mux);
+    s->dev->int_ena.val &= ~BIT(MCPWM_INT_CAP_SHIFT + channel);
+    c->cb = NULL;
+    c->edges = 0;
+    s->captures &= ~BIT(channel);
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    mcpwm_capture_disable((mcpwm_unit_t)unit, (mcpwm_capture_signal_t)channel);
+    pinMatrixInDetach((unit ? PWM1_CAP0_IN_IDX : PWM0_CAP0_IN_IDX) + channel, false, false);
+}
+
+bool mcpwmReadCapture(uint8_t unit, uint8_t channel, uint32_t * ticks, uint32_t * delta)
+{
+    mcpwm_unit_state_t * s = _mcpwmUnit(unit, channel);
+    if(!s) {
+        return false;
+    }
+    mcpwm_capture_t * c = &s->capture[channel];
+    portENTER_CRITICAL(&_mcpwm_mux);
+    bool valid = c->edges >= 2;
+    if(ticks) {
+        *ticks = c->ticks;
+    }
+    if(delta) {
+        *delta = c->delta;
+    }
+    portEXIT_CRITICAL(&_mcpwm_mux);
+    return valid;
+}
@@ -0,0 +1,97 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_MCPWM_H_
+#define _ESP32_HAL_MCPWM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The motor control PWM units (2), each with three timers driving an A/B output pair.
+ * B can be the complement of A with hardware dead-time, timers reload from each
+ * other's or an input's sync, fault inputs force the outputs without software,
+ * and the three capture channels latch the 80MHz capture timer on their edges.
+ * The timers count at 1MHz, dead-time is in steps of 100ns.
+ */
+#define MCPWM_UNITS         2
+#define MCPWM_TIMERS        3   // per unit, and as many fault, sync and capture inputs
+#define MCPWM_CAPTURE_HZ    80000000
+
+typedef enum {
+    MCPWM_SYNC_NONE,
+    MCPWM_SYNC_TIMER0,      // when the timer passes zero
+    MCPWM_SYNC_TIMER1,
+    MCPWM_SYNC_TIMER2,
+    MCPWM_SYNC_PIN0,        // on the sync input, see mcpwmAttachSync()
+    MCPWM_SYNC_PIN1,
+    MCPWM_SYNC_PIN2
+} mcpwm_sync_source_t;
+
+typedef enum {
+    MCPWM_FAULT_KEEP,
+    MCPWM_FAULT_LOW,
+    MCPWM_FAULT_HIGH,
+    MCPWM_FAULT_TOGGLE
+} mcpwm_fault_action_t;
+
+typedef enum {
+    MCPWM_CAPTURE_FALLING = 1,
+    MCPWM_CAPTURE_RISING,
+    MCPWM_CAPTURE_BOTH
+} mcpwm_capture_edge_t;
+
+// both from the interrupt, they have to be IRAM_ATTR
+typedef void (*mcpwm_capture_cb_t)(void * arg, uint8_t channel, uint32_t ticks, bool rising);
+typedef void (*mcpwm_fault_cb_t)(void * arg, uint8_t fault);
+
+// starts the timer, centerAligned counts up and down for pulses centered in the period; -1 for a pin not used
+bool mcpwmAttach(uint8_t unit, uint8_t timer, int8_t pinA, int8_t pinB, uint32_t frequency, bool centerAligned);
+void mcpwmDetach(uint8_t unit, uint8_t timer);
+bool mcpwmSetFrequency(uint8_t unit, uint8_t timer, uint32_t frequency);
+// output 0 is A, 1 is B; duty in percent
+bool mcpwmWrite(uint8_t unit, uint8_t timer, uint8_t output, float duty);
+
+// B is the inverted A, riseNs delays A going high and fallNs B going high after A went low; 0, 0 turns it off
+bool mcpwmSetComplementary(uint8_t unit, uint8_t timer, uint32_t riseNs, uint32_t fallNs);
+
+// timer reloads to phase (in 1/1000 of its period) on the source, MCPWM_SYNC_NONE stops it
+bool mcpwmSync(uint8_t unit, uint8_t timer, mcpwm_sync_source_t source, uint16_t phase);
+bool mcpwmAttachSync(uint8_t unit, uint8_t sync, uint8_t pin);
+
+// the fault input is active while pin is at level; in oneShot the action holds until mcpwmClearFault(),
+// else it ends with the first period after the fault did
+bool mcpwmAttachFault(uint8_t unit, uint8_t fault, uint8_t pin, bool activeHigh);
+void mcpwmDetachFault(uint8_t unit, uint8_t fault);
+bool mcpwmSetFaultAction(uint8_t unit, uint8_t timer, uint8_t fault, bool oneShot, mcpwm_fault_action_t actionA, mcpwm_fault_action_t actionB);
+void mcpwmClearFault(uint8_t unit, uint8_t timer);
+bool mcpwmFaultActive(uint8_t unit, uint8_t fault);
+void mcpwmOnFault(uint8_t unit, mcpwm_fault_cb_t cb, void * arg);
+
+// ticks of MCPWM_CAPTURE_HZ latched by the hardware on the edges, prescale > 1 divides the rising edges first
+bool mcpwmAttachCapture(uint8_t unit, uint8_t channel, uint8_t pin, mcpwm_capture_edge_t edge, uint8_t prescale,
+                        mcpwm_capture_cb_t cb, void * arg);
+void mcpwmDetachCapture(uint8_t unit, uint8_t channel);
+// the last edge and the ticks since the one before, false until there were two
+bool mcpwmReadCapture(uint8_t unit, uint8_t channel, uint32_t * ticks, uint32_t * delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_MCPWM_H_ */
@@ -0,0 +1,270 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-pcnt.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/pcnt.h"
+#include "soc/pcnt_struct.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+
+#define PCNT_HIGH_LIMIT 32767
+#define PCNT_LOW_LIMIT  -32768
+
+struct pcnt_s {
+    pcnt_unit_t unit;
+    int64_t overflow;       // counted at the limits so far
+    int64_t lastCount;      // for pcntFrequency() without a gate
+    int64_t lastTime;
+};
+
+static pcnt_t * _pcnt_units[PCNT_UNIT_MAX] = { NULL };
+static portMUX_TYPE _pcnt_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR _pcntIsr(void * arg)
+{
+    pcnt_t * u = (pcnt_t *)arg;
+    portENTER_CRITICAL_ISR(&_pcnt_mux);
+    if(PCNT.status_unit[u->unit].h_lim_lat) {
+        u->overflow += PCNT_HIGH_LIMIT;
+    }
+    if(PCNT.status_unit[u->unit].l_lim_lat) {
+        u->overflow += PCNT_LOW_LIMIT;
+    }
+    // cleared here, under the lock, so pcntRead() never sees it pending after it was counted
+    PCNT.int_clr.val = BIT(u->unit);
+    portEXIT_CRITICAL_ISR(&_pcnt_mux);
+}
+
+static pcnt_t * _pcntAlloc(void)
+{
+    pcnt_t * u = (pcnt_t *)calloc(1, sizeof(pcnt_t));
+    if(!u) {
+        return NULL;
+    }
+    int unit = -1;
+    portENTER_CRITICAL(&_pcnt_mux);
+    for(int i = 0; i < PCNT_UNIT_MAX; i++) {
+        if(!_pcnt_units[i]) {
+            // taken until _pcntRelease()
+            _pcnt_units[i] = u;
+            unit = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_pcnt_mux);
+    if(unit < 0) {
+        log_e("no free pulse counter unit");
+        free(u);
+        return NULL;
+    }
+    u->unit = (pcnt_unit_t)unit;
+    return u;
+}
+
+static void _pcntRelease(pcnt_t * u)
+{
+    _pcnt_units[u->unit] = NULL;
+    free(u);
+}
+
+static bool _pcntStart(pcnt_t * u)
+{
+    esp_err_t err = pcnt_isr_service_install(0);
+    if(err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        log_e("pcnt_isr_service_install failed: %d", err);
+        return false;
+    }
+    pcnt_set_event_value(u->unit, PCNT_EVT_H_LIM, PCNT_HIGH_LIMIT);
+    pcnt_set_event_value(u->unit, PCNT_EVT_L_LIM, PCNT_LOW_LIMIT);
+    pcnt_event_enable(u->unit, PCNT_EVT_H_LIM);
+    pcnt_event_enable(u->unit, PCNT_EVT_L_LIM);
+    pcnt_event_disable(u->unit, PCNT_EVT_ZERO);
+    pcnt_event_disable(u->unit, PCNT_EVT_THRES_0);
+    pcnt_event_disable(u->unit, PCNT_EVT_THRES_1);
+    if(pcnt_isr_handler_add(u->unit, _pcntIsr, u) != ESP_OK) {
+        log_e("pulse counter %u interrupt failed", u->unit);
+        return false;
+    }
+    pcnt_counter_pause(u->unit);
+    pcnt_counter_clear(u->unit);
+    pcnt_intr_enable(u->unit);
+    pcnt_counter_resume(u->unit);
+    u->lastTime = esp_timer_get_time();
+    return true;
+}
+
+static bool _pcntConfig(pcnt_t * u, pcnt_channel_t channel, int pulse, int ctrl,
+                        pcnt_count_mode_t pos, pcnt_count_mode_t neg, pcnt_ctrl_mode_t lctrl)
+{
+    pcnt_config_t config = {
+        .pulse_gpio_num = pulse,
+        .ctrl_gpio_num = ctrl,
+        .lctrl_mode = lctrl,
+        .hctrl_mode = PCNT_MODE_KEEP,
+        .pos_mode = pos,
+        .neg_mode = neg,
+        .counter_h_lim = PCNT_HIGH_LIMIT,
+        .counter_l_lim = PCNT_LOW_LIMIT,
+        .unit = u->unit,
+        .channel = channel
+    };
+    esp_err_t err = pcnt_unit_config(&config);
+    if(err != ESP_OK) {
+        log_e("pulse counter %u channel %u config failed: %d", u->unit, channel, err);
+        return false;
+    }
+    return true;
+}
+
+pcnt_t * pcntAttachCounter(uint8_t pin, pcnt_edge_t edge, int8_t ctrlPin)
+{
+    pcnt_t * u = _pcntAlloc();
+    if(!u) {
+        return NULL;
+    }
+    pcnt_count_mode_t pos = (edge == PCNT_FALLING) ? PCNT_COUNT_DIS : PCNT_COUNT_INC;
+    pcnt_count_mode_t neg = (edge == PCNT_RISING) ? PCNT_COUNT_DIS : PCNT_COUNT_INC;
+    // a low control input stops the count, without one the input reads as high
+    if(!_pcntConfig(u, PCNT_CHANNEL_0, pin, (ctrlPin < 0) ? PCNT_PIN_NOT_USED : ctrlPin, pos, neg,
+                    (ctrlPin < 0) ? PCNT_MODE_KEEP : PCNT_MODE_DISABLE)
+        || !_pcntConfig(u, PCNT_CHANNEL_1, PCNT_PIN_NOT_USED, PCNT_PIN_NOT_USED, PCNT_COUNT_DIS, PCNT_COUNT_DIS, PCNT_MODE_KEEP)
+        || !_pcntStart(u)) {
+        _pcntRelease(u);
+        return NULL;
+    }
+    return u;
+}
+
+pcnt_t * pcntAttachEncoder(uint8_t pinA, uint8_t pinB, pcnt_encoder_t mode)
+{
+    pcnt_t * u = _pcntAlloc();
+    if(!u) {
+        return NULL;
+    }
+    // B low reverses the direction A's edges count in
+    bool ok = _pcntConfig(u, PCNT_CHANNEL_0, pinA, pinB, PCNT_COUNT_DEC,
+                          (mode == PCNT_ENCODER_X1) ? PCNT_COUNT_DIS : PCNT_COUNT_INC, PCNT_MODE_REVERSE);
+    if(ok && mode == PCNT_ENCODER_X4) {
+        ok = _pcntConfig(u, PCNT_CHANNEL_1, pinB, pinA, PCNT_COUNT_INC, PCNT_COUNT_DEC, PCNT_MODE_REVERSE);
+    } else if(ok) {
+        ok = _pcntConfig(u, PCNT_CHANNEL_1, PCNT_PIN_NOT_USED, PCNT_PIN_NOT_USED, PCNT_COUNT_DIS, PCNT_COUNT_DIS, PCNT_MODE_KEEP);
+    }
+    if(!ok || !_pcntStart(u)) {
+        _pcntRelease(u);
+        return NULL;
+    }
+    return u;
+}
+
+void pcntDetach(pcnt_t * u)
+{
+    if(!u) {
+        return;
+    }
+    pcnt_counter_pause(u->unit);
+    pcnt_intr_disable(u->unit);
+    pcnt_isr_handler_remove(u->unit);
+    pcnt_set_pin(u->unit, PCNT_CHANNEL_0, PCNT_PIN_NOT_USED, PCNT_PIN_NOT_USED);
+    pcnt_set_pin(u->unit, PCNT_CHANNEL_1, PCNT_PIN_NOT_USED, PCNT_PIN_NOT_USED);
+    _pcntRelease(u);
+}
+
+bool pcntSetFilter(pcnt_t * u, uint32_t ns)
+{
+    if(!u) {
+        return false;
+    }
+    if(!ns) {
+        return pcnt_filter_disable(u->unit) == ESP_OK;
+    }
+    if(ns > PCNT_FILTER_MAX_NS) {
+        log_w("filter of %u ns limited to %u ns", ns, PCNT_FILTER_MAX_NS);
+        ns = PCNT_FILTER_MAX_NS;
+    }
+    // in APB clock cycles
+    uint16_t cycles = (uint16_t)((ns * (uint64_t)(APB_CLK_FREQ / 1000000) + 999) / 1000);
+    return pcnt_set_filter_value(u->unit, cycles) == ESP_OK && pcnt_filter_enable(u->unit) == ESP_OK;
+}
+
+int64_t pcntRead(pcnt_t * u)
+{
+    if(!u) {
+        return 0;
+    }
+    portENTER_CRITICAL(&_pcnt_mux);
+    int64_t total = u->overflow;
+    int16_t count = (int16_t)PCNT.cnt_unit[u->unit].cnt_val;
+    if(PCNT.int_raw.val & BIT(u->unit)) {
+        // the limit was hit and the counter reset, but the interrupt did not run yet;
+        // read again, count may be from before or after the reset
+        if(PCNT.status_unit[u->unit].h_lim_lat) {
+            total += PCNT_HIGH_LIMIT;
+        }
+        if(PCNT.status_unit[u->unit].l_lim_lat) {
+            total += PCNT_LOW_LIMIT;
+        }
+        count = (int16_t)PCNT.cnt_unit[u->unit].cnt_val;
+    }
+    portEXIT_CRITICAL(&_pcnt_mux);
+    return total + count;
+}
+
+void pcntClear(pcnt_t * u)
+{
+    if(!u) {
+        return;
+    }
+    portENTER_CRITICAL(&_pcnt_mux);
+    pcnt_counter_clear(u->unit);
+    PCNT.int_clr.val = BIT(u->unit);
+    u->overflow = 0;
+    u->lastCount = 0;
+    portEXIT_CRITICAL(&_pcnt_mux);
+}
+
+void pcntPause(pcnt_t * u)
+{
+    if(u) {
+        pcnt_counter_pause(u->unit);
+    }
+}
+
+void pcntResume(pcnt_t * u)
+{
+    if(u) {
+        pcnt_counter_resume(u->unit);
+    }
+}
+
+float pcntFrequency(pcnt_t * u, uint32_t gate_ms)
+{
+    if(!u) {
+        return 0;
+    }
+    if(gate_ms) {
+        u->lastCount = pcntRead(u);
+        u->lastTime = esp_timer_get_time();
+        vTaskDelay(pdMS_TO_TICKS(gate_ms) ? pdMS_TO_TICKS(gate_ms) : 1);
+    }
+    int64_t count = pcntRead(u);
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - u->lastTime;
+    float frequency = (elapsed > 0) ? (float)(count - u->lastCount) * 1000000.0f / (float)elapsed : 0;
+    u->lastCount = count;
+    u->lastTime = now;
+    return frequency;
+}
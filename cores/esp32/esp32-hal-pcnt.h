@@ -0,0 +1,68 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_PCNT_H_
+#define _ESP32_HAL_PCNT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The pulse counter units (8) counting edges or quadrature encoders in hardware.
+ * The 16 bit counters are extended to 64 bit: the unit interrupts when it hits
+ * its limit and resets, and pcntRead() adds what the interrupt counted, also
+ * when the limit was just hit and the interrupt did not run yet.
+ */
+typedef struct pcnt_s pcnt_t;
+
+typedef enum {
+    PCNT_RISING,
+    PCNT_FALLING,
+    PCNT_BOTH_EDGES
+} pcnt_edge_t;
+
+typedef enum {
+    PCNT_ENCODER_X1,    // one count per cycle, rising edges of A
+    PCNT_ENCODER_X2,    // both edges of A
+    PCNT_ENCODER_X4     // both edges of A and B
+} pcnt_encoder_t;
+
+#define PCNT_FILTER_MAX_NS 12787 // 1023 APB clock cycles
+
+// counts edges on pin; with a ctrlPin only while it is high
+pcnt_t * pcntAttachCounter(uint8_t pin, pcnt_edge_t edge, int8_t ctrlPin);
+// up for A leading B, down the other way
+pcnt_t * pcntAttachEncoder(uint8_t pinA, uint8_t pinB, pcnt_encoder_t mode);
+void pcntDetach(pcnt_t * unit);
+
+// pulses shorter than ns are ignored, 0 turns the filter off
+bool pcntSetFilter(pcnt_t * unit, uint32_t ns);
+
+int64_t pcntRead(pcnt_t * unit);
+void pcntClear(pcnt_t * unit);
+void pcntPause(pcnt_t * unit);
+void pcntResume(pcnt_t * unit);
+
+// counts per second over gate_ms (sleeps), or since the previous call with 0
+float pcntFrequency(pcnt_t * unit, uint32_t gate_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_PCNT_H_ */
@@ -0,0 +1,142 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "esp32-hal-pool.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+typedef struct pool_block_s {
+    struct pool_block_s * next;
+} pool_block_t;
+
+struct pool_s {
+    uint8_t * mem;
+    pool_block_t * free_list;
+    size_t block_size;
+    size_t blocks;
+    size_t used;
+    size_t high_water;
+    uint32_t alloc_failures;
+    portMUX_TYPE lock;
+};
+
+pool_t * poolCreate(size_t blockSize, size_t count, uint32_t caps)
+{
+    if(!blockSize || !count){
+        return NULL;
+    }
+    // every free block holds the link to the next one
+    if(blockSize < sizeof(pool_block_t)){
+        blockSize = sizeof(pool_block_t);
+    }
+    blockSize = (blockSize + 3) & ~3;
+    pool_t * pool = (pool_t *)calloc(1, sizeof(pool_t));
+    if(!pool){
+        return NULL;
+    }
+    pool->mem = (uint8_t *)heap_caps_malloc(blockSize * count, caps);
+    if(!pool->mem){
+        log_e("could not allocate %u x %u bytes", count, blockSize);
+        free(pool);
+        return NULL;
+    }
+    pool->block_size = blockSize;
+    pool->blocks = count;
+    vPortCPUInitializeMutex(&pool->lock);
+    for(size_t i = count; i--; ){
+        pool_block_t * b = (pool_block_t *)(pool->mem + i * blockSize);
+        b->next = pool->free_list;
+        pool->free_list = b;
+    }
+    return pool;
+}
+
+void poolDelete(pool_t * pool)
+{
+    if(!pool){
+        return;
+    }
+    if(pool->used){
+        log_w("%u blocks still in use", pool->used);
+    }
+    heap_caps_free(pool->mem);
+    free(pool);
+}
+
+void * IRAM_ATTR poolAlloc(pool_t * pool)
+{
+    if(!pool){
+        return NULL;
+    }
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    pool_block_t * b = pool->free_list;
+    if(b){
+        pool->free_list = b->next;
+        if(++pool->used > pool->high_water){
+            pool->high_water = pool->used;
+        }
+    } else {
+        pool->alloc_failures++;
+    }
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+    return b;
+}
+
+void * poolCalloc(pool_t * pool)
+{
+    void * p = poolAlloc(pool);
+    if(p){
+        memset(p, 0, pool->block_size);
+    }
+    return p;
+}
+
+bool IRAM_ATTR poolOwns(pool_t * pool, const void * ptr)
+{
+    if(!pool || (const uint8_t *)ptr < pool->mem || (const uint8_t *)ptr >= pool->mem + pool->block_size * pool->blocks){
+        return false;
+    }
+    return (((const uint8_t *)ptr - pool->mem) % pool->block_size) == 0;
+}
+
+bool IRAM_ATTR poolFree(pool_t * pool, void * ptr)
+{
+    if(!poolOwns(pool, ptr)){
+        return false;
+    }
+    pool_block_t * b = (pool_block_t *)ptr;
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    b->next = pool->free_list;
+    pool->free_list = b;
+    pool->used--;
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+    return true;
+}
+
+void poolGetStats(pool_t * pool, pool_stats_t * stats)
+{
+    if(!pool || !stats){
+        return;
+    }
+    portENTER_CRITICAL(&pool->lock);
+    stats->blockSize = pool->block_size;
+    stats->blocks = pool->blocks;
+    stats->used = pool->used;
+    stats->highWater = pool->high_water;
+    stats->allocFailures = pool->alloc_failures;
+    portEXIT_CRITICAL(&pool->lock);
+}
@@ -0,0 +1,57 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _ESP32_HAL_POOL_H_
+#define _ESP32_HAL_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Fixed-block pools, carved out of one heap_caps allocation (MALLOC_CAP_* caps).
+ * Alloc and free are O(1) and ISR safe, blocks are 4 byte aligned.
+ */
+struct pool_s;
+typedef struct pool_s pool_t;
+
+typedef struct {
+    size_t blockSize;
+    size_t blocks;
+    size_t used;
+    size_t highWater;       // most blocks in use at once
+    uint32_t allocFailures; // alloc while the pool was empty
+} pool_stats_t;
+
+pool_t * poolCreate(size_t blockSize, size_t count, uint32_t caps);
+void poolDelete(pool_t * pool);
+
+void * poolAlloc(pool_t * pool);
+void * poolCalloc(pool_t * pool);
+// returns false (and leaves ptr alone) when ptr is not a block of this pool
+bool poolFree(pool_t * pool, void * ptr);
+bool poolOwns(pool_t * pool, const void * ptr);
+
+void poolGetStats(pool_t * pool, pool_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_POOL_H_ */
@@ -13,11 +13,11 @@
 // limitations under the License.
 
 #include "esp32-hal.h"
+#include "esp_heap_caps.h"
 
 #if CONFIG_SPIRAM_SUPPORT
 #include "esp_spiram.h"
 #include "soc/efuse_reg.h"
-#include "esp_heap_caps.h"
 
 static volatile bool spiramDetected = false;
 static volatile bool spiramFailed = false;
@@ -109,3 +109,59 @@ void IRAM_ATTR *ps_realloc(void *ptr, size_t size){
 }
 
 #endif
+
+/*
+ * Heap policy
+ * With PSRAM present, blocks of at least the user's threshold go to PSRAM first,
+ * smaller ones stay internal; either side falls back to the other when full.
+ */
+static size_t heapPsramThreshold[HEAP_USER_MAX] = { HEAP_PSRAM_THRESHOLD };
+
+void heapSetPsramThreshold(heap_user_t user, size_t threshold){
+    if(user < HEAP_USER_MAX){
+        heapPsramThreshold[user] = threshold;
+    }
+}
+
+size_t heapGetPsramThreshold(heap_user_t user){
+    if(user >= HEAP_USER_MAX){
+        user = HEAP_USER_DEFAULT;
+    }
+    if(user != HEAP_USER_DEFAULT && heapPsramThreshold[user] == HEAP_PSRAM_INHERIT){
+        return heapPsramThreshold[HEAP_USER_DEFAULT];
+    }
+    return heapPsramThreshold[user];
+}
+
+static inline uint32_t heapPolicyCaps(heap_user_t user, size_t size, bool first){
+    bool psram = psramFound() && size >= heapGetPsramThreshold(user);
+    if(!first){
+        psram = !psram;
+    }
+    return psram ? (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+void *heap_policy_malloc(heap_user_t user, size_t size){
+    void * p = heap_caps_malloc(size, heapPolicyCaps(user, size, true));
+    if(!p && psramFound()){
+        p = heap_caps_malloc(size, heapPolicyCaps(user, size, false));
+    }
+    return p;
+}
+
+void *heap_policy_calloc(heap_user_t user, size_t n, size_t size){
+    void * p = heap_caps_calloc(n, size, heapPolicyCaps(user, n * size, true));
+    if(!p && psramFound()){
+        p = heap_caps_calloc(n, size, heapPolicyCaps(user, n * size, false));
+    }
+    return p;
+}
+
+// a block moves to the other memory when the new size crosses the threshold
+void *heap_policy_realloc(heap_user_t user, void *ptr, size_t size){
+    void * p = heap_caps_realloc(ptr, size, heapPolicyCaps(user, size, true));
+    if(!p && size && psramFound()){
+        p = heap_caps_realloc(ptr, size, heapPolicyCaps(user, size, false));
+    }
+    return p;
+}
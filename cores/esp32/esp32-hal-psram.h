@@ -19,6 +19,10 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
 bool psramInit();
 bool psramFound();
 
@@ -26,6 +30,35 @@ void *ps_malloc(size_t size);
 void *ps_calloc(size_t n, size_t size);
 void *ps_realloc(void *ptr, size_t size);
 
+/*
+ * Heap policy: allocations of at least the user's threshold go to PSRAM when present.
+ * Only for buffers that are never used for DMA; release with free().
+ */
+typedef enum {
+    HEAP_USER_DEFAULT,
+    HEAP_USER_STRING,
+    HEAP_USER_HTTP_CLIENT,
+    HEAP_USER_WEB_SERVER,
+    HEAP_USER_UPDATE,
+    HEAP_USER_TLS,          // mbedTLS of WiFiClientSecure, record buffers are the big ones
+    HEAP_USER_FS,           // File::setBufferSize() stdio buffers, the FFat sector cache
+    HEAP_USER_MAX
+} heap_user_t;
+
+#ifndef HEAP_PSRAM_THRESHOLD
+#define HEAP_PSRAM_THRESHOLD 4096
+#endif
+
+#define HEAP_PSRAM_INHERIT  0           // use the HEAP_USER_DEFAULT threshold
+#define HEAP_PSRAM_NEVER    SIZE_MAX    // keep internal
+
+void heapSetPsramThreshold(heap_user_t user, size_t threshold);
+size_t heapGetPsramThreshold(heap_user_t user);
+
+void *heap_policy_malloc(heap_user_t user, size_t size);
+void *heap_policy_calloc(heap_user_t user, size_t n, size_t size);
+void *heap_policy_realloc(heap_user_t user, void *ptr, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
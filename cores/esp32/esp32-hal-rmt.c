@@ -70,6 +70,8 @@ typedef enum {
     E_TX_INTR = 1,
     E_TXTHR_INTR = 2,
     E_RX_INTR = 4,
+    E_TX_STREAM_INTR = 8,
+    E_RX_RING_INTR = 16,
 } intr_mode_t;
 
 typedef enum {
@@ -95,8 +97,43 @@ struct rmt_obj_s
     rmt_rx_data_cb_t cb;
     bool data_alloc;
     void * arg;
+    // rmtWriteStream()
+    rmt_tx_encoder_t encoder;
+    void * encoder_arg;
+    uint32_t * stage;        // encoder output for one half of the channel memory
+    int tx_offset;           // next half to refill
+    int tx_sub_len;          // items per half
+    bool tx_ending;          // end marker written
+    volatile bool tx_busy;
+    TaskHandle_t tx_waiter;
+    uint32_t tx_start_us;
+    uint32_t tx_time_us;     // duration of the last stream
+    float tick_ns;
+    struct rmt_led_state_s* led;
+    // rmtReadContinuous(), frames stored as [len][items...], RMT_RING_WRAP skips to the start
+    uint32_t* rx_ring;
+    size_t rx_ring_size;     // words
+    volatile size_t rx_head;
+    volatile size_t rx_tail;
+    size_t rx_frame_words;   // frame handed out by rmtReceiveFrame(), 0 if none
+    uint32_t rx_dropped;
+    TaskHandle_t rx_waiter;
 };
 
+#define RMT_RING_WRAP 0xFFFFFFFF
+
+// rmtWriteLedStrip() encoder state
+typedef struct rmt_led_state_s {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    uint8_t bit;
+    bool reset_sent;
+    uint32_t bits[2];        // symbol for a 0 and a 1 bit
+    uint32_t lut[16][4];     // symbols for every nibble, MSB first
+    uint32_t reset;
+} rmt_led_state_t;
+
 /**
  * Internal variables for channel descriptors
  */
@@ -143,6 +180,8 @@ static void IRAM_ATTR _rmt_tx_mem_first(uint8_t ch);
 
 static void IRAM_ATTR _rmt_tx_mem_second(uint8_t ch);
 
+static void IRAM_ATTR _rmt_stream_fill(rmt_obj_t* rmt, int offset, int len);
+
 
 /**
  * Public method definitions
@@ -224,6 +263,18 @@ bool rmtDeinit(rmt_obj_t *rmt)
     if (g_rmt_objects[from].data_alloc) {
         free(g_rmt_objects[from].data_ptr);
     }
+    if (g_rmt_objects[from].tx_busy) {
+        rmtWaitTx(rmt, portMAX_DELAY);
+    }
+    free(g_rmt_objects[from].stage);
+    g_rmt_objects[from].stage = NULL;
+    free(g_rmt_objects[from].led);
+    g_rmt_objects[from].led = NULL;
+    if (g_rmt_objects[from].rx_ring) {
+        rmtEnd(rmt);
+        free(g_rmt_objects[from].rx_ring);
+        g_rmt_objects[from].rx_ring = NULL;
+    }
     
     for (i = from; i < to; i++) {
         g_rmt_objects[i].allocated = false;
@@ -304,6 +355,176 @@ bool rmtWrite(rmt_obj_t* rmt, rmt_data_t* data, size_t size)
     }
 }
 
+bool rmtWriteStream(rmt_obj_t* rmt, rmt_tx_encoder_t encoder, void * arg)
+{
+    if (!rmt || !encoder || !rmt->tx_not_rx) {
+        return false;
+    }
+    int channel = rmt->channel;
+    int mem_len = MAX_DATA_PER_CHANNEL * rmt->buffers;
+
+    if (rmt->tx_busy) {
+        rmtWaitTx(rmt, portMAX_DELAY);
+    }
+
+    RMT_MUTEX_LOCK(channel);
+    if (!rmt->stage) {
+        rmt->stage = (uint32_t*)heap_caps_malloc(mem_len / 2 * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!rmt->stage) {
+            RMT_MUTEX_UNLOCK(channel);
+            log_e("RMT stream buffer alloc failed");
+            return false;
+        }
+    }
+    if (!intr_handle) {
+        esp_intr_alloc(ETS_RMT_INTR_SOURCE, (int)ESP_INTR_FLAG_IRAM, _rmt_isr, NULL, &intr_handle);
+    }
+
+    rmt->encoder = encoder;
+    rmt->encoder_arg = arg;
+    rmt->tx_sub_len = mem_len / 2;
+    rmt->tx_ending = false;
+    rmt->tx_waiter = NULL;
+    rmt->intr_mode = E_TX_STREAM_INTR;
+
+    RMT.int_ena.val &= ~(_INT_TX_END(channel) | _INT_THR_EVNT(channel));
+    RMT.conf_ch[channel].conf1.tx_conti_mode = 0;
+    RMT.conf_ch[channel].conf1.mem_rd_rst = 1;
+    RMT.conf_ch[channel].conf1.mem_rd_rst = 0;
+    RMT.apb_conf.fifo_mask = 1;
+    RMT.apb_conf.mem_tx_wrap_en = 1;
+
+    // both halves up front, the threshold event then asks for one half at a time
+    _rmt_stream_fill(rmt, 0, rmt->tx_sub_len);
+    if (!rmt->tx_ending) {
+        _rmt_stream_fill(rmt, rmt->tx_sub_len, rmt->tx_sub_len);
+    }
+    rmt->tx_offset = 0;
+    RMT.tx_lim_ch[channel].limit = rmt->tx_sub_len;
+
+    RMT.int_clr.val = _INT_TX_END(channel) | _INT_THR_EVNT(channel) | _INT_ERROR(channel);
+    RMT.int_ena.val |= _INT_TX_END(channel) | _INT_ERROR(channel);
+    if (!rmt->tx_ending) {
+        RMT.int_ena.val |= _INT_THR_EVNT(channel);
+    }
+    rmt->tx_busy = true;
+    rmt->tx_start_us = micros();
+    RMT.conf_ch[channel].conf1.tx_start = 1;
+    RMT_MUTEX_UNLOCK(channel);
+
+    return true;
+}
+
+bool rmtWaitTx(rmt_obj_t* rmt, uint32_t timeout_ms)
+{
+    if (!rmt) {
+        return false;
+    }
+    if (!rmt->tx_busy) {
+        return true;
+    }
+    rmt->tx_waiter = xTaskGetCurrentTaskHandle();
+    // the ISR may have finished between the check and publishing the waiter
+    while (rmt->tx_busy) {
+        if (!ulTaskNotifyTake(pdTRUE, (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : (timeout_ms / portTICK_PERIOD_MS))) {
+            break;
+        }
+    }
+    rmt->tx_waiter = NULL;
+    return !rmt->tx_busy;
+}
+
+uint32_t rmtGetTxTime(rmt_obj_t* rmt)
+{
+    return rmt ? rmt->tx_time_us : 0;
+}
+
+static size_t IRAM_ATTR _rmt_led_encode(rmt_data_t* items, size_t max_items, void* arg)
+{
+    rmt_led_state_t* led = (rmt_led_state_t*)arg;
+    uint32_t* out = (uint32_t*)items;
+    size_t n = 0;
+    while (n < max_items && led->pos < led->len) {
+        uint8_t b = led->data[led->pos];
+        if (led->bit == 0 && max_items - n >= 8) {
+            // whole byte from the nibble table
+            const uint32_t* hi = led->lut[b >> 4];
+            const uint32_t* lo = led->lut[b & 0x0F];
+            out[n] = hi[0]; out[n + 1] = hi[1]; out[n + 2] = hi[2]; out[n + 3] = hi[3];
+            out[n + 4] = lo[0]; out[n + 5] = lo[1]; out[n + 6] = lo[2]; out[n + 7] = lo[3];
+            n += 8;
+            led->pos++;
+        } else {
+            out[n++] = led->bits[(b >> (7 - led->bit)) & 1];
+            if (++led->bit == 8) {
+                led->bit = 0;
+                led->pos++;
+            }
+        }
+    }
+    if (led->pos == led->len && n < max_items && !led->reset_sent) {
+        out[n++] = led->reset;
+        led->reset_sent = true;
+    }
+    return n;
+}
+
+static uint32_t _rmt_ns_to_ticks(rmt_obj_t* rmt, uint32_t ns)
+{
+    uint32_t ticks = (uint32_t)(ns / rmt->tick_ns + 0.5);
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    return (ticks > 0x7FFF) ? 0x7FFF : ticks;
+}
+
+bool rmtWriteLedStrip(rmt_obj_t* rmt, const uint8_t* data, size_t len, const rmt_led_timing_t* timing)
+{
+    if (!rmt || !data || !len || !timing) {
+        return false;
+    }
+    if (rmt->tx_busy) {
+        rmtWaitTx(rmt, portMAX_DELAY);
+    }
+    if (!rmt->led) {
+        rmt->led = (rmt_led_state_t*)heap_caps_malloc(sizeof(rmt_led_state_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!rmt->led) {
+            return false;
+        }
+    }
+    rmt_led_state_t* led = rmt->led;
+    rmt_data_t sym;
+
+    sym.level0 = 1;
+    sym.duration0 = _rmt_ns_to_ticks(rmt, timing->t0h_ns);
+    sym.level1 = 0;
+    sym.duration1 = _rmt_ns_to_ticks(rmt, timing->t0l_ns);
+    led->bits[0] = sym.val;
+    sym.duration0 = _rmt_ns_to_ticks(rmt, timing->t1h_ns);
+    sym.duration1 = _rmt_ns_to_ticks(rmt, timing->t1l_ns);
+    led->bits[1] = sym.val;
+    for (int nib = 0; nib < 16; nib++) {
+        for (int i = 0; i < 4; i++) {
+            led->lut[nib][i] = led->bits[(nib >> (3 - i)) & 1];
+        }
+    }
+    // latch time, the line idles low meanwhile
+    uint32_t reset = _rmt_ns_to_ticks(rmt, timing->reset_ns / 2);
+    sym.level0 = 0;
+    sym.duration0 = reset;
+    sym.level1 = 0;
+    sym.duration1 = reset;
+    led->reset = sym.val;
+
+    led->data = data;
+    led->len = len;
+    led->pos = 0;
+    led->bit = 0;
+    led->reset_sent = (timing->reset_ns == 0);
+
+    return rmtWriteStream(rmt, _rmt_led_encode, led);
+}
+
 bool rmtReadData(rmt_obj_t* rmt, uint32_t* data, size_t size)
 {
     if (!rmt) {
@@ -400,12 +621,105 @@ bool rmtEnd(rmt_obj_t* rmt) {
     int channel = rmt->channel;
 
     RMT_MUTEX_LOCK(channel);
-    RMT.conf_ch[channel].conf1.rx_en = 1;
+    RMT.conf_ch[channel].conf1.rx_en = 0;
+    RMT.int_ena.val &= ~(_INT_RX_END(channel) | _INT_ERROR(channel));
+    rmt->intr_mode = E_NO_INTR;
     RMT_MUTEX_UNLOCK(channel);
 
     return  true;
 }
 
+bool rmtReadContinuous(rmt_obj_t* rmt, size_t ring_items)
+{
+    if (!rmt || rmt->tx_not_rx) {
+        return false;
+    }
+    int channel = rmt->channel;
+    // room for at least two full frames
+    size_t min_words = 2 * (MAX_DATA_PER_CHANNEL * rmt->buffers + 1) + 1;
+    size_t words = ring_items + 1;
+    if (words < min_words) {
+        words = min_words;
+    }
+
+    RMT_MUTEX_LOCK(channel);
+    if (rmt->rx_ring && rmt->rx_ring_size != words) {
+        free(rmt->rx_ring);
+        rmt->rx_ring = NULL;
+    }
+    if (!rmt->rx_ring) {
+        rmt->rx_ring = (uint32_t*)heap_caps_malloc(words * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+        if (!rmt->rx_ring) {
+            RMT_MUTEX_UNLOCK(channel);
+            log_e("RMT rx ring alloc failed");
+            return false;
+        }
+        rmt->rx_ring_size = words;
+    }
+    rmt->rx_head = 0;
+    rmt->rx_tail = 0;
+    rmt->rx_frame_words = 0;
+    rmt->rx_dropped = 0;
+    rmt->rx_waiter = NULL;
+    rmt->intr_mode = E_RX_RING_INTR;
+
+    if (!intr_handle) {
+        esp_intr_alloc(ETS_RMT_INTR_SOURCE, (int)ESP_INTR_FLAG_IRAM, _rmt_isr, NULL, &intr_handle);
+    }
+    RMT.conf_ch[channel].conf1.mem_owner = 1;
+    RMT.int_clr.val = _INT_RX_END(channel) | _INT_ERROR(channel);
+    RMT.int_ena.val |= _INT_RX_END(channel) | _INT_ERROR(channel);
+    RMT.conf_ch[channel].conf1.mem_wr_rst = 1;
+    RMT.conf_ch[channel].conf1.rx_en = 1;
+    RMT_MUTEX_UNLOCK(channel);
+
+    return true;
+}
+
+size_t rmtReceiveFrame(rmt_obj_t* rmt, rmt_data_t** data, uint32_t timeout_ms)
+{
+    if (!rmt || !rmt->rx_ring || !data) {
+        return 0;
+    }
+    if (rmt->rx_frame_words) { // previous span not returned
+        rmtReturnFrame(rmt);
+    }
+    rmt->rx_waiter = xTaskGetCurrentTaskHandle();
+    while (rmt->rx_tail == rmt->rx_head) {
+        if (!ulTaskNotifyTake(pdTRUE, (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : (timeout_ms / portTICK_PERIOD_MS))) {
+            break;
+        }
+    }
+    rmt->rx_waiter = NULL;
+    if (rmt->rx_tail == rmt->rx_head) {
+        return 0;
+    }
+    size_t tail = rmt->rx_tail;
+    if (rmt->rx_ring[tail] == RMT_RING_WRAP) {
+        tail = 0;
+        rmt->rx_tail = 0;
+    }
+    size_t len = rmt->rx_ring[tail];
+    rmt->rx_frame_words = len + 1;
+    *data = (rmt_data_t*)&rmt->rx_ring[tail + 1];
+    return len;
+}
+
+void rmtReturnFrame(rmt_obj_t* rmt)
+{
+    if (!rmt || !rmt->rx_frame_words) {
+        return;
+    }
+    size_t tail = rmt->rx_tail + rmt->rx_frame_words;
+    rmt->rx_frame_words = 0;
+    rmt->rx_tail = (tail >= rmt->rx_ring_size) ? 0 : tail;
+}
+
+uint32_t rmtGetRxDropped(rmt_obj_t* rmt)
+{
+    return rmt ? rmt->rx_dropped : 0;
+}
+
 bool rmtReadAsync(rmt_obj_t* rmt, rmt_data_t* data, size_t size, void* eventFlag, bool waitForData, uint32_t timeout)
 {
     if (!rmt) {
@@ -478,10 +792,12 @@ float rmtSetTick(rmt_obj_t* rmt, float tick)
     if (_ABS(apb_tick - tick) < _ABS(ref_tick - tick)) {
         RMT.conf_ch[channel].conf0.div_cnt = apb_div & 0xFF;
         RMT.conf_ch[channel].conf1.ref_always_on = 1;
+        rmt->tick_ns = apb_tick;
         return apb_tick;
     } else {
         RMT.conf_ch[channel].conf0.div_cnt = ref_div & 0xFF;
         RMT.conf_ch[channel].conf1.ref_always_on = 0;
+        rmt->tick_ns = ref_tick;
         return ref_tick;
     }
 }
@@ -539,6 +855,7 @@ rmt_obj_t* rmtInit(int pin, bool tx_not_rx, rmt_reserve_memsize_t memsize)
     rmt->buffers =buffers;
     rmt->channel = channel;
     rmt->arg = NULL;
+    rmt->tick_ns = 1000.0; // REF_TICK, div_cnt 1 below
 
     _initPin(pin, channel, tx_not_rx);
 
@@ -644,9 +961,56 @@ static void _initPin(int pin, int channel, bool tx_not_rx)
 }
 
 
+/**
+ * Copies the received frame into the ring and re-arms the receiver, the channel memory
+ * is reused by the next frame so only this copy separates two captures
+ */
+static void IRAM_ATTR _rmt_rx_ring_push(rmt_obj_t* rmt, portBASE_TYPE* woken)
+{
+    int ch = rmt->channel;
+    size_t len = _rmt_get_mem_len(ch);
+    size_t head = rmt->rx_head;
+    size_t tail = rmt->rx_tail;
+    size_t size = rmt->rx_ring_size;
+    size_t used = (head >= tail) ? (head - tail) : (size - tail + head);
+    size_t free_words = size - 1 - used;
+    size_t need = len + 1;
+    size_t contiguous = size - head;
+    size_t i;
+
+    if (need > contiguous) {
+        need += contiguous; // wrap marker and unused end
+    }
+    if (len == 0 || need > free_words) {
+        if (len) {
+            rmt->rx_dropped++;
+        }
+    } else {
+        if (len + 1 > contiguous) {
+            rmt->rx_ring[head] = RMT_RING_WRAP;
+            head = 0;
+        }
+        uint32_t* dst = &rmt->rx_ring[head];
+        *dst++ = len;
+        for (i = 0; i < len; i++) {
+            *dst++ = RMTMEM.chan[ch].data32[i].val;
+        }
+        head += len + 1;
+        rmt->rx_head = (head >= size) ? 0 : head;
+        if (rmt->rx_waiter) {
+            vTaskNotifyGiveFromISR(rmt->rx_waiter, woken);
+        }
+    }
+    // restart the reception
+    RMT.conf_ch[ch].conf1.mem_owner = 1;
+    RMT.conf_ch[ch].conf1.mem_wr_rst = 1;
+    RMT.conf_ch[ch].conf1.rx_en = 1;
+}
+
 static void IRAM_ATTR _rmt_isr(void* arg)
 {
     int intr_val = RMT.int_st.val;
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
     size_t ch;
     for (ch = 0; ch < MAX_CHANNELS; ch++) {
 
@@ -714,6 +1078,48 @@ static void IRAM_ATTR _rmt_isr(void* arg)
             RMT.conf_ch[ch].conf1.mem_wr_rst = 0;
         }
 
+        if (g_rmt_objects[ch].intr_mode & E_RX_RING_INTR) {
+            if (intr_val & (_INT_RX_END(ch) | _INT_ERROR(ch))) {
+                RMT.int_clr.val = _INT_RX_END(ch) | _INT_ERROR(ch);
+                if (intr_val & _INT_ERROR(ch)) { // frame longer than the channel memory
+                    g_rmt_objects[ch].rx_dropped++;
+                    RMT.conf_ch[ch].conf1.mem_owner = 1;
+                    RMT.conf_ch[ch].conf1.mem_wr_rst = 1;
+                    RMT.conf_ch[ch].conf1.rx_en = 1;
+                } else {
+                    _rmt_rx_ring_push(&g_rmt_objects[ch], &xHigherPriorityTaskWoken);
+                }
+            }
+            continue;
+        }
+
+        if (g_rmt_objects[ch].intr_mode & E_TX_STREAM_INTR) {
+            rmt_obj_t* rmt = &g_rmt_objects[ch];
+            if (intr_val & _INT_THR_EVNT(ch)) {
+                RMT.int_clr.val = _INT_THR_EVNT(ch);
+                if (rmt->tx_ending) {
+                    RMT.int_ena.val &= ~_INT_THR_EVNT(ch);
+                } else {
+                    _rmt_stream_fill(rmt, rmt->tx_offset, rmt->tx_sub_len);
+                    rmt->tx_offset = rmt->tx_offset ? 0 : rmt->tx_sub_len;
+                }
+            }
+            if (intr_val & (_INT_TX_END(ch) | _INT_ERROR(ch))) {
+                RMT.int_clr.val = _INT_TX_END(ch) | _INT_ERROR(ch);
+                RMT.int_ena.val &= ~(_INT_TX_END(ch) | _INT_THR_EVNT(ch) | _INT_ERROR(ch));
+                rmt->intr_mode = E_NO_INTR;
+                rmt->tx_time_us = micros() - rmt->tx_start_us;
+                rmt->tx_busy = false;
+                if (rmt->events) {
+                    xEventGroupSetBitsFromISR(rmt->events, RMT_FLAG_TX_DONE, &xHigherPriorityTaskWoken);
+                }
+                if (rmt->tx_waiter) {
+                    vTaskNotifyGiveFromISR(rmt->tx_waiter, &xHigherPriorityTaskWoken);
+                }
+            }
+            continue;
+        }
+
         if (intr_val & _INT_TX_END(ch)) {
 
             RMT.int_clr.val = _INT_TX_END(ch);
@@ -732,6 +1138,36 @@ static void IRAM_ATTR _rmt_isr(void* arg)
             _rmt_tx_mem_first(ch);
         }
     }
+    if (xHigherPriorityTaskWoken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * Asks the encoder for up to len items and copies them to the channel memory at offset,
+ * an end marker follows the last item of the stream
+ */
+static void IRAM_ATTR _rmt_stream_fill(rmt_obj_t* rmt, int offset, int len)
+{
+    volatile uint32_t* mem = &(RMTMEM.chan[rmt->channel].data32[offset].val);
+    int filled = 0;
+    while (filled < len) {
+        size_t n = rmt->encoder((rmt_data_t*)rmt->stage, len - filled, rmt->encoder_arg);
+        if (n == 0) {
+            break;
+        }
+        if (n > len - filled) {
+            n = len - filled;
+        }
+        for (size_t i = 0; i < n; i++) {
+            *mem++ = rmt->stage[i];
+        }
+        filled += n;
+    }
+    if (filled < len) {
+        *mem = 0; // tx end mark
+        rmt->tx_ending = true;
+    }
 }
 
 static void IRAM_ATTR _rmt_tx_mem_second(uint8_t ch)
@@ -73,6 +73,49 @@ float rmtSetTick(rmt_obj_t* rmt, float tick);
 */
 bool rmtWrite(rmt_obj_t* rmt, rmt_data_t* data, size_t size);
 
+/**
+*    Streaming transmit: the ISR calls encoder (must be IRAM_ATTR) to write up to
+*    max_items symbols into items whenever half of the channel memory was sent,
+*    returning 0 ends the stream. RAM use is independent of the waveform length.
+*/
+typedef size_t (*rmt_tx_encoder_t)(rmt_data_t* items, size_t max_items, void* arg);
+
+bool rmtWriteStream(rmt_obj_t* rmt, rmt_tx_encoder_t encoder, void* arg);
+
+/**
+*    Waits for the end of rmtWriteStream(), true if it finished
+*
+*/
+bool rmtWaitTx(rmt_obj_t* rmt, uint32_t timeout_ms);
+
+/**
+*    Time from start to end of the last rmtWriteStream()/rmtWriteLedStrip() in us
+*
+*/
+uint32_t rmtGetTxTime(rmt_obj_t* rmt);
+
+/**
+*    Addressable LED strips: bit timings in ns, reset_ns is the latch time after the frame
+*/
+typedef struct {
+    uint32_t t0h_ns;
+    uint32_t t0l_ns;
+    uint32_t t1h_ns;
+    uint32_t t1l_ns;
+    uint32_t reset_ns;
+} rmt_led_timing_t;
+
+#define RMT_LED_TIMING_WS2812   { 400, 850, 800, 450, 50000 }
+#define RMT_LED_TIMING_SK6812   { 300, 900, 600, 600, 80000 }
+
+/**
+*    Sends data (bytes in strip order, e.g. GRB) as LED bit symbols, expanded from a
+*    nibble table in the ISR refill. Returns once started, data must be in RAM and stay valid until
+*    rmtWaitTx(); starting several channels back to back updates them in parallel.
+*    Set a tick of 100ns or finer with rmtSetTick() first.
+*/
+bool rmtWriteLedStrip(rmt_obj_t* rmt, const uint8_t* data, size_t len, const rmt_led_timing_t* timing);
+
 /**
 *    Loop data up to the reserved memsize continuously
 *
@@ -93,11 +136,30 @@ bool rmtReadAsync(rmt_obj_t* rmt, rmt_data_t* data, size_t size, void* eventFlag
 bool rmtRead(rmt_obj_t* rmt, rmt_rx_data_cb_t cb, void * arg);
 
 /***
- * Ends async receive started with rmtRead(); but does not
+ * Ends async receive started with rmtRead() or rmtReadContinuous(); but does not
  * rmtDeInit().
  */
 bool rmtEnd(rmt_obj_t* rmt);
 
+/**
+*    Continuous capture: every frame is copied once from the channel memory into a
+*    ring of ring_items words and the receiver is re-armed right away
+*
+*/
+bool rmtReadContinuous(rmt_obj_t* rmt, size_t ring_items);
+
+/**
+*    Next captured frame as a span into the ring (no copy), returns its length in
+*    items or 0 on timeout. The span stays valid until rmtReturnFrame() or the next call.
+*/
+size_t rmtReceiveFrame(rmt_obj_t* rmt, rmt_data_t** data, uint32_t timeout_ms);
+void rmtReturnFrame(rmt_obj_t* rmt);
+
+/**
+*    Frames lost because the ring was full or a frame overflowed the channel memory
+*/
+uint32_t rmtGetRxDropped(rmt_obj_t* rmt);
+
 /*  Additional interface */
 
 /**
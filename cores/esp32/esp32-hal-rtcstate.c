@@ -0,0 +1,254 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-rtcstate.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "rom/crc.h"
+
+#define RTC_STATE_MAGIC 0x52545331 // "RTS1"
+
+typedef struct {
+    uint32_t key;       // crc of the key string
+    uint16_t len;
+    uint16_t reserved;
+    uint32_t crc;       // of key, len and the data
+} rtc_state_block_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t used;      // bytes of data taken by the blocks
+    uint32_t data[RTC_STATE_SIZE / 4];
+} rtc_state_t;
+
+typedef struct {
+    uint32_t key;
+    void * data;
+    size_t len;
+} rtc_state_entry_t;
+
+// set up again by the bootloader on every reset but the wake from deep sleep
+static RTC_DATA_ATTR rtc_state_t _rtc_state;
+static rtc_state_entry_t _rtc_entries[RTC_STATE_BLOCKS];
+static bool _rtc_checked = false;
+static portMUX_TYPE _rtc_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define BLOCK_SIZE(len) (sizeof(rtc_state_block_t) + (((len) + 3) & ~3))
+
+static uint32_t _rtcKey(const char * key)
+{
+    return crc32_le(0, (const uint8_t *)key, strlen(key));
+}
+
+static uint32_t _rtcBlockCrc(const rtc_state_block_t * block, const void * data)
+{
+    uint32_t crc = crc32_le(0, (const uint8_t *)block, offsetof(rtc_state_block_t, crc));
+    return crc32_le(crc, (const uint8_t *)data, block->len);
+}
+
+// the blocks are walked from the start, anything after one that does not fit is dropped
+static void _rtcCheck(void)
+{
+    if(_rtc_checked) {
+        return;
+    }
+    _rtc_checked = true;
+    if(_rtc_state.magic != RTC_STATE_MAGIC || _rtc_state.used > sizeof(_rtc_state.data)) {
+        _rtc_state.magic = RTC_STATE_MAGIC;
+        _rtc_state.used = 0;
+        return;
+    }
+    uint32_t pos = 0;
+    while(pos + sizeof(rtc_state_block_t) <= _rtc_state.used) {
+        rtc_state_block_t * block = (rtc_state_block_t *)((uint8_t *)_rtc_state.data + pos);
+        if(pos + BLOCK_SIZE(block->len) > _rtc_state.used) {
+            break;
+        }
+        pos += BLOCK_SIZE(block->len);
+    }
+    _rtc_state.used = pos;
+}
+
+static rtc_state_block_t * _rtcFind(uint32_t key)
+{
+    uint32_t pos = 0;
+    while(pos < _rtc_state.used) {
+        rtc_state_block_t * block = (rtc_state_block_t *)((uint8_t *)_rtc_state.data + pos);
+        if(block->key == key) {
+            return block;
+        }
+        pos += BLOCK_SIZE(block->len);
+    }
+    return NULL;
+}
+
+static void _rtcDrop(rtc_state_block_t * block)
+{
+    uint8_t * start = (uint8_t *)block;
+    uint8_t * end = start + BLOCK_SIZE(block->len);
+    uint8_t * last = (uint8_t *)_rtc_state.data + _rtc_state.used;
+    memmove(start, end, last - end);
+    _rtc_state.used -= end - start;
+}
+
+static bool _rtcSave(uint32_t key, const void * data, size_t len)
+{
+    rtc_state_block_t * block = _rtcFind(key);
+    if(block && block->len != len) {
+        _rtcDrop(block);
+        block = NULL;
+    }
+    if(!block) {
+        if(_rtc_state.used + BLOCK_SIZE(len) > sizeof(_rtc_state.data)) {
+            return false;
+        }
+        block = (rtc_state_block_t *)((uint8_t *)_rtc_state.data + _rtc_state.used);
+        _rtc_state.used += BLOCK_SIZE(len);
+        block->key = key;
+        block->len = len;
+        block->reserved = 0;
+    }
+    memcpy(block + 1, data, len);
+    block->crc = _rtcBlockCrc(block, data);
+    return true;
+}
+
+static bool _rtcLoad(uint32_t key, void * data, size_t len)
+{
+    rtc_state_block_t * block = _rtcFind(key);
+    if(!block || block->len != len || block->crc != _rtcBlockCrc(block, block + 1)) {
+        return false;
+    }
+    memcpy(data, block + 1, len);
+    return true;
+}
+
+bool rtcStateSave(const char * key, const void * data, size_t len)
+{
+    if(!key || !data || !len || len > UINT16_MAX) {
+        return false;
+    }
+    uint32_t k = _rtcKey(key);
+    portENTER_CRITICAL(&_rtc_mux);
+    _rtcCheck();
+    bool ok = _rtcSave(k, data, len);
+    portEXIT_CRITICAL(&_rtc_mux);
+    if(!ok) {
+        log_e("no room for %u bytes of '%s', RTC_STATE_SIZE is %u", len, key, RTC_STATE_SIZE);
+    }
+    return ok;
+}
+
+bool rtcStateLoad(const char * key, void * data, size_t len)
+{
+    if(!key || !data || !len) {
+        return false;
+    }
+    uint32_t k = _rtcKey(key);
+    portENTER_CRITICAL(&_rtc_mux);
+    _rtcCheck();
+    bool ok = _rtcLoad(k, data, len);
+    portEXIT_CRITICAL(&_rtc_mux);
+    return ok;
+}
+
+void rtcStateRemove(const char * key)
+{
+    if(!key) {
+        return;
+    }
+    uint32_t k = _rtcKey(key);
+    portENTER_CRITICAL(&_rtc_mux);
+    _rtcCheck();
+    rtc_state_block_t * block = _rtcFind(k);
+    if(block) {
+        _rtcDrop(block);
+    }
+    portEXIT_CRITICAL(&_rtc_mux);
+}
+
+void rtcStateClear(void)
+{
+    portENTER_CRITICAL(&_rtc_mux);
+    _rtc_checked = true;
+    _rtc_state.magic = RTC_STATE_MAGIC;
+    _rtc_state.used = 0;
+    portEXIT_CRITICAL(&_rtc_mux);
+}
+
+bool rtcStateRegister(const char * key, void * data, size_t len)
+{
+    if(!key || !data || !len || len > UINT16_MAX) {
+        return false;
+    }
+    uint32_t k = _rtcKey(key);
+    int slot = -1;
+    bool restored = false;
+    portENTER_CRITICAL(&_rtc_mux);
+    _rtcCheck();
+    for(int i = 0; i < RTC_STATE_BLOCKS; i++) {
+        if(_rtc_entries[i].key == k && _rtc_entries[i].data) {
+            slot = i;
+            break;
+        }
+        if(slot < 0 && !_rtc_entries[i].data) {
+            slot = i;
+        }
+    }
+    if(slot >= 0) {
+        _rtc_entries[slot].key = k;
+        _rtc_entries[slot].data = data;
+        _rtc_entries[slot].len = len;
+        restored = _rtcLoad(k, data, len);
+    }
+    portEXIT_CRITICAL(&_rtc_mux);
+    if(slot < 0) {
+        log_e("'%s' not registered, RTC_STATE_BLOCKS are taken", key);
+    }
+    return restored;
+}
+
+void rtcStateUnregister(const char * key)
+{
+    if(!key) {
+        return;
+    }
+    uint32_t k = _rtcKey(key);
+    portENTER_CRITICAL(&_rtc_mux);
+    for(int i = 0; i < RTC_STATE_BLOCKS; i++) {
+        if(_rtc_entries[i].key == k && _rtc_entries[i].data) {
+            _rtc_entries[i].data = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&_rtc_mux);
+    rtcStateRemove(key);
+}
+
+bool rtcStateCommit(void)
+{
+    bool ok = true;
+    portENTER_CRITICAL(&_rtc_mux);
+    _rtcCheck();
+    for(int i = 0; i < RTC_STATE_BLOCKS; i++) {
+        if(_rtc_entries[i].data && !_rtcSave(_rtc_entries[i].key, _rtc_entries[i].data, _rtc_entries[i].len)) {
+            ok = false;
+        }
+    }
+    portEXIT_CRITICAL(&_rtc_mux);
+    if(!ok) {
+        log_e("not all blocks stored, RTC_STATE_SIZE is %u", RTC_STATE_SIZE);
+    }
+    return ok;
+}
@@ -0,0 +1,60 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_RTCSTATE_H_
+#define _ESP32_HAL_RTCSTATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef RTC_STATE_SIZE
+#define RTC_STATE_SIZE 1024 // bytes of RTC slow memory for the blocks, 12 of them per block for its header
+#endif
+
+#ifndef RTC_STATE_BLOCKS
+#define RTC_STATE_BLOCKS 16 // registered at once
+#endif
+
+/*
+ * Small blocks of state kept in RTC slow memory over deep sleep, so a library can
+ * pick up after a wake where it was instead of setting up again. The memory is
+ * only kept over deep sleep, every other reset starts empty. Blocks are found by
+ * their key and have a crc each; one whose length changed or that does not check
+ * is not restored. rtcStateRegister() restores a block into data and remembers it,
+ * rtcStateCommit() stores all registered blocks as they are then; ESP.deepSleep()
+ * commits, call it before esp_deep_sleep_start() otherwise.
+ */
+
+// true when data was restored, else it is left as it is
+bool rtcStateRegister(const char * key, void * data, size_t len);
+// also drops what was stored for key
+void rtcStateUnregister(const char * key);
+bool rtcStateCommit(void);
+
+// right away, for blocks that are not registered
+bool rtcStateSave(const char * key, const void * data, size_t len);
+bool rtcStateLoad(const char * key, void * data, size_t len);
+void rtcStateRemove(const char * key);
+void rtcStateClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_RTCSTATE_H_ */
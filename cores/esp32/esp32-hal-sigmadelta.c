@@ -38,16 +38,16 @@ static void _on_apb_change(void * arg, apb_change_ev_t ev_type, uint32_t old_apb
     uint32_t iarg = (uint32_t)arg;
     uint8_t channel = iarg;
     if(ev_type == APB_BEFORE_CHANGE){
-        SIGMADELTA.cg.clk_en = 0;
-    } else {
         old_apb /= 1000000;
         new_apb /= 1000000;
         SD_MUTEX_LOCK();
         uint32_t old_prescale = SIGMADELTA.channel[channel].prescale + 1;
-        SIGMADELTA.channel[channel].prescale = ((new_apb * old_prescale) / old_apb) - 1;
-        SIGMADELTA.cg.clk_en = 0;
-        SIGMADELTA.cg.clk_en = 1;
+        uint32_t prescale = ((new_apb * old_prescale) / old_apb) - 1;
         SD_MUTEX_UNLOCK();
+        // new prescaler and a clock restart, together with the clock switch
+        apbChangeQueueWrite(&SIGMADELTA.channel[channel].val, 0xFF00, prescale << 8);
+        apbChangeQueueWrite(&SIGMADELTA.cg.val, 1UL << 31, 0);
+        apbChangeQueueWrite(&SIGMADELTA.cg.val, 1UL << 31, 1UL << 31);
     }
 }
 
@@ -89,6 +89,40 @@ void sigmaDeltaWrite(uint8_t channel, uint8_t duty) //chan 0-7 duty 8 bit
     SD_MUTEX_UNLOCK();
 }
 
+void sigmaDeltaUpdateStage(sigmadelta_update_t * update, uint8_t channel, uint8_t duty)
+{
+    if(!update || channel > 7) {
+        return;
+    }
+    update->duty[channel] = duty;
+    update->mask |= (1 << channel);
+}
+
+static portMUX_TYPE _sd_update_mux = portMUX_INITIALIZER_UNLOCKED;
+
+bool sigmaDeltaUpdateCommit(sigmadelta_update_t * update)
+{
+    if(!update || !update->mask) {
+        return false;
+    }
+    SD_MUTEX_LOCK();
+    // computed first, so only the register writes are in the critical section
+    uint32_t values[8];
+    for(uint8_t channel = 0; channel < 8; channel++) {
+        values[channel] = (SIGMADELTA.channel[channel].val & ~0xFF) | (uint8_t)(update->duty[channel] - 128);
+    }
+    portENTER_CRITICAL(&_sd_update_mux);
+    for(uint8_t channel = 0; channel < 8; channel++) {
+        if(update->mask & (1 << channel)) {
+            SIGMADELTA.channel[channel].val = values[channel];
+        }
+    }
+    portEXIT_CRITICAL(&_sd_update_mux);
+    SD_MUTEX_UNLOCK();
+    update->mask = 0;
+    return true;
+}
+
 uint8_t sigmaDeltaRead(uint8_t channel) //chan 0-7
 {
     if(channel > 7) {
@@ -26,6 +26,16 @@ extern "C" {
 uint32_t    sigmaDeltaSetup(uint8_t channel, uint32_t freq);
 void        sigmaDeltaWrite(uint8_t channel, uint8_t duty);
 uint8_t     sigmaDeltaRead(uint8_t channel);
+
+//duties staged for several channels, then written within a few cycles of each other;
+//the modulator has no period to latch on. Start from a zeroed sigmadelta_update_t, the commit empties it
+typedef struct {
+    uint8_t mask;
+    uint8_t duty[8];
+} sigmadelta_update_t;
+
+void        sigmaDeltaUpdateStage(sigmadelta_update_t * update, uint8_t channel, uint8_t duty);
+bool        sigmaDeltaUpdateCommit(sigmadelta_update_t * update);
 void        sigmaDeltaAttachPin(uint8_t pin, uint8_t channel);
 void        sigmaDeltaDetachPin(uint8_t pin);
 
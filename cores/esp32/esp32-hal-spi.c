@@ -17,6 +17,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "rom/ets_sys.h"
 #include "esp_attr.h"
 #include "esp_intr.h"
@@ -27,18 +28,48 @@
 #include "soc/gpio_sig_map.h"
 #include "soc/dport_reg.h"
 #include "soc/rtc.h"
+#include "soc/soc_memory_layout.h"
+#include "rom/lldesc.h"
+#include "esp_heap_caps.h"
 
 #define SPI_CLK_IDX(p)  ((p==0)?SPICLK_OUT_IDX:((p==1)?SPICLK_OUT_IDX:((p==2)?HSPICLK_OUT_IDX:((p==3)?VSPICLK_OUT_IDX:0))))
 #define SPI_MISO_IDX(p) ((p==0)?SPIQ_OUT_IDX:((p==1)?SPIQ_OUT_IDX:((p==2)?HSPIQ_OUT_IDX:((p==3)?VSPIQ_OUT_IDX:0))))
 #define SPI_MOSI_IDX(p) ((p==0)?SPID_IN_IDX:((p==1)?SPID_IN_IDX:((p==2)?HSPID_IN_IDX:((p==3)?VSPID_IN_IDX:0))))
 
+#define SPI_WP_IDX(p)   ((p==0)?SPIWP_OUT_IDX:((p==1)?SPIWP_OUT_IDX:((p==2)?HSPIWP_OUT_IDX:((p==3)?VSPIWP_OUT_IDX:0))))
+#define SPI_HD_IDX(p)   ((p==0)?SPIHD_OUT_IDX:((p==1)?SPIHD_OUT_IDX:((p==2)?HSPIHD_OUT_IDX:((p==3)?VSPIHD_OUT_IDX:0))))
+
 #define SPI_SPI_SS_IDX(n)   ((n==0)?SPICS0_OUT_IDX:((n==1)?SPICS1_OUT_IDX:((n==2)?SPICS2_OUT_IDX:SPICS0_OUT_IDX)))
 #define SPI_HSPI_SS_IDX(n)   ((n==0)?HSPICS0_OUT_IDX:((n==1)?HSPICS1_OUT_IDX:((n==2)?HSPICS2_OUT_IDX:HSPICS0_OUT_IDX)))
 #define SPI_VSPI_SS_IDX(n)   ((n==0)?VSPICS0_OUT_IDX:((n==1)?VSPICS1_OUT_IDX:((n==2)?VSPICS2_OUT_IDX:VSPICS0_OUT_IDX)))
 #define SPI_SS_IDX(p, n)   ((p==0)?SPI_SPI_SS_IDX(n):((p==1)?SPI_SPI_SS_IDX(n):((p==2)?SPI_HSPI_SS_IDX(n):((p==3)?SPI_VSPI_SS_IDX(n):0))))
 
 #define SPI_INUM(u)        (2)
-#define SPI_INTR_SOURCE(u) ((u==0)?ETS_SPI0_INTR_SOURCE:((u==1)?ETS_SPI1_INTR_SOURCE:((u==2)?ETS_SPI2_INTR_SOURCE:((p==3)?ETS_SPI3_INTR_SOURCE:0))))
+#define SPI_INTR_SOURCE(u) ((u==0)?ETS_SPI0_INTR_SOURCE:((u==1)?ETS_SPI1_INTR_SOURCE:((u==2)?ETS_SPI2_INTR_SOURCE:((u==3)?ETS_SPI3_INTR_SOURCE:0))))
+
+#define SPI_DMA_DESC_MAX_LEN    4092 //largest word aligned length of one lldesc_t
+#define SPI_DMA_DESC_COUNT      8
+#define SPI_DMA_MAX_SEGMENT     (SPI_DMA_DESC_MAX_LEN * SPI_DMA_DESC_COUNT)
+
+#ifndef SPI_DMA_PIXEL_BUF_SIZE
+#define SPI_DMA_PIXEL_BUF_SIZE  2048 //size of each of the two bounce buffers used by spiWritePixelsDMANL
+#endif
+
+typedef struct {
+    lldesc_t tx_desc[SPI_DMA_DESC_COUNT];
+    lldesc_t rx_desc[SPI_DMA_DESC_COUNT];
+    uint8_t * pix_buf[2];
+    uint8_t pix_idx;
+    uint8_t chan;
+    intr_handle_t intr_handle;
+    const uint8_t * tx;
+    uint8_t * rx;
+    uint32_t remaining;
+    spi_dma_cb_t cb;
+    void * cb_arg;
+    volatile bool busy;
+    volatile TaskHandle_t waiter;
+} spi_dma_t;
 
 struct spi_struct_t {
     spi_dev_t * dev;
@@ -46,8 +77,23 @@ struct spi_struct_t {
     xSemaphoreHandle lock;
 #endif
     uint8_t num;
+    spi_dma_t * dma;
+    QueueHandle_t queue;
+    volatile TaskHandle_t queue_task;
 };
 
+#ifndef SPI_QUEUE_TASK_STACK_SIZE
+#define SPI_QUEUE_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef SPI_QUEUE_TASK_PRIORITY
+#define SPI_QUEUE_TASK_PRIORITY 5
+#endif
+
+#ifndef SPI_QUEUE_TASK_RUNNING_CORE
+#define SPI_QUEUE_TASK_RUNNING_CORE -1
+#endif
+
 #if CONFIG_DISABLE_HAL_LOCKS
 #define SPI_MUTEX_LOCK()
 #define SPI_MUTEX_UNLOCK()
@@ -180,6 +226,54 @@ void spiDetachMOSI(spi_t * spi, int8_t mosi)
     pinMode(mosi, INPUT);
 }
 
+static void spiAttachDataLine(int8_t pin, uint32_t signal)
+{
+    // the peripheral drives the output enable, so the line can turn around for reads
+    pinMode(pin, INPUT);
+    pinMatrixOutAttach(pin, signal, false, false);
+    pinMatrixInAttach(pin, signal, false);
+}
+
+void spiAttachQuadPins(spi_t * spi, int8_t mosi, int8_t miso, int8_t wp, int8_t hd)
+{
+    if(!spi) {
+        return;
+    }
+    if(mosi < 0) {
+        mosi = (spi->num == HSPI)?13:((spi->num == VSPI)?23:8);
+    }
+    if(miso < 0) {
+        miso = (spi->num == HSPI)?12:((spi->num == VSPI)?19:7);
+    }
+    SPI_MUTEX_LOCK();
+    spiAttachDataLine(mosi, SPI_MOSI_IDX(spi->num));
+    spiAttachDataLine(miso, SPI_MISO_IDX(spi->num));
+    if(wp >= 0) {
+        spiAttachDataLine(wp, SPI_WP_IDX(spi->num));
+    }
+    if(hd >= 0) {
+        spiAttachDataLine(hd, SPI_HD_IDX(spi->num));
+    }
+    SPI_MUTEX_UNLOCK();
+}
+
+void spiDetachQuadPins(spi_t * spi, int8_t wp, int8_t hd)
+{
+    if(!spi) {
+        return;
+    }
+    if(wp >= 0) {
+        pinMatrixOutDetach(wp, false, false);
+        pinMatrixInDetach(SPI_WP_IDX(spi->num), false, false);
+        pinMode(wp, INPUT);
+    }
+    if(hd >= 0) {
+        pinMatrixOutDetach(hd, false, false);
+        pinMatrixInDetach(SPI_HD_IDX(spi->num), false, false);
+        pinMode(hd, INPUT);
+    }
+}
+
 void spiAttachSS(spi_t * spi, uint8_t cs_num, int8_t ss)
 {
     if(!spi) {
@@ -404,6 +498,8 @@ void spiStopBus(spi_t * spi)
     }
 
     removeApbChangeCallback(spi, _on_apb_change);
+    spiQueueEnd(spi);
+    spiDMAEnd(spi);
 
     SPI_MUTEX_LOCK();
     spiInitBus(spi);
@@ -711,6 +807,9 @@ void spiTransferBits(spi_t * spi, uint32_t data, uint32_t * out, uint8_t bits)
 #define MSB_16_SET(var, val) { (var) = (((val) & 0xFF00) >> 8) | (((val) & 0xFF) << 8); }
 #define MSB_PIX_SET(var, val) { uint8_t * d = (uint8_t *)&(val); (var) = d[1] | (d[0] << 8) | (d[3] << 16) | (d[2] << 24); }
 
+// CPU driven transfers share the data registers and length fields with DMA, let it finish first
+#define SPI_DMA_WAIT_IDLE(spi) do { if((spi)->dma && (spi)->dma->busy) { spiDMAWaitNL(spi); } } while(0)
+
 void spiTransaction(spi_t * spi, uint32_t clockDiv, uint8_t dataMode, uint8_t bitOrder)
 {
     if(!spi) {
@@ -746,6 +845,37 @@ void spiTransaction(spi_t * spi, uint32_t clockDiv, uint8_t dataMode, uint8_t bi
     }
 }
 
+void spiPrepareSettings(spi_settings_t * settings, uint32_t clockDiv, uint8_t dataMode, uint8_t bitOrder)
+{
+    if(!settings) {
+        return;
+    }
+    settings->clock = clockDiv;
+    settings->pin = (dataMode == SPI_MODE2 || dataMode == SPI_MODE3)?SPI_CK_IDLE_EDGE:0;
+    settings->user = (dataMode == SPI_MODE1 || dataMode == SPI_MODE2)?SPI_CK_OUT_EDGE:0;
+    settings->ctrl = (bitOrder == SPI_LSBFIRST)?(SPI_WR_BIT_ORDER | SPI_RD_BIT_ORDER):0;
+}
+
+void IRAM_ATTR spiApplySettingsNL(spi_t * spi, const spi_settings_t * settings)
+{
+    if(!spi || !settings) {
+        return;
+    }
+    spi->dev->clock.val = settings->clock;
+    spi->dev->pin.val = (spi->dev->pin.val & ~SPI_CK_IDLE_EDGE) | settings->pin;
+    spi->dev->user.val = (spi->dev->user.val & ~SPI_CK_OUT_EDGE) | settings->user;
+    spi->dev->ctrl.val = (spi->dev->ctrl.val & ~(SPI_WR_BIT_ORDER | SPI_RD_BIT_ORDER)) | settings->ctrl;
+}
+
+void spiTransactionSettings(spi_t * spi, const spi_settings_t * settings)
+{
+    if(!spi) {
+        return;
+    }
+    SPI_MUTEX_LOCK();
+    spiApplySettingsNL(spi, settings);
+}
+
 void spiSimpleTransaction(spi_t * spi)
 {
     if(!spi) {
@@ -759,6 +889,7 @@ void spiEndTransaction(spi_t * spi)
     if(!spi) {
         return;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     SPI_MUTEX_UNLOCK();
 }
 
@@ -767,6 +898,7 @@ void IRAM_ATTR spiWriteByteNL(spi_t * spi, uint8_t data)
     if(!spi) {
         return;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     spi->dev->mosi_dlen.usr_mosi_dbitlen = 7;
     spi->dev->miso_dlen.usr_miso_dbitlen = 0;
     spi->dev->data_buf[0] = data;
@@ -779,6 +911,7 @@ uint8_t spiTransferByteNL(spi_t * spi, uint8_t data)
     if(!spi) {
         return 0;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     spi->dev->mosi_dlen.usr_mosi_dbitlen = 7;
     spi->dev->miso_dlen.usr_miso_dbitlen = 7;
     spi->dev->data_buf[0] = data;
@@ -793,6 +926,7 @@ void IRAM_ATTR spiWriteShortNL(spi_t * spi, uint16_t data)
     if(!spi) {
         return;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     if(!spi->dev->ctrl.wr_bit_order){
         MSB_16_SET(data, data);
     }
@@ -808,6 +942,7 @@ uint16_t spiTransferShortNL(spi_t * spi, uint16_t data)
     if(!spi) {
         return 0;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     if(!spi->dev->ctrl.wr_bit_order){
         MSB_16_SET(data, data);
     }
@@ -828,6 +963,7 @@ void IRAM_ATTR spiWriteLongNL(spi_t * spi, uint32_t data)
     if(!spi) {
         return;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     if(!spi->dev->ctrl.wr_bit_order){
         MSB_32_SET(data, data);
     }
@@ -843,6 +979,7 @@ uint32_t spiTransferLongNL(spi_t * spi, uint32_t data)
     if(!spi) {
         return 0;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     if(!spi->dev->ctrl.wr_bit_order){
         MSB_32_SET(data, data);
     }
@@ -859,6 +996,7 @@ uint32_t spiTransferLongNL(spi_t * spi, uint32_t data)
 }
 
 void spiWriteNL(spi_t * spi, const void * data_in, uint32_t len){
+    SPI_DMA_WAIT_IDLE(spi);
     size_t longs = len >> 2;
     if(len & 3){
         longs++;
@@ -888,6 +1026,7 @@ void spiTransferBytesNL(spi_t * spi, const void * data_in, uint8_t * data_out, u
     if(!spi) {
         return;
     }
+    SPI_DMA_WAIT_IDLE(spi);
     size_t longs = len >> 2;
     if(len & 3){
         longs++;
@@ -934,6 +1073,7 @@ void spiTransferBitsNL(spi_t * spi, uint32_t data, uint32_t * out, uint8_t bits)
     if(!spi) {
         return;
     }
+    SPI_DMA_WAIT_IDLE(spi);
 
     if(bits > 32) {
         bits = 32;
@@ -972,6 +1112,7 @@ void spiTransferBitsNL(spi_t * spi, uint32_t data, uint32_t * out, uint8_t bits)
 }
 
 void IRAM_ATTR spiWritePixelsNL(spi_t * spi, const void * data_in, uint32_t len){
+    SPI_DMA_WAIT_IDLE(spi);
     size_t longs = len >> 2;
     if(len & 3){
         longs++;
@@ -1013,6 +1154,483 @@ void IRAM_ATTR spiWritePixelsNL(spi_t * spi, const void * data_in, uint32_t len)
 
 
 
+/*
+ * Phased Transfers
+ * */
+
+#define SPI_SWAP32(x) ((((x) & 0xFF) << 24) | (((x) & 0xFF00) << 8) | (((x) >> 8) & 0xFF00) | (((x) >> 24) & 0xFF))
+
+void spiTransferPhasedNL(spi_t * spi, const spi_phased_trans_t * trans)
+{
+    if(!spi || !trans) {
+        return;
+    }
+    SPI_DMA_WAIT_IDLE(spi);
+
+    uint32_t user = spi->dev->user.val;
+    uint32_t user1 = spi->dev->user1.val;
+    uint32_t user2 = spi->dev->user2.val;
+    uint32_t ctrl = spi->dev->ctrl.val;
+    bool lsb = spi->dev->ctrl.wr_bit_order;
+    bool read = trans->rx != NULL;
+    uint8_t mode = trans->io_mode;
+
+    spi->dev->user.doutdin = 0;
+    spi->dev->user.sio = 0;
+    spi->dev->user.usr_mosi = !read && trans->len;
+    spi->dev->user.usr_miso = read && trans->len;
+
+    spi->dev->user.usr_command = (trans->cmd_bits != 0);
+    if(trans->cmd_bits) {
+        uint8_t bits = (trans->cmd_bits > 16)?16:trans->cmd_bits;
+        spi->dev->user2.usr_command_bitlen = bits - 1;
+        // sent as bits 7-0 then 15-8, swap so the command goes out MSB first
+        spi->dev->user2.usr_command_value = lsb?trans->cmd:SPI_SWAP32((uint32_t)trans->cmd << (32 - bits));
+    }
+    uint8_t addr_bits = (trans->addr_bits > 32)?32:trans->addr_bits;
+    spi->dev->user.usr_addr = (addr_bits != 0);
+    if(addr_bits) {
+        spi->dev->user1.usr_addr_bitlen = addr_bits - 1;
+    }
+    spi->dev->user.usr_dummy = (trans->dummy_cycles != 0);
+    if(trans->dummy_cycles) {
+        spi->dev->user1.usr_dummy_cyclelen = trans->dummy_cycles - 1;
+    }
+
+    spi->dev->ctrl.fread_dual = read && mode == SPI_IO_DUAL;
+    spi->dev->ctrl.fread_quad = read && mode == SPI_IO_QUAD;
+    spi->dev->ctrl.fread_dio = read && mode == SPI_IO_DIO;
+    spi->dev->ctrl.fread_qio = read && mode == SPI_IO_QIO;
+    spi->dev->ctrl.fastrd_mode = read && mode != SPI_IO_SINGLE;
+    spi->dev->user.fwrite_dual = !read && mode == SPI_IO_DUAL;
+    spi->dev->user.fwrite_quad = !read && mode == SPI_IO_QUAD;
+    spi->dev->user.fwrite_dio = !read && mode == SPI_IO_DIO;
+    spi->dev->user.fwrite_qio = !read && mode == SPI_IO_QIO;
+
+    const uint8_t * tx = (const uint8_t *)trans->tx;
+    uint8_t * rx = (uint8_t *)trans->rx;
+    uint32_t len = trans->len;
+    uint32_t addr = trans->addr;
+    uint32_t buf[16];
+
+    do {
+        uint32_t c_len = (len > 64)?64:len;
+        uint32_t c_longs = (c_len + 3) >> 2;
+
+        if(addr_bits) {
+            spi->dev->addr = lsb?SPI_SWAP32(addr):(addr << (32 - addr_bits));
+        }
+        spi->dev->mosi_dlen.usr_mosi_dbitlen = (!read && c_len)?((c_len * 8) - 1):0;
+        spi->dev->miso_dlen.usr_miso_dbitlen = (read && c_len)?((c_len * 8) - 1):0;
+        if(!read && c_len) {
+            if(tx) {
+                memcpy(buf, tx, c_len);
+            } else {
+                memset(buf, 0xFF, c_len);
+            }
+            for(int i=0; i<c_longs; i++) {
+                spi->dev->data_buf[i] = buf[i];
+            }
+        }
+        spi->dev->cmd.usr = 1;
+        while(spi->dev->cmd.usr);
+        if(read && c_len) {
+            for(int i=0; i<c_longs; i++) {
+                buf[i] = spi->dev->data_buf[i];
+            }
+            memcpy(rx, buf, c_len);
+            rx += c_len;
+        }
+        if(tx) {
+            tx += c_len;
+        }
+        addr += c_len;
+        len -= c_len;
+    } while(len);
+
+    spi->dev->user.val = user;
+    spi->dev->user1.val = user1;
+    spi->dev->user2.val = user2;
+    spi->dev->ctrl.val = ctrl;
+}
+
+void spiTransferPhased(spi_t * spi, const spi_phased_trans_t * trans)
+{
+    if(!spi) {
+        return;
+    }
+    SPI_MUTEX_LOCK();
+    spiTransferPhasedNL(spi, trans);
+    SPI_MUTEX_UNLOCK();
+}
+
+
+/*
+ * DMA Transfers
+ * */
+
+static void IRAM_ATTR spiDMALink(lldesc_t * desc, const uint8_t * buf, uint32_t len)
+{
+    while(len) {
+        uint32_t d_len = (len > SPI_DMA_DESC_MAX_LEN)?SPI_DMA_DESC_MAX_LEN:len;
+        len -= d_len;
+        desc->size = (d_len + 3) & ~3;
+        desc->length = d_len;
+        desc->offset = 0;
+        desc->sosf = 0;
+        desc->eof = (len == 0);
+        desc->owner = 1;
+        desc->buf = (uint8_t *)buf;
+        desc->qe.stqe_next = len?(desc + 1):NULL;
+        buf += d_len;
+        desc++;
+    }
+}
+
+// Queues the next (up to SPI_DMA_MAX_SEGMENT bytes) part of the transfer. Runs from the ISR too.
+static void IRAM_ATTR spiDMAStartSegment(spi_t * spi)
+{
+    spi_dma_t * dma = spi->dma;
+    uint32_t len = (dma->remaining > SPI_DMA_MAX_SEGMENT)?SPI_DMA_MAX_SEGMENT:dma->remaining;
+
+    spi->dev->dma_conf.val |= SPI_OUT_RST | SPI_IN_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST;
+    spi->dev->dma_out_link.start = 0;
+    spi->dev->dma_in_link.start = 0;
+    spi->dev->dma_conf.val &= ~(SPI_OUT_RST | SPI_IN_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST);
+    spi->dev->dma_conf.out_data_burst_en = 1;
+    spi->dev->dma_conf.indscr_burst_en = 1;
+    spi->dev->dma_conf.outdscr_burst_en = 1;
+
+    if(dma->rx) {
+        spiDMALink(dma->rx_desc, dma->rx, len);
+        spi->dev->dma_in_link.addr = (uint32_t)&dma->rx_desc[0] & 0xFFFFF;
+        spi->dev->dma_in_link.start = 1;
+        spi->dev->miso_dlen.usr_miso_dbitlen = (len * 8) - 1;
+        dma->rx += len;
+    } else {
+        spi->dev->miso_dlen.usr_miso_dbitlen = 0;
+    }
+    spiDMALink(dma->tx_desc, dma->tx, len);
+    spi->dev->dma_out_link.addr = (uint32_t)&dma->tx_desc[0] & 0xFFFFF;
+    spi->dev->dma_out_link.start = 1;
+    spi->dev->mosi_dlen.usr_mosi_dbitlen = (len * 8) - 1;
+    dma->tx += len;
+    dma->remaining -= len;
+
+    spi->dev->slave.trans_done = 0;
+    spi->dev->slave.trans_inten = 1;
+    spi->dev->cmd.usr = 1;
+}
+
+static void IRAM_ATTR _spi_dma_isr(void * arg)
+{
+    spi_t * spi = (spi_t *)arg;
+    spi_dma_t * dma = spi->dma;
+
+    if(!spi->dev->slave.trans_done) {
+        return;
+    }
+    spi->dev->slave.trans_done = 0;
+    if(!dma || !dma->busy) {
+        return;
+    }
+    if(dma->remaining) {
+        spiDMAStartSegment(spi);
+        return;
+    }
+    // put the bus back to the W0..W15 buffer transfers used by the CPU path
+    spi->dev->slave.trans_inten = 0;
+    spi->dev->dma_out_link.start = 0;
+    spi->dev->dma_in_link.start = 0;
+    spi->dev->dma_conf.val |= SPI_OUT_RST | SPI_IN_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST;
+    spi->dev->dma_conf.val &= ~(SPI_OUT_RST | SPI_IN_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST);
+    dma->busy = false;
+    if(dma->cb) {
+        dma->cb(dma->cb_arg);
+    }
+    BaseType_t woken = pdFALSE;
+    if(dma->waiter) {
+        vTaskNotifyGiveFromISR(dma->waiter, &woken);
+    }
+    if(woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+bool spiDMABegin(spi_t * spi, uint8_t dma_chan)
+{
+    if(!spi) {
+        return false;
+    }
+    if(spi->dma) {
+        return true;
+    }
+    if(spi->num != HSPI && spi->num != VSPI) {
+        log_e("DMA is only available on HSPI and VSPI");
+        return false;
+    }
+    if(!dma_chan) {
+        dma_chan = (spi->num == HSPI)?1:2;
+    }
+    if(dma_chan > 2) {
+        log_e("Invalid DMA channel %u", dma_chan);
+        return false;
+    }
+
+    spi_dma_t * dma = (spi_dma_t *)heap_caps_calloc(1, sizeof(spi_dma_t), MALLOC_CAP_DMA);
+    if(!dma) {
+        log_e("DMA descriptor alloc failed");
+        return false;
+    }
+    dma->chan = dma_chan;
+    dma->pix_buf[0] = (uint8_t *)heap_caps_malloc(SPI_DMA_PIXEL_BUF_SIZE, MALLOC_CAP_DMA);
+    dma->pix_buf[1] = (uint8_t *)heap_caps_malloc(SPI_DMA_PIXEL_BUF_SIZE, MALLOC_CAP_DMA);
+    if(!dma->pix_buf[0] || !dma->pix_buf[1]) {
+        log_w("DMA pixel buffer alloc failed, writePixels will not use DMA");
+        free(dma->pix_buf[0]);
+        free(dma->pix_buf[1]);
+        dma->pix_buf[0] = dma->pix_buf[1] = NULL;
+    }
+
+    DPORT_SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_SPI_DMA_CLK_EN);
+    DPORT_CLEAR_PERI_REG_MASK(DPORT_PERIP_RST_EN_REG, DPORT_SPI_DMA_RST);
+
+    SPI_MUTEX_LOCK();
+    DPORT_SET_PERI_REG_BITS(DPORT_SPI_DMA_CHAN_SEL_REG, 3, dma_chan, ((spi->num - 1) * 2));
+    spi->dev->slave.trans_inten = 0;
+    spi->dev->slave.trans_done = 0;
+    spi->dma = dma;
+    if(esp_intr_alloc(SPI_INTR_SOURCE(spi->num), (int)ESP_INTR_FLAG_IRAM, _spi_dma_isr, spi, &dma->intr_handle) != ESP_OK) {
+        spi->dma = NULL;
+        SPI_MUTEX_UNLOCK();
+        log_e("DMA interrupt alloc failed");
+        free(dma->pix_buf[0]);
+        free(dma->pix_buf[1]);
+        free(dma);
+        return false;
+    }
+    SPI_MUTEX_UNLOCK();
+    return true;
+}
+
+void spiDMAEnd(spi_t * spi)
+{
+    if(!spi || !spi->dma) {
+        return;
+    }
+    SPI_MUTEX_LOCK();
+    SPI_DMA_WAIT_IDLE(spi);
+    spi_dma_t * dma = spi->dma;
+    spi->dev->slave.trans_inten = 0;
+    esp_intr_free(dma->intr_handle);
+    DPORT_SET_PERI_REG_BITS(DPORT_SPI_DMA_CHAN_SEL_REG, 3, 0, ((spi->num - 1) * 2));
+    spi->dma = NULL;
+    SPI_MUTEX_UNLOCK();
+    free(dma->pix_buf[0]);
+    free(dma->pix_buf[1]);
+    free(dma);
+}
+
+bool spiDMABusyNL(spi_t * spi)
+{
+    return spi && spi->dma && spi->dma->busy;
+}
+
+void spiDMAWaitNL(spi_t * spi)
+{
+    if(!spi || !spi->dma) {
+        return;
+    }
+    spi_dma_t * dma = spi->dma;
+    dma->waiter = xTaskGetCurrentTaskHandle();
+    while(dma->busy) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    dma->waiter = NULL;
+}
+
+void spiTransferDMANL(spi_t * spi, const void * data_in, void * data_out, uint32_t len, spi_dma_cb_t cb, void * arg)
+{
+    if(!spi) {
+        return;
+    }
+    // DMA needs word aligned buffers in DMA capable RAM, and whole words when receiving
+    bool dma_ok = spi->dma && data_in && esp_ptr_dma_capable(data_in) && !((uint32_t)data_in & 3)
+        && (!data_out || (esp_ptr_dma_capable(data_out) && !((uint32_t)data_out & 3) && !(len & 3)));
+    if(!dma_ok || !len) {
+        spiTransferBytesNL(spi, data_in, (uint8_t *)data_out, len);
+        if(cb) {
+            cb(arg);
+        }
+        return;
+    }
+
+    spi_dma_t * dma = spi->dma;
+    SPI_DMA_WAIT_IDLE(spi);
+    dma->tx = (const uint8_t *)data_in;
+    dma->rx = (uint8_t *)data_out;
+    dma->remaining = len;
+    dma->cb = cb;
+    dma->cb_arg = arg;
+    dma->busy = true;
+    spiDMAStartSegment(spi);
+}
+
+void spiWritePixelsDMANL(spi_t * spi, const void * data_in, uint32_t len)
+{
+    if(!spi) {
+        return;
+    }
+    spi_dma_t * dma = spi->dma;
+    if(!dma || !dma->pix_buf[0]) {
+        spiWritePixelsNL(spi, data_in, len);
+        return;
+    }
+    bool msb = !spi->dev->ctrl.wr_bit_order;
+    const uint8_t * data = (const uint8_t *)data_in;
+
+    while(len) {
+        uint32_t c_len = (len > SPI_DMA_PIXEL_BUF_SIZE)?SPI_DMA_PIXEL_BUF_SIZE:len;
+        // the other buffer may still be clocked out, this one was released by the previous wait
+        uint8_t * buf = dma->pix_buf[dma->pix_idx];
+        dma->pix_idx ^= 1;
+        if(msb) {
+            uint32_t i = 0;
+            for(; (i + 1) < c_len; i += 2) {
+                buf[i] = data[i + 1];
+                buf[i + 1] = data[i];
+            }
+            if(i < c_len) {
+                buf[i] = data[i];
+            }
+        } else {
+            memcpy(buf, data, c_len);
+        }
+        spiTransferDMANL(spi, buf, NULL, c_len, NULL, NULL);
+        data += c_len;
+        len -= c_len;
+    }
+}
+
+
+/*
+ * Transaction Queue
+ * */
+
+static void spiQueueRun(spi_t * spi, spi_trans_t * trans)
+{
+    if(trans->settings) {
+        spiApplySettingsNL(spi, trans->settings);
+    }
+    if(trans->cs >= 0) {
+        digitalWrite(trans->cs, LOW);
+    }
+    spiTransferDMANL(spi, trans->tx, trans->rx, trans->len, NULL, NULL);
+    SPI_DMA_WAIT_IDLE(spi);
+    if(trans->cs >= 0) {
+        digitalWrite(trans->cs, HIGH);
+    }
+    // the owner may release trans as soon as it is done, read everything needed first
+    spi_trans_cb_t cb = trans->cb;
+    TaskHandle_t waiter = trans->waiter;
+    trans->done = true;
+    if(cb) {
+        cb(trans);
+    }
+    if(waiter) {
+        xTaskNotifyGive(waiter);
+    }
+}
+
+static void spiQueueTask(void * arg)
+{
+    spi_t * spi = (spi_t *)arg;
+    spi_trans_t * trans = NULL;
+    bool stop = false;
+
+    while(!stop) {
+        xQueueReceive(spi->queue, &trans, portMAX_DELAY);
+        SPI_MUTEX_LOCK();
+        // run everything queued by now back to back under a single lock
+        do {
+            if(!trans) {
+                stop = true;
+                break;
+            }
+            spiQueueRun(spi, trans);
+        } while(xQueueReceive(spi->queue, &trans, 0) == pdTRUE);
+        SPI_MUTEX_UNLOCK();
+    }
+    spi->queue_task = NULL;
+    vTaskDelete(NULL);
+}
+
+bool spiQueueBegin(spi_t * spi, uint32_t depth)
+{
+    if(!spi) {
+        return false;
+    }
+    if(spi->queue) {
+        return true;
+    }
+    spi->queue = xQueueCreate(depth?depth:1, sizeof(spi_trans_t *));
+    if(!spi->queue) {
+        log_e("Queue create failed");
+        return false;
+    }
+    TaskHandle_t task = NULL;
+    if(xTaskCreateUniversal(spiQueueTask, "spi_queue", SPI_QUEUE_TASK_STACK_SIZE, spi, SPI_QUEUE_TASK_PRIORITY, &task, SPI_QUEUE_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("Queue task create failed");
+        vQueueDelete(spi->queue);
+        spi->queue = NULL;
+        return false;
+    }
+    spi->queue_task = task;
+    return true;
+}
+
+void spiQueueEnd(spi_t * spi)
+{
+    if(!spi || !spi->queue) {
+        return;
+    }
+    // a NULL entry stops the task once everything queued before it ran
+    spi_trans_t * stop = NULL;
+    xQueueSend(spi->queue, &stop, portMAX_DELAY);
+    while(spi->queue_task) {
+        vTaskDelay(1);
+    }
+    vQueueDelete(spi->queue);
+    spi->queue = NULL;
+}
+
+bool spiQueueTransfer(spi_t * spi, spi_trans_t * trans, uint32_t timeout_ms)
+{
+    if(!spi || !spi->queue || !trans) {
+        return false;
+    }
+    trans->done = false;
+    trans->waiter = NULL;
+    return xQueueSend(spi->queue, &trans, (timeout_ms == UINT32_MAX)?portMAX_DELAY:(timeout_ms / portTICK_PERIOD_MS)) == pdTRUE;
+}
+
+bool spiQueueTransferWait(spi_t * spi, spi_trans_t * trans)
+{
+    if(!spi || !spi->queue || !trans) {
+        return false;
+    }
+    trans->done = false;
+    trans->waiter = xTaskGetCurrentTaskHandle();
+    if(xQueueSend(spi->queue, &trans, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    while(!trans->done) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    return true;
+}
+
+
 /*
  * Clock Calculators
  *
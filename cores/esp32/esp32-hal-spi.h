@@ -51,9 +51,64 @@ extern "C" {
 #define SPI_LSBFIRST 0
 #define SPI_MSBFIRST 1
 
+//Data lines used by phased transfers
+#define SPI_IO_SINGLE 0 //one line per direction
+#define SPI_IO_DUAL   1 //data phase on two lines
+#define SPI_IO_QUAD   2 //data phase on four lines
+#define SPI_IO_DIO    3 //address and data phases on two lines
+#define SPI_IO_QIO    4 //address and data phases on four lines
+
 struct spi_struct_t;
 typedef struct spi_struct_t spi_t;
 
+typedef void (*spi_dma_cb_t)(void * arg);
+
+/*
+ * Bus settings of one device, precomputed by spiPrepareSettings()
+ * */
+typedef struct {
+    uint32_t clock;         /*!< value of the clock register */
+    uint32_t pin;           /*!< clock idle edge bit of the pin register */
+    uint32_t user;          /*!< clock out edge bit of the user register */
+    uint32_t ctrl;          /*!< bit order bits of the ctrl register */
+} spi_settings_t;
+
+/*
+ * Half duplex transfer made of optional command, address and dummy phases followed by
+ * the data phase, which reads when rx is set and writes otherwise.
+ * Data longer than 64 bytes is split, each part repeats the command and address phases
+ * with the address advanced by the bytes already transferred (as flash and PSRAM expect).
+ * */
+typedef struct {
+    uint16_t cmd;
+    uint8_t cmd_bits;        /*!< 0 - 16, 0 skips the command phase */
+    uint8_t addr_bits;       /*!< 0 - 32, 0 skips the address phase */
+    uint32_t addr;
+    uint8_t dummy_cycles;    /*!< 0 skips the dummy phase */
+    uint8_t io_mode;         /*!< SPI_IO_SINGLE, SPI_IO_DUAL, SPI_IO_QUAD, SPI_IO_DIO or SPI_IO_QIO */
+    const void * tx;         /*!< data to write, NULL sends 0xFF */
+    void * rx;               /*!< buffer for read data, NULL to write */
+    uint32_t len;            /*!< length of the data phase, may be 0 */
+} spi_phased_trans_t;
+
+typedef struct spi_trans_s spi_trans_t;
+typedef void (*spi_trans_cb_t)(spi_trans_t * trans);
+
+/*
+ * Queued transfer. Must stay valid until it is done.
+ * */
+struct spi_trans_s {
+    const spi_settings_t * settings; /*!< settings of the device, NULL keeps the current ones */
+    int8_t cs;                       /*!< chip select pin held LOW during the transfer, -1 for none */
+    const void * tx;                 /*!< data to send, NULL sends 0xFF */
+    void * rx;                       /*!< buffer for the received data, NULL to discard */
+    uint32_t len;
+    spi_trans_cb_t cb;               /*!< called from the queue task when done, may be NULL */
+    void * user;                     /*!< free for the owner */
+    volatile bool done;              /*!< set by the queue task */
+    void * waiter;                   /*!< internal */
+};
+
 spi_t * spiStartBus(uint8_t spi_num, uint32_t clockDiv, uint8_t dataMode, uint8_t bitOrder);
 void spiStopBus(spi_t * spi);
 
@@ -65,6 +120,10 @@ void spiDetachSCK(spi_t * spi, int8_t sck);
 void spiDetachMISO(spi_t * spi, int8_t miso);
 void spiDetachMOSI(spi_t * spi, int8_t mosi);
 
+//Attach/Detach all data lines in both directions for dual and quad transfers (wp, hd -1 for dual only)
+void spiAttachQuadPins(spi_t * spi, int8_t mosi, int8_t miso, int8_t wp, int8_t hd);
+void spiDetachQuadPins(spi_t * spi, int8_t wp, int8_t hd);
+
 //Attach/Detach SS pin to SPI_CSx signal
 void spiAttachSS(spi_t * spi, uint8_t cs_num, int8_t ss);
 void spiDetachSS(spi_t * spi, int8_t ss);
@@ -115,6 +174,14 @@ void spiTransaction(spi_t * spi, uint32_t clockDiv, uint8_t dataMode, uint8_t bi
 void spiSimpleTransaction(spi_t * spi);
 void spiEndTransaction(spi_t * spi);
 
+/*
+ * Transactions with precomputed settings, so switching between devices on a shared bus
+ * is a few register writes. spiApplySettingsNL() switches inside a running transaction.
+ * */
+void spiPrepareSettings(spi_settings_t * settings, uint32_t clockDiv, uint8_t dataMode, uint8_t bitOrder);
+void spiTransactionSettings(spi_t * spi, const spi_settings_t * settings);
+void spiApplySettingsNL(spi_t * spi, const spi_settings_t * settings);
+
 void spiWriteNL(spi_t * spi, const void * data_in, uint32_t len);
 void spiWriteByteNL(spi_t * spi, uint8_t data);
 void spiWriteShortNL(spi_t * spi, uint16_t data);
@@ -128,6 +195,37 @@ uint32_t spiTransferLongNL(spi_t * spi, uint32_t data);
 void spiTransferBytesNL(spi_t * spi, const void * data_in, uint8_t * data_out, uint32_t len);
 void spiTransferBitsNL(spi_t * spi, uint32_t data_in, uint32_t * data_out, uint8_t bits);
 
+void spiTransferPhased(spi_t * spi, const spi_phased_trans_t * trans);
+void spiTransferPhasedNL(spi_t * spi, const spi_phased_trans_t * trans);
+
+/*
+ * DMA transfers (HSPI and VSPI only), used inside a transaction like the other NL functions.
+ * spiDMABegin() selects the DMA channel (1 or 2, 0 picks 1 for HSPI and 2 for VSPI).
+ * spiTransferDMANL() returns as soon as the transfer is started; cb is called from the
+ * interrupt when it completes, so it must be IRAM_ATTR and ISR safe. Buffers must stay valid
+ * until then. Buffers the DMA can not reach fall back to a blocking CPU transfer.
+ * spiWritePixelsDMANL() copies through two internal buffers, so the CPU can prepare the
+ * next block while the previous one is clocked out. It returns while the last block is sent.
+ * Any other transfer on the bus and spiEndTransaction() wait for the DMA to finish.
+ * */
+bool spiDMABegin(spi_t * spi, uint8_t dma_chan);
+void spiDMAEnd(spi_t * spi);
+void spiTransferDMANL(spi_t * spi, const void * data_in, void * data_out, uint32_t len, spi_dma_cb_t cb, void * arg);
+void spiWritePixelsDMANL(spi_t * spi, const void * data_in, uint32_t len);
+bool spiDMABusyNL(spi_t * spi);
+void spiDMAWaitNL(spi_t * spi);
+
+/*
+ * Transaction queue. Any task can queue transfers for different devices, a bus task
+ * runs them back to back while holding the bus lock once per batch.
+ * spiQueueTransfer() returns once the transfer is queued (timeout_ms UINT32_MAX waits forever),
+ * spiQueueTransferWait() returns once it is done.
+ * */
+bool spiQueueBegin(spi_t * spi, uint32_t depth);
+void spiQueueEnd(spi_t * spi);
+bool spiQueueTransfer(spi_t * spi, spi_trans_t * trans, uint32_t timeout_ms);
+bool spiQueueTransferWait(spi_t * spi, spi_trans_t * trans);
+
 /*
  * Helper functions to translate frequency to clock divider and back
  * */
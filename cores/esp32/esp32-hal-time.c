@@ -14,7 +14,14 @@
 
 #include "esp32-hal.h"
 #include "lwip/apps/sntp.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
 #include "tcpip_adapter.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <sys/time.h>
 
 static void setTimeZone(long offset, int daylight)
 {
@@ -92,3 +99,358 @@ bool getLocalTime(struct tm * info, uint32_t ms)
     return false;
 }
 
+
+#ifndef TIME_SYNC_TASK_STACK_SIZE
+#define TIME_SYNC_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef TIME_SYNC_TASK_PRIORITY
+#define TIME_SYNC_TASK_PRIORITY 2
+#endif
+
+#ifndef TIME_SYNC_TASK_RUNNING_CORE
+#define TIME_SYNC_TASK_RUNNING_CORE -1
+#endif
+
+#define TIME_SYNC_TIMEOUT     1000      // ms to wait for one answer
+#define TIME_SYNC_RETRY       10000     // ms before trying again after a failed exchange
+#define TIME_SYNC_MAX_RTT     500000    // us, slower answers are not used
+#define TIME_SYNC_STEP_US     128000    // larger corrections are stepped, as ntpd does
+#define TIME_SYNC_SLEW_PPM    500       // fastest slew
+#define TIME_SYNC_DRIFT_MAX   500000    // ppb, anything beyond is not a crystal
+#define TIME_SYNC_DRIFT_INIT  50000     // ppb assumed as error before the drift is known
+#define TIME_SYNC_DRIFT_MIN   1000      // ppb, the least error assumed for a known drift
+#define NTP_UNIX_OFFSET       2208988800LL
+
+/*
+ * utc(t) = refUtc + (t - refLocal) * (1 + driftPpb / 1e9) + the part of slewUs
+ * slewed in by t. Each exchange anchors a new model at the moment it measured,
+ * continuous with the old one, and leaves the difference to the measurement
+ * in slewUs.
+ */
+typedef struct {
+    int64_t refLocal;
+    int64_t refUtc;
+    int64_t slewUs;
+    int32_t driftPpb;
+    uint32_t driftErrPpb;
+    uint32_t errorUs;
+} time_model_t;
+
+static time_model_t _time_model;
+static time_sync_info_t _time_info;
+static bool _time_synced = false;
+static bool _time_drift_known = false;
+static int64_t _time_last_local = 0;
+static int64_t _time_last_offset = 0;
+static portMUX_TYPE _time_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t _time_task = NULL;
+static volatile bool _time_running = false;
+static char * _time_server = NULL;
+static uint32_t _time_interval = TIME_SYNC_INTERVAL;
+
+static int64_t _time_model_utc(const time_model_t * m, int64_t t, uint32_t * errorUs)
+{
+    int64_t dt = t - m->refLocal;
+    int64_t utc = m->refUtc + dt + dt * m->driftPpb / 1000000000LL;
+    int64_t remaining = m->slewUs;
+    if(dt > 0 && m->slewUs){
+        int64_t max = dt * TIME_SYNC_SLEW_PPM / 1000000;
+        int64_t slewed = (llabs(m->slewUs) <= max) ? m->slewUs : ((m->slewUs > 0) ? max : -max);
+        utc += slewed;
+        remaining -= slewed;
+    }
+    if(errorUs){
+        int64_t e = m->errorUs + llabs(dt) * m->driftErrPpb / 1000000000LL + llabs(remaining);
+        *errorUs = (e > UINT32_MAX) ? UINT32_MAX : (uint32_t)e;
+    }
+    return utc;
+}
+
+int64_t timeToUtcMicros(int64_t timerUs, uint32_t * errorUs)
+{
+    if(!_time_synced){
+        if(errorUs){
+            *errorUs = UINT32_MAX;
+        }
+        return -1;
+    }
+    time_model_t m;
+    portENTER_CRITICAL(&_time_mux);
+    m = _time_model;
+    portEXIT_CRITICAL(&_time_mux);
+    return _time_model_utc(&m, timerUs, errorUs);
+}
+
+int64_t getTimeMicros(uint32_t * errorUs)
+{
+    return timeToUtcMicros(esp_timer_get_time(), errorUs);
+}
+
+bool timeSynced(void)
+{
+    return _time_synced;
+}
+
+bool getTimeSyncInfo(time_sync_info_t * info)
+{
+    if(!info){
+        return false;
+    }
+    portENTER_CRITICAL(&_time_mux);
+    *info = _time_info;
+    time_model_t m = _time_model;
+    portEXIT_CRITICAL(&_time_mux);
+    if(_time_synced){
+        uint32_t e;
+        int64_t now = esp_timer_get_time();
+        int64_t utc = _time_model_utc(&m, now, &e);
+        info->errorUs = e;
+        info->offsetUs = utc - now;
+        info->driftPpb = m.driftPpb;
+    }
+    return _time_synced;
+}
+
+// one measured pair: UTC at the local timestamp, the error is half the round trip
+static void _time_update(int64_t local, int64_t utc, uint32_t rtt)
+{
+    portENTER_CRITICAL(&_time_mux);
+    time_model_t m = _time_model;
+    portEXIT_CRITICAL(&_time_mux);
+
+    int64_t offset = utc - local;
+    if(_time_last_local && local - _time_last_local > 10000000LL){
+        int64_t measured = (offset - _time_last_offset) * 1000000000LL / (local - _time_last_local);
+        if(llabs(measured) < TIME_SYNC_DRIFT_MAX){
+            if(!_time_drift_known){
+                m.driftPpb = measured;
+                m.driftErrPpb = TIME_SYNC_DRIFT_INIT / 2;
+                _time_drift_known = true;
+            } else {
+                int64_t dev = measured - m.driftPpb;
+                m.driftPpb += dev / 4;
+                m.driftErrPpb += (llabs(dev) - (int64_t)m.driftErrPpb) / 4;
+            }
+            if(m.driftErrPpb < TIME_SYNC_DRIFT_MIN){
+                m.driftErrPpb = TIME_SYNC_DRIFT_MIN;
+            }
+        }
+    }
+    _time_last_local = local;
+    _time_last_offset = offset;
+
+    int64_t predicted = _time_synced ? _time_model_utc(&m, local, NULL) : utc;
+    int64_t correction = utc - predicted;
+    if(!_time_synced || llabs(correction) > TIME_SYNC_STEP_US){
+        if(_time_synced){
+            log_w("time stepped by %lld us", correction);
+        }
+        m.refUtc = utc;
+        m.slewUs = 0;
+        if(!_time_drift_known){
+            m.driftPpb = 0;
+            m.driftErrPpb = TIME_SYNC_DRIFT_INIT;
+        }
+    } else {
+        m.refUtc = predicted;
+        m.slewUs = correction;
+    }
+    m.refLocal = local;
+    m.errorUs = rtt / 2;
+
+    portENTER_CRITICAL(&_time_mux);
+    _time_model = m;
+    _time_info.rttUs = rtt;
+    _time_info.slewUs = m.slewUs;
+    _time_info.exchanges++;
+    _time_info.lastSyncUs = local;
+    portEXIT_CRITICAL(&_time_mux);
+    _time_synced = true;
+
+    // the system clock follows, slewed by newlib as long as it is close
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t now = esp_timer_get_time();
+    int64_t delta = _time_model_utc(&m, now, NULL) - ((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec);
+    if(llabs(delta) > 1000000LL){
+        int64_t target = _time_model_utc(&m, esp_timer_get_time(), NULL);
+        tv.tv_sec = target / 1000000LL;
+        tv.tv_usec = target % 1000000LL;
+        settimeofday(&tv, NULL);
+    } else {
+        tv.tv_sec = delta / 1000000LL;
+        tv.tv_usec = delta % 1000000LL;
+        adjtime(&tv, NULL);
+    }
+}
+
+static void _ntp_put32(uint8_t * p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t _ntp_get32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int64_t _ntp_to_us(const uint8_t * p)
+{
+    int64_t sec = _ntp_get32(p);
+    if(!(sec & 0x80000000)){
+        sec += 0x100000000LL;   // era 1, from 2036
+    }
+    uint64_t frac = _ntp_get32(p + 4);
+    return (sec - NTP_UNIX_OFFSET) * 1000000LL + (int64_t)((frac * 1000000ULL) >> 32);
+}
+
+// one request, the local and server timestamps are averaged over the round trip
+static bool _time_exchange(int sock, const struct sockaddr_in * addr, int64_t * local, int64_t * utc, uint32_t * rtt)
+{
+    uint8_t pkt[48];
+    memset(pkt, 0, sizeof(pkt));
+    pkt[0] = 0x23;                      // no leap warning, version 4, client
+    uint32_t cookie[2] = { esp_random(), esp_random() };
+    _ntp_put32(&pkt[40], cookie[0]);    // echoed as originate timestamp
+    _ntp_put32(&pkt[44], cookie[1]);
+
+    int64_t t1 = esp_timer_get_time();
+    if(sendto(sock, pkt, sizeof(pkt), 0, (const struct sockaddr *)addr, sizeof(*addr)) != sizeof(pkt)){
+        return false;
+    }
+    for(;;){
+        int32_t left = TIME_SYNC_TIMEOUT - (int32_t)((esp_timer_get_time() - t1) / 1000);
+        if(left <= 0){
+            return false;
+        }
+        fd_set fdset;
+        FD_ZERO(&fdset);
+        FD_SET(sock, &fdset);
+        struct timeval tv = { left / 1000, (left % 1000) * 1000 };
+        if(select(sock + 1, &fdset, NULL, NULL, &tv) <= 0){
+            return false;
+        }
+        int len = recv(sock, pkt, sizeof(pkt), 0);
+        int64_t t4 = esp_timer_get_time();
+        if(len < (int)sizeof(pkt) || (pkt[0] & 0x07) != 4 || !pkt[1] || pkt[1] > 15
+                || _ntp_get32(&pkt[24]) != cookie[0] || _ntp_get32(&pkt[28]) != cookie[1]){
+            continue;
+        }
+        int64_t t2 = _ntp_to_us(&pkt[32]);
+        int64_t t3 = _ntp_to_us(&pkt[40]);
+        int64_t delay = (t4 - t1) - (t3 - t2);
+        if(delay < 0){
+            delay = 0;
+        }
+        *local = (t1 + t4) / 2;
+        *utc = t2 + (t3 - t2) / 2;
+        *rtt = delay;
+        return true;
+    }
+}
+
+static bool _time_sync_once(const char * server)
+{
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if(getaddrinfo(server, "123", &hints, &res) != 0 || !res){
+        log_w("could not resolve %s", server);
+        return false;
+    }
+    struct sockaddr_in addr;
+    memcpy(&addr, res->ai_addr, sizeof(addr));
+    freeaddrinfo(res);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0){
+        log_e("socket: %d", errno);
+        return false;
+    }
+    int64_t local, utc, bestLocal = 0, bestUtc = 0;
+    uint32_t rtt, bestRtt = UINT32_MAX;
+    for(int i = 0; i < TIME_SYNC_BURST && _time_running; i++){
+        if(_time_exchange(sock, &addr, &local, &utc, &rtt) && rtt < bestRtt){
+            bestLocal = local;
+            bestUtc = utc;
+            bestRtt = rtt;
+        }
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    close(sock);
+    if(bestRtt > TIME_SYNC_MAX_RTT){
+        return false;
+    }
+    _time_update(bestLocal, bestUtc, bestRtt);
+    return true;
+}
+
+static void _time_sync_task(void * arg)
+{
+    while(_time_running){
+        bool ok = _time_sync_once(_time_server);
+        if(!ok){
+            portENTER_CRITICAL(&_time_mux);
+            _time_info.failures++;
+            portEXIT_CRITICAL(&_time_mux);
+        }
+        uint32_t wait = _time_interval;
+        if(!ok && wait > TIME_SYNC_RETRY){
+            wait = TIME_SYNC_RETRY;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    }
+    free(_time_server);
+    _time_server = NULL;
+    portENTER_CRITICAL(&_time_mux);
+    _time_task = NULL;
+    portEXIT_CRITICAL(&_time_mux);
+    vTaskDelete(NULL);
+}
+
+bool timeSyncBegin(const char * server, uint32_t intervalMs)
+{
+    if(!server || !server[0]){
+        log_e("no server given");
+        return false;
+    }
+    if(_time_task){
+        log_e("time sync already running");
+        return false;
+    }
+    tcpip_adapter_init();  // Should not hurt anything if already inited
+    if(sntp_enabled()){
+        sntp_stop();
+    }
+    _time_server = strdup(server);
+    if(!_time_server){
+        return false;
+    }
+    _time_interval = intervalMs ? intervalMs : TIME_SYNC_INTERVAL;
+    _time_running = true;
+    if(xTaskCreateUniversal(_time_sync_task, "time_sync", TIME_SYNC_TASK_STACK_SIZE, NULL, TIME_SYNC_TASK_PRIORITY, &_time_task, TIME_SYNC_TASK_RUNNING_CORE) != pdPASS){
+        log_e("could not start the time sync task");
+        _time_running = false;
+        free(_time_server);
+        _time_server = NULL;
+        return false;
+    }
+    return true;
+}
+
+// the mapping stays usable, it drifts from here on by what the drift estimate missed
+void timeSyncEnd(void)
+{
+    portENTER_CRITICAL(&_time_mux);
+    _time_running = false;
+    if(_time_task){
+        xTaskNotifyGive(_time_task);
+    }
+    portEXIT_CRITICAL(&_time_mux);
+}
@@ -0,0 +1,66 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_TIME_H_
+#define _ESP32_HAL_TIME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef TIME_SYNC_INTERVAL
+#define TIME_SYNC_INTERVAL 64000 // ms between exchanges with the server, the shortest NTP poll
+#endif
+
+#ifndef TIME_SYNC_BURST
+#define TIME_SYNC_BURST 4 // requests per exchange, the one with the shortest round trip is used
+#endif
+
+/*
+ * UTC in microseconds mapped onto esp_timer_get_time(). Every exchange with the NTP
+ * server measures the offset of the local clock with an error of half the round trip,
+ * successive offsets give its drift. Corrections are slewed in at no more than
+ * 500 ppm so the mapping never jumps or runs backwards; offsets above 128 ms are
+ * stepped. The system clock behind time() and gettimeofday() follows via adjtime().
+ */
+typedef struct {
+    int64_t offsetUs;     // UTC minus esp_timer_get_time() at the last exchange
+    int32_t driftPpb;     // how much faster UTC runs than the local clock, parts per billion
+    uint32_t errorUs;     // bound of getTimeMicros() right now
+    uint32_t rttUs;       // round trip of the last exchange
+    int32_t slewUs;       // correction still being slewed in
+    uint32_t exchanges;   // successful exchanges
+    uint32_t failures;
+    int64_t lastSyncUs;   // esp_timer_get_time() of the last exchange, 0 before the first
+} time_sync_info_t;
+
+// replaces SNTP started by configTime(), the time zone stays as it was set
+bool timeSyncBegin(const char * server, uint32_t intervalMs);
+void timeSyncEnd(void);
+bool timeSynced(void);
+
+// microseconds since 1970 UTC, -1 before the first exchange; errorUs may be NULL
+int64_t getTimeMicros(uint32_t * errorUs);
+// the same for a local timestamp taken earlier with esp_timer_get_time()
+int64_t timeToUtcMicros(int64_t timerUs, uint32_t * errorUs);
+bool getTimeSyncInfo(time_sync_info_t * info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_TIME_H_ */
@@ -0,0 +1,348 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "esp32-hal-timer-sched.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_attr.h"
+
+#ifndef TIMER_SCHED_MAX_JOBS
+#define TIMER_SCHED_MAX_JOBS 32
+#endif
+
+#ifndef TIMER_SCHED_MIN_PERIOD_US
+#define TIMER_SCHED_MIN_PERIOD_US 10
+#endif
+
+#ifndef TIMER_SCHED_TASK_STACK_SIZE
+#define TIMER_SCHED_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef TIMER_SCHED_TASK_PRIORITY
+#define TIMER_SCHED_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#endif
+
+#ifndef TIMER_SCHED_TASK_RUNNING_CORE
+#define TIMER_SCHED_TASK_RUNNING_CORE -1
+#endif
+
+struct timer_sched_job_s {
+    timer_sched_cb_t cb;
+    void * arg;
+    uint64_t deadline;
+    uint64_t fired;         // deadline the queued task run belongs to
+    uint32_t period;
+    uint8_t dispatch;
+    uint8_t index;          // position in the heap
+    volatile bool pending;  // queued for the task
+    bool used;
+    uint64_t jitterSum;
+    timer_sched_stats_t stats;
+};
+
+typedef struct {
+    hw_timer_t * timer;
+    TaskHandle_t task;
+    QueueHandle_t queue;
+    portMUX_TYPE lock;
+    uint8_t count;
+    timer_sched_job_t * heap[TIMER_SCHED_MAX_JOBS];
+    timer_sched_job_t jobs[TIMER_SCHED_MAX_JOBS];
+} timer_sched_t;
+
+static timer_sched_t * _sched = NULL;
+
+static inline void IRAM_ATTR _heapSwap(uint8_t a, uint8_t b)
+{
+    timer_sched_job_t * j = _sched->heap[a];
+    _sched->heap[a] = _sched->heap[b];
+    _sched->heap[b] = j;
+    _sched->heap[a]->index = a;
+    _sched->heap[b]->index = b;
+}
+
+static void IRAM_ATTR _heapUp(uint8_t i)
+{
+    while(i){
+        uint8_t parent = (i - 1) / 2;
+        if(_sched->heap[parent]->deadline <= _sched->heap[i]->deadline){
+            break;
+        }
+        _heapSwap(i, parent);
+        i = parent;
+    }
+}
+
+static void IRAM_ATTR _heapDown(uint8_t i)
+{
+    for(;;){
+        uint8_t smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if(l < _sched->count && _sched->heap[l]->deadline < _sched->heap[smallest]->deadline){
+            smallest = l;
+        }
+        if(r < _sched->count && _sched->heap[r]->deadline < _sched->heap[smallest]->deadline){
+            smallest = r;
+        }
+        if(smallest == i){
+            break;
+        }
+        _heapSwap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void _heapRemove(uint8_t i)
+{
+    _sched->count--;
+    if(i != _sched->count){
+        _heapSwap(i, _sched->count);
+        _heapDown(i);
+        _heapUp(i);
+    }
+}
+
+static void IRAM_ATTR _recordRun(timer_sched_job_t * job, uint64_t deadline, uint64_t now)
+{
+    uint32_t jitter = (now > deadline) ? (uint32_t)(now - deadline) : 0;
+    job->stats.runs++;
+    job->stats.jitterLastUs = jitter;
+    if(jitter > job->stats.jitterMaxUs){
+        job->stats.jitterMaxUs = jitter;
+    }
+    job->jitterSum += jitter;
+    job->stats.jitterAvgUs = job->jitterSum / job->stats.runs;
+}
+
+// the alarm only fires on a future count, so recheck once armed
+static bool IRAM_ATTR _armAlarm(uint64_t deadline)
+{
+    timerAlarmWrite(_sched->timer, deadline, false);
+    timerAlarmEnable(_sched->timer);
+    return timerRead(_sched->timer) < deadline;
+}
+
+static void IRAM_ATTR _timerSchedISR(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    if(!_sched){
+        return;
+    }
+    for(;;){
+        portENTER_CRITICAL_ISR(&_sched->lock);
+        if(!_sched->count){
+            portEXIT_CRITICAL_ISR(&_sched->lock);
+            break;
+        }
+        timer_sched_job_t * job = _sched->heap[0];
+        uint64_t now = timerRead(_sched->timer);
+        if(job->deadline > now && _armAlarm(job->deadline)){
+            portEXIT_CRITICAL_ISR(&_sched->lock);
+            break;
+        }
+        uint64_t deadline = job->deadline;
+        job->deadline += job->period;
+        if(job->deadline <= now){
+            uint32_t missed = (now - job->deadline) / job->period + 1;
+            job->stats.overruns += missed;
+            job->deadline += (uint64_t)missed * job->period;
+        }
+        _heapDown(0);
+        timer_sched_cb_t cb = NULL;
+        if(job->dispatch == TIMER_SCHED_ISR){
+            _recordRun(job, deadline, now);
+            cb = job->cb;
+        } else if(job->pending){
+            job->stats.overruns++;
+        } else {
+            job->pending = true;
+            job->fired = deadline;
+            if(xQueueSendFromISR(_sched->queue, &job, &xHigherPriorityTaskWoken) != pdTRUE){
+                job->pending = false;
+                job->stats.overruns++;
+            }
+        }
+        void * arg = job->arg;
+        portEXIT_CRITICAL_ISR(&_sched->lock);
+        if(cb){
+            cb(arg);
+        }
+    }
+    if(xHigherPriorityTaskWoken){
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void _timerSchedTask(void * arg)
+{
+    timer_sched_job_t * job = NULL;
+    for(;;){
+        if(xQueueReceive(_sched->queue, &job, portMAX_DELAY) != pdTRUE){
+            continue;
+        }
+        if(job == NULL){
+            break;
+        }
+        portENTER_CRITICAL(&_sched->lock);
+        timer_sched_cb_t cb = job->cb;
+        void * cb_arg = job->arg;
+        if(cb){
+            _recordRun(job, job->fired, timerRead(_sched->timer));
+        } else {
+            job->used = false; // removed while queued
+        }
+        portEXIT_CRITICAL(&_sched->lock);
+        if(cb){
+            cb(cb_arg);
+        }
+        job->pending = false;
+    }
+    _sched->task = NULL;
+    vTaskDelete(NULL);
+}
+
+bool timerSchedBegin(uint8_t timer)
+{
+    if(_sched){
+        log_e("timer scheduler already running");
+        return false;
+    }
+    timer_sched_t * sched = (timer_sched_t *)calloc(1, sizeof(timer_sched_t));
+    if(!sched){
+        return false;
+    }
+    vPortCPUInitializeMutex(&sched->lock);
+    sched->queue = xQueueCreate(TIMER_SCHED_MAX_JOBS, sizeof(timer_sched_job_t *));
+    if(!sched->queue){
+        free(sched);
+        return false;
+    }
+    // 1 tick = 1us
+    sched->timer = timerBegin(timer, getApbFrequency() / 1000000, true);
+    if(!sched->timer){
+        vQueueDelete(sched->queue);
+        free(sched);
+        return false;
+    }
+    _sched = sched;
+    if(xTaskCreateUniversal(_timerSchedTask, "timer_sched", TIMER_SCHED_TASK_STACK_SIZE, NULL, TIMER_SCHED_TASK_PRIORITY, &sched->task, TIMER_SCHED_TASK_RUNNING_CORE) != pdPASS){
+        log_e("timer scheduler task create failed");
+        timerSchedEnd();
+        return false;
+    }
+    timerAttachInterrupt(sched->timer, _timerSchedISR, true);
+    return true;
+}
+
+void timerSchedEnd(void)
+{
+    timer_sched_t * sched = _sched;
+    if(!sched){
+        return;
+    }
+    timerAlarmDisable(sched->timer);
+    timerEnd(sched->timer);
+    portENTER_CRITICAL(&sched->lock);
+    sched->count = 0;
+    portEXIT_CRITICAL(&sched->lock);
+    if(sched->task){
+        timer_sched_job_t * stop = NULL;
+        xQueueSend(sched->queue, &stop, portMAX_DELAY);
+        while(sched->task){
+            vTaskDelay(1);
+        }
+    }
+    _sched = NULL;
+    vQueueDelete(sched->queue);
+    free(sched);
+}
+
+timer_sched_job_t * timerSchedAdd(uint32_t periodUs, timer_sched_cb_t cb, void * arg, timer_sched_dispatch_t dispatch)
+{
+    if(!_sched || !cb || periodUs < TIMER_SCHED_MIN_PERIOD_US){
+        return NULL;
+    }
+    timer_sched_job_t * job = NULL;
+    portENTER_CRITICAL(&_sched->lock);
+    for(uint8_t i = 0; i < TIMER_SCHED_MAX_JOBS; i++){
+        if(!_sched->jobs[i].used){
+            job = &_sched->jobs[i];
+            break;
+        }
+    }
+    if(job){
+        memset(job, 0, sizeof(timer_sched_job_t));
+        job->used = true;
+        job->cb = cb;
+        job->arg = arg;
+        job->period = periodUs;
+        job->dispatch = dispatch;
+        job->deadline = timerRead(_sched->timer) + periodUs;
+        job->index = _sched->count;
+        _sched->heap[_sched->count++] = job;
+        _heapUp(job->index);
+        if(_sched->heap[0] == job){
+            uint64_t at = job->deadline;
+            while(!_armAlarm(at)){
+                at = timerRead(_sched->timer) + 2; // already due, the ISR runs it late
+            }
+        }
+    }
+    portEXIT_CRITICAL(&_sched->lock);
+    if(!job){
+        log_e("no free timer scheduler slot, %u max", TIMER_SCHED_MAX_JOBS);
+    }
+    return job;
+}
+
+void timerSchedRemove(timer_sched_job_t * job)
+{
+    if(!_sched || !job || !job->used){
+        return;
+    }
+    portENTER_CRITICAL(&_sched->lock);
+    if(job->cb){
+        _heapRemove(job->index);
+        job->cb = NULL;
+        // a queued task run releases the slot once it is drained
+        if(!job->pending){
+            job->used = false;
+        }
+    }
+    portEXIT_CRITICAL(&_sched->lock);
+}
+
+bool timerSchedGetStats(timer_sched_job_t * job, timer_sched_stats_t * stats)
+{
+    if(!_sched || !job || !job->used || !stats){
+        return false;
+    }
+    portENTER_CRITICAL(&_sched->lock);
+    *stats = job->stats;
+    portEXIT_CRITICAL(&_sched->lock);
+    return true;
+}
+
+void timerSchedResetStats(timer_sched_job_t * job)
+{
+    if(!_sched || !job || !job->used){
+        return;
+    }
+    portENTER_CRITICAL(&_sched->lock);
+    memset(&job->stats, 0, sizeof(timer_sched_stats_t));
+    job->jitterSum = 0;
+    portEXIT_CRITICAL(&_sched->lock);
+}
@@ -0,0 +1,63 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _ESP32_HAL_TIMER_SCHED_H_
+#define _ESP32_HAL_TIMER_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Many periodic jobs multiplexed on one hardware timer counting microseconds.
+ * Deadlines are kept in a min-heap and the alarm is always set to the nearest one.
+ * ISR jobs must be IRAM_ATTR and ISR safe; task jobs run in the scheduler task
+ * one at a time. A job that is still pending (task) or whose next deadline has
+ * already passed counts an overrun and skips the missed periods.
+ */
+typedef struct timer_sched_job_s timer_sched_job_t;
+typedef void (*timer_sched_cb_t)(void * arg);
+
+typedef enum {
+    TIMER_SCHED_ISR,
+    TIMER_SCHED_TASK
+} timer_sched_dispatch_t;
+
+typedef struct {
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t jitterLastUs;  // start of the callback minus its deadline
+    uint32_t jitterMaxUs;
+    uint32_t jitterAvgUs;
+} timer_sched_stats_t;
+
+// timer 0-3, the timer can not be used through timerBegin() at the same time
+bool timerSchedBegin(uint8_t timer);
+void timerSchedEnd(void);
+
+timer_sched_job_t * timerSchedAdd(uint32_t periodUs, timer_sched_cb_t cb, void * arg, timer_sched_dispatch_t dispatch);
+void timerSchedRemove(timer_sched_job_t * job);
+
+bool timerSchedGetStats(timer_sched_job_t * job, timer_sched_stats_t * stats);
+void timerSchedResetStats(timer_sched_job_t * job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_TIMER_SCHED_H_ */
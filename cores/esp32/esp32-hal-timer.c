@@ -66,10 +66,13 @@ static hw_timer_t hw_timer[4] = {
 
 typedef void (*voidFuncPtr)(void);
 static voidFuncPtr __timerInterruptHandlers[4] = {0,0,0,0};
+// timers whose interrupt goes to each core, the handlers run on the core that attached them
+static volatile uint8_t __timerCoreMask[portNUM_PROCESSORS] = {0};
 
 void IRAM_ATTR __timerISR(void * arg){
-    uint32_t s0 = TIMERG0.int_st_timers.val;
-    uint32_t s1 = TIMERG1.int_st_timers.val;
+    uint8_t mask = __timerCoreMask[(uint32_t)arg];
+    uint32_t s0 = TIMERG0.int_st_timers.val & (mask & 3);
+    uint32_t s1 = TIMERG1.int_st_timers.val & ((mask >> 2) & 3);
     TIMERG0.int_clr_timers.val = s0;
     TIMERG1.int_clr_timers.val = s1;
     uint8_t status = (s1 & 3) << 2 | (s0 & 3);
@@ -185,15 +188,22 @@ bool IRAM_ATTR timerAlarmEnabled(hw_timer_t *timer){
     return timer->dev->config.alarm_en;
 }
 
+// divider field of the config register
+#define HWTIMER_DIVIDER_S   13
+#define HWTIMER_DIVIDER_M   (0xFFFF << HWTIMER_DIVIDER_S)
+#define HWTIMER_ENABLE_M    (1UL << 31)
+
 static void IRAM_ATTR _on_apb_change(void * arg, apb_change_ev_t ev_type, uint32_t old_apb, uint32_t new_apb){
     hw_timer_t * timer = (hw_timer_t *)arg;
     if(ev_type == APB_BEFORE_CHANGE){
-        timer->dev->config.enable = 0;
-    } else {
+        // the timer only stops for the few cycles of the clock switch
+        uint32_t enabled = timer->dev->config.val & HWTIMER_ENABLE_M;
         old_apb /= 1000000;
         new_apb /= 1000000;
-        timer->dev->config.divider = (new_apb * timer->dev->config.divider) / old_apb;
-        timer->dev->config.enable = 1;
+        uint32_t divider = (new_apb * timer->dev->config.divider) / old_apb;
+        apbChangeQueueWrite(&timer->dev->config.val, HWTIMER_ENABLE_M, 0);
+        apbChangeQueueWrite(&timer->dev->config.val, HWTIMER_DIVIDER_M, divider << HWTIMER_DIVIDER_S);
+        apbChangeQueueWrite(&timer->dev->config.val, HWTIMER_ENABLE_M, enabled);
     }
 }
 
@@ -229,11 +239,15 @@ void IRAM_ATTR timerEnd(hw_timer_t *timer){
 }
 
 void IRAM_ATTR timerAttachInterrupt(hw_timer_t *timer, void (*fn)(void), bool edge){
-    static bool initialized = false;
-    static intr_handle_t intr_handle = NULL;
+    static intr_handle_t intr_handles[portNUM_PROCESSORS] = {NULL};
+    uint32_t core = xPortGetCoreID();
+    intr_handle_t intr_handle = intr_handles[core];
     if(intr_handle){
         esp_intr_disable(intr_handle);
     }
+    for(int i = 0; i < portNUM_PROCESSORS; i++){
+        __timerCoreMask[i] &= ~BIT(timer->num);
+    }
     if(fn == NULL){
         timer->dev->config.level_int_en = 0;
         timer->dev->config.edge_int_en = 0;
@@ -262,12 +276,13 @@ void IRAM_ATTR timerAttachInterrupt(hw_timer_t *timer, void (*fn)(void), bool ed
                 intr_source = ETS_TG0_T0_EDGE_INTR_SOURCE + timer->timer;
             }
         }
-        if(!initialized){
-            initialized = true;
-            esp_intr_alloc(intr_source, (int)(ESP_INTR_FLAG_IRAM|ESP_INTR_FLAG_LOWMED|ESP_INTR_FLAG_EDGE), __timerISR, NULL, &intr_handle);
+        if(!intr_handle){
+            esp_intr_alloc(intr_source, (int)(ESP_INTR_FLAG_IRAM|ESP_INTR_FLAG_LOWMED|ESP_INTR_FLAG_EDGE), __timerISR, (void *)core, &intr_handles[core]);
+            intr_handle = intr_handles[core];
         } else {
-            intr_matrix_set(esp_intr_get_cpu(intr_handle), intr_source, esp_intr_get_intno(intr_handle));
+            intr_matrix_set(core, intr_source, esp_intr_get_intno(intr_handle));
         }
+        __timerCoreMask[core] |= BIT(timer->num);
         if(timer->group){
             TIMERG1.int_ena.val |= BIT(timer->timer);
         } else {
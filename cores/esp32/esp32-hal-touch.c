@@ -77,6 +77,22 @@ void __touchInit()
     esp_intr_alloc(ETS_RTC_CORE_INTR_SOURCE, (int)ESP_INTR_FLAG_IRAM, __touchISR, NULL, &touch_intr_handle);
 }
 
+static void __touchConfigPad(int8_t pad)
+{
+    uint32_t rtc_tio_reg = RTC_IO_TOUCH_PAD0_REG + pad * 4;
+    WRITE_PERI_REG(rtc_tio_reg, (READ_PERI_REG(rtc_tio_reg)
+                      & ~(RTC_IO_TOUCH_PAD0_DAC_M))
+                      | (7 << RTC_IO_TOUCH_PAD0_DAC_S)//Touch Set Slope
+                      | RTC_IO_TOUCH_PAD0_TIE_OPT_M   //Enable Tie,Init Level
+                      | RTC_IO_TOUCH_PAD0_START_M     //Enable Touch Pad IO
+                      | RTC_IO_TOUCH_PAD0_XPD_M);     //Enable Touch Pad Power on
+}
+
+static uint16_t __touchValue(int8_t pad)
+{
+    return READ_PERI_REG(SENS_SAR_TOUCH_OUT1_REG + (pad / 2) * 4) >> ((pad & 1) ? SENS_TOUCH_MEAS_OUT1_S : SENS_TOUCH_MEAS_OUT0_S);
+}
+
 uint16_t __touchRead(uint8_t pin)
 {
     int8_t pad = digitalPinToTouchChannel(pin);
@@ -96,13 +112,7 @@ uint16_t __touchRead(uint8_t pin)
 
     SET_PERI_REG_MASK(SENS_SAR_TOUCH_ENABLE_REG, (1 << (pad + SENS_TOUCH_PAD_WORKEN_S)));
 
-    uint32_t rtc_tio_reg = RTC_IO_TOUCH_PAD0_REG + pad * 4;
-    WRITE_PERI_REG(rtc_tio_reg, (READ_PERI_REG(rtc_tio_reg)
-                      & ~(RTC_IO_TOUCH_PAD0_DAC_M))
-                      | (7 << RTC_IO_TOUCH_PAD0_DAC_S)//Touch Set Slope
-                      | RTC_IO_TOUCH_PAD0_TIE_OPT_M   //Enable Tie,Init Level
-                      | RTC_IO_TOUCH_PAD0_START_M     //Enable Touch Pad IO
-                      | RTC_IO_TOUCH_PAD0_XPD_M);     //Enable Touch Pad Power on
+    __touchConfigPad(pad);
 
     //force oneTime test start
     SET_PERI_REG_MASK(SENS_SAR_TOUCH_CTRL2_REG, SENS_TOUCH_START_EN_M|SENS_TOUCH_START_FORCE_M);
@@ -111,7 +121,7 @@ uint16_t __touchRead(uint8_t pin)
 
     while (GET_PERI_REG_MASK(SENS_SAR_TOUCH_CTRL2_REG, SENS_TOUCH_MEAS_DONE) == 0) {};
 
-    uint16_t touch_value = READ_PERI_REG(SENS_SAR_TOUCH_OUT1_REG + (pad / 2) * 4) >> ((pad & 1) ? SENS_TOUCH_MEAS_OUT1_S : SENS_TOUCH_MEAS_OUT0_S);
+    uint16_t touch_value = __touchValue(pad);
 
     //clear touch force ,select the Touch mode is Timer
     CLEAR_PERI_REG_MASK(SENS_SAR_TOUCH_CTRL2_REG, SENS_TOUCH_START_EN_M|SENS_TOUCH_START_FORCE_M);
@@ -148,13 +158,7 @@ void __touchAttachInterrupt(uint8_t pin, void (*userFunc)(void), uint16_t thresh
     uint8_t shift = (pad & 1) ? SENS_TOUCH_OUT_TH1_S : SENS_TOUCH_OUT_TH0_S;
     SET_PERI_REG_BITS((SENS_SAR_TOUCH_THRES1_REG + (pad / 2) * 4), SENS_TOUCH_OUT_TH0, threshold, shift);
 
-    uint32_t rtc_tio_reg = RTC_IO_TOUCH_PAD0_REG + pad * 4;
-    WRITE_PERI_REG(rtc_tio_reg, (READ_PERI_REG(rtc_tio_reg)
-                      & ~(RTC_IO_TOUCH_PAD0_DAC_M))
-                      | (7 << RTC_IO_TOUCH_PAD0_DAC_S)//Touch Set Slope
-                      | RTC_IO_TOUCH_PAD0_TIE_OPT_M   //Enable Tie,Init Level
-                      | RTC_IO_TOUCH_PAD0_START_M     //Enable Touch Pad IO
-                      | RTC_IO_TOUCH_PAD0_XPD_M);     //Enable Touch Pad Power on
+    __touchConfigPad(pad);
 
     //Enable Digital rtc control :work mode and out mode
     SET_PERI_REG_MASK(SENS_SAR_TOUCH_ENABLE_REG,
@@ -163,6 +167,198 @@ void __touchAttachInterrupt(uint8_t pin, void (*userFunc)(void), uint16_t thresh
                       (1 << (pad + SENS_TOUCH_PAD_OUTEN1_S)));
 }
 
+#ifndef TOUCH_TASK_STACK_SIZE
+#define TOUCH_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef TOUCH_TASK_PRIORITY
+#define TOUCH_TASK_PRIORITY 2
+#endif
+
+#ifndef TOUCH_TASK_RUNNING_CORE
+#define TOUCH_TASK_RUNNING_CORE -1
+#endif
+
+#define TOUCH_PADS              10
+#define TOUCH_FILTER_SHIFT      2   // value follows the readings by 1/4
+#define TOUCH_BASELINE_SHIFT    6   // baseline follows the released value by 1/64
+#define TOUCH_CALIBRATE_SCANS   8   // baseline taken from the value at first
+
+typedef struct {
+    touch_event_cb_t cb;
+    void * arg;
+    uint32_t value;         // << TOUCH_BASELINE_SHIFT, so both filters keep their fraction
+    uint32_t baseline;
+    uint8_t pin;
+    uint8_t percent;
+    uint8_t scans;
+    bool used;
+    bool pressed;
+} touch_scan_pad_t;
+
+static touch_scan_pad_t __touchScanPads[TOUCH_PADS];
+static TaskHandle_t __touchScanTask = NULL;
+static volatile bool __touchScanRunning = false;
+static uint32_t __touchScanInterval = 20;
+static portMUX_TYPE __touchScanMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void __touchScanPad(int8_t pad, touch_scan_pad_t * p)
+{
+    uint32_t raw = (uint32_t)__touchValue(pad) << TOUCH_BASELINE_SHIFT;
+    bool changed = false;
+    portENTER_CRITICAL(&__touchScanMux);
+    if(!p->used) {
+        portEXIT_CRITICAL(&__touchScanMux);
+        return;
+    }
+    if(p->scans < TOUCH_CALIBRATE_SCANS) {
+        p->value = p->baseline = p->scans ? ((p->value + raw) / 2) : raw;
+        p->scans++;
+        portEXIT_CRITICAL(&__touchScanMux);
+        return;
+    }
+    p->value = p->value + (raw >> TOUCH_FILTER_SHIFT) - (p->value >> TOUCH_FILTER_SHIFT);
+    // pressed below the threshold, released above half of it
+    uint32_t press = p->baseline - (p->baseline / 100) * p->percent;
+    uint32_t release = p->baseline - (p->baseline / 200) * p->percent;
+    if(!p->pressed && p->value < press) {
+        p->pressed = changed = true;
+    } else if(p->pressed && p->value > release) {
+        p->pressed = false;
+        changed = true;
+    }
+    if(!p->pressed) {
+        // tracks drift in temperature and humidity, not a touch
+        p->baseline = p->baseline + (p->value >> TOUCH_BASELINE_SHIFT) - (p->baseline >> TOUCH_BASELINE_SHIFT);
+    }
+    touch_event_cb_t cb = p->cb;
+    void * arg = p->arg;
+    bool pressed = p->pressed;
+    uint8_t pin = p->pin;
+    portEXIT_CRITICAL(&__touchScanMux);
+    if(changed && cb) {
+        cb(arg, pin, pressed);
+    }
+}
+
+static void __touchScanTaskFn(void * arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    while(__touchScanRunning) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(__touchScanInterval) ? pdMS_TO_TICKS(__touchScanInterval) : 1);
+        for(int8_t pad = 0; pad < TOUCH_PADS; pad++) {
+            __touchScanPad(pad, &__touchScanPads[pad]);
+        }
+    }
+    __touchScanTask = NULL;
+    vTaskDelete(NULL);
+}
+
+bool __touchScanBegin(uint32_t interval_ms)
+{
+    __touchScanInterval = interval_ms;
+    if(__touchScanTask) {
+        return true;
+    }
+    __touchInit();
+    //clear touch force ,select the Touch mode is Timer
+    CLEAR_PERI_REG_MASK(SENS_SAR_TOUCH_CTRL2_REG, SENS_TOUCH_START_EN_M|SENS_TOUCH_START_FORCE_M);
+    __touchScanRunning = true;
+    if(xTaskCreateUniversal(__touchScanTaskFn, "touch", TOUCH_TASK_STACK_SIZE, NULL, TOUCH_TASK_PRIORITY, &__touchScanTask, TOUCH_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("touch task create failed");
+        __touchScanRunning = false;
+        __touchScanTask = NULL;
+        return false;
+    }
+    return true;
+}
+
+void __touchScanEnd(void)
+{
+    __touchScanRunning = false;
+    if(xTaskGetCurrentTaskHandle() == __touchScanTask) {
+        // from a callback, the task ends after it
+        return;
+    }
+    while(__touchScanTask) {
+        vTaskDelay(1);
+    }
+}
+
+bool __touchScanAttach(uint8_t pin, uint8_t percent, touch_event_cb_t cb, void * arg)
+{
+    int8_t pad = digitalPinToTouchChannel(pin);
+    if(pad < 0 || !percent || percent >= 100){
+        return false;
+    }
+    pinMode(pin, ANALOG);
+    __touchInit();
+    touch_scan_pad_t * p = &__touchScanPads[pad];
+    portENTER_CRITICAL(&__touchScanMux);
+    p->cb = cb;
+    p->arg = arg;
+    p->pin = pin;
+    p->percent = percent;
+    p->scans = 0;
+    p->pressed = false;
+    p->used = true;
+    portEXIT_CRITICAL(&__touchScanMux);
+    __touchConfigPad(pad);
+    //measured by the timer FSM
+    SET_PERI_REG_MASK(SENS_SAR_TOUCH_ENABLE_REG, (1 << (pad + SENS_TOUCH_PAD_WORKEN_S)));
+    return true;
+}
+
+void __touchScanDetach(uint8_t pin)
+{
+    int8_t pad = digitalPinToTouchChannel(pin);
+    if(pad < 0){
+        return;
+    }
+    portENTER_CRITICAL(&__touchScanMux);
+    __touchScanPads[pad].used = false;
+    __touchScanPads[pad].cb = NULL;
+    portEXIT_CRITICAL(&__touchScanMux);
+    if(!__touchInterruptHandlers[pad]) {
+        CLEAR_PERI_REG_MASK(SENS_SAR_TOUCH_ENABLE_REG, (1 << (pad + SENS_TOUCH_PAD_WORKEN_S)));
+    }
+}
+
+static uint32_t __touchScanField(uint8_t pin, bool baseline)
+{
+    int8_t pad = digitalPinToTouchChannel(pin);
+    if(pad < 0 || !__touchScanPads[pad].used){
+        return 0;
+    }
+    portENTER_CRITICAL(&__touchScanMux);
+    uint32_t v = baseline ? __touchScanPads[pad].baseline : __touchScanPads[pad].value;
+    portEXIT_CRITICAL(&__touchScanMux);
+    return v >> TOUCH_BASELINE_SHIFT;
+}
+
+uint16_t __touchScanValue(uint8_t pin)
+{
+    return __touchScanField(pin, false);
+}
+
+uint16_t __touchScanBaseline(uint8_t pin)
+{
+    return __touchScanField(pin, true);
+}
+
+bool __touchScanPressed(uint8_t pin)
+{
+    int8_t pad = digitalPinToTouchChannel(pin);
+    return pad >= 0 && __touchScanPads[pad].used && __touchScanPads[pad].pressed;
+}
+
 extern uint16_t touchRead(uint8_t pin) __attribute__ ((weak, alias("__touchRead")));
 extern void touchAttachInterrupt(uint8_t pin, void (*userFunc)(void), uint16_t threshold) __attribute__ ((weak, alias("__touchAttachInterrupt")));
 extern void touchSetCycles(uint16_t measure, uint16_t sleep) __attribute__ ((weak, alias("__touchSetCycles")));
+extern bool touchScanBegin(uint32_t interval_ms) __attribute__ ((weak, alias("__touchScanBegin")));
+extern void touchScanEnd(void) __attribute__ ((weak, alias("__touchScanEnd")));
+extern bool touchScanAttach(uint8_t pin, uint8_t percent, touch_event_cb_t cb, void * arg) __attribute__ ((weak, alias("__touchScanAttach")));
+extern void touchScanDetach(uint8_t pin) __attribute__ ((weak, alias("__touchScanDetach")));
+extern uint16_t touchScanValue(uint8_t pin) __attribute__ ((weak, alias("__touchScanValue")));
+extern uint16_t touchScanBaseline(uint8_t pin) __attribute__ ((weak, alias("__touchScanBaseline")));
+extern bool touchScanPressed(uint8_t pin) __attribute__ ((weak, alias("__touchScanPressed")));
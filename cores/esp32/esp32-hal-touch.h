@@ -44,6 +44,23 @@ uint16_t touchRead(uint8_t pin);
  * */
 void touchAttachInterrupt(uint8_t pin, void (*userFunc)(void), uint16_t threshold);
 
+/*
+ * Scan the attached pads in the background: the touch FSM measures them
+ * on its timer, a task filters the values every interval_ms and tracks
+ * each pad's untouched baseline, so slow drift doesn't need a new threshold.
+ * A pad is pressed when its value is percent below the baseline
+ * and released above half of that; the callback runs in the task
+ * */
+typedef void (*touch_event_cb_t)(void * arg, uint8_t pin, bool pressed);
+
+bool touchScanBegin(uint32_t interval_ms);
+void touchScanEnd(void);
+bool touchScanAttach(uint8_t pin, uint8_t percent, touch_event_cb_t cb, void * arg);
+void touchScanDetach(uint8_t pin);
+uint16_t touchScanValue(uint8_t pin);
+uint16_t touchScanBaseline(uint8_t pin);
+bool touchScanPressed(uint8_t pin);
+
 #ifdef __cplusplus
 }
 #endif
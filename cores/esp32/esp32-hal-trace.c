@@ -0,0 +1,264 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-trace.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_ipc.h"
+#include "esp_timer.h"
+#include <string.h>
+
+#define TRACE_SYNC_CYCLES (1UL << 30)   // the converter takes deltas from a sync as signed 32 bit
+#define TRACE_DUMP_VERSION 1
+
+typedef struct {
+    uint32_t task;
+    char name[configMAX_TASK_NAME_LEN];
+} trace_task_t;
+
+typedef struct {
+    trace_event_t * events;
+    uint32_t mask;
+    uint32_t head;              // events reserved since traceBegin(), atomically
+    uint32_t syncCcount;
+    uint32_t lastTask;
+    uint8_t taskCount;
+    trace_task_t tasks[TRACE_MAX_TASKS];
+    portMUX_TYPE mux;           // the task table only
+} trace_ring_t;
+
+typedef struct {
+    uint16_t id;
+    const char * name;
+} trace_name_t;
+
+static trace_ring_t * _trace_rings[portNUM_PROCESSORS];
+static volatile bool _trace_on = false;
+static trace_name_t _trace_names[TRACE_MAX_NAMES];
+static uint8_t _trace_name_count = 0;
+static portMUX_TYPE _trace_names_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t IRAM_ATTR _trace_ccount(void)
+{
+    uint32_t ccount;
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));
+    return ccount;
+}
+
+static inline void IRAM_ATTR _trace_put(trace_ring_t * ring, uint16_t id, uint8_t type, bool isr, uint32_t task, uint32_t value)
+{
+    uint32_t pos = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_event_t * e = &ring->events[pos & ring->mask];
+    e->ccount = _trace_ccount();
+    e->id = id;
+    e->type = type;
+    e->isr = isr;
+    e->task = task;
+    e->value = value;
+}
+
+static void IRAM_ATTR _trace_sync(trace_ring_t * ring, bool isr)
+{
+    uint64_t now = esp_timer_get_time();
+    ring->syncCcount = _trace_ccount();
+    _trace_put(ring, TRACE_ID_SYNC, TRACE_EVENT_INSTANT, isr, (uint32_t)(now >> 32), (uint32_t)now);
+}
+
+// only when the task changed, the names are looked up in the dump
+static void _trace_note_task(trace_ring_t * ring, uint32_t task)
+{
+    portENTER_CRITICAL(&ring->mux);
+    ring->lastTask = task;
+    bool known = false;
+    for(uint8_t i = 0; i < ring->taskCount && !known; i++) {
+        known = ring->tasks[i].task == task;
+    }
+    if(!known && ring->taskCount < TRACE_MAX_TASKS) {
+        trace_task_t * t = &ring->tasks[ring->taskCount++];
+        t->task = task;
+        strncpy(t->name, pcTaskGetTaskName((TaskHandle_t)task), sizeof(t->name) - 1);
+        t->name[sizeof(t->name) - 1] = 0;
+    }
+    portEXIT_CRITICAL(&ring->mux);
+}
+
+void IRAM_ATTR traceRecord(uint16_t id, uint8_t type, uint32_t value)
+{
+    if(!_trace_on) {
+        return;
+    }
+    trace_ring_t * ring = _trace_rings[xPortGetCoreID()];
+    bool isr = xPortInIsrContext();
+    uint32_t task = isr ? 0 : (uint32_t)xTaskGetCurrentTaskHandle();
+    if(task && task != ring->lastTask) {
+        _trace_note_task(ring, task);
+    }
+    if(_trace_ccount() - ring->syncCcount >= TRACE_SYNC_CYCLES) {
+        _trace_sync(ring, isr);
+    }
+    _trace_put(ring, id, type, isr, task, value);
+}
+
+// on each core for its own CCOUNT
+static void _trace_sync_ipc(void * arg)
+{
+    _trace_sync((trace_ring_t *)arg, false);
+}
+
+static void _trace_free(void)
+{
+    for(int core = 0; core < portNUM_PROCESSORS; core++) {
+        if(_trace_rings[core]) {
+            free(_trace_rings[core]->events);
+            free(_trace_rings[core]);
+            _trace_rings[core] = NULL;
+        }
+    }
+}
+
+bool traceBegin(size_t eventsPerCore)
+{
+    if(_trace_rings[0]) {
+        log_w("trace already running");
+        return false;
+    }
+    size_t events = 1;
+    while(events < (eventsPerCore ? eventsPerCore : TRACE_DEFAULT_EVENTS)) {
+        events <<= 1;
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_ring_t * ring = (trace_ring_t *)heap_caps_calloc(1, sizeof(trace_ring_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if(ring) {
+            ring->events = (trace_event_t *)heap_caps_calloc(events, sizeof(trace_event_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        _trace_rings[core] = ring;
+        if(!ring || !ring->events) {
+            log_e("could not allocate %u trace events", events);
+            _trace_free();
+            return false;
+        }
+        ring->mask = events - 1;
+        ring->mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    }
+    traceName(TRACE_ID_LOOP, "loop");
+    traceName(TRACE_ID_UART_ISR, "uart_isr");
+    traceName(TRACE_ID_I2C_QUEUE, "i2cProcQueue");
+    traceName(TRACE_ID_I2C_WAIT, "i2c_wait");
+    traceName(TRACE_ID_UDP_DISPATCH, "udp_dispatch");
+    traceName(TRACE_ID_TCP_DISPATCH, "tcp_dispatch");
+    traceName(TRACE_ID_WIFI_EVENT, "wifi_event");
+    traceEnable(true);
+    return true;
+}
+
+void traceEnd(void)
+{
+    _trace_on = false;
+    // a record under way on the other core is done within a few cycles
+    delay(1);
+    _trace_free();
+}
+
+void traceEnable(bool enable)
+{
+    if(!_trace_rings[0] || enable == _trace_on) {
+        return;
+    }
+    if(enable) {
+        // a fresh sync, the time could have gone past what 32 bits of CCOUNT cover
+        for(int core = 0; core < portNUM_PROCESSORS; core++) {
+            esp_ipc_call_blocking(core, _trace_sync_ipc, _trace_rings[core]);
+        }
+    }
+    _trace_on = enable;
+}
+
+bool traceEnabled(void)
+{
+    return _trace_on;
+}
+
+void traceName(uint16_t id, const char * name)
+{
+    portENTER_CRITICAL(&_trace_names_mux);
+    uint8_t i = 0;
+    while(i < _trace_name_count && _trace_names[i].id != id) {
+        i++;
+    }
+    if(i < TRACE_MAX_NAMES) {
+        _trace_names[i].id = id;
+        _trace_names[i].name = name;
+        if(i == _trace_name_count) {
+            _trace_name_count++;
+        }
+    }
+    portEXIT_CRITICAL(&_trace_names_mux);
+}
+
+static size_t _trace_write_string(trace_write_cb write, void * ctx, const char * s)
+{
+    uint8_t len = strnlen(s, 255);
+    return write(ctx, &len, 1) + write(ctx, (const uint8_t *)s, len);
+}
+
+/*
+ * Little endian:
+ *   "ESPT", version (1), cores (1), CPU MHz (2), names (2)
+ *   per name: id (2), length (1), bytes
+ *   per core: events (4), tasks (1), per task: handle (4), length (1), bytes;
+ *             then the events, oldest first, as trace_event_t
+ */
+size_t traceDump(trace_write_cb write, void * ctx)
+{
+    if(!_trace_rings[0] || !write) {
+        return 0;
+    }
+    bool enabled = _trace_on;
+    _trace_on = false;
+    delay(1);
+    size_t n = 0;
+    uint8_t header[10] = { 'E', 'S', 'P', 'T', TRACE_DUMP_VERSION, portNUM_PROCESSORS };
+    uint16_t mhz = getCpuFrequencyMhz();
+    uint16_t names = _trace_name_count;
+    memcpy(header + 6, &mhz, 2);
+    memcpy(header + 8, &names, 2);
+    n += write(ctx, header, sizeof(header));
+    for(uint8_t i = 0; i < names; i++) {
+        n += write(ctx, (const uint8_t *)&_trace_names[i].id, 2);
+        n += _trace_write_string(write, ctx, _trace_names[i].name);
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_ring_t * ring = _trace_rings[core];
+        uint32_t size = ring->mask + 1;
+        uint32_t count = (ring->head < size) ? ring->head : size;
+        uint32_t first = ring->head - count;
+        n += write(ctx, (const uint8_t *)&count, 4);
+        n += write(ctx, &ring->taskCount, 1);
+        for(uint8_t i = 0; i < ring->taskCount; i++) {
+            n += write(ctx, (const uint8_t *)&ring->tasks[i].task, 4);
+            n += _trace_write_string(write, ctx, ring->tasks[i].name);
+        }
+        // in at most two pieces, where the ring wraps
+        uint32_t start = first & ring->mask;
+        uint32_t part = (count < size - start) ? count : size - start;
+        n += write(ctx, (const uint8_t *)&ring->events[start], part * sizeof(trace_event_t));
+        n += write(ctx, (const uint8_t *)ring->events, (count - part) * sizeof(trace_event_t));
+    }
+    if(enabled) {
+        traceEnable(true);
+    }
+    return n;
+}
@@ -0,0 +1,108 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_TRACE_H_
+#define _ESP32_HAL_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Timeline of trace points, for tools/trace2json.py to turn into a trace
+ * Chrome and Perfetto open. The points of the core and the libraries compile
+ * to nothing unless ARDUINO_TRACE is 1 in the build flags, traceRecord() can
+ * be called in any case. Each core records into its own ring, from tasks and
+ * interrupts alike, without taking a lock; the ring keeps the newest events,
+ * traceEnable(false) freezes it at the moment of interest for traceDump().
+ * Events carry the CCOUNT of the core, tied to esp_timer by a sync event
+ * written whenever 2^30 cycles have passed since the last one.
+ */
+#ifndef ARDUINO_TRACE
+#define ARDUINO_TRACE 0
+#endif
+
+#ifndef TRACE_DEFAULT_EVENTS
+#define TRACE_DEFAULT_EVENTS 1024 // per core, 16 bytes each
+#endif
+
+#ifndef TRACE_MAX_NAMES
+#define TRACE_MAX_NAMES 32 // ids given a name with traceName(), those of the core included
+#endif
+
+#ifndef TRACE_MAX_TASKS
+#define TRACE_MAX_TASKS 24 // task names kept per core for the dump
+#endif
+
+// ids of the core and the libraries, a sketch numbers its own from TRACE_ID_USER
+enum {
+    TRACE_ID_SYNC = 0,          // CCOUNT against esp_timer, written by the ring itself
+    TRACE_ID_LOOP,              // loop()
+    TRACE_ID_UART_ISR,
+    TRACE_ID_I2C_QUEUE,         // i2cProcQueue() with the bus locked
+    TRACE_ID_I2C_WAIT,          // blocked until the ISR finished the transaction
+    TRACE_ID_UDP_DISPATCH,      // async_udp task handing a packet to AsyncUDP
+    TRACE_ID_TCP_DISPATCH,      // async_tcp task handling an event of lwIP
+    TRACE_ID_WIFI_EVENT,        // instant, the value is the system_event_id_t
+    TRACE_ID_USER = 0x100
+};
+
+typedef enum {
+    TRACE_EVENT_BEGIN,
+    TRACE_EVENT_END,
+    TRACE_EVENT_INSTANT
+} trace_event_type_t;
+
+typedef struct {
+    uint32_t ccount;
+    uint16_t id;
+    uint8_t  type;      // trace_event_type_t
+    uint8_t  isr;       // recorded in an interrupt
+    uint32_t task;      // TaskHandle_t, 0 in an interrupt; for a sync the upper half of esp_timer
+    uint32_t value;     // of TRACE_INSTANT(); for a sync the lower half of esp_timer
+} trace_event_t;
+
+#if ARDUINO_TRACE
+#define TRACE_BEGIN(id)             traceRecord((id), TRACE_EVENT_BEGIN, 0)
+#define TRACE_END(id)               traceRecord((id), TRACE_EVENT_END, 0)
+#define TRACE_INSTANT(id, value)    traceRecord((id), TRACE_EVENT_INSTANT, (uint32_t)(value))
+#else
+#define TRACE_BEGIN(id)             do {} while(0)
+#define TRACE_END(id)               do {} while(0)
+#define TRACE_INSTANT(id, value)    do {} while(0)
+#endif
+
+// eventsPerCore 0 uses TRACE_DEFAULT_EVENTS, rounded up to a power of two; recording starts
+bool traceBegin(size_t eventsPerCore);
+void traceEnd(void);
+void traceEnable(bool enable);
+bool traceEnabled(void);
+
+// name shown for id, the string has to stay valid
+void traceName(uint16_t id, const char * name);
+void traceRecord(uint16_t id, uint8_t type, uint32_t value);
+
+typedef size_t (*trace_write_cb)(void * ctx, const uint8_t * data, size_t len);
+// the binary trace through write, recording paused meanwhile; returns the bytes written
+size_t traceDump(trace_write_cb write, void * ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_TRACE_H_ */
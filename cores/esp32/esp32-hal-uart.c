@@ -16,7 +16,6 @@
 #include "esp32-hal.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "rom/ets_sys.h"
 #include "esp_attr.h"
@@ -29,6 +28,8 @@
 #include "soc/dport_reg.h"
 #include "soc/rtc.h"
 #include "esp_intr_alloc.h"
+#include "esp_ipc.h"
+#include "esp_timer.h"
 
 #define UART_REG_BASE(u)    ((u==0)?DR_REG_UART_BASE:(      (u==1)?DR_REG_UART1_BASE:(    (u==2)?DR_REG_UART2_BASE:0)))
 #define UART_RXD_IDX(u)     ((u==0)?U0RXD_IN_IDX:(          (u==1)?U1RXD_IN_IDX:(         (u==2)?U2RXD_IN_IDX:0)))
@@ -37,14 +38,36 @@
 
 static int s_uart_debug_nr = 0;
 
+/*
+ * Single producer / single consumer byte ring.
+ * The producer (the UART ISR) only moves head and the consumer (the reading task) only moves tail,
+ * so neither side needs a lock. Indexes are free running and size is a power of two.
+ */
+typedef struct {
+    uint8_t * buf;
+    size_t size;
+    volatile size_t head;
+    volatile size_t tail;
+} uart_ring_t;
+
 struct uart_struct_t {
     uart_dev_t * dev;
 #if !CONFIG_DISABLE_HAL_LOCKS
     xSemaphoreHandle lock;
 #endif
     uint8_t num;
-    xQueueHandle queue;
     intr_handle_t intr_handle;
+    portMUX_TYPE spinlock;
+    int8_t intr_core;
+    uint8_t rx_fifo_full_thrhd;
+    uint8_t rx_tout_thrhd;
+    uart_ring_t rx_ring;
+    volatile TaskHandle_t rx_task;
+    uart_ring_t tx_ring;
+    volatile TaskHandle_t tx_task;
+    volatile bool rx_timeout_pending;
+    volatile size_t rx_timeout_count;
+    volatile int64_t rx_timeout_time;
 };
 
 #if CONFIG_DISABLE_HAL_LOCKS
@@ -52,62 +75,204 @@ struct uart_struct_t {
 #define UART_MUTEX_UNLOCK()
 
 static uart_t _uart_bus_array[3] = {
-    {(volatile uart_dev_t *)(DR_REG_UART_BASE), 0, NULL, NULL},
-    {(volatile uart_dev_t *)(DR_REG_UART1_BASE), 1, NULL, NULL},
-    {(volatile uart_dev_t *)(DR_REG_UART2_BASE), 2, NULL, NULL}
+    {(volatile uart_dev_t *)(DR_REG_UART_BASE), 0, NULL, portMUX_INITIALIZER_UNLOCKED, -1},
+    {(volatile uart_dev_t *)(DR_REG_UART1_BASE), 1, NULL, portMUX_INITIALIZER_UNLOCKED, -1},
+    {(volatile uart_dev_t *)(DR_REG_UART2_BASE), 2, NULL, portMUX_INITIALIZER_UNLOCKED, -1}
 };
 #else
 #define UART_MUTEX_LOCK()    do {} while (xSemaphoreTake(uart->lock, portMAX_DELAY) != pdPASS)
 #define UART_MUTEX_UNLOCK()  xSemaphoreGive(uart->lock)
 
 static uart_t _uart_bus_array[3] = {
-    {(volatile uart_dev_t *)(DR_REG_UART_BASE), NULL, 0, NULL, NULL},
-    {(volatile uart_dev_t *)(DR_REG_UART1_BASE), NULL, 1, NULL, NULL},
-    {(volatile uart_dev_t *)(DR_REG_UART2_BASE), NULL, 2, NULL, NULL}
+    {(volatile uart_dev_t *)(DR_REG_UART_BASE), NULL, 0, NULL, portMUX_INITIALIZER_UNLOCKED, -1},
+    {(volatile uart_dev_t *)(DR_REG_UART1_BASE), NULL, 1, NULL, portMUX_INITIALIZER_UNLOCKED, -1},
+    {(volatile uart_dev_t *)(DR_REG_UART2_BASE), NULL, 2, NULL, portMUX_INITIALIZER_UNLOCKED, -1}
 };
 #endif
 
+#define UART_RX_FIFO_NOT_EMPTY(u) ((u)->dev->status.rxfifo_cnt || ((u)->dev->mem_rx_status.wr_addr != (u)->dev->mem_rx_status.rd_addr))
+#define UART_TX_FIFO_FULL               0x7F
+#define UART_TX_FIFO_EMPTY_THRHD        16
+#define UART_RX_FIFO_FULL_THRHD_DEFAULT 112
+#define UART_RX_TOUT_THRHD_DEFAULT      2
+
 static void uart_on_apb_change(void * arg, apb_change_ev_t ev_type, uint32_t old_apb, uint32_t new_apb);
 
-static void IRAM_ATTR _uart_isr(void *arg)
+static inline size_t IRAM_ATTR uart_ring_count(const uart_ring_t * ring)
 {
-    uint8_t i, c;
-    BaseType_t xHigherPriorityTaskWoken;
-    uart_t* uart;
+    return ring->head - ring->tail;
+}
 
-    for(i=0;i<3;i++){
-        uart = &_uart_bus_array[i];
-        if(uart->intr_handle == NULL){
-            continue;
+static uint8_t * uart_ring_alloc(size_t len, size_t * size)
+{
+    *size = 1;
+    while(*size < len) {
+        *size <<= 1;
+    }
+    return (uint8_t *)malloc(*size);
+}
+
+// Installs a new backing buffer and returns the previous one, pending data is discarded.
+// Must be called with uart->spinlock taken.
+static uint8_t * uart_ring_swap(uart_ring_t * ring, uint8_t * buf, size_t size)
+{
+    uint8_t * old_buf = ring->buf;
+    ring->buf = buf;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    return old_buf;
+}
+
+// Moves everything the hardware holds into the RX ring with a single head update.
+// Must be called with uart->spinlock taken. Bytes that do not fit are dropped.
+static size_t IRAM_ATTR uart_rx_fifo_drain(uart_t* uart)
+{
+    uart_ring_t * ring = &uart->rx_ring;
+    size_t head = ring->head;
+    size_t room = ring->size - (head - ring->tail);
+    size_t mask = ring->size - 1;
+    size_t count = 0;
+    uint8_t c;
+
+    while(UART_RX_FIFO_NOT_EMPTY(uart)) {
+        uint32_t fifo_cnt = uart->dev->status.rxfifo_cnt;
+        if(!fifo_cnt) {
+            fifo_cnt = 1;
         }
-        uart->dev->int_clr.rxfifo_full = 1;
-        uart->dev->int_clr.frm_err = 1;
-        uart->dev->int_clr.rxfifo_tout = 1;
-        while(uart->dev->status.rxfifo_cnt || (uart->dev->mem_rx_status.wr_addr != uart->dev->mem_rx_status.rd_addr)) {
+        while(fifo_cnt--) {
             c = uart->dev->fifo.rw_byte;
-            if(uart->queue != NULL)  {
-                xQueueSendFromISR(uart->queue, &c, &xHigherPriorityTaskWoken);
+            if(count < room) {
+                ring->buf[(head + count) & mask] = c;
+                count++;
             }
         }
     }
+    ring->head = head + count;
+    return count;
+}
+
+// Copies as much as fits into the ring with a single head update, returns the amount copied.
+static size_t uart_ring_write(uart_ring_t * ring, const uint8_t * data, size_t len)
+{
+    size_t head = ring->head;
+    size_t room = ring->size - (head - ring->tail);
+    if(len > room) {
+        len = room;
+    }
+    size_t offset = head & (ring->size - 1);
+    size_t first = ring->size - offset;
+    if(first > len) {
+        first = len;
+    }
+    memcpy(ring->buf + offset, data, first);
+    memcpy(ring->buf, data + first, len - first);
+    ring->head = head + len;
+    return len;
+}
+
+// Refills the TX FIFO from the TX ring in one burst.
+// Must be called with uart->spinlock taken.
+static size_t IRAM_ATTR uart_tx_fifo_fill(uart_t* uart)
+{
+    uart_ring_t * ring = &uart->tx_ring;
+    size_t tail = ring->tail;
+    size_t mask = ring->size - 1;
+    size_t count = uart_ring_count(ring);
+    size_t room = UART_TX_FIFO_FULL - uart->dev->status.txfifo_cnt;
+    size_t i;
+
+    if(count > room) {
+        count = room;
+    }
+    for(i = 0; i < count; i++) {
+        uart->dev->fifo.rw_byte = ring->buf[(tail + i) & mask];
+    }
+    ring->tail = tail + count;
+    return count;
+}
+
+static void IRAM_ATTR _uart_isr(void *arg)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uart_t* uart = (uart_t*)arg;
+    uint32_t int_st = uart->dev->int_st.val;
+    TRACE_BEGIN(TRACE_ID_UART_ISR);
+
+    if(int_st & (UART_RXFIFO_FULL_INT_ST_M | UART_FRM_ERR_INT_ST_M | UART_RXFIFO_TOUT_INT_ST_M)) {
+        uart->dev->int_clr.val = int_st & (UART_RXFIFO_FULL_INT_CLR_M | UART_FRM_ERR_INT_CLR_M | UART_RXFIFO_TOUT_INT_CLR_M);
+        portENTER_CRITICAL_ISR(&uart->spinlock);
+        size_t received = uart_rx_fifo_drain(uart);
+        bool timeout = (int_st & UART_RXFIFO_TOUT_INT_ST_M) != 0;
+        if(timeout) {
+            // the line has been idle for rx_tout_thrhd symbols, i.e. a burst just ended
+            uart->rx_timeout_time = esp_timer_get_time();
+            uart->rx_timeout_count = uart_ring_count(&uart->rx_ring);
+            uart->rx_timeout_pending = true;
+        }
+        portEXIT_CRITICAL_ISR(&uart->spinlock);
+        if((received || timeout) && uart->rx_task != NULL) {
+            vTaskNotifyGiveFromISR(uart->rx_task, &xHigherPriorityTaskWoken);
+        }
+        if(received || timeout) {
+            loopSignalEventFromISR();
+        }
+    }
+    if(int_st & UART_TXFIFO_EMPTY_INT_ST_M) {
+        portENTER_CRITICAL_ISR(&uart->spinlock);
+        uart_tx_fifo_fill(uart);
+        if(!uart_ring_count(&uart->tx_ring)) {
+            uart->dev->int_ena.txfifo_empty = 0;
+        }
+        uart->dev->int_clr.txfifo_empty = 1;
+        portEXIT_CRITICAL_ISR(&uart->spinlock);
+        if(uart->tx_task != NULL) {
+            vTaskNotifyGiveFromISR(uart->tx_task, &xHigherPriorityTaskWoken);
+        }
+    }
+    TRACE_END(TRACE_ID_UART_ISR);
 
     if (xHigherPriorityTaskWoken) {
         portYIELD_FROM_ISR();
     }
 }
 
+static void uart_apply_rx_thresholds(uart_t* uart)
+{
+    uart->dev->conf1.rxfifo_full_thrhd = uart->rx_fifo_full_thrhd ? uart->rx_fifo_full_thrhd : UART_RX_FIFO_FULL_THRHD_DEFAULT;
+    uart->dev->conf1.rx_tout_thrhd = uart->rx_tout_thrhd ? uart->rx_tout_thrhd : UART_RX_TOUT_THRHD_DEFAULT;
+}
+
+static void uart_intr_alloc_cb(void * arg)
+{
+    uart_t* uart = (uart_t*)arg;
+    esp_intr_alloc(UART_INTR_SOURCE(uart->num), (int)ESP_INTR_FLAG_IRAM, _uart_isr, uart, &uart->intr_handle);
+}
+
+// esp_intr_alloc() binds the interrupt to the calling core, so hop over to the requested one if needed
+static void uart_intr_alloc(uart_t* uart)
+{
+    if(uart->intr_core >= 0 && uart->intr_core < portNUM_PROCESSORS && uart->intr_core != xPortGetCoreID()) {
+        esp_ipc_call_blocking(uart->intr_core, uart_intr_alloc_cb, uart);
+    } else {
+        uart_intr_alloc_cb(uart);
+    }
+}
+
 void uartEnableInterrupt(uart_t* uart)
 {
     UART_MUTEX_LOCK();
-    uart->dev->conf1.rxfifo_full_thrhd = 112;
-    uart->dev->conf1.rx_tout_thrhd = 2;
+    uart_apply_rx_thresholds(uart);
     uart->dev->conf1.rx_tout_en = 1;
+    uart->dev->conf1.txfifo_empty_thrhd = UART_TX_FIFO_EMPTY_THRHD;
     uart->dev->int_ena.rxfifo_full = 1;
     uart->dev->int_ena.frm_err = 1;
     uart->dev->int_ena.rxfifo_tout = 1;
     uart->dev->int_clr.val = 0xffffffff;
 
-    esp_intr_alloc(UART_INTR_SOURCE(uart->num), (int)ESP_INTR_FLAG_IRAM, _uart_isr, NULL, &uart->intr_handle);
+    if(uart->intr_handle == NULL) {
+        uart_intr_alloc(uart);
+    }
     UART_MUTEX_UNLOCK();
 }
 
@@ -181,11 +346,15 @@ uart_t* uartBegin(uint8_t uart_nr, uint32_t baudrate, uint32_t config, int8_t rx
     }
 #endif
 
-    if(queueLen && uart->queue == NULL) {
-        uart->queue = xQueueCreate(queueLen, sizeof(uint8_t)); //initialize the queue
-        if(uart->queue == NULL) {
+    if(queueLen && uart->rx_ring.buf == NULL) {
+        size_t size;
+        uint8_t * buf = uart_ring_alloc(queueLen, &size);
+        if(buf == NULL) {
             return NULL;
         }
+        portENTER_CRITICAL(&uart->spinlock);
+        uart_ring_swap(&uart->rx_ring, buf, size);
+        portEXIT_CRITICAL(&uart->spinlock);
     }
     if(uart_nr == 1){
         DPORT_SET_PERI_REG_MASK(DPORT_PERIP_CLK_EN_REG, DPORT_UART1_CLK_EN);
@@ -233,18 +402,23 @@ void uartEnd(uart_t* uart, uint8_t txPin, uint8_t rxPin)
     }
     removeApbChangeCallback(uart, uart_on_apb_change);
 
-    UART_MUTEX_LOCK();
-    if(uart->queue != NULL) {
-        vQueueDelete(uart->queue);
-        uart->queue = NULL;
-    }
+    uartFlushTxOnly(uart, true);
 
+    UART_MUTEX_LOCK();
     uart->dev->conf0.val = 0;
-
     UART_MUTEX_UNLOCK();
 
     uartDetachRx(uart, rxPin);
     uartDetachTx(uart, txPin);
+
+    UART_MUTEX_LOCK();
+    portENTER_CRITICAL(&uart->spinlock);
+    uint8_t * rx_buf = uart_ring_swap(&uart->rx_ring, NULL, 0);
+    uint8_t * tx_buf = uart_ring_swap(&uart->tx_ring, NULL, 0);
+    portEXIT_CRITICAL(&uart->spinlock);
+    UART_MUTEX_UNLOCK();
+    free(rx_buf);
+    free(tx_buf);
 }
 
 size_t uartResizeRxBuffer(uart_t * uart, size_t new_size) {
@@ -252,18 +426,88 @@ size_t uartResizeRxBuffer(uart_t * uart, size_t new_size) {
         return 0;
     }
 
+    // the ring is rounded up to the next power of two, pending data is discarded
+    size_t size;
+    uint8_t * buf = uart_ring_alloc(new_size, &size);
+    if(buf == NULL) {
+        return 0;
+    }
     UART_MUTEX_LOCK();
-    if(uart->queue != NULL) {
-        vQueueDelete(uart->queue);
-        uart->queue = xQueueCreate(new_size, sizeof(uint8_t));
-        if(uart->queue == NULL) {
-            UART_MUTEX_UNLOCK();
-            return NULL;
+    portENTER_CRITICAL(&uart->spinlock);
+    uint8_t * old_buf = uart_ring_swap(&uart->rx_ring, buf, size);
+    portEXIT_CRITICAL(&uart->spinlock);
+    UART_MUTEX_UNLOCK();
+    free(old_buf);
+
+    return size;
+}
+
+size_t uartResizeTxBuffer(uart_t * uart, size_t new_size) {
+    if(uart == NULL) {
+        return 0;
+    }
+
+    // a size of 0 makes writes go straight to the FIFO again
+    size_t size = 0;
+    uint8_t * buf = NULL;
+    if(new_size) {
+        buf = uart_ring_alloc(new_size, &size);
+        if(buf == NULL) {
+            return 0;
         }
     }
+    uartFlushTxOnly(uart, true);
+    UART_MUTEX_LOCK();
+    portENTER_CRITICAL(&uart->spinlock);
+    uint8_t * old_buf = uart_ring_swap(&uart->tx_ring, buf, size);
+    portEXIT_CRITICAL(&uart->spinlock);
     UART_MUTEX_UNLOCK();
+    free(old_buf);
 
-    return new_size;
+    return size;
+}
+
+void uartSetRxFIFOFull(uart_t* uart, uint8_t numBytesFIFOFull)
+{
+    if(uart == NULL) {
+        return;
+    }
+    if(numBytesFIFOFull > UART_TX_FIFO_FULL) {
+        numBytesFIFOFull = UART_TX_FIFO_FULL;
+    }
+    UART_MUTEX_LOCK();
+    uart->rx_fifo_full_thrhd = numBytesFIFOFull;
+    uart_apply_rx_thresholds(uart);
+    UART_MUTEX_UNLOCK();
+}
+
+void uartSetRxTimeout(uart_t* uart, uint8_t numSymbTimeout)
+{
+    if(uart == NULL) {
+        return;
+    }
+    if(numSymbTimeout > UART_RX_TOUT_THRHD_V) {
+        numSymbTimeout = UART_RX_TOUT_THRHD_V;
+    }
+    UART_MUTEX_LOCK();
+    uart->rx_tout_thrhd = numSymbTimeout;
+    uart_apply_rx_thresholds(uart);
+    UART_MUTEX_UNLOCK();
+}
+
+void uartSetInterruptCore(uart_t* uart, int8_t core)
+{
+    if(uart == NULL) {
+        return;
+    }
+    UART_MUTEX_LOCK();
+    uart->intr_core = core;
+    if(uart->intr_handle != NULL) {
+        esp_intr_free(uart->intr_handle);
+        uart->intr_handle = NULL;
+        uart_intr_alloc(uart);
+    }
+    UART_MUTEX_UNLOCK();
 }
 
 void uartSetRxInvert(uart_t* uart, bool invert)
@@ -279,10 +523,10 @@ void uartSetRxInvert(uart_t* uart, bool invert)
 
 uint32_t uartAvailable(uart_t* uart)
 {
-    if(uart == NULL || uart->queue == NULL) {
+    if(uart == NULL || uart->rx_ring.buf == NULL) {
         return 0;
     }
-    return (uxQueueMessagesWaiting(uart->queue) + uart->dev->status.rxfifo_cnt) ;
+    return (uart_ring_count(&uart->rx_ring) + uart->dev->status.rxfifo_cnt) ;
 }
 
 uint32_t uartAvailableForWrite(uart_t* uart)
@@ -290,69 +534,201 @@ uint32_t uartAvailableForWrite(uart_t* uart)
     if(uart == NULL) {
         return 0;
     }
-    return 0x7f - uart->dev->status.txfifo_cnt;
+    size_t room = UART_TX_FIFO_FULL - uart->dev->status.txfifo_cnt;
+    if(uart->tx_ring.buf != NULL) {
+        room += uart->tx_ring.size - uart_ring_count(&uart->tx_ring);
+    }
+    return room;
 }
 
-void uartRxFifoToQueue(uart_t* uart)
+// Pulls bytes that have not reached the FIFO threshold yet, so that reads do not wait for the RX timeout.
+static void uartRxFifoToRing(uart_t* uart)
 {
-	uint8_t c;
-    UART_MUTEX_LOCK();
-	//disable interrupts
-	uart->dev->int_ena.val = 0;
-	uart->dev->int_clr.val = 0xffffffff;
-	while (uart->dev->status.rxfifo_cnt || (uart->dev->mem_rx_status.wr_addr != uart->dev->mem_rx_status.rd_addr)) {
-		c = uart->dev->fifo.rw_byte;
-		xQueueSend(uart->queue, &c, 0);
-	}
-	//enable interrupts
-	uart->dev->int_ena.rxfifo_full = 1;
-	uart->dev->int_ena.frm_err = 1;
-	uart->dev->int_ena.rxfifo_tout = 1;
-	uart->dev->int_clr.val = 0xffffffff;
-    UART_MUTEX_UNLOCK();
+    if(!UART_RX_FIFO_NOT_EMPTY(uart)) {
+        return;
+    }
+    portENTER_CRITICAL(&uart->spinlock);
+    uart_rx_fifo_drain(uart);
+    portEXIT_CRITICAL(&uart->spinlock);
 }
 
-uint8_t uartRead(uart_t* uart)
+// Sleeps until the ISR delivers more bytes or the ticks run out.
+static void uart_rx_wait(uart_t* uart, TickType_t ticks)
 {
-    if(uart == NULL || uart->queue == NULL) {
+    uart->rx_task = xTaskGetCurrentTaskHandle();
+    if(!uart_ring_count(&uart->rx_ring) && !UART_RX_FIFO_NOT_EMPTY(uart)) {
+        ulTaskNotifyTake(pdTRUE, ticks);
+    }
+    uart->rx_task = NULL;
+}
+
+size_t uartReadBytes(uart_t* uart, uint8_t *buffer, size_t size, uint32_t timeout_ms)
+{
+    if(uart == NULL || uart->rx_ring.buf == NULL || buffer == NULL) {
         return 0;
     }
-    uint8_t c;
-    if ((uxQueueMessagesWaiting(uart->queue) == 0) && (uart->dev->status.rxfifo_cnt > 0))
-    {
-    	uartRxFifoToQueue(uart);
+    uart_ring_t * ring = &uart->rx_ring;
+    TickType_t ticks = timeout_ms ? pdMS_TO_TICKS(timeout_ms) : 0;
+    TickType_t start = xTaskGetTickCount();
+    size_t total = 0;
+
+    while(total < size) {
+        size_t count = uart_ring_count(ring);
+        if(!count) {
+            uartRxFifoToRing(uart);
+            count = uart_ring_count(ring);
+        }
+        if(count) {
+            if(count > size - total) {
+                count = size - total;
+            }
+            size_t tail = ring->tail;
+            size_t offset = tail & (ring->size - 1);
+            size_t first = ring->size - offset;
+            if(first > count) {
+                first = count;
+            }
+            memcpy(buffer + total, ring->buf + offset, first);
+            memcpy(buffer + total + first, ring->buf, count - first);
+            ring->tail = tail + count;
+            total += count;
+            continue;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if(elapsed >= ticks) {
+            break;
+        }
+        uart_rx_wait(uart, ticks - elapsed);
     }
-    if(xQueueReceive(uart->queue, &c, 0)) {
-        return c;
+    return total;
+}
+
+uint32_t uartWaitRx(uart_t* uart, size_t count, uint32_t timeout_ms)
+{
+    if(uart == NULL || uart->rx_ring.buf == NULL) {
+        return 0;
     }
-    return 0;
+    uart_ring_t * ring = &uart->rx_ring;
+    TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+    TickType_t start = xTaskGetTickCount();
+
+    if(count > ring->size) {
+        count = ring->size;
+    }
+    uartRxFifoToRing(uart);
+    while(uart_ring_count(ring) < count && !uart->rx_timeout_pending) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if(elapsed >= ticks) {
+            break;
+        }
+        // the waiter slot only wakes us for new data, so a partial frame does not spin
+        size_t pending = uart_ring_count(ring);
+        uart->rx_task = xTaskGetCurrentTaskHandle();
+        if(uart_ring_count(ring) == pending) {
+            ulTaskNotifyTake(pdTRUE, ticks - elapsed);
+        }
+        uart->rx_task = NULL;
+        uartRxFifoToRing(uart);
+    }
+    return uart_ring_count(ring);
 }
 
-uint8_t uartPeek(uart_t* uart)
+size_t uartPeekView(uart_t* uart, uart_rx_view_t * view)
 {
-    if(uart == NULL || uart->queue == NULL) {
+    view->data[0] = view->data[1] = NULL;
+    view->len[0] = view->len[1] = 0;
+    if(uart == NULL || uart->rx_ring.buf == NULL) {
         return 0;
     }
-    uint8_t c;
-    if ((uxQueueMessagesWaiting(uart->queue) == 0) && (uart->dev->status.rxfifo_cnt > 0))
-    {
-    	uartRxFifoToQueue(uart);
+    uart_ring_t * ring = &uart->rx_ring;
+    size_t count = uart_ring_count(ring);
+    size_t offset = ring->tail & (ring->size - 1);
+    size_t first = ring->size - offset;
+    if(first > count) {
+        first = count;
+    }
+    view->data[0] = ring->buf + offset;
+    view->len[0] = first;
+    if(count > first) {
+        view->data[1] = ring->buf;
+        view->len[1] = count - first;
+    }
+    return count;
+}
+
+size_t uartFindByte(uart_t* uart, uint8_t c, size_t max_len)
+{
+    uart_rx_view_t view;
+    size_t count = uartPeekView(uart, &view);
+    size_t scanned = 0;
+    size_t i;
+    if(count > max_len) {
+        count = max_len;
     }
-    if(xQueuePeek(uart->queue, &c, 0)) {
-        return c;
+    for(i = 0; i < 2 && scanned < count; i++) {
+        size_t len = view.len[i];
+        if(len > count - scanned) {
+            len = count - scanned;
+        }
+        const uint8_t * found = (const uint8_t *)memchr(view.data[i], c, len);
+        if(found != NULL) {
+            return scanned + (found - view.data[i]) + 1;
+        }
+        scanned += len;
     }
     return 0;
 }
 
-void uartWrite(uart_t* uart, uint8_t c)
+bool uartGetRxTimeoutEvent(uart_t* uart, size_t * count, int64_t * timestamp)
 {
-    if(uart == NULL) {
+    if(uart == NULL || !uart->rx_timeout_pending) {
+        return false;
+    }
+    portENTER_CRITICAL(&uart->spinlock);
+    *count = uart->rx_timeout_count;
+    *timestamp = uart->rx_timeout_time;
+    uart->rx_timeout_pending = false;
+    portEXIT_CRITICAL(&uart->spinlock);
+    return true;
+}
+
+void uartConsume(uart_t* uart, size_t len)
+{
+    if(uart == NULL || uart->rx_ring.buf == NULL) {
         return;
     }
-    UART_MUTEX_LOCK();
-    while(uart->dev->status.txfifo_cnt == 0x7F);
-    uart->dev->fifo.rw_byte = c;
-    UART_MUTEX_UNLOCK();
+    size_t count = uart_ring_count(&uart->rx_ring);
+    if(len > count) {
+        len = count;
+    }
+    uart->rx_ring.tail += len;
+}
+
+uint8_t uartRead(uart_t* uart)
+{
+    uint8_t c = 0;
+    uartReadBytes(uart, &c, 1, 0);
+    return c;
+}
+
+uint8_t uartPeek(uart_t* uart)
+{
+    if(uart == NULL || uart->rx_ring.buf == NULL) {
+        return 0;
+    }
+    uart_ring_t * ring = &uart->rx_ring;
+    if(!uart_ring_count(ring)) {
+        uartRxFifoToRing(uart);
+        if(!uart_ring_count(ring)) {
+            return 0;
+        }
+    }
+    return ring->buf[ring->tail & (ring->size - 1)];
+}
+
+void uartWrite(uart_t* uart, uint8_t c)
+{
+    uartWriteBuf(uart, &c, 1);
 }
 
 void uartWriteBuf(uart_t* uart, const uint8_t * data, size_t len)
@@ -361,10 +737,40 @@ void uartWriteBuf(uart_t* uart, const uint8_t * data, size_t len)
         return;
     }
     UART_MUTEX_LOCK();
+    if(uart->tx_ring.buf == NULL || uart->intr_handle == NULL) {
+        while(len) {
+            while(uart->dev->status.txfifo_cnt == UART_TX_FIFO_FULL);
+            uart->dev->fifo.rw_byte = *data++;
+            len--;
+        }
+        UART_MUTEX_UNLOCK();
+        return;
+    }
+    uart_ring_t * ring = &uart->tx_ring;
     while(len) {
-        while(uart->dev->status.txfifo_cnt == 0x7F);
-        uart->dev->fifo.rw_byte = *data++;
-        len--;
+        size_t written = 0;
+        // nothing queued yet, so bytes can go straight to the FIFO without reordering
+        if(!uart_ring_count(ring)) {
+            while(written < len && uart->dev->status.txfifo_cnt < UART_TX_FIFO_FULL) {
+                uart->dev->fifo.rw_byte = data[written++];
+            }
+        }
+        written += uart_ring_write(ring, data + written, len - written);
+        data += written;
+        len -= written;
+        if(uart_ring_count(ring)) {
+            portENTER_CRITICAL(&uart->spinlock);
+            uart->dev->int_ena.txfifo_empty = 1;
+            portEXIT_CRITICAL(&uart->spinlock);
+        }
+        if(len) {
+            // ring is full, sleep until the ISR has moved some of it into the FIFO
+            uart->tx_task = xTaskGetCurrentTaskHandle();
+            if(uart_ring_count(ring) == ring->size) {
+                ulTaskNotifyTake(pdTRUE, 1);
+            }
+            uart->tx_task = NULL;
+        }
     }
     UART_MUTEX_UNLOCK();
 }
@@ -381,6 +787,9 @@ void uartFlushTxOnly(uart_t* uart, bool txOnly)
     }
 
     UART_MUTEX_LOCK();
+    while(uart_ring_count(&uart->tx_ring) && uart->intr_handle != NULL) {
+        vTaskDelay(1);
+    }
     while(uart->dev->status.txfifo_cnt || uart->dev->status.st_utx_out);
     
     if( !txOnly ){
@@ -392,7 +801,7 @@ void uartFlushTxOnly(uart_t* uart, bool txOnly)
             READ_PERI_REG(UART_FIFO_REG(uart->num));
         }
 
-        xQueueReset(uart->queue);
+        uart->rx_ring.tail = uart->rx_ring.head;
     }
     
     UART_MUTEX_UNLOCK();
@@ -415,36 +824,29 @@ static void uart_on_apb_change(void * arg, apb_change_ev_t ev_type, uint32_t old
     uart_t* uart = (uart_t*)arg;
     if(ev_type == APB_BEFORE_CHANGE){
         UART_MUTEX_LOCK();
-        //disabple interrupt
+        // the TX ring is left as is, it goes out at the new divisor once interrupts are back
         uart->dev->int_ena.val = 0;
         uart->dev->int_clr.val = 0xffffffff;
         // read RX fifo
-        uint8_t c;
-   //     BaseType_t xHigherPriorityTaskWoken;
-        while(uart->dev->status.rxfifo_cnt != 0 || (uart->dev->mem_rx_status.wr_addr != uart->dev->mem_rx_status.rd_addr)) {
-            c = uart->dev->fifo.rw_byte;
-            if(uart->queue != NULL ) {
-                xQueueSend(uart->queue, &c, 1); //&xHigherPriorityTaskWoken);
-            }
-        }
-        UART_MUTEX_UNLOCK();
- 
+        uartRxFifoToRing(uart);
+
         // wait TX empty
         while(uart->dev->status.txfifo_cnt || uart->dev->status.st_utx_out);
-    } else {
-        //todo:
-        // set baudrate
-        UART_MUTEX_LOCK();
+
+        // new divisor for the same baud rate, written with the clock switch
         uint32_t clk_div = (uart->dev->clk_div.div_int << 4) | (uart->dev->clk_div.div_frag & 0x0F);
         uint32_t baud_rate = ((old_apb<<4)/clk_div);
         clk_div = ((new_apb<<4)/baud_rate);
-        uart->dev->clk_div.div_int = clk_div>>4 ;
-        uart->dev->clk_div.div_frag = clk_div & 0xf;
+        apbChangeQueueWrite(&uart->dev->clk_div.val, 0x00FFFFFF, ((clk_div & 0xf) << 20) | (clk_div >> 4));
+    } else {
         //enable interrupts
         uart->dev->int_ena.rxfifo_full = 1;
         uart->dev->int_ena.frm_err = 1;
         uart->dev->int_ena.rxfifo_tout = 1;
         uart->dev->int_clr.val = 0xffffffff;
+        if(uart_ring_count(&uart->tx_ring)) {
+            uart->dev->int_ena.txfifo_empty = 1;
+        }
         UART_MUTEX_UNLOCK();
     }
 }
@@ -518,7 +920,33 @@ int uartGetDebug()
     return s_uart_debug_nr;
 }
 
+void uartWriteDebug(const uint8_t * data, size_t len)
+{
+    if(s_uart_debug_nr < 0){
+        return;
+    }
+    uart_t* uart = &_uart_bus_array[s_uart_debug_nr];
+#if !CONFIG_DISABLE_HAL_LOCKS
+    if(uart->lock){
+        uartWriteBuf(uart, data, len);
+        return;
+    }
+#endif
+    while(len--) {
+        ets_write_char_uart(*data++);
+    }
+}
+
 int log_printf(const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    int len = log_vprintf(format, arg);
+    va_end(arg);
+    return len;
+}
+
+int log_vprintf(const char *format, va_list arg)
 {
     if(s_uart_debug_nr < 0){
         return 0;
@@ -526,11 +954,21 @@ int log_printf(const char *format, ...)
     static char loc_buf[64];
     char * temp = loc_buf;
     int len;
-    va_list arg;
     va_list copy;
-    va_start(arg, format);
+    if(logBufferActive()){
+        // format straight into the log buffer, the log task does the actual output
+        va_copy(copy, arg);
+        len = vsnprintf(NULL, 0, format, copy);
+        va_end(copy);
+        char * record = (len > 0) ? (char *)logBufferReserve(len + 1, LOG_RECORD_TEXT) : NULL;
+        if(record != NULL) {
+            vsnprintf(record, len + 1, format, arg);
+            logBufferCommit(record);
+        }
+        return len;
+    }
     va_copy(copy, arg);
-    len = vsnprintf(NULL, 0, format, arg);
+    len = vsnprintf(NULL, 0, format, copy);
     va_end(copy);
     if(len >= sizeof(loc_buf)){
         temp = (char*)malloc(len+1);
@@ -542,6 +980,10 @@ int log_printf(const char *format, ...)
 #if !CONFIG_DISABLE_HAL_LOCKS
     if(_uart_bus_array[s_uart_debug_nr].lock){
         xSemaphoreTake(_uart_bus_array[s_uart_debug_nr].lock, portMAX_DELAY);
+        // keep the log line behind anything still buffered for TX
+        while(uart_ring_count(&_uart_bus_array[s_uart_debug_nr].tx_ring) && _uart_bus_array[s_uart_debug_nr].intr_handle != NULL) {
+            vTaskDelay(1);
+        }
         ets_printf("%s", temp);
         xSemaphoreGive(_uart_bus_array[s_uart_debug_nr].lock);
     } else {
@@ -550,7 +992,6 @@ int log_printf(const char *format, ...)
 #else
     ets_printf("%s", temp);
 #endif
-    va_end(arg);
     if(len >= sizeof(loc_buf)){
         free(temp);
     }
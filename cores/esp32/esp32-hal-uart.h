@@ -51,6 +51,12 @@ extern "C" {
 struct uart_struct_t;
 typedef struct uart_struct_t uart_t;
 
+// Received bytes mapped in place inside the RX buffer, split in two when the data wraps around
+typedef struct {
+    const uint8_t * data[2];
+    size_t len[2];
+} uart_rx_view_t;
+
 uart_t* uartBegin(uint8_t uart_nr, uint32_t baudrate, uint32_t config, int8_t rxPin, int8_t txPin, uint16_t queueLen, bool inverted);
 void uartEnd(uart_t* uart, uint8_t rxPin, uint8_t txPin);
 
@@ -58,6 +64,17 @@ uint32_t uartAvailable(uart_t* uart);
 uint32_t uartAvailableForWrite(uart_t* uart);
 uint8_t uartRead(uart_t* uart);
 uint8_t uartPeek(uart_t* uart);
+size_t uartReadBytes(uart_t* uart, uint8_t *buffer, size_t size, uint32_t timeout_ms);
+uint32_t uartWaitRx(uart_t* uart, size_t count, uint32_t timeout_ms);
+
+// Zero-copy access for the single reader: the view stays valid until the bytes are consumed
+size_t uartPeekView(uart_t* uart, uart_rx_view_t * view);
+size_t uartFindByte(uart_t* uart, uint8_t c, size_t max_len);
+void uartConsume(uart_t* uart, size_t len);
+
+// Reports the last RX timeout (idle line after a burst): bytes pending at that moment and the esp_timer_get_time() stamp taken in the ISR.
+// uartWaitRx() returns early once such an event is pending.
+bool uartGetRxTimeoutEvent(uart_t* uart, size_t * count, int64_t * timestamp);
 
 void uartWrite(uart_t* uart, uint8_t c);
 void uartWriteBuf(uart_t* uart, const uint8_t * data, size_t len);
@@ -69,11 +86,18 @@ void uartSetBaudRate(uart_t* uart, uint32_t baud_rate);
 uint32_t uartGetBaudRate(uart_t* uart);
 
 size_t uartResizeRxBuffer(uart_t* uart, size_t new_size);
+size_t uartResizeTxBuffer(uart_t* uart, size_t new_size);
 
 void uartSetRxInvert(uart_t* uart, bool invert);
+// 0 restores the defaults (112 bytes / 2 symbols)
+void uartSetRxFIFOFull(uart_t* uart, uint8_t numBytesFIFOFull);
+void uartSetRxTimeout(uart_t* uart, uint8_t numSymbTimeout);
+// -1 lets the interrupt run on the core that calls uartBegin()
+void uartSetInterruptCore(uart_t* uart, int8_t core);
 
 void uartSetDebug(uart_t* uart);
 int uartGetDebug();
+void uartWriteDebug(const uint8_t * data, size_t len);
 
 void uartStartDetectBaudrate(uart_t *uart);
 unsigned long uartDetectBaudrate(uart_t *uart);
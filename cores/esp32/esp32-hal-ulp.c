@@ -0,0 +1,243 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp32-hal-ulp.h"
+#include "esp32-hal.h"
+#include "esp32/ulp.h"
+#include "esp_sleep.h"
+#include "driver/adc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/soc.h"
+#include "esp_attr.h"
+
+// the words the ADC program shares, at the end of the reserved memory
+#define ULP_ADC_COUNT   0   // samples in the batch so far
+#define ULP_ADC_BATCH   1
+#define ULP_ADC_LOW     2
+#define ULP_ADC_HIGH    3
+#define ULP_ADC_CROSSED 4   // set with the wake for a sample outside low to high
+#define ULP_ADC_SAMPLES 5
+
+enum { L_SAMPLE = 1, L_CROSSED, L_CHECK, L_WAIT, L_WAKE, L_DONE };
+
+// the ULP runs on over deep sleep, so where its program left things has to be kept too
+static RTC_DATA_ATTR size_t _ulp_words = 0;
+static RTC_DATA_ATTR size_t _ulp_adc_base = 0;  // 0 while ulpAdcBegin() did not load its program
+
+bool ulpLoadProgram(const void * program, size_t count)
+{
+    size_t size = count;
+    esp_err_t err = ulp_process_macros_and_load(0, (const ulp_insn_t *)program, &size);
+    if(err != ESP_OK) {
+        log_e("ULP program not loaded: 0x%x", err);
+        return false;
+    }
+    _ulp_words = size;
+    _ulp_adc_base = 0;
+    return true;
+}
+
+bool ulpLoadBinary(const uint8_t * binary, size_t size)
+{
+    esp_err_t err = ulp_load_binary(0, binary, size);
+    if(err != ESP_OK) {
+        log_e("ULP binary not loaded: 0x%x", err);
+        return false;
+    }
+    // TEXT_SIZE and DATA_SIZE of the header, in bytes
+    _ulp_words = (((const uint16_t *)binary)[3] + ((const uint16_t *)binary)[4] + 3) / 4;
+    _ulp_adc_base = 0;
+    return true;
+}
+
+size_t ulpProgramWords(void)
+{
+    return _ulp_words;
+}
+
+bool ulpRun(uint32_t entry, uint32_t periodUs)
+{
+    if(ulp_set_wakeup_period(0, periodUs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = esp_sleep_enable_ulp_wakeup();
+    if(err != ESP_OK) {
+        log_e("ULP wakeup not enabled: 0x%x", err);
+        return false;
+    }
+    err = ulp_run(entry);
+    if(err != ESP_OK) {
+        log_e("ULP not started: 0x%x", err);
+        return false;
+    }
+    return true;
+}
+
+void ulpStop(void)
+{
+    // the timer does not start it again, a run under way ends with its I_HALT()
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ULP);
+}
+
+uint16_t ulpRead(size_t word)
+{
+    if(word >= ULP_MEMORY_WORDS) {
+        return 0;
+    }
+    return RTC_SLOW_MEM[word] & 0xffff;
+}
+
+void ulpWrite(size_t word, uint16_t value)
+{
+    if(word < ULP_MEMORY_WORDS) {
+        RTC_SLOW_MEM[word] = value;
+    }
+}
+
+/*
+ * Every run: when the batch is not full, take a sample and add it; a sample
+ * outside low to high sets ULP_ADC_CROSSED and wakes the main cores, unless it
+ * is still set from the last one. Once the batch is full they are woken too.
+ * The wake waits for them to be in deep sleep, and is dropped when they took
+ * the batch in the meantime.
+ */
+static size_t _ulpAdcProgram(ulp_insn_t * program, uint8_t channel, uint16_t base)
+{
+    const ulp_insn_t code[] = {
+        I_MOVI(R3, base),
+        I_LD(R0, R3, ULP_ADC_COUNT),
+        I_LD(R1, R3, ULP_ADC_BATCH),
+        I_SUBR(R2, R0, R1),
+        M_BXF(L_SAMPLE),
+        M_BX(L_DONE),                   // full, until the main cores take it
+
+        M_LABEL(L_SAMPLE),
+        I_ADC(R0, 0, channel),
+        I_LD(R1, R3, ULP_ADC_COUNT),
+        I_ADDR(R2, R3, R1),
+        I_ST(R0, R2, ULP_ADC_SAMPLES),
+        I_ADDI(R1, R1, 1),
+        I_ST(R1, R3, ULP_ADC_COUNT),
+        I_LD(R1, R3, ULP_ADC_LOW),
+        I_SUBR(R2, R0, R1),
+        M_BXF(L_CROSSED),               // below low
+        I_LD(R1, R3, ULP_ADC_HIGH),
+        I_SUBR(R2, R1, R0),
+        M_BXF(L_CROSSED),               // above high
+        M_BX(L_CHECK),
+
+        M_LABEL(L_CROSSED),
+        I_LD(R0, R3, ULP_ADC_CROSSED),
+        M_BGE(L_CHECK, 1),              // they were told already
+        I_MOVI(R0, 1),
+        I_ST(R0, R3, ULP_ADC_CROSSED),
+        M_BX(L_WAIT),
+
+        M_LABEL(L_CHECK),
+        I_LD(R0, R3, ULP_ADC_COUNT),
+        I_LD(R1, R3, ULP_ADC_BATCH),
+        I_SUBR(R2, R0, R1),
+        M_BXF(L_DONE),                  // not full yet
+
+        M_LABEL(L_WAIT),
+        I_RD_REG(RTC_CNTL_LOW_POWER_ST_REG, RTC_CNTL_RDY_FOR_WAKEUP_S, RTC_CNTL_RDY_FOR_WAKEUP_S),
+        M_BL(L_WAIT, 1),
+        I_LD(R0, R3, ULP_ADC_CROSSED),
+        M_BGE(L_WAKE, 1),
+        I_LD(R0, R3, ULP_ADC_COUNT),
+        I_LD(R1, R3, ULP_ADC_BATCH),
+        I_SUBR(R2, R0, R1),
+        M_BXF(L_DONE),                  // taken while they were awake
+        M_LABEL(L_WAKE),
+        I_WAKE(),
+
+        M_LABEL(L_DONE),
+        I_HALT()
+    };
+    size_t words = 0;
+    for(size_t i = 0; i < sizeof(code) / sizeof(code[0]); i++) {
+        if(program) {
+            program[i] = code[i];
+        }
+        if(code[i].macro.opcode != OPCODE_MACRO) {
+            words++;
+        }
+    }
+    return program ? sizeof(code) / sizeof(code[0]) : words;
+}
+
+size_t ulpAdcMaxBatch(void)
+{
+    size_t used = _ulpAdcProgram(NULL, 0, 0) + ULP_ADC_SAMPLES;
+    return (used < ULP_MEMORY_WORDS) ? ULP_MEMORY_WORDS - used : 0;
+}
+
+bool ulpAdcBegin(uint8_t pin, uint16_t batch, uint32_t periodUs, uint16_t low, uint16_t high)
+{
+    int8_t channel = digitalPinToAnalogChannel(pin);
+    if(channel < 0 || channel > 7) {
+        log_e("pin %u is not on ADC1", pin);
+        return false;
+    }
+    if(!batch || batch > ulpAdcMaxBatch()) {
+        log_e("batch of %u samples, at most %u fit", batch, ulpAdcMaxBatch());
+        return false;
+    }
+    ulpStop();
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten((adc1_channel_t)channel, ADC_ATTEN_DB_11);
+    adc1_ulp_enable();
+
+    uint16_t base = ULP_MEMORY_WORDS - ULP_ADC_SAMPLES - batch;
+    ulp_insn_t program[64];
+    if(!ulpLoadProgram(program, _ulpAdcProgram(program, channel, base))) {
+        return false;
+    }
+    ulpWrite(base + ULP_ADC_COUNT, 0);
+    ulpWrite(base + ULP_ADC_BATCH, batch);
+    ulpWrite(base + ULP_ADC_LOW, low);
+    ulpWrite(base + ULP_ADC_HIGH, high);
+    ulpWrite(base + ULP_ADC_CROSSED, 0);
+    _ulp_adc_base = base;
+    return ulpRun(0, periodUs);
+}
+
+size_t ulpAdcRead(uint16_t * samples, size_t size, bool * crossed)
+{
+    size_t base = _ulp_adc_base;
+    if(!base) {
+        return 0;
+    }
+    size_t count = ulpRead(base + ULP_ADC_COUNT);
+    if(count > size) {
+        count = size;
+    }
+    for(size_t i = 0; i < count; i++) {
+        samples[i] = ulpRead(base + ULP_ADC_SAMPLES + i);
+    }
+    if(crossed) {
+        *crossed = ulpRead(base + ULP_ADC_CROSSED) != 0;
+    }
+    // a sample the ULP adds right now is lost with the old batch
+    ulpWrite(base + ULP_ADC_CROSSED, 0);
+    ulpWrite(base + ULP_ADC_COUNT, 0);
+    return count;
+}
+
+void ulpAdcEnd(void)
+{
+    ulpStop();
+    _ulp_adc_base = 0;
+}
@@ -0,0 +1,64 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESP32_HAL_ULP_H_
+#define _ESP32_HAL_ULP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+/*
+ * The ULP coprocessor, which runs its program every periodUs also while the main
+ * cores are in deep sleep and wakes them with I_WAKE(). Programs are ulp_insn_t
+ * made with the macros of esp32/ulp.h (I_ADC(), I_ST(), M_LABEL(), ...), left to
+ * the sketch to include as their short names would clash, or come from the ULP
+ * toolchain. They go at the start of the CONFIG_ULP_COPROC_RESERVE_MEM bytes of
+ * RTC slow memory; what they share with the main cores is in the words after
+ * them, where the ULP writes the low 16 bits. ulpAdcBegin() loads a ready-made
+ * program sampling a pin of ADC1 into a batch that wakes the main cores when it
+ * is full, or right away when a sample is outside low to high.
+ */
+#define ULP_MEMORY_WORDS (CONFIG_ULP_COPROC_RESERVE_MEM / 4)
+
+// program is an array of count ulp_insn_t
+bool ulpLoadProgram(const void * program, size_t count);
+bool ulpLoadBinary(const uint8_t * binary, size_t size);
+// the words taken by the program loaded last
+size_t ulpProgramWords(void);
+// from entry every periodUs, and enables the ULP wakeup from deep sleep
+bool ulpRun(uint32_t entry, uint32_t periodUs);
+void ulpStop(void);
+
+// a word of the reserved memory, of what the ULP wrote only the low 16 bits count
+uint16_t ulpRead(size_t word);
+void ulpWrite(size_t word, uint16_t value);
+
+// pin of ADC1 (32 - 39) at 12 bits and 11dB; batch of at most ulpAdcMaxBatch()
+bool ulpAdcBegin(uint8_t pin, uint16_t batch, uint32_t periodUs, uint16_t low, uint16_t high);
+size_t ulpAdcMaxBatch(void);
+// the samples taken so far, which start a new batch; crossed tells whether one was outside the thresholds
+size_t ulpAdcRead(uint16_t * samples, size_t size, bool * crossed);
+void ulpAdcEnd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP32_HAL_ULP_H_ */
@@ -29,6 +29,7 @@ extern "C" {
 #include <math.h>
 #include "sdkconfig.h"
 #include "esp_system.h"
+#include "esp_attr.h"
 
 #ifndef F_CPU
 #define F_CPU (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000U)
@@ -42,6 +43,16 @@ void yield(void);
 #define ESP_REG(addr) *((volatile uint32_t *)(addr))
 #define NOP() asm volatile ("nop")
 
+// hot paths of the core and libraries, in IRAM with the "Hot Paths in IRAM" board menu or CONFIG_ARDUINO_HOT_IN_IRAM
+#if !defined(ARDUINO_HOT_IN_IRAM) && defined(CONFIG_ARDUINO_HOT_IN_IRAM)
+#define ARDUINO_HOT_IN_IRAM 1
+#endif
+#if ARDUINO_HOT_IN_IRAM
+#define ARDUINO_HOT IRAM_ATTR
+#else
+#define ARDUINO_HOT
+#endif
+
 #include "esp32-hal-log.h"
 #include "esp32-hal-matrix.h"
 #include "esp32-hal-uart.h"
@@ -51,13 +62,25 @@ void yield(void);
 #include "esp32-hal-adc.h"
 #include "esp32-hal-spi.h"
 #include "esp32-hal-i2c.h"
+#include "esp32-hal-i2c-slave.h"
+#include "esp32-hal-i2s.h"
 #include "esp32-hal-ledc.h"
+#include "esp32-hal-mcpwm.h"
+#include "esp32-hal-pcnt.h"
 #include "esp32-hal-rmt.h"
 #include "esp32-hal-sigmadelta.h"
 #include "esp32-hal-timer.h"
+#include "esp32-hal-timer-sched.h"
 #include "esp32-hal-bt.h"
 #include "esp32-hal-psram.h"
+#include "esp32-hal-pool.h"
+#include "esp32-hal-rtcstate.h"
+#include "esp32-hal-ulp.h"
+#include "esp32-hal-heap-trace.h"
+#include "esp32-hal-trace.h"
 #include "esp32-hal-cpu.h"
+#include "esp32-hal-time.h"
+#include "esp32-hal-loop.h"
 
 #ifndef BOARD_HAS_PSRAM
 #ifdef CONFIG_SPIRAM_SUPPORT
@@ -21,10 +21,26 @@
 #define CONFIG_ARDUINO_LOOP_STACK_SIZE 8192
 #endif
 
+#ifndef CONFIG_ARDUINO_LOOP_PRIORITY
+#define CONFIG_ARDUINO_LOOP_PRIORITY 1
+#endif
+
 TaskHandle_t loopTaskHandle = NULL;
 
 #if CONFIG_AUTOSTART_ARDUINO
 
+__attribute__((weak)) size_t getArduinoLoopTaskStackSize(void) {
+    return CONFIG_ARDUINO_LOOP_STACK_SIZE;
+}
+
+__attribute__((weak)) BaseType_t getArduinoLoopTaskCore(void) {
+    return CONFIG_ARDUINO_RUNNING_CORE;
+}
+
+__attribute__((weak)) UBaseType_t getArduinoLoopTaskPriority(void) {
+    return CONFIG_ARDUINO_LOOP_PRIORITY;
+}
+
 bool loopTaskWDTEnabled;
 
 void loopTask(void *pvParameters)
@@ -34,7 +50,9 @@ void loopTask(void *pvParameters)
         if(loopTaskWDTEnabled){
             esp_task_wdt_reset();
         }
+        TRACE_BEGIN(TRACE_ID_LOOP);
         loop();
+        TRACE_END(TRACE_ID_LOOP);
         if (serialEventRun) serialEventRun();
     }
 }
@@ -43,7 +61,9 @@ extern "C" void app_main()
 {
     loopTaskWDTEnabled = false;
     initArduino();
-    xTaskCreateUniversal(loopTask, "loopTask", CONFIG_ARDUINO_LOOP_STACK_SIZE, NULL, 1, &loopTaskHandle, CONFIG_ARDUINO_RUNNING_CORE);
+    if(xTaskCreateUniversal(loopTask, "loopTask", getArduinoLoopTaskStackSize(), NULL, getArduinoLoopTaskPriority(), &loopTaskHandle, getArduinoLoopTaskCore()) != pdPASS) {
+        log_e("loopTask could not be started");
+    }
 }
 
 #endif
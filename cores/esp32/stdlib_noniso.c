@@ -41,11 +41,77 @@ void reverse(char* begin, char* end) {
     }
 }
 
+static const char _digit_pairs[201] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+static const uint32_t _pow10_u32[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+size_t u32toa(uint32_t value, char* s) {
+    char tmp[10];
+    char* p = tmp + sizeof(tmp);
+    while(value >= 100) {
+        const uint32_t q = value / 100;
+        const char* d = &_digit_pairs[(value - q * 100) * 2];
+        *--p = d[1];
+        *--p = d[0];
+        value = q;
+    }
+    if(value >= 10) {
+        *--p = _digit_pairs[value * 2 + 1];
+        *--p = _digit_pairs[value * 2];
+    } else {
+        *--p = '0' + value;
+    }
+    const size_t len = tmp + sizeof(tmp) - p;
+    memcpy(s, p, len);
+    s[len] = 0;
+    return len;
+}
+
+size_t u64toa(uint64_t value, char* s) {
+    if(value <= UINT32_MAX) {
+        return u32toa((uint32_t) value, s);
+    }
+    // one 64 bit division per nine digits, the digits themselves in 32 bit
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while(value > UINT32_MAX) {
+        const uint64_t q = value / 1000000000;
+        uint32_t r = (uint32_t) (value - q * 1000000000);
+        for(int i = 0; i < 4; i++) {
+            const uint32_t rq = r / 100;
+            const char* d = &_digit_pairs[(r - rq * 100) * 2];
+            *--p = d[1];
+            *--p = d[0];
+            r = rq;
+        }
+        *--p = '0' + r;
+        value = q;
+    }
+    const size_t len = u32toa((uint32_t) value, s);
+    const size_t rest = tmp + sizeof(tmp) - p;
+    memcpy(s + len, p, rest);
+    s[len + rest] = 0;
+    return len + rest;
+}
+
 char* ltoa(long value, char* result, int base) {
     if(base < 2 || base > 16) {
         *result = 0;
         return result;
     }
+    if(base == 10) {
+        if(value < 0) {
+            *result = '-';
+            u64toa(-(unsigned long) value, result + 1);
+        } else {
+            u64toa(value, result);
+        }
+        return result;
+    }
 
     char* out = result;
     long quotient = abs(value);
@@ -71,6 +137,10 @@ char* ultoa(unsigned long value, char* result, int base) {
         *result = 0;
         return result;
     }
+    if(base == 10) {
+        u64toa(value, result);
+        return result;
+    }
 
     char* out = result;
     unsigned long quotient = value;
@@ -113,6 +183,32 @@ char * dtostrf(double number, signed char width, unsigned char prec, char *s) {
         number = -number;
     }
 
+    // Integer arithmetic while the scaled value is exact enough, one rounding
+    if (prec < 10 && number * _pow10_u32[prec] < 9007199254740992.0) {
+        const uint64_t fixed = (uint64_t) (number * _pow10_u32[prec] + 0.5);
+        const uint64_t int_part = fixed / _pow10_u32[prec];
+        const uint32_t frac = (uint32_t) (fixed - int_part * _pow10_u32[prec]);
+        char digits[21];
+        size_t len = u64toa(int_part, digits);
+        fillme -= len;
+        while (fillme-- > 0) {
+            *out++ = ' ';
+        }
+        if (negative) *out++ = '-';
+        memcpy(out, digits, len);
+        out += len;
+        if (prec > 0) {
+            *out++ = '.';
+            len = u32toa(frac, digits);
+            memset(out, '0', prec - len);
+            out += prec - len;
+            memcpy(out, digits, len);
+            out += len;
+        }
+        *out = 0;
+        return s;
+    }
+
     // Round correctly so that print(1.999, 2) prints as "2.00"
     // I optimized out most of the divisions
     double rounding = 2.0;
@@ -159,3 +255,288 @@ char * dtostrf(double number, signed char width, unsigned char prec, char *s) {
     *out = 0;
     return s;
 }
+
+static double _pow10_double(int e) {
+    double r = 1.0;
+    double b = 10.0;
+    unsigned int n = (e < 0) ? -e : e;
+    while (n) {
+        if (n & 1) r *= b;
+        b *= b;
+        n >>= 1;
+    }
+    return (e < 0) ? 1.0 / r : r;
+}
+
+size_t ftostr(float value, char* s) {
+    char* out = s;
+    if (isnan(value)) {
+        strcpy(s, "nan");
+        return 3;
+    }
+    if (signbit(value)) {
+        *out++ = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        strcpy(out, "inf");
+        return out - s + 3;
+    }
+    if (value == 0.0f) {
+        *out++ = '0';
+        *out = 0;
+        return out - s;
+    }
+
+    // Every float is exact in double, and so are the midpoints to its
+    // neighbours: a decimal between them reads back as value (on the
+    // midpoint too when the mantissa is even, ties go to even)
+    const double v = value;
+    const double down = nextafterf(value, 0.0f);
+    const float up = nextafterf(value, INFINITY);
+    const double hi = isinf(up) ? v + (v - down) / 2 : (v + (double) up) / 2;
+    const double lo = (v + down) / 2;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const bool even = !(bits & 1);
+    int e10 = (int) floor(log10(v));
+    double pe = _pow10_double(e10);
+    if (pe > v) {
+        e10--;
+    } else if (pe * 10 <= v) {
+        e10++;
+    }
+
+    // fewest significant digits first, nine always round trip
+    uint32_t m = 0;
+    size_t k;
+    for (k = 1; k <= 9; k++) {
+        const int q = k - 1 - e10;
+        double r;
+        bool ok;
+        if (q < 0 && q >= -9) {
+            // r * 10^-q is exact, so is the test
+            const double t = _pow10_double(-q);
+            r = floor(v / t + 0.5);
+            const double d = r * t;
+            ok = (d > lo && d < hi) || (even && (d == lo || d == hi));
+        } else if (q >= 0 && q <= 12) {
+            // v, lo and hi times 10^q are still exact
+            const double p = _pow10_double(q);
+            r = floor(v * p + 0.5);
+            ok = (r > lo * p && r < hi * p) || (even && (r == lo * p || r == hi * p));
+        } else {
+            // far from 1 the scaling rounds, keep clear of the midpoints
+            const double p = _pow10_double(q);
+            const double a = lo * p;
+            const double b = hi * p;
+            const double margin = (b - a) * 1e-6;
+            r = floor(v * p + 0.5);
+            ok = r > a + margin && r < b - margin;
+        }
+        if (ok || k == 9) {
+            m = (uint32_t) r;
+            break;
+        }
+    }
+    if (m >= _pow10_u32[k]) {
+        // rounded up to the next power of ten
+        m /= 10;
+        e10++;
+    }
+    while (m >= 10 && m % 10 == 0) {
+        m /= 10;
+    }
+    char digits[11];
+    const int n = u32toa(m, digits);
+
+    if (e10 >= -4 && e10 < 0) {
+        *out++ = '0';
+        *out++ = '.';
+        for (int i = -1; i > e10; i--) {
+            *out++ = '0';
+        }
+        memcpy(out, digits, n);
+        out += n;
+    } else if (e10 >= 0 && e10 < 9) {
+        if (n <= e10 + 1) {
+            memcpy(out, digits, n);
+            out += n;
+            for (int i = n; i <= e10; i++) {
+                *out++ = '0';
+            }
+        } else {
+            memcpy(out, digits, e10 + 1);
+            out += e10 + 1;
+            *out++ = '.';
+            memcpy(out, digits + e10 + 1, n - e10 - 1);
+            out += n - e10 - 1;
+        }
+    } else {
+        *out++ = digits[0];
+        if (n > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, n - 1);
+            out += n - 1;
+        }
+        *out++ = 'e';
+        if (e10 < 0) {
+            *out++ = '-';
+            e10 = -e10;
+        }
+        out += u32toa(e10, out);
+    }
+    *out = 0;
+    return out - s;
+}
+
+// four ASCII digits at s, the first the most significant, or -1 when one is not a digit
+static inline int32_t _parse4(const char* s) {
+    uint32_t v;
+    memcpy(&v, s, 4);   // little endian, s[0] in the low byte
+    if ((v & 0xF0F0F0F0) != 0x30303030 || ((v + 0x06060606) & 0xF0F0F0F0) != 0x30303030) {
+        return -1;
+    }
+    v -= 0x30303030;
+    v = v * 10 + (v >> 8);      // pairs in bytes 0 and 2
+    return (v & 0xFF) * 100 + ((v >> 16) & 0xFF);
+}
+
+static inline bool _isdigit(char c) {
+    return (unsigned char) (c - '0') < 10;
+}
+
+size_t parseIntBuffer(const char* s, size_t len, long* value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+')) {
+        negative = s[i++] == '-';
+    }
+    const size_t start = i;
+    unsigned long v = 0;
+    for (; i + 4 <= len; i += 4) {
+        const int32_t q = _parse4(s + i);
+        if (q < 0) {
+            break;
+        }
+        v = v * 10000 + q;
+    }
+    for (; i < len && _isdigit(s[i]); i++) {
+        v = v * 10 + (s[i] - '0');
+    }
+    if (i == start) {
+        return 0;
+    }
+    *value = negative ? -(long) v : (long) v;
+    return i;
+}
+
+static const float _pow10_float[11] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+static const double _pow10_exact[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// m * 10^e10, plus a little when digits past the 19th were not zero
+static float _decimal_to_float(uint64_t m, int e10, bool sticky) {
+    if (m == 0) {
+        return 0.0f;
+    }
+    if (!sticky && m <= (1UL << 24) && e10 >= -10 && e10 <= 10) {
+        // both exact in float, so one correctly rounded operation
+        const float f = (float) m;
+        return (e10 < 0) ? f / _pow10_float[-e10] : f * _pow10_float[e10];
+    }
+    if (!sticky && m <= (1ULL << 53) && e10 >= -22 && e10 <= 22) {
+        // exact in double and rounded once there; rounding that again to float
+        // only goes wrong when the double lands right on the midpoint of two floats
+        const double d = (e10 < 0) ? (double) m / _pow10_exact[-e10] : (double) m * _pow10_exact[e10];
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        if ((bits & 0x1FFFFFFF) != 0x10000000) {
+            return (float) d;
+        }
+    }
+    // the rest goes to the C library, as the digits that were kept
+    char text[32];
+    size_t n = u64toa(m, text);
+    if (sticky) {
+        text[n++] = '1';
+        e10--;
+    }
+    text[n++] = 'e';
+    itoa(e10, text + n, 10);
+    return strtof(text, NULL);
+}
+
+size_t parseFloatBuffer(const char* s, size_t len, float* value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+')) {
+        negative = s[i++] == '-';
+    }
+    uint64_t m = 0;
+    int digits = 0;     // significant ones in m
+    int e10 = 0;
+    bool any = false;
+    bool sticky = false;
+    for (; i < len && s[i] == '0'; i++) {
+        any = true;
+    }
+    for (; i < len && _isdigit(s[i]); i++) {
+        if (digits < 19) {
+            m = m * 10 + (s[i] - '0');
+            digits++;
+        } else {
+            sticky |= s[i] != '0';
+            e10++;
+        }
+        any = true;
+    }
+    if (i < len && s[i] == '.') {
+        i++;
+        if (!digits) {
+            for (; i < len && s[i] == '0'; i++) {
+                e10--;
+                any = true;
+            }
+        }
+        for (; i < len && _isdigit(s[i]); i++) {
+            if (digits < 19) {
+                m = m * 10 + (s[i] - '0');
+                digits++;
+                e10--;
+            } else {
+                sticky |= s[i] != '0';
+            }
+            any = true;
+        }
+    }
+    if (!any) {
+        return 0;
+    }
+    // an exponent only counts with digits after the e
+    if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+        size_t j = i + 1;
+        bool eneg = false;
+        if (j < len && (s[j] == '-' || s[j] == '+')) {
+            eneg = s[j++] == '-';
+        }
+        if (j < len && _isdigit(s[j])) {
+            int x = 0;
+            for (; j < len && _isdigit(s[j]); j++) {
+                if (x < 10000) {
+                    x = x * 10 + (s[j] - '0');
+                }
+            }
+            e10 += eneg ? -x : x;
+            i = j;
+        }
+    }
+    const float f = _decimal_to_float(m, e10, sticky);
+    *value = negative ? -f : f;
+    return i;
+}
@@ -21,6 +21,9 @@
 #ifndef STDLIB_NONISO_H
 #define STDLIB_NONISO_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,6 +44,19 @@ char* ultoa (unsigned long val, char *s, int radix);
 
 char* dtostrf (double val, signed char width, unsigned char prec, char *s);
 
+// decimal conversion two digits per step, writes a NUL and returns the length
+size_t u32toa (uint32_t val, char *s);  // s holds at least 11 bytes
+size_t u64toa (uint64_t val, char *s);  // s holds at least 21 bytes
+
+// shortest text that reads back as the same float, s holds at least 16 bytes
+size_t ftostr (float val, char *s);
+
+// decimal numbers at the start of s, which needs no NUL; they return the characters taken, 0 when
+// there is no number. No leading whitespace is skipped, parseIntBuffer() wraps on overflow like
+// atol(), parseFloatBuffer() takes an exponent and rounds correctly
+size_t parseIntBuffer (const char *s, size_t len, long *value);
+size_t parseFloatBuffer (const char *s, size_t len, float *value);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
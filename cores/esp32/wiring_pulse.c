@@ -48,3 +48,83 @@ unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout)
 {
     return pulseIn(pin, state, timeout);
 }
+
+struct pulse_in_s {
+    rmt_obj_t * rmt;
+    uint8_t state;
+    float tickUs;
+    uint32_t idleTicks;     // a level this long is the line idling, not a pulse
+    rmt_data_t * frame;
+    size_t len;
+    size_t pos;             // half item in frame
+};
+
+// the RMT receiver times the pulses in hardware, frames of them end when the line idles for maxPulseUs
+pulse_in_t * pulseInAsyncBegin(uint8_t pin, uint8_t state, unsigned long maxPulseUs)
+{
+    if (!maxPulseUs) {
+        return NULL;
+    }
+    pulse_in_t * pulse = (pulse_in_t *)calloc(1, sizeof(pulse_in_t));
+    if (!pulse) {
+        return NULL;
+    }
+    pulse->rmt = rmtInit(pin, false, RMT_MEM_128);
+    if (!pulse->rmt) {
+        free(pulse);
+        return NULL;
+    }
+    // durations are 15 bit, the tick is 1us or as coarse as the longest pulse needs
+    float tick_ns = (maxPulseUs > 32767) ? ((maxPulseUs * 1000.0f) / 32767 + 1000) : 1000;
+    pulse->tickUs = rmtSetTick(pulse->rmt, tick_ns) / 1000.0f;
+    uint32_t idle = (uint32_t)(maxPulseUs / pulse->tickUs) + 1;
+    pulse->idleTicks = (idle > 32767) ? 32767 : idle;
+    pulse->state = state;
+    if (!rmtSetRxThreshold(pulse->rmt, pulse->idleTicks) || !rmtReadContinuous(pulse->rmt, 512)) {
+        rmtDeinit(pulse->rmt);
+        free(pulse);
+        return NULL;
+    }
+    return pulse;
+}
+
+// width of the next pulse in us, 0 when none completed within timeout_ms
+unsigned long pulseInAsync(pulse_in_t * pulse, uint32_t timeout_ms)
+{
+    if (!pulse) {
+        return 0;
+    }
+    uint32_t start = millis();
+    for (;;) {
+        while (pulse->frame && pulse->pos < 2 * pulse->len) {
+            rmt_data_t * item = &pulse->frame[pulse->pos / 2];
+            uint32_t duration = (pulse->pos & 1) ? item->duration1 : item->duration0;
+            uint8_t level = (pulse->pos & 1) ? item->level1 : item->level0;
+            pulse->pos++;
+            if (!duration) {
+                // end of the frame
+                break;
+            }
+            if (level == pulse->state && duration < pulse->idleTicks) {
+                return (unsigned long)(duration * pulse->tickUs + 0.5f);
+            }
+        }
+        uint32_t waited = millis() - start;
+        pulse->frame = NULL;
+        pulse->pos = 0;
+        pulse->len = rmtReceiveFrame(pulse->rmt, &pulse->frame, (waited < timeout_ms) ? timeout_ms - waited : 0);
+        if (!pulse->len) {
+            pulse->frame = NULL;
+            return 0;
+        }
+    }
+}
+
+void pulseInAsyncEnd(pulse_in_t * pulse)
+{
+    if (!pulse) {
+        return;
+    }
+    rmtDeinit(pulse->rmt);
+    free(pulse);
+}
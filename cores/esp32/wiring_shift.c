@@ -49,3 +49,83 @@ void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val)
         digitalWrite(clockPin, LOW);
     }
 }
+
+#ifndef SHIFT_SPI_HOST
+#define SHIFT_SPI_HOST HSPI // not otherwise in use while shifting
+#endif
+
+static spi_t * _shift_spi = NULL;
+
+static spi_t * _shiftBegin(uint8_t clockPin, uint8_t bitOrder, uint32_t freq)
+{
+    uint32_t div = spiFrequencyToClockDiv(freq);
+    uint8_t order = (bitOrder == LSBFIRST) ? SPI_LSBFIRST : SPI_MSBFIRST;
+    if(!_shift_spi) {
+        _shift_spi = spiStartBus(SHIFT_SPI_HOST, div, SPI_MODE0, order);
+        if(!_shift_spi) {
+            log_e("SPI host %u failed", SHIFT_SPI_HOST);
+            return NULL;
+        }
+    }
+    spiTransaction(_shift_spi, div, SPI_MODE0, order);
+    // low again when the pin is back on the GPIO
+    digitalWrite(clockPin, LOW);
+    spiAttachSCK(_shift_spi, clockPin);
+    return _shift_spi;
+}
+
+static void _shiftEnd(spi_t * spi, uint8_t clockPin)
+{
+    pinMatrixOutDetach(clockPin, false, false);
+    spiEndTransaction(spi);
+}
+
+/*
+ * shiftOut() of a buffer by the SPI host, routed to the pins through the GPIO matrix;
+ * the pins stay outputs after, so a shift register is not clocked by a floating pin
+ */
+void shiftOutFast(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, const uint8_t * buf, size_t len, uint32_t freq)
+{
+    if(!buf || !len) {
+        return;
+    }
+    spi_t * spi = _shiftBegin(clockPin, bitOrder, freq);
+    if(!spi) {
+        return;
+    }
+    spiAttachMOSI(spi, dataPin);
+    // the FIFO is loaded a word at a time, buf may not be aligned
+    uint32_t chunk[16];
+    while(len) {
+        size_t n = (len > sizeof(chunk)) ? sizeof(chunk) : len;
+        memcpy(chunk, buf, n);
+        spiWriteNL(spi, chunk, n);
+        buf += n;
+        len -= n;
+    }
+    pinMatrixOutDetach(dataPin, false, false);
+    _shiftEnd(spi, clockPin);
+}
+
+void shiftInFast(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t * buf, size_t len, uint32_t freq)
+{
+    if(!buf || !len) {
+        return;
+    }
+    spi_t * spi = _shiftBegin(clockPin, bitOrder, freq);
+    if(!spi) {
+        return;
+    }
+    spiAttachMISO(spi, dataPin);
+    // read a word at a time, a whole one also past the end of buf
+    uint32_t chunk[16];
+    while(len) {
+        size_t n = (len > sizeof(chunk)) ? sizeof(chunk) : len;
+        spiTransferBytesNL(spi, NULL, (uint8_t *)chunk, n);
+        memcpy(buf, chunk, n);
+        buf += n;
+        len -= n;
+    }
+    spiDetachMISO(spi, dataPin);
+    _shiftEnd(spi, clockPin);
+}
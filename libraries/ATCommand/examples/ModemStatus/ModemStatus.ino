@@ -0,0 +1,58 @@
+// Polls a cellular modem on Serial1 for its signal and registration while
+// the loop keeps running: the commands are queued, the answers come back in
+// callbacks, and registration changes are reported as they happen (+CREG:).
+
+#include <ATCommand.h>
+
+#define MODEM_RX 16
+#define MODEM_TX 17
+
+ATCommand at(Serial1);
+unsigned long lastPoll = 0;
+unsigned long loops = 0;
+
+void printResult(const char* what, at_result_t result, const String& response) {
+  static const char* const names[] = { "OK", "ERROR", "TIMEOUT", "CANCELLED" };
+  Serial.printf("%s: %s\n", what, names[result]);
+  if (response.length()) {
+    Serial.println(response);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial1.begin(115200, SERIAL_8N1, MODEM_RX, MODEM_TX);
+  if (!at.begin()) {
+    Serial.println("AT engine not started");
+    return;
+  }
+  at.onUrc("+CREG:", [](const String& line) {
+    Serial.printf("registration changed: %s\n", line.c_str());
+  });
+
+  // no echo, and report registration changes by themselves
+  if (at.sendWait("ATE0") != AT_OK) {
+    Serial.println("no answer from the modem");
+  }
+  at.send("AT+CREG=1");
+  String model;
+  if (at.sendWait("AT+CGMM", &model) == AT_OK) {
+    Serial.printf("modem: %s\n", model.c_str());
+  }
+}
+
+void loop() {
+  loops++;
+  if (millis() - lastPoll >= 5000) {
+    lastPoll = millis();
+    // both go out back to back, the loop does not wait for either
+    at.send("AT+CSQ", [](at_result_t result, const String& response) {
+      printResult("signal", result, response);
+    });
+    at.send("AT+CREG?", [](at_result_t result, const String& response) {
+      printResult("registration", result, response);
+    }, 2000);
+    Serial.printf("%lu loops in the last 5s\n", loops);
+    loops = 0;
+  }
+}
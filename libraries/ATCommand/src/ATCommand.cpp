@@ -0,0 +1,325 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ATCommand.h"
+#include <new>
+
+#define AT_LINE_QUEUE 16    // lines waiting for the engine task, on top of the commands
+
+ATCommand::ATCommand(HardwareSerial& serial, size_t queueSize)
+    : _serial(serial)
+    , _queueSize(queueSize ? queueSize : 1)
+    , _events(NULL)
+    , _task(NULL)
+    , _exited(NULL)
+    , _urcLock(xSemaphoreCreateMutex())
+    , _depth(1)
+    , _pending(0)
+{
+}
+
+ATCommand::~ATCommand()
+{
+    end();
+    if(_urcLock) {
+        vSemaphoreDelete(_urcLock);
+    }
+}
+
+bool ATCommand::begin(size_t maxLineLen)
+{
+    if(_task) {
+        return true;
+    }
+    _events = xQueueCreate(_queueSize + AT_LINE_QUEUE, sizeof(Event));
+    _exited = xSemaphoreCreateBinary();
+    if(!_events || !_exited || !_urcLock) {
+        log_e("out of memory");
+        end();
+        return false;
+    }
+    if(xTaskCreateUniversal(_taskFn, "at_command", AT_COMMAND_TASK_STACK_SIZE, this,
+                            AT_COMMAND_TASK_PRIORITY, &_task, CONFIG_ARDUINO_RUNNING_CORE) != pdPASS) {
+        log_e("engine task not created");
+        _task = NULL;
+        end();
+        return false;
+    }
+    _serial.onFrame('\n', [this](const uint8_t* data, size_t len) { _onLine(data, len); }, maxLineLen);
+    return true;
+}
+
+void ATCommand::end()
+{
+    if(_task) {
+        // no more lines, then the task finishes what is left
+        _serial.onFrame('\n', nullptr);
+        Event event = { EVENT_STOP, NULL };
+        xQueueSend(_events, &event, portMAX_DELAY);
+        xSemaphoreTake(_exited, portMAX_DELAY);
+        _task = NULL;
+    }
+    if(_events) {
+        Event event;
+        while(xQueueReceive(_events, &event, 0) == pdTRUE) {
+            if(event.type == EVENT_LINE) {
+                free(event.data);
+            } else if(event.type == EVENT_COMMAND) {
+                _finish((Command*)event.data, AT_CANCELLED);
+            }
+        }
+        vQueueDelete(_events);
+        _events = NULL;
+    }
+    if(_exited) {
+        vSemaphoreDelete(_exited);
+        _exited = NULL;
+    }
+}
+
+bool ATCommand::send(const char* command, ResponseCb cb, uint32_t timeout_ms, const char* expect)
+{
+    if(!_task || !command) {
+        return false;
+    }
+    Command* cmd = new (std::nothrow) Command();
+    if(!cmd) {
+        log_e("out of memory");
+        return false;
+    }
+    cmd->text = command;
+    cmd->expect = expect ? expect : "";
+    cmd->cb = cb;
+    cmd->timeout = timeout_ms;
+    cmd->deadline = 0;
+    // AT+CSQ and AT+CREG? are answered with +CSQ: and +CREG: lines
+    const char* p = command;
+    if(!strncasecmp(p, "AT", 2)) {
+        p += 2;
+    }
+    if(*p == '+' || *p == '^' || *p == '#' || *p == '$' || *p == '%') {
+        cmd->prefix = String(p).substring(0, strcspn(p, "=?;")) + ':';
+    }
+    _pending++;
+    Event event = { EVENT_COMMAND, cmd };
+    if(xQueueSend(_events, &event, 0) != pdTRUE) {
+        _pending--;
+        delete cmd;
+        return false;
+    }
+    return true;
+}
+
+at_result_t ATCommand::sendWait(const char* command, String* response, uint32_t timeout_ms, const char* expect)
+{
+    if(_task && xTaskGetCurrentTaskHandle() == _task) {
+        log_e("not from the callbacks");
+        return AT_ERROR;
+    }
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if(!done) {
+        return AT_ERROR;
+    }
+    at_result_t result = AT_ERROR;
+    bool queued = send(command, [&](at_result_t r, const String& text) {
+        result = r;
+        if(response) {
+            *response = text;
+        }
+        xSemaphoreGive(done);
+    }, timeout_ms, expect);
+    // every command is completed, at the latest by its timeout or end()
+    if(queued) {
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(done);
+    return result;
+}
+
+void ATCommand::onUrc(const char* prefix, UrcCb cb)
+{
+    String p = prefix ? prefix : "";
+    xSemaphoreTake(_urcLock, portMAX_DELAY);
+    for(auto it = _urcs.begin(); it != _urcs.end(); ++it) {
+        if(it->prefix == p) {
+            if(cb) {
+                it->cb = cb;
+            } else {
+                _urcs.erase(it);
+            }
+            xSemaphoreGive(_urcLock);
+            return;
+        }
+    }
+    if(cb) {
+        _urcs.push_back({ p, cb });
+    }
+    xSemaphoreGive(_urcLock);
+}
+
+// in the event task of the port
+void ATCommand::_onLine(const uint8_t* data, size_t len)
+{
+    while(len && (data[len - 1] == '\r' || data[len - 1] == '\n')) {
+        len--;
+    }
+    if(!len) {
+        return;
+    }
+    char* line = (char*)malloc(len + 1);
+    if(!line) {
+        log_e("line dropped, out of memory");
+        return;
+    }
+    memcpy(line, data, len);
+    line[len] = 0;
+    Event event = { EVENT_LINE, line };
+    if(xQueueSend(_events, &event, pdMS_TO_TICKS(100)) != pdTRUE) {
+        log_w("line dropped, engine busy: %s", line);
+        free(line);
+    }
+}
+
+int ATCommand::_finalResult(const char* line)
+{
+    static const char* const errors[] = {
+        "ERROR", "+CME ERROR", "+CMS ERROR", "NO CARRIER", "BUSY", "NO ANSWER", "NO DIALTONE"
+    };
+    if(!strcmp(line, "OK")) {
+        return AT_OK;
+    }
+    for(size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+        if(!strncmp(line, errors[i], strlen(errors[i]))) {
+            return AT_ERROR;
+        }
+    }
+    return -1;
+}
+
+void ATCommand::_line(const char* line)
+{
+    Command* cmd = _sent.empty() ? NULL : _sent.front();
+    if(cmd) {
+        if(cmd->text == line) {
+            return;     // echo
+        }
+        int result = _finalResult(line);
+        bool expected = cmd->expect.length() && !strncmp(line, cmd->expect.c_str(), cmd->expect.length());
+        if(expected || result >= 0 || (cmd->prefix.length() && !strncmp(line, cmd->prefix.c_str(), cmd->prefix.length()))) {
+            if(result != AT_OK) {
+                if(cmd->response.length()) {
+                    cmd->response += '\n';
+                }
+                cmd->response += line;
+            }
+            if(expected || result >= 0) {
+                _sent.pop_front();
+                _finish(cmd, expected ? AT_OK : (at_result_t)result);
+            }
+            return;
+        }
+    }
+
+    UrcCb cb = nullptr;
+    UrcCb any = nullptr;
+    xSemaphoreTake(_urcLock, portMAX_DELAY);
+    for(const Urc& urc : _urcs) {
+        if(!urc.prefix.length()) {
+            any = urc.cb;
+        } else if(!strncmp(line, urc.prefix.c_str(), urc.prefix.length())) {
+            cb = urc.cb;
+            break;
+        }
+    }
+    xSemaphoreGive(_urcLock);
+    if(cb) {
+        cb(String(line));
+    } else if(cmd) {
+        // information text of the command, as the IMEI for AT+CGSN
+        if(cmd->response.length()) {
+            cmd->response += '\n';
+        }
+        cmd->response += line;
+    } else if(any) {
+        any(String(line));
+    } else {
+        log_d("unsolicited: %s", line);
+    }
+}
+
+void ATCommand::_pump()
+{
+    while(_sent.size() < _depth && !_waiting.empty()) {
+        Command* cmd = _waiting.front();
+        _waiting.pop_front();
+        _serial.print(cmd->text);
+        _serial.write('\r');
+        cmd->deadline = millis() + cmd->timeout;
+        _sent.push_back(cmd);
+    }
+}
+
+void ATCommand::_finish(Command* cmd, at_result_t result)
+{
+    if(cmd->cb) {
+        cmd->cb(result, cmd->response);
+    }
+    delete cmd;
+    _pending--;
+}
+
+// responses come in order, so only the oldest command can time out
+uint32_t ATCommand::_nextTimeout()
+{
+    if(_sent.empty()) {
+        return portMAX_DELAY;
+    }
+    int32_t left = (int32_t)(_sent.front()->deadline - millis());
+    return (left > 0) ? pdMS_TO_TICKS(left) + 1 : 0;
+}
+
+void ATCommand::_taskFn(void* arg)
+{
+    ATCommand* at = (ATCommand*)arg;
+    Event event;
+    for(;;) {
+        if(xQueueReceive(at->_events, &event, at->_nextTimeout()) == pdTRUE) {
+            if(event.type == EVENT_STOP) {
+                break;
+            }
+            if(event.type == EVENT_LINE) {
+                at->_line((const char*)event.data);
+                free(event.data);
+            } else {
+                at->_waiting.push_back((Command*)event.data);
+            }
+        }
+        while(!at->_sent.empty() && (int32_t)(millis() - at->_sent.front()->deadline) >= 0) {
+            Command* cmd = at->_sent.front();
+            at->_sent.pop_front();
+            at->_finish(cmd, AT_TIMEOUT);
+        }
+        at->_pump();
+    }
+    while(!at->_sent.empty()) {
+        at->_finish(at->_sent.front(), AT_CANCELLED);
+        at->_sent.pop_front();
+    }
+    while(!at->_waiting.empty()) {
+        at->_finish(at->_waiting.front(), AT_CANCELLED);
+        at->_waiting.pop_front();
+    }
+    xSemaphoreGive(at->_exited);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,131 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _AT_COMMAND_H_
+#define _AT_COMMAND_H_
+
+#include "Arduino.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#ifndef AT_COMMAND_TASK_STACK_SIZE
+#define AT_COMMAND_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef AT_COMMAND_TASK_PRIORITY
+#define AT_COMMAND_TASK_PRIORITY 2 // above loop(), the callbacks are short
+#endif
+
+#ifndef AT_COMMAND_TIMEOUT
+#define AT_COMMAND_TIMEOUT 1000 // ms, for send() without one
+#endif
+
+typedef enum {
+    AT_OK,
+    AT_ERROR,           // ERROR, +CME ERROR:, +CMS ERROR:, NO CARRIER, BUSY, ...
+    AT_TIMEOUT,
+    AT_CANCELLED        // end() was called before the response
+} at_result_t;
+
+/*
+ * Commands to a modem on a serial port, without blocking the loop:
+ *
+ *   ATCommand at(Serial1);
+ *   at.begin();
+ *   at.onUrc("+CREG:", [](const String& line) { ... });
+ *   at.send("AT+CSQ", [](at_result_t result, const String& response) { ... });
+ *
+ * send() queues the command and returns right away; a task of the engine
+ * writes it to the port and gathers the lines of the response until the final
+ * result code or the timeout, then calls the callback with them. Lines come in
+ * from the RX events of the port. With a pipeline depth above 1 the next
+ * commands go out before the response to the one before came in, for modems
+ * that queue them; responses are matched in order. Lines that start with a
+ * prefix given to onUrc() go to its callback, unless they answer the command
+ * under way (+CSQ: for AT+CSQ). All callbacks run in the engine task, which
+ * should not be blocked in them; sendWait() is for other tasks. Echo is best
+ * turned off with ATE0, echoed commands are skipped. The engine takes the
+ * onFrame() callback of the port.
+ */
+class ATCommand
+{
+public:
+    typedef std::function<void(at_result_t result, const String& response)> ResponseCb;
+    typedef std::function<void(const String& line)> UrcCb;
+
+    ATCommand(HardwareSerial& serial, size_t queueSize = 8);
+    ~ATCommand();
+
+    bool begin(size_t maxLineLen = 256);
+    // pending commands are completed with AT_CANCELLED
+    void end();
+
+    // false when the queue is full; a final line that starts with expect completes the command with AT_OK
+    bool send(const char* command, ResponseCb cb = nullptr, uint32_t timeout_ms = AT_COMMAND_TIMEOUT, const char* expect = NULL);
+    // waits for the response, not from the callbacks
+    at_result_t sendWait(const char* command, String* response = NULL, uint32_t timeout_ms = AT_COMMAND_TIMEOUT, const char* expect = NULL);
+
+    // an empty prefix takes every line no command and no other prefix claimed
+    void onUrc(const char* prefix, UrcCb cb);
+    // commands sent before the response to the first, 1 waits for every response
+    void setPipelineDepth(uint8_t depth) { _depth = depth ? depth : 1; }
+    // queued and under way
+    size_t pending() const { return _pending; }
+
+private:
+    struct Command {
+        String text;
+        String prefix;          // of the lines answering it, +CSQ: for AT+CSQ
+        String expect;
+        String response;
+        ResponseCb cb;
+        uint32_t timeout;
+        uint32_t deadline;
+    };
+
+    struct Urc {
+        String prefix;
+        UrcCb cb;
+    };
+
+    enum { EVENT_LINE, EVENT_COMMAND, EVENT_STOP };
+    struct Event {
+        uint8_t type;
+        void* data;             // char* line or Command*
+    };
+
+    HardwareSerial& _serial;
+    size_t _queueSize;
+    QueueHandle_t _events;
+    TaskHandle_t _task;
+    SemaphoreHandle_t _exited;
+    SemaphoreHandle_t _urcLock;
+    std::vector<Urc> _urcs;
+    std::deque<Command*> _waiting;
+    std::deque<Command*> _sent;
+    volatile uint8_t _depth;
+    std::atomic<uint32_t> _pending;
+
+    void _onLine(const uint8_t* data, size_t len);
+    void _line(const char* line);
+    void _pump();
+    void _finish(Command* cmd, at_result_t result);
+    uint32_t _nextTimeout();
+    static int _finalResult(const char* line);
+    static void _taskFn(void* arg);
+};
+
+#endif /* _AT_COMMAND_H_ */
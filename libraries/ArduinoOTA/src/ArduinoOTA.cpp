@@ -35,6 +35,9 @@ ArduinoOTAClass::ArduinoOTAClass()
 , _cmd(0)
 , _ota_port(0)
 , _ota_timeout(1000)
+, _window(0)
+, _async(false)
+, _taskHandle(NULL)
 , _start_callback(NULL)
 , _end_callback(NULL)
 , _error_callback(NULL)
@@ -43,6 +46,7 @@ ArduinoOTAClass::ArduinoOTAClass()
 }
 
 ArduinoOTAClass::~ArduinoOTAClass(){
+    loopUnwatchFd(_udp_ota.fd());
     _udp_ota.stop();
 }
 
@@ -152,6 +156,14 @@ void ArduinoOTAClass::begin() {
     }
     _initialized = true;
     _state = OTA_IDLE;
+    if (_async && xTaskCreateUniversal(_task, "arduino_ota", ARDUINO_OTA_TASK_STACK_SIZE, this,
+                                       ARDUINO_OTA_TASK_PRIORITY, &_taskHandle, ARDUINO_OTA_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("task create failed, call handle() in loop()");
+        _taskHandle = NULL;
+    }
+    if (!_taskHandle) {
+        loopWatchFd(_udp_ota.fd());
+    }
     log_i("OTA server at: %s.local:%u", _hostname.c_str(), _port);
 }
 
@@ -184,6 +196,14 @@ String ArduinoOTAClass::readStringUntil(char end){
     return res;
 }
 
+void ArduinoOTAClass::_sendOk(){
+    if(_window){
+        _udp_ota.printf("OK W%d", _window);
+    } else {
+        _udp_ota.print("OK");
+    }
+}
+
 void ArduinoOTAClass::_onRx(){
     if (_state == OTA_IDLE) {
         int cmd = parseInt();
@@ -199,6 +219,12 @@ void ArduinoOTAClass::_onRx(){
             log_e("bad md5 length");
             return;
         }
+        //espota.py asks for a window on a second line, older hosts send none
+        _window = 0;
+        if(_udp_ota.peek() == 'W'){
+            _udp_ota.read();
+            _window = constrain(parseInt(), 0, ARDUINO_OTA_MAX_WINDOW);
+        }
 
         if (_password.length()){
             MD5Builder nonce_md5;
@@ -214,7 +240,7 @@ void ArduinoOTAClass::_onRx(){
             return;
         } else {
             _udp_ota.beginPacket(_udp_ota.remoteIP(), _udp_ota.remotePort());
-            _udp_ota.print("OK");
+            _sendOk();
             _udp_ota.endPacket();
             _ota_ip = _udp_ota.remoteIP();
             _state = OTA_RUNUPDATE;
@@ -244,7 +270,7 @@ void ArduinoOTAClass::_onRx(){
 
         if(result.equals(response)){
             _udp_ota.beginPacket(_udp_ota.remoteIP(), _udp_ota.remotePort());
-            _udp_ota.print("OK");
+            _sendOk();
             _udp_ota.endPacket();
             _ota_ip = _udp_ota.remoteIP();
             _state = OTA_RUNUPDATE;
@@ -261,7 +287,11 @@ void ArduinoOTAClass::_onRx(){
 
 void ArduinoOTAClass::_runUpdate() {
     const char *partition_label = _partition_label.length() ? _partition_label.c_str() : NULL;
-    if (!Update.begin(_size, _cmd, -1, LOW, partition_label)) {
+    //a windowed upload keeps coming while the last sector is flashed
+    Update.setPipelined(_window > 0);
+    bool began = Update.begin(_size, _cmd, -1, LOW, partition_label);
+    Update.setPipelined(false);
+    if (!began) {
 
         log_e("Begin ERROR: %s", Update.errorString());
 
@@ -286,9 +316,24 @@ void ArduinoOTAClass::_runUpdate() {
             _error_callback(OTA_CONNECT_ERROR);
         }
         _state = OTA_IDLE;
+        Update.abort();
+        return;
     }
 
-    uint32_t written = 0, total = 0, tried = 0;
+    size_t bufferSize = _window ? ARDUINO_OTA_WINDOW_BUFFER : 1460;
+    uint8_t *buf = (uint8_t *)malloc(bufferSize);
+    if (!buf) {
+        log_e("malloc failed");
+        if (_error_callback) {
+            _error_callback(OTA_RECEIVE_ERROR);
+        }
+        _state = OTA_IDLE;
+        Update.abort();
+        return;
+    }
+    // acknowledged at half the window, so the host never runs dry
+    uint32_t ackEvery = _window * 512;
+    uint32_t written = 0, total = 0, acked = 0, tried = 0;
 
     while (!Update.isFinished() && client.connected()) {
         size_t waited = _ota_timeout;
@@ -301,7 +346,7 @@ void ArduinoOTAClass::_runUpdate() {
         if (!waited){
             if(written && tried++ < 3){
                 log_i("Try[%u]: %u", tried, written);
-                if(!client.printf("%u", written)){
+                if(!(_window ? client.printf("%u\n", total) : client.printf("%u", written))){
                     log_e("failed to respond");
                     _state = OTA_IDLE;
                     break;
@@ -314,6 +359,7 @@ void ArduinoOTAClass::_runUpdate() {
             }
             _state = OTA_IDLE;
             Update.abort();
+            free(buf);
             return;
         }
         if(!available){
@@ -322,9 +368,8 @@ void ArduinoOTAClass::_runUpdate() {
             break;
         }
         tried = 0;
-        static uint8_t buf[1460];
-        if(available > 1460){
-            available = 1460;
+        if(available > bufferSize){
+            available = bufferSize;
         }
         size_t r = client.read(buf, available);
         if(r != available){
@@ -336,17 +381,28 @@ void ArduinoOTAClass::_runUpdate() {
             if(written != r){
                 log_w("didn't write enough! %u != %u", written, r);
             }
-            if(!client.printf("%u", written)){
-                log_w("failed to respond");
-            }
             total += written;
+            if(!_window){
+                if(!client.printf("%u", written)){
+                    log_w("failed to respond");
+                }
+            } else if(total - acked >= ackEvery || Update.isFinished()){
+                if(!client.printf("%u\n", total)){
+                    log_w("failed to respond");
+                }
+                acked = total;
+            }
             if(_progress_callback) {
                 _progress_callback(total, _size);
             }
         } else {
             log_e("Write ERROR: %s", Update.errorString());
+            if(_window){
+                break;
+            }
         }
     }
+    free(buf);
 
     if (Update.end()) {
         client.print("OK");
@@ -372,8 +428,30 @@ void ArduinoOTAClass::_runUpdate() {
     }
 }
 
+ArduinoOTAClass& ArduinoOTAClass::setAsync(bool async){
+    if (!_initialized) {
+        _async = async;
+    }
+    return *this;
+}
+
+void ArduinoOTAClass::_task(void *arg){
+    ArduinoOTAClass *ota = (ArduinoOTAClass *)arg;
+    while (ota->_initialized) {
+        ota->handle();
+        delay(ARDUINO_OTA_TASK_POLL);
+    }
+    ota->_taskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
 void ArduinoOTAClass::end() {
     _initialized = false;
+    //let the task finish a handle() it is in, unless this is the task
+    while (_taskHandle && _taskHandle != xTaskGetCurrentTaskHandle()) {
+        delay(1);
+    }
+    loopUnwatchFd(_udp_ota.fd());
     _udp_ota.stop();
     if(_mdnsEnabled){
         MDNS.end();
@@ -383,7 +461,7 @@ void ArduinoOTAClass::end() {
 }
 
 void ArduinoOTAClass::handle() {
-    if (!_initialized) {
+    if (!_initialized || (_taskHandle && _taskHandle != xTaskGetCurrentTaskHandle())) {
         return;
     }
     if (_state == OTA_RUNUPDATE) {
@@ -392,6 +470,10 @@ void ArduinoOTAClass::handle() {
     }
     if(_udp_ota.parsePacket()){
         _onRx();
+        if (_state == OTA_RUNUPDATE) {
+            // the update starts on the next handle(), do not let loop() sleep before it
+            loopSignalEvent();
+        }
     }
     _udp_ota.flush(); // always flush, even zero length packets must be flushed.
 }
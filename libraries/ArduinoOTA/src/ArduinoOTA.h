@@ -21,6 +21,30 @@
 
 #define INT_BUFFER_SIZE 16
 
+#ifndef ARDUINO_OTA_MAX_WINDOW
+#define ARDUINO_OTA_MAX_WINDOW 256 // KB espota.py may send ahead of the acknowledgements
+#endif
+
+#ifndef ARDUINO_OTA_WINDOW_BUFFER
+#define ARDUINO_OTA_WINDOW_BUFFER 4096 // read at once in a windowed upload, one flash sector
+#endif
+
+#ifndef ARDUINO_OTA_TASK_STACK_SIZE
+#define ARDUINO_OTA_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef ARDUINO_OTA_TASK_PRIORITY
+#define ARDUINO_OTA_TASK_PRIORITY 1
+#endif
+
+#ifndef ARDUINO_OTA_TASK_RUNNING_CORE
+#define ARDUINO_OTA_TASK_RUNNING_CORE -1
+#endif
+
+#ifndef ARDUINO_OTA_TASK_POLL
+#define ARDUINO_OTA_TASK_POLL 20 // ms between invitation checks of the async task
+#endif
+
 typedef enum {
   OTA_IDLE,
   OTA_WAITAUTH,
@@ -68,6 +92,10 @@ class ArduinoOTAClass
     //Sets if the device should advertise itself to Arduino IDE. Default true
     ArduinoOTAClass& setMdnsEnabled(bool enabled);
 
+    //Runs the service in its own task, handle() is not needed. Set before begin(). Default false
+    //Callbacks are then called from that task
+    ArduinoOTAClass& setAsync(bool async);
+
     //This callback will be called when OTA connection has begun
     ArduinoOTAClass& onStart(THandlerFunction fn);
 
@@ -86,7 +114,7 @@ class ArduinoOTAClass
     //Ends the ArduinoOTA service
     void end();
 
-    //Call this in loop() to run the service
+    //Call this in loop() to run the service, unless it is async
     void handle();
 
     //Gets update command type after OTA has started. Either U_FLASH or U_SPIFFS
@@ -111,6 +139,9 @@ class ArduinoOTAClass
     int _ota_timeout;
     IPAddress _ota_ip;
     String _md5;
+    int _window;
+    bool _async;
+    TaskHandle_t _taskHandle;
 
     THandlerFunction _start_callback;
     THandlerFunction _end_callback;
@@ -119,6 +150,8 @@ class ArduinoOTAClass
 
     void _runUpdate(void);
     void _onRx(void);
+    void _sendOk(void);
+    static void _task(void *arg);
     int parseInt(void);
     String readStringUntil(char end);
 };
@@ -0,0 +1,65 @@
+/*
+ * Serves a folder straight from flash: no File, no copy into RAM.
+ *
+ * Add a data partition for it to the partition table, e.g.
+ *   assets, data, 0x99, , 1M,
+ * build the image of the sketch's data folder and flash it there:
+ *   python tools/mkassets.py data assets.bin --gzip
+ *   python tools/esptool.py write_flash <partition offset> assets.bin
+ */
+
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <WebServer.h>
+#include <Assets.h>
+
+const char* ssid = "........";
+const char* password = "........";
+
+WebServer server(80);
+
+void handleAsset() {
+  String path = server.uri();
+  if (path.endsWith("/")) {
+    path += "index.html";
+  }
+  Asset asset = Assets.get(path.c_str());
+  if (!asset) {
+    server.send(404, "text/plain", "Not Found");
+    return;
+  }
+  if (asset.gzip) {
+    server.sendHeader("Content-Encoding", "gzip");
+  }
+  server.sendHeader("Cache-Control", "max-age=86400");
+  server.send_P(200, asset.contentType, (PGM_P)asset.data, asset.size);
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  if (!Assets.begin()) {
+    Serial.println("No asset image, build one with tools/mkassets.py");
+    return;
+  }
+  for (size_t i = 0; i < Assets.count(); i++) {
+    Asset asset = Assets.at(i);
+    Serial.printf("%s\t%s\t%u%s\n", asset.path, asset.contentType, asset.size, asset.gzip ? " gzip" : "");
+  }
+
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.println("");
+  Serial.print("IP address: ");
+  Serial.println(WiFi.localIP());
+
+  server.onNotFound(handleAsset);
+  server.begin();
+}
+
+void loop(void) {
+  server.handleClient();
+}
@@ -0,0 +1,141 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Assets.h"
+#include "Esp.h"
+
+#define ASSETS_MAGIC        0x41505345 // "ESPA"
+#define ASSETS_VERSION      1
+#define ASSETS_FLAG_GZIP    0x01
+
+// image layout, little endian: header, entries sorted by path, strings, 4 byte aligned data
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t count;
+    uint32_t size;           // whole image
+} assets_header_t;
+
+typedef struct {
+    uint32_t path;           // offsets from the start of the image
+    uint32_t type;
+    uint32_t data;
+    uint32_t size;
+    uint32_t flags;
+} assets_entry_t;
+
+AssetsClass::AssetsClass()
+    : _image(NULL)
+    , _size(0)
+    , _count(0)
+    , _handle(0)
+{}
+
+AssetsClass::~AssetsClass()
+{
+    end();
+}
+
+static bool entryValid(const assets_entry_t & e, size_t size)
+{
+    return e.path < size && e.type < size && e.data <= size && e.size <= size - e.data;
+}
+
+bool AssetsClass::begin(const char * partitionLabel)
+{
+    if(_image) {
+        return true;
+    }
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if(!partition) {
+        log_e("no data partition '%s'", partitionLabel);
+        return false;
+    }
+    assets_header_t header;
+    if(esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    if(header.magic != ASSETS_MAGIC || header.version != ASSETS_VERSION || header.size > partition->size
+            || sizeof(header) + header.count * sizeof(assets_entry_t) > header.size) {
+        log_e("no asset image in '%s'", partitionLabel);
+        return false;
+    }
+    const uint8_t *image = (const uint8_t *)ESP.partitionMmap(partition, 0, header.size, &_handle);
+    if(!image) {
+        return false;
+    }
+    // checked once here, so get() can trust the offsets
+    const assets_entry_t *entries = (const assets_entry_t *)(image + sizeof(header));
+    for(size_t i = 0; i < header.count; i++) {
+        if(!entryValid(entries[i], header.size) || !memchr(image + entries[i].path, 0, header.size - entries[i].path)
+                || !memchr(image + entries[i].type, 0, header.size - entries[i].type)) {
+            log_e("asset image in '%s' is corrupt", partitionLabel);
+            ESP.partitionMunmap(_handle);
+            return false;
+        }
+    }
+    _image = image;
+    _size = header.size;
+    _count = header.count;
+    return true;
+}
+
+void AssetsClass::end()
+{
+    if(_image) {
+        ESP.partitionMunmap(_handle);
+        _image = NULL;
+        _size = 0;
+        _count = 0;
+    }
+}
+
+Asset AssetsClass::at(size_t index) const
+{
+    Asset asset = { NULL, NULL, NULL, 0, false };
+    if(!_image || index >= _count) {
+        return asset;
+    }
+    const assets_entry_t & e = ((const assets_entry_t *)(_image + sizeof(assets_header_t)))[index];
+    asset.path = (const char *)_image + e.path;
+    asset.contentType = (const char *)_image + e.type;
+    asset.data = _image + e.data;
+    asset.size = e.size;
+    asset.gzip = e.flags & ASSETS_FLAG_GZIP;
+    return asset;
+}
+
+Asset AssetsClass::get(const char * path) const
+{
+    if(_image && path) {
+        const assets_entry_t *entries = (const assets_entry_t *)(_image + sizeof(assets_header_t));
+        size_t lo = 0, hi = _count;
+        while(lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int cmp = strcmp(path, (const char *)_image + entries[mid].path);
+            if(!cmp) {
+                return at(mid);
+            }
+            if(cmp < 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+    }
+    return at(_count);
+}
+
+AssetsClass Assets;
@@ -0,0 +1,56 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ASSETS_H_
+#define _ASSETS_H_
+
+#include "Arduino.h"
+#include "esp_partition.h"
+
+// one file of the image; the pointers are into mapped flash and stay valid until end()
+struct Asset
+{
+    const char * path;
+    const char * contentType;
+    const uint8_t * data;
+    size_t size;
+    bool gzip;           // data is gzip, send it with Content-Encoding: gzip
+
+    explicit operator bool() const { return data != NULL; }
+};
+
+class AssetsClass
+{
+public:
+    AssetsClass();
+    ~AssetsClass();
+    // maps the image in the data partition with this label (tools/mkassets.py builds it)
+    bool begin(const char * partitionLabel="assets");
+    void end();
+    // path as it was in the source folder, starting with '/'
+    Asset get(const char * path) const;
+    bool exists(const char * path) const { return (bool)get(path); }
+    size_t count() const { return _count; }
+    Asset at(size_t index) const;
+
+private:
+    const uint8_t * _image;
+    size_t _size;
+    size_t _count;
+    spi_flash_mmap_handle_t _handle;
+};
+
+extern AssetsClass Assets;
+
+#endif /* _ASSETS_H_ */
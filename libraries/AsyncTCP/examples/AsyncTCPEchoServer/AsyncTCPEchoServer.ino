@@ -0,0 +1,48 @@
+#include "WiFi.h"
+#include "AsyncTCP.h"
+
+const char * ssid = "***********";
+const char * password = "***********";
+
+AsyncServer server(7);
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(ssid, password);
+    if (WiFi.waitForConnectResult() != WL_CONNECTED) {
+        Serial.println("WiFi Failed");
+        while(1) {
+            delay(1000);
+        }
+    }
+
+    server.onClient([](void * arg, AsyncClient * client) {
+        Serial.printf("Client %s:%u connected\n", client->remoteIP().toString().c_str(), client->remotePort());
+        client->onData([](void * arg, AsyncClient * c, void * data, size_t len) {
+            //echo back what fits into the send buffer; to apply backpressure instead,
+            //call c->ackLater() here and c->ack() once onAck() reports room again
+            size_t sent = c->write((const char *)data, len);
+            if(sent < len) {
+                Serial.printf("send buffer full, dropped %u bytes\n", len - sent);
+            }
+        });
+        client->onDisconnect([](void * arg, AsyncClient * c) {
+            Serial.println("Client disconnected");
+            delete c;
+        });
+        client->setRxTimeout(30);
+    }, NULL);
+    server.setNoDelay(true);
+    server.begin();
+
+    Serial.print("Echo server on ");
+    Serial.print(WiFi.localIP());
+    Serial.println(":7");
+}
+
+void loop()
+{
+    delay(1000);
+}
@@ -0,0 +1,947 @@
+#include "Arduino.h"
+#include "AsyncTCP.h"
+
+extern "C" {
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+#include "lwip/inet.h"
+#include "lwip/err.h"
+}
+
+#include "lwip/priv/tcpip_priv.h"
+
+#ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
+#define CONFIG_ASYNC_TCP_RUNNING_CORE -1
+#endif
+
+#ifndef ASYNC_TCP_TASK_STACK_SIZE
+#define ASYNC_TCP_TASK_STACK_SIZE 8192
+#endif
+
+#ifndef ASYNC_TCP_TASK_PRIORITY
+#define ASYNC_TCP_TASK_PRIORITY 3
+#endif
+
+// events are taken from a fixed pool first, malloc() covers bursts beyond it
+#ifndef ASYNC_TCP_EVENT_POOL_BLOCKS
+#define ASYNC_TCP_EVENT_POOL_BLOCKS 64
+#endif
+
+/*
+ * lwIP thread -> async_tcp task
+ *
+ * The lwIP callbacks only fill in an event and append it to a list, they never
+ * block: a bounded queue would stall the lwIP thread while the task waits in
+ * tcpip_api_call() for that same thread.
+ */
+
+typedef enum {
+    LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED
+} lwip_event_t;
+
+typedef struct lwip_event_packet_s {
+    struct lwip_event_packet_s * next;
+    lwip_event_t event;
+    void * arg;
+    tcp_pcb * pcb;
+    union {
+        struct {
+            pbuf * pb;
+            int8_t err;
+        } recv;
+        int8_t err;
+        uint16_t len;
+        AsyncClient * client;
+    };
+} lwip_event_packet_t;
+
+static lwip_event_packet_t * _async_head = NULL;
+static lwip_event_packet_t * _async_tail = NULL;
+static portMUX_TYPE _async_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t _async_service_task_handle = NULL;
+static pool_t * _async_event_pool = NULL;
+
+static lwip_event_packet_t * _async_event_alloc(lwip_event_t event, void * arg, tcp_pcb * pcb){
+    lwip_event_packet_t * e = (lwip_event_packet_t *)poolAlloc(_async_event_pool);
+    if(!e){
+        e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    }
+    if(e){
+        e->next = NULL;
+        e->event = event;
+        e->arg = arg;
+        e->pcb = pcb;
+    }
+    return e;
+}
+
+static void _async_event_free(lwip_event_packet_t * e){
+    if(!poolFree(_async_event_pool, e)){
+        free((void*)(e));
+    }
+}
+
+static void _async_event_post(lwip_event_packet_t * e){
+    portENTER_CRITICAL(&_async_lock);
+    if(_async_tail){
+        _async_tail->next = e;
+    } else {
+        _async_head = e;
+    }
+    _async_tail = e;
+    portEXIT_CRITICAL(&_async_lock);
+    xTaskNotifyGive(_async_service_task_handle);
+}
+
+static lwip_event_packet_t * _async_event_get(){
+    portENTER_CRITICAL(&_async_lock);
+    lwip_event_packet_t * e = _async_head;
+    if(e){
+        _async_head = e->next;
+        if(!_async_head){
+            _async_tail = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&_async_lock);
+    return e;
+}
+
+// drop what is still queued for a client or server that goes away
+static void _async_event_discard(lwip_event_packet_t * e){
+    if(e->event == LWIP_TCP_RECV && e->recv.pb){
+        pbuf_free(e->recv.pb);
+    } else if(e->event == LWIP_TCP_ACCEPT){
+        delete e->client;
+    }
+    _async_event_free(e);
+}
+
+static void _async_events_remove(void * arg){
+    lwip_event_packet_t * removed = NULL;
+    portENTER_CRITICAL(&_async_lock);
+    lwip_event_packet_t ** p = &_async_head;
+    _async_tail = NULL;
+    while(*p){
+        lwip_event_packet_t * e = *p;
+        if(e->arg == arg){
+            *p = e->next;
+            e->next = removed;
+            removed = e;
+        } else {
+            _async_tail = e;
+            p = &e->next;
+        }
+    }
+    portEXIT_CRITICAL(&_async_lock);
+    // outside the lock, deleting an accepted client comes back here
+    while(removed){
+        lwip_event_packet_t * e = removed;
+        removed = e->next;
+        _async_event_discard(e);
+    }
+}
+
+static void _async_event_handle(lwip_event_packet_t * e){
+    AsyncClient * client = (AsyncClient *)e->arg;
+    // events of a pcb the client already let go of are stale
+    if(e->event != LWIP_TCP_ACCEPT && e->event != LWIP_TCP_ERROR && e->pcb != client->pcb()){
+        _async_event_discard(e);
+        return;
+    }
+    switch(e->event){
+        case LWIP_TCP_CONNECTED: client->_connected(e->pcb, e->err); break;
+        case LWIP_TCP_RECV:      client->_recv(e->pcb, e->recv.pb, e->recv.err); break;
+        case LWIP_TCP_FIN:       client->_fin(e->pcb, e->err); break;
+        case LWIP_TCP_SENT:      client->_sent(e->pcb, e->len); break;
+        case LWIP_TCP_POLL:      client->_poll(e->pcb); break;
+        case LWIP_TCP_ERROR:
+            if(!client->pcb()){
+                client->_error(e->err);
+            }
+            break;
+        case LWIP_TCP_ACCEPT:    ((AsyncServer *)e->arg)->_accepted(e->client); break;
+    }
+    _async_event_free(e);
+}
+
+static void _async_service_task(void *pvParameters){
+    lwip_event_packet_t * e = NULL;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while((e = _async_event_get()) != NULL){
+            TRACE_BEGIN(TRACE_ID_TCP_DISPATCH);
+            _async_event_handle(e);
+            TRACE_END(TRACE_ID_TCP_DISPATCH);
+        }
+    }
+    _async_service_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+static bool _start_async_task(){
+    if(!_async_event_pool && ASYNC_TCP_EVENT_POOL_BLOCKS){
+        _async_event_pool = poolCreate(sizeof(lwip_event_packet_t), ASYNC_TCP_EVENT_POOL_BLOCKS, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if(!_async_service_task_handle){
+        xTaskCreateUniversal(_async_service_task, "async_tcp", ASYNC_TCP_TASK_STACK_SIZE, NULL, ASYNC_TCP_TASK_PRIORITY, &_async_service_task_handle, CONFIG_ASYNC_TCP_RUNNING_CORE);
+        if(!_async_service_task_handle){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * lwIP callbacks, in the lwIP thread
+ */
+
+static int8_t _tcp_connected(void * arg, tcp_pcb * pcb, int8_t err){
+    lwip_event_packet_t * e = _async_event_alloc(LWIP_TCP_CONNECTED, arg, pcb);
+    if(!e){
+        return ERR_MEM;
+    }
+    e->err = err;
+    _async_event_post(e);
+    return ERR_OK;
+}
+
+static int8_t _tcp_poll(void * arg, tcp_pcb * pcb){
+    lwip_event_packet_t * e = _async_event_alloc(LWIP_TCP_POLL, arg, pcb);
+    if(e){
+        _async_event_post(e);
+    }
+    return ERR_OK;
+}
+
+static int8_t _tcp_recv(void * arg, tcp_pcb * pcb, pbuf * pb, int8_t err){
+    lwip_event_packet_t * e = _async_event_alloc(pb ? LWIP_TCP_RECV : LWIP_TCP_FIN, arg, pcb);
+    if(!e){
+        // lwIP keeps the data as refused and offers it again
+        return ERR_MEM;
+    }
+    if(pb){
+        e->recv.pb = pb;
+        e->recv.err = err;
+    } else {
+        e->err = err;
+    }
+    _async_event_post(e);
+    return ERR_OK;
+}
+
+static int8_t _tcp_sent(void * arg, tcp_pcb * pcb, uint16_t len){
+    lwip_event_packet_t * e = _async_event_alloc(LWIP_TCP_SENT, arg, pcb);
+    if(e){
+        e->len = len;
+        _async_event_post(e);
+    }
+    return ERR_OK;
+}
+
+static void _tcp_error(void * arg, int8_t err){
+    // lwIP has freed the pcb already
+    AsyncClient * client = (AsyncClient *)arg;
+    if(!client){
+        return;
+    }
+    client->_lwipError(err);
+    lwip_event_packet_t * e = _async_event_alloc(LWIP_TCP_ERROR, arg, NULL);
+    if(e){
+        e->err = err;
+        _async_event_post(e);
+    }
+}
+
+static void _tcp_detach(tcp_pcb * pcb){
+    tcp_arg(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+}
+
+static void _tcp_attach(tcp_pcb * pcb, void * arg){
+    tcp_arg(pcb, arg);
+    tcp_recv(pcb, &_tcp_recv);
+    tcp_sent(pcb, &_tcp_sent);
+    tcp_err(pcb, &_tcp_error);
+    tcp_poll(pcb, &_tcp_poll, 1);
+}
+
+static int8_t _tcp_accept(void * arg, tcp_pcb * pcb, int8_t err){
+    if(err != ERR_OK || !pcb){
+        return ERR_OK;
+    }
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    AsyncClient * client = new (std::nothrow) AsyncClient(pcb);
+    lwip_event_packet_t * e = client ? _async_event_alloc(LWIP_TCP_ACCEPT, arg, pcb) : NULL;
+    if(!e){
+        if(client){
+            // drop the pcb from the client first, its destructor must not call into this thread
+            _tcp_detach(pcb);
+            client->_lwipError(ERR_MEM);
+            delete client;
+        }
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    e->client = client;
+    _async_event_post(e);
+    return ERR_OK;
+}
+
+/*
+ * TCP API calls into the lwIP thread. They take the address of the owner's pcb
+ * pointer, since the pcb may have been freed by an error in the meantime.
+ */
+
+typedef struct {
+    struct tcpip_api_call_data call;
+    tcp_pcb ** pcb;
+    void * arg;
+    int8_t err;
+    union {
+        struct {
+            const char * data;
+            size_t size;
+            uint8_t apiflags;
+        } write;
+        size_t received;
+        struct {
+            const ip_addr_t * addr;
+            uint16_t port;
+            uint8_t backlog;
+        } bind;
+    };
+} tcp_api_call_t;
+
+static err_t _tcp_output_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    msg->err = *msg->pcb ? tcp_output(*msg->pcb) : ERR_CONN;
+    return msg->err;
+}
+
+static err_t _tcp_write_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    msg->err = *msg->pcb ? tcp_write(*msg->pcb, msg->write.data, msg->write.size, msg->write.apiflags) : ERR_CONN;
+    return msg->err;
+}
+
+static err_t _tcp_recved_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    msg->err = ERR_CONN;
+    if(*msg->pcb){
+        size_t len = msg->received;
+        while(len){
+            uint16_t chunk = (len > 0xFFFF) ? 0xFFFF : len;
+            tcp_recved(*msg->pcb, chunk);
+            len -= chunk;
+        }
+        msg->err = ERR_OK;
+    }
+    return msg->err;
+}
+
+static err_t _tcp_close_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    tcp_pcb * pcb = *msg->pcb;
+    msg->err = ERR_CONN;
+    if(pcb){
+        _tcp_detach(pcb);
+        msg->err = tcp_close(pcb);
+        if(msg->err != ERR_OK){
+            tcp_abort(pcb);
+            msg->err = ERR_ABRT;
+        }
+        *msg->pcb = NULL;
+    }
+    return msg->err;
+}
+
+static err_t _tcp_abort_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    tcp_pcb * pcb = *msg->pcb;
+    msg->err = ERR_CONN;
+    if(pcb){
+        _tcp_detach(pcb);
+        tcp_abort(pcb);
+        *msg->pcb = NULL;
+        msg->err = ERR_ABRT;
+    }
+    return msg->err;
+}
+
+static err_t _tcp_connect_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    tcp_pcb * pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+    if(!pcb){
+        msg->err = ERR_MEM;
+        return msg->err;
+    }
+    _tcp_attach(pcb, msg->arg);
+    msg->err = tcp_connect(pcb, msg->bind.addr, msg->bind.port, (tcp_connected_fn)&_tcp_connected);
+    if(msg->err != ERR_OK){
+        _tcp_detach(pcb);
+        tcp_abort(pcb);
+        return msg->err;
+    }
+    *msg->pcb = pcb;
+    return msg->err;
+}
+
+static err_t _tcp_listen_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    tcp_pcb * pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+    if(!pcb){
+        msg->err = ERR_MEM;
+        return msg->err;
+    }
+    msg->err = tcp_bind(pcb, msg->bind.addr, msg->bind.port);
+    if(msg->err != ERR_OK){
+        tcp_abort(pcb);
+        return msg->err;
+    }
+    tcp_pcb * lpcb = tcp_listen_with_backlog(pcb, msg->bind.backlog);
+    if(!lpcb){
+        tcp_abort(pcb);
+        msg->err = ERR_MEM;
+        return msg->err;
+    }
+    tcp_arg(lpcb, msg->arg);
+    tcp_accept(lpcb, (tcp_accept_fn)&_tcp_accept);
+    *msg->pcb = lpcb;
+    return msg->err;
+}
+
+static err_t _tcp_listen_close_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    tcp_pcb * pcb = *msg->pcb;
+    msg->err = ERR_CONN;
+    if(pcb){
+        tcp_arg(pcb, NULL);
+        tcp_accept(pcb, NULL);
+        msg->err = tcp_close(pcb);
+        if(msg->err != ERR_OK){
+            tcp_abort(pcb);
+        }
+        *msg->pcb = NULL;
+    }
+    return msg->err;
+}
+
+static int8_t _tcp_call(tcpip_api_call_fn fn, tcp_pcb ** pcb, tcp_api_call_t * msg){
+    msg->pcb = pcb;
+    tcpip_api_call(fn, (struct tcpip_api_call_data*)msg);
+    return msg->err;
+}
+
+/*
+ * AsyncClient
+ */
+
+AsyncClient::AsyncClient(tcp_pcb * pcb)
+: _pcb(pcb)
+, _connect_cb(0), _connect_cb_arg(0)
+, _discard_cb(0), _discard_cb_arg(0)
+, _sent_cb(0), _sent_cb_arg(0)
+, _error_cb(0), _error_cb_arg(0)
+, _recv_cb(0), _recv_cb_arg(0)
+, _pb_cb(0), _pb_cb_arg(0)
+, _timeout_cb(0), _timeout_cb_arg(0)
+, _poll_cb(0), _poll_cb_arg(0)
+, _pcb_busy(false)
+, _pcb_sent_at(0)
+, _ack_pcb(true)
+, _rx_ack_len(0)
+, _rx_last_packet(0)
+, _rx_since_timeout(0)
+, _ack_timeout(ASYNC_MAX_ACK_TIME)
+{
+    if(_pcb){
+        // accepted connection, this runs in the lwIP thread
+        _rx_last_packet = millis();
+        _tcp_attach(_pcb, this);
+    }
+}
+
+AsyncClient::~AsyncClient(){
+    if(_pcb){
+        _close();
+    }
+    _async_events_remove(this);
+}
+
+bool AsyncClient::connect(IPAddress ip, uint16_t port){
+    if(_pcb){
+        log_w("already connected, state %d", _pcb->state);
+        return false;
+    }
+    if(!_start_async_task()){
+        log_e("failed to start task");
+        return false;
+    }
+    ip_addr_t addr;
+    addr.type = IPADDR_TYPE_V4;
+    addr.u_addr.ip4.addr = ip;
+    tcp_api_call_t msg;
+    msg.arg = this;
+    msg.bind.addr = &addr;
+    msg.bind.port = port;
+    int8_t err = _tcp_call(_tcp_connect_api, &_pcb, &msg);
+    if(err != ERR_OK){
+        log_e("connect failed: %s", errorToString(err));
+        return false;
+    }
+    return true;
+}
+
+void AsyncClient::close(bool now){
+    if(!_pcb){
+        return;
+    }
+    if(now){
+        abort();
+    } else {
+        _close();
+    }
+}
+
+int8_t AsyncClient::abort(){
+    tcp_api_call_t msg;
+    int8_t err = _tcp_call(_tcp_abort_api, &_pcb, &msg);
+    if(err == ERR_ABRT){
+        _disconnected();
+    }
+    return err;
+}
+
+int8_t AsyncClient::_close(){
+    tcp_api_call_t msg;
+    int8_t err = _tcp_call(_tcp_close_api, &_pcb, &msg);
+    if(err != ERR_CONN){
+        _disconnected();
+    }
+    return err;
+}
+
+// last thing touching the object, the handler may delete it
+void AsyncClient::_disconnected(){
+    if(_discard_cb){
+        _discard_cb(_discard_cb_arg, this);
+    }
+}
+
+bool AsyncClient::canSend(){
+    return space() > 0;
+}
+
+size_t AsyncClient::space(){
+    tcp_pcb * pcb = _pcb;
+    if(pcb && pcb->state == ESTABLISHED){
+        return tcp_sndbuf(pcb);
+    }
+    return 0;
+}
+
+size_t AsyncClient::add(const char * data, size_t size, uint8_t apiflags){
+    if(!_pcb || !size || !data){
+        return 0;
+    }
+    size_t room = space();
+    if(!room){
+        return 0;
+    }
+    tcp_api_call_t msg;
+    msg.write.data = data;
+    msg.write.size = (size < room) ? size : room;
+    msg.write.apiflags = apiflags;
+    if(_tcp_call(_tcp_write_api, &_pcb, &msg) != ERR_OK){
+        return 0;
+    }
+    return msg.write.size;
+}
+
+bool AsyncClient::send(){
+    tcp_api_call_t msg;
+    if(_tcp_call(_tcp_output_api, &_pcb, &msg) != ERR_OK){
+        return false;
+    }
+    _pcb_busy = true;
+    _pcb_sent_at = millis();
+    return true;
+}
+
+size_t AsyncClient::write(const char * data){
+    if(!data){
+        return 0;
+    }
+    return write(data, strlen(data));
+}
+
+size_t AsyncClient::write(const char * data, size_t size, uint8_t apiflags){
+    size_t will_send = add(data, size, apiflags);
+    if(!will_send || !send()){
+        return 0;
+    }
+    return will_send;
+}
+
+size_t AsyncClient::ack(size_t len){
+    if(len > _rx_ack_len){
+        len = _rx_ack_len;
+    }
+    if(len){
+        tcp_api_call_t msg;
+        msg.received = len;
+        _tcp_call(_tcp_recved_api, &_pcb, &msg);
+        _rx_ack_len -= len;
+    }
+    return len;
+}
+
+void AsyncClient::ackPacket(struct pbuf * pb){
+    if(!pb){
+        return;
+    }
+    tcp_api_call_t msg;
+    msg.received = pb->len;
+    _tcp_call(_tcp_recved_api, &_pcb, &msg);
+    pbuf_free(pb);
+}
+
+/*
+ * events, in the async_tcp task
+ */
+
+void AsyncClient::_lwipError(int8_t err){
+    _pcb = NULL;
+}
+
+void AsyncClient::_connected(tcp_pcb * pcb, int8_t err){
+    _pcb_busy = false;
+    _rx_last_packet = millis();
+    if(_connect_cb){
+        _connect_cb(_connect_cb_arg, this);
+    }
+}
+
+void AsyncClient::_error(int8_t err){
+    if(_error_cb){
+        _error_cb(_error_cb_arg, this, err);
+    }
+    _disconnected();
+}
+
+void AsyncClient::_fin(tcp_pcb * pcb, int8_t err){
+    // the peer is done sending, finish our side too
+    _close();
+}
+
+void AsyncClient::_sent(tcp_pcb * pcb, uint16_t len){
+    _rx_last_packet = millis();
+    _pcb_busy = false;
+    if(_sent_cb){
+        _sent_cb(_sent_cb_arg, this, len, millis() - _pcb_sent_at);
+    }
+}
+
+void AsyncClient::_recv(tcp_pcb * pcb, pbuf * pb, int8_t err){
+    while(pb != NULL){
+        _rx_last_packet = millis();
+        _ack_pcb = true;
+        pbuf * b = pb;
+        pb = b->next;
+        b->next = NULL;
+        if(_pb_cb){
+            _pb_cb(_pb_cb_arg, this, b);
+            continue;
+        }
+        if(_recv_cb){
+            _recv_cb(_recv_cb_arg, this, b->payload, b->len);
+        }
+        if(!_ack_pcb){
+            _rx_ack_len += b->len;
+        } else if(_pcb){
+            tcp_api_call_t msg;
+            msg.received = b->len;
+            _tcp_call(_tcp_recved_api, &_pcb, &msg);
+        }
+        pbuf_free(b);
+    }
+}
+
+void AsyncClient::_poll(tcp_pcb * pcb){
+    uint32_t now = millis();
+    if(_pcb_busy && _ack_timeout && (now - _pcb_sent_at) >= _ack_timeout){
+        _pcb_busy = false;
+        log_w("ack timeout %d", pcb->state);
+        if(_timeout_cb){
+            _timeout_cb(_timeout_cb_arg, this, now - _pcb_sent_at);
+        }
+        return;
+    }
+    if(_rx_since_timeout && (now - _rx_last_packet) >= (_rx_since_timeout * 1000)){
+        log_w("rx timeout %d", pcb->state);
+        _close();
+        return;
+    }
+    if(_poll_cb){
+        _poll_cb(_poll_cb_arg, this);
+    }
+}
+
+/*
+ * state and settings
+ */
+
+uint8_t AsyncClient::state(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? pcb->state : 0;
+}
+
+bool AsyncClient::connecting(){
+    uint8_t s = state();
+    return s > CLOSED && s < ESTABLISHED;
+}
+
+bool AsyncClient::connected(){
+    return state() == ESTABLISHED;
+}
+
+bool AsyncClient::disconnecting(){
+    return state() > ESTABLISHED && state() < TIME_WAIT;
+}
+
+bool AsyncClient::disconnected(){
+    uint8_t s = state();
+    return s == CLOSED || s == TIME_WAIT;
+}
+
+bool AsyncClient::freeable(){
+    uint8_t s = state();
+    return s == CLOSED || s > ESTABLISHED;
+}
+
+uint16_t AsyncClient::getMss(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? tcp_mss(pcb) : 0;
+}
+
+uint32_t AsyncClient::getRxTimeout(){
+    return _rx_since_timeout;
+}
+
+void AsyncClient::setRxTimeout(uint32_t timeout){
+    _rx_since_timeout = timeout;
+}
+
+uint32_t AsyncClient::getAckTimeout(){
+    return _ack_timeout;
+}
+
+void AsyncClient::setAckTimeout(uint32_t timeout){
+    _ack_timeout = timeout;
+}
+
+void AsyncClient::setNoDelay(bool nodelay){
+    tcp_pcb * pcb = _pcb;
+    if(!pcb){
+        return;
+    }
+    if(nodelay){
+        tcp_nagle_disable(pcb);
+    } else {
+        tcp_nagle_enable(pcb);
+    }
+}
+
+bool AsyncClient::getNoDelay(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? tcp_nagle_disabled(pcb) : false;
+}
+
+IPAddress AsyncClient::remoteIP(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? IPAddress(pcb->remote_ip.u_addr.ip4.addr) : IPAddress();
+}
+
+uint16_t AsyncClient::remotePort(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? pcb->remote_port : 0;
+}
+
+IPAddress AsyncClient::localIP(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? IPAddress(pcb->local_ip.u_addr.ip4.addr) : IPAddress();
+}
+
+uint16_t AsyncClient::localPort(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? pcb->local_port : 0;
+}
+
+void AsyncClient::onConnect(AcConnectHandler cb, void * arg){
+    _connect_cb = cb;
+    _connect_cb_arg = arg;
+}
+
+void AsyncClient::onDisconnect(AcConnectHandler cb, void * arg){
+    _discard_cb = cb;
+    _discard_cb_arg = arg;
+}
+
+void AsyncClient::onAck(AcAckHandler cb, void * arg){
+    _sent_cb = cb;
+    _sent_cb_arg = arg;
+}
+
+void AsyncClient::onError(AcErrorHandler cb, void * arg){
+    _error_cb = cb;
+    _error_cb_arg = arg;
+}
+
+void AsyncClient::onData(AcDataHandler cb, void * arg){
+    _recv_cb = cb;
+    _recv_cb_arg = arg;
+}
+
+void AsyncClient::onPacket(AcPacketHandler cb, void * arg){
+    _pb_cb = cb;
+    _pb_cb_arg = arg;
+}
+
+void AsyncClient::onTimeout(AcTimeoutHandler cb, void * arg){
+    _timeout_cb = cb;
+    _timeout_cb_arg = arg;
+}
+
+void AsyncClient::onPoll(AcConnectHandler cb, void * arg){
+    _poll_cb = cb;
+    _poll_cb_arg = arg;
+}
+
+const char * AsyncClient::errorToString(int8_t error){
+    switch(error){
+        case ERR_OK: return "OK";
+        case ERR_MEM: return "Out of memory error";
+        case ERR_BUF: return "Buffer error";
+        case ERR_TIMEOUT: return "Timeout";
+        case ERR_RTE: return "Routing problem";
+        case ERR_INPROGRESS: return "Operation in progress";
+        case ERR_VAL: return "Illegal value";
+        case ERR_WOULDBLOCK: return "Operation would block";
+        case ERR_USE: return "Address in use";
+        case ERR_ALREADY: return "Already connected";
+        case ERR_CONN: return "Not connected";
+        case ERR_IF: return "Low-level netif error";
+        case ERR_ABRT: return "Connection aborted";
+        case ERR_RST: return "Connection reset";
+        case ERR_CLSD: return "Connection closed";
+        case ERR_ARG: return "Illegal argument";
+        default: return "UNKNOWN";
+    }
+}
+
+const char * AsyncClient::stateToString(){
+    switch(state()){
+        case 0: return "Closed";
+        case 1: return "Listen";
+        case 2: return "SYN Sent";
+        case 3: return "SYN Received";
+        case 4: return "Established";
+        case 5: return "FIN Wait 1";
+        case 6: return "FIN Wait 2";
+        case 7: return "Close Wait";
+        case 8: return "Closing";
+        case 9: return "Last ACK";
+        case 10: return "Time Wait";
+        default: return "UNKNOWN";
+    }
+}
+
+/*
+ * AsyncServer
+ */
+
+AsyncServer::AsyncServer(IPAddress addr, uint16_t port)
+: _port(port)
+, _addr(addr)
+, _noDelay(false)
+, _backlog(TCP_DEFAULT_LISTEN_BACKLOG)
+, _pcb(NULL)
+, _connect_cb(0)
+, _connect_cb_arg(0)
+{}
+
+AsyncServer::AsyncServer(uint16_t port)
+: _port(port)
+, _addr((uint32_t) IPADDR_ANY)
+, _noDelay(false)
+, _backlog(TCP_DEFAULT_LISTEN_BACKLOG)
+, _pcb(NULL)
+, _connect_cb(0)
+, _connect_cb_arg(0)
+{}
+
+AsyncServer::~AsyncServer(){
+    end();
+}
+
+void AsyncServer::onClient(AcConnectHandler cb, void * arg){
+    _connect_cb = cb;
+    _connect_cb_arg = arg;
+}
+
+void AsyncServer::begin(){
+    if(_pcb){
+        return;
+    }
+    if(!_start_async_task()){
+        log_e("failed to start task");
+        return;
+    }
+    ip_addr_t local_addr;
+    local_addr.type = IPADDR_TYPE_V4;
+    local_addr.u_addr.ip4.addr = (uint32_t) _addr;
+    tcp_api_call_t msg;
+    msg.arg = this;
+    msg.bind.addr = &local_addr;
+    msg.bind.port = _port;
+    msg.bind.backlog = _backlog;
+    int8_t err = _tcp_call(_tcp_listen_api, &_pcb, &msg);
+    if(err != ERR_OK){
+        log_e("listen on port %u failed: %d", _port, err);
+    }
+}
+
+void AsyncServer::end(){
+    if(_pcb){
+        tcp_api_call_t msg;
+        _tcp_call(_tcp_listen_close_api, &_pcb, &msg);
+    }
+    // connections accepted but not handed out yet are dropped
+    _async_events_remove(this);
+}
+
+void AsyncServer::_accepted(AsyncClient * client){
+    if(!_connect_cb){
+        client->close(true);
+        delete client;
+        return;
+    }
+    client->setNoDelay(_noDelay);
+    _connect_cb(_connect_cb_arg, client);
+}
+
+void AsyncServer::setNoDelay(bool nodelay){
+    _noDelay = nodelay;
+}
+
+bool AsyncServer::getNoDelay(){
+    return _noDelay;
+}
+
+uint8_t AsyncServer::status(){
+    tcp_pcb * pcb = _pcb;
+    return pcb ? pcb->state : 0;
+}
@@ -0,0 +1,157 @@
+#ifndef ASYNCTCP_H_
+#define ASYNCTCP_H_
+
+#include "IPAddress.h"
+#include <functional>
+extern "C" {
+#include "freertos/FreeRTOS.h"
+}
+
+class AsyncClient;
+class AsyncServer;
+struct tcp_pcb;
+struct pbuf;
+
+#define ASYNC_MAX_ACK_TIME    5000
+#define ASYNC_WRITE_FLAG_COPY 0x01 //copy the data into lwIP, otherwise it is referenced until onAck() reports it sent
+#define ASYNC_WRITE_FLAG_MORE 0x02 //more data follows, do not set PSH on this segment
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, struct pbuf *pb)> AcPacketHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+
+/*
+ * Callbacks run in the async_tcp task, never in the lwIP thread, so they may
+ * call back into the client. Received data is acknowledged to the peer only
+ * after onData() returns (or later with ack()), so a slow consumer closes the
+ * TCP window instead of queueing pbufs.
+ */
+class AsyncClient {
+  public:
+    AsyncClient(tcp_pcb * pcb = NULL);
+    ~AsyncClient();
+
+    bool connect(IPAddress ip, uint16_t port);
+    void close(bool now = false);
+    int8_t abort();
+
+    bool canSend();                 //the send buffer has room
+    size_t space();                 //bytes tcp_write() accepts right now
+    //queue data, returns what fitted into space(); without ASYNC_WRITE_FLAG_COPY
+    //data must stay valid until onAck() has covered it
+    size_t add(const char * data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    bool send();                    //push everything added so far
+    //add() + send()
+    size_t write(const char * data);
+    size_t write(const char * data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
+    uint8_t state();
+    bool connecting();
+    bool connected();
+    bool disconnecting();
+    bool disconnected();
+    bool freeable();                //disconnected or disconnecting
+
+    uint16_t getMss();
+
+    uint32_t getRxTimeout();
+    void setRxTimeout(uint32_t timeout);    //close after this many seconds without data, 0 off
+    uint32_t getAckTimeout();
+    void setAckTimeout(uint32_t timeout);   //onTimeout() after this many ms without an ACK, 0 off
+
+    void setNoDelay(bool nodelay);
+    bool getNoDelay();
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    IPAddress localIP();
+    uint16_t localPort();
+
+    void onConnect(AcConnectHandler cb, void * arg = NULL);     //connection established
+    void onDisconnect(AcConnectHandler cb, void * arg = NULL);  //closed by either side, the client may be deleted here
+    void onAck(AcAckHandler cb, void * arg = NULL);             //sent data acknowledged
+    void onError(AcErrorHandler cb, void * arg = NULL);         //connect failed or connection lost
+    void onData(AcDataHandler cb, void * arg = NULL);           //data received, one call per pbuf
+    void onPacket(AcPacketHandler cb, void * arg = NULL);       //data received as pbuf, release with ackPacket()
+    void onTimeout(AcTimeoutHandler cb, void * arg = NULL);     //no ACK within the ack timeout
+    void onPoll(AcConnectHandler cb, void * arg = NULL);        //every 500ms while connected
+
+    void ackPacket(struct pbuf * pb);   //ack and free a pbuf from onPacket()
+    size_t ack(size_t len);             //ack data held back by ackLater()
+    void ackLater(){ _ack_pcb = false; }//call from onData() to keep the window closed
+
+    const char * errorToString(int8_t error);
+    const char * stateToString();
+
+    //used by the lwIP and async_tcp glue only
+    void _lwipError(int8_t err);
+    void _connected(tcp_pcb * pcb, int8_t err);
+    void _error(int8_t err);
+    void _recv(tcp_pcb * pcb, pbuf * pb, int8_t err);
+    void _fin(tcp_pcb * pcb, int8_t err);
+    void _sent(tcp_pcb * pcb, uint16_t len);
+    void _poll(tcp_pcb * pcb);
+    tcp_pcb * pcb(){ return _pcb; }
+
+  protected:
+    tcp_pcb * _pcb;
+
+    AcConnectHandler _connect_cb;
+    void * _connect_cb_arg;
+    AcConnectHandler _discard_cb;
+    void * _discard_cb_arg;
+    AcAckHandler _sent_cb;
+    void * _sent_cb_arg;
+    AcErrorHandler _error_cb;
+    void * _error_cb_arg;
+    AcDataHandler _recv_cb;
+    void * _recv_cb_arg;
+    AcPacketHandler _pb_cb;
+    void * _pb_cb_arg;
+    AcTimeoutHandler _timeout_cb;
+    void * _timeout_cb_arg;
+    AcConnectHandler _poll_cb;
+    void * _poll_cb_arg;
+
+    bool _pcb_busy;
+    uint32_t _pcb_sent_at;
+    bool _ack_pcb;
+    uint32_t _rx_ack_len;
+    uint32_t _rx_last_packet;
+    uint32_t _rx_since_timeout;
+    uint32_t _ack_timeout;
+
+    int8_t _close();
+    void _disconnected();
+};
+
+class AsyncServer {
+  public:
+    AsyncServer(IPAddress addr, uint16_t port);
+    AsyncServer(uint16_t port);
+    ~AsyncServer();
+    void onClient(AcConnectHandler cb, void * arg);
+    void begin();
+    void end();
+    void setNoDelay(bool nodelay);
+    bool getNoDelay();
+    void setBacklog(uint8_t backlog){ _backlog = backlog; } //takes effect on begin()
+    uint8_t status();
+
+    //used by the lwIP and async_tcp glue only
+    void _accepted(AsyncClient * client);
+
+  protected:
+    uint16_t _port;
+    IPAddress _addr;
+    bool _noDelay;
+    uint8_t _backlog;
+    tcp_pcb * _pcb;
+    AcConnectHandler _connect_cb;
+    void * _connect_cb_arg;
+};
+
+#endif /* ASYNCTCP_H_ */
@@ -114,6 +114,48 @@ static err_t _udp_sendto_if(struct udp_pcb *pcb, struct pbuf *pb, const ip_addr_
     return msg.err;
 }
 
+typedef struct {
+    struct tcpip_api_call_data call;
+    udp_pcb * pcb;
+    async_udp_batch_entry_t * entries;
+    size_t count;
+    size_t sent;
+    struct netif *netif;
+    err_t err;
+} udp_batch_api_call_t;
+
+static err_t _udp_sendto_batch_api(struct tcpip_api_call_data *api_call_msg){
+    udp_batch_api_call_t * msg = (udp_batch_api_call_t *)api_call_msg;
+    msg->err = ERR_OK;
+    msg->sent = 0;
+    for(size_t i = 0; i < msg->count; i++){
+        async_udp_batch_entry_t * e = &msg->entries[i];
+        err_t err;
+        if(msg->netif){
+            err = udp_sendto_if(msg->pcb, e->pb, &e->addr, e->port, msg->netif);
+        } else {
+            err = udp_sendto(msg->pcb, e->pb, &e->addr, e->port);
+        }
+        if(err == ERR_OK){
+            msg->sent++;
+        } else {
+            msg->err = err;
+        }
+    }
+    return msg->err;
+}
+
+static size_t _udp_sendto_batch(struct udp_pcb *pcb, async_udp_batch_entry_t * entries, size_t count, struct netif *netif, err_t * err){
+    udp_batch_api_call_t msg;
+    msg.pcb = pcb;
+    msg.entries = entries;
+    msg.count = count;
+    msg.netif = netif;
+    tcpip_api_call(_udp_sendto_batch_api, (struct tcpip_api_call_data*)&msg);
+    *err = msg.err;
+    return msg.sent;
+}
+
 typedef struct {
         void *arg;
         udp_pcb *pcb;
@@ -123,47 +165,92 @@ typedef struct {
         struct netif * netif;
 } lwip_event_packet_t;
 
-static xQueueHandle _udp_queue;
-static volatile TaskHandle_t _udp_task_handle = NULL;
+// packets are spread over this many dispatch tasks, each socket always lands on the same one
+#ifndef ASYNC_UDP_TASK_COUNT
+#define ASYNC_UDP_TASK_COUNT 1
+#endif
+
+#ifndef ASYNC_UDP_QUEUE_LENGTH
+#define ASYNC_UDP_QUEUE_LENGTH 32
+#endif
+
+static xQueueHandle _udp_queue[ASYNC_UDP_TASK_COUNT];
+static volatile TaskHandle_t _udp_task_handle[ASYNC_UDP_TASK_COUNT];
+static volatile uint32_t _udp_dropped = 0;
+
+// one event per queued packet, taken from a fixed pool so packets do not churn the heap
+#ifndef ASYNC_UDP_EVENT_POOL_BLOCKS
+#define ASYNC_UDP_EVENT_POOL_BLOCKS 32
+#endif
+
+static pool_t * _udp_event_pool = NULL;
+
+static lwip_event_packet_t * _udp_event_alloc(){
+    lwip_event_packet_t * e = (lwip_event_packet_t *)poolAlloc(_udp_event_pool);
+    if(!e){
+        e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    }
+    return e;
+}
+
+static void _udp_event_free(lwip_event_packet_t * e){
+    if(!poolFree(_udp_event_pool, e)){
+        free((void*)(e));
+    }
+}
+
+static inline size_t _udp_shard(void *arg){
+    return ((uintptr_t)arg >> 4) % ASYNC_UDP_TASK_COUNT;
+}
 
 static void _udp_task(void *pvParameters){
+    size_t shard = (size_t)pvParameters;
     lwip_event_packet_t * e = NULL;
     for (;;) {
-        if(xQueueReceive(_udp_queue, &e, portMAX_DELAY) == pdTRUE){
+        if(xQueueReceive(_udp_queue[shard], &e, portMAX_DELAY) == pdTRUE){
             if(!e->pb){
-                free((void*)(e));
+                _udp_event_free(e);
                 continue;
             }
+            TRACE_BEGIN(TRACE_ID_UDP_DISPATCH);
             AsyncUDP::_s_recv(e->arg, e->pcb, e->pb, e->addr, e->port, e->netif);
-            free((void*)(e));
+            TRACE_END(TRACE_ID_UDP_DISPATCH);
+            _udp_event_free(e);
         }
     }
-    _udp_task_handle = NULL;
+    _udp_task_handle[shard] = NULL;
     vTaskDelete(NULL);
 }
 
 static bool _udp_task_start(){
-    if(!_udp_queue){
-        _udp_queue = xQueueCreate(32, sizeof(lwip_event_packet_t *));
-        if(!_udp_queue){
-            return false;
-        }
+    if(!_udp_event_pool && ASYNC_UDP_EVENT_POOL_BLOCKS){
+        _udp_event_pool = poolCreate(sizeof(lwip_event_packet_t), ASYNC_UDP_EVENT_POOL_BLOCKS, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     }
-    if(!_udp_task_handle){
-        xTaskCreateUniversal(_udp_task, "async_udp", 4096, NULL, CONFIG_ARDUINO_UDP_TASK_PRIORITY, (TaskHandle_t*)&_udp_task_handle, CONFIG_ARDUINO_UDP_RUNNING_CORE);
-        if(!_udp_task_handle){
-            return false;
+    for(size_t i = 0; i < ASYNC_UDP_TASK_COUNT; i++){
+        if(!_udp_queue[i]){
+            _udp_queue[i] = xQueueCreate(ASYNC_UDP_QUEUE_LENGTH, sizeof(lwip_event_packet_t *));
+            if(!_udp_queue[i]){
+                return false;
+            }
+        }
+        if(!_udp_task_handle[i]){
+            xTaskCreateUniversal(_udp_task, "async_udp", 4096, (void *)i, CONFIG_ARDUINO_UDP_TASK_PRIORITY, (TaskHandle_t*)&_udp_task_handle[i], CONFIG_ARDUINO_UDP_RUNNING_CORE);
+            if(!_udp_task_handle[i]){
+                return false;
+            }
         }
     }
     return true;
 }
 
+// never blocks the lwIP thread: a full queue drops the packet and counts it
 static bool _udp_task_post(void *arg, udp_pcb *pcb, pbuf *pb, const ip_addr_t *addr, uint16_t port, struct netif *netif)
 {
-    if(!_udp_task_handle || !_udp_queue){
+    size_t shard = _udp_shard(arg);
+    if(!_udp_task_handle[shard] || !_udp_queue[shard]){
         return false;
     }
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _udp_event_alloc();
     if(!e){
         return false;
     }
@@ -173,8 +260,8 @@ static bool _udp_task_post(void *arg, udp_pcb *pcb, pbuf *pb, const ip_addr_t *a
     e->addr = addr;
     e->port = port;
     e->netif = netif;
-    if (xQueueSend(_udp_queue, &e, portMAX_DELAY) != pdPASS) {
-        free((void*)(e));
+    if (xQueueSend(_udp_queue[shard], &e, 0) != pdPASS) {
+        _udp_event_free(e);
         return false;
     }
     return true;
@@ -182,13 +269,15 @@ static bool _udp_task_post(void *arg, udp_pcb *pcb, pbuf *pb, const ip_addr_t *a
 
 static void _udp_recv(void *arg, udp_pcb *pcb, pbuf *pb, const ip_addr_t *addr, uint16_t port)
 {
-    while(pb != NULL) {
-        pbuf * this_pb = pb;
-        pb = pb->next;
-        this_pb->next = NULL;
-        if(!_udp_task_post(arg, pcb, this_pb, addr, port, ip_current_input_netif())){
-            pbuf_free(this_pb);
-        }
+    if(AsyncUDP::_s_direct(arg)){
+        AsyncUDP::_s_recv(arg, pcb, pb, addr, port, ip_current_input_netif());
+        return;
+    }
+    // a chain is one reassembled datagram, it travels as a whole
+    if(!_udp_task_post(arg, pcb, pb, addr, port, ip_current_input_netif())){
+        _udp_dropped++;
+        AsyncUDP::_s_dropped(arg);
+        pbuf_free(pb);
     }
 }
 /*
@@ -277,25 +366,86 @@ void AsyncUDPMessage::flush()
     _index = 0;
 }
 
-AsyncUDPPacket::AsyncUDPPacket(AsyncUDPPacket &packet){
+AsyncUDPSegment AsyncUDPSegmentIterator::operator*() const
+{
+    AsyncUDPSegment segment = { (const uint8_t *)_pb->payload, _pb->len };
+    return segment;
+}
+
+AsyncUDPSegmentIterator & AsyncUDPSegmentIterator::operator++()
+{
+    _pb = _pb->next;
+    return *this;
+}
+
+void AsyncUDPPacket::_copyFrom(const AsyncUDPPacket &packet){
     _udp = packet._udp;
     _pb = packet._pb;
     _if = packet._if;
+    _localIp = packet._localIp;
+    _localPort = packet._localPort;
+    _remoteIp = packet._remoteIp;
+    _remotePort = packet._remotePort;
+    memcpy(_remoteMac, packet._remoteMac, 6);
     _data = packet._data;
     _len = packet._len;
     _index = 0;
+    _flat = NULL;
+}
 
+AsyncUDPPacket::AsyncUDPPacket(const AsyncUDPPacket &packet){
+    _copyFrom(packet);
     pbuf_ref(_pb);
 }
 
+AsyncUDPPacket::AsyncUDPPacket(AsyncUDPPacket &&packet){
+    _copyFrom(packet);
+    _index = packet._index;
+    _flat = packet._flat;
+    packet._pb = NULL;
+    packet._flat = NULL;
+    packet._data = NULL;
+    packet._len = packet._index = 0;
+}
+
+AsyncUDPPacket & AsyncUDPPacket::operator=(const AsyncUDPPacket &packet){
+    if(this != &packet){
+        pbuf_ref(packet._pb);
+        if(_pb){
+            pbuf_free(_pb);
+        }
+        free(_flat);
+        _copyFrom(packet);
+    }
+    return *this;
+}
+
+AsyncUDPPacket & AsyncUDPPacket::operator=(AsyncUDPPacket &&packet){
+    if(this != &packet){
+        if(_pb){
+            pbuf_free(_pb);
+        }
+        free(_flat);
+        _copyFrom(packet);
+        _index = packet._index;
+        _flat = packet._flat;
+        packet._pb = NULL;
+        packet._flat = NULL;
+        packet._data = NULL;
+        packet._len = packet._index = 0;
+    }
+    return *this;
+}
+
 AsyncUDPPacket::AsyncUDPPacket(AsyncUDP *udp, pbuf *pb, const ip_addr_t *raddr, uint16_t rport, struct netif * ntif)
 {
     _udp = udp;
     _pb = pb;
     _if = TCPIP_ADAPTER_IF_MAX;
     _data = (uint8_t*)(pb->payload);
-    _len = pb->len;
+    _len = pb->tot_len;
     _index = 0;
+    _flat = NULL;
 
     pbuf_ref(_pb);
 
@@ -336,12 +486,33 @@ AsyncUDPPacket::AsyncUDPPacket(AsyncUDP *udp, pbuf *pb, const ip_addr_t *raddr,
 
 AsyncUDPPacket::~AsyncUDPPacket()
 {
-    pbuf_free(_pb);
+    if(_pb){
+        pbuf_free(_pb);
+    }
+    free(_flat);
 }
 
 uint8_t * AsyncUDPPacket::data()
 {
-    return _data;
+    if(_pb && _pb->next && !_flat){
+        _flat = (uint8_t *)malloc(_len);
+        if(!_flat){
+            log_e("no memory to flatten %u byte packet", _len);
+            return NULL;
+        }
+        pbuf_copy_partial(_pb, _flat, _len, 0);
+    }
+    return _flat ? _flat : _data;
+}
+
+bool AsyncUDPPacket::isChained()
+{
+    return _pb && _pb->next;
+}
+
+AsyncUDPSegments AsyncUDPPacket::segments()
+{
+    return AsyncUDPSegments(_pb);
 }
 
 size_t AsyncUDPPacket::length()
@@ -354,27 +525,32 @@ int AsyncUDPPacket::available(){
 }
 
 size_t AsyncUDPPacket::read(uint8_t *data, size_t len){
-    size_t i;
     size_t a = _len - _index;
     if(len > a){
         len = a;
     }
-    for(i=0;i<len;i++){
-        data[i] = read();
+    if(!len){
+        return 0;
+    }
+    if(!_pb->next){
+        memcpy(data, _data + _index, len);
+    } else {
+        pbuf_copy_partial(_pb, data, len, _index);
     }
+    _index += len;
     return len;
 }
 
 int AsyncUDPPacket::read(){
     if(_index < _len){
-        return _data[_index++];
+        return _pb->next ? pbuf_get_at(_pb, _index++) : _data[_index++];
     }
     return -1;
 }
 
 int AsyncUDPPacket::peek(){
     if(_index < _len){
-        return _data[_index];
+        return _pb->next ? pbuf_get_at(_pb, _index) : _data[_index];
     }
     return -1;
 }
@@ -491,6 +667,8 @@ AsyncUDP::AsyncUDP()
     _connected = false;
 	_lastErr = ERR_OK;
     _handler = NULL;
+    _direct = false;
+    _dropped = 0;
 }
 
 AsyncUDP::~AsyncUDP()
@@ -684,18 +862,136 @@ size_t AsyncUDP::writeTo(const uint8_t * data, size_t len, const ip_addr_t * add
     return 0;
 }
 
-void AsyncUDP::_recv(udp_pcb *upcb, pbuf *pb, const ip_addr_t *addr, uint16_t port, struct netif * netif)
+size_t AsyncUDP::sendBatch(AsyncUDPBatch &batch, tcpip_adapter_if_t tcpip_if)
 {
-    while(pb != NULL) {
-        pbuf * this_pb = pb;
-        pb = pb->next;
-        this_pb->next = NULL;
-        if(_handler) {
-            AsyncUDPPacket packet(this, this_pb, addr, port, netif);
-            _handler(packet);
+    if(!batch._count) {
+        return 0;
+    }
+    if(!_pcb) {
+        UDP_MUTEX_LOCK();
+        _pcb = udp_new();
+        UDP_MUTEX_UNLOCK();
+        if(_pcb == NULL) {
+            batch.clear();
+            return 0;
         }
-        pbuf_free(this_pb);
     }
+    struct netif * netif = NULL;
+    if(tcpip_if < TCPIP_ADAPTER_IF_MAX){
+        void * nif = NULL;
+        tcpip_adapter_get_netif((tcpip_adapter_if_t)tcpip_if, &nif);
+        netif = (struct netif *)nif;
+    }
+    err_t err = ERR_OK;
+    UDP_MUTEX_LOCK();
+    size_t sent = _udp_sendto_batch(_pcb, batch._entries, batch._count, netif, &err);
+    UDP_MUTEX_UNLOCK();
+    _lastErr = err;
+    batch.clear();
+    return sent;
+}
+
+AsyncUDPBatch::AsyncUDPBatch(size_t maxPackets)
+{
+    _count = 0;
+    _entries = (async_udp_batch_entry_t *)calloc(maxPackets, sizeof(async_udp_batch_entry_t));
+    _max = _entries ? maxPackets : 0;
+}
+
+AsyncUDPBatch::~AsyncUDPBatch()
+{
+    clear();
+    free(_entries);
+}
+
+bool AsyncUDPBatch::add(const uint8_t *data, size_t len, const ip_addr_t *addr, uint16_t port)
+{
+    if(_count >= _max || !addr) {
+        return false;
+    }
+    if(len > CONFIG_TCP_MSS) {
+        len = CONFIG_TCP_MSS;
+    }
+    pbuf* pbt = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if(pbt == NULL) {
+        return false;
+    }
+    memcpy(pbt->payload, data, len);
+    async_udp_batch_entry_t * e = &_entries[_count++];
+    e->pb = pbt;
+    ip_addr_copy(e->addr, *addr);
+    e->port = port;
+    return true;
+}
+
+bool AsyncUDPBatch::add(const uint8_t *data, size_t len, const IPAddress addr, uint16_t port)
+{
+    ip_addr_t daddr;
+    daddr.type = IPADDR_TYPE_V4;
+    daddr.u_addr.ip4.addr = addr;
+    return add(data, len, &daddr, port);
+}
+
+bool AsyncUDPBatch::add(const uint8_t *data, size_t len, const IPv6Address addr, uint16_t port)
+{
+    ip_addr_t daddr;
+    daddr.type = IPADDR_TYPE_V6;
+    memcpy((uint8_t*)(daddr.u_addr.ip6.addr), (const uint8_t*)addr, 16);
+    return add(data, len, &daddr, port);
+}
+
+size_t AsyncUDPBatch::count()
+{
+    return _count;
+}
+
+bool AsyncUDPBatch::full()
+{
+    return _count >= _max;
+}
+
+void AsyncUDPBatch::clear()
+{
+    for(size_t i = 0; i < _count; i++) {
+        pbuf_free(_entries[i].pb);
+        _entries[i].pb = NULL;
+    }
+    _count = 0;
+}
+
+void AsyncUDP::_recv(udp_pcb *upcb, pbuf *pb, const ip_addr_t *addr, uint16_t port, struct netif * netif)
+{
+    if(_handler) {
+        AsyncUDPPacket packet(this, pb, addr, port, netif);
+        _handler(packet);
+        loopSignalEvent();
+    }
+    pbuf_free(pb);
+}
+
+bool AsyncUDP::_s_direct(void *arg)
+{
+    return reinterpret_cast<AsyncUDP*>(arg)->_direct;
+}
+
+void AsyncUDP::_s_dropped(void *arg)
+{
+    reinterpret_cast<AsyncUDP*>(arg)->_dropped++;
+}
+
+void AsyncUDP::setDirectDispatch(bool direct)
+{
+    _direct = direct;
+}
+
+uint32_t AsyncUDP::droppedPackets()
+{
+    return _dropped;
+}
+
+uint32_t AsyncUDP::totalDroppedPackets()
+{
+    return _udp_dropped;
 }
 
 void AsyncUDP::_s_recv(void *arg, udp_pcb *upcb, pbuf *p, const ip_addr_t *addr, uint16_t port, struct netif * netif)
@@ -3,7 +3,7 @@
 
 #include "IPAddress.h"
 #include "IPv6Address.h"
-#include "Print.h"
+#include "Stream.h"
 #include <functional>
 extern "C" {
 #include "lwip/ip_addr.h"
@@ -43,6 +43,38 @@ public:
     }
 };
 
+struct AsyncUDPSegment
+{
+    const uint8_t * data;
+    size_t length;
+};
+
+// walks the pbufs of one datagram, for(AsyncUDPSegment s : packet.segments())
+class AsyncUDPSegmentIterator
+{
+    pbuf * _pb;
+public:
+    AsyncUDPSegmentIterator(pbuf * pb) : _pb(pb) {}
+    AsyncUDPSegment operator*() const;
+    AsyncUDPSegmentIterator & operator++();
+    bool operator!=(const AsyncUDPSegmentIterator & other) const { return _pb != other._pb; }
+};
+
+class AsyncUDPSegments
+{
+    pbuf * _pb;
+public:
+    AsyncUDPSegments(pbuf * pb) : _pb(pb) {}
+    AsyncUDPSegmentIterator begin() const { return AsyncUDPSegmentIterator(_pb); }
+    AsyncUDPSegmentIterator end() const { return AsyncUDPSegmentIterator(NULL); }
+};
+
+/*
+ * A packet references the received pbuf chain, copies share it with pbuf_ref()
+ * and moves hand it over, so a handler can keep packets without copying the
+ * payload. Reassembled datagrams span several pbufs: iterate segments() to
+ * stay zero-copy, data() flattens them into one buffer on first use.
+ */
 class AsyncUDPPacket : public Stream
 {
 protected:
@@ -57,13 +89,21 @@ protected:
     uint8_t *_data;
     size_t _len;
     size_t _index;
+    uint8_t *_flat;
+
+    void _copyFrom(const AsyncUDPPacket &packet);
 public:
-    AsyncUDPPacket(AsyncUDPPacket &packet);
+    AsyncUDPPacket(const AsyncUDPPacket &packet);
+    AsyncUDPPacket(AsyncUDPPacket &&packet);
     AsyncUDPPacket(AsyncUDP *udp, pbuf *pb, const ip_addr_t *addr, uint16_t port, struct netif * netif);
     virtual ~AsyncUDPPacket();
+    AsyncUDPPacket & operator=(const AsyncUDPPacket &packet);
+    AsyncUDPPacket & operator=(AsyncUDPPacket &&packet);
 
     uint8_t * data();
     size_t length();
+    bool isChained();
+    AsyncUDPSegments segments();
     bool isBroadcast();
     bool isMulticast();
     bool isIPv6();
@@ -90,6 +130,32 @@ public:
     size_t write(uint8_t data);
 };
 
+typedef struct {
+    pbuf * pb;
+    ip_addr_t addr;
+    uint16_t port;
+} async_udp_batch_entry_t;
+
+// datagrams collected for AsyncUDP::sendBatch(), which hands them all to lwIP in one call
+class AsyncUDPBatch
+{
+protected:
+    async_udp_batch_entry_t * _entries;
+    size_t _max;
+    size_t _count;
+    friend class AsyncUDP;
+public:
+    AsyncUDPBatch(size_t maxPackets=16);
+    virtual ~AsyncUDPBatch();
+    // copies data (up to CONFIG_TCP_MSS), false when full or out of memory
+    bool add(const uint8_t *data, size_t len, const ip_addr_t *addr, uint16_t port);
+    bool add(const uint8_t *data, size_t len, const IPAddress addr, uint16_t port);
+    bool add(const uint8_t *data, size_t len, const IPv6Address addr, uint16_t port);
+    size_t count();
+    bool full();
+    void clear();
+};
+
 class AsyncUDP : public Print
 {
 protected:
@@ -98,6 +164,8 @@ protected:
     bool _connected;
 	esp_err_t _lastErr;
     AuPacketHandlerFunction _handler;
+    volatile bool _direct;
+    volatile uint32_t _dropped;
 
     bool _init();
     void _recv(udp_pcb *upcb, pbuf *pb, const ip_addr_t *addr, uint16_t port, struct netif * netif);
@@ -108,6 +176,12 @@ public:
 
     void onPacket(AuPacketHandlerFunctionWithArg cb, void * arg=NULL);
     void onPacket(AuPacketHandlerFunction cb);
+    // run the handler in the lwIP thread instead of async_udp: no queueing, but it
+    // must be short and must not call blocking or lwIP socket APIs
+    void setDirectDispatch(bool direct);
+    // packets this socket lost to a full dispatch queue, and all sockets together
+    uint32_t droppedPackets();
+    static uint32_t totalDroppedPackets();
 
     bool listen(const ip_addr_t *addr, uint16_t port);
     bool listen(const IPAddress addr, uint16_t port);
@@ -140,6 +214,9 @@ public:
     size_t sendTo(AsyncUDPMessage &message, const IPv6Address addr, uint16_t port, tcpip_adapter_if_t tcpip_if=TCPIP_ADAPTER_IF_MAX);
     size_t send(AsyncUDPMessage &message);
 
+    // sends and empties the batch, returns the number of datagrams lwIP accepted
+    size_t sendBatch(AsyncUDPBatch &batch, tcpip_adapter_if_t tcpip_if=TCPIP_ADAPTER_IF_MAX);
+
     size_t broadcastTo(AsyncUDPMessage &message, uint16_t port, tcpip_adapter_if_t tcpip_if=TCPIP_ADAPTER_IF_MAX);
     size_t broadcast(AsyncUDPMessage &message);
 
@@ -150,6 +227,8 @@ public:
     operator bool();
 
     static void _s_recv(void *arg, udp_pcb *upcb, pbuf *p, const ip_addr_t *addr, uint16_t port, struct netif * netif);
+    static bool _s_direct(void *arg);
+    static void _s_dropped(void *arg);
 };
 
 #endif
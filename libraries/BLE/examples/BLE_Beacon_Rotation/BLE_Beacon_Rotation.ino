@@ -0,0 +1,72 @@
+/*
+   Takes turns advertising an iBeacon, an Eddystone URL and an Eddystone TLM
+   frame, one second each.
+
+   The payloads are built once in setup(); the advertising keeps running while
+   the rotation switches between them, and the TLM frame gets its PDU count and
+   uptime updated on every turn. loop() only hands it new sensor values.
+*/
+#include "BLEDevice.h"
+#include "BLEAdvertising.h"
+#include "BLEBeacon.h"
+
+#define BEACON_UUID "8ec76ea3-6668-48da-9866-75be8bc86f4d"
+
+BLEAdvertising* pAdvertising;
+
+// https://example.com, 0x01 is "https://www." and 0x07 ".com"
+static const uint8_t eddystoneURL[] = {
+  0x02, 0x01, 0x06,             // Flags: GENERAL_DISC_MODE | BR_EDR_NOT_SUPPORTED
+  0x03, 0x03, 0xAA, 0xFE,       // Complete 16-bit UUIDs: Eddystone
+  0x0E, 0x16, 0xAA, 0xFE,       // Service data of Eddystone
+  0x10, 0xF4, 0x01,             // URL frame, TX power at 0 m, scheme
+  'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x07
+};
+
+void addIBeacon() {
+  BLEBeacon beacon;
+  beacon.setManufacturerId(0x4C00); // 0x004C LSB first
+  beacon.setProximityUUID(BLEUUID(BEACON_UUID));
+  beacon.setMajor(1);
+  beacon.setMinor(2);
+
+  BLEAdvertisementData data;
+  data.setFlags(0x04); // BR_EDR_NOT_SUPPORTED
+  std::string manufacturerData;
+  manufacturerData += (char)26;   // Len
+  manufacturerData += (char)0xFF; // Type
+  manufacturerData += beacon.getData();
+  data.addData(manufacturerData);
+  pAdvertising->addRotationPayload(data, 1000);
+}
+
+void addEddystoneTLM() {
+  // frame type, version, then battery, temperature, PDU count and uptime the rotation fills in
+  char tlm[14] = { 0x20, 0x00 };
+  BLEAdvertisementData data;
+  data.setFlags(0x06);
+  data.setCompleteServices(BLEUUID((uint16_t)0xFEAA));
+  data.setServiceData(BLEUUID((uint16_t)0xFEAA), std::string(tlm, sizeof(tlm)));
+  pAdvertising->addRotationPayload(data, 1000);
+}
+
+void setup() {
+  Serial.begin(115200);
+  BLEDevice::init("RotatingBeacon");
+  pAdvertising = BLEDevice::getAdvertising();
+  pAdvertising->setAdvertisementType(ADV_TYPE_NONCONN_IND);
+
+  addIBeacon();
+  pAdvertising->addRotationPayload(eddystoneURL, sizeof(eddystoneURL), 1000);
+  addEddystoneTLM();
+  pAdvertising->setRotationTLM(3300, temperatureRead());
+  if (!pAdvertising->startRotation()) {
+    Serial.println("rotation not started");
+  }
+}
+
+void loop() {
+  delay(10000);
+  // the battery is taken as full here
+  pAdvertising->setRotationTLM(3300, temperatureRead());
+}
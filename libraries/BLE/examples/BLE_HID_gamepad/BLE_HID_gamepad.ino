@@ -0,0 +1,110 @@
+/*
+   A gamepad with 8 buttons and two axes on GPIO, sending a report every time
+   they change and at least every 100 ms.
+
+   The reports go out with sendReport(), straight to the stack, and once the
+   host bonded it is asked for a 7.5 ms connection interval. Every 5 s the
+   report rate, the time a report spent in sendReport() and the connection
+   interval the host settled on are printed.
+*/
+#include <BLEDevice.h>
+#include <BLEHIDDevice.h>
+#include <BLE2902.h>
+
+static const uint8_t buttonPins[8] = { 4, 5, 12, 13, 14, 15, 16, 17 };
+#define AXIS_X_PIN 34
+#define AXIS_Y_PIN 35
+#define GAMEPAD_REPORT_ID 1
+
+static const uint8_t reportMap[] = {
+  0x05, 0x01,        // Usage Page (Generic Desktop)
+  0x09, 0x05,        // Usage (Game Pad)
+  0xA1, 0x01,        // Collection (Application)
+  0x85, GAMEPAD_REPORT_ID, //   Report ID
+  0x05, 0x09,        //   Usage Page (Button)
+  0x19, 0x01,        //   Usage Minimum (1)
+  0x29, 0x08,        //   Usage Maximum (8)
+  0x15, 0x00,        //   Logical Minimum (0)
+  0x25, 0x01,        //   Logical Maximum (1)
+  0x75, 0x01,        //   Report Size (1)
+  0x95, 0x08,        //   Report Count (8)
+  0x81, 0x02,        //   Input (Data, Variable, Absolute)
+  0x05, 0x01,        //   Usage Page (Generic Desktop)
+  0x09, 0x30,        //   Usage (X)
+  0x09, 0x31,        //   Usage (Y)
+  0x15, 0x81,        //   Logical Minimum (-127)
+  0x25, 0x7F,        //   Logical Maximum (127)
+  0x75, 0x08,        //   Report Size (8)
+  0x95, 0x02,        //   Report Count (2)
+  0x81, 0x02,        //   Input (Data, Variable, Absolute)
+  0xC0               // End Collection
+};
+
+BLEHIDDevice* hid;
+uint8_t report[3];
+uint8_t lastReport[3];
+unsigned long lastSent = 0;
+unsigned long lastStats = 0;
+
+int8_t readAxis(uint8_t pin) {
+  return (int8_t)((analogRead(pin) >> 4) - 128);
+}
+
+void setup() {
+  Serial.begin(115200);
+  for (int i = 0; i < 8; i++) {
+    pinMode(buttonPins[i], INPUT_PULLUP);
+  }
+
+  BLEDevice::init("ESP32 Gamepad");
+  BLEServer* server = BLEDevice::createServer();
+
+  hid = new BLEHIDDevice(server);
+  hid->manufacturer()->setValue("Espressif");
+  hid->pnp(0x02, 0xe502, 0xa111, 0x0210);
+  hid->hidInfo(0x00, 0x01);
+  hid->reportMap((uint8_t*)reportMap, sizeof(reportMap));
+  hid->inputReport(GAMEPAD_REPORT_ID);
+  hid->setLowLatency();
+  hid->startServices();
+
+  BLESecurity* security = new BLESecurity();
+  security->setAuthenticationMode(ESP_LE_AUTH_BOND);
+
+  BLEAdvertising* advertising = server->getAdvertising();
+  advertising->setAppearance(HID_GAMEPAD);
+  advertising->addServiceUUID(hid->hidService()->getUUID());
+  advertising->start();
+  Serial.println("Advertising, pair with the host");
+}
+
+void loop() {
+  uint8_t buttons = 0;
+  for (int i = 0; i < 8; i++) {
+    if (digitalRead(buttonPins[i]) == LOW) {
+      buttons |= 1 << i;
+    }
+  }
+  report[0] = buttons;
+  report[1] = (uint8_t)readAxis(AXIS_X_PIN);
+  report[2] = (uint8_t)readAxis(AXIS_Y_PIN);
+
+  if (memcmp(report, lastReport, sizeof(report)) || millis() - lastSent >= 100) {
+    // a stale report is worth nothing, so none is waited for
+    if (hid->sendReport(GAMEPAD_REPORT_ID, report, sizeof(report))) {
+      memcpy(lastReport, report, sizeof(report));
+      lastSent = millis();
+    }
+  }
+
+  if (millis() - lastStats >= 5000) {
+    lastStats = millis();
+    ble_hid_stats_t stats = hid->getStats();
+    Serial.printf("%u reports, %u sent, %u dropped, %u/s, send %u us (max %u), connection interval %u us\n",
+                  stats.reports, stats.sent, stats.dropped,
+                  stats.interval_us ? 1000000 / stats.interval_us : 0,
+                  stats.send_us, stats.send_max_us, stats.conn_interval_us);
+    hid->resetStats();
+  }
+  delay(1);
+}
@@ -0,0 +1,51 @@
+/*
+   Keeps a few Heart Rate sensors connected at once. BLECentral connects them in the
+   background, reconnects them when they drop and prints each link's counters.
+   Put the addresses of your sensors below.
+*/
+
+#include <BLEDevice.h>
+#include <BLECentral.h>
+
+static BLEUUID heartRateService((uint16_t)0x180d);
+static BLEUUID heartRateMeasurement((uint16_t)0x2a37);
+
+const char* sensors[] = {
+  "c4:7c:8d:6a:00:01",
+  "c4:7c:8d:6a:00:02",
+  "c4:7c:8d:6a:00:03",
+};
+const size_t sensorCount = sizeof(sensors) / sizeof(sensors[0]);
+
+BLECentral central;
+
+void setup() {
+  Serial.begin(115200);
+  BLEDevice::init("");
+  BLEClient::setDiscoveryCache(true);
+  central.begin();
+  central.setLinkCallback([](BLEAddress address, BLEClient* client, bool connected) {
+    Serial.printf("%s %s\n", address.toString().c_str(), connected ? "up" : "down");
+  });
+  for (size_t i = 0; i < sensorCount; i++) {
+    BLEAddress address(sensors[i]);
+    central.add(address);
+    central.subscribe(address, heartRateService, heartRateMeasurement,
+      [](BLERemoteCharacteristic* characteristic, uint8_t* data, size_t length, bool isNotify) {
+        if (length > 1) {
+          Serial.printf("%s: %u bpm\n", characteristic->getRemoteService()->getClient()->getPeerAddress().toString().c_str(), data[1]);
+        }
+      });
+  }
+}
+
+void loop() {
+  delay(10000);
+  for (size_t i = 0; i < sensorCount; i++) {
+    ble_link_stats_t stats;
+    if (central.getStats(BLEAddress(sensors[i]), &stats)) {
+      Serial.printf("%s: %u connects, %u notifications, %u bytes, interval %u, up %u s\n", sensors[i],
+                    stats.connects, stats.notifications, stats.notifyBytes, stats.interval, stats.connectedMs / 1000);
+    }
+  }
+}
@@ -0,0 +1,39 @@
+/*
+   Scans without end and keeps the 256 most recently heard devices in a fixed table,
+   nothing is allocated per advert. Prints the strongest ones every five seconds.
+*/
+
+#include <BLEDevice.h>
+#include <BLEScan.h>
+
+#define TABLE_SIZE 256
+
+BLEScan* pBLEScan;
+BLEScanEntry entries[TABLE_SIZE];
+
+void setup() {
+  Serial.begin(115200);
+  BLEDevice::init("");
+  pBLEScan = BLEDevice::getScan();
+  pBLEScan->setTable(TABLE_SIZE);
+  pBLEScan->setActiveScan(false);
+  pBLEScan->setInterval(100);
+  pBLEScan->setWindow(99);
+  pBLEScan->start(0, nullptr, false);
+}
+
+void loop() {
+  delay(5000);
+  size_t count = pBLEScan->getTable(entries, TABLE_SIZE);
+  uint32_t now = millis();
+  Serial.printf("%u devices\n", count);
+  for (size_t i = 0; i < count; i++) {
+    BLEScanEntry &e = entries[i];
+    if (e.rssi < -75) {
+      continue;
+    }
+    Serial.printf("%02x:%02x:%02x:%02x:%02x:%02x rssi %d, %u adverts, %u ms ago\n",
+                  e.address[0], e.address[1], e.address[2], e.address[3], e.address[4], e.address[5],
+                  e.rssi, e.count, now - e.lastSeen);
+  }
+}
@@ -24,6 +24,8 @@
 #include "GeneralUtils.h"
 #include "esp32-hal-log.h"
 
+#define EDDYSTONE_TLM_FRAME_LEN 14
+
 /**
  * @brief Construct a default advertising object.
  *
@@ -285,6 +287,169 @@ void BLEAdvertising::setDeviceAddress(esp_bd_addr_t addr, esp_ble_addr_type_t ty
 	log_v("<< setPrivateAddress");
 } // setPrivateAddress
 
+/**
+ * @brief Add a payload to the rotation.
+ * The payload is kept as the raw advertising data, so switching to it is a single
+ * esp_ble_gap_config_adv_data_raw() while the advertising goes on.
+ * @param [in] advertisementData The data to advertise.
+ * @param [in] durationMs How long it is advertised before the next one.
+ * @return Its index in the rotation, -1 if the rotation is full.
+ */
+int BLEAdvertising::addRotationPayload(BLEAdvertisementData& advertisementData, uint32_t durationMs) {
+	return addRotationPayload((const uint8_t*)advertisementData.m_payload.data(), advertisementData.m_payload.length(), durationMs);
+} // addRotationPayload
+
+
+/**
+ * @brief Add a raw payload to the rotation.
+ * An Eddystone TLM frame in it gets its PDU count and time since boot updated in place on every switch.
+ * @param [in] payload The advertising data, AD structures.
+ * @param [in] length Its size, up to 31 bytes.
+ * @param [in] durationMs How long it is advertised before the next one.
+ * @return Its index in the rotation, -1 if the rotation is full.
+ */
+int BLEAdvertising::addRotationPayload(const uint8_t* payload, size_t length, uint32_t durationMs) {
+	if (m_rotationCount == BLE_ADV_ROTATION_MAX || length > ESP_BLE_ADV_DATA_LEN_MAX) {
+		log_e("payload not added, %u bytes, %u of %u in the rotation", length, m_rotationCount, BLE_ADV_ROTATION_MAX);
+		return -1;
+	}
+	rotation_payload_t entry = {};
+	memcpy(entry.data, payload, length);
+	entry.length = length;
+	entry.durationMs = durationMs ? durationMs : 1;
+	// service data of 0xFEAA with frame type 0x20
+	for (size_t i = 0; i + 1 < length && payload[i] != 0; i += payload[i] + 1) {
+		if (payload[i + 1] == ESP_BLE_AD_TYPE_SERVICE_DATA && payload[i] >= 3 + EDDYSTONE_TLM_FRAME_LEN && i + 4 + EDDYSTONE_TLM_FRAME_LEN <= length &&
+				payload[i + 2] == 0xAA && payload[i + 3] == 0xFE && payload[i + 4] == 0x20) {
+			entry.tlm = i + 4;
+			break;
+		}
+	}
+	portENTER_CRITICAL(&m_rotationMux);
+	m_rotation[m_rotationCount] = entry;
+	portEXIT_CRITICAL(&m_rotationMux);
+	return m_rotationCount++;
+} // addRotationPayload
+
+
+void BLEAdvertising::clearRotation() {
+	stopRotation();
+	m_rotationCount = 0;
+	m_rotationIndex = 0;
+} // clearRotation
+
+
+/**
+ * @brief Start advertising the payloads of the rotation in turn.
+ * @return False if there is nothing to rotate or the timer couldn't be created.
+ */
+bool BLEAdvertising::startRotation() {
+	if (m_rotationCount == 0) {
+		log_e("no payloads to rotate");
+		return false;
+	}
+	if (m_rotationTimer == nullptr) {
+		esp_timer_create_args_t args = {};
+		args.callback = rotationTimerCb;
+		args.arg = this;
+		args.dispatch_method = ESP_TIMER_TASK;
+		args.name = "adv_rotation";
+		if (esp_timer_create(&args, &m_rotationTimer) != ESP_OK) {
+			log_e("rotation timer not created");
+			m_rotationTimer = nullptr;
+			return false;
+		}
+	}
+	esp_timer_stop(m_rotationTimer);
+	m_rotationIndex = m_rotationCount - 1;
+	m_customAdvData = true;   // start() leaves the data of the rotation as it is
+	rotate();
+	start();
+	return true;
+} // startRotation
+
+
+/**
+ * @brief Stop switching payloads, the current one stays advertised until stop().
+ */
+void BLEAdvertising::stopRotation() {
+	if (m_rotationTimer != nullptr) {
+		esp_timer_stop(m_rotationTimer);
+	}
+} // stopRotation
+
+
+/**
+ * @brief Set the sensor values of the Eddystone TLM payloads in the rotation.
+ * @param [in] volt Battery voltage in mV.
+ * @param [in] temp Temperature in degrees Celsius, sent as 8.8 fixed point.
+ */
+void BLEAdvertising::setRotationTLM(uint16_t volt, float temp) {
+	int16_t fixed = (int16_t)(temp * 256);
+	portENTER_CRITICAL(&m_rotationMux);
+	for (uint8_t i = 0; i < m_rotationCount; i++) {
+		uint8_t* frame = m_rotation[i].tlm ? &m_rotation[i].data[m_rotation[i].tlm] : nullptr;
+		if (frame != nullptr) {
+			frame[2] = volt >> 8;
+			frame[3] = volt;
+			frame[4] = (uint16_t)fixed >> 8;
+			frame[5] = fixed;
+		}
+	}
+	portEXIT_CRITICAL(&m_rotationMux);
+} // setRotationTLM
+
+
+/**
+ * @brief Switch to the next payload and arm the timer for it.
+ * Runs in the esp_timer task, the stack copies the data and applies it from its own task.
+ */
+void BLEAdvertising::rotate() {
+	int64_t now = esp_timer_get_time();
+	// PDUs since the last switch, one every advertising interval plus the 0 to 10 ms the controller adds
+	if (m_rotationSwitched) {
+		uint32_t eventUs = (m_advParams.adv_int_min + m_advParams.adv_int_max) * 625 / 2 + 5000;
+		m_tlmAdvCount += (now - m_rotationSwitched) / eventUs;
+	}
+	m_rotationSwitched = now;
+
+	uint8_t data[ESP_BLE_ADV_DATA_LEN_MAX];
+	portENTER_CRITICAL(&m_rotationMux);
+	m_rotationIndex = (m_rotationIndex + 1) % m_rotationCount;
+	rotation_payload_t& entry = m_rotation[m_rotationIndex];
+	if (entry.tlm) {
+		uint8_t* frame = &entry.data[entry.tlm];
+		uint32_t tenths = now / 100000;
+		frame[6] = m_tlmAdvCount >> 24;
+		frame[7] = m_tlmAdvCount >> 16;
+		frame[8] = m_tlmAdvCount >> 8;
+		frame[9] = m_tlmAdvCount;
+		frame[10] = tenths >> 24;
+		frame[11] = tenths >> 16;
+		frame[12] = tenths >> 8;
+		frame[13] = tenths;
+	}
+	uint8_t length = entry.length;
+	uint32_t durationMs = entry.durationMs;
+	bool again = m_rotationCount > 1 || entry.tlm != 0;	// a TLM alone is still refreshed
+	memcpy(data, entry.data, length);
+	portEXIT_CRITICAL(&m_rotationMux);
+
+	esp_err_t errRc = ::esp_ble_gap_config_adv_data_raw(data, length);
+	if (errRc != ESP_OK) {
+		log_e("esp_ble_gap_config_adv_data_raw: %d %s", errRc, GeneralUtils::errorToString(errRc));
+	}
+	if (again) {
+		esp_timer_start_once(m_rotationTimer, (uint64_t)durationMs * 1000);
+	}
+} // rotate
+
+
+void BLEAdvertising::rotationTimerCb(void* arg) {
+	((BLEAdvertising*)arg)->rotate();
+} // rotationTimerCb
+
+
 /**
  * @brief Add data to the payload to be advertised.
  * @param [in] data The data to be added to the payload.
@@ -13,6 +13,11 @@
 #include "BLEUUID.h"
 #include <vector>
 #include "FreeRTOS.h"
+#include "esp_timer.h"
+
+#ifndef BLE_ADV_ROTATION_MAX
+#define BLE_ADV_ROTATION_MAX 4 // payloads one rotation takes turns with
+#endif
 
 /**
  * @brief Advertisement data set by the programmer to be published by the %BLE server.
@@ -66,7 +71,34 @@ public:
 	void setMaxPreferred(uint16_t);
 	void setScanResponse(bool);
 
+	// payloads advertised in turn, each for durationMs, built once and switched without stopping the advertising
+	int  addRotationPayload(BLEAdvertisementData& advertisementData, uint32_t durationMs);
+	int  addRotationPayload(const uint8_t* payload, size_t length, uint32_t durationMs);
+	void clearRotation();
+	bool startRotation();
+	void stopRotation();
+	// battery in mV and temperature in degrees of the Eddystone TLM payloads, counters are kept by the rotation
+	void setRotationTLM(uint16_t volt, float temp);
+
 private:
+	typedef struct {
+		uint8_t  data[ESP_BLE_ADV_DATA_LEN_MAX];
+		uint8_t  length;
+		uint8_t  tlm;			// offset of the Eddystone TLM frame, 0 if it has none
+		uint32_t durationMs;
+	} rotation_payload_t;
+
+	rotation_payload_t   m_rotation[BLE_ADV_ROTATION_MAX];
+	uint8_t              m_rotationCount = 0;
+	uint8_t              m_rotationIndex = 0;
+	esp_timer_handle_t   m_rotationTimer = nullptr;
+	int64_t              m_rotationSwitched = 0;	// esp_timer_get_time() of the last switch
+	uint32_t             m_tlmAdvCount = 0;
+	portMUX_TYPE         m_rotationMux = portMUX_INITIALIZER_UNLOCKED;
+
+	void        rotate();
+	static void rotationTimerCb(void* arg);
+
 	esp_ble_adv_data_t   m_advData;
 	esp_ble_adv_data_t   m_scanRespData; // Used for configuration of scan response data when m_scanResp is true
 	esp_ble_adv_params_t m_advParams;
@@ -0,0 +1,539 @@
+/*
+ * BLECentral.cpp
+ *
+ * Keeps a set of peripherals connected and runs their GATT operations from one task.
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_gap_ble_api.h>
+#include <string.h>
+#include "BLECentral.h"
+#include "BLERemoteService.h"
+#include "esp32-hal.h"
+#include "esp32-hal-log.h"
+
+#define BLE_CENTRAL_POLL_MS 500 // links are looked at this often when no operation comes in
+
+/**
+ * @brief Wakes the task when a link drops, so it is counted and reconnected without waiting for the poll.
+ */
+class BLECentral::LinkCallbacks : public BLEClientCallbacks {
+public:
+	LinkCallbacks(BLECentral* pCentral) : m_pCentral(pCentral) {}
+	void onConnect(BLEClient* pClient) {}
+	void onDisconnect(BLEClient* pClient) {
+		BLECentral::operation_t* pOperation = nullptr;
+		xQueueSend(m_pCentral->m_queue, &pOperation, 0);
+	}
+private:
+	BLECentral* m_pCentral;
+}; // LinkCallbacks
+
+
+BLECentral::BLECentral() {
+	m_lock            = nullptr;
+	m_queue           = nullptr;
+	m_task            = nullptr;
+	m_pCallbacks      = nullptr;
+	m_linkCallback    = nullptr;
+	m_maxLinks        = BLE_CENTRAL_MAX_LINKS;
+	m_intervalPerLink = BLE_CENTRAL_INTERVAL_PER_LINK;
+	m_running         = false;
+} // BLECentral
+
+
+BLECentral::~BLECentral() {
+	end();
+} // ~BLECentral
+
+
+/**
+ * @brief Start the task that connects the peers and runs the operations.
+ * @param [in] maxLinks Links kept open at the same time, at most BLE_CENTRAL_MAX_LINKS.
+ * @param [in] stackSize Stack of the task, the callbacks run on it.
+ * @param [in] priority Priority of the task.
+ * @return True if the task runs.
+ */
+bool BLECentral::begin(uint8_t maxLinks, uint32_t stackSize, UBaseType_t priority) {
+	if (m_task != nullptr) {
+		return true;
+	}
+	if (maxLinks == 0 || maxLinks > BLE_CENTRAL_MAX_LINKS) {
+		log_w("%d links asked, the controller takes %d", maxLinks, BLE_CENTRAL_MAX_LINKS);
+		maxLinks = BLE_CENTRAL_MAX_LINKS;
+	}
+	m_maxLinks = maxLinks;
+	if (!m_lock) {
+		m_lock = xSemaphoreCreateMutex();
+	}
+	if (!m_queue) {
+		m_queue = xQueueCreate(BLE_CENTRAL_QUEUE_SIZE, sizeof(operation_t*));
+	}
+	if (!m_lock || !m_queue) {
+		log_e("no memory for the queue");
+		return false;
+	}
+	if (!m_pCallbacks) {
+		m_pCallbacks = new LinkCallbacks(this);
+	}
+	m_running = true;
+	if (xTaskCreate(taskFunction, "bleCentral", stackSize, this, priority, &m_task) != pdPASS) {
+		log_e("task not created");
+		m_running = false;
+		m_task = nullptr;
+		return false;
+	}
+	return true;
+} // begin
+
+
+/**
+ * @brief Close all links, stop the task and forget the peers.
+ */
+void BLECentral::end() {
+	if (m_task != nullptr) {
+		m_running = false;
+		operation_t* pOperation = nullptr;
+		xQueueSend(m_queue, &pOperation, portMAX_DELAY);
+		while (m_task != nullptr) {
+			vTaskDelay(pdMS_TO_TICKS(10));
+		}
+	}
+	if (m_queue) {
+		operation_t* pOperation;
+		while (xQueueReceive(m_queue, &pOperation, 0) == pdTRUE) {
+			if (pOperation) {
+				free(pOperation->data);
+				delete pOperation;
+			}
+		}
+		vQueueDelete(m_queue);
+		m_queue = nullptr;
+	}
+	for (auto pLink : m_links) {
+		delete pLink->pClient;
+		delete pLink;
+	}
+	m_links.clear();
+	delete m_pCallbacks;
+	m_pCallbacks = nullptr;
+	if (m_lock) {
+		vSemaphoreDelete(m_lock);
+		m_lock = nullptr;
+	}
+} // end
+
+
+/**
+ * @brief Add a peer to keep connected.
+ *
+ * Returns at once, the task connects the peer when a link is free.
+ *
+ * @param [in] address The peer.
+ * @param [in] type Its address type.
+ * @return False if the peer was added before or the manager is not running.
+ */
+bool BLECentral::add(BLEAddress address, esp_ble_addr_type_t type) {
+	if (!m_running) {
+		return false;
+	}
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	if (find(address) != nullptr) {
+		xSemaphoreGive(m_lock);
+		return false;
+	}
+	m_links.push_back(new link_t{address, type, nullptr, false, false, millis(), 0, {}, {}});
+	xSemaphoreGive(m_lock);
+	operation_t* pOperation = nullptr;
+	xQueueSend(m_queue, &pOperation, 0);
+	return true;
+} // add
+
+
+/**
+ * @brief Disconnect a peer and stop reconnecting it.
+ * @param [in] address The peer.
+ * @return False if it was not added.
+ */
+bool BLECentral::remove(BLEAddress address) {
+	if (!m_running) {
+		return false;
+	}
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	link_t* pLink = find(address);
+	if (pLink != nullptr) {
+		pLink->removed = true;
+	}
+	xSemaphoreGive(m_lock);
+	operation_t* pOperation = nullptr;
+	xQueueSend(m_queue, &pOperation, 0);
+	return pLink != nullptr;
+} // remove
+
+
+/**
+ * @brief Set what is called on the task when a link comes up or goes down.
+ */
+void BLECentral::setLinkCallback(ble_link_callback callback) {
+	m_linkCallback = callback;
+} // setLinkCallback
+
+
+/**
+ * @brief Set the connection interval each open link adds.
+ *
+ * With n links open every link is asked for n times this interval, so the links share the radio evenly
+ * and one more link does not starve the others.
+ *
+ * @param [in] interval In 1.25 ms units.
+ */
+void BLECentral::setIntervalPerLink(uint16_t interval) {
+	m_intervalPerLink = interval;
+} // setIntervalPerLink
+
+
+/**
+ * @brief Queue a read of a characteristic.
+ * @param [in] address The peer.
+ * @param [in] service The service UUID.
+ * @param [in] characteristic The characteristic UUID.
+ * @param [in] callback Gets the value on the task.
+ * @return False if the queue is full or the manager is not running.
+ */
+bool BLECentral::read(BLEAddress address, BLEUUID service, BLEUUID characteristic, ble_operation_callback callback) {
+	return post(new operation_t{OP_READ, address, service, characteristic, nullptr, 0, false, millis(), callback, nullptr});
+} // read
+
+
+/**
+ * @brief Queue a write of a characteristic.
+ * @param [in] address The peer.
+ * @param [in] service The service UUID.
+ * @param [in] characteristic The characteristic UUID.
+ * @param [in] data The value, copied.
+ * @param [in] length Its length.
+ * @param [in] response Write with response.
+ * @param [in] callback Gets the outcome on the task, may be nullptr.
+ * @return False if the queue is full, there is no memory for the copy or the manager is not running.
+ */
+bool BLECentral::write(BLEAddress address, BLEUUID service, BLEUUID characteristic, const uint8_t* data, size_t length, bool response, ble_operation_callback callback) {
+	uint8_t* copy = (uint8_t*)malloc(length ? length : 1);
+	if (!copy) {
+		return false;
+	}
+	memcpy(copy, data, length);
+	return post(new operation_t{OP_WRITE, address, service, characteristic, copy, length, response, millis(), callback, nullptr});
+} // write
+
+
+/**
+ * @brief Subscribe to the notifications or indications of a characteristic.
+ *
+ * The subscription is kept and made again each time the link comes back up.
+ *
+ * @param [in] address The peer.
+ * @param [in] service The service UUID.
+ * @param [in] characteristic The characteristic UUID.
+ * @param [in] callback Gets the values, on the BLE task.
+ * @param [in] notifications Notifications, false for indications.
+ * @return False if the queue is full or the manager is not running.
+ */
+bool BLECentral::subscribe(BLEAddress address, BLEUUID service, BLEUUID characteristic, notify_callback callback, bool notifications) {
+	return post(new operation_t{OP_SUBSCRIBE, address, service, characteristic, nullptr, 0, notifications, millis(), nullptr, callback});
+} // subscribe
+
+
+bool BLECentral::isConnected(BLEAddress address) {
+	if (!m_lock) {
+		return false;
+	}
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	link_t* pLink = find(address);
+	bool connected = pLink != nullptr && pLink->connected;
+	xSemaphoreGive(m_lock);
+	return connected;
+} // isConnected
+
+
+uint8_t BLECentral::getConnectedCount() {
+	if (!m_lock) {
+		return 0;
+	}
+	uint8_t count = 0;
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	for (auto pLink : m_links) {
+		count += pLink->connected ? 1 : 0;
+	}
+	xSemaphoreGive(m_lock);
+	return count;
+} // getConnectedCount
+
+
+/**
+ * @brief Get the counters of a link.
+ * @param [in] address The peer.
+ * @param [out] stats The counters.
+ * @return False if the peer was not added.
+ */
+bool BLECentral::getStats(BLEAddress address, ble_link_stats_t* stats) {
+	if (!m_lock || !stats) {
+		return false;
+	}
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	link_t* pLink = find(address);
+	if (pLink != nullptr) {
+		*stats = pLink->stats;
+		stats->connectedMs = pLink->connected ? millis() - pLink->since : 0;
+	}
+	xSemaphoreGive(m_lock);
+	return pLink != nullptr;
+} // getStats
+
+
+void BLECentral::taskFunction(void* pvParameters) {
+	((BLECentral*)pvParameters)->run();
+} // taskFunction
+
+
+void BLECentral::run() {
+	while (m_running) {
+		maintainLinks();
+		operation_t* pOperation = nullptr;
+		if (xQueueReceive(m_queue, &pOperation, pdMS_TO_TICKS(BLE_CENTRAL_POLL_MS)) == pdTRUE && pOperation != nullptr) {
+			if (m_running) {
+				execute(pOperation);
+			}
+			free(pOperation->data);
+			delete pOperation;
+		}
+	}
+	for (auto pLink : m_links) {
+		if (pLink->pClient != nullptr && pLink->pClient->isConnected()) {
+			pLink->pClient->disconnect();
+		}
+	}
+	m_task = nullptr;
+	vTaskDelete(NULL);
+} // run
+
+
+bool BLECentral::post(operation_t* pOperation) {
+	if (!m_running || xQueueSend(m_queue, &pOperation, 0) != pdTRUE) {
+		log_w("operation not queued");
+		free(pOperation->data);
+		delete pOperation;
+		return false;
+	}
+	return true;
+} // post
+
+
+// m_lock is held
+BLECentral::link_t* BLECentral::find(BLEAddress address) {
+	for (auto pLink : m_links) {
+		if (pLink->address.equals(address)) {
+			return pLink;
+		}
+	}
+	return nullptr;
+} // find
+
+
+/**
+ * @brief Count links that dropped, close removed peers and connect the ones that are down.
+ *
+ * Connecting blocks the task until the peer answers or the stack gives up on it.
+ */
+void BLECentral::maintainLinks() {
+	bool changed = false;
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	std::vector<link_t*> links = m_links;
+	uint8_t open = 0;
+	for (auto pLink : links) {
+		open += pLink->connected ? 1 : 0;
+	}
+	xSemaphoreGive(m_lock);
+
+	for (auto pLink : links) {
+		bool up = pLink->pClient != nullptr && pLink->pClient->isConnected();
+		if (pLink->connected && !up) {
+			xSemaphoreTake(m_lock, portMAX_DELAY);
+			pLink->connected = false;
+			pLink->stats.disconnects++;
+			xSemaphoreGive(m_lock);
+			open--;
+			changed = true;
+			pLink->retryAt = millis();
+			log_i("%s disconnected", pLink->address.toString().c_str());
+			if (m_linkCallback) {
+				m_linkCallback(pLink->address, pLink->pClient, false);
+			}
+		}
+		if (pLink->removed) {
+			if (up) {
+				pLink->pClient->disconnect(); // dropped on the next pass, once the stack has closed it
+				continue;
+			}
+			xSemaphoreTake(m_lock, portMAX_DELAY);
+			for (auto it = m_links.begin(); it != m_links.end(); it++) {
+				if (*it == pLink) {
+					m_links.erase(it);
+					break;
+				}
+			}
+			xSemaphoreGive(m_lock);
+			delete pLink->pClient;
+			delete pLink;
+			continue;
+		}
+		if (up || open >= m_maxLinks || (int32_t)(millis() - pLink->retryAt) < 0) {
+			continue;
+		}
+		if (pLink->pClient == nullptr) {
+			pLink->pClient = new BLEClient();
+			pLink->pClient->setClientCallbacks(m_pCallbacks);
+		}
+		log_d("connecting %s", pLink->address.toString().c_str());
+		if (!pLink->pClient->connect(pLink->address, pLink->type)) {
+			pLink->stats.failures++;
+			pLink->retryAt = millis() + BLE_CENTRAL_RETRY_MS;
+			continue;
+		}
+		xSemaphoreTake(m_lock, portMAX_DELAY);
+		pLink->connected = true;
+		pLink->since = millis();
+		pLink->stats.connects++;
+		xSemaphoreGive(m_lock);
+		open++;
+		changed = true;
+		log_i("%s connected", pLink->address.toString().c_str());
+		for (auto &subscription : pLink->subscriptions) {
+			subscribeLink(pLink, subscription);
+		}
+		if (m_linkCallback) {
+			m_linkCallback(pLink->address, pLink->pClient, true);
+		}
+	}
+	if (changed) {
+		balanceIntervals();
+	}
+} // maintainLinks
+
+
+/**
+ * @brief Ask every open link for the same interval, m_intervalPerLink for each link that is open.
+ */
+void BLECentral::balanceIntervals() {
+	uint8_t open = 0;
+	for (auto pLink : m_links) {
+		open += pLink->connected ? 1 : 0;
+	}
+	if (open == 0 || m_intervalPerLink == 0) {
+		return;
+	}
+	uint32_t interval = (uint32_t)m_intervalPerLink * open;
+	if (interval < 6) {
+		interval = 6;     // 7.5 ms, the shortest there is
+	} else if (interval > 800) {
+		interval = 800;   // 1 s, well inside the supervision timeout below
+	}
+	for (auto pLink : m_links) {
+		if (!pLink->connected) {
+			continue;
+		}
+		esp_ble_conn_update_params_t params;
+		memcpy(params.bda, *pLink->address.getNative(), sizeof(esp_bd_addr_t));
+		params.min_int = interval;
+		params.max_int = interval;
+		params.latency = 0;
+		params.timeout = 400;   // 4 s
+		esp_err_t errRc = ::esp_ble_gap_update_conn_params(&params);
+		if (errRc != ESP_OK) {
+			log_w("esp_ble_gap_update_conn_params: %d", errRc);
+			continue;
+		}
+		pLink->stats.interval = interval;
+	}
+} // balanceIntervals
+
+
+BLERemoteCharacteristic* BLECentral::getCharacteristic(link_t* pLink, BLEUUID service, BLEUUID characteristic) {
+	BLERemoteService* pService = pLink->pClient->getService(service);
+	if (pService == nullptr) {
+		log_w("%s has no service %s", pLink->address.toString().c_str(), service.toString().c_str());
+		return nullptr;
+	}
+	BLERemoteCharacteristic* pCharacteristic = pService->getCharacteristic(characteristic);
+	if (pCharacteristic == nullptr) {
+		log_w("%s has no characteristic %s", pLink->address.toString().c_str(), characteristic.toString().c_str());
+	}
+	return pCharacteristic;
+} // getCharacteristic
+
+
+bool BLECentral::subscribeLink(link_t* pLink, subscription_t& subscription) {
+	BLERemoteCharacteristic* pCharacteristic = getCharacteristic(pLink, subscription.service, subscription.characteristic);
+	if (pCharacteristic == nullptr) {
+		return false;
+	}
+	notify_callback callback = subscription.callback;
+	pCharacteristic->registerForNotify([pLink, callback](BLERemoteCharacteristic* pChar, uint8_t* pData, size_t length, bool isNotify) {
+		pLink->stats.notifications++;
+		pLink->stats.notifyBytes += length;
+		if (callback) {
+			callback(pChar, pData, length, isNotify);
+		}
+	}, subscription.notifications);
+	return true;
+} // subscribeLink
+
+
+/**
+ * @brief Run one queued operation and report it.
+ */
+void BLECentral::execute(operation_t* pOperation) {
+	xSemaphoreTake(m_lock, portMAX_DELAY);
+	link_t* pLink = find(pOperation->address);
+	xSemaphoreGive(m_lock);
+
+	bool success = false;
+	std::string value;
+	if (pLink != nullptr && pOperation->type == OP_SUBSCRIBE) {
+		subscription_t subscription = {pOperation->service, pOperation->characteristic, pOperation->notify, pOperation->flag};
+		pLink->subscriptions.push_back(subscription);
+		success = !pLink->connected || subscribeLink(pLink, pLink->subscriptions.back());
+	} else if (pLink != nullptr && pLink->connected) {
+		BLERemoteCharacteristic* pCharacteristic = getCharacteristic(pLink, pOperation->service, pOperation->characteristic);
+		if (pCharacteristic != nullptr && pOperation->type == OP_READ) {
+			value = pCharacteristic->readValue();
+			success = pLink->pClient->isConnected();
+			pLink->stats.bytesRead += value.length();
+		} else if (pCharacteristic != nullptr && pOperation->type == OP_WRITE) {
+			pCharacteristic->writeValue(pOperation->data, pOperation->length, pOperation->flag);
+			success = pLink->pClient->isConnected();
+			pLink->stats.bytesWritten += pOperation->length;
+		}
+	}
+
+	if (pLink != nullptr) {
+		uint32_t latency = millis() - pOperation->queued;
+		xSemaphoreTake(m_lock, portMAX_DELAY);
+		pLink->stats.operations++;
+		pLink->stats.errors += success ? 0 : 1;
+		pLink->stats.lastLatencyMs = latency;
+		pLink->stats.totalLatencyMs += latency;
+		if (latency > pLink->stats.maxLatencyMs) {
+			pLink->stats.maxLatencyMs = latency;
+		}
+		xSemaphoreGive(m_lock);
+	}
+	if (pOperation->callback) {
+		if (pOperation->type == OP_READ) {
+			pOperation->callback(pOperation->address, success, (const uint8_t*)value.data(), value.length());
+		} else {
+			pOperation->callback(pOperation->address, success, pOperation->data, pOperation->length);
+		}
+	}
+} // execute
+
+#endif /* CONFIG_BT_ENABLED */
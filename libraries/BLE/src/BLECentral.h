@@ -0,0 +1,147 @@
+/*
+ * BLECentral.h
+ *
+ * Keeps a set of peripherals connected and runs their GATT operations from one task.
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLECENTRAL_H_
+#define COMPONENTS_CPP_UTILS_BLECENTRAL_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <functional>
+#include <vector>
+#include "BLEClient.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLEAddress.h"
+#include "BLEUUID.h"
+#include "FreeRTOS.h"
+
+#ifndef BLE_CENTRAL_MAX_LINKS
+#define BLE_CENTRAL_MAX_LINKS CONFIG_BTDM_CONTROLLER_BLE_MAX_CONN_EFF // the controller has no room for more
+#endif
+
+#ifndef BLE_CENTRAL_QUEUE_SIZE
+#define BLE_CENTRAL_QUEUE_SIZE 16 // GATT operations waiting for the task
+#endif
+
+#ifndef BLE_CENTRAL_RETRY_MS
+#define BLE_CENTRAL_RETRY_MS 5000 // wait after a failed connect before the next try
+#endif
+
+#ifndef BLE_CENTRAL_INTERVAL_PER_LINK
+#define BLE_CENTRAL_INTERVAL_PER_LINK 8 // 1.25 ms units of connection interval for each open link, 10 ms
+#endif
+
+// what one link has done since it was added
+typedef struct {
+	uint32_t connects;       // successful connects
+	uint32_t failures;       // connects that did not make it
+	uint32_t disconnects;    // links lost or closed
+	uint32_t operations;     // reads, writes and subscriptions run
+	uint32_t errors;         // of those, the ones that failed
+	uint32_t bytesRead;
+	uint32_t bytesWritten;
+	uint32_t notifications;  // notifications and indications received
+	uint32_t notifyBytes;
+	uint32_t lastLatencyMs;  // queued to done, of the last operation
+	uint32_t maxLatencyMs;
+	uint32_t totalLatencyMs; // divided by operations gives the average
+	uint32_t connectedMs;    // how long the current link has been up, 0 when down
+	uint16_t interval;       // connection interval asked for, 1.25 ms units
+} ble_link_stats_t;
+
+typedef std::function<void(BLEAddress address, BLEClient* pClient, bool connected)> ble_link_callback;
+typedef std::function<void(BLEAddress address, bool success, const uint8_t* data, size_t length)> ble_operation_callback;
+
+/**
+ * @brief Keeps a set of peripherals connected.
+ *
+ * add() only registers a peer, a task connects it, reconnects it when the link drops and spreads the
+ * connection interval with the number of open links so each gets its share of air time. Reads, writes
+ * and subscriptions are queued and run one at a time by the same task, the result comes back through a
+ * callback on that task.
+ */
+class BLECentral {
+public:
+	BLECentral();
+	~BLECentral();
+
+	bool       begin(uint8_t maxLinks = BLE_CENTRAL_MAX_LINKS, uint32_t stackSize = 4096, UBaseType_t priority = 2);
+	void       end();
+	bool       add(BLEAddress address, esp_ble_addr_type_t type = BLE_ADDR_TYPE_PUBLIC);
+	bool       remove(BLEAddress address);
+	void       setLinkCallback(ble_link_callback callback);
+	void       setIntervalPerLink(uint16_t interval);
+
+	bool       read(BLEAddress address, BLEUUID service, BLEUUID characteristic, ble_operation_callback callback);
+	bool       write(BLEAddress address, BLEUUID service, BLEUUID characteristic, const uint8_t* data, size_t length, bool response = false, ble_operation_callback callback = nullptr);
+	bool       subscribe(BLEAddress address, BLEUUID service, BLEUUID characteristic, notify_callback callback, bool notifications = true);
+
+	bool       isConnected(BLEAddress address);
+	uint8_t    getConnectedCount();
+	bool       getStats(BLEAddress address, ble_link_stats_t* stats);
+
+private:
+	typedef enum {
+		OP_READ,
+		OP_WRITE,
+		OP_SUBSCRIBE,
+	} op_type_t;
+
+	typedef struct {
+		op_type_t              type;
+		BLEAddress             address;
+		BLEUUID                service;
+		BLEUUID                characteristic;
+		uint8_t*               data;
+		size_t                 length;
+		bool                   flag;      // write with response, notifications over indications
+		uint32_t               queued;
+		ble_operation_callback callback;
+		notify_callback        notify;
+	} operation_t;
+
+	typedef struct {
+		BLEUUID         service;
+		BLEUUID         characteristic;
+		notify_callback callback;
+		bool            notifications;
+	} subscription_t;
+
+	typedef struct {
+		BLEAddress                  address;
+		esp_ble_addr_type_t         type;
+		BLEClient*                  pClient;
+		bool                        connected;
+		bool                        removed;
+		uint32_t                    retryAt;
+		uint32_t                    since;
+		ble_link_stats_t            stats;
+		std::vector<subscription_t> subscriptions;
+	} link_t;
+
+	class LinkCallbacks;
+
+	std::vector<link_t*> m_links;
+	SemaphoreHandle_t    m_lock;
+	QueueHandle_t        m_queue;
+	TaskHandle_t         m_task;
+	LinkCallbacks*       m_pCallbacks;
+	ble_link_callback    m_linkCallback;
+	uint8_t              m_maxLinks;
+	uint16_t             m_intervalPerLink;
+	volatile bool        m_running;
+
+	static void          taskFunction(void* pvParameters);
+	void                 run();
+	bool                 post(operation_t* pOperation);
+	link_t*              find(BLEAddress address);
+	void                 maintainLinks();
+	void                 balanceIntervals();
+	void                 execute(operation_t* pOperation);
+	BLERemoteCharacteristic* getCharacteristic(link_t* pLink, BLEUUID service, BLEUUID characteristic);
+	bool                 subscribeLink(link_t* pLink, subscription_t& subscription);
+}; // BLECentral
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLECENTRAL_H_ */
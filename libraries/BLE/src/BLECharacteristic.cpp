@@ -29,7 +29,7 @@ static BLECharacteristicCallbacks defaultCallback; //null-object-pattern
  * @param [in] uuid - UUID (const char*) for the characteristic.
  * @param [in] properties - Properties for the characteristic.
  */
-BLECharacteristic::BLECharacteristic(const char* uuid, uint32_t properties) : BLECharacteristic(BLEUUID(uuid), properties) {
+BLECharacteristic::BLECharacteristic(const char* uuid, uint32_t properties, size_t maxLength) : BLECharacteristic(BLEUUID(uuid), properties, maxLength) {
 }
 
 /**
@@ -37,7 +37,7 @@ BLECharacteristic::BLECharacteristic(const char* uuid, uint32_t properties) : BL
  * @param [in] uuid - UUID for the characteristic.
  * @param [in] properties - Properties for the characteristic.
  */
-BLECharacteristic::BLECharacteristic(BLEUUID uuid, uint32_t properties) {
+BLECharacteristic::BLECharacteristic(BLEUUID uuid, uint32_t properties, size_t maxLength) {
 	m_bleUUID    = uuid;
 	m_handle     = NULL_HANDLE;
 	m_properties = (esp_gatt_char_prop_t)0;
@@ -49,6 +49,9 @@ BLECharacteristic::BLECharacteristic(BLEUUID uuid, uint32_t properties) {
 	setNotifyProperty((properties & PROPERTY_NOTIFY) != 0);
 	setIndicateProperty((properties & PROPERTY_INDICATE) != 0);
 	setWriteNoResponseProperty((properties & PROPERTY_WRITE_NR) != 0);
+	if (maxLength) {
+		m_value.setCapacity(maxLength);
+	}
 } // BLECharacteristic
 
 /**
@@ -188,6 +191,14 @@ uint8_t* BLECharacteristic::getData() {
 } // getData
 
 
+/**
+ * @brief Retrieve the length of the current data, which getData() points to.
+ */
+size_t BLECharacteristic::getLength() {
+	return m_value.getLength();
+} // getLength
+
+
 /**
  * Handle a GATT server event.
  */
@@ -364,19 +375,19 @@ void BLECharacteristic::handleGATTServerEvent(
 					esp_gatt_rsp_t rsp;
 
 					if (param->read.is_long) {
-						std::string value = m_value.getValue();
+						size_t length = m_value.getLength();
 
-						if (value.length() - m_value.getReadOffset() < maxOffset) {
+						if (length - m_value.getReadOffset() < maxOffset) {
 							// This is the last in the chain
-							rsp.attr_value.len    = value.length() - m_value.getReadOffset();
+							rsp.attr_value.len    = length - m_value.getReadOffset();
 							rsp.attr_value.offset = m_value.getReadOffset();
-							memcpy(rsp.attr_value.value, value.data() + rsp.attr_value.offset, rsp.attr_value.len);
+							memcpy(rsp.attr_value.value, m_value.getData() + rsp.attr_value.offset, rsp.attr_value.len);
 							m_value.setReadOffset(0);
 						} else {
 							// There will be more to come.
 							rsp.attr_value.len    = maxOffset;
 							rsp.attr_value.offset = m_value.getReadOffset();
-							memcpy(rsp.attr_value.value, value.data() + rsp.attr_value.offset, rsp.attr_value.len);
+							memcpy(rsp.attr_value.value, m_value.getData() + rsp.attr_value.offset, rsp.attr_value.len);
 							m_value.setReadOffset(rsp.attr_value.offset + maxOffset);
 						}
 					} else { // read.is_long == false
@@ -385,19 +396,19 @@ void BLECharacteristic::handleGATTServerEvent(
 						// Invoke the read callback.
 						m_pCallbacks->onRead(this);
 
-						std::string value = m_value.getValue();
+						size_t length = m_value.getLength();
 
-						if (value.length() + 1 > maxOffset) {
+						if (length + 1 > maxOffset) {
 							// Too big for a single shot entry.
 							m_value.setReadOffset(maxOffset);
 							rsp.attr_value.len    = maxOffset;
 							rsp.attr_value.offset = 0;
-							memcpy(rsp.attr_value.value, value.data(), rsp.attr_value.len);
+							memcpy(rsp.attr_value.value, m_value.getData(), rsp.attr_value.len);
 						} else {
 							// Will fit in a single packet with no callbacks required.
-							rsp.attr_value.len    = value.length();
+							rsp.attr_value.len    = length;
 							rsp.attr_value.offset = 0;
-							memcpy(rsp.attr_value.value, value.data(), rsp.attr_value.len);
+							memcpy(rsp.attr_value.value, m_value.getData(), rsp.attr_value.len);
 						}
 					}
 					rsp.attr_value.handle   = param->read.handle;
@@ -465,7 +476,7 @@ void BLECharacteristic::handleGATTServerEvent(
  */
 void BLECharacteristic::indicate() {
 
-	log_v(">> indicate: length: %d", m_value.getValue().length());
+	log_v(">> indicate: length: %d", m_value.getLength());
 	notify(false);
 	log_v("<< indicate");
 } // indicate
@@ -478,14 +489,16 @@ void BLECharacteristic::indicate() {
  * @return N/A.
  */
 void BLECharacteristic::notify(bool is_notification) {
-	log_v(">> notify: length: %d", m_value.getValue().length());
+	log_v(">> notify: length: %d", m_value.getLength());
 
 	assert(getService() != nullptr);
 	assert(getService()->getServer() != nullptr);
 
 	m_pCallbacks->onNotify(this);   // Invoke the notify callback.
 
-	GeneralUtils::hexDump((uint8_t*)m_value.getValue().data(), m_value.getValue().length());
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_VERBOSE
+	GeneralUtils::hexDump(m_value.getData(), m_value.getLength());
+#endif
 
 	if (getService()->getServer()->getConnectedCount() == 0) {
 		log_v("<< notify: No connected clients.");
@@ -513,17 +526,17 @@ void BLECharacteristic::notify(bool is_notification) {
 	}
 	for (auto &myPair : getService()->getServer()->getPeerDevices(false)) {
 		uint16_t _mtu = (myPair.second.mtu);
-		if (m_value.getValue().length() > _mtu - 3) {
+		size_t length = m_value.getLength();
+		if (length > _mtu - 3) {
 			log_w("- Truncating to %d bytes (maximum notify size)", _mtu - 3);
 		}
 
-		size_t length = m_value.getValue().length();
 		if(!is_notification) // is indication
 			m_semaphoreConfEvt.take("indicate");
 		esp_err_t errRc = ::esp_ble_gatts_send_indicate(
 				getService()->getServer()->getGattsIf(),
 				myPair.first,
-				getHandle(), length, (uint8_t*)m_value.getValue().data(), !is_notification); // The need_confirm = false makes this a notify.
+				getHandle(), length, m_value.getData(), !is_notification); // The need_confirm = false makes this a notify.
 		if (errRc != ESP_OK) {
 			log_e("<< esp_ble_gatts_send_ %s: rc=%d %s",is_notification?"notify":"indicate", errRc, GeneralUtils::errorToString(errRc));
 			m_semaphoreConfEvt.give();
@@ -549,6 +562,73 @@ void BLECharacteristic::notify(bool is_notification) {
 } // Notify
 
 
+/**
+ * @brief Stream data to the subscribed clients.
+ *
+ * The data goes out in as few notifications as each connection's MTU allows, the value of the characteristic
+ * is left as it is. A packet is only handed to the stack while the connection has room for it, so a fast
+ * producer is held back instead of the stack dropping notifications. What went out is counted in
+ * BLEServer::getNotifyStats().
+ *
+ * @param [in] data The bytes to send.
+ * @param [in] length How many.
+ * @param [in] timeoutMs How long a congested connection is waited for before the rest is dropped for it.
+ * @return The bytes sent to every connected client.
+ */
+size_t BLECharacteristic::notify(const uint8_t* data, size_t length, uint32_t timeoutMs) {
+	log_v(">> notify: length: %d", length);
+
+	assert(getService() != nullptr);
+	BLEServer* pServer = getService()->getServer();
+	assert(pServer != nullptr);
+
+	if (pServer->getConnectedCount() == 0) {
+		log_v("<< notify: No connected clients.");
+		m_pCallbacks->onStatus(this, BLECharacteristicCallbacks::Status::ERROR_NO_CLIENT, 0);
+		return 0;
+	}
+	BLE2902 *p2902 = (BLE2902*)getDescriptorByUUID((uint16_t)0x2902);
+	if (p2902 != nullptr && !p2902->getNotifications()) {
+		log_v("<< notifications disabled; ignoring");
+		m_pCallbacks->onStatus(this, BLECharacteristicCallbacks::Status::ERROR_NOTIFY_DISABLED, 0);
+		return 0;
+	}
+
+	size_t sentToAll = length;
+	for (auto &myPair : pServer->getPeerDevices(false)) {
+		uint16_t connId = myPair.first;
+		size_t packet = myPair.second.mtu - 3;
+		size_t sent = 0;
+		esp_err_t errRc = ESP_OK;
+		while (sent < length) {
+			if (!pServer->waitUncongested(connId, timeoutMs)) {
+				log_w("- conn %d congested, %d bytes dropped", connId, length - sent);
+				break;
+			}
+			size_t chunk = length - sent < packet ? length - sent : packet;
+			errRc = ::esp_ble_gatts_send_indicate(pServer->getGattsIf(), connId, getHandle(), chunk, (uint8_t*)data + sent, false);
+			if (errRc != ESP_OK) {
+				log_e("<< esp_ble_gatts_send_notify: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+				break;
+			}
+			pServer->addNotifyStats(connId, chunk, 0);
+			sent += chunk;
+		}
+		if (sent < length) {
+			pServer->addNotifyStats(connId, 0, length - sent);
+			m_pCallbacks->onStatus(this, BLECharacteristicCallbacks::Status::ERROR_GATT, errRc);
+		} else {
+			m_pCallbacks->onStatus(this, BLECharacteristicCallbacks::Status::SUCCESS_NOTIFY, 0);
+		}
+		if (sent < sentToAll) {
+			sentToAll = sent;
+		}
+	}
+	log_v("<< notify");
+	return sentToAll;
+} // notify
+
+
 /**
  * @brief Set the permission to broadcast.
  * A characteristics has properties associated with it which define what it is capable of doing.
@@ -646,9 +726,11 @@ void BLECharacteristic::setReadProperty(bool value) {
  * @param [in] length The length of the data in bytes.
  */
 void BLECharacteristic::setValue(uint8_t* data, size_t length) {
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_VERBOSE
 	char* pHex = BLEUtils::buildHexData(nullptr, data, length);
 	log_v(">> setValue: length=%d, data=%s, characteristic UUID=%s", length, pHex, getUUID().toString().c_str());
 	free(pHex);
+#endif
 	if (length > ESP_GATT_MAX_ATTR_LEN) {
 		log_e("Size %d too large, must be no bigger than %d", length, ESP_GATT_MAX_ATTR_LEN);
 		return;
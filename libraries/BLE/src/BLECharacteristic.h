@@ -11,6 +11,7 @@
 #if defined(CONFIG_BT_ENABLED)
 #include <string>
 #include <map>
+#include <vector>
 #include "BLEUUID.h"
 #include <esp_gatts_api.h>
 #include <esp_gap_ble_api.h>
@@ -38,9 +39,9 @@ public:
 	BLEDescriptor* getFirst();
 	BLEDescriptor* getNext();
 private:
-	std::map<BLEDescriptor*, std::string> m_uuidMap;
-	std::map<uint16_t, BLEDescriptor*> m_handleMap;
-	std::map<BLEDescriptor*, std::string>::iterator m_iterator;
+	std::vector<BLEDescriptor*> m_descriptors; // in the order they were added
+	std::vector<std::pair<uint16_t, BLEDescriptor*>> m_handleMap; // sorted by handle
+	size_t m_iterator = 0;
 };
 
 
@@ -52,8 +53,9 @@ private:
  */
 class BLECharacteristic {
 public:
-	BLECharacteristic(const char* uuid, uint32_t properties = 0);
-	BLECharacteristic(BLEUUID uuid, uint32_t properties = 0);
+	// maxLength > 0 allocates the value once, setValue() then copies into it and cuts longer values
+	BLECharacteristic(const char* uuid, uint32_t properties = 0, size_t maxLength = 0);
+	BLECharacteristic(BLEUUID uuid, uint32_t properties = 0, size_t maxLength = 0);
 	virtual ~BLECharacteristic();
 
 	void           addDescriptor(BLEDescriptor* pDescriptor);
@@ -62,9 +64,11 @@ public:
 	BLEUUID        getUUID();
 	std::string    getValue();
 	uint8_t*       getData();
+	size_t         getLength();
 
 	void indicate();
 	void notify(bool is_notification = true);
+	size_t notify(const uint8_t* data, size_t length, uint32_t timeoutMs = notificationTimeout);
 	void setBroadcastProperty(bool value);
 	void setCallbacks(BLECharacteristicCallbacks* pCallbacks);
 	void setIndicateProperty(bool value);
@@ -91,11 +95,13 @@ public:
 	static const uint32_t PROPERTY_WRITE_NR  = 1<<5;
 
 	static const uint32_t indicationTimeout = 1000;
+	static const uint32_t notificationTimeout = 1000; // a congested connection is given this long per packet
 
 private:
 
 	friend class BLEServer;
 	friend class BLEService;
+	friend class BLEServiceMap;
 	friend class BLEDescriptor;
 	friend class BLECharacteristicMap;
 
@@ -8,6 +8,7 @@
 #if defined(CONFIG_BT_ENABLED)
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 #include "BLEService.h"
 #ifdef ARDUINO_ARCH_ESP32
 #include "esp32-hal-log.h"
@@ -20,7 +21,12 @@
  * @return The characteristic.
  */
 BLECharacteristic* BLECharacteristicMap::getByHandle(uint16_t handle) {
-	return m_handleMap.at(handle);
+	auto it = std::lower_bound(m_handleMap.begin(), m_handleMap.end(), handle,
+		[](const std::pair<uint16_t, BLECharacteristic*>& entry, uint16_t h) { return entry.first < h; });
+	if (it == m_handleMap.end() || it->first != handle) {
+		return nullptr;
+	}
+	return it->second;
 } // getByHandle
 
 
@@ -40,9 +46,9 @@ BLECharacteristic* BLECharacteristicMap::getByUUID(const char* uuid) {
  * @return The characteristic.
  */
 BLECharacteristic* BLECharacteristicMap::getByUUID(BLEUUID uuid) {
-	for (auto &myPair : m_uuidMap) {
-		if (myPair.first->getUUID().equals(uuid)) {
-			return myPair.first;
+	for (auto pCharacteristic : m_characteristics) {
+		if (pCharacteristic->getUUID().equals(uuid)) {
+			return pCharacteristic;
 		}
 	}
 	//return m_uuidMap.at(uuid.toString());
@@ -55,11 +61,8 @@ BLECharacteristic* BLECharacteristicMap::getByUUID(BLEUUID uuid) {
  * @return The first characteristic in the map.
  */
 BLECharacteristic* BLECharacteristicMap::getFirst() {
-	m_iterator = m_uuidMap.begin();
-	if (m_iterator == m_uuidMap.end()) return nullptr;
-	BLECharacteristic* pRet = m_iterator->first;
-	m_iterator++;
-	return pRet;
+	m_iterator = 0;
+	return getNext();
 } // getFirst
 
 
@@ -68,10 +71,8 @@ BLECharacteristic* BLECharacteristicMap::getFirst() {
  * @return The next characteristic in the map.
  */
 BLECharacteristic* BLECharacteristicMap::getNext() {
-	if (m_iterator == m_uuidMap.end()) return nullptr;
-	BLECharacteristic* pRet = m_iterator->first;
-	m_iterator++;
-	return pRet;
+	if (m_iterator >= m_characteristics.size()) return nullptr;
+	return m_characteristics[m_iterator++];
 } // getNext
 
 
@@ -83,8 +84,8 @@ BLECharacteristic* BLECharacteristicMap::getNext() {
  */
 void BLECharacteristicMap::handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t* param) {
 	// Invoke the handler for every Service we have.
-	for (auto& myPair : m_uuidMap) {
-		myPair.first->handleGATTServerEvent(event, gatts_if, param);
+	for (auto pCharacteristic : m_characteristics) {
+		pCharacteristic->handleGATTServerEvent(event, gatts_if, param);
 	}
 } // handleGATTServerEvent
 
@@ -96,7 +97,13 @@ void BLECharacteristicMap::handleGATTServerEvent(esp_gatts_cb_event_t event, esp
  * @return N/A.
  */
 void BLECharacteristicMap::setByHandle(uint16_t handle, BLECharacteristic* characteristic) {
-	m_handleMap.insert(std::pair<uint16_t, BLECharacteristic*>(handle, characteristic));
+	auto it = std::lower_bound(m_handleMap.begin(), m_handleMap.end(), handle,
+		[](const std::pair<uint16_t, BLECharacteristic*>& entry, uint16_t h) { return entry.first < h; });
+	if (it != m_handleMap.end() && it->first == handle) {
+		it->second = characteristic;
+		return;
+	}
+	m_handleMap.insert(it, std::pair<uint16_t, BLECharacteristic*>(handle, characteristic));
 } // setByHandle
 
 
@@ -107,7 +114,9 @@ void BLECharacteristicMap::setByHandle(uint16_t handle, BLECharacteristic* chara
  * @return N/A.
  */
 void BLECharacteristicMap::setByUUID(BLECharacteristic* pCharacteristic, BLEUUID uuid) {
-	m_uuidMap.insert(std::pair<BLECharacteristic*, std::string>(pCharacteristic, uuid.toString()));
+	if (std::find(m_characteristics.begin(), m_characteristics.end(), pCharacteristic) == m_characteristics.end()) {
+		m_characteristics.push_back(pCharacteristic);
+	}
 } // setByUUID
 
 
@@ -119,13 +128,13 @@ std::string BLECharacteristicMap::toString() {
 	std::string res;
 	int count = 0;
 	char hex[5];
-	for (auto &myPair: m_uuidMap) {
+	for (auto pCharacteristic : m_characteristics) {
 		if (count > 0) {res += "\n";}
-		snprintf(hex, sizeof(hex), "%04x", myPair.first->getHandle());
+		snprintf(hex, sizeof(hex), "%04x", pCharacteristic->getHandle());
 		count++;
 		res += "handle: 0x";
 		res += hex;
-		res += ", uuid: " + myPair.first->getUUID().toString();
+		res += ", uuid: " + pCharacteristic->getUUID().toString();
 	}
 	return res;
 } // toString
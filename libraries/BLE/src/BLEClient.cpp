@@ -19,6 +19,69 @@
 #include <unordered_set>
 #include "BLEDevice.h"
 #include "esp32-hal-log.h"
+#include <nvs.h>
+
+#ifndef BLE_CLIENT_CACHE_PEERS
+#define BLE_CLIENT_CACHE_PEERS 32 // peers whose attribute table is kept in RAM
+#endif
+
+#define BLE_CLIENT_CACHE_NVS     "blecache"
+#define BLE_CLIENT_CACHE_VERSION 1
+
+/*
+ * Discovery cache
+ * ---------------
+ * A discovered attribute table is kept per peer address as a blob, the same bytes in RAM and in NVS:
+ * version, service count, then per service its esp_gatt_id_t, start and end handle, characteristic count,
+ * per characteristic its handle, esp_bt_uuid_t, properties, descriptor count and per descriptor its handle
+ * and esp_bt_uuid_t. Only this device reads it back, so the structs are stored as they are in memory.
+ */
+static bool                               s_cacheEnabled = false;
+static bool                               s_cachePersist = false;
+static std::map<std::string, std::string> s_discoveryCache;
+static SemaphoreHandle_t                  s_cacheLock = nullptr;
+
+static void cacheLock() {
+	if (!s_cacheLock) {
+		s_cacheLock = xSemaphoreCreateMutex();
+	}
+	xSemaphoreTake(s_cacheLock, portMAX_DELAY);
+}
+
+static void cacheUnlock() {
+	xSemaphoreGive(s_cacheLock);
+}
+
+// NVS keys are at most 15 characters, the address without its colons is 12
+static std::string cacheKey(BLEAddress address) {
+	std::string key;
+	for (char c : address.toString()) {
+		if (c != ':') {
+			key += c;
+		}
+	}
+	return key;
+}
+
+static void cacheErase(BLEAddress address) {
+	std::string key = cacheKey(address);
+	cacheLock();
+	s_discoveryCache.erase(key);
+	cacheUnlock();
+	nvs_handle handle;
+	if (s_cachePersist && nvs_open(BLE_CLIENT_CACHE_NVS, NVS_READWRITE, &handle) == ESP_OK) {
+		nvs_erase_key(handle, key.c_str());
+		nvs_commit(handle);
+		nvs_close(handle);
+	}
+}
+
+// the peer's Service Changed indication, its handles may have moved
+static void cacheServiceChanged(BLERemoteCharacteristic* pCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	BLEClient* pClient = pCharacteristic->getRemoteService()->getClient();
+	log_i("Service changed on %s, discovery cache dropped", pClient->getPeerAddress().toString().c_str());
+	cacheErase(pClient->getPeerAddress());
+}
 
 /*
  * Design
@@ -186,6 +249,9 @@ void BLEClient::gattClientEventHandler(
 
 		case ESP_GATTC_SRVC_CHG_EVT:
 			log_i("SERVICE CHANGED");
+			if (s_cacheEnabled) {
+				cacheErase(BLEAddress(evtParam->srvc_chg.remote_bda));
+			}
 			break;
 
 		case ESP_GATTC_CLOSE_EVT: {
@@ -445,8 +511,11 @@ std::map<std::string, BLERemoteService*>* BLEClient::getServices() {
  * and will culminate with an ESP_GATTC_SEARCH_CMPL_EVT when all have been received.
  */
 	log_v(">> getServices");
-// TODO implement retrieving services from cache
 	clearServices(); // Clear any services that may exist.
+	if (s_cacheEnabled && loadDiscoveryCache()) {
+		log_v("<< getServices: from cache");
+		return &m_servicesMap;
+	}
 
 	esp_err_t errRc = esp_ble_gattc_search_service(
 		getGattcIf(),
@@ -461,11 +530,234 @@ std::map<std::string, BLERemoteService*>* BLEClient::getServices() {
 	}
 	// If sucessfull, remember that we now have services.
 	m_haveServices = (m_semaphoreSearchCmplEvt.wait("getServices") == 0);
+	if (m_haveServices && s_cacheEnabled) {
+		saveDiscoveryCache();
+	}
 	log_v("<< getServices");
 	return &m_servicesMap;
 } // getServices
 
 
+/**
+ * @brief Turn the discovery cache on or off.
+ *
+ * Discovering the services of a peripheral takes a second or two. With the cache on, getServices() on a peer
+ * seen before builds the services, characteristics and descriptors from what was found the last time, without
+ * asking the peer. The table is dropped when the peer indicates Service Changed.
+ *
+ * @param [in] enable Use the cache.
+ * @param [in] persist Also keep the tables in NVS, so they outlive a restart.
+ */
+void BLEClient::setDiscoveryCache(bool enable, bool persist) {
+	s_cacheEnabled = enable;
+	s_cachePersist = enable && persist;
+} // setDiscoveryCache
+
+
+/**
+ * @brief Forget the attribute tables of all peers, in RAM and in NVS.
+ */
+void BLEClient::clearDiscoveryCache() {
+	cacheLock();
+	s_discoveryCache.clear();
+	cacheUnlock();
+	nvs_handle handle;
+	if (nvs_open(BLE_CLIENT_CACHE_NVS, NVS_READWRITE, &handle) == ESP_OK) {
+		nvs_erase_all(handle);
+		nvs_commit(handle);
+		nvs_close(handle);
+	}
+} // clearDiscoveryCache
+
+
+/**
+ * @brief Forget the attribute table of one peer, so it is discovered on the next getServices().
+ * @param [in] address The peer.
+ */
+void BLEClient::clearDiscoveryCache(BLEAddress address) {
+	cacheErase(address);
+} // clearDiscoveryCache
+
+
+/**
+ * @brief Build the services of the peer from the discovery cache.
+ * @return False if the peer is not cached, discovery has to be done.
+ */
+bool BLEClient::loadDiscoveryCache() {
+	std::string key = cacheKey(m_peerAddress);
+	std::string blob;
+	cacheLock();
+	auto it = s_discoveryCache.find(key);
+	if (it != s_discoveryCache.end()) {
+		blob = it->second;
+	}
+	cacheUnlock();
+	nvs_handle handle;
+	if (blob.empty() && s_cachePersist && nvs_open(BLE_CLIENT_CACHE_NVS, NVS_READONLY, &handle) == ESP_OK) {
+		size_t length = 0;
+		if (nvs_get_blob(handle, key.c_str(), nullptr, &length) == ESP_OK && length) {
+			blob.resize(length);
+			if (nvs_get_blob(handle, key.c_str(), &blob[0], &length) != ESP_OK) {
+				blob.clear();
+			}
+		}
+		nvs_close(handle);
+	}
+	if (blob.size() < 2 || blob[0] != BLE_CLIENT_CACHE_VERSION) {
+		return false;
+	}
+
+	const uint8_t* p   = (const uint8_t*)blob.data();
+	const uint8_t* end = p + blob.size();
+	bool ok = true;
+	auto take = [&](void* dst, size_t size) {
+		if (!ok || (size_t)(end - p) < size) {
+			ok = false;
+			return;
+		}
+		memcpy(dst, p, size);
+		p += size;
+	};
+
+	BLERemoteCharacteristic* pServiceChanged = nullptr;
+	uint8_t version, serviceCount;
+	take(&version, 1);
+	take(&serviceCount, 1);
+	for (uint8_t i = 0; ok && i < serviceCount; i++) {
+		esp_gatt_id_t srvcId;
+		uint16_t startHandle, endHandle;
+		uint8_t charCount;
+		take(&srvcId, sizeof(srvcId));
+		take(&startHandle, 2);
+		take(&endHandle, 2);
+		take(&charCount, 1);
+		if (!ok) {
+			break;
+		}
+		BLERemoteService* pRemoteService = new BLERemoteService(srvcId, this, startHandle, endHandle);
+		m_servicesMap.insert(std::pair<std::string, BLERemoteService*>(BLEUUID(srvcId).toString(), pRemoteService));
+		m_servicesMapByInstID.insert(std::pair<BLERemoteService *, uint16_t>(pRemoteService, srvcId.inst_id));
+		for (uint8_t c = 0; ok && c < charCount; c++) {
+			uint16_t charHandle;
+			esp_bt_uuid_t charUuid;
+			uint8_t properties, descrCount;
+			take(&charHandle, 2);
+			take(&charUuid, sizeof(charUuid));
+			take(&properties, 1);
+			take(&descrCount, 1);
+			if (!ok) {
+				break;
+			}
+			BLERemoteCharacteristic* pCharacteristic = new BLERemoteCharacteristic(charHandle, BLEUUID(charUuid),
+				(esp_gatt_char_prop_t)properties, pRemoteService, false);
+			pRemoteService->m_characteristicMap.insert(std::pair<std::string, BLERemoteCharacteristic*>(pCharacteristic->getUUID().toString(), pCharacteristic));
+			pRemoteService->m_characteristicMapByHandle.insert(std::pair<uint16_t, BLERemoteCharacteristic*>(charHandle, pCharacteristic));
+			for (uint8_t d = 0; ok && d < descrCount; d++) {
+				uint16_t descrHandle;
+				esp_bt_uuid_t descrUuid;
+				take(&descrHandle, 2);
+				take(&descrUuid, sizeof(descrUuid));
+				if (!ok) {
+					break;
+				}
+				BLERemoteDescriptor* pDescriptor = new BLERemoteDescriptor(descrHandle, BLEUUID(descrUuid), pCharacteristic);
+				pCharacteristic->m_descriptorMap.insert(std::pair<std::string, BLERemoteDescriptor*>(pDescriptor->getUUID().toString(), pDescriptor));
+			}
+			if (pRemoteService->getUUID().equals(BLEUUID((uint16_t)0x1801)) && pCharacteristic->getUUID().equals(BLEUUID((uint16_t)0x2a05))) {
+				pServiceChanged = pCharacteristic;
+			}
+		}
+		pRemoteService->m_haveCharacteristics = true;
+	}
+	if (!ok) {
+		log_w("Discovery cache of %s is damaged, discovering", m_peerAddress.toString().c_str());
+		clearServices();
+		m_servicesMapByInstID.clear();
+		cacheErase(m_peerAddress);
+		return false;
+	}
+	m_haveServices = true;
+
+	// discovery would have told the stack where Service Changed is, without it the indication comes through here
+	if (pServiceChanged != nullptr && pServiceChanged->canIndicate()) {
+		pServiceChanged->registerForNotify(cacheServiceChanged, false);
+	}
+	return true;
+} // loadDiscoveryCache
+
+
+/**
+ * @brief Read the whole attribute table of the peer into the discovery cache.
+ *
+ * The characteristics and descriptors come from the table the stack built during service discovery,
+ * nothing more is asked of the peer.
+ */
+void BLEClient::saveDiscoveryCache() {
+	std::string blob;
+	uint8_t serviceCount = 0;
+	blob += (char)BLE_CLIENT_CACHE_VERSION;
+	blob += (char)0;
+	auto put = [&blob](const void* src, size_t size) {
+		blob.append((const char*)src, size);
+	};
+	for (auto &myPair : m_servicesMap) {
+		BLERemoteService* pRemoteService = myPair.second;
+		if (serviceCount == 0xff) {
+			break;
+		}
+		std::map<uint16_t, BLERemoteCharacteristic*>* pChars = pRemoteService->getCharacteristicsByHandle();
+		uint8_t charCount = pChars->size() > 0xff ? 0xff : pChars->size();
+		put(pRemoteService->getSrvcId(), sizeof(esp_gatt_id_t));
+		put(&pRemoteService->m_startHandle, 2);
+		put(&pRemoteService->m_endHandle, 2);
+		put(&charCount, 1);
+		uint8_t c = 0;
+		for (auto &charPair : *pChars) {
+			if (c++ == charCount) {
+				break;
+			}
+			BLERemoteCharacteristic* pCharacteristic = charPair.second;
+			uint8_t properties = pCharacteristic->m_charProp;
+			std::map<std::string, BLERemoteDescriptor*>* pDescrs = pCharacteristic->getDescriptors();
+			uint8_t descrCount = pDescrs->size() > 0xff ? 0xff : pDescrs->size();
+			put(&pCharacteristic->m_handle, 2);
+			put(pCharacteristic->m_uuid.getNative(), sizeof(esp_bt_uuid_t));
+			put(&properties, 1);
+			put(&descrCount, 1);
+			uint8_t d = 0;
+			for (auto &descrPair : *pDescrs) {
+				if (d++ == descrCount) {
+					break;
+				}
+				uint16_t descrHandle = descrPair.second->getHandle();
+				put(&descrHandle, 2);
+				put(descrPair.second->m_uuid.getNative(), sizeof(esp_bt_uuid_t));
+			}
+		}
+		serviceCount++;
+	}
+	blob[1] = (char)serviceCount;
+
+	std::string key = cacheKey(m_peerAddress);
+	cacheLock();
+	if (s_discoveryCache.find(key) == s_discoveryCache.end() && s_discoveryCache.size() >= BLE_CLIENT_CACHE_PEERS) {
+		s_discoveryCache.erase(s_discoveryCache.begin());
+	}
+	s_discoveryCache[key] = blob;
+	cacheUnlock();
+	nvs_handle handle;
+	if (s_cachePersist && nvs_open(BLE_CLIENT_CACHE_NVS, NVS_READWRITE, &handle) == ESP_OK) {
+		esp_err_t err = nvs_set_blob(handle, key.c_str(), blob.data(), blob.size());
+		if (err != ESP_OK) {
+			log_w("nvs_set_blob: %s", GeneralUtils::errorToString(err));
+		}
+		nvs_commit(handle);
+		nvs_close(handle);
+	}
+	log_d("Discovery cache of %s: %d services, %d bytes", m_peerAddress.toString().c_str(), serviceCount, blob.size());
+} // saveDiscoveryCache
+
+
 /**
  * @brief Get the value of a specific characteristic associated with a specific service.
  * @param [in] serviceUUID The service that owns the characteristic.
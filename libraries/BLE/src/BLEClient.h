@@ -58,6 +58,12 @@ public:
 	esp_gatt_if_t                              getGattcIf();
 	uint16_t								   getMTU();
 
+	// Keep the services, characteristics and descriptors found on a peer and skip discovery when it is
+	// connected again. persist keeps them in NVS as well, over a restart.
+	static void                                setDiscoveryCache(bool enable, bool persist = false);
+	static void                                clearDiscoveryCache();
+	static void                                clearDiscoveryCache(BLEAddress address);
+
 uint16_t m_appId;
 private:
 	friend class BLEDevice;
@@ -85,6 +91,8 @@ private:
 	std::map<std::string, BLERemoteService*> m_servicesMap;
 	std::map<BLERemoteService*, uint16_t> m_servicesMapByInstID;
 	void clearServices();   // Clear any existing services.
+	bool loadDiscoveryCache();
+	void saveDiscoveryCache();
 	uint16_t m_mtu = 23;
 }; // class BLEDevice
 
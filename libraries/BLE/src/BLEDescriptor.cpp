@@ -142,6 +142,7 @@ void BLEDescriptor::handleGATTServerEvent(
 					m_pCharacteristic->getService()->getHandle() == param->add_char_descr.service_handle &&
 					m_pCharacteristic == m_pCharacteristic->getService()->getLastCreatedCharacteristic()) {
 				setHandle(param->add_char_descr.attr_handle);
+				m_pCharacteristic->m_descriptorMap.setByHandle(param->add_char_descr.attr_handle, this);
 				m_semaphoreCreateEvt.give();
 			}
 			break;
@@ -8,6 +8,7 @@
 #if defined(CONFIG_BT_ENABLED)
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 #include "BLECharacteristic.h"
 #include "BLEDescriptor.h"
 #include <esp_gatts_api.h>   // ESP32 BLE
@@ -31,9 +32,9 @@ BLEDescriptor* BLEDescriptorMap::getByUUID(const char* uuid) {
  * @return The descriptor.  If not present, then nullptr is returned.
  */
 BLEDescriptor* BLEDescriptorMap::getByUUID(BLEUUID uuid) {
-	for (auto &myPair : m_uuidMap) {
-		if (myPair.first->getUUID().equals(uuid)) {
-			return myPair.first;
+	for (auto pDescriptor : m_descriptors) {
+		if (pDescriptor->getUUID().equals(uuid)) {
+			return pDescriptor;
 		}
 	}
 	//return m_uuidMap.at(uuid.toString());
@@ -47,7 +48,12 @@ BLEDescriptor* BLEDescriptorMap::getByUUID(BLEUUID uuid) {
  * @return The descriptor.
  */
 BLEDescriptor* BLEDescriptorMap::getByHandle(uint16_t handle) {
-	return m_handleMap.at(handle);
+	auto it = std::lower_bound(m_handleMap.begin(), m_handleMap.end(), handle,
+		[](const std::pair<uint16_t, BLEDescriptor*>& entry, uint16_t h) { return entry.first < h; });
+	if (it == m_handleMap.end() || it->first != handle) {
+		return nullptr;
+	}
+	return it->second;
 } // getByHandle
 
 
@@ -58,7 +64,9 @@ BLEDescriptor* BLEDescriptorMap::getByHandle(uint16_t handle) {
  * @return N/A.
  */
 void BLEDescriptorMap::setByUUID(const char* uuid, BLEDescriptor* pDescriptor){
-	m_uuidMap.insert(std::pair<BLEDescriptor*, std::string>(pDescriptor, uuid));
+	if (std::find(m_descriptors.begin(), m_descriptors.end(), pDescriptor) == m_descriptors.end()) {
+		m_descriptors.push_back(pDescriptor);
+	}
 } // setByUUID
 
 
@@ -70,7 +78,9 @@ void BLEDescriptorMap::setByUUID(const char* uuid, BLEDescriptor* pDescriptor){
  * @return N/A.
  */
 void BLEDescriptorMap::setByUUID(BLEUUID uuid, BLEDescriptor* pDescriptor) {
-	m_uuidMap.insert(std::pair<BLEDescriptor*, std::string>(pDescriptor, uuid.toString()));
+	if (std::find(m_descriptors.begin(), m_descriptors.end(), pDescriptor) == m_descriptors.end()) {
+		m_descriptors.push_back(pDescriptor);
+	}
 } // setByUUID
 
 
@@ -81,7 +91,13 @@ void BLEDescriptorMap::setByUUID(BLEUUID uuid, BLEDescriptor* pDescriptor) {
  * @return N/A.
  */
 void BLEDescriptorMap::setByHandle(uint16_t handle, BLEDescriptor* pDescriptor) {
-	m_handleMap.insert(std::pair<uint16_t, BLEDescriptor*>(handle, pDescriptor));
+	auto it = std::lower_bound(m_handleMap.begin(), m_handleMap.end(), handle,
+		[](const std::pair<uint16_t, BLEDescriptor*>& entry, uint16_t h) { return entry.first < h; });
+	if (it != m_handleMap.end() && it->first == handle) {
+		it->second = pDescriptor;
+		return;
+	}
+	m_handleMap.insert(it, std::pair<uint16_t, BLEDescriptor*>(handle, pDescriptor));
 } // setByHandle
 
 
@@ -93,13 +109,13 @@ std::string BLEDescriptorMap::toString() {
 	std::string res;
 	char hex[5];
 	int count = 0;
-	for (auto &myPair : m_uuidMap) {
+	for (auto pDescriptor : m_descriptors) {
 		if (count > 0) {res += "\n";}
-		snprintf(hex, sizeof(hex), "%04x", myPair.first->getHandle());
+		snprintf(hex, sizeof(hex), "%04x", pDescriptor->getHandle());
 		count++;
 		res += "handle: 0x";
 		res += hex;
-		res += ", uuid: " + myPair.first->getUUID().toString();
+		res += ", uuid: " + pDescriptor->getUUID().toString();
 	}
 	return res;
 } // toString
@@ -116,8 +132,8 @@ void BLEDescriptorMap::handleGATTServerEvent(
 		esp_gatt_if_t             gatts_if,
 		esp_ble_gatts_cb_param_t* param) {
 	// Invoke the handler for every descriptor we have.
-	for (auto &myPair : m_uuidMap) {
-		myPair.first->handleGATTServerEvent(event, gatts_if, param);
+	for (auto pDescriptor : m_descriptors) {
+		pDescriptor->handleGATTServerEvent(event, gatts_if, param);
 	}
 } // handleGATTServerEvent
 
@@ -127,11 +143,8 @@ void BLEDescriptorMap::handleGATTServerEvent(
  * @return The first descriptor in the map.
  */
 BLEDescriptor* BLEDescriptorMap::getFirst() {
-	m_iterator = m_uuidMap.begin();
-	if (m_iterator == m_uuidMap.end()) return nullptr;
-	BLEDescriptor* pRet = m_iterator->first;
-	m_iterator++;
-	return pRet;
+	m_iterator = 0;
+	return getNext();
 } // getFirst
 
 
@@ -140,9 +153,7 @@ BLEDescriptor* BLEDescriptorMap::getFirst() {
  * @return The next descriptor in the map.
  */
 BLEDescriptor* BLEDescriptorMap::getNext() {
-	if (m_iterator == m_uuidMap.end()) return nullptr;
-	BLEDescriptor* pRet = m_iterator->first;
-	m_iterator++;
-	return pRet;
+	if (m_iterator >= m_descriptors.size()) return nullptr;
+	return m_descriptors[m_iterator++];
 } // getNext
 #endif /* CONFIG_BT_ENABLED */
@@ -10,6 +10,7 @@
 #include <freertos/event_groups.h>
 #include <freertos/task.h>
 #include <esp_err.h>
+#include <esp_heap_caps.h>
 #include <nvs_flash.h>
 #include <esp_bt.h>            // ESP32 BLE
 #include <esp_bt_device.h>     // ESP32 BLE
@@ -262,6 +263,10 @@ gatts_event_handler BLEDevice::m_customGattsHandler = nullptr;
 		}
 	} // switch
 
+	if (BLEDevice::m_pServer != nullptr) {
+		BLEDevice::m_pServer->handleGAPEvent(event, param);
+	}
+
 	if (BLEDevice::m_pClient != nullptr) {
 		BLEDevice::m_pClient->handleGAPEvent(event, param);
 	}
@@ -335,8 +340,9 @@ gatts_event_handler BLEDevice::m_customGattsHandler = nullptr;
 		initialized = true; // Set the initialization flag to ensure we are only initialized once.
 
 		esp_err_t errRc = ESP_OK;
+		size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
 #ifdef ARDUINO_ARCH_ESP32
-		if (!btStart()) {
+		if (!btStartMode(BLE_ONLY ? BT_MODE_BLE : BT_MODE_DEFAULT)) {
 			errRc = ESP_FAIL;
 			return;
 		}
@@ -425,8 +431,9 @@ gatts_event_handler BLEDevice::m_customGattsHandler = nullptr;
 			return;
 		};
 #endif // CONFIG_BLE_SMP_ENABLE
+		log_i("BLE stack took %u bytes of internal RAM", freeHeap - heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+		vTaskDelay(200 / portTICK_PERIOD_MS); // Delay for 200 msecs as a workaround to an apparent Arduino environment issue.
 	}
-	vTaskDelay(200 / portTICK_PERIOD_MS); // Delay for 200 msecs as a workaround to an apparent Arduino environment issue.
 } // init
 
 
@@ -642,7 +649,7 @@ void BLEDevice::removePeerDevice(uint16_t conn_id, bool _client) {
     esp_bt_controller_deinit();
 #ifdef ARDUINO_ARCH_ESP32
     if (release_memory) {
-        esp_bt_controller_mem_release(ESP_BT_MODE_BTDM);  // <-- require tests because we released classic BT memory and this can cause crash (most likely not, esp-idf takes care of it)
+        esp_bt_mem_release(ESP_BT_MODE_BTDM);  // the controller and the host stack's .bss and .data, BT can not start again until restart
     } else {
         initialized = false;   
     } 
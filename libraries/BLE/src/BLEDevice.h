@@ -21,6 +21,10 @@
 #include "BLEScan.h"
 #include "BLEAddress.h"
 
+#ifndef BLE_ONLY
+#define BLE_ONLY 0 // 1 gives the Classic controller memory (tens of KB) back to the heap, BluetoothSerial can not start after BLE then
+#endif
+
 /**
  * @brief BLE functions.
  */
@@ -9,9 +9,11 @@
 
 #include "BLEHIDDevice.h"
 #include "BLE2904.h"
+#include "esp_timer.h"
+#include "esp32-hal-log.h"
 
 
-BLEHIDDevice::BLEHIDDevice(BLEServer* server) {
+BLEHIDDevice::BLEHIDDevice(BLEServer* server) : m_server(server) {
 	/*
 	 * Here we create mandatory services described in bluetooth specification
 	 */
@@ -121,9 +123,114 @@ BLECharacteristic* BLEHIDDevice::inputReport(uint8_t reportID) {
 	inputReportCharacteristic->addDescriptor(p2902);
 	inputReportCharacteristic->addDescriptor(inputReportDescriptor);
 
+	if (m_inputReportCount < BLE_HID_MAX_INPUT_REPORTS) {
+		m_inputReports[m_inputReportCount++] = { reportID, inputReportCharacteristic, p2902 };
+	} else {
+		log_w("input report %u can't be sent with sendReport(), raise BLE_HID_MAX_INPUT_REPORTS", reportID);
+	}
 	return inputReportCharacteristic;
 }
 
+/*
+ * @brief Send an input report to every host that subscribed to it.
+ * The report goes straight to the stack: no copy into the characteristic, no descriptor lookup and nothing
+ * allocated. A report that doesn't fit the MTU of a host is not sent to it, HID reports can't be cut.
+ * @param [in] reportID Input report ID, one created with inputReport()
+ * @param [in] data The report, without the ID
+ * @param [in] length Its size
+ * @param [in] timeoutMs How long a congested link is waited for, 0 drops the report at once so the next one is fresh
+ * @return True if every connected host got it
+ */
+bool BLEHIDDevice::sendReport(uint8_t reportID, const uint8_t* data, size_t length, uint32_t timeoutMs) {
+	int64_t start = esp_timer_get_time();
+	m_stats.reports++;
+
+	input_report_t* report = nullptr;
+	for (uint8_t i = 0; i < m_inputReportCount; i++) {
+		if (m_inputReports[i].id == reportID) {
+			report = &m_inputReports[i];
+			break;
+		}
+	}
+	if (report == nullptr || !report->p2902->getNotifications()) {
+		m_stats.dropped++;
+		return false;
+	}
+
+	// the connections go away in the BT task, so not walked while waiting for one of them
+	uint16_t connIds[BLE_HID_MAX_CONNECTIONS];
+	size_t count = 0;
+	for (auto &myPair : m_server->m_connectedServersMap) {
+		if (count == BLE_HID_MAX_CONNECTIONS) {
+			break;
+		}
+		connIds[count++] = myPair.first;
+	}
+	if (count == 0) {
+		m_stats.dropped++;
+		return false;
+	}
+
+	bool all = true;
+	for (size_t i = 0; i < count; i++) {
+		if (!m_server->waitUncongested(connIds[i], timeoutMs) || length > (size_t)m_server->getPeerMTU(connIds[i]) - 3) {
+			m_server->addNotifyStats(connIds[i], 0, length);
+			all = false;
+			continue;
+		}
+		esp_err_t errRc = ::esp_ble_gatts_send_indicate(m_server->getGattsIf(), connIds[i], report->characteristic->getHandle(), length, (uint8_t*)data, false);
+		if (errRc != ESP_OK) {
+			log_e("esp_ble_gatts_send_indicate: rc=%d", errRc);
+			all = false;
+			continue;
+		}
+		m_server->addNotifyStats(connIds[i], length, 0);
+		m_stats.sent++;
+	}
+	if (!all) {
+		m_stats.dropped++;
+	}
+
+	int64_t now = esp_timer_get_time();
+	uint32_t took = now - start;
+	m_stats.send_us = m_stats.send_us ? (m_stats.send_us * 7 + took) / 8 : took;
+	if (took > m_stats.send_max_us) {
+		m_stats.send_max_us = took;
+	}
+	if (m_lastReport) {
+		uint32_t interval = now - m_lastReport;
+		m_stats.interval_us = m_stats.interval_us ? (m_stats.interval_us * 7 + interval) / 8 : interval;
+	}
+	m_lastReport = now;
+	return all;
+}
+
+/*
+ * @brief Ask the hosts for the shortest connection interval, a report waits at most one interval for the air
+ * Hosts agree to it once bonded if at all, Apple hosts settle on 11.25 ms and up for HID.
+ * @param [in] interval Connection interval in 1.25 ms units
+ * @param [in] timeout Supervision timeout in 10 ms units
+ */
+void BLEHIDDevice::setLowLatency(uint16_t interval, uint16_t timeout) {
+	m_server->setPreferredConnParams(interval, interval, 0, timeout, true);
+}
+
+/*
+ * @brief Get the counters of sendReport()
+ */
+ble_hid_stats_t BLEHIDDevice::getStats() {
+	ble_hid_stats_t stats = m_stats;
+	if (!m_server->m_connectedServersMap.empty()) {
+		stats.conn_interval_us = m_server->m_connectedServersMap.begin()->second.interval * 1250;
+	}
+	return stats;
+}
+
+void BLEHIDDevice::resetStats() {
+	m_stats = {};
+	m_lastReport = 0;
+}
+
 /*
  * @brief Create output report characteristic that need to be saved as new characteristic object so can be further used
  * @param [in] reportID Output report ID, the same as in report map for output object related to created characteristic
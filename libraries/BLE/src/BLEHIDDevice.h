@@ -27,6 +27,25 @@
 #define HID_DIGITAL_PEN	0x03C7
 #define HID_BARCODE		0x03C8
 
+#ifndef BLE_HID_MAX_INPUT_REPORTS
+#define BLE_HID_MAX_INPUT_REPORTS	8	// input reports sendReport() knows, inputReport() creates more without it
+#endif
+
+#ifndef BLE_HID_MAX_CONNECTIONS
+#define BLE_HID_MAX_CONNECTIONS		4	// hosts one sendReport() goes to
+#endif
+
+// input reports sent with sendReport(), since resetStats()
+typedef struct {
+	uint32_t reports;		// sendReport() calls
+	uint32_t sent;			// notifications the stack took
+	uint32_t dropped;		// reports no host got, nobody subscribed or the link stayed congested past the timeout
+	uint32_t interval_us;	// between the reports handed to the stack, averaged; 1000000 / interval_us is the report rate
+	uint32_t send_us;		// sendReport() until the stack had the report, averaged
+	uint32_t send_max_us;
+	uint32_t conn_interval_us;	// of the first host, a report waits up to this long for its connection event
+} ble_hid_stats_t;
+
 class BLEHIDDevice {
 public:
 	BLEHIDDevice(BLEServer*);
@@ -58,7 +77,26 @@ public:
 	BLECharacteristic* 	bootInput();
 	BLECharacteristic* 	bootOutput();
 
+	// an input report to every subscribed host, without copying it into the characteristic; timeoutMs 0 drops it when the link is congested
+	bool	sendReport(uint8_t reportID, const uint8_t* data, size_t length, uint32_t timeoutMs = 0);
+	// asks every host for this interval in 1.25 ms units once it bonded, 6 is 7.5 ms, the shortest there is
+	void	setLowLatency(uint16_t interval = 6, uint16_t timeout = 200);
+	ble_hid_stats_t	getStats();
+	void	resetStats();
+
 private:
+	typedef struct {
+		uint8_t				id;
+		BLECharacteristic*	characteristic;
+		BLE2902*			p2902;
+	} input_report_t;
+
+	BLEServer*			m_server;
+	input_report_t		m_inputReports[BLE_HID_MAX_INPUT_REPORTS] = {};
+	uint8_t				m_inputReportCount = 0;
+	ble_hid_stats_t		m_stats = {};
+	int64_t				m_lastReport = 0;
+
 	BLEService*			m_deviceInfoService;			//0x180a
 	BLEService*			m_hidService;					//0x1812
 	BLEService*			m_batteryService = 0;			//0x180f
@@ -32,7 +32,8 @@ BLERemoteCharacteristic::BLERemoteCharacteristic(
 		uint16_t             handle,
 		BLEUUID              uuid,
 		esp_gatt_char_prop_t charProp,
-		BLERemoteService*    pRemoteService) {
+		BLERemoteService*    pRemoteService,
+		bool                 discover) {
 	log_v(">> BLERemoteCharacteristic: handle: %d 0x%d, uuid: %s", handle, handle, uuid.toString().c_str());
 	m_handle         = handle;
 	m_uuid           = uuid;
@@ -42,7 +43,9 @@ BLERemoteCharacteristic::BLERemoteCharacteristic(
 	m_rawData = nullptr;
     m_auth           = ESP_GATT_AUTH_REQ_NONE;
 
-	retrieveDescriptors(); // Get the descriptors for this characteristic
+	if (discover) {
+		retrieveDescriptors(); // Get the descriptors for this characteristic
+	}
 	log_v("<< BLERemoteCharacteristic");
 } // BLERemoteCharacteristic
 
@@ -184,7 +187,7 @@ void BLERemoteCharacteristic::gattClientEventHandler(esp_gattc_cb_event_t event,
 			// At this point, we have determined that the event is for us, so now we save the value
 			// and unlock the semaphore to ensure that the requestor of the data can continue.
 			if (evtParam->read.status == ESP_GATT_OK) {
-				m_value = std::string((char*) evtParam->read.value, evtParam->read.value_len);
+				m_value.assign((char*) evtParam->read.value, evtParam->read.value_len); // keeps the storage of the last value
 				if(m_rawData != nullptr) free(m_rawData);
 				m_rawData = (uint8_t*) calloc(evtParam->read.value_len, sizeof(uint8_t));
 				memcpy(m_rawData, evtParam->read.value, evtParam->read.value_len);
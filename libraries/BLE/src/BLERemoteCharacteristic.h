@@ -43,6 +43,9 @@ public:
 	uint16_t    getHandle();
 	BLEUUID     getUUID();
 	std::string readValue();
+	// the value of the last readValue(), without a copy
+	const uint8_t* getData()   { return (const uint8_t*) m_value.data(); }
+	size_t      getLength()    { return m_value.length(); }
 	uint8_t     readUInt8();
 	uint16_t    readUInt16();
 	uint32_t    readUInt32();
@@ -56,7 +59,7 @@ public:
     void        setAuth(esp_gatt_auth_req_t auth);
 
 private:
-	BLERemoteCharacteristic(uint16_t handle, BLEUUID uuid, esp_gatt_char_prop_t charProp, BLERemoteService* pRemoteService);
+	BLERemoteCharacteristic(uint16_t handle, BLEUUID uuid, esp_gatt_char_prop_t charProp, BLERemoteService* pRemoteService, bool discover = true);
 	friend class BLEClient;
 	friend class BLERemoteService;
 	friend class BLERemoteDescriptor;
@@ -38,6 +38,7 @@ public:
 	void        gattClientEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* evtParam);
 
 private:
+	friend class BLEClient;
 	friend class BLERemoteCharacteristic;
 	BLERemoteDescriptor(
 		uint16_t                 handle,
@@ -17,6 +17,7 @@
 #include "BLEUtils.h"
 #include "GeneralUtils.h"
 #include "esp32-hal-log.h"
+#include "esp32-hal.h"
 
 /**
  * Constructor
@@ -33,6 +34,7 @@ BLEScan::BLEScan() {
 	m_shouldParse                    = true;
 	setInterval(100);
 	setWindow(100);
+	vPortCPUInitializeMutex(&m_tableMux);
 } // BLEScan
 
 
@@ -87,6 +89,17 @@ void BLEScan::handleGAPEvent(
 						break;
 					}
 
+					if (m_table) {
+						tableUpdate(param);
+					}
+					if (m_rawCallback) {
+						m_rawCallback(param->scan_rst.bda, param->scan_rst.ble_addr_type, param->scan_rst.rssi,
+						              param->scan_rst.ble_adv, param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len);
+					}
+					if ((m_table || m_rawCallback) && !m_pAdvertisedDeviceCallbacks) {
+						break;
+					}
+
 // Examine our list of previously scanned addresses and, if we found this one already,
 // ignore it.
 					BLEAddress advertisedAddress(param->scan_rst.bda);
@@ -123,7 +136,7 @@ void BLEScan::handleGAPEvent(
 
 					if (m_pAdvertisedDeviceCallbacks) { // if has callback, no need to record to vector
 						m_pAdvertisedDeviceCallbacks->onResult(*advertisedDevice);
-					} else if (!m_wantDuplicates && !found) {   // if no callback and not want duplicate, and not already in vector, record it
+					} else if (!m_wantDuplicates && !found && !m_table) {   // if no callback and not want duplicate, and not already in vector, record it
 						m_scanResults.m_vectorAdvertisedDevices.insert(std::pair<std::string, BLEAdvertisedDevice*>(advertisedAddress.toString(), advertisedDevice));
 						shouldDelete = false;
 					}
@@ -177,6 +190,15 @@ void BLEScan::setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* pAdvert
 	m_shouldParse = shouldParse;
 } // setAdvertisedDeviceCallbacks
 
+/**
+ * @brief Set a function to be handed each advert as it arrives, unparsed.
+ * It runs in the Bluetooth task, so it should return quickly.
+ * @param [in] cb The function, nullptr to remove it.
+ */
+void BLEScan::setRawAdvertisedCallback(BLERawAdvertisedCallback cb) {
+	m_rawCallback = cb;
+} // setRawAdvertisedCallback
+
 /**
  * @brief Set the interval to scan.
  * @param [in] The interval in msecs.
@@ -215,6 +237,12 @@ bool BLEScan::start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults), b
 			delete _dev.second;
 		}
 		m_scanResults.m_vectorAdvertisedDevices.clear();
+		if (m_table) {
+			portENTER_CRITICAL(&m_tableMux);
+			memset(m_table, 0, m_tableSlots * sizeof(BLEScanEntry));
+			m_tableCount = 0;
+			portEXIT_CRITICAL(&m_tableMux);
+		}
 	}
 
 	esp_err_t errRc = ::esp_ble_gap_set_scan_params(&m_scan_params);
@@ -330,4 +358,162 @@ void BLEScan::clearResults() {
 	m_scanResults.m_vectorAdvertisedDevices.clear();
 }
 
+/**
+ * @brief Keep the results in a table of fixed size instead of BLEScanResults.
+ * Nothing is allocated per advert: a known address has its RSSI, payload and
+ * last seen time updated in place, and a new one takes the place of the least
+ * recently seen device once the table is full. Set it while not scanning.
+ * @param [in] capacity The number of devices kept, 0 to go back to BLEScanResults.
+ * @return False if the table could not be allocated.
+ */
+bool BLEScan::setTable(size_t capacity) {
+	size_t slots = 0;
+	BLEScanEntry* table = nullptr;
+	if (capacity) {
+		slots = 8;
+		while (slots < capacity + capacity / 4) {
+			slots <<= 1;
+		}
+		table = (BLEScanEntry*)calloc(slots, sizeof(BLEScanEntry));
+		if (!table) {
+			log_e("no memory for %u scan entries", capacity);
+			return false;
+		}
+	}
+	portENTER_CRITICAL(&m_tableMux);
+	BLEScanEntry* old = m_table;
+	m_table = table;
+	m_tableSlots = slots;
+	m_tableCapacity = capacity;
+	m_tableCount = 0;
+	portEXIT_CRITICAL(&m_tableMux);
+	free(old);
+	return true;
+} // setTable
+
+
+size_t BLEScan::getTableCount() {
+	return m_tableCount;
+} // getTableCount
+
+
+size_t BLEScan::getTable(BLEScanEntry* entries, size_t max) {
+	size_t n = 0;
+	if (!m_table || !entries) {
+		return 0;
+	}
+	portENTER_CRITICAL(&m_tableMux);
+	for (size_t i = 0; i < m_tableSlots && n < max; i++) {
+		if (m_table[i].used) {
+			entries[n++] = m_table[i];
+		}
+	}
+	portEXIT_CRITICAL(&m_tableMux);
+	return n;
+} // getTable
+
+
+bool BLEScan::getTableEntry(BLEAddress address, BLEScanEntry* entry) {
+	if (!m_table || !entry) {
+		return false;
+	}
+	portENTER_CRITICAL(&m_tableMux);
+	int slot = tableFind(*address.getNative());
+	if (slot >= 0 && m_table[slot].used) {
+		*entry = m_table[slot];
+	} else {
+		slot = -1;
+	}
+	portEXIT_CRITICAL(&m_tableMux);
+	return slot >= 0;
+} // getTableEntry
+
+
+/**
+ * @brief Have the controller filter out repeated adverts of a device.
+ * Fewer events reach the host, but RSSI and last seen stop updating.
+ * Takes effect on the next start().
+ */
+void BLEScan::setDuplicateFilter(bool enable) {
+	m_scan_params.scan_duplicate = enable ? BLE_SCAN_DUPLICATE_ENABLE : BLE_SCAN_DUPLICATE_DISABLE;
+} // setDuplicateFilter
+
+
+/**
+ * @brief The slot holding the address, or the free slot it would go in. Call with the mux held.
+ */
+int BLEScan::tableFind(const uint8_t* address) {
+	uint32_t hash = ((uint32_t)address[2] << 24 | (uint32_t)address[3] << 16 | address[4] << 8 | address[5]) ^ (address[0] << 8 | address[1]);
+	size_t mask = m_tableSlots - 1;
+	size_t slot = (hash * 2654435761u) & mask;
+	while (m_table[slot].used && memcmp(m_table[slot].address, address, ESP_BD_ADDR_LEN) != 0) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+} // tableFind
+
+
+/**
+ * @brief Empties a slot, moving back the entries that probed past it. Call with the mux held.
+ */
+void BLEScan::tableRemove(int slot) {
+	size_t mask = m_tableSlots - 1;
+	size_t hole = slot;
+	size_t next = (hole + 1) & mask;
+	while (m_table[next].used) {
+		m_table[next].used = 0;
+		size_t home = tableFind(m_table[next].address);
+		m_table[next].used = 1;
+		// still reachable from where it hashes if the hole is not between the two
+		if (home == next) {
+			next = (next + 1) & mask;
+			continue;
+		}
+		m_table[hole] = m_table[next];
+		m_table[next].used = 0;
+		hole = next;
+		next = (next + 1) & mask;
+	}
+	m_table[hole].used = 0;
+	m_tableCount--;
+} // tableRemove
+
+
+void BLEScan::tableUpdate(esp_ble_gap_cb_param_t* param) {
+	uint32_t now = millis();
+	portENTER_CRITICAL(&m_tableMux);
+	int slot = tableFind(param->scan_rst.bda);
+	if (!m_table[slot].used) {
+		if (m_tableCount >= m_tableCapacity) {
+			int oldest = -1;
+			for (size_t i = 0; i < m_tableSlots; i++) {
+				if (m_table[i].used && (oldest < 0 || (int32_t)(m_table[i].lastSeen - m_table[oldest].lastSeen) < 0)) {
+					oldest = i;
+				}
+			}
+			tableRemove(oldest);
+			slot = tableFind(param->scan_rst.bda);
+		}
+		BLEScanEntry* entry = &m_table[slot];
+		memcpy(entry->address, param->scan_rst.bda, ESP_BD_ADDR_LEN);
+		entry->used = 1;
+		entry->count = 0;
+		m_tableCount++;
+	}
+	BLEScanEntry* entry = &m_table[slot];
+	size_t len = param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len;
+	entry->addressType = param->scan_rst.ble_addr_type;
+	entry->rssi = param->scan_rst.rssi;
+	entry->lastSeen = now;
+	if (entry->count < UINT16_MAX) {
+		entry->count++;
+	}
+	// a scan response alone keeps the advert seen before it
+	if (param->scan_rst.adv_data_len || !entry->payloadLength) {
+		entry->payloadLength = len < BLE_SCAN_TABLE_PAYLOAD ? len : BLE_SCAN_TABLE_PAYLOAD;
+		memcpy(entry->payload, param->scan_rst.ble_adv, entry->payloadLength);
+	}
+	portEXIT_CRITICAL(&m_tableMux);
+} // tableUpdate
+
 #endif /* CONFIG_BT_ENABLED */
@@ -17,6 +17,75 @@
 #include "BLEClient.h"
 #include "FreeRTOS.h"
 
+#ifndef BLE_SCAN_TABLE_PAYLOAD
+#define BLE_SCAN_TABLE_PAYLOAD 31 // advertising bytes a table entry keeps
+#endif
+
+/**
+ * @brief A device in the scan table, see BLEScan::setTable().
+ */
+typedef struct {
+	esp_bd_addr_t address;
+	uint8_t       addressType;
+	int8_t        rssi;         // of the last advert
+	uint8_t       used;
+	uint8_t       payloadLength;
+	uint16_t      count;        // adverts heard, saturating
+	uint32_t      lastSeen;     // millis() of the last advert
+	uint8_t       payload[BLE_SCAN_TABLE_PAYLOAD]; // of the last advert, cut to fit
+} BLEScanEntry;
+
+/**
+ * @brief Called from the GAP event of every advert, with the controller's buffer.
+ * The payload is the advertising data followed by any scan response, valid during the call only.
+ */
+typedef void (*BLERawAdvertisedCallback)(const uint8_t* address, uint8_t addressType, int rssi, const uint8_t* payload, size_t length);
+
+/**
+ * @brief Walks the AD structures of a payload in place, without copying or parsing the rest.
+ *
+ *	BLEAdIterator ad(payload, length);
+ *	if (ad.find(ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE) && ad.length() >= 2) {
+ *		uint16_t company = ad.data()[0] | ad.data()[1] << 8;
+ *	}
+ */
+class BLEAdIterator {
+public:
+	BLEAdIterator(const uint8_t* payload, size_t length) : m_payload(payload), m_end(payload + length), m_next(payload), m_current(nullptr) {}
+	// moves to the next structure, false at the end or on a truncated one
+	bool next() {
+		while (m_next < m_end && m_next[0] == 0) { // padding
+			m_next++;
+		}
+		if (m_next + 1 >= m_end || m_next + 1 + m_next[0] > m_end) {
+			m_current = nullptr;
+			return false;
+		}
+		m_current = m_next;
+		m_next += 1 + m_next[0];
+		return true;
+	}
+	// moves to the next structure of the type
+	bool find(uint8_t type) {
+		while (next()) {
+			if (m_current[1] == type) {
+				return true;
+			}
+		}
+		return false;
+	}
+	void           rewind()       { m_next = m_payload; m_current = nullptr; }
+	uint8_t        type() const   { return m_current ? m_current[1] : 0; }
+	uint8_t        length() const { return m_current ? m_current[0] - 1 : 0; }
+	const uint8_t* data() const   { return m_current ? m_current + 2 : nullptr; }
+
+private:
+	const uint8_t* m_payload;
+	const uint8_t* m_end;
+	const uint8_t* m_next;
+	const uint8_t* m_current;
+};
+
 class BLEAdvertisedDevice;
 class BLEAdvertisedDeviceCallbacks;
 class BLEClient;
@@ -53,6 +122,8 @@ public:
 			              BLEAdvertisedDeviceCallbacks* pAdvertisedDeviceCallbacks,
 										bool wantDuplicates = false,
 										bool shouldParse = true);
+	// every advert goes to cb first; with no device callbacks set, no BLEAdvertisedDevice is built
+	void           setRawAdvertisedCallback(BLERawAdvertisedCallback cb);
 	void           setInterval(uint16_t intervalMSecs);
 	void           setWindow(uint16_t windowMSecs);
 	bool           start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults), bool is_continue = false);
@@ -62,6 +133,16 @@ public:
 	BLEScanResults getResults();
 	void			clearResults();
 
+	// Fixed size results: up to capacity devices in one allocation, updated in place
+	// and the least recently seen dropped for a new one. 0 goes back to BLEScanResults.
+	bool           setTable(size_t capacity);
+	size_t         getTableCount();
+	// copies up to max entries, returns how many
+	size_t         getTable(BLEScanEntry* entries, size_t max);
+	bool           getTableEntry(BLEAddress address, BLEScanEntry* entry);
+	// the controller drops repeated adverts, so entries stop updating while it is on
+	void           setDuplicateFilter(bool enable);
+
 private:
 	BLEScan();   // One doesn't create a new instance instead one asks the BLEDevice for the singleton.
 	friend class BLEDevice;
@@ -69,6 +150,9 @@ private:
 		esp_gap_ble_cb_event_t  event,
 		esp_ble_gap_cb_param_t* param);
 	void parseAdvertisement(BLEClient* pRemoteDevice, uint8_t *payload);
+	int          tableFind(const uint8_t* address);
+	void         tableRemove(int slot);
+	void         tableUpdate(esp_ble_gap_cb_param_t* param);
 
 
 	esp_ble_scan_params_t         m_scan_params;
@@ -79,6 +163,12 @@ private:
 	BLEScanResults                m_scanResults;
 	bool                          m_wantDuplicates;
 	void                        (*m_scanCompleteCB)(BLEScanResults scanResults);
+	BLERawAdvertisedCallback      m_rawCallback = nullptr;
+	BLEScanEntry*                 m_table = nullptr;     // open addressing by address, linear probing
+	size_t                        m_tableSlots = 0;      // power of two, a quarter more than the capacity
+	size_t                        m_tableCapacity = 0;
+	size_t                        m_tableCount = 0;
+	portMUX_TYPE                  m_tableMux;
 }; // BLEScan
 
 #endif /* CONFIG_BT_ENABLED */
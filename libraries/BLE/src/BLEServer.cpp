@@ -18,6 +18,12 @@
 #include <string>
 #include <unordered_set>
 #include "esp32-hal-log.h"
+#include "esp32-hal.h"
+
+#define BLE_SERVER_UNCONGESTED BIT0 // some connection drained, waiters look again
+
+// in libbt, esp_gatt_common_api.h only declares it when the stack's BLE_INCLUDED is set
+extern "C" uint16_t esp_ble_get_cur_sendable_packets_num(uint16_t connid);
 
 /**
  * @brief Construct a %BLE Server
@@ -31,6 +37,7 @@ BLEServer::BLEServer() {
 	m_connectedCount   = 0;
 	m_connId           = ESP_GATT_IF_NONE;
 	m_pServerCallbacks = nullptr;
+	m_congestEvt       = xEventGroupCreate();
 } // BLEServer
 
 
@@ -159,6 +166,23 @@ void BLEServer::handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t
 			updatePeerMTU(param->mtu.conn_id, param->mtu.mtu);
 			break;
 
+		// ESP_GATTS_CONGEST_EVT
+		// congest:
+		// - uint16_t conn_id
+		// - bool     congested
+		//
+		// The stack has no room for more packets on the link, notify() holds back until it reports free again.
+		case ESP_GATTS_CONGEST_EVT: {
+			auto it = m_connectedServersMap.find(param->congest.conn_id);
+			if (it != m_connectedServersMap.end()) {
+				it->second.congested = param->congest.congested;
+			}
+			if (!param->congest.congested) {
+				xEventGroupSetBits(m_congestEvt, BLE_SERVER_UNCONGESTED);
+			}
+			break;
+		} // ESP_GATTS_CONGEST_EVT
+
 		// ESP_GATTS_CONNECT_EVT
 		// connect:
 		// - uint16_t      conn_id
@@ -167,6 +191,13 @@ void BLEServer::handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t
 		case ESP_GATTS_CONNECT_EVT: {
 			m_connId = param->connect.conn_id;
 			addPeerDevice((void*)this, false, m_connId);
+			memcpy(m_connectedServersMap[m_connId].bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+			if (BLE_SERVER_DATA_LEN > 27) {
+				::esp_ble_gap_set_pkt_data_len(param->connect.remote_bda, BLE_SERVER_DATA_LEN);
+			}
+			if (!m_preferAfterBonding) {
+				requestPreferredConnParams(param->connect.remote_bda);
+			}
 			if (m_pServerCallbacks != nullptr) {
 				m_pServerCallbacks->onConnect(this);
 				m_pServerCallbacks->onConnect(this, param);			
@@ -214,6 +245,7 @@ void BLEServer::handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t
 			if(removePeerDevice(param->disconnect.conn_id, false)) {
                 m_connectedCount--;                          // Decrement the number of connected devices count.
             }
+			xEventGroupSetBits(m_congestEvt, BLE_SERVER_UNCONGESTED);  // a notify() waiting on it gives up
             break;
 		} // ESP_GATTS_DISCONNECT_EVT
 
@@ -395,7 +427,13 @@ void BLEServer::addPeerDevice(void* peer, bool _client, uint16_t conn_id) {
 	conn_status_t status = {
 		.peer_device = peer,
 		.connected = true,
-		.mtu = 23
+		.mtu = 23,
+		.congested = false,
+		.since = millis(),
+		.stats = {},
+		.bda = {},
+		.interval = 0,
+		.latency = 0
 	};
 
 	m_connectedServersMap.insert(std::pair<uint16_t, conn_status_t>(conn_id, status));	
@@ -404,8 +442,141 @@ void BLEServer::addPeerDevice(void* peer, bool _client, uint16_t conn_id) {
 bool BLEServer::removePeerDevice(uint16_t conn_id, bool _client) {
 	return m_connectedServersMap.erase(conn_id) > 0;
 }
+
+/**
+ * @brief Get what was notified to a connection and how long it took.
+ * @param [in] conn_id The connection.
+ * @return The counters, all zero for an unknown connection.
+ */
+ble_notify_stats_t BLEServer::getNotifyStats(uint16_t conn_id) {
+	ble_notify_stats_t stats = {};
+	auto it = m_connectedServersMap.find(conn_id);
+	if (it != m_connectedServersMap.end()) {
+		stats = it->second.stats;
+		stats.elapsed_ms = millis() - it->second.since;
+	}
+	return stats;
+} // getNotifyStats
+
+/**
+ * @brief Wait until the stack takes another packet for a connection.
+ * @param [in] conn_id The connection.
+ * @param [in] timeoutMs How long to wait.
+ * @return False if it is still congested, or went away.
+ */
+bool BLEServer::waitUncongested(uint16_t conn_id, uint32_t timeoutMs) {
+	auto it = m_connectedServersMap.find(conn_id);
+	if (it == m_connectedServersMap.end()) {
+		return false;
+	}
+	if (!it->second.congested && ::esp_ble_get_cur_sendable_packets_num(conn_id) > 0) {
+		return true;
+	}
+	uint32_t start = millis();
+	it->second.stats.congestions++;
+	bool ready = false;
+	do {
+		xEventGroupClearBits(m_congestEvt, BLE_SERVER_UNCONGESTED);
+		it = m_connectedServersMap.find(conn_id);
+		if (it == m_connectedServersMap.end()) {
+			return false;
+		}
+		ready = !it->second.congested && ::esp_ble_get_cur_sendable_packets_num(conn_id) > 0;
+		if (ready) {
+			break;
+		}
+		// the stack frees buffers without an event unless it was congested, so look again every tick too
+		xEventGroupWaitBits(m_congestEvt, BLE_SERVER_UNCONGESTED, pdTRUE, pdFALSE, it->second.congested ? pdMS_TO_TICKS(10) : 1);
+	} while (millis() - start < timeoutMs);
+	it = m_connectedServersMap.find(conn_id);
+	if (it != m_connectedServersMap.end()) {
+		it->second.stats.congested_ms += millis() - start;
+	}
+	return ready;
+} // waitUncongested
+
+void BLEServer::addNotifyStats(uint16_t conn_id, size_t bytes, size_t dropped) {
+	auto it = m_connectedServersMap.find(conn_id);
+	if (it != m_connectedServersMap.end()) {
+		it->second.stats.bytes += bytes;
+		it->second.stats.notifications += bytes ? 1 : 0;
+		it->second.stats.dropped += dropped;
+	}
+} // addNotifyStats
 /* multi connect support */
 
+/**
+ * @brief Set the connection parameters asked of every peer.
+ *
+ * Hosts often open a connection slow and only agree to a short interval once the link is encrypted, so by
+ * default the request goes out when bonding completes. What the peer settled on is in getConnInterval().
+ *
+ * @param [in] minInterval Shortest connection interval in 1.25 ms units, 6 is 7.5 ms; 0 stops asking.
+ * @param [in] maxInterval Longest connection interval in 1.25 ms units.
+ * @param [in] latency Connection events the peer may skip.
+ * @param [in] timeout Supervision timeout in 10 ms units.
+ * @param [in] afterBonding Ask once the peer bonded instead of right on connect.
+ */
+void BLEServer::setPreferredConnParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout, bool afterBonding) {
+	m_preferredParams.min_int = minInterval;
+	m_preferredParams.max_int = (maxInterval < minInterval) ? minInterval : maxInterval;
+	m_preferredParams.latency = latency;
+	m_preferredParams.timeout = timeout;
+	m_preferAfterBonding = afterBonding;
+} // setPreferredConnParams
+
+/**
+ * @brief Get the connection interval a peer settled on.
+ * @param [in] conn_id The connection.
+ * @return The interval in 1.25 ms units, 0 until the first update or for an unknown connection.
+ */
+uint16_t BLEServer::getConnInterval(uint16_t conn_id) {
+	auto it = m_connectedServersMap.find(conn_id);
+	return (it != m_connectedServersMap.end()) ? it->second.interval : 0;
+} // getConnInterval
+
+void BLEServer::requestPreferredConnParams(esp_bd_addr_t remote_bda) {
+	if (m_preferredParams.min_int == 0) {
+		return;
+	}
+	updateConnParams(remote_bda, m_preferredParams.min_int, m_preferredParams.max_int, m_preferredParams.latency, m_preferredParams.timeout);
+}
+
+/**
+ * @brief Handle the GAP events of the connections of the server.
+ * @param [in] event The type of event.
+ * @param [in] param Parameters for the event.
+ */
+void BLEServer::handleGAPEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+	switch (event) {
+		case ESP_GAP_BLE_AUTH_CMPL_EVT: {
+			if (param->ble_security.auth_cmpl.success && m_preferAfterBonding) {
+				requestPreferredConnParams(param->ble_security.auth_cmpl.bd_addr);
+			}
+			break;
+		}
+
+		case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+			if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) {
+				log_w("connection parameters not updated: %d", param->update_conn_params.status);
+				break;
+			}
+			for (auto &myPair : m_connectedServersMap) {
+				if (memcmp(myPair.second.bda, param->update_conn_params.bda, sizeof(esp_bd_addr_t)) == 0) {
+					myPair.second.interval = param->update_conn_params.conn_int;
+					myPair.second.latency = param->update_conn_params.latency;
+					log_d("conn %u: interval %u x 1.25 ms, latency %u", myPair.first, myPair.second.interval, myPair.second.latency);
+					break;
+				}
+			}
+			break;
+		}
+
+		default:
+			break;
+	}
+} // handleGAPEvent
+
 /**
  * Update connection parameters can be called only after connection has been established
  */
@@ -13,6 +13,7 @@
 
 #include <string>
 #include <string.h>
+#include <vector>
 // #include "BLEDevice.h"
 
 #include "BLEUUID.h"
@@ -21,14 +22,36 @@
 #include "BLEService.h"
 #include "BLESecurity.h"
 #include "FreeRTOS.h"
+#include <freertos/event_groups.h>
 #include "BLEAddress.h"
 
+#ifndef BLE_SERVER_DATA_LEN
+#define BLE_SERVER_DATA_LEN 251 // LE data length asked of each peer on connect, 27 leaves it at the 4.0 default
+#endif
+
 class BLEServerCallbacks;
+
+// notifications sent to one connection, kept while it lasts
+typedef struct {
+	uint32_t bytes;			// payload bytes handed to the stack
+	uint32_t notifications;	// packets those bytes went out in
+	uint32_t dropped;		// bytes not sent, the connection stayed congested past the timeout
+	uint32_t congestions;	// times a send waited for the stack to drain
+	uint32_t congested_ms;	// time spent waiting
+	uint32_t elapsed_ms;	// since the connection opened, bytes * 1000 / elapsed_ms is the throughput
+} ble_notify_stats_t;
+
 /* TODO possibly refactor this struct */ 
 typedef struct {
 	void *peer_device;		// peer device BLEClient or BLEServer - maybe its better to have 2 structures or union here
 	bool connected;			// do we need it?
 	uint16_t mtu;			// every peer device negotiate own mtu
+	bool congested;			// ESP_GATTS_CONGEST_EVT, no notification is sent until it clears
+	uint32_t since;			// millis() of the connect
+	ble_notify_stats_t stats;
+	esp_bd_addr_t bda;		// of the peer, for the connection parameter updates
+	uint16_t interval;		// connection interval in 1.25 ms units, 0 until the stack reported one
+	uint16_t latency;		// connection events the peer may skip
 } conn_status_t;
 
 
@@ -51,6 +74,18 @@ public:
 	int 		getRegisteredServiceCount();
 
 private:
+	// a characteristic or descriptor handle of a started service, the owner gets its read and write events directly
+	typedef struct {
+		uint16_t           handle;
+		BLECharacteristic* pCharacteristic;
+		BLEDescriptor*     pDescriptor;
+	} attribute_t;
+
+	std::vector<attribute_t>           m_attributes; // sorted by handle
+	void        indexService(BLEService* service);
+	void        unindexService(BLEService* service);
+	attribute_t* getAttribute(uint16_t handle);
+
 	std::map<uint16_t, BLEService*>    m_handleMap;
 	std::map<BLEService*, std::string> m_uuidMap;
 	std::map<BLEService*, std::string>::iterator m_iterator;
@@ -84,6 +119,10 @@ public:
 	void updatePeerMTU(uint16_t connId, uint16_t mtu);
 	uint16_t getPeerMTU(uint16_t conn_id);
 	uint16_t        getConnId();
+	ble_notify_stats_t getNotifyStats(uint16_t conn_id);
+	// asked of every peer once it bonded, or right on connect with afterBonding false; intervals in 1.25 ms units, minInterval 0 stops asking
+	void            setPreferredConnParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency = 0, uint16_t timeout = 400, bool afterBonding = true);
+	uint16_t        getConnInterval(uint16_t conn_id);
 
 
 private:
@@ -91,23 +130,31 @@ private:
 	friend class BLEService;
 	friend class BLECharacteristic;
 	friend class BLEDevice;
+	friend class BLEHIDDevice;
 	esp_ble_adv_data_t  m_adv_data;
 	// BLEAdvertising      m_bleAdvertising;
 	uint16_t			m_connId;
 	uint32_t            m_connectedCount;
 	uint16_t            m_gatts_if;
   	std::map<uint16_t, conn_status_t> m_connectedServersMap;
+	EventGroupHandle_t  m_congestEvt = nullptr;
 
 	FreeRTOS::Semaphore m_semaphoreRegisterAppEvt 	= FreeRTOS::Semaphore("RegisterAppEvt");
 	FreeRTOS::Semaphore m_semaphoreCreateEvt 		= FreeRTOS::Semaphore("CreateEvt");
 	FreeRTOS::Semaphore m_semaphoreOpenEvt   		= FreeRTOS::Semaphore("OpenEvt");
 	BLEServiceMap       m_serviceMap;
 	BLEServerCallbacks* m_pServerCallbacks = nullptr;
+	esp_ble_conn_update_params_t m_preferredParams = {};	// min_int of 0 when none were set
+	bool                m_preferAfterBonding = true;
 
 	void            createApp(uint16_t appId);
 	uint16_t        getGattsIf();
 	void            handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+	void            handleGAPEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+	void            requestPreferredConnParams(esp_bd_addr_t remote_bda);
 	void            registerApp(uint16_t);
+	bool            waitUncongested(uint16_t conn_id, uint32_t timeoutMs);
+	void            addNotifyStats(uint16_t conn_id, size_t bytes, size_t dropped);
 }; // BLEServer
 
 
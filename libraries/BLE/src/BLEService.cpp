@@ -244,8 +244,8 @@ void BLEService::addCharacteristic(BLECharacteristic* pCharacteristic) {
  * @param [in] properties - The properties of the characteristic.
  * @return The new BLE characteristic.
  */
-BLECharacteristic* BLEService::createCharacteristic(const char* uuid, uint32_t properties) {
-	return createCharacteristic(BLEUUID(uuid), properties);
+BLECharacteristic* BLEService::createCharacteristic(const char* uuid, uint32_t properties, size_t maxLength) {
+	return createCharacteristic(BLEUUID(uuid), properties, maxLength);
 }
 	
 
@@ -253,10 +253,11 @@ BLECharacteristic* BLEService::createCharacteristic(const char* uuid, uint32_t p
  * @brief Create a new BLE Characteristic associated with this service.
  * @param [in] uuid - The UUID of the characteristic.
  * @param [in] properties - The properties of the characteristic.
+ * @param [in] maxLength - Allocate the value once for up to this many bytes, 0 to let it grow.
  * @return The new BLE characteristic.
  */
-BLECharacteristic* BLEService::createCharacteristic(BLEUUID uuid, uint32_t properties) {
-	BLECharacteristic* pCharacteristic = new BLECharacteristic(uuid, properties);
+BLECharacteristic* BLEService::createCharacteristic(BLEUUID uuid, uint32_t properties, size_t maxLength) {
+	BLECharacteristic* pCharacteristic = new BLECharacteristic(uuid, properties, maxLength);
 	addCharacteristic(pCharacteristic);
 	return pCharacteristic;
 } // createCharacteristic
@@ -11,6 +11,7 @@
 #if defined(CONFIG_BT_ENABLED)
 
 #include <esp_gatts_api.h>
+#include <vector>
 
 #include "BLECharacteristic.h"
 #include "BLEServer.h"
@@ -36,9 +37,9 @@ public:
 	void handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t* param);
 
 private:
-	std::map<BLECharacteristic*, std::string> m_uuidMap;
-	std::map<uint16_t, BLECharacteristic*> m_handleMap;
-	std::map<BLECharacteristic*, std::string>::iterator m_iterator;
+	std::vector<BLECharacteristic*> m_characteristics; // in the order they were added
+	std::vector<std::pair<uint16_t, BLECharacteristic*>> m_handleMap; // sorted by handle
+	size_t m_iterator = 0;
 };
 
 
@@ -49,8 +50,8 @@ private:
 class BLEService {
 public:
 	void               addCharacteristic(BLECharacteristic* pCharacteristic);
-	BLECharacteristic* createCharacteristic(const char* uuid, uint32_t properties);
-	BLECharacteristic* createCharacteristic(BLEUUID uuid, uint32_t properties);
+	BLECharacteristic* createCharacteristic(const char* uuid, uint32_t properties, size_t maxLength = 0);
+	BLECharacteristic* createCharacteristic(BLEUUID uuid, uint32_t properties, size_t maxLength = 0);
 	void               dump();
 	void               executeCreate(BLEServer* pServer);
 	void			   executeDelete();
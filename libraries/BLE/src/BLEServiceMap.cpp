@@ -8,6 +8,7 @@
 #if defined(CONFIG_BT_ENABLED)
 #include <stdio.h>
 #include <iomanip>
+#include <algorithm>
 #include "BLEService.h"
 
 
@@ -88,11 +89,81 @@ void BLEServiceMap::handleGATTServerEvent(
 		esp_gatts_cb_event_t      event,
 		esp_gatt_if_t             gatts_if,
 		esp_ble_gatts_cb_param_t* param) {
+	// Reads and writes name their attribute, hand them straight to it.
+	attribute_t* pAttribute = nullptr;
+	if (event == ESP_GATTS_READ_EVT) {
+		pAttribute = getAttribute(param->read.handle);
+	} else if (event == ESP_GATTS_WRITE_EVT) {
+		pAttribute = getAttribute(param->write.handle);
+	}
+	if (pAttribute != nullptr) {
+		if (pAttribute->pDescriptor != nullptr) {
+			pAttribute->pDescriptor->handleGATTServerEvent(event, gatts_if, param);
+		} else {
+			pAttribute->pCharacteristic->handleGATTServerEvent(event, gatts_if, param);
+		}
+		return;
+	}
+
 	// Invoke the handler for every Service we have.
 	for (auto &myPair : m_uuidMap) {
 		myPair.first->handleGATTServerEvent(event, gatts_if, param);
 	}
-}
+
+	// all handles of a service are known once it has started
+	if (event == ESP_GATTS_START_EVT && param->start.status == ESP_GATT_OK) {
+		auto it = m_handleMap.find(param->start.service_handle);
+		if (it != m_handleMap.end()) {
+			indexService(it->second);
+		}
+	}
+} // handleGATTServerEvent
+
+
+/**
+ * @brief Add the characteristics and descriptors of a service to the handle index.
+ * @param [in] service The started service.
+ */
+void BLEServiceMap::indexService(BLEService* service) {
+	unindexService(service);
+	BLECharacteristic* pCharacteristic = service->m_characteristicMap.getFirst();
+	while (pCharacteristic != nullptr) {
+		m_attributes.push_back({pCharacteristic->getHandle(), pCharacteristic, nullptr});
+		BLEDescriptor* pDescriptor = pCharacteristic->m_descriptorMap.getFirst();
+		while (pDescriptor != nullptr) {
+			m_attributes.push_back({pDescriptor->getHandle(), pCharacteristic, pDescriptor});
+			pDescriptor = pCharacteristic->m_descriptorMap.getNext();
+		}
+		pCharacteristic = service->m_characteristicMap.getNext();
+	}
+	std::sort(m_attributes.begin(), m_attributes.end(),
+		[](const attribute_t& a, const attribute_t& b) { return a.handle < b.handle; });
+} // indexService
+
+
+/**
+ * @brief Drop the characteristics and descriptors of a service from the handle index.
+ * @param [in] service The service.
+ */
+void BLEServiceMap::unindexService(BLEService* service) {
+	m_attributes.erase(std::remove_if(m_attributes.begin(), m_attributes.end(),
+		[service](const attribute_t& a) { return a.pCharacteristic->getService() == service; }), m_attributes.end());
+} // unindexService
+
+
+/**
+ * @brief Find the attribute of a started service by handle.
+ * @param [in] handle The attribute handle from a read or write event.
+ * @return The attribute, nullptr if no started service owns the handle.
+ */
+BLEServiceMap::attribute_t* BLEServiceMap::getAttribute(uint16_t handle) {
+	auto it = std::lower_bound(m_attributes.begin(), m_attributes.end(), handle,
+		[](const attribute_t& a, uint16_t h) { return a.handle < h; });
+	if (it == m_attributes.end() || it->handle != handle) {
+		return nullptr;
+	}
+	return &*it;
+} // getAttribute
 
 /**
  * @brief Get the first service in the map.
@@ -122,6 +193,7 @@ BLEService* BLEServiceMap::getNext() {
  * @return N/A.
  */
 void BLEServiceMap::removeService(BLEService* service) {
+	unindexService(service);
 	m_handleMap.erase(service->getHandle());
 	m_uuidMap.erase(service);
 } // removeService
@@ -8,14 +8,41 @@
 #if defined(CONFIG_BT_ENABLED)
 #include "BLEValue.h"
 #include "esp32-hal-log.h"
+#include <string.h>
+#include <stdlib.h>
 
 BLEValue::BLEValue() {
 	m_accumulation = "";
-	m_value        = "";
 	m_readOffset   = 0;
+	m_data         = nullptr;
+	m_length       = 0;
+	m_capacity     = 0;
+	m_fixed        = false;
 } // BLEValue
 
 
+BLEValue::BLEValue(const BLEValue& other) : BLEValue() {
+	*this = other;
+} // BLEValue
+
+
+BLEValue::~BLEValue() {
+	free(m_data);
+} // ~BLEValue
+
+
+BLEValue& BLEValue::operator=(const BLEValue& other) {
+	if (this != &other) {
+		m_accumulation = other.m_accumulation;
+		m_readOffset   = other.m_readOffset;
+		m_fixed        = false;
+		setValue(other.m_data, other.m_length);
+		m_fixed        = other.m_fixed;
+	}
+	return *this;
+} // operator=
+
+
 /**
  * @brief Add a message part to the accumulation.
  * The accumulation is a growing set of data that is added to until a commit or cancel.
@@ -70,7 +97,8 @@ void BLEValue::commit() {
  * @return A pointer to the data.
  */
 uint8_t* BLEValue::getData() {
-	return (uint8_t*) m_value.data();
+	static uint8_t empty = 0;
+	return m_data ? m_data : &empty;
 }
 
 
@@ -79,7 +107,7 @@ uint8_t* BLEValue::getData() {
  * @return The length of the data in bytes.
  */
 size_t BLEValue::getLength() {
-	return m_value.length();
+	return m_length;
 } // getLength
 
 
@@ -96,7 +124,7 @@ uint16_t BLEValue::getReadOffset() {
  * @brief Get the current value.
  */
 std::string BLEValue::getValue() {
-	return m_value;
+	return std::string((char*) getData(), m_length);
 } // getValue
 
 
@@ -113,7 +141,7 @@ void BLEValue::setReadOffset(uint16_t readOffset) {
  * @brief Set the current value.
  */
 void BLEValue::setValue(std::string value) {
-	m_value = value;
+	setValue((uint8_t*) value.data(), value.length());
 } // setValue
 
 
@@ -123,8 +151,53 @@ void BLEValue::setValue(std::string value) {
  * @param [in] The length of the new current value.
  */
 void BLEValue::setValue(uint8_t* pData, size_t length) {
-	m_value = std::string((char*) pData, length);
+	if (length > m_capacity) {
+		if (m_fixed) {
+			log_w("value of %d bytes cut to %d", length, m_capacity);
+			length = m_capacity;
+		} else {
+			uint8_t* data = (uint8_t*) realloc(m_data, length);
+			if (!data) {
+				log_e("no memory for a %d byte value", length);
+				return;
+			}
+			m_data     = data;
+			m_capacity = length;
+		}
+	}
+	if (length) {
+		memmove(m_data, pData, length);
+	}
+	m_length = length;
 } // setValue
 
 
+/**
+ * @brief Allocate the storage for values up to capacity bytes once.
+ * Later values are copied into it; longer ones are cut to fit.
+ * @param [in] capacity The largest value in bytes, 0 to grow as needed again.
+ */
+void BLEValue::setCapacity(size_t capacity) {
+	m_fixed = false;
+	if (capacity > m_capacity) {
+		uint8_t* data = (uint8_t*) realloc(m_data, capacity);
+		if (!data) {
+			log_e("no memory for a %d byte value", capacity);
+			return;
+		}
+		m_data     = data;
+		m_capacity = capacity;
+	}
+	if (capacity && m_length > capacity) {
+		m_length = capacity;
+	}
+	m_fixed = capacity != 0;
+} // setCapacity
+
+
+size_t BLEValue::getCapacity() {
+	return m_capacity;
+} // getCapacity
+
+
 #endif // CONFIG_BT_ENABLED
@@ -17,6 +17,9 @@
 class BLEValue {
 public:
 	BLEValue();
+	BLEValue(const BLEValue& other);
+	~BLEValue();
+	BLEValue&   operator=(const BLEValue& other);
 	void		addPart(std::string part);
 	void		addPart(uint8_t* pData, size_t length);
 	void		cancel();
@@ -28,11 +31,16 @@ public:
 	void        setReadOffset(uint16_t readOffset);
 	void        setValue(std::string value);
 	void        setValue(uint8_t* pData, size_t length);
+	void        setCapacity(size_t capacity);
+	size_t      getCapacity();
 
 private:
 	std::string m_accumulation;
 	uint16_t    m_readOffset;
-	std::string m_value;
+	uint8_t*    m_data;       // grows to the longest value set, never shrinks
+	size_t      m_length;
+	size_t      m_capacity;
+	bool        m_fixed;      // setCapacity() was called, longer values are cut
 
 };
 #endif // CONFIG_BT_ENABLED
@@ -19,6 +19,7 @@
 #include <cstring>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/ringbuf.h"
 
 
 #if defined(CONFIG_BT_ENABLED) && defined(CONFIG_BLUEDROID_ENABLED)
@@ -37,14 +38,16 @@
 #include <esp_log.h>
 
 #include "esp32-hal-log.h"
+#include "LockFreeQueue.h"
 
 const char * _spp_server_name = "ESP32SPP";
 
-#define RX_QUEUE_SIZE 512
-#define TX_QUEUE_SIZE 32
 static uint32_t _spp_client = 0;
-static xQueueHandle _spp_rx_queue = NULL;
-static xQueueHandle _spp_tx_queue = NULL;
+// filled by the SPP callback, emptied by the sketch; every access holds the mux
+// filled by the SPP callback, emptied by the sketch
+static SpscRing<uint8_t> _spp_rx_buffer;
+static RingbufHandle_t _spp_tx_ring = NULL;
+static spp_tx_stats_t _spp_tx_stats;
 static SemaphoreHandle_t _spp_tx_done = NULL;
 static TaskHandle_t _spp_task_handle = NULL;
 static EventGroupHandle_t _spp_event_group = NULL;
@@ -72,11 +75,7 @@ static bool _enableSSP;
 #define SPP_CONNECTED   0x02
 #define SPP_CONGESTED   0x04
 #define SPP_DISCONNECTED 0x08
-
-typedef struct {
-        size_t len;
-        uint8_t data[];
-} spp_packet_t;
+#define SPP_RX_DATA     0x10
 
 #if (ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO)
 static char *bda2str(esp_bd_addr_t bda, char *str, size_t size)
@@ -131,90 +130,59 @@ static bool btSetPin() {
     return false;
 }
 
+// blocks until all of it is queued; the ring is the only copy this side of esp_spp_write()
 static esp_err_t _spp_queue_packet(uint8_t *data, size_t len){
     if(!data || !len){
         log_w("No data provided");
         return ESP_OK;
     }
-    spp_packet_t * packet = (spp_packet_t*)malloc(sizeof(spp_packet_t) + len);
-    if(!packet){
-        log_e("SPP TX Packet Malloc Failed!");
-        return ESP_FAIL;
-    }
-    packet->len = len;
-    memcpy(packet->data, data, len);
-    if (xQueueSend(_spp_tx_queue, &packet, portMAX_DELAY) != pdPASS) {
-        log_e("SPP TX Queue Send Failed!");
-        free(packet);
-        return ESP_FAIL;
+    while(len){
+        size_t chunk = len > (SPP_TX_QUEUE_SIZE / 2) ? (SPP_TX_QUEUE_SIZE / 2) : len;
+        if(!_spp_tx_ring || xRingbufferSend(_spp_tx_ring, data, chunk, portMAX_DELAY) != pdTRUE){
+            log_e("SPP TX Queue Send Failed!");
+            return ESP_FAIL;
+        }
+        _spp_tx_stats.queued += chunk;
+        data += chunk;
+        len -= chunk;
     }
     return ESP_OK;
 }
 
-const uint16_t SPP_TX_MAX = 330;
-static uint8_t _spp_tx_buffer[SPP_TX_MAX];
-static uint16_t _spp_tx_buffer_len = 0;
-
-static bool _spp_send_buffer(){
-    if((xEventGroupWaitBits(_spp_event_group, SPP_CONGESTED, pdFALSE, pdTRUE, portMAX_DELAY) & SPP_CONGESTED) != 0){
-        esp_err_t err = esp_spp_write(_spp_client, _spp_tx_buffer_len, _spp_tx_buffer);
-        if(err != ESP_OK){
-            log_e("SPP Write Failed! [0x%X]", err);
-            return false;
-        }
-        _spp_tx_buffer_len = 0;
-        if(xSemaphoreTake(_spp_tx_done, portMAX_DELAY) != pdTRUE){
-            log_e("SPP Ack Failed!");
-            return false;
-        }
-        return true;
+static bool _spp_send_buffer(uint8_t *data, size_t len){
+    if(!(xEventGroupGetBits(_spp_event_group) & SPP_CONGESTED)){
+        uint32_t start = millis();
+        xEventGroupWaitBits(_spp_event_group, SPP_CONGESTED, pdFALSE, pdTRUE, portMAX_DELAY);
+        _spp_tx_stats.congested_ms += millis() - start;
     }
-    return false;
+    esp_err_t err = esp_spp_write(_spp_client, len, data);
+    if(err != ESP_OK){
+        log_e("SPP Write Failed! [0x%X]", err);
+        return false;
+    }
+    // the stack copies the data before it reports the write done
+    if(xSemaphoreTake(_spp_tx_done, portMAX_DELAY) != pdTRUE){
+        log_e("SPP Ack Failed!");
+        return false;
+    }
+    _spp_tx_stats.writes++;
+    return true;
 }
 
 static void _spp_tx_task(void * arg){
-    spp_packet_t *packet = NULL;
-    size_t len = 0, to_send = 0;
-    uint8_t * data = NULL;
     for (;;) {
-        if(_spp_tx_queue && xQueueReceive(_spp_tx_queue, &packet, portMAX_DELAY) == pdTRUE && packet){
-            if(packet->len <= (SPP_TX_MAX - _spp_tx_buffer_len)){
-                memcpy(_spp_tx_buffer+_spp_tx_buffer_len, packet->data, packet->len);
-                _spp_tx_buffer_len+=packet->len;
-                free(packet);
-                packet = NULL;
-                if(SPP_TX_MAX == _spp_tx_buffer_len || uxQueueMessagesWaiting(_spp_tx_queue) == 0){
-                    _spp_send_buffer();
-                }
-            } else {
-                len = packet->len;
-                data = packet->data;
-                to_send = SPP_TX_MAX - _spp_tx_buffer_len;
-                memcpy(_spp_tx_buffer+_spp_tx_buffer_len, data, to_send);
-                _spp_tx_buffer_len = SPP_TX_MAX;
-                data += to_send;
-                len -= to_send;
-                _spp_send_buffer();
-                while(len >= SPP_TX_MAX){
-                    memcpy(_spp_tx_buffer, data, SPP_TX_MAX);
-                    _spp_tx_buffer_len = SPP_TX_MAX;
-                    data += SPP_TX_MAX;
-                    len -= SPP_TX_MAX;
-                    _spp_send_buffer();
-                }
-                if(len){
-                    memcpy(_spp_tx_buffer, data, len);
-                    _spp_tx_buffer_len += len;
-                    if(uxQueueMessagesWaiting(_spp_tx_queue) == 0){
-                        _spp_send_buffer();
-                    }
-                }
-                free(packet);
-                packet = NULL;
-            }
+        size_t len = 0;
+        // takes what is queued, up to the MTU; a write that wrapped comes out in two
+        uint8_t *data = (uint8_t *)xRingbufferReceiveUpTo(_spp_tx_ring, &len, portMAX_DELAY, SPP_TX_MAX);
+        if(!data){
+            continue;
+        }
+        if(_spp_send_buffer(data, len)){
+            _spp_tx_stats.sent += len;
         } else {
-            log_e("Something went horribly wrong");
+            _spp_tx_stats.dropped += len;
         }
+        vRingbufferReturnItem(_spp_tx_ring, data);
     }
     vTaskDelete(NULL);
     _spp_task_handle = NULL;
@@ -259,6 +227,7 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
 
     case ESP_SPP_CONG_EVT://connection congestion status changed
         if(param->cong.cong){
+            _spp_tx_stats.congestions++;
             xEventGroupClearBits(_spp_event_group, SPP_CONGESTED);
         } else {
             xEventGroupSetBits(_spp_event_group, SPP_CONGESTED);
@@ -268,6 +237,7 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
 
     case ESP_SPP_WRITE_EVT://write operation completed
         if(param->write.cong){
+            _spp_tx_stats.congestions++;
             xEventGroupClearBits(_spp_event_group, SPP_CONGESTED);
         }
         xSemaphoreGive(_spp_tx_done);//we can try to send another packet
@@ -281,12 +251,11 @@ static void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
 
         if(custom_data_callback){
             custom_data_callback(param->data_ind.data, param->data_ind.len);
-        } else if (_spp_rx_queue != NULL){
-            for (int i = 0; i < param->data_ind.len; i++){
-                if(xQueueSend(_spp_rx_queue, param->data_ind.data + i, (TickType_t)0) != pdTRUE){
-                    log_e("RX Full! Discarding %u bytes", param->data_ind.len - i);
-                    break;
-                }
+        } else if (_spp_rx_buffer.capacity()){
+            size_t written = _spp_rx_buffer.push(param->data_ind.data, param->data_ind.len);
+            xEventGroupSetBits(_spp_event_group, SPP_RX_DATA);
+            if(written < param->data_ind.len){
+                log_e("RX Full! Discarding %u bytes", param->data_ind.len - written);
             }
         }
         break;
@@ -452,7 +421,7 @@ static void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *pa
     }
 }
 
-static bool _init_bt(const char *deviceName)
+static bool _init_bt(const char *deviceName, size_t rxBufferSize)
 {
     if(!_spp_event_group){
         _spp_event_group = xEventGroupCreate();
@@ -464,19 +433,19 @@ static bool _init_bt(const char *deviceName)
         xEventGroupSetBits(_spp_event_group, SPP_CONGESTED);
         xEventGroupSetBits(_spp_event_group, SPP_DISCONNECTED);
     }
-    if (_spp_rx_queue == NULL){
-        _spp_rx_queue = xQueueCreate(RX_QUEUE_SIZE, sizeof(uint8_t)); //initialize the queue
-        if (_spp_rx_queue == NULL){
+    if (!_spp_rx_buffer.capacity()){
+        if (!_spp_rx_buffer.begin(rxBufferSize)){
             log_e("RX Queue Create Failed");
             return false;
         }
     }
-    if (_spp_tx_queue == NULL){
-        _spp_tx_queue = xQueueCreate(TX_QUEUE_SIZE, sizeof(spp_packet_t*)); //initialize the queue
-        if (_spp_tx_queue == NULL){
+    if (_spp_tx_ring == NULL){
+        _spp_tx_ring = xRingbufferCreate(SPP_TX_QUEUE_SIZE, RINGBUF_TYPE_BYTEBUF);
+        if (_spp_tx_ring == NULL){
             log_e("TX Queue Create Failed");
             return false;
         }
+        memset(&_spp_tx_stats, 0, sizeof(_spp_tx_stats));
     }
     if(_spp_tx_done == NULL){
         _spp_tx_done = xSemaphoreCreateBinary();
@@ -581,18 +550,10 @@ static bool _stop_bt()
         vEventGroupDelete(_spp_event_group);
         _spp_event_group = NULL;
     }
-    if(_spp_rx_queue){
-        vQueueDelete(_spp_rx_queue);
-        //ToDo: clear RX queue when in packet mode
-        _spp_rx_queue = NULL;
-    }
-    if(_spp_tx_queue){
-        spp_packet_t *packet = NULL;
-        while(xQueueReceive(_spp_tx_queue, &packet, 0) == pdTRUE){
-            free(packet);
-        }
-        vQueueDelete(_spp_tx_queue);
-        _spp_tx_queue = NULL;
+    _spp_rx_buffer.end();
+    if(_spp_tx_ring){
+        vRingbufferDelete(_spp_tx_ring);
+        _spp_tx_ring = NULL;
     }
     if (_spp_tx_done) {
         vSemaphoreDelete(_spp_tx_done);
@@ -621,27 +582,24 @@ BluetoothSerial::~BluetoothSerial(void)
     _stop_bt();
 }
 
-bool BluetoothSerial::begin(String localName, bool isMaster)
+bool BluetoothSerial::begin(String localName, bool isMaster, size_t rxBufferSize)
 {
     _isMaster = isMaster;
     if (localName.length()){
         local_name = localName;
     }
-    return _init_bt(local_name.c_str());
+    return _init_bt(local_name.c_str(), rxBufferSize);
 }
 
 int BluetoothSerial::available(void)
 {
-    if (_spp_rx_queue == NULL){
-        return 0;
-    }
-    return uxQueueMessagesWaiting(_spp_rx_queue);
+    return _spp_rx_buffer.available();
 }
 
 int BluetoothSerial::peek(void)
 {
     uint8_t c;
-    if (_spp_rx_queue && xQueuePeek(_spp_rx_queue, &c, 0)){
+    if (_spp_rx_buffer.peek(c)){
         return c;
     }
     return -1;
@@ -654,14 +612,42 @@ bool BluetoothSerial::hasClient(void)
 
 int BluetoothSerial::read(void)
 {
-
-    uint8_t c = 0;
-    if (_spp_rx_queue && xQueueReceive(_spp_rx_queue, &c, 0)){
+    uint8_t c;
+    if (_spp_rx_buffer.pop(c)){
         return c;
     }
     return -1;
 }
 
+size_t BluetoothSerial::read(uint8_t *buffer, size_t size)
+{
+    if (!buffer){
+        return 0;
+    }
+    return _spp_rx_buffer.pop(buffer, size);
+}
+
+// as read(buffer, size) but waits up to the stream timeout for the remaining bytes
+size_t BluetoothSerial::readBytes(uint8_t *buffer, size_t length)
+{
+    size_t len = read(buffer, length);
+    unsigned long start = millis();
+    while (len < length && _spp_event_group){
+        unsigned long elapsed = millis() - start;
+        if (elapsed >= _timeout){
+            break;
+        }
+        // cleared before looking, so data arriving in between still wakes the wait
+        xEventGroupClearBits(_spp_event_group, SPP_RX_DATA);
+        size_t got = read(buffer + len, length - len);
+        if (!got){
+            xEventGroupWaitBits(_spp_event_group, SPP_RX_DATA, pdFALSE, pdTRUE, (_timeout - elapsed) / portTICK_PERIOD_MS);
+        }
+        len += got;
+    }
+    return len;
+}
+
 size_t BluetoothSerial::write(uint8_t c)
 {
     return write(&c, 1);
@@ -677,13 +663,18 @@ size_t BluetoothSerial::write(const uint8_t *buffer, size_t size)
 
 void BluetoothSerial::flush()
 {
-    if (_spp_tx_queue != NULL){
-        while(uxQueueMessagesWaiting(_spp_tx_queue) > 0){
+    if (_spp_tx_ring != NULL){
+        while(_spp_tx_stats.queued - _spp_tx_stats.sent - _spp_tx_stats.dropped > 0 && _spp_client){
 	    delay(5);
         }
     }
 }
 
+spp_tx_stats_t BluetoothSerial::txStats()
+{
+    return _spp_tx_stats;
+}
+
 void BluetoothSerial::end()
 {
     _stop_bt();
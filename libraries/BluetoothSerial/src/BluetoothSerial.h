@@ -24,6 +24,27 @@
 #include <esp_spp_api.h>
 #include <functional>
 
+#ifndef SPP_RX_QUEUE_SIZE
+#define SPP_RX_QUEUE_SIZE 512 // default bytes received and not read yet, more are dropped
+#endif
+
+#ifndef SPP_TX_QUEUE_SIZE
+#define SPP_TX_QUEUE_SIZE 4096 // bytes write() queues before it blocks
+#endif
+
+#ifndef SPP_TX_MAX
+#define SPP_TX_MAX 330 // bytes per esp_spp_write(), the RFCOMM MTU most peers take
+#endif
+
+typedef struct {
+    uint32_t queued;       // bytes taken by write()
+    uint32_t sent;         // bytes the stack accepted
+    uint32_t dropped;      // bytes lost to a failed esp_spp_write()
+    uint32_t writes;       // esp_spp_write() calls
+    uint32_t congestions;  // times the link reported congestion
+    uint32_t congested_ms; // time the TX task waited for it to clear
+} spp_tx_stats_t;
+
 typedef std::function<void(const uint8_t *buffer, size_t size)> BluetoothSerialDataCb;
 typedef std::function<void(uint32_t num_val)> ConfirmRequestCb;
 typedef std::function<void(boolean success)> AuthCompleteCb;
@@ -35,14 +56,26 @@ class BluetoothSerial: public Stream
         BluetoothSerial(void);
         ~BluetoothSerial(void);
 
-        bool begin(String localName=String(), bool isMaster=false);
+        // rxBufferSize applies when begin() starts the stack, end() frees it
+        bool begin(String localName=String(), bool isMaster=false, size_t rxBufferSize=SPP_RX_QUEUE_SIZE);
         int available(void);
         int peek(void);
         bool hasClient(void);
         int read(void);
+        size_t read(uint8_t *buffer, size_t size);
+        inline size_t read(char *buffer, size_t size)
+        {
+            return read((uint8_t*) buffer, size);
+        }
+        size_t readBytes(uint8_t *buffer, size_t length);
+        inline size_t readBytes(char *buffer, size_t length)
+        {
+            return readBytes((uint8_t*) buffer, length);
+        }
         size_t write(uint8_t c);
         size_t write(const uint8_t *buffer, size_t size);
         void flush();
+        spp_tx_stats_t txStats();
         void end(void);
         void onData(BluetoothSerialDataCb cb);
         esp_err_t register_callback(esp_spp_cb_t * callback);
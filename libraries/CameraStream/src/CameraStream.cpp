@@ -0,0 +1,392 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CameraStream.h"
+#include "img_converters.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <errno.h>
+
+#ifndef CAMERA_STREAM_CAPTURE_TASK_STACK_SIZE
+#define CAMERA_STREAM_CAPTURE_TASK_STACK_SIZE 8192 // frame2jpg() for sensors without JPEG
+#endif
+
+#ifndef CAMERA_STREAM_CAPTURE_TASK_PRIORITY
+#define CAMERA_STREAM_CAPTURE_TASK_PRIORITY 2
+#endif
+
+#ifndef CAMERA_STREAM_CAPTURE_TASK_RUNNING_CORE
+#define CAMERA_STREAM_CAPTURE_TASK_RUNNING_CORE 1
+#endif
+
+#ifndef CAMERA_STREAM_SEND_TASK_STACK_SIZE
+#define CAMERA_STREAM_SEND_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef CAMERA_STREAM_SEND_TASK_PRIORITY
+#define CAMERA_STREAM_SEND_TASK_PRIORITY 2
+#endif
+
+#ifndef CAMERA_STREAM_SEND_TASK_RUNNING_CORE
+#define CAMERA_STREAM_SEND_TASK_RUNNING_CORE 0 // with the network stack
+#endif
+
+#define CAMERA_STREAM_BOUNDARY  "123456789000000000000987654321"
+#define CAMERA_STREAM_WAIT_MS   20  // for a socket or a frame, between accepting clients
+
+// averages over about 8 frames
+#define CAMERA_STREAM_AVG(avg, value) ((avg) = (avg) - (avg) / 8 + (uint32_t)(value) / 8)
+
+static const char _streamResponse[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" CAMERA_STREAM_BOUNDARY "\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "\r\n";
+
+static const char _streamPart[] =
+    "\r\n--" CAMERA_STREAM_BOUNDARY "\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: %u\r\n"
+    "\r\n";
+
+CameraStream::CameraStream(uint16_t port, uint8_t maxClients)
+    : _port(port)
+    , _maxClients(maxClients ? maxClients : 1)
+    , _quality(80)
+    , _server(port, maxClients ? maxClients : 1)
+    , _slots(NULL)
+    , _framePool(NULL)
+    , _latest(NULL)
+    , _seq(0)
+    , _run(false)
+    , _captureTask(NULL)
+    , _sendTask(NULL)
+{
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+CameraStream::~CameraStream()
+{
+    end();
+}
+
+bool CameraStream::begin()
+{
+    if(_captureTask) {
+        return true;
+    }
+    // the newest frame, one per client and the one being taken
+    _framePool = poolCreate(sizeof(Frame), _maxClients + 2, MALLOC_CAP_8BIT);
+    _slots = new (std::nothrow) Slot[_maxClients];
+    if(!_framePool || !_slots) {
+        log_e("no memory for %u clients", _maxClients);
+        end();
+        return false;
+    }
+    for(uint8_t i = 0; i < _maxClients; i++) {
+        _slots[i].active = false;
+        _slots[i].frame = NULL;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    _server.begin();
+    _server.setNoDelay(true);
+    _run = true;
+    if(xTaskCreateUniversal(_sendTaskFn, "cam_send", CAMERA_STREAM_SEND_TASK_STACK_SIZE, this,
+                            CAMERA_STREAM_SEND_TASK_PRIORITY, &_sendTask, CAMERA_STREAM_SEND_TASK_RUNNING_CORE) != pdPASS
+        || xTaskCreateUniversal(_captureTaskFn, "cam_capture", CAMERA_STREAM_CAPTURE_TASK_STACK_SIZE, this,
+                                CAMERA_STREAM_CAPTURE_TASK_PRIORITY, &_captureTask, CAMERA_STREAM_CAPTURE_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("camera stream tasks create failed");
+        end();
+        return false;
+    }
+    return true;
+}
+
+void CameraStream::end()
+{
+    _run = false;
+    while(_captureTask || _sendTask) {
+        if(_captureTask) {
+            xTaskNotifyGive(_captureTask);
+        }
+        if(_sendTask) {
+            xTaskNotifyGive(_sendTask);
+        }
+        delay(1);
+    }
+    if(_slots) {
+        for(uint8_t i = 0; i < _maxClients; i++) {
+            _close(_slots[i]);
+        }
+        delete[] _slots;
+        _slots = NULL;
+    }
+    _release(_latest);
+    _latest = NULL;
+    _server.end();
+    if(_framePool) {
+        poolDelete(_framePool);
+        _framePool = NULL;
+    }
+}
+
+uint8_t CameraStream::clients()
+{
+    return _stats.clients;
+}
+
+void CameraStream::getStats(camera_stream_stats_t* stats)
+{
+    portENTER_CRITICAL(&_mux);
+    *stats = _stats;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void CameraStream::_release(Frame* frame)
+{
+    if(!frame) {
+        return;
+    }
+    portENTER_CRITICAL(&_mux);
+    bool last = (--frame->refs == 0);
+    portEXIT_CRITICAL(&_mux);
+    if(!last) {
+        return;
+    }
+    if(frame->fb) {
+        esp_camera_fb_return(frame->fb);
+    } else {
+        free(frame->jpg);
+    }
+    poolFree(_framePool, frame);
+}
+
+CameraStream::Frame* CameraStream::_take()
+{
+    portENTER_CRITICAL(&_mux);
+    Frame* frame = _latest;
+    if(frame) {
+        frame->refs++;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return frame;
+}
+
+void CameraStream::_captureTaskFn(void* arg)
+{
+    CameraStream* self = (CameraStream*)arg;
+    self->_capture();
+    self->_captureTask = NULL;
+    vTaskDelete(NULL);
+}
+
+void CameraStream::_capture()
+{
+    int64_t lastFrame = 0;
+    while(_run) {
+        if(!_stats.clients) {
+            // the send task gives a notification with the first client
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        Frame* frame = (Frame*)poolAlloc(_framePool);
+        if(!frame) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAMERA_STREAM_WAIT_MS));
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        camera_fb_t* fb = esp_camera_fb_get();
+        int64_t got = esp_timer_get_time();
+        if(!fb) {
+            log_e("camera capture failed");
+            poolFree(_framePool, frame);
+            delay(CAMERA_STREAM_WAIT_MS);
+            continue;
+        }
+        frame->fb = fb;
+        frame->jpg = fb->buf;
+        frame->len = fb->len;
+        if(fb->format != PIXFORMAT_JPEG) {
+            bool converted = frame2jpg(fb, _quality, &frame->jpg, &frame->len);
+            esp_camera_fb_return(fb);
+            frame->fb = NULL;
+            if(!converted) {
+                log_e("JPEG compression failed");
+                poolFree(_framePool, frame);
+                continue;
+            }
+        }
+        frame->ready = esp_timer_get_time();
+        frame->refs = 1;
+
+        portENTER_CRITICAL(&_mux);
+        Frame* old = _latest;
+        _latest = frame;
+        _seq++;
+        _stats.frames++;
+        CAMERA_STREAM_AVG(_stats.captureUs, got - start);
+        CAMERA_STREAM_AVG(_stats.encodeUs, frame->ready - got);
+        if(lastFrame) {
+            _stats.fps = _stats.fps * 0.875f + 125000.0f / (float)(frame->ready - lastFrame);
+        }
+        portEXIT_CRITICAL(&_mux);
+        lastFrame = frame->ready;
+        _release(old);
+        xTaskNotifyGive(_sendTask);
+    }
+}
+
+void CameraStream::_sendTaskFn(void* arg)
+{
+    CameraStream* self = (CameraStream*)arg;
+    self->_send();
+    self->_sendTask = NULL;
+    vTaskDelete(NULL);
+}
+
+void CameraStream::_close(Slot& slot)
+{
+    if(!slot.active) {
+        return;
+    }
+    _release(slot.frame);
+    slot.frame = NULL;
+    slot.client.stop();
+    slot.client = WiFiClient();
+    slot.active = false;
+    portENTER_CRITICAL(&_mux);
+    _stats.clients--;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void CameraStream::_accept()
+{
+    WiFiClient client = _server.available();
+    while(client) {
+        Slot* slot = NULL;
+        for(uint8_t i = 0; i < _maxClients && !slot; i++) {
+            if(!_slots[i].active) {
+                slot = &_slots[i];
+            }
+        }
+        if(!slot) {
+            client.stop();
+        } else {
+            slot->client = client;
+            slot->frame = NULL;
+            slot->seq = _seq - 1;
+            slot->started = false;
+            slot->active = true;
+            portENTER_CRITICAL(&_mux);
+            _stats.clients++;
+            portEXIT_CRITICAL(&_mux);
+            xTaskNotifyGive(_captureTask);
+        }
+        client = _server.available();
+    }
+}
+
+// the newest frame for an idle client, false when it has sent that one already
+bool CameraStream::_next(Slot& slot)
+{
+    uint32_t seq = _seq;
+    if(seq == slot.seq || !_latest) {
+        return false;
+    }
+    Frame* frame = _take();
+    if(!frame) {
+        return false;
+    }
+    if(slot.started && seq - slot.seq > 1) {
+        portENTER_CRITICAL(&_mux);
+        _stats.skipped += seq - slot.seq - 1;
+        portEXIT_CRITICAL(&_mux);
+    }
+    slot.seq = seq;
+    slot.frame = frame;
+    slot.pos = 0;
+    slot.headLen = 0;
+    if(!slot.started) {
+        memcpy(slot.head, _streamResponse, sizeof(_streamResponse) - 1);
+        slot.headLen = sizeof(_streamResponse) - 1;
+        slot.started = true;
+    }
+    slot.headLen += snprintf(slot.head + slot.headLen, sizeof(slot.head) - slot.headLen, _streamPart, frame->len);
+    slot.taken = esp_timer_get_time();
+    return true;
+}
+
+void CameraStream::_send()
+{
+    while(_run) {
+        _accept();
+        fd_set writable;
+        FD_ZERO(&writable);
+        int maxFd = -1;
+        for(uint8_t i = 0; i < _maxClients; i++) {
+            Slot& slot = _slots[i];
+            if(slot.active && (slot.frame || _next(slot))) {
+                int fd = slot.client.fd();
+                FD_SET(fd, &writable);
+                maxFd = (fd > maxFd) ? fd : maxFd;
+            }
+        }
+        if(maxFd < 0) {
+            // a new frame from the capture task, or once in a while, for new clients
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAMERA_STREAM_WAIT_MS));
+            continue;
+        }
+        struct timeval tv = { 0, CAMERA_STREAM_WAIT_MS * 1000 };
+        if(select(maxFd + 1, NULL, &writable, NULL, &tv) <= 0) {
+            continue;
+        }
+        for(uint8_t i = 0; i < _maxClients; i++) {
+            Slot& slot = _slots[i];
+            if(!slot.active || !slot.frame || !FD_ISSET(slot.client.fd(), &writable)) {
+                continue;
+            }
+            // the frame goes to the socket from the camera's buffer, as much as it takes
+            const uint8_t* data;
+            size_t len;
+            if(slot.pos < slot.headLen) {
+                data = (const uint8_t*)slot.head + slot.pos;
+                len = slot.headLen - slot.pos;
+            } else {
+                data = slot.frame->jpg + (slot.pos - slot.headLen);
+                len = slot.frame->len - (slot.pos - slot.headLen);
+            }
+            int sent = lwip_send(slot.client.fd(), data, len, MSG_DONTWAIT);
+            if(sent < 0) {
+                if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                    log_d("client gone: %d", errno);
+                    _close(slot);
+                }
+                continue;
+            }
+            slot.pos += sent;
+            if(slot.pos < slot.headLen + slot.frame->len) {
+                continue;
+            }
+            int64_t now = esp_timer_get_time();
+            portENTER_CRITICAL(&_mux);
+            _stats.sent++;
+            CAMERA_STREAM_AVG(_stats.sendUs, now - slot.taken);
+            CAMERA_STREAM_AVG(_stats.latencyUs, now - slot.frame->ready);
+            portEXIT_CRITICAL(&_mux);
+            _release(slot.frame);
+            slot.frame = NULL;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _CAMERA_STREAM_H_
+#define _CAMERA_STREAM_H_
+
+#include "Arduino.h"
+#include "WiFiServer.h"
+#include "esp_camera.h"
+
+typedef struct {
+    uint32_t frames;        // captured
+    uint32_t sent;          // frames sent, to each client counted
+    uint32_t skipped;       // frames a client missed because it was still sending the one before
+    uint32_t captureUs;     // waiting for the camera
+    uint32_t encodeUs;      // JPEG conversion, 0 with a JPEG sensor
+    uint32_t sendUs;        // from a client taking a frame until it was sent
+    uint32_t latencyUs;     // from the frame being ready until it was sent
+    float fps;              // captured
+    uint8_t clients;
+} camera_stream_stats_t;
+
+/*
+ * MJPEG over HTTP to several clients at once:
+ *
+ *   esp_camera_init(&config);          // fb_count of 3 or more, in PSRAM
+ *   CameraStream stream(81);
+ *   stream.begin();                    // http://<ip>:81/
+ *
+ * A task on one core takes the frames from the camera, a task on the other
+ * sends them. Every client is sent the newest frame once it is done with the
+ * one before, straight from the camera's frame buffer, which goes back to the
+ * camera when the last client sent it; a slow client skips frames and does not
+ * hold up the others. The times in the stats are averaged over recent frames.
+ */
+class CameraStream
+{
+public:
+    CameraStream(uint16_t port = 81, uint8_t maxClients = 4);
+    ~CameraStream();
+
+    bool begin();
+    void end();
+    operator bool() const { return _captureTask != NULL; }
+
+    // for sensors that do not give JPEG, 0 - 100
+    void setQuality(uint8_t quality) { _quality = quality; }
+    uint8_t clients();
+    void getStats(camera_stream_stats_t* stats);
+
+private:
+    struct Frame {
+        camera_fb_t* fb;        // NULL once it was converted
+        uint8_t* jpg;
+        size_t len;
+        int64_t ready;
+        uint32_t refs;
+    };
+
+    struct Slot {
+        WiFiClient client;
+        Frame* frame;
+        size_t pos;             // in head and then the frame
+        size_t headLen;
+        char head[192];
+        int64_t taken;
+        uint32_t seq;
+        bool active;
+        bool started;           // the HTTP response was sent
+    };
+
+    uint16_t _port;
+    uint8_t _maxClients;
+    uint8_t _quality;
+    WiFiServer _server;
+    Slot* _slots;
+    pool_t* _framePool;
+    Frame* _latest;
+    volatile uint32_t _seq;
+    volatile bool _run;
+    TaskHandle_t _captureTask;
+    TaskHandle_t _sendTask;
+    portMUX_TYPE _mux;
+    camera_stream_stats_t _stats;
+
+    void _release(Frame* frame);
+    Frame* _take();
+    void _capture();
+    void _send();
+    void _accept();
+    void _close(Slot& slot);
+    bool _next(Slot& slot);
+    static void _captureTaskFn(void* arg);
+    static void _sendTaskFn(void* arg);
+};
+
+#endif /* _CAMERA_STREAM_H_ */
@@ -17,14 +17,13 @@ void setup() {
   WiFi.softAPConfig(apIP, apIP, IPAddress(255, 255, 255, 0));
 
   // if DNSServer is started with "*" for domain name, it will reply with
-  // provided IP to all DNS request
+  // provided IP to all DNS request, requests are answered in the background
   dnsServer.start(DNS_PORT, "*", apIP);
 
   server.begin();
 }
 
 void loop() {
-  dnsServer.processNextRequest();
   WiFiClient client = server.available();   // listen for incoming clients
 
   if (client) {
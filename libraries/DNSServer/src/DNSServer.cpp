@@ -27,25 +27,29 @@ DNSServer::DNSServer()
 {
   _ttl = htonl(DNS_DEFAULT_TTL);
   _errorReplyCode = DNSReplyCode::NonExistentDomain;
-  _dnsHeader    = (DNSHeader*) malloc( sizeof(DNSHeader) ) ;
-  _dnsQuestion  = (DNSQuestion*) malloc( sizeof(DNSQuestion) ) ;     
-  _buffer     = NULL;
-  _currentPacketSize = 0;
   _port = 0;
+  _wildcard = false;
+  _domainLength = 0;
+  memset(_resolvedIP, 0, sizeof(_resolvedIP));
+  buildAnswer();
 }
 
 bool DNSServer::start(const uint16_t &port, const String &domainName,
                      const IPAddress &resolvedIP)
 {
   _port = port;
-  _buffer = NULL;
   _domainName = domainName;
   _resolvedIP[0] = resolvedIP[0];
   _resolvedIP[1] = resolvedIP[1];
   _resolvedIP[2] = resolvedIP[2];
   _resolvedIP[3] = resolvedIP[3];
   downcaseAndRemoveWwwPrefix(_domainName);
-  return _udp.begin(_port) == 1;
+  encodeDomainName();
+  buildAnswer();
+  _udp.onPacket([this](AsyncUDPPacket &packet) {
+    handlePacket(packet);
+  });
+  return _udp.listen(_port);
 }
 
 void DNSServer::setErrorReplyCode(const DNSReplyCode &replyCode)
@@ -56,13 +60,16 @@ void DNSServer::setErrorReplyCode(const DNSReplyCode &replyCode)
 void DNSServer::setTTL(const uint32_t &ttl)
 {
   _ttl = htonl(ttl);
+  buildAnswer();
 }
 
 void DNSServer::stop()
 {
-  _udp.stop();
-  free(_buffer);
-  _buffer = NULL;
+  _udp.close();
+}
+
+void DNSServer::processNextRequest()
+{
 }
 
 void DNSServer::downcaseAndRemoveWwwPrefix(String &domainName)
@@ -71,154 +78,149 @@ void DNSServer::downcaseAndRemoveWwwPrefix(String &domainName)
   domainName.replace("www.", "");
 }
 
-void DNSServer::processNextRequest()
+// The configured name in the form it has in a query, "github.com" becomes
+// 6 github 3 com 0, so that matching is a compare over the received bytes
+void DNSServer::encodeDomainName()
 {
-  _currentPacketSize = _udp.parsePacket();
-  if (_currentPacketSize)
+  _wildcard = _domainName == "*";
+  _domainLength = 0;
+  if (_wildcard || _domainName.length() + 2 > DNS_MAX_NAME_SIZE)
+    return;
+
+  const char *name = _domainName.c_str();
+  size_t pos = 0;
+  while (*name)
   {
-    // Allocate buffer for the DNS query
-    if (_buffer != NULL) 
-      free(_buffer);
-    _buffer = (unsigned char*)malloc(_currentPacketSize * sizeof(char));
-    if (_buffer == NULL) 
-      return;
-
-    // Put the packet received in the buffer and get DNS header (beginning of message)
-    // and the question
-    _udp.read(_buffer, _currentPacketSize);
-    memcpy( _dnsHeader, _buffer, DNS_HEADER_SIZE ) ; 
-    if ( requestIncludesOnlyOneQuestion() )
+    const char *dot = strchr(name, '.');
+    size_t labelLength = dot ? dot - name : strlen(name);
+    if (labelLength == 0 || labelLength > 63)
     {
-      // The QName has a variable length, maximum 255 bytes and is comprised of multiple labels.
-      // Each label contains a byte to describe its length and the label itself. The list of 
-      // labels terminates with a zero-valued byte. In "github.com", we have two labels "github" & "com"
-      // Iterate through the labels and copy them as they come into a single buffer (for simplicity's sake)
-      _dnsQuestion->QNameLength = 0 ;
-      while ( _buffer[ DNS_HEADER_SIZE + _dnsQuestion->QNameLength ] != 0 )
-      {
-        memcpy( (void*) &_dnsQuestion->QName[_dnsQuestion->QNameLength], (void*) &_buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength], _buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength] + 1 ) ;
-        _dnsQuestion->QNameLength += _buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength] + 1 ; 
-      }
-      _dnsQuestion->QName[_dnsQuestion->QNameLength] = 0 ; 
-      _dnsQuestion->QNameLength++ ;   
-
-      // Copy the QType and QClass 
-      memcpy( &_dnsQuestion->QType, (void*) &_buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength], sizeof(_dnsQuestion->QType) ) ;
-      memcpy( &_dnsQuestion->QClass, (void*) &_buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength + sizeof(_dnsQuestion->QType)], sizeof(_dnsQuestion->QClass) ) ;
+      _domainLength = 0;
+      return;
     }
-    
+    _domain[pos++] = labelLength;
+    memcpy(&_domain[pos], name, labelLength);
+    pos += labelLength;
+    name += labelLength;
+    if (*name == '.')
+      name++;
+  }
+  _domain[pos++] = 0;
+  _domainLength = pos;
+}
 
-    if (_dnsHeader->QR == DNS_QR_QUERY &&
-        _dnsHeader->OPCode == DNS_OPCODE_QUERY &&
-        requestIncludesOnlyOneQuestion() &&
-        (_domainName == "*" || getDomainNameWithoutWwwPrefix() == _domainName)
-       )
-    {
-      replyWithIP();
-    }
-    else if (_dnsHeader->QR == DNS_QR_QUERY)
-    {
-      replyWithCustomCode();
-    }
+// The answer is the same for every query: a pointer to the name of the question,
+// type A, class IN, the TTL and the address, so it is put together once
+void DNSServer::buildAnswer()
+{
+  uint16_t answerType = htons(DNS_TYPE_A), answerClass = htons(DNS_CLASS_IN), answerIPv4 = htons(DNS_RDLENGTH_IPV4);
+  // Use DNS name compression : instead of repeating the name in this RNAME occurence,
+  // set the two MSB of the byte corresponding normally to the length to 1. The following
+  // 14 bits must be used to specify the offset of the domain name in the message 
+  // (<255 here so the first byte has the 6 LSB at 0) 
+  _answer[0] = 0xC0;
+  _answer[1] = DNS_OFFSET_DOMAIN_NAME;
+  memcpy(&_answer[2], &answerType, 2);
+  memcpy(&_answer[4], &answerClass, 2);
+  memcpy(&_answer[6], &_ttl, 4);
+  memcpy(&_answer[10], &answerIPv4, 2);
+  memcpy(&_answer[12], _resolvedIP, sizeof(_resolvedIP));
+}
 
-    free(_buffer);
-    _buffer = NULL;
+void DNSServer::handlePacket(AsyncUDPPacket &packet)
+{
+  // The query is read into the fixed buffer and the reply is made in place
+  size_t length = packet.read(_buffer, DNS_MAX_PACKET_SIZE);
+  if (length < DNS_HEADER_SIZE)
+    return;
+
+  DNSHeader *header = (DNSHeader*) _buffer;
+  if (header->QR != DNS_QR_QUERY)
+    return;
+
+  size_t end = 0;
+  if (header->OPCode == DNS_OPCODE_QUERY &&
+      requestIncludesOnlyOneQuestion(header) &&
+      (end = questionEnd(length)) != 0 &&
+      matchesDomain()
+     )
+  {
+    replyWithIP(packet, end);
+  }
+  else
+  {
+    replyWithCustomCode(packet);
   }
 }
 
-bool DNSServer::requestIncludesOnlyOneQuestion()
+bool DNSServer::requestIncludesOnlyOneQuestion(const DNSHeader *header)
 {
-  return ntohs(_dnsHeader->QDCount) == 1 &&
-         _dnsHeader->ANCount == 0 &&
-         _dnsHeader->NSCount == 0 &&
-         _dnsHeader->ARCount == 0;
+  return ntohs(header->QDCount) == 1 &&
+         header->ANCount == 0 &&
+         header->NSCount == 0 &&
+         header->ARCount == 0;
 }
 
-
-String DNSServer::getDomainNameWithoutWwwPrefix()
+// The QName has a variable length, maximum 255 bytes and is comprised of multiple labels.
+// Each label contains a byte to describe its length and the label itself. The list of 
+// labels terminates with a zero-valued byte, QType and QClass follow.
+// Returns where the question ends, 0 when it does not fit the packet
+size_t DNSServer::questionEnd(size_t length)
 {
-  // Error checking : if the buffer containing the DNS request is a null pointer, return an empty domain
-  String parsedDomainName = "";
-  if (_buffer == NULL) 
-    return parsedDomainName;
-  
-  // Set the start of the domain just after the header (12 bytes). If equal to null character, return an empty domain
-  unsigned char *start = _buffer + DNS_OFFSET_DOMAIN_NAME;
-  if (*start == 0)
+  size_t pos = DNS_HEADER_SIZE;
+  while (pos < length && _buffer[pos] != 0)
   {
-    return parsedDomainName;
+    // a query carries no compressed names
+    if (_buffer[pos] & 0xC0)
+      return 0;
+    pos += _buffer[pos] + 1;
   }
+  pos += 1 + 2 * sizeof(uint16_t);
+  if (pos > length)
+    return 0;
+  return pos;
+}
 
-  int pos = 0;
-  while(true)
+bool DNSServer::matchesDomain()
+{
+  if (_wildcard)
+    return true;
+  if (!_domainLength)
+    return false;
+
+  // Label length bytes are below 64 and left alone by tolower()
+  const uint8_t *name = &_buffer[DNS_OFFSET_DOMAIN_NAME];
+  if (name[0] == 3 && tolower(name[1]) == 'w' && tolower(name[2]) == 'w' && tolower(name[3]) == 'w')
+    name += 4;
+  for (size_t i = 0; i < _domainLength; i++)
   {
-    unsigned char labelLength = *(start + pos);
-    for(int i = 0; i < labelLength; i++)
-    {
-      pos++;
-      parsedDomainName += (char)*(start + pos);
-    }
-    pos++;
-    if (*(start + pos) == 0)
-    {
-      downcaseAndRemoveWwwPrefix(parsedDomainName);
-      return parsedDomainName;
-    }
-    else
-    {
-      parsedDomainName += ".";
-    }
+    if (tolower(name[i]) != _domain[i])
+      return false;
   }
+  return true;
 }
 
-void DNSServer::replyWithIP()
+void DNSServer::replyWithIP(AsyncUDPPacket &packet, size_t length)
 {
-  if (_buffer == NULL) return;
-  
-  _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-  
   // Change the type of message to a response and set the number of answers equal to 
-  // the number of questions in the header
-  _dnsHeader->QR      = DNS_QR_RESPONSE;
-  _dnsHeader->ANCount = _dnsHeader->QDCount;
-  _udp.write( (unsigned char*) _dnsHeader, DNS_HEADER_SIZE ) ;
-
-  // Write the question
-  _udp.write(_dnsQuestion->QName, _dnsQuestion->QNameLength) ;
-  _udp.write( (unsigned char*) &_dnsQuestion->QType, 2 ) ;
-  _udp.write( (unsigned char*) &_dnsQuestion->QClass, 2 ) ;
-
-  // Write the answer 
-  // Use DNS name compression : instead of repeating the name in this RNAME occurence,
-  // set the two MSB of the byte corresponding normally to the length to 1. The following
-  // 14 bits must be used to specify the offset of the domain name in the message 
-  // (<255 here so the first byte has the 6 LSB at 0) 
-  _udp.write((uint8_t) 0xC0); 
-  _udp.write((uint8_t) DNS_OFFSET_DOMAIN_NAME);  
-
-  // DNS type A : host address, DNS class IN for INternet, returning an IPv4 address 
-  uint16_t answerType = htons(DNS_TYPE_A), answerClass = htons(DNS_CLASS_IN), answerIPv4 = htons(DNS_RDLENGTH_IPV4)  ; 
-  _udp.write((unsigned char*) &answerType, 2 );
-  _udp.write((unsigned char*) &answerClass, 2 );
-  _udp.write((unsigned char*) &_ttl, 4);        // DNS Time To Live
-  _udp.write((unsigned char*) &answerIPv4, 2 );
-  _udp.write(_resolvedIP, sizeof(_resolvedIP)); // The IP address to return
-  _udp.endPacket();
+  // the number of questions in the header, the question stays where it is
+  DNSHeader *header = (DNSHeader*) _buffer;
+  header->QR      = DNS_QR_RESPONSE;
+  header->ANCount = header->QDCount;
+  memcpy(&_buffer[length], _answer, DNS_ANSWER_SIZE);
+  packet.write(_buffer, length + DNS_ANSWER_SIZE);
 
   #ifdef DEBUG_ESP_DNS
-    DEBUG_OUTPUT.printf("DNS responds: %s for %s\n",
-            IPAddress(_resolvedIP).toString().c_str(), getDomainNameWithoutWwwPrefix().c_str() );
+    DEBUG_OUTPUT.printf("DNS responds: %s\n", IPAddress(_resolvedIP).toString().c_str());
   #endif  
 }
 
-void DNSServer::replyWithCustomCode()
+void DNSServer::replyWithCustomCode(AsyncUDPPacket &packet)
 {
-  if (_buffer == NULL) return;
-  _dnsHeader->QR = DNS_QR_RESPONSE;
-  _dnsHeader->RCode = (unsigned char)_errorReplyCode;
-  _dnsHeader->QDCount = 0;
-
-  _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-  _udp.write(_buffer, sizeof(DNSHeader));
-  _udp.endPacket();
+  DNSHeader *header = (DNSHeader*) _buffer;
+  header->QR = DNS_QR_RESPONSE;
+  header->RCode = (unsigned char)_errorReplyCode;
+  header->QDCount = 0;
+
+  packet.write(_buffer, sizeof(DNSHeader));
 }
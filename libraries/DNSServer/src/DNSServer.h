@@ -14,7 +14,7 @@
 
 #ifndef DNSServer_h
 #define DNSServer_h
-#include <WiFiUdp.h>
+#include <AsyncUDP.h>
 
 #define DNS_QR_QUERY 0
 #define DNS_QR_RESPONSE 1
@@ -22,6 +22,9 @@
 #define DNS_DEFAULT_TTL 60        // Default Time To Live : time interval in seconds that the resource record should be cached before being discarded
 #define DNS_OFFSET_DOMAIN_NAME 12 // Offset in bytes to reach the domain name in the DNS message 
 #define DNS_HEADER_SIZE 12 
+#define DNS_MAX_PACKET_SIZE 512   // Largest query answered, the UDP limit of plain DNS
+#define DNS_ANSWER_SIZE 16        // The A record appended to every positive reply
+#define DNS_MAX_NAME_SIZE 256     // Domain name in wire format, labels and the closing zero
 
 enum class DNSReplyCode
 {
@@ -90,6 +93,8 @@ class DNSServer
 {
   public:
     DNSServer();
+    // Queries are answered from the AsyncUDP task as they arrive, this is kept
+    // so that sketches written for the polled server still build
     void processNextRequest();
     void setErrorReplyCode(const DNSReplyCode &replyCode);
     void setTTL(const uint32_t &ttl);
@@ -102,22 +107,26 @@ class DNSServer
     void stop();
 
   private:
-    WiFiUDP _udp;
+    AsyncUDP _udp;
     uint16_t _port;
     String _domainName;
+    bool _wildcard;
+    uint8_t _domain[DNS_MAX_NAME_SIZE];
+    size_t _domainLength;
     unsigned char _resolvedIP[4];
-    int _currentPacketSize;
-    unsigned char* _buffer;
-    DNSHeader* _dnsHeader;
+    uint8_t _buffer[DNS_MAX_PACKET_SIZE + DNS_ANSWER_SIZE];
+    uint8_t _answer[DNS_ANSWER_SIZE];
     uint32_t _ttl;
     DNSReplyCode _errorReplyCode;
-    DNSQuestion*    _dnsQuestion ; 
-
 
     void downcaseAndRemoveWwwPrefix(String &domainName);
-    String getDomainNameWithoutWwwPrefix();
-    bool requestIncludesOnlyOneQuestion();
-    void replyWithIP();
-    void replyWithCustomCode();
+    void encodeDomainName();
+    void buildAnswer();
+    void handlePacket(AsyncUDPPacket &packet);
+    bool requestIncludesOnlyOneQuestion(const DNSHeader *header);
+    size_t questionEnd(size_t length);
+    bool matchesDomain();
+    void replyWithIP(AsyncUDPPacket &packet, size_t length);
+    void replyWithCustomCode(AsyncUDPPacket &packet);
 };
 #endif
\ No newline at end of file
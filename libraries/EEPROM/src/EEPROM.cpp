@@ -35,6 +35,7 @@ EEPROMClass::EEPROMClass(void)
   , _dirty(false)
   , _name("eeprom")
   , _user_defined_size(0)
+  , _dirtyChunks(0)
 {
 }
 
@@ -46,6 +47,7 @@ EEPROMClass::EEPROMClass(uint32_t sector)
   , _dirty(false)
   , _name("eeprom")
   , _user_defined_size(0)
+  , _dirtyChunks(0)
 {
 }
 
@@ -56,6 +58,7 @@ EEPROMClass::EEPROMClass(const char* name, uint32_t user_defined_size)
   , _dirty(false)
   , _name(name)
   , _user_defined_size(user_defined_size)
+  , _dirtyChunks(0)
 {
 }
 
@@ -63,10 +66,61 @@ EEPROMClass::~EEPROMClass() {
   end();
 }
 
+/*
+   The data is kept in EEPROM_CHUNK_SIZE blobs "#0", "#1", ... of the _name
+   namespace. Earlier versions, and convert(), stored it as one blob named
+   _name; begin() moves that over to chunks.
+*/
+static void chunkKey(char * out, size_t index) {
+  snprintf(out, 16, "#%x", (unsigned)index);
+}
+
+// reads the chunks into _data, marks the ones that are missing or of another length
+bool EEPROMClass::_readChunks() {
+  char key[16];
+  uint8_t chunk[EEPROM_CHUNK_SIZE];
+  size_t chunks = (_size + EEPROM_CHUNK_SIZE - 1) / EEPROM_CHUNK_SIZE;
+  for (size_t i = 0; i < chunks; i++) {
+    size_t start = i * EEPROM_CHUNK_SIZE;
+    size_t clen = (_size - start < EEPROM_CHUNK_SIZE) ? _size - start : EEPROM_CHUNK_SIZE;
+    size_t len = EEPROM_CHUNK_SIZE;
+    chunkKey(key, i);
+    esp_err_t res = nvs_get_blob(_handle, key, chunk, &len);
+    if (res == ESP_ERR_NVS_NOT_FOUND) {
+      _markDirty(start, clen);
+      continue;
+    }
+    if (res != ESP_OK) {
+      log_e("Unable to read NVS key: %d", res);
+      return false;
+    }
+    memcpy(_data + start, chunk, (len < clen) ? len : clen);
+    if (len != clen) {
+      _markDirty(start, clen);
+    }
+  }
+  // chunks past the end, from a bigger EEPROM before
+  size_t i = chunks;
+  for (; ; i++) {
+    chunkKey(key, i);
+    if (nvs_erase_key(_handle, key) != ESP_OK) {
+      break;
+    }
+  }
+  if (i > chunks) {
+    log_i("Truncated EEPROM to %d", _size);
+    nvs_commit(_handle);
+  }
+  return true;
+}
+
 bool EEPROMClass::begin(size_t size) {
   if (!size) {
       return false;
   }
+  if (_size) {
+      end();
+  }
 
   esp_err_t res = nvs_open(_name, NVS_READWRITE, &_handle);
   if (res != ESP_OK) {
@@ -74,71 +128,60 @@ bool EEPROMClass::begin(size_t size) {
       return false;
   }
 
-  size_t key_size = 0;
+  _data = (uint8_t*) malloc(size);
+  _dirtyChunks = (uint8_t*) calloc((size + EEPROM_CHUNK_SIZE * 8 - 1) / (EEPROM_CHUNK_SIZE * 8), 1);
+  if (!_data || !_dirtyChunks) {
+    log_e("Not enough memory for %d bytes in EEPROM", size);
+    goto fail;
+  }
+  memset(_data, 0xFF, size);
+  _size = size;
+
+  size_t key_size;
+  key_size = 0;
   res = nvs_get_blob(_handle, _name, NULL, &key_size);
-  if(res != ESP_OK && res != ESP_ERR_NVS_NOT_FOUND) {
+  if (res != ESP_OK && res != ESP_ERR_NVS_NOT_FOUND) {
       log_e("Unable to read NVS key: %d", res);
-      return false;
+      goto fail;
   }
-  if (size < key_size) { // truncate
-      log_w("truncating EEPROM from %d to %d", key_size, size);
+  if (key_size) {
       uint8_t* key_data = (uint8_t*) malloc(key_size);
-      if(!key_data) {
-         log_e("Not enough memory to truncate EEPROM!");
-         return false;
+      if (!key_data) {
+         log_e("Not enough memory to convert EEPROM!");
+         goto fail;
       }
       nvs_get_blob(_handle, _name, key_data, &key_size);
-      nvs_set_blob(_handle, _name, key_data, size);
-      nvs_commit(_handle);
-      free(key_data);
-  }
-  else if (size > key_size) { // expand or new
-      size_t expand_size = size - key_size;
-      uint8_t* expand_key = (uint8_t*) malloc(expand_size);
-      if(!expand_key) {
-         log_e("Not enough memory to expand EEPROM!");
-         return false;
-      }
-      // check for adequate free space
-      if(nvs_set_blob(_handle, "expand", expand_key, expand_size)) {
-        log_e("Not enough space to expand EEPROM from %d to %d", key_size, size);
-        free(expand_key);
-        return false;
-      }
-      free(expand_key);
-      nvs_erase_key(_handle, "expand");
-      uint8_t* key_data = (uint8_t*) malloc(size);
-      if(!key_data) {
-         log_e("Not enough memory to expand EEPROM!");
-         return false;
-      }
-      memset(key_data, 0xFF, size);
-      if(key_size) {
-        log_i("Expanding EEPROM from %d to %d", key_size, size);
-	// hold data while key is deleted
-        nvs_get_blob(_handle, _name, key_data, &key_size);
-        nvs_erase_key(_handle, _name);
-      } else {
-        log_i("New EEPROM of %d bytes", size);
+      if (size != key_size) {
+        log_i("Resizing EEPROM from %d to %d", key_size, size);
       }
-      nvs_commit(_handle);
-      nvs_set_blob(_handle, _name, key_data, size);
+      memcpy(_data, key_data, (key_size < size) ? key_size : size);
       free(key_data);
-      nvs_commit(_handle);
+      _markDirty(0, size);
+  } else if (!_readChunks()) {
+      goto fail;
   }
 
-  if (_data) {
-    delete[] _data;
+  // new, resized or converted chunks are written now, so a full NVS shows up here
+  if (_dirty && !commit()) {
+      log_e("Not enough space for %d bytes of EEPROM", size);
+      goto fail;
   }
-
-  _data = (uint8_t*) malloc(size);
-  if(!_data) {
-    log_e("Not enough memory for %d bytes in EEPROM");
-    return false;
+  if (key_size) {
+      nvs_erase_key(_handle, _name);
+      nvs_commit(_handle);
   }
-  _size = size;
-  nvs_get_blob(_handle, _name, _data, &_size);
   return true;
+
+fail:
+  free(_data);
+  free(_dirtyChunks);
+  _data = 0;
+  _dirtyChunks = 0;
+  _size = 0;
+  _dirty = false;
+  nvs_close(_handle);
+  _handle = 0;
+  return false;
 }
 
 void EEPROMClass::end() {
@@ -147,16 +190,29 @@ void EEPROMClass::end() {
   }
 
   commit();
-  if (_data) {
-    delete[] _data;
-  }
+  free(_data);
+  free(_dirtyChunks);
   _data = 0;
+  _dirtyChunks = 0;
   _size = 0;
 
   nvs_close(_handle);
   _handle = 0;
 }
 
+void EEPROMClass::_markDirty(size_t address, size_t len) {
+  if (!len || !_dirtyChunks || address >= _size) {
+    return;
+  }
+  if (len > _size - address) {
+    len = _size - address;
+  }
+  for (size_t i = address / EEPROM_CHUNK_SIZE; i <= (address + len - 1) / EEPROM_CHUNK_SIZE; i++) {
+    _dirtyChunks[i / 8] |= 1 << (i % 8);
+  }
+  _dirty = true;
+}
+
 uint8_t EEPROMClass::read(int address) {
   if (address < 0 || (size_t)address >= _size) {
     return 0;
@@ -179,7 +235,7 @@ void EEPROMClass::write(int address, uint8_t value) {
   if (*pData != value)
   {
     *pData = value;
-    _dirty = true;
+    _markDirty(address, 1);
   }
 }
 
@@ -195,9 +251,22 @@ bool EEPROMClass::commit() {
       return true;
   }
 
-  if (ESP_OK != nvs_set_blob(_handle, _name, _data, _size)) {
+  char key[16];
+  size_t chunks = (_size + EEPROM_CHUNK_SIZE - 1) / EEPROM_CHUNK_SIZE;
+  for (size_t i = 0; i < chunks; i++) {
+    if (!(_dirtyChunks[i / 8] & (1 << (i % 8)))) {
+      continue;
+    }
+    size_t start = i * EEPROM_CHUNK_SIZE;
+    size_t clen = (_size - start < EEPROM_CHUNK_SIZE) ? _size - start : EEPROM_CHUNK_SIZE;
+    chunkKey(key, i);
+    if (ESP_OK != nvs_set_blob(_handle, key, _data + start, clen)) {
       log_e( "error in write");
-  } else {
+      return false;
+    }
+    _dirtyChunks[i / 8] &= ~(1 << (i % 8));
+  }
+  if (ESP_OK == nvs_commit(_handle)) {
       _dirty = false;
       ret = true;
   }
@@ -206,7 +275,7 @@ bool EEPROMClass::commit() {
 }
 
 uint8_t * EEPROMClass::getDataPtr() {
-  _dirty = true;
+  _markDirty(0, _size);
   return &_data[0];
 }
 
@@ -519,7 +588,7 @@ size_t EEPROMClass::writeString (int address, const char* value)
     return 0;
 
   memcpy(_data + address, (const uint8_t*) value, len + 1);
-  _dirty = true;
+  _markDirty(address, len + 1);
   return strlen(value);
 }
 
@@ -537,7 +606,7 @@ size_t EEPROMClass::writeBytes (int address, const void* value, size_t len)
     return 0;
 
   memcpy(_data + address, (const void*) value, len);
-  _dirty = true;
+  _markDirty(address, len);
   return len;
 }
 
@@ -547,7 +616,7 @@ template <class T> T EEPROMClass::writeAll (int address, const T &value)
     return value;
 
   memcpy(_data + address, (const uint8_t*) &value, sizeof(T));
-  _dirty = true;
+  _markDirty(address, sizeof(T));
 
   return sizeof (value);
 }
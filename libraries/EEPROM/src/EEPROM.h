@@ -28,6 +28,9 @@
 #ifndef EEPROM_FLASH_PARTITION_NAME
 #define EEPROM_FLASH_PARTITION_NAME "eeprom"
 #endif
+#ifndef EEPROM_CHUNK_SIZE
+#define EEPROM_CHUNK_SIZE 128 // bytes per NVS blob, commit() rewrites only the chunks written to
+#endif
 #include <Arduino.h>
 
 typedef uint32_t nvs_handle;
@@ -64,7 +67,7 @@ class EEPROMClass {
         return t;
 
       memcpy(_data + address, (const uint8_t*) &t, sizeof(T));
-      _dirty = true;
+      _markDirty(address, sizeof(T));
       return t;
     }
 
@@ -113,6 +116,10 @@ class EEPROMClass {
     bool _dirty;
     const char* _name;
     uint32_t _user_defined_size;
+    uint8_t* _dirtyChunks;  // bit per EEPROM_CHUNK_SIZE chunk
+
+    void _markDirty(size_t address, size_t len);
+    bool _readChunks();
 };
 
 #if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_EEPROM)
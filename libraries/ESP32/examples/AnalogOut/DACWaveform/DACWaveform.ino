@@ -0,0 +1,25 @@
+/*
+ * A 1 kHz tone from the cosine generator on pin 26 and a sawtooth played
+ * from a buffer by DMA on pin 25, with nothing left for loop() to do.
+ */
+
+#define SAMPLE_RATE 16000
+
+uint8_t sawtooth[64];
+
+void setup() {
+  Serial.begin(115200);
+  for (int i = 0; i < sizeof(sawtooth); i++) {
+    sawtooth[i] = i * 256 / sizeof(sawtooth);
+  }
+  // 250 Hz: 64 samples at 16 kHz
+  if (!dacWriteBuffer(25, sawtooth, sizeof(sawtooth), SAMPLE_RATE, true)) {
+    Serial.println("DAC buffer failed");
+  }
+  // half amplitude
+  dacCosine(26, 1000, 1, 0);
+}
+
+void loop() {
+  delay(1000);
+}
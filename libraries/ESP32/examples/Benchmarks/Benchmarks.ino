@@ -0,0 +1,197 @@
+/*
+  Core primitive benchmarks
+
+  Times cbuf, String, Print, Stream::readBytes, base64, MD5Builder,
+  digitalWrite, spiTransferBytes and i2cWrite with the CPU cycle counter and
+  prints one CSV line per primitive, so runs of different core versions can be
+  diffed or parsed by a script:
+
+    BENCH,<name>,<iterations>,<cycles/op>,<ops/sec>
+
+  Lines that do not start with BENCH are comments. SPI and I2C run on the pins
+  below with nothing attached: SPI clocks out regardless, I2C measures a full
+  address NACK round trip. Run with WiFi/BT off for stable numbers.
+*/
+
+#include "cbuf.h"
+#include "base64.h"
+#include "MD5Builder.h"
+
+#define BENCH_GPIO      2
+#define BENCH_SPI_BUS   HSPI
+#define BENCH_SPI_SCK   14
+#define BENCH_SPI_MISO  12
+#define BENCH_SPI_MOSI  13
+#define BENCH_SPI_FREQ  10000000
+#define BENCH_I2C_SDA   21
+#define BENCH_I2C_SCL   22
+#define BENCH_I2C_FREQ  400000
+
+// keeps the compiler from dropping results
+static volatile uint32_t sink;
+static uint8_t data[1024];
+
+// a Print that discards everything, so only the formatting is measured
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *, size_t size) override { return size; }
+};
+
+// a Stream that serves the same block over and over
+class MemStream : public Stream {
+  const uint8_t *_buf;
+  size_t _len, _pos;
+public:
+  MemStream(const uint8_t *buf, size_t len) : _buf(buf), _len(len), _pos(0) {}
+  int available() override { return _len - _pos; }
+  int read() override { return _pos < _len ? _buf[_pos++] : -1; }
+  int peek() override { return _pos < _len ? _buf[_pos] : -1; }
+  void flush() override {}
+  size_t write(uint8_t) override { return 0; }
+  void rewind() { _pos = 0; }
+};
+
+typedef void (*bench_fn_t)(void);
+
+// run fn iterations times, report cycles per call
+static void bench(const char *name, uint32_t iterations, bench_fn_t fn)
+{
+  fn(); // warm up flash cache and lazy init
+  uint64_t cycles = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    uint32_t start = xthal_get_ccount();
+    fn();
+    cycles += (uint32_t)(xthal_get_ccount() - start);
+  }
+  uint32_t perOp = cycles / iterations;
+  uint32_t opsPerSec = perOp ? (uint64_t)getCpuFrequencyMhz() * 1000000 / perOp : 0;
+  Serial.printf("BENCH,%s,%u,%u,%u\n", name, iterations, perOp, opsPerSec);
+}
+
+static cbuf ring(512);
+static NullPrint nullPrint;
+static MemStream memStream(data, 256);
+static MD5Builder md5;
+static spi_t *spi;
+static i2c_t *i2c;
+
+static void cbufWriteRead()
+{
+  ring.write((const char *)data, 256);
+  sink = ring.read((char *)data + 512, 256);
+}
+
+static void cbufByte()
+{
+  ring.write((char)sink);
+  sink = ring.read();
+}
+
+static void stringConcat()
+{
+  String s;
+  for (int i = 0; i < 16; i++) {
+    s += "chunk";
+  }
+  sink = s.length();
+}
+
+static void stringNumber()
+{
+  String s(123456789UL);
+  s += 3.14159f;
+  sink = s.length();
+}
+
+static void printInt()
+{
+  sink = nullPrint.print(1234567890UL);
+}
+
+static void printFloat()
+{
+  sink = nullPrint.print(2.71828, 4);
+}
+
+static void printfMixed()
+{
+  sink = nullPrint.printf("%s=%d %08x %.2f\n", "value", -42, 0xbeefU, 1.5);
+}
+
+static void streamReadBytes()
+{
+  memStream.rewind();
+  sink = memStream.readBytes(data + 512, 256);
+}
+
+static void base64Encode()
+{
+  sink = base64::encode(data, 256).length();
+}
+
+static void md5Block()
+{
+  md5.begin();
+  md5.add(data, 1024);
+  md5.calculate();
+  sink = md5.getSize();
+}
+
+static void gpioWrite()
+{
+  digitalWrite(BENCH_GPIO, HIGH);
+  digitalWrite(BENCH_GPIO, LOW);
+}
+
+static void spiBytes()
+{
+  spiTransferBytes(spi, data, data + 512, 64);
+}
+
+static void i2cNack()
+{
+  sink = i2cWrite(i2c, 0x7f, data, 1, true, 10);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = i * 31 + 7;
+  }
+  pinMode(BENCH_GPIO, OUTPUT);
+
+  spi = spiStartBus(BENCH_SPI_BUS, spiFrequencyToClockDiv(BENCH_SPI_FREQ), SPI_MODE0, SPI_MSBFIRST);
+  spiAttachSCK(spi, BENCH_SPI_SCK);
+  spiAttachMISO(spi, BENCH_SPI_MISO);
+  spiAttachMOSI(spi, BENCH_SPI_MOSI);
+  i2c = i2cInit(0, BENCH_I2C_SDA, BENCH_I2C_SCL, BENCH_I2C_FREQ);
+
+  delay(100);
+  Serial.printf("# sdk %s, cpu %u MHz, heap %u\n", ESP.getSdkVersion(), getCpuFrequencyMhz(), ESP.getFreeHeap());
+  Serial.println("# name,iterations,cycles/op,ops/sec");
+}
+
+void loop()
+{
+  bench("cbuf_write_read_256", 10000, cbufWriteRead);
+  bench("cbuf_byte", 100000, cbufByte);
+  bench("string_concat_16", 10000, stringConcat);
+  bench("string_number", 10000, stringNumber);
+  bench("print_int", 100000, printInt);
+  bench("print_float", 10000, printFloat);
+  bench("printf_mixed", 10000, printfMixed);
+  bench("stream_readbytes_256", 10000, streamReadBytes);
+  bench("base64_encode_256", 10000, base64Encode);
+  bench("md5_1k", 1000, md5Block);
+  bench("digitalwrite_pair", 100000, gpioWrite);
+  if (spi) {
+    bench("spi_transfer_64", 1000, spiBytes);
+  }
+  if (i2c) {
+    bench("i2c_write_nack", 100, i2cNack);
+  }
+  Serial.println("# done");
+  delay(10000);
+}
@@ -0,0 +1,56 @@
+/*
+Keeping state over deep sleep with rtcStateRegister()
+=====================================================
+The calibration below takes a while, so it is done
+once after power on and kept in RTC memory. After
+every wake it is restored and the sketch gets to work
+right away. ESP.deepSleep() stores the registered
+blocks as they are when it is called.
+
+This code is under Public Domain License.
+*/
+
+#define TIME_TO_SLEEP_US 10000000ULL
+
+// a new version makes the block a different size or key, an old one is not restored
+struct Calibration {
+  uint16_t offset;
+  float scale;
+  uint32_t wakeups;
+};
+
+Calibration calibration;
+
+void calibrate() {
+  uint32_t sum = 0;
+  for (int i = 0; i < 64; i++) {
+    sum += analogRead(36);
+    delay(20);
+  }
+  calibration.offset = sum / 64;
+  calibration.scale = 3.3f / 4095;
+  calibration.wakeups = 0;
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  unsigned long start = micros();
+  if (rtcStateRegister("calibration", &calibration, sizeof(calibration))) {
+    calibration.wakeups++;
+    Serial.printf("Restored after %u wakeups\n", calibration.wakeups);
+  } else {
+    Serial.println("Nothing kept, calibrating");
+    calibrate();
+  }
+  Serial.printf("Ready in %lu us\n", micros() - start);
+
+  int raw = analogRead(36);
+  Serial.printf("Reading %.3f V\n", (raw - (int)calibration.offset) * calibration.scale);
+
+  Serial.flush();
+  ESP.deepSleep(TIME_TO_SLEEP_US);
+}
+
+void loop() {
+}
@@ -0,0 +1,46 @@
+/*
+ADC sampling in deep sleep by the ULP coprocessor
+=================================================
+The ULP samples GPIO 34 every 100 ms while the main
+cores sleep, and wakes them once 50 samples were taken,
+or right away when one is below 500 or above 3500.
+The wake is only spent on processing the batch.
+
+This code is under Public Domain License.
+*/
+
+#define ADC_PIN        34
+#define BATCH          50
+#define PERIOD_US      100000
+#define LOW_THRESHOLD  500
+#define HIGH_THRESHOLD 3500
+
+uint16_t samples[BATCH];
+
+void setup() {
+  Serial.begin(115200);
+
+  if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_ULP) {
+    Serial.printf("Starting the ULP, batches of up to %u fit\n", ulpAdcMaxBatch());
+    if (!ulpAdcBegin(ADC_PIN, BATCH, PERIOD_US, LOW_THRESHOLD, HIGH_THRESHOLD)) {
+      Serial.println("ULP failed to start");
+      return;
+    }
+  } else {
+    bool crossed;
+    size_t count = ulpAdcRead(samples, BATCH, &crossed);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+      sum += samples[i];
+    }
+    Serial.printf("%u samples, average %u, last %u%s\n", count, count ? sum / count : 0,
+                  count ? samples[count - 1] : 0, crossed ? ", outside the thresholds" : "");
+  }
+
+  Serial.flush();
+  // the ULP keeps running and wakes us, there is no timer
+  esp_deep_sleep_start();
+}
+
+void loop() {
+}
@@ -0,0 +1,237 @@
+/**
+   ESPNOW - Benchmark - Initiator
+   Purpose: Measures ESPNow between two ESP32s, the other one running the
+            Responder sketch on the same CHANNEL.
+   Description: For every payload size and PHY rate below it sends a burst of
+                BURST_PACKETS as fast as the driver takes them, then asks the
+                Responder how many arrived, then pings PING_PACKETS times one
+                after the other for the round trip times. Each test prints one
+                line of CSV after the '#' header line:
+
+     payload,rate,packets,pps,kbps,loss_pct,mac_fail,rtt_lost,rtt_p50_us,rtt_p90_us,rtt_p99_us,rtt_max_us
+
+   pps and kbps are of the burst, loss_pct what did not arrive of it, mac_fail
+   the packets the MAC gave up on after its retries; rtt_lost are the pings
+   without an answer in PING_TIMEOUT_MS.
+*/
+
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <esp_wifi_internal.h>
+#include <WiFi.h>
+
+#define CHANNEL 1
+#define BURST_PACKETS 1000
+#define PING_PACKETS 200
+#define PING_TIMEOUT_MS 50
+#define SEND_WINDOW 4         // packets in the driver at once during the burst
+
+const uint8_t payloads[] = { 16, 64, 128, 250 };
+const wifi_phy_rate_t rates[] = { WIFI_PHY_RATE_1M_L, WIFI_PHY_RATE_11M_S, WIFI_PHY_RATE_24M, WIFI_PHY_RATE_54M };
+const char * rateNames[] = { "1M_L", "11M_S", "24M", "54M" };
+
+// the same in both sketches
+enum {
+  BENCH_HELLO,
+  BENCH_HELLO_ACK,
+  BENCH_CONFIG,       // value is the PHY rate, resets the count
+  BENCH_CONFIG_ACK,
+  BENCH_DATA,
+  BENCH_PING,
+  BENCH_PONG,
+  BENCH_RESULT_REQ,
+  BENCH_RESULT        // value is the count of BENCH_DATA since BENCH_CONFIG
+};
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;
+  uint8_t test;
+  uint16_t reserved;
+  uint32_t seq;
+  uint32_t value;
+} bench_header_t;
+
+typedef struct {
+  bench_header_t header;
+  int64_t time;
+} reply_t;
+
+static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+static uint8_t peer[6];
+static uint8_t packet[ESP_NOW_MAX_DATA_LEN];
+static uint32_t rtt[PING_PACKETS];
+static QueueHandle_t replyQueue;
+static SemaphoreHandle_t window;
+static volatile uint32_t macFail = 0;
+static uint8_t test = 0;
+
+void OnDataSent(const uint8_t * mac, esp_now_send_status_t status) {
+  if (status != ESP_NOW_SEND_SUCCESS) {
+    macFail++;
+  }
+  xSemaphoreGive(window);
+}
+
+void OnDataRecv(const uint8_t * mac, const uint8_t * data, int len) {
+  if (len < (int)sizeof(bench_header_t)) {
+    return;
+  }
+  reply_t reply;
+  // taken first, the queue is not part of the round trip
+  reply.time = esp_timer_get_time();
+  reply.header = *(const bench_header_t *)data;
+  if (reply.header.type == BENCH_HELLO_ACK) {
+    memcpy(peer, mac, 6);
+  }
+  xQueueSend(replyQueue, &reply, 0);
+}
+
+static void sendPacket(const uint8_t * mac, uint8_t type, uint32_t seq, uint32_t value, uint8_t len) {
+  bench_header_t * header = (bench_header_t *)packet;
+  header->type = type;
+  header->test = test;
+  header->seq = seq;
+  header->value = value;
+  // whatever is left of the previous test is not looked at
+  while (esp_now_send(mac, packet, len) == ESP_ERR_ESPNOW_NO_MEM) {
+    delay(1);
+  }
+}
+
+// for the reply of type to seq, older ones are dropped; false after timeout
+static bool waitReply(uint8_t type, uint32_t seq, uint32_t timeout, reply_t * reply) {
+  int64_t end = esp_timer_get_time() + timeout * 1000LL;
+  for (;;) {
+    int64_t left = end - esp_timer_get_time();
+    if (left <= 0 || xQueueReceive(replyQueue, reply, pdMS_TO_TICKS(left / 1000) + 1) != pdTRUE) {
+      return false;
+    }
+    if (reply->header.type == type && reply->header.test == test && reply->header.seq == seq) {
+      return true;
+    }
+  }
+}
+
+// a few tries, the control packets can get lost like any other
+static bool request(uint8_t type, uint8_t ack, uint32_t value, reply_t * reply) {
+  for (int i = 0; i < 5; i++) {
+    sendPacket(peer, type, i, value, sizeof(bench_header_t));
+    if (waitReply(ack, i, 200, reply)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void findResponder() {
+  esp_now_peer_info_t info = {};
+  memcpy(info.peer_addr, broadcast, 6);
+  info.channel = CHANNEL;
+  info.ifidx = WIFI_IF_STA;
+  esp_now_add_peer(&info);
+
+  Serial.println("Looking for the Responder");
+  reply_t reply;
+  do {
+    sendPacket(broadcast, BENCH_HELLO, 0, 0, sizeof(bench_header_t));
+  } while (!waitReply(BENCH_HELLO_ACK, 0, 500, &reply));
+  // OnDataRecv() took the address before the reply was queued
+  memcpy(info.peer_addr, peer, 6);
+  esp_now_add_peer(&info);
+  Serial.printf("Responder %02x:%02x:%02x:%02x:%02x:%02x\n",
+                peer[0], peer[1], peer[2], peer[3], peer[4], peer[5]);
+}
+
+static int compareRtt(const void * a, const void * b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void runTest(uint8_t payload, size_t r) {
+  reply_t reply;
+  test++;
+  esp_wifi_internal_set_fix_rate(WIFI_IF_STA, true, rates[r]);
+  if (!request(BENCH_CONFIG, BENCH_CONFIG_ACK, rates[r], &reply)) {
+    Serial.printf("# %u,%s: no answer from the Responder\n", payload, rateNames[r]);
+    return;
+  }
+
+  // burst, SEND_WINDOW packets in flight
+  macFail = 0;
+  while (xSemaphoreTake(window, 0) == pdTRUE);
+  for (int i = 0; i < SEND_WINDOW; i++) {
+    xSemaphoreGive(window);
+  }
+  int64_t start = esp_timer_get_time();
+  for (uint32_t seq = 0; seq < BURST_PACKETS; seq++) {
+    xSemaphoreTake(window, portMAX_DELAY);
+    sendPacket(peer, BENCH_DATA, seq, 0, payload);
+  }
+  for (int i = 0; i < SEND_WINDOW; i++) {
+    xSemaphoreTake(window, pdMS_TO_TICKS(100));
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+  uint32_t failed = macFail;
+
+  uint32_t received = 0;
+  if (request(BENCH_RESULT_REQ, BENCH_RESULT, 0, &reply)) {
+    received = reply.header.value;
+  }
+
+  // pings, one at a time
+  uint32_t answered = 0;
+  for (uint32_t seq = 0; seq < PING_PACKETS; seq++) {
+    int64_t sent = esp_timer_get_time();
+    sendPacket(peer, BENCH_PING, seq, 0, payload);
+    if (waitReply(BENCH_PONG, seq, PING_TIMEOUT_MS, &reply)) {
+      rtt[answered++] = (uint32_t)(reply.time - sent);
+    }
+  }
+  qsort(rtt, answered, sizeof(rtt[0]), compareRtt);
+
+  float pps = BURST_PACKETS * 1000000.0f / elapsed;
+  Serial.printf("%u,%s,%u,%.0f,%.1f,%.2f,%u,%u",
+                payload, rateNames[r], BURST_PACKETS, pps, pps * payload * 8 / 1000,
+                100.0f * (BURST_PACKETS - received) / BURST_PACKETS, failed, PING_PACKETS - answered);
+  if (answered) {
+    Serial.printf(",%u,%u,%u,%u\n", rtt[answered * 50 / 100], rtt[answered * 90 / 100],
+                  rtt[answered * 99 / 100], rtt[answered - 1]);
+  } else {
+    Serial.println(",,,,");
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("ESPNow/Benchmark/Initiator Example");
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  esp_wifi_set_promiscuous(true);
+  esp_wifi_set_channel(CHANNEL, WIFI_SECOND_CHAN_NONE);
+  esp_wifi_set_promiscuous(false);
+  Serial.print("STA MAC: "); Serial.println(WiFi.macAddress());
+
+  replyQueue = xQueueCreate(16, sizeof(reply_t));
+  window = xSemaphoreCreateCounting(SEND_WINDOW, SEND_WINDOW);
+  if (esp_now_init() != ESP_OK) {
+    Serial.println("ESPNow Init Failed");
+    ESP.restart();
+  }
+  esp_now_register_send_cb(OnDataSent);
+  esp_now_register_recv_cb(OnDataRecv);
+  // the Responder is looked for at the slowest rate, it always receives it
+  esp_wifi_internal_set_fix_rate(WIFI_IF_STA, true, WIFI_PHY_RATE_1M_L);
+  findResponder();
+
+  Serial.println("# payload,rate,packets,pps,kbps,loss_pct,mac_fail,rtt_lost,rtt_p50_us,rtt_p90_us,rtt_p99_us,rtt_max_us");
+  for (size_t p = 0; p < sizeof(payloads); p++) {
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+      runTest(payloads[p], r);
+    }
+  }
+  Serial.println("# done");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,144 @@
+/**
+   ESPNOW - Benchmark - Responder
+   Purpose: The other end of the Initiator sketch, which measures throughput,
+            loss and round trip times of ESPNow between two ESP32s.
+   Description: Echoes the pings back, counts the burst packets and reports
+                the count when asked. The Initiator finds it by broadcasting
+                on CHANNEL, both have to use the same.
+*/
+
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <esp_wifi_internal.h>
+#include <WiFi.h>
+
+#define CHANNEL 1
+
+// the same in both sketches
+enum {
+  BENCH_HELLO,
+  BENCH_HELLO_ACK,
+  BENCH_CONFIG,       // value is the PHY rate, resets the count
+  BENCH_CONFIG_ACK,
+  BENCH_DATA,
+  BENCH_PING,
+  BENCH_PONG,
+  BENCH_RESULT_REQ,
+  BENCH_RESULT        // value is the count of BENCH_DATA since BENCH_CONFIG
+};
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;
+  uint8_t test;
+  uint16_t reserved;
+  uint32_t seq;
+  uint32_t value;
+} bench_header_t;
+
+static uint8_t peer[6];
+static volatile bool havePeer = false;
+static volatile uint32_t received = 0;
+static uint8_t test = 0;
+static QueueHandle_t controlQueue;
+static uint8_t echo[ESP_NOW_MAX_DATA_LEN];
+
+typedef struct {
+  uint8_t mac[6];
+  bench_header_t header;
+} control_t;
+
+static void reply(const uint8_t * mac, uint8_t type, const bench_header_t * in, uint32_t value) {
+  bench_header_t out = *in;
+  out.type = type;
+  out.value = value;
+  esp_now_send(mac, (const uint8_t *)&out, sizeof(out));
+}
+
+// runs in the WiFi task: counting and echoing here keeps the measured times
+// free of the loop() latency, peers and rates are changed from loop()
+void OnDataRecv(const uint8_t * mac, const uint8_t * data, int len) {
+  if (len < (int)sizeof(bench_header_t)) {
+    return;
+  }
+  const bench_header_t * header = (const bench_header_t *)data;
+  switch (header->type) {
+    case BENCH_DATA:
+      if (header->test == test) {
+        received++;
+      }
+      break;
+    case BENCH_PING:
+      if (havePeer) {
+        // the whole packet, so the round trip carries the payload both ways
+        memcpy(echo, data, len);
+        ((bench_header_t *)echo)->type = BENCH_PONG;
+        esp_now_send(mac, echo, len);
+      }
+      break;
+    case BENCH_RESULT_REQ:
+      if (havePeer) {
+        reply(mac, BENCH_RESULT, header, received);
+      }
+      break;
+    case BENCH_HELLO:
+    case BENCH_CONFIG: {
+        control_t control;
+        memcpy(control.mac, mac, 6);
+        control.header = *header;
+        xQueueSend(controlQueue, &control, 0);
+      }
+      break;
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("ESPNow/Benchmark/Responder Example");
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  esp_wifi_set_promiscuous(true);
+  esp_wifi_set_channel(CHANNEL, WIFI_SECOND_CHAN_NONE);
+  esp_wifi_set_promiscuous(false);
+  Serial.print("STA MAC: "); Serial.println(WiFi.macAddress());
+
+  controlQueue = xQueueCreate(4, sizeof(control_t));
+  if (esp_now_init() != ESP_OK) {
+    Serial.println("ESPNow Init Failed");
+    ESP.restart();
+  }
+  esp_now_register_recv_cb(OnDataRecv);
+}
+
+void loop() {
+  control_t control;
+  if (xQueueReceive(controlQueue, &control, portMAX_DELAY) != pdTRUE) {
+    return;
+  }
+  if (!esp_now_is_peer_exist(control.mac)) {
+    if (havePeer) {
+      esp_now_del_peer(peer);
+      havePeer = false;
+    }
+    esp_now_peer_info_t info = {};
+    memcpy(info.peer_addr, control.mac, 6);
+    info.channel = CHANNEL;
+    info.ifidx = WIFI_IF_STA;
+    if (esp_now_add_peer(&info) != ESP_OK) {
+      Serial.println("Add Peer failed");
+      return;
+    }
+    memcpy(peer, control.mac, 6);
+    havePeer = true;
+    Serial.printf("Initiator %02x:%02x:%02x:%02x:%02x:%02x\n",
+                  peer[0], peer[1], peer[2], peer[3], peer[4], peer[5]);
+  }
+  if (control.header.type == BENCH_HELLO) {
+    reply(peer, BENCH_HELLO_ACK, &control.header, 0);
+    return;
+  }
+  // the replies go at the rate the Initiator measures
+  esp_wifi_internal_set_fix_rate(WIFI_IF_STA, true, (wifi_phy_rate_t)control.header.value);
+  test = control.header.test;
+  received = 0;
+  reply(peer, BENCH_CONFIG_ACK, &control.header, 0);
+}
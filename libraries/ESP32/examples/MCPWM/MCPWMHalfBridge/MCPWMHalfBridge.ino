@@ -0,0 +1,62 @@
+/*
+ * Three half bridges driven by MCPWM0 at 20kHz: each timer drives a high side on A
+ * and the complementary low side on B with 500ns dead-time, timers 1 and 2 follow
+ * timer 0 at a third of a period apart. A high on the fault pin pulls all
+ * outputs low until it is cleared, and the capture unit times hall sensor edges.
+ */
+
+#define FAULT_PIN 34
+#define HALL_PIN  35
+
+const int8_t highSide[3] = { 16, 18, 21 };
+const int8_t lowSide[3] = { 17, 19, 22 };
+
+volatile uint32_t hallPeriod = 0;
+volatile bool tripped = false;
+
+void IRAM_ATTR onHall(void * arg, uint8_t channel, uint32_t ticks, bool rising) {
+  static uint32_t last = 0;
+  if (rising) {
+    hallPeriod = ticks - last;
+    last = ticks;
+  }
+}
+
+void IRAM_ATTR onFault(void * arg, uint8_t fault) {
+  tripped = true;
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  mcpwmAttachFault(0, 0, FAULT_PIN, true);
+  mcpwmOnFault(0, onFault, NULL);
+  for (uint8_t timer = 0; timer < MCPWM_TIMERS; timer++) {
+    mcpwmAttach(0, timer, highSide[timer], lowSide[timer], 20000, true);
+    mcpwmSetComplementary(0, timer, 500, 500);
+    mcpwmSetFaultAction(0, timer, 0, true, MCPWM_FAULT_LOW, MCPWM_FAULT_LOW);
+    mcpwmWrite(0, timer, 0, 0);
+  }
+  mcpwmSync(0, 1, MCPWM_SYNC_TIMER0, 333);
+  mcpwmSync(0, 2, MCPWM_SYNC_TIMER0, 667);
+
+  mcpwmAttachCapture(0, 0, HALL_PIN, MCPWM_CAPTURE_BOTH, 0, onHall, NULL);
+}
+
+void loop() {
+  static float duty = 0;
+  duty = (duty >= 90) ? 10 : duty + 10;
+  for (uint8_t timer = 0; timer < MCPWM_TIMERS; timer++) {
+    mcpwmWrite(0, timer, 0, duty);
+  }
+  if (tripped && !mcpwmFaultActive(0, 0)) {
+    Serial.println("fault cleared");
+    tripped = false;
+    for (uint8_t timer = 0; timer < MCPWM_TIMERS; timer++) {
+      mcpwmClearFault(0, timer);
+    }
+  }
+  uint32_t period = hallPeriod;
+  Serial.printf("duty: %.0f%% hall: %.1f Hz\n", duty, period ? (float)MCPWM_CAPTURE_HZ / period : 0.0f);
+  delay(1000);
+}
@@ -0,0 +1,36 @@
+/*
+ * A quadrature encoder on pins 18/19 counted in hardware, the frequency of
+ * a signal on pin 21 and the width of the HIGH pulses on pin 22, all without
+ * the CPU waiting on the pins.
+ */
+
+#define ENCODER_A 18
+#define ENCODER_B 19
+#define FREQ_PIN  21
+#define PULSE_PIN 22
+
+pcnt_t * encoder;
+pcnt_t * counter;
+pulse_in_t * pulse;
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(ENCODER_A, INPUT_PULLUP);
+  pinMode(ENCODER_B, INPUT_PULLUP);
+
+  encoder = pcntAttachEncoder(ENCODER_A, ENCODER_B, PCNT_ENCODER_X4);
+  // contact bounce of mechanical encoders
+  pcntSetFilter(encoder, 10000);
+
+  counter = pcntAttachCounter(FREQ_PIN, PCNT_RISING, -1);
+  pulse = pulseInAsyncBegin(PULSE_PIN, HIGH, 20000);
+}
+
+void loop() {
+  Serial.printf("position: %lld frequency: %.1f Hz\n", pcntRead(encoder), pcntFrequency(counter, 0));
+  unsigned long width;
+  while ((width = pulseInAsync(pulse, 0)) != 0) {
+    Serial.printf("pulse: %lu us\n", width);
+  }
+  delay(500);
+}
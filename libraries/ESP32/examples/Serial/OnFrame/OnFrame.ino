@@ -0,0 +1,31 @@
+/*
+  Receives NMEA style sentences on Serial2 without polling in loop().
+
+  Every line ending with '\n' is handed to the callback straight out of the
+  UART receive buffer, so no String is built and nothing is copied unless
+  the line wraps around the end of the buffer.
+*/
+
+#define RXD2 16
+#define TXD2 17
+
+volatile uint32_t sentences = 0;
+
+void onSentence(const uint8_t * frame, size_t len) {
+  sentences++;
+  if (len && frame[0] == '$') {
+    Serial.write(frame, len);
+    Serial.println();
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial2.begin(9600, SERIAL_8N1, RXD2, TXD2);
+  Serial2.onFrame('\n', onSentence, 128);
+}
+
+void loop() {
+  delay(10000);
+  Serial.printf("%u sentences received\n", sentences);
+}
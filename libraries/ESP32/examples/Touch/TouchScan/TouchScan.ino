@@ -0,0 +1,31 @@
+/*
+This is an example how to scan touch pads in the background:
+loop() reads nothing from the pads, the callback tells when one
+was pressed or released, also after the baseline moved with
+temperature or humidity
+*/
+
+const uint8_t pads[] = { T0, T2, T3, T4, T5 };
+
+void onTouch(void * arg, uint8_t pin, bool pressed) {
+  Serial.printf("pin %u %s\n", pin, pressed ? "pressed" : "released");
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000); // give me time to bring up serial monitor
+  Serial.println("ESP32 Touch Scan Test");
+  for (uint8_t i = 0; i < sizeof(pads); i++) {
+    // pressed 20% below the untouched value
+    touchScanAttach(pads[i], 20, onTouch, NULL);
+  }
+  touchScanBegin(20);
+}
+
+void loop() {
+  for (uint8_t i = 0; i < sizeof(pads); i++) {
+    Serial.printf("%u/%u ", touchScanValue(pads[i]), touchScanBaseline(pads[i]));
+  }
+  Serial.println();
+  delay(2000);
+}
@@ -0,0 +1,73 @@
+// Timeline of two tasks and the points of the core. Build with ARDUINO_TRACE=1
+// (e.g. -DARDUINO_TRACE=1 in build_opt.h or build_flags) for those of the core
+// and the libraries, the points of the sketch below are recorded in any case.
+// After three seconds the trace is printed as hex; save the output and run
+//   python tools/trace2json.py capture.txt trace.json
+// then open trace.json in ui.perfetto.dev or chrome://tracing.
+
+enum {
+  TRACE_ID_PRODUCE = TRACE_ID_USER,
+  TRACE_ID_CONSUME,
+  TRACE_ID_ITEM,
+};
+
+QueueHandle_t queue;
+
+void producer(void*) {
+  uint32_t n = 0;
+  for (;;) {
+    traceRecord(TRACE_ID_PRODUCE, TRACE_EVENT_BEGIN, 0);
+    delayMicroseconds(200);
+    xQueueSend(queue, &n, portMAX_DELAY);
+    traceRecord(TRACE_ID_PRODUCE, TRACE_EVENT_END, 0);
+    n++;
+    delay(5);
+  }
+}
+
+void consumer(void*) {
+  uint32_t n;
+  for (;;) {
+    xQueueReceive(queue, &n, portMAX_DELAY);
+    traceRecord(TRACE_ID_CONSUME, TRACE_EVENT_BEGIN, 0);
+    traceRecord(TRACE_ID_ITEM, TRACE_EVENT_INSTANT, n);
+    delayMicroseconds(500);
+    traceRecord(TRACE_ID_CONSUME, TRACE_EVENT_END, 0);
+  }
+}
+
+size_t printHex(void* ctx, const uint8_t* data, size_t len) {
+  static uint8_t column = 0;
+  for (size_t i = 0; i < len; i++) {
+    Serial.printf("%02x", data[i]);
+    if (++column == 32) {
+      Serial.println();
+      column = 0;
+    }
+  }
+  return len;
+}
+
+void setup() {
+  Serial.begin(115200);
+  if (!traceBegin(2048)) {
+    Serial.println("trace not started");
+    return;
+  }
+  traceName(TRACE_ID_PRODUCE, "produce");
+  traceName(TRACE_ID_CONSUME, "consume");
+  traceName(TRACE_ID_ITEM, "item");
+  queue = xQueueCreate(4, sizeof(uint32_t));
+  xTaskCreatePinnedToCore(producer, "producer", 2048, NULL, 2, NULL, 0);
+  xTaskCreatePinnedToCore(consumer, "consumer", 2048, NULL, 2, NULL, 1);
+  delay(3000);
+  Serial.println("# trace");
+  traceDump(printHex, NULL);
+  Serial.println();
+  Serial.println("# end");
+  traceEnd();
+}
+
+void loop() {
+  delay(1000);
+}
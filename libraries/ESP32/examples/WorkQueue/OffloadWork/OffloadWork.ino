@@ -0,0 +1,71 @@
+/*
+  Work taken off the loop by a WorkQueue
+
+  Two workers on core 0 hash blocks of data while loop() on core 1
+  keeps its 1 ms control cycle. The loop only submits the work and
+  picks up the results when they are done.
+*/
+
+#include "WorkQueue.h"
+#include "SHA256Builder.h"
+
+#define BLOCKS 8
+#define BLOCK_SIZE 4096
+
+WorkQueue work(2, 0);   // two workers on core 0, none on core 1
+
+uint8_t data[BLOCKS][BLOCK_SIZE];
+String digests[BLOCKS];
+WorkQueue::Future jobs[BLOCKS];
+volatile uint32_t finished = 0;
+
+void submitAll() {
+  for (int i = 0; i < BLOCKS; i++) {
+    esp_fill_random(data[i], BLOCK_SIZE);
+    jobs[i] = work.submit([i]() {
+      SHA256Builder sha;
+      sha.begin();
+      sha.add(data[i], BLOCK_SIZE);
+      sha.calculate();
+      digests[i] = sha.toString();
+    }, WORK_ANY_CORE, []() {
+      finished++;
+    });
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  if (!work.begin()) {
+    Serial.println("WorkQueue failed to start");
+    return;
+  }
+  submitAll();
+}
+
+void loop() {
+  static unsigned long last = micros();
+  static uint32_t cycles = 0, late = 0;
+
+  // the control cycle, it is not held up by the hashing
+  unsigned long now = micros();
+  if (now - last > 1500) {
+    late++;
+  }
+  last = now;
+  cycles++;
+
+  if (finished == BLOCKS) {
+    for (int i = 0; i < BLOCKS; i++) {
+      jobs[i]->wait();
+      Serial.printf("%d: %s\n", i, digests[i].c_str());
+    }
+    Serial.printf("%u cycles, %u late\n", cycles, late);
+    finished = 0;
+    cycles = late = 0;
+    delay(2000);
+    last = micros();
+    submitAll();
+  }
+  delay(1);
+}
@@ -0,0 +1,56 @@
+/*
+ * Counter shared over ESP-NOW.
+ *
+ * Flash the same sketch to a few boards. Each broadcasts its counter ten times
+ * a second, adds every board it hears from as a peer and prints what comes in.
+ * Every fifth packet goes to the peers one by one instead, acknowledged.
+ */
+#include <WiFi.h>
+#include <ESPNow.h>
+
+const uint8_t broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+uint32_t counter = 0;
+
+void onReceive(const espnow_packet_t& packet)
+{
+    if (!ESPNow.hasPeer(packet.mac)) {
+        ESPNow.addPeer(packet.mac);
+    }
+    uint32_t value;
+    memcpy(&value, packet.data, sizeof(value));
+    Serial.printf("%02X:%02X:%02X:%02X:%02X:%02X %u\n", packet.mac[0], packet.mac[1], packet.mac[2],
+                  packet.mac[3], packet.mac[4], packet.mac[5], value);
+}
+
+void onSent(const uint8_t* mac, bool success)
+{
+    if (!success) {
+        Serial.printf("%02X:%02X:%02X:%02X:%02X:%02X did not answer\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.mode(WIFI_STA);
+    if (!ESPNow.begin(1)) {
+        Serial.println("ESP-NOW failed");
+        return;
+    }
+    ESPNow.onReceive(onReceive);
+    ESPNow.onSent(onSent);
+}
+
+void loop()
+{
+    counter++;
+    ESPNow.send((counter % 5) ? broadcast : NULL, (const uint8_t*)&counter, sizeof(counter));
+    delay(100);
+
+    if (counter % 100 == 0) {
+        espnow_stats_t stats;
+        ESPNow.getStats(&stats);
+        Serial.printf("sent %u, failed %u, retries %u, received %u, dropped %u, peers %u\n",
+                      stats.sent, stats.failed, stats.retries, stats.received, stats.rxDropped, ESPNow.peerCount());
+    }
+}
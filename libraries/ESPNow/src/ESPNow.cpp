@@ -0,0 +1,394 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ESPNow.h"
+#include "WiFi.h"
+#include "esp_wifi.h"
+
+static const uint8_t _broadcast[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+ESPNowClass::ESPNowClass()
+    : _started(false)
+    , _txTask(NULL)
+    , _rxTask(NULL)
+    , _txQueue(NULL)
+    , _txFree(NULL)
+    , _rxQueue(NULL)
+    , _rxFree(NULL)
+    , _txPool(NULL)
+    , _rxPool(NULL)
+    , _onReceive(NULL)
+    , _onSent(NULL)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+ESPNowClass::~ESPNowClass()
+{
+    end();
+}
+
+/**
+ * Start ESP-NOW on the STA interface, WiFi is started when it is not yet
+ * @param channel 1 to 14 to move the radio there, only while the STA is not connected, 0 stays
+ */
+bool ESPNowClass::begin(uint8_t channel)
+{
+    if(_started) {
+        return true;
+    }
+    if(!(WiFi.getMode() & WIFI_MODE_STA) && !WiFi.enableSTA(true)) {
+        log_e("WiFi could not be started");
+        return false;
+    }
+    if(channel && esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) != ESP_OK) {
+        log_w("channel %u could not be set", channel);
+    }
+    esp_err_t err = esp_now_init();
+    if(err != ESP_OK) {
+        log_e("esp_now_init failed: %d", err);
+        return false;
+    }
+
+    _txPool = (tx_packet_t*)malloc(ESPNOW_TX_QUEUE_SIZE * sizeof(tx_packet_t));
+    _rxPool = (espnow_packet_t*)malloc(ESPNOW_RX_POOL_SIZE * sizeof(espnow_packet_t));
+    // one more place than buffers for the NULL that stops the task
+    _txQueue = xQueueCreate(ESPNOW_TX_QUEUE_SIZE + 1, sizeof(tx_packet_t*));
+    _txFree = xQueueCreate(ESPNOW_TX_QUEUE_SIZE, sizeof(tx_packet_t*));
+    _rxQueue = xQueueCreate(ESPNOW_RX_POOL_SIZE + 1, sizeof(espnow_packet_t*));
+    _rxFree = xQueueCreate(ESPNOW_RX_POOL_SIZE, sizeof(espnow_packet_t*));
+    if(!_txPool || !_rxPool || !_txQueue || !_txFree || !_rxQueue || !_rxFree) {
+        log_e("no memory for the queues");
+        _started = true;
+        end();
+        return false;
+    }
+    for(int i = 0; i < ESPNOW_TX_QUEUE_SIZE; i++) {
+        tx_packet_t* packet = &_txPool[i];
+        xQueueSend(_txFree, &packet, 0);
+    }
+    for(int i = 0; i < ESPNOW_RX_POOL_SIZE; i++) {
+        espnow_packet_t* packet = &_rxPool[i];
+        xQueueSend(_rxFree, &packet, 0);
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    _started = true;
+
+    if(xTaskCreateUniversal(_txTaskFn, "espnow_tx", ESPNOW_TASK_STACK_SIZE, this, ESPNOW_TASK_PRIORITY, &_txTask, ESPNOW_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("send task could not be started");
+        _txTask = NULL;
+        end();
+        return false;
+    }
+    if(_onReceive) {
+        onReceive(_onReceive);
+    }
+    esp_now_register_send_cb(_sendCb);
+    esp_now_register_recv_cb(_recvCb);
+    return true;
+}
+
+void ESPNowClass::_stopTask(TaskHandle_t& task, QueueHandle_t queue)
+{
+    if(!task) {
+        return;
+    }
+    void* stop = NULL;
+    xQueueSend(queue, &stop, portMAX_DELAY);
+    while(task) {
+        delay(1);
+    }
+}
+
+/**
+ * Stop ESP-NOW, packets still queued are not sent
+ */
+void ESPNowClass::end()
+{
+    if(!_started) {
+        return;
+    }
+    esp_now_unregister_recv_cb();
+    esp_now_unregister_send_cb();
+    _started = false;
+    // what the send task still has queued goes back to the pool unsent
+    if(_txQueue && _txFree) {
+        tx_packet_t* packet;
+        while(xQueueReceive(_txQueue, &packet, 0) == pdTRUE) {
+            xQueueSend(_txFree, &packet, 0);
+        }
+    }
+    _stopTask(_txTask, _txQueue);
+    _stopTask(_rxTask, _rxQueue);
+    esp_now_deinit();
+
+    if(_txQueue) {
+        vQueueDelete(_txQueue);
+    }
+    if(_txFree) {
+        vQueueDelete(_txFree);
+    }
+    if(_rxQueue) {
+        vQueueDelete(_rxQueue);
+    }
+    if(_rxFree) {
+        vQueueDelete(_rxFree);
+    }
+    _txQueue = _txFree = _rxQueue = _rxFree = NULL;
+    free(_txPool);
+    free(_rxPool);
+    _txPool = NULL;
+    _rxPool = NULL;
+}
+
+bool ESPNowClass::addPeer(const uint8_t* mac, uint8_t channel, const uint8_t* lmk, wifi_interface_t ifidx)
+{
+    if(!_started || !mac) {
+        return false;
+    }
+    esp_now_peer_info_t peer;
+    memset(&peer, 0, sizeof(peer));
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    peer.channel = channel;
+    peer.ifidx = ifidx;
+    if(lmk) {
+        memcpy(peer.lmk, lmk, ESP_NOW_KEY_LEN);
+        peer.encrypt = true;
+    }
+    esp_err_t err = esp_now_is_peer_exist(mac) ? esp_now_mod_peer(&peer) : esp_now_add_peer(&peer);
+    if(err != ESP_OK) {
+        log_e("peer " MACSTR " could not be added: %d", MAC2STR(mac), err);
+        return false;
+    }
+    return true;
+}
+
+bool ESPNowClass::removePeer(const uint8_t* mac)
+{
+    return _started && mac && esp_now_del_peer(mac) == ESP_OK;
+}
+
+bool ESPNowClass::hasPeer(const uint8_t* mac)
+{
+    return _started && mac && esp_now_is_peer_exist(mac);
+}
+
+size_t ESPNowClass::peerCount()
+{
+    esp_now_peer_num_t num;
+    if(!_started || esp_now_get_peer_num(&num) != ESP_OK) {
+        return 0;
+    }
+    return num.total_num;
+}
+
+/**
+ * Queue a packet for the send task
+ * @param mac        peer, FF:FF:FF:FF:FF:FF to broadcast, NULL for each peer in turn
+ * @param data       up to ESP_NOW_MAX_DATA_LEN bytes, copied
+ * @param timeout_ms how long to wait for room in the queue
+ * @return false when the queue stayed full
+ */
+bool ESPNowClass::send(const uint8_t* mac, const uint8_t* data, size_t length, uint32_t timeout_ms)
+{
+    if(!_started) {
+        log_e("not started");
+        return false;
+    }
+    if(!length || length > ESP_NOW_MAX_DATA_LEN) {
+        log_e("%u bytes do not fit a packet", length);
+        return false;
+    }
+    if(mac && !memcmp(mac, _broadcast, ESP_NOW_ETH_ALEN) && !esp_now_is_peer_exist(_broadcast) && !addPeer(_broadcast)) {
+        return false;
+    }
+    tx_packet_t* packet;
+    if(xQueueReceive(_txFree, &packet, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        _stats.queueFull++;
+        return false;
+    }
+    packet->fanout = mac == NULL;
+    if(mac) {
+        memcpy(packet->mac, mac, ESP_NOW_ETH_ALEN);
+    }
+    packet->length = length;
+    packet->queued = millis();
+    memcpy(packet->data, data, length);
+    xQueueSend(_txQueue, &packet, portMAX_DELAY);
+    _stats.queued++;
+    return true;
+}
+
+/**
+ * Packets queued and not yet sent
+ */
+size_t ESPNowClass::pending()
+{
+    return _started ? ESPNOW_TX_QUEUE_SIZE - uxQueueMessagesWaiting(_txFree) : 0;
+}
+
+void ESPNowClass::_sendCb(const uint8_t* mac, esp_now_send_status_t status)
+{
+    if(ESPNow._txTask) {
+        xTaskNotify(ESPNow._txTask, status == ESP_NOW_SEND_SUCCESS ? 1 : 2, eSetValueWithOverwrite);
+    }
+}
+
+bool ESPNowClass::_sendOne(const uint8_t* mac, const tx_packet_t* packet)
+{
+    bool unicast = memcmp(mac, _broadcast, ESP_NOW_ETH_ALEN) != 0;
+    for(int attempt = 0; attempt <= ESPNOW_SEND_RETRIES; attempt++) {
+        if(attempt) {
+            _stats.retries++;
+        }
+        xTaskNotifyWait(0, ULONG_MAX, NULL, 0);
+        esp_err_t err = esp_now_send(mac, packet->data, packet->length);
+        if(err == ESP_ERR_ESPNOW_NO_MEM) {
+            delay(1);
+            continue;
+        }
+        if(err != ESP_OK) {
+            log_e("send to " MACSTR " failed: %d", MAC2STR(mac), err);
+            break;
+        }
+        uint32_t result = 0;
+        if(xTaskNotifyWait(0, ULONG_MAX, &result, pdMS_TO_TICKS(ESPNOW_SEND_TIMEOUT)) != pdTRUE) {
+            log_w("no send callback for " MACSTR, MAC2STR(mac));
+            continue;
+        }
+        if(result == 1) {
+            uint32_t latency = millis() - packet->queued;
+            if(latency > _stats.maxLatencyMs) {
+                _stats.maxLatencyMs = latency;
+            }
+            _stats.sent++;
+            return true;
+        }
+        // a broadcast is not acknowledged, trying it again would not tell more
+        if(!unicast) {
+            break;
+        }
+    }
+    _stats.failed++;
+    return false;
+}
+
+void ESPNowClass::_txTaskFn(void* arg)
+{
+    ESPNowClass* self = (ESPNowClass*)arg;
+    tx_packet_t* packet;
+    while(xQueueReceive(self->_txQueue, &packet, portMAX_DELAY) == pdTRUE && packet) {
+        if(packet->fanout) {
+            esp_now_peer_info_t peer;
+            bool first = true;
+            while(esp_now_fetch_peer(first, &peer) == ESP_OK) {
+                first = false;
+                if(!memcmp(peer.peer_addr, _broadcast, ESP_NOW_ETH_ALEN)) {
+                    continue;
+                }
+                bool ok = self->_sendOne(peer.peer_addr, packet);
+                if(self->_onSent) {
+                    self->_onSent(peer.peer_addr, ok);
+                }
+            }
+        } else {
+            bool ok = self->_sendOne(packet->mac, packet);
+            if(self->_onSent) {
+                self->_onSent(packet->mac, ok);
+            }
+        }
+        xQueueSend(self->_txFree, &packet, 0);
+    }
+    self->_txTask = NULL;
+    vTaskDelete(NULL);
+}
+
+// runs in the WiFi task, takes a buffer from the pool without waiting
+void ESPNowClass::_recvCb(const uint8_t* mac, const uint8_t* data, int length)
+{
+    ESPNowClass* self = &ESPNow;
+    espnow_packet_t* packet;
+    if(!self->_started || length <= 0 || length > ESP_NOW_MAX_DATA_LEN || xQueueReceive(self->_rxFree, &packet, 0) != pdTRUE) {
+        self->_stats.rxDropped++;
+        return;
+    }
+    memcpy(packet->mac, mac, ESP_NOW_ETH_ALEN);
+    packet->length = length;
+    packet->timestamp = millis();
+    memcpy(packet->data, data, length);
+    xQueueSend(self->_rxQueue, &packet, 0);
+    self->_stats.received++;
+    loopSignalEvent();
+}
+
+void ESPNowClass::_rxTaskFn(void* arg)
+{
+    ESPNowClass* self = (ESPNowClass*)arg;
+    espnow_packet_t* packet;
+    while(xQueueReceive(self->_rxQueue, &packet, portMAX_DELAY) == pdTRUE && packet) {
+        if(self->_onReceive) {
+            self->_onReceive(*packet);
+        }
+        xQueueSend(self->_rxFree, &packet, 0);
+    }
+    self->_rxTask = NULL;
+    vTaskDelete(NULL);
+}
+
+/**
+ * Set the function received packets are handed to, on a task of its own
+ * Without one they wait in the pool for read().
+ */
+void ESPNowClass::onReceive(ESPNowRecvCb cb)
+{
+    _onReceive = cb;
+    if(!_started || !cb || _rxTask) {
+        return;
+    }
+    if(xTaskCreateUniversal(_rxTaskFn, "espnow_rx", ESPNOW_TASK_STACK_SIZE, this, ESPNOW_TASK_PRIORITY, &_rxTask, ESPNOW_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("receive task could not be started");
+        _rxTask = NULL;
+    }
+}
+
+int ESPNowClass::available()
+{
+    return (_started && !_rxTask) ? uxQueueMessagesWaiting(_rxQueue) : 0;
+}
+
+/**
+ * Take the oldest received packet, when there is no onReceive() callback
+ */
+bool ESPNowClass::read(espnow_packet_t* packet, uint32_t timeout_ms)
+{
+    if(!_started || _rxTask || !packet) {
+        return false;
+    }
+    espnow_packet_t* received;
+    if(xQueueReceive(_rxQueue, &received, pdMS_TO_TICKS(timeout_ms)) != pdTRUE || !received) {
+        return false;
+    }
+    memcpy(packet, received, offsetof(espnow_packet_t, data) + received->length);
+    xQueueSend(_rxFree, &received, 0);
+    return true;
+}
+
+void ESPNowClass::getStats(espnow_stats_t* stats)
+{
+    if(stats) {
+        *stats = _stats;
+    }
+}
+
+ESPNowClass ESPNow;
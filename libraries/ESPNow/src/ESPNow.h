@@ -0,0 +1,144 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ESPNOW_H_
+#define _ESPNOW_H_
+
+#include <functional>
+#include "Arduino.h"
+#include "esp_now.h"
+
+#ifndef ESPNOW_TX_QUEUE_SIZE
+#define ESPNOW_TX_QUEUE_SIZE 16 // packets send() may queue ahead of the radio
+#endif
+
+#ifndef ESPNOW_RX_POOL_SIZE
+#define ESPNOW_RX_POOL_SIZE 16 // received packets waiting to be read, more are dropped
+#endif
+
+#ifndef ESPNOW_SEND_TIMEOUT
+#define ESPNOW_SEND_TIMEOUT 100 // ms to wait for the send callback of one packet
+#endif
+
+#ifndef ESPNOW_SEND_RETRIES
+#define ESPNOW_SEND_RETRIES 2 // extra tries of a unicast packet the peer did not acknowledge
+#endif
+
+#ifndef ESPNOW_TASK_STACK_SIZE
+#define ESPNOW_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef ESPNOW_TASK_PRIORITY
+#define ESPNOW_TASK_PRIORITY 3
+#endif
+
+#ifndef ESPNOW_TASK_RUNNING_CORE
+#define ESPNOW_TASK_RUNNING_CORE -1
+#endif
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t length;
+    uint32_t timestamp;     // millis() when it came in
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} espnow_packet_t;
+
+typedef struct {
+    uint32_t queued;        // packets send() took
+    uint32_t sent;          // acknowledged by the peer, or broadcast
+    uint32_t failed;        // not acknowledged after the retries
+    uint32_t retries;
+    uint32_t queueFull;     // send() calls refused
+    uint32_t received;
+    uint32_t rxDropped;     // no free buffer in the pool
+    uint32_t maxLatencyMs;  // queued to acknowledged, the longest
+} espnow_stats_t;
+
+typedef std::function<void(const espnow_packet_t& packet)> ESPNowRecvCb;
+typedef std::function<void(const uint8_t* mac, bool success)> ESPNowSentCb;
+
+/*
+ * ESP-NOW with a send queue and a pool of receive buffers:
+ *
+ *   ESPNow.begin();
+ *   ESPNow.addPeer(peerMac);
+ *   ESPNow.onReceive([](const espnow_packet_t& packet) { ... });
+ *   ESPNow.send(peerMac, data, length);   // queued, returns at once
+ *   ESPNow.send(NULL, data, length);      // to every peer, one after the other
+ *
+ * A task sends the queued packets one at a time and waits for the send callback
+ * of each before the next goes out, so the driver never runs out of room and
+ * drops them; a unicast packet that was not acknowledged is tried again. The
+ * receive callback of the driver only copies the packet into a buffer from the
+ * pool, onReceive() is called from a task, or read() takes them when there is
+ * no callback.
+ */
+class ESPNowClass
+{
+public:
+    ESPNowClass();
+    ~ESPNowClass();
+
+    bool begin(uint8_t channel = 0);
+    void end();
+
+    bool addPeer(const uint8_t* mac, uint8_t channel = 0, const uint8_t* lmk = NULL, wifi_interface_t ifidx = WIFI_IF_STA);
+    bool removePeer(const uint8_t* mac);
+    bool hasPeer(const uint8_t* mac);
+    size_t peerCount();
+
+    // NULL mac sends to each peer, FF:FF:FF:FF:FF:FF is a broadcast
+    bool send(const uint8_t* mac, const uint8_t* data, size_t length, uint32_t timeout_ms = 0);
+    size_t pending();
+
+    void onReceive(ESPNowRecvCb cb);
+    void onSent(ESPNowSentCb cb) { _onSent = cb; }
+    int available();
+    bool read(espnow_packet_t* packet, uint32_t timeout_ms = 0);
+
+    void getStats(espnow_stats_t* stats);
+
+private:
+    typedef struct {
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        bool fanout;
+        uint8_t length;
+        uint32_t queued;
+        uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    } tx_packet_t;
+
+    bool _started;
+    TaskHandle_t _txTask;
+    TaskHandle_t _rxTask;
+    QueueHandle_t _txQueue;   // tx_packet_t* to send, NULL stops the task
+    QueueHandle_t _txFree;
+    QueueHandle_t _rxQueue;   // espnow_packet_t* received, NULL stops the task
+    QueueHandle_t _rxFree;
+    tx_packet_t* _txPool;
+    espnow_packet_t* _rxPool;
+    ESPNowRecvCb _onReceive;
+    ESPNowSentCb _onSent;
+    espnow_stats_t _stats;
+
+    static void _sendCb(const uint8_t* mac, esp_now_send_status_t status);
+    static void _recvCb(const uint8_t* mac, const uint8_t* data, int length);
+    static void _txTaskFn(void* arg);
+    static void _rxTaskFn(void* arg);
+    bool _sendOne(const uint8_t* mac, const tx_packet_t* packet);
+    void _stopTask(TaskHandle_t& task, QueueHandle_t queue);
+};
+
+extern ESPNowClass ESPNow;
+
+#endif /* _ESPNOW_H_ */
@@ -38,7 +38,7 @@ static void _on_sys_event(system_event_t *event){
     mdns_handle_system_event(NULL, event);
 }
 
-MDNSResponder::MDNSResponder() :results(NULL) {}
+MDNSResponder::MDNSResponder() :results(NULL), _lock(NULL), _browseTask(NULL), _browsing(false), _browseUntil(0) {}
 MDNSResponder::~MDNSResponder() {
     end();
 }
@@ -49,6 +49,9 @@ bool MDNSResponder::begin(const char* hostName){
         return false;
     }
     WiFi.onEvent(_on_sys_event);
+    if(!_lock){
+        _lock = xSemaphoreCreateMutex();
+    }
     _hostname = hostName;
 	_hostname.toLowerCase();
     if(mdns_hostname_set(hostName)) {
@@ -59,6 +62,11 @@ bool MDNSResponder::begin(const char* hostName){
 }
 
 void MDNSResponder::end() {
+    stopBrowse();
+    // the browse task finishes the query it is in, at most MDNS_BROWSE_ROUND
+    while(_browseTask){
+        delay(10);
+    }
     mdns_free();
 }
 
@@ -183,20 +191,11 @@ int MDNSResponder::queryService(char *service, char *proto) {
         results = NULL;
     }
 
-    char srv[strlen(service)+2];
-    char prt[strlen(proto)+2];
-	if (service[0] == '_') {
-		sprintf(srv, "%s", service);
-	} else {
-		sprintf(srv, "_%s", service);
-	}
-	if (proto[0] == '_') {
-		sprintf(prt, "%s", proto);
-	} else {
-		sprintf(prt, "_%s", proto);
-	}
+    String srv = _serviceName(service);
+    String prt = _serviceName(proto);
 
-    esp_err_t err = mdns_query_ptr(srv, prt, 3000, 20,  &results);
+    _index.clear();
+    esp_err_t err = mdns_query_ptr(srv.c_str(), prt.c_str(), 3000, 20,  &results);
     if(err){
         log_e("Query Failed");
         return 0;
@@ -206,26 +205,196 @@ int MDNSResponder::queryService(char *service, char *proto) {
         return 0;
     }
 
+    MDNSService entry;
     mdns_result_t * r = results;
-    int i = 0;
     while(r){
-        i++;
+        _index.push_back(r);
+        _cacheResult(r, srv, prt, entry);
         r = r->next;
     }
-    return i;
+    return _index.size();
+}
+
+String MDNSResponder::_serviceName(const char * name){
+    if(name[0] == '_'){
+        return String(name);
+    }
+    return String("_") + name;
 }
 
 mdns_result_t * MDNSResponder::_getResult(int idx){
-    mdns_result_t * result = results;
-    int i = 0;
-    while(result){
-        if(i == idx){
+    if(idx < 0 || idx >= (int)_index.size()){
+        return NULL;
+    }
+    return _index[idx];
+}
+
+/*
+ * The IDF responder keeps no cache of its own and its results carry no TTL, so
+ * a service counts as alive for MDNS_CACHE_TTL after the last answer naming it.
+ * Returns true when the service is new or its host, address or port changed.
+ */
+bool MDNSResponder::_cacheResult(mdns_result_t * result, const String &service, const String &proto, MDNSService &entry){
+    entry.instance = result->instance_name ? result->instance_name : "";
+    entry.hostname = result->hostname ? result->hostname : "";
+    entry.service = service;
+    entry.proto = proto;
+    entry.ip = IPAddress();
+    entry.ipv6 = IPv6Address();
+    entry.port = result->port;
+    entry.lastSeen = millis();
+    entry.txt.clear();
+    for(size_t i = 0; i < result->txt_count; i++){
+        entry.txt.push_back(std::make_pair(String(result->txt[i].key), String(result->txt[i].value ? result->txt[i].value : "")));
+    }
+    for(mdns_ip_addr_t * addr = result->addr; addr; addr = addr->next){
+        if(addr->addr.type == MDNS_IP_PROTOCOL_V4 && !(uint32_t)entry.ip){
+            entry.ip = IPAddress(addr->addr.u_addr.ip4.addr);
+        } else if(addr->addr.type == MDNS_IP_PROTOCOL_V6){
+            entry.ipv6 = IPv6Address(addr->addr.u_addr.ip6.addr);
+        }
+    }
+    if(!_lock){
+        return true;
+    }
+
+    bool changed = true;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for(auto &cached : _cache){
+        if(cached.instance == entry.instance && cached.service == service && cached.proto == proto){
+            changed = cached.hostname != entry.hostname || cached.ip != entry.ip || cached.port != entry.port;
+            cached = entry;
+            xSemaphoreGive(_lock);
+            return changed;
+        }
+    }
+    if(_cache.size() < MDNS_CACHE_SIZE){
+        _cache.push_back(entry);
+    }
+    xSemaphoreGive(_lock);
+    return changed;
+}
+
+void MDNSResponder::_expireCache(std::vector<MDNSService> &expired){
+    if(!_lock){
+        return;
+    }
+    uint32_t now = millis();
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for(auto it = _cache.begin(); it != _cache.end();){
+        if(now - it->lastSeen >= MDNS_CACHE_TTL * 1000UL){
+            expired.push_back(*it);
+            it = _cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    xSemaphoreGive(_lock);
+}
+
+int MDNSResponder::numCached(){
+    std::vector<MDNSService> expired;
+    _expireCache(expired);
+    return _cache.size();
+}
+
+bool MDNSResponder::cached(int idx, MDNSService &service){
+    if(!_lock){
+        return false;
+    }
+    bool found = false;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if(idx >= 0 && idx < (int)_cache.size()){
+        service = _cache[idx];
+        found = true;
+    }
+    xSemaphoreGive(_lock);
+    return found;
+}
+
+void MDNSResponder::clearCache(){
+    if(!_lock){
+        return;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _cache.clear();
+    xSemaphoreGive(_lock);
+}
+
+bool MDNSResponder::browseService(const char *service, const char *proto, MDNSBrowseCb cb, uint32_t duration){
+    if(!service || !service[0] || !proto || !proto[0] || !cb){
+        log_e("Bad Parameters");
+        return false;
+    }
+    if(!_lock){
+        log_e("MDNS is not running");
+        return false;
+    }
+    if(_browseTask){
+        log_e("Already browsing");
+        return false;
+    }
+    _browseService = _serviceName(service);
+    _browseProto = _serviceName(proto);
+    _browseCb = cb;
+    _browseUntil = duration ? millis() + duration : 0;
+    _browsing = true;
+    if(xTaskCreateUniversal(_browseTaskFn, "mdns_browse", 4096, this, 1, &_browseTask, CONFIG_ARDUINO_RUNNING_CORE) != pdPASS){
+        log_e("Browse Task Start Failed!");
+        _browsing = false;
+        _browseTask = NULL;
+        return false;
+    }
+    return true;
+}
+
+void MDNSResponder::stopBrowse(){
+    _browsing = false;
+}
+
+bool MDNSResponder::browsing(){
+    return _browseTask != NULL;
+}
+
+void MDNSResponder::_browseTaskFn(void * arg){
+    MDNSResponder * self = (MDNSResponder *)arg;
+    self->_browse();
+    self->_browseTask = NULL;
+    vTaskDelete(NULL);
+}
+
+/*
+ * Each round is one PTR query collecting answers for MDNS_BROWSE_ROUND ms, so the
+ * callback hears about a device within a round of its answer instead of after the
+ * whole query, and devices that went quiet are reported once their entry expires.
+ */
+void MDNSResponder::_browse(){
+    MDNSService entry;
+    std::vector<MDNSService> expired;
+    while(_browsing && (!_browseUntil || (int32_t)(_browseUntil - millis()) > 0)){
+        mdns_result_t * found = NULL;
+        esp_err_t err = mdns_query_ptr(_browseService.c_str(), _browseProto.c_str(), MDNS_BROWSE_ROUND, MDNS_CACHE_SIZE, &found);
+        if(err){
+            log_e("Query Failed");
             break;
         }
-        i++;
-        result = result->next;
+        for(mdns_result_t * r = found; r && _browsing; r = r->next){
+            if(_cacheResult(r, _browseService, _browseProto, entry)){
+                _browseCb(entry, true);
+            }
+        }
+        if(found){
+            mdns_query_results_free(found);
+        }
+        expired.clear();
+        _expireCache(expired);
+        for(auto &service : expired){
+            if(service.service == _browseService && service.proto == _browseProto){
+                _browseCb(service, false);
+            }
+        }
     }
-    return result;
+    _browsing = false;
 }
 
 String MDNSResponder::hostname(int idx) {
@@ -18,12 +18,42 @@
 #include "Arduino.h"
 #include "IPv6Address.h"
 #include "mdns.h"
+#include <functional>
+#include <vector>
 
 //this should be defined at build time
 #ifndef ARDUINO_VARIANT
 #define ARDUINO_VARIANT "esp32"
 #endif
 
+#ifndef MDNS_CACHE_TTL
+#define MDNS_CACHE_TTL 120 // seconds a service stays cached after its last answer, the TTL of SRV records
+#endif
+
+#ifndef MDNS_CACHE_SIZE
+#define MDNS_CACHE_SIZE 32 // services kept, answers for more are passed on but not cached
+#endif
+
+#ifndef MDNS_BROWSE_ROUND
+#define MDNS_BROWSE_ROUND 1000 // ms each browse query collects answers before they are reported
+#endif
+
+// a service found by queryService() or browseService()
+struct MDNSService {
+  String instance;
+  String hostname;
+  String service;
+  String proto;
+  IPAddress ip;
+  IPv6Address ipv6;
+  uint16_t port;
+  std::vector<std::pair<String, String>> txt;
+  uint32_t lastSeen;   // millis() of the last answer
+};
+
+// found is false when a service has not answered for MDNS_CACHE_TTL and left the cache
+typedef std::function<void(const MDNSService &service, bool found)> MDNSBrowseCb;
+
 class MDNSResponder {
 public:
   MDNSResponder();
@@ -77,6 +107,20 @@ public:
     return queryService(service.c_str(), proto.c_str());
   }
 
+  // queries in the background until duration ms have passed (0 until stopBrowse()),
+  // cb runs on the browse task for every new or changed service and for expired ones
+  bool browseService(const char *service, const char *proto, MDNSBrowseCb cb, uint32_t duration=10000);
+  bool browseService(String service, String proto, MDNSBrowseCb cb, uint32_t duration=10000){
+    return browseService(service.c_str(), proto.c_str(), cb, duration);
+  }
+  void stopBrowse();
+  bool browsing();
+
+  // services seen by queries and browsing, until MDNS_CACHE_TTL after their last answer
+  int numCached();
+  bool cached(int idx, MDNSService &service);
+  void clearCache();
+
   String hostname(int idx);
   IPAddress IP(int idx);
   IPv6Address IPv6(int idx);
@@ -89,7 +133,22 @@ public:
 private:
   String _hostname;
   mdns_result_t * results;
+  std::vector<mdns_result_t *> _index;
+  std::vector<MDNSService> _cache;
+  SemaphoreHandle_t _lock;
+  TaskHandle_t _browseTask;
+  volatile bool _browsing;
+  String _browseService;
+  String _browseProto;
+  MDNSBrowseCb _browseCb;
+  uint32_t _browseUntil;
+
   mdns_result_t * _getResult(int idx);
+  static String _serviceName(const char * name);
+  static void _browseTaskFn(void * arg);
+  void _browse();
+  bool _cacheResult(mdns_result_t * result, const String &service, const String &proto, MDNSService &entry);
+  void _expireCache(std::vector<MDNSService> &expired);
 };
 
 extern MDNSResponder MDNS;
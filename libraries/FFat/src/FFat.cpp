@@ -23,6 +23,213 @@ extern "C" {
 
 using namespace fs;
 
+/*
+ * Sector cache
+ * Replaces the wear levelling diskio of the drive while it is mounted.
+ * Single sector reads and writes, which are the FAT and directory updates,
+ * go through it; longer runs go to the partition and refresh what is cached.
+ * FatFs serializes the calls of a drive, so the cache has no lock of its own.
+ */
+typedef struct {
+    wl_handle_t wl;
+    size_t sectorSize;
+    uint16_t count;
+    uint32_t tick;
+    uint32_t * sectors;     // cached sector, UINT32_MAX for a free slot
+    uint32_t * used;        // tick of the last access
+    uint8_t * dirty;
+    uint8_t * data;
+} ffat_cache_t;
+
+static ffat_cache_t * s_ffat_cache[FF_VOLUMES] = { NULL };
+
+static bool ffatWrite(ffat_cache_t * cache, DWORD sector, const BYTE * buff, UINT count)
+{
+    size_t addr = sector * cache->sectorSize;
+    size_t len = count * cache->sectorSize;
+    return wl_erase_range(cache->wl, addr, len) == ESP_OK && wl_write(cache->wl, addr, buff, len) == ESP_OK;
+}
+
+static int ffatCacheFind(ffat_cache_t * cache, DWORD sector)
+{
+    for(int i = 0; i < cache->count; i++) {
+        if(cache->sectors[i] == sector) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool ffatCacheWriteBack(ffat_cache_t * cache, int i)
+{
+    if(!cache->dirty[i]) {
+        return true;
+    }
+    if(!ffatWrite(cache, cache->sectors[i], cache->data + i * cache->sectorSize, 1)) {
+        log_e("write back of sector %u failed", cache->sectors[i]);
+        return false;
+    }
+    cache->dirty[i] = 0;
+    return true;
+}
+
+static bool ffatCacheFlush(ffat_cache_t * cache)
+{
+    bool ok = true;
+    for(int i = 0; i < cache->count; i++) {
+        ok = ffatCacheWriteBack(cache, i) && ok;
+    }
+    return ok;
+}
+
+// a free slot, or the least recently used one written back; -1 if that fails
+static int ffatCacheSlot(ffat_cache_t * cache, DWORD sector)
+{
+    int slot = 0;
+    for(int i = 0; i < cache->count; i++) {
+        if(cache->sectors[i] == UINT32_MAX) {
+            slot = i;
+            break;
+        }
+        if(cache->used[i] < cache->used[slot]) {
+            slot = i;
+        }
+    }
+    if(!ffatCacheWriteBack(cache, slot)) {
+        return -1;
+    }
+    cache->sectors[slot] = sector;
+    return slot;
+}
+
+static DSTATUS ffatCacheInit(BYTE pdrv)
+{
+    return 0;
+}
+
+static DSTATUS ffatCacheStatus(BYTE pdrv)
+{
+    return 0;
+}
+
+static DRESULT ffatCacheRead(BYTE pdrv, BYTE * buff, DWORD sector, UINT count)
+{
+    ffat_cache_t * cache = s_ffat_cache[pdrv];
+    int i = ffatCacheFind(cache, sector);
+    if(count == 1 && i >= 0) {
+        cache->used[i] = ++cache->tick;
+        memcpy(buff, cache->data + i * cache->sectorSize, cache->sectorSize);
+        return RES_OK;
+    }
+    if(wl_read(cache->wl, sector * cache->sectorSize, buff, count * cache->sectorSize) != ESP_OK) {
+        return RES_ERROR;
+    }
+    if(count == 1) {
+        i = ffatCacheSlot(cache, sector);
+        if(i >= 0) {
+            cache->used[i] = ++cache->tick;
+            memcpy(cache->data + i * cache->sectorSize, buff, cache->sectorSize);
+        }
+        return RES_OK;
+    }
+    // what is still waiting in the cache is newer than the partition
+    for(i = 0; i < cache->count; i++) {
+        if(cache->sectors[i] != UINT32_MAX && cache->sectors[i] >= sector && cache->sectors[i] < sector + count) {
+            memcpy(buff + (cache->sectors[i] - sector) * cache->sectorSize, cache->data + i * cache->sectorSize, cache->sectorSize);
+        }
+    }
+    return RES_OK;
+}
+
+static DRESULT ffatCacheWrite(BYTE pdrv, const BYTE * buff, DWORD sector, UINT count)
+{
+    ffat_cache_t * cache = s_ffat_cache[pdrv];
+    if(count == 1) {
+        int i = ffatCacheFind(cache, sector);
+        if(i < 0) {
+            i = ffatCacheSlot(cache, sector);
+        }
+        if(i < 0) {
+            return ffatWrite(cache, sector, buff, 1) ? RES_OK : RES_ERROR;
+        }
+        cache->used[i] = ++cache->tick;
+        cache->dirty[i] = 1;
+        memcpy(cache->data + i * cache->sectorSize, buff, cache->sectorSize);
+        return RES_OK;
+    }
+    if(!ffatWrite(cache, sector, buff, count)) {
+        return RES_ERROR;
+    }
+    for(int i = 0; i < cache->count; i++) {
+        if(cache->sectors[i] != UINT32_MAX && cache->sectors[i] >= sector && cache->sectors[i] < sector + count) {
+            memcpy(cache->data + i * cache->sectorSize, buff + (cache->sectors[i] - sector) * cache->sectorSize, cache->sectorSize);
+            cache->dirty[i] = 0;
+        }
+    }
+    return RES_OK;
+}
+
+static DRESULT ffatCacheIoctl(BYTE pdrv, BYTE cmd, void * buff)
+{
+    ffat_cache_t * cache = s_ffat_cache[pdrv];
+    switch(cmd) {
+    case CTRL_SYNC:
+        return ffatCacheFlush(cache) ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *((DWORD *)buff) = wl_size(cache->wl) / cache->sectorSize;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *)buff) = cache->sectorSize;
+        return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+static void ffatCacheFree(BYTE pdrv)
+{
+    ffat_cache_t * cache = s_ffat_cache[pdrv];
+    if(!cache) {
+        return;
+    }
+    s_ffat_cache[pdrv] = NULL;
+    free(cache->sectors);
+    free(cache->used);
+    free(cache->dirty);
+    free(cache->data);
+    free(cache);
+}
+
+static bool ffatCacheBegin(BYTE pdrv, wl_handle_t wl, uint16_t sectors)
+{
+    static const ff_diskio_impl_t impl = {
+        .init = &ffatCacheInit,
+        .status = &ffatCacheStatus,
+        .read = &ffatCacheRead,
+        .write = &ffatCacheWrite,
+        .ioctl = &ffatCacheIoctl
+    };
+    ffat_cache_t * cache = (ffat_cache_t *)calloc(1, sizeof(ffat_cache_t));
+    if(!cache) {
+        return false;
+    }
+    s_ffat_cache[pdrv] = cache;
+    cache->wl = wl;
+    cache->sectorSize = wl_sector_size(wl);
+    cache->count = sectors;
+    cache->sectors = (uint32_t *)malloc(sectors * sizeof(uint32_t));
+    cache->used = (uint32_t *)calloc(sectors, sizeof(uint32_t));
+    cache->dirty = (uint8_t *)calloc(sectors, 1);
+    cache->data = (uint8_t *)heap_policy_malloc(HEAP_USER_FS, sectors * cache->sectorSize);
+    if(!cache->sectors || !cache->used || !cache->dirty || !cache->data) {
+        log_e("no memory for a %u sector cache", sectors);
+        ffatCacheFree(pdrv);
+        return false;
+    }
+    memset(cache->sectors, 0xFF, sectors * sizeof(uint32_t));
+    ff_diskio_register(pdrv, &impl);
+    return true;
+}
+
 F_Fat::F_Fat(FSImplPtr impl)
     : FS(impl)
 {}
@@ -38,7 +245,7 @@ const esp_partition_t *check_ffat_partition(const char* label)
     return ck_part;
 }
 
-bool F_Fat::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles, const char * partitionLabel)
+bool F_Fat::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles, const char * partitionLabel, size_t allocationUnit, uint16_t cacheSectors)
 {
     if(_wl_handle != WL_INVALID_HANDLE){
         log_w("Already Mounted!");
@@ -53,7 +260,7 @@ bool F_Fat::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles
     esp_vfs_fat_mount_config_t conf = {
       .format_if_mount_failed = formatOnFail,
       .max_files = maxOpenFiles,
-      .allocation_unit_size = CONFIG_WL_SECTOR_SIZE
+      .allocation_unit_size = allocationUnit ? allocationUnit : CONFIG_WL_SECTOR_SIZE
     };
     esp_err_t err = esp_vfs_fat_spiflash_mount(basePath, partitionLabel, &conf, &_wl_handle);
     if(err){
@@ -62,24 +269,35 @@ bool F_Fat::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles
         _wl_handle = WL_INVALID_HANDLE;
         return false;
     }
+    BYTE pdrv = ff_diskio_get_pdrv_wl(_wl_handle);
+    if(cacheSectors && !ffatCacheBegin(pdrv, _wl_handle, cacheSectors)){
+        log_w("Running without a sector cache");
+    }
     _impl->mountpoint(basePath);
+    _impl->fatDrive(pdrv);
     return true;
 }
 
 void F_Fat::end()
 {
     if(_wl_handle != WL_INVALID_HANDLE){
+        BYTE pdrv = ff_diskio_get_pdrv_wl(_wl_handle);
+        if(s_ffat_cache[pdrv] && !ffatCacheFlush(s_ffat_cache[pdrv])){
+            log_e("Writing the sector cache back failed");
+        }
         esp_err_t err = esp_vfs_fat_spiflash_unmount(_impl->mountpoint(), _wl_handle);
         if(err){
             log_e("Unmounting FFat partition failed! Error: %d", err);
             return;
         }
+        ffatCacheFree(pdrv);
         _wl_handle = WL_INVALID_HANDLE;
         _impl->mountpoint(NULL);
+        _impl->fatDrive(-1);
     }
 }
 
-bool F_Fat::format(bool full_wipe, char* partitionLabel)
+bool F_Fat::format(bool full_wipe, char* partitionLabel, size_t allocationUnit)
 {
     esp_err_t result;
     bool res = true;
@@ -109,7 +327,7 @@ bool F_Fat::format(bool full_wipe, char* partitionLabel)
     esp_vfs_fat_mount_config_t conf = {
       .format_if_mount_failed = true,
       .max_files = 1,
-      .allocation_unit_size = CONFIG_WL_SECTOR_SIZE
+      .allocation_unit_size = allocationUnit ? allocationUnit : CONFIG_WL_SECTOR_SIZE
     };
     result = esp_vfs_fat_spiflash_mount("/format_ffat", partitionLabel, &conf, &temp_handle);
     esp_vfs_fat_spiflash_unmount("/format_ffat", temp_handle);
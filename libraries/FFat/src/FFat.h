@@ -22,6 +22,10 @@
 #define FFAT_WIPE_FULL 1
 #define FFAT_PARTITION_LABEL "ffat"
 
+#ifndef FFAT_CACHE_SECTORS
+#define FFAT_CACHE_SECTORS 0 // 4K sectors FFat.begin() caches by default, 0 for none
+#endif
+
 namespace fs
 {
 
@@ -29,8 +33,12 @@ class F_Fat : public FS
 {
 public:
     F_Fat(FSImplPtr impl);
-    bool begin(bool formatOnFail=false, const char * basePath="/ffat", uint8_t maxOpenFiles=10, const char * partitionLabel = (char*)FFAT_PARTITION_LABEL);
-    bool format(bool full_wipe = FFAT_WIPE_QUICK, char* partitionLabel = (char*)FFAT_PARTITION_LABEL);
+    // allocationUnit is the cluster size a format uses, 0 for one sector.
+    // cacheSectors keeps that many sectors in RAM: FAT and directory sectors are read once
+    // and rewritten only when evicted or on a sync (File::flush(), close(), mkdir, remove, end())
+    bool begin(bool formatOnFail=false, const char * basePath="/ffat", uint8_t maxOpenFiles=10, const char * partitionLabel = (char*)FFAT_PARTITION_LABEL,
+               size_t allocationUnit=0, uint16_t cacheSectors=FFAT_CACHE_SECTORS);
+    bool format(bool full_wipe = FFAT_WIPE_QUICK, char* partitionLabel = (char*)FFAT_PARTITION_LABEL, size_t allocationUnit=0);
     size_t totalBytes();
     size_t usedBytes();
     size_t freeBytes();
@@ -103,6 +103,33 @@ void File::flush()
     _p->flush();
 }
 
+bool File::setBufferSize(size_t size)
+{
+    if (!_p) {
+        return false;
+    }
+
+    return _p->setBufferSize(size);
+}
+
+size_t File::readBytesDirect(uint8_t* buf, size_t size)
+{
+    if (!_p) {
+        return 0;
+    }
+
+    return _p->readDirect(buf, size);
+}
+
+size_t File::writeDirect(const uint8_t *buf, size_t size)
+{
+    if (!_p) {
+        return 0;
+    }
+
+    return _p->writeDirect(buf, size);
+}
+
 bool File::seek(uint32_t pos, SeekMode mode)
 {
     if (!_p) {
@@ -258,6 +285,51 @@ bool FS::rmdir(const String &path)
 }
 
 
+Dir FS::openDir(const char* path)
+{
+    if (!_impl) {
+        return Dir();
+    }
+
+    return Dir(_impl->openDir(path));
+}
+
+Dir FS::openDir(const String& path)
+{
+    return openDir(path.c_str());
+}
+
+bool Dir::next(DirEntry& entry)
+{
+    if (!_p) {
+        return false;
+    }
+
+    return _p->next(entry);
+}
+
+void Dir::rewind()
+{
+    if (!_p) {
+        return;
+    }
+
+    _p->rewind();
+}
+
+void Dir::close()
+{
+    if (_p) {
+        _p->close();
+        _p = nullptr;
+    }
+}
+
+Dir::operator bool() const
+{
+    return !!_p;
+}
+
 void FSImpl::mountpoint(const char * mp)
 {
     _mountpoint = mp;
@@ -37,6 +37,8 @@ class FileImpl;
 typedef std::shared_ptr<FileImpl> FileImplPtr;
 class FSImpl;
 typedef std::shared_ptr<FSImpl> FSImplPtr;
+class DirImpl;
+typedef std::shared_ptr<DirImpl> DirImplPtr;
 
 enum SeekMode {
     SeekSet = 0,
@@ -63,6 +65,21 @@ public:
         return read((uint8_t*)buffer, length);
     }
 
+    /*
+      Sets the stdio buffer of the file, 0 for none. Records smaller than
+      the buffer are gathered into one write to the file system.
+      The buffer is taken through the HEAP_USER_FS heap policy
+    */
+    bool setBufferSize(size_t size);
+
+    /*
+      Read and write past the stdio buffer, straight to the file system,
+      for large transfers that would only be copied through it.
+      Buffered data is flushed first and the position is kept in step
+    */
+    size_t readBytesDirect(uint8_t* buf, size_t size);
+    size_t writeDirect(const uint8_t *buf, size_t size);
+
     bool seek(uint32_t pos, SeekMode mode);
     bool seek(uint32_t pos)
     {
@@ -83,6 +100,33 @@ protected:
     FileImplPtr _p;
 };
 
+struct DirEntry {
+    const char * name;      // within the directory, valid until the next call to next()
+    size_t size;
+    time_t lastWrite;
+    bool isDirectory;
+};
+
+/*
+  Lists a directory without opening its entries:
+  Dir dir = SD.openDir("/logs");
+  DirEntry entry;
+  while (dir.next(entry)) { ... }
+*/
+class Dir
+{
+public:
+    Dir(DirImplPtr p = DirImplPtr()) : _p(p) { }
+
+    bool next(DirEntry& entry);
+    void rewind();
+    void close();
+    operator bool() const;
+
+protected:
+    DirImplPtr _p;
+};
+
 class FS
 {
 public:
@@ -91,6 +135,9 @@ public:
     File open(const char* path, const char* mode = FILE_READ);
     File open(const String& path, const char* mode = FILE_READ);
 
+    Dir openDir(const char* path);
+    Dir openDir(const String& path);
+
     bool exists(const char* path);
     bool exists(const String& path);
 
@@ -116,6 +163,8 @@ protected:
 #ifndef FS_NO_GLOBALS
 using fs::FS;
 using fs::File;
+using fs::Dir;
+using fs::DirEntry;
 using fs::SeekMode;
 using fs::SeekSet;
 using fs::SeekCur;
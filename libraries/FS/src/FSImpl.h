@@ -43,14 +43,28 @@ public:
     virtual FileImplPtr openNextFile(const char* mode) = 0;
     virtual void rewindDirectory(void) = 0;
     virtual operator bool() = 0;
+    virtual bool setBufferSize(size_t size) { return false; }
+    virtual size_t readDirect(uint8_t* buf, size_t size) { return read(buf, size); }
+    virtual size_t writeDirect(const uint8_t *buf, size_t size) { return write(buf, size); }
+};
+
+class DirImpl
+{
+public:
+    virtual ~DirImpl() { }
+    virtual bool next(DirEntry& entry) = 0;
+    virtual void rewind() = 0;
+    virtual void close() = 0;
+    virtual operator bool() = 0;
 };
 
 class FSImpl
 {
 protected:
     const char * _mountpoint;
+    int _fatDrive;
 public:
-    FSImpl() : _mountpoint(NULL) { }
+    FSImpl() : _mountpoint(NULL), _fatDrive(-1) { }
     virtual ~FSImpl() { }
     virtual FileImplPtr open(const char* path, const char* mode) = 0;
     virtual bool exists(const char* path) = 0;
@@ -58,8 +72,12 @@ public:
     virtual bool remove(const char* path) = 0;
     virtual bool mkdir(const char *path) = 0;
     virtual bool rmdir(const char *path) = 0;
+    virtual DirImplPtr openDir(const char* path) { return DirImplPtr(); }
     void mountpoint(const char *);
     const char * mountpoint();
+    // FatFs drive behind the mount point, -1 for none; lets openDir() read FAT entries whole
+    void fatDrive(int pdrv) { _fatDrive = pdrv; }
+    int fatDrive() { return _fatDrive; }
 };
 
 } // namespace fs
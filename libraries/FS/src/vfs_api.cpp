@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "vfs_api.h"
+#include "ff.h"
 
 using namespace fs;
 
@@ -28,42 +29,33 @@ FileImplPtr VFSImpl::open(const char* path, const char* mode)
         return FileImplPtr();
     }
 
-    char * temp = (char *)malloc(strlen(path)+strlen(_mountpoint)+2);
-    if(!temp) {
-        log_e("malloc failed");
+    //the file opens itself, a directory if it is none
+    std::shared_ptr<VFSFileImpl> file = std::make_shared<VFSFileImpl>(this, path, mode);
+    if(!*file) {
+        log_e("%s%s does not exist", _mountpoint, path);
         return FileImplPtr();
     }
+    return file;
+}
 
-    sprintf(temp,"%s%s", _mountpoint, path);
-
-    struct stat st;
-    //file lound
-    if(!stat(temp, &st)) {
-        free(temp);
-        if (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) {
-            return std::make_shared<VFSFileImpl>(this, path, mode);
-        }
-        log_e("%s has wrong mode 0x%08X", path, st.st_mode);
-        return FileImplPtr();
+DirImplPtr VFSImpl::openDir(const char* path)
+{
+    if(!_mountpoint) {
+        log_e("File system is not mounted");
+        return DirImplPtr();
     }
 
-    //file not found but mode permits creation
-    if(mode && mode[0] != 'r') {
-        free(temp);
-        return std::make_shared<VFSFileImpl>(this, path, mode);
+    if(!path || path[0] != '/') {
+        log_e("%s does not start with /", path);
+        return DirImplPtr();
     }
 
-    //try to open this as directory (might be mount point)
-    DIR * d = opendir(temp);
-    if(d) {
-        closedir(d);
-        free(temp);
-        return std::make_shared<VFSFileImpl>(this, path, mode);
+    std::shared_ptr<VFSDirImpl> dir = std::make_shared<VFSDirImpl>(this, path);
+    if(!*dir) {
+        log_e("%s%s is no directory", _mountpoint, path);
+        return DirImplPtr();
     }
-
-    log_e("%s does not exist", temp);
-    free(temp);
-    return FileImplPtr();
+    return dir;
 }
 
 bool VFSImpl::exists(const char* path)
@@ -220,6 +212,10 @@ VFSFileImpl::VFSFileImpl(VFSImpl* fs, const char* path, const char* mode)
     , _path(NULL)
     , _isDirectory(false)
     , _written(false)
+    , _statValid(false)
+    , _fsSize(-1)
+    , _end(0)
+    , _buffer(NULL)
 {
     char * temp = (char *)malloc(strlen(path)+strlen(_fs->_mountpoint)+1);
     if(!temp) {
@@ -234,41 +230,16 @@ VFSFileImpl::VFSFileImpl(VFSImpl* fs, const char* path, const char* mode)
         return;
     }
 
-    if(!stat(temp, &_stat)) {
-        //file found
-        if (S_ISREG(_stat.st_mode)) {
-            _isDirectory = false;
-            _f = fopen(temp, mode);
-            if(!_f) {
-                log_e("fopen(%s) failed", temp);
-            }
-        } else if(S_ISDIR(_stat.st_mode)) {
+    //opened straight away: a directory only when that fails,
+    //stat() after the path lookup of fopen() would walk it again
+    bool create = mode && mode[0] != 'r';
+    _f = fopen(temp, mode ? mode : "r");
+    if(!_f) {
+        _d = opendir(temp);
+        if(_d) {
             _isDirectory = true;
-            _d = opendir(temp);
-            if(!_d) {
-                log_e("opendir(%s) failed", temp);
-            }
-        } else {
-            log_e("Unknown type 0x%08X for file %s", ((_stat.st_mode)&_IFMT), temp);
-        }
-    } else {
-        //file not found
-        if(!mode || mode[0] == 'r') {
-            //try to open as directory
-            _d = opendir(temp);
-            if(_d) {
-                _isDirectory = true;
-            } else {
-                _isDirectory = false;
-                //log_w("stat(%s) failed", temp);
-            }
-        } else {
-            //lets create this new file
-            _isDirectory = false;
-            _f = fopen(temp, mode);
-            if(!_f) {
-                log_e("fopen(%s) failed", temp);
-            }
+        } else if(create) {
+            log_e("fopen(%s) failed", temp);
         }
     }
     free(temp);
@@ -293,6 +264,8 @@ void VFSFileImpl::close()
         fclose(_f);
         _f = NULL;
     }
+    free(_buffer);
+    _buffer = NULL;
 }
 
 VFSFileImpl::operator bool()
@@ -301,7 +274,9 @@ VFSFileImpl::operator bool()
 }
 
 time_t VFSFileImpl::getLastWrite() {
-    _getStat() ;
+    if(!_statValid || _written) {
+        _getStat();
+    }
     return _stat.st_mtime;
 }
 
@@ -317,17 +292,28 @@ void VFSFileImpl::_getStat() const
     sprintf(temp,"%s%s", _fs->_mountpoint, _path);
     if(!stat(temp, &_stat)) {
         _written = false;
+        _statValid = true;
     }
     free(temp);
 }
 
+void VFSFileImpl::_wrote()
+{
+    _written = true;
+    long pos = ftell(_f);
+    if(pos > 0 && (size_t)pos > _end) {
+        _end = pos;
+    }
+}
+
 size_t VFSFileImpl::write(const uint8_t *buf, size_t size)
 {
     if(_isDirectory || !_f || !buf || !size) {
         return 0;
     }
-    _written = true;
-    return fwrite(buf, 1, size, _f);
+    size_t written = fwrite(buf, 1, size, _f);
+    _wrote();
+    return written;
 }
 
 size_t VFSFileImpl::read(uint8_t* buf, size_t size)
@@ -349,6 +335,70 @@ void VFSFileImpl::flush()
     fsync(fileno(_f));
 }
 
+bool VFSFileImpl::setBufferSize(size_t size)
+{
+    if(_isDirectory || !_f) {
+        return false;
+    }
+    fflush(_f);
+    char * buffer = NULL;
+    if(size) {
+        buffer = (char *)heap_policy_malloc(HEAP_USER_FS, size);
+        if(!buffer) {
+            log_e("malloc(%u) failed", size);
+            return false;
+        }
+    }
+    if(setvbuf(_f, buffer, size ? _IOFBF : _IONBF, size)) {
+        free(buffer);
+        return false;
+    }
+    // stdio lets go of the old buffer in setvbuf()
+    free(_buffer);
+    _buffer = buffer;
+    return true;
+}
+
+// moves the descriptor to where stdio is, transfers, then puts stdio there
+bool VFSFileImpl::_direct(uint8_t *buf, size_t size, bool write, size_t *done)
+{
+    *done = 0;
+    if(_isDirectory || !_f || !buf || !size) {
+        return false;
+    }
+    long pos = ftell(_f);
+    if(pos < 0 || fflush(_f) || lseek(fileno(_f), pos, SEEK_SET) < 0) {
+        return false;
+    }
+    while(*done < size) {
+        ssize_t n = write ? ::write(fileno(_f), buf + *done, size - *done)
+                          : ::read(fileno(_f), buf + *done, size - *done);
+        if(n <= 0) {
+            break;
+        }
+        *done += n;
+    }
+    // from the descriptor, an append lands at the end whatever pos was
+    fseek(_f, lseek(fileno(_f), 0, SEEK_CUR), SEEK_SET);
+    return true;
+}
+
+size_t VFSFileImpl::readDirect(uint8_t* buf, size_t size)
+{
+    size_t done;
+    _direct(buf, size, false, &done);
+    return done;
+}
+
+size_t VFSFileImpl::writeDirect(const uint8_t *buf, size_t size)
+{
+    size_t done;
+    if(_direct((uint8_t *)buf, size, true, &done)) {
+        _wrote();
+    }
+    return done;
+}
+
 bool VFSFileImpl::seek(uint32_t pos, SeekMode mode)
 {
     if(_isDirectory || !_f) {
@@ -371,10 +421,15 @@ size_t VFSFileImpl::size() const
     if(_isDirectory || !_f) {
         return 0;
     }
-    if (_written) {
-        _getStat();
+    //what the file system has, or stdio still holds back
+    if(_fsSize < 0) {
+        struct stat st;
+        if(fstat(fileno(_f), &st)) {
+            return _end;
+        }
+        _fsSize = st.st_size;
     }
-    return _stat.st_size;
+    return (size_t)_fsSize > _end ? _fsSize : _end;
 }
 
 const char* VFSFileImpl::name() const
@@ -417,3 +472,126 @@ void VFSFileImpl::rewindDirectory(void)
     }
     rewinddir(_d);
 }
+
+struct VFSDirImpl::FatDir {
+    FF_DIR dir;
+    FILINFO info;
+};
+
+// as the FAT VFS converts them for stat()
+static time_t fat_time(WORD fdate, WORD ftime)
+{
+    struct tm tm = {};
+    tm.tm_mday = fdate & 0x1f;
+    tm.tm_mon = ((fdate >> 5) & 0xf) - 1;
+    tm.tm_year = (fdate >> 9) + 80;
+    tm.tm_sec = (ftime & 0x1f) * 2;
+    tm.tm_min = (ftime >> 5) & 0x3f;
+    tm.tm_hour = (ftime >> 11) & 0x1f;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+VFSDirImpl::VFSDirImpl(VFSImpl* fs, const char* path)
+    : _d(NULL)
+    , _fat(NULL)
+    , _path(NULL)
+    , _pathLen(0)
+{
+    if(fs->fatDrive() >= 0) {
+        char * temp = (char *)malloc(strlen(path)+3);
+        _fat = (FatDir *)malloc(sizeof(FatDir));
+        if(temp && _fat) {
+            sprintf(temp, "%d:%s", fs->fatDrive(), path);
+            if(f_opendir(&_fat->dir, temp) == FR_OK) {
+                free(temp);
+                return;
+            }
+        }
+        free(temp);
+        free(_fat);
+        _fat = NULL;
+    }
+
+    _pathLen = strlen(fs->mountpoint())+strlen(path);
+    _path = (char *)malloc(_pathLen+1+sizeof(((struct dirent *)0)->d_name));
+    if(!_path) {
+        log_e("malloc failed");
+        return;
+    }
+    sprintf(_path, "%s%s", fs->mountpoint(), path);
+    _d = opendir(_path);
+    if(_path[_pathLen-1] != '/') {
+        _path[_pathLen++] = '/';
+    }
+}
+
+VFSDirImpl::~VFSDirImpl()
+{
+    close();
+}
+
+bool VFSDirImpl::next(DirEntry& entry)
+{
+    if(_fat) {
+        if(f_readdir(&_fat->dir, &_fat->info) != FR_OK || !_fat->info.fname[0]) {
+            return false;
+        }
+        entry.name = _fat->info.fname;
+        entry.size = _fat->info.fsize;
+        entry.lastWrite = fat_time(_fat->info.fdate, _fat->info.ftime);
+        entry.isDirectory = _fat->info.fattrib & AM_DIR;
+        return true;
+    }
+    if(!_d) {
+        return false;
+    }
+    struct dirent * file;
+    do {
+        file = readdir(_d);
+        if(!file) {
+            return false;
+        }
+    } while(file->d_type != DT_REG && file->d_type != DT_DIR);
+
+    entry.name = file->d_name;
+    entry.isDirectory = file->d_type == DT_DIR;
+    entry.size = 0;
+    entry.lastWrite = 0;
+    strcpy(_path+_pathLen, file->d_name);
+    struct stat st;
+    if(!stat(_path, &st)) {
+        entry.size = entry.isDirectory ? 0 : st.st_size;
+        entry.lastWrite = st.st_mtime;
+    }
+    return true;
+}
+
+void VFSDirImpl::rewind()
+{
+    if(_fat) {
+        f_rewinddir(&_fat->dir);
+    } else if(_d) {
+        rewinddir(_d);
+    }
+}
+
+void VFSDirImpl::close()
+{
+    if(_fat) {
+        f_closedir(&_fat->dir);
+        free(_fat);
+        _fat = NULL;
+    }
+    if(_d) {
+        closedir(_d);
+        _d = NULL;
+    }
+    free(_path);
+    _path = NULL;
+}
+
+VFSDirImpl::operator bool()
+{
+    return _fat || _d;
+}
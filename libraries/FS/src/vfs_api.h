@@ -41,6 +41,26 @@ public:
     bool        remove(const char* path) override;
     bool        mkdir(const char *path) override;
     bool        rmdir(const char *path) override;
+    DirImplPtr  openDir(const char* path) override;
+};
+
+class VFSDirImpl : public DirImpl
+{
+protected:
+    struct FatDir;
+
+    DIR *               _d;
+    FatDir *            _fat;           // f_readdir() has size and date, readdir() would need a stat()
+    char *              _path;          // the directory, then room for an entry name
+    size_t              _pathLen;
+
+public:
+    VFSDirImpl(VFSImpl* fs, const char* path);
+    ~VFSDirImpl() override;
+    bool        next(DirEntry& entry) override;
+    void        rewind() override;
+    void        close() override;
+    operator    bool() override;
 };
 
 class VFSFileImpl : public FileImpl
@@ -51,10 +71,17 @@ protected:
     DIR *               _d;
     char *              _path;
     bool                _isDirectory;
-    mutable struct stat _stat;
+    mutable struct stat _stat;          // by path, taken when getLastWrite() needs it
     mutable bool        _written;
+    mutable bool        _statValid;
+    mutable long        _fsSize;        // from fstat(), -1 until size() asks
+    size_t              _end;           // end of the furthest write
+    char *              _buffer;
+
+    bool _direct(uint8_t *buf, size_t size, bool write, size_t *done);
 
     void _getStat() const;
+    void _wrote();
 
 public:
     VFSFileImpl(VFSImpl* fs, const char* path, const char* mode);
@@ -72,6 +99,9 @@ public:
     FileImplPtr openNextFile(const char* mode) override;
     void        rewindDirectory(void) override;
     operator    bool();
+    bool        setBufferSize(size_t size) override;
+    size_t      readDirect(uint8_t* buf, size_t size) override;
+    size_t      writeDirect(const uint8_t *buf, size_t size) override;
 };
 
 #endif
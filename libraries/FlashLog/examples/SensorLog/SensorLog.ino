@@ -0,0 +1,44 @@
+/*
+ * Logs a sample 50 times a second to the "log" partition, and prints
+ * what was logged before the last reset when it starts.
+ *
+ * Needs a data partition in the partition table, for example:
+ *   log,      data, 0x99,    ,        256K,
+ */
+#include "FlashLog.h"
+
+typedef struct {
+  uint32_t ms;
+  int16_t value;
+} sample_t;
+
+FlashLog flashLog;
+
+void setup() {
+  Serial.begin(115200);
+  if (!flashLog.begin("log")) {
+    Serial.println("no log partition");
+    return;
+  }
+  Serial.printf("log: %u of %u bytes used\n", flashLog.usedBytes(), flashLog.capacity());
+
+  sample_t sample;
+  uint32_t count = 0;
+  int len;
+  while ((len = flashLog.next(&sample, sizeof(sample))) != 0) {
+    if (len == sizeof(sample)) {
+      count++;
+    }
+  }
+  Serial.printf("%u samples, the last at %u ms, %u corrupt\n", count, count ? sample.ms : 0, flashLog.corrupt());
+}
+
+void loop() {
+  static uint32_t last = 0;
+  if (millis() - last < 20) {
+    return;
+  }
+  last = millis();
+  sample_t sample = { last, (int16_t)analogRead(34) };
+  flashLog.append(&sample, sizeof(sample));
+}
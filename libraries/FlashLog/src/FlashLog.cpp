@@ -0,0 +1,315 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FlashLog.h"
+#include "Esp.h"
+#include "rom/crc.h"
+
+#define FLASHLOG_SECTOR_MAGIC   0x474F4C46 // "FLOG"
+#define FLASHLOG_RECORD_MAGIC   0x5AA5
+#define FLASHLOG_ALIGN(n)       (((n) + 3) & ~3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} flashlog_sector_t;
+
+// written before the data: a record cut short by a reset keeps its length and fails its CRC
+typedef struct {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t crc;
+} flashlog_record_t;
+
+class FlashLogLock
+{
+public:
+    explicit FlashLogLock(SemaphoreHandle_t lock) : _lock(lock) { xSemaphoreTake(_lock, portMAX_DELAY); }
+    ~FlashLogLock() { xSemaphoreGive(_lock); }
+private:
+    SemaphoreHandle_t _lock;
+};
+
+FlashLog::FlashLog()
+    : _partition(NULL)
+    , _sectors(0)
+    , _head(0)
+    , _headSeq(0)
+    , _offset(0)
+    , _tail(0)
+    , _tailSeq(0)
+    , _readSector(0)
+    , _readSeq(0)
+    , _readOffset(0)
+    , _corrupt(0)
+    , _lock(NULL)
+{}
+
+FlashLog::~FlashLog()
+{
+    end();
+}
+
+bool FlashLog::_sectorSeq(size_t sector, uint32_t * seq)
+{
+    flashlog_sector_t header;
+    if(!ESP.partitionRead(_partition, sector * FLASHLOG_SECTOR_SIZE, (uint32_t *)&header, sizeof(header))) {
+        return false;
+    }
+    *seq = header.seq;
+    return header.magic == FLASHLOG_SECTOR_MAGIC;
+}
+
+bool FlashLog::_erase(size_t sector)
+{
+    if(!ESP.partitionEraseRange(_partition, sector * FLASHLOG_SECTOR_SIZE, FLASHLOG_SECTOR_SIZE)) {
+        log_e("erase of sector %u failed", sector);
+        return false;
+    }
+    return true;
+}
+
+bool FlashLog::_startSector(size_t sector, uint32_t seq)
+{
+    flashlog_sector_t header = { FLASHLOG_SECTOR_MAGIC, seq };
+    if(!ESP.partitionWrite(_partition, sector * FLASHLOG_SECTOR_SIZE, (uint32_t *)&header, sizeof(header))) {
+        return false;
+    }
+    _head = sector;
+    _headSeq = seq;
+    _offset = sizeof(header);
+    return true;
+}
+
+// write position in a sector, past the last record that has a sane header
+size_t FlashLog::_scan(size_t sector)
+{
+    size_t base = sector * FLASHLOG_SECTOR_SIZE;
+    size_t offset = sizeof(flashlog_sector_t);
+    while(offset + sizeof(flashlog_record_t) <= FLASHLOG_SECTOR_SIZE) {
+        flashlog_record_t rec;
+        if(!ESP.partitionRead(_partition, base + offset, (uint32_t *)&rec, sizeof(rec))) {
+            return FLASHLOG_SECTOR_SIZE;
+        }
+        if(rec.magic == 0xFFFF && rec.len == 0xFFFF) {
+            return offset;
+        }
+        if(rec.magic != FLASHLOG_RECORD_MAGIC || !rec.len || offset + sizeof(rec) + rec.len > FLASHLOG_SECTOR_SIZE) {
+            // garbage, nothing more goes in this sector
+            return FLASHLOG_SECTOR_SIZE;
+        }
+        offset += sizeof(rec) + FLASHLOG_ALIGN(rec.len);
+    }
+    return FLASHLOG_SECTOR_SIZE;
+}
+
+// the oldest sector is the first one with a header after the head, going round
+void FlashLog::_findTail()
+{
+    for(size_t i = 1; i <= _sectors; i++) {
+        size_t sector = (_head + i) % _sectors;
+        uint32_t seq;
+        if(_sectorSeq(sector, &seq) && seq <= _headSeq) {
+            _tail = sector;
+            _tailSeq = seq;
+            return;
+        }
+    }
+    _tail = _head;
+    _tailSeq = _headSeq;
+}
+
+bool FlashLog::begin(const char * partitionLabel)
+{
+    if(_partition) {
+        return true;
+    }
+    const esp_partition_t * partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if(!partition) {
+        log_e("no data partition '%s'", partitionLabel);
+        return false;
+    }
+    if(partition->size / FLASHLOG_SECTOR_SIZE < 2) {
+        log_e("partition '%s' needs two sectors at least", partitionLabel);
+        return false;
+    }
+    _lock = xSemaphoreCreateMutex();
+    if(!_lock) {
+        return false;
+    }
+    _partition = partition;
+    _sectors = partition->size / FLASHLOG_SECTOR_SIZE;
+    _corrupt = 0;
+
+    // recovery: the newest sector header is the head, its records give the write position
+    bool found = false;
+    for(size_t i = 0; i < _sectors; i++) {
+        uint32_t seq;
+        if(_sectorSeq(i, &seq) && (!found || seq > _headSeq)) {
+            _head = i;
+            _headSeq = seq;
+            found = true;
+        }
+    }
+    if(found) {
+        _offset = _scan(_head);
+    } else if(!_erase(0) || !_startSector(0, 1)) {
+        end();
+        return false;
+    }
+    // a reset may have come in the middle of erasing the spare
+    if(!_erase((_head + 1) % _sectors)) {
+        end();
+        return false;
+    }
+    _findTail();
+    rewind();
+    log_d("%u sectors, head %u seq %u offset %u, tail %u", _sectors, _head, _headSeq, _offset, _tail);
+    return true;
+}
+
+void FlashLog::end()
+{
+    _partition = NULL;
+    if(_lock) {
+        vSemaphoreDelete(_lock);
+        _lock = NULL;
+    }
+}
+
+bool FlashLog::_advance()
+{
+    if(!_startSector((_head + 1) % _sectors, _headSeq + 1)) {
+        return false;
+    }
+    size_t spare = (_head + 1) % _sectors;
+    if(spare == _tail) {
+        // full, the oldest sector goes
+        _tail = (_tail + 1) % _sectors;
+        uint32_t seq;
+        _tailSeq = _sectorSeq(_tail, &seq) ? seq : _headSeq;
+    }
+    return _erase(spare);
+}
+
+bool FlashLog::append(const void * data, size_t len)
+{
+    if(!_partition || !data || !len || len > FLASHLOG_MAX_RECORD) {
+        return false;
+    }
+    FlashLogLock lock(_lock);
+    size_t need = sizeof(flashlog_record_t) + FLASHLOG_ALIGN(len);
+    if(_offset + need > FLASHLOG_SECTOR_SIZE && !_advance()) {
+        return false;
+    }
+    flashlog_record_t rec = { FLASHLOG_RECORD_MAGIC, (uint16_t)len, crc32_le(0, (const uint8_t *)data, len) };
+    size_t addr = _head * FLASHLOG_SECTOR_SIZE + _offset;
+    // the position moves on even if the write fails, what was written of it is skipped
+    _offset += need;
+    return ESP.partitionWrite(_partition, addr, (uint32_t *)&rec, sizeof(rec))
+        && ESP.partitionWrite(_partition, addr + sizeof(rec), (uint32_t *)data, len);
+}
+
+bool FlashLog::clear()
+{
+    if(!_partition) {
+        return false;
+    }
+    FlashLogLock lock(_lock);
+    if(!ESP.partitionEraseRange(_partition, 0, _sectors * FLASHLOG_SECTOR_SIZE)) {
+        return false;
+    }
+    if(!_startSector(0, _headSeq + 1)) {
+        return false;
+    }
+    _tail = _head;
+    _tailSeq = _headSeq;
+    _readSector = _tail;
+    _readSeq = _tailSeq;
+    _readOffset = sizeof(flashlog_sector_t);
+    return true;
+}
+
+void FlashLog::rewind()
+{
+    if(!_partition) {
+        return;
+    }
+    FlashLogLock lock(_lock);
+    _readSector = _tail;
+    _readSeq = _tailSeq;
+    _readOffset = sizeof(flashlog_sector_t);
+}
+
+int FlashLog::next(void * buf, size_t maxLen)
+{
+    if(!_partition || !buf) {
+        return 0;
+    }
+    FlashLogLock lock(_lock);
+    while(true) {
+        uint32_t seq;
+        if(_readSector == _head && _readOffset >= _offset) {
+            return 0;
+        }
+        if(!_sectorSeq(_readSector, &seq) || seq != _readSeq) {
+            // overwritten while reading, go on from the oldest
+            _readSector = _tail;
+            _readSeq = _tailSeq;
+            _readOffset = sizeof(flashlog_sector_t);
+            continue;
+        }
+        flashlog_record_t rec;
+        size_t base = _readSector * FLASHLOG_SECTOR_SIZE;
+        bool end = _readOffset + sizeof(rec) > FLASHLOG_SECTOR_SIZE;
+        if(!end) {
+            ESP.partitionRead(_partition, base + _readOffset, (uint32_t *)&rec, sizeof(rec));
+            end = rec.magic != FLASHLOG_RECORD_MAGIC || !rec.len || _readOffset + sizeof(rec) + rec.len > FLASHLOG_SECTOR_SIZE;
+        }
+        if(end) {
+            if(_readSector == _head) {
+                return 0;
+            }
+            _readSector = (_readSector + 1) % _sectors;
+            _readSeq++;
+            _readOffset = sizeof(flashlog_sector_t);
+            continue;
+        }
+        size_t offset = _readOffset + sizeof(rec);
+        _readOffset += sizeof(rec) + FLASHLOG_ALIGN(rec.len);
+        if(rec.len > maxLen) {
+            return -1;
+        }
+        if(!ESP.partitionRead(_partition, base + offset, (uint32_t *)buf, rec.len)
+                || crc32_le(0, (const uint8_t *)buf, rec.len) != rec.crc) {
+            _corrupt++;
+            continue;
+        }
+        return rec.len;
+    }
+}
+
+size_t FlashLog::capacity() const
+{
+    return _sectors ? (_sectors - 1) * (FLASHLOG_SECTOR_SIZE - sizeof(flashlog_sector_t)) : 0;
+}
+
+size_t FlashLog::usedBytes() const
+{
+    if(!_partition) {
+        return 0;
+    }
+    size_t full = (_head + _sectors - _tail) % _sectors;
+    return full * (FLASHLOG_SECTOR_SIZE - sizeof(flashlog_sector_t)) + _offset - sizeof(flashlog_sector_t);
+}
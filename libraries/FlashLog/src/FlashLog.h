@@ -0,0 +1,78 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _FLASHLOG_H_
+#define _FLASHLOG_H_
+
+#include "Arduino.h"
+#include "esp_partition.h"
+
+#ifndef FLASHLOG_SECTOR_SIZE
+#define FLASHLOG_SECTOR_SIZE 4096
+#endif
+
+// largest record, what remains of a sector after its header and the record's
+#define FLASHLOG_MAX_RECORD (FLASHLOG_SECTOR_SIZE - 16)
+
+/*
+ * The partition is a ring of sectors, each starting with a sequence number.
+ * Records are appended to the newest sector, and the one after it is kept
+ * erased. So an append that fills a sector only writes the next header, and
+ * then erases the sector after that, dropping the oldest one when the ring is
+ * full. That erase (tens of ms, with the flash cache off) is the one slow
+ * append per sector; buffer samples while it runs if they cannot wait.
+ */
+class FlashLog
+{
+public:
+    FlashLog();
+    ~FlashLog();
+
+    bool begin(const char * partitionLabel="log");
+    void end();
+    bool append(const void * data, size_t len);
+    bool clear();
+
+    // reading, oldest record first
+    void rewind();
+    // length of the next record copied to buf, 0 at the end, -1 if it is longer than maxLen (it is skipped)
+    int next(void * buf, size_t maxLen);
+
+    size_t capacity() const;    // bytes of the sectors in use, the spare sector left out
+    size_t usedBytes() const;
+    uint32_t corrupt() const { return _corrupt; } // records skipped for a bad CRC since begin()
+
+protected:
+    const esp_partition_t * _partition;
+    size_t _sectors;
+    size_t _head;          // sector appended to
+    uint32_t _headSeq;
+    size_t _offset;        // write position in the head sector
+    size_t _tail;          // oldest sector
+    uint32_t _tailSeq;
+    size_t _readSector;
+    uint32_t _readSeq;
+    size_t _readOffset;
+    uint32_t _corrupt;
+    SemaphoreHandle_t _lock;
+
+    bool _sectorSeq(size_t sector, uint32_t * seq);
+    bool _erase(size_t sector);
+    bool _startSector(size_t sector, uint32_t seq);
+    bool _advance();
+    size_t _scan(size_t sector);
+    void _findTail();
+};
+
+#endif /* _FLASHLOG_H_ */
@@ -0,0 +1,394 @@
+/**
+ * AsyncHTTPClient.cpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "AsyncHTTPClient.h"
+
+namespace {
+
+// safe to send again when the answer was lost, and answered with a body
+// whose end is known
+bool pipelinable(const String& method)
+{
+    return method == "GET" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+}
+
+// "http://host:port" of url
+String serverOf(const String& url)
+{
+    int index = url.indexOf("://");
+    if(index < 0) {
+        return url;
+    }
+    int end = url.indexOf('/', index + 3);
+    return end < 0 ? url : url.substring(0, end);
+}
+
+bool discard(const uint8_t*, size_t)
+{
+    return true;
+}
+
+}
+
+AsyncHTTPClient::AsyncHTTPClient()
+    : _lock(nullptr), _ready(nullptr), _head(nullptr), _tail(nullptr), _count(0), _workers(0), _stopping(false)
+{
+}
+
+AsyncHTTPClient::~AsyncHTTPClient()
+{
+    end();
+}
+
+bool AsyncHTTPClient::begin(uint8_t workers)
+{
+    if(_lock) {
+        return true;
+    }
+    if(!workers) {
+        workers = 1;
+    }
+    _lock = xSemaphoreCreateMutex();
+    // requeued requests and the stop signals may come on top of a full queue
+    _ready = xSemaphoreCreateCounting(HTTP_ASYNC_QUEUE_LENGTH + (HTTP_ASYNC_PIPELINE_DEPTH + 1) * workers, 0);
+    if(!_lock || !_ready) {
+        log_e("could not create semaphores");
+        end();
+        return false;
+    }
+    _stopping = false;
+    for(uint8_t i = 0; i < workers; i++) {
+        if(xTaskCreateUniversal(_workerTask, "http_async", HTTP_ASYNC_TASK_STACK_SIZE, this,
+                                HTTP_ASYNC_TASK_PRIORITY, NULL, HTTP_ASYNC_TASK_RUNNING_CORE) != pdPASS) {
+            log_e("could not create worker %u", i);
+            break;
+        }
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        _workers++;
+        xSemaphoreGive(_lock);
+    }
+    if(!_workers) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void AsyncHTTPClient::end()
+{
+    if(!_lock) {
+        return;
+    }
+
+    // the workers finish what they have, then exit on the extra signals
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stopping = true;
+    Request * queued = _head;
+    _head = _tail = nullptr;
+    _count = 0;
+    uint8_t workers = _workers;
+    xSemaphoreGive(_lock);
+    for(uint8_t i = 0; i < workers; i++) {
+        xSemaphoreGive(_ready);
+    }
+    while(1) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        workers = _workers;
+        xSemaphoreGive(_lock);
+        if(!workers) {
+            break;
+        }
+        delay(10);
+    }
+
+    HTTPClient http;
+    while(queued) {
+        Request * r = queued;
+        queued = r->next;
+        _finish(r, HTTPC_ERROR_NOT_CONNECTED, http);
+    }
+
+    if(_ready) {
+        vSemaphoreDelete(_ready);
+        _ready = nullptr;
+    }
+    vSemaphoreDelete(_lock);
+    _lock = nullptr;
+}
+
+bool AsyncHTTPClient::send(const char * method, const String& url, const uint8_t * payload, size_t size,
+                           ResponseCallback cb, const String& headers, const char * CAcert)
+{
+    if(!_lock || _stopping) {
+        return false;
+    }
+
+    Request * r = new (std::nothrow) Request;
+    if(!r) {
+        return false;
+    }
+    r->payload = nullptr;
+    if(payload && size) {
+        r->payload = (uint8_t *) heap_policy_malloc(HEAP_USER_HTTP_CLIENT, size);
+        if(!r->payload) {
+            delete r;
+            return false;
+        }
+        memcpy(r->payload, payload, size);
+    }
+    r->method = method;
+    r->url = url;
+    r->server = serverOf(url);
+    r->headers = headers;
+    r->size = r->payload ? size : 0;
+    r->CAcert = CAcert;
+    r->cb = cb;
+    r->retries = 0;
+    r->next = nullptr;
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    bool queued = !_stopping && _count < HTTP_ASYNC_QUEUE_LENGTH;
+    if(queued) {
+        if(_tail) {
+            _tail->next = r;
+        } else {
+            _head = r;
+        }
+        _tail = r;
+        _count++;
+    }
+    xSemaphoreGive(_lock);
+
+    if(!queued) {
+        log_w("queue full, %s %s refused", method, url.c_str());
+        free(r->payload);
+        delete r;
+        return false;
+    }
+    xSemaphoreGive(_ready);
+    return true;
+}
+
+bool AsyncHTTPClient::GET(const String& url, ResponseCallback cb, const char * CAcert)
+{
+    return send("GET", url, nullptr, 0, cb, String(), CAcert);
+}
+
+bool AsyncHTTPClient::POST(const String& url, const String& payload, ResponseCallback cb,
+                           const String& contentType, const char * CAcert)
+{
+    return send("POST", url, (const uint8_t *) payload.c_str(), payload.length(), cb,
+                "Content-Type: " + contentType + "\r\n", CAcert);
+}
+
+size_t AsyncHTTPClient::pending()
+{
+    if(!_lock) {
+        return 0;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    size_t count = _count;
+    xSemaphoreGive(_lock);
+    return count;
+}
+
+void AsyncHTTPClient::_workerTask(void * arg)
+{
+    AsyncHTTPClient * self = (AsyncHTTPClient *) arg;
+    self->_worker();
+    xSemaphoreTake(self->_lock, portMAX_DELAY);
+    self->_workers--;
+    xSemaphoreGive(self->_lock);
+    vTaskDelete(NULL);
+}
+
+/**
+ * takes the next request, and the queued ones for the same server that can be
+ * pipelined behind it
+ * @return number of requests in batch, 0 when stopping
+ */
+uint8_t AsyncHTTPClient::_take(Request ** batch)
+{
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if(_stopping || !_head) {
+        xSemaphoreGive(_lock);
+        return 0;
+    }
+    Request * first = _head;
+    _head = first->next;
+    batch[0] = first;
+    uint8_t n = 1;
+    if(pipelinable(first->method)) {
+        Request ** link = &_head;
+        while(*link && n < HTTP_ASYNC_PIPELINE_DEPTH) {
+            Request * r = *link;
+            if(r->server == first->server && r->CAcert == first->CAcert && pipelinable(r->method)) {
+                *link = r->next;
+                batch[n++] = r;
+                // its signal is taken below, the count stays in step
+            } else {
+                link = &r->next;
+            }
+        }
+    }
+    _tail = nullptr;
+    for(Request * r = _head; r; r = r->next) {
+        _tail = r;
+    }
+    _count -= n;
+    xSemaphoreGive(_lock);
+
+    for(uint8_t i = 1; i < n; i++) {
+        xSemaphoreTake(_ready, 0);
+    }
+    for(uint8_t i = 0; i < n; i++) {
+        batch[i]->next = nullptr;
+    }
+    return n;
+}
+
+// puts requests the server did not answer back in front of the queue
+void AsyncHTTPClient::_requeue(Request ** batch, uint8_t n)
+{
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if(_stopping) {
+        xSemaphoreGive(_lock);
+        HTTPClient http;
+        for(uint8_t i = 0; i < n; i++) {
+            _finish(batch[i], HTTPC_ERROR_NOT_CONNECTED, http);
+        }
+        return;
+    }
+    for(int i = n - 1; i >= 0; i--) {
+        batch[i]->next = _head;
+        _head = batch[i];
+        if(!_tail) {
+            _tail = batch[i];
+        }
+        _count++;
+    }
+    xSemaphoreGive(_lock);
+    for(uint8_t i = 0; i < n; i++) {
+        xSemaphoreGive(_ready);
+    }
+}
+
+bool AsyncHTTPClient::_prepare(HTTPClient& http, Request * r)
+{
+    bool ok = r->CAcert ? http.begin(r->url, r->CAcert) : http.begin(r->url);
+    if(!ok) {
+        return false;
+    }
+
+    String headers = _defaultHeaders + r->headers;
+    int start = 0;
+    while(start < (int) headers.length()) {
+        int end = headers.indexOf('\n', start);
+        if(end < 0) {
+            end = headers.length();
+        }
+        int colon = headers.indexOf(':', start);
+        if(colon > start && colon < end) {
+            String name = headers.substring(start, colon);
+            String value = headers.substring(colon + 1, end);
+            name.trim();
+            value.trim();
+            http.addHeader(name, value);
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+void AsyncHTTPClient::_finish(Request * r, int code, HTTPClient& http)
+{
+    if(r->cb) {
+        r->cb(code, http);
+    }
+    // the rest of the body, so the connection can carry the next response
+    if(code >= 200 && code != 204 && code != 304 && r->method != "HEAD" && http.connected()) {
+        http.readBody(discard);
+    }
+    free(r->payload);
+    delete r;
+}
+
+void AsyncHTTPClient::_worker()
+{
+    HTTPClient http;
+    http.setReuse(true);
+    Request * batch[HTTP_ASYNC_PIPELINE_DEPTH];
+
+    while(1) {
+        xSemaphoreTake(_ready, portMAX_DELAY);
+        uint8_t n = _take(batch);
+        if(!n) {
+            if(_stopping) {
+                break;
+            }
+            continue;
+        }
+
+        if(n == 1) {
+            Request * r = batch[0];
+            int code = HTTPC_ERROR_CONNECTION_REFUSED;
+            if(_prepare(http, r)) {
+                code = http.sendRequest(r->method.c_str(), r->payload, r->size);
+            }
+            _finish(r, code, http);
+            continue;
+        }
+
+        // all requests go out, then the responses are read in the same order
+        uint8_t sent = 0;
+        while(sent < n) {
+            if(!_prepare(http, batch[sent]) ||
+               http.sendOnly(batch[sent]->method.c_str(), batch[sent]->payload, batch[sent]->size) < 0) {
+                break;
+            }
+            sent++;
+        }
+        if(!sent) {
+            _finish(batch[0], HTTPC_ERROR_CONNECTION_REFUSED, http);
+            sent = 1;
+        }
+
+        uint8_t done = 0;
+        while(done < sent) {
+            int code = http.readResponse();
+            if(code < 0 && done) {
+                break; // the server closed after what it answered, try the rest again
+            }
+            _finish(batch[done++], code, http);
+        }
+
+        // what was not answered goes back once, then fails like a single request would
+        uint8_t retry = 0;
+        for(uint8_t i = done; i < n; i++) {
+            if(batch[i]->retries++) {
+                _finish(batch[i], HTTPC_ERROR_CONNECTION_LOST, http);
+            } else {
+                batch[retry++] = batch[i];
+            }
+        }
+        if(retry) {
+            _requeue(batch, retry);
+        }
+    }
+    http.end();
+}
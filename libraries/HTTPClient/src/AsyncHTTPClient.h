@@ -0,0 +1,117 @@
+/**
+ * AsyncHTTPClient.h
+ *
+ * Requests queued from any task and carried out by background workers.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef AsyncHTTPClient_H_
+#define AsyncHTTPClient_H_
+
+#include "HTTPClient.h"
+
+#ifndef HTTP_ASYNC_TASK_STACK_SIZE
+#define HTTP_ASYNC_TASK_STACK_SIZE 6144 // TLS needs most of it
+#endif
+
+#ifndef HTTP_ASYNC_TASK_PRIORITY
+#define HTTP_ASYNC_TASK_PRIORITY 1
+#endif
+
+#ifndef HTTP_ASYNC_TASK_RUNNING_CORE
+#define HTTP_ASYNC_TASK_RUNNING_CORE -1
+#endif
+
+#ifndef HTTP_ASYNC_QUEUE_LENGTH
+#define HTTP_ASYNC_QUEUE_LENGTH 16 // requests waiting before send() refuses more
+#endif
+
+#ifndef HTTP_ASYNC_PIPELINE_DEPTH
+#define HTTP_ASYNC_PIPELINE_DEPTH 4 // requests sent ahead on one connection, 1 disables pipelining
+#endif
+
+/*
+ * Requests are queued and returned from at once; workers take them in order,
+ * each with its own HTTPClient, and connections come from the shared
+ * HTTPClient pool:
+ *
+ *   AsyncHTTPClient async;
+ *   async.begin(2);
+ *   async.POST("http://example.com/telemetry", json, [](int code, HTTPClient& http) {
+ *       log_i("telemetry: %d", code);
+ *   });
+ *
+ * Idempotent requests (GET, HEAD, PUT, DELETE) queued for the same server
+ * are pipelined, up to HTTP_ASYNC_PIPELINE_DEPTH on one connection; one the
+ * server did not answer is sent again. The callback runs on the worker and
+ * may read the body through http (getString(), readBody(), ...), whatever it
+ * leaves is skipped. code is negative, an HTTPC_ERROR, when the request failed.
+ */
+class AsyncHTTPClient
+{
+public:
+    typedef std::function<void(int code, HTTPClient& http)> ResponseCallback;
+
+    AsyncHTTPClient();
+    ~AsyncHTTPClient();
+
+    bool begin(uint8_t workers = 1);
+    void end(); // waits for the running requests, the queued ones fail
+
+    // false when the queue is full or begin() was not called
+    bool send(const char * method, const String& url, const uint8_t * payload, size_t size,
+              ResponseCallback cb, const String& headers = String(), const char * CAcert = nullptr);
+    bool GET(const String& url, ResponseCallback cb, const char * CAcert = nullptr);
+    bool POST(const String& url, const String& payload, ResponseCallback cb,
+              const String& contentType = "application/json", const char * CAcert = nullptr);
+
+    size_t pending(); // queued and not started
+
+    // "Name: value\r\n" lines sent with every request, e.g. an API key
+    void setDefaultHeaders(const String& headers) { _defaultHeaders = headers; }
+
+protected:
+    struct Request {
+        String method;
+        String url;
+        String server;   // scheme, host and port, to group requests for pipelining
+        String headers;
+        uint8_t * payload;
+        size_t size;
+        const char * CAcert;
+        ResponseCallback cb;
+        uint8_t retries;
+        Request * next;
+    };
+
+    static void _workerTask(void * arg);
+    void _worker();
+    uint8_t _take(Request ** batch);
+    void _requeue(Request ** batch, uint8_t n);
+    bool _prepare(HTTPClient& http, Request * r);
+    void _finish(Request * r, int code, HTTPClient& http);
+
+    SemaphoreHandle_t _lock;
+    SemaphoreHandle_t _ready;   // counts the queued requests
+    Request * _head;
+    Request * _tail;
+    size_t _count;
+    uint8_t _workers;           // running
+    bool _stopping;
+    String _defaultHeaders;
+};
+
+#endif /* AsyncHTTPClient_H_ */
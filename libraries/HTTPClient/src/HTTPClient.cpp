@@ -38,6 +38,7 @@
 #include <base64.h>
 
 #include "HTTPClient.h"
+#include "HTTPInflater.h"
 
 #ifdef HTTPCLIENT_1_1_COMPATIBLE
 class TransportTraits
@@ -56,6 +57,12 @@ public:
     {
         return true;
     }
+
+    // connections are only shared between the same server and settings
+    virtual String poolKey(const String& host, uint16_t port)
+    {
+        return host + ':' + port;
+    }
 };
 
 class TLSTraits : public TransportTraits
@@ -84,13 +91,177 @@ public:
         return true;
     }
 
+    String poolKey(const String& host, uint16_t port) override
+    {
+        char settings[40];
+        snprintf(settings, sizeof(settings), "|tls|%p|%p|%p", _cacert, _clicert, _clikey);
+        return host + ':' + port + settings;
+    }
+
 protected:
     const char* _cacert;
     const char* _clicert;
     const char* _clikey;
 };
+
+/*
+ * Idle connections left by end() wait here for the next request to the same
+ * server, whichever HTTPClient makes it. When a TLS connection has to be
+ * opened anew, WiFiClientSecure still resumes the cached session.
+ */
+namespace {
+
+struct PooledConnection {
+    String key;
+    std::unique_ptr<WiFiClient> client;
+    unsigned long idleSince;
+};
+
+PooledConnection poolConnections[HTTPCLIENT_POOL_SIZE ? HTTPCLIENT_POOL_SIZE : 1];
+SemaphoreHandle_t poolLock = NULL;
+
+void lockPool()
+{
+    if(!poolLock) {
+        // the first request of all, made before any task could race for it
+        poolLock = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(poolLock, portMAX_DELAY);
+}
+
+void unlockPool()
+{
+    xSemaphoreGive(poolLock);
+}
+
+void dropConnection(PooledConnection& conn)
+{
+    conn.client->stop();
+    conn.client.reset();
+    conn.key = String();
+}
+
+// an idle connection to key that is still open, drained of anything left behind
+std::unique_ptr<WiFiClient> takeConnection(const String& key)
+{
+    std::unique_ptr<WiFiClient> client;
+    lockPool();
+    for(size_t i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        PooledConnection& conn = poolConnections[i];
+        if(!conn.client) {
+            continue;
+        }
+        if(millis() - conn.idleSince > HTTPCLIENT_POOL_IDLE_TIMEOUT || !conn.client->connected()) {
+            dropConnection(conn);
+            continue;
+        }
+        if(!client && conn.key == key) {
+            client = std::move(conn.client);
+            conn.key = String();
+        }
+    }
+    unlockPool();
+    if(client) {
+        while(client->available() > 0) {
+            client->read();
+        }
+    }
+    return client;
+}
+
+void putConnection(const String& key, std::unique_ptr<WiFiClient> client)
+{
+    lockPool();
+    PooledConnection* slot = &poolConnections[0];
+    for(size_t i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        PooledConnection& conn = poolConnections[i];
+        if(!conn.client) {
+            slot = &conn;
+            break;
+        }
+        if(millis() - conn.idleSince > millis() - slot->idleSince) {
+            slot = &conn;
+        }
+    }
+    if(slot->client) {
+        log_d("connection pool full, closing %s", slot->key.c_str());
+        dropConnection(*slot);
+    }
+    slot->key = key;
+    slot->client = std::move(client);
+    slot->idleSince = millis();
+    unlockPool();
+}
+
+} // namespace
+
+void HTTPClient::clearConnectionPool()
+{
+    lockPool();
+    for(size_t i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        if(poolConnections[i].client) {
+            dropConnection(poolConnections[i]);
+        }
+    }
+    unlockPool();
+    WiFiClientSecure::clearSessionCache();
+}
 #endif // HTTPCLIENT_1_1_COMPATIBLE
 
+namespace {
+
+// for collected header names, ignoring case
+uint16_t hashIgnoreCase(StringView name)
+{
+    uint16_t h = 0;
+    for(size_t i = 0; i < name.length(); i++) {
+        h = h * 31 + (uint8_t) tolower(name[i]);
+    }
+    return h;
+}
+
+// gathers the request header into a few writes without building it in a String
+class HeaderWriter
+{
+public:
+    HeaderWriter(WiFiClient& client) : _client(client) {}
+
+    void add(const char * data, size_t len)
+    {
+        if(_failed) {
+            return;
+        }
+        if(_len + len > sizeof(_buf)) {
+            flush();
+            if(len >= sizeof(_buf)) {
+                _failed = _client.write((const uint8_t *) data, len) != len;
+                return;
+            }
+        }
+        memcpy(_buf + _len, data, len);
+        _len += len;
+    }
+    void add(const char * text) { add(text, strlen(text)); }
+    void add(const String& text) { add(text.c_str(), text.length()); }
+
+    bool flush()
+    {
+        if(_len && !_failed) {
+            _failed = _client.write((const uint8_t *) _buf, _len) != _len;
+        }
+        _len = 0;
+        return !_failed;
+    }
+
+protected:
+    WiFiClient& _client;
+    char _buf[HTTPCLIENT_HEADER_BUFFER_SIZE];
+    size_t _len = 0;
+    bool _failed = false;
+};
+
+} // namespace
+
 /**
  * constructor
  */
@@ -114,6 +285,8 @@ HTTPClient::~HTTPClient()
 void HTTPClient::clear()
 {
     _returnCode = 0;
+    _bodyState = BODY_NONE;
+    _contentEncoding = HTTPC_CE_IDENTITY;
     _size = -1;
     _headers = "";
 }
@@ -367,6 +540,11 @@ void HTTPClient::end(void)
  */
 void HTTPClient::disconnect(bool preserveClient)
 {
+    if(connected() && _pendingResponses && preserveClient && _reuse && _canReuse) {
+        log_d("tcp kept open for the pipelined responses\n");
+        return;
+    }
+    _pendingResponses = 0;
     if(connected()) {
         if(_client->available() > 0) {
             log_d("still data in buffer (%d), clean up.\n", _client->available());
@@ -376,6 +554,16 @@ void HTTPClient::disconnect(bool preserveClient)
         }
 
         if(_reuse && _canReuse) {
+#ifdef HTTPCLIENT_1_1_COMPATIBLE
+            if(_tcpDeprecated && !preserveClient && HTTPCLIENT_POOL_SIZE) {
+                // any HTTPClient may pick it up for the same server
+                log_d("tcp kept in the connection pool\n");
+                putConnection(_poolKey, std::move(_tcpDeprecated));
+                _client = nullptr;
+                _transportTraits.reset(nullptr);
+                return;
+            }
+#endif
             log_d("tcp keep open for reuse\n");
         } else {
             log_d("tcp stop\n");
@@ -484,6 +672,15 @@ void HTTPClient::useHTTP10(bool useHTTP10)
     _reuse = !useHTTP10;
 }
 
+/**
+ * ask the server for a compressed body
+ * @param accept bool
+ */
+void HTTPClient::acceptCompressed(bool accept)
+{
+    _acceptCompressed = accept;
+}
+
 /**
  * send a GET request
  * @return http code
@@ -661,6 +858,62 @@ int HTTPClient::sendRequest(const char * type, uint8_t * payload, size_t size)
     return returnError(code);
 }
 
+/**
+ * sends a request without waiting for its response
+ * @param type const char *     "GET", "POST", ....
+ * @param payload uint8_t *     data for the message body if null not send
+ * @param size size_t           size for the message body if 0 not send
+ * @return 0 or error
+ */
+int HTTPClient::sendOnly(const char * type, const uint8_t * payload, size_t size)
+{
+    if(!connect()) {
+        return returnError(HTTPC_ERROR_CONNECTION_REFUSED);
+    }
+
+    if(payload && size > 0) {
+        addHeader(F("Content-Length"), String(size));
+    }
+
+    if(!sendHeader(type)) {
+        return returnError(HTTPC_ERROR_SEND_HEADER_FAILED);
+    }
+
+    if(payload && size > 0) {
+        if(_client->write(payload, size) != size) {
+            return returnError(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+        }
+    }
+
+    // the next request brings its own
+    _headers = "";
+    _pendingResponses++;
+    return 0;
+}
+
+/**
+ * reads the response to the oldest request sent with sendOnly()
+ * @return http code or error
+ */
+int HTTPClient::readResponse()
+{
+    if(!_pendingResponses) {
+        return returnError(HTTPC_ERROR_NOT_CONNECTED);
+    }
+    _pendingResponses--;
+
+    // wipe out any existing headers from previous request
+    for(size_t i = 0; i < _headerKeysCount; i++) {
+        if (_currentHeaders[i].value.length() > 0) {
+            _currentHeaders[i].value.clear();
+        }
+    }
+
+    int code = handleHeaderResponse();
+    log_d("readResponse code=%d\n", code);
+    return code < 0 ? returnError(code) : code;
+}
+
 /**
  * sendRequest
  * @param type const char *     "GET", "POST", ....
@@ -704,7 +957,7 @@ int HTTPClient::sendRequest(const char * type, Stream * stream, size_t size)
     }
 
     // create buffer for read
-    uint8_t * buff = (uint8_t *) malloc(buff_size);
+    uint8_t * buff = (uint8_t *) heap_policy_malloc(HEAP_USER_HTTP_CLIENT, buff_size);
 
     if(buff) {
         // read all data from stream and send it to server
@@ -850,78 +1103,298 @@ int HTTPClient::writeToStream(Stream * stream)
         return returnError(HTTPC_ERROR_NO_STREAM);
     }
 
+    return readBody([stream](const uint8_t * data, size_t len) {
+        size_t bytesWrite = stream->write(data, len);
+
+        // are all Bytes a writen to stream ?
+        if(bytesWrite != len) {
+            log_d("short write asked for %d but got %d retry...", len, bytesWrite);
+
+            // check for write error
+            if(stream->getWriteError()) {
+                log_d("stream write error %d", stream->getWriteError());
+
+                //reset write error for retry
+                stream->clearWriteError();
+            }
+
+            // some time for the stream
+            delay(1);
+
+            size_t leftBytes = len - bytesWrite;
+
+            // retry to send the missed bytes
+            bytesWrite = stream->write(data + bytesWrite, leftBytes);
+            if(bytesWrite != leftBytes) {
+                // failed again
+                log_w("short write asked for %d but got %d failed.", leftBytes, bytesWrite);
+                return false;
+            }
+        }
+
+        // check for write error
+        if(stream->getWriteError()) {
+            log_w("stream write error %d", stream->getWriteError());
+            return false;
+        }
+        return true;
+    });
+}
+
+/**
+ * passes the message body / payload on in spans, without buffering it
+ * @param onData BodyCallback
+ * @return bytes passed on or error
+ */
+int HTTPClient::readBody(BodyCallback onData)
+{
     if(!connected()) {
         return returnError(HTTPC_ERROR_NOT_CONNECTED);
     }
 
-    // get length of document (is -1 when Server sends no Content-Length header)
-    int len = _size;
-    int ret = 0;
-
-    if(_transferEncoding == HTTPC_TE_IDENTITY) {
-        ret = writeToStreamDataBlock(stream, len);
+    std::unique_ptr<HTTPInflater> inflater;
+    if(_contentEncoding != HTTPC_CE_IDENTITY) {
+        inflater.reset(new (std::nothrow) HTTPInflater(_contentEncoding == HTTPC_CE_GZIP));
+        if(!inflater || !inflater->begin()) {
+            return returnError(HTTPC_ERROR_TOO_LESS_RAM);
+        }
+    }
+    // 0 or error
+    auto pass = [&](const uint8_t * data, size_t len) -> int {
+        if(inflater) {
+            return inflater->write(data, len, onData);
+        }
+        return onData(data, len) ? 0 : HTTPC_ERROR_STREAM_WRITE;
+    };
+
+    int total = 0;
+    while(1) {
+        int span = bodySpan();
+        if(span < 0) {
+            return returnError(span);
+        }
+        if(span == 0) {
+            break;
+        }
 
-        // have we an error?
-        if(ret < 0) {
-            return returnError(ret);
+        // wait for data of this span
+        unsigned long start = millis();
+        int avail;
+        while((avail = _client->available()) <= 0) {
+            if(!_client->connected()) {
+                break;
+            }
+            if(millis() - start > _tcpTimeout) {
+                return returnError(HTTPC_ERROR_READ_TIMEOUT);
+            }
+            delay(1);
         }
-    } else if(_transferEncoding == HTTPC_TE_CHUNKED) {
-        int size = 0;
-        while(1) {
-            if(!connected()) {
+        if(avail <= 0) {
+            if(_bodyLeft >= 0) {
                 return returnError(HTTPC_ERROR_CONNECTION_LOST);
             }
-            String chunkHeader = _client->readStringUntil('\n');
+            _bodyState = BODY_DONE; // no length given, the body ends with the connection
+            break;
+        }
 
-            if(chunkHeader.length() <= 0) {
-                return returnError(HTTPC_ERROR_READ_TIMEOUT);
+        // straight from the receive buffer if the client has one, through the stack if not
+        size_t len = (size_t) span < (size_t) avail ? span : avail;
+        size_t peeked = _client->peekAvailable();
+        int err;
+        if(peeked) {
+            if(len > peeked) {
+                len = peeked;
             }
+            err = pass(_client->peekBuffer(), len);
+            _client->peekConsume(len);
+        } else {
+            uint8_t buff[512];
+            int r = _client->read(buff, len < sizeof(buff) ? len : sizeof(buff));
+            if(r <= 0) {
+                return returnError(HTTPC_ERROR_CONNECTION_LOST);
+            }
+            len = r;
+            err = pass(buff, len);
+        }
+        if(err < 0) {
+            return returnError(err);
+        }
+        bodyConsumed(len);
+        total += len;
+        delay(0);
+    }
 
-            chunkHeader.trim(); // remove \r
+    if(inflater) {
+        if(!inflater->done()) {
+            log_e("compressed body cut short");
+            return returnError(HTTPC_ERROR_DECOMPRESS);
+        }
+        total = inflater->produced();
+    }
 
-            // read size of chunk
-            len = (uint32_t) strtol((const char *) chunkHeader.c_str(), NULL, 16);
-            size += len;
-            log_d(" read chunk len: %d", len);
-
-            // data left?
-            if(len > 0) {
-                int r = writeToStreamDataBlock(stream, len);
-                if(r < 0) {
-                    // error in writeToStreamDataBlock
-                    return returnError(r);
-                }
-                ret += r;
+    // if no length Header use global chunk size
+    if(_transferEncoding == HTTPC_TE_CHUNKED && _size <= 0) {
+        _size = total;
+    }
+    log_d("connection closed or file end (written: %d).", total);
+
+//    end();
+    disconnect(true);
+    return total;
+}
+
+/**
+ * GET, with the body passed to onData
+ * @param onData BodyCallback
+ * @return http code or error
+ */
+int HTTPClient::GET(BodyCallback onData)
+{
+    int code = GET();
+    if(code > 0) {
+        int ret = readBody(onData);
+        if(ret < 0) {
+            return ret;
+        }
+    }
+    return code;
+}
+
+/**
+ * the message body for readers that take it byte by byte or in pieces
+ * @return Stream&
+ */
+Stream& HTTPClient::getBodyStream()
+{
+    return _bodyStream;
+}
+
+/**
+ * moves to the body data that comes next, through chunk framing
+ * @return bytes left in the current span, 0 at the end of the body, or error
+ */
+int HTTPClient::bodySpan()
+{
+    while(1) {
+        switch(_bodyState) {
+        case BODY_START:
+            if(_transferEncoding == HTTPC_TE_CHUNKED) {
+                _bodyState = BODY_CHUNK_HEAD;
             } else {
+                _bodyLeft = _size; // -1 when the Server sends no Content-Length header
+                _bodyState = _bodyLeft ? BODY_DATA : BODY_DONE;
+            }
+            break;
 
-                // if no length Header use global chunk size
-                if(_size <= 0) {
-                    _size = size;
-                }
+        case BODY_CHUNK_HEAD: {
+            String chunkHeader = _client->readStringUntil('\n');
+            if(chunkHeader.length() <= 0) {
+                return HTTPC_ERROR_READ_TIMEOUT;
+            }
+            chunkHeader.trim(); // remove \r
 
-                // check if we have write all data out
-                if(ret != _size) {
-                    return returnError(HTTPC_ERROR_STREAM_WRITE);
-                }
+            // read size of chunk
+            _bodyLeft = (uint32_t) strtol((const char *) chunkHeader.c_str(), NULL, 16);
+            log_d(" read chunk len: %d", _bodyLeft);
+            if(_bodyLeft > 0) {
+                _bodyState = BODY_DATA;
                 break;
             }
+            // last chunk, trailers up to the empty line
+            do {
+                chunkHeader = _client->readStringUntil('\n');
+                chunkHeader.trim();
+            } while(chunkHeader.length() > 0);
+            _bodyState = BODY_DONE;
+            break;
+        }
 
-            // read trailing \r\n at the end of the chunk
-            char buf[2];
-            auto trailing_seq_len = _client->readBytes((uint8_t*)buf, 2);
-            if (trailing_seq_len != 2 || buf[0] != '\r' || buf[1] != '\n') {
-                return returnError(HTTPC_ERROR_READ_TIMEOUT);
+        case BODY_DATA:
+            if(_bodyLeft) {
+                return _bodyLeft > 0 ? _bodyLeft : INT_MAX;
+            }
+            if(_transferEncoding != HTTPC_TE_CHUNKED) {
+                _bodyState = BODY_DONE;
+                break;
+            }
+            {
+                // read trailing \r\n at the end of the chunk
+                char buf[2];
+                auto trailing_seq_len = _client->readBytes((uint8_t*)buf, 2);
+                if (trailing_seq_len != 2 || buf[0] != '\r' || buf[1] != '\n') {
+                    return HTTPC_ERROR_READ_TIMEOUT;
+                }
             }
+            _bodyState = BODY_CHUNK_HEAD;
+            break;
 
-            delay(0);
+        case BODY_DONE:
+            return 0;
+
+        default:
+            return HTTPC_ERROR_NOT_CONNECTED;
         }
-    } else {
-        return returnError(HTTPC_ERROR_ENCODING);
     }
+}
 
-//    end();
-    disconnect(true);
-    return ret;
+void HTTPClient::bodyConsumed(size_t len)
+{
+    if(_bodyLeft > 0) {
+        _bodyLeft -= len;
+    }
+}
+
+int HTTPBodyStream::available()
+{
+    if(!_http._client || _http.bodySpan() <= 0) {
+        return 0;
+    }
+    int avail = _http._client->available();
+    return avail < _http._bodyLeft || _http._bodyLeft < 0 ? avail : _http._bodyLeft;
+}
+
+int HTTPBodyStream::read()
+{
+    if(available() <= 0) {
+        return -1;
+    }
+    int c = _http._client->read();
+    if(c >= 0) {
+        _http.bodyConsumed(1);
+    }
+    return c;
+}
+
+int HTTPBodyStream::peek()
+{
+    if(available() <= 0) {
+        return -1;
+    }
+    return _http._client->peek();
+}
+
+size_t HTTPBodyStream::readBytes(char *buffer, size_t length)
+{
+    size_t got = 0;
+    unsigned long start = millis();
+    while(got < length) {
+        int avail = available();
+        if(avail <= 0) {
+            if(_http._bodyState == HTTPClient::BODY_DONE || !_http.connected() || millis() - start >= _timeout) {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        int r = _http._client->read((uint8_t *) buffer + got, (size_t) avail < length - got ? avail : length - got);
+        if(r <= 0) {
+            break;
+        }
+        _http.bodyConsumed(r);
+        got += r;
+        start = millis();
+    }
+    return got;
 }
 
 /**
@@ -975,6 +1448,8 @@ String HTTPClient::errorToString(int error)
         return F("Stream write error");
     case HTTPC_ERROR_READ_TIMEOUT:
         return F("read Timeout");
+    case HTTPC_ERROR_DECOMPRESS:
+        return F("decompression failed");
     default:
         return String();
     }
@@ -1024,13 +1499,19 @@ void HTTPClient::collectHeaders(const char* headerKeys[], const size_t headerKey
     _currentHeaders = new RequestArgument[_headerKeysCount];
     for(size_t i = 0; i < _headerKeysCount; i++) {
         _currentHeaders[i].key = headerKeys[i];
+        _currentHeaders[i].hash = hashIgnoreCase(_currentHeaders[i].key);
     }
 }
 
 String HTTPClient::header(const char* name)
+{
+    return header(StringView(name));
+}
+
+String HTTPClient::header(StringView name)
 {
     for(size_t i = 0; i < _headerKeysCount; ++i) {
-        if(_currentHeaders[i].key == name) {
+        if(name == _currentHeaders[i].key) {
             return _currentHeaders[i].value;
         }
     }
@@ -1059,9 +1540,14 @@ int HTTPClient::headers()
 }
 
 bool HTTPClient::hasHeader(const char* name)
+{
+    return hasHeader(StringView(name));
+}
+
+bool HTTPClient::hasHeader(StringView name)
 {
     for(size_t i = 0; i < _headerKeysCount; ++i) {
-        if((_currentHeaders[i].key == name) && (_currentHeaders[i].value.length() > 0)) {
+        if((name == _currentHeaders[i].key) && (_currentHeaders[i].value.length() > 0)) {
             return true;
         }
     }
@@ -1080,7 +1566,8 @@ bool HTTPClient::connect(void)
         } else {
             log_d("already connected, try reuse!");
         }
-        while(_client->available() > 0) {
+        // anything left is stale, unless it is the answer to a pipelined request
+        while(!_pendingResponses && _client->available() > 0) {
             _client->read();
         }
         return true;
@@ -1088,6 +1575,16 @@ bool HTTPClient::connect(void)
 
 #ifdef HTTPCLIENT_1_1_COMPATIBLE
      if(_transportTraits && !_client) {
+        _poolKey = _transportTraits->poolKey(_host, _port);
+        if(_reuse && HTTPCLIENT_POOL_SIZE) {
+            _tcpDeprecated = takeConnection(_poolKey);
+            if(_tcpDeprecated) {
+                log_d("reusing pooled connection to %s:%u", _host.c_str(), _port);
+                _client = _tcpDeprecated.get();
+                _client->setTimeout((_tcpTimeout + 500) / 1000);
+                return true;
+            }
+        }
         _tcpDeprecated = _transportTraits->create();
         if(!_tcpDeprecated) {
             log_e("failed to create client");
@@ -1138,44 +1635,41 @@ bool HTTPClient::sendHeader(const char * type)
         return false;
     }
 
-    String header = String(type) + " " + _uri + F(" HTTP/1.");
+    HeaderWriter header(*_client);
+    header.add(type);
+    header.add(" ");
+    header.add(_uri);
+    header.add(_useHTTP10 ? " HTTP/1.0" : " HTTP/1.1");
 
-    if(_useHTTP10) {
-        header += "0";
-    } else {
-        header += "1";
-    }
-
-    header += String(F("\r\nHost: ")) + _host;
+    header.add("\r\nHost: ");
+    header.add(_host);
     if (_port != 80 && _port != 443)
     {
-        header += ':';
-        header += String(_port);
-    }
-    header += String(F("\r\nUser-Agent: ")) + _userAgent +
-              F("\r\nConnection: ");
-
-    if(_reuse) {
-        header += F("keep-alive");
-    } else {
-        header += F("close");
+        char port[7];
+        header.add(port, snprintf(port, sizeof(port), ":%u", _port));
     }
-    header += "\r\n";
+    header.add("\r\nUser-Agent: ");
+    header.add(_userAgent);
+    header.add("\r\nConnection: ");
+    header.add(_reuse ? "keep-alive\r\n" : "close\r\n");
 
-    if(!_useHTTP10) {
-        header += F("Accept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n");
+    if(_acceptCompressed) {
+        header.add("Accept-Encoding: gzip, deflate\r\n");
+    } else if(!_useHTTP10) {
+        header.add("Accept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n");
     }
 
     if(_base64Authorization.length()) {
         _base64Authorization.replace("\n", "");
-        header += F("Authorization: Basic ");
-        header += _base64Authorization;
-        header += "\r\n";
+        header.add("Authorization: Basic ");
+        header.add(_base64Authorization);
+        header.add("\r\n");
     }
 
-    header += _headers + "\r\n";
+    header.add(_headers);
+    header.add("\r\n");
 
-    return (_client->write((const uint8_t *) header.c_str(), header.length()) == header.length());
+    return header.flush();
 }
 
 /**
@@ -1193,78 +1687,90 @@ int HTTPClient::handleHeaderResponse()
 
     _canReuse = _reuse;
 
-    String transferEncoding;
+    bool chunked = false;
+    bool unknownEncoding = false;
 
     _transferEncoding = HTTPC_TE_IDENTITY;
     unsigned long lastDataTime = millis();
     bool firstLine = true;
+    char buf[HTTPCLIENT_HEADER_LINE_SIZE];
 
     while(connected()) {
         size_t len = _client->available();
         if(len > 0) {
-            String headerLine = _client->readStringUntil('\n');
-            headerLine.trim(); // remove \r
+            // one line into the stack buffer, whatever does not fit is dropped
+            size_t n = _client->readBytesUntil('\n', buf, sizeof(buf) - 1);
+            if(n == sizeof(buf) - 1) {
+                // the newline is still unread, and maybe more of the line
+                if(_client->peek() != '\n') {
+                    log_w("header line longer than %u bytes, truncated", sizeof(buf) - 1);
+                }
+                _client->find("\n");
+            }
+            buf[n] = 0;
+            StringView line = StringView(buf, n).trim(); // remove \r
 
             lastDataTime = millis();
 
-            log_v("RX: '%s'", headerLine.c_str());
+            log_v("RX: '%.*s'", (int) line.length(), line.data());
 
+            // parse on views, only the values that are kept get copied
             if(firstLine) {
 		firstLine = false;
-                if(_canReuse && headerLine.startsWith("HTTP/1.")) {
-                    _canReuse = (headerLine[sizeof "HTTP/1." - 1] != '0');
+                if(_canReuse && line.startsWith("HTTP/1.")) {
+                    _canReuse = (line[sizeof "HTTP/1." - 1] != '0');
                 }
-                int codePos = headerLine.indexOf(' ') + 1;
-                _returnCode = headerLine.substring(codePos, headerLine.indexOf(' ', codePos)).toInt();
-            } else if(headerLine.indexOf(':')) {
-                String headerName = headerLine.substring(0, headerLine.indexOf(':'));
-                String headerValue = headerLine.substring(headerLine.indexOf(':') + 1);
-                headerValue.trim();
+                int codePos = line.indexOf(' ') + 1;
+                _returnCode = line.substring(codePos, line.indexOf(' ', codePos)).toInt();
+            } else if(line.indexOf(':') > 0) {
+                StringView headerName, headerValue;
+                line.split(':', headerName, headerValue);
+                headerValue = headerValue.trim();
 
                 if(headerName.equalsIgnoreCase("Content-Length")) {
                     _size = headerValue.toInt();
-                }
-
-                if(_canReuse && headerName.equalsIgnoreCase("Connection")) {
-                    if(headerValue.indexOf("close") >= 0 && headerValue.indexOf("keep-alive") < 0) {
+                } else if(headerName.equalsIgnoreCase("Connection")) {
+                    if(_canReuse && headerValue.indexOf("close") >= 0 && headerValue.indexOf("keep-alive") < 0) {
                         _canReuse = false;
                     }
+                } else if(headerName.equalsIgnoreCase("Transfer-Encoding")) {
+                    log_d("Transfer-Encoding: %.*s", (int) headerValue.length(), headerValue.data());
+                    chunked = headerValue.equalsIgnoreCase("chunked");
+                    unknownEncoding = !chunked;
+                } else if (headerName.equalsIgnoreCase("Location")) {
+                    _location = headerValue.toString();
+                } else if(_acceptCompressed && headerName.equalsIgnoreCase("Content-Encoding")) {
+                    if(headerValue.equalsIgnoreCase("gzip") || headerValue.equalsIgnoreCase("x-gzip")) {
+                        _contentEncoding = HTTPC_CE_GZIP;
+                    } else if(headerValue.equalsIgnoreCase("deflate")) {
+                        _contentEncoding = HTTPC_CE_DEFLATE;
+                    } else if(!headerValue.equalsIgnoreCase("identity")) {
+                        unknownEncoding = true;
+                    }
                 }
 
-                if(headerName.equalsIgnoreCase("Transfer-Encoding")) {
-                    transferEncoding = headerValue;
-                }
-
-                if (headerName.equalsIgnoreCase("Location")) {
-                    _location = headerValue;
-                }
-
+                uint16_t hash = hashIgnoreCase(headerName);
                 for(size_t i = 0; i < _headerKeysCount; i++) {
-                    if(_currentHeaders[i].key.equalsIgnoreCase(headerName)) {
-                        _currentHeaders[i].value = headerValue;
+                    if(_currentHeaders[i].hash == hash && headerName.equalsIgnoreCase(_currentHeaders[i].key)) {
+                        _currentHeaders[i].value = headerValue.toString();
                         break;
                     }
                 }
             }
 
-            if(headerLine == "") {
+            if(line.isEmpty()) {
                 log_d("code: %d", _returnCode);
 
                 if(_size > 0) {
                     log_d("size: %d", _size);
                 }
 
-                if(transferEncoding.length() > 0) {
-                    log_d("Transfer-Encoding: %s", transferEncoding.c_str());
-                    if(transferEncoding.equalsIgnoreCase("chunked")) {
-                        _transferEncoding = HTTPC_TE_CHUNKED;
-                    } else {
-                        return HTTPC_ERROR_ENCODING;
-                    }
-                } else {
-                    _transferEncoding = HTTPC_TE_IDENTITY;
+                if(unknownEncoding) {
+                    return HTTPC_ERROR_ENCODING;
                 }
+                _transferEncoding = chunked ? HTTPC_TE_CHUNKED : HTTPC_TE_IDENTITY;
 
+                _bodyState = BODY_START;
                 if(_returnCode) {
                     return _returnCode;
                 } else {
@@ -1284,122 +1790,6 @@ int HTTPClient::handleHeaderResponse()
     return HTTPC_ERROR_CONNECTION_LOST;
 }
 
-/**
- * write one Data Block to Stream
- * @param stream Stream *
- * @param size int
- * @return < 0 = error >= 0 = size written
- */
-int HTTPClient::writeToStreamDataBlock(Stream * stream, int size)
-{
-    int buff_size = HTTP_TCP_BUFFER_SIZE;
-    int len = size;
-    int bytesWritten = 0;
-
-    // if possible create smaller buffer then HTTP_TCP_BUFFER_SIZE
-    if((len > 0) && (len < HTTP_TCP_BUFFER_SIZE)) {
-        buff_size = len;
-    }
-
-    // create buffer for read
-    uint8_t * buff = (uint8_t *) malloc(buff_size);
-
-    if(buff) {
-        // read all data from server
-        while(connected() && (len > 0 || len == -1)) {
-
-            // get available data size
-            size_t sizeAvailable = _client->available();
-
-            if(sizeAvailable) {
-
-                int readBytes = sizeAvailable;
-
-                // read only the asked bytes
-                if(len > 0 && readBytes > len) {
-                    readBytes = len;
-                }
-
-                // not read more the buffer can handle
-                if(readBytes > buff_size) {
-                    readBytes = buff_size;
-                }
-		    
-        		// stop if no more reading    
-        		if (readBytes == 0)
-        			break;
-
-                // read data
-                int bytesRead = _client->readBytes(buff, readBytes);
-
-                // write it to Stream
-                int bytesWrite = stream->write(buff, bytesRead);
-                bytesWritten += bytesWrite;
-
-                // are all Bytes a writen to stream ?
-                if(bytesWrite != bytesRead) {
-                    log_d("short write asked for %d but got %d retry...", bytesRead, bytesWrite);
-
-                    // check for write error
-                    if(stream->getWriteError()) {
-                        log_d("stream write error %d", stream->getWriteError());
-
-                        //reset write error for retry
-                        stream->clearWriteError();
-                    }
-
-                    // some time for the stream
-                    delay(1);
-
-                    int leftBytes = (readBytes - bytesWrite);
-
-                    // retry to send the missed bytes
-                    bytesWrite = stream->write((buff + bytesWrite), leftBytes);
-                    bytesWritten += bytesWrite;
-
-                    if(bytesWrite != leftBytes) {
-                        // failed again
-                        log_w("short write asked for %d but got %d failed.", leftBytes, bytesWrite);
-                        free(buff);
-                        return HTTPC_ERROR_STREAM_WRITE;
-                    }
-                }
-
-                // check for write error
-                if(stream->getWriteError()) {
-                    log_w("stream write error %d", stream->getWriteError());
-                    free(buff);
-                    return HTTPC_ERROR_STREAM_WRITE;
-                }
-
-                // count bytes to read left
-                if(len > 0) {
-                    len -= readBytes;
-                }
-
-                delay(0);
-            } else {
-                delay(1);
-            }
-        }
-
-        free(buff);
-
-        log_d("connection closed or file end (written: %d).", bytesWritten);
-
-        if((size > 0) && (size != bytesWritten)) {
-            log_d("bytesWritten %d and size %d mismatch!.", bytesWritten, size);
-            return HTTPC_ERROR_STREAM_WRITE;
-        }
-
-    } else {
-        log_w("too less ram! need %d", HTTP_TCP_BUFFER_SIZE);
-        return HTTPC_ERROR_TOO_LESS_RAM;
-    }
-
-    return bytesWritten;
-}
-
 /**
  * called to handle error return, may disconnect the connection if still exists
  * @param error
@@ -1409,6 +1799,7 @@ int HTTPClient::returnError(int error)
 {
     if(error < 0) {
         log_w("error(%d): %s", error, errorToString(error).c_str());
+        _pendingResponses = 0;
         if(connected()) {
             log_d("tcp stop");
             _client->stop();
@@ -30,12 +30,21 @@
 #define HTTPCLIENT_1_1_COMPATIBLE
 
 #include <memory>
+#include <functional>
 #include <Arduino.h>
 #include <WiFiClient.h>
 #include <WiFiClientSecure.h>
 
 #define HTTPCLIENT_DEFAULT_TCP_TIMEOUT (5000)
 
+/// persistent connections shared by HTTPClient instances that own their client (begin(url))
+#ifndef HTTPCLIENT_POOL_SIZE
+#define HTTPCLIENT_POOL_SIZE (4)             // idle connections kept, 0 disables the pool
+#endif
+#ifndef HTTPCLIENT_POOL_IDLE_TIMEOUT
+#define HTTPCLIENT_POOL_IDLE_TIMEOUT (10000) // ms, kept below common server keep-alive timeouts
+#endif
+
 /// HTTP client errors
 #define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
 #define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
@@ -48,10 +57,21 @@
 #define HTTPC_ERROR_ENCODING            (-9)
 #define HTTPC_ERROR_STREAM_WRITE        (-10)
 #define HTTPC_ERROR_READ_TIMEOUT        (-11)
+#define HTTPC_ERROR_DECOMPRESS          (-12)
 
 /// size for the stream handling
 #define HTTP_TCP_BUFFER_SIZE (1460)
 
+/// longest response header line kept whole, longer ones are truncated
+#ifndef HTTPCLIENT_HEADER_LINE_SIZE
+#define HTTPCLIENT_HEADER_LINE_SIZE (768)
+#endif
+
+/// request header pieces are gathered into writes of this size
+#ifndef HTTPCLIENT_HEADER_BUFFER_SIZE
+#define HTTPCLIENT_HEADER_BUFFER_SIZE (256)
+#endif
+
 /// HTTP codes see RFC7231
 typedef enum {
     HTTP_CODE_CONTINUE = 100,
@@ -119,6 +139,12 @@ typedef enum {
     HTTPC_TE_CHUNKED
 } transferEncoding_t;
 
+typedef enum {
+    HTTPC_CE_IDENTITY,
+    HTTPC_CE_GZIP,
+    HTTPC_CE_DEFLATE
+} contentEncoding_t;
+
 /**
  * redirection follow mode.
  * + `HTTPC_DISABLE_FOLLOW_REDIRECTS` - no redirection will be followed.
@@ -142,6 +168,24 @@ class TransportTraits;
 typedef std::unique_ptr<TransportTraits> TransportTraitsPtr;
 #endif
 
+class HTTPClient;
+
+/// the response body without chunk framing, see HTTPClient::getBodyStream()
+class HTTPBodyStream : public Stream
+{
+public:
+    HTTPBodyStream(HTTPClient& http) : _http(http) {}
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length) override;
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+protected:
+    HTTPClient& _http;
+};
+
 class HTTPClient
 {
 public:
@@ -180,6 +224,10 @@ public:
 
     bool setURL(const String &url);
     void useHTTP10(bool usehttp10 = true);
+    /// Ask for gzip or deflate compressed bodies, readBody(), writeToStream()
+    /// and getString() pass them on inflated. getSize() and getBodyStream()
+    /// stay with the body as it is sent. Inflating takes about 43 KB of heap.
+    void acceptCompressed(bool accept = true);
 
     /// request handling
     int GET();
@@ -193,18 +241,27 @@ public:
     int sendRequest(const char * type, uint8_t * payload = NULL, size_t size = 0);
     int sendRequest(const char * type, Stream * stream, size_t size = 0);
 
+    /// Pipelining: sendOnly() requests back to back on one connection, then
+    /// readResponse() and read the body for each of them in the same order.
+    /// No redirects are followed. Both return an HTTPC_ERROR on failure.
+    int sendOnly(const char * type, const uint8_t * payload = NULL, size_t size = 0);
+    int readResponse();
+
     void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
 
     /// Response handling
     void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
     String header(const char* name);   // get request header value by name
+    String header(StringView name);
     String header(size_t i);              // get request header value by number
     String headerName(size_t i);          // get request header name by number
     int headers();                     // get header count
     bool hasHeader(const char* name);  // check if header exists
+    bool hasHeader(StringView name);
 
 
     int getSize(void);
+    contentEncoding_t getContentEncoding(void) { return _contentEncoding; }
     const String &getLocation(void);
 
     WiFiClient& getStream(void);
@@ -212,12 +269,24 @@ public:
     int writeToStream(Stream* stream);
     String getString(void);
 
+    /// The body in spans as it arrives, de-chunked and taken straight from the
+    /// socket buffer where the client allows it; return false to stop.
+    /// readBody() returns the bytes passed on or an error.
+    typedef std::function<bool(const uint8_t * data, size_t len)> BodyCallback;
+    int readBody(BodyCallback onData);
+    int GET(BodyCallback onData); // GET() and readBody(), returns the HTTP code
+    Stream& getBodyStream();      // the body for incremental parsers, e.g. a JSON reader
+
     static String errorToString(int error);
 
+    // closes the idle connections kept for reuse and forgets the TLS sessions
+    static void clearConnectionPool();
+
 protected:
     struct RequestArgument {
         String key;
         String value;
+        uint16_t hash = 0; // of the key ignoring case, checked before comparing
     };
 
     bool beginInternal(String url, const char* expectedProtocol);
@@ -227,12 +296,16 @@ protected:
     bool connect(void);
     bool sendHeader(const char * type);
     int handleHeaderResponse();
-    int writeToStreamDataBlock(Stream * stream, int len);
+    int bodySpan();
+    void bodyConsumed(size_t len);
+
+    friend class HTTPBodyStream;
 
 
 #ifdef HTTPCLIENT_1_1_COMPATIBLE
     TransportTraitsPtr _transportTraits;
     std::unique_ptr<WiFiClient> _tcpDeprecated;
+    String _poolKey; // host, port and TLS settings of _tcpDeprecated
 #endif
 
     WiFiClient* _client = nullptr;
@@ -244,6 +317,7 @@ protected:
     bool _reuse = true;
     uint16_t _tcpTimeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
     bool _useHTTP10 = false;
+    bool _acceptCompressed = false;
     bool _secure = false;
 
     String _uri;
@@ -259,10 +333,18 @@ protected:
     int _returnCode = 0;
     int _size = -1;
     bool _canReuse = false;
+    uint8_t _pendingResponses = 0; // sent with sendOnly(), not read yet
     followRedirects_t _followRedirects = HTTPC_DISABLE_FOLLOW_REDIRECTS;
     uint16_t _redirectLimit = 10;
     String _location;
     transferEncoding_t _transferEncoding = HTTPC_TE_IDENTITY;
+    contentEncoding_t _contentEncoding = HTTPC_CE_IDENTITY; // only set with _acceptCompressed
+
+    /// body reading
+    enum { BODY_NONE, BODY_START, BODY_CHUNK_HEAD, BODY_DATA, BODY_DONE };
+    uint8_t _bodyState = BODY_NONE;
+    int _bodyLeft = 0; // of the body or the current chunk, -1 up to the end of the connection
+    HTTPBodyStream _bodyStream{*this};
 };
 
 
@@ -0,0 +1,132 @@
+/**
+ * HTTPInflater.cpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "HTTPInflater.h"
+
+bool HTTPInflater::begin()
+{
+    _state = (State *) heap_policy_malloc(HEAP_USER_HTTP_CLIENT, sizeof(State));
+    if(!_state) {
+        return false;
+    }
+    tinfl_init(&_state->inflator);
+    return true;
+}
+
+int HTTPInflater::write(const uint8_t * data, size_t len, const HTTPClient::BodyCallback& onData)
+{
+    while(len || _moreOutput) {
+        if(_phase == INFLATE) {
+            size_t in = len;
+            size_t out = TINFL_LZ_DICT_SIZE - _offset;
+            tinfl_status status = tinfl_decompress(&_state->inflator, data, &in, _state->window,
+                                                   _state->window + _offset, &out, _flags | TINFL_FLAG_HAS_MORE_INPUT);
+            data += in;
+            len -= in;
+            if(out) {
+                if(!onData(_state->window + _offset, out)) {
+                    return HTTPC_ERROR_STREAM_WRITE;
+                }
+                _produced += out;
+                _offset = (_offset + out) & (TINFL_LZ_DICT_SIZE - 1);
+            }
+            if(status < 0) {
+                log_e("inflate failed: %d", status);
+                return HTTPC_ERROR_DECOMPRESS;
+            }
+            _moreOutput = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+            if(status == TINFL_STATUS_DONE) {
+                _phase = TRAILER;
+            }
+            continue;
+        }
+        if(_phase == TRAILER) {
+            return 0; // gzip CRC and size, not checked
+        }
+        if(_phase == ZLIB_DETECT) {
+            // a zlib stream starts with CM 8, no raw deflate block type has it in the low nibble
+            _flags = (*data & 0x0F) == 8 ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0;
+            _phase = INFLATE;
+            continue;
+        }
+        if(!_header(*data++)) {
+            log_e("no gzip stream");
+            return HTTPC_ERROR_DECOMPRESS;
+        }
+        len--;
+    }
+    return 0;
+}
+
+// one byte of the gzip header, false if it is not one
+bool HTTPInflater::_header(uint8_t b)
+{
+    switch(_phase) {
+    case GZ_FIXED:
+        if((_count == 0 && b != 0x1f) || (_count == 1 && b != 0x8b) || (_count == 2 && b != 8)) {
+            return false;
+        }
+        if(_count == 3) {
+            _gzFlags = b;
+        }
+        if(++_count == 10) {
+            _count = 0;
+            _phase = (_gzFlags & GZ_FEXTRA) ? GZ_EXTRA_LEN : _after(GZ_EXTRA);
+        }
+        break;
+    case GZ_EXTRA_LEN:
+        _extra |= b << (8 * _count);
+        if(++_count == 2) {
+            _count = 0;
+            _phase = _extra ? GZ_EXTRA : _after(GZ_EXTRA);
+        }
+        break;
+    case GZ_EXTRA:
+        if(!--_extra) {
+            _phase = _after(GZ_EXTRA);
+        }
+        break;
+    case GZ_NAME:
+    case GZ_COMMENT:
+        if(!b) {
+            _phase = _after(_phase);
+        }
+        break;
+    case GZ_HCRC:
+        if(++_count == 2) {
+            _phase = INFLATE;
+        }
+        break;
+    }
+    return true;
+}
+
+// the header field that follows phase
+uint8_t HTTPInflater::_after(uint8_t phase)
+{
+    if(phase < GZ_NAME && (_gzFlags & GZ_FNAME)) {
+        return GZ_NAME;
+    }
+    if(phase < GZ_COMMENT && (_gzFlags & GZ_FCOMMENT)) {
+        return GZ_COMMENT;
+    }
+    if(_gzFlags & GZ_FHCRC) {
+        return GZ_HCRC;
+    }
+    return INFLATE;
+}
@@ -0,0 +1,71 @@
+/**
+ * HTTPInflater.h
+ *
+ * Streaming gzip and deflate decoder on the ESP32 ROM inflater.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef HTTPInflater_H_
+#define HTTPInflater_H_
+
+#include "HTTPClient.h"
+#include "rom/miniz.h"
+
+/*
+ * gzip (RFC 1952) and deflate (RFC 1950, or raw RFC 1951 as some servers send
+ * it) fed in pieces of any size. The 32 KB window doubles as the output
+ * buffer, so inflated data is passed on from there without a copy; about
+ * 43 KB of heap in all, taken by begin().
+ */
+class HTTPInflater
+{
+public:
+    HTTPInflater(bool gzip) : _phase(gzip ? GZ_FIXED : ZLIB_DETECT) {}
+    ~HTTPInflater() { free(_state); }
+
+    bool begin();
+    bool done() const { return _phase >= TRAILER; } // the end of the compressed stream was seen
+    size_t produced() const { return _produced; }
+
+    // 0, or HTTPC_ERROR_DECOMPRESS on corrupt data, HTTPC_ERROR_STREAM_WRITE when onData refused it
+    int write(const uint8_t * data, size_t len, const HTTPClient::BodyCallback& onData);
+
+    static bool isGzip(const uint8_t * data, size_t len) { return len >= 2 && data[0] == 0x1f && data[1] == 0x8b; }
+
+protected:
+    enum { GZ_FIXED, GZ_EXTRA_LEN, GZ_EXTRA, GZ_NAME, GZ_COMMENT, GZ_HCRC, ZLIB_DETECT, INFLATE, TRAILER };
+    enum { GZ_FHCRC = 2, GZ_FEXTRA = 4, GZ_FNAME = 8, GZ_FCOMMENT = 16 };
+
+    struct State {
+        tinfl_decompressor inflator;
+        uint8_t window[TINFL_LZ_DICT_SIZE];
+    };
+
+    bool _header(uint8_t b);
+    uint8_t _after(uint8_t phase);
+
+    State * _state = nullptr;
+    uint8_t _phase;
+    uint8_t _gzFlags = 0;
+    uint8_t _count = 0;
+    uint16_t _extra = 0;
+    uint32_t _flags = 0;
+    size_t _offset = 0;
+    size_t _produced = 0;
+    bool _moreOutput = false;
+};
+
+#endif /* HTTPInflater_H_ */
@@ -25,6 +25,7 @@
 
 #include "HTTPUpdate.h"
 #include <StreamString.h>
+#include <HTTPInflater.h>
 
 #include <esp_partition.h>
 #include <esp_ota_ops.h>                // get running partition
@@ -129,6 +130,8 @@ String HTTPUpdate::getLastErrorString(void)
         return "New Binary Does Not Fit Flash Size";
     case HTTP_UE_NO_PARTITION:
         return "Partition Could Not be Found";
+    case HTTP_UE_RESUME_FAILED:
+        return "Download Could Not be Resumed";
     }
 
     return String();
@@ -162,16 +165,13 @@ String getSketchSHA256() {
 }
 
 /**
- *
- * @param http HTTPClient *
- * @param currentVersion const char *
- * @return HTTPUpdateResult
+ * the request headers, sent again with each resumed download
+ * @param http HTTPClient &
+ * @param currentVersion const String &
+ * @param spiffs bool
  */
-HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& currentVersion, bool spiffs)
+void HTTPUpdate::addRequestHeaders(HTTPClient& http, const String& currentVersion, bool spiffs)
 {
-
-    HTTPUpdateResult ret = HTTP_UPDATE_FAILED;
-
     // use HTTP/1.0 for update since the update handler not support any transfer Encoding
     http.useHTTP10(true);
     http.setTimeout(_httpClientTimeout);
@@ -202,8 +202,22 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
     if(currentVersion && currentVersion[0] != 0x00) {
         http.addHeader("x-ESP32-version", currentVersion);
     }
+}
 
-    const char * headerkeys[] = { "x-MD5" };
+/**
+ *
+ * @param http HTTPClient *
+ * @param currentVersion const char *
+ * @return HTTPUpdateResult
+ */
+HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& currentVersion, bool spiffs)
+{
+
+    HTTPUpdateResult ret = HTTP_UPDATE_FAILED;
+
+    addRequestHeaders(http, currentVersion, spiffs);
+
+    const char * headerkeys[] = { "x-MD5", "Content-Range" };
     size_t headerkeyssize = sizeof(headerkeys) / sizeof(char*);
 
     // track these headers
@@ -288,7 +302,9 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
                     log_d("runUpdate flash...\n");
                 }
 
-                if(!spiffs) {
+                // a gzip image is inflated on the way, Update checks its magic byte
+                bool compressed = tcp->peek() == 0x1f;
+                if(!spiffs && !compressed) {
 /* To do
                     uint8_t buf[4];
                     if(tcp->peekBytes(&buf[0], 4) != 4) {
@@ -320,7 +336,7 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
                     }
 */
                 }
-                if(runUpdate(*tcp, len, http.header("x-MD5"), command)) {
+                if(runDownload(http, len, http.header("x-MD5"), command, compressed, currentVersion, spiffs)) {
                     ret = HTTP_UPDATE_OK;
                     log_d("Update ok\n");
                     http.end();
@@ -363,6 +379,138 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
     return ret;
 }
 
+/**
+ * writes the body of the current response to flash, resuming it after errors
+ * @param http HTTPClient&          with the response headers read
+ * @param size uint32_t             of the body
+ * @param md5 String                of the image, uncompressed
+ * @param compressed bool           gzip, inflated into flash
+ * @return true if Update ok
+ */
+bool HTTPUpdate::runDownload(HTTPClient& http, uint32_t size, const String& md5, int command, bool compressed,
+                             const String& currentVersion, bool spiffs)
+{
+    StreamString error;
+
+    // a compressed image ends where its stream does, the partition bounds it
+    if(!Update.begin(compressed ? UPDATE_SIZE_UNKNOWN : size, command, _ledPin, _ledOn)) {
+        _lastError = Update.getError();
+        Update.printError(error);
+        error.trim(); // remove line ending
+        log_e("Update.begin failed! (%s)\n", error.c_str());
+        return false;
+    }
+
+    if(md5.length()) {
+        if(!Update.setMD5(md5.c_str())) {
+            _lastError = HTTP_UE_SERVER_FAULTY_MD5;
+            log_e("Update.setMD5 failed! (%s)\n", md5.c_str());
+            Update.abort();
+            return false;
+        }
+    }
+
+    std::unique_ptr<HTTPInflater> inflater;
+    if(compressed) {
+        inflater.reset(new (std::nothrow) HTTPInflater(true));
+        if(!inflater || !inflater->begin()) {
+            _lastError = HTTPC_ERROR_TOO_LESS_RAM;
+            Update.abort();
+            return false;
+        }
+    }
+
+    HTTPClient::BodyCallback toFlash = [](const uint8_t * data, size_t len) {
+        return Update.write((uint8_t *) data, len) == len;
+    };
+    uint32_t received = 0; // of the body, the inflater keeps its state across reconnects
+    uint32_t skip = 0;     // resent from the start by a server ignoring Range
+    int inflateError = 0;
+    uint8_t retries = _resumeRetries;
+
+    while(1) {
+        int ret = http.readBody([&](const uint8_t * data, size_t len) {
+            if(skip) {
+                size_t n = len < skip ? len : skip;
+                skip -= n;
+                data += n;
+                len -= n;
+            }
+            received += len;
+            if(inflater) {
+                inflateError = inflater->write(data, len, toFlash);
+                return inflateError == 0;
+            }
+            return toFlash(data, len);
+        });
+        if(ret >= 0 && received >= size) {
+            break;
+        }
+        if(Update.hasError()) {
+            _lastError = Update.getError();
+            Update.printError(error);
+            error.trim(); // remove line ending
+            log_e("Update.write failed! (%s)\n", error.c_str());
+            return false;
+        }
+        if(inflateError) {
+            _lastError = inflateError;
+            Update.abort();
+            return false;
+        }
+
+        // the connection broke off, ask for the rest
+        if(!retries) {
+            _lastError = ret < 0 ? ret : HTTPC_ERROR_CONNECTION_LOST;
+            log_e("download failed at %u of %u bytes\n", received, size);
+            Update.abort();
+            return false;
+        }
+        retries--;
+        log_w("download broke off at %u of %u bytes, resuming\n", received, size);
+        delay(HTTP_UPDATE_RESUME_DELAY);
+
+        addRequestHeaders(http, currentVersion, spiffs);
+        http.addHeader("Range", String("bytes=") + received + "-");
+        int code = http.GET();
+        if(code == HTTP_CODE_PARTIAL_CONTENT) {
+            String expected = String("bytes ") + received + "-";
+            if(!http.header("Content-Range").startsWith(expected)) {
+                _lastError = HTTP_UE_RESUME_FAILED;
+                log_e("resumed at the wrong place: %s\n", http.header("Content-Range").c_str());
+                Update.abort();
+                return false;
+            }
+            skip = 0;
+        } else if(code == HTTP_CODE_OK && (uint32_t) http.getSize() == size) {
+            skip = received;
+        } else if(code > 0) {
+            _lastError = HTTP_UE_RESUME_FAILED;
+            log_e("resume answered with HTTP code %d\n", code);
+            Update.abort();
+            return false;
+        }
+        // a failed request leaves the connection closed, the next readBody() finds out
+    }
+
+    if(inflater && !inflater->done()) {
+        _lastError = HTTPC_ERROR_DECOMPRESS;
+        log_e("compressed image cut short\n");
+        Update.abort();
+        return false;
+    }
+
+    if(!Update.end(compressed)) {
+        _lastError = Update.getError();
+        Update.printError(error);
+        error.trim(); // remove line ending
+        log_e("Update.end failed! (%s)\n", error.c_str());
+        return false;
+    }
+
+    return true;
+}
+
 /**
  * write Update to flash
  * @param in Stream&
@@ -43,6 +43,14 @@
 #define HTTP_UE_BIN_VERIFY_HEADER_FAILED    (-106)
 #define HTTP_UE_BIN_FOR_WRONG_FLASH         (-107)
 #define HTTP_UE_NO_PARTITION                (-108)
+#define HTTP_UE_RESUME_FAILED               (-109)
+
+#ifndef HTTP_UPDATE_RESUME_RETRIES
+#define HTTP_UPDATE_RESUME_RETRIES 5       // reconnects after the download broke off, 0 restarts nothing
+#endif
+#ifndef HTTP_UPDATE_RESUME_DELAY
+#define HTTP_UPDATE_RESUME_DELAY 2000      // ms before a reconnect
+#endif
 
 enum HTTPUpdateResult {
     HTTP_UPDATE_FAILED,
@@ -64,6 +72,15 @@ public:
         _rebootOnUpdate = reboot;
     }
 
+    // A broken download continues with a Range request from where it
+    // stopped, up to retries times. Images in gzip format (.bin.gz) are
+    // inflated into flash as they arrive, x-MD5 is then that of the
+    // uncompressed image.
+    void setResumeRetries(uint8_t retries)
+    {
+        _resumeRetries = retries;
+    }
+
     void setLedPin(int ledPin = -1, uint8_t ledOn = HIGH)
     {
         _ledPin = ledPin;
@@ -84,9 +101,13 @@ public:
 protected:
     t_httpUpdate_return handleUpdate(HTTPClient& http, const String& currentVersion, bool spiffs = false);
     bool runUpdate(Stream& in, uint32_t size, String md5, int command = U_FLASH);
+    bool runDownload(HTTPClient& http, uint32_t size, const String& md5, int command, bool compressed,
+                     const String& currentVersion, bool spiffs);
+    void addRequestHeaders(HTTPClient& http, const String& currentVersion, bool spiffs);
 
     int _lastError;
     bool _rebootOnUpdate = true;
+    uint8_t _resumeRetries = HTTP_UPDATE_RESUME_RETRIES;
 private:
     int _httpClientTimeout;
 
@@ -44,17 +44,39 @@ R"(<!DOCTYPE html>
 static const char successResponse[] PROGMEM =
 "<META http-equiv=\"refresh\" content=\"15;URL=/\">Update Success! Rebooting...";
 
+#ifndef HTTP_UPDATE_SERVER_DOT_BYTES
+#define HTTP_UPDATE_SERVER_DOT_BYTES 65536 //a dot on the debug output for each
+#endif
+
+/*
+ * The upload is flashed by the pipelined Update writer: a task erases and
+ * writes one sector while the next is read from the connection, so TCP keeps
+ * flowing instead of stalling on each erase. The progress callback gets the
+ * bytes flashed so far and the size of the form, which is a little more than
+ * the file. The response tells the size, time and throughput of the upload.
+ */
 class HTTPUpdateServer
 {
 public:
+    typedef std::function<void(size_t done, size_t total)> THandlerFunction_Progress;
+
     HTTPUpdateServer(bool serial_debug=false) {
         _serial_output = serial_debug;
         _server = NULL;
         _username = emptyString;
         _password = emptyString;
         _authenticated = false;
+        _pipelined = true;
+        _uploadStart = 0;
+        _uploadTime = 0;
+        _uploadSize = 0;
     }
 
+    // called from the upload handler, keep it short
+    void onProgress(THandlerFunction_Progress fn) { _progress = fn; }
+    // false writes each chunk in the handler, for partitions too tight for the second buffer
+    void setPipelined(bool pipelined) { _pipelined = pipelined; }
+
     void setup(WebServer *server)
     {
         setup(server, emptyString, emptyString);
@@ -92,8 +114,16 @@ public:
                 _server->send(200, F("text/html"), String(F("Update error: ")) + _updaterError);
             }
             else {
+                String response = FPSTR(successResponse);
+                response += F("<br>");
+                response += _uploadSize;
+                response += F(" bytes in ");
+                response += _uploadTime;
+                response += F(" ms, ");
+                response += _uploadTime ? (uint32_t)((uint64_t)_uploadSize * 1000 / 1024 / _uploadTime) : 0;
+                response += F(" KB/s");
                 _server->client().setNoDelay(true);
-                _server->send_P(200, PSTR("text/html"), successResponse);
+                _server->send(200, F("text/html"), response);
                 delay(100);
                 _server->client().stop();
                 ESP.restart();
@@ -117,6 +147,10 @@ public:
 
                     if (_serial_output)
                         Serial.printf("Update: %s\n", upload.filename.c_str());
+                    _uploadStart = millis();
+                    _uploadTime = 0;
+                    _uploadSize = 0;
+                    Update.setPipelined(_pipelined);
                     if (upload.name == "filesystem") {
                         if (!Update.begin(SPIFFS.totalBytes(), U_SPIFFS)) {//start with max available size
                             if (_serial_output) Update.printError(Serial);
@@ -130,14 +164,23 @@ public:
                     }
                 }
                 else if (_authenticated && upload.status == UPLOAD_FILE_WRITE && !_updaterError.length()) {
-                    if (_serial_output) Serial.printf(".");
                     if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
                         _setUpdaterError();
                     }
+                    size_t done = upload.totalSize + upload.currentSize;
+                    if (_serial_output && done / HTTP_UPDATE_SERVER_DOT_BYTES != upload.totalSize / HTTP_UPDATE_SERVER_DOT_BYTES)
+                        Serial.printf(".");
+                    if (_progress)
+                        _progress(done, upload.contentLength);
                 }
                 else if (_authenticated && upload.status == UPLOAD_FILE_END && !_updaterError.length()) {
+                    // end() waits for the writer task to flash the rest
                     if (Update.end(true)) { //true to set the size to the current progress
-                        if (_serial_output) Serial.printf("Update Success: %u\nRebooting...\n", upload.totalSize);
+                        _uploadTime = millis() - _uploadStart;
+                        _uploadSize = upload.totalSize;
+                        if (_progress)
+                            _progress(upload.totalSize, upload.totalSize);
+                        if (_serial_output) Serial.printf("Update Success: %u in %u ms\nRebooting...\n", upload.totalSize, _uploadTime);
                     }
                     else {
                         _setUpdaterError();
@@ -173,7 +216,12 @@ private:
     String _username;
     String _password;
     bool _authenticated;
+    bool _pipelined;
     String _updaterError;
+    THandlerFunction_Progress _progress;
+    uint32_t _uploadStart;
+    uint32_t _uploadTime;   // ms, of the last update that succeeded
+    size_t _uploadSize;
 };
 
 
@@ -0,0 +1,43 @@
+/*
+ * Samples pin 32 with the built-in ADC through I2S at 40 kHz and prints
+ * the average of every DMA buffer. The buffers are handed to the callback
+ * from the I2S task as soon as the DMA filled them, without a copy.
+ */
+#include <I2S.h>
+
+#define ADC_PIN 32
+#define SAMPLE_RATE 40000
+
+volatile uint32_t lastAverage = 0;
+volatile uint32_t buffers = 0;
+
+void setup() {
+  Serial.begin(115200);
+
+  I2S.setAdcPin(ADC_PIN);
+  I2S.setBuffers(4, 512);
+  I2S.onBuffer([](i2s_event_type_t event, const uint8_t* data, size_t len) {
+    if (event != I2S_EVENT_RX_DONE) {
+      return;
+    }
+    // 12 bit readings, the high 4 bits carry the channel
+    const uint16_t* samples = (const uint16_t*)data;
+    size_t count = len / sizeof(uint16_t);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+      sum += samples[i] & 0x0FFF;
+    }
+    lastAverage = sum / count;
+    buffers++;
+  });
+  if (!I2S.begin(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN, SAMPLE_RATE)) {
+    Serial.println("I2S failed to start");
+  }
+}
+
+void loop() {
+  i2s_hal_stats_t stats;
+  I2S.getStats(&stats);
+  Serial.printf("buffers: %u average: %u overruns: %u\n", buffers, lastAverage, stats.rxOverruns);
+  delay(1000);
+}
@@ -0,0 +1,208 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "I2S.h"
+
+I2SClass::I2SClass(uint8_t port)
+    : _port(port)
+    , _bus(NULL)
+    , _rxBlock(NULL)
+    , _rxLen(0)
+    , _rxPos(0)
+    , _writeTimeout(1000)
+{
+    i2sDefaultConfig(&_config);
+}
+
+I2SClass::~I2SClass()
+{
+    end();
+}
+
+void I2SClass::setPins(int8_t bck, int8_t ws, int8_t dout, int8_t din)
+{
+    _config.bckPin = bck;
+    _config.wsPin = ws;
+    _config.doutPin = dout;
+    _config.dinPin = din;
+}
+
+void I2SClass::setBuffers(uint8_t count, uint16_t frames, uint8_t rxBlocks)
+{
+    _config.dmaBufCount = count;
+    _config.dmaBufLen = frames;
+    _config.rxBlocks = rxBlocks;
+}
+
+/**
+ * Start the port
+ * @param mode I2S_MODE_MASTER or I2S_MODE_SLAVE with I2S_MODE_TX and/or I2S_MODE_RX,
+ *             or the built-in ADC/DAC modes
+ */
+bool I2SClass::begin(int mode, uint32_t sampleRate, i2s_bits_per_sample_t bits, bool stereo)
+{
+    _config.mode = (i2s_mode_t)mode;
+    _config.sampleRate = sampleRate;
+    _config.bitsPerSample = bits;
+    _config.channelFormat = stereo ? I2S_CHANNEL_FMT_RIGHT_LEFT : I2S_CHANNEL_FMT_ONLY_LEFT;
+    if(mode & (I2S_MODE_ADC_BUILT_IN | I2S_MODE_DAC_BUILT_IN)) {
+        _config.commFormat = I2S_COMM_FORMAT_I2S_MSB;
+    }
+    return begin(_config);
+}
+
+bool I2SClass::begin(const i2s_hal_config_t& config)
+{
+    end();
+    _config = config;
+    _bus = i2sBegin(_port, &_config);
+    if(!_bus) {
+        return false;
+    }
+    if(_onBuffer) {
+        i2sOnBuffer(_bus, _bufferCb, this);
+    }
+    return true;
+}
+
+void I2SClass::end()
+{
+    if(!_bus) {
+        return;
+    }
+    i2sEnd(_bus);
+    // the blocks went with the pool
+    _bus = NULL;
+    _rxBlock = NULL;
+    _rxLen = _rxPos = 0;
+}
+
+bool I2SClass::setSampleRate(uint32_t rate)
+{
+    _config.sampleRate = rate;
+    return !_bus || i2sSetSampleRate(_bus, rate);
+}
+
+size_t I2SClass::bufferSize()
+{
+    return i2sBufferSize(_bus);
+}
+
+/**
+ * Take the oldest received DMA buffer, it stays valid until releaseBuffer()
+ */
+const uint8_t* I2SClass::readBuffer(size_t* len, uint32_t timeout_ms)
+{
+    return i2sReadBuffer(_bus, len, timeout_ms);
+}
+
+void I2SClass::releaseBuffer(const uint8_t* buffer)
+{
+    i2sReleaseBuffer(_bus, buffer);
+}
+
+void I2SClass::_bufferCb(void* arg, i2s_event_type_t event, const uint8_t* data, size_t len)
+{
+    I2SClass* self = (I2SClass*)arg;
+    if(self->_onBuffer) {
+        self->_onBuffer(event, data, len);
+    }
+}
+
+void I2SClass::onBuffer(I2SBufferCb cb)
+{
+    if(_bus) {
+        // no new calls into the old one while it is replaced
+        i2sOnBuffer(_bus, NULL, NULL);
+    }
+    _onBuffer = cb;
+    if(_bus && _onBuffer) {
+        i2sOnBuffer(_bus, _bufferCb, this);
+    }
+}
+
+bool I2SClass::_nextBlock(uint32_t timeout_ms)
+{
+    if(_rxBlock && _rxPos < _rxLen) {
+        return true;
+    }
+    if(_rxBlock) {
+        i2sReleaseBuffer(_bus, _rxBlock);
+        _rxBlock = NULL;
+    }
+    _rxBlock = i2sReadBuffer(_bus, &_rxLen, timeout_ms);
+    _rxPos = 0;
+    return _rxBlock != NULL;
+}
+
+int I2SClass::available()
+{
+    if(!_bus) {
+        return 0;
+    }
+    size_t current = _rxBlock ? _rxLen - _rxPos : 0;
+    return current + i2sBuffersAvailable(_bus) * i2sBufferSize(_bus);
+}
+
+int I2SClass::read()
+{
+    if(!_bus || !_nextBlock(0)) {
+        return -1;
+    }
+    return _rxBlock[_rxPos++];
+}
+
+int I2SClass::peek()
+{
+    if(!_bus || !_nextBlock(0)) {
+        return -1;
+    }
+    return _rxBlock[_rxPos];
+}
+
+size_t I2SClass::readBytes(char* buffer, size_t length)
+{
+    size_t done = 0;
+    while(_bus && done < length && _nextBlock(_timeout)) {
+        size_t n = _rxLen - _rxPos;
+        if(n > length - done) {
+            n = length - done;
+        }
+        memcpy(buffer + done, _rxBlock + _rxPos, n);
+        _rxPos += n;
+        done += n;
+    }
+    return done;
+}
+
+void I2SClass::flush()
+{
+    // nothing to wait for, the DMA sends continuously and silence once the written data ran out
+}
+
+size_t I2SClass::write(const uint8_t* buffer, size_t size)
+{
+    return i2sWrite(_bus, buffer, size, _writeTimeout);
+}
+
+void I2SClass::getStats(i2s_hal_stats_t* stats)
+{
+    if(!_bus) {
+        memset(stats, 0, sizeof(i2s_hal_stats_t));
+        return;
+    }
+    i2sGetStats(_bus, stats);
+}
+
+I2SClass I2S(0);
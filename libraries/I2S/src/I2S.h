@@ -0,0 +1,97 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _I2S_H_
+#define _I2S_H_
+
+#include <functional>
+#include "Arduino.h"
+#include "esp32-hal-i2s.h"
+
+// data is NULL for sent buffers, a received one is valid until the callback returns
+typedef std::function<void(i2s_event_type_t event, const uint8_t* data, size_t len)> I2SBufferCb;
+
+/*
+ * I2S as a Stream, or a DMA buffer at a time:
+ *
+ *   I2S.setPins(26, 25, 22, 35);
+ *   I2S.begin(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_RX, 48000);
+ *   I2S.write(samples, sizeof(samples));
+ *
+ *   size_t len;
+ *   const uint8_t* buffer = I2S.readBuffer(&len, 100);   // a received DMA buffer, no copy
+ *   ...
+ *   I2S.releaseBuffer(buffer);
+ *
+ * onBuffer() sees every buffer the DMA completed, from the I2S task; while it is
+ * set, received buffers go to it and not to read()/readBuffer(). Set it before
+ * begin(), the task may be in the callback when it is replaced later.
+ */
+class I2SClass : public Stream
+{
+public:
+    I2SClass(uint8_t port);
+    ~I2SClass();
+
+    // before begin(), -1 for the pins not used
+    void setPins(int8_t bck, int8_t ws, int8_t dout, int8_t din = -1);
+    // DMA buffers and their length in frames, rxBlocks is how many received ones can wait to be read
+    void setBuffers(uint8_t count, uint16_t frames, uint8_t rxBlocks = 0);
+    // the built-in ADC (I2S_MODE_ADC_BUILT_IN) samples this ADC1 pin
+    void setAdcPin(int8_t pin) { _config.adcPin = pin; }
+
+    bool begin(int mode, uint32_t sampleRate = 44100, i2s_bits_per_sample_t bits = I2S_BITS_PER_SAMPLE_16BIT, bool stereo = true);
+    bool begin(const i2s_hal_config_t& config);
+    void end();
+    operator bool() const { return _bus != NULL; }
+
+    bool setSampleRate(uint32_t rate);
+    size_t bufferSize();
+
+    const uint8_t* readBuffer(size_t* len, uint32_t timeout_ms = 0);
+    void releaseBuffer(const uint8_t* buffer);
+    void onBuffer(I2SBufferCb cb);
+
+    // timeout for write(), 0 returns what fit into the DMA buffers
+    void setWriteTimeout(uint32_t timeout_ms) { _writeTimeout = timeout_ms; }
+
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char* buffer, size_t length);
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+    void flush();
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+
+    void getStats(i2s_hal_stats_t* stats);
+
+private:
+    uint8_t _port;
+    i2s_hal_config_t _config;
+    i2s_t* _bus;
+    const uint8_t* _rxBlock;    // the block read() is in
+    size_t _rxLen;
+    size_t _rxPos;
+    uint32_t _writeTimeout;
+    I2SBufferCb _onBuffer;
+
+    static void _bufferCb(void* arg, i2s_event_type_t event, const uint8_t* data, size_t len);
+    bool _nextBlock(uint32_t timeout_ms);
+};
+
+extern I2SClass I2S;
+
+#endif /* _I2S_H_ */
@@ -0,0 +1,49 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _LITTLEFS_H_
+#define _LITTLEFS_H_
+
+#include "FS.h"
+
+#ifndef CONFIG_LITTLEFS_PAGE_SIZE
+#error "LittleFS needs the esp_littlefs component in the build"
+#endif
+
+namespace fs
+{
+
+class LittleFSFS : public FS
+{
+public:
+    LittleFSFS();
+    ~LittleFSFS();
+    // mounts the "spiffs" partition by default, so the tables in tools/partitions work unchanged;
+    // maxOpenFiles is kept for SPIFFS compatibility, esp_littlefs has no limit
+    bool begin(bool formatOnFail=false, const char * basePath="/littlefs", uint8_t maxOpenFiles=10, const char * partitionLabel="spiffs");
+    bool format();
+    size_t totalBytes();
+    size_t usedBytes();
+    void end();
+
+private:
+    char * partitionLabel_;
+};
+
+}
+
+extern fs::LittleFSFS LittleFS;
+
+
+#endif
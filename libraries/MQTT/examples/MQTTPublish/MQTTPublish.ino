@@ -0,0 +1,94 @@
+/*
+ * Streams sensor samples to a MQTT broker.
+ *
+ * Samples are published with QoS1 from a ring of buffers; each buffer is only
+ * reused once the broker acknowledged it, so nothing is ever copied. Commands
+ * sent to "esp32/cmd" are printed.
+ */
+#include <WiFi.h>
+#include <MQTTClient.h>
+
+#define SLOTS 8 // buffers in the ring, also the in-flight window
+
+const char* ssid     = "your-ssid";
+const char* password = "your-password";
+const char* broker   = "192.168.1.10";
+
+WiFiClient net;
+MQTTClient mqtt(net);
+
+uint8_t samples[SLOTS][64];
+uint16_t slotId[SLOTS];     // packet id the slot is waiting for, 0 when free
+uint8_t nextSlot = 0;
+
+void onMessage(const char* topic, const uint8_t* payload, size_t length)
+{
+    Serial.printf("%s: %.*s\n", topic, (int)length, (const char*)payload);
+}
+
+void onPublished(uint16_t packetId, uint8_t reason)
+{
+    for (int i = 0; i < SLOTS; i++) {
+        if (slotId[i] == packetId) {
+            slotId[i] = 0;
+        }
+    }
+}
+
+void reconnect()
+{
+    while (!mqtt.connected()) {
+        Serial.print("MQTT connect... ");
+        if (mqtt.connect("esp32-sampler", NULL, NULL, MQTT_V5)) {
+            Serial.println("ok");
+            mqtt.subscribe("esp32/cmd", 1);
+        } else {
+            Serial.println("failed");
+            delay(2000);
+        }
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+        Serial.print(".");
+    }
+    Serial.println();
+
+    mqtt.setServer(broker);
+    mqtt.setInflightWindow(SLOTS);
+    mqtt.onMessage(onMessage);
+    mqtt.onPublished(onPublished);
+}
+
+void loop()
+{
+    reconnect();
+    mqtt.loop();
+
+    static uint32_t last = 0;
+    if (millis() - last >= 100 && !slotId[nextSlot]) {
+        last = millis();
+        uint8_t* sample = samples[nextSlot];
+        for (int i = 0; i < 32; i++) {
+            uint16_t value = analogRead(36);
+            sample[2 * i] = value >> 8;
+            sample[2 * i + 1] = value;
+        }
+        slotId[nextSlot] = mqtt.publish("esp32/samples", sample, sizeof(samples[0]), 1);
+        nextSlot = (nextSlot + 1) % SLOTS;
+    }
+
+    static uint32_t lastStats = 0;
+    if (millis() - lastStats >= 10000) {
+        lastStats = millis();
+        mqtt_stats_t stats;
+        mqtt.getStats(&stats);
+        Serial.printf("published %u, acked %u, in flight %u, aliased %u\n",
+                      stats.published, stats.acknowledged, stats.inflight, stats.aliased);
+    }
+}
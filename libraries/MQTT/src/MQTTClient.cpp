@@ -0,0 +1,964 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "MQTTClient.h"
+
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_PUBREC      0x50
+#define MQTT_PUBREL      0x62
+#define MQTT_PUBCOMP     0x70
+#define MQTT_SUBSCRIBE   0x82
+#define MQTT_SUBACK      0x90
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_UNSUBACK    0xB0
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+#define MQTT_PROP_RECEIVE_MAX     0x21
+#define MQTT_PROP_TOPIC_ALIAS_MAX 0x22
+#define MQTT_PROP_TOPIC_ALIAS     0x23
+#define MQTT_PROP_MAX_PACKET      0x27
+#define MQTT_PROP_SESSION_EXPIRY  0x11
+#define MQTT_PROP_KEEP_ALIVE      0x13
+
+#define MQTT_HEADER_SIZE 128 // fixed header, topic and properties written in one go when they fit
+
+#define MQTT_RX_HEADER 0
+#define MQTT_RX_LENGTH 1
+#define MQTT_RX_BODY   2
+
+static size_t _putLength(uint8_t* p, size_t length)
+{
+    size_t n = 0;
+    do {
+        uint8_t b = length & 0x7F;
+        length >>= 7;
+        p[n++] = b | (length ? 0x80 : 0);
+    } while(length);
+    return n;
+}
+
+static size_t _lengthSize(size_t length)
+{
+    return (length < 128) ? 1 : (length < 16384) ? 2 : (length < 2097152) ? 3 : 4;
+}
+
+static size_t _put16(uint8_t* p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value;
+    return 2;
+}
+
+static size_t _putString(uint8_t* p, const void* data, size_t length)
+{
+    _put16(p, length);
+    memcpy(p + 2, data, length);
+    return length + 2;
+}
+
+static uint16_t _get16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+// reads a variable byte integer, false if it runs past end
+static bool _getLength(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 28; shift += 7) {
+        if(p >= end) {
+            return false;
+        }
+        uint8_t b = *p++;
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// steps over one MQTT 5 property, value holds it when it is a number
+static bool _nextProperty(const uint8_t*& p, const uint8_t* end, uint8_t& id, uint32_t& value)
+{
+    if(p >= end) {
+        return false;
+    }
+    id = *p++;
+    value = 0;
+    size_t size;
+    switch(id) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+        size = 1;
+        break;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+        size = 2;
+        break;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+        size = 4;
+        break;
+    case 0x0B:
+        return _getLength(p, end, value);
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+        if(end - p < 2 || (size_t)(end - p) < 2 + _get16(p)) {
+            return false;
+        }
+        p += 2 + _get16(p);
+        return true;
+    case 0x26:
+        for(int i = 0; i < 2; i++) {
+            if(end - p < 2 || (size_t)(end - p) < 2 + _get16(p)) {
+                return false;
+            }
+            p += 2 + _get16(p);
+        }
+        return true;
+    default:
+        log_w("unknown property 0x%02x", id);
+        return false;
+    }
+    if((size_t)(end - p) < size) {
+        return false;
+    }
+    while(size--) {
+        value = (value << 8) | *p++;
+    }
+    return true;
+}
+
+MQTTClient::MQTTClient(Client& client)
+    : _client(client)
+    , _port(MQTT_PORT)
+    , _state(MQTT_DISCONNECTED)
+    , _version(MQTT_V311)
+    , _keepAlive(MQTT_KEEPALIVE)
+    , _keepAliveUsed(MQTT_KEEPALIVE)
+    , _cleanSession(true)
+    , _maxPacket(0)
+    , _willPayload(NULL)
+    , _willLength(0)
+    , _willQos(0)
+    , _willRetain(false)
+    , _rx(NULL)
+    , _rxSize(MQTT_RX_BUFFER_SIZE)
+    , _rxLength(0)
+    , _rxPos(0)
+    , _rxHeader(0)
+    , _rxStage(MQTT_RX_HEADER)
+    , _rxShift(0)
+    , _rxSkip(false)
+    , _nextId(0)
+    , _window(MQTT_INFLIGHT_WINDOW)
+    , _serverWindow(0xFFFF)
+    , _aliasMax(0)
+    , _lastOut(0)
+    , _lastIn(0)
+    , _pingPending(false)
+    , _onMessage(NULL)
+    , _onPublished(NULL)
+    , _onConnection(NULL)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+MQTTClient::~MQTTClient()
+{
+    if(_state != MQTT_DISCONNECTED) {
+        disconnect();
+    }
+    for(outgoing_t* msg : _inflight) {
+        _free(msg);
+    }
+    for(outgoing_t* msg : _queue) {
+        _free(msg);
+    }
+    free(_rx);
+    free(_willPayload);
+}
+
+void MQTTClient::setServer(const char* host, uint16_t port)
+{
+    _host = host;
+    _ip = IPAddress();
+    _port = port;
+}
+
+void MQTTClient::setServer(IPAddress ip, uint16_t port)
+{
+    _host = "";
+    _ip = ip;
+    _port = port;
+}
+
+void MQTTClient::setKeepAlive(uint16_t seconds)
+{
+    _keepAlive = seconds;
+}
+
+void MQTTClient::setCleanSession(bool clean)
+{
+    _cleanSession = clean;
+}
+
+void MQTTClient::setWill(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain)
+{
+    free(_willPayload);
+    _willPayload = NULL;
+    _willLength = 0;
+    _willTopic = topic ? topic : "";
+    if(length) {
+        _willPayload = (uint8_t*)malloc(length);
+        if(!_willPayload) {
+            log_e("no memory for the will");
+            _willTopic = "";
+            return;
+        }
+        memcpy(_willPayload, payload, length);
+        _willLength = length;
+    }
+    _willQos = qos > 2 ? 2 : qos;
+    _willRetain = retain;
+}
+
+void MQTTClient::setInflightWindow(uint16_t window)
+{
+    _window = window ? window : 1;
+}
+
+bool MQTTClient::setBufferSize(size_t size)
+{
+    if(_rxStage != MQTT_RX_HEADER) {
+        log_e("a packet is being read");
+        return false;
+    }
+    if(_rx) {
+        uint8_t* rx = (uint8_t*)realloc(_rx, size);
+        if(!rx) {
+            log_e("no memory for %u bytes", size);
+            return false;
+        }
+        _rx = rx;
+    }
+    _rxSize = size;
+    return true;
+}
+
+bool MQTTClient::connect(const char* clientId, const char* user, const char* pass, mqtt_version_t version)
+{
+    if(_state != MQTT_DISCONNECTED) {
+        disconnect();
+    }
+    if(!_rx) {
+        _rx = (uint8_t*)malloc(_rxSize);
+        if(!_rx) {
+            log_e("no memory for the receive buffer");
+            return false;
+        }
+    }
+    if(!clientId) {
+        clientId = "";
+    }
+    _version = version;
+
+    int ok = _host.length() ? _client.connect(_host.c_str(), _port) : _client.connect(_ip, _port);
+    if(!ok) {
+        log_e("connect to %s:%u failed", _host.length() ? _host.c_str() : _ip.toString().c_str(), _port);
+        return false;
+    }
+
+    bool v5 = version == MQTT_V5;
+    bool will = _willTopic.length() != 0;
+    bool expiry = v5 && !_cleanSession;
+    size_t idLength = strlen(clientId);
+    size_t userLength = user ? strlen(user) : 0;
+    size_t passLength = pass ? strlen(pass) : 0;
+
+    size_t remaining = 10 + 2 + idLength;
+    if(v5) {
+        remaining += 1 + (expiry ? 5 : 0);
+    }
+    if(will) {
+        remaining += (v5 ? 1 : 0) + 2 + _willTopic.length() + 2 + _willLength;
+    }
+    if(user) {
+        remaining += 2 + userLength;
+    }
+    if(pass) {
+        remaining += 2 + passLength;
+    }
+
+    uint8_t* packet = (uint8_t*)malloc(5 + remaining);
+    if(!packet) {
+        log_e("no memory for CONNECT");
+        _client.stop();
+        return false;
+    }
+    uint8_t flags = _cleanSession ? 0x02 : 0;
+    if(will) {
+        flags |= 0x04 | (_willQos << 3) | (_willRetain ? 0x20 : 0);
+    }
+    if(user) {
+        flags |= 0x80;
+    }
+    if(pass) {
+        flags |= 0x40;
+    }
+
+    uint8_t* p = packet;
+    *p++ = MQTT_CONNECT;
+    p += _putLength(p, remaining);
+    p += _putString(p, "MQTT", 4);
+    *p++ = version;
+    *p++ = flags;
+    p += _put16(p, _keepAlive);
+    if(v5) {
+        *p++ = expiry ? 5 : 0;
+        if(expiry) {
+            *p++ = MQTT_PROP_SESSION_EXPIRY;
+            uint32_t seconds = MQTT_SESSION_EXPIRY;
+            p += _put16(p, seconds >> 16);
+            p += _put16(p, seconds);
+        }
+    }
+    p += _putString(p, clientId, idLength);
+    if(will) {
+        if(v5) {
+            *p++ = 0;
+        }
+        p += _putString(p, _willTopic.c_str(), _willTopic.length());
+        p += _putString(p, _willPayload, _willLength);
+    }
+    if(user) {
+        p += _putString(p, user, userLength);
+    }
+    if(pass) {
+        p += _putString(p, pass, passLength);
+    }
+
+    _state = MQTT_CONNECTING;
+    _rxStage = MQTT_RX_HEADER;
+    bool sent = _write(packet, p - packet);
+    free(packet);
+    if(!sent) {
+        return false;
+    }
+
+    uint32_t start = millis();
+    while(_state == MQTT_CONNECTING) {
+        uint32_t elapsed = millis() - start;
+        if(elapsed >= MQTT_CONNECT_TIMEOUT || !_client.connected()) {
+            log_e("no CONNACK from the server");
+            _close(0);
+            return false;
+        }
+        if(_readPacket(MQTT_CONNECT_TIMEOUT - elapsed)) {
+            _handlePacket();
+        }
+    }
+    if(_state != MQTT_CONNECTED) {
+        return false;
+    }
+    _drainQueue();
+    return _state == MQTT_CONNECTED;
+}
+
+void MQTTClient::disconnect()
+{
+    if(_state == MQTT_DISCONNECTED) {
+        return;
+    }
+    // remaining length 0 is reason code 0, normal disconnection, on MQTT 5 as well
+    uint8_t packet[2] = { MQTT_DISCONNECT, 0 };
+    _client.write(packet, 2);
+    _close(0);
+}
+
+bool MQTTClient::connected()
+{
+    if(_state == MQTT_CONNECTED && !_client.connected()) {
+        _close(0);
+    }
+    return _state == MQTT_CONNECTED;
+}
+
+uint16_t MQTTClient::_takeId()
+{
+    while(true) {
+        if(++_nextId == 0) {
+            _nextId = 1;
+        }
+        bool used = false;
+        for(outgoing_t* msg : _inflight) {
+            if(msg->id == _nextId) {
+                used = true;
+                break;
+            }
+        }
+        for(size_t i = 0; !used && i < _queue.size(); i++) {
+            used = _queue[i]->id == _nextId;
+        }
+        if(!used) {
+            return _nextId;
+        }
+    }
+}
+
+bool MQTTClient::_write(const uint8_t* data, size_t length)
+{
+    if(_client.write(data, length) != length) {
+        log_e("write failed");
+        _close(0);
+        return false;
+    }
+    _lastOut = millis();
+    return true;
+}
+
+bool MQTTClient::_sendPublish(outgoing_t* msg)
+{
+    bool v5 = _version == MQTT_V5;
+    uint16_t alias = 0;
+    bool sendTopic = true;
+    if(_aliasMax) {
+        for(size_t i = 0; i < _aliases.size(); i++) {
+            if(_aliases[i] == msg->topic) {
+                alias = i + 1;
+                sendTopic = false;
+                break;
+            }
+        }
+        if(!alias && _aliases.size() < _aliasMax) {
+            _aliases.push_back(msg->topic);
+            alias = _aliases.size();
+        }
+    }
+
+    size_t topicLength = sendTopic ? msg->topic.length() : 0;
+    size_t properties = alias ? 3 : 0;
+    size_t head = 2 + topicLength + (msg->qos ? 2 : 0) + (v5 ? _lengthSize(properties) + properties : 0);
+    size_t remaining = head + msg->length;
+    if(_maxPacket && 1 + _lengthSize(remaining) + remaining > _maxPacket) {
+        log_e("%u bytes are more than the server takes", 1 + _lengthSize(remaining) + remaining);
+        return false;
+    }
+
+    uint8_t header[MQTT_HEADER_SIZE];
+    uint8_t* p = header;
+    *p++ = MQTT_PUBLISH | (msg->dup ? 0x08 : 0) | (msg->qos << 1) | (msg->retain ? 0x01 : 0);
+    p += _putLength(p, remaining);
+    p += _put16(p, topicLength);
+
+    // a topic too long for the header buffer is written on its own
+    if((size_t)(p - header) + head > sizeof(header)) {
+        if(!_write(header, p - header) || !_write((const uint8_t*)msg->topic.c_str(), topicLength)) {
+            return false;
+        }
+        p = header;
+    } else {
+        memcpy(p, msg->topic.c_str(), topicLength);
+        p += topicLength;
+    }
+    if(msg->qos) {
+        p += _put16(p, msg->id);
+    }
+    if(v5) {
+        p += _putLength(p, properties);
+        if(alias) {
+            *p++ = MQTT_PROP_TOPIC_ALIAS;
+            p += _put16(p, alias);
+        }
+    }
+    if(p > header && !_write(header, p - header)) {
+        return false;
+    }
+    if(msg->length && !_write(msg->payload, msg->length)) {
+        return false;
+    }
+    _stats.published++;
+    if(!sendTopic) {
+        _stats.aliased++;
+    }
+    return true;
+}
+
+bool MQTTClient::_sendAck(uint8_t type, uint16_t id)
+{
+    // MQTT 5 leaves the reason code out when it is 0, success
+    uint8_t packet[4] = { type, 2 };
+    _put16(packet + 2, id);
+    return _write(packet, 4);
+}
+
+uint16_t MQTTClient::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain, bool copy)
+{
+    if(!topic || !*topic) {
+        log_e("no topic");
+        return 0;
+    }
+    if(qos > 1) {
+        log_w("QoS%u is not supported, publishing with QoS1", qos);
+        qos = 1;
+    }
+    if(!qos) {
+        if(_state != MQTT_CONNECTED) {
+            _stats.rejected++;
+            return 0;
+        }
+        outgoing_t msg;
+        msg.id = 0;
+        msg.qos = 0;
+        msg.retain = retain;
+        msg.dup = false;
+        msg.topic = topic;
+        msg.payload = payload;
+        msg.owned = NULL;
+        msg.length = length;
+        return _sendPublish(&msg) ? 1 : 0;
+    }
+
+    if(_queue.size() >= MQTT_QUEUE_SIZE) {
+        log_w("publish queue is full");
+        _stats.rejected++;
+        return 0;
+    }
+    outgoing_t* msg = new outgoing_t;
+    msg->qos = 1;
+    msg->retain = retain;
+    msg->dup = false;
+    msg->topic = topic;
+    msg->payload = payload;
+    msg->owned = NULL;
+    msg->length = length;
+    if(copy && length) {
+        msg->owned = (uint8_t*)malloc(length);
+        if(!msg->owned) {
+            log_e("no memory to copy %u bytes", length);
+            delete msg;
+            _stats.rejected++;
+            return 0;
+        }
+        memcpy(msg->owned, payload, length);
+        msg->payload = msg->owned;
+    }
+    msg->id = _takeId();
+    _queue.push_back(msg);
+    _drainQueue();
+    return msg->id;
+}
+
+uint16_t MQTTClient::publish(const char* topic, const char* payload, uint8_t qos, bool retain, bool copy)
+{
+    return publish(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, qos, retain, copy);
+}
+
+uint16_t MQTTClient::subscribe(const char* topic, uint8_t qos)
+{
+    if(_state != MQTT_CONNECTED || !topic || !*topic) {
+        return 0;
+    }
+    bool v5 = _version == MQTT_V5;
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + (v5 ? 1 : 0) + 2 + topicLength + 1;
+    uint8_t* packet = (uint8_t*)malloc(5 + remaining);
+    if(!packet) {
+        log_e("no memory for SUBSCRIBE");
+        return 0;
+    }
+    uint16_t id = _takeId();
+    uint8_t* p = packet;
+    *p++ = MQTT_SUBSCRIBE;
+    p += _putLength(p, remaining);
+    p += _put16(p, id);
+    if(v5) {
+        *p++ = 0;
+    }
+    p += _putString(p, topic, topicLength);
+    *p++ = qos > 2 ? 2 : qos;
+    bool sent = _write(packet, p - packet);
+    free(packet);
+    return sent ? id : 0;
+}
+
+uint16_t MQTTClient::unsubscribe(const char* topic)
+{
+    if(_state != MQTT_CONNECTED || !topic || !*topic) {
+        return 0;
+    }
+    bool v5 = _version == MQTT_V5;
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + (v5 ? 1 : 0) + 2 + topicLength;
+    uint8_t* packet = (uint8_t*)malloc(5 + remaining);
+    if(!packet) {
+        log_e("no memory for UNSUBSCRIBE");
+        return 0;
+    }
+    uint16_t id = _takeId();
+    uint8_t* p = packet;
+    *p++ = MQTT_UNSUBSCRIBE;
+    p += _putLength(p, remaining);
+    p += _put16(p, id);
+    if(v5) {
+        *p++ = 0;
+    }
+    p += _putString(p, topic, topicLength);
+    bool sent = _write(packet, p - packet);
+    free(packet);
+    return sent ? id : 0;
+}
+
+void MQTTClient::_drainQueue()
+{
+    uint16_t window = _window < _serverWindow ? _window : _serverWindow;
+    while(_state == MQTT_CONNECTED && !_queue.empty() && _inflight.size() < window) {
+        outgoing_t* msg = _queue.front();
+        if(!_sendPublish(msg)) {
+            if(_state == MQTT_CONNECTED) {
+                // the server would never take it, give up on it
+                _queue.pop_front();
+                if(_onPublished) {
+                    _onPublished(msg->id, 0x95);
+                }
+                _free(msg);
+            }
+            continue;
+        }
+        _queue.pop_front();
+        _inflight.push_back(msg);
+    }
+}
+
+bool MQTTClient::loop()
+{
+    if(_state != MQTT_CONNECTED) {
+        return false;
+    }
+    if(!_client.connected()) {
+        log_w("connection lost");
+        _close(0);
+        return false;
+    }
+    while(_state == MQTT_CONNECTED && _readPacket(0)) {
+        _handlePacket();
+    }
+    if(_state != MQTT_CONNECTED) {
+        return false;
+    }
+
+    if(_keepAliveUsed) {
+        uint32_t now = millis();
+        uint32_t interval = _keepAliveUsed * 1000UL;
+        if(_pingPending && (now - _lastIn) > interval + interval / 2) {
+            log_e("no answer from the server in %u s", _keepAliveUsed + _keepAliveUsed / 2);
+            _close(0);
+            return false;
+        }
+        if(!_pingPending && (now - _lastOut) >= interval) {
+            uint8_t packet[2] = { MQTT_PINGREQ, 0 };
+            if(!_write(packet, 2)) {
+                return false;
+            }
+            _pingPending = true;
+        }
+    }
+    _drainQueue();
+    return _state == MQTT_CONNECTED;
+}
+
+// reads what the client has, true once a whole packet is in _rx, waits up to timeout ms for it
+bool MQTTClient::_readPacket(uint32_t timeout)
+{
+    uint32_t start = millis();
+    while(true) {
+        int available = _client.available();
+        if(available <= 0) {
+            if(!timeout || (millis() - start) >= timeout || !_client.connected()) {
+                return false;
+            }
+            delay(1);
+            continue;
+        }
+        _lastIn = millis();
+
+        if(_rxStage != MQTT_RX_BODY) {
+            int c = _client.read();
+            if(c < 0) {
+                return false;
+            }
+            if(_rxStage == MQTT_RX_HEADER) {
+                _rxHeader = c;
+                _rxLength = 0;
+                _rxShift = 0;
+                _rxStage = MQTT_RX_LENGTH;
+                continue;
+            }
+            _rxLength |= (size_t)(c & 0x7F) << _rxShift;
+            _rxShift += 7;
+            if(c & 0x80) {
+                if(_rxShift >= 28) {
+                    log_e("malformed remaining length");
+                    _close(0x81);
+                    return false;
+                }
+                continue;
+            }
+            _rxStage = MQTT_RX_BODY;
+            _rxPos = 0;
+            _rxSkip = _rxLength > _rxSize;
+            if(_rxSkip) {
+                log_w("skipping a %u byte packet, the buffer has %u", _rxLength, _rxSize);
+            }
+        }
+
+        while(_rxPos < _rxLength && _client.available() > 0) {
+            size_t want = _rxLength - _rxPos;
+            int got;
+            if(_rxSkip) {
+                uint8_t scratch[64];
+                got = _client.read(scratch, want < sizeof(scratch) ? want : sizeof(scratch));
+            } else {
+                got = _client.read(_rx + _rxPos, want);
+            }
+            if(got <= 0) {
+                break;
+            }
+            _rxPos += got;
+        }
+        if(_rxPos < _rxLength) {
+            continue;
+        }
+        _rxStage = MQTT_RX_HEADER;
+        if(_rxSkip) {
+            if((_rxHeader & 0xF0) == MQTT_PUBLISH) {
+                _stats.received++;
+                _stats.skipped++;
+            }
+            continue;
+        }
+        return true;
+    }
+}
+
+void MQTTClient::_handlePacket()
+{
+    uint8_t type = _rxHeader & 0xF0;
+    if(_state == MQTT_CONNECTING) {
+        if(type == MQTT_CONNACK) {
+            _handleConnack();
+        } else {
+            log_w("packet 0x%02x before CONNACK", _rxHeader);
+        }
+        return;
+    }
+    switch(type) {
+    case MQTT_PUBLISH:
+        _handlePublish();
+        break;
+    case MQTT_PUBACK:
+        _handlePuback();
+        break;
+    case MQTT_PUBREL & 0xF0:
+        if(_rxLength >= 2) {
+            _sendAck(MQTT_PUBCOMP, _get16(_rx));
+        }
+        break;
+    case MQTT_SUBACK:
+    case MQTT_UNSUBACK: {
+        // MQTT 3.1.1 UNSUBACK has no codes, MQTT 5 puts properties first
+        const uint8_t* p = _rx + 2;
+        const uint8_t* end = _rx + _rxLength;
+        uint32_t properties = 0;
+        if(_version == MQTT_V5 && (!_getLength(p, end, properties) || (size_t)(end - p) < properties)) {
+            break;
+        }
+        for(p += properties; p < end; p++) {
+            if(*p >= 0x80) {
+                log_e("%s %u refused: 0x%02x", type == MQTT_SUBACK ? "subscription" : "unsubscribe", _get16(_rx), *p);
+            }
+        }
+        break;
+    }
+    case MQTT_PINGRESP:
+        _pingPending = false;
+        break;
+    case MQTT_DISCONNECT: {
+        uint8_t reason = _rxLength ? _rx[0] : 0;
+        log_w("server disconnected: 0x%02x", reason);
+        _close(reason);
+        break;
+    }
+    default:
+        log_w("unexpected packet 0x%02x", _rxHeader);
+        break;
+    }
+}
+
+void MQTTClient::_handleConnack()
+{
+    if(_rxLength < 2) {
+        _close(0x81);
+        return;
+    }
+    uint8_t reason = _rx[1];
+    if(reason) {
+        log_e("server refused the connection: 0x%02x", reason);
+        _close(reason);
+        return;
+    }
+
+    _keepAliveUsed = _keepAlive;
+    _serverWindow = 0xFFFF;
+    _aliasMax = 0;
+    _maxPacket = 0;
+    if(_version == MQTT_V5) {
+        const uint8_t* p = _rx + 2;
+        const uint8_t* end = _rx + _rxLength;
+        uint32_t length;
+        if(_getLength(p, end, length) && (size_t)(end - p) >= length) {
+            end = p + length;
+            uint8_t id;
+            uint32_t value;
+            while(p < end && _nextProperty(p, end, id, value)) {
+                if(id == MQTT_PROP_RECEIVE_MAX) {
+                    _serverWindow = value;
+                } else if(id == MQTT_PROP_TOPIC_ALIAS_MAX) {
+                    _aliasMax = value < MQTT_TOPIC_ALIAS_MAX ? value : MQTT_TOPIC_ALIAS_MAX;
+                } else if(id == MQTT_PROP_MAX_PACKET) {
+                    _maxPacket = value;
+                } else if(id == MQTT_PROP_KEEP_ALIVE) {
+                    _keepAliveUsed = value;
+                }
+            }
+        }
+    }
+    _aliases.clear();
+    _aliases.reserve(_aliasMax);
+    _pingPending = false;
+    _lastIn = _lastOut = millis();
+    _state = MQTT_CONNECTED;
+    log_i("connected, MQTT %s, window %u, %u topic aliases", _version == MQTT_V5 ? "5" : "3.1.1",
+          _window < _serverWindow ? _window : _serverWindow, _aliasMax);
+
+    // what was on the wire when the last connection went is sent again
+    for(outgoing_t* msg : _inflight) {
+        msg->dup = true;
+        if(_sendPublish(msg)) {
+            _stats.retransmitted++;
+        } else if(_state != MQTT_CONNECTED) {
+            return;
+        }
+    }
+    if(_onConnection) {
+        _onConnection(true, 0);
+    }
+}
+
+void MQTTClient::_handlePublish()
+{
+    uint8_t qos = (_rxHeader >> 1) & 0x03;
+    const uint8_t* p = _rx;
+    const uint8_t* end = _rx + _rxLength;
+    if(_rxLength < 2 || (size_t)(end - p) < 2 + _get16(p) + (qos ? 2 : 0)) {
+        log_e("malformed PUBLISH");
+        return;
+    }
+    size_t topicLength = _get16(p);
+    p += 2 + topicLength;
+    uint16_t id = 0;
+    if(qos) {
+        id = _get16(p);
+        p += 2;
+    }
+    if(_version == MQTT_V5) {
+        uint32_t properties;
+        if(!_getLength(p, end, properties) || (size_t)(end - p) < properties) {
+            log_e("malformed PUBLISH properties");
+            return;
+        }
+        p += properties;
+    }
+    _stats.received++;
+
+    // moving the topic over its length makes room for the terminator without touching the payload
+    memmove(_rx, _rx + 2, topicLength);
+    _rx[topicLength] = 0;
+    if(_onMessage) {
+        _onMessage((const char*)_rx, p, end - p);
+    }
+    if(qos == 1) {
+        _sendAck(MQTT_PUBACK, id);
+    } else if(qos == 2) {
+        _sendAck(MQTT_PUBREC, id);
+    }
+}
+
+void MQTTClient::_handlePuback()
+{
+    if(_rxLength < 2) {
+        return;
+    }
+    uint16_t id = _get16(_rx);
+    uint8_t reason = (_version == MQTT_V5 && _rxLength > 2) ? _rx[2] : 0;
+    for(size_t i = 0; i < _inflight.size(); i++) {
+        outgoing_t* msg = _inflight[i];
+        if(msg->id != id) {
+            continue;
+        }
+        _inflight.erase(_inflight.begin() + i);
+        _stats.acknowledged++;
+        if(reason >= 0x80) {
+            log_w("publish %u refused: 0x%02x", id, reason);
+        }
+        if(_onPublished) {
+            _onPublished(id, reason);
+        }
+        _free(msg);
+        return;
+    }
+    log_w("PUBACK for unknown packet %u", id);
+}
+
+void MQTTClient::_free(outgoing_t* msg)
+{
+    free(msg->owned);
+    delete msg;
+}
+
+void MQTTClient::_close(uint8_t reason)
+{
+    mqtt_state_t state = _state;
+    _state = MQTT_DISCONNECTED;
+    _rxStage = MQTT_RX_HEADER;
+    _pingPending = false;
+    _client.stop();
+    if(state == MQTT_CONNECTED && _onConnection) {
+        _onConnection(false, reason);
+    }
+}
+
+void MQTTClient::getStats(mqtt_stats_t* stats)
+{
+    if(!stats) {
+        return;
+    }
+    *stats = _stats;
+    stats->inflight = _inflight.size();
+    stats->queued = _queue.size();
+    stats->window = _window < _serverWindow ? _window : _serverWindow;
+    stats->aliases = _aliasMax;
+}
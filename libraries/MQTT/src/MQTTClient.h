@@ -0,0 +1,218 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MQTT_CLIENT_H_
+#define _MQTT_CLIENT_H_
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include "Arduino.h"
+#include "Client.h"
+
+#ifndef MQTT_PORT
+#define MQTT_PORT 1883
+#endif
+
+#ifndef MQTT_KEEPALIVE
+#define MQTT_KEEPALIVE 60 // seconds, 0 turns keep alive off
+#endif
+
+#ifndef MQTT_RX_BUFFER_SIZE
+#define MQTT_RX_BUFFER_SIZE 1024 // largest incoming packet, bigger ones are skipped
+#endif
+
+#ifndef MQTT_INFLIGHT_WINDOW
+#define MQTT_INFLIGHT_WINDOW 8 // QoS1 publishes sent ahead of their PUBACK
+#endif
+
+#ifndef MQTT_QUEUE_SIZE
+#define MQTT_QUEUE_SIZE 32 // QoS1 publishes waiting for room in the window
+#endif
+
+#ifndef MQTT_TOPIC_ALIAS_MAX
+#define MQTT_TOPIC_ALIAS_MAX 16 // MQTT 5 topic aliases used, the server may allow fewer
+#endif
+
+#ifndef MQTT_CONNECT_TIMEOUT
+#define MQTT_CONNECT_TIMEOUT 5000 // ms to wait for CONNACK
+#endif
+
+#ifndef MQTT_SESSION_EXPIRY
+#define MQTT_SESSION_EXPIRY 3600 // seconds a MQTT 5 server keeps a session that is not clean
+#endif
+
+typedef enum {
+    MQTT_V311 = 4,
+    MQTT_V5   = 5
+} mqtt_version_t;
+
+typedef enum {
+    MQTT_DISCONNECTED,
+    MQTT_CONNECTING,
+    MQTT_CONNECTED
+} mqtt_state_t;
+
+typedef struct {
+    uint32_t published;     // PUBLISH packets written, retransmissions included
+    uint32_t acknowledged;  // QoS1 publishes the server took
+    uint32_t retransmitted;
+    uint32_t rejected;      // publish() calls refused, queue full or not connected
+    uint32_t aliased;       // MQTT 5 publishes that went out with an empty topic
+    uint32_t received;      // PUBLISH packets from the server
+    uint32_t skipped;       // of those, too big for the receive buffer
+    uint16_t inflight;      // QoS1 publishes waiting for PUBACK
+    uint16_t queued;        // QoS1 publishes waiting for room in the window
+    uint16_t window;        // in-flight limit in use after the server's Receive Maximum
+    uint16_t aliases;       // topic aliases the server allows, 0 on MQTT 3.1.1
+} mqtt_stats_t;
+
+typedef std::function<void(const char* topic, const uint8_t* payload, size_t length)> MQTTMessageCb;
+typedef std::function<void(uint16_t packetId, uint8_t reason)> MQTTPublishedCb;
+typedef std::function<void(bool connected, uint8_t reason)> MQTTConnectionCb;
+
+/*
+ * MQTT 3.1.1 and 5 client on any Client, WiFiClient or WiFiClientSecure:
+ *
+ *   WiFiClient net;
+ *   MQTTClient mqtt(net);
+ *   mqtt.setServer("broker.local");
+ *   mqtt.onMessage([](const char* topic, const uint8_t* payload, size_t length) { ... });
+ *   mqtt.connect("esp32-1", NULL, NULL, MQTT_V5);
+ *   mqtt.subscribe("cmd/esp32-1", 1);
+ *   ...
+ *   mqtt.publish("data/esp32-1", buffer, length, 1);
+ *   mqtt.loop();
+ *
+ * The fixed header and topic are put together on the stack and the payload
+ * is written to the client straight from the caller's buffer, nothing is
+ * copied. A QoS1 publish keeps pointing at that buffer until its PUBACK, so
+ * the buffer has to stay as it is until onPublished() reports the packet id,
+ * or publish() is told to copy it. Up to setInflightWindow() QoS1 publishes
+ * are on the wire at once, the rest wait in a queue and go out from loop()
+ * as acknowledgements come in. QoS1 publishes may be queued while there is
+ * no connection, and the ones still waiting for PUBACK when it went are sent
+ * again after the next connect. QoS2 is published as QoS1. On MQTT 5 each
+ * topic gets an alias the first time it is published and later publishes
+ * send only the alias.
+ *
+ * Not thread safe: connect, publish and loop from the same task.
+ */
+class MQTTClient
+{
+public:
+    MQTTClient(Client& client);
+    ~MQTTClient();
+
+    void setServer(const char* host, uint16_t port = MQTT_PORT);
+    void setServer(IPAddress ip, uint16_t port = MQTT_PORT);
+    void setKeepAlive(uint16_t seconds);
+    void setCleanSession(bool clean);
+    void setWill(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0, bool retain = false);
+    void setInflightWindow(uint16_t window);
+    bool setBufferSize(size_t size);
+
+    bool connect(const char* clientId, const char* user = NULL, const char* pass = NULL, mqtt_version_t version = MQTT_V311);
+    void disconnect();
+    bool connected();
+    mqtt_state_t state() { return _state; }
+    mqtt_version_t version() { return _version; }
+
+    // returns the packet id for QoS1, 1 for a QoS0 publish written, 0 on failure
+    uint16_t publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0, bool retain = false, bool copy = false);
+    uint16_t publish(const char* topic, const char* payload, uint8_t qos = 0, bool retain = false, bool copy = false);
+    uint16_t subscribe(const char* topic, uint8_t qos = 0);
+    uint16_t unsubscribe(const char* topic);
+
+    // reads what the server sent, keeps the connection alive and drains the queue
+    bool loop();
+
+    void onMessage(MQTTMessageCb cb) { _onMessage = cb; }
+    void onPublished(MQTTPublishedCb cb) { _onPublished = cb; }
+    void onConnection(MQTTConnectionCb cb) { _onConnection = cb; }
+
+    bool pending() { return !_inflight.empty() || !_queue.empty(); }
+    void getStats(mqtt_stats_t* stats);
+
+private:
+    typedef struct {
+        uint16_t id;
+        uint8_t qos;
+        bool retain;
+        bool dup;
+        String topic;
+        const uint8_t* payload;
+        uint8_t* owned;     // the copy publish() made, freed with the message
+        size_t length;
+    } outgoing_t;
+
+    Client& _client;
+    String _host;
+    IPAddress _ip;
+    uint16_t _port;
+    mqtt_state_t _state;
+    mqtt_version_t _version;
+    uint16_t _keepAlive;
+    uint16_t _keepAliveUsed; // the server's Server Keep Alive wins over ours
+    bool _cleanSession;
+    uint32_t _maxPacket;
+
+    String _willTopic;
+    uint8_t* _willPayload;
+    size_t _willLength;
+    uint8_t _willQos;
+    bool _willRetain;
+
+    uint8_t* _rx;
+    size_t _rxSize;
+    size_t _rxLength;       // remaining length of the packet being read
+    size_t _rxPos;
+    uint8_t _rxHeader;
+    uint8_t _rxStage;       // fixed header, remaining length or body
+    uint8_t _rxShift;       // of the next remaining length byte
+    bool _rxSkip;
+
+    uint16_t _nextId;
+    uint16_t _window;
+    uint16_t _serverWindow;
+    std::vector<outgoing_t*> _inflight;
+    std::deque<outgoing_t*> _queue;
+
+    std::vector<String> _aliases;
+    uint16_t _aliasMax;
+
+    uint32_t _lastOut;
+    uint32_t _lastIn;
+    bool _pingPending;
+    mqtt_stats_t _stats;
+
+    MQTTMessageCb _onMessage;
+    MQTTPublishedCb _onPublished;
+    MQTTConnectionCb _onConnection;
+
+    uint16_t _takeId();
+    bool _write(const uint8_t* data, size_t length);
+    bool _sendPublish(outgoing_t* msg);
+    bool _sendAck(uint8_t type, uint16_t id);
+    void _drainQueue();
+    bool _readPacket(uint32_t timeout);
+    void _handlePacket();
+    void _handleConnack();
+    void _handlePublish();
+    void _handlePuback();
+    void _free(outgoing_t* msg);
+    void _close(uint8_t reason);
+};
+
+#endif /* _MQTT_CLIENT_H_ */
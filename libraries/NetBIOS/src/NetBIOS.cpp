@@ -1,145 +1,162 @@
-// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
-//
-// Licensed under the Apache License, Version 2.0 (the "License");
-// you may not use this file except in compliance with the License.
-// You may obtain a copy of the License at
-
-//     http://www.apache.org/licenses/LICENSE-2.0
-//
-// Unless required by applicable law or agreed to in writing, software
-// distributed under the License is distributed on an "AS IS" BASIS,
-// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-// See the License for the specific language governing permissions and
-// limitations under the License.
-
-#include "NetBIOS.h"
-
-#include <functional>
-
-#define NBNS_PORT 137
-#define NBNS_MAX_HOSTNAME_LEN 32
-
-typedef struct {
-    uint16_t id;
-    uint8_t flags1;
-    uint8_t flags2;
-    uint16_t qcount;
-    uint16_t acount;
-    uint16_t nscount;
-    uint16_t adcount;
-    uint8_t name_len;
-    char name[NBNS_MAX_HOSTNAME_LEN + 1];
-    uint16_t type;
-    uint16_t clas;
-} __attribute__((packed)) nbns_question_t;
-
-typedef struct {
-    uint16_t id;
-    uint8_t flags1;
-    uint8_t flags2;
-    uint16_t qcount;
-    uint16_t acount;
-    uint16_t nscount;
-    uint16_t adcount;
-    uint8_t name_len;
-    char name[NBNS_MAX_HOSTNAME_LEN + 1];
-    uint16_t type;
-    uint16_t clas;
-    uint32_t ttl;
-    uint16_t data_len;
-    uint16_t flags;
-    uint32_t addr;
-} __attribute__((packed)) nbns_answer_t;
-
-static void _getnbname(const char *nbname, char *name, uint8_t maxlen){
-    uint8_t b;
-    uint8_t c = 0;
-
-    while ((*nbname) && (c < maxlen)) {
-        b = (*nbname++ - 'A') << 4;
-        c++;
-        if (*nbname) {
-            b |= *nbname++ - 'A';
-            c++;
-        }
-        if(!b || b == ' '){
-            break;
-        }
-        *name++ = b;
-    }
-    *name = 0;
-}
-
-static void append_16(void * dst, uint16_t value){
-    uint8_t * d = (uint8_t *)dst;
-    *d++ = (value >> 8) & 0xFF;
-    *d++ = value & 0xFF;
-}
-
-static void append_32(void * dst, uint32_t value){
-    uint8_t * d = (uint8_t *)dst;
-    *d++ = (value >> 24) & 0xFF;
-    *d++ = (value >> 16) & 0xFF;
-    *d++ = (value >> 8) & 0xFF;
-    *d++ = value & 0xFF;
-}
-
-void NetBIOS::_onPacket(AsyncUDPPacket& packet){
-    if (packet.length() >= sizeof(nbns_question_t)) {
-        nbns_question_t * question = (nbns_question_t *)packet.data();
-        if (0 == (question->flags1 & 0x80)) {
-            char name[ NBNS_MAX_HOSTNAME_LEN + 1 ];
-            _getnbname(&question->name[0], (char *)&name, question->name_len);
-            if (_name.equals(name)) {
-                nbns_answer_t nbnsa;
-                nbnsa.id = question->id;
-                nbnsa.flags1 = 0x85;
-                nbnsa.flags2 = 0;
-                append_16((void *)&nbnsa.qcount, 0);
-                append_16((void *)&nbnsa.acount, 1);
-                append_16((void *)&nbnsa.nscount, 0);
-                append_16((void *)&nbnsa.adcount, 0);
-                nbnsa.name_len = question->name_len;
-                memcpy(&nbnsa.name[0], &question->name[0], question->name_len + 1);
-                append_16((void *)&nbnsa.type, 0x20);
-                append_16((void *)&nbnsa.clas, 1);
-                append_32((void *)&nbnsa.ttl, 300000);
-                append_16((void *)&nbnsa.data_len, 6);
-                append_16((void *)&nbnsa.flags, 0);
-                nbnsa.addr = WiFi.localIP();
-                _udp.writeTo((uint8_t *)&nbnsa, sizeof(nbnsa), packet.remoteIP(), NBNS_PORT);
-            }
-        }
-    }
-}
-
-NetBIOS::NetBIOS(){
-
-}
-NetBIOS::~NetBIOS(){
-    end();
-}
-
-bool NetBIOS::begin(const char *name){
-    _name = name;
-    _name.toUpperCase();
-
-    if(_udp.connected()){
-        return true;
-    }
-
-    _udp.onPacket([](void * arg, AsyncUDPPacket& packet){ ((NetBIOS*)(arg))->_onPacket(packet); }, this);
-    return _udp.listen(NBNS_PORT);
-}
-
-void NetBIOS::end(){
-    if(_udp.connected()){
-        _udp.close();
-    }
-}
-
-#if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_NETBIOS)
-NetBIOS NBNS;
-#endif
-
-// EOF
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "NetBIOS.h"
+
+#include <functional>
+
+#define NBNS_PORT 137
+#define NBNS_MAX_HOSTNAME_LEN 32
+
+typedef struct {
+    uint16_t id;
+    uint8_t flags1;
+    uint8_t flags2;
+    uint16_t qcount;
+    uint16_t acount;
+    uint16_t nscount;
+    uint16_t adcount;
+    uint8_t name_len;
+    char name[NBNS_MAX_HOSTNAME_LEN + 1];
+    uint16_t type;
+    uint16_t clas;
+} __attribute__((packed)) nbns_question_t;
+
+typedef struct {
+    uint16_t id;
+    uint8_t flags1;
+    uint8_t flags2;
+    uint16_t qcount;
+    uint16_t acount;
+    uint16_t nscount;
+    uint16_t adcount;
+    uint8_t name_len;
+    char name[NBNS_MAX_HOSTNAME_LEN + 1];
+    uint16_t type;
+    uint16_t clas;
+    uint32_t ttl;
+    uint16_t data_len;
+    uint16_t flags;
+    uint32_t addr;
+} __attribute__((packed)) nbns_answer_t;
+
+static_assert(sizeof(nbns_answer_t) == 62, "NetBIOS answer size");
+
+static void append_16(void * dst, uint16_t value){
+    uint8_t * d = (uint8_t *)dst;
+    *d++ = (value >> 8) & 0xFF;
+    *d++ = value & 0xFF;
+}
+
+static void append_32(void * dst, uint32_t value){
+    uint8_t * d = (uint8_t *)dst;
+    *d++ = (value >> 24) & 0xFF;
+    *d++ = (value >> 16) & 0xFF;
+    *d++ = (value >> 8) & 0xFF;
+    *d++ = value & 0xFF;
+}
+
+// first level encoding: the name padded to 15 characters and a suffix byte,
+// every byte split into two nibbles written as 'A' + nibble
+static void _setnbname(const char *name, uint8_t *nbname){
+    for (uint8_t i = 0; i < 16; i++) {
+        uint8_t b = ' ';
+        if (i == 15) {
+            b = 0;
+        } else if (*name) {
+            b = *name++;
+        }
+        *nbname++ = 'A' + (b >> 4);
+        *nbname++ = 'A' + (b & 0x0F);
+    }
+}
+
+/*
+ * The answer only differs from query to query in the id and the address, so it is
+ * put together once in begin() and the query is matched on the encoded name as it
+ * arrives, without decoding it. Any suffix (the 16th byte) is answered.
+ */
+void NetBIOS::_onPacket(AsyncUDPPacket& packet){
+    if (packet.length() < sizeof(nbns_question_t)) {
+        return;
+    }
+    nbns_question_t * question = (nbns_question_t *)packet.data();
+    if ((question->flags1 & 0x80) || question->name_len != sizeof(_encoded) || memcmp(question->name, _encoded, sizeof(_encoded) - 2)) {
+        return;
+    }
+
+    nbns_answer_t nbnsa;
+    memcpy(&nbnsa, _answer, sizeof(nbnsa));
+    nbnsa.id = question->id;
+    nbnsa.name[30] = question->name[30];
+    nbnsa.name[31] = question->name[31];
+    // the address of the interface the query came in on, not always the station
+    tcpip_adapter_ip_info_t ip;
+    tcpip_adapter_if_t tcpip_if = packet.interface();
+    if (tcpip_if < TCPIP_ADAPTER_IF_MAX && !tcpip_adapter_get_ip_info(tcpip_if, &ip) && ip.ip.addr) {
+        nbnsa.addr = ip.ip.addr;
+    } else {
+        nbnsa.addr = WiFi.localIP();
+    }
+    _udp.writeTo((uint8_t *)&nbnsa, sizeof(nbnsa), packet.remoteIP(), NBNS_PORT);
+}
+
+NetBIOS::NetBIOS(){
+
+}
+NetBIOS::~NetBIOS(){
+    end();
+}
+
+bool NetBIOS::begin(const char *name){
+    _name = name;
+    _name.toUpperCase();
+    _setnbname(_name.c_str(), _encoded);
+
+    nbns_answer_t * nbnsa = (nbns_answer_t *)_answer;
+    memset(nbnsa, 0, sizeof(nbns_answer_t));
+    nbnsa->flags1 = 0x85;
+    nbnsa->flags2 = 0;
+    append_16((void *)&nbnsa->qcount, 0);
+    append_16((void *)&nbnsa->acount, 1);
+    append_16((void *)&nbnsa->nscount, 0);
+    append_16((void *)&nbnsa->adcount, 0);
+    nbnsa->name_len = sizeof(_encoded);
+    memcpy(&nbnsa->name[0], _encoded, sizeof(_encoded));
+    nbnsa->name[NBNS_MAX_HOSTNAME_LEN] = 0;
+    append_16((void *)&nbnsa->type, 0x20);
+    append_16((void *)&nbnsa->clas, 1);
+    append_32((void *)&nbnsa->ttl, 300000);
+    append_16((void *)&nbnsa->data_len, 6);
+    append_16((void *)&nbnsa->flags, 0);
+
+    if(_udp.connected()){
+        return true;
+    }
+
+    _udp.onPacket([](void * arg, AsyncUDPPacket& packet){ ((NetBIOS*)(arg))->_onPacket(packet); }, this);
+    return _udp.listen(NBNS_PORT);
+}
+
+void NetBIOS::end(){
+    if(_udp.connected()){
+        _udp.close();
+    }
+}
+
+#if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_NETBIOS)
+NetBIOS NBNS;
+#endif
+
+// EOF
@@ -1,39 +1,41 @@
-// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
-//
-// Licensed under the Apache License, Version 2.0 (the "License");
-// you may not use this file except in compliance with the License.
-// You may obtain a copy of the License at
-
-//     http://www.apache.org/licenses/LICENSE-2.0
-//
-// Unless required by applicable law or agreed to in writing, software
-// distributed under the License is distributed on an "AS IS" BASIS,
-// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-// See the License for the specific language governing permissions and
-// limitations under the License.
-
-#ifndef __ESPNBNS_h__
-#define __ESPNBNS_h__
-
-#include <WiFi.h>
-#include "AsyncUDP.h"
-
-class NetBIOS
-{
-protected:
-    AsyncUDP _udp;
-    String _name;
-    void _onPacket(AsyncUDPPacket& packet);
-
-public:
-    NetBIOS();
-    ~NetBIOS();
-    bool begin(const char *name);
-    void end();
-};
-
-#if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_NETBIOS)
-extern NetBIOS NBNS;
-#endif
-
-#endif
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __ESPNBNS_h__
+#define __ESPNBNS_h__
+
+#include <WiFi.h>
+#include "AsyncUDP.h"
+
+class NetBIOS
+{
+protected:
+    AsyncUDP _udp;
+    String _name;
+    uint8_t _encoded[32];   // the name as it appears in queries
+    uint8_t _answer[62];    // the reply, built by begin()
+    void _onPacket(AsyncUDPPacket& packet);
+
+public:
+    NetBIOS();
+    ~NetBIOS();
+    bool begin(const char *name);
+    void end();
+};
+
+#if !defined(NO_GLOBAL_INSTANCES) && !defined(NO_GLOBAL_NETBIOS)
+extern NetBIOS NBNS;
+#endif
+
+#endif
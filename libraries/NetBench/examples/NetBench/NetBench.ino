@@ -0,0 +1,38 @@
+// Throughput of the board against iperf 2 on a PC:
+//   iperf -s            for the TCP upload
+//   iperf -s -u         for the UDP upload, on the same port
+//   iperf -c <board>    when the board asks for it, for the TCP download
+// and a TLS upload to "openssl s_server -quiet -accept 4433 -cert c.pem -key k.pem".
+// Each result comes with the load of both cores and the lowest free heap.
+
+#include <WiFi.h>
+#include <NetBench.h>
+
+const char* ssid = "........";
+const char* password = "........";
+IPAddress host(192, 168, 1, 10);
+
+NetBench bench;
+
+void setup() {
+  Serial.begin(115200);
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.printf("\nconnected, this board is %s\n", WiFi.localIP().toString().c_str());
+  // no power save, it halves what the radio can do
+  WiFi.setSleep(false);
+
+  NetBench::print(Serial, "tcp tx", bench.tcpClient(host));
+  NetBench::print(Serial, "udp tx 20M", bench.udpClient(host, NET_BENCH_PORT, 10, 20000000));
+
+  Serial.printf("run: iperf -c %s\n", WiFi.localIP().toString().c_str());
+  NetBench::print(Serial, "tcp rx", bench.tcpServer());
+
+  NetBench::print(Serial, "tls tx", bench.tlsClient(host.toString().c_str()));
+}
+
+void loop() {
+}
@@ -0,0 +1,386 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "NetBench.h"
+#include "WiFi.h"
+#include "WiFiClientSecure.h"
+#include "AsyncUDP.h"
+#include "lwip/def.h"
+
+#define NET_BENCH_READ_SIZE 4096
+#define NET_BENCH_FIN_TRIES 10   // end of test datagrams sent for the server report, as iperf does
+#define NET_BENCH_FIN_WAIT 250   // ms each
+
+#define IPERF_HEADER_VERSION1 0x80000000
+
+// iperf 2 wire format, in network order
+typedef struct {
+    int32_t id;             // negative in the end of test datagrams
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+} __attribute__((packed)) iperf_udp_datagram_t;
+
+typedef struct {
+    int32_t flags;
+    int32_t total_len1;
+    int32_t total_len2;
+    int32_t stop_sec;
+    int32_t stop_usec;
+    int32_t error_cnt;
+    int32_t outorder_cnt;
+    int32_t datagrams;
+    int32_t jitter1;
+    int32_t jitter2;
+} __attribute__((packed)) iperf_server_hdr_t;
+
+void NetBench::_begin(netbench_result_t& result)
+{
+    memset(&result, 0, sizeof(result));
+    ESP.beginTaskStats();
+    ESP.resetTaskStats();
+    result.heapMin = ESP.getFreeHeap();
+    _start = millis();
+}
+
+void NetBench::_sample(netbench_result_t& result)
+{
+    uint32_t heap = ESP.getFreeHeap();
+    if(heap < result.heapMin) {
+        result.heapMin = heap;
+    }
+}
+
+void NetBench::_end(netbench_result_t& result)
+{
+    result.ms = millis() - _start;
+    result.mbps = result.ms ? (float)result.bytes * 8 / result.ms / 1000 : 0;
+    result.heapFree = ESP.getFreeHeap();
+    _sample(result);
+    task_stats_t* stats = (task_stats_t*)malloc(NET_BENCH_MAX_TASKS * sizeof(task_stats_t));
+    if(!stats) {
+        return;
+    }
+    size_t count = ESP.getTaskStats(stats, NET_BENCH_MAX_TASKS);
+    if(count > NET_BENCH_MAX_TASKS) {
+        count = NET_BENCH_MAX_TASKS;
+    }
+    // what the idle task of a core did not get, the rest was work
+    for(size_t i = 0; i < count; i++) {
+        if(!strncmp(stats[i].name, "IDLE", 4) && stats[i].affinity >= 0 && stats[i].affinity < 2) {
+            result.cpu[stats[i].affinity] = 100.0f - stats[i].cpuPercent;
+        }
+    }
+    free(stats);
+}
+
+netbench_result_t NetBench::tcpClient(const IPAddress& host, uint16_t port, uint32_t seconds, size_t blockSize)
+{
+    netbench_result_t result;
+    _begin(result);
+    // all zeros: no flags in the iperf header, a plain one way test
+    uint8_t* block = (uint8_t*)calloc(1, blockSize);
+    WiFiClient client;
+    if(!block || !client.connect(host, port)) {
+        log_e("no connection to %s:%u", host.toString().c_str(), port);
+        free(block);
+        result.errors++;
+        _end(result);
+        return result;
+    }
+    _start = millis();
+    while(millis() - _start < seconds * 1000 && client.connected()) {
+        size_t written = client.write(block, blockSize);
+        if(!written) {
+            result.errors++;
+            break;
+        }
+        result.bytes += written;
+        _sample(result);
+    }
+    _end(result);
+    client.stop();
+    free(block);
+    return result;
+}
+
+netbench_result_t NetBench::tcpServer(uint16_t port, uint32_t timeout_ms)
+{
+    netbench_result_t result;
+    _begin(result);
+    uint8_t* buf = (uint8_t*)malloc(NET_BENCH_READ_SIZE);
+    WiFiServer server(port, 1);
+    server.begin();
+    WiFiClient client;
+    uint32_t waitStart = millis();
+    while(buf && !client && millis() - waitStart < timeout_ms) {
+        client = server.available();
+        if(!client) {
+            delay(10);
+        }
+    }
+    if(!client) {
+        log_e("no client on port %u", port);
+        result.errors++;
+        _end(result);
+        server.end();
+        free(buf);
+        return result;
+    }
+    _begin(result);
+    while(client.connected() || client.available()) {
+        int n = client.read(buf, NET_BENCH_READ_SIZE);
+        if(n > 0) {
+            result.bytes += n;
+            _sample(result);
+        } else if(millis() - _start > timeout_ms) {
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    _end(result);
+    client.stop();
+    server.end();
+    free(buf);
+    return result;
+}
+
+netbench_result_t NetBench::udpClient(const IPAddress& host, uint16_t port, uint32_t seconds, uint32_t bandwidth, size_t datagramSize)
+{
+    netbench_result_t result;
+    _begin(result);
+    if(datagramSize < sizeof(iperf_udp_datagram_t)) {
+        datagramSize = sizeof(iperf_udp_datagram_t);
+    }
+    uint8_t* datagram = (uint8_t*)calloc(1, datagramSize);
+    AsyncUDP udp;
+    volatile bool reported = false;
+    iperf_server_hdr_t report;
+    udp.onPacket([&](AsyncUDPPacket& packet) {
+        if(!reported && packet.length() >= sizeof(iperf_udp_datagram_t) + sizeof(iperf_server_hdr_t)) {
+            memcpy(&report, packet.data() + sizeof(iperf_udp_datagram_t), sizeof(report));
+            reported = true;
+        }
+    });
+    if(!datagram || !udp.connect(host, port)) {
+        log_e("no socket to %s:%u", host.toString().c_str(), port);
+        free(datagram);
+        result.errors++;
+        _end(result);
+        return result;
+    }
+    iperf_udp_datagram_t* header = (iperf_udp_datagram_t*)datagram;
+    uint64_t startUs = esp_timer_get_time();
+    int32_t id = 0;
+    _start = millis();
+    while(millis() - _start < seconds * 1000) {
+        uint64_t now = esp_timer_get_time();
+        if(bandwidth) {
+            // where this datagram is due, a tick early at most
+            uint64_t due = startUs + (result.bytes + result.errors * datagramSize) * 8 * 1000000ULL / bandwidth;
+            if(due > now + portTICK_PERIOD_MS * 1000) {
+                delay((due - now) / 1000);
+                continue;
+            } else if(due > now) {
+                continue;
+            }
+        }
+        header->id = htonl(id);
+        header->tv_sec = htonl(now / 1000000);
+        header->tv_usec = htonl(now % 1000000);
+        if(udp.write(datagram, datagramSize) == datagramSize) {
+            result.bytes += datagramSize;
+            id++;
+        } else {
+            // out of buffers, the stack is the limit
+            result.errors++;
+            delay(1);
+        }
+        _sample(result);
+    }
+    _end(result);
+    result.packets = id;
+    for(int i = 0; i < NET_BENCH_FIN_TRIES && !reported; i++) {
+        header->id = htonl(-id);
+        udp.write(datagram, datagramSize);
+        uint32_t sent = millis();
+        while(!reported && millis() - sent < NET_BENCH_FIN_WAIT) {
+            delay(10);
+        }
+    }
+    udp.close();
+    if(reported) {
+        result.packets = ntohl(report.datagrams);
+        result.lost = ntohl(report.error_cnt);
+        result.outOfOrder = ntohl(report.outorder_cnt);
+    } else {
+        log_w("no report from the server, the loss is not known");
+    }
+    free(datagram);
+    return result;
+}
+
+netbench_result_t NetBench::udpServer(uint16_t port, uint32_t timeout_ms)
+{
+    netbench_result_t result;
+    _begin(result);
+    struct {
+        volatile bool started;
+        volatile bool finished;
+        uint32_t start;
+        uint32_t stop;
+        uint64_t bytes;
+        uint32_t packets;
+        uint32_t lost;
+        uint32_t outOfOrder;
+        int32_t next;
+    } run = {};
+    AsyncUDP udp;
+    // in the async_udp task
+    udp.onPacket([&](AsyncUDPPacket& packet) {
+        if(packet.length() < sizeof(iperf_udp_datagram_t) || run.finished) {
+            return;
+        }
+        iperf_udp_datagram_t header;
+        memcpy(&header, packet.data(), sizeof(header));
+        int32_t id = ntohl(header.id);
+        if(!run.started) {
+            run.start = millis();
+            run.started = true;
+        }
+        if(id >= 0) {
+            run.bytes += packet.length();
+            run.packets++;
+            if(id > run.next) {
+                run.lost += id - run.next;
+            } else if(id < run.next) {
+                // counted as lost when it was skipped
+                run.outOfOrder++;
+                if(run.lost) {
+                    run.lost--;
+                }
+            }
+            if(id >= run.next) {
+                run.next = id + 1;
+            }
+            return;
+        }
+        // the end of the test, answered with the report every time the client asks
+        if(!run.stop) {
+            run.stop = millis();
+        }
+        uint32_t elapsed = run.stop - run.start;
+        uint8_t reply[sizeof(iperf_udp_datagram_t) + sizeof(iperf_server_hdr_t)] = {};
+        iperf_server_hdr_t report = {};
+        report.flags = htonl(IPERF_HEADER_VERSION1);
+        report.total_len1 = htonl((uint32_t)(run.bytes >> 32));
+        report.total_len2 = htonl((uint32_t)run.bytes);
+        report.stop_sec = htonl(elapsed / 1000);
+        report.stop_usec = htonl((elapsed % 1000) * 1000);
+        report.error_cnt = htonl(run.lost);
+        report.outorder_cnt = htonl(run.outOfOrder);
+        report.datagrams = htonl(run.packets);
+        memcpy(reply, &header, sizeof(header));
+        memcpy(reply + sizeof(header), &report, sizeof(report));
+        udp.writeTo(reply, sizeof(reply), packet.remoteIP(), packet.remotePort());
+        run.finished = true;
+    });
+    if(!udp.listen(port)) {
+        log_e("port %u not open", port);
+        result.errors++;
+        _end(result);
+        return result;
+    }
+    uint32_t waitStart = millis();
+    while(!run.started && millis() - waitStart < timeout_ms) {
+        delay(10);
+    }
+    if(!run.started) {
+        log_e("no client on port %u", port);
+        result.errors++;
+        _end(result);
+        udp.close();
+        return result;
+    }
+    ESP.resetTaskStats();
+    while(!run.finished && millis() - run.start < timeout_ms) {
+        _sample(result);
+        delay(10);
+    }
+    _end(result);
+    // the client repeats the end of test until it has the report
+    delay(NET_BENCH_FIN_WAIT);
+    udp.close();
+    result.ms = (run.stop ? run.stop : millis()) - run.start;
+    result.bytes = run.bytes;
+    result.mbps = result.ms ? (float)result.bytes * 8 / result.ms / 1000 : 0;
+    result.packets = run.packets;
+    result.lost = run.lost;
+    result.outOfOrder = run.outOfOrder;
+    return result;
+}
+
+netbench_result_t NetBench::tlsClient(const char* host, uint16_t port, uint32_t seconds, const char* rootCA, size_t blockSize)
+{
+    netbench_result_t result;
+    _begin(result);
+    uint8_t* block = (uint8_t*)calloc(1, blockSize);
+    WiFiClientSecure client;
+    if(rootCA) {
+        client.setCACert(rootCA);
+    } else {
+        client.setInsecure();
+    }
+    uint32_t handshakeStart = millis();
+    if(!block || !client.connect(host, port)) {
+        log_e("no TLS connection to %s:%u", host, port);
+        free(block);
+        result.errors++;
+        _end(result);
+        return result;
+    }
+    uint32_t handshakeMs = millis() - handshakeStart;
+    _begin(result);
+    result.handshakeMs = handshakeMs;
+    while(millis() - _start < seconds * 1000 && client.connected()) {
+        size_t written = client.write(block, blockSize);
+        if(!written) {
+            result.errors++;
+            break;
+        }
+        result.bytes += written;
+        _sample(result);
+    }
+    _end(result);
+    client.stop();
+    free(block);
+    return result;
+}
+
+void NetBench::print(Print& out, const char* label, const netbench_result_t& result)
+{
+    out.printf("%s: %.2f Mbit/s, %llu bytes in %u ms, cpu %.0f%% / %.0f%%, heap %u (min %u)",
+               label, result.mbps, result.bytes, result.ms, result.cpu[0], result.cpu[1], result.heapFree, result.heapMin);
+    if(result.packets) {
+        out.printf(", %u datagrams, %u lost (%.2f%%), %u out of order", result.packets, result.lost,
+                   result.packets + result.lost ? result.lost * 100.0f / (result.packets + result.lost) : 0.0f, result.outOfOrder);
+    }
+    if(result.handshakeMs) {
+        out.printf(", handshake %u ms", result.handshakeMs);
+    }
+    if(result.errors) {
+        out.printf(", %u errors", result.errors);
+    }
+    out.println();
+}
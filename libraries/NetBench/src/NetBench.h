@@ -0,0 +1,81 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _NET_BENCH_H_
+#define _NET_BENCH_H_
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+#ifndef NET_BENCH_PORT
+#define NET_BENCH_PORT 5001 // the iperf 2 default
+#endif
+
+#ifndef NET_BENCH_MAX_TASKS
+#define NET_BENCH_MAX_TASKS 32 // task statistics read to find the idle tasks
+#endif
+
+typedef struct {
+    uint64_t bytes;         // payload moved, TCP and TLS without the headers of the protocol
+    uint32_t ms;
+    float mbps;
+    float cpu[2];           // percent of each core busy during the run
+    uint32_t heapFree;      // at the end
+    uint32_t heapMin;       // lowest seen during the run
+    uint32_t packets;       // UDP datagrams, received by the far end for a client run
+    uint32_t lost;          // UDP datagrams missing in the sequence
+    uint32_t outOfOrder;
+    uint32_t errors;        // failed writes, or the run did not start
+    uint32_t handshakeMs;   // TLS
+} netbench_result_t;
+
+/*
+ * Throughput tests against iperf 2 on a PC, or against another board:
+ *
+ *   NetBench bench;
+ *   netbench_result_t r = bench.tcpClient(IPAddress(192, 168, 1, 10));  // iperf -s
+ *   NetBench::print(Serial, "tcp tx", r);
+ *
+ * tcpClient() and udpClient() send to "iperf -s [-u]", tcpServer() and
+ * udpServer() take one run of "iperf -c <board> [-u -b 20M]". UDP runs send
+ * the iperf datagram header and its end of test handshake, so both sides
+ * report the loss. tlsClient() writes over WiFiClientSecure to any TLS server
+ * that reads and drops what it gets, such as "openssl s_server -quiet".
+ * WiFiClient and WiFiServer carry TCP, AsyncUDP carries UDP.
+ *
+ * The core load comes from ESP.beginTaskStats(), left running after the
+ * first test so other measurements can go on using them.
+ */
+class NetBench
+{
+public:
+    netbench_result_t tcpClient(const IPAddress& host, uint16_t port = NET_BENCH_PORT, uint32_t seconds = 10, size_t blockSize = 8192);
+    netbench_result_t tcpServer(uint16_t port = NET_BENCH_PORT, uint32_t timeout_ms = 60000);
+    // bandwidth in bit/s, 0 sends as fast as the stack takes datagrams
+    netbench_result_t udpClient(const IPAddress& host, uint16_t port = NET_BENCH_PORT, uint32_t seconds = 10, uint32_t bandwidth = 1000000, size_t datagramSize = 1470);
+    netbench_result_t udpServer(uint16_t port = NET_BENCH_PORT, uint32_t timeout_ms = 60000);
+    // rootCA NULL accepts any certificate
+    netbench_result_t tlsClient(const char* host, uint16_t port = 4433, uint32_t seconds = 10, const char* rootCA = NULL, size_t blockSize = 4096);
+
+    static void print(Print& out, const char* label, const netbench_result_t& result);
+
+private:
+    uint32_t _start;
+
+    void _begin(netbench_result_t& result);
+    void _sample(netbench_result_t& result);
+    void _end(netbench_result_t& result);
+};
+
+#endif /* _NET_BENCH_H_ */
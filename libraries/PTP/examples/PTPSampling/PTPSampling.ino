@@ -0,0 +1,68 @@
+/*
+ * Boards sampling at the same instant.
+ *
+ * Flash one board with MASTER set to true and the others with false. Every second
+ * of master time each board pulses PULSE_PIN; put a scope on two boards to see how
+ * close they are. The slaves print offset, path delay and their error bound.
+ */
+#include <WiFi.h>
+#include <PTP.h>
+
+#define MASTER    false
+#define PULSE_PIN 2
+
+const char* ssid     = "your-ssid";
+const char* password = "your-password";
+
+PTPClock ptp;
+int64_t nextTick = 0;
+
+void setup()
+{
+    Serial.begin(115200);
+    pinMode(PULSE_PIN, OUTPUT);
+
+    WiFi.mode(WIFI_STA);
+    // the radio must not sleep between beacons, that adds milliseconds of delay
+    WiFi.setSleep(false);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+        Serial.print(".");
+    }
+    Serial.println();
+
+    ptp.begin(MASTER ? PTP_MASTER : PTP_SLAVE);
+}
+
+void loop()
+{
+    if (!ptp.synced()) {
+        delay(100);
+        return;
+    }
+
+    int64_t now = ptp.now();
+    if (!nextTick || nextTick < now) {
+        nextTick = (now / 1000000 + 1) * 1000000;
+    }
+    // start waiting a little early, then spin to the exact local time
+    int64_t at = ptp.toLocal(nextTick);
+    int64_t wait = at - esp_timer_get_time();
+    if (wait > 2000) {
+        delay((wait - 2000) / 1000);
+        return;
+    }
+    while (esp_timer_get_time() < at);
+    digitalWrite(PULSE_PIN, HIGH);
+    delayMicroseconds(100);
+    digitalWrite(PULSE_PIN, LOW);
+    nextTick += 1000000;
+
+    if (!MASTER) {
+        ptp_stats_t stats;
+        ptp.getStats(&stats);
+        Serial.printf("offset %lld us, delay %u us (min %u), rate %d ppb, error %u us\n",
+            stats.offsetUs, stats.delayUs, stats.minDelayUs, stats.ratePpb, stats.errorUs);
+    }
+}
@@ -0,0 +1,429 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PTP.h"
+#include "esp_timer.h"
+
+#define PTP_MAGIC      0x50545045   // "EPTP"
+#define PTP_GROUP      IPAddress(224, 0, 1, 129)
+#define PTP_SLEW_PPM   1000         // fastest slew of a model change
+#define PTP_STEP_US    10000        // larger model changes are stepped
+#define PTP_RATE_MAX   500000       // ppb, anything beyond is not a crystal
+#define PTP_RATE_ERROR 1000         // ppb assumed as the error of the fitted rate
+
+enum {
+    PTP_SYNC,
+    PTP_FOLLOW_UP,
+    PTP_DELAY_REQ,
+    PTP_DELAY_RESP
+};
+
+PTPClock::PTPClock()
+    : _role(PTP_SLAVE)
+    , _interval(PTP_SYNC_INTERVAL)
+    , _clockId(0)
+    , _queue(NULL)
+    , _task(NULL)
+    , _running(false)
+    , _masterId(0)
+    , _masterIp(0)
+    , _lastSync(0)
+    , _seq(0)
+    , _t1(0), _t2(0), _t3(0)
+    , _haveT1(false), _haveT2(false), _haveT3(false)
+    , _sampleCount(0)
+    , _sampleNext(0)
+    , _synced(false)
+{
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    memset(&_model, 0, sizeof(_model));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+PTPClock::~PTPClock()
+{
+    end();
+}
+
+bool PTPClock::begin(ptp_role_t role, uint32_t syncInterval)
+{
+    if(_task){
+        log_e("already running");
+        return false;
+    }
+    _role = role;
+    _interval = syncInterval ? syncInterval : PTP_SYNC_INTERVAL;
+    _clockId = (uint32_t)(ESP.getEfuseMac() >> 16);
+    _masterId = 0;
+    _sampleCount = 0;
+    _sampleNext = 0;
+    _synced = false;
+    _haveT1 = _haveT2 = _haveT3 = false;
+    memset(&_stats, 0, sizeof(_stats));
+
+    _queue = xQueueCreate(PTP_QUEUE_SIZE, sizeof(event_t));
+    if(!_queue){
+        log_e("queue create failed");
+        return false;
+    }
+    // timestamps have to be taken where the datagram arrives, not after a queue
+    _udp.setDirectDispatch(true);
+    _udp.onPacket([](void * arg, AsyncUDPPacket & packet){
+        ((PTPClock *)arg)->_onPacket(packet);
+    }, this);
+    if(!_udp.listenMulticast(PTP_GROUP, PTP_PORT)){
+        log_e("could not listen on %u", PTP_PORT);
+        vQueueDelete(_queue);
+        _queue = NULL;
+        return false;
+    }
+    _running = true;
+    if(xTaskCreateUniversal(_taskFn, "ptp", 4096, this, 10, &_task, CONFIG_ARDUINO_RUNNING_CORE) != pdPASS){
+        log_e("task start failed");
+        _running = false;
+        _udp.close();
+        vQueueDelete(_queue);
+        _queue = NULL;
+        return false;
+    }
+    return true;
+}
+
+void PTPClock::end()
+{
+    if(!_task){
+        return;
+    }
+    _running = false;
+    while(_task){
+        delay(10);
+    }
+    _udp.close();
+    vQueueDelete(_queue);
+    _queue = NULL;
+}
+
+// lwIP thread: timestamp and hand over, nothing that sends or blocks
+void PTPClock::_onPacket(AsyncUDPPacket & packet)
+{
+    int64_t rx = esp_timer_get_time();
+    if(packet.length() != sizeof(message_t) || !_queue){
+        return;
+    }
+    event_t event;
+    memcpy(&event.message, packet.data(), sizeof(message_t));
+    if(event.message.magic != PTP_MAGIC || event.message.clockId == _clockId){
+        return;
+    }
+    event.rx = rx;
+    event.ip = packet.remoteIP();
+    if(xQueueSend(_queue, &event, 0) != pdTRUE){
+        _stats.dropped++;
+    }
+}
+
+void PTPClock::_taskFn(void * arg)
+{
+    PTPClock * self = (PTPClock *)arg;
+    self->_run();
+    self->_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void PTPClock::_run()
+{
+    uint32_t nextSync = millis();
+    event_t event;
+    while(_running){
+        uint32_t wait = 100;
+        if(_role == PTP_MASTER){
+            int32_t left = (int32_t)(nextSync - millis());
+            wait = (left <= 0) ? 0 : ((left < 100) ? left : 100);
+        }
+        if(xQueueReceive(_queue, &event, pdMS_TO_TICKS(wait)) == pdTRUE){
+            _handle(event);
+        }
+        if(_role == PTP_MASTER && (int32_t)(millis() - nextSync) >= 0){
+            nextSync += _interval;
+            if((int32_t)(millis() - nextSync) >= 0){
+                nextSync = millis() + _interval;
+            }
+            int64_t sent;
+            _seq++;
+            _send(PTP_SYNC, _seq, _clockId, 0, PTP_GROUP, &sent);
+            _send(PTP_FOLLOW_UP, _seq, _clockId, _masterClock(sent), PTP_GROUP, NULL);
+            _stats.syncs++;
+        }
+    }
+}
+
+void PTPClock::_send(uint8_t type, uint16_t seq, uint32_t clockId, int64_t time, uint32_t ip, int64_t * sent)
+{
+    message_t message;
+    message.magic = PTP_MAGIC;
+    message.type = type;
+    message.reserved = 0;
+    message.seq = seq;
+    message.clockId = clockId;
+    message.time = time;
+    _udp.writeTo((const uint8_t *)&message, sizeof(message), IPAddress(ip), PTP_PORT);
+    // writeTo() returns once lwIP has passed the datagram to the driver
+    if(sent){
+        *sent = esp_timer_get_time();
+    }
+}
+
+int64_t PTPClock::_masterClock(int64_t local)
+{
+    if(timeSynced()){
+        return timeToUtcMicros(local, NULL);
+    }
+    return local;
+}
+
+void PTPClock::_handle(const event_t & event)
+{
+    const message_t & message = event.message;
+    if(_role == PTP_MASTER){
+        if(message.type == PTP_DELAY_REQ){
+            _send(PTP_DELAY_RESP, message.seq, message.clockId, _masterClock(event.rx), event.ip, NULL);
+        }
+        return;
+    }
+
+    switch(message.type){
+    case PTP_SYNC:
+        if(message.clockId != _masterId){
+            if(_masterId && millis() - _lastSync < PTP_MASTER_TIMEOUT){
+                return;
+            }
+            log_i("following master %08x", message.clockId);
+            _masterId = message.clockId;
+            _sampleCount = 0;
+            _sampleNext = 0;
+        }
+        _masterIp = event.ip;
+        _lastSync = millis();
+        _seq = message.seq;
+        _t2 = event.rx;
+        _haveT2 = true;
+        _haveT1 = _haveT3 = false;
+        _stats.syncs++;
+        _stats.masterId = _masterId;
+        break;
+
+    case PTP_FOLLOW_UP:
+        if(message.clockId != _masterId || message.seq != _seq || !_haveT2){
+            return;
+        }
+        _t1 = message.time;
+        _haveT1 = true;
+        _send(PTP_DELAY_REQ, _seq, _clockId, 0, _masterIp, &_t3);
+        _haveT3 = true;
+        break;
+
+    case PTP_DELAY_RESP:
+        if(message.clockId != _clockId || message.seq != _seq || !_haveT1 || !_haveT2 || !_haveT3){
+            return;
+        }
+        {
+            // t2 and t3 are local, t1 and t4 master: t2 - t1 = delay + offset, t4 - t3 = delay - offset
+            int64_t t4 = message.time;
+            int64_t offset = ((_t2 - _t1) - (t4 - _t3)) / 2;
+            int64_t delay = ((_t2 - _t1) + (t4 - _t3)) / 2;
+            _haveT1 = _haveT2 = _haveT3 = false;
+            _stats.exchanges++;
+            _stats.offsetUs = offset;
+            _stats.delayUs = (delay < 0) ? 0 : delay;
+            _addSample(_t2, -offset, _stats.delayUs);
+        }
+        break;
+    }
+}
+
+int64_t PTPClock::_modelTime(const model_t & m, int64_t local, uint32_t * errorUs)
+{
+    int64_t dt = local - m.refLocal;
+    int64_t master = m.refMaster + dt + dt * m.ratePpb / 1000000000LL;
+    int64_t remaining = m.slewUs;
+    if(dt > 0 && m.slewUs){
+        int64_t max = dt * PTP_SLEW_PPM / 1000000;
+        int64_t slewed = (llabs(m.slewUs) <= max) ? m.slewUs : ((m.slewUs > 0) ? max : -max);
+        master += slewed;
+        remaining -= slewed;
+    }
+    if(errorUs){
+        int64_t e = m.errorUs + llabs(remaining) + llabs(dt) * PTP_RATE_ERROR / 1000000000LL;
+        *errorUs = (e > UINT32_MAX) ? UINT32_MAX : (uint32_t)e;
+    }
+    return master;
+}
+
+/*
+ * The fit only uses exchanges within PTP_DELAY_SLACK of the shortest path delay
+ * in the filter: a longer delay means the message sat in a queue on one way,
+ * which shows up as offset. Offset over local time is fitted as a line, its
+ * slope is the rate of the master clock against ours.
+ */
+void PTPClock::_addSample(int64_t local, int64_t offset, uint32_t delay)
+{
+    _samples[_sampleNext].local = local;
+    _samples[_sampleNext].offset = offset;
+    _samples[_sampleNext].delay = delay;
+    _sampleNext = (_sampleNext + 1) % PTP_FILTER_SIZE;
+    if(_sampleCount < PTP_FILTER_SIZE){
+        _sampleCount++;
+    }
+
+    uint32_t minDelay = UINT32_MAX;
+    for(uint8_t i = 0; i < _sampleCount; i++){
+        if(_samples[i].delay < minDelay){
+            minDelay = _samples[i].delay;
+        }
+    }
+    _stats.minDelayUs = minDelay;
+    if(delay > minDelay + PTP_DELAY_SLACK){
+        _stats.filtered++;
+    }
+
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int n = 0;
+    int64_t span = 0;
+    for(uint8_t i = 0; i < _sampleCount; i++){
+        if(_samples[i].delay > minDelay + PTP_DELAY_SLACK){
+            continue;
+        }
+        double x = _samples[i].local - local;
+        double y = _samples[i].offset - offset;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        n++;
+        if(local - _samples[i].local > span){
+            span = local - _samples[i].local;
+        }
+    }
+    if(!n){
+        return;
+    }
+
+    double rate = _model.ratePpb / 1e9;
+    if(n >= 2 && span > 1000000){
+        double d = n * sxx - sx * sx;
+        if(d > 0){
+            rate = (n * sxy - sx * sy) / d;
+        }
+    }
+    if(rate > PTP_RATE_MAX / 1e9){
+        rate = PTP_RATE_MAX / 1e9;
+    } else if(rate < -PTP_RATE_MAX / 1e9){
+        rate = -PTP_RATE_MAX / 1e9;
+    }
+    double intercept = (sy - rate * sx) / n;
+    double residuals = 0;
+    for(uint8_t i = 0; i < _sampleCount; i++){
+        if(_samples[i].delay > minDelay + PTP_DELAY_SLACK){
+            continue;
+        }
+        double r = (_samples[i].offset - offset) - (intercept + rate * (_samples[i].local - local));
+        residuals += r * r;
+    }
+
+    // the new line, anchored now and continuous with the old model
+    int64_t now = esp_timer_get_time();
+    int64_t fitted = now + offset + (int64_t)intercept + (int64_t)(rate * (now - local));
+    model_t m;
+    portENTER_CRITICAL(&_mux);
+    m = _model;
+    portEXIT_CRITICAL(&_mux);
+    int64_t current = _synced ? _modelTime(m, now, NULL) : fitted;
+    if(!_synced || llabs(fitted - current) > PTP_STEP_US){
+        m.refMaster = fitted;
+        m.slewUs = 0;
+    } else {
+        m.refMaster = current;
+        m.slewUs = fitted - current;
+    }
+    m.refLocal = now;
+    m.ratePpb = rate * 1e9;
+    m.errorUs = sqrt(residuals / n);
+    portENTER_CRITICAL(&_mux);
+    _model = m;
+    portEXIT_CRITICAL(&_mux);
+    _synced = true;
+    _stats.ratePpb = m.ratePpb;
+    _stats.errorUs = m.errorUs + llabs(m.slewUs);
+}
+
+bool PTPClock::synced()
+{
+    return (_role == PTP_MASTER) ? _task != NULL : _synced;
+}
+
+int64_t PTPClock::toMaster(int64_t localUs, uint32_t * errorUs)
+{
+    if(_role == PTP_MASTER){
+        if(!_task){
+            return -1;
+        }
+        if(timeSynced()){
+            return timeToUtcMicros(localUs, errorUs);
+        }
+        if(errorUs){
+            *errorUs = 0;
+        }
+        return localUs;
+    }
+    if(!_synced){
+        if(errorUs){
+            *errorUs = UINT32_MAX;
+        }
+        return -1;
+    }
+    model_t m;
+    portENTER_CRITICAL(&_mux);
+    m = _model;
+    portEXIT_CRITICAL(&_mux);
+    return _modelTime(m, localUs, errorUs);
+}
+
+int64_t PTPClock::now(uint32_t * errorUs)
+{
+    return toMaster(esp_timer_get_time(), errorUs);
+}
+
+int64_t PTPClock::toLocal(int64_t masterUs)
+{
+    int64_t local = esp_timer_get_time();
+    int64_t master = toMaster(local);
+    if(master < 0){
+        return -1;
+    }
+    // the mapping is a line with a slope within a few hundred ppm of 1, this converges at once
+    for(int i = 0; i < 3 && master != masterUs; i++){
+        local -= master - masterUs;
+        master = toMaster(local);
+    }
+    return local;
+}
+
+bool PTPClock::getStats(ptp_stats_t * stats)
+{
+    if(!stats){
+        return false;
+    }
+    memcpy(stats, &_stats, sizeof(ptp_stats_t));
+    return true;
+}
@@ -0,0 +1,156 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _PTP_H_
+#define _PTP_H_
+
+#include "Arduino.h"
+#include "AsyncUDP.h"
+
+#ifndef PTP_PORT
+#define PTP_PORT 1588 // not 319/320, this is not wire compatible with IEEE 1588 devices
+#endif
+
+#ifndef PTP_SYNC_INTERVAL
+#define PTP_SYNC_INTERVAL 1000 // ms between Sync messages of the master
+#endif
+
+#ifndef PTP_FILTER_SIZE
+#define PTP_FILTER_SIZE 16 // exchanges the clock model of a slave is fitted over
+#endif
+
+#ifndef PTP_DELAY_SLACK
+#define PTP_DELAY_SLACK 100 // us above the shortest path delay an exchange may take and still be used
+#endif
+
+#ifndef PTP_MASTER_TIMEOUT
+#define PTP_MASTER_TIMEOUT 5000 // ms without Sync before a slave follows another master
+#endif
+
+#ifndef PTP_QUEUE_SIZE
+#define PTP_QUEUE_SIZE 8 // received messages waiting for the PTP task
+#endif
+
+typedef enum {
+    PTP_MASTER,
+    PTP_SLAVE
+} ptp_role_t;
+
+typedef struct {
+    uint32_t syncs;        // Sync messages sent (master) or received from the master (slave)
+    uint32_t exchanges;    // delay request and response pairs completed
+    uint32_t filtered;     // of those, left out of the fit for a long path delay
+    uint32_t dropped;      // received while the queue was full
+    uint32_t masterId;
+    int64_t offsetUs;      // local minus master clock, last exchange
+    uint32_t delayUs;      // one way path delay, last exchange
+    uint32_t minDelayUs;   // shortest in the filter
+    int32_t ratePpb;       // how much faster the master clock runs than the local one
+    uint32_t errorUs;      // spread of the fitted exchanges and the correction not yet slewed in
+} ptp_stats_t;
+
+/*
+ * The master multicasts Sync and a Follow_Up with the time it sent it, each slave
+ * answers with a Delay_Req and gets the time it arrived in a Delay_Resp. From the
+ * four timestamps a slave has offset and path delay of every exchange; the clock
+ * model is a line fitted over the recent exchanges with the shortest delays, so
+ * that queueing in the access point does not count. Model changes are slewed in,
+ * master time as seen by a slave never jumps back.
+ *
+ * Receive timestamps are taken in the lwIP thread as the datagram comes up from
+ * the driver, transmit timestamps right after the datagram was handed to it.
+ * The master clock is its UTC from the time service (timeSyncBegin()) once that
+ * is synced, else its esp_timer_get_time().
+ */
+class PTPClock
+{
+public:
+    PTPClock();
+    ~PTPClock();
+
+    bool begin(ptp_role_t role, uint32_t syncInterval = PTP_SYNC_INTERVAL);
+    void end();
+
+    bool synced();
+    // master clock in microseconds now, or at an esp_timer_get_time() timestamp, -1 before sync
+    int64_t now(uint32_t * errorUs = NULL);
+    int64_t toMaster(int64_t localUs, uint32_t * errorUs = NULL);
+    // esp_timer_get_time() at which the master clock reads masterUs, to sample at a common instant
+    int64_t toLocal(int64_t masterUs);
+
+    bool getStats(ptp_stats_t * stats);
+protected:
+    typedef struct __attribute__((packed)) {
+        uint32_t magic;
+        uint8_t type;
+        uint8_t reserved;
+        uint16_t seq;
+        uint32_t clockId;      // the sender, for Delay_Resp the slave it answers
+        int64_t time;
+    } message_t;
+
+    typedef struct {
+        message_t message;
+        int64_t rx;            // esp_timer_get_time() on arrival
+        uint32_t ip;
+    } event_t;
+
+    typedef struct {
+        int64_t local;
+        int64_t offset;        // master minus local
+        uint32_t delay;
+    } sample_t;
+
+    typedef struct {
+        int64_t refLocal;
+        int64_t refMaster;
+        int64_t slewUs;
+        int32_t ratePpb;
+        uint32_t errorUs;
+    } model_t;
+
+    AsyncUDP _udp;
+    ptp_role_t _role;
+    uint32_t _interval;
+    uint32_t _clockId;
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+    volatile bool _running;
+    portMUX_TYPE _mux;
+
+    // slave
+    uint32_t _masterId;
+    uint32_t _masterIp;
+    uint32_t _lastSync;
+    uint16_t _seq;
+    int64_t _t1, _t2, _t3;
+    bool _haveT1, _haveT2, _haveT3;
+    sample_t _samples[PTP_FILTER_SIZE];
+    uint8_t _sampleCount;
+    uint8_t _sampleNext;
+    model_t _model;
+    bool _synced;
+    ptp_stats_t _stats;
+
+    static void _taskFn(void * arg);
+    void _run();
+    void _onPacket(AsyncUDPPacket & packet);
+    void _handle(const event_t & event);
+    void _send(uint8_t type, uint16_t seq, uint32_t clockId, int64_t time, uint32_t ip, int64_t * sent);
+    int64_t _masterClock(int64_t local);
+    void _addSample(int64_t local, int64_t offset, uint32_t delay);
+    static int64_t _modelTime(const model_t & m, int64_t local, uint32_t * errorUs);
+};
+
+#endif /* _PTP_H_ */
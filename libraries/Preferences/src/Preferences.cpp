@@ -20,10 +20,175 @@
 const char * nvs_errors[] = { "OTHER", "NOT_INITIALIZED", "NOT_FOUND", "TYPE_MISMATCH", "READ_ONLY", "NOT_ENOUGH_SPACE", "INVALID_NAME", "INVALID_HANDLE", "REMOVE_FAILED", "KEY_TOO_LONG", "PAGE_FULL", "INVALID_STATE", "INVALID_LENGTH"};
 #define nvs_error(e) (((e)>ESP_ERR_NVS_BASE)?nvs_errors[(e)&~(ESP_ERR_NVS_BASE)]:nvs_errors[0])
 
+/*
+ * Namespace handles stay open after end() so the next begin() of the same
+ * namespace does not reopen it, and small values are kept in RAM once read
+ * or written. Both are shared by all Preferences objects; the read cache
+ * assumes the namespace is only written through Preferences.
+ * */
+
+typedef struct {
+    uint32_t handle;
+    uint16_t refs;
+    bool readOnly;
+    uint32_t used;
+    char name[16];
+    char label[17];
+} pref_handle_t;
+
+typedef struct {
+    uint32_t handle;    // 0 for a free entry
+    uint32_t used;
+    uint8_t type;
+    uint8_t len;
+    char key[16];
+    uint8_t value[8];
+} pref_value_t;
+
+static pref_handle_t s_handles[PREFERENCES_HANDLE_CACHE];
+static pref_value_t s_values[PREFERENCES_READ_CACHE];
+static uint32_t s_clock = 0;
+static uint16_t s_uncached = 0;   // open handles that got no slot, they would write past the read cache
+static SemaphoreHandle_t s_lock = NULL;
+
+static void prefsLock(){
+    if(!s_lock){
+        // the first begin() of all, normally from setup()
+        s_lock = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void prefsUnlock(){
+    xSemaphoreGive(s_lock);
+}
+
+static pref_value_t * cacheFind(uint32_t handle, const char* key, int type){
+    for(int i = 0; i < PREFERENCES_READ_CACHE; i++){
+        pref_value_t * v = &s_values[i];
+        if(v->handle == handle && (type < 0 || v->type == type) && !strncmp(v->key, key, sizeof(v->key))){
+            return v;
+        }
+    }
+    return NULL;
+}
+
+// lock held; values are only cached for handles kept in s_handles
+static pref_handle_t * slotOf(uint32_t handle){
+    for(int i = 0; i < PREFERENCES_HANDLE_CACHE; i++){
+        if(handle && s_handles[i].handle == handle){
+            return &s_handles[i];
+        }
+    }
+    return NULL;
+}
+
+// lock held; a read-only and a read-write handle of one namespace see the same values
+static bool sameNamespace(uint32_t a, uint32_t b){
+    if(a == b){
+        return true;
+    }
+    pref_handle_t * ha = slotOf(a);
+    pref_handle_t * hb = slotOf(b);
+    return ha && hb && !strcmp(ha->name, hb->name) && !strcmp(ha->label, hb->label);
+}
+
+// lock held, key NULL drops every value of the namespace
+static void cacheDropLocked(uint32_t handle, const char* key){
+    for(int i = 0; i < PREFERENCES_READ_CACHE; i++){
+        pref_value_t * v = &s_values[i];
+        if(v->handle && sameNamespace(v->handle, handle) && (!key || !strncmp(v->key, key, sizeof(v->key)))){
+            v->handle = 0;
+        }
+    }
+}
+
+static void cacheDrop(uint32_t handle, const char* key){
+    prefsLock();
+    cacheDropLocked(handle, key);
+    prefsUnlock();
+}
+
+static bool cacheLookup(uint32_t handle, const char* key, PreferenceType type, void* value, size_t len){
+    bool hit = false;
+    prefsLock();
+    pref_value_t * v = s_uncached ? NULL : cacheFind(handle, key, type);
+    if(v && v->len <= len){
+        memcpy(value, v->value, v->len);
+        v->used = ++s_clock;
+        hit = true;
+    }
+    prefsUnlock();
+    return hit;
+}
+
+// 0 when not cached
+static size_t cacheLength(uint32_t handle, const char* key, PreferenceType type){
+    prefsLock();
+    pref_value_t * v = s_uncached ? NULL : cacheFind(handle, key, type);
+    size_t len = v ? v->len : 0;
+    prefsUnlock();
+    return len;
+}
+
+static bool cacheSame(uint32_t handle, const char* key, PreferenceType type, const void* value, size_t len){
+    bool same = false;
+    prefsLock();
+    pref_value_t * v = s_uncached ? NULL : cacheFind(handle, key, type);
+    if(v && v->len == len && !memcmp(v->value, value, len)){
+        v->used = ++s_clock;
+        same = true;
+    }
+    prefsUnlock();
+    return same;
+}
+
+static void cacheStore(uint32_t handle, const char* key, PreferenceType type, const void* value, size_t len){
+    if(len > sizeof(((pref_value_t *)0)->value) || strlen(key) >= sizeof(((pref_value_t *)0)->key)){
+        cacheDrop(handle, key);
+        return;
+    }
+    prefsLock();
+    if(!slotOf(handle) || s_uncached){
+        prefsUnlock();
+        return;
+    }
+    // a key holds one value whatever its type
+    cacheDropLocked(handle, key);
+    pref_value_t * v = &s_values[0];
+    for(int i = 0; i < PREFERENCES_READ_CACHE; i++){
+        if(!s_values[i].handle){
+            v = &s_values[i];
+            break;
+        }
+        if(s_values[i].used < v->used){
+            v = &s_values[i];
+        }
+    }
+    strncpy(v->key, key, sizeof(v->key));
+    v->handle = handle;
+    v->type = type;
+    v->len = len;
+    memcpy(v->value, value, len);
+    v->used = ++s_clock;
+    prefsUnlock();
+}
+
+// lock held
+static void handleClose(uint32_t handle){
+    nvs_close(handle);
+    for(int i = 0; i < PREFERENCES_READ_CACHE; i++){
+        if(s_values[i].handle == handle){
+            s_values[i].handle = 0;
+        }
+    }
+}
+
 Preferences::Preferences()
     :_handle(0)
     ,_started(false)
     ,_readOnly(false)
+    ,_batch(false)
 {}
 
 Preferences::~Preferences(){
@@ -34,11 +199,28 @@ bool Preferences::begin(const char * name, bool readOnly, const char* partition_
     if(_started){
         return false;
     }
+    if(!name){
+        return false;
+    }
     _readOnly = readOnly;
+    const char * label = partition_label ? partition_label : "";
+    prefsLock();
+    for(int i = 0; i < PREFERENCES_HANDLE_CACHE; i++){
+        pref_handle_t * h = &s_handles[i];
+        if(h->handle && h->readOnly == readOnly && !strcmp(h->name, name) && !strcmp(h->label, label)){
+            h->refs++;
+            h->used = ++s_clock;
+            _handle = h->handle;
+            _started = true;
+            prefsUnlock();
+            return true;
+        }
+    }
     esp_err_t err = ESP_OK;
     if (partition_label != NULL) {
         err = nvs_flash_init_partition(partition_label);
         if (err) {
+            prefsUnlock();
             log_e("nvs_flash_init_partition failed: %s", nvs_error(err));
             return false;
         }
@@ -47,9 +229,38 @@ bool Preferences::begin(const char * name, bool readOnly, const char* partition_
         err = nvs_open(name, readOnly?NVS_READONLY:NVS_READWRITE, &_handle);
     }
     if(err){
+        prefsUnlock();
         log_e("nvs_open failed: %s", nvs_error(err));
         return false;
     }
+    // keep it in a free slot, or in place of the least recently used idle one;
+    // when all are in use it is closed again by end()
+    pref_handle_t * slot = NULL;
+    for(int i = 0; i < PREFERENCES_HANDLE_CACHE; i++){
+        pref_handle_t * h = &s_handles[i];
+        if(!h->handle){
+            slot = h;
+            break;
+        }
+        if(!h->refs && (!slot || h->used < slot->used)){
+            slot = h;
+        }
+    }
+    if(slot && strlen(name) < sizeof(slot->name) && strlen(label) < sizeof(slot->label)){
+        if(slot->handle){
+            handleClose(slot->handle);
+        }
+        slot->handle = _handle;
+        slot->refs = 1;
+        slot->readOnly = readOnly;
+        slot->used = ++s_clock;
+        strcpy(slot->name, name);
+        strcpy(slot->label, label);
+    } else {
+        memset(s_values, 0, sizeof(s_values));
+        s_uncached++;
+    }
+    prefsUnlock();
     _started = true;
     return true;
 }
@@ -58,10 +269,63 @@ void Preferences::end(){
     if(!_started){
         return;
     }
-    nvs_close(_handle);
+    if(_batch){
+        commit();
+    }
+    prefsLock();
+    bool cached = false;
+    for(int i = 0; i < PREFERENCES_HANDLE_CACHE; i++){
+        if(s_handles[i].handle == _handle){
+            s_handles[i].refs--;
+            cached = true;
+            break;
+        }
+    }
+    if(!cached){
+        handleClose(_handle);
+        s_uncached--;
+    }
+    prefsUnlock();
     _started = false;
 }
 
+/*
+ * Batched writes
+ * */
+
+bool Preferences::beginBatch(){
+    if(!_started || _readOnly){
+        return false;
+    }
+    _batch = true;
+    return true;
+}
+
+bool Preferences::commit(){
+    if(!_started || _readOnly){
+        return false;
+    }
+    _batch = false;
+    esp_err_t err = nvs_commit(_handle);
+    if(err){
+        log_e("nvs_commit fail: %s", nvs_error(err));
+        return false;
+    }
+    return true;
+}
+
+bool Preferences::_commit(const char* key){
+    if(_batch){
+        return true;
+    }
+    esp_err_t err = nvs_commit(_handle);
+    if(err){
+        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+        return false;
+    }
+    return true;
+}
+
 /*
  * Clear all keys in opened preferences
  * */
@@ -70,12 +334,13 @@ bool Preferences::clear(){
     if(!_started || _readOnly){
         return false;
     }
+    cacheDrop(_handle, NULL);
     esp_err_t err = nvs_erase_all(_handle);
     if(err){
         log_e("nvs_erase_all fail: %s", nvs_error(err));
         return false;
     }
-    return true;
+    return _commit("");
 }
 
 /*
@@ -86,12 +351,13 @@ bool Preferences::remove(const char * key){
     if(!_started || !key || _readOnly){
         return false;
     }
+    cacheDrop(_handle, key);
     esp_err_t err = nvs_erase_key(_handle, key);
     if(err){
         log_e("nvs_erase_key fail: %s %s", key, nvs_error(err));
         return false;
     }
-    return true;
+    return _commit(key);
 }
 
 /*
@@ -102,14 +368,16 @@ size_t Preferences::putChar(const char* key, int8_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_I8, &value, sizeof(value))){
+        return 1;
+    }
     esp_err_t err = nvs_set_i8(_handle, key, value);
     if(err){
         log_e("nvs_set_i8 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_I8, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 1;
@@ -119,14 +387,16 @@ size_t Preferences::putUChar(const char* key, uint8_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_U8, &value, sizeof(value))){
+        return 1;
+    }
     esp_err_t err = nvs_set_u8(_handle, key, value);
     if(err){
         log_e("nvs_set_u8 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_U8, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 1;
@@ -136,14 +406,16 @@ size_t Preferences::putShort(const char* key, int16_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_I16, &value, sizeof(value))){
+        return 2;
+    }
     esp_err_t err = nvs_set_i16(_handle, key, value);
     if(err){
         log_e("nvs_set_i16 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_I16, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 2;
@@ -153,14 +425,16 @@ size_t Preferences::putUShort(const char* key, uint16_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_U16, &value, sizeof(value))){
+        return 2;
+    }
     esp_err_t err = nvs_set_u16(_handle, key, value);
     if(err){
         log_e("nvs_set_u16 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_U16, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 2;
@@ -170,14 +444,16 @@ size_t Preferences::putInt(const char* key, int32_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_I32, &value, sizeof(value))){
+        return 4;
+    }
     esp_err_t err = nvs_set_i32(_handle, key, value);
     if(err){
         log_e("nvs_set_i32 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_I32, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 4;
@@ -187,14 +463,16 @@ size_t Preferences::putUInt(const char* key, uint32_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_U32, &value, sizeof(value))){
+        return 4;
+    }
     esp_err_t err = nvs_set_u32(_handle, key, value);
     if(err){
         log_e("nvs_set_u32 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_U32, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 4;
@@ -212,14 +490,16 @@ size_t Preferences::putLong64(const char* key, int64_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_I64, &value, sizeof(value))){
+        return 8;
+    }
     esp_err_t err = nvs_set_i64(_handle, key, value);
     if(err){
         log_e("nvs_set_i64 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_I64, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 8;
@@ -229,14 +509,16 @@ size_t Preferences::putULong64(const char* key, uint64_t value){
     if(!_started || !key || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_U64, &value, sizeof(value))){
+        return 8;
+    }
     esp_err_t err = nvs_set_u64(_handle, key, value);
     if(err){
         log_e("nvs_set_u64 fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_U64, &value, sizeof(value));
+    if(!_commit(key)){
         return 0;
     }
     return 8;
@@ -258,35 +540,56 @@ size_t Preferences::putString(const char* key, const char* value){
     if(!_started || !key || !value || _readOnly){
         return 0;
     }
+    cacheDrop(_handle, key);
     esp_err_t err = nvs_set_str(_handle, key, value);
     if(err){
         log_e("nvs_set_str fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    if(!_commit(key)){
         return 0;
     }
     return strlen(value);
 }
 
-size_t Preferences::putString(const char* key, const String value){
+size_t Preferences::putString(const char* key, const String& value){
     return putString(key, value.c_str());
 }
 
+size_t Preferences::putString(const char* key, StringView value){
+    // nvs wants a NUL terminated copy, short values stay on the stack
+    char buf[64];
+    char * str = buf;
+    if(value.length() >= sizeof(buf)){
+        str = (char *)malloc(value.length() + 1);
+        if(!str){
+            log_e("could not allocate %u bytes for %s", value.length() + 1, key);
+            return 0;
+        }
+    }
+    memcpy(str, value.data(), value.length());
+    str[value.length()] = 0;
+    size_t len = putString(key, (const char *)str);
+    if(str != buf){
+        free(str);
+    }
+    return len;
+}
+
 size_t Preferences::putBytes(const char* key, const void* value, size_t len){
     if(!_started || !key || !value || !len || _readOnly){
         return 0;
     }
+    if(cacheSame(_handle, key, PT_BLOB, value, len)){
+        return len;
+    }
     esp_err_t err = nvs_set_blob(_handle, key, value, len);
     if(err){
         log_e("nvs_set_blob fail: %s %s", key, nvs_error(err));
         return 0;
     }
-    err = nvs_commit(_handle);
-    if(err){
-        log_e("nvs_commit fail: %s %s", key, nvs_error(err));
+    cacheStore(_handle, key, PT_BLOB, value, len);
+    if(!_commit(key)){
         return 0;
     }
     return len;
@@ -325,9 +628,14 @@ int8_t Preferences::getChar(const char* key, const int8_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_I8, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_i8(_handle, key, &value);
     if(err){
         log_v("nvs_get_i8 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_I8, &value, sizeof(value));
     }
     return value;
 }
@@ -337,9 +645,14 @@ uint8_t Preferences::getUChar(const char* key, const uint8_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_U8, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_u8(_handle, key, &value);
     if(err){
         log_v("nvs_get_u8 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_U8, &value, sizeof(value));
     }
     return value;
 }
@@ -349,9 +662,14 @@ int16_t Preferences::getShort(const char* key, const int16_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_I16, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_i16(_handle, key, &value);
     if(err){
         log_v("nvs_get_i16 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_I16, &value, sizeof(value));
     }
     return value;
 }
@@ -361,9 +679,14 @@ uint16_t Preferences::getUShort(const char* key, const uint16_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_U16, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_u16(_handle, key, &value);
     if(err){
         log_v("nvs_get_u16 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_U16, &value, sizeof(value));
     }
     return value;
 }
@@ -373,9 +696,14 @@ int32_t Preferences::getInt(const char* key, const int32_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_I32, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_i32(_handle, key, &value);
     if(err){
         log_v("nvs_get_i32 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_I32, &value, sizeof(value));
     }
     return value;
 }
@@ -385,9 +713,14 @@ uint32_t Preferences::getUInt(const char* key, const uint32_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_U32, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_u32(_handle, key, &value);
     if(err){
         log_v("nvs_get_u32 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_U32, &value, sizeof(value));
     }
     return value;
 }
@@ -405,9 +738,14 @@ int64_t Preferences::getLong64(const char* key, const int64_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_I64, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_i64(_handle, key, &value);
     if(err){
         log_v("nvs_get_i64 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_I64, &value, sizeof(value));
     }
     return value;
 }
@@ -417,9 +755,14 @@ uint64_t Preferences::getULong64(const char* key, const uint64_t defaultValue){
     if(!_started || !key){
         return value;
     }
+    if(cacheLookup(_handle, key, PT_U64, &value, sizeof(value))){
+        return value;
+    }
     esp_err_t err = nvs_get_u64(_handle, key, &value);
     if(err){
         log_v("nvs_get_u64 fail: %s %s", key, nvs_error(err));
+    } else {
+        cacheStore(_handle, key, PT_U64, &value, sizeof(value));
     }
     return value;
 }
@@ -488,6 +831,10 @@ size_t Preferences::getBytesLength(const char* key){
     if(!_started || !key){
         return 0;
     }
+    len = cacheLength(_handle, key, PT_BLOB);
+    if(len){
+        return len;
+    }
     esp_err_t err = nvs_get_blob(_handle, key, NULL, &len);
     if(err){
         log_e("nvs_get_blob len fail: %s %s", key, nvs_error(err));
@@ -497,22 +844,142 @@ size_t Preferences::getBytesLength(const char* key){
 }
 
 size_t Preferences::getBytes(const char* key, void * buf, size_t maxLen){
-    size_t len = getBytesLength(key);
-    if(!len || !buf || !maxLen){
+    if(!buf || !maxLen){
+        return getBytesLength(key);
+    }
+    if(!_started || !key){
+        return 0;
+    }
+    size_t len = cacheLength(_handle, key, PT_BLOB);
+    if(len && len <= maxLen && cacheLookup(_handle, key, PT_BLOB, buf, len)){
         return len;
     }
-    if(len > maxLen){
+    // one lookup: NVS reports a blob that does not fit instead of reading it
+    len = maxLen;
+    esp_err_t err = nvs_get_blob(_handle, key, buf, &len);
+    if(err == ESP_ERR_NVS_INVALID_LENGTH){
         log_e("not enough space in buffer: %u < %u", maxLen, len);
         return 0;
     }
-    esp_err_t err = nvs_get_blob(_handle, key, buf, &len);
     if(err){
-        log_e("nvs_get_blob fail: %s %s", key, nvs_error(err));
+        log_v("nvs_get_blob fail: %s %s", key, nvs_error(err));
         return 0;
     }
+    cacheStore(_handle, key, PT_BLOB, buf, len);
     return len;
 }
 
+/*
+ * Structs, stored in PREFERENCES_CHUNK_SIZE blobs under "<key>.<n>" with the
+ * length under "<key>"; only the chunks that differ from what NVS holds are written
+ * */
+
+static void chunkKey(char * out, const char* key, size_t index){
+    snprintf(out, 16, "%s.%x", key, (unsigned)index);
+}
+
+size_t Preferences::putStruct(const char* key, const void* value, size_t len, size_t offset, size_t changed){
+    if(!_started || !key || !value || !len || _readOnly){
+        return 0;
+    }
+    if(strlen(key) > 12 || (len + PREFERENCES_CHUNK_SIZE - 1) / PREFERENCES_CHUNK_SIZE > 0x100){
+        log_e("struct key too long or struct too big: %s %u", key, len);
+        return 0;
+    }
+    uint32_t stored = 0;
+    bool sameLayout = getBytes(key, &stored, sizeof(stored)) == sizeof(stored) && stored == len;
+    if(!sameLayout){
+        // everything is rewritten
+        offset = 0;
+        changed = len;
+    }
+    if(offset >= len){
+        return len;
+    }
+    if(changed > len - offset){
+        changed = len - offset;
+    }
+
+    bool batch = _batch;
+    _batch = true;
+    char ckey[16];
+    uint8_t current[PREFERENCES_CHUNK_SIZE];
+    size_t written = 0;
+    for(size_t i = offset / PREFERENCES_CHUNK_SIZE; i * PREFERENCES_CHUNK_SIZE < offset + changed; i++){
+        size_t start = i * PREFERENCES_CHUNK_SIZE;
+        size_t clen = (len - start < PREFERENCES_CHUNK_SIZE) ? len - start : PREFERENCES_CHUNK_SIZE;
+        const uint8_t * chunk = (const uint8_t *)value + start;
+        chunkKey(ckey, key, i);
+        size_t have = clen;
+        if(sameLayout && nvs_get_blob(_handle, ckey, current, &have) == ESP_OK && have == clen && !memcmp(current, chunk, clen)){
+            continue;
+        }
+        esp_err_t err = nvs_set_blob(_handle, ckey, chunk, clen);
+        if(err){
+            log_e("nvs_set_blob fail: %s %s", ckey, nvs_error(err));
+            _batch = batch;
+            return 0;
+        }
+        written++;
+    }
+    if(!sameLayout){
+        // chunks of a longer struct stored before
+        for(size_t i = (stored + PREFERENCES_CHUNK_SIZE - 1) / PREFERENCES_CHUNK_SIZE; i > (len + PREFERENCES_CHUNK_SIZE - 1) / PREFERENCES_CHUNK_SIZE; i--){
+            chunkKey(ckey, key, i - 1);
+            nvs_erase_key(_handle, ckey);
+        }
+        stored = len;
+        if(!putBytes(key, &stored, sizeof(stored))){
+            _batch = batch;
+            return 0;
+        }
+    }
+    _batch = batch;
+    if(written && !_commit(key)){
+        return 0;
+    }
+    return len;
+}
+
+size_t Preferences::getStruct(const char* key, void* value, size_t len){
+    if(!_started || !key || !value || !len){
+        return 0;
+    }
+    uint32_t stored = 0;
+    if(getBytes(key, &stored, sizeof(stored)) != sizeof(stored)){
+        return 0;
+    }
+    if(stored != len){
+        log_e("struct %s is %u bytes, not %u", key, stored, len);
+        return 0;
+    }
+    char ckey[16];
+    for(size_t start = 0; start < len; start += PREFERENCES_CHUNK_SIZE){
+        size_t clen = (len - start < PREFERENCES_CHUNK_SIZE) ? len - start : PREFERENCES_CHUNK_SIZE;
+        chunkKey(ckey, key, start / PREFERENCES_CHUNK_SIZE);
+        size_t have = clen;
+        esp_err_t err = nvs_get_blob(_handle, ckey, (uint8_t *)value + start, &have);
+        if(err || have != clen){
+            log_e("nvs_get_blob fail: %s %s", ckey, nvs_error(err));
+            return 0;
+        }
+    }
+    return len;
+}
+
+bool Preferences::removeStruct(const char* key){
+    uint32_t stored = 0;
+    if(!_started || !key || _readOnly || getBytes(key, &stored, sizeof(stored)) != sizeof(stored)){
+        return false;
+    }
+    char ckey[16];
+    for(size_t i = 0; i * PREFERENCES_CHUNK_SIZE < stored; i++){
+        chunkKey(ckey, key, i);
+        nvs_erase_key(_handle, ckey);
+    }
+    return remove(key);
+}
+
 size_t Preferences::freeEntries() {
     nvs_stats_t nvs_stats;
     esp_err_t err = nvs_get_stats(NULL, &nvs_stats);
@@ -17,6 +17,18 @@
 
 #include "Arduino.h"
 
+#ifndef PREFERENCES_HANDLE_CACHE
+#define PREFERENCES_HANDLE_CACHE 4 // namespaces kept open after end(), reused by the next begin()
+#endif
+
+#ifndef PREFERENCES_CHUNK_SIZE
+#define PREFERENCES_CHUNK_SIZE 128 // bytes of a struct per NVS blob, the unit putStruct() rewrites
+#endif
+
+#ifndef PREFERENCES_READ_CACHE
+#define PREFERENCES_READ_CACHE 16 // values of up to 8 bytes (numbers, bool, float, double) kept after a get or put
+#endif
+
 typedef enum {
     PT_I8, PT_U8, PT_I16, PT_U16, PT_I32, PT_U32, PT_I64, PT_U64, PT_STR, PT_BLOB, PT_INVALID
 } PreferenceType;
@@ -26,6 +38,8 @@ class Preferences {
         uint32_t _handle;
         bool _started;
         bool _readOnly;
+        bool _batch;
+        bool _commit(const char* key);
     public:
         Preferences();
         ~Preferences();
@@ -33,6 +47,10 @@ class Preferences {
         bool begin(const char * name, bool readOnly=false, const char* partition_label=NULL);
         void end();
 
+        // puts until commit() go out with one nvs_commit; end() commits an open batch
+        bool beginBatch();
+        bool commit();
+
         bool clear();
         bool remove(const char * key);
 
@@ -50,7 +68,8 @@ class Preferences {
         size_t putDouble(const char* key, double_t value);
         size_t putBool(const char* key, bool value);
         size_t putString(const char* key, const char* value);
-        size_t putString(const char* key, String value);
+        size_t putString(const char* key, const String& value);
+        size_t putString(const char* key, StringView value);
         size_t putBytes(const char* key, const void* value, size_t len);
 
         bool isKey(const char* key);
@@ -73,6 +92,23 @@ class Preferences {
         size_t getBytesLength(const char* key);
         size_t getBytes(const char* key, void * buf, size_t maxLen);
         size_t freeEntries();
+
+        // a struct in chunks (key up to 12 characters): only chunks that changed are written,
+        // and with offset/changed only those holding that byte range are looked at
+        size_t putStruct(const char* key, const void* value, size_t len, size_t offset=0, size_t changed=SIZE_MAX);
+        size_t getStruct(const char* key, void* value, size_t len);
+        bool removeStruct(const char* key);
+
+        template<typename T> size_t putStruct(const char* key, const T& value){
+            return putStruct(key, &value, sizeof(T));
+        }
+        // writes the chunks of one member: prefs.putField("cfg", cfg, cfg.ssid)
+        template<typename T, typename F> size_t putField(const char* key, const T& value, const F& field){
+            return putStruct(key, &value, sizeof(T), (const uint8_t*)&field - (const uint8_t*)&value, sizeof(F));
+        }
+        template<typename T> bool getStruct(const char* key, T& value){
+            return getStruct(key, &value, sizeof(T)) == sizeof(T);
+        }
 };
 
 #endif
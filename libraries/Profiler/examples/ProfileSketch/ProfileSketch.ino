@@ -0,0 +1,52 @@
+// Profiles two busy loops for a few seconds, then prints the samples. Save
+// the output between "# profiler" and "# end" and resolve it with the ELF of
+// the sketch (Sketch > Export compiled Binary, or the build folder):
+//   python tools/profile.py --elf ProfileSketch.ino.elf dump.txt
+// or read it off the port directly:
+//   python tools/profile.py --elf ProfileSketch.ino.elf --port /dev/ttyUSB0
+// Sending 'p' prints the profile again, 'r' starts it over.
+
+#include <Profiler.h>
+
+volatile float sink;
+
+void slowMath() {
+  float x = 1;
+  for (int i = 0; i < 2000; i++) {
+    x = sqrtf(x + i) * 1.0001f;
+  }
+  sink = x;
+}
+
+void fastMath() {
+  int x = 1;
+  for (int i = 0; i < 2000; i++) {
+    x = x * 3 + i;
+  }
+  sink = x;
+}
+
+void setup() {
+  Serial.begin(115200);
+  if (!Profiler.begin()) {
+    Serial.println("profiler not started");
+  }
+}
+
+void loop() {
+  slowMath();
+  fastMath();
+  static unsigned long started = millis();
+  if (started && millis() - started > 5000) {
+    started = 0;
+    Profiler.dump(Serial);
+  }
+  if (Serial.available()) {
+    char c = Serial.read();
+    if (c == 'p') {
+      Profiler.dump(Serial);
+    } else if (c == 'r') {
+      Profiler.reset();
+    }
+  }
+}
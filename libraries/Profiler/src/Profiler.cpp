@@ -0,0 +1,200 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "Profiler.h"
+#include "esp_heap_caps.h"
+#include "freertos/xtensa_context.h"
+
+static_assert((PROFILER_SLOTS & (PROFILER_SLOTS - 1)) == 0, "PROFILER_SLOTS has to be a power of two");
+
+// interrupt levels entered on each core, from the port of FreeRTOS
+extern "C" volatile uint32_t port_interruptNesting[portNUM_PROCESSORS];
+
+typedef struct {
+    profiler_entry_t* slots;
+    hw_timer_t* timer;
+    volatile uint32_t samples;
+    volatile uint32_t inIsr;
+    volatile uint32_t dropped;
+} profiler_core_t;
+
+static profiler_core_t _cores[portNUM_PROCESSORS];
+static volatile bool _sampling = false;
+static uint32_t _hz = 0;
+
+static void IRAM_ATTR _profilerSample()
+{
+    uint32_t core = xPortGetCoreID();
+    profiler_core_t& c = _cores[core];
+    if(!_sampling || !c.slots) {
+        return;
+    }
+    // nested in another interrupt, the frame with the PC of the task is not ours to find
+    if(port_interruptNesting[core] != 1) {
+        c.inIsr++;
+        return;
+    }
+    // entering the first interrupt level saved the frame of the task at its top of stack,
+    // the first member of the TCB
+    XtExcFrame* frame = *(XtExcFrame**)xTaskGetCurrentTaskHandleForCPU(core);
+    uint32_t pc = frame->pc;
+    uint32_t hash = (pc >> 2) * 2654435761UL;
+    for(uint32_t i = 0; i < PROFILER_PROBES; i++) {
+        profiler_entry_t& e = c.slots[(hash + i) & (PROFILER_SLOTS - 1)];
+        if(e.pc == pc || !e.pc) {
+            e.pc = pc;
+            e.count++;
+            c.samples++;
+            return;
+        }
+    }
+    c.dropped++;
+}
+
+typedef struct {
+    uint8_t core;
+    SemaphoreHandle_t done;
+} profiler_attach_t;
+
+// the timer interrupt goes to the core the handler is attached from
+static void _attachTask(void* arg)
+{
+    profiler_attach_t* attach = (profiler_attach_t*)arg;
+    profiler_core_t& c = _cores[attach->core];
+    timerAttachInterrupt(c.timer, _profilerSample, true);
+    timerAlarmWrite(c.timer, 1000000 / _hz, true);
+    timerAlarmEnable(c.timer);
+    xSemaphoreGive(attach->done);
+    vTaskDelete(NULL);
+}
+
+bool ProfilerClass::begin(uint32_t hz, uint8_t firstTimer)
+{
+    if(running()) {
+        return true;
+    }
+    if(!hz || hz > 100000 || firstTimer + portNUM_PROCESSORS > 4) {
+        log_e("%u Hz on timer %u not supported", hz, firstTimer);
+        return false;
+    }
+    _hz = hz;
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if(!done) {
+        return false;
+    }
+    bool ok = true;
+    for(uint8_t core = 0; core < portNUM_PROCESSORS && ok; core++) {
+        profiler_core_t& c = _cores[core];
+        c.slots = (profiler_entry_t*)heap_caps_calloc(PROFILER_SLOTS, sizeof(profiler_entry_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        // 1 MHz from the 80 MHz APB clock
+        c.timer = c.slots ? timerBegin(firstTimer + core, 80, true) : NULL;
+        if(!c.timer) {
+            log_e("no memory or timer for core %u", core);
+            ok = false;
+            break;
+        }
+        c.samples = c.inIsr = c.dropped = 0;
+        profiler_attach_t attach = { core, done };
+        if(xTaskCreatePinnedToCore(_attachTask, "profiler", 2048, &attach, configMAX_PRIORITIES - 1, NULL, core) != pdPASS) {
+            log_e("no task to attach the timer on core %u", core);
+            ok = false;
+            break;
+        }
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(done);
+    _sampling = ok;
+    if(!ok) {
+        end();
+    }
+    return ok;
+}
+
+void ProfilerClass::end()
+{
+    _sampling = false;
+    for(uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        profiler_core_t& c = _cores[core];
+        if(c.timer) {
+            timerAlarmDisable(c.timer);
+            timerEnd(c.timer);
+            c.timer = NULL;
+        }
+        free(c.slots);
+        c.slots = NULL;
+    }
+}
+
+bool ProfilerClass::running()
+{
+    return _sampling;
+}
+
+void ProfilerClass::reset()
+{
+    bool sampling = _sampling;
+    _sampling = false;
+    for(uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        profiler_core_t& c = _cores[core];
+        if(c.slots) {
+            memset(c.slots, 0, PROFILER_SLOTS * sizeof(profiler_entry_t));
+        }
+        c.samples = c.inIsr = c.dropped = 0;
+    }
+    _sampling = sampling;
+}
+
+uint32_t ProfilerClass::samples(uint8_t core)
+{
+    return (core < portNUM_PROCESSORS) ? _cores[core].samples : 0;
+}
+
+uint32_t ProfilerClass::isrSamples(uint8_t core)
+{
+    return (core < portNUM_PROCESSORS) ? _cores[core].inIsr : 0;
+}
+
+uint32_t ProfilerClass::dropped(uint8_t core)
+{
+    return (core < portNUM_PROCESSORS) ? _cores[core].dropped : 0;
+}
+
+size_t ProfilerClass::dump(Print& out)
+{
+    // a consistent snapshot, the run goes on once it is out
+    bool sampling = _sampling;
+    _sampling = false;
+    size_t n = out.printf("# profiler %u Hz\n", _hz);
+    for(uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        const profiler_core_t& c = _cores[core];
+        n += out.printf("# core %u: %u samples, %u in interrupts, %u dropped\n", core, c.samples, c.inIsr, c.dropped);
+    }
+    for(uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        const profiler_core_t& c = _cores[core];
+        if(!c.slots) {
+            continue;
+        }
+        for(size_t i = 0; i < PROFILER_SLOTS; i++) {
+            if(c.slots[i].pc) {
+                n += out.printf("%u 0x%08x %u\n", core, c.slots[i].pc, c.slots[i].count);
+            }
+        }
+    }
+    n += out.println("# end");
+    _sampling = sampling;
+    return n;
+}
+
+ProfilerClass Profiler;
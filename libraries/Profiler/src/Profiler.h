@@ -0,0 +1,70 @@
+// Copyright 2015-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include "Arduino.h"
+
+#ifndef PROFILER_SLOTS
+#define PROFILER_SLOTS 512 // distinct PCs counted per core, a power of two
+#endif
+
+#ifndef PROFILER_PROBES
+#define PROFILER_PROBES 8 // slots tried before a sample of a new PC is dropped
+#endif
+
+typedef struct {
+    uint32_t pc;            // 0 when the slot is free
+    uint32_t count;
+} profiler_entry_t;
+
+/*
+ * Statistical profile of the sketch and everything else running:
+ *
+ *   Profiler.begin();
+ *   ...
+ *   Profiler.dump(Serial);     // python tools/profile.py --elf sketch.elf dump.txt
+ *
+ * A hardware timer of esp32-hal-timer interrupts each core hz times a second,
+ * its handler, attached from that core, counts the PC the task there was
+ * interrupted at in a hash table of the core. Time spent in other interrupts
+ * or with interrupts masked is not seen, samples that land in an interrupt
+ * are only counted. dump() writes the tables as text to any Print, a
+ * StreamString to send it from a WebServer; the tool maps the addresses to
+ * functions and lines with addr2line.
+ */
+class ProfilerClass
+{
+public:
+    // hz a little off the 1 kHz tick of FreeRTOS so the samples do not lock to it;
+    // timer firstTimer samples core 0, firstTimer + 1 core 1
+    bool begin(uint32_t hz = 997, uint8_t firstTimer = 2);
+    void end();
+    bool running();
+
+    // the counts start over, the sampling goes on
+    void reset();
+    uint32_t samples(uint8_t core);     // in tasks
+    uint32_t isrSamples(uint8_t core);  // the core was in an interrupt
+    uint32_t dropped(uint8_t core);     // the table was full around the PC
+
+    // "# ..." header lines, then "<core> 0x<pc> <count>", then "# end"
+    size_t dump(Print& out);
+};
+
+extern ProfilerClass Profiler;
+
+#endif /* _PROFILER_H_ */
@@ -43,6 +43,7 @@ bool SDFS::begin(uint8_t ssPin, SPIClass &spi, uint32_t frequency, const char *
     }
 
     _impl->mountpoint(mountpoint);
+    _impl->fatDrive(_pdrv);
     return true;
 }
 
@@ -50,6 +51,7 @@ void SDFS::end()
 {
     if(_pdrv != 0xFF) {
         _impl->mountpoint(NULL);
+        _impl->fatDrive(-1);
         sdcard_unmount(_pdrv);
 
         sdcard_uninit(_pdrv);
@@ -75,6 +77,14 @@ uint64_t SDFS::cardSize()
     return (uint64_t)sectors * sectorSize;
 }
 
+bool SDFS::setWriteCache(uint16_t sectors, bool psram)
+{
+    if(_pdrv == 0xFF) {
+        return false;
+    }
+    return sdcard_cache(_pdrv, sectors, psram);
+}
+
 uint64_t SDFS::totalBytes()
 {
 	FATFS* fsinfo;
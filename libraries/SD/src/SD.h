@@ -35,6 +35,9 @@ public:
     uint64_t cardSize();
     uint64_t totalBytes();
     uint64_t usedBytes();
+    // after begin(): hold back up to sectors single sector writes and merge them, 0 turns it off;
+    // psram keeps the cache there when present, its sectors then go without DMA
+    bool setWriteCache(uint16_t sectors, bool psram=false);
 };
 
 }
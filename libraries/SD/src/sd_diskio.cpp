@@ -47,6 +47,27 @@ typedef enum {
     CRC_ON_OFF              = 59
 } ardu_sdcard_command_t;
 
+typedef struct {
+    DWORD sector;
+    uint32_t used;      // LRU stamp
+    bool valid;
+    bool dirty;
+} ardu_sdcache_entry_t;
+
+typedef struct {
+    uint16_t count;
+    uint32_t clock;
+    uint32_t since;     // millis() of the oldest write not on the card yet
+    bool dirty;
+    volatile bool stop;
+    SemaphoreHandle_t lock;
+    TaskHandle_t volatile task;
+    ardu_sdcache_entry_t * entries;
+    uint16_t * order;   // flush scratch: dirty slots by sector
+    const char ** blocks;
+    uint8_t * data;     // count sectors
+} ardu_sdcache_t;
+
 typedef struct {
     uint8_t ssPin;
     SPIClass * spi;
@@ -56,6 +77,7 @@ typedef struct {
     unsigned long sectors;
     bool supports_crc;
     int status;
+    ardu_sdcache_t * cache;
 } ardu_sdcard_t;
 
 static ardu_sdcard_t* s_cards[FF_VOLUMES] = { NULL };
@@ -163,10 +185,10 @@ char sdCommand(uint8_t pdrv, char cmd, unsigned int arg, unsigned int* resp)
     return token;
 }
 
-bool sdReadBytes(uint8_t pdrv, char* buffer, int length)
+// waits for the data token and starts the block, a whole sector through the DMA
+bool sdReadStart(uint8_t pdrv, char* buffer, int length)
 {
     char token;
-    unsigned short crc;
     ardu_sdcard_t * card = s_cards[pdrv];
 
     uint32_t start = millis();
@@ -178,21 +200,44 @@ bool sdReadBytes(uint8_t pdrv, char* buffer, int length)
         return false;
     }
 
-    card->spi->transferBytes(NULL, (uint8_t*)buffer, length);
-    crc = card->spi->transfer16(0xFFFF);
-    return (!card->supports_crc || crc == CRC16(buffer, length));
+    if (length == 512) {
+        // clocked out in place, the ones go ahead of what comes back
+        memset(buffer, 0xFF, length);
+        card->spi->transferAsync(buffer, buffer, length);
+    } else {
+        card->spi->transferBytes(NULL, (uint8_t*)buffer, length);
+    }
+    return true;
+}
+
+unsigned short sdReadFinish(uint8_t pdrv)
+{
+    ardu_sdcard_t * card = s_cards[pdrv];
+    card->spi->waitDMA();
+    return card->spi->transfer16(0xFFFF);
+}
+
+bool sdReadBytes(uint8_t pdrv, char* buffer, int length)
+{
+    if (!sdReadStart(pdrv, buffer, length)) {
+        return false;
+    }
+    unsigned short crc = sdReadFinish(pdrv);
+    return (!s_cards[pdrv]->supports_crc || crc == CRC16(buffer, length));
 }
 
 char sdWriteBytes(uint8_t pdrv, const char* buffer, char token)
 {
     ardu_sdcard_t * card = s_cards[pdrv];
-    unsigned short crc = (card->supports_crc)?CRC16(buffer, 512):0xFFFF;
     if (!sdWait(pdrv, 500)) {
         return false;
     }
 
     card->spi->write(token);
-    card->spi->writeBytes((uint8_t*)buffer, 512);
+    card->spi->transferAsync(buffer, NULL, 512);
+    // the CRC is worked out while the DMA sends the block
+    unsigned short crc = (card->supports_crc)?CRC16(buffer, 512):0xFFFF;
+    card->spi->waitDMA();
     card->spi->write16(crc);
     return (card->spi->transfer(0xFF) & 0x1F);
 }
@@ -239,16 +284,28 @@ bool sdReadSectors(uint8_t pdrv, char* buffer, unsigned long long sector, int co
         }
 
         if (!sdCommand(pdrv, READ_BLOCK_MULTIPLE, (s_cards[pdrv]->type == CARD_SDHC) ? sector : sector << 9, NULL)) {
-            do {
-                if (!sdReadBytes(pdrv, buffer, 512)) {
+            // a block is checked while the DMA receives the next one,
+            // sector and buffer stay on the first block not checked yet
+            int inFlight = 0;
+            unsigned short crc = 0;
+            while (count) {
+                bool more = count > inFlight;
+                bool started = more && sdReadStart(pdrv, buffer + (inFlight << 9), 512);
+                bool ok = !inFlight || !s_cards[pdrv]->supports_crc || crc == CRC16(buffer, 512);
+                unsigned short next = started ? sdReadFinish(pdrv) : 0;
+                if (!ok || (more && !started)) {
                     f++;
                     break;
                 }
-
-                sector++;
-                buffer += 512;
-                f = 0;
-            } while (--count);
+                if (inFlight) {
+                    sector++;
+                    buffer += 512;
+                    count--;
+                    f = 0;
+                }
+                inFlight = more;
+                crc = next;
+            }
 
             if (sdCommand(pdrv, STOP_TRANSMISSION, 0, NULL)) {
                 log_e("command failed");
@@ -296,10 +353,11 @@ bool sdWriteSector(uint8_t pdrv, const char* buffer, unsigned long long sector)
     return false;
 }
 
-bool sdWriteSectors(uint8_t pdrv, const char* buffer, unsigned long long sector, int count)
+// blocks, when given, holds a pointer to each sector's data instead of one contiguous buffer
+static bool sdWriteBlocks(uint8_t pdrv, const char* buffer, const char* const* blocks, unsigned long long sector, int count)
 {
     char token;
-    const char* currentBuffer = buffer;
+    int currentBlock = 0;
     unsigned long long currentSector = sector;
     int currentCount = count;
     ardu_sdcard_t * card = s_cards[pdrv];
@@ -317,12 +375,12 @@ bool sdWriteSectors(uint8_t pdrv, const char* buffer, unsigned long long sector,
 
         if (!sdCommand(pdrv, WRITE_BLOCK_MULTIPLE, (card->type == CARD_SDHC) ? currentSector : currentSector << 9, NULL)) {
             do {
-                token = sdWriteBytes(pdrv, currentBuffer, 0xFC);
+                token = sdWriteBytes(pdrv, blocks ? blocks[currentBlock] : buffer + (currentBlock << 9), 0xFC);
                 if (token != 0x05) {
                     f++;
                     break;
                 }
-                currentBuffer += 512;
+                currentBlock++;
                 f = 0;
             } while (--currentCount);
 
@@ -360,7 +418,7 @@ bool sdWriteSectors(uint8_t pdrv, const char* buffer, unsigned long long sector,
                         }
                         sdDeselectCard(pdrv);
                     }
-                    currentBuffer = buffer + (writtenBlocks << 9);
+                    currentBlock = writtenBlocks;
                     currentSector = sector + writtenBlocks;
                     currentCount = count - writtenBlocks;
                     continue;
@@ -376,6 +434,11 @@ bool sdWriteSectors(uint8_t pdrv, const char* buffer, unsigned long long sector,
     return false;
 }
 
+bool sdWriteSectors(uint8_t pdrv, const char* buffer, unsigned long long sector, int count)
+{
+    return sdWriteBlocks(pdrv, buffer, NULL, sector, count);
+}
+
 unsigned long sdGetSectorsCount(uint8_t pdrv)
 {
     for (int f = 0; f < 3; f++) {
@@ -443,6 +506,203 @@ private:
     AcquireSPI& operator=(AcquireSPI const&);
 };
 
+struct LockCache
+{
+    ardu_sdcache_t *cache;
+    explicit LockCache(ardu_sdcache_t* cache)
+        : cache(cache)
+    {
+        if (cache) {
+            xSemaphoreTake(cache->lock, portMAX_DELAY);
+        }
+    }
+    ~LockCache()
+    {
+        if (cache) {
+            xSemaphoreGive(cache->lock);
+        }
+    }
+private:
+    LockCache(LockCache const&);
+    LockCache& operator=(LockCache const&);
+};
+
+}
+
+
+/*
+ * Write-behind sector cache
+ * */
+
+static int sdCacheFind(ardu_sdcache_t * cache, DWORD sector)
+{
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].valid && cache->entries[i].sector == sector) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// cache lock and SPI held; dirty sectors go out in order, contiguous ones as one multi block write
+static bool sdCacheFlush(uint8_t pdrv)
+{
+    ardu_sdcache_t * cache = s_cards[pdrv]->cache;
+    if (!cache->dirty) {
+        return true;
+    }
+    uint16_t dirty = 0;
+    for (uint16_t i = 0; i < cache->count; i++) {
+        if (!cache->entries[i].dirty) {
+            continue;
+        }
+        uint16_t j = dirty++;
+        while (j && cache->entries[cache->order[j - 1]].sector > cache->entries[i].sector) {
+            cache->order[j] = cache->order[j - 1];
+            j--;
+        }
+        cache->order[j] = i;
+    }
+
+    bool ok = true;
+    for (uint16_t i = 0; i < dirty;) {
+        DWORD first = cache->entries[cache->order[i]].sector;
+        uint16_t run = 0;
+        while (i + run < dirty && cache->entries[cache->order[i + run]].sector == first + run) {
+            cache->blocks[run] = (const char*)cache->data + ((size_t)cache->order[i + run] << 9);
+            run++;
+        }
+        bool written = (run > 1) ? sdWriteBlocks(pdrv, NULL, cache->blocks, first, run) : sdWriteSector(pdrv, cache->blocks[0], first);
+        for (uint16_t r = 0; written && r < run; r++) {
+            cache->entries[cache->order[i + r]].dirty = false;
+        }
+        ok = ok && written;
+        i += run;
+    }
+    cache->dirty = !ok;
+    if (!ok) {
+        cache->since = millis();
+    }
+    return ok;
+}
+
+static bool sdCacheWrite(uint8_t pdrv, const uint8_t* buffer, DWORD sector)
+{
+    ardu_sdcache_t * cache = s_cards[pdrv]->cache;
+    int slot = sdCacheFind(cache, sector);
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 0; i < cache->count; i++) {
+            if (!cache->entries[i].valid) {
+                slot = i;
+                break;
+            }
+            if (cache->entries[i].used < cache->entries[slot].used) {
+                slot = i;
+            }
+        }
+        // evicting a dirty sector writes them all, while there is the most to merge
+        if (cache->entries[slot].dirty && !sdCacheFlush(pdrv)) {
+            return false;
+        }
+        cache->entries[slot].sector = sector;
+        cache->entries[slot].valid = true;
+    }
+    memcpy(cache->data + ((size_t)slot << 9), buffer, 512);
+    cache->entries[slot].dirty = true;
+    cache->entries[slot].used = ++cache->clock;
+    if (!cache->dirty) {
+        cache->dirty = true;
+        cache->since = millis();
+    }
+    return true;
+}
+
+// the sectors are being written around the cache, the cached copies are stale
+static void sdCacheDrop(ardu_sdcache_t * cache, DWORD sector, UINT count)
+{
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].valid && cache->entries[i].sector - sector < count) {
+            cache->entries[i].valid = false;
+            cache->entries[i].dirty = false;
+        }
+    }
+}
+
+static bool sdCacheRead(uint8_t pdrv, uint8_t* buffer, DWORD sector, UINT count)
+{
+    ardu_sdcache_t * cache = s_cards[pdrv]->cache;
+    for (UINT i = 0; i < count;) {
+        int slot = sdCacheFind(cache, sector + i);
+        if (slot >= 0) {
+            memcpy(buffer + ((size_t)i << 9), cache->data + ((size_t)slot << 9), 512);
+            cache->entries[slot].used = ++cache->clock;
+            i++;
+            continue;
+        }
+        UINT run = 1;
+        while (i + run < count && sdCacheFind(cache, sector + i + run) < 0) {
+            run++;
+        }
+        char * dst = (char*)buffer + ((size_t)i << 9);
+        if (!((run > 1) ? sdReadSectors(pdrv, dst, sector + i, run) : sdReadSector(pdrv, dst, sector + i))) {
+            return false;
+        }
+        i += run;
+    }
+    return true;
+}
+
+#if SD_CACHE_FLUSH_INTERVAL
+static void sdCacheTask(void * arg)
+{
+    uint8_t pdrv = (uint8_t)(uintptr_t)arg;
+    ardu_sdcard_t * card = s_cards[pdrv];
+    ardu_sdcache_t * cache = card->cache;
+    while (!cache->stop) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SD_CACHE_FLUSH_INTERVAL));
+        LockCache locked(cache);
+        if (!cache->stop && cache->dirty && !(card->status & STA_NOINIT)
+                && millis() - cache->since >= SD_CACHE_FLUSH_INTERVAL) {
+            AcquireSPI lock(card);
+            if (!sdCacheFlush(pdrv)) {
+                log_w("sector cache flush failed");
+            }
+        }
+    }
+    cache->task = NULL;
+    vTaskDelete(NULL);
+}
+#endif
+
+// flushes and releases the cache, false if the dirty sectors could not be written
+static bool sdCacheFree(uint8_t pdrv)
+{
+    ardu_sdcard_t * card = s_cards[pdrv];
+    ardu_sdcache_t * cache = card->cache;
+    if (!cache) {
+        return true;
+    }
+    if (cache->task) {
+        cache->stop = true;
+        xTaskNotifyGive(cache->task);
+        while (cache->task) {
+            delay(1);
+        }
+    }
+    bool ok = true;
+    if (cache->dirty && !(card->status & STA_NOINIT)) {
+        AcquireSPI lock(card);
+        ok = sdCacheFlush(pdrv);
+    }
+    card->cache = NULL;
+    vSemaphoreDelete(cache->lock);
+    free(cache->entries);
+    free(cache->order);
+    free(cache->blocks);
+    free(cache->data);
+    free(cache);
+    return ok;
 }
 
 
@@ -473,6 +733,7 @@ DSTATUS ff_sd_initialize(uint8_t pdrv)
         goto unknown_card;
     }
 
+#if SD_SPI_CRC
     token = sdTransaction(pdrv, CRC_ON_OFF, 1, NULL);
     if (token == 0x5) {
         //old card maybe
@@ -481,6 +742,10 @@ DSTATUS ff_sd_initialize(uint8_t pdrv)
         log_w("CRC_ON_OFF failed: %u", token);
         goto unknown_card;
     }
+#else
+    //off after GO_IDLE_STATE in SPI mode
+    card->supports_crc = false;
+#endif
 
     if (sdTransaction(pdrv, SEND_IF_COND, 0x1AA, &resp) == 1) {
         if ((resp & 0xFFF) != 0x1AA) {
@@ -582,9 +847,12 @@ DRESULT ff_sd_read(uint8_t pdrv, uint8_t* buffer, DWORD sector, UINT count)
     }
     DRESULT res = RES_OK;
 
+    LockCache cached(card->cache);
     AcquireSPI lock(card);
 
-    if (count > 1) {
+    if (card->cache) {
+        res = sdCacheRead(pdrv, buffer, sector, count) ? RES_OK : RES_ERROR;
+    } else if (count > 1) {
         res = sdReadSectors(pdrv, (char*)buffer, sector, count) ? RES_OK : RES_ERROR;
     } else {
         res = sdReadSector(pdrv, (char*)buffer, sector) ? RES_OK : RES_ERROR;
@@ -604,8 +872,17 @@ DRESULT ff_sd_write(uint8_t pdrv, const uint8_t* buffer, DWORD sector, UINT coun
     }
     DRESULT res = RES_OK;
 
+    LockCache cached(card->cache);
     AcquireSPI lock(card);
 
+    // single sectors are FAT, directory and partial data updates: held back and merged,
+    // longer runs are already what the card writes best
+    if (card->cache && count == 1) {
+        return sdCacheWrite(pdrv, buffer, sector) ? RES_OK : RES_ERROR;
+    }
+    if (card->cache) {
+        sdCacheDrop(card->cache, sector, count);
+    }
     if (count > 1) {
         res = sdWriteSectors(pdrv, (const char*)buffer, sector, count) ? RES_OK : RES_ERROR;
     } else {
@@ -619,7 +896,11 @@ DRESULT ff_sd_ioctl(uint8_t pdrv, uint8_t cmd, void* buff)
     switch(cmd) {
     case CTRL_SYNC:
         {
+            LockCache cached(s_cards[pdrv]->cache);
             AcquireSPI lock(s_cards[pdrv]);
+            if (s_cards[pdrv]->cache && !sdCacheFlush(pdrv)) {
+                return RES_ERROR;
+            }
             if (sdSelectCard(pdrv)) {
                 sdDeselectCard(pdrv);
                 return RES_OK;
@@ -650,6 +931,7 @@ uint8_t sdcard_uninit(uint8_t pdrv)
     if (pdrv >= FF_VOLUMES || card == NULL) {
         return 1;
     }
+    sdCacheFree(pdrv);
     sdTransaction(pdrv, GO_IDLE_STATE, 0, NULL);
     ff_diskio_register(pdrv, NULL);
     s_cards[pdrv] = NULL;
@@ -682,6 +964,7 @@ uint8_t sdcard_init(uint8_t cs, SPIClass * spi, int hz)
     card->supports_crc = true;
     card->type = CARD_NONE;
     card->status = STA_NOINIT;
+    card->cache = NULL;
 
     pinMode(card->ssPin, OUTPUT);
     digitalWrite(card->ssPin, HIGH);
@@ -706,6 +989,13 @@ uint8_t sdcard_unmount(uint8_t pdrv)
     if (pdrv >= FF_VOLUMES || card == NULL) {
         return 1;
     }
+    if (card->cache && !(card->status & STA_NOINIT)) {
+        LockCache cached(card->cache);
+        AcquireSPI lock(card);
+        if (!sdCacheFlush(pdrv)) {
+            log_e("sector cache flush failed, data lost");
+        }
+    }
     card->status |= STA_NOINIT;
     card->type = CARD_NONE;
 
@@ -748,6 +1038,61 @@ bool sdcard_mount(uint8_t pdrv, const char* path, uint8_t max_files)
     return true;
 }
 
+bool sdcard_cache(uint8_t pdrv, uint16_t sectors, bool psram)
+{
+    ardu_sdcard_t * card = s_cards[pdrv];
+    if(pdrv >= FF_VOLUMES || card == NULL){
+        return false;
+    }
+    if(!sdCacheFree(pdrv)){
+        return false;
+    }
+    if(!sectors){
+        return true;
+    }
+
+    ardu_sdcache_t * cache = (ardu_sdcache_t *)calloc(1, sizeof(ardu_sdcache_t));
+    if(!cache){
+        return false;
+    }
+    cache->count = sectors;
+    cache->entries = (ardu_sdcache_entry_t *)calloc(sectors, sizeof(ardu_sdcache_entry_t));
+    cache->order = (uint16_t *)malloc(sectors * sizeof(uint16_t));
+    cache->blocks = (const char **)malloc(sectors * sizeof(const char *));
+    // PSRAM is not DMA capable, the SPI driver then moves those sectors by CPU
+    cache->data = psram ? (uint8_t *)ps_malloc((size_t)sectors << 9) : NULL;
+    if(!cache->data){
+        cache->data = (uint8_t *)heap_caps_malloc((size_t)sectors << 9, MALLOC_CAP_DMA);
+    }
+    cache->lock = xSemaphoreCreateMutex();
+    if(!cache->entries || !cache->order || !cache->blocks || !cache->data || !cache->lock){
+        log_e("no memory for a %u sector cache", sectors);
+        goto fail;
+    }
+    card->cache = cache;
+#if SD_CACHE_FLUSH_INTERVAL
+    xTaskCreateUniversal(sdCacheTask, "sd_cache", SD_CACHE_TASK_STACK_SIZE, (void *)(uintptr_t)pdrv,
+                         SD_CACHE_TASK_PRIORITY, (TaskHandle_t *)&cache->task, SD_CACHE_TASK_RUNNING_CORE);
+    if(!cache->task){
+        log_e("could not start the cache flush task");
+        card->cache = NULL;
+        goto fail;
+    }
+#endif
+    return true;
+
+fail:
+    if(cache->lock){
+        vSemaphoreDelete(cache->lock);
+    }
+    free(cache->entries);
+    free(cache->order);
+    free(cache->blocks);
+    free(cache->data);
+    free(cache);
+    return false;
+}
+
 uint32_t sdcard_num_sectors(uint8_t pdrv)
 {
     ardu_sdcard_t * card = s_cards[pdrv];
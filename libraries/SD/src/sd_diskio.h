@@ -19,12 +19,35 @@
 #include "SPI.h"
 #include "sd_defines.h"
 
+#ifndef SD_SPI_CRC
+#define SD_SPI_CRC 1 // 0 leaves the card's CRC check off and skips computing it for each block
+#endif
+
+#ifndef SD_CACHE_FLUSH_INTERVAL
+#define SD_CACHE_FLUSH_INTERVAL 1000 // ms a cached write may wait for the card, 0 flushes only on sync and eviction
+#endif
+
+#ifndef SD_CACHE_TASK_STACK_SIZE
+#define SD_CACHE_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef SD_CACHE_TASK_PRIORITY
+#define SD_CACHE_TASK_PRIORITY 1
+#endif
+
+#ifndef SD_CACHE_TASK_RUNNING_CORE
+#define SD_CACHE_TASK_RUNNING_CORE -1
+#endif
+
 uint8_t sdcard_init(uint8_t cs, SPIClass * spi, int hz);
 uint8_t sdcard_uninit(uint8_t pdrv);
 
 bool sdcard_mount(uint8_t pdrv, const char* path, uint8_t max_files);
 uint8_t sdcard_unmount(uint8_t pdrv);
 
+// write-behind cache of single sector writes, 0 sectors flushes and removes it
+bool sdcard_cache(uint8_t pdrv, uint16_t sectors, bool psram);
+
 sdcard_type_t sdcard_type(uint8_t pdrv);
 uint32_t sdcard_num_sectors(uint8_t pdrv);
 uint32_t sdcard_sector_size(uint8_t pdrv);
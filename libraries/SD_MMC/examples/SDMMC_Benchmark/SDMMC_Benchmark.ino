@@ -0,0 +1,129 @@
+/*
+ * Measures SD_MMC throughput: sequential and random (4 KB at random offsets)
+ * writes and reads of a test file, reported in MB/s.
+ *
+ * Connect the SD card to the following pins:
+ *
+ * SD Card | ESP32
+ *    D2       12
+ *    D3       13
+ *    CMD      15
+ *    VSS      GND
+ *    VDD      3.3V
+ *    CLK      14
+ *    VSS      GND
+ *    D0       2  (add 1K pull up after flashing)
+ *    D1       4
+ *
+ * Set MODE_1BIT to true if only D0 is wired. SDMMC_FREQ_DEFAULT (20 MHz)
+ * is the one to try if the card does not mount at high speed.
+ */
+
+#include "FS.h"
+#include "SD_MMC.h"
+
+#define MODE_1BIT   false
+#define FREQ_KHZ    SDMMC_FREQ_HIGHSPEED
+#define FILE_SIZE   (8 * 1024 * 1024)
+#define CHUNK_SIZE  (32 * 1024)
+#define RANDOM_SIZE 4096
+#define RANDOM_OPS  256
+
+static const char * path = "/bench.bin";
+static uint8_t * buf;
+
+void report(const char * test, size_t bytes, uint32_t us){
+    Serial.printf("%-18s %8u bytes %8u ms %6.2f MB/s\n", test, bytes, us / 1000, (float)bytes / us);
+}
+
+void sequentialWrite(fs::FS &fs){
+    File file = fs.open(path, FILE_WRITE);
+    if(!file){
+        Serial.println("Failed to open file for writing");
+        return;
+    }
+    uint32_t start = micros();
+    size_t written = 0;
+    while(written < FILE_SIZE){
+        size_t n = file.write(buf, CHUNK_SIZE);
+        if(n != CHUNK_SIZE){
+            Serial.println("Write failed");
+            break;
+        }
+        written += n;
+    }
+    file.close();
+    report("sequential write", written, micros() - start);
+}
+
+void sequentialRead(fs::FS &fs){
+    File file = fs.open(path);
+    if(!file){
+        Serial.println("Failed to open file for reading");
+        return;
+    }
+    uint32_t start = micros();
+    size_t total = 0;
+    size_t n;
+    while((n = file.read(buf, CHUNK_SIZE)) > 0){
+        total += n;
+    }
+    file.close();
+    report("sequential read", total, micros() - start);
+}
+
+void randomAccess(fs::FS &fs, bool write){
+    File file = fs.open(path, write ? "r+" : FILE_READ);
+    if(!file){
+        Serial.println("Failed to open file");
+        return;
+    }
+    size_t blocks = file.size() / RANDOM_SIZE;
+    if(!blocks){
+        file.close();
+        return;
+    }
+    randomSeed(1);
+    uint32_t start = micros();
+    size_t total = 0;
+    for(int i = 0; i < RANDOM_OPS; i++){
+        file.seek(random(blocks) * RANDOM_SIZE);
+        total += write ? file.write(buf, RANDOM_SIZE) : file.read(buf, RANDOM_SIZE);
+    }
+    file.close();
+    report(write ? "random write" : "random read", total, micros() - start);
+}
+
+void setup(){
+    Serial.begin(115200);
+    if(!SD_MMC.begin("/sdcard", MODE_1BIT, false, FREQ_KHZ)){
+        Serial.println("Card Mount Failed");
+        return;
+    }
+    if(SD_MMC.cardType() == CARD_NONE){
+        Serial.println("No SD_MMC card attached");
+        return;
+    }
+    Serial.printf("SD_MMC Card Size: %lluMB, %s bus at %u kHz\n", SD_MMC.cardSize() / (1024 * 1024), MODE_1BIT ? "1-bit" : "4-bit", FREQ_KHZ);
+
+    buf = (uint8_t *)malloc(CHUNK_SIZE);
+    if(!buf){
+        Serial.println("No memory for the buffer");
+        return;
+    }
+    for(size_t i = 0; i < CHUNK_SIZE; i++){
+        buf[i] = i;
+    }
+
+    sequentialWrite(SD_MMC);
+    sequentialRead(SD_MMC);
+    randomAccess(SD_MMC, true);
+    randomAccess(SD_MMC, false);
+
+    SD_MMC.remove(path);
+    free(buf);
+}
+
+void loop(){
+
+}
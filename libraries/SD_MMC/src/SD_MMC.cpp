@@ -24,6 +24,7 @@ extern "C" {
 #include "sdmmc_cmd.h"
 }
 #include "ff.h"
+#include "diskio.h"
 #include "SD_MMC.h"
 
 using namespace fs;
@@ -35,7 +36,8 @@ SDMMCFS::SDMMCFS(FSImplPtr impl)
     : FS(impl), _card(NULL)
 {}
 
-bool SDMMCFS::begin(const char * mountpoint, bool mode1bit)
+bool SDMMCFS::begin(const char * mountpoint, bool mode1bit, bool format_if_mount_failed,
+                    int sdmmc_frequency, uint8_t maxOpenFiles, size_t allocationUnit, bool ddr)
 {
     if(_card) {
         return true;
@@ -58,7 +60,7 @@ bool SDMMCFS::begin(const char * mountpoint, bool mode1bit)
         .io_int_wait = &sdmmc_host_io_int_wait,
         .command_timeout_ms = 0
     };
-    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    host.max_freq_khz = sdmmc_frequency;
 #ifdef BOARD_HAS_1BIT_SDMMC
     mode1bit = true;
 #endif
@@ -66,13 +68,19 @@ bool SDMMCFS::begin(const char * mountpoint, bool mode1bit)
         host.flags = SDMMC_HOST_FLAG_1BIT; //use 1-line SD mode
 	slot_config.width = 1;
     }
+    if(ddr) {
+        host.flags |= SDMMC_HOST_FLAG_DDR;
+    }
 
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = false,
-        .max_files = 5,
-        .allocation_unit_size = 0
+        .format_if_mount_failed = format_if_mount_failed,
+        .max_files = maxOpenFiles,
+        .allocation_unit_size = allocationUnit
     };
 
+    //the mount takes the first free drive, as this finds it
+    BYTE pdrv = 0xFF;
+    ff_diskio_get_drive(&pdrv);
     esp_err_t ret = esp_vfs_fat_sdmmc_mount(mountpoint, &host, &slot_config, &mount_config, &_card);
     if (ret != ESP_OK) {
         if (ret == ESP_FAIL) {
@@ -88,6 +96,7 @@ bool SDMMCFS::begin(const char * mountpoint, bool mode1bit)
         return false;
     }
     _impl->mountpoint(mountpoint);
+    _impl->fatDrive(pdrv == 0xFF ? -1 : pdrv);
     return true;
 }
 
@@ -96,6 +105,7 @@ void SDMMCFS::end()
     if(_card) {
         esp_vfs_fat_sdmmc_unmount();
         _impl->mountpoint(NULL);
+        _impl->fatDrive(-1);
         _card = NULL;
     }
 }
@@ -19,6 +19,10 @@
 #include "driver/sdmmc_types.h"
 #include "sd_defines.h"
 
+#ifndef BOARD_MAX_SDMMC_FREQ
+#define BOARD_MAX_SDMMC_FREQ SDMMC_FREQ_HIGHSPEED // kHz, boards with long card traces may need SDMMC_FREQ_DEFAULT
+#endif
+
 namespace fs
 {
 
@@ -29,7 +33,10 @@ protected:
 
 public:
     SDMMCFS(FSImplPtr impl);
-    bool begin(const char * mountpoint="/sdcard", bool mode1bit=false);
+    // sdmmc_frequency in kHz; ddr is taken up by cards that report it (eMMC);
+    // allocationUnit is the cluster size a format uses, 0 for one sector
+    bool begin(const char * mountpoint="/sdcard", bool mode1bit=false, bool format_if_mount_failed=false,
+               int sdmmc_frequency=BOARD_MAX_SDMMC_FREQ, uint8_t maxOpenFiles=5, size_t allocationUnit=0, bool ddr=false);
     void end();
     sdcard_type_t cardType();
     uint64_t cardSize();
@@ -22,6 +22,8 @@ SPIClass::SPIClass(uint8_t spi_bus)
     ,_miso(-1)
     ,_mosi(-1)
     ,_ss(-1)
+    ,_wp(-1)
+    ,_hd(-1)
     ,_div(0)
     ,_freq(1000000)
     ,_inTransaction(false)
@@ -68,6 +70,8 @@ void SPIClass::end()
     spiDetachSCK(_spi, _sck);
     spiDetachMISO(_spi, _miso);
     spiDetachMOSI(_spi, _mosi);
+    spiDetachQuadPins(_spi, _wp, _hd);
+    _wp = _hd = -1;
     setHwCs(false);
     spiStopBus(_spi);
     _spi = NULL;
@@ -85,6 +89,21 @@ void SPIClass::setHwCs(bool use)
     _use_hw_ss = use;
 }
 
+/**
+ * Turns MOSI and MISO into bidirectional data lines and adds WP/HD for quad transfers
+ * @param wp int8_t data line 2, -1 selects the bus default
+ * @param hd int8_t data line 3, -1 selects the bus default
+ */
+void SPIClass::attachQuadPins(int8_t wp, int8_t hd)
+{
+    if(!_spi) {
+        return;
+    }
+    _wp = (wp >= 0) ? wp : ((_spi_num == VSPI) ? 22 : 2);
+    _hd = (hd >= 0) ? hd : ((_spi_num == VSPI) ? 21 : 4);
+    spiAttachQuadPins(_spi, _mosi, _miso, _wp, _hd);
+}
+
 void SPIClass::setFrequency(uint32_t freq)
 {
     //check if last freq changed
@@ -129,6 +148,20 @@ void SPIClass::beginTransaction(SPISettings settings)
     _inTransaction = true;
 }
 
+/**
+ * @param settings const spi_settings_t * filled once by prepareSettings()
+ */
+void SPIClass::beginTransaction(const spi_settings_t * settings)
+{
+    spiTransactionSettings(_spi, settings);
+    _inTransaction = true;
+}
+
+void SPIClass::prepareSettings(spi_settings_t * out, SPISettings settings)
+{
+    spiPrepareSettings(out, spiFrequencyToClockDiv(settings._clock), settings._dataMode, settings._bitOrder);
+}
+
 void SPIClass::endTransaction()
 {
     if(_inTransaction){
@@ -193,6 +226,17 @@ void SPIClass::transferBits(uint32_t data, uint32_t * out, uint8_t bits)
     spiTransferBits(_spi, data, out, bits);
 }
 
+/**
+ * @param trans const spi_phased_trans_t * command, address, dummy and data phases
+ */
+void SPIClass::transferPhased(const spi_phased_trans_t * trans)
+{
+    if(_inTransaction){
+        return spiTransferPhasedNL(_spi, trans);
+    }
+    spiTransferPhased(_spi, trans);
+}
+
 /**
  * @param data uint8_t *
  * @param size uint32_t
@@ -239,6 +283,74 @@ void SPIClass::transferBytes(const uint8_t * data, uint8_t * out, uint32_t size)
     spiTransferBytes(_spi, data, out, size);
 }
 
+/**
+ * @param channel uint8_t DMA channel 1 or 2, 0 selects the bus default
+ * Called on first use of transferAsync/writePixelsDMA when not done before
+ */
+bool SPIClass::beginDMA(uint8_t channel)
+{
+    return spiDMABegin(_spi, channel);
+}
+
+/**
+ * Starts the transfer and returns while it is clocked out when inside a transaction
+ * @param data const void * data buffer, word aligned in internal RAM for DMA
+ * @param out  void * output buffer. can be NULL for Write Only operation
+ * @param size uint32_t
+ * @param callback spi_dma_cb_t called from the interrupt on completion (IRAM_ATTR)
+ * @param arg void * passed to callback
+ */
+void SPIClass::transferAsync(const void * data, void * out, uint32_t size, spi_dma_cb_t callback, void * arg)
+{
+    beginDMA();
+    if(_inTransaction){
+        return spiTransferDMANL(_spi, data, out, size, callback, arg);
+    }
+    spiSimpleTransaction(_spi);
+    spiTransferDMANL(_spi, data, out, size, callback, arg);
+    spiEndTransaction(_spi);
+}
+
+/**
+ * Pixels are double buffered, the last block may still be sent when this returns
+ * @param data void *
+ * @param size uint32_t
+ */
+void SPIClass::writePixelsDMA(const void * data, uint32_t size)
+{
+    beginDMA();
+    if(_inTransaction){
+        return spiWritePixelsDMANL(_spi, data, size);
+    }
+    spiSimpleTransaction(_spi);
+    spiWritePixelsDMANL(_spi, data, size);
+    spiEndTransaction(_spi);
+}
+
+void SPIClass::waitDMA()
+{
+    spiDMAWaitNL(_spi);
+}
+
+/**
+ * Starts the bus task that runs queued transfers
+ * @param depth uint32_t number of transfers that can be queued
+ */
+bool SPIClass::beginQueue(uint32_t depth)
+{
+    return spiQueueBegin(_spi, depth);
+}
+
+bool SPIClass::queueTransfer(spi_trans_t * trans, uint32_t timeout_ms)
+{
+    return spiQueueTransfer(_spi, trans, timeout_ms);
+}
+
+bool SPIClass::queueTransferWait(spi_trans_t * trans)
+{
+    return spiQueueTransferWait(_spi, trans);
+}
+
 /**
  * @param data uint8_t *
  * @param size uint8_t  max for size is 64Byte
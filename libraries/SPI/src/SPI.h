@@ -41,6 +41,8 @@ private:
     int8_t _miso;
     int8_t _mosi;
     int8_t _ss;
+    int8_t _wp;
+    int8_t _hd;
     uint32_t _div;
     uint32_t _freq;
     bool _inTransaction;
@@ -52,6 +54,7 @@ public:
     void end();
 
     void setHwCs(bool use);
+    void attachQuadPins(int8_t wp=-1, int8_t hd=-1);
     void setBitOrder(uint8_t bitOrder);
     void setDataMode(uint8_t dataMode);
     void setFrequency(uint32_t freq);
@@ -60,6 +63,8 @@ public:
     uint32_t getClockDivider();
 
     void beginTransaction(SPISettings settings);
+    void beginTransaction(const spi_settings_t * settings);
+    static void prepareSettings(spi_settings_t * out, SPISettings settings);
     void endTransaction(void);
     void transfer(uint8_t * data, uint32_t size);
     uint8_t transfer(uint8_t data);
@@ -68,6 +73,7 @@ public:
   
     void transferBytes(const uint8_t * data, uint8_t * out, uint32_t size);
     void transferBits(uint32_t data, uint32_t * out, uint8_t bits);
+    void transferPhased(const spi_phased_trans_t * trans);
 
     void write(uint8_t data);
     void write16(uint16_t data);
@@ -76,6 +82,15 @@ public:
     void writePixels(const void * data, uint32_t size);//ili9341 compatible
     void writePattern(const uint8_t * data, uint8_t size, uint32_t repeat);
 
+    bool beginDMA(uint8_t channel=0);
+    void transferAsync(const void * data, void * out, uint32_t size, spi_dma_cb_t callback=NULL, void * arg=NULL);
+    void writePixelsDMA(const void * data, uint32_t size);
+    void waitDMA();
+
+    bool beginQueue(uint32_t depth=8);
+    bool queueTransfer(spi_trans_t * trans, uint32_t timeout_ms=UINT32_MAX);
+    bool queueTransferWait(spi_trans_t * trans);
+
     spi_t * bus(){ return _spi; }
 };
 
@@ -19,8 +19,17 @@ extern "C" {
 #include <sys/stat.h>
 #include <dirent.h>
 #include "esp_spiffs.h"
+#include "esp_idf_version.h"
 }
 
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+#define SPIFFS_HAS_GC 1 // esp_spiffs_gc()
+#endif
+
+#ifndef SPIFFS_GC_STEP
+#define SPIFFS_GC_STEP 4096 // bytes freed per esp_spiffs_gc() call, one flash block
+#endif
+
 #include "SPIFFS.h"
 
 using namespace fs;
@@ -43,7 +52,7 @@ bool SPIFFSImpl::exists(const char* path)
     return (f == true) && !f.isDirectory();
 }
 
-SPIFFSFS::SPIFFSFS() : FS(FSImplPtr(new SPIFFSImpl())), partitionLabel_(NULL)
+SPIFFSFS::SPIFFSFS() : FS(FSImplPtr(new SPIFFSImpl())), partitionLabel_(NULL), gcRuns_(0), gcTime_(0), gcMaxTime_(0)
 {
 
 }
@@ -56,7 +65,7 @@ SPIFFSFS::~SPIFFSFS()
     }
 }
 
-bool SPIFFSFS::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles, const char * partitionLabel)
+bool SPIFFSFS::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles, const char * partitionLabel, uint8_t cachePages)
 {
     if (partitionLabel_){
         free(partitionLabel_);
@@ -75,7 +84,8 @@ bool SPIFFSFS::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFi
     esp_vfs_spiffs_conf_t conf = {
       .base_path = basePath,
       .partition_label = partitionLabel_,
-      .max_files = maxOpenFiles,
+      // the cache gets a page per file slot, extra slots only cost a descriptor each
+      .max_files = (cachePages > maxOpenFiles) ? cachePages : maxOpenFiles,
       .format_if_mount_failed = false
     };
 
@@ -135,5 +145,45 @@ size_t SPIFFSFS::usedBytes()
     return used;
 }
 
+bool SPIFFSFS::gc(uint32_t budgetMs)
+{
+#if SPIFFS_HAS_GC
+    if(!esp_spiffs_mounted(partitionLabel_)){
+        return false;
+    }
+    uint32_t start = millis();
+    bool collected = false;
+    do {
+        if(esp_spiffs_gc(partitionLabel_, SPIFFS_GC_STEP) != ESP_OK){
+            break;
+        }
+        collected = true;
+    } while(millis() - start < budgetMs);
+    uint32_t spent = millis() - start;
+    if(collected){
+        gcRuns_++;
+    }
+    gcTime_ += spent;
+    if(spent > gcMaxTime_){
+        gcMaxTime_ = spent;
+    }
+    return collected;
+#else
+    static bool warned = false;
+    if(!warned){
+        log_w("SPIFFS gc needs IDF 4.3, here it runs inside writes");
+        warned = true;
+    }
+    return false;
+#endif
+}
+
+SPIFFSStats SPIFFSFS::stats()
+{
+    SPIFFSStats s = { 0, 0, gcRuns_, gcTime_, gcMaxTime_ };
+    esp_spiffs_info(partitionLabel_, &s.totalBytes, &s.usedBytes);
+    return s;
+}
+
 SPIFFSFS SPIFFS;
 
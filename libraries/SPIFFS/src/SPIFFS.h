@@ -20,19 +20,36 @@
 namespace fs
 {
 
+struct SPIFFSStats
+{
+    size_t totalBytes;
+    size_t usedBytes;
+    uint32_t gcRuns;    // gc() calls that collected something
+    uint32_t gcTime;    // ms spent in gc() altogether
+    uint32_t gcMaxTime; // longest gc() call, ms
+};
+
 class SPIFFSFS : public FS
 {
 public:
     SPIFFSFS();
     ~SPIFFSFS();
-    bool begin(bool formatOnFail=false, const char * basePath="/spiffs", uint8_t maxOpenFiles=10, const char * partitionLabel=NULL);
+    // cachePages: pages of read/write cache, one per open file when 0 (the IDF sizes it by max files)
+    bool begin(bool formatOnFail=false, const char * basePath="/spiffs", uint8_t maxOpenFiles=10, const char * partitionLabel=NULL, uint8_t cachePages=0);
     bool format();
     size_t totalBytes();
     size_t usedBytes();
+    // collects deleted pages for up to budgetMs, meant for an idle task so writes find free blocks;
+    // it holds the FS lock while it runs. Needs IDF 4.3 or later, false otherwise
+    bool gc(uint32_t budgetMs);
+    SPIFFSStats stats();
     void end();
 
 private:
     char * partitionLabel_;
+    uint32_t gcRuns_;
+    uint32_t gcTime_;
+    uint32_t gcMaxTime_;
 };
 
 }
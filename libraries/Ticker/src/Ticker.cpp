@@ -23,29 +23,55 @@
 */
 
 #include "Ticker.h"
+#include "esp32-hal-log.h"
 
 Ticker::Ticker() :
-  _timer(nullptr) {}
+  _timer(nullptr), _job(nullptr), _repeat(false), _invoke(nullptr), _destroy(nullptr) {}
 
 Ticker::~Ticker() {
   detach();
 }
 
 void Ticker::_attach_ms(uint32_t milliseconds, bool repeat, callback_with_arg_t callback, uint32_t arg) {
+  _attach_us(milliseconds * 1000ULL, repeat, callback, arg, TICKER_DISPATCH_TASK);
+}
+
+void Ticker::_attach_us(uint32_t microseconds, bool repeat, callback_with_arg_t callback, uint32_t arg, ticker_dispatch_t dispatch) {
+  // plain function pointer and argument fit the inline storage
+  _setCallable([callback, arg]() { callback(reinterpret_cast<void*>(arg)); });
+  _start(microseconds, repeat, dispatch);
+}
+
+void IRAM_ATTR Ticker::_onTimer(void* arg) {
+  Ticker* ticker = static_cast<Ticker*>(arg);
+  if (ticker->_job && !ticker->_repeat) {
+    timerSchedRemove(ticker->_job);
+    ticker->_job = nullptr;
+  }
+  if (ticker->_invoke) {
+    ticker->_invoke(&ticker->_storage);
+  }
+}
+
+void Ticker::_start(uint64_t microseconds, bool repeat, ticker_dispatch_t dispatch) {
+  _repeat = repeat;
+  if (dispatch == TICKER_DISPATCH_ISR) {
+    _job = timerSchedAdd(microseconds, _onTimer, this, TIMER_SCHED_ISR);
+    if (!_job) {
+      log_e("ISR dispatch needs timerSchedBegin() and a free job slot");
+    }
+    return;
+  }
   esp_timer_create_args_t _timerConfig;
-  _timerConfig.arg = reinterpret_cast<void*>(arg);
-  _timerConfig.callback = callback;
+  _timerConfig.arg = this;
+  _timerConfig.callback = _onTimer;
   _timerConfig.dispatch_method = ESP_TIMER_TASK;
   _timerConfig.name = "Ticker";
-  if (_timer) {
-    esp_timer_stop(_timer);
-    esp_timer_delete(_timer);
-  }
   esp_timer_create(&_timerConfig, &_timer);
   if (repeat) {
-    esp_timer_start_periodic(_timer, milliseconds * 1000ULL);
+    esp_timer_start_periodic(_timer, microseconds);
   } else {
-    esp_timer_start_once(_timer, milliseconds * 1000ULL);
+    esp_timer_start_once(_timer, microseconds);
   }
 }
 
@@ -55,4 +81,17 @@ void Ticker::detach() {
     esp_timer_delete(_timer);
     _timer = nullptr;
   }
+  if (_job) {
+    timerSchedRemove(_job);
+    _job = nullptr;
+  }
+  if (_destroy) {
+    _destroy(&_storage);
+    _destroy = nullptr;
+    _invoke = nullptr;
+  }
+}
+
+bool Ticker::active() {
+  return _timer || _job;
 }
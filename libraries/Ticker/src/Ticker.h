@@ -25,10 +25,26 @@
 #ifndef TICKER_H
 #define TICKER_H
 
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "esp_attr.h"
+#include "esp32-hal-timer-sched.h"
+
 extern "C" {
   #include "esp_timer.h"
 }
 
+// bytes available for a callable's captures, no heap is used
+#ifndef TICKER_CALLBACK_STORAGE
+#define TICKER_CALLBACK_STORAGE 16
+#endif
+
+typedef enum {
+  TICKER_DISPATCH_TASK, // esp_timer task
+  TICKER_DISPATCH_ISR   // timer scheduler ISR, needs timerSchedBegin(); callback must be IRAM safe
+} ticker_dispatch_t;
+
 class Ticker
 {
 public:
@@ -47,6 +63,11 @@ public:
     _attach_ms(milliseconds, true, reinterpret_cast<callback_with_arg_t>(callback), 0);
   }
 
+  void attach_us(uint32_t microseconds, callback_t callback, ticker_dispatch_t dispatch = TICKER_DISPATCH_TASK)
+  {
+    _attach_us(microseconds, true, reinterpret_cast<callback_with_arg_t>(callback), 0, dispatch);
+  }
+
   template<typename TArg>
   void attach(float seconds, void (*callback)(TArg), TArg arg)
   {
@@ -66,6 +87,36 @@ public:
     _attach_ms(milliseconds, true, reinterpret_cast<callback_with_arg_t>(callback), arg32);
   }
 
+  template<typename TArg>
+  void attach_us(uint32_t microseconds, void (*callback)(TArg), TArg arg, ticker_dispatch_t dispatch = TICKER_DISPATCH_TASK)
+  {
+    static_assert(sizeof(TArg) <= sizeof(uint32_t), "attach_us() callback argument size must be <= 4 bytes");
+    uint32_t arg32 = (uint32_t)arg;
+    _attach_us(microseconds, true, reinterpret_cast<callback_with_arg_t>(callback), arg32, dispatch);
+  }
+
+  // any callable, e.g. a capturing lambda, kept inside the Ticker object
+  template<typename F>
+  void attach(float seconds, F&& callback)
+  {
+    _setCallable(std::forward<F>(callback));
+    _start(seconds * 1000000ULL, true, TICKER_DISPATCH_TASK);
+  }
+
+  template<typename F>
+  void attach_ms(uint32_t milliseconds, F&& callback)
+  {
+    _setCallable(std::forward<F>(callback));
+    _start(milliseconds * 1000ULL, true, TICKER_DISPATCH_TASK);
+  }
+
+  template<typename F>
+  void attach_us(uint32_t microseconds, F&& callback, ticker_dispatch_t dispatch = TICKER_DISPATCH_TASK)
+  {
+    _setCallable(std::forward<F>(callback));
+    _start(microseconds, true, dispatch);
+  }
+
   void once(float seconds, callback_t callback)
   {
     _attach_ms(seconds * 1000, false, reinterpret_cast<callback_with_arg_t>(callback), 0);
@@ -76,6 +127,11 @@ public:
     _attach_ms(milliseconds, false, reinterpret_cast<callback_with_arg_t>(callback), 0);	
   }
 
+  void once_us(uint32_t microseconds, callback_t callback)
+  {
+    _attach_us(microseconds, false, reinterpret_cast<callback_with_arg_t>(callback), 0, TICKER_DISPATCH_TASK);
+  }
+
   template<typename TArg>
   void once(float seconds, void (*callback)(TArg), TArg arg)
   {
@@ -92,15 +148,70 @@ public:
     _attach_ms(milliseconds, false, reinterpret_cast<callback_with_arg_t>(callback), arg32);
   }
 
+  template<typename F>
+  void once(float seconds, F&& callback)
+  {
+    _setCallable(std::forward<F>(callback));
+    _start(seconds * 1000000ULL, false, TICKER_DISPATCH_TASK);
+  }
+
+  template<typename F>
+  void once_ms(uint32_t milliseconds, F&& callback)
+  {
+    _setCallable(std::forward<F>(callback));
+    _start(milliseconds * 1000ULL, false, TICKER_DISPATCH_TASK);
+  }
+
+  template<typename F>
+  void once_us(uint32_t microseconds, F&& callback)
+  {
+    _setCallable(std::forward<F>(callback));
+    _start(microseconds, false, TICKER_DISPATCH_TASK);
+  }
+
   void detach();
   bool active();
 
 protected:	
   void _attach_ms(uint32_t milliseconds, bool repeat, callback_with_arg_t callback, uint32_t arg);
+  void _attach_us(uint32_t microseconds, bool repeat, callback_with_arg_t callback, uint32_t arg, ticker_dispatch_t dispatch);
 
+  template<typename F>
+  void _setCallable(F&& callback)
+  {
+    typedef typename std::decay<F>::type Fn;
+    static_assert(sizeof(Fn) <= TICKER_CALLBACK_STORAGE, "Ticker callback captures too much, raise TICKER_CALLBACK_STORAGE");
+    static_assert(alignof(Fn) <= alignof(_storage_t), "Ticker callback alignment not supported");
+    detach();
+    new (&_storage) Fn(std::forward<F>(callback));
+    _invoke = &_invokeCallable<Fn>;
+    _destroy = &_destroyCallable<Fn>;
+  }
+
+  template<typename Fn>
+  static void IRAM_ATTR _invokeCallable(void* storage)
+  {
+    (*reinterpret_cast<Fn*>(storage))();
+  }
+
+  template<typename Fn>
+  static void _destroyCallable(void* storage)
+  {
+    reinterpret_cast<Fn*>(storage)->~Fn();
+  }
+
+  void _start(uint64_t microseconds, bool repeat, ticker_dispatch_t dispatch);
+  static void IRAM_ATTR _onTimer(void* arg);
 
 protected:
+  typedef typename std::aligned_storage<TICKER_CALLBACK_STORAGE, alignof(void*) * 2>::type _storage_t;
+
   esp_timer_handle_t _timer;
+  timer_sched_job_t* _job;
+  bool _repeat;
+  _storage_t _storage;
+  void (*_invoke)(void*);
+  void (*_destroy)(void*);
 };
 
 
@@ -3,8 +3,12 @@
 
 #include <Arduino.h>
 #include <MD5Builder.h>
+#include <SHA256Builder.h>
 #include <functional>
 #include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #define UPDATE_ERROR_OK                 (0)
 #define UPDATE_ERROR_WRITE              (1)
@@ -19,6 +23,8 @@
 #define UPDATE_ERROR_NO_PARTITION       (10)
 #define UPDATE_ERROR_BAD_ARGUMENT       (11)
 #define UPDATE_ERROR_ABORT              (12)
+#define UPDATE_ERROR_PATCH              (13)
+#define UPDATE_ERROR_SIGN               (14)
 
 #define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
 
@@ -28,6 +34,20 @@
 
 #define ENCRYPTED_BLOCK_SIZE 16
 
+#ifndef UPDATE_TASK_STACK_SIZE
+#define UPDATE_TASK_STACK_SIZE 2048
+#endif
+
+#ifndef UPDATE_TASK_PRIORITY
+#define UPDATE_TASK_PRIORITY 2
+#endif
+
+#ifndef UPDATE_TASK_RUNNING_CORE
+#define UPDATE_TASK_RUNNING_CORE -1
+#endif
+
+struct mbedtls_pk_context;
+
 class UpdateClass {
   public:
     typedef std::function<void(size_t, size_t)> THandlerFunction_Progress;
@@ -39,12 +59,30 @@ class UpdateClass {
     */
     UpdateClass& onProgress(THandlerFunction_Progress fn);
 
+    /*
+      Call this before begin() to flash in a background task:
+      a sector is erased and written while the next one is received,
+      erasing 64KB blocks ahead where they are aligned.
+      Costs a second 4KB buffer; progress counts the bytes handed over
+    */
+    void setPipelined(bool pipelined){ _pipelined = pipelined; }
+
     /*
       Call this to check the space needed for the update
       Will return false if there is not enough space
     */
     bool begin(size_t size=UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW, const char *label = NULL);
 
+    /*
+      Like begin(UPDATE_SIZE_UNKNOWN, U_FLASH) but write() takes a patch made
+      by tools/espdelta.py against the running firmware. The patch names the
+      size and MD5 of both images: a different running image fails with
+      UPDATE_ERROR_PATCH, the new one is checked in end() as with setMD5().
+      A U_FLASH update whose first write(buf, len) starts with a patch applies
+      it too, writeStream() takes one only after beginDelta()
+    */
+    bool beginDelta(int ledPin = -1, uint8_t ledOn = LOW);
+
     /*
       Writes a buffer to the flash and increments the address
       Returns the amount written
@@ -89,6 +127,21 @@ class UpdateClass {
     */
     bool setMD5(const char * expected_md5);
 
+    /*
+      sets the RSA or EC key (PEM or DER) the image has to be signed with,
+      kept for later updates until cleared with NULL. The SHA-256 is taken
+      as the image is written, end() then checks the signature against it.
+      Set it before the first write
+    */
+    bool setPublicKey(const uint8_t * key, size_t len);
+    bool setPublicKey(const char * pem){ return setPublicKey((const uint8_t *)pem, pem ? strlen(pem) + 1 : 0); }
+
+    /*
+      sets the signature of this update, PKCS#1 v1.5 for RSA and DER for ECDSA:
+      openssl dgst -sha256 -sign key.pem -out firmware.sig firmware.bin
+    */
+    bool setSignature(const uint8_t * signature, size_t len);
+
     /*
       returns the MD5 String of the successfully ended firmware
     */
@@ -122,6 +175,17 @@ class UpdateClass {
         return 0;
 
       size_t available = data.available();
+      if(_delta) {
+        uint8_t chunk[128];
+        while(available && remaining()) {
+          int len = data.read(chunk, available < sizeof(chunk) ? available : sizeof(chunk));
+          if(len <= 0 || write(chunk, len) != (size_t)len)
+            return written;
+          written += len;
+          available = data.available();
+        }
+        return written;
+      }
       while(available) {
         if(_bufferLen + available > remaining()){
           available = remaining() - _bufferLen;
@@ -166,6 +230,15 @@ class UpdateClass {
     bool _verifyHeader(uint8_t data);
     bool _verifyEnd();
     bool _enablePartition(const esp_partition_t* partition);
+    bool _startWriter();
+    void _stopWriter();
+    bool _waitWriter();
+    static void _writerTask(void *arg);
+    bool _flashSector(uint32_t offset, uint8_t *data, size_t len, uint8_t skip);
+    bool _startDelta();
+    size_t _writeDelta(const uint8_t *data, size_t len);
+    bool _deltaHeader();
+    bool _deltaOutput(const uint8_t *data, size_t len, bool diff);
 
 
     uint8_t _error;
@@ -183,6 +256,27 @@ class UpdateClass {
 
     int _ledPin;
     uint8_t _ledOn;
+
+    bool _pipelined;
+    TaskHandle_t _writer;
+    SemaphoreHandle_t _flashStart;
+    SemaphoreHandle_t _flashDone;
+    uint8_t *_flashBuffer;   // sector the writer task is flashing
+    size_t _flashLen;        // 0 stops the writer task
+    uint32_t _flashOffset;
+    uint8_t _flashSkip;
+    volatile uint8_t _flashError;
+    uint32_t _erased;        // end of the range erased so far
+
+    bool _verifySignature();
+
+    mbedtls_pk_context *_publicKey;
+    SHA256Builder _sha256;
+    uint8_t *_signature;
+    size_t _signatureLen;
+
+    struct DeltaState;
+    DeltaState *_delta;      // patch being applied, see beginDelta()
 };
 
 extern UpdateClass Update;
@@ -3,6 +3,56 @@
 #include "esp_spi_flash.h"
 #include "esp_ota_ops.h"
 #include "esp_image_format.h"
+#include "mbedtls/pk.h"
+
+#define UPDATE_ERASE_BLOCK_SIZE 0x10000
+
+// tools/espdelta.py: "ESPD", version, 3 reserved, then little endian
+// source size, source MD5, target size, target MD5
+#define UPDATE_DELTA_MAGIC       "ESPD"
+#define UPDATE_DELTA_VERSION     1
+#define UPDATE_DELTA_HEADER_SIZE 48
+#define UPDATE_DELTA_CACHE_SIZE  256
+
+// after the header come records of three varints: bytes to add to the
+// source, bytes to copy from the patch, then the zigzag encoded seek in
+// the source once both are done; the two byte runs follow each record
+struct UpdateClass::DeltaState {
+    enum { HEADER, DIFF_LEN, EXTRA_LEN, SEEK, DIFF, EXTRA };
+    const esp_partition_t *source;
+    uint8_t stage;
+    uint8_t shift;
+    uint32_t value;
+    uint32_t diffLen;
+    uint32_t extraLen;
+    int32_t seek;
+    uint32_t sourceSize;
+    uint32_t sourcePos;
+    uint32_t cacheBase;
+    size_t cacheLen;
+    size_t headerLen;
+    uint8_t header[UPDATE_DELTA_HEADER_SIZE];
+    uint8_t cache[UPDATE_DELTA_CACHE_SIZE];
+
+    // skips empty runs, applies the seek; false if it leaves the source
+    bool settle(){
+        if(stage == DIFF && !diffLen){
+            stage = EXTRA;
+        }
+        if(stage == EXTRA && !extraLen){
+            if((seek < 0 && (uint32_t)-seek > sourcePos) || (seek > 0 && (uint32_t)seek > sourceSize - sourcePos)){
+                return false;
+            }
+            sourcePos += seek;
+            stage = DIFF_LEN;
+        }
+        return true;
+    }
+};
+
+static uint32_t _le32(const uint8_t *p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
 static const char * _err2str(uint8_t _error){
     if(_error == UPDATE_ERROR_OK){
@@ -31,6 +81,10 @@ static const char * _err2str(uint8_t _error){
         return ("Bad Argument");
     } else if(_error == UPDATE_ERROR_ABORT){
         return ("Aborted");
+    } else if(_error == UPDATE_ERROR_PATCH){
+        return ("Patch Does Not Apply");
+    } else if(_error == UPDATE_ERROR_SIGN){
+        return ("Signature Verification Failed");
     }
     return ("UNKNOWN");
 }
@@ -66,6 +120,20 @@ UpdateClass::UpdateClass()
 , _progress(0)
 , _command(U_FLASH)
 , _partition(NULL)
+, _pipelined(false)
+, _writer(NULL)
+, _flashStart(NULL)
+, _flashDone(NULL)
+, _flashBuffer(NULL)
+, _flashLen(0)
+, _flashOffset(0)
+, _flashSkip(0)
+, _flashError(UPDATE_ERROR_OK)
+, _erased(0)
+, _publicKey(NULL)
+, _signature(NULL)
+, _signatureLen(0)
+, _delta(NULL)
 {
 }
 
@@ -75,9 +143,11 @@ UpdateClass& UpdateClass::onProgress(THandlerFunction_Progress fn) {
 }
 
 void UpdateClass::_reset() {
-    if (_buffer)
-        delete[] _buffer;
+    _stopWriter();
+    free(_buffer);
     _buffer = 0;
+    free(_delta);
+    _delta = NULL;
     _bufferLen = 0;
     _progress = 0;
     _size = 0;
@@ -117,6 +187,7 @@ bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, con
     _error = 0;
     _target_md5 = emptyString;
     _md5 = MD5Builder();
+    setSignature(NULL, 0);
 
     if(size == 0) {
         _error = UPDATE_ERROR_SIZE;
@@ -153,17 +224,292 @@ bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, con
     }
 
     //initialize
-    _buffer = (uint8_t*)malloc(SPI_FLASH_SEC_SIZE);
+    _buffer = (uint8_t*)heap_policy_malloc(HEAP_USER_UPDATE, SPI_FLASH_SEC_SIZE);
     if(!_buffer){
         log_e("malloc failed");
         return false;
     }
     _size = size;
     _command = command;
+    _erased = 0;
     _md5.begin();
+    _sha256.begin();
+    if(_pipelined && !_startWriter()){
+        log_w("flashing in the foreground");
+    }
     return true;
 }
 
+bool UpdateClass::_startWriter(){
+    _flashBuffer = (uint8_t*)heap_policy_malloc(HEAP_USER_UPDATE, SPI_FLASH_SEC_SIZE);
+    _flashStart = xSemaphoreCreateBinary();
+    _flashDone = xSemaphoreCreateBinary();
+    if(_flashBuffer && _flashStart && _flashDone){
+        _flashError = UPDATE_ERROR_OK;
+        xSemaphoreGive(_flashDone);
+        if(xTaskCreateUniversal(_writerTask, "update", UPDATE_TASK_STACK_SIZE, this,
+                                UPDATE_TASK_PRIORITY, &_writer, UPDATE_TASK_RUNNING_CORE) == pdPASS){
+            return true;
+        }
+        _writer = NULL;
+    }
+    _stopWriter();
+    return false;
+}
+
+void UpdateClass::_stopWriter(){
+    if(_writer){
+        xSemaphoreTake(_flashDone, portMAX_DELAY);
+        _flashLen = 0;
+        xSemaphoreGive(_flashStart);
+        xSemaphoreTake(_flashDone, portMAX_DELAY);
+        _writer = NULL;
+    }
+    if(_flashStart){
+        vSemaphoreDelete(_flashStart);
+        _flashStart = NULL;
+    }
+    if(_flashDone){
+        vSemaphoreDelete(_flashDone);
+        _flashDone = NULL;
+    }
+    free(_flashBuffer);
+    _flashBuffer = NULL;
+}
+
+// false, and the update aborted, if the sector handed over last failed
+bool UpdateClass::_waitWriter(){
+    if(!_writer){
+        return true;
+    }
+    xSemaphoreTake(_flashDone, portMAX_DELAY);
+    xSemaphoreGive(_flashDone);
+    if(_flashError != UPDATE_ERROR_OK){
+        _abort(_flashError);
+        return false;
+    }
+    return true;
+}
+
+void UpdateClass::_writerTask(void *arg){
+    UpdateClass *update = (UpdateClass*)arg;
+    for(;;){
+        xSemaphoreTake(update->_flashStart, portMAX_DELAY);
+        if(!update->_flashLen){
+            break;
+        }
+        if(update->_flashError == UPDATE_ERROR_OK
+           && !update->_flashSector(update->_flashOffset, update->_flashBuffer, update->_flashLen, update->_flashSkip)){
+            update->_flashError = update->_erased > update->_flashOffset ? UPDATE_ERROR_WRITE : UPDATE_ERROR_ERASE;
+        }
+        xSemaphoreGive(update->_flashDone);
+    }
+    xSemaphoreGive(update->_flashDone);
+    vTaskDelete(NULL);
+}
+
+bool UpdateClass::_flashSector(uint32_t offset, uint8_t *data, size_t len, uint8_t skip){
+    if(offset + len > _erased){
+        // the writer task erases a whole block ahead, one erase instead of sixteen
+        size_t erase = SPI_FLASH_SEC_SIZE;
+        if(_writer && !(offset % UPDATE_ERASE_BLOCK_SIZE) && offset + UPDATE_ERASE_BLOCK_SIZE <= _size){
+            erase = UPDATE_ERASE_BLOCK_SIZE;
+        }
+        if(!ESP.partitionEraseRange(_partition, offset, erase)){
+            return false;
+        }
+        _erased = offset + erase;
+    }
+    return ESP.partitionWrite(_partition, offset + skip, (uint32_t*)data + skip/sizeof(uint32_t), len - skip);
+}
+
+bool UpdateClass::beginDelta(int ledPin, uint8_t ledOn){
+    if(!begin(UPDATE_SIZE_UNKNOWN, U_FLASH, ledPin, ledOn)){
+        return false;
+    }
+    return _startDelta();
+}
+
+bool UpdateClass::_startDelta(){
+    _delta = (DeltaState*)calloc(1, sizeof(DeltaState));
+    if(!_delta){
+        log_e("malloc failed");
+        _abort(UPDATE_ERROR_PATCH);
+        return false;
+    }
+    return true;
+}
+
+bool UpdateClass::_deltaHeader(){
+    const uint8_t *header = _delta->header;
+    if(memcmp(header, UPDATE_DELTA_MAGIC, 4) || header[4] != UPDATE_DELTA_VERSION){
+        log_e("not a patch");
+        _abort(UPDATE_ERROR_PATCH);
+        return false;
+    }
+    uint32_t sourceSize = _le32(header + 8);
+    uint32_t targetSize = _le32(header + 28);
+    if(!targetSize || targetSize > _partition->size){
+        log_e("bad target size %u", targetSize);
+        _abort(UPDATE_ERROR_SIZE);
+        return false;
+    }
+    _delta->source = esp_ota_get_running_partition();
+    if(!_delta->source || sourceSize > _delta->source->size){
+        log_e("bad source size %u", sourceSize);
+        _abort(UPDATE_ERROR_PATCH);
+        return false;
+    }
+
+    //the patch only applies to the image it was made from,
+    //nothing is buffered yet so the sector buffer can hash it
+    MD5Builder md5;
+    md5.begin();
+    for(uint32_t offset = 0; offset < sourceSize; offset += SPI_FLASH_SEC_SIZE){
+        size_t len = sourceSize - offset < SPI_FLASH_SEC_SIZE ? sourceSize - offset : SPI_FLASH_SEC_SIZE;
+        if(!ESP.partitionRead(_delta->source, offset, (uint32_t*)_buffer, len)){
+            _abort(UPDATE_ERROR_READ);
+            return false;
+        }
+        md5.add(_buffer, len);
+    }
+    md5.calculate();
+    uint8_t digest[16];
+    md5.getBytes(digest);
+    if(memcmp(digest, header + 12, sizeof(digest))){
+        log_e("patch is for another firmware");
+        _abort(UPDATE_ERROR_PATCH);
+        return false;
+    }
+
+    _delta->sourceSize = sourceSize;
+    _size = targetSize;
+    if(!_target_md5.length()){
+        char hex[33];
+        for(int i = 0; i < 16; i++){
+            sprintf(hex + i * 2, "%02x", header[32 + i]);
+        }
+        _target_md5 = hex;
+    }
+    log_d("patch %s %u -> %u", _delta->source->label, sourceSize, targetSize);
+    return true;
+}
+
+bool UpdateClass::_deltaOutput(const uint8_t *data, size_t len, bool diff){
+    DeltaState &d = *_delta;
+    while(len){
+        size_t run = SPI_FLASH_SEC_SIZE - _bufferLen;
+        if(run > len){
+            run = len;
+        }
+        if(diff){
+            uint32_t end = d.cacheBase + d.cacheLen;
+            if(d.sourcePos < d.cacheBase || d.sourcePos >= end){
+                d.cacheBase = d.sourcePos & ~(UPDATE_DELTA_CACHE_SIZE - 1);
+                d.cacheLen = d.sourceSize - d.cacheBase < UPDATE_DELTA_CACHE_SIZE ? d.sourceSize - d.cacheBase : UPDATE_DELTA_CACHE_SIZE;
+                if(!ESP.partitionRead(d.source, d.cacheBase, (uint32_t*)d.cache, d.cacheLen)){
+                    d.cacheLen = 0;
+                    _abort(UPDATE_ERROR_READ);
+                    return false;
+                }
+                end = d.cacheBase + d.cacheLen;
+            }
+            if(run > end - d.sourcePos){
+                run = end - d.sourcePos;
+            }
+            const uint8_t *source = d.cache + (d.sourcePos - d.cacheBase);
+            for(size_t i = 0; i < run; i++){
+                _buffer[_bufferLen + i] = source[i] + data[i];
+            }
+            d.sourcePos += run;
+        } else {
+            memcpy(_buffer + _bufferLen, data, run);
+        }
+        _bufferLen += run;
+        data += run;
+        len -= run;
+        if((_bufferLen == SPI_FLASH_SEC_SIZE || _bufferLen == remaining()) && !_writeBuffer()){
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t UpdateClass::_writeDelta(const uint8_t *data, size_t len){
+    size_t used = 0;
+    bool corrupt = false;
+    while(used < len){
+        DeltaState &d = *_delta;
+        if(d.stage == DeltaState::HEADER){
+            size_t n = UPDATE_DELTA_HEADER_SIZE - d.headerLen;
+            if(n > len - used){
+                n = len - used;
+            }
+            memcpy(d.header + d.headerLen, data + used, n);
+            d.headerLen += n;
+            used += n;
+            if(d.headerLen == UPDATE_DELTA_HEADER_SIZE){
+                if(!_deltaHeader()){
+                    return used;
+                }
+                d.stage = DeltaState::DIFF_LEN;
+            }
+        } else if(d.stage == DeltaState::DIFF || d.stage == DeltaState::EXTRA){
+            uint32_t &left = d.stage == DeltaState::DIFF ? d.diffLen : d.extraLen;
+            size_t n = left < len - used ? left : len - used;
+            if(!_deltaOutput(data + used, n, d.stage == DeltaState::DIFF)){
+                return used;
+            }
+            used += n;
+            left -= n;
+            if(!d.settle()){
+                corrupt = true;
+                break;
+            }
+        } else {
+            uint8_t b = data[used++];
+            if(d.shift > 28){
+                corrupt = true;
+                break;
+            }
+            d.value |= (uint32_t)(b & 0x7f) << d.shift;
+            d.shift += 7;
+            if(b & 0x80){
+                continue;
+            }
+            uint32_t value = d.value;
+            d.value = 0;
+            d.shift = 0;
+            if(d.stage == DeltaState::DIFF_LEN){
+                d.diffLen = value;
+                d.stage = DeltaState::EXTRA_LEN;
+                continue;
+            }
+            if(d.stage == DeltaState::EXTRA_LEN){
+                d.extraLen = value;
+                d.stage = DeltaState::SEEK;
+                continue;
+            }
+            d.seek = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+            uint32_t room = _size - _progress - _bufferLen;
+            if(d.diffLen > room || d.extraLen > room - d.diffLen || d.diffLen > d.sourceSize - d.sourcePos){
+                corrupt = true;
+                break;
+            }
+            d.stage = DeltaState::DIFF;
+            if(!d.settle()){
+                corrupt = true;
+                break;
+            }
+        }
+    }
+    if(corrupt){
+        log_e("corrupt patch at %u", used);
+        _abort(UPDATE_ERROR_PATCH);
+    }
+    return used;
+}
+
 void UpdateClass::_abort(uint8_t err){
     _reset();
     _error = err;
@@ -197,12 +543,32 @@ bool UpdateClass::_writeBuffer(){
     if (!_progress && _progress_callback) {
         _progress_callback(0, _size);
     }
-    if(!ESP.partitionEraseRange(_partition, _progress, SPI_FLASH_SEC_SIZE)){
-        _abort(UPDATE_ERROR_ERASE);
-        return false;
+    if(_writer){
+        //hand the sector over and fill the other buffer while it is flashed
+        if(!_waitWriter()){
+            return false;
+        }
+        xSemaphoreTake(_flashDone, portMAX_DELAY);
+        uint8_t *full = _buffer;
+        _buffer = _flashBuffer;
+        _flashBuffer = full;
+        _flashOffset = _progress;
+        _flashLen = _bufferLen;
+        _flashSkip = skip;
+        xSemaphoreGive(_flashStart);
+        _md5.add(_flashBuffer, _flashLen);
+        if(_publicKey){
+            _sha256.add(_flashBuffer, _flashLen);
+        }
+        _progress += _bufferLen;
+        _bufferLen = 0;
+        if (_progress_callback) {
+            _progress_callback(_progress, _size);
+        }
+        return true;
     }
-    if (!ESP.partitionWrite(_partition, _progress + skip, (uint32_t*)_buffer + skip/sizeof(uint32_t), _bufferLen - skip)) {
-        _abort(UPDATE_ERROR_WRITE);
+    if(!_flashSector(_progress, _buffer, _bufferLen, skip)){
+        _abort(_erased > _progress ? UPDATE_ERROR_WRITE : UPDATE_ERROR_ERASE);
         return false;
     }
     //restore magic or md5 will fail
@@ -210,6 +576,9 @@ bool UpdateClass::_writeBuffer(){
         _buffer[0] = ESP_IMAGE_HEADER_MAGIC;
     }
     _md5.add(_buffer, _bufferLen);
+    if(_publicKey){
+        _sha256.add(_buffer, _bufferLen);
+    }
     _progress += _bufferLen;
     _bufferLen = 0;
     if (_progress_callback) {
@@ -260,21 +629,92 @@ bool UpdateClass::setMD5(const char * expected_md5){
     return true;
 }
 
+bool UpdateClass::setPublicKey(const uint8_t * key, size_t len){
+    if(_progress || _bufferLen){
+        log_e("set the key before writing");
+        return false;
+    }
+    if(_publicKey){
+        mbedtls_pk_free(_publicKey);
+        free(_publicKey);
+        _publicKey = NULL;
+    }
+    if(!key || !len){
+        return true;
+    }
+    _publicKey = (mbedtls_pk_context*)malloc(sizeof(mbedtls_pk_context));
+    if(!_publicKey){
+        log_e("malloc failed");
+        return false;
+    }
+    mbedtls_pk_init(_publicKey);
+    int ret = mbedtls_pk_parse_public_key(_publicKey, key, len);
+    if(ret != 0){
+        log_e("bad public key: -0x%04x", -ret);
+        mbedtls_pk_free(_publicKey);
+        free(_publicKey);
+        _publicKey = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool UpdateClass::setSignature(const uint8_t * signature, size_t len){
+    free(_signature);
+    _signature = NULL;
+    _signatureLen = 0;
+    if(!signature || !len){
+        return true;
+    }
+    _signature = (uint8_t*)malloc(len);
+    if(!_signature){
+        log_e("malloc failed");
+        return false;
+    }
+    memcpy(_signature, signature, len);
+    _signatureLen = len;
+    return true;
+}
+
+bool UpdateClass::_verifySignature(){
+    if(!_publicKey){
+        return true;
+    }
+    if(!_signature){
+        log_e("no signature for the image");
+        _abort(UPDATE_ERROR_SIGN);
+        return false;
+    }
+    uint8_t hash[32];
+    _sha256.calculate();
+    _sha256.getBytes(hash);
+    int ret = mbedtls_pk_verify(_publicKey, MBEDTLS_MD_SHA256, hash, sizeof(hash), _signature, _signatureLen);
+    if(ret != 0){
+        log_e("signature check failed: -0x%04x", -ret);
+        _abort(UPDATE_ERROR_SIGN);
+        return false;
+    }
+    return true;
+}
+
 bool UpdateClass::end(bool evenIfRemaining){
     if(hasError() || _size == 0){
         return false;
     }
 
-    if(!isFinished() && !evenIfRemaining){
+    if(!isFinished() && (!evenIfRemaining || _delta)){
         log_e("premature end: res:%u, pos:%u/%u\n", getError(), progress(), _size);
         _abort(UPDATE_ERROR_ABORT);
         return false;
     }
 
+    if(evenIfRemaining && _bufferLen > 0 && !_writeBuffer()) {
+        return false;
+    }
+    if(!_waitWriter()){
+        return false;
+    }
     if(evenIfRemaining) {
-        if(_bufferLen > 0) {
-            _writeBuffer();
-        }
         _size = progress();
     }
 
@@ -285,6 +725,9 @@ bool UpdateClass::end(bool evenIfRemaining){
             return false;
         }
     }
+    if(!_verifySignature()){
+        return false;
+    }
 
     return _verifyEnd();
 }
@@ -294,6 +737,15 @@ size_t UpdateClass::write(uint8_t *data, size_t len) {
         return 0;
     }
 
+    //a patch is taken wherever a firmware image is
+    if(!_delta && _command == U_FLASH && !_progress && !_bufferLen
+       && len >= 4 && !memcmp(data, UPDATE_DELTA_MAGIC, 4) && !_startDelta()){
+        return 0;
+    }
+    if(_delta){
+        return _writeDelta(data, len);
+    }
+
     if(len > remaining()){
         _abort(UPDATE_ERROR_SPACE);
         return 0;
@@ -328,6 +780,30 @@ size_t UpdateClass::writeStream(Stream &data) {
     if(hasError() || !isRunning())
         return 0;
 
+    if(_delta) {
+        //patch bytes go through write(), remaining() counts the image
+        uint8_t chunk[256];
+        while(remaining()) {
+            toRead = 0;
+            timeout_failures = 0;
+            while(!toRead) {
+                toRead = data.readBytes(chunk, sizeof(chunk));
+                if(toRead == 0) {
+                    timeout_failures++;
+                    if (timeout_failures >= 300) {
+                        _abort(UPDATE_ERROR_STREAM);
+                        return written;
+                    }
+                    delay(100);
+                }
+            }
+            if(write(chunk, toRead) != toRead)
+                return written;
+            written += toRead;
+        }
+        return written;
+    }
+
     if(!_verifyHeader(data.peek())) {
         _reset();
         return 0;
@@ -118,6 +118,8 @@ void setup(void) {
   server.on("/inline", []() {
     server.send(200, "text/plain", "this works as well");
   });
+  // request timing at /metrics, for Prometheus or tools/webload.py --metrics
+  server.enableMetrics();
   server.onNotFound(handleNotFound);
   server.begin();
   Serial.println("HTTP server started");
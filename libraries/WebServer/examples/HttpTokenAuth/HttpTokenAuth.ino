@@ -0,0 +1,72 @@
+/*
+   A dashboard that is polled every second: the password is checked once at
+   /login, which hands out a session cookie. The polls only compare the cookie
+   with the tokens the server keeps, nothing is hashed for them.
+
+   Scripts can send the same token as "Authorization: Bearer <token>", it is
+   the body of the /login response.
+*/
+#include <WiFi.h>
+#include <WebServer.h>
+
+const char* ssid = "........";
+const char* password = "........";
+
+WebServer server(80);
+
+const char* www_username = "admin";
+const char* www_password = "esp32";
+
+void setup() {
+  Serial.begin(115200);
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(ssid, password);
+  if (WiFi.waitForConnectResult() != WL_CONNECTED) {
+    Serial.println("WiFi Connect Failed! Rebooting...");
+    delay(1000);
+    ESP.restart();
+  }
+
+  server.on("/login", []() {
+    if (!server.authenticate(www_username, www_password)) {
+      return server.requestAuthentication(DIGEST_AUTH);
+    }
+    String token = server.createAuthToken(3600);
+    server.setAuthCookie(token, 3600);
+    server.sendHeader("Location", "/");
+    server.send(303, "text/plain", token);
+  });
+
+  server.on("/logout", []() {
+    // every session, not only this browser's
+    server.revokeAuthToken();
+    server.setAuthCookie("");
+    server.send(200, "text/plain", "Logged out");
+  });
+
+  server.on("/", []() {
+    if (!server.authenticateToken()) {
+      server.sendHeader("Location", "/login");
+      return server.send(303);
+    }
+    server.send(200, "text/html",
+                "<p>Uptime <span id=u></span> s</p>"
+                "<script>setInterval(()=>fetch('/uptime').then(r=>r.text()).then(t=>u.textContent=t),1000)</script>");
+  });
+
+  server.on("/uptime", []() {
+    if (!server.authenticateToken()) {
+      return server.send(401);
+    }
+    server.send(200, "text/plain", String(millis() / 1000));
+  });
+
+  server.begin();
+  Serial.print("Open http://");
+  Serial.print(WiFi.localIP());
+  Serial.println("/ in your browser to see it working");
+}
+
+void loop() {
+  server.handleClient();
+}
@@ -0,0 +1,46 @@
+#include <WiFi.h>
+#include <WebServer.h>
+#include <WebSocketServer.h>
+
+const char* ssid = "........";
+const char* password = "........";
+
+WebServer server(80);
+WebSocketServer ws(server, "/ws");
+
+const char page[] PROGMEM =
+  "<script>var s=new WebSocket('ws://'+location.host+'/ws');"
+  "s.onmessage=function(e){document.body.textContent=e.data};</script>";
+
+void setup(void) {
+  Serial.begin(115200);
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.println(WiFi.localIP());
+
+  server.on("/", []() {
+    server.send_P(200, "text/html", page);
+  });
+  ws.onEvent([](uint8_t id, WebSocketEvent type, const uint8_t* data, size_t len) {
+    if (type == WS_EVT_CONNECT) {
+      Serial.printf("[%u] connected from %s\n", id, ws.remoteIP(id).toString().c_str());
+    } else if (type == WS_EVT_TEXT) {
+      ws.sendText(id, data, len);
+    }
+  });
+  server.begin();
+}
+
+void loop(void) {
+  server.handleClient();
+  static unsigned long last;
+  // the uptime goes to every client; a client that does not keep up misses updates
+  if (millis() - last > 1000 && ws.count()) {
+    last = millis();
+    ws.broadcastText(String(millis() / 1000));
+  }
+}
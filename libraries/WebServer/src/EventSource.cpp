@@ -0,0 +1,261 @@
+/*
+  EventSource.cpp - Server-Sent Events endpoint for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <Arduino.h>
+#include <esp32-hal-log.h>
+#include "EventSource.h"
+
+// answers the subscribing request, the connection then belongs to the EventSource
+class EventSourceRequestHandler : public RequestHandler {
+public:
+  EventSourceRequestHandler(EventSource* es, const Uri& uri)
+  : _es(es)
+  , _uri(uri.clone())
+  {
+    _uri->initPathArgs(pathArgs);
+  }
+
+  ~EventSourceRequestHandler() {
+    delete _uri;
+  }
+
+  bool canHandle(HTTPMethod method, String uri) override {
+    return method == HTTP_GET && _uri->canHandle(uri, pathArgs);
+  }
+
+  bool handle(WebServer& server, HTTPMethod method, String uri) override {
+    if (!canHandle(method, uri))
+      return false;
+    if (!_es) {
+      server.send(503, "text/plain", "");
+      return true;
+    }
+    return _es->_accept(server);
+  }
+
+  const String* exactUri(HTTPMethod& method) override {
+    if (!_uri->isExact())
+      return nullptr;
+    method = HTTP_GET;
+    return &_uri->str();
+  }
+
+  EventSource* _es;
+
+protected:
+  Uri* _uri;
+};
+
+EventSource::EventSource(WebServer& server, const Uri& uri, uint8_t maxClients)
+: _server(server)
+, _handler(new EventSourceRequestHandler(this, uri))
+, _clients(new Subscriber[maxClients ? maxClients : 1]())
+, _maxClients(maxClients ? maxClients : 1)
+, _retry(0)
+, _dropped(0)
+, _lastEvent(0)
+{
+  server.addHandler(_handler);
+  server._addService(this);
+}
+
+EventSource::~EventSource() {
+  // the handler stays with the server, which deletes it
+  _handler->_es = nullptr;
+  _server._removeService(this);
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    _disconnect(i);
+  }
+  delete[] _clients;
+}
+
+bool EventSource::_accept(WebServer& server) {
+  uint8_t id = 0;
+  while (id < _maxClients && _clients[id].active) id++;
+  if (id == _maxClients) {
+    log_w("no free EventSource slot");
+    server.send(503, "text/plain", "");
+    return true;
+  }
+
+  String head = F("HTTP/1.1 200 OK\r\n"
+                  "Content-Type: text/event-stream\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "Connection: keep-alive\r\n\r\n");
+  if (_retry) {
+    head += "retry: ";
+    head += _retry;
+    head += "\n\n";
+  }
+  SharedBlock* block = SharedBlock::alloc(head.length());
+  if (!block) {
+    server.send(503, "text/plain", "");
+    return true;
+  }
+  memcpy(block->data(), head.c_str(), head.length());
+  Subscriber& s = _clients[id];
+  s.tcp = server.client();
+  s.active = true;
+  s.queue.init();
+  s.queue.push(block);
+  s.queue.drain(s.tcp.fd());
+  log_v("EventSource %u connected", id);
+  if (_cb) {
+    _cb(id);
+  }
+  return true;
+}
+
+SharedBlock* EventSource::_format(const char* event, const char* data, uint32_t id) {
+  // size first, then fill, so the event is written once for all subscribers
+  char idText[11];
+  size_t idLen = id ? sprintf(idText, "%u", id) : 0;
+  size_t eventLen = event ? strlen(event) : 0;
+  size_t dataLen = data ? strlen(data) : 0;
+  size_t lines = 1;
+  for (size_t i = 0; i < dataLen; i++) {
+    lines += data[i] == '\n';
+  }
+  size_t len = (idLen ? idLen + 5 : 0) + (eventLen ? eventLen + 8 : 0) + dataLen + lines * 6 + 2;
+  SharedBlock* block = SharedBlock::alloc(len);
+  if (!block) {
+    return nullptr;
+  }
+  char* p = (char*) block->data();
+  if (idLen) {
+    memcpy(p, "id: ", 4);
+    memcpy(p + 4, idText, idLen);
+    p += idLen + 4;
+    *p++ = '\n';
+  }
+  if (eventLen) {
+    memcpy(p, "event: ", 7);
+    memcpy(p + 7, event, eventLen);
+    p += eventLen + 7;
+    *p++ = '\n';
+  }
+  const char* line = data ? data : "";
+  for (size_t n = 0; n < lines; n++) {
+    const char* end = strchr(line, '\n');
+    size_t lineLen = end ? end - line : strlen(line);
+    memcpy(p, "data: ", 6);
+    memcpy(p + 6, line, lineLen);
+    p += lineLen + 6;
+    *p++ = '\n';
+    line += lineLen + 1;
+  }
+  *p++ = '\n';
+  return block;
+}
+
+uint8_t EventSource::_broadcast(SharedBlock* block) {
+  block->refs++;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    Subscriber& s = _clients[i];
+    if (!s.active) {
+      continue;
+    }
+    if (!s.queue.push(block)) {
+      log_d("EventSource %u is not keeping up, dropped", i);
+      _dropped++;
+      _disconnect(i);
+      continue;
+    }
+    if (s.queue.drain(s.tcp.fd()) < 0) {
+      _disconnect(i);
+      continue;
+    }
+    count++;
+  }
+  SharedBlock::release(block);
+  _lastEvent = millis();
+  return count;
+}
+
+uint8_t EventSource::broadcast(const char* event, const char* data, uint32_t id) {
+  if (!count()) {
+    return 0;
+  }
+  SharedBlock* block = _format(event, data, id);
+  return block ? _broadcast(block) : 0;
+}
+
+bool EventSource::send(uint8_t client, const char* event, const char* data, uint32_t id) {
+  if (!connected(client) || _clients[client].queue.full()) {
+    return false;
+  }
+  Subscriber& s = _clients[client];
+  SharedBlock* block = _format(event, data, id);
+  if (!block) {
+    return false;
+  }
+  s.queue.push(block);
+  if (s.queue.drain(s.tcp.fd()) < 0) {
+    _disconnect(client);
+  }
+  return true;
+}
+
+void EventSource::_disconnect(uint8_t client) {
+  Subscriber& s = _clients[client];
+  if (!s.active) {
+    return;
+  }
+  s.active = false;
+  s.tcp.stop();
+  s.queue.clear();
+  log_v("EventSource %u disconnected", client);
+}
+
+bool EventSource::connected(uint8_t client) {
+  return client < _maxClients && _clients[client].active;
+}
+
+uint8_t EventSource::count() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    n += _clients[i].active;
+  }
+  return n;
+}
+
+bool EventSource::_poll() {
+  bool busy = false;
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    Subscriber& s = _clients[i];
+    if (!s.active) {
+      continue;
+    }
+    int sent = s.queue.drain(s.tcp.fd());
+    if (sent < 0 || !s.tcp.connected()) {
+      _disconnect(i);
+      continue;
+    }
+    busy |= sent > 0;
+  }
+  // a comment now and then keeps proxies from timing out and finds dead subscribers
+  if (millis() - _lastEvent >= EVENTSOURCE_KEEPALIVE_INTERVAL && count()) {
+    SharedBlock* block = SharedBlock::alloc(2);
+    if (block) {
+      memcpy(block->data(), ":\n", 2);
+      _broadcast(block);
+    }
+  }
+  return busy;
+}
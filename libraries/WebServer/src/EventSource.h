@@ -0,0 +1,96 @@
+/*
+  EventSource.h - Server-Sent Events endpoint for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef EVENTSOURCE_H
+#define EVENTSOURCE_H
+
+#include "WebServer.h"
+#include "detail/SendQueue.h"
+
+#ifndef EVENTSOURCE_MAX_CLIENTS
+#define EVENTSOURCE_MAX_CLIENTS 8 //subscribers per endpoint
+#endif
+
+#ifndef EVENTSOURCE_QUEUE_LENGTH
+#define EVENTSOURCE_QUEUE_LENGTH 4 //events waiting per subscriber before it is dropped
+#endif
+
+#ifndef EVENTSOURCE_KEEPALIVE_INTERVAL
+#define EVENTSOURCE_KEEPALIVE_INTERVAL 15000 //ms without events before a comment is sent
+#endif
+
+class EventSourceRequestHandler;
+
+/*
+ * Streams text/event-stream to every GET on uri, served from
+ * WebServer::handleClient():
+ *
+ *   EventSource& events = server.onEvents("/events");
+ *   events.broadcast("temperature", "21.5");
+ *
+ * An event is formatted once into a shared block and queued for every
+ * subscriber; sending never blocks. A subscriber that still has
+ * EVENTSOURCE_QUEUE_LENGTH events waiting is too slow and is dropped,
+ * the browser reconnects and can resume from Last-Event-ID.
+ */
+class EventSource : public WebServerService {
+public:
+  typedef std::function<void(uint8_t client)> ConnectHandler;
+
+  EventSource(WebServer& server, const Uri& uri, uint8_t maxClients = EVENTSOURCE_MAX_CLIENTS);
+  ~EventSource();
+
+  // called while the subscribing request is current, so server.header("Last-Event-ID") works
+  void onConnect(ConnectHandler cb) { _cb = cb; }
+  void setRetry(uint32_t ms) { _retry = ms; } // reconnect delay suggested to browsers
+
+  // event and id are left out when NULL or 0; data may span several lines.
+  // broadcast() returns how many subscribers the event was queued for.
+  uint8_t broadcast(const char* event, const char* data, uint32_t id = 0);
+  bool send(uint8_t client, const char* event, const char* data, uint32_t id = 0);
+
+  bool connected(uint8_t client);
+  uint8_t count();
+  uint32_t droppedClients() { return _dropped; }
+
+  // used by WebServer only
+  bool _poll() override;
+  bool _accept(WebServer& server);
+
+protected:
+  struct Subscriber {
+    WiFiClient tcp;
+    bool       active;
+    SendQueue<EVENTSOURCE_QUEUE_LENGTH> queue;
+  };
+
+  static SharedBlock* _format(const char* event, const char* data, uint32_t id);
+  uint8_t _broadcast(SharedBlock* block);
+  void _disconnect(uint8_t client);
+
+  WebServer&    _server;
+  EventSourceRequestHandler* _handler;
+  Subscriber*   _clients;
+  uint8_t       _maxClients;
+  uint32_t      _retry;
+  uint32_t      _dropped;
+  unsigned long _lastEvent;
+  ConnectHandler _cb;
+};
+
+#endif //EVENTSOURCE_H
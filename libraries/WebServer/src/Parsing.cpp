@@ -19,6 +19,7 @@
   Modified 8 May 2015 by Hristo Gochkov (proper post and file upload handling)
 */
 
+#include <algorithm>
 #include <Arduino.h>
 #include <esp32-hal-log.h>
 #include "WiFiServer.h"
@@ -33,161 +34,220 @@
 static const char Content_Type[] PROGMEM = "Content-Type";
 static const char filename[] PROGMEM = "filename";
 
-static char* readBytesWithTimeout(WiFiClient& client, size_t maxLength, size_t& dataLength, int timeout_ms)
+// reads up to length bytes into buf, waiting at most timeout_ms for each piece
+static size_t readBytesWithTimeout(WiFiClient& client, char* buf, size_t length, int timeout_ms)
 {
-  char *buf = nullptr;
-  dataLength = 0;
-  while (dataLength < maxLength) {
+  size_t dataLength = 0;
+  while (dataLength < length) {
     int tries = timeout_ms;
     size_t newLength;
     while (!(newLength = client.available()) && tries--) delay(1);
     if (!newLength) {
       break;
     }
-    if (!buf) {
-      buf = (char *) malloc(newLength + 1);
-      if (!buf) {
-        return nullptr;
-      }
+    if (newLength > length - dataLength) {
+      newLength = length - dataLength; // leave a pipelined request in the socket
+    }
+    dataLength += client.readBytes(buf + dataLength, newLength);
+  }
+  return dataLength;
+}
+
+// the same for a body nobody reads, returns how much of it was dropped
+static size_t skipBytesWithTimeout(WiFiClient& client, size_t length, int timeout_ms)
+{
+  char buf[128];
+  size_t skipped = 0;
+  while (skipped < length) {
+    size_t n = length - skipped < sizeof(buf) ? length - skipped : sizeof(buf);
+    size_t got = readBytesWithTimeout(client, buf, n, timeout_ms);
+    skipped += got;
+    if (got < n) {
+      break;
+    }
+  }
+  return skipped;
+}
+
+int WebServer::_readRequestHead(WiFiClient& client, HTTPClientSlot& slot) {
+  if (!slot.head) {
+    slot.head = (char *) heap_policy_malloc(HEAP_USER_WEB_SERVER, WEBSERVER_HEAD_BUFFER_SIZE);
+    if (!slot.head) {
+      log_e("no memory for the request head");
+      return -1;
+    }
+  }
+  // byte by byte from the client's RX buffer, so the body (or a pipelined
+  // request) stays in the stream for whoever reads it next
+  int avail = client.available();
+  while (avail-- > 0) {
+    int c = client.read();
+    if (c < 0) {
+      break;
+    }
+    if (c == '\r') {
+      continue;
     }
-    else {
-      char* newBuf = (char *) realloc(buf, dataLength + newLength + 1);
-      if (!newBuf) {
-        free(buf);
-        return nullptr;
+    if (c == '\n') {
+      if (!slot.headLen) {
+        continue; // empty lines before the request line
+      }
+      if (slot.headLineEmpty) {
+        slot.head[slot.headLen] = '\0'; // blank line, the head is complete
+        return 1;
       }
-      buf = newBuf;
+      c = '\0';
+      slot.headLineEmpty = true;
+    } else {
+      slot.headLineEmpty = false;
+    }
+    // keep room for the terminating empty line
+    if (slot.headLen >= WEBSERVER_HEAD_BUFFER_SIZE - 1) {
+      log_e("request head exceeds %u bytes", WEBSERVER_HEAD_BUFFER_SIZE);
+      return -1;
     }
-    client.readBytes(buf + dataLength, newLength);
-    dataLength += newLength;
-    buf[dataLength] = '\0';
+    slot.head[slot.headLen++] = c;
   }
-  return buf;
+  return 0;
 }
 
-bool WebServer::_parseRequest(WiFiClient& client) {
-  // Read the first line of HTTP request
-  String req = client.readStringUntil('\r');
-  client.readStringUntil('\n');
-  //reset header value
-  for (int i = 0; i < _headerKeysCount; ++i) {
-    _currentHeaders[i].value =String();
-   }
+// method tokens, picked by length and first character
+static HTTPMethod parseMethod(const char* m, size_t len) {
+  switch (len) {
+  case 3:
+    if (m[0] == 'P' && !memcmp(m, "PUT", 3)) return HTTP_PUT;
+    break;
+  case 4:
+    if (m[0] == 'P' && !memcmp(m, "POST", 4)) return HTTP_POST;
+    break;
+  case 5:
+    if (m[0] == 'P' && !memcmp(m, "PATCH", 5)) return HTTP_PATCH;
+    break;
+  case 6:
+    if (m[0] == 'D' && !memcmp(m, "DELETE", 6)) return HTTP_DELETE;
+    break;
+  case 7:
+    if (m[0] == 'O' && !memcmp(m, "OPTIONS", 7)) return HTTP_OPTIONS;
+    break;
+  }
+  // GET, and anything not handled separately, as before
+  return HTTP_GET;
+}
+
+static bool startsWithIgnoreCase(const char* s, const char* prefix) {
+  return !strncasecmp(s, prefix, strlen(prefix));
+}
+
+bool WebServer::_parseRequest(WiFiClient& client, char* head) {
+  uint32_t parseStart = micros();
+  //reset arguments and header values, they live in the arena
+  _arena.reset();
+  for (int i = 0; i < _headerKeysCount + BUILTIN_HEADER_COUNT; ++i) {
+    _currentHeaders[i].valueLen = 0;
+  }
 
   // First line of HTTP request looks like "GET /path HTTP/1.1"
-  // Retrieve the "/path" part by finding the spaces
-  int addr_start = req.indexOf(' ');
-  int addr_end = req.indexOf(' ', addr_start + 1);
-  if (addr_start == -1 || addr_end == -1) {
-    log_e("Invalid request: %s", req.c_str());
+  // _readRequestHead() left it and each header as NUL terminated lines,
+  // the head ends with an empty one; everything is tokenized in place
+  char* req = head;
+  char* addr_start = strchr(req, ' ');
+  char* addr_end = addr_start ? strchr(addr_start + 1, ' ') : nullptr;
+  if (!addr_end) {
+    log_e("Invalid request: %s", req);
     return false;
   }
-
-  String methodStr = req.substring(0, addr_start);
-  String url = req.substring(addr_start + 1, addr_end);
-  String versionEnd = req.substring(addr_end + 8);
-  _currentVersion = atoi(versionEnd.c_str());
-  String searchStr = "";
-  int hasSearch = url.indexOf('?');
-  if (hasSearch != -1){
-    searchStr = url.substring(hasSearch + 1);
-    url = url.substring(0, hasSearch);
+  HTTPMethod method = parseMethod(req, addr_start - req);
+  char* url = addr_start + 1;
+  *addr_end = '\0';
+  const char* version = addr_end + 1;
+  _currentVersion = startsWithIgnoreCase(version, "HTTP/1.") ? atoi(version + 7) : 0;
+  StringView searchStr;
+  char* hasSearch = strchr(url, '?');
+  if (hasSearch) {
+    *hasSearch = '\0';
+    searchStr = StringView(hasSearch + 1, addr_end - hasSearch - 1);
   }
   _currentUri = url;
   _chunked = false;
-
-  HTTPMethod method = HTTP_GET;
-  if (methodStr == F("POST")) {
-    method = HTTP_POST;
-  } else if (methodStr == F("DELETE")) {
-    method = HTTP_DELETE;
-  } else if (methodStr == F("OPTIONS")) {
-    method = HTTP_OPTIONS;
-  } else if (methodStr == F("PUT")) {
-    method = HTTP_PUT;
-  } else if (methodStr == F("PATCH")) {
-    method = HTTP_PATCH;
-  }
+  // HTTP/1.1 connections are persistent unless the client says otherwise
+  _requestKeepAlive = _currentVersion >= 1;
   _currentMethod = method;
 
-  log_v("method: %s url: %s search: %s", methodStr.c_str(), url.c_str(), searchStr.c_str());
+  log_v("method: %.*s url: %s search: %.*s", (int)(addr_start - req), req, url, (int)searchStr.length(), searchStr.data());
 
   //attach handler
-  RequestHandler* handler;
-  for (handler = _firstHandler; handler; handler = handler->next()) {
-    if (handler->canHandle(_currentMethod, _currentUri))
+  _currentHandler = _findRequestHandler(_currentMethod, _currentUri);
+
+  //parse headers
+  const char* boundary = nullptr;
+  bool isForm = false;
+  bool isEncoded = false;
+  uint32_t contentLength = 0;
+  for (char* line = (char*)version + strlen(version) + 1; *line; line += strlen(line) + 1) {
+    char* headerDiv = strchr(line, ':');
+    if (!headerDiv) {
       break;
+    }
+    *headerDiv = '\0';
+    const char* headerName = line;
+    char* headerValue = headerDiv + 1;
+    while (*headerValue == ' ' || *headerValue == '\t') headerValue++;
+    // the line ends where the next one starts, trim from there
+    char* valueEnd = headerValue + strlen(headerValue);
+    while (valueEnd > headerValue && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) *--valueEnd = '\0';
+    _collectHeader(headerName, headerValue);
+
+    log_v("headerName: %s", headerName);
+    log_v("headerValue: %s", headerValue);
+
+    if (!strcasecmp(headerName, Content_Type)) {
+      using namespace mime;
+      if (startsWithIgnoreCase(headerValue, mimeTable[txt].mimeType)) {
+        isForm = false;
+      } else if (startsWithIgnoreCase(headerValue, "application/x-www-form-urlencoded")) {
+        isForm = false;
+        isEncoded = true;
+      } else if (startsWithIgnoreCase(headerValue, "multipart/")) {
+        boundary = strchr(headerValue, '=');
+        boundary = boundary ? boundary + 1 : "";
+        isForm = true;
+      }
+    } else if (!strcasecmp(headerName, "Content-Length")) {
+      contentLength = atoi(headerValue);
+    } else if (!strcasecmp(headerName, "Host")) {
+      _hostHeader = headerValue;
+    } else if (!strcasecmp(headerName, "Connection")) {
+      _parseConnectionHeader(headerValue);
+    }
   }
-  _currentHandler = handler;
+  _parseTime = micros() - parseStart;
 
-  String formData;
   // below is needed only when POST type request
   if (method == HTTP_POST || method == HTTP_PUT || method == HTTP_PATCH || method == HTTP_DELETE){
-    String boundaryStr;
-    String headerName;
-    String headerValue;
-    bool isForm = false;
-    bool isEncoded = false;
-    uint32_t contentLength = 0;
-    //parse headers
-    while(1){
-      req = client.readStringUntil('\r');
-      client.readStringUntil('\n');
-      if (req == "") break;//no moar headers
-      int headerDiv = req.indexOf(':');
-      if (headerDiv == -1){
-        break;
-      }
-      headerName = req.substring(0, headerDiv);
-      headerValue = req.substring(headerDiv + 1);
-      headerValue.trim();
-       _collectHeader(headerName.c_str(),headerValue.c_str());
-
-      log_v("headerName: %s", headerName.c_str());
-      log_v("headerValue: %s", headerValue.c_str());
-
-      if (headerName.equalsIgnoreCase(FPSTR(Content_Type))){
-        using namespace mime;
-        if (headerValue.startsWith(FPSTR(mimeTable[txt].mimeType))){
-          isForm = false;
-        } else if (headerValue.startsWith(F("application/x-www-form-urlencoded"))){
-          isForm = false;
-          isEncoded = true;
-        } else if (headerValue.startsWith(F("multipart/"))){
-          boundaryStr = headerValue.substring(headerValue.indexOf('=') + 1);
-          boundaryStr.replace("\"","");
-          isForm = true;
-        }
-      } else if (headerName.equalsIgnoreCase(F("Content-Length"))){
-        contentLength = headerValue.toInt();
-      } else if (headerName.equalsIgnoreCase(F("Host"))){
-        _hostHeader = headerValue;
-      }
-    }
-
     if (!isForm){
-      size_t plainLength;
-      char* plainBuf = readBytesWithTimeout(client, contentLength, plainLength, HTTP_MAX_POST_WAIT);
-      if (plainLength < contentLength) {
-      	free(plainBuf);
-      	return false;
-      }
       if (contentLength > 0) {
-        if(isEncoded){
-          //url encoded form
-          if (searchStr != "") searchStr += '&';
-          searchStr += plainBuf;
-        }
         _parseArguments(searchStr);
-        if(!isEncoded){
-          //plain post json or other data
-          RequestArgument& arg = _currentArgs[_currentArgCount++];
-          arg.key = F("plain");
-          arg.value = String(plainBuf);
+        //the body goes to the arena as it is, "plain" or the encoded form
+        int32_t key = isEncoded ? -1 : _arena.append("plain", 5);
+        char* plainBuf = _arena.reserve(contentLength + 1);
+        if (!plainBuf || (!isEncoded && key < 0)) {
+          log_e("no memory for a %u byte body", contentLength);
+          return false;
         }
-
+        uint32_t plain = _arena.size();
+        if (readBytesWithTimeout(client, plainBuf, contentLength, HTTP_MAX_POST_WAIT) < contentLength) {
+          return false;
+        }
+        plainBuf[contentLength] = '\0';
+        _arena.commit(contentLength + 1);
         log_v("Plain: %s", plainBuf);
-        free(plainBuf);
+        if(isEncoded){
+          //url encoded form, after the query arguments
+          _parseArenaArguments(plain, contentLength);
+        } else {
+          //plain post json or other data
+          _arena.add(key, 5, plain, contentLength);
+        }
       } else {
         // No content - but we can still have arguments in the URL.
         _parseArguments(searchStr);
@@ -195,156 +255,198 @@ bool WebServer::_parseRequest(WiFiClient& client) {
     }
 
     if (isForm){
+      // multipart bodies are read up to the closing boundary, not by length, so
+      // the end of the request is not known exactly; do not reuse the connection
+      _requestKeepAlive = false;
+      String boundaryStr(boundary);
+      boundaryStr.replace("\"","");
       _parseArguments(searchStr);
       if (!_parseForm(client, boundaryStr, contentLength)) {
         return false;
       }
     }
   } else {
-    String headerName;
-    String headerValue;
-    //parse headers
-    while(1){
-      req = client.readStringUntil('\r');
-      client.readStringUntil('\n');
-      if (req == "") break;//no moar headers
-      int headerDiv = req.indexOf(':');
-      if (headerDiv == -1){
-        break;
-      }
-      headerName = req.substring(0, headerDiv);
-      headerValue = req.substring(headerDiv + 2);
-      _collectHeader(headerName.c_str(),headerValue.c_str());
-
-	  log_v("headerName: %s", headerName.c_str());
-	  log_v("headerValue: %s", headerValue.c_str());
-
-	  if (headerName.equalsIgnoreCase("Host")){
-        _hostHeader = headerValue;
+    _parseArguments(searchStr);
+    if (contentLength > 0) {
+      // a body nobody reads would be taken for the next request, skip it
+      if (skipBytesWithTimeout(client, contentLength, HTTP_MAX_POST_WAIT) < contentLength) {
+        _requestKeepAlive = false;
       }
     }
-    _parseArguments(searchStr);
   }
-  client.flush();
+  if (!_requestKeepAlive) {
+    // nothing else is read from this connection, drop whatever follows
+    client.flush();
+  }
 
-  log_v("Request: %s", url.c_str());
-  log_v(" Arguments: %s", searchStr.c_str());
+  log_v("Request: %s", _currentUri.c_str());
+  log_v(" Arguments: %.*s", (int)searchStr.length(), searchStr.data());
 
   return true;
 }
 
+void WebServer::_parseConnectionHeader(const char* value) {
+  // a comma separated token list, e.g. "keep-alive, Upgrade"
+  while (*value) {
+    while (*value == ' ' || *value == ',') value++;
+    size_t len = strcspn(value, " ,");
+    if (len == 5 && !strncasecmp(value, "close", 5)) {
+      _requestKeepAlive = false;
+      return;
+    }
+    if (len == 10 && !strncasecmp(value, "keep-alive", 10)) {
+      _requestKeepAlive = true;
+    }
+    value += len;
+  }
+}
+
 bool WebServer::_collectHeader(const char* headerName, const char* headerValue) {
-  for (int i = 0; i < _headerKeysCount; i++) {
-    if (_currentHeaders[i].key.equalsIgnoreCase(headerName)) {
-            _currentHeaders[i].value=headerValue;
-            return true;
-        }
+  // collected and builtin keys alike, a key asked for twice gets the value in both
+  size_t nameLen = strlen(headerName);
+  uint16_t hash = RequestArena::hashIgnoreCase(headerName, nameLen);
+  int32_t value = -1;
+  size_t valueLen = strlen(headerValue);
+  for (int i = 0; i < _headerKeysCount + BUILTIN_HEADER_COUNT; i++) {
+    RequestHeader& h = _currentHeaders[i];
+    if (h.hash != hash || h.key.length() != nameLen || strcasecmp(h.key.c_str(), headerName))
+      continue;
+    if (value < 0 && (value = _arena.append(headerValue, valueLen)) < 0)
+      return false;
+    h.value = value;
+    h.valueLen = valueLen;
   }
-  return false;
+  return value >= 0;
 }
 
-void WebServer::_parseArguments(String data) {
-  log_v("args: %s", data.c_str());
-  if (_currentArgs)
-    delete[] _currentArgs;
-  _currentArgs = 0;
+// percent and '+' decoding in place, the text only gets shorter
+static size_t urlDecodeInPlace(char* text, size_t len) {
+  char temp[] = "0x00";
+  size_t i = 0, o = 0;
+  while (i < len) {
+    char c = text[i++];
+    if (c == '%' && i + 1 < len) {
+      temp[2] = text[i++];
+      temp[3] = text[i++];
+      c = strtol(temp, NULL, 16);
+    } else if (c == '+') {
+      c = ' ';
+    }
+    text[o++] = c;
+  }
+  text[o] = '\0';
+  return o;
+}
+
+void WebServer::_parseArguments(StringView data) {
+  log_v("args: %.*s", (int)data.length(), data.data());
   if (data.length() == 0) {
-    _currentArgCount = 0;
-    _currentArgs = new RequestArgument[1];
     return;
   }
-  _currentArgCount = 1;
-
-  for (int i = 0; i < (int)data.length(); ) {
-    i = data.indexOf('&', i);
-    if (i == -1)
-      break;
-    ++i;
-    ++_currentArgCount;
+  int32_t offset = _arena.append(data.data(), data.length());
+  if (offset < 0) {
+    log_e("no memory for the arguments");
+    return;
   }
-  log_v("args count: %d", _currentArgCount);
-
-  _currentArgs = new RequestArgument[_currentArgCount+1];
-  int pos = 0;
-  int iarg;
-  for (iarg = 0; iarg < _currentArgCount;) {
-    int equal_sign_index = data.indexOf('=', pos);
-    int next_arg_index = data.indexOf('&', pos);
-    log_v("pos %d =@%d &@%d", pos, equal_sign_index, next_arg_index);
-    if ((equal_sign_index == -1) || ((equal_sign_index > next_arg_index) && (next_arg_index != -1))) {
-      log_e("arg missing value: %d", iarg);
-      if (next_arg_index == -1)
-        break;
-      pos = next_arg_index + 1;
+  _parseArenaArguments(offset, data.length());
+}
+
+void WebServer::_parseArenaArguments(uint32_t offset, size_t len) {
+  // split key=value&... already in the arena, each piece is decoded where it is
+  size_t pos = 0;
+  while (pos < len) {
+    char* pair = _arena.at(offset + pos);
+    char* amp = (char*) memchr(pair, '&', len - pos);
+    size_t pairLen = amp ? amp - pair : len - pos;
+    pos += pairLen + 1;
+    char* eq = (char*) memchr(pair, '=', pairLen);
+    if (!eq) {
+      log_e("arg missing value: %d", _arena.count());
       continue;
     }
-    RequestArgument& arg = _currentArgs[iarg];
-    arg.key = urlDecode(data.substring(pos, equal_sign_index));
-    arg.value = urlDecode(data.substring(equal_sign_index + 1, next_arg_index));
-    log_v("arg %d key: %s value: %s", iarg, arg.key.c_str(), arg.value.c_str());
-    ++iarg;
-    if (next_arg_index == -1)
-      break;
-    pos = next_arg_index + 1;
+    size_t keyLen = urlDecodeInPlace(pair, eq - pair);
+    size_t valueLen = urlDecodeInPlace(eq + 1, pair + pairLen - eq - 1);
+    uint32_t key = pair - _arena.at(0);
+    _arena.add(key, keyLen, key + (eq + 1 - pair), valueLen);
+    log_v("arg %d key: %s value: %s", _arena.count() - 1, pair, eq + 1);
   }
-  _currentArgCount = iarg;
-  log_v("args count: %d", _currentArgCount);
+  log_v("args count: %d", _arena.count());
+}
 
+bool WebServer::_addArgument(const char* key, size_t keyLen, const char* value, size_t valueLen) {
+  int32_t k = _arena.append(key, keyLen);
+  int32_t v = k < 0 ? -1 : _arena.append(value, valueLen);
+  return v >= 0 && _arena.add(k, keyLen, v, valueLen);
 }
 
-void WebServer::_uploadWriteByte(uint8_t b){
-  if (_currentUpload->currentSize == HTTP_UPLOAD_BUFLEN){
-    if(_currentHandler && _currentHandler->canUpload(_currentUri))
-      _currentHandler->upload(*this, _currentUri, *_currentUpload);
-    _currentUpload->totalSize += _currentUpload->currentSize;
-    _currentUpload->currentSize = 0;
+void WebServer::_uploadWrite(const uint8_t* data, size_t len){
+  while (len) {
+    if (_currentUpload->currentSize == HTTP_UPLOAD_BUFLEN){
+      if(_currentHandler && _currentHandler->canUpload(_currentUri))
+        _currentHandler->upload(*this, _currentUri, *_currentUpload);
+      _currentUpload->totalSize += _currentUpload->currentSize;
+      _currentUpload->currentSize = 0;
+    }
+    size_t n = HTTP_UPLOAD_BUFLEN - _currentUpload->currentSize;
+    if (n > len) n = len;
+    memcpy(_currentUpload->buf + _currentUpload->currentSize, data, n);
+    _currentUpload->currentSize += n;
+    data += n;
+    len -= n;
   }
-  _currentUpload->buf[_currentUpload->currentSize++] = b;
 }
 
-int WebServer::_uploadReadByte(WiFiClient& client){
-  int res = client.read();
-  if(res < 0) {
-    // keep trying until you either read a valid byte or timeout
-    unsigned long startMillis = millis();
-    long timeoutIntervalMillis = client.getTimeout();
-    boolean timedOut = false;
-    for(;;) {
-      if (!client.connected()) return -1;
-      // loosely modeled after blinkWithoutDelay pattern
-      while(!timedOut && !client.available() && client.connected()){
-        delay(2);
-        timedOut = millis() - startMillis >= timeoutIntervalMillis;
-      }
+// Boyer-Moore-Horspool search for needle (length m) in hay, skip[] from the needle
+static const uint8_t* findDelimiter(const uint8_t* hay, size_t len, const uint8_t* needle, size_t m, const uint16_t* skip){
+  if (len < m) return nullptr;
+  size_t pos = 0;
+  uint8_t last = needle[m - 1];
+  while (pos <= len - m) {
+    uint8_t c = hay[pos + m - 1];
+    if (c == last && !memcmp(hay + pos, needle, m - 1))
+      return hay + pos;
+    pos += skip[c];
+  }
+  return nullptr;
+}
 
-      res = client.read();
-      if(res >= 0) {
-        return res; // exit on a valid read
+bool WebServer::_uploadReadFile(WiFiClient& client, const String& boundary){
+  // the file ends at CRLF "--" boundary; search for it in whatever the client
+  // has buffered and pass everything before it on in blocks
+  String delimiter = "\r\n--" + boundary;
+  const uint8_t* needle = (const uint8_t*)delimiter.c_str();
+  size_t m = delimiter.length();
+  uint16_t skip[256];
+  for (int i = 0; i < 256; i++) skip[i] = m;
+  for (size_t i = 0; i < m - 1; i++) skip[needle[i]] = m - 1 - i;
+
+  unsigned long lastData = millis();
+  for (;;) {
+    size_t avail = client.peekAvailable();
+    const uint8_t* data = client.peekBuffer();
+    if (avail) {
+      const uint8_t* found = findDelimiter(data, avail, needle, m, skip);
+      if (found) {
+        _uploadWrite(data, found - data);
+        client.peekConsume(found - data + m);
+        return true;
       }
-      // NOTE: it is possible to get here and have all of the following
-      //       assertions hold true
-      //
-      //       -- client.available() > 0
-      //       -- client.connected == true
-      //       -- res == -1
-      //
-      //       a simple retry strategy overcomes this which is to say the
-      //       assertion is not permanent, but the reason that this works
-      //       is elusive, and possibly indicative of a more subtle underlying
-      //       issue
-
-      timedOut = millis() - startMillis >= timeoutIntervalMillis;
-      if(timedOut) {
-        return res; // exit on a timeout
+      // keep a tail that could be the start of the delimiter
+      if (avail >= m) {
+        size_t safe = avail - (m - 1);
+        _uploadWrite(data, safe);
+        client.peekConsume(safe);
+        lastData = millis();
+        continue;
       }
     }
+    if (!client.connected() || millis() - lastData >= (unsigned long)client.getTimeout())
+      return false;
+    delay(1);
   }
-
-  return res;
 }
 
 bool WebServer::_parseForm(WiFiClient& client, String boundary, uint32_t len){
-  (void) len;
   log_v("Parse Form: Boundary: %s Length: %d", boundary.c_str(), len);
   String line;
   int retry = 0;
@@ -356,9 +458,9 @@ bool WebServer::_parseForm(WiFiClient& client, String boundary, uint32_t len){
   client.readStringUntil('\n');
   //start reading the form
   if (line == ("--"+boundary)){
-   if(_postArgs) delete[] _postArgs;
-    _postArgs = new RequestArgument[WEBSERVER_MAX_POST_ARGS];
-    _postArgsLen = 0;
+    // fields go after the query arguments, and are moved in front of them at the end
+    int queryArgs = _arena.count();
+    int postArgs = 0;
     while(1){
       String argName;
       String argValue;
@@ -406,14 +508,16 @@ bool WebServer::_parseForm(WiFiClient& client, String boundary, uint32_t len){
             }
             log_v("PostArg Value: %s", argValue.c_str());
 
-            RequestArgument& arg = _postArgs[_postArgsLen++];
-            arg.key = argName;
-            arg.value = argValue;
+            if (!_addArgument(argName.c_str(), argName.length(), argValue.c_str(), argValue.length())) {
+              log_e("no memory for PostArg %s", argName.c_str());
+              return false;
+            }
+            postArgs++;
 
             if (line == ("--"+boundary+"--")){
               log_v("Done Parsing POST");
               break;
-            } else if (_postArgsLen >= WEBSERVER_MAX_POST_ARGS) {
+            } else if (postArgs >= WEBSERVER_MAX_POST_ARGS) {
               log_e("Too many PostArgs (max: %d) in request.", WEBSERVER_MAX_POST_ARGS);
               return false;
             }
@@ -425,137 +529,56 @@ bool WebServer::_parseForm(WiFiClient& client, String boundary, uint32_t len){
             _currentUpload->type = argType;
             _currentUpload->totalSize = 0;
             _currentUpload->currentSize = 0;
+            _currentUpload->contentLength = len;
             log_v("Start File: %s Type: %s", _currentUpload->filename.c_str(), _currentUpload->type.c_str());
             if(_currentHandler && _currentHandler->canUpload(_currentUri))
               _currentHandler->upload(*this, _currentUri, *_currentUpload);
             _currentUpload->status = UPLOAD_FILE_WRITE;
-            int argByte = _uploadReadByte(client);
-readfile:
-
-            while(argByte != 0x0D){
-                if(argByte < 0) return _parseFormUploadAborted();
-                _uploadWriteByte(argByte);
-                argByte = _uploadReadByte(client);
-            }
-
-            argByte = _uploadReadByte(client);
-            if(argByte < 0) return _parseFormUploadAborted();
-            if (argByte == 0x0A){
-              argByte = _uploadReadByte(client);
-              if(argByte < 0) return _parseFormUploadAborted();
-              if ((char)argByte != '-'){
-                //continue reading the file
-                _uploadWriteByte(0x0D);
-                _uploadWriteByte(0x0A);
-                goto readfile;
-              } else {
-                argByte = _uploadReadByte(client);
-                if(argByte < 0) return _parseFormUploadAborted();
-                if ((char)argByte != '-'){
-                  //continue reading the file
-                  _uploadWriteByte(0x0D);
-                  _uploadWriteByte(0x0A);
-                  _uploadWriteByte((uint8_t)('-'));
-                  goto readfile;
-                }
-              }
-
-              uint8_t endBuf[boundary.length()];
-              uint32_t i = 0;
-              while(i < boundary.length()){
-                argByte = _uploadReadByte(client);
-                if(argByte < 0) return _parseFormUploadAborted();
-                if ((char)argByte == 0x0D){
-                  _uploadWriteByte(0x0D);
-                  _uploadWriteByte(0x0A);
-                  _uploadWriteByte((uint8_t)('-'));
-                  _uploadWriteByte((uint8_t)('-'));
-                  uint32_t j = 0;
-                  while(j < i){
-                    _uploadWriteByte(endBuf[j++]);
-                  }
-                  goto readfile;
-                }
-                endBuf[i++] = (uint8_t)argByte;
-              }
-
-              if (strstr((const char*)endBuf, boundary.c_str()) != NULL){
-                if(_currentHandler && _currentHandler->canUpload(_currentUri))
-                  _currentHandler->upload(*this, _currentUri, *_currentUpload);
-                _currentUpload->totalSize += _currentUpload->currentSize;
-                _currentUpload->status = UPLOAD_FILE_END;
-                if(_currentHandler && _currentHandler->canUpload(_currentUri))
-                  _currentHandler->upload(*this, _currentUri, *_currentUpload);
-                log_v("End File: %s Type: %s Size: %d", _currentUpload->filename.c_str(), _currentUpload->type.c_str(), _currentUpload->totalSize);
-                line = client.readStringUntil(0x0D);
-                client.readStringUntil(0x0A);
-                if (line == "--"){
-                  log_v("Done Parsing POST");
-                  break;
-                }
-                continue;
-              } else {
-                _uploadWriteByte(0x0D);
-                _uploadWriteByte(0x0A);
-                _uploadWriteByte((uint8_t)('-'));
-                _uploadWriteByte((uint8_t)('-'));
-                uint32_t i = 0;
-                while(i < boundary.length()){
-                  _uploadWriteByte(endBuf[i++]);
-                }
-                argByte = _uploadReadByte(client);
-                goto readfile;
-              }
-            } else {
-              _uploadWriteByte(0x0D);
-              goto readfile;
+            if (!_uploadReadFile(client, boundary)) return _parseFormUploadAborted();
+            if(_currentHandler && _currentHandler->canUpload(_currentUri))
+              _currentHandler->upload(*this, _currentUri, *_currentUpload);
+            _currentUpload->totalSize += _currentUpload->currentSize;
+            _currentUpload->status = UPLOAD_FILE_END;
+            if(_currentHandler && _currentHandler->canUpload(_currentUri))
+              _currentHandler->upload(*this, _currentUri, *_currentUpload);
+            log_v("End File: %s Type: %s Size: %d", _currentUpload->filename.c_str(), _currentUpload->type.c_str(), _currentUpload->totalSize);
+            line = client.readStringUntil(0x0D);
+            client.readStringUntil(0x0A);
+            if (line == "--"){
+              log_v("Done Parsing POST");
+              break;
             }
-            break;
+            continue;
           }
         }
       }
     }
 
-    int iarg;
-    int totalArgs = ((WEBSERVER_MAX_POST_ARGS - _postArgsLen) < _currentArgCount)?(WEBSERVER_MAX_POST_ARGS - _postArgsLen):_currentArgCount;
-    for (iarg = 0; iarg < totalArgs; iarg++){
-      RequestArgument& arg = _postArgs[_postArgsLen++];
-      arg.key = _currentArgs[iarg].key;
-      arg.value = _currentArgs[iarg].value;
-    }
-    if (_currentArgs) delete[] _currentArgs;
-    _currentArgs = new RequestArgument[_postArgsLen];
-    for (iarg = 0; iarg < _postArgsLen; iarg++){
-      RequestArgument& arg = _currentArgs[iarg];
-      arg.key = _postArgs[iarg].key;
-      arg.value = _postArgs[iarg].value;
-    }
-    _currentArgCount = iarg;
-    if (_postArgs) {
-      delete[] _postArgs;
-      _postArgs=nullptr;
-      _postArgsLen = 0;
-    }
+    // form fields first, then as many query arguments as WEBSERVER_MAX_POST_ARGS leaves room for
+    RequestArena::Entry* args = _arena.entries();
+    std::rotate(args, args + queryArgs, args + _arena.count());
+    _arena.truncate(WEBSERVER_MAX_POST_ARGS);
     return true;
   }
   log_e("Error: line: %s", line.c_str());
   return false;
 }
 
-String WebServer::urlDecode(const String& text)
+String WebServer::urlDecode(StringView text)
 {
 	String decoded = "";
+	decoded.reserve(text.length());
 	char temp[] = "0x00";
 	unsigned int len = text.length();
 	unsigned int i = 0;
 	while (i < len)
 	{
 		char decodedChar;
-		char encodedChar = text.charAt(i++);
+		char encodedChar = text[i++];
 		if ((encodedChar == '%') && (i + 1 < len))
 		{
-			temp[2] = text.charAt(i++);
-			temp[3] = text.charAt(i++);
+			temp[2] = text[i++];
+			temp[3] = text[i++];
 
 			decodedChar = strtol(temp, NULL, 16);
 		}
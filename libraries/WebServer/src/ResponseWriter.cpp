@@ -0,0 +1,162 @@
+/*
+  ResponseWriter.cpp - buffered, streaming response body for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <Arduino.h>
+#include <esp32-hal-log.h>
+#include "ResponseWriter.h"
+
+#define CHUNK_HEAD_LEN 6    // "ffff\r\n", chunks never exceed 0xffff bytes
+#define CHUNK_TAIL_LEN 7    // "\r\n" plus room for the final "0\r\n\r\n"
+#define CHUNK_MAX_SIZE 0xffff
+
+ResponseWriter::ResponseWriter(WebServer& server, size_t bufferSize)
+: _server(server)
+, _buffer(nullptr)
+, _size(0)
+, _start(0)
+, _fill(0)
+, _written(0)
+, _begun(false)
+, _ended(false)
+, _chunked(false)
+{
+  if (bufferSize > CHUNK_MAX_SIZE) {
+    bufferSize = CHUNK_MAX_SIZE;
+  }
+  if (bufferSize > CHUNK_HEAD_LEN + CHUNK_TAIL_LEN) {
+    _buffer = (uint8_t*) heap_policy_malloc(HEAP_USER_WEB_SERVER, bufferSize);
+  }
+  if (_buffer) {
+    _size = bufferSize;
+  } else {
+    log_w("no response buffer, writing through");
+  }
+}
+
+ResponseWriter::~ResponseWriter() {
+  if (_begun && !_ended) {
+    end();
+  }
+  free(_buffer);
+}
+
+void ResponseWriter::begin(int code, const char* contentType, size_t contentLength) {
+  if (_begun) {
+    return;
+  }
+  _begun = true;
+  String header;
+  _server.setContentLength(contentLength);
+  _server._prepareHeader(header, code, contentType, 0);
+  _chunked = _server._chunked;
+  // the header waits in the buffer for the first chunk, unless it leaves no room
+  _start = 0;
+  if (_buffer && header.length() + CHUNK_HEAD_LEN + CHUNK_TAIL_LEN < _size / 2) {
+    memcpy(_buffer, header.c_str(), header.length());
+    _start = header.length();
+  } else {
+    _send((const uint8_t*) header.c_str(), header.length());
+  }
+  _fill = _start + (_chunked ? CHUNK_HEAD_LEN : 0);
+}
+
+bool ResponseWriter::_send(const uint8_t* buf, size_t size) {
+  return !size || _server._write((const char*) buf, size) == size;
+}
+
+size_t ResponseWriter::write(const uint8_t* buf, size_t size) {
+  if (_ended) {
+    return 0;
+  }
+  if (!_begun) {
+    begin(200);
+  }
+  if (!_buffer) {
+    _server.sendContent((const char*) buf, size);
+    _written += size;
+    return size;
+  }
+  size_t left = size;
+  size_t end = _size - (_chunked ? CHUNK_TAIL_LEN : 0);
+  while (left) {
+    if (_fill == end) {
+      flush();
+    }
+    size_t n = end - _fill;
+    if (n > left) {
+      n = left;
+    }
+    memcpy(_buffer + _fill, buf, n);
+    _fill += n;
+    buf += n;
+    left -= n;
+  }
+  _written += size;
+  return size;
+}
+
+size_t ResponseWriter::_frameChunk() {
+  // wraps the buffered data in its size line and CRLF, in place; the size
+  // line with leading zeros is valid and keeps the data where it is
+  size_t len = _fill - _start - CHUNK_HEAD_LEN;
+  if (!len) {
+    return _start; // nothing but a pending header
+  }
+  snprintf((char*) _buffer + _start, CHUNK_HEAD_LEN + 1, "%04x\r", (unsigned) len);
+  _buffer[_start + CHUNK_HEAD_LEN - 1] = '\n';
+  _buffer[_fill] = '\r';
+  _buffer[_fill + 1] = '\n';
+  return _fill + 2;
+}
+
+void ResponseWriter::flush() {
+  if (!_buffer || !_begun || _ended) {
+    return;
+  }
+  _send(_buffer, _chunked ? _frameChunk() : _fill);
+  _start = 0;
+  _fill = _chunked ? CHUNK_HEAD_LEN : 0;
+}
+
+void ResponseWriter::end() {
+  if (!_begun) {
+    begin(200);
+  }
+  if (_ended) {
+    return;
+  }
+  if (!_buffer) {
+    _ended = true;
+    if (_chunked) {
+      _server.sendContent("");
+    }
+    return;
+  }
+  if (!_chunked) {
+    flush();
+    _ended = true;
+    return;
+  }
+  // the last chunk and the terminating one in the same write
+  size_t out = _frameChunk();
+  memcpy(_buffer + out, "0\r\n\r\n", 5);
+  _send(_buffer, out + 5);
+  _ended = true;
+  // WebServer would otherwise terminate the body a second time
+  _server._chunked = false;
+}
@@ -0,0 +1,75 @@
+/*
+  ResponseWriter.h - buffered, streaming response body for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef RESPONSEWRITER_H
+#define RESPONSEWRITER_H
+
+#include "WebServer.h"
+
+#ifndef WEBSERVER_RESPONSE_BUFFER_SIZE
+#define WEBSERVER_RESPONSE_BUFFER_SIZE 1436 //bytes collected before a chunk goes out
+#endif
+
+/*
+ * Streams a response body through a fixed buffer, e.g. from a handler:
+ *
+ *   ResponseWriter out(server);
+ *   out.begin(200, "application/json");
+ *   out.printf("{\"uptime\":%lu}", millis());
+ *   out.end();
+ *
+ * Without a content length the body is sent chunked, one chunk per full
+ * buffer (HTTP/1.0 clients get it unframed and the connection is closed).
+ * Each chunk, including its size line and CRLF, leaves in a single write;
+ * the header goes out together with the first one.
+ */
+class ResponseWriter : public Print {
+public:
+  ResponseWriter(WebServer& server, size_t bufferSize = WEBSERVER_RESPONSE_BUFFER_SIZE);
+  ~ResponseWriter();
+
+  void begin(int code, const char* contentType = NULL, size_t contentLength = CONTENT_LENGTH_UNKNOWN);
+  void begin(int code, const String& contentType, size_t contentLength = CONTENT_LENGTH_UNKNOWN) {
+    begin(code, contentType.c_str(), contentLength);
+  }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  using Print::write;
+
+  void flush();   // send what is buffered now, as one chunk
+  void end();     // flush and terminate the body, called by the destructor if needed
+
+  size_t written() { return _written; }
+
+protected:
+  bool _send(const uint8_t* buf, size_t size);
+  size_t _frameChunk();
+
+  WebServer& _server;
+  uint8_t*   _buffer;
+  size_t     _size;
+  size_t     _start;    // where the chunk size line goes, after a still unsent header
+  size_t     _fill;
+  size_t     _written;
+  bool       _begun;
+  bool       _ended;
+  bool       _chunked;
+};
+
+#endif //RESPONSEWRITER_H
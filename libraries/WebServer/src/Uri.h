@@ -8,6 +8,7 @@ class Uri {
 
     protected:
         const String _uri;
+        bool _exact = false; // plain string match, set on the copies clone() hands out
 
     public:
         Uri(const char *uri) : _uri(uri) {}
@@ -16,9 +17,16 @@ class Uri {
         virtual ~Uri() {}
 
         virtual Uri* clone() const {
-            return new Uri(_uri);
+            Uri* uri = new Uri(_uri);
+            uri->_exact = true;
+            return uri;
         };
 
+        // true for a plain Uri, whose requests can be looked up by string
+        // instead of calling canHandle(); subclasses with their own clone() are never exact
+        bool isExact() const { return _exact; }
+        const String& str() const { return _uri; }
+
         virtual void initPathArgs(__attribute__((unused)) std::vector<String> &pathArgs) {}
 
         virtual bool canHandle(const String &requestUri, __attribute__((unused)) std::vector<String> &pathArgs) {
@@ -29,11 +29,13 @@
 #include "WebServer.h"
 #include "FS.h"
 #include "detail/RequestHandlersImpl.h"
+#include "EventSource.h"
 #include "mbedtls/md5.h"
+#include <initializer_list>
+#include <new>
 
 
 static const char AUTHORIZATION_HEADER[] = "Authorization";
-static const char qop_auth[] = "qop=\"auth\"";
 static const char WWW_Authenticate[] = "WWW-Authenticate";
 static const char Content_Length[] = "Content-Length";
 
@@ -43,20 +45,31 @@ WebServer::WebServer(IPAddress addr, int port)
 , _server(addr, port)
 , _currentMethod(HTTP_ANY)
 , _currentVersion(0)
-, _currentStatus(HC_NONE)
-, _statusChange(0)
 , _nullDelay(true)
+, _maxClients(WEBSERVER_MAX_CLIENTS)
+, _nextClient(0)
+, _keepAlive(true)
+, _keepAliveTimeout(HTTP_KEEPALIVE_TIMEOUT)
+, _keepAliveMax(HTTP_KEEPALIVE_MAX_REQUESTS)
+, _requestCount(0)
+, _requestKeepAlive(false)
+, _responseKeepAlive(false)
+, _parseTime(0)
+, _sendTime(0)
+, _services(nullptr)
 , _currentHandler(nullptr)
 , _firstHandler(nullptr)
 , _lastHandler(nullptr)
-, _currentArgCount(0)
-, _currentArgs(nullptr)
-, _postArgsLen(0)
-, _postArgs(nullptr)
+, _routes()
+, _dynamicRoutes(nullptr)
+, _lastDynamicRoute(nullptr)
+, _routeCount(0)
 , _headerKeysCount(0)
 , _currentHeaders(nullptr)
 , _contentLength(0)
 , _chunked(false)
+, _authHA1()
+, _authTokens()
 {
 }
 
@@ -65,27 +78,58 @@ WebServer::WebServer(int port)
 , _server(port)
 , _currentMethod(HTTP_ANY)
 , _currentVersion(0)
-, _currentStatus(HC_NONE)
-, _statusChange(0)
 , _nullDelay(true)
+, _maxClients(WEBSERVER_MAX_CLIENTS)
+, _nextClient(0)
+, _keepAlive(true)
+, _keepAliveTimeout(HTTP_KEEPALIVE_TIMEOUT)
+, _keepAliveMax(HTTP_KEEPALIVE_MAX_REQUESTS)
+, _requestCount(0)
+, _requestKeepAlive(false)
+, _responseKeepAlive(false)
+, _parseTime(0)
+, _sendTime(0)
+, _services(nullptr)
 , _currentHandler(nullptr)
 , _firstHandler(nullptr)
 , _lastHandler(nullptr)
-, _currentArgCount(0)
-, _currentArgs(nullptr)
-, _postArgsLen(0)
-, _postArgs(nullptr)
+, _routes()
+, _dynamicRoutes(nullptr)
+, _lastDynamicRoute(nullptr)
+, _routeCount(0)
 , _headerKeysCount(0)
 , _currentHeaders(nullptr)
 , _contentLength(0)
 , _chunked(false)
+, _authHA1()
+, _authTokens()
 {
 }
 
 WebServer::~WebServer() {
+  loopUnwatchFd(_server.fd());
   _server.close();
+  WebServerService* service = _services;
+  while (service) {
+    WebServerService* next = service->_nextService;
+    if (service->_ownedByServer)
+      delete service;
+    service = next;
+  }
+  for (uint8_t i = 0; i < WEBSERVER_MAX_CLIENTS; i++) {
+    _resetSlot(_clients[i]);
+    free(_clients[i].head);
+  }
   if (_currentHeaders)
     delete[]_currentHeaders;
+  for (int i = 0; i <= WEBSERVER_ROUTE_BUCKETS; i++) {
+    RouteEntry* route = i < WEBSERVER_ROUTE_BUCKETS ? _routes[i] : _dynamicRoutes;
+    while (route) {
+      RouteEntry* next = route->next;
+      delete route;
+      route = next;
+    }
+  }
   RequestHandler* handler = _firstHandler;
   while (handler) {
     RequestHandler* next = handler->next();
@@ -96,14 +140,18 @@ WebServer::~WebServer() {
 
 void WebServer::begin() {
   close();
+  _server.setBacklog(_maxClients);
   _server.begin();
   _server.setNoDelay(true);
+  loopWatchFd(_server.fd());
 }
 
 void WebServer::begin(uint16_t port) {
   close();
+  _server.setBacklog(_maxClients);
   _server.begin(port);
   _server.setNoDelay(true);
+  loopWatchFd(_server.fd());
 }
 
 String WebServer::_extractParam(String& authReq,const String& param,const char delimit){
@@ -113,114 +161,208 @@ String WebServer::_extractParam(String& authReq,const String& param,const char d
   return authReq.substring(_begin+param.length(),authReq.indexOf(delimit,_begin+param.length()));
 }
 
-static String md5str(String &in){
-  char out[33] = {0};
-  mbedtls_md5_context _ctx;
-  uint8_t i;
-  uint8_t * _buf = (uint8_t*)malloc(16);
-  if(_buf == NULL)
-    return String(out);
-  memset(_buf, 0x00, 16);
-  mbedtls_md5_init(&_ctx);
-  mbedtls_md5_starts(&_ctx);
-  mbedtls_md5_update(&_ctx, (const uint8_t *)in.c_str(), in.length());
-  mbedtls_md5_finish(&_ctx, _buf);
-  for(i = 0; i < 16; i++) {
-    sprintf(out + (i * 2), "%02x", _buf[i]);
-  }
-  out[32] = 0;
-  free(_buf);
-  return String(out);
+// the parts hashed as one string, as lowercase hex
+static void md5hex(char* out, std::initializer_list<StringView> parts){
+  uint8_t digest[16];
+  mbedtls_md5_context ctx;
+  mbedtls_md5_init(&ctx);
+  mbedtls_md5_starts_ret(&ctx);
+  for (const StringView& part : parts)
+    mbedtls_md5_update_ret(&ctx, (const uint8_t *)part.data(), part.length());
+  mbedtls_md5_finish_ret(&ctx, digest);
+  mbedtls_md5_free(&ctx);
+  for (int i = 0; i < 16; i++)
+    sprintf(out + (i * 2), "%02x", digest[i]);
 }
 
-bool WebServer::authenticate(const char * username, const char * password){
-  if(hasHeader(FPSTR(AUTHORIZATION_HEADER))) {
-    String authReq = header(FPSTR(AUTHORIZATION_HEADER));
-    if(authReq.startsWith(F("Basic"))){
-      authReq = authReq.substring(6);
-      authReq.trim();
-      char toencodeLen = strlen(username)+strlen(password)+1;
-      char *toencode = new char[toencodeLen + 1];
-      if(toencode == NULL){
-        authReq = "";
-        return false;
-      }
-      char *encoded = new char[base64_encode_expected_len(toencodeLen)+1];
-      if(encoded == NULL){
-        authReq = "";
-        delete[] toencode;
-        return false;
-      }
-      sprintf(toencode, "%s:%s", username, password);
-      if(base64_encode_chars(toencode, toencodeLen, encoded) > 0 && authReq.equalsConstantTime(encoded)) {
-        authReq = "";
-        delete[] toencode;
-        delete[] encoded;
-        return true;
-      }
-      delete[] toencode;
-      delete[] encoded;
-    } else if(authReq.startsWith(F("Digest"))) {
-      authReq = authReq.substring(7);
-      log_v("%s", authReq.c_str());
-      String _username = _extractParam(authReq,F("username=\""),'\"');
-      if(!_username.length() || _username != String(username)) {
-        authReq = "";
-        return false;
-      }
-      // extracting required parameters for RFC 2069 simpler Digest
-      String _realm    = _extractParam(authReq, F("realm=\""),'\"');
-      String _nonce    = _extractParam(authReq, F("nonce=\""),'\"');
-      String _uri      = _extractParam(authReq, F("uri=\""),'\"');
-      String _response = _extractParam(authReq, F("response=\""),'\"');
-      String _opaque   = _extractParam(authReq, F("opaque=\""),'\"');
-
-      if((!_realm.length()) || (!_nonce.length()) || (!_uri.length()) || (!_response.length()) || (!_opaque.length())) {
-        authReq = "";
-        return false;
-      }
-      if((_opaque != _sopaque) || (_nonce != _snonce) || (_realm != _srealm)) {
-        authReq = "";
-        return false;
-      }
-      // parameters for the RFC 2617 newer Digest
-      String _nc,_cnonce;
-      if(authReq.indexOf(FPSTR(qop_auth)) != -1) {
-        _nc = _extractParam(authReq, F("nc="), ',');
-        _cnonce = _extractParam(authReq, F("cnonce=\""),'\"');
-      }
-      String _H1 = md5str(String(username) + ':' + _realm + ':' + String(password));
-      log_v("Hash of user:realm:pass=%s", _H1.c_str());
-      String _H2 = "";
-      if(_currentMethod == HTTP_GET){
-          _H2 = md5str(String(F("GET:")) + _uri);
-      }else if(_currentMethod == HTTP_POST){
-          _H2 = md5str(String(F("POST:")) + _uri);
-      }else if(_currentMethod == HTTP_PUT){
-          _H2 = md5str(String(F("PUT:")) + _uri);
-      }else if(_currentMethod == HTTP_DELETE){
-          _H2 = md5str(String(F("DELETE:")) + _uri);
-      }else{
-          _H2 = md5str(String(F("GET:")) + _uri);
-      }
-      log_v("Hash of GET:uri=%s", _H2.c_str());
-      String _responsecheck = "";
-      if(authReq.indexOf(FPSTR(qop_auth)) != -1) {
-          _responsecheck = md5str(_H1 + ':' + _nonce + ':' + _nc + ':' + _cnonce + F(":auth:") + _H2);
+static bool equalsConstantTime(StringView a, StringView b){
+  if (a.length() != b.length())
+    return false;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < a.length(); i++)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+// the value of name in a Digest header, quoted or not, pointing into it
+static StringView authParam(StringView req, const char* name){
+  size_t nameLen = strlen(name);
+  size_t len = req.length();
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && (req[i] == ' ' || req[i] == ','))
+      i++;
+    size_t keyStart = i;
+    while (i < len && req[i] != '=' && req[i] != ',')
+      i++;
+    StringView key = req.substring(keyStart, i).trim();
+    StringView value;
+    if (i < len && req[i] == '=') {
+      i++;
+      while (i < len && req[i] == ' ')
+        i++;
+      if (i < len && req[i] == '"') {
+        size_t valueStart = ++i;
+        while (i < len && req[i] != '"')
+          i += (req[i] == '\\' && i + 1 < len) ? 2 : 1;
+        value = req.substring(valueStart, i);
+        if (i < len)
+          i++;
       } else {
-          _responsecheck = md5str(_H1 + ':' + _nonce + ':' + _H2);
+        size_t valueStart = i;
+        while (i < len && req[i] != ',')
+          i++;
+        value = req.substring(valueStart, i).trim();
       }
-      log_v("The Proper response=%s", _responsecheck.c_str());
-      if(_response == _responsecheck){
-        authReq = "";
-        return true;
+    }
+    if (key.length() == nameLen && !strncasecmp(key.data(), name, nameLen))
+      return value;
+  }
+  return StringView();
+}
+
+StringView WebServer::_headerValue(int i){
+  if (i < 0 || !_currentHeaders || i >= _headerKeysCount + BUILTIN_HEADER_COUNT || !_currentHeaders[i].valueLen)
+    return StringView();
+  return StringView(_arena.at(_currentHeaders[i].value), _currentHeaders[i].valueLen);
+}
+
+void WebServer::_authCache(const char * username, const char * password){
+  if (_authUser == username && _authPass == password && _authBasic.length())
+    return;
+  _authUser = username;
+  _authPass = password;
+  _authBasic = "";
+  _authHA1Realm = "";
+  String credentials = _authUser + ':' + _authPass;
+  char *encoded = new (std::nothrow) char[base64_encode_expected_len(credentials.length()) + 1];
+  if (encoded == NULL)
+    return;
+  if (base64_encode_chars(credentials.c_str(), credentials.length(), encoded) > 0)
+    _authBasic = encoded;
+  delete[] encoded;
+}
+
+bool WebServer::authenticate(const char * username, const char * password){
+  if (!username || !password)
+    return false;
+  // Authorization is always collected, first
+  StringView authReq = _headerValue(0);
+  if (authReq.startsWith("Basic")) {
+    _authCache(username, password);
+    return _authBasic.length() && equalsConstantTime(authReq.substring(6).trim(), _authBasic);
+  } else if (authReq.startsWith("Digest")) {
+    StringView req = authReq.substring(7);
+    StringView _username = authParam(req, "username");
+    if (!_username.length() || _username != StringView(username))
+      return false;
+    // extracting required parameters for RFC 2069 simpler Digest
+    StringView _realm    = authParam(req, "realm");
+    StringView _nonce    = authParam(req, "nonce");
+    StringView _uri      = authParam(req, "uri");
+    StringView _response = authParam(req, "response");
+    StringView _opaque   = authParam(req, "opaque");
+    if (!_realm.length() || !_nonce.length() || !_uri.length() || !_response.length() || !_opaque.length())
+      return false;
+    if (_opaque != _sopaque || _nonce != _snonce || _realm != _srealm)
+      return false;
+    _authCache(username, password);
+    if (_authHA1Realm != _srealm) {
+      md5hex(_authHA1, { username, ":", _srealm, ":", password });
+      _authHA1Realm = _srealm;
+    }
+    const char* method = "GET";
+    if (_currentMethod == HTTP_POST)
+      method = "POST";
+    else if (_currentMethod == HTTP_PUT)
+      method = "PUT";
+    else if (_currentMethod == HTTP_DELETE)
+      method = "DELETE";
+    char _H2[33];
+    md5hex(_H2, { method, ":", _uri });
+    char _responsecheck[33];
+    // parameters for the RFC 2617 newer Digest
+    if (authParam(req, "qop") == "auth")
+      md5hex(_responsecheck, { _authHA1, ":", _nonce, ":", authParam(req, "nc"), ":", authParam(req, "cnonce"), ":auth:", _H2 });
+    else
+      md5hex(_responsecheck, { _authHA1, ":", _nonce, ":", _H2 });
+    log_v("The Proper response=%s", _responsecheck);
+    return equalsConstantTime(_response, _responsecheck);
+  }
+  return false;
+}
+
+String WebServer::createAuthToken(uint32_t lifetime){
+  uint32_t now = millis();
+  AuthToken* slot = &_authTokens[0];
+  for (int i = 0; i < WEBSERVER_AUTH_TOKENS; i++) {
+    AuthToken& t = _authTokens[i];
+    if (!t.token[0] || (t.lifetime && now - t.created >= t.lifetime)) {
+      slot = &t;
+      break;
+    }
+    if (now - t.created > now - slot->created)
+      slot = &t;
+  }
+  String token = _getRandomHexString();
+  memcpy(slot->token, token.c_str(), sizeof(slot->token));
+  slot->created = now;
+  slot->lifetime = (lifetime > UINT32_MAX / 1000) ? UINT32_MAX : lifetime * 1000;
+  return token;
+}
+
+bool WebServer::authenticateToken(){
+  StringView token;
+  StringView authReq = _headerValue(0);
+  if (authReq.startsWith("Bearer ")) {
+    token = authReq.substring(7).trim();
+  } else {
+    StringView cookies = _headerValue(_headerKeysCount + BUILTIN_HEADER_COOKIE);
+    StringView cookie;
+    while (cookies.length()) {
+      cookies.split(';', cookie, cookies);
+      cookie = cookie.trim();
+      if (cookie.startsWith(WEBSERVER_AUTH_COOKIE "=")) {
+        token = cookie.substring(sizeof(WEBSERVER_AUTH_COOKIE));
+        break;
       }
     }
-    authReq = "";
+  }
+  if (token.length() != 32)
+    return false;
+  uint32_t now = millis();
+  for (int i = 0; i < WEBSERVER_AUTH_TOKENS; i++) {
+    AuthToken& t = _authTokens[i];
+    if (!t.token[0])
+      continue;
+    if (t.lifetime && now - t.created >= t.lifetime) {
+      t.token[0] = 0;
+      continue;
+    }
+    if (equalsConstantTime(token, t.token))
+      return true;
   }
   return false;
 }
 
+void WebServer::revokeAuthToken(const String& token){
+  for (int i = 0; i < WEBSERVER_AUTH_TOKENS; i++) {
+    if (!token.length() || token == _authTokens[i].token)
+      _authTokens[i].token[0] = 0;
+  }
+}
+
+void WebServer::setAuthCookie(const String& token, uint32_t maxAge){
+  String cookie = F(WEBSERVER_AUTH_COOKIE "=");
+  cookie += token;
+  cookie += F("; Path=/; HttpOnly; SameSite=Strict");
+  if (!token.length() || maxAge) {
+    cookie += F("; Max-Age=");
+    cookie += token.length() ? maxAge : 0;
+  }
+  sendHeader(F("Set-Cookie"), cookie);
+}
+
 String WebServer::_getRandomHexString() {
   char buffer[33];  // buffer to hold 32 Hex Digit + /0
   int i;
@@ -263,6 +405,12 @@ void WebServer::addHandler(RequestHandler* handler) {
     _addRequestHandler(handler);
 }
 
+EventSource& WebServer::onEvents(const Uri &uri) {
+    EventSource* events = new EventSource(*this, uri);
+    events->_ownedByServer = true;
+    return *events;
+}
+
 void WebServer::_addRequestHandler(RequestHandler* handler) {
     if (!_lastHandler) {
       _firstHandler = handler;
@@ -272,6 +420,53 @@ void WebServer::_addRequestHandler(RequestHandler* handler) {
       _lastHandler->next(handler);
       _lastHandler = handler;
     }
+
+    RouteEntry* route = new RouteEntry;
+    route->handler = handler;
+    route->method = HTTP_ANY;
+    route->uri = handler->exactUri(route->method);
+    route->hash = route->uri ? _hashUri(*route->uri) : 0;
+    route->order = _routeCount++;
+    route->next = nullptr;
+    if (route->uri) {
+      // order within a bucket is kept, the first match is the oldest handler
+      RouteEntry** tail = &_routes[route->hash % WEBSERVER_ROUTE_BUCKETS];
+      while (*tail) tail = &(*tail)->next;
+      *tail = route;
+    } else if (_lastDynamicRoute) {
+      _lastDynamicRoute->next = route;
+      _lastDynamicRoute = route;
+    } else {
+      _dynamicRoutes = _lastDynamicRoute = route;
+    }
+}
+
+RequestHandler* WebServer::_findRequestHandler(HTTPMethod method, const String& uri) {
+  // the first match in registration order wins, as with a plain walk of the list:
+  // take the oldest literal match, then ask only the dynamic handlers added before it
+  uint32_t hash = _hashUri(uri);
+  RouteEntry* found = nullptr;
+  for (RouteEntry* route = _routes[hash % WEBSERVER_ROUTE_BUCKETS]; route; route = route->next) {
+    if (route->hash == hash && (route->method == HTTP_ANY || route->method == method) && *route->uri == uri) {
+      found = route;
+      break;
+    }
+  }
+  for (RouteEntry* route = _dynamicRoutes; route && (!found || route->order < found->order); route = route->next) {
+    if (route->handler->canHandle(method, uri)) {
+      return route->handler;
+    }
+  }
+  return found ? found->handler : nullptr;
+}
+
+uint32_t WebServer::_hashUri(const String& uri) {
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  for (const char* p = uri.c_str(); *p; p++) {
+    hash = (hash ^ (uint8_t)*p) * 16777619UL;
+  }
+  return hash;
 }
 
 void WebServer::serveStatic(const char* uri, FS& fs, const char* path, const char* cache_header) {
@@ -279,57 +474,101 @@ void WebServer::serveStatic(const char* uri, FS& fs, const char* path, const cha
 }
 
 void WebServer::handleClient() {
-  if (_currentStatus == HC_NONE) {
+  // accept pending connections while there are free slots, the rest wait in the backlog
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    HTTPClientSlot& slot = _clients[i];
+    if (slot.status != HC_NONE) {
+      continue;
+    }
     WiFiClient client = _server.available();
     if (!client) {
-      if (_nullDelay) {
-        delay(1);
-      }
-      return;
+      break;
+    }
+    log_v("New client in slot %u", i);
+    slot.client = client;
+    slot.status = HC_WAIT_READ;
+    slot.statusChange = millis();
+    if (_metrics) {
+      _metrics->connections++;
+    }
+  }
+
+  bool active = false;
+  bool callYield = false;
+  for (uint8_t n = 0; n < _maxClients; n++) {
+    HTTPClientSlot& slot = _clients[(_nextClient + n) % _maxClients];
+    if (slot.status == HC_NONE) {
+      continue;
     }
+    active = true;
+    callYield |= _serviceClient(slot);
+    _watchSlot(slot);
+  }
+  // start with the next slot on the following call so no connection is always last
+  _nextClient = (_nextClient + 1) % _maxClients;
 
-    log_v("New client");
+  for (WebServerService* service = _services; service; service = service->_nextService) {
+    active |= service->_poll();
+  }
 
-    _currentClient = client;
-    _currentStatus = HC_WAIT_READ;
-    _statusChange = millis();
+  if (!active && _nullDelay) {
+    delay(1);
+  } else if (callYield) {
+    yield();
   }
+}
 
+bool WebServer::_serviceClient(HTTPClientSlot& slot) {
   bool keepCurrentClient = false;
   bool callYield = false;
 
+  _currentClient = slot.client;
   if (_currentClient.connected()) {
-    switch (_currentStatus) {
+    switch (slot.status) {
     case HC_NONE:
       // No-op to avoid C++ compiler warning
       break;
-    case HC_WAIT_READ:
-      // Wait for data from client to become available
-      if (_currentClient.available()) {
-        if (_parseRequest(_currentClient)) {
+    case HC_WAIT_READ: {
+      // Collect the request head as it arrives, a slow client does not hold up the others
+      int head = _currentClient.available() ? _readRequestHead(_currentClient, slot) : 0;
+      if (head > 0) {
+        slot.headLen = 0;
+        slot.headLineEmpty = false;
+        _requestCount = slot.requests + 1;
+        _responseKeepAlive = false;
+        _sendTime = 0;
+        uint32_t start = micros();
+        if (_parseRequest(_currentClient, slot.head)) {
           // because HTTP_MAX_SEND_WAIT is expressed in milliseconds,
           // it must be divided by 1000
           _currentClient.setTimeout(HTTP_MAX_SEND_WAIT / 1000);
           _contentLength = CONTENT_LENGTH_NOT_SET;
           _handleRequest();
-
-// Fix for issue with Chrome based browsers: https://github.com/espressif/arduino-esp32/issues/3652
-//           if (_currentClient.connected()) {
-//             _currentStatus = HC_WAIT_CLOSE;
-//             _statusChange = millis();
-//             keepCurrentClient = true;
-//           }
+          _countRequest(start);
+
+          if (_responseKeepAlive && _currentClient.connected()) {
+            // wait for the next request, a pipelined one is already buffered;
+            // available() also pushes out what is left in the client's TX buffer
+            slot.requests = _requestCount;
+            slot.status = HC_WAIT_READ;
+            slot.statusChange = millis();
+            keepCurrentClient = true;
+            callYield = !_currentClient.available();
+          }
         }
-      } else { // !_currentClient.available()
-        if (millis() - _statusChange <= HTTP_MAX_DATA_WAIT) {
+      } else if (head == 0) {
+        // a fresh connection or a started head gets HTTP_MAX_DATA_WAIT, an idle persistent one the keep-alive timeout
+        uint32_t wait = (slot.requests && !slot.headLen) ? _keepAliveTimeout : HTTP_MAX_DATA_WAIT;
+        if (millis() - slot.statusChange <= wait) {
           keepCurrentClient = true;
         }
         callYield = true;
       }
       break;
+    }
     case HC_WAIT_CLOSE:
       // Wait for client to close the connection
-      if (millis() - _statusChange <= HTTP_MAX_CLOSE_WAIT) {
+      if (millis() - slot.statusChange <= HTTP_MAX_CLOSE_WAIT) {
         keepCurrentClient = true;
         callYield = true;
       }
@@ -337,19 +576,65 @@ void WebServer::handleClient() {
   }
 
   if (!keepCurrentClient) {
-    _currentClient = WiFiClient();
-    _currentStatus = HC_NONE;
+    _resetSlot(slot);
     _currentUpload.reset();
   }
+  _currentClient = WiFiClient();
+  return callYield;
+}
 
-  if (callYield) {
-    yield();
+void WebServer::_addService(WebServerService* service) {
+  service->_nextService = _services;
+  _services = service;
+}
+
+void WebServer::_removeService(WebServerService* service) {
+  for (WebServerService** p = &_services; *p; p = &(*p)->_nextService) {
+    if (*p == service) {
+      *p = service->_nextService;
+      return;
+    }
+  }
+}
+
+void WebServer::_resetSlot(HTTPClientSlot& slot) {
+  // the head buffer is kept for the next connection in this slot
+  if (slot.watchedFd >= 0) {
+    loopUnwatchFd(slot.watchedFd);
+    slot.watchedFd = -1;
+  }
+  slot.client = WiFiClient();
+  slot.status = HC_NONE;
+  slot.statusChange = 0;
+  slot.requests = 0;
+  slot.headLen = 0;
+  slot.headLineEmpty = false;
+}
+
+// keep loopWaitForEvent() watching the socket of an open connection
+void WebServer::_watchSlot(HTTPClientSlot& slot) {
+  if (slot.status == HC_NONE) {
+    return;
+  }
+  int fd = slot.client.fd();
+  if (fd != slot.watchedFd) {
+    if (slot.watchedFd >= 0) {
+      loopUnwatchFd(slot.watchedFd);
+    }
+    slot.watchedFd = loopWatchFd(fd) ? fd : -1;
+  }
+  // a pipelined request already in the client's buffer does not make the socket readable
+  if (slot.status == HC_WAIT_READ && slot.client.available()) {
+    loopSignalEvent();
   }
 }
 
 void WebServer::close() {
+  loopUnwatchFd(_server.fd());
   _server.close();
-  _currentStatus = HC_NONE;
+  for (uint8_t i = 0; i < WEBSERVER_MAX_CLIENTS; i++) {
+    _resetSlot(_clients[i]);
+  }
   if(!_headerKeysCount)
     collectHeaders(0, 0);
 }
@@ -376,6 +661,30 @@ void WebServer::setContentLength(const size_t contentLength) {
     _contentLength = contentLength;
 }
 
+void WebServer::setMaxClients(uint8_t count) {
+  if (count < 1) {
+    count = 1;
+  } else if (count > WEBSERVER_MAX_CLIENTS) {
+    log_w("max clients %u exceeds WEBSERVER_MAX_CLIENTS %u", count, WEBSERVER_MAX_CLIENTS);
+    count = WEBSERVER_MAX_CLIENTS;
+  }
+  // connections in slots that are dropped are closed
+  for (uint8_t i = count; i < _maxClients; i++) {
+    _resetSlot(_clients[i]);
+  }
+  _maxClients = count;
+  _nextClient = 0;
+}
+
+void WebServer::enableKeepAlive(boolean value) {
+  _keepAlive = value;
+}
+
+void WebServer::setKeepAlive(uint32_t timeout, uint16_t maxRequests) {
+  _keepAliveTimeout = timeout;
+  _keepAliveMax = maxRequests ? maxRequests : 1;
+}
+
 void WebServer::enableDelay(boolean value) {
   _nullDelay = value;
 }
@@ -388,7 +697,142 @@ void WebServer::enableCrossOrigin(boolean value) {
   enableCORS(value);
 }
 
+// upper bounds of the request duration histogram, us
+static const uint32_t metricsBounds[WEBSERVER_METRICS_BUCKETS] = {
+  1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 1000000, 5000000
+};
+
+void WebServer::enableMetrics(const char* uri) {
+  if (_metrics) {
+    return;
+  }
+  _metrics.reset(new (std::nothrow) WebServerMetrics());
+  if (!_metrics) {
+    log_e("no memory for the metrics");
+    return;
+  }
+  if (uri) {
+    on(uri, HTTP_GET, [this]() { _sendMetrics(); });
+  }
+}
+
+void WebServer::resetMetrics() {
+  if (_metrics) {
+    memset(_metrics.get(), 0, sizeof(WebServerMetrics));
+  }
+}
+
+uint8_t WebServer::activeClients() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < WEBSERVER_MAX_CLIENTS; i++) {
+    if (_clients[i].status != HC_NONE) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void WebServer::_countRequest(uint32_t start) {
+  if (!_metrics) {
+    return;
+  }
+  WebServerMetrics& m = *_metrics;
+  uint32_t total = micros() - start;
+  uint32_t handler = total - _parseTime;
+  handler = handler > _sendTime ? handler - _sendTime : 0;
+  m.requests++;
+  m.parseUs += _parseTime;
+  m.handlerUs += handler;
+  m.sendUs += _sendTime;
+  m.totalUs += total;
+  m.parseMaxUs = max(m.parseMaxUs, _parseTime);
+  m.handlerMaxUs = max(m.handlerMaxUs, handler);
+  m.sendMaxUs = max(m.sendMaxUs, _sendTime);
+  m.totalMaxUs = max(m.totalMaxUs, total);
+  uint8_t bucket = 0;
+  while (bucket < WEBSERVER_METRICS_BUCKETS && total > metricsBounds[bucket]) {
+    bucket++;
+  }
+  m.buckets[bucket]++;
+}
+
+void WebServer::_sendMetrics() {
+  const WebServerMetrics& m = *_metrics;
+  char line[96];
+  String out;
+  out.reserve(2048);
+  out += F("# TYPE webserver_requests_total counter\n");
+  snprintf(line, sizeof(line), "webserver_requests_total %u\n", m.requests);
+  out += line;
+  out += F("# TYPE webserver_responses_total counter\n");
+  for (int i = 0; i < 5; i++) {
+    snprintf(line, sizeof(line), "webserver_responses_total{code=\"%dxx\"} %u\n", i + 1, m.responses[i]);
+    out += line;
+  }
+  out += F("# TYPE webserver_not_found_total counter\n");
+  snprintf(line, sizeof(line), "webserver_not_found_total %u\n", m.notFound);
+  out += line;
+  out += F("# TYPE webserver_connections_total counter\n");
+  snprintf(line, sizeof(line), "webserver_connections_total %u\n", m.connections);
+  out += line;
+  out += F("# TYPE webserver_active_connections gauge\n");
+  snprintf(line, sizeof(line), "webserver_active_connections %u\n", activeClients());
+  out += line;
+  out += F("# TYPE webserver_sent_bytes_total counter\n");
+  snprintf(line, sizeof(line), "webserver_sent_bytes_total %llu\n", m.bytesSent);
+  out += line;
+
+  const char* phases[] = { "parse", "handler", "send" };
+  const uint64_t sums[] = { m.parseUs, m.handlerUs, m.sendUs };
+  const uint32_t maxima[] = { m.parseMaxUs, m.handlerMaxUs, m.sendMaxUs };
+  out += F("# TYPE webserver_phase_seconds_total counter\n");
+  for (int i = 0; i < 3; i++) {
+    snprintf(line, sizeof(line), "webserver_phase_seconds_total{phase=\"%s\"} %.6f\n", phases[i], sums[i] / 1e6);
+    out += line;
+  }
+  out += F("# TYPE webserver_phase_seconds_max gauge\n");
+  for (int i = 0; i < 3; i++) {
+    snprintf(line, sizeof(line), "webserver_phase_seconds_max{phase=\"%s\"} %.6f\n", phases[i], maxima[i] / 1e6);
+    out += line;
+  }
+
+  // the buckets of Prometheus count everything up to their bound
+  out += F("# TYPE webserver_request_duration_seconds histogram\n");
+  uint32_t count = 0;
+  for (int i = 0; i < WEBSERVER_METRICS_BUCKETS; i++) {
+    count += m.buckets[i];
+    snprintf(line, sizeof(line), "webserver_request_duration_seconds_bucket{le=\"%g\"} %u\n", metricsBounds[i] / 1e6, count);
+    out += line;
+  }
+  count += m.buckets[WEBSERVER_METRICS_BUCKETS];
+  snprintf(line, sizeof(line), "webserver_request_duration_seconds_bucket{le=\"+Inf\"} %u\n", count);
+  out += line;
+  snprintf(line, sizeof(line), "webserver_request_duration_seconds_sum %.6f\n", m.totalUs / 1e6);
+  out += line;
+  snprintf(line, sizeof(line), "webserver_request_duration_seconds_count %u\n", count);
+  out += line;
+  out += F("# TYPE webserver_request_seconds_max gauge\n");
+  snprintf(line, sizeof(line), "webserver_request_seconds_max %.6f\n", m.totalMaxUs / 1e6);
+  out += line;
+
+  out += F("# TYPE esp_heap_free_bytes gauge\n");
+  snprintf(line, sizeof(line), "esp_heap_free_bytes %u\n", ESP.getFreeHeap());
+  out += line;
+  out += F("# TYPE esp_heap_min_free_bytes gauge\n");
+  snprintf(line, sizeof(line), "esp_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+  out += line;
+  send(200, "text/plain; version=0.0.4", out);
+}
+
 void WebServer::_prepareHeader(String& response, int code, const char* content_type, size_t contentLength) {
+    if (_metrics) {
+      if (code >= 100 && code < 600) {
+        _metrics->responses[code / 100 - 1]++;
+      }
+      if (code == 404) {
+        _metrics->notFound++;
+      }
+    }
     response = String(F("HTTP/1.")) + String(_currentVersion) + ' ';
     response += String(code);
     response += ' ';
@@ -415,7 +859,19 @@ void WebServer::_prepareHeader(String& response, int code, const char* content_t
 	sendHeader(String(FPSTR("Access-Control-Allow-Methods")), String("*"));
 	sendHeader(String(FPSTR("Access-Control-Allow-Headers")), String("*"));
     }
-    sendHeader(String(F("Connection")), String(F("close")));
+    // keep the connection only if the client asked for it, the body is framed and
+    // the handler did not set its own Connection header
+    bool framed = _contentLength != CONTENT_LENGTH_UNKNOWN || _chunked;
+    bool userConnection = _responseHeaders.indexOf("Connection:") >= 0;
+    _responseKeepAlive = _keepAlive && _requestKeepAlive && framed && !userConnection
+                         && _requestCount < _keepAliveMax;
+    if (_responseKeepAlive) {
+      sendHeader(String(F("Connection")), String(F("keep-alive")));
+      sendHeader(String(F("Keep-Alive")), String(F("timeout=")) + String(_keepAliveTimeout / 1000)
+                 + String(F(", max=")) + String(_keepAliveMax - _requestCount));
+    } else if (!userConnection) {
+      sendHeader(String(F("Connection")), String(F("close")));
+    }
 
     response += _responseHeaders;
     response += "\r\n";
@@ -428,7 +884,7 @@ void WebServer::send(int code, const char* content_type, const String& content)
     //if(code == 200 && content.length() == 0 && _contentLength == CONTENT_LENGTH_NOT_SET)
     //  _contentLength = CONTENT_LENGTH_UNKNOWN;
     _prepareHeader(header, code, content_type, content.length());
-    _currentClientWrite(header.c_str(), header.length());
+    _write(header.c_str(), header.length());
     if(content.length())
       sendContent(content);
 }
@@ -444,7 +900,7 @@ void WebServer::send_P(int code, PGM_P content_type, PGM_P content) {
     char type[64];
     memccpy_P((void*)type, (PGM_VOID_P)content_type, 0, sizeof(type));
     _prepareHeader(header, code, (const char* )type, contentLength);
-    _currentClientWrite(header.c_str(), header.length());
+    _write(header.c_str(), header.length());
     sendContent_P(content);
 }
 
@@ -465,26 +921,53 @@ void WebServer::send(int code, const String& content_type, const String& content
   send(code, (const char*)content_type.c_str(), content);
 }
 
+size_t WebServer::_write(const char* b, size_t l) {
+  if (!_metrics) {
+    return _currentClientWrite(b, l);
+  }
+  uint32_t start = micros();
+  size_t sent = _currentClientWrite(b, l);
+  _countSent(sent, start);
+  return sent;
+}
+
+size_t WebServer::_write_P(PGM_P b, size_t l) {
+  if (!_metrics) {
+    return _currentClientWrite_P(b, l);
+  }
+  uint32_t start = micros();
+  size_t sent = _currentClientWrite_P(b, l);
+  _countSent(sent, start);
+  return sent;
+}
+
 void WebServer::sendContent(const String& content) {
   sendContent(content.c_str(), content.length());
 }
 
 void WebServer::sendContent(const char* content, size_t contentLength) {
-  const char * footer = "\r\n";
   if(_chunked) {
-    char * chunkSize = (char *)malloc(11);
-    if(chunkSize){
-      sprintf(chunkSize, "%x%s", contentLength, footer);
-      _currentClientWrite(chunkSize, strlen(chunkSize));
-      free(chunkSize);
-    }
+    _sendChunk(content, contentLength);
+    return;
   }
-  _currentClientWrite(content, contentLength);
-  if(_chunked){
-    _currentClient.write(footer, 2);
-    if (contentLength == 0) {
-      _chunked = false;
-    }
+  _write(content, contentLength);
+}
+
+void WebServer::_sendChunk(const char* content, size_t contentLength) {
+  // size line, data and CRLF in one write when the chunk is small
+  char small[HTTP_SMALL_CHUNK_SIZE + 16];
+  int head = sprintf(small, "%x\r\n", (unsigned) contentLength);
+  if (contentLength <= HTTP_SMALL_CHUNK_SIZE) {
+    memcpy(small + head, content, contentLength);
+    memcpy(small + head + contentLength, "\r\n", 2);
+    _write(small, head + contentLength + 2);
+  } else {
+    _write(small, head);
+    _write(content, contentLength);
+    _write("\r\n", 2);
+  }
+  if (contentLength == 0) {
+    _chunked = false;
   }
 }
 
@@ -493,22 +976,12 @@ void WebServer::sendContent_P(PGM_P content) {
 }
 
 void WebServer::sendContent_P(PGM_P content, size_t size) {
-  const char * footer = "\r\n";
   if(_chunked) {
-    char * chunkSize = (char *)malloc(11);
-    if(chunkSize){
-      sprintf(chunkSize, "%x%s", size, footer);
-      _currentClientWrite(chunkSize, strlen(chunkSize));
-      free(chunkSize);
-    }
-  }
-  _currentClientWrite_P(content, size);
-  if(_chunked){
-    _currentClient.write(footer, 2);
-    if (size == 0) {
-      _chunked = false;
-    }
+    // flash is memory mapped, a chunk can be built from it directly
+    _sendChunk(content, size);
+    return;
   }
+  _write_P(content, size);
 }
 
 
@@ -531,73 +1004,95 @@ String WebServer::pathArg(unsigned int i) {
 }
 
 String WebServer::arg(String name) {
-  for (int j = 0; j < _postArgsLen; ++j) {
-	    if ( _postArgs[j].key == name )
-	      return _postArgs[j].value;
-	  }
-  for (int i = 0; i < _currentArgCount; ++i) {
-    if ( _currentArgs[i].key == name )
-      return _currentArgs[i].value;
-  }
-  return "";
+  return arg(StringView(name));
+}
+
+String WebServer::arg(StringView name) {
+  int i = _arena.find(name);
+  return i >= 0 ? String(_arena.value(i)) : String();
 }
 
 String WebServer::arg(int i) {
-  if (i < _currentArgCount)
-    return _currentArgs[i].value;
+  if (i >= 0 && i < _arena.count())
+    return _arena.value(i);
   return "";
 }
 
 String WebServer::argName(int i) {
-  if (i < _currentArgCount)
-    return _currentArgs[i].key;
+  if (i >= 0 && i < _arena.count())
+    return _arena.key(i);
   return "";
 }
 
 int WebServer::args() {
-  return _currentArgCount;
+  return _arena.count();
 }
 
 bool WebServer::hasArg(String  name) {
-  for (int j = 0; j < _postArgsLen; ++j) {
-	    if (_postArgs[j].key == name)
-	      return true;
-	  }
-  for (int i = 0; i < _currentArgCount; ++i) {
-    if (_currentArgs[i].key == name)
-      return true;
-  }
-  return false;
+  return hasArg(StringView(name));
+}
+
+bool WebServer::hasArg(StringView name) {
+  return _arena.find(name) >= 0;
 }
 
 
 String WebServer::header(String name) {
-  for (int i = 0; i < _headerKeysCount; ++i) {
-    if (_currentHeaders[i].key.equalsIgnoreCase(name))
-      return _currentHeaders[i].value;
+  return header(StringView(name));
+}
+
+String WebServer::header(StringView name) {
+  int i = _headerIndex(name);
+  if (i >= 0 && _currentHeaders[i].valueLen)
+    return _arena.at(_currentHeaders[i].value);
+  return String();
+}
+
+// kept for serveStatic(), WebSocketServer and EventSource even when they are not collected
+static const char* const BUILTIN_HEADER_NAMES[] = {
+  "If-None-Match", "Range", "Upgrade", "Sec-WebSocket-Key", "Sec-WebSocket-Version",
+  "Last-Event-ID", "Accept-Encoding", "Cookie"
+};
+
+int WebServer::_headerIndex(StringView name) {
+  if (!_currentHeaders)
+    return -1;
+  uint16_t hash = RequestArena::hashIgnoreCase(name.data(), name.length());
+  for (int i = 0; i < _headerKeysCount + BUILTIN_HEADER_COUNT; ++i) {
+    if (_currentHeaders[i].hash == hash && name.equalsIgnoreCase(_currentHeaders[i].key))
+      return i;
   }
-  return "";
+  return -1;
 }
 
 void WebServer::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
   _headerKeysCount = headerKeysCount + 1;
   if (_currentHeaders)
      delete[]_currentHeaders;
-  _currentHeaders = new RequestArgument[_headerKeysCount];
+  _currentHeaders = new RequestHeader[_headerKeysCount + BUILTIN_HEADER_COUNT];
   _currentHeaders[0].key = FPSTR(AUTHORIZATION_HEADER);
   for (int i = 1; i < _headerKeysCount; i++){
     _currentHeaders[i].key = headerKeys[i-1];
   }
+  for (int i = 0; i < BUILTIN_HEADER_COUNT; i++){
+    _currentHeaders[_headerKeysCount + i].key = BUILTIN_HEADER_NAMES[i];
+  }
+  for (int i = 0; i < _headerKeysCount + BUILTIN_HEADER_COUNT; i++){
+    RequestHeader& h = _currentHeaders[i];
+    h.hash = RequestArena::hashIgnoreCase(h.key.c_str(), h.key.length());
+    h.valueLen = 0;
+    h.value = 0;
+  }
 }
 
 String WebServer::header(int i) {
-  if (i < _headerKeysCount)
-    return _currentHeaders[i].value;
+  if (i >= 0 && i < _headerKeysCount && _currentHeaders[i].valueLen)
+    return _arena.at(_currentHeaders[i].value);
   return "";
 }
 
 String WebServer::headerName(int i) {
-  if (i < _headerKeysCount)
+  if (i >= 0 && i < _headerKeysCount)
     return _currentHeaders[i].key;
   return "";
 }
@@ -607,11 +1102,12 @@ int WebServer::headers() {
 }
 
 bool WebServer::hasHeader(String name) {
-  for (int i = 0; i < _headerKeysCount; ++i) {
-    if ((_currentHeaders[i].key.equalsIgnoreCase(name)) &&  (_currentHeaders[i].value.length() > 0))
-      return true;
-  }
-  return false;
+  return hasHeader(StringView(name));
+}
+
+bool WebServer::hasHeader(StringView name) {
+  int i = _headerIndex(name);
+  return i >= 0 && _currentHeaders[i].valueLen > 0;
 }
 
 String WebServer::hostHeader() {
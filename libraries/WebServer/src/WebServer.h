@@ -46,6 +46,40 @@ enum HTTPAuthMethod { BASIC_AUTH, DIGEST_AUTH };
 #define HTTP_MAX_SEND_WAIT 5000 //ms to wait for data chunk to be ACKed
 #define HTTP_MAX_CLOSE_WAIT 2000 //ms to wait for the client to close the connection
 
+#ifndef HTTP_KEEPALIVE_TIMEOUT
+#define HTTP_KEEPALIVE_TIMEOUT 5000 //ms an idle persistent connection is kept open
+#endif
+
+#ifndef HTTP_KEEPALIVE_MAX_REQUESTS
+#define HTTP_KEEPALIVE_MAX_REQUESTS 100 //requests served on one connection before it is closed
+#endif
+
+#ifndef HTTP_SMALL_CHUNK_SIZE
+#define HTTP_SMALL_CHUNK_SIZE 256 //chunks up to this size go out in a single write
+#endif
+
+#ifndef WEBSERVER_HEAD_BUFFER_SIZE
+#define WEBSERVER_HEAD_BUFFER_SIZE 1536 //request line and headers, per connection
+#endif
+
+#ifndef WEBSERVER_ROUTE_BUCKETS
+#define WEBSERVER_ROUTE_BUCKETS 32 //hash buckets for handlers with a literal URI
+#endif
+
+#ifndef WEBSERVER_MAX_CLIENTS
+#define WEBSERVER_MAX_CLIENTS 8 //connections held open and serviced round-robin
+#endif
+
+#ifndef WEBSERVER_AUTH_TOKENS
+#define WEBSERVER_AUTH_TOKENS 4 //tokens of createAuthToken() valid at once, a new one replaces the oldest
+#endif
+
+#ifndef WEBSERVER_AUTH_COOKIE
+#define WEBSERVER_AUTH_COOKIE "ESPSESSION" //cookie authenticateToken() looks for the token in
+#endif
+
+#define WEBSERVER_METRICS_BUCKETS 10 //request duration histogram bounds, 1 ms to 5 s
+
 #define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
 #define CONTENT_LENGTH_NOT_SET ((size_t) -2)
 
@@ -58,15 +92,60 @@ typedef struct {
   String  type;
   size_t  totalSize;    // file size
   size_t  currentSize;  // size of data currently in buf
+  size_t  contentLength; // of the whole form, an upper bound of the file size for progress
   uint8_t buf[HTTP_UPLOAD_BUFLEN];
 } HTTPUpload;
 
+// one open connection and where it is in its request cycle
+typedef struct {
+  WiFiClient       client;
+  HTTPClientStatus status = HC_NONE;
+  unsigned long    statusChange = 0;
+  uint16_t         requests = 0;  // requests already answered on this connection
+  char*            head = nullptr; // request head received so far, allocated once per slot
+  uint16_t         headLen = 0;
+  bool             headLineEmpty = false;
+  int              watchedFd = -1; // socket handed to loopWatchFd()
+} HTTPClientSlot;
+
+// counted from enableMetrics() on; times in us, a request from its head
+// being complete to the end of its handler
+typedef struct {
+  uint32_t requests;
+  uint32_t responses[5];  // by class, 1xx to 5xx
+  uint32_t notFound;
+  uint32_t connections;   // accepted
+  uint64_t bytesSent;     // headers and bodies
+  uint64_t parseUs;       // request heads
+  uint64_t handlerUs;     // reading the body and in the handler, without the time spent sending
+  uint64_t sendUs;        // writing to the clients
+  uint64_t totalUs;
+  uint32_t parseMaxUs;
+  uint32_t handlerMaxUs;
+  uint32_t sendMaxUs;
+  uint32_t totalMaxUs;
+  uint32_t buckets[WEBSERVER_METRICS_BUCKETS + 1]; // requests per duration bound, the last one above all of them
+} WebServerMetrics;
+
 #include "detail/RequestHandler.h"
+#include "detail/RequestArena.h"
 
 namespace fs {
 class FS;
 }
 
+// An endpoint that takes connections over from requests and keeps serving
+// them, polled from WebServer::handleClient().
+class WebServerService {
+public:
+  virtual ~WebServerService() {}
+  virtual bool _poll() = 0; // returns true if there was traffic
+  WebServerService* _nextService = nullptr;
+  bool _ownedByServer = false;
+};
+
+class EventSource;
+
 class WebServer
 {
 public:
@@ -83,12 +162,21 @@ public:
 
   bool authenticate(const char * username, const char * password);
   void requestAuthentication(HTTPAuthMethod mode = BASIC_AUTH, const char* realm = NULL, const String& authFailMsg = String("") );
+  // a random token for a client that authenticated, valid for lifetime seconds (0 for ever) unless revoked;
+  // it comes back as "Authorization: Bearer <token>" or in the WEBSERVER_AUTH_COOKIE cookie
+  String createAuthToken(uint32_t lifetime = 3600);
+  bool authenticateToken();
+  // an empty token revokes all of them
+  void revokeAuthToken(const String& token = String());
+  // Set-Cookie for the token, HttpOnly and SameSite=Strict; an empty token clears the cookie, maxAge 0 keeps it for the browser session
+  void setAuthCookie(const String& token, uint32_t maxAge = 3600);
 
   typedef std::function<void(void)> THandlerFunction;
   void on(const Uri &uri, THandlerFunction handler);
   void on(const Uri &uri, HTTPMethod method, THandlerFunction fn);
   void on(const Uri &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
   void addHandler(RequestHandler* handler);
+  EventSource& onEvents(const Uri &uri);  //Server-Sent Events endpoint, owned by the server
   void serveStatic(const char* uri, fs::FS& fs, const char* path, const char* cache_header = NULL );
   void onNotFound(THandlerFunction fn);  //called when handler is not assigned
   void onFileUpload(THandlerFunction fn); //handle file uploads
@@ -97,19 +185,28 @@ public:
   HTTPMethod method() { return _currentMethod; }
   virtual WiFiClient client() { return _currentClient; }
   HTTPUpload& upload() { return *_currentUpload; }
+  uint32_t parseTime() { return _parseTime; } // us spent parsing the last request head
 
   String pathArg(unsigned int i); // get request path argument by number
   String arg(String name);        // get request argument value by name
+  String arg(const char* name) { return arg(StringView(name)); }
+  String arg(StringView name);
   String arg(int i);              // get request argument value by number
   String argName(int i);          // get request argument name by number
   int args();                     // get arguments count
   bool hasArg(String name);       // check if argument exists
+  bool hasArg(const char* name) { return hasArg(StringView(name)); }
+  bool hasArg(StringView name);
   void collectHeaders(const char* headerKeys[], const size_t headerKeysCount); // set the request headers to collect
   String header(String name);      // get request header value by name
+  String header(const char* name) { return header(StringView(name)); }
+  String header(StringView name);
   String header(int i);              // get request header value by number
   String headerName(int i);          // get request header name by number
   int headers();                     // get header count
   bool hasHeader(String name);       // check if header exists
+  bool hasHeader(const char* name) { return hasHeader(StringView(name)); }
+  bool hasHeader(StringView name);
 
   String hostHeader();            // get request host header if available or empty String if not
 
@@ -124,7 +221,16 @@ public:
   void send_P(int code, PGM_P content_type, PGM_P content, size_t contentLength);
 
   void enableDelay(boolean value);
+  void setMaxClients(uint8_t count); //1..WEBSERVER_MAX_CLIENTS concurrent connections
+  uint8_t getMaxClients() { return _maxClients; }
+  void enableKeepAlive(boolean value = true);
+  void setKeepAlive(uint32_t timeout, uint16_t maxRequests = HTTP_KEEPALIVE_MAX_REQUESTS); //timeout in ms
   void enableCORS(boolean value = true);
+  // request timing and counters, served in the Prometheus text format at uri unless it is NULL
+  void enableMetrics(const char* uri = "/metrics");
+  void resetMetrics();
+  const WebServerMetrics* metrics() { return _metrics.get(); } // NULL until enableMetrics()
+  uint8_t activeClients();
   void enableCrossOrigin(boolean value = true);
 
   void setContentLength(const size_t contentLength);
@@ -134,39 +240,84 @@ public:
   void sendContent_P(PGM_P content);
   void sendContent_P(PGM_P content, size_t size);
 
-  static String urlDecode(const String& text);
+  static String urlDecode(const String& text) { return urlDecode(StringView(text)); }
+  static String urlDecode(StringView text);
 
   template<typename T>
   size_t streamFile(T &file, const String& contentType) {
     _streamFileCore(file.size(), file.name(), contentType);
-    return _currentClient.write(file);
+    uint32_t start = _metrics ? micros() : 0;
+    size_t sent = _currentClient.sendFile(file);
+    _countSent(sent, start);
+    return sent;
+  }
+
+  // used by WebSocketServer and EventSource, polled from handleClient()
+  void _addService(WebServerService* service);
+  void _removeService(WebServerService* service);
+  // bytes written past _write(), by the static handler
+  void _countSent(size_t sent, uint32_t start) {
+    if (_metrics) {
+      _metrics->bytesSent += sent;
+      _sendTime += micros() - start;
+    }
   }
 
 protected:
+  friend class ResponseWriter;
   virtual size_t _currentClientWrite(const char* b, size_t l) { return _currentClient.write( b, l ); }
   virtual size_t _currentClientWrite_P(PGM_P b, size_t l) { return _currentClient.write_P( b, l ); }
+  // every response goes out through these, they count it for the metrics
+  size_t _write(const char* b, size_t l);
+  size_t _write_P(PGM_P b, size_t l);
   void _addRequestHandler(RequestHandler* handler);
+  RequestHandler* _findRequestHandler(HTTPMethod method, const String& uri);
+  static uint32_t _hashUri(const String& uri);
   void _handleRequest();
+  bool _serviceClient(HTTPClientSlot& slot);
+  static void _resetSlot(HTTPClientSlot& slot);
+  static void _watchSlot(HTTPClientSlot& slot);
   void _finalizeResponse();
-  bool _parseRequest(WiFiClient& client);
-  void _parseArguments(String data);
+  void _sendChunk(const char* content, size_t contentLength);
+  int _readRequestHead(WiFiClient& client, HTTPClientSlot& slot);
+  bool _parseRequest(WiFiClient& client, char* head);
+  void _parseArguments(StringView data);
+  void _parseArenaArguments(uint32_t offset, size_t len);
+  bool _addArgument(const char* key, size_t keyLen, const char* value, size_t valueLen);
   static String _responseCodeToString(int code);
   bool _parseForm(WiFiClient& client, String boundary, uint32_t len);
   bool _parseFormUploadAborted();
-  void _uploadWriteByte(uint8_t b);
-  int _uploadReadByte(WiFiClient& client);
+  void _uploadWrite(const uint8_t* data, size_t len);
+  bool _uploadReadFile(WiFiClient& client, const String& boundary);
   void _prepareHeader(String& response, int code, const char* content_type, size_t contentLength);
   bool _collectHeader(const char* headerName, const char* headerValue);
+  int _headerIndex(StringView name);
+  void _parseConnectionHeader(const char* value);
+
+  void _countRequest(uint32_t start);
+  void _sendMetrics();
 
   void _streamFileCore(const size_t fileSize, const String & fileName, const String & contentType);
 
   String _getRandomHexString();
   // for extracting Auth parameters
   String _extractParam(String& authReq,const String& param,const char delimit = '"');
+  // the expected Basic token and HA1 for the credentials authenticate() was last called with
+  void _authCache(const char* username, const char* password);
+  StringView _headerValue(int i);
+
+  struct AuthToken {
+    char     token[33]; // empty when the slot is free
+    uint32_t created;
+    uint32_t lifetime;  // ms, 0 for ever
+  };
 
-  struct RequestArgument {
-    String key;
-    String value;
+  // a header kept for header(), its value is in the arena
+  struct RequestHeader {
+    String   key;
+    uint16_t hash;
+    uint16_t valueLen; // 0 when the request had none
+    uint32_t value;
   };
 
   boolean     _corsEnabled;
@@ -176,34 +327,67 @@ protected:
   HTTPMethod  _currentMethod;
   String      _currentUri;
   uint8_t     _currentVersion;
-  HTTPClientStatus _currentStatus;
-  unsigned long _statusChange;
   boolean     _nullDelay;
 
+  HTTPClientSlot   _clients[WEBSERVER_MAX_CLIENTS];
+  uint8_t          _maxClients;
+  uint8_t          _nextClient;
+
+  boolean          _keepAlive;
+  uint32_t         _keepAliveTimeout;
+  uint16_t         _keepAliveMax;
+  uint16_t         _requestCount;      // requests on the current connection, this one included
+  bool             _requestKeepAlive;  // the client accepts a persistent connection
+  bool             _responseKeepAlive; // the response is framed and announced keep-alive
+  uint32_t         _parseTime;
+  uint32_t         _sendTime;          // us spent writing the current response
+  std::unique_ptr<WebServerMetrics> _metrics;
+  WebServerService* _services;
+
   RequestHandler*  _currentHandler;
   RequestHandler*  _firstHandler;
   RequestHandler*  _lastHandler;
+
+  // handlers in registration order: literal URIs hashed, the rest in a list
+  struct RouteEntry {
+    RequestHandler* handler;
+    const String*   uri;
+    uint32_t        hash;
+    HTTPMethod      method;
+    uint16_t        order;
+    RouteEntry*     next;
+  };
+  RouteEntry*      _routes[WEBSERVER_ROUTE_BUCKETS];
+  RouteEntry*      _dynamicRoutes;
+  RouteEntry*      _lastDynamicRoute;
+  uint16_t         _routeCount;
   THandlerFunction _notFoundHandler;
   THandlerFunction _fileUploadHandler;
 
-  int              _currentArgCount;
-  RequestArgument* _currentArgs;
-  int              _postArgsLen;
-  RequestArgument* _postArgs;
+  RequestArena     _arena;  // arguments and header values of the current request
 
   std::unique_ptr<HTTPUpload> _currentUpload;
 
-  int              _headerKeysCount;
-  RequestArgument* _currentHeaders;
+  int              _headerKeysCount; // collected ones, the builtin ones follow them
+  RequestHeader*   _currentHeaders;
   size_t           _contentLength;
   String           _responseHeaders;
 
   String           _hostHeader;
+  enum { BUILTIN_HEADER_IF_NONE_MATCH, BUILTIN_HEADER_RANGE, BUILTIN_HEADER_UPGRADE,
+         BUILTIN_HEADER_WS_KEY, BUILTIN_HEADER_WS_VERSION, BUILTIN_HEADER_LAST_EVENT_ID,
+         BUILTIN_HEADER_ACCEPT_ENCODING, BUILTIN_HEADER_COOKIE, BUILTIN_HEADER_COUNT };
   bool             _chunked;
 
   String           _snonce;  // Store noance and opaque for future comparison
   String           _sopaque;
   String           _srealm;  // Store the Auth realm between Calls
+  String           _authUser;
+  String           _authPass;
+  String           _authBasic;  // base64 of user:pass
+  String           _authHA1Realm; // realm _authHA1 is for, empty when it has to be worked out
+  char             _authHA1[33];
+  AuthToken        _authTokens[WEBSERVER_AUTH_TOKENS];
 
 };
 
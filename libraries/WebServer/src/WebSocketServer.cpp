@@ -0,0 +1,472 @@
+/*
+  WebSocketServer.cpp - WebSocket (RFC 6455) endpoint for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <Arduino.h>
+#include <esp32-hal-log.h>
+#include "mbedtls/sha1.h"
+#include "base64.h"
+#include "WebSocketServer.h"
+
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT         0x1
+#define WS_OP_BINARY       0x2
+#define WS_OP_CLOSE        0x8
+#define WS_OP_PING         0x9
+#define WS_OP_PONG         0xA
+
+#define WS_CLOSE_PROTOCOL_ERROR 1002
+#define WS_CLOSE_TOO_BIG        1009
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// answers the upgrade request, the rest of the connection belongs to the WebSocketServer
+class WebSocketRequestHandler : public RequestHandler {
+public:
+  WebSocketRequestHandler(WebSocketServer* ws, const Uri& uri)
+  : _ws(ws)
+  , _uri(uri.clone())
+  {
+    _uri->initPathArgs(pathArgs);
+  }
+
+  ~WebSocketRequestHandler() {
+    delete _uri;
+  }
+
+  bool canHandle(HTTPMethod method, String uri) override {
+    return method == HTTP_GET && _uri->canHandle(uri, pathArgs);
+  }
+
+  bool handle(WebServer& server, HTTPMethod method, String uri) override {
+    if (!canHandle(method, uri))
+      return false;
+    if (!_ws) {
+      server.send(503, "text/plain", "");
+      return true;
+    }
+    return _ws->_accept(server);
+  }
+
+  const String* exactUri(HTTPMethod& method) override {
+    if (!_uri->isExact())
+      return nullptr;
+    method = HTTP_GET;
+    return &_uri->str();
+  }
+
+  WebSocketServer* _ws;
+
+protected:
+  Uri* _uri;
+};
+
+WebSocketServer::WebSocketServer(WebServer& server, const Uri& uri, uint8_t maxClients)
+: _server(server)
+, _handler(new WebSocketRequestHandler(this, uri))
+, _clients(new Connection[maxClients ? maxClients : 1]())
+, _maxClients(maxClients ? maxClients : 1)
+, _dropped(0)
+{
+  server.addHandler(_handler);
+  server._addService(this);
+}
+
+WebSocketServer::~WebSocketServer() {
+  // the handler stays with the server, which deletes it
+  _handler->_ws = nullptr;
+  _server._removeService(this);
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    _disconnect(i);
+  }
+  delete[] _clients;
+}
+
+bool WebSocketServer::_accept(WebServer& server) {
+  String key = server.header("Sec-WebSocket-Key");
+  String upgrade = server.header("Upgrade");
+  if (!upgrade.equalsIgnoreCase("websocket") || !key.length()) {
+    server.send(400, "text/plain", "WebSocket upgrade expected");
+    return true;
+  }
+  if (server.header("Sec-WebSocket-Version") != "13") {
+    server.sendHeader("Sec-WebSocket-Version", "13");
+    server.send(400, "text/plain", "unsupported WebSocket version");
+    return true;
+  }
+  uint8_t id = 0;
+  while (id < _maxClients && _clients[id].active) id++;
+  if (id == _maxClients) {
+    log_w("no free WebSocket slot");
+    server.send(503, "text/plain", "");
+    return true;
+  }
+  Connection& c = _clients[id];
+  c.rx = (uint8_t*) heap_policy_malloc(HEAP_USER_WEB_SERVER, WEBSOCKET_RX_BUFFER_SIZE + 1);
+  if (!c.rx) {
+    server.send(503, "text/plain", "");
+    return true;
+  }
+
+  key += WS_GUID;
+  uint8_t sha[20];
+  mbedtls_sha1_ret((const unsigned char*) key.c_str(), key.length(), sha);
+  String response = F("HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: ");
+  response += base64::encode(sha, sizeof(sha));
+  response += "\r\n\r\n";
+
+  // the handshake is the first entry of the send queue, so anything queued
+  // from the connect event goes out behind it
+  SharedBlock* frame = SharedBlock::alloc(response.length());
+  if (!frame) {
+    free(c.rx);
+    c.rx = nullptr;
+    server.send(503, "text/plain", "");
+    return true;
+  }
+  memcpy(frame->data(), response.c_str(), response.length());
+  c.tcp = server.client();
+  c.active = true;
+  c.closing = false;
+  c.rxLen = 0;
+  c.rxOpcode = 0;
+  c.hdrLen = 0;
+  c.queue.init();
+  _enqueue(c, frame);
+  _drain(c);
+  log_v("WebSocket %u connected", id);
+  if (_cb) {
+    _cb(id, WS_EVT_CONNECT, nullptr, 0);
+  }
+  return true;
+}
+
+SharedBlock* WebSocketServer::_makeFrame(uint8_t opcode, const uint8_t* data, size_t len) {
+  // server frames are never masked
+  size_t head = len < 126 ? 2 : (len <= 0xffff ? 4 : 10);
+  SharedBlock* frame = SharedBlock::alloc(head + len);
+  if (!frame) {
+    return nullptr;
+  }
+  uint8_t* p = frame->data();
+  *p++ = 0x80 | opcode;
+  if (len < 126) {
+    *p++ = len;
+  } else if (len <= 0xffff) {
+    *p++ = 126;
+    *p++ = len >> 8;
+    *p++ = len;
+  } else {
+    *p++ = 127;
+    for (int i = 7; i >= 0; i--) {
+      *p++ = i < 4 ? (uint8_t)(len >> (i * 8)) : 0;
+    }
+  }
+  if (len) {
+    memcpy(p, data, len);
+  }
+  return frame;
+}
+
+bool WebSocketServer::_enqueue(Connection& c, SharedBlock* frame) {
+  return c.active && c.queue.push(frame);
+}
+
+bool WebSocketServer::_drain(Connection& c) {
+  int sent = c.queue.drain(c.tcp.fd());
+  if (sent < 0) {
+    c.tcp.stop();
+  }
+  return sent > 0;
+}
+
+bool WebSocketServer::_send(uint8_t id, uint8_t opcode, const uint8_t* data, size_t len) {
+  if (id >= _maxClients || !_clients[id].active || _clients[id].closing) {
+    return false;
+  }
+  Connection& c = _clients[id];
+  if (c.queue.full()) {
+    return false;
+  }
+  SharedBlock* frame = _makeFrame(opcode, data, len);
+  if (!frame) {
+    return false;
+  }
+  frame->refs++; // held while queueing, so a failed attempt frees it
+  bool queued = _enqueue(c, frame);
+  SharedBlock::release(frame);
+  if (queued) {
+    _drain(c);
+  }
+  return queued;
+}
+
+uint8_t WebSocketServer::_broadcast(uint8_t opcode, const uint8_t* data, size_t len) {
+  SharedBlock* frame = _makeFrame(opcode, data, len);
+  if (!frame) {
+    return 0;
+  }
+  frame->refs++;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    Connection& c = _clients[i];
+    if (!c.active || c.closing) {
+      continue;
+    }
+    if (_enqueue(c, frame)) {
+      count++;
+      _drain(c);
+    } else {
+      _dropped++;
+    }
+  }
+  SharedBlock::release(frame);
+  return count;
+}
+
+bool WebSocketServer::sendText(uint8_t id, const uint8_t* data, size_t len) {
+  return _send(id, WS_OP_TEXT, data, len);
+}
+
+bool WebSocketServer::sendBinary(uint8_t id, const uint8_t* data, size_t len) {
+  return _send(id, WS_OP_BINARY, data, len);
+}
+
+uint8_t WebSocketServer::broadcastText(const uint8_t* data, size_t len) {
+  return _broadcast(WS_OP_TEXT, data, len);
+}
+
+uint8_t WebSocketServer::broadcastBinary(const uint8_t* data, size_t len) {
+  return _broadcast(WS_OP_BINARY, data, len);
+}
+
+void WebSocketServer::_closeFrame(Connection& c, uint16_t code) {
+  uint8_t payload[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+  SharedBlock* frame = _makeFrame(WS_OP_CLOSE, payload, sizeof(payload));
+  if (frame) {
+    frame->refs++;
+    if (!_enqueue(c, frame)) {
+      // no room to say goodbye, just drop the connection
+      c.tcp.stop();
+    }
+    SharedBlock::release(frame);
+  }
+  c.closing = true;
+  _drain(c);
+}
+
+void WebSocketServer::close(uint8_t id, uint16_t code) {
+  if (id < _maxClients && _clients[id].active && !_clients[id].closing) {
+    _closeFrame(_clients[id], code);
+  }
+}
+
+void WebSocketServer::closeAll(uint16_t code) {
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    close(i, code);
+  }
+}
+
+void WebSocketServer::_disconnect(uint8_t id) {
+  Connection& c = _clients[id];
+  if (!c.active) {
+    return;
+  }
+  c.active = false;
+  c.tcp.stop();
+  c.queue.clear();
+  free(c.rx);
+  c.rx = nullptr;
+  log_v("WebSocket %u disconnected", id);
+  if (_cb) {
+    _cb(id, WS_EVT_DISCONNECT, nullptr, 0);
+  }
+}
+
+bool WebSocketServer::connected(uint8_t id) {
+  return id < _maxClients && _clients[id].active && !_clients[id].closing;
+}
+
+uint8_t WebSocketServer::count() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    n += connected(i);
+  }
+  return n;
+}
+
+bool WebSocketServer::canSend(uint8_t id) {
+  return connected(id) && !_clients[id].queue.full();
+}
+
+uint8_t WebSocketServer::queued(uint8_t id) {
+  return id < _maxClients ? _clients[id].queue.count : 0;
+}
+
+IPAddress WebSocketServer::remoteIP(uint8_t id) {
+  return connected(id) ? _clients[id].tcp.remoteIP() : IPAddress();
+}
+
+bool WebSocketServer::_frameComplete(uint8_t id) {
+  // a whole frame is in: header in hdr, payload in ctrl or at the end of rx
+  Connection& c = _clients[id];
+  uint8_t opcode = c.hdr[0] & 0x0f;
+  bool fin = c.hdr[0] & 0x80;
+  const uint8_t* mask = c.hdr + c.hdrLen - 4;
+  uint8_t* payload = (opcode & 0x8) ? c.ctrl : c.rx + c.rxLen;
+  for (size_t i = 0; i < c.frameLen; i++) {
+    payload[i] ^= mask[i & 3];
+  }
+  c.hdrLen = 0;
+
+  switch (opcode) {
+  case WS_OP_PING: {
+    SharedBlock* pong = _makeFrame(WS_OP_PONG, c.ctrl, c.frameLen);
+    if (pong) {
+      pong->refs++;
+      _enqueue(c, pong);
+      SharedBlock::release(pong);
+    }
+    return true;
+  }
+  case WS_OP_PONG:
+    return true;
+  case WS_OP_CLOSE: {
+    // echo the status code, the connection goes once that is sent
+    uint16_t code = c.frameLen >= 2 ? (c.ctrl[0] << 8) | c.ctrl[1] : 1000;
+    _closeFrame(c, code);
+    return false;
+  }
+  }
+
+  c.rxLen += c.frameLen;
+  if (!fin) {
+    return true;
+  }
+  WebSocketEvent type = c.rxOpcode == WS_OP_TEXT ? WS_EVT_TEXT : WS_EVT_BINARY;
+  size_t len = c.rxLen;
+  c.rx[len] = 0;
+  c.rxLen = 0;
+  c.rxOpcode = 0;
+  if (_cb) {
+    _cb(id, type, c.rx, len);
+  }
+  return c.active;
+}
+
+// bytes of frame header to expect, judging by what has arrived
+static size_t headerLength(const uint8_t* hdr, size_t have) {
+  if (have < 2) {
+    return 2;
+  }
+  uint8_t len7 = hdr[1] & 0x7f;
+  // client frames always carry a mask
+  return 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + 4;
+}
+
+bool WebSocketServer::_receive(uint8_t id) {
+  Connection& c = _clients[id];
+  bool busy = false;
+  while (c.active && !c.closing && c.tcp.available() > 0) {
+    busy = true;
+    size_t full = headerLength(c.hdr, c.hdrLen);
+    if (c.hdrLen < full) {
+      int res = c.tcp.read(c.hdr + c.hdrLen, full - c.hdrLen);
+      if (res <= 0) {
+        break;
+      }
+      c.hdrLen += res;
+      if (c.hdrLen == 2 && !(c.hdr[1] & 0x80)) {
+        log_d("WebSocket %u sent an unmasked frame", id);
+        _closeFrame(c, WS_CLOSE_PROTOCOL_ERROR);
+        break;
+      }
+      full = headerLength(c.hdr, c.hdrLen);
+      if (c.hdrLen < full) {
+        continue;
+      }
+      uint8_t opcode = c.hdr[0] & 0x0f;
+      uint8_t len7 = c.hdr[1] & 0x7f;
+      uint64_t len = len7;
+      if (len7 == 126) {
+        len = (c.hdr[2] << 8) | c.hdr[3];
+      } else if (len7 == 127) {
+        len = 0;
+        for (int i = 2; i < 10; i++) {
+          len = (len << 8) | c.hdr[i];
+        }
+      }
+      bool bad;
+      if (opcode & 0x8) {
+        // control frames are short and never fragmented
+        bad = len > sizeof(c.ctrl) || !(c.hdr[0] & 0x80);
+      } else {
+        // a continuation needs a message in progress, anything else must not have one
+        bad = opcode > WS_OP_BINARY || (opcode == WS_OP_CONTINUATION) != (c.rxOpcode != 0);
+      }
+      if (bad) {
+        _closeFrame(c, WS_CLOSE_PROTOCOL_ERROR);
+        break;
+      }
+      if (!(opcode & 0x8)) {
+        if (c.rxLen + len > WEBSOCKET_RX_BUFFER_SIZE) {
+          log_w("WebSocket %u message exceeds %u bytes", id, WEBSOCKET_RX_BUFFER_SIZE);
+          _closeFrame(c, WS_CLOSE_TOO_BIG);
+          break;
+        }
+        if (opcode != WS_OP_CONTINUATION) {
+          c.rxOpcode = opcode;
+        }
+      }
+      c.frameLen = len;
+      c.frameGot = 0;
+    } else {
+      // payload, straight into its final place
+      uint8_t* dst = (c.hdr[0] & 0x8) ? c.ctrl : c.rx + c.rxLen;
+      int res = c.tcp.read(dst + c.frameGot, c.frameLen - c.frameGot);
+      if (res <= 0) {
+        break;
+      }
+      c.frameGot += res;
+    }
+    if (c.frameGot == c.frameLen && !_frameComplete(id)) {
+      break;
+    }
+  }
+  return busy;
+}
+
+bool WebSocketServer::_poll() {
+  bool busy = false;
+  for (uint8_t i = 0; i < _maxClients; i++) {
+    Connection& c = _clients[i];
+    if (!c.active) {
+      continue;
+    }
+    busy |= _drain(c);
+    // once the close frame is out the TCP connection goes, the server may close first
+    if ((c.closing && !c.queue.count) || !c.tcp.connected()) {
+      _disconnect(i);
+      continue;
+    }
+    busy |= _receive(i);
+  }
+  return busy;
+}
@@ -0,0 +1,125 @@
+/*
+  WebSocketServer.h - WebSocket (RFC 6455) endpoint for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef WEBSOCKETSERVER_H
+#define WEBSOCKETSERVER_H
+
+#include "WebServer.h"
+#include "detail/SendQueue.h"
+
+#ifndef WEBSOCKET_MAX_CLIENTS
+#define WEBSOCKET_MAX_CLIENTS 8 //connections per endpoint
+#endif
+
+#ifndef WEBSOCKET_RX_BUFFER_SIZE
+#define WEBSOCKET_RX_BUFFER_SIZE 1024 //largest message accepted, allocated per connection
+#endif
+
+#ifndef WEBSOCKET_QUEUE_LENGTH
+#define WEBSOCKET_QUEUE_LENGTH 8 //frames waiting per connection before sends are refused
+#endif
+
+class WebSocketRequestHandler;
+
+enum WebSocketEvent { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_TEXT, WS_EVT_BINARY };
+
+/*
+ * Upgrades GET requests on uri to WebSocket connections and serves them from
+ * WebServer::handleClient():
+ *
+ *   WebSocketServer ws(server, "/ws");
+ *   ws.onEvent([](uint8_t id, WebSocketEvent type, const uint8_t* data, size_t len) {
+ *     if (type == WS_EVT_TEXT) ws.sendText(id, "pong");
+ *   });
+ *
+ * Received messages are reassembled and unmasked in a per-connection buffer
+ * and handed to the callback without a copy; text is NUL terminated. Each
+ * frame sent is serialized once into a reference counted block, so
+ * broadcast() costs one allocation however many clients there are. Frames
+ * queue per connection and go out without blocking; a full queue makes
+ * send*() return false so a producer can back off.
+ */
+class WebSocketServer : public WebServerService {
+public:
+  typedef std::function<void(uint8_t id, WebSocketEvent type, const uint8_t* data, size_t len)> WebSocketEventHandler;
+
+  WebSocketServer(WebServer& server, const Uri& uri, uint8_t maxClients = WEBSOCKET_MAX_CLIENTS);
+  ~WebSocketServer();
+
+  void onEvent(WebSocketEventHandler cb) { _cb = cb; }
+
+  bool sendText(uint8_t id, const char* text) { return sendText(id, (const uint8_t*)text, strlen(text)); }
+  bool sendText(uint8_t id, const String& text) { return sendText(id, (const uint8_t*)text.c_str(), text.length()); }
+  bool sendText(uint8_t id, const uint8_t* data, size_t len);
+  bool sendBinary(uint8_t id, const uint8_t* data, size_t len);
+
+  // returns how many clients the frame was queued for
+  uint8_t broadcastText(const char* text) { return broadcastText((const uint8_t*)text, strlen(text)); }
+  uint8_t broadcastText(const String& text) { return broadcastText((const uint8_t*)text.c_str(), text.length()); }
+  uint8_t broadcastText(const uint8_t* data, size_t len);
+  uint8_t broadcastBinary(const uint8_t* data, size_t len);
+
+  void close(uint8_t id, uint16_t code = 1000);
+  void closeAll(uint16_t code = 1001);
+
+  bool connected(uint8_t id);
+  uint8_t count();
+  bool canSend(uint8_t id);           // room in the send queue
+  uint8_t queued(uint8_t id);         // frames not yet handed to TCP
+  IPAddress remoteIP(uint8_t id);
+  uint32_t droppedFrames() { return _dropped; } // broadcasts skipped for full queues
+
+  // used by WebServer only
+  bool _poll() override;
+  bool _accept(WebServer& server);
+
+protected:
+  struct Connection {
+    WiFiClient tcp;
+    bool       active;
+    bool       closing;     // close frame queued, drop the connection once it is sent
+    uint8_t*   rx;          // message being reassembled
+    size_t     rxLen;
+    uint8_t    rxOpcode;    // opcode of the message in rx, 0 if none
+    uint8_t    hdr[14];     // frame header as it arrives
+    uint8_t    hdrLen;
+    uint8_t    ctrl[125];   // control frame payload, apart from a fragmented message
+    size_t     frameLen;
+    size_t     frameGot;
+    SendQueue<WEBSOCKET_QUEUE_LENGTH> queue;
+  };
+
+  static SharedBlock* _makeFrame(uint8_t opcode, const uint8_t* data, size_t len);
+  bool _send(uint8_t id, uint8_t opcode, const uint8_t* data, size_t len);
+  uint8_t _broadcast(uint8_t opcode, const uint8_t* data, size_t len);
+  bool _enqueue(Connection& c, SharedBlock* frame);
+  bool _drain(Connection& c);
+  bool _receive(uint8_t id);
+  bool _frameComplete(uint8_t id);
+  void _closeFrame(Connection& c, uint16_t code);
+  void _disconnect(uint8_t id);
+
+  WebServer&  _server;
+  WebSocketRequestHandler* _handler;
+  Connection* _clients;
+  uint8_t     _maxClients;
+  uint32_t    _dropped;
+  WebSocketEventHandler _cb;
+};
+
+#endif //WEBSOCKETSERVER_H
@@ -0,0 +1,131 @@
+#ifndef REQUESTARENA_H
+#define REQUESTARENA_H
+
+#include <Arduino.h>
+#include <StringView.h>
+
+#ifndef WEBSERVER_ARENA_KEEP
+#define WEBSERVER_ARENA_KEEP 2048 //arena bytes kept between requests, a bigger arena is freed
+#endif
+
+// Text of the current request: argument names and values, collected header
+// values. Everything lives in one buffer and is addressed by offset, the
+// buffer and the entry table are reused so a request allocates nothing once
+// they have grown to size. Strings are NUL terminated.
+class RequestArena {
+public:
+  struct Entry {
+    uint32_t key;
+    uint32_t value;
+    uint16_t keyLen;
+    uint16_t hash;     // of the key, checked before comparing
+    uint32_t valueLen;
+  };
+
+  RequestArena() : _buf(nullptr), _size(0), _len(0), _entries(nullptr), _capacity(0), _count(0) {}
+  ~RequestArena() {
+    free(_buf);
+    free(_entries);
+  }
+
+  void reset() {
+    _len = 0;
+    _count = 0;
+    if (_size > WEBSERVER_ARENA_KEEP) {
+      free(_buf);
+      _buf = nullptr;
+      _size = 0;
+    }
+  }
+
+  // room for n more bytes at offset size(), nullptr without memory
+  char* reserve(size_t n) {
+    if (_len + n > _size) {
+      size_t size = _size ? _size * 2 : 256;
+      if (size < _len + n) size = _len + n;
+      char* buf = (char*) heap_policy_realloc(HEAP_USER_WEB_SERVER, _buf, size);
+      if (!buf) {
+        return nullptr;
+      }
+      _buf = buf;
+      _size = size;
+    }
+    return _buf + _len;
+  }
+  void commit(size_t n) { _len += n; }
+  size_t size() const { return _len; }
+  char* at(uint32_t offset) const { return _buf + offset; }
+
+  // copies text and a NUL in, returns its offset or -1
+  int32_t append(const char* text, size_t len) {
+    char* p = reserve(len + 1);
+    if (!p) {
+      return -1;
+    }
+    memcpy(p, text, len);
+    p[len] = '\0';
+    uint32_t offset = _len;
+    _len += len + 1;
+    return offset;
+  }
+
+  // an argument whose key and value are already in the buffer
+  bool add(uint32_t key, size_t keyLen, uint32_t value, size_t valueLen) {
+    if (_count == _capacity) {
+      uint16_t capacity = _capacity ? _capacity * 2 : 8;
+      Entry* entries = (Entry*) heap_policy_realloc(HEAP_USER_WEB_SERVER, _entries, capacity * sizeof(Entry));
+      if (!entries) {
+        return false;
+      }
+      _entries = entries;
+      _capacity = capacity;
+    }
+    Entry& e = _entries[_count++];
+    e.key = key;
+    e.keyLen = keyLen;
+    e.value = value;
+    e.valueLen = valueLen;
+    e.hash = hash(_buf + key, keyLen);
+    return true;
+  }
+
+  int count() const { return _count; }
+  void truncate(int count) { if (count < _count) _count = count; }
+  Entry* entries() { return _entries; }
+  const char* key(int i) const { return _buf + _entries[i].key; }
+  const char* value(int i) const { return _buf + _entries[i].value; }
+
+  // first entry named key, -1 if there is none
+  int find(StringView key) const {
+    uint16_t h = hash(key.data(), key.length());
+    for (int i = 0; i < _count; i++) {
+      const Entry& e = _entries[i];
+      if (e.hash == h && e.keyLen == key.length() && !memcmp(_buf + e.key, key.data(), e.keyLen))
+        return i;
+    }
+    return -1;
+  }
+
+  static uint16_t hash(const char* s, size_t len) {
+    uint16_t h = 0;
+    while (len--) h = h * 31 + (uint8_t)*s++;
+    return h;
+  }
+
+  // case-insensitive, for header names
+  static uint16_t hashIgnoreCase(const char* s, size_t len) {
+    uint16_t h = 0;
+    while (len--) h = h * 31 + (uint8_t)tolower(*s++);
+    return h;
+  }
+
+private:
+  char*    _buf;
+  size_t   _size;
+  size_t   _len;
+  Entry*   _entries;
+  uint16_t _capacity;
+  uint16_t _count;
+};
+
+#endif //REQUESTARENA_H
@@ -11,6 +11,9 @@ public:
     virtual bool canUpload(String uri) { (void) uri; return false; }
     virtual bool handle(WebServer& server, HTTPMethod requestMethod, String requestUri) { (void) server; (void) requestMethod; (void) requestUri; return false; }
     virtual void upload(WebServer& server, String requestUri, HTTPUpload& upload) { (void) server; (void) requestUri; (void) upload; }
+    // the URI this handler matches literally, so the server can index it; nullptr
+    // if requests have to be offered to canHandle()
+    virtual const String* exactUri(HTTPMethod& method) { (void) method; return nullptr; }
 
     RequestHandler* next() { return _next; }
     void next(RequestHandler* r) { _next = r; }
@@ -8,6 +8,10 @@
 
 using namespace mime;
 
+#ifndef WEBSERVER_STATIC_CACHE_SIZE
+#define WEBSERVER_STATIC_CACHE_SIZE 32 //files per serveStatic() whose metadata is kept in RAM
+#endif
+
 class FunctionRequestHandler : public RequestHandler {
 public:
     FunctionRequestHandler(WebServer::THandlerFunction fn, WebServer::THandlerFunction ufn, const Uri &uri, HTTPMethod method)
@@ -53,6 +57,13 @@ public:
             _ufn();
     }
 
+    const String* exactUri(HTTPMethod& method) override {
+        if (!_uri->isExact())
+            return nullptr;
+        method = _method;
+        return &_uri->str();
+    }
+
 protected:
     WebServer::THandlerFunction _fn;
     WebServer::THandlerFunction _ufn;
@@ -67,10 +78,22 @@ public:
     , _uri(uri)
     , _path(path)
     , _cache_header(cache_header)
+    , _cache(nullptr)
+    , _cacheCount(0)
     {
         _isFile = fs.exists(path);
         log_v("StaticRequestHandler: path=%s uri=%s isFile=%d, cache_header=%s\r\n", path, uri, _isFile, cache_header);
         _baseUriLength = _uri.length();
+        if (_isFile)
+            _lookup(_uri, true);
+    }
+
+    ~StaticRequestHandler() {
+        while (_cache) {
+            FileEntry* next = _cache->next;
+            delete _cache;
+            _cache = next;
+        }
     }
 
     bool canHandle(HTTPMethod requestMethod, String requestUri) override  {
@@ -89,62 +112,246 @@ public:
 
         log_v("StaticRequestHandler::handle: request=%s _uri=%s\r\n", requestUri.c_str(), _uri.c_str());
 
-        String path(_path);
+        FileEntry* entry = _lookup(requestUri, _acceptsGzip(server.header("Accept-Encoding")));
+        if (!entry)
+            return false;
+        String contentType(FPSTR(mimeTable[entry->mime].mimeType));
+        if (entry->vary)
+            server.sendHeader("Vary", "Accept-Encoding");
+
+        // the browser has this version already, no flash access at all
+        String ifNoneMatch = server.header("If-None-Match");
+        if (ifNoneMatch.length() && (ifNoneMatch == "*" || ifNoneMatch.indexOf(entry->etag) >= 0)) {
+            server.sendHeader("ETag", entry->etag);
+            if (_cache_header.length() != 0)
+                server.sendHeader("Cache-Control", _cache_header);
+            server.send(304, contentType, "");
+            return true;
+        }
+
+        File f = _fs.open(entry->path, "r");
+        if (!f || !f.available()) {
+            _forget(entry);
+            return false;
+        }
+        if (f.size() != entry->size) {
+            // changed since it was cached
+            entry->size = f.size();
+            entry->etag = _makeETag(f);
+            f.seek(0);
+        }
 
+        if (_cache_header.length() != 0)
+            server.sendHeader("Cache-Control", _cache_header);
+        server.sendHeader("ETag", entry->etag);
+        server.sendHeader("Accept-Ranges", "bytes");
+
+        size_t start, length;
+        int range = _parseRange(server.header("Range"), entry->size, start, length);
+        if (range < 0) {
+            server.sendHeader("Content-Range", String("bytes */") + String(entry->size));
+            server.send(416, contentType, "");
+            return true;
+        }
+        if (range == 0) {
+            server.streamFile(f, contentType);
+            return true;
+        }
+
+        server.setContentLength(length);
+        if (entry->gz)
+            server.sendHeader(F("Content-Encoding"), F("gzip"));
+        server.sendHeader("Content-Range", String("bytes ") + String(start) + '-' + String(start + length - 1) + '/' + String(entry->size));
+        server.send(206, contentType, "");
+        if (!f.seek(start))
+            return true;
+        FileRange part = { f, length };
+        uint32_t sendStart = micros();
+        server._countSent(server.client().sendFile(part), sendStart);
+        return true;
+    }
+
+    static mime::type getMimeType(const String& path) {
+        // Check all entries but last one for match
+        for (size_t i=0; i < maxType-1; i++) {
+            if (StringView(path).endsWith(mimeTable[i].endsWith))
+                return (mime::type)i;
+        }
+        // Fall-through and just return default type
+        return (mime::type)(maxType-1);
+    }
+
+    static String getContentType(const String& path) {
+        return String(FPSTR(mimeTable[getMimeType(path)].mimeType));
+    }
+
+protected:
+    // what handle() needs to answer a request without touching the file system
+    struct FileEntry {
+        String uri;     // request URI
+        String path;    // file served for it, possibly the .gz variant
+        size_t size;
+        String etag;
+        mime::type mime;
+        bool gz;        // sent with Content-Encoding: gzip
+        bool acceptGz;  // looked up for a client that takes gzip
+        bool vary;      // the answer depends on Accept-Encoding
+        FileEntry* next;
+    };
+
+    // a File limited to a byte range, for WiFiClient::sendFile()
+    struct FileRange {
+        File& file;
+        size_t left;
+        size_t read(uint8_t* buf, size_t len) {
+            if (len > left)
+                len = left;
+            len = file.read(buf, len);
+            left -= len;
+            return len;
+        }
+    };
+
+    FileEntry* _lookup(const String& requestUri, bool acceptGz) {
+        for (FileEntry* entry = _cache; entry; entry = entry->next) {
+            if (entry->uri == requestUri && (entry->acceptGz == acceptGz || !entry->vary))
+                return entry;
+        }
+
+        String path(_path);
         if (!_isFile) {
             // Base URI doesn't point to a file.
             // If a directory is requested, look for index file.
-            if (requestUri.endsWith("/")) 
-              requestUri += "index.htm";
+            String uri(requestUri);
+            if (uri.endsWith("/"))
+              uri += "index.htm";
 
             // Append whatever follows this URI in request to get the file path.
-            path += requestUri.substring(_baseUriLength);
+            path += uri.substring(_baseUriLength);
         }
         log_v("StaticRequestHandler::handle: path=%s, isFile=%d\r\n", path.c_str(), _isFile);
 
-        String contentType = getContentType(path);
+        mime::type fileType = getMimeType(path);
 
-        // look for gz file, only if the original specified path is not a gz.  So part only works to send gzip via content encoding when a non compressed is asked for
-        // if you point the the path to gzip you will serve the gzip as content type "application/x-gzip", not text or javascript etc...
-        if (!path.endsWith(FPSTR(mimeTable[gz].endsWith)) && !_fs.exists(path))  {
+        // the gz file is sent in place of the original to clients that take gzip, and
+        // to all of them when there is no original. Only a non compressed path is looked
+        // up that way, one pointing to the gzip is served as "application/x-gzip"
+        bool vary = false;
+        if (!path.endsWith(FPSTR(mimeTable[gz].endsWith)))  {
             String pathWithGz = path + FPSTR(mimeTable[gz].endsWith);
-            if(_fs.exists(pathWithGz))
-                path += FPSTR(mimeTable[gz].endsWith);
+            if (_fs.exists(pathWithGz)) {
+                bool original = _fs.exists(path);
+                vary = original;
+                if (acceptGz || !original)
+                    path = pathWithGz;
+            }
         }
 
         File f = _fs.open(path, "r");
         if (!f || !f.available())
-            return false;
+            return nullptr;
 
-        if (_cache_header.length() != 0)
-            server.sendHeader("Cache-Control", _cache_header);
+        FileEntry* entry = new FileEntry;
+        entry->uri = requestUri;
+        entry->path = path;
+        entry->size = f.size();
+        entry->etag = _makeETag(f);
+        entry->mime = fileType;
+        entry->gz = path.endsWith(FPSTR(mimeTable[gz].endsWith)) && fileType != gz && fileType != none;
+        entry->acceptGz = acceptGz;
+        entry->vary = vary;
+        entry->next = nullptr;
+        if (_cacheCount >= WEBSERVER_STATIC_CACHE_SIZE) {
+            // cache full, drop the oldest entry
+            FileEntry* oldest = _cache;
+            _cache = oldest->next;
+            delete oldest;
+            _cacheCount--;
+        }
+        FileEntry** tail = &_cache;
+        while (*tail)
+            tail = &(*tail)->next;
+        *tail = entry;
+        _cacheCount++;
+        return entry;
+    }
 
-        server.streamFile(f, contentType);
-        return true;
+    // gzip in Accept-Encoding and not refused with q=0
+    static bool _acceptsGzip(const String& acceptEncoding) {
+        int i = acceptEncoding.indexOf("gzip");
+        if (i < 0)
+            return false;
+        int end = acceptEncoding.indexOf(',', i);
+        String coding = acceptEncoding.substring(i, end < 0 ? acceptEncoding.length() : end);
+        coding.replace(" ", "");
+        return coding.indexOf(";q=0") < 0 || coding.indexOf(";q=0.") >= 0;
     }
 
-    static String getContentType(const String& path) {
-        char buff[sizeof(mimeTable[0].mimeType)];
-        // Check all entries but last one for match, return if found
-        for (size_t i=0; i < sizeof(mimeTable)/sizeof(mimeTable[0])-1; i++) {
-            strcpy_P(buff, mimeTable[i].endsWith);
-            if (path.endsWith(buff)) {
-                strcpy_P(buff, mimeTable[i].mimeType);
-                return String(buff);
+    void _forget(FileEntry* entry) {
+        for (FileEntry** p = &_cache; *p; p = &(*p)->next) {
+            if (*p == entry) {
+                *p = entry->next;
+                delete entry;
+                _cacheCount--;
+                return;
             }
         }
-        // Fall-through and just return default type
-        strcpy_P(buff, mimeTable[sizeof(mimeTable)/sizeof(mimeTable[0])-1].mimeType);
-        return String(buff);
     }
 
-protected:
+    // size and modification time, or a hash of the content where the file
+    // system keeps no time; read once when the file is cached
+    static String _makeETag(File& f) {
+        uint32_t stamp = (uint32_t) f.getLastWrite();
+        if (!stamp) {
+            uint8_t buf[128];
+            size_t len;
+            stamp = 2166136261UL;
+            while ((len = f.read(buf, sizeof(buf))) > 0) {
+                for (size_t i = 0; i < len; i++)
+                    stamp = (stamp ^ buf[i]) * 16777619UL;
+            }
+        }
+        return String("\"") + String(f.size(), HEX) + '-' + String(stamp, HEX) + '"';
+    }
+
+    // single "bytes=" range: 0 none or not understood (send everything),
+    // 1 start/length set, -1 not satisfiable
+    static int _parseRange(const String& header, size_t size, size_t& start, size_t& length) {
+        if (!header.startsWith("bytes=") || header.indexOf(',') >= 0)
+            return 0;
+        int dash = header.indexOf('-');
+        if (dash < 0)
+            return 0;
+        String first = header.substring(6, dash);
+        String last = header.substring(dash + 1);
+        first.trim();
+        last.trim();
+        size_t end = size ? size - 1 : 0;
+        if (first.length()) {
+            start = first.toInt();
+            if (last.length() && (size_t)last.toInt() < end)
+                end = last.toInt();
+        } else {
+            // suffix range, the last N bytes
+            size_t n = last.toInt();
+            if (!n)
+                return -1;
+            start = n < size ? size - n : 0;
+        }
+        if (!size || start >= size || end < start)
+            return -1;
+        length = end - start + 1;
+        return 1;
+    }
+
     FS _fs;
     String _uri;
     String _path;
     String _cache_header;
     bool _isFile;
     size_t _baseUriLength;
+    FileEntry* _cache;
+    uint8_t _cacheCount;
 };
 
 
@@ -0,0 +1,95 @@
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <Arduino.h>
+#include <errno.h>
+#include "lwip/sockets.h"
+
+// A reference counted block of bytes to send. It is serialized once and
+// queued for any number of connections.
+struct SharedBlock {
+  uint16_t refs;
+  size_t   len;
+
+  uint8_t* data() { return (uint8_t*)(this + 1); }
+
+  static SharedBlock* alloc(size_t len) {
+    SharedBlock* block = (SharedBlock*) heap_policy_malloc(HEAP_USER_WEB_SERVER, sizeof(SharedBlock) + len);
+    if (block) {
+      block->refs = 0;
+      block->len = len;
+    }
+    return block;
+  }
+
+  static void release(SharedBlock* block) {
+    if (block && !--block->refs) {
+      free(block);
+    }
+  }
+};
+
+// Blocks waiting for one connection, drained without blocking.
+template<uint8_t N>
+struct SendQueue {
+  SharedBlock* blocks[N];
+  uint8_t      head;
+  uint8_t      count;
+  size_t       offset; // bytes of blocks[head] already sent
+
+  void init() {
+    head = count = 0;
+    offset = 0;
+  }
+
+  bool full() const { return count == N; }
+
+  bool push(SharedBlock* block) {
+    if (full()) {
+      return false;
+    }
+    block->refs++;
+    blocks[(head + count) % N] = block;
+    count++;
+    return true;
+  }
+
+  void pop() {
+    SharedBlock::release(blocks[head]);
+    head = (head + 1) % N;
+    count--;
+    offset = 0;
+  }
+
+  void clear() {
+    while (count) {
+      pop();
+    }
+  }
+
+  // hands queued blocks to TCP until it stops taking them;
+  // returns the bytes sent, -1 once the connection failed
+  int drain(int fd) {
+    int sent = 0;
+    while (count) {
+      SharedBlock* block = blocks[head];
+      int res = lwip_send_r(fd, block->data() + offset, block->len - offset, MSG_DONTWAIT);
+      if (res < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          log_d("send failed on fd %d, errno: %d", fd, errno);
+          return -1;
+        }
+        break;
+      }
+      sent += res;
+      offset += res;
+      if (offset < block->len) {
+        break;
+      }
+      pop();
+    }
+    return sent;
+  }
+};
+
+#endif //SENDQUEUE_H
@@ -7,19 +7,15 @@
 class UriRegex : public Uri {
 
     public:
-        explicit UriRegex(const char *uri) : Uri(uri) {};
-        explicit UriRegex(const String &uri) : Uri(uri) {};
+        explicit UriRegex(const char *uri) : Uri(uri), _rgx(_uri.c_str()) {};
+        explicit UriRegex(const String &uri) : Uri(uri), _rgx(_uri.c_str()) {};
 
         Uri* clone() const override final {
             return new UriRegex(_uri);
         };
 
         void initPathArgs(std::vector<String> &pathArgs) override final {
-            std::regex rgx((_uri + "|").c_str());
-            std::smatch matches;
-            std::string s{""};
-            std::regex_search(s, matches, rgx);
-            pathArgs.resize(matches.size() - 1);
+            pathArgs.resize(_rgx.mark_count());
         }
 
         bool canHandle(const String &requestUri, std::vector<String> &pathArgs) override final {
@@ -27,10 +23,8 @@ class UriRegex : public Uri {
                 return true;
 
             unsigned int pathArgIndex = 0;
-            std::regex rgx(_uri.c_str());
-            std::smatch matches;
-            std::string s(requestUri.c_str());
-            if (std::regex_search(s, matches, rgx)) {
+            std::cmatch matches;
+            if (std::regex_search(requestUri.c_str(), matches, _rgx)) {
                 for (size_t i = 1; i < matches.size(); ++i) {  // skip first
                     pathArgs[pathArgIndex] = String(matches[i].str().c_str());
                     pathArgIndex++;
@@ -39,6 +33,10 @@ class UriRegex : public Uri {
             }
             return false;
         }
+
+    protected:
+        // compiled once, constructing a std::regex is far more expensive than matching
+        const std::regex _rgx;
 };
 
 #endif
@@ -0,0 +1,70 @@
+/*
+ *  This sketch captures the management and data frames on the channel of the AP
+ *  and streams them as pcap to whoever connects to port 5555:
+ *
+ *    nc <esp32 ip> 5555 | wireshark -k -i -
+ *
+ *  Frames sent to the ESP32 itself are left out, they would mostly be the stream.
+ */
+#include "WiFi.h"
+
+const char* ssid     = "your-ssid";
+const char* password = "your-password";
+
+WiFiServer server(5555);
+WiFiClient viewer;
+uint8_t ownMac[6];
+volatile uint32_t beacons = 0;
+
+bool notForUs(const wifi_promiscuous_pkt_t* pkt, wifi_promiscuous_pkt_type_t type)
+{
+    // addr1, the receiver, starts 4 bytes into the 802.11 header
+    return pkt->rx_ctrl.sig_len < 10 || memcmp(pkt->payload + 4, ownMac, 6) != 0;
+}
+
+void onFrame(const wifi_capture_frame_t& frame)
+{
+    if (frame.type == WIFI_PKT_MGMT && frame.length && frame.payload[0] == 0x80) {
+        beacons++;
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+        Serial.print(".");
+    }
+    Serial.println();
+    Serial.println(WiFi.localIP());
+
+    WiFi.macAddress(ownMac);
+    WiFi.setCaptureFilter(notForUs);
+    if (!WiFi.startCapture(WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_DATA, 32768, onFrame)) {
+        Serial.println("capture failed");
+    }
+    server.begin();
+}
+
+void loop()
+{
+    if (!viewer.connected()) {
+        WiFi.streamCapture(NULL);
+        viewer = server.available();
+        if (viewer) {
+            viewer.setNoDelay(true);
+            WiFi.streamCapture(&viewer);
+        }
+    }
+
+    static uint32_t last = 0;
+    if (millis() - last >= 5000) {
+        last = millis();
+        wifi_capture_stats_t stats;
+        WiFi.getCaptureStats(&stats);
+        Serial.printf("frames %u, dropped %u, streamed %u, ring peak %u, beacons %u\n",
+                      stats.frames, stats.dropped, stats.streamed, stats.ringPeak, beacons);
+    }
+}
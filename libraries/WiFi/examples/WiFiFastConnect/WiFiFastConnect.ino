@@ -0,0 +1,36 @@
+/*
+     Wakes up every minute, connects and goes back to deep sleep.
+     The first wake scans and runs DHCP, the ones after that go straight to the
+     same AP with the cached key and address.
+     Public domain
+*/
+
+#include <WiFi.h>
+
+const char* ssid     = "your_network_name";
+const char* password = "your_network_password";
+
+#define SLEEP_SECONDS 60
+
+void setup()
+{
+  Serial.begin(115200);
+
+  // true keeps the cache in NVS as well, so a power cycle skips the scan too
+  if (WiFi.beginFast(ssid, password, WIFI_FAST_CONNECT_TIMEOUT, true) == WL_CONNECTED) {
+    const wifi_fast_timing_t& t = WiFi.fastTiming();
+    Serial.printf("connected as %s in %u ms\n", WiFi.localIP().toString().c_str(), t.total);
+    Serial.printf("  pmk %u ms, associate %u ms, ip %u ms%s%s\n", t.pmk, t.associate, t.ip,
+                  t.staticIp ? ", cached lease" : "", t.fallback ? ", cached AP failed" : "");
+    // the work of this wake goes here
+  } else {
+    Serial.println("not connected");
+  }
+
+  esp_sleep_enable_timer_wakeup(SLEEP_SECONDS * 1000000ULL);
+  esp_deep_sleep_start();
+}
+
+void loop()
+{
+}
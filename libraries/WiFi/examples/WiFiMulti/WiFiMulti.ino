@@ -17,13 +17,18 @@ void setup()
     wifiMulti.addAP("ssid_from_AP_2", "your_password_for_AP_2");
     wifiMulti.addAP("ssid_from_AP_3", "your_password_for_AP_3");
 
+    // move to a stronger AP of the list when the signal gets weak
+    wifiMulti.setRoaming(true);
+
+    // run() does not block, it has to be called until the connection is up
     Serial.println("Connecting Wifi...");
-    if(wifiMulti.run() == WL_CONNECTED) {
-        Serial.println("");
-        Serial.println("WiFi connected");
-        Serial.println("IP address: ");
-        Serial.println(WiFi.localIP());
+    while(wifiMulti.run() != WL_CONNECTED) {
+        delay(10);
     }
+    Serial.println("");
+    Serial.println("WiFi connected");
+    Serial.println("IP address: ");
+    Serial.println(WiFi.localIP());
 }
 
 void loop()
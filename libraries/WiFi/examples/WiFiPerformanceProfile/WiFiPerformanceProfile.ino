@@ -0,0 +1,101 @@
+/*
+     Measures what each WiFi.setPerformanceProfile() preset does on your network.
+
+     For every profile the sketch times TCP connects to a host on the LAN
+     (round trip latency) and a download (throughput), then idles for a while
+     so the supply current can be read off a meter.
+
+     What to expect:
+     - WIFI_PROFILE_DEFAULT     modem sleep between DTIM beacons, the core's
+                                usual setting. Latency jumps by up to a beacon
+                                interval when the radio was asleep.
+     - WIFI_PROFILE_LOW_LATENCY radio always on, the lowest and steadiest
+                                latency and the highest idle current.
+     - WIFI_PROFILE_THROUGHPUT  radio always on with HT40 and a wide block
+                                ack window, the best download rate if the AP
+                                does HT40. The window only applies when the
+                                profile is set before WiFi starts, as below.
+     - WIFI_PROFILE_BATTERY     sleeps over 10 beacons with reduced TX power,
+                                the lowest idle current, the slowest to answer.
+     Public domain
+*/
+
+#include <WiFi.h>
+
+const char* ssid     = "your_network_name";
+const char* password = "your_network_password";
+const char* host     = "192.168.1.10";  // a machine on the LAN with a web server
+const uint16_t port  = 80;
+const char* path     = "/10MB.bin";     // something big to download
+
+#define IDLE_SECONDS 20
+
+const wifi_profile_t profiles[] = { WIFI_PROFILE_DEFAULT, WIFI_PROFILE_LOW_LATENCY, WIFI_PROFILE_THROUGHPUT, WIFI_PROFILE_BATTERY };
+const char* names[] = { "default", "low latency", "throughput", "battery" };
+
+void measure()
+{
+  WiFiClient client;
+  uint32_t total = 0, worst = 0;
+  for (int i = 0; i < 10; i++) {
+    uint32_t start = micros();
+    if (!client.connect(host, port)) {
+      Serial.println("  connect failed");
+      return;
+    }
+    uint32_t took = micros() - start;
+    client.stop();
+    total += took;
+    worst = max(worst, took);
+    delay(500);  // long enough for the modem to go back to sleep
+  }
+  Serial.printf("  connect: %u us average, %u us worst\n", total / 10, worst);
+
+  if (!client.connect(host, port)) {
+    return;
+  }
+  client.printf("GET %s HTTP/1.0\r\nHost: %s\r\n\r\n", path, host);
+  uint8_t buf[1460];
+  size_t bytes = 0;
+  uint32_t start = millis();
+  while (client.connected() || client.available()) {
+    int n = client.read(buf, sizeof(buf));
+    if (n > 0) {
+      bytes += n;
+    }
+  }
+  uint32_t ms = millis() - start;
+  client.stop();
+  Serial.printf("  download: %u bytes in %u ms, %.2f Mbit/s\n", bytes, ms, ms ? bytes * 8.0 / ms / 1000.0 : 0.0);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+
+  // before begin() so the block ack windows of the throughput profile are used
+  WiFi.setPerformanceProfile(WIFI_PROFILE_THROUGHPUT);
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(100);
+  }
+  Serial.println(WiFi.localIP());
+}
+
+void loop()
+{
+  for (int p = 0; p < 4; p++) {
+    WiFi.setPerformanceProfile(profiles[p]);
+    Serial.printf("%s:\n", names[p]);
+    // a new listen interval is only used after associating again
+    if (profiles[p] == WIFI_PROFILE_BATTERY) {
+      WiFi.reconnect();
+      while (WiFi.status() != WL_CONNECTED) {
+        delay(100);
+      }
+    }
+    measure();
+    Serial.printf("  idle for %u s, read the current now\n", IDLE_SECONDS);
+    delay(IDLE_SECONDS * 1000);
+  }
+}
@@ -25,6 +25,8 @@
 #include "eth_phy/phy_ip101.h"
 #include "lwip/err.h"
 #include "lwip/dns.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
 
 extern void tcpipInit();
 
@@ -33,6 +35,10 @@ static int _eth_phy_mdio_pin = -1;
 static int _eth_phy_power_pin = -1;
 static eth_phy_power_enable_func _eth_phy_power_enable_orig = NULL;
 
+static eth_stats_t _eth_stats;
+static bool _eth_rx_zero_copy = false;
+static netif_linkoutput_fn _eth_linkoutput_orig = NULL;
+
 static void _eth_phy_config_gpio(void)
 {
     if(_eth_phy_mdc_pin < 0 || _eth_phy_mdio_pin < 0){
@@ -50,7 +56,112 @@ static void _eth_phy_power_enable(bool enable)
     delay(1);
 }
 
-ETHClass::ETHClass():initialized(false),started(false),staticIP(false)
+/*
+ * The EMAC hands every frame over in a buffer of its own that stays taken until
+ * esp_eth_free_rx_buf(). The stock input copies it into a PBUF_RAM and frees it,
+ * in zero copy mode the buffer is wrapped in a custom pbuf instead and freed when
+ * the stack lets go of the frame. The pool bounds how many frames may be held that
+ * way, once it runs dry frames are copied again.
+ */
+#if LWIP_SUPPORT_CUSTOM_PBUF
+typedef struct eth_rx_pbuf_s {
+    struct pbuf_custom p;
+    void * buffer;
+    struct eth_rx_pbuf_s * next;
+} eth_rx_pbuf_t;
+
+static eth_rx_pbuf_t _eth_rx_pool[ETH_RX_ZERO_COPY_POOL];
+static eth_rx_pbuf_t * _eth_rx_free = NULL;
+static bool _eth_rx_pool_ready = false;
+static portMUX_TYPE _eth_rx_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void _eth_rx_pbuf_free(struct pbuf * p)
+{
+    eth_rx_pbuf_t * rx = (eth_rx_pbuf_t *)p;
+    esp_eth_free_rx_buf(rx->buffer);
+    portENTER_CRITICAL(&_eth_rx_mux);
+    rx->next = _eth_rx_free;
+    _eth_rx_free = rx;
+    _eth_stats.zeroCopyInUse--;
+    portEXIT_CRITICAL(&_eth_rx_mux);
+}
+
+static struct pbuf * _eth_rx_pbuf_wrap(void * buffer, uint16_t len)
+{
+    portENTER_CRITICAL(&_eth_rx_mux);
+    eth_rx_pbuf_t * rx = _eth_rx_free;
+    if(rx){
+        _eth_rx_free = rx->next;
+        if(++_eth_stats.zeroCopyInUse > _eth_stats.zeroCopyPeak){
+            _eth_stats.zeroCopyPeak = _eth_stats.zeroCopyInUse;
+        }
+    }
+    portEXIT_CRITICAL(&_eth_rx_mux);
+    if(!rx){
+        return NULL;
+    }
+    rx->buffer = buffer;
+    rx->p.custom_free_function = _eth_rx_pbuf_free;
+    return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx->p, buffer, len);
+}
+#endif
+
+static err_t _eth_linkoutput(struct netif * netif, struct pbuf * p)
+{
+    err_t err = _eth_linkoutput_orig(netif, p);
+    if(err == ERR_OK){
+        _eth_stats.txFrames++;
+        _eth_stats.txBytes += p->tot_len;
+    } else {
+        _eth_stats.txErrors++;
+    }
+    return err;
+}
+
+static esp_err_t _eth_tcpip_input(void * buffer, uint16_t len, void * eb)
+{
+    struct netif * netif = NULL;
+    if(tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_ETH, (void **)&netif) != ESP_OK || !netif_is_up(netif)){
+        esp_eth_free_rx_buf(buffer);
+        _eth_stats.rxDropped++;
+        return ESP_OK;
+    }
+    if(netif->linkoutput != _eth_linkoutput){
+        _eth_linkoutput_orig = netif->linkoutput;
+        netif->linkoutput = _eth_linkoutput;
+    }
+
+    struct pbuf * p = NULL;
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    if(_eth_rx_zero_copy){
+        p = _eth_rx_pbuf_wrap(buffer, len);
+    }
+#endif
+    bool zeroCopy = p != NULL;
+    if(!p){
+        p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+        if(!p){
+            esp_eth_free_rx_buf(buffer);
+            _eth_stats.rxNoMem++;
+            return ESP_OK;
+        }
+        memcpy(p->payload, buffer, len);
+        esp_eth_free_rx_buf(buffer);
+    }
+    if(netif->input(p, netif) != ERR_OK){
+        pbuf_free(p);
+        _eth_stats.rxQueueFull++;
+        return ESP_OK;
+    }
+    _eth_stats.rxFrames++;
+    _eth_stats.rxBytes += len;
+    if(zeroCopy){
+        _eth_stats.rxZeroCopy++;
+    }
+    return ESP_OK;
+}
+
+ETHClass::ETHClass():initialized(false),started(false),staticIP(false),flowControl(true)
 {
 }
 
@@ -90,7 +201,8 @@ bool ETHClass::begin(uint8_t phy_addr, int power, int mdc, int mdio, eth_phy_typ
     eth_config.phy_addr = (eth_phy_base_t)phy_addr;
     eth_config.clock_mode = clock_mode;
     eth_config.gpio_config = _eth_phy_config_gpio;
-    eth_config.tcpip_input = tcpip_adapter_eth_input;
+    eth_config.tcpip_input = _eth_tcpip_input;
+    eth_config.flow_ctrl_enable = flowControl;
     if(_eth_phy_power_pin >= 0){
         _eth_phy_power_enable_orig = eth_config.phy_power_enable;
         eth_config.phy_power_enable = _eth_phy_power_enable;
@@ -257,6 +369,74 @@ uint8_t ETHClass::linkSpeed()
     return eth_config.phy_get_speed_mode()?100:10;
 }
 
+bool ETHClass::setFlowControl(bool enable)
+{
+    if(initialized){
+        log_e("flow control has to be set before begin()");
+        return false;
+    }
+    flowControl = enable;
+    return true;
+}
+
+bool ETHClass::setRxZeroCopy(bool enable)
+{
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    if(enable && !_eth_rx_pool_ready){
+        for(int i = 0; i < ETH_RX_ZERO_COPY_POOL; i++){
+            _eth_rx_pool[i].next = (i + 1 < ETH_RX_ZERO_COPY_POOL)?&_eth_rx_pool[i + 1]:NULL;
+        }
+        _eth_rx_free = &_eth_rx_pool[0];
+        _eth_rx_pool_ready = true;
+    }
+    _eth_rx_zero_copy = enable;
+    return true;
+#else
+    if(enable){
+        log_e("zero copy needs custom pbufs in lwIP");
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool ETHClass::getStats(eth_stats_t * stats)
+{
+    if(!stats){
+        return false;
+    }
+    memcpy(stats, &_eth_stats, sizeof(eth_stats_t));
+    stats->rxDmaBuffers = CONFIG_DMA_RX_BUF_NUM;
+    stats->txDmaBuffers = CONFIG_DMA_TX_BUF_NUM;
+    if(!initialized){
+        stats->speed = 0;
+        stats->fullDuplex = false;
+        stats->link = false;
+        stats->flowControl = false;
+        return true;
+    }
+    stats->link = eth_config.phy_check_link();
+    stats->speed = eth_config.phy_get_speed_mode()?100:10;
+    stats->fullDuplex = eth_config.phy_get_duplex_mode();
+    stats->flowControl = eth_config.flow_ctrl_enable && stats->fullDuplex
+        && eth_config.phy_get_partner_pause_enable && eth_config.phy_get_partner_pause_enable();
+    return true;
+}
+
+void ETHClass::resetStats()
+{
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    portENTER_CRITICAL(&_eth_rx_mux);
+#endif
+    uint16_t inUse = _eth_stats.zeroCopyInUse;
+    memset(&_eth_stats, 0, sizeof(eth_stats_t));
+    _eth_stats.zeroCopyInUse = inUse;
+    _eth_stats.zeroCopyPeak = inUse;
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    portEXIT_CRITICAL(&_eth_rx_mux);
+#endif
+}
+
 bool ETHClass::enableIpV6()
 {
     return tcpip_adapter_create_ip6_linklocal(TCPIP_ADAPTER_IF_ETH) == 0;
@@ -48,13 +48,38 @@
 #define ETH_CLK_MODE ETH_CLOCK_GPIO0_IN
 #endif
 
+#ifndef ETH_RX_ZERO_COPY_POOL
+#define ETH_RX_ZERO_COPY_POOL 16 // received frames the stack may hold without a copy
+#endif
+
 typedef enum { ETH_PHY_LAN8720, ETH_PHY_TLK110, ETH_PHY_IP101, ETH_PHY_MAX } eth_phy_type_t;
 
+typedef struct {
+    uint32_t rxFrames;       // frames handed to the stack
+    uint32_t rxBytes;
+    uint32_t rxZeroCopy;     // of those, passed on in the EMAC buffer
+    uint32_t rxDropped;      // the interface was down
+    uint32_t rxNoMem;        // no pbuf for the frame
+    uint32_t rxQueueFull;    // the TCP/IP task did not take it
+    uint32_t txFrames;
+    uint32_t txBytes;
+    uint32_t txErrors;
+    uint16_t zeroCopyInUse;  // frames the stack holds right now
+    uint16_t zeroCopyPeak;
+    uint8_t rxDmaBuffers;    // DMA buffers of the EMAC, fixed when the SDK is built
+    uint8_t txDmaBuffers;
+    uint8_t speed;           // 10 or 100
+    bool fullDuplex;
+    bool link;
+    bool flowControl;
+} eth_stats_t;
+
 class ETHClass {
     private:
         bool initialized;
         bool started;
         bool staticIP;
+        bool flowControl;
         eth_config_t eth_config;
     public:
         ETHClass();
@@ -71,6 +96,11 @@ class ETHClass {
         bool linkUp();
         uint8_t linkSpeed();
 
+        bool setFlowControl(bool enable);
+        bool setRxZeroCopy(bool enable);
+        bool getStats(eth_stats_t * stats);
+        void resetStats();
+
         bool enableIpV6();
         IPv6Address localIPv6();
 
@@ -32,13 +32,14 @@
 #include "WiFiSTA.h"
 #include "WiFiAP.h"
 #include "WiFiScan.h"
+#include "WiFiCapture.h"
 #include "WiFiGeneric.h"
 
 #include "WiFiClient.h"
 #include "WiFiServer.h"
 #include "WiFiUdp.h"
 
-class WiFiClass : public WiFiGenericClass, public WiFiSTAClass, public WiFiScanClass, public WiFiAPClass
+class WiFiClass : public WiFiGenericClass, public WiFiSTAClass, public WiFiScanClass, public WiFiAPClass, public WiFiCaptureClass
 {
 private:
     bool prov_enable;
@@ -0,0 +1,400 @@
+/*
+ WiFiCapture.cpp - promiscuous mode capture for the ESP32
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "WiFi.h"
+#include "WiFiCapture.h"
+
+extern "C" {
+#include <esp_err.h>
+#include <esp_wifi.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+}
+
+#include "esp32-hal-log.h"
+
+#define CAPTURE_RADIOTAP_LEN 13 // version, pad, length, present, channel, antenna signal
+
+// in front of each frame in the ring, size 0 tells the reader the rest of the ring is unused
+typedef struct {
+    uint16_t size;       // of the record with the frame, a multiple of 4
+    uint16_t length;
+    uint16_t origLength;
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t type;
+    uint8_t rate;
+    uint16_t reserved;
+    int64_t timestamp;
+} capture_record_t;
+
+// one writer, the driver callback, moves _head and one reader, the task, moves _tail
+static uint8_t* _ring = NULL;
+static uint32_t _ringSize = 0;
+static volatile uint32_t _head = 0;
+static volatile uint32_t _tail = 0;
+
+static volatile bool _accepting = false;
+static volatile bool _running = false;
+static TaskHandle_t _task = NULL;
+static WiFiCaptureCb _callback = NULL;
+static WiFiCaptureFilter _filter = NULL;
+static uint16_t _snapLen = WIFI_CAPTURE_SNAPLEN;
+static Print* volatile _stream = NULL;
+static volatile bool _streamHeader = false;
+static volatile bool _streamBusy = false;  // the task holds a copy of _stream
+static wifi_capture_stats_t _stats;
+
+static inline uint32_t _used(uint32_t head, uint32_t tail)
+{
+    return (head >= tail) ? head - tail : _ringSize - tail + head;
+}
+
+/**
+ * Runs in the WiFi task for every frame the filter let through
+ * Copies what fits of it into the ring or counts it as dropped, never waits
+ */
+void WiFiCaptureClass::_promiscuousRx(void* buf, wifi_promiscuous_pkt_type_t type)
+{
+    if(!_accepting) {
+        return;
+    }
+    const wifi_promiscuous_pkt_t* pkt = (const wifi_promiscuous_pkt_t*)buf;
+    if(_filter && !_filter(pkt, type)) {
+        _stats.filtered++;
+        return;
+    }
+    uint16_t origLength = 0;
+    if(type != WIFI_PKT_MISC && pkt->rx_ctrl.sig_len > 4) {
+        origLength = pkt->rx_ctrl.sig_len - 4;
+    }
+    uint16_t length = origLength > _snapLen ? _snapLen : origLength;
+    uint32_t need = (sizeof(capture_record_t) + length + 3) & ~3;
+
+    uint32_t head = _head;
+    uint32_t tail = _tail;
+    uint32_t at;
+    if(head >= tail) {
+        // the record may end exactly at the end of the ring, unless the reader is at 0
+        if(_ringSize - head > need || (_ringSize - head == need && tail)) {
+            at = head;
+        } else if(tail > need) {
+            ((capture_record_t*)(_ring + head))->size = 0;
+            at = 0;
+        } else {
+            _stats.dropped++;
+            return;
+        }
+    } else if(tail - head > need) {
+        at = head;
+    } else {
+        _stats.dropped++;
+        return;
+    }
+
+    capture_record_t* rec = (capture_record_t*)(_ring + at);
+    rec->size = need;
+    rec->length = length;
+    rec->origLength = origLength;
+    rec->rssi = pkt->rx_ctrl.rssi;
+    rec->channel = pkt->rx_ctrl.channel;
+    rec->type = type;
+    rec->rate = pkt->rx_ctrl.sig_mode ? (0x80 | pkt->rx_ctrl.mcs) : pkt->rx_ctrl.rate;
+    rec->timestamp = esp_timer_get_time();
+    memcpy(rec + 1, pkt->payload, length);
+
+    uint32_t next = at + need;
+    if(next == _ringSize) {
+        next = 0;
+    }
+    // the record has to be in memory before the reader can see it
+    __sync_synchronize();
+    _head = next;
+
+    _stats.frames++;
+    _stats.bytes += length;
+    if(length < origLength) {
+        _stats.truncated++;
+    }
+    uint32_t used = _used(next, tail);
+    if(used > _stats.ringPeak) {
+        _stats.ringPeak = used;
+    }
+    if(head == tail && _task) {
+        xTaskNotifyGive(_task);
+    }
+}
+
+static bool _writeStream(Print* out, const void* data, size_t length)
+{
+    if(out->write((const uint8_t*)data, length) != length) {
+        log_w("capture stream failed, stopping it");
+        _stream = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void _streamFrame(Print* out, const capture_record_t* rec, int64_t wallOffset)
+{
+    uint8_t header[16 + CAPTURE_RADIOTAP_LEN];
+    int64_t wall = rec->timestamp + wallOffset;
+    uint32_t value[4] = {
+        (uint32_t)(wall / 1000000LL),
+        (uint32_t)(wall % 1000000LL),
+        (uint32_t)(rec->length + CAPTURE_RADIOTAP_LEN),
+        (uint32_t)(rec->origLength + CAPTURE_RADIOTAP_LEN)
+    };
+    memcpy(header, value, sizeof(value));
+
+    // radiotap: channel and dBm antenna signal present
+    uint8_t* rt = header + 16;
+    uint16_t freq = (rec->channel == 14) ? 2484 : 2407 + 5 * rec->channel;
+    rt[0] = 0;
+    rt[1] = 0;
+    rt[2] = CAPTURE_RADIOTAP_LEN;
+    rt[3] = 0;
+    rt[4] = (1 << 3) | (1 << 5);
+    rt[5] = 0;
+    rt[6] = 0;
+    rt[7] = 0;
+    rt[8] = freq;
+    rt[9] = freq >> 8;
+    rt[10] = 0x80; // 2 GHz
+    rt[11] = 0;
+    rt[12] = rec->rssi;
+
+    if(_writeStream(out, header, sizeof(header)) && _writeStream(out, rec + 1, rec->length)) {
+        _stats.streamed++;
+    }
+}
+
+void WiFiCaptureClass::_captureTask(void* arg)
+{
+    int64_t wallOffset = 0;
+    while(_running) {
+        uint32_t tail = _tail;
+        if(tail == _head) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
+        }
+        const capture_record_t* rec = (const capture_record_t*)(_ring + tail);
+        if(!rec->size) {
+            _tail = 0;
+            continue;
+        }
+
+        if(_callback) {
+            wifi_capture_frame_t frame;
+            frame.timestamp = rec->timestamp;
+            frame.payload = (const uint8_t*)(rec + 1);
+            frame.length = rec->length;
+            frame.origLength = rec->origLength;
+            frame.rssi = rec->rssi;
+            frame.channel = rec->channel;
+            frame.type = rec->type;
+            frame.rate = rec->rate;
+            _callback(frame);
+        }
+
+        _streamBusy = true;
+        __sync_synchronize();
+        Print* out = _stream;
+        if(out && _streamHeader) {
+            _streamHeader = false;
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            wallOffset = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec - esp_timer_get_time();
+            // pcap, microsecond timestamps, LINKTYPE_IEEE802_11_RADIOTAP
+            uint32_t global[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, (uint32_t)(_snapLen + CAPTURE_RADIOTAP_LEN), 127 };
+            if(!_writeStream(out, global, sizeof(global))) {
+                out = NULL;
+            }
+        }
+        if(out) {
+            _streamFrame(out, rec, wallOffset);
+        }
+        _streamBusy = false;
+        _stats.processed++;
+
+        uint32_t next = tail + rec->size;
+        if(next == _ringSize) {
+            next = 0;
+        }
+        // done with the record before the writer may reuse it
+        __sync_synchronize();
+        _tail = next;
+    }
+    _task = NULL;
+    vTaskDelete(NULL);
+}
+
+/**
+ * Start capturing frames in promiscuous mode
+ * The driver callback copies each frame, up to snapLen bytes, into a ring of ringBytes and a task
+ * hands them to cb and streamCapture(). When the task falls behind and the ring is full frames are
+ * dropped and counted, the driver is never held up.
+ * @param filter    WIFI_PROMIS_FILTER_MASK_* of the frames wanted
+ * @param ringBytes size of the ring
+ * @param cb        called on the capture task for each frame, may be NULL when only streaming
+ * @param snapLen   bytes kept of each frame
+ * @return true when capturing
+ */
+bool WiFiCaptureClass::startCapture(uint32_t filter, size_t ringBytes, WiFiCaptureCb cb, uint16_t snapLen)
+{
+    if(_running) {
+        stopCapture();
+    }
+    if(!snapLen) {
+        snapLen = WIFI_CAPTURE_SNAPLEN;
+    }
+    ringBytes &= ~3;
+    // a few full frames have to fit, or nearly all of them would be dropped
+    if(ringBytes < 4 * (sizeof(capture_record_t) + snapLen)) {
+        log_e("ring of %u bytes is too small for a snap length of %u", ringBytes, snapLen);
+        return false;
+    }
+    if(WiFi.getMode() == WIFI_MODE_NULL && !WiFi.enableSTA(true)) {
+        log_e("WiFi could not be started");
+        return false;
+    }
+
+    _ring = (uint8_t*)malloc(ringBytes);
+    if(!_ring) {
+        log_e("no memory for a %u byte ring", ringBytes);
+        return false;
+    }
+    _ringSize = ringBytes;
+    _head = 0;
+    _tail = 0;
+    _snapLen = snapLen;
+    _callback = cb;
+    memset(&_stats, 0, sizeof(_stats));
+
+    _running = true;
+    if(xTaskCreateUniversal(_captureTask, "wifi_capture", WIFI_CAPTURE_TASK_STACK_SIZE, NULL, WIFI_CAPTURE_TASK_PRIORITY, &_task, WIFI_CAPTURE_TASK_RUNNING_CORE) != pdPASS) {
+        log_e("capture task could not be started");
+        _running = false;
+        _task = NULL;
+        free(_ring);
+        _ring = NULL;
+        return false;
+    }
+
+    wifi_promiscuous_filter_t promiscuous = { .filter_mask = filter };
+    esp_wifi_set_promiscuous_filter(&promiscuous);
+    if(filter & WIFI_PROMIS_FILTER_MASK_CTRL) {
+        wifi_promiscuous_filter_t ctrl = { .filter_mask = WIFI_PROMIS_CTRL_FILTER_MASK_ALL };
+        esp_wifi_set_promiscuous_ctrl_filter(&ctrl);
+    }
+    esp_wifi_set_promiscuous_rx_cb(_promiscuousRx);
+    _accepting = true;
+    esp_err_t err = esp_wifi_set_promiscuous(true);
+    if(err != ESP_OK) {
+        log_e("promiscuous mode failed: %d", err);
+        stopCapture();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Stop capturing, frames still in the ring are thrown away
+ */
+void WiFiCaptureClass::stopCapture()
+{
+    _accepting = false;
+    esp_wifi_set_promiscuous(false);
+    esp_wifi_set_promiscuous_rx_cb(NULL);
+    if(_task) {
+        _running = false;
+        xTaskNotifyGive(_task);
+        while(_task) {
+            delay(1);
+        }
+    }
+    _running = false;
+    _stream = NULL;
+    free(_ring);
+    _ring = NULL;
+    _ringSize = 0;
+    _callback = NULL;
+}
+
+bool WiFiCaptureClass::capturing()
+{
+    return _running;
+}
+
+/**
+ * Set a function the driver callback asks about each frame before copying it
+ * @param filter WiFiCaptureFilter, NULL takes every frame the mask lets through
+ */
+void WiFiCaptureClass::setCaptureFilter(WiFiCaptureFilter filter)
+{
+    _filter = filter;
+}
+
+/**
+ * Move the radio to another channel, it only stays there while the STA is not connected
+ * @param channel 1 to 14
+ */
+bool WiFiCaptureClass::setCaptureChannel(uint8_t channel)
+{
+    esp_err_t err = esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    if(err != ESP_OK) {
+        log_e("channel %u could not be set: %d", channel, err);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write the captured frames as pcap with radiotap headers, for Wireshark on the other side
+ * out is written from the capture task: a WiFiClient connected to `nc -l 5555 | wireshark -k -i -`
+ * or a Serial at a high baud rate. A failed write stops the stream. Once this returns the task no
+ * longer writes to the previous stream.
+ * @param out Print*, NULL stops streaming
+ */
+bool WiFiCaptureClass::streamCapture(Print* out)
+{
+    if(out && !_running) {
+        log_e("not capturing");
+        return false;
+    }
+    _stream = NULL;
+    __sync_synchronize();
+    // the old stream may be in use by the task until it is done with this frame
+    while(_streamBusy && _task && xTaskGetCurrentTaskHandle() != _task) {
+        delay(1);
+    }
+    _streamHeader = true;
+    _stream = out;
+    return true;
+}
+
+void WiFiCaptureClass::getCaptureStats(wifi_capture_stats_t* stats)
+{
+    if(!stats) {
+        return;
+    }
+    *stats = _stats;
+    stats->ringUsed = _ring ? _used(_head, _tail) : 0;
+}
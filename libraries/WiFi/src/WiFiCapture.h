@@ -0,0 +1,92 @@
+/*
+ WiFiCapture.h - promiscuous mode capture for the ESP32
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef ESP32WIFICAPTURE_H_
+#define ESP32WIFICAPTURE_H_
+
+#include "WiFiType.h"
+#include "WiFiGeneric.h"
+#include "Print.h"
+#include <functional>
+
+#ifndef WIFI_CAPTURE_RING_SIZE
+#define WIFI_CAPTURE_RING_SIZE 32768 // bytes of frames waiting for the capture task
+#endif
+
+#ifndef WIFI_CAPTURE_SNAPLEN
+#define WIFI_CAPTURE_SNAPLEN 256 // bytes kept of each frame, enough for the headers of most
+#endif
+
+#ifndef WIFI_CAPTURE_TASK_STACK_SIZE
+#define WIFI_CAPTURE_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef WIFI_CAPTURE_TASK_PRIORITY
+#define WIFI_CAPTURE_TASK_PRIORITY 2
+#endif
+
+#ifndef WIFI_CAPTURE_TASK_RUNNING_CORE
+#define WIFI_CAPTURE_TASK_RUNNING_CORE -1
+#endif
+
+// one frame out of the ring, payload is only valid during the callback
+typedef struct {
+    int64_t timestamp;      // esp_timer_get_time() when the driver handed it over
+    const uint8_t* payload; // from the 802.11 header on, FCS stripped
+    uint16_t length;        // bytes in payload, at most the snap length
+    uint16_t origLength;    // of the frame on air, FCS stripped
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t type;           // wifi_promiscuous_pkt_type_t
+    uint8_t rate;           // rx_ctrl.rate for 11b/g, 0x80 | MCS for 11n
+} wifi_capture_frame_t;
+
+typedef struct {
+    uint32_t frames;        // copied into the ring
+    uint32_t bytes;
+    uint32_t dropped;       // the ring was full
+    uint32_t filtered;      // refused by the setCaptureFilter() function
+    uint32_t truncated;     // longer than the snap length
+    uint32_t processed;     // handed to the callback and the stream
+    uint32_t streamed;      // written to the stream
+    uint32_t ringUsed;      // bytes in the ring now
+    uint32_t ringPeak;      // most there have been
+} wifi_capture_stats_t;
+
+typedef std::function<void(const wifi_capture_frame_t& frame)> WiFiCaptureCb;
+// runs in the WiFi driver for every frame, has to be quick, false leaves the frame out
+typedef bool (*WiFiCaptureFilter)(const wifi_promiscuous_pkt_t* pkt, wifi_promiscuous_pkt_type_t type);
+
+class WiFiCaptureClass
+{
+public:
+    static bool startCapture(uint32_t filter = WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_DATA, size_t ringBytes = WIFI_CAPTURE_RING_SIZE, WiFiCaptureCb cb = NULL, uint16_t snapLen = WIFI_CAPTURE_SNAPLEN);
+    static void stopCapture();
+    static bool capturing();
+
+    static void setCaptureFilter(WiFiCaptureFilter filter);
+    static bool setCaptureChannel(uint8_t channel);
+    static bool streamCapture(Print* out);
+    static void getCaptureStats(wifi_capture_stats_t* stats);
+
+protected:
+    static void _promiscuousRx(void* buf, wifi_promiscuous_pkt_type_t type);
+    static void _captureTask(void* arg);
+};
+
+#endif /* ESP32WIFICAPTURE_H_ */
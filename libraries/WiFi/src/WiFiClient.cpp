@@ -26,17 +26,24 @@
 #define WIFI_CLIENT_MAX_WRITE_RETRY   (10)
 #define WIFI_CLIENT_SELECT_TIMEOUT_US (1000000)
 #define WIFI_CLIENT_FLUSH_BUFFER_SIZE (1024)
+#define WIFI_CLIENT_RX_BUFFER_SIZE    (1436)
+#define WIFI_CLIENT_STREAM_CHUNK_SIZE (1436)
 
 #undef connect
 #undef write
 #undef read
 
+static pool_t * _rxBufferPool = NULL;
+size_t WiFiClient::_streamChunkSize = WIFI_CLIENT_STREAM_CHUNK_SIZE;
+
 class WiFiClientRxBuffer {
 private:
         size_t _size;
         uint8_t *_buffer;
+        pool_t *_pool;
         size_t _pos;
         size_t _fill;
+        size_t _sockAvail; // FIONREAD at the last query, minus what was received since
         int _fd;
         bool _failed;
 
@@ -51,11 +58,48 @@ private:
                 _failed = true;
                 return 0;
             }
+            _sockAvail = count;
             return count;
         }
 
+        int r_recv(uint8_t * dst, size_t len)
+        {
+            int res = recv(_fd, dst, len, MSG_DONTWAIT);
+            if(res < 0) {
+                if(errno != EWOULDBLOCK) {
+                    _failed = true;
+                }
+                return 0;
+            }
+            _sockAvail = ((size_t)res < _sockAvail) ? _sockAvail - res : 0;
+            return res;
+        }
+
+        void selectPool()
+        {
+            pool_stats_t stats;
+            _pool = NULL;
+            if(_rxBufferPool){
+                poolGetStats(_rxBufferPool, &stats);
+                if(stats.blockSize >= _size){
+                    _pool = _rxBufferPool;
+                }
+            }
+        }
+
+        void releaseBuffer()
+        {
+            if(!poolFree(_pool, _buffer)){
+                free(_buffer);
+            }
+            _buffer = NULL;
+        }
+
         size_t fillBuffer()
         {
+            if(!_buffer && _pool){
+                _buffer = (uint8_t *)poolAlloc(_pool);
+            }
             if(!_buffer){
                 _buffer = (uint8_t *)malloc(_size);
                 if(!_buffer) {
@@ -68,74 +112,88 @@ private:
                 _fill = 0;
                 _pos = 0;
             }
-            if(!_buffer || _size <= _fill || !r_available()) {
-                return 0;
-            }
-            int res = recv(_fd, _buffer + _fill, _size - _fill, MSG_DONTWAIT);
-            if(res < 0) {
-                if(errno != EWOULDBLOCK) {
-                    _failed = true;
-                }
+            if(_fd < 0 || _size <= _fill) {
                 return 0;
             }
+            // recv() reports an empty socket itself, no FIONREAD round trip first
+            int res = r_recv(_buffer + _fill, _size - _fill);
             _fill += res;
             return res;
         }
 
 public:
-    WiFiClientRxBuffer(int fd, size_t size=1436)
+    WiFiClientRxBuffer(int fd, size_t size=WIFI_CLIENT_RX_BUFFER_SIZE)
         :_size(size)
         ,_buffer(NULL)
+        ,_pool(NULL)
         ,_pos(0)
         ,_fill(0)
+        ,_sockAvail(0)
         ,_fd(fd)
         ,_failed(false)
     {
-        //_buffer = (uint8_t *)malloc(_size);
+        selectPool();
     }
 
     ~WiFiClientRxBuffer()
     {
-        free(_buffer);
+        releaseBuffer();
     }
 
     bool failed(){
         return _failed;
     }
 
+    // only while nothing is buffered, the next fill allocates the new size
+    bool setSize(size_t size){
+        if(!size || _pos != _fill){
+            return false;
+        }
+        releaseBuffer();
+        _pos = _fill = 0;
+        _size = size;
+        selectPool();
+        return true;
+    }
+
     int read(uint8_t * dst, size_t len){
-        if(!dst || !len || (_pos == _fill && !fillBuffer())){
+        if(!dst || !len){
             return _failed ? -1 : 0;
         }
-        size_t a = _fill - _pos;
-        if(len <= a || ((len - a) <= (_size - _fill) && fillBuffer() >= (len - a))){
-            if(len == 1){
-                *dst = _buffer[_pos];
-            } else {
-                memcpy(dst, _buffer + _pos, len);
-            }
-            _pos += len;
-            return len;
-        }
         size_t left = len;
-        size_t toRead = a;
-        uint8_t * buf = dst;
-        memcpy(buf, _buffer + _pos, toRead);
-        _pos += toRead;
-        left -= toRead;
-        buf += toRead;
         while(left){
-            if(!fillBuffer()){
-                return len - left;
+            if(_pos == _fill){
+                if(left >= _size && _fd >= 0){
+                    // large reads go straight from the socket into dst
+                    int res = r_recv(dst, left);
+                    if(!res){
+                        break;
+                    }
+                    dst += res;
+                    left -= res;
+                    continue;
+                }
+                if(!fillBuffer()){
+                    break;
+                }
+            }
+            size_t toRead = _fill - _pos;
+            if(toRead > left){
+                toRead = left;
+            }
+            if(toRead == 1){
+                *dst = _buffer[_pos];
+            } else {
+                memcpy(dst, _buffer + _pos, toRead);
             }
-            a = _fill - _pos;
-            toRead = (a > left)?left:a;
-            memcpy(buf, _buffer + _pos, toRead);
             _pos += toRead;
+            dst += toRead;
             left -= toRead;
-            buf += toRead;
         }
-        return len;
+        if(left == len){
+            return _failed ? -1 : 0;
+        }
+        return len - left;
     }
 
     int peek(){
@@ -145,8 +203,57 @@ public:
         return _buffer[_pos];
     }
 
+    // contiguous buffered bytes for peekBuffer(); a short tail is moved to the
+    // front and topped up from the socket so a pattern can be seen in one piece
+    size_t peekAvailable(){
+        if(_pos == _fill){
+            fillBuffer();
+        } else if(_fill - _pos < _size / 2 && (_sockAvail || _fill < _size)){
+            if(_pos){
+                memmove(_buffer, _buffer + _pos, _fill - _pos);
+                _fill -= _pos;
+                _pos = 0;
+            }
+            fillBuffer();
+        }
+        return _fill - _pos;
+    }
+
+    const uint8_t * peekBuffer(){
+        return _buffer ? _buffer + _pos : NULL;
+    }
+
+    void peekConsume(size_t len){
+        _pos += (len < _fill - _pos) ? len : _fill - _pos;
+    }
+
     size_t available(){
-        return _fill - _pos + r_available();
+        // while data is buffered the cached socket count is good enough,
+        // so byte-wise read loops do not ask lwIP every time
+        if(_pos < _fill){
+            return _fill - _pos + _sockAvail;
+        }
+        return r_available();
+    }
+};
+
+// outgoing bytes collected by write() until flush(), a full buffer or a read
+class WiFiClientTxBuffer {
+public:
+    uint8_t *buffer;
+    size_t size;
+    size_t fill;
+
+    WiFiClientTxBuffer(size_t len)
+        :buffer((uint8_t *)malloc(len))
+        ,size(buffer ? len : 0)
+        ,fill(0)
+    {
+    }
+
+    ~WiFiClientTxBuffer()
+    {
+        free(buffer);
     }
 };
 
@@ -170,11 +277,13 @@ public:
     }
 };
 
-WiFiClient::WiFiClient():_connected(false),next(NULL)
+WiFiClient::Config WiFiClient::_defaultConfig;
+
+WiFiClient::WiFiClient():_connected(false),_config(_defaultConfig),next(NULL)
 {
 }
 
-WiFiClient::WiFiClient(int fd):_connected(true),next(NULL)
+WiFiClient::WiFiClient(int fd):_connected(true),_config(_defaultConfig),next(NULL)
 {
     clientSocketHandle.reset(new WiFiClientSocketHandle(fd));
     _rxBuffer.reset(new WiFiClientRxBuffer(fd));
@@ -190,12 +299,16 @@ WiFiClient & WiFiClient::operator=(const WiFiClient &other)
     stop();
     clientSocketHandle = other.clientSocketHandle;
     _rxBuffer = other._rxBuffer;
+    _txBuffer = other._txBuffer;
+    _config = other._config;
     _connected = other._connected;
     return *this;
 }
 
 void WiFiClient::stop()
 {
+    flushTxBuffer();
+    _txBuffer = NULL;
     clientSocketHandle = NULL;
     _rxBuffer = NULL;
     _connected = false;
@@ -213,6 +326,8 @@ int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
         return 0;
     }
     fcntl( sockfd, F_SETFL, fcntl( sockfd, F_GETFL, 0 ) | O_NONBLOCK );
+    // before the SYN, so the receive window and TOS apply from the first segment
+    applyConfig(sockfd, _config);
 
     uint32_t ip_addr = ip;
     struct sockaddr_in serveraddr;
@@ -274,11 +389,141 @@ int WiFiClient::connect(const char *host, uint16_t port)
 }
 int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout)
 {
-    IPAddress srv((uint32_t)0);
+    wifi_dns_result_t srv;
     if(!WiFiGenericClass::hostByName(host, srv)){
         return 0;
     }
-    return connect(srv, port, timeout);
+    if(srv.count == 1){
+        return connect(srv.addresses[0], port, timeout);
+    }
+    return connectAny(srv.addresses, srv.count, port, timeout);
+}
+
+static int _connect_start(IPAddress ip, uint16_t port, const WiFiClient::Config &config)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        log_e("socket: %d", errno);
+        return -1;
+    }
+    fcntl( sockfd, F_SETFL, fcntl( sockfd, F_GETFL, 0 ) | O_NONBLOCK );
+    WiFiClient::applyConfig(sockfd, config);
+
+    uint32_t ip_addr = ip;
+    struct sockaddr_in serveraddr;
+    memset((char *) &serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sin_family = AF_INET;
+    memcpy((void *)&serveraddr.sin_addr.s_addr, (const void *)(&ip_addr), 4);
+    serveraddr.sin_port = htons(port);
+    int res = lwip_connect_r(sockfd, (struct sockaddr*)&serveraddr, sizeof(serveraddr));
+    if (res < 0 && errno != EINPROGRESS) {
+        log_e("connect on fd %d, errno: %d, \"%s\"", sockfd, errno, strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/*
+ * Happy eyeballs over the addresses of one name: the first gets a head start of
+ * WIFI_CLIENT_CONNECT_STAGGER ms, then the next one joins, and so on, sooner when
+ * an attempt fails. The first connection to come up is kept, the others closed.
+ */
+int WiFiClient::connectAny(const IPAddress *addresses, uint8_t count, uint16_t port, int32_t timeout)
+{
+    int fds[WIFI_DNS_MAX_ADDRESSES];
+    uint8_t started = 0, pending = 0;
+    int sockfd = -1;
+    uint32_t start = millis();
+    uint32_t nextAt = start;
+
+    if (count > WIFI_DNS_MAX_ADDRESSES) {
+        count = WIFI_DNS_MAX_ADDRESSES;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        fds[i] = -1;
+    }
+    while (sockfd < 0) {
+        uint32_t now = millis();
+        if (timeout >= 0 && (int32_t)(now - start) >= timeout) {
+            log_i("connect timed out after %d ms on %u addresses", timeout, started);
+            break;
+        }
+        if (started < count && (!pending || (int32_t)(now - nextAt) >= 0)) {
+            fds[started] = _connect_start(addresses[started], port, _config);
+            if (fds[started] >= 0) {
+                pending++;
+            }
+            started++;
+            nextAt = millis() + WIFI_CLIENT_CONNECT_STAGGER;
+            continue;
+        }
+        if (!pending) {
+            break;
+        }
+
+        int32_t wait = -1;
+        if (started < count) {
+            wait = (int32_t)(nextAt - now);
+        }
+        if (timeout >= 0) {
+            int32_t left = timeout - (int32_t)(now - start);
+            if (wait < 0 || left < wait) {
+                wait = left;
+            }
+        }
+        fd_set fdset;
+        int maxfd = -1;
+        FD_ZERO(&fdset);
+        for (uint8_t i = 0; i < started; i++) {
+            if (fds[i] >= 0) {
+                FD_SET(fds[i], &fdset);
+                if (fds[i] > maxfd) {
+                    maxfd = fds[i];
+                }
+            }
+        }
+        struct timeval tv;
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+        int res = select(maxfd + 1, nullptr, &fdset, nullptr, wait < 0 ? nullptr : &tv);
+        if (res < 0) {
+            log_e("select, errno: %d, \"%s\"", errno, strerror(errno));
+            break;
+        }
+        for (uint8_t i = 0; i < started && res > 0; i++) {
+            if (fds[i] < 0 || !FD_ISSET(fds[i], &fdset)) {
+                continue;
+            }
+            int sockerr = 0;
+            socklen_t len = (socklen_t)sizeof(int);
+            if (getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &sockerr, &len) == 0 && sockerr == 0) {
+                sockfd = fds[i];
+                fds[i] = -1;
+                break;
+            }
+            log_d("connect to %s failed, errno: %d", addresses[i].toString().c_str(), sockerr);
+            close(fds[i]);
+            fds[i] = -1;
+            pending--;
+            // the next address need not wait out its stagger
+            nextAt = millis();
+        }
+    }
+    for (uint8_t i = 0; i < started; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    if (sockfd < 0) {
+        return 0;
+    }
+
+    fcntl( sockfd, F_SETFL, fcntl( sockfd, F_GETFL, 0 ) & (~O_NONBLOCK) );
+    clientSocketHandle.reset(new WiFiClientSocketHandle(sockfd));
+    _rxBuffer.reset(new WiFiClientRxBuffer(sockfd));
+    _connected = true;
+    return 1;
 }
 
 int WiFiClient::setSocketOption(int option, char* value, size_t len)
@@ -334,6 +579,53 @@ bool WiFiClient::getNoDelay()
     return flag;
 }
 
+static bool applySocketOption(int fd, int level, int option, int value)
+{
+    if(value < 0) {
+        return true;
+    }
+    if(setsockopt(fd, level, option, &value, sizeof(value)) < 0) {
+        log_w("option %X on fd %d, errno: %d, \"%s\"", option, fd, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool WiFiClient::applyConfig(int fd, const Config &config)
+{
+    if(fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    ok &= applySocketOption(fd, SOL_SOCKET, SO_RCVBUF, config.rcvbuf);
+    ok &= applySocketOption(fd, SOL_SOCKET, SO_KEEPALIVE, config.keepalive);
+    ok &= applySocketOption(fd, IPPROTO_TCP, TCP_NODELAY, config.nodelay);
+    ok &= applySocketOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, config.keepIdle);
+    ok &= applySocketOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, config.keepInterval);
+    ok &= applySocketOption(fd, IPPROTO_TCP, TCP_KEEPCNT, config.keepCount);
+    ok &= applySocketOption(fd, IPPROTO_IP, IP_TOS, config.tos);
+    return ok;
+}
+
+bool WiFiClient::setConfig(const Config &config)
+{
+    _config = config;
+    if(fd() < 0) {
+        return true;
+    }
+    return applyConfig(fd(), _config);
+}
+
+void WiFiClient::setDefaultConfig(const Config &config)
+{
+    _defaultConfig = config;
+}
+
+const WiFiClient::Config & WiFiClient::getDefaultConfig()
+{
+    return _defaultConfig;
+}
+
 size_t WiFiClient::write(uint8_t data)
 {
     return write(&data, 1);
@@ -352,60 +644,99 @@ int WiFiClient::read()
     return data;
 }
 
-size_t WiFiClient::write(const uint8_t *buf, size_t size)
+size_t WiFiClient::sendBytes(const uint8_t *buf, size_t size)
 {
-    int res =0;
+    int res = 0;
     int retry = WIFI_CLIENT_MAX_WRITE_RETRY;
     int socketFileDescriptor = fd();
     size_t totalBytesSent = 0;
-    size_t bytesRemaining = size;
 
     if(!_connected || (socketFileDescriptor < 0)) {
         return 0;
     }
 
-    while(retry) {
-        //use select to make sure the socket is ready for writing
+    while(totalBytesSent < size && retry) {
+        //try the send first, only wait when the socket buffer is full
+        res = send(socketFileDescriptor, (void*) (buf + totalBytesSent), size - totalBytesSent, MSG_DONTWAIT);
+        if(res > 0) {
+            totalBytesSent += res;
+            retry = WIFI_CLIENT_MAX_WRITE_RETRY;
+            continue;
+        }
+        if(res < 0 && errno != EAGAIN) {
+            log_e("fail on fd %d, errno: %d, \"%s\"", socketFileDescriptor, errno, strerror(errno));
+            stop();
+            break;
+        }
+        retry--;
         fd_set set;
         struct timeval tv;
-        FD_ZERO(&set);        // empties the set
-        FD_SET(socketFileDescriptor, &set); // adds FD to the set
+        FD_ZERO(&set);
+        FD_SET(socketFileDescriptor, &set);
         tv.tv_sec = 0;
         tv.tv_usec = WIFI_CLIENT_SELECT_TIMEOUT_US;
-        retry--;
-
         if(select(socketFileDescriptor + 1, NULL, &set, NULL, &tv) < 0) {
-            return 0;
+            break;
         }
+    }
+    return totalBytesSent;
+}
 
-        if(FD_ISSET(socketFileDescriptor, &set)) {
-            res = send(socketFileDescriptor, (void*) buf, bytesRemaining, MSG_DONTWAIT);
-            if(res > 0) {
-                totalBytesSent += res;
-                if (totalBytesSent >= size) {
-                    //completed successfully
-                    retry = 0;
-                } else {
-                    buf += res;
-                    bytesRemaining -= res;
-                    retry = WIFI_CLIENT_MAX_WRITE_RETRY;
-                }
-            }
-            else if(res < 0) {
-                log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
-                if(errno != EAGAIN) {
-                    //if resource was busy, can try again, otherwise give up
-                    stop();
-                    res = 0;
-                    retry = 0;
-                }
-            }
-            else {
-                // Try again
-            }
+bool WiFiClient::flushTxBuffer()
+{
+    if(!_txBuffer || !_txBuffer->fill) {
+        return true;
+    }
+    // empty it first, stop() on a send error comes back here
+    size_t len = _txBuffer->fill;
+    _txBuffer->fill = 0;
+    return sendBytes(_txBuffer->buffer, len) == len;
+}
+
+bool WiFiClient::setRxBufferSize(size_t size)
+{
+    if(!_rxBuffer) {
+        return false;
+    }
+    return _rxBuffer->setSize(size);
+}
+
+bool WiFiClient::setTxBufferSize(size_t size)
+{
+    flushTxBuffer();
+    _txBuffer = NULL;
+    if(!size) {
+        return true;
+    }
+    _txBuffer.reset(new WiFiClientTxBuffer(size));
+    if(!_txBuffer->size) {
+        log_e("Not enough memory to allocate buffer");
+        _txBuffer = NULL;
+        return false;
+    }
+    return true;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+    if(!_txBuffer) {
+        return sendBytes(buf, size);
+    }
+    WiFiClientTxBuffer *tx = _txBuffer.get();
+    if(size > tx->size - tx->fill) {
+        if(!flushTxBuffer()) {
+            return 0;
+        }
+        if(size >= tx->size) {
+            return sendBytes(buf, size);
         }
     }
-    return totalBytesSent;
+    if(!_connected) {
+        return 0;
+    }
+    memcpy(tx->buffer + tx->fill, buf, size);
+    tx->fill += size;
+    return size;
 }
 
 size_t WiFiClient::write_P(PGM_P buf, size_t size)
@@ -413,27 +744,48 @@ size_t WiFiClient::write_P(PGM_P buf, size_t size)
     return write(buf, size);
 }
 
-size_t WiFiClient::write(Stream &stream)
+size_t WiFiClient::sendFrom(read_cb_t cb, void *src, size_t chunkSize)
 {
-    uint8_t * buf = (uint8_t *)malloc(1360);
+    if(!chunkSize) {
+        chunkSize = _streamChunkSize;
+    }
+    uint8_t * buf = (uint8_t *)malloc(chunkSize);
     if(!buf){
         return 0;
     }
-    size_t toRead = 0, toWrite = 0, written = 0;
-    size_t available = stream.available();
-    while(available){
-        toRead = (available > 1360)?1360:available;
-        toWrite = stream.readBytes(buf, toRead);
-        written += write(buf, toWrite);
-        available = stream.available();
+    size_t len = 0, sent = 0, written = 0;
+    while((len = cb(src, buf, chunkSize)) > 0){
+        sent = write(buf, len);
+        written += sent;
+        if(sent < len){
+            break;
+        }
     }
     free(buf);
     return written;
 }
 
+void WiFiClient::setStreamChunkSize(size_t size)
+{
+    _streamChunkSize = size ? size : WIFI_CLIENT_STREAM_CHUNK_SIZE;
+}
+
+size_t WiFiClient::write(Stream &stream)
+{
+    return sendFrom([](void *src, uint8_t *buf, size_t len) -> size_t {
+        Stream *s = static_cast<Stream *>(src);
+        int a = s->available();
+        if(a <= 0){
+            return 0;
+        }
+        return s->readBytes(buf, ((size_t)a < len) ? a : len);
+    }, &stream, 0);
+}
+
 int WiFiClient::read(uint8_t *buf, size_t size)
 {
     int res = -1;
+    flushTxBuffer();
     res = _rxBuffer->read(buf, size);
     if(_rxBuffer->failed()) {
         log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
@@ -444,6 +796,7 @@ int WiFiClient::read(uint8_t *buf, size_t size)
 
 int WiFiClient::peek()
 {
+    flushTxBuffer();
     int res = _rxBuffer->peek();
     if(_rxBuffer->failed()) {
         log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
@@ -452,12 +805,41 @@ int WiFiClient::peek()
     return res;
 }
 
+size_t WiFiClient::peekAvailable()
+{
+    if(!_rxBuffer)
+    {
+        return 0;
+    }
+    flushTxBuffer();
+    size_t res = _rxBuffer->peekAvailable();
+    if(_rxBuffer->failed()) {
+        log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
+        stop();
+        return 0;
+    }
+    return res;
+}
+
+const uint8_t * WiFiClient::peekBuffer()
+{
+    return _rxBuffer ? _rxBuffer->peekBuffer() : NULL;
+}
+
+void WiFiClient::peekConsume(size_t len)
+{
+    if(_rxBuffer) {
+        _rxBuffer->peekConsume(len);
+    }
+}
+
 int WiFiClient::available()
 {
     if(!_rxBuffer)
     {
         return 0;
     }
+    flushTxBuffer();
     int res = _rxBuffer->available();
     if(_rxBuffer->failed()) {
         log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
@@ -470,6 +852,7 @@ int WiFiClient::available()
 // seems that in Arduino it also means to clear RX
 void WiFiClient::flush() {
     int res;
+    flushTxBuffer();
     size_t a = available(), toRead = 0;
     if(!a){
         return;//nothing to flush
@@ -595,3 +978,16 @@ int WiFiClient::fd() const
     }
 }
 
+bool WiFiClient::setRxBufferPool(pool_t * pool)
+{
+    pool_stats_t stats;
+    if(pool){
+        poolGetStats(pool, &stats);
+        if(stats.blockSize < WIFI_CLIENT_RX_BUFFER_SIZE){
+            log_e("pool blocks must hold %u bytes", WIFI_CLIENT_RX_BUFFER_SIZE);
+            return false;
+        }
+    }
+    _rxBufferPool = pool;
+    return true;
+}
@@ -25,8 +25,13 @@
 #include "Client.h"
 #include <memory>
 
+#ifndef WIFI_CLIENT_CONNECT_STAGGER
+#define WIFI_CLIENT_CONNECT_STAGGER 250 // ms before connect(host) also tries the next address of the name
+#endif
+
 class WiFiClientSocketHandle;
 class WiFiClientRxBuffer;
+class WiFiClientTxBuffer;
 
 class ESPLwIPClient : public Client
 {
@@ -38,10 +43,36 @@ public:
 
 class WiFiClient : public ESPLwIPClient
 {
+public:
+    // socket options applied in one go before connect() and by WiFiServer::available(),
+    // -1 leaves the stack default
+    struct Config {
+        int rcvbuf = -1;        // SO_RCVBUF, bytes
+        int sndbuf = -1;        // SO_SNDBUF, bytes (lwIP has a fixed send buffer, ignored)
+        int nodelay = -1;       // TCP_NODELAY, 0 or 1
+        int keepalive = -1;     // SO_KEEPALIVE, 0 or 1
+        int keepIdle = -1;      // TCP_KEEPIDLE, seconds
+        int keepInterval = -1;  // TCP_KEEPINTVL, seconds
+        int keepCount = -1;     // TCP_KEEPCNT, probes
+        int tos = -1;           // IP_TOS
+    };
+
 protected:
     std::shared_ptr<WiFiClientSocketHandle> clientSocketHandle;
     std::shared_ptr<WiFiClientRxBuffer> _rxBuffer;
+    std::shared_ptr<WiFiClientTxBuffer> _txBuffer;
     bool _connected;
+    Config _config;
+    static Config _defaultConfig;
+
+    size_t sendBytes(const uint8_t *buf, size_t size);
+    bool flushTxBuffer();
+
+    typedef size_t (*read_cb_t)(void *src, uint8_t *buf, size_t len);
+    static size_t _streamChunkSize;
+    size_t sendFrom(read_cb_t cb, void *src, size_t chunkSize);
+
+    int connectAny(const IPAddress *addresses, uint8_t count, uint16_t port, int32_t timeout);
 
 public:
     WiFiClient *next;
@@ -56,10 +87,26 @@ public:
     size_t write(const uint8_t *buf, size_t size);
     size_t write_P(PGM_P buf, size_t size);
     size_t write(Stream &stream);
+    // send a whole file (anything with read(uint8_t*, size_t)) with bulk reads of
+    // chunkSize bytes, 0 uses setStreamChunkSize()
+    template<typename T>
+    size_t sendFile(T &file, size_t chunkSize = 0)
+    {
+        return sendFrom([](void *src, uint8_t *buf, size_t len) -> size_t {
+            return static_cast<T *>(src)->read(buf, len);
+        }, &file, chunkSize);
+    }
+    // chunk size of write(Stream&) and sendFile(), default one TCP segment (1436)
+    static void setStreamChunkSize(size_t size);
     int available();
     int read();
     int read(uint8_t *buf, size_t size);
     int peek();
+    // received data without copying: peekBuffer() points at peekAvailable()
+    // bytes, valid until the next read; peekConsume() drops them once used
+    size_t peekAvailable();
+    const uint8_t * peekBuffer();
+    void peekConsume(size_t len);
     void flush();
     void stop();
     uint8_t connected();
@@ -92,6 +139,14 @@ public:
     int setNoDelay(bool nodelay);
     bool getNoDelay();
 
+    // applied now when connected, and on every later connect()
+    bool setConfig(const Config &config);
+    const Config & getConfig() const { return _config; }
+    // what new clients and WiFiServer::available() start with
+    static void setDefaultConfig(const Config &config);
+    static const Config & getDefaultConfig();
+    static bool applyConfig(int fd, const Config &config);
+
     IPAddress remoteIP() const;
     IPAddress remoteIP(int fd) const;
     uint16_t remotePort() const;
@@ -101,6 +156,16 @@ public:
     uint16_t localPort() const;
     uint16_t localPort(int fd) const;
 
+    // receive buffers of new connections come from pool (blocks >= 1436 bytes) while it has
+    // free blocks, NULL goes back to malloc; connections keep the pool they started with
+    static bool setRxBufferPool(pool_t * pool);
+    // receive buffer size of this connection (default 1436), only while it holds no data
+    bool setRxBufferSize(size_t size);
+
+    // collect writes into one buffer of size bytes (0 turns it off) so print() chains
+    // go out as one segment; sent on flush(), when full, or before the next read
+    bool setTxBufferSize(size_t size);
+
     //friend class WiFiServer;
     using Print::write;
 };
@@ -40,6 +40,7 @@ extern "C" {
 #include "lwip/opt.h"
 #include "lwip/err.h"
 #include "lwip/dns.h"
+#include "lwip/sockets.h"
 #include "esp_ipc.h"
 
 } //extern "C"
@@ -51,12 +52,24 @@ extern "C" {
 static xQueueHandle _network_event_queue;
 static TaskHandle_t _network_event_task_handle = NULL;
 static EventGroupHandle_t _network_event_group = NULL;
+static UBaseType_t _network_event_task_priority = ESP_TASKD_EVENT_PRIO - 1;
+static BaseType_t _network_event_task_core = CONFIG_ARDUINO_EVENT_RUNNING_CORE;
+static uint32_t _network_event_task_stack = 4096;
+static wifi_event_stats_t _network_event_stats = { 0, 0, 0 };
 
 esp_err_t postToSysQueue(system_prov_event_t *data)
 {
-    if (xQueueSend(_network_event_queue, &data, portMAX_DELAY) != pdPASS) {
-        log_w("Network Event Queue Send Failed!");
-            return ESP_FAIL;
+    // never wait here, a slow callback must not hold up the event loop and with it the TCP/IP stack
+    if (xQueueSend(_network_event_queue, &data, 0) != pdPASS) {
+        if(!_network_event_stats.dropped++) {
+            log_w("Network Event Queue Send Failed!");
+        }
+        return ESP_FAIL;
+    }
+    _network_event_stats.posted++;
+    UBaseType_t waiting = uxQueueMessagesWaiting(_network_event_queue);
+    if(waiting > _network_event_stats.peak) {
+        _network_event_stats.peak = waiting;
     }
     return ESP_OK;
 }
@@ -65,12 +78,10 @@ static void _network_event_task(void * arg){
     system_prov_event_t *data;
     for (;;) {
         if(xQueueReceive(_network_event_queue, &data, portMAX_DELAY) == pdTRUE){
+            WiFiGenericClass::_eventCallback(arg, data->sys_event, data->prov_event);
+            free(data->sys_event);
             if(data->prov_event != NULL){
-                WiFiGenericClass::_eventCallback(arg, data->sys_event, data->prov_event);
-                free(data->sys_event);
                 free(data->prov_event);
-            } else {
-                WiFiGenericClass::_eventCallback(arg, data->sys_event, NULL);
             }
             free(data);
         }        
@@ -80,15 +91,26 @@ static void _network_event_task(void * arg){
 }
 
 static esp_err_t _network_event_cb(void *arg, system_event_t *event){ 
+    // status bits and the like follow the event here, in order, even when the queue has no room
+    WiFiGenericClass::_handleEvent(event);
+
     system_prov_event_t *sys_prov_data = (system_prov_event_t *)malloc(sizeof(system_prov_event_t));
     if(sys_prov_data == NULL) {
-        return ESP_FAIL;
+        _network_event_stats.dropped++;
+        return ESP_OK;
+    }
+    // the event belongs to the event loop and is reused once this returns
+    sys_prov_data->sys_event = (system_event_t *)malloc(sizeof(system_event_t));
+    if(sys_prov_data->sys_event == NULL) {
+        _network_event_stats.dropped++;
+        free(sys_prov_data);
+        return ESP_OK;
     }
-    sys_prov_data->sys_event = event;
+    memcpy(sys_prov_data->sys_event, event, sizeof(system_event_t));
     sys_prov_data->prov_event = NULL;
     if (postToSysQueue(sys_prov_data) != ESP_OK){
+        free(sys_prov_data->sys_event);
         free(sys_prov_data);
-        return ESP_FAIL;
     }
     return ESP_OK;
 }
@@ -103,14 +125,14 @@ static bool _start_network_event_task(){
         xEventGroupSetBits(_network_event_group, WIFI_DNS_IDLE_BIT);
     }
     if(!_network_event_queue){
-        _network_event_queue = xQueueCreate(32, sizeof(system_prov_event_t));
+        _network_event_queue = xQueueCreate(WIFI_EVENT_QUEUE_SIZE, sizeof(system_prov_event_t));
         if(!_network_event_queue){
             log_e("Network Event Queue Create Failed!");
             return false;
         }
     }
     if(!_network_event_task_handle){
-        xTaskCreateUniversal(_network_event_task, "network_event", 4096, NULL, ESP_TASKD_EVENT_PRIO - 1, &_network_event_task_handle, CONFIG_ARDUINO_EVENT_RUNNING_CORE);
+        xTaskCreateUniversal(_network_event_task, "network_event", _network_event_task_stack, NULL, _network_event_task_priority, &_network_event_task_handle, _network_event_task_core);
         if(!_network_event_task_handle){
             log_e("Network Event Task Start Failed!");
             return false;
@@ -132,6 +154,27 @@ static bool wifiLowLevelInit(bool persistent){
     if(!lowLevelInitDone){
         tcpipInit();
         wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+        const wifi_buffer_config_t& buffers = WiFiGenericClass::getBuffers();
+        cfg.static_rx_buf_num = buffers.staticRxBuffers;
+        cfg.dynamic_rx_buf_num = buffers.dynamicRxBuffers;
+        cfg.dynamic_tx_buf_num = buffers.dynamicTxBuffers;
+        cfg.ampdu_rx_enable = buffers.ampduRx;
+        cfg.ampdu_tx_enable = buffers.ampduTx;
+        if(cfg.ampdu_rx_enable && !cfg.rx_ba_win) {
+            cfg.rx_ba_win = 6;
+        }
+        if(cfg.ampdu_tx_enable && !cfg.tx_ba_win) {
+            cfg.tx_ba_win = 6;
+        }
+        const wifi_profile_config_t& profile = WiFiGenericClass::getPerformanceProfile();
+        if(cfg.ampdu_rx_enable && profile.rxBaWin) {
+            cfg.rx_ba_win = profile.rxBaWin;
+        }
+        // the driver can not hold more frames of a window than it has static RX buffers
+        cfg.rx_ba_win = min(cfg.rx_ba_win, cfg.static_rx_buf_num);
+        if(cfg.ampdu_tx_enable && profile.txBaWin) {
+            cfg.tx_ba_win = min((int)profile.txBaWin, 32);
+        }
         esp_err_t err = esp_wifi_init(&cfg);
         if(err){
             log_e("esp_wifi_init %d", err);
@@ -203,11 +246,19 @@ wifi_event_id_t WiFiEventCbList::current_id = 1;
 
 
 // arduino dont like std::vectors move static here
-static std::vector<WiFiEventCbList_t> cbEventList;
+// one list per event id, the last one for the callbacks that want every event
+static std::vector<WiFiEventCbList_t> cbEventList[SYSTEM_EVENT_MAX + 1];
+
+static std::vector<WiFiEventCbList_t>& _event_list(system_event_id_t event)
+{
+    return cbEventList[(event < SYSTEM_EVENT_MAX) ? event : SYSTEM_EVENT_MAX];
+}
 
 bool WiFiGenericClass::_persistent = true;
 bool WiFiGenericClass::_long_range = false;
 wifi_mode_t WiFiGenericClass::_forceSleepLastMode = WIFI_MODE_NULL;
+wifi_profile_config_t WiFiGenericClass::_profile = { WIFI_PS_MIN_MODEM, 0, WIFI_POWER_19_5dBm, 0, 0, 0 };
+bool WiFiGenericClass::_profileSet = false;
 
 WiFiGenericClass::WiFiGenericClass()
 {
@@ -263,7 +314,8 @@ wifi_event_id_t WiFiGenericClass::onEvent(WiFiProvEventCb cbEvent, system_event_
     newEventHandler.scb = NULL;
     newEventHandler.provcb = cbEvent;
     newEventHandler.event = event;
-    cbEventList.push_back(newEventHandler);
+    // provisioning callbacks see every event, whatever they asked for
+    cbEventList[SYSTEM_EVENT_MAX].push_back(newEventHandler);
     return newEventHandler.id;
 }
 wifi_event_id_t WiFiGenericClass::onEvent(WiFiEventCb cbEvent, system_event_id_t event)
@@ -277,7 +329,7 @@ wifi_event_id_t WiFiGenericClass::onEvent(WiFiEventCb cbEvent, system_event_id_t
     newEventHandler.scb = NULL;
     newEventHandler.provcb = NULL;
     newEventHandler.event = event;
-    cbEventList.push_back(newEventHandler);
+    _event_list(event).push_back(newEventHandler);
     return newEventHandler.id;
 }
 
@@ -292,7 +344,7 @@ wifi_event_id_t WiFiGenericClass::onEvent(WiFiEventFuncCb cbEvent, system_event_
     newEventHandler.scb = NULL;
     newEventHandler.provcb = NULL;
     newEventHandler.event = event;
-    cbEventList.push_back(newEventHandler);
+    _event_list(event).push_back(newEventHandler);
     return newEventHandler.id;
 }
 
@@ -307,7 +359,7 @@ wifi_event_id_t WiFiGenericClass::onEvent(WiFiEventSysCb cbEvent, system_event_i
     newEventHandler.scb = cbEvent;
     newEventHandler.provcb = NULL;
     newEventHandler.event = event;
-    cbEventList.push_back(newEventHandler);
+    _event_list(event).push_back(newEventHandler);
     return newEventHandler.id;
 }
 
@@ -322,10 +374,12 @@ void WiFiGenericClass::removeEvent(WiFiEventCb cbEvent, system_event_id_t event)
         return;
     }
 
-    for(uint32_t i = 0; i < cbEventList.size(); i++) {
-        WiFiEventCbList_t entry = cbEventList[i];
-        if(entry.cb == cbEvent && entry.event == event) {
-            cbEventList.erase(cbEventList.begin() + i);
+    std::vector<WiFiEventCbList_t>& list = _event_list(event);
+    for(uint32_t i = 0; i < list.size(); ) {
+        if(list[i].cb == cbEvent && list[i].event == event) {
+            list.erase(list.begin() + i);
+        } else {
+            i++;
         }
     }
 }
@@ -336,28 +390,29 @@ void WiFiGenericClass::removeEvent(WiFiEventSysCb cbEvent, system_event_id_t eve
         return;
     }
 
-    for(uint32_t i = 0; i < cbEventList.size(); i++) {
-        WiFiEventCbList_t entry = cbEventList[i];
-        if(entry.scb == cbEvent && entry.event == event) {
-            cbEventList.erase(cbEventList.begin() + i);
+    std::vector<WiFiEventCbList_t>& list = _event_list(event);
+    for(uint32_t i = 0; i < list.size(); ) {
+        if(list[i].scb == cbEvent && list[i].event == event) {
+            list.erase(list.begin() + i);
+        } else {
+            i++;
         }
     }
 }
 
 void WiFiGenericClass::removeEvent(wifi_event_id_t id)
 {
-    for(uint32_t i = 0; i < cbEventList.size(); i++) {
-        WiFiEventCbList_t entry = cbEventList[i];
-        if(entry.id == id) {
-            cbEventList.erase(cbEventList.begin() + i);
+    for(uint32_t e = 0; e <= SYSTEM_EVENT_MAX; e++) {
+        std::vector<WiFiEventCbList_t>& list = cbEventList[e];
+        for(uint32_t i = 0; i < list.size(); i++) {
+            if(list[i].id == id) {
+                list.erase(list.begin() + i);
+                return;
+            }
         }
     }
 }
 
-/**
- * callback for WiFi events
- * @param arg
- */
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
 const char * system_event_names[] = { "WIFI_READY", "SCAN_DONE", "STA_START", "STA_STOP", "STA_CONNECTED", "STA_DISCONNECTED", "STA_AUTHMODE_CHANGE", "STA_GOT_IP", "STA_LOST_IP", "STA_WPS_ER_SUCCESS", "STA_WPS_ER_FAILED", "STA_WPS_ER_TIMEOUT", "STA_WPS_ER_PIN", "STA_WPS_ER_PBC_OVERLAP", "AP_START", "AP_STOP", "AP_STACONNECTED", "AP_STADISCONNECTED", "AP_STAIPASSIGNED", "AP_PROBEREQRECVED", "GOT_IP6", "ETH_START", "ETH_STOP", "ETH_CONNECTED", "ETH_DISCONNECTED", "ETH_GOT_IP", "MAX"};
 #endif
@@ -365,11 +420,14 @@ const char * system_event_names[] = { "WIFI_READY", "SCAN_DONE", "STA_START", "S
 const char * system_event_reasons[] = { "UNSPECIFIED", "AUTH_EXPIRE", "AUTH_LEAVE", "ASSOC_EXPIRE", "ASSOC_TOOMANY", "NOT_AUTHED", "NOT_ASSOCED", "ASSOC_LEAVE", "ASSOC_NOT_AUTHED", "DISASSOC_PWRCAP_BAD", "DISASSOC_SUPCHAN_BAD", "UNSPECIFIED", "IE_INVALID", "MIC_FAILURE", "4WAY_HANDSHAKE_TIMEOUT", "GROUP_KEY_UPDATE_TIMEOUT", "IE_IN_4WAY_DIFFERS", "GROUP_CIPHER_INVALID", "PAIRWISE_CIPHER_INVALID", "AKMP_INVALID", "UNSUPP_RSN_IE_VERSION", "INVALID_RSN_IE_CAP", "802_1X_AUTH_FAILED", "CIPHER_SUITE_REJECTED", "BEACON_TIMEOUT", "NO_AP_FOUND", "AUTH_FAIL", "ASSOC_FAIL", "HANDSHAKE_TIMEOUT", "CONNECTION_FAIL" };
 #define reason2str(r) ((r>176)?system_event_reasons[r-176]:system_event_reasons[r-1])
 #endif
-esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event, wifi_prov_event_t *prov_event)
+/**
+ * keeps the status bits and the STA status in step with the events
+ * runs on the system event loop before the event is queued for the callbacks, so it has to stay short
+ * @param event
+ */
+void WiFiGenericClass::_handleEvent(system_event_t *event)
 {
-    if(WiFi.isProvEnabled()) {
-        wifi_prov_mgr_event_handler(arg,event);        
-    }
+    WiFiSTAClass::_statsEvent(event);
     if(event->event_id < 26) {
         log_d("Event: %d - %s", event->event_id, system_event_names[event->event_id]);
     }
@@ -465,28 +523,84 @@ esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event, wif
             setStatusBits(ETH_CONNECTED_BIT | ETH_HAS_IP6_BIT);
         }
     }
- 
-    for(uint32_t i = 0; i < cbEventList.size(); i++) {
-        WiFiEventCbList_t entry = cbEventList[i];
-        if(entry.cb || entry.fcb || entry.scb) {
-            if(entry.event == (system_event_id_t) event->event_id || entry.event == SYSTEM_EVENT_MAX) {
-                if(entry.cb) {
-                    entry.cb((system_event_id_t) event->event_id);
-                } else if(entry.fcb) {
-                    entry.fcb((system_event_id_t) event->event_id, (system_event_info_t) event->event_info);
-                } else {
-                    entry.scb(event);
-                }
-            }
-        }
+}
+
+static void _call_event(WiFiEventCbList_t& entry, system_event_t *event, wifi_prov_event_t *prov_event)
+{
+    if(entry.cb) {
+        entry.cb((system_event_id_t) event->event_id);
+    } else if(entry.fcb) {
+        entry.fcb((system_event_id_t) event->event_id, (system_event_info_t) event->event_info);
+    } else if(entry.scb) {
+        entry.scb(event);
+    }
+
+    if(entry.provcb) {
+        entry.provcb(event,prov_event);
+    }
+}
+
+/**
+ * callback for WiFi events
+ * runs on the network_event task, calls those for the event and those for every event
+ * @param arg
+ */
+esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event, wifi_prov_event_t *prov_event)
+{
+    TRACE_INSTANT(TRACE_ID_WIFI_EVENT, event->event_id);
+    if(WiFi.isProvEnabled()) {
+        wifi_prov_mgr_event_handler(arg,event);        
+    }
 
-        if(entry.provcb) {
-            entry.provcb(event,prov_event);
+    std::vector<WiFiEventCbList_t>& all = cbEventList[SYSTEM_EVENT_MAX];
+    std::vector<WiFiEventCbList_t>* one = (event->event_id < SYSTEM_EVENT_MAX) ? &cbEventList[event->event_id] : NULL;
+    size_t a = 0, o = 0;
+    // both lists are in the order the callbacks were added, merging on the id keeps it
+    while(a < all.size() || (one && o < one->size())) {
+        WiFiEventCbList_t entry;
+        if(one && o < one->size() && (a >= all.size() || (*one)[o].id < all[a].id)) {
+            entry = (*one)[o++];
+        } else {
+            entry = all[a++];
         }
+        _call_event(entry, event, prov_event);
     }
+    // a sketch waiting in loopWaitForEvent() checks WiFi.status() again
+    loopSignalEvent();
     return ESP_OK;
 }
 
+/**
+ * Choose where the callbacks of onEvent() run, call it before WiFi is started
+ * @param priority  of the network_event task
+ * @param core      it is pinned to, tskNO_AFFINITY for none
+ * @param stackSize in bytes
+ * @return false once the task is running
+ */
+bool WiFiGenericClass::setEventTask(UBaseType_t priority, BaseType_t core, uint32_t stackSize)
+{
+    if(_network_event_task_handle) {
+        log_w("network_event task already running");
+        return false;
+    }
+    _network_event_task_priority = priority;
+    _network_event_task_core = core;
+    _network_event_task_stack = stackSize;
+    return true;
+}
+
+/**
+ * How the event queue has done so far
+ * @param stats
+ */
+void WiFiGenericClass::getEventStats(wifi_event_stats_t* stats)
+{
+    if(stats) {
+        *stats = _network_event_stats;
+    }
+}
+
+
 /**
  * Return the current channel associated with the network
  * @return channel (1-13)
@@ -566,6 +680,9 @@ bool WiFiGenericClass::mode(wifi_mode_t m)
     if(!espWiFiStart()){
         return false;
     }
+    if(_profileSet){
+        _applyProfile();
+    }
     return true;
 }
 
@@ -696,6 +813,119 @@ wifi_power_t WiFiGenericClass::getTxPower(){
     return (wifi_power_t)power;
 }
 
+static const wifi_profile_config_t wifi_profiles[] = {
+    { WIFI_PS_MIN_MODEM, 0,  WIFI_POWER_19_5dBm, 0,            0, 0 },  // WIFI_PROFILE_DEFAULT
+    { WIFI_PS_NONE,      0,  WIFI_POWER_19_5dBm, WIFI_BW_HT20, 0, 0 },  // WIFI_PROFILE_LOW_LATENCY
+    { WIFI_PS_NONE,      0,  WIFI_POWER_19_5dBm, WIFI_BW_HT40, 16, 32 },// WIFI_PROFILE_THROUGHPUT
+    { WIFI_PS_MAX_MODEM, 10, WIFI_POWER_11dBm,   WIFI_BW_HT20, 0, 0 },  // WIFI_PROFILE_BATTERY
+};
+
+/**
+ * set power save, listen interval, TX power, bandwidth and block ack windows in one go
+ * takes effect now when WiFi runs, or when it is started. The block ack windows are only read
+ * when WiFi is initialised, so they have to be set before the first begin() or mode().
+ * @param profile wifi_profile_t
+ * @return ok
+ */
+bool WiFiGenericClass::setPerformanceProfile(wifi_profile_t profile)
+{
+    if(profile > WIFI_PROFILE_BATTERY){
+        return false;
+    }
+    return setPerformanceProfile(wifi_profiles[profile]);
+}
+
+bool WiFiGenericClass::setPerformanceProfile(const wifi_profile_config_t& config)
+{
+    if(lowLevelInitDone && (config.rxBaWin != _profile.rxBaWin || config.txBaWin != _profile.txBaWin)){
+        log_w("block ack windows only change before WiFi is started");
+    }
+    _profile = config;
+    _profileSet = true;
+    if(getMode() == WIFI_MODE_NULL){
+        return true;
+    }
+    return _applyProfile();
+}
+
+const wifi_profile_config_t& WiFiGenericClass::getPerformanceProfile()
+{
+    return _profile;
+}
+
+static const wifi_buffer_config_t wifi_buffer_presets[] = {
+    { CONFIG_ESP32_WIFI_STATIC_RX_BUFFER_NUM, CONFIG_ESP32_WIFI_DYNAMIC_RX_BUFFER_NUM, WIFI_DYNAMIC_TX_BUFFER_NUM, WIFI_AMPDU_RX_ENABLED, WIFI_AMPDU_TX_ENABLED }, // WIFI_BUFFERS_DEFAULT
+    { 16, 64, 64, true, true },   // WIFI_BUFFERS_THROUGHPUT
+    { 4, 8, 16, false, false },   // WIFI_BUFFERS_LOW_MEMORY
+};
+
+wifi_buffer_config_t WiFiGenericClass::_buffers = wifi_buffer_presets[WIFI_BUFFERS_PRESET];
+
+/**
+ * set how many buffers the WiFi driver gets
+ * has to be called before WiFi is started, the driver only reads them in esp_wifi_init()
+ * @param preset wifi_buffers_t
+ * @return false once WiFi runs
+ */
+bool WiFiGenericClass::setBuffers(wifi_buffers_t preset)
+{
+    if(preset > WIFI_BUFFERS_LOW_MEMORY){
+        return false;
+    }
+    return setBuffers(wifi_buffer_presets[preset]);
+}
+
+bool WiFiGenericClass::setBuffers(const wifi_buffer_config_t& config)
+{
+    if(lowLevelInitDone){
+        log_w("WiFi buffers can only change before WiFi is started");
+        return false;
+    }
+    if(config.staticRxBuffers < 2 || config.staticRxBuffers > 25 || config.dynamicRxBuffers > 1024
+        || !config.dynamicTxBuffers || config.dynamicTxBuffers > 128){
+        log_e("buffer counts out of range");
+        return false;
+    }
+    _buffers = config;
+    return true;
+}
+
+const wifi_buffer_config_t& WiFiGenericClass::getBuffers()
+{
+    return _buffers;
+}
+
+bool WiFiGenericClass::_applyProfile()
+{
+    wifi_mode_t m = getMode();
+    bool ok = true;
+    if(m & WIFI_MODE_STA){
+        if(esp_wifi_set_ps(_profile.ps) != ESP_OK){
+            log_e("power save %d failed", _profile.ps);
+            ok = false;
+        }
+        wifi_config_t conf;
+        // picked up by the next association
+        if(esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK && conf.sta.listen_interval != _profile.listenInterval){
+            conf.sta.listen_interval = _profile.listenInterval;
+            esp_wifi_set_config(WIFI_IF_STA, &conf);
+        }
+        if(_profile.bandwidth && esp_wifi_set_bandwidth(WIFI_IF_STA, (wifi_bandwidth_t)_profile.bandwidth) != ESP_OK){
+            log_e("STA bandwidth %u failed", _profile.bandwidth);
+            ok = false;
+        }
+    }
+    if((m & WIFI_MODE_AP) && _profile.bandwidth && esp_wifi_set_bandwidth(WIFI_IF_AP, (wifi_bandwidth_t)_profile.bandwidth) != ESP_OK){
+        log_e("AP bandwidth %u failed", _profile.bandwidth);
+        ok = false;
+    }
+    if(m && esp_wifi_set_max_tx_power(_profile.txPower) != ESP_OK){
+        log_e("TX power %d failed", _profile.txPower);
+        ok = false;
+    }
+    return ok;
+}
+
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------------------ Generic Network function ---------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -714,6 +944,331 @@ static void wifi_dns_found_callback(const char *name, const ip_addr_t *ipaddr, v
     xEventGroupSetBits(_network_event_group, WIFI_DNS_DONE_BIT);
 }
 
+/**
+ * Resolve through lwIP, one address and no TTL, for names the query below
+ * gets no answer for (no server configured, mDNS names)
+ */
+static int wifi_dns_lwip_resolve(const char* aHostname, IPAddress& aResult)
+{
+    ip_addr_t addr;
+    aResult = static_cast<uint32_t>(0);
+    WiFiGenericClass::waitStatusBits(WIFI_DNS_IDLE_BIT, 16000);
+    xEventGroupClearBits(_network_event_group, WIFI_DNS_IDLE_BIT | WIFI_DNS_DONE_BIT);
+    err_t err = dns_gethostbyname(aHostname, &addr, &wifi_dns_found_callback, &aResult);
+    if(err == ERR_OK && addr.u_addr.ip4.addr) {
+        aResult = addr.u_addr.ip4.addr;
+    } else if(err == ERR_INPROGRESS) {
+        WiFiGenericClass::waitStatusBits(WIFI_DNS_DONE_BIT, 15000);  //real internal timeout in lwip library is 14[s]
+        xEventGroupClearBits(_network_event_group, WIFI_DNS_DONE_BIT);
+    }
+    xEventGroupSetBits(_network_event_group, WIFI_DNS_IDLE_BIT);
+    return (uint32_t)aResult != 0;
+}
+
+#define WIFI_DNS_PORT       53
+#define WIFI_DNS_NAME_MAX   64   // longer names are resolved but not cached
+#define WIFI_DNS_PACKET_MAX 512
+
+typedef struct {
+    char name[WIFI_DNS_NAME_MAX];
+    wifi_dns_result_t result;
+    uint32_t expires;            // millis()
+} wifi_dns_cache_entry_t;
+
+static wifi_dns_cache_entry_t _dns_cache[WIFI_DNS_CACHE_SIZE];
+static portMUX_TYPE _dns_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool wifi_dns_cache_get(const char* name, wifi_dns_result_t& result)
+{
+    bool found = false;
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_dns_mux);
+    for(int i = 0; i < WIFI_DNS_CACHE_SIZE; i++) {
+        wifi_dns_cache_entry_t& entry = _dns_cache[i];
+        if(entry.name[0] && (int32_t)(entry.expires - now) > 0 && !strcasecmp(entry.name, name)) {
+            result = entry.result;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_dns_mux);
+    return found;
+}
+
+static void wifi_dns_cache_put(const char* name, const wifi_dns_result_t& result)
+{
+    size_t len = strlen(name);
+    if(!result.ttl || len >= WIFI_DNS_NAME_MAX) {
+        return;
+    }
+    uint32_t ttl = result.ttl;
+    if(ttl > WIFI_DNS_CACHE_MAX_TTL) {
+        ttl = WIFI_DNS_CACHE_MAX_TTL;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_dns_mux);
+    // the same name, else a free or expired slot, else the one expiring first
+    int slot = 0;
+    for(int i = 0; i < WIFI_DNS_CACHE_SIZE; i++) {
+        wifi_dns_cache_entry_t& entry = _dns_cache[i];
+        if(entry.name[0] && !strcasecmp(entry.name, name)) {
+            slot = i;
+            break;
+        }
+        if(!entry.name[0] || (int32_t)(entry.expires - now) <= 0) {
+            slot = i;
+        } else if(_dns_cache[slot].name[0] && (int32_t)(entry.expires - _dns_cache[slot].expires) < 0) {
+            slot = i;
+        }
+    }
+    memcpy(_dns_cache[slot].name, name, len + 1);
+    _dns_cache[slot].result = result;
+    _dns_cache[slot].expires = now + ttl * 1000;
+    portEXIT_CRITICAL(&_dns_mux);
+}
+
+static int wifi_dns_skip_name(const uint8_t* packet, int pos, int len)
+{
+    while(pos < len) {
+        uint8_t label = packet[pos];
+        if(!label) {
+            return pos + 1;
+        }
+        if((label & 0xC0) == 0xC0) {
+            return pos + 2;
+        }
+        pos += label + 1;
+    }
+    return -1;
+}
+
+static int wifi_dns_put_query(uint8_t* packet, uint16_t id, const char* name)
+{
+    size_t len = strlen(name);
+    if(!len || len > 253) {
+        return -1;
+    }
+    memset(packet, 0, 12);
+    packet[0] = id >> 8;
+    packet[1] = id & 0xFF;
+    packet[2] = 0x01;            // recursion desired
+    packet[5] = 1;               // one question
+    int pos = 12;
+    while(*name) {
+        const char* dot = strchr(name, '.');
+        size_t label = dot ? dot - name : strlen(name);
+        if(!label || label > 63) {
+            return -1;
+        }
+        packet[pos++] = label;
+        memcpy(&packet[pos], name, label);
+        pos += label;
+        name += label;
+        if(*name == '.') {
+            name++;
+        }
+    }
+    packet[pos++] = 0;
+    packet[pos++] = 0;
+    packet[pos++] = 1;           // type A
+    packet[pos++] = 0;
+    packet[pos++] = 1;           // class IN
+    return pos;
+}
+
+/**
+ * Parse the answer to the query with id
+ * @return the number of addresses, 0 for a valid answer without any, -1 for a packet that is not the answer
+ */
+static int wifi_dns_parse_answer(const uint8_t* packet, int len, uint16_t id, wifi_dns_result_t& result)
+{
+    if(len < 12 || packet[0] != (id >> 8) || packet[1] != (id & 0xFF) || !(packet[2] & 0x80)) {
+        return -1;
+    }
+    if(packet[3] & 0x0F) {
+        return 0;                // NXDOMAIN and friends
+    }
+    int questions = (packet[4] << 8) | packet[5];
+    int answers = (packet[6] << 8) | packet[7];
+    int pos = 12;
+    while(questions-- && pos >= 0) {
+        pos = wifi_dns_skip_name(packet, pos, len);
+        if(pos >= 0) {
+            pos += 4;
+        }
+    }
+    result.count = 0;
+    result.ttl = 0;
+    bool first = true;
+    while(answers-- && pos >= 0 && result.count < WIFI_DNS_MAX_ADDRESSES) {
+        pos = wifi_dns_skip_name(packet, pos, len);
+        if(pos < 0 || pos + 10 > len) {
+            break;
+        }
+        uint16_t type = (packet[pos] << 8) | packet[pos + 1];
+        uint16_t rclass = (packet[pos + 2] << 8) | packet[pos + 3];
+        uint32_t ttl = ((uint32_t)packet[pos + 4] << 24) | ((uint32_t)packet[pos + 5] << 16) | (packet[pos + 6] << 8) | packet[pos + 7];
+        uint16_t rdlength = (packet[pos + 8] << 8) | packet[pos + 9];
+        pos += 10;
+        if(pos + rdlength > len) {
+            break;
+        }
+        // CNAME records in front of the addresses are skipped, their TTL still counts
+        if(first || ttl < result.ttl) {
+            result.ttl = ttl;
+            first = false;
+        }
+        if(type == 1 && rclass == 1 && rdlength == 4) {
+            result.addresses[result.count++] = IPAddress(packet[pos], packet[pos + 1], packet[pos + 2], packet[pos + 3]);
+        }
+        pos += rdlength;
+    }
+    return result.count;
+}
+
+/**
+ * Ask the configured DNS servers in turn, one socket per call so that
+ * resolving from several tasks does not queue them behind each other
+ */
+static bool wifi_dns_query(const char* name, wifi_dns_result_t& result)
+{
+    uint8_t* packet = (uint8_t*)malloc(WIFI_DNS_PACKET_MAX);
+    if(!packet) {
+        return false;
+    }
+    uint16_t id = esp_random();
+    int qlen = wifi_dns_put_query(packet, id, name);
+    if(qlen < 0) {
+        free(packet);
+        return false;
+    }
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sockfd < 0) {
+        log_e("socket: %d", errno);
+        free(packet);
+        return false;
+    }
+
+    int found = -1;
+    for(int i = 0; i < DNS_MAX_SERVERS && found < 0; i++) {
+        const ip_addr_t* server = dns_getserver(i);
+        if(!server || IP_GET_TYPE(server) != IPADDR_TYPE_V4 || !server->u_addr.ip4.addr) {
+            continue;
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(WIFI_DNS_PORT);
+        addr.sin_addr.s_addr = server->u_addr.ip4.addr;
+        wifi_dns_put_query(packet, id, name);
+        if(sendto(sockfd, packet, qlen, 0, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            continue;
+        }
+        uint32_t start = millis();
+        while(found < 0) {
+            int32_t left = WIFI_DNS_QUERY_TIMEOUT - (int32_t)(millis() - start);
+            if(left <= 0) {
+                break;
+            }
+            fd_set fdset;
+            FD_ZERO(&fdset);
+            FD_SET(sockfd, &fdset);
+            struct timeval tv = { left / 1000, (left % 1000) * 1000 };
+            if(select(sockfd + 1, &fdset, NULL, NULL, &tv) <= 0) {
+                break;
+            }
+            struct sockaddr_in from;
+            socklen_t fromlen = sizeof(from);
+            int len = recvfrom(sockfd, packet, WIFI_DNS_PACKET_MAX, 0, (struct sockaddr*)&from, &fromlen);
+            if(len > 0 && from.sin_addr.s_addr == addr.sin_addr.s_addr && from.sin_port == addr.sin_port) {
+                found = wifi_dns_parse_answer(packet, len, id, result);
+            }
+        }
+    }
+    close(sockfd);
+    free(packet);
+    return found > 0;
+}
+
+static bool wifi_dns_resolve(const char* name, wifi_dns_result_t& result)
+{
+    ip_addr_t literal;
+    if(ipaddr_aton(name, &literal) && IP_GET_TYPE(&literal) == IPADDR_TYPE_V4) {
+        result.addresses[0] = literal.u_addr.ip4.addr;
+        result.count = 1;
+        result.ttl = 0;
+        return true;
+    }
+    if(wifi_dns_cache_get(name, result)) {
+        return true;
+    }
+    if(wifi_dns_query(name, result)) {
+        wifi_dns_cache_put(name, result);
+        return true;
+    }
+    IPAddress ip;
+    if(wifi_dns_lwip_resolve(name, ip)) {
+        result.addresses[0] = ip;
+        result.count = 1;
+        result.ttl = 0;
+        return true;
+    }
+    result.count = 0;
+    return false;
+}
+
+typedef struct {
+    char* name;
+    WiFiDnsCb cb;
+} wifi_dns_request_t;
+
+static xQueueHandle _dns_queue = NULL;
+
+static void _dns_task(void* arg)
+{
+    wifi_dns_request_t* request;
+    for(;;) {
+        if(xQueueReceive(_dns_queue, &request, portMAX_DELAY) == pdTRUE) {
+            wifi_dns_result_t result;
+            bool ok = wifi_dns_resolve(request->name, result);
+            if(!ok) {
+                log_e("DNS Failed for %s", request->name);
+            }
+            request->cb(request->name, ok ? &result : NULL);
+            free(request->name);
+            delete request;
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static bool _start_dns_task()
+{
+    if(_dns_queue) {
+        return true;
+    }
+    xQueueHandle queue = xQueueCreate(WIFI_DNS_CACHE_SIZE, sizeof(wifi_dns_request_t*));
+    if(!queue) {
+        log_e("DNS Queue Create Failed!");
+        return false;
+    }
+    portENTER_CRITICAL(&_dns_mux);
+    bool started = _dns_queue != NULL;
+    if(!started) {
+        _dns_queue = queue;
+    }
+    portEXIT_CRITICAL(&_dns_mux);
+    if(started) {
+        vQueueDelete(queue);
+        return true;
+    }
+    if(xTaskCreateUniversal(_dns_task, "wifi_dns", 4096, NULL, 2, NULL, CONFIG_ARDUINO_EVENT_RUNNING_CORE) != pdPASS) {
+        log_e("DNS Task Start Failed!");
+        return false;
+    }
+    return true;
+}
+
 /**
  * Resolve the given hostname to an IP address.
  * @param aHostname     Name to be resolved
@@ -723,22 +1278,79 @@ static void wifi_dns_found_callback(const char *name, const ip_addr_t *ipaddr, v
  */
 int WiFiGenericClass::hostByName(const char* aHostname, IPAddress& aResult)
 {
-    ip_addr_t addr;
+    wifi_dns_result_t result;
     aResult = static_cast<uint32_t>(0);
-    waitStatusBits(WIFI_DNS_IDLE_BIT, 16000);
-    clearStatusBits(WIFI_DNS_IDLE_BIT | WIFI_DNS_DONE_BIT);
-    err_t err = dns_gethostbyname(aHostname, &addr, &wifi_dns_found_callback, &aResult);
-    if(err == ERR_OK && addr.u_addr.ip4.addr) {
-        aResult = addr.u_addr.ip4.addr;
-    } else if(err == ERR_INPROGRESS) {
-        waitStatusBits(WIFI_DNS_DONE_BIT, 15000);  //real internal timeout in lwip library is 14[s]
-        clearStatusBits(WIFI_DNS_DONE_BIT);
+    if(!hostByName(aHostname, result)) {
+        return 0;
     }
-    setStatusBits(WIFI_DNS_IDLE_BIT);
-    if((uint32_t)aResult == 0){
+    aResult = result.addresses[0];
+    return 1;
+}
+
+/**
+ * Resolve the given hostname to all of its IPv4 addresses.
+ * Answers are cached for their TTL, capped at WIFI_DNS_CACHE_MAX_TTL.
+ * @param aHostname     Name to be resolved
+ * @param aResult       addresses, their count and the TTL of the answer
+ * @return 1 if at least one address was found, else 0
+ */
+int WiFiGenericClass::hostByName(const char* aHostname, wifi_dns_result_t& aResult)
+{
+    if(!wifi_dns_resolve(aHostname, aResult)) {
         log_e("DNS Failed for %s", aHostname);
+        return 0;
     }
-    return (uint32_t)aResult != 0;
+    return 1;
+}
+
+/**
+ * Resolve the given hostname without blocking.
+ * Literal addresses and cached names call cb right away, others are
+ * resolved by a task that calls cb once the answer is in.
+ * @param aHostname     Name to be resolved
+ * @param cb            called with the result, NULL if the name could not be resolved
+ * @return false if the request could not be queued
+ */
+bool WiFiGenericClass::hostByNameAsync(const char* aHostname, WiFiDnsCb cb)
+{
+    if(!aHostname || !cb) {
+        return false;
+    }
+    wifi_dns_result_t result;
+    ip_addr_t literal;
+    if(ipaddr_aton(aHostname, &literal) && IP_GET_TYPE(&literal) == IPADDR_TYPE_V4) {
+        result.addresses[0] = literal.u_addr.ip4.addr;
+        result.count = 1;
+        result.ttl = 0;
+        cb(aHostname, &result);
+        return true;
+    }
+    if(wifi_dns_cache_get(aHostname, result)) {
+        cb(aHostname, &result);
+        return true;
+    }
+    if(!_start_dns_task()) {
+        return false;
+    }
+    wifi_dns_request_t* request = new wifi_dns_request_t;
+    request->name = strdup(aHostname);
+    request->cb = cb;
+    if(!request->name || xQueueSend(_dns_queue, &request, 0) != pdPASS) {
+        log_e("DNS Queue Send Failed!");
+        free(request->name);
+        delete request;
+        return false;
+    }
+    return true;
+}
+
+void WiFiGenericClass::clearDnsCache()
+{
+    portENTER_CRITICAL(&_dns_mux);
+    for(int i = 0; i < WIFI_DNS_CACHE_SIZE; i++) {
+        _dns_cache[i].name[0] = 0;
+    }
+    portEXIT_CRITICAL(&_dns_mux);
 }
 
 IPAddress WiFiGenericClass::calculateNetworkID(IPAddress ip, IPAddress subnet) {
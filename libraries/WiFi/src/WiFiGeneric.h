@@ -49,6 +49,16 @@ typedef void (*WiFiProvEventCb)(system_event_t *sys_event, wifi_prov_event_t *pr
 
 typedef size_t wifi_event_id_t;
 
+#ifndef WIFI_EVENT_QUEUE_SIZE
+#define WIFI_EVENT_QUEUE_SIZE 32 // events waiting for the network_event task, more are dropped
+#endif
+
+typedef struct {
+    uint32_t posted;  // events queued for the callbacks
+    uint32_t dropped; // events the callbacks never saw, the queue was full
+    uint32_t peak;    // most events waiting at once
+} wifi_event_stats_t;
+
 typedef enum {
     WIFI_POWER_19_5dBm = 78,// 19.5dBm
     WIFI_POWER_19dBm = 76,// 19dBm
@@ -64,6 +74,66 @@ typedef enum {
     WIFI_POWER_MINUS_1dBm = -4// -1dBm
 } wifi_power_t;
 
+typedef enum {
+    WIFI_PROFILE_DEFAULT,      // modem sleep between DTIM beacons, full TX power, what the core does anyway
+    WIFI_PROFILE_LOW_LATENCY,  // radio always on, HT20
+    WIFI_PROFILE_THROUGHPUT,   // radio always on, HT40, wide TX block ack window
+    WIFI_PROFILE_BATTERY       // sleeps over several beacons, reduced TX power, HT20
+} wifi_profile_t;
+
+typedef struct {
+    wifi_ps_type_t ps;
+    uint16_t listenInterval;   // beacons slept over with WIFI_PS_MAX_MODEM, 0 for the driver's 3
+    wifi_power_t txPower;
+    uint8_t bandwidth;         // wifi_bandwidth_t, 0 leaves it to the driver
+    uint8_t rxBaWin;           // block ack windows, 0 for the build default, only read when WiFi is initialised
+    uint8_t txBaWin;
+} wifi_profile_config_t;
+
+typedef enum {
+    WIFI_BUFFERS_DEFAULT,      // what the SDK was built with
+    WIFI_BUFFERS_THROUGHPUT,   // more RX and TX buffers, AMPDU both ways
+    WIFI_BUFFERS_LOW_MEMORY    // few buffers, no AMPDU
+} wifi_buffers_t;
+
+#ifndef WIFI_BUFFERS_PRESET
+#define WIFI_BUFFERS_PRESET WIFI_BUFFERS_DEFAULT // the board menu picks one, setBuffers() overrides it
+#endif
+
+// WiFi driver buffers, only read when WiFi is initialised
+typedef struct {
+    uint8_t staticRxBuffers;   // 2 to 25, allocated up front
+    uint16_t dynamicRxBuffers; // 0 for no limit, to 1024
+    uint16_t dynamicTxBuffers; // 1 to 128
+    bool ampduRx;
+    bool ampduTx;
+} wifi_buffer_config_t;
+
+#ifndef WIFI_DNS_MAX_ADDRESSES
+#define WIFI_DNS_MAX_ADDRESSES 4 // A records kept per name
+#endif
+
+#ifndef WIFI_DNS_CACHE_SIZE
+#define WIFI_DNS_CACHE_SIZE 8 // names answered without a query while their TTL lasts
+#endif
+
+#ifndef WIFI_DNS_CACHE_MAX_TTL
+#define WIFI_DNS_CACHE_MAX_TTL 3600 // seconds, longer TTLs are cut to this
+#endif
+
+#ifndef WIFI_DNS_QUERY_TIMEOUT
+#define WIFI_DNS_QUERY_TIMEOUT 2000 // ms to wait for each DNS server
+#endif
+
+typedef struct {
+    IPAddress addresses[WIFI_DNS_MAX_ADDRESSES];
+    uint8_t count;
+    uint32_t ttl;     // seconds, 0 when the answer did not carry one
+} wifi_dns_result_t;
+
+// result is NULL when the name could not be resolved
+typedef std::function<void(const char *hostname, const wifi_dns_result_t *result)> WiFiDnsCb;
+
 static const int AP_STARTED_BIT    = BIT0;
 static const int AP_HAS_IP6_BIT    = BIT1;
 static const int AP_HAS_CLIENT_BIT = BIT2;
@@ -93,6 +163,9 @@ class WiFiGenericClass
     void removeEvent(WiFiEventSysCb cbEvent, system_event_id_t event = SYSTEM_EVENT_MAX);
     void removeEvent(wifi_event_id_t id);
 
+    static bool setEventTask(UBaseType_t priority, BaseType_t core, uint32_t stackSize = 4096);
+    static void getEventStats(wifi_event_stats_t* stats);
+
     static int getStatusBits();
     static int waitStatusBits(int bits, uint32_t timeout_ms);
 
@@ -114,18 +187,35 @@ class WiFiGenericClass
     bool setTxPower(wifi_power_t power);
     wifi_power_t getTxPower();
 
+    bool setPerformanceProfile(wifi_profile_t profile);
+    bool setPerformanceProfile(const wifi_profile_config_t& config);
+    static const wifi_profile_config_t& getPerformanceProfile();
+
+    static bool setBuffers(wifi_buffers_t preset);
+    static bool setBuffers(const wifi_buffer_config_t& config);
+    static const wifi_buffer_config_t& getBuffers();
+
     static esp_err_t _eventCallback(void *arg, system_event_t *event, wifi_prov_event_t *prov_event);
+    static void _handleEvent(system_event_t *event);
 
   protected:
     static bool _persistent;
     static bool _long_range;
     static wifi_mode_t _forceSleepLastMode;
+    static wifi_profile_config_t _profile;
+    static wifi_buffer_config_t _buffers;
+    static bool _profileSet;
+
+    static bool _applyProfile();
 
     static int setStatusBits(int bits);
     static int clearStatusBits(int bits);
 
   public:
     static int hostByName(const char *aHostname, IPAddress &aResult);
+    static int hostByName(const char *aHostname, wifi_dns_result_t &aResult);
+    static bool hostByNameAsync(const char *aHostname, WiFiDnsCb cb);
+    static void clearDnsCache();
 
     static IPAddress calculateNetworkID(IPAddress ip, IPAddress subnet);
     static IPAddress calculateBroadcast(IPAddress ip, IPAddress subnet);
@@ -29,6 +29,10 @@
 #include <esp32-hal.h>
 
 WiFiMulti::WiFiMulti()
+    : _state(WIFI_MULTI_IDLE), _knownChannels(0), _scanChannels(0), _fullScan(false), _roamScan(false),
+      _best(-1), _bestRssi(INT_MIN), _bestChannel(0), _lastGood(-1), _lastChannel(0), _lastGoodTried(false),
+      _connecting(-1), _connectStarted(0), _roaming(false), _roamRssi(WIFI_MULTI_ROAM_RSSI),
+      _roamInterval(WIFI_MULTI_ROAM_INTERVAL), _roamChecked(0)
 {
 }
 
@@ -85,120 +89,240 @@ bool WiFiMulti::addAP(const char* ssid, const char *passphrase)
     return true;
 }
 
+/**
+ * Look for a better AP while connected
+ * every interval ms, when the RSSI is below rssiThreshold, the channels the listed SSIDs were seen on
+ * are scanned in the background and an AP that is WIFI_MULTI_ROAM_HYSTERESIS dB better is moved to.
+ */
+void WiFiMulti::setRoaming(bool enable, int8_t rssiThreshold, uint32_t interval)
+{
+    _roaming = enable;
+    _roamRssi = rssiThreshold;
+    _roamInterval = interval;
+}
+
+/**
+ * Keep connected to the best of the listed APs, call it from loop()
+ * Never blocks: the last good AP is tried first, then the channels the listed SSIDs were seen on
+ * are scanned one at a time, and only when none of them answers all channels are.
+ * @param connectTimeout ms a connection attempt may take
+ * @return WiFi.status(), WL_NO_SSID_AVAIL while scanning
+ */
 uint8_t WiFiMulti::run(uint32_t connectTimeout)
 {
-    int8_t scanResult;
     uint8_t status = WiFi.status();
-    if(status == WL_CONNECTED) {
-        for(uint32_t x = 0; x < APlist.size(); x++) {
-            if(WiFi.SSID()==APlist[x].ssid) {
-                return status;
+
+    if(_state == WIFI_MULTI_CONNECTING) {
+        if(status != WL_CONNECTED && status != WL_NO_SSID_AVAIL && status != WL_CONNECT_FAILED && (millis() - _connectStarted) <= connectTimeout) {
+            return status;
+        }
+        switch(status) {
+        case WL_CONNECTED:
+            log_i("[WIFI] Connecting done.");
+            log_d("[WIFI] SSID: %s", WiFi.SSID().c_str());
+            log_d("[WIFI] IP: %s", WiFi.localIP().toString().c_str());
+            log_d("[WIFI] MAC: %s", WiFi.BSSIDstr().c_str());
+            log_d("[WIFI] Channel: %d", WiFi.channel());
+            break;
+        case WL_NO_SSID_AVAIL:
+            log_e("[WIFI] Connecting Failed AP not found.");
+            break;
+        case WL_CONNECT_FAILED:
+            log_e("[WIFI] Connecting Failed.");
+            break;
+        default:
+            log_e("[WIFI] Connecting Failed (%d).", status);
+            break;
+        }
+        _state = WIFI_MULTI_IDLE;
+        if(status == WL_CONNECTED) {
+            uint8_t* bssid = WiFi.BSSID();
+            _lastGood = _connecting;
+            _lastChannel = WiFi.channel();
+            if(bssid) {
+                memcpy(_lastBSSID, bssid, sizeof(_lastBSSID));
+            }
+            _lastGoodTried = false;
+            if(_lastChannel > 0 && _lastChannel <= 14) {
+                _knownChannels |= 1 << _lastChannel;
             }
+            _state = WIFI_MULTI_CONNECTED;
+            _roamChecked = millis();
+            return status;
         }
-        WiFi.disconnect(false,false);
-        delay(10);
-        status = WiFi.status();
     }
 
-    scanResult = WiFi.scanNetworks();
-    if(scanResult == WIFI_SCAN_RUNNING) {
-        // scan is running
-        return WL_NO_SSID_AVAIL;
-    } else if(scanResult >= 0) {
-        // scan done analyze
-        WifiAPlist_t bestNetwork { NULL, NULL };
-        int bestNetworkDb = INT_MIN;
-        uint8_t bestBSSID[6];
-        int32_t bestChannel = 0;
-
-        log_i("[WIFI] scan done");
-
-        if(scanResult == 0) {
-            log_e("[WIFI] no networks found");
+    if(status == WL_CONNECTED) {
+        if(_find(WiFi.SSID()) < 0) {
+            WiFi.disconnect(false,false);
+            delay(10);
+            status = WiFi.status();
+            _state = WIFI_MULTI_IDLE;
+        } else if(_state == WIFI_MULTI_SCANNING && _roamScan) {
+            if(_scanStep() == WIFI_SCAN_RUNNING) {
+                return status;
+            }
+            _state = WIFI_MULTI_CONNECTED;
+            int8_t rssi = WiFi.RSSI();
+            if(_best >= 0 && _bestRssi >= rssi + WIFI_MULTI_ROAM_HYSTERESIS) {
+                log_i("[WIFI] Roaming to BSSID: %02X:%02X:%02X:%02X:%02X:%02X Channel: %d (%d, was %d)", _bestBSSID[0], _bestBSSID[1], _bestBSSID[2], _bestBSSID[3], _bestBSSID[4], _bestBSSID[5], _bestChannel, _bestRssi, rssi);
+                _connect(_best, _bestChannel, _bestBSSID);
+            }
+            return status;
         } else {
-            log_i("[WIFI] %d networks found", scanResult);
-            for(int8_t i = 0; i < scanResult; ++i) {
-
-                String ssid_scan;
-                int32_t rssi_scan;
-                uint8_t sec_scan;
-                uint8_t* BSSID_scan;
-                int32_t chan_scan;
-
-                WiFi.getNetworkInfo(i, ssid_scan, sec_scan, rssi_scan, BSSID_scan, chan_scan);
-
-                bool known = false;
-                for(uint32_t x = 0; x < APlist.size(); x++) {
-                    WifiAPlist_t entry = APlist[x];
-
-                    if(ssid_scan == entry.ssid) { // SSID match
-                        known = true;
-                        if(rssi_scan > bestNetworkDb) { // best network
-                            if(sec_scan == WIFI_AUTH_OPEN || entry.passphrase) { // check for passphrase if not open wlan
-                                bestNetworkDb = rssi_scan;
-                                bestChannel = chan_scan;
-                                memcpy((void*) &bestNetwork, (void*) &entry, sizeof(bestNetwork));
-                                memcpy((void*) &bestBSSID, (void*) BSSID_scan, sizeof(bestBSSID));
-                            }
-                        }
-                        break;
-                    }
-                }
-
-                if(known) {
-                    log_d(" --->   %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
-                } else {
-                    log_d("       %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
+            if(_state != WIFI_MULTI_CONNECTED) {
+                // the driver got there on its own
+                _state = WIFI_MULTI_CONNECTED;
+                _roamChecked = millis();
+            }
+            if(_roaming && (millis() - _roamChecked) >= _roamInterval) {
+                _roamChecked = millis();
+                if(WiFi.RSSI() < _roamRssi) {
+                    log_d("[WIFI] RSSI %d, looking for a better AP", WiFi.RSSI());
+                    _startScan(true);
                 }
             }
+            return status;
         }
+    }
 
-        // clean up ram
-        WiFi.scanDelete();
-
-        if(bestNetwork.ssid) {
-            log_i("[WIFI] Connecting BSSID: %02X:%02X:%02X:%02X:%02X:%02X SSID: %s Channel: %d (%d)", bestBSSID[0], bestBSSID[1], bestBSSID[2], bestBSSID[3], bestBSSID[4], bestBSSID[5], bestNetwork.ssid, bestChannel, bestNetworkDb);
+    if(_state == WIFI_MULTI_SCANNING) {
+        // a roaming scan that outlived the link finds the next AP instead
+        _roamScan = false;
+        if(_scanStep() == WIFI_SCAN_RUNNING) {
+            return WL_NO_SSID_AVAIL;
+        }
+        _state = WIFI_MULTI_IDLE;
+        if(_best >= 0) {
+            log_i("[WIFI] Connecting BSSID: %02X:%02X:%02X:%02X:%02X:%02X SSID: %s Channel: %d (%d)", _bestBSSID[0], _bestBSSID[1], _bestBSSID[2], _bestBSSID[3], _bestBSSID[4], _bestBSSID[5], APlist[_best].ssid, _bestChannel, _bestRssi);
+            _connect(_best, _bestChannel, _bestBSSID);
+        } else {
+            log_e("[WIFI] no matching wifi found!");
+        }
+        return status;
+    }
 
-            WiFi.begin(bestNetwork.ssid, bestNetwork.passphrase, bestChannel, bestBSSID);
-            status = WiFi.status();
+    // link lost or never made, a reconnect to the same AP needs no scan
+    if(_lastGood >= 0 && !_lastGoodTried) {
+        _lastGoodTried = true;
+        log_i("[WIFI] Connecting to the last AP, SSID: %s Channel: %d", APlist[_lastGood].ssid, _lastChannel);
+        _connect(_lastGood, _lastChannel, _lastBSSID);
+        return status;
+    }
 
-            auto startTime = millis();
-            // wait for connection, fail, or timeout
-            while(status != WL_CONNECTED && status != WL_NO_SSID_AVAIL && status != WL_CONNECT_FAILED && (millis() - startTime) <= connectTimeout) {
-                delay(10);
-                status = WiFi.status();
-            }
+    _startScan(false);
+    return status;
+}
 
-            switch(status) {
-            case WL_CONNECTED:
-                log_i("[WIFI] Connecting done.");
-                log_d("[WIFI] SSID: %s", WiFi.SSID().c_str());
-                log_d("[WIFI] IP: %s", WiFi.localIP().toString().c_str());
-                log_d("[WIFI] MAC: %s", WiFi.BSSIDstr().c_str());
-                log_d("[WIFI] Channel: %d", WiFi.channel());
-                break;
-            case WL_NO_SSID_AVAIL:
-                log_e("[WIFI] Connecting Failed AP not found.");
-                break;
-            case WL_CONNECT_FAILED:
-                log_e("[WIFI] Connecting Failed.");
-                break;
-            default:
-                log_e("[WIFI] Connecting Failed (%d).", status);
-                break;
-            }
-        } else {
-            log_e("[WIFI] no matching wifi found!");
+int WiFiMulti::_find(const String& ssid)
+{
+    for(uint32_t x = 0; x < APlist.size(); x++) {
+        if(ssid == APlist[x].ssid) {
+            return x;
         }
-    } else {
-        // start scan
+    }
+    return -1;
+}
+
+void WiFiMulti::_connect(int index, int32_t channel, const uint8_t* bssid)
+{
+    WiFi.begin(APlist[index].ssid, APlist[index].passphrase, channel, bssid);
+    _connecting = index;
+    _connectStarted = millis();
+    _state = WIFI_MULTI_CONNECTING;
+}
+
+void WiFiMulti::_startScan(bool roam)
+{
+    _roamScan = roam;
+    _fullScan = false;
+    _scanChannels = _knownChannels;
+    _best = -1;
+    _bestRssi = INT_MIN;
+    if(!roam) {
         log_d("[WIFI] delete old wifi config...");
         WiFi.disconnect();
+    }
+    if(_scanNext()) {
+        _state = WIFI_MULTI_SCANNING;
+    } else {
+        _state = roam ? WIFI_MULTI_CONNECTED : WIFI_MULTI_IDLE;
+    }
+}
 
+/**
+ * start the scan of the next known channel, or of all channels once those are done
+ * @return false when there is nothing left to scan
+ */
+bool WiFiMulti::_scanNext()
+{
+    int16_t result;
+    if(_scanChannels) {
+        uint8_t channel = __builtin_ctz(_scanChannels);
+        _scanChannels &= ~(1 << channel);
+        log_d("[WIFI] start scan, channel %u", channel);
+        result = WiFi.scanNetworks(true, false, false, WIFI_MULTI_SCAN_MS_PER_CHAN, channel);
+    } else if(!_fullScan && !_roamScan) {
+        // roaming only ever looks at the known channels, it must not take the link off air for long
+        _fullScan = true;
         log_d("[WIFI] start scan");
-        // scan wifi async mode
-        WiFi.scanNetworks(true);
+        result = WiFi.scanNetworks(true);
+    } else {
+        return false;
     }
+    return result == WIFI_SCAN_RUNNING;
+}
 
-    return status;
+/**
+ * collect the results of a finished channel and move on to the next one
+ * @return WIFI_SCAN_RUNNING until the scan is over
+ */
+int16_t WiFiMulti::_scanStep()
+{
+    int16_t scanResult = WiFi.scanComplete();
+    if(scanResult == WIFI_SCAN_RUNNING) {
+        return WIFI_SCAN_RUNNING;
+    }
+
+    if(scanResult > 0) {
+        log_i("[WIFI] %d networks found", scanResult);
+        uint8_t* current = _roamScan ? WiFi.BSSID() : NULL;
+        for(int16_t i = 0; i < scanResult; ++i) {
+
+            String ssid_scan;
+            int32_t rssi_scan;
+            uint8_t sec_scan;
+            uint8_t* BSSID_scan;
+            int32_t chan_scan;
+
+            WiFi.getNetworkInfo(i, ssid_scan, sec_scan, rssi_scan, BSSID_scan, chan_scan);
+
+            int x = _find(ssid_scan);
+            if(x >= 0) {
+                if(chan_scan > 0 && chan_scan <= 14) {
+                    _knownChannels |= 1 << chan_scan;
+                }
+                bool connected = current && memcmp(current, BSSID_scan, 6) == 0;
+                if(!connected && rssi_scan > _bestRssi && (sec_scan == WIFI_AUTH_OPEN || APlist[x].passphrase)) { // check for passphrase if not open wlan
+                    _best = x;
+                    _bestRssi = rssi_scan;
+                    _bestChannel = chan_scan;
+                    memcpy((void*) &_bestBSSID, (void*) BSSID_scan, sizeof(_bestBSSID));
+                }
+                log_d(" --->   %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
+            } else {
+                log_d("       %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
+            }
+        }
+    }
+
+    // clean up ram
+    WiFi.scanDelete();
+
+    // the rest of the known channels are cheap, the full scan only runs when they had nothing
+    if((_scanChannels || _best < 0) && _scanNext()) {
+        return WIFI_SCAN_RUNNING;
+    }
+    log_i("[WIFI] scan done");
+    return scanResult;
 }
@@ -29,6 +29,22 @@
 #include "WiFi.h"
 #include <vector>
 
+#ifndef WIFI_MULTI_SCAN_MS_PER_CHAN
+#define WIFI_MULTI_SCAN_MS_PER_CHAN 120 // active scan time on a channel a known AP was seen on
+#endif
+
+#ifndef WIFI_MULTI_ROAM_RSSI
+#define WIFI_MULTI_ROAM_RSSI -75 // dBm below which a connected run() looks for a better AP
+#endif
+
+#ifndef WIFI_MULTI_ROAM_INTERVAL
+#define WIFI_MULTI_ROAM_INTERVAL 30000 // ms between two of those looks
+#endif
+
+#ifndef WIFI_MULTI_ROAM_HYSTERESIS
+#define WIFI_MULTI_ROAM_HYSTERESIS 8 // dB the other AP has to be better by
+#endif
+
 typedef struct {
     char * ssid;
     char * passphrase;
@@ -44,8 +60,47 @@ public:
 
     uint8_t run(uint32_t connectTimeout=5000);
 
+    void setRoaming(bool enable, int8_t rssiThreshold = WIFI_MULTI_ROAM_RSSI, uint32_t interval = WIFI_MULTI_ROAM_INTERVAL);
+
 private:
+    typedef enum {
+        WIFI_MULTI_IDLE,
+        WIFI_MULTI_SCANNING,
+        WIFI_MULTI_CONNECTING,
+        WIFI_MULTI_CONNECTED
+    } wifi_multi_state_t;
+
     std::vector<WifiAPlist_t> APlist;
+
+    wifi_multi_state_t _state;
+    uint16_t _knownChannels;    // bit n set when a listed SSID was seen on channel n
+    uint16_t _scanChannels;     // of those, the ones the current scan still has to do
+    bool _fullScan;
+    bool _roamScan;
+
+    int _best;                  // APlist index of the strongest match of the scan, -1 for none
+    int32_t _bestRssi;
+    int32_t _bestChannel;
+    uint8_t _bestBSSID[6];
+
+    int _lastGood;              // what run() connected to last, tried before any scan
+    int32_t _lastChannel;
+    uint8_t _lastBSSID[6];
+    bool _lastGoodTried;
+
+    int _connecting;
+    uint32_t _connectStarted;
+
+    bool _roaming;
+    int8_t _roamRssi;
+    uint32_t _roamInterval;
+    uint32_t _roamChecked;
+
+    int _find(const String& ssid);
+    void _connect(int index, int32_t channel, const uint8_t* bssid);
+    void _startScan(bool roam);
+    bool _scanNext();
+    int16_t _scanStep();
 };
 
 #endif /* WIFICLIENTMULTI_H_ */
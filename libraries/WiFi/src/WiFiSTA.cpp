@@ -42,6 +42,18 @@ extern "C" {
 #include "lwip/dns.h"
 #include <esp_smartconfig.h>
 #include <tcpip_adapter.h>
+#include "lwip/dhcp.h"
+#include <esp_clk.h>
+#include <esp_attr.h>
+#include <nvs.h>
+#include <rom/crc.h>
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_wifi_internal.h>
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/priv/tcpip_priv.h"
 }
 
 // -----------------------------------------------------------------------------------------------------------------------
@@ -71,11 +83,39 @@ static bool sta_config_equal(const wifi_config_t& lhs, const wifi_config_t& rhs)
 
 bool WiFiSTAClass::_autoReconnect = true;
 bool WiFiSTAClass::_useStaticIp = false;
+wifi_fast_timing_t WiFiSTAClass::_fastTiming;
 String WiFiSTAClass::_hostname = "esp32-arduino";
 
 static wl_status_t _sta_status = WL_NO_SHIELD;
 static EventGroupHandle_t _sta_status_group = NULL;
 
+#define WIFI_FAST_MAGIC 0x57465331 // "WFS1"
+
+// what beginFast() needs to skip the scan, PBKDF2 and DHCP, kept over deep sleep
+typedef struct {
+    uint32_t magic;
+    uint32_t key;       // crc of ssid and passphrase, new credentials drop the cache
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t hasPmk;
+    uint8_t pmk[32];
+    uint32_t ip;
+    uint32_t gw;
+    uint32_t netmask;
+    uint32_t dns1;
+    uint32_t dns2;
+    uint32_t lease;     // seconds, 0 when the address can not be reused
+    uint64_t obtained;  // esp_clk_rtc_time() of the DHCP ack
+    uint32_t crc;
+} wifi_fast_cache_t;
+
+static RTC_DATA_ATTR wifi_fast_cache_t _fast_cache;
+
+static uint32_t fast_cache_crc(const wifi_fast_cache_t* cache)
+{
+    return crc32_le(0, (const uint8_t*)cache, offsetof(wifi_fast_cache_t, crc));
+}
+
 void WiFiSTAClass::_setStatus(wl_status_t status)
 {
     if(!_sta_status_group){
@@ -151,6 +191,7 @@ wl_status_t WiFiSTAClass::begin(const char* ssid, const char *passphrase, int32_
     if(channel > 0 && channel <= 13) {
         conf.sta.channel = channel;
     }
+    conf.sta.listen_interval = WiFiGenericClass::getPerformanceProfile().listenInterval;
 
     wifi_config_t current_conf;
     esp_wifi_get_config(WIFI_IF_STA, &current_conf);
@@ -224,6 +265,232 @@ wl_status_t WiFiSTAClass::begin()
     return status();
 }
 
+/**
+ * Connect using what the last successful connection learned
+ * The first call scans, derives the PMK and runs DHCP as usual and then caches the BSSID, channel,
+ * PMK and lease in RTC memory (and NVS with persist). Later calls, after deep sleep for example,
+ * go straight to that AP with the PMK and, while the lease is within its renewal time, the cached
+ * address without DHCP. When the cached AP does not answer within timeout_ms the cache is dropped
+ * and a full scan with DHCP is done. Blocks until connected or failed, fastTiming() has the phases.
+ * @param ssid const char*          Pointer to the SSID string.
+ * @param passphrase const char *   Optional. Passphrase or 64 hex digit PSK.
+ * @param timeout_ms                Optional. Time given to the cached AP.
+ * @param persist                   Optional. Keep the cache in NVS too, for cold boots.
+ * @return
+ */
+wl_status_t WiFiSTAClass::beginFast(const char* ssid, const char *passphrase, uint32_t timeout_ms, bool persist)
+{
+    uint32_t start = millis();
+    memset(&_fastTiming, 0, sizeof(_fastTiming));
+
+    if(!ssid || *ssid == 0x00 || strlen(ssid) > 31) {
+        log_e("SSID too long or missing!");
+        return WL_CONNECT_FAILED;
+    }
+    size_t passLen = passphrase ? strlen(passphrase) : 0;
+    if(passLen > 64) {
+        log_e("passphrase too long!");
+        return WL_CONNECT_FAILED;
+    }
+
+    uint32_t key = crc32_le(crc32_le(0, (const uint8_t*)ssid, strlen(ssid) + 1), (const uint8_t*)(passphrase ? passphrase : ""), passLen);
+    bool cached = _loadFastCache(key, persist);
+
+    // the PBKDF2 behind a passphrase takes the better part of a second, pass the PMK as PSK instead
+    uint8_t pmk[32];
+    bool hasPmk = false;
+    char psk[65];
+    const char* secret = passphrase;
+    if(cached && _fast_cache.hasPmk) {
+        memcpy(pmk, _fast_cache.pmk, sizeof(pmk));
+        hasPmk = true;
+    } else if(passLen >= 8 && passLen < 64) {
+        uint32_t derive = millis();
+        mbedtls_md_context_t ctx;
+        mbedtls_md_init(&ctx);
+        if(mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1) == 0
+            && mbedtls_pkcs5_pbkdf2_hmac(&ctx, (const unsigned char*)passphrase, passLen, (const unsigned char*)ssid, strlen(ssid), 4096, sizeof(pmk), pmk) == 0) {
+            hasPmk = true;
+        }
+        mbedtls_md_free(&ctx);
+        _fastTiming.pmk = millis() - derive;
+    }
+    if(hasPmk) {
+        for(size_t i = 0; i < sizeof(pmk); i++) {
+            sprintf(psk + i * 2, "%02x", pmk[i]);
+        }
+        secret = psk;
+    }
+
+    wl_status_t s = WL_DISCONNECTED;
+    if(cached) {
+        _fastTiming.cached = true;
+        // within T1 the server has not started to think about giving the address away
+        uint64_t age = (esp_clk_rtc_time() - _fast_cache.obtained) / 1000000ULL;
+        if(!_useStaticIp && _fast_cache.lease && age < _fast_cache.lease / 2) {
+            _fastTiming.staticIp = config(_fast_cache.ip, _fast_cache.gw, _fast_cache.netmask, _fast_cache.dns1, _fast_cache.dns2);
+        }
+        _setStatus(WL_DISCONNECTED);
+        uint32_t phase = millis();
+        if(begin(ssid, secret, _fast_cache.channel, _fast_cache.bssid) != WL_CONNECT_FAILED) {
+            s = (wl_status_t)_waitFastConnect(phase, timeout_ms);
+        }
+        if(s != WL_CONNECTED) {
+            log_w("cached AP did not answer (%d), scanning", s);
+            _fastTiming.fallback = true;
+            clearFastCache();
+            esp_wifi_disconnect();
+            if(_fastTiming.staticIp) {
+                config((uint32_t)0, (uint32_t)0, (uint32_t)0);
+                _fastTiming.staticIp = false;
+            }
+        }
+    }
+
+    if(s != WL_CONNECTED) {
+        // a WL_NO_SSID_AVAIL left from the cached AP would end the wait at once
+        _setStatus(WL_DISCONNECTED);
+        uint32_t phase = millis();
+        if(begin(ssid, secret) == WL_CONNECT_FAILED) {
+            _fastTiming.total = millis() - start;
+            return WL_CONNECT_FAILED;
+        }
+        s = (wl_status_t)_waitFastConnect(phase, WIFI_FULL_CONNECT_TIMEOUT);
+    }
+
+    if(s == WL_CONNECTED) {
+        _saveFastCache(key, hasPmk ? pmk : NULL, persist, !_fastTiming.staticIp);
+    }
+    _fastTiming.total = millis() - start;
+    log_d("fast connect: pmk %u ms, associate %u ms, ip %u ms, total %u ms%s%s", _fastTiming.pmk, _fastTiming.associate,
+        _fastTiming.ip, _fastTiming.total, _fastTiming.staticIp ? ", cached lease" : "", _fastTiming.fallback ? ", after a scan" : "");
+    return s;
+}
+
+/**
+ * Forget what beginFast() cached, in RTC memory and NVS
+ */
+void WiFiSTAClass::clearFastCache()
+{
+    memset(&_fast_cache, 0, sizeof(_fast_cache));
+    nvs_handle handle;
+    if(nvs_open("wififast", NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, "cache");
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+/**
+ * Where the time of the last beginFast() went
+ * @return wifi_fast_timing_t
+ */
+const wifi_fast_timing_t& WiFiSTAClass::fastTiming()
+{
+    return _fastTiming;
+}
+
+bool WiFiSTAClass::_loadFastCache(uint32_t key, bool persist)
+{
+    if(_fast_cache.magic == WIFI_FAST_MAGIC && _fast_cache.crc == fast_cache_crc(&_fast_cache)) {
+        return _fast_cache.key == key;
+    }
+    memset(&_fast_cache, 0, sizeof(_fast_cache));
+    if(!persist) {
+        return false;
+    }
+    nvs_handle handle;
+    if(nvs_open("wififast", NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    wifi_fast_cache_t stored;
+    size_t len = sizeof(stored);
+    esp_err_t err = nvs_get_blob(handle, "cache", &stored, &len);
+    nvs_close(handle);
+    if(err != ESP_OK || len != sizeof(stored) || stored.magic != WIFI_FAST_MAGIC || stored.crc != fast_cache_crc(&stored) || stored.key != key) {
+        return false;
+    }
+    // the RTC clock started over with the power, the age of the lease is unknown
+    stored.lease = 0;
+    stored.crc = fast_cache_crc(&stored);
+    _fast_cache = stored;
+    return true;
+}
+
+void WiFiSTAClass::_saveFastCache(uint32_t key, const uint8_t* pmk, bool persist, bool leaseRenewed)
+{
+    wifi_fast_cache_t cache = _fast_cache;
+    cache.magic = WIFI_FAST_MAGIC;
+    cache.key = key;
+
+    wifi_ap_record_t info;
+    if(esp_wifi_sta_get_ap_info(&info) != ESP_OK) {
+        return;
+    }
+    memcpy(cache.bssid, info.bssid, sizeof(cache.bssid));
+    cache.channel = info.primary;
+    cache.hasPmk = pmk != NULL;
+    if(pmk) {
+        memcpy(cache.pmk, pmk, sizeof(cache.pmk));
+    }
+
+    if(leaseRenewed) {
+        tcpip_adapter_ip_info_t ip;
+        struct netif* netif = NULL;
+        struct dhcp* dhcp = NULL;
+        cache.lease = 0;
+        if(!_useStaticIp && tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &ip) == ESP_OK
+            && tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void**)&netif) == ESP_OK && netif && (dhcp = netif_dhcp_data(netif)) != NULL) {
+            cache.ip = ip.ip.addr;
+            cache.gw = ip.gw.addr;
+            cache.netmask = ip.netmask.addr;
+            cache.dns1 = ip_2_ip4(dns_getserver(0))->addr;
+            cache.dns2 = ip_2_ip4(dns_getserver(1))->addr;
+            cache.lease = dhcp->offered_t0_lease;
+            cache.obtained = esp_clk_rtc_time();
+        }
+    }
+    cache.crc = fast_cache_crc(&cache);
+
+    // NVS only sees a write when the AP, key or address moved, not on every renewal
+    bool changed = memcmp(&cache, &_fast_cache, offsetof(wifi_fast_cache_t, lease)) != 0;
+    _fast_cache = cache;
+    if(!persist || !changed) {
+        return;
+    }
+    nvs_handle handle;
+    if(nvs_open("wififast", NVS_READWRITE, &handle) != ESP_OK) {
+        log_w("fast connect cache not stored");
+        return;
+    }
+    if(nvs_set_blob(handle, "cache", &cache, sizeof(cache)) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+uint8_t WiFiSTAClass::_waitFastConnect(uint32_t start, uint32_t timeout_ms)
+{
+    uint32_t associated = 0;
+    wl_status_t s = status();
+    while((millis() - start) < timeout_ms) {
+        if(!associated && (WiFiGenericClass::getStatusBits() & STA_CONNECTED_BIT)) {
+            associated = millis();
+            _fastTiming.associate = associated - start;
+        }
+        s = status();
+        if(s == WL_CONNECTED) {
+            _fastTiming.ip = millis() - (associated ? associated : start);
+            break;
+        }
+        if(s == WL_CONNECT_FAILED || s == WL_NO_SSID_AVAIL) {
+            break;
+        }
+        delay(2);
+    }
+    return s;
+}
+
 /**
  * will force a disconnect and then start reconnecting to AP
  * @return true when successful
@@ -614,6 +881,189 @@ int8_t WiFiSTAClass::RSSI(void)
     return 0;
 }
 
+static int8_t _rssi_history[WIFI_STATS_RSSI_HISTORY];
+static uint8_t _rssi_head = 0;
+static uint8_t _rssi_count = 0;
+static uint32_t _sta_connected_at = 0;
+static uint32_t _sta_connects = 0;
+static uint32_t _sta_disconnects = 0;
+static uint32_t _sta_beacon_timeouts = 0;
+static uint8_t _sta_last_reason = 0;
+static esp_timer_handle_t _stats_timer = NULL;
+static portMUX_TYPE _stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool _sample_rssi(wifi_ap_record_t* info)
+{
+    if(esp_wifi_sta_get_ap_info(info) != ESP_OK) {
+        return false;
+    }
+    portENTER_CRITICAL(&_stats_mux);
+    _rssi_history[_rssi_head] = info->rssi;
+    _rssi_head = (_rssi_head + 1) % WIFI_STATS_RSSI_HISTORY;
+    if(_rssi_count < WIFI_STATS_RSSI_HISTORY) {
+        _rssi_count++;
+    }
+    portEXIT_CRITICAL(&_stats_mux);
+    return true;
+}
+
+static void _stats_timer_cb(void* arg)
+{
+    wifi_ap_record_t info;
+    _sample_rssi(&info);
+}
+
+typedef struct {
+    struct tcpip_api_call_data call;
+    wifi_stats_t* stats;
+} wifi_stats_api_t;
+
+// walks the PCB list on the TCP/IP thread, the only place it is safe to
+static err_t _tcp_stats_api(struct tcpip_api_call_data *api_call_msg)
+{
+    wifi_stats_t* stats = ((wifi_stats_api_t*)api_call_msg)->stats;
+    for(struct tcp_pcb* pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+        stats->tcpActive++;
+        if(pcb->nrtx) {
+            stats->tcpRetransmitting++;
+        }
+        stats->tcpUnsent += pcb->snd_lbb - pcb->snd_nxt;
+        stats->tcpUnacked += pcb->snd_nxt - pcb->lastack;
+    }
+    return ERR_OK;
+}
+
+/**
+ * private
+ * counts connects and disconnects, called for every event
+ * @param event
+ */
+void WiFiSTAClass::_statsEvent(system_event_t *event)
+{
+    if(event->event_id == SYSTEM_EVENT_STA_CONNECTED) {
+        _sta_connects++;
+        _sta_connected_at = millis() | 1;
+        portENTER_CRITICAL(&_stats_mux);
+        _rssi_count = 0;
+        portEXIT_CRITICAL(&_stats_mux);
+    } else if(event->event_id == SYSTEM_EVENT_STA_DISCONNECTED) {
+        _sta_last_reason = event->event_info.disconnected.reason;
+        if(_sta_connected_at) {
+            _sta_disconnects++;
+            if(_sta_last_reason == WIFI_REASON_BEACON_TIMEOUT) {
+                _sta_beacon_timeouts++;
+            }
+        }
+        _sta_connected_at = 0;
+    }
+}
+
+/**
+ * Sample the STA link
+ * Cheap enough to call for every telemetry report: one driver call, one trip to the TCP/IP thread.
+ * Each call also adds an RSSI sample to the history, setStatsInterval() adds more in between.
+ * The IDF driver keeps its TX retry, PHY rate and RX drop counters to itself, they are not here.
+ * @param stats wifi_stats_t*
+ * @return false when not connected, the counters are filled in anyway
+ */
+bool WiFiSTAClass::getStats(wifi_stats_t* stats)
+{
+    if(!stats) {
+        return false;
+    }
+    memset(stats, 0, sizeof(wifi_stats_t));
+    stats->connects = _sta_connects;
+    stats->disconnects = _sta_disconnects;
+    stats->beaconTimeouts = _sta_beacon_timeouts;
+    stats->lastReason = _sta_last_reason;
+    stats->heapFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    stats->heapMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    wifi_event_stats_t events;
+    WiFiGenericClass::getEventStats(&events);
+    stats->eventsDropped = events.dropped;
+
+    if(WiFiGenericClass::getMode() == WIFI_MODE_NULL) {
+        return false;
+    }
+
+    wifi_stats_api_t msg;
+    msg.stats = stats;
+    tcpip_api_call(_tcp_stats_api, (struct tcpip_api_call_data*)&msg);
+    stats->txBlocked = esp_wifi_internal_tx_is_stop();
+
+    wifi_ap_record_t info;
+    if(!_sample_rssi(&info)) {
+        return false;
+    }
+    stats->connectedMs = _sta_connected_at ? millis() - _sta_connected_at : 0;
+    stats->rssi = info.rssi;
+    stats->channel = info.primary;
+    stats->secondChannel = info.second;
+    stats->phy = info.phy_11b | (info.phy_11g << 1) | (info.phy_11n << 2) | (info.phy_lr << 3);
+    uint8_t bw = 0;
+    if(esp_wifi_internal_get_negotiated_bandwidth(WIFI_IF_STA, 0, &bw) == ESP_OK) {
+        stats->bandwidth = bw;
+    }
+
+    int32_t sum = 0;
+    stats->rssiMin = INT8_MAX;
+    stats->rssiMax = INT8_MIN;
+    portENTER_CRITICAL(&_stats_mux);
+    for(uint8_t i = 0; i < _rssi_count; i++) {
+        int8_t r = _rssi_history[(_rssi_head + WIFI_STATS_RSSI_HISTORY - _rssi_count + i) % WIFI_STATS_RSSI_HISTORY];
+        sum += r;
+        stats->rssiMin = min(stats->rssiMin, r);
+        stats->rssiMax = max(stats->rssiMax, r);
+    }
+    stats->rssiSamples = _rssi_count;
+    portEXIT_CRITICAL(&_stats_mux);
+    stats->rssiAvg = stats->rssiSamples ? sum / stats->rssiSamples : info.rssi;
+    return true;
+}
+
+/**
+ * Copy the RSSI history, oldest first
+ * @param rssi  where to put it
+ * @param count room there
+ * @return samples copied
+ */
+uint8_t WiFiSTAClass::getRssiHistory(int8_t* rssi, uint8_t count)
+{
+    if(!rssi) {
+        return 0;
+    }
+    portENTER_CRITICAL(&_stats_mux);
+    uint8_t n = min(count, _rssi_count);
+    // the newest n, in the order they were taken
+    uint8_t first = (_rssi_head + WIFI_STATS_RSSI_HISTORY - n) % WIFI_STATS_RSSI_HISTORY;
+    for(uint8_t i = 0; i < n; i++) {
+        rssi[i] = _rssi_history[(first + i) % WIFI_STATS_RSSI_HISTORY];
+    }
+    portEXIT_CRITICAL(&_stats_mux);
+    return n;
+}
+
+/**
+ * Sample the RSSI in the background
+ * @param interval_ms time between two samples, 0 to stop
+ * @return ok
+ */
+bool WiFiSTAClass::setStatsInterval(uint32_t interval_ms)
+{
+    if(!_stats_timer) {
+        esp_timer_create_args_t args = { &_stats_timer_cb, NULL, ESP_TIMER_TASK, "wifiStats" };
+        if(esp_timer_create(&args, &_stats_timer) != ESP_OK) {
+            log_e("stats timer create failed");
+            return false;
+        }
+    }
+    esp_timer_stop(_stats_timer);
+    if(!interval_ms) {
+        return true;
+    }
+    return esp_timer_start_periodic(_stats_timer, interval_ms * 1000ULL) == ESP_OK;
+}
+
 /**
  * Get the station interface Host name.
  * @return char array hostname
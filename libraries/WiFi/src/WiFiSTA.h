@@ -27,6 +27,55 @@
 #include "WiFiType.h"
 #include "WiFiGeneric.h"
 
+#ifndef WIFI_FAST_CONNECT_TIMEOUT
+#define WIFI_FAST_CONNECT_TIMEOUT 1500 // ms for the cached AP before falling back to a scan
+#endif
+
+#ifndef WIFI_FULL_CONNECT_TIMEOUT
+#define WIFI_FULL_CONNECT_TIMEOUT 10000 // ms for the scan, association and DHCP of the fallback
+#endif
+
+// where the time of the last beginFast() went, in ms
+typedef struct {
+    uint32_t pmk;        // deriving the key from the passphrase, 0 once cached
+    uint32_t associate;  // begin to associated with the AP
+    uint32_t ip;         // associated to holding an address
+    uint32_t total;      // call to return, fallback included
+    bool cached;         // cached BSSID and channel were tried
+    bool staticIp;       // and the cached lease was used without DHCP
+    bool fallback;       // the cached AP failed and a full scan was done
+} wifi_fast_timing_t;
+
+
+#ifndef WIFI_STATS_RSSI_HISTORY
+#define WIFI_STATS_RSSI_HISTORY 32 // RSSI samples kept for getStats() and getRssiHistory()
+#endif
+
+// the STA link as the driver and lwIP see it, see WiFiSTAClass::getStats()
+typedef struct {
+    int8_t rssi;              // dBm now
+    int8_t rssiMin;           // over the samples in the history
+    int8_t rssiMax;
+    int8_t rssiAvg;
+    uint8_t rssiSamples;
+    uint8_t channel;
+    uint8_t secondChannel;    // wifi_second_chan_t, set when the AP runs HT40
+    uint8_t bandwidth;        // wifi_bandwidth_t negotiated with the AP
+    uint8_t phy;              // bit 0 11b, bit 1 11g, bit 2 11n, bit 3 LR, as the AP offers them
+    uint8_t lastReason;       // wifi_err_reason_t of the last disconnect
+    bool txBlocked;           // the driver is out of TX buffers right now
+    uint32_t connectedMs;     // time the current link has been up, 0 when down
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t beaconTimeouts;  // of those, the AP went out of reach
+    uint32_t eventsDropped;   // WiFi events the onEvent() callbacks missed
+    uint16_t tcpActive;       // TCP connections past LISTEN
+    uint16_t tcpRetransmitting; // of those, waiting on a retransmission now
+    uint32_t tcpUnsent;       // bytes queued but not yet sent, over all connections
+    uint32_t tcpUnacked;      // bytes sent and waiting for an ACK
+    uint32_t heapFree;        // internal RAM, where pbufs come from
+    uint32_t heapMinFree;     // lowest it has been
+} wifi_stats_t;
 
 class WiFiSTAClass
 {
@@ -39,6 +88,9 @@ public:
     wl_status_t begin(const char* ssid, const char *passphrase = NULL, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true);
     wl_status_t begin(char* ssid, char *passphrase = NULL, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true);
     wl_status_t begin();
+    wl_status_t beginFast(const char* ssid, const char *passphrase = NULL, uint32_t timeout_ms = WIFI_FAST_CONNECT_TIMEOUT, bool persist = false);
+    static void clearFastCache();
+    static const wifi_fast_timing_t& fastTiming();
 
     bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0x00000000, IPAddress dns2 = (uint32_t)0x00000000);
 
@@ -85,11 +137,21 @@ public:
 
     int8_t RSSI();
 
+    bool getStats(wifi_stats_t* stats);
+    uint8_t getRssiHistory(int8_t* rssi, uint8_t count);
+    bool setStatsInterval(uint32_t interval_ms);
+    static void _statsEvent(system_event_t *event);
+
     static void _setStatus(wl_status_t status);
     static String _hostname;
 protected:
     static bool _useStaticIp;
     static bool _autoReconnect;
+    static wifi_fast_timing_t _fastTiming;
+
+    static bool _loadFastCache(uint32_t key, bool persist);
+    static void _saveFastCache(uint32_t key, const uint8_t* pmk, bool persist, bool leaseRenewed);
+    static uint8_t _waitFastConnect(uint32_t start, uint32_t timeout_ms);
 
 public: 
     bool beginSmartConfig();
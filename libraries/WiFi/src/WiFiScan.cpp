@@ -40,6 +40,7 @@ extern "C" {
 #include <esp32-hal.h>
 #include <lwip/ip_addr.h>
 #include "lwip/err.h"
+#include <esp_timer.h>
 }
 
 bool WiFiScanClass::_scanAsync = false;
@@ -48,6 +49,17 @@ uint32_t WiFiScanClass::_scanTimeout = 10000;
 uint16_t WiFiScanClass::_scanCount = 0;
 void* WiFiScanClass::_scanResult = 0;
 
+bool WiFiScanClass::_surveyActive = false;
+uint16_t WiFiScanClass::_surveyChannels = 0;
+bool WiFiScanClass::_surveyPassive = false;
+uint32_t WiFiScanClass::_surveyMsPerChan = 0;
+uint32_t WiFiScanClass::_surveyPause = 0;
+WiFiScanResultCb WiFiScanClass::_surveyCb = NULL;
+wifi_scan_compact_t* WiFiScanClass::_compactResult = 0;
+uint16_t WiFiScanClass::_compactCount = 0;
+
+static esp_timer_handle_t _survey_timer = NULL;
+
 /**
  * Start scan WiFi networks available
  * @param async         run in async mode
@@ -100,6 +112,131 @@ int16_t WiFiScanClass::scanNetworks(bool async, bool show_hidden, bool passive,
 }
 
 
+/**
+ * Scan a set of channels one at a time
+ * Between two channels the radio goes back to the home channel for pause_ms so a connection keeps
+ * flowing. The APs of each channel go to cb as they come, on the WiFi event task, or when cb is NULL
+ * up to WIFI_SCAN_COMPACT_MAX of them are kept for getCompactInfo(). scanComplete() tells when it is over.
+ * @param cb                called for each AP seen
+ * @param channels          bit n set to scan channel n, 1 to 13 by default
+ * @param passive           listen for beacons instead of probing
+ * @param max_ms_per_chan   time on each channel
+ * @param pause_ms          time between two channels
+ * @return WIFI_SCAN_RUNNING or WIFI_SCAN_FAILED
+ */
+int16_t WiFiScanClass::scanChannels(WiFiScanResultCb cb, uint16_t channels, bool passive, uint32_t max_ms_per_chan, uint32_t pause_ms)
+{
+    if(WiFiGenericClass::getStatusBits() & WIFI_SCANNING_BIT) {
+        return WIFI_SCAN_RUNNING;
+    }
+    channels &= 0x7FFE;
+    if(!channels) {
+        return WIFI_SCAN_FAILED;
+    }
+    if(!_survey_timer) {
+        esp_timer_create_args_t args = { &WiFiScanClass::_surveyNext, NULL, ESP_TIMER_TASK, "wifiSurvey" };
+        if(esp_timer_create(&args, &_survey_timer) != ESP_OK) {
+            log_e("survey timer create failed");
+            return WIFI_SCAN_FAILED;
+        }
+    }
+
+    WiFi.enableSTA(true);
+
+    scanDelete();
+    if(!cb) {
+        _compactResult = (wifi_scan_compact_t*)malloc(WIFI_SCAN_COMPACT_MAX * sizeof(wifi_scan_compact_t));
+        if(!_compactResult) {
+            log_e("no memory for %u results", WIFI_SCAN_COMPACT_MAX);
+            return WIFI_SCAN_FAILED;
+        }
+    }
+
+    _surveyCb = cb;
+    _surveyChannels = channels;
+    _surveyPassive = passive;
+    _surveyMsPerChan = max_ms_per_chan;
+    _surveyPause = pause_ms;
+    _surveyActive = true;
+    // no timeout for the whole run, every channel ends with its own SCAN_DONE
+    _scanStarted = 0;
+    WiFiGenericClass::clearStatusBits(WIFI_SCAN_DONE_BIT);
+    WiFiGenericClass::setStatusBits(WIFI_SCANNING_BIT);
+    _surveyNext();
+    return _surveyActive ? WIFI_SCAN_RUNNING : WIFI_SCAN_FAILED;
+}
+
+/**
+ * private
+ * start the scan of the next channel of scanChannels(), or finish it
+ */
+void WiFiScanClass::_surveyNext(void* arg)
+{
+    while(_surveyChannels) {
+        uint8_t channel = __builtin_ctz(_surveyChannels);
+        _surveyChannels &= ~(1 << channel);
+
+        wifi_scan_config_t config;
+        config.ssid = 0;
+        config.bssid = 0;
+        config.channel = channel;
+        config.show_hidden = false;
+        if(_surveyPassive){
+            config.scan_type = WIFI_SCAN_TYPE_PASSIVE;
+            config.scan_time.passive = _surveyMsPerChan;
+        } else {
+            config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+            config.scan_time.active.min = _surveyMsPerChan / 2;
+            config.scan_time.active.max = _surveyMsPerChan;
+        }
+        if(esp_wifi_scan_start(&config, false) == ESP_OK) {
+            return;
+        }
+        log_w("scan of channel %u failed", channel);
+    }
+    _surveyActive = false;
+    _surveyCb = NULL;
+    _scanCount = _compactCount;
+    WiFiGenericClass::setStatusBits(WIFI_SCAN_DONE_BIT);
+    WiFiGenericClass::clearStatusBits(WIFI_SCANNING_BIT);
+}
+
+/**
+ * private
+ * hand out what one channel of scanChannels() found, a bounded batch at a time
+ */
+void WiFiScanClass::_surveyChannelDone()
+{
+    uint16_t count = 0;
+    esp_wifi_scan_get_ap_num(&count);
+    if(count > WIFI_SCAN_MAX_PER_CHAN) {
+        log_d("%u APs on the channel, keeping %u", count, WIFI_SCAN_MAX_PER_CHAN);
+        count = WIFI_SCAN_MAX_PER_CHAN;
+    }
+    wifi_ap_record_t* records = count ? new wifi_ap_record_t[count] : NULL;
+    if(records && esp_wifi_scan_get_ap_records(&count, records) == ESP_OK) {
+        for(uint16_t i = 0; i < count; i++) {
+            wifi_scan_compact_t ap;
+            memcpy(ap.bssid, records[i].bssid, sizeof(ap.bssid));
+            ap.rssi = records[i].rssi;
+            ap.channel = records[i].primary;
+            ap.authmode = records[i].authmode;
+            ap.reserved = 0;
+            if(_surveyCb) {
+                _surveyCb(ap, reinterpret_cast<const char*>(records[i].ssid));
+            } else if(_compactResult && _compactCount < WIFI_SCAN_COMPACT_MAX) {
+                _compactResult[_compactCount++] = ap;
+            }
+        }
+    }
+    delete[] records;
+
+    if(_surveyChannels && _surveyPause && esp_timer_start_once(_survey_timer, _surveyPause * 1000) == ESP_OK) {
+        return;
+    }
+    _surveyNext();
+}
+
 /**
  * private
  * scan callback
@@ -108,6 +245,10 @@ int16_t WiFiScanClass::scanNetworks(bool async, bool show_hidden, bool passive,
  */
 void WiFiScanClass::_scanDone()
 {
+    if(_surveyActive) {
+        _surveyChannelDone();
+        return;
+    }
     esp_wifi_scan_get_ap_num(&(WiFiScanClass::_scanCount));
     if(WiFiScanClass::_scanCount) {
         WiFiScanClass::_scanResult = new wifi_ap_record_t[WiFiScanClass::_scanCount];
@@ -168,6 +309,12 @@ void WiFiScanClass::scanDelete()
         WiFiScanClass::_scanResult = 0;
         WiFiScanClass::_scanCount = 0;
     }
+    if(WiFiScanClass::_compactResult && !WiFiScanClass::_surveyActive) {
+        free(WiFiScanClass::_compactResult);
+        WiFiScanClass::_compactResult = 0;
+        WiFiScanClass::_compactCount = 0;
+        WiFiScanClass::_scanCount = 0;
+    }
 }
 
 
@@ -196,6 +343,19 @@ bool WiFiScanClass::getNetworkInfo(uint8_t i, String &ssid, uint8_t &encType, in
 }
 
 
+/**
+ * Return what scanChannels() kept of an AP
+ * @param i specify from which network item want to get the information
+ * @return wifi_scan_compact_t *, NULL when out of range or the results went to a callback
+ */
+const wifi_scan_compact_t * WiFiScanClass::getCompactInfo(uint8_t i)
+{
+    if(!WiFiScanClass::_compactResult || i >= WiFiScanClass::_compactCount) {
+        return NULL;
+    }
+    return &WiFiScanClass::_compactResult[i];
+}
+
 /**
  * Return the SSID discovered during the network scan.
  * @param i     specify from which network item want to get the information
@@ -25,6 +25,26 @@
 
 #include "WiFiType.h"
 #include "WiFiGeneric.h"
+#include <functional>
+
+#ifndef WIFI_SCAN_MAX_PER_CHAN
+#define WIFI_SCAN_MAX_PER_CHAN 16 // records fetched from the driver after each channel of scanChannels()
+#endif
+
+#ifndef WIFI_SCAN_COMPACT_MAX
+#define WIFI_SCAN_COMPACT_MAX 64 // results scanChannels() keeps when there is no callback
+#endif
+
+// one AP seen by scanChannels(), 10 bytes instead of a wifi_ap_record_t
+typedef struct {
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t authmode;  // wifi_auth_mode_t
+    uint8_t reserved;
+} wifi_scan_compact_t;
+
+typedef std::function<void(const wifi_scan_compact_t& ap, const char* ssid)> WiFiScanResultCb;
 
 class WiFiScanClass
 {
@@ -33,6 +53,8 @@ public:
 
     int16_t scanNetworks(bool async = false, bool show_hidden = false, bool passive = false, uint32_t max_ms_per_chan = 300, uint8_t channel = 0);
 
+    int16_t scanChannels(WiFiScanResultCb cb = NULL, uint16_t channels = 0x3FFE, bool passive = false, uint32_t max_ms_per_chan = 120, uint32_t pause_ms = 100);
+
     int16_t scanComplete();
     void scanDelete();
 
@@ -46,6 +68,7 @@ public:
     String BSSIDstr(uint8_t networkItem);
     int32_t channel(uint8_t networkItem);
     static void * getScanInfoByIndex(int i) { return _getScanInfoByIndex(i); }; 
+    const wifi_scan_compact_t * getCompactInfo(uint8_t networkItem);
 
     static void _scanDone();
 protected:
@@ -60,6 +83,18 @@ protected:
 
     static void * _getScanInfoByIndex(int i);
 
+    static bool _surveyActive;
+    static uint16_t _surveyChannels;
+    static bool _surveyPassive;
+    static uint32_t _surveyMsPerChan;
+    static uint32_t _surveyPause;
+    static WiFiScanResultCb _surveyCb;
+    static wifi_scan_compact_t* _compactResult;
+    static uint16_t _compactCount;
+
+    static void _surveyNext(void* arg = NULL);
+    static void _surveyChannelDone();
+
 };
 
 
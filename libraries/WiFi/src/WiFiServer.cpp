@@ -23,6 +23,21 @@
 #undef write
 #undef close
 
+#ifndef WIFI_SERVER_TASK_STACK_SIZE
+#define WIFI_SERVER_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef WIFI_SERVER_TASK_PRIORITY
+#define WIFI_SERVER_TASK_PRIORITY 2
+#endif
+
+#ifndef WIFI_SERVER_TASK_RUNNING_CORE
+#define WIFI_SERVER_TASK_RUNNING_CORE -1
+#endif
+
+// how long the accept task sleeps in select() before it checks for end()
+#define WIFI_SERVER_SELECT_TIMEOUT_MS 100
+
 int WiFiServer::setTimeout(uint32_t seconds){
   struct timeval tv;
   tv.tv_sec = seconds;
@@ -51,17 +66,87 @@ WiFiClient WiFiServer::available(){
   int cs = sizeof(struct sockaddr_in);
     client_sock = lwip_accept_r(sockfd, (struct sockaddr *)&_client, (socklen_t*)&cs);
   }
+  return _setupClient(client_sock);
+}
+
+WiFiClient WiFiServer::_setupClient(int client_sock){
   if(client_sock >= 0){
-    int val = 1;
-    if(setsockopt(client_sock, SOL_SOCKET, SO_KEEPALIVE, (char*)&val, sizeof(int)) == ESP_OK) {
-      val = _noDelay;
-      if(setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, (char*)&val, sizeof(int)) == ESP_OK)
-        return WiFiClient(client_sock);
-    }
+    // the client default, keepalive on unless it says otherwise; failed options are logged
+    WiFiClient::Config config = WiFiClient::getDefaultConfig();
+    if(config.keepalive < 0)
+      config.keepalive = 1;
+    if(_noDelay)
+      config.nodelay = 1;
+    WiFiClient::applyConfig(client_sock, config);
+    return WiFiClient(client_sock);
   }
   return WiFiClient();
 }
 
+void WiFiServer::_acceptTaskFn(void *arg){
+  WiFiServer * server = (WiFiServer *)arg;
+  while(server->_acceptRun){
+    fd_set set;
+    struct timeval tv;
+    FD_ZERO(&set);
+    FD_SET(server->sockfd, &set);
+    tv.tv_sec = 0;
+    tv.tv_usec = WIFI_SERVER_SELECT_TIMEOUT_MS * 1000;
+    int res = select(server->sockfd + 1, &set, NULL, NULL, &tv);
+    if(res < 0){
+      delay(WIFI_SERVER_SELECT_TIMEOUT_MS);
+      continue;
+    }
+    // take everything that queued up, not one client per wakeup
+    while(res > 0 && server->_acceptRun){
+      struct sockaddr_in _client;
+      int cs = sizeof(struct sockaddr_in);
+      int client_sock = lwip_accept_r(server->sockfd, (struct sockaddr *)&_client, (socklen_t*)&cs);
+      if(client_sock < 0){
+        break;
+      }
+      WiFiClient client = server->_setupClient(client_sock);
+      if(client && server->_onClient){
+        server->_onClient(client);
+      }
+    }
+    // whatever onClient() handed over may be serviced from loop()
+    loopSignalEvent();
+  }
+  server->_acceptTask = NULL;
+  vTaskDelete(NULL);
+}
+
+void WiFiServer::_startAcceptTask(){
+  if(!_listening || !_onClient)
+    return;
+  _acceptRun = true;
+  // still running when restarted from its own callback
+  if(_acceptTask)
+    return;
+  xTaskCreateUniversal(_acceptTaskFn, "wifi_server", WIFI_SERVER_TASK_STACK_SIZE, this, WIFI_SERVER_TASK_PRIORITY, &_acceptTask, WIFI_SERVER_TASK_RUNNING_CORE);
+  if(_acceptTask == NULL){
+    _acceptRun = false;
+    log_e("Could not create accept task");
+  }
+}
+
+void WiFiServer::_stopAcceptTask(){
+  _acceptRun = false;
+  // from the callback itself the task ends on its own after returning
+  if(xTaskGetCurrentTaskHandle() == _acceptTask)
+    return;
+  while(_acceptTask){
+    delay(1);
+  }
+}
+
+void WiFiServer::onClient(WiFiServerClientCb cb){
+  _stopAcceptTask();
+  _onClient = cb;
+  _startAcceptTask();
+}
+
 void WiFiServer::begin(uint16_t port){
     begin(port, 1);
 }
@@ -88,6 +173,7 @@ void WiFiServer::begin(uint16_t port, int enable){
   _listening = true;
   _noDelay = false;
   _accepted_sockfd = -1;
+  _startAcceptTask();
 }
 
 void WiFiServer::setNoDelay(bool nodelay) {
@@ -112,6 +198,7 @@ bool WiFiServer::hasClient() {
 }
 
 void WiFiServer::end(){
+  _stopAcceptTask();
   lwip_close_r(sockfd);
   sockfd = -1;
   _listening = false;
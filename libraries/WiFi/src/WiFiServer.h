@@ -22,6 +22,9 @@
 #include "Arduino.h"
 #include "Server.h"
 #include "WiFiClient.h"
+#include <functional>
+
+typedef std::function<void(WiFiClient &client)> WiFiServerClientCb;
 
 class WiFiServer : public Server {
   private:
@@ -31,6 +34,14 @@ class WiFiServer : public Server {
     uint8_t _max_clients;
     bool _listening;
     bool _noDelay = false;
+    WiFiServerClientCb _onClient;
+    TaskHandle_t _acceptTask = NULL;
+    volatile bool _acceptRun = false;
+
+    WiFiClient _setupClient(int client_sock);
+    void _startAcceptTask();
+    void _stopAcceptTask();
+    static void _acceptTaskFn(void *arg);
 
   public:
     void listenOnLocalhost(){}
@@ -44,6 +55,11 @@ class WiFiServer : public Server {
     void setNoDelay(bool nodelay);
     bool getNoDelay();
     bool hasClient();
+    // accept in a background task and pass every new connection to cb, which runs in
+    // that task; the whole queue is drained per wakeup. NULL goes back to available()
+    void onClient(WiFiServerClientCb cb);
+    // length of the listen() queue, takes effect on begin(), defaults to max_clients
+    void setBacklog(uint8_t backlog){ _max_clients = backlog; }
     size_t write(const uint8_t *data, size_t len);
     size_t write(uint8_t data){
       return write(&data, 1);
@@ -54,6 +70,8 @@ class WiFiServer : public Server {
     void close();
     void stop();
     operator bool(){return _listening;}
+    // the listening socket, -1 before begin()
+    int fd() const { return sockfd; }
     int setTimeout(uint32_t seconds);
     void stopAll();
 };
@@ -24,6 +24,10 @@
 #undef write
 #undef read
 
+#ifndef WIFI_UDP_RX_BUFFER_SIZE
+#define WIFI_UDP_RX_BUFFER_SIZE 1460
+#endif
+
 WiFiUDP::WiFiUDP()
 : udp_server(-1)
 , server_port(0)
@@ -31,6 +35,10 @@ WiFiUDP::WiFiUDP()
 , tx_buffer(0)
 , tx_buffer_len(0)
 , rx_buffer(0)
+, rx_pool(0)
+, rx_buffer_size(WIFI_UDP_RX_BUFFER_SIZE)
+, rx_len(0)
+, rx_pos(0)
 {}
 
 WiFiUDP::~WiFiUDP(){
@@ -102,11 +110,7 @@ void WiFiUDP::stop(){
     tx_buffer = NULL;
   }
   tx_buffer_len = 0;
-  if(rx_buffer){
-    cbuf *b = rx_buffer;
-    rx_buffer = NULL;
-    delete b;
-  }
+  freeRxBuffer();
   if(udp_server == -1)
     return;
   if(multicast_ip != 0){
@@ -187,62 +191,135 @@ int WiFiUDP::endPacket(){
 }
 
 size_t WiFiUDP::write(uint8_t data){
-  if(tx_buffer_len == 1460){
-    endPacket();
-    tx_buffer_len = 0;
-  }
-  tx_buffer[tx_buffer_len++] = data;
-  return 1;
+  return write(&data, 1);
 }
 
 size_t WiFiUDP::write(const uint8_t *buffer, size_t size){
-  size_t i;
-  for(i=0;i<size;i++)
-    write(buffer[i]);
-  return i;
+  if(!tx_buffer)
+    return 0;
+  size_t left = size;
+  while(left){
+    if(tx_buffer_len == 1460){
+      endPacket();
+      tx_buffer_len = 0;
+    }
+    size_t n = 1460 - tx_buffer_len;
+    if(n > left)
+      n = left;
+    memcpy(tx_buffer + tx_buffer_len, buffer, n);
+    tx_buffer_len += n;
+    buffer += n;
+    left -= n;
+  }
+  return size;
 }
 
-int WiFiUDP::parsePacket(){
+static pool_t * _rxPool = NULL;
+
+bool WiFiUDP::setRxPool(pool_t * pool){
+  pool_stats_t stats;
+  if(pool){
+    poolGetStats(pool, &stats);
+    if(stats.blockSize < 1460){
+      log_e("pool blocks must hold 1460 bytes");
+      return false;
+    }
+  }
+  _rxPool = pool;
+  return true;
+}
+
+bool WiFiUDP::setRxBufferSize(size_t size){
+  if(!size)
+    return false;
+  freeRxBuffer();
+  rx_buffer_size = size;
+  return true;
+}
+
+bool WiFiUDP::allocRxBuffer(){
   if(rx_buffer)
-    return 0;
-  struct sockaddr_in si_other;
-  int slen = sizeof(si_other) , len;
-  char * buf = new char[1460];
-  if(!buf){
-    return 0;
+    return true;
+  pool_stats_t stats;
+  if(_rxPool){
+    poolGetStats(_rxPool, &stats);
+    if(stats.blockSize >= rx_buffer_size){
+      rx_buffer = (uint8_t *)poolAlloc(_rxPool);
+      rx_pool = rx_buffer ? _rxPool : NULL;
+    }
   }
-  if ((len = recvfrom(udp_server, buf, 1460, MSG_DONTWAIT, (struct sockaddr *) &si_other, (socklen_t *)&slen)) == -1){
-    delete[] buf;
-    if(errno == EWOULDBLOCK){
-      return 0;
+  if(!rx_buffer){
+    rx_buffer = (uint8_t *)malloc(rx_buffer_size);
+  }
+  if(!rx_buffer){
+    log_e("could not allocate %u byte receive buffer", rx_buffer_size);
+    return false;
+  }
+  return true;
+}
+
+void WiFiUDP::freeRxBuffer(){
+  if(!poolFree(rx_pool, rx_buffer)){
+    free(rx_buffer);
+  }
+  rx_buffer = NULL;
+  rx_pool = NULL;
+  rx_len = rx_pos = 0;
+}
+
+// one datagram into the socket's buffer, kept until the next receive or stop()
+int WiFiUDP::receive(){
+  rx_len = rx_pos = 0;
+  if(udp_server < 0 || !allocRxBuffer())
+    return -1;
+  struct sockaddr_in si_other;
+  int slen = sizeof(si_other), len;
+  if ((len = recvfrom(udp_server, rx_buffer, rx_buffer_size, MSG_DONTWAIT, (struct sockaddr *) &si_other, (socklen_t *)&slen)) == -1){
+    if(errno != EWOULDBLOCK){
+      log_e("could not receive data: %d", errno);
     }
-    log_e("could not receive data: %d", errno);
-    return 0;
+    return -1;
   }
   remote_ip = IPAddress(si_other.sin_addr.s_addr);
   remote_port = ntohs(si_other.sin_port);
-  if (len > 0) {
-    rx_buffer = new cbuf(len);
-    rx_buffer->write(buf, len);
-  }
-  delete[] buf;
+  rx_len = len;
   return len;
 }
 
+int WiFiUDP::parsePacket(){
+  // whatever is left of the previous packet is dropped
+  int len = receive();
+  return (len > 0) ? len : 0;
+}
+
+int WiFiUDP::parsePackets(WiFiUDPPacketHandler handler, int maxPackets){
+  int count = 0;
+  while(!maxPackets || count < maxPackets){
+    int len = receive();
+    if(len < 0)
+      break;
+    count++;
+    if(handler)
+      handler(rx_buffer, len, remote_ip, remote_port);
+  }
+  return count;
+}
+
+const uint8_t * WiFiUDP::data(){
+  return rx_buffer;
+}
+
+size_t WiFiUDP::length(){
+  return rx_len;
+}
+
 int WiFiUDP::available(){
-  if(!rx_buffer) return 0;
-  return rx_buffer->available();
+  return rx_len - rx_pos;
 }
 
 int WiFiUDP::read(){
-  if(!rx_buffer) return -1;
-  int out = rx_buffer->read();
-  if(!rx_buffer->available()){
-    cbuf *b = rx_buffer;
-    rx_buffer = 0;
-    delete b;
-  }
-  return out;
+  if(rx_pos >= rx_len) return -1;
+  return rx_buffer[rx_pos++];
 }
 
 int WiFiUDP::read(unsigned char* buffer, size_t len){
@@ -250,26 +327,33 @@ int WiFiUDP::read(unsigned char* buffer, size_t len){
 }
 
 int WiFiUDP::read(char* buffer, size_t len){
-  if(!rx_buffer) return 0;
-  int out = rx_buffer->read(buffer, len);
-  if(!rx_buffer->available()){
-    cbuf *b = rx_buffer;
-    rx_buffer = 0;
-    delete b;
-  }
-  return out;
+  size_t a = rx_len - rx_pos;
+  if(len > a)
+    len = a;
+  memcpy(buffer, rx_buffer + rx_pos, len);
+  rx_pos += len;
+  return len;
 }
 
 int WiFiUDP::peek(){
-  if(!rx_buffer) return -1;
-  return rx_buffer->peek();
+  if(rx_pos >= rx_len) return -1;
+  return rx_buffer[rx_pos];
+}
+
+size_t WiFiUDP::peekAvailable(){
+  return rx_len - rx_pos;
+}
+
+const uint8_t * WiFiUDP::peekBuffer(){
+  return rx_buffer ? rx_buffer + rx_pos : NULL;
+}
+
+void WiFiUDP::peekConsume(size_t len){
+  rx_pos += (len < rx_len - rx_pos) ? len : rx_len - rx_pos;
 }
 
 void WiFiUDP::flush(){
-  if(!rx_buffer) return;
-  cbuf *b = rx_buffer;
-  rx_buffer = 0;
-  delete b;
+  rx_pos = rx_len;
 }
 
 IPAddress WiFiUDP::remoteIP(){
@@ -38,6 +38,9 @@
 #include <Arduino.h>
 #include <Udp.h>
 #include <cbuf.h>
+#include <functional>
+
+typedef std::function<void(const uint8_t * data, size_t len, IPAddress remoteIP, uint16_t remotePort)> WiFiUDPPacketHandler;
 
 class WiFiUDP : public UDP {
 private:
@@ -48,7 +51,15 @@ private:
   uint16_t remote_port;
   char * tx_buffer;
   size_t tx_buffer_len;
-  cbuf * rx_buffer;
+  uint8_t * rx_buffer;
+  pool_t * rx_pool;
+  size_t rx_buffer_size;
+  size_t rx_len;
+  size_t rx_pos;
+
+  bool allocRxBuffer();
+  void freeRxBuffer();
+  int receive();
 public:
   WiFiUDP();
   ~WiFiUDP();
@@ -63,15 +74,31 @@ public:
   int endPacket();
   size_t write(uint8_t);
   size_t write(const uint8_t *buffer, size_t size);
+  // receives the next packet, the unread rest of the previous one is dropped
   int parsePacket();
+  // receive until the socket is empty (or maxPackets), handler sees each packet in place
+  int parsePackets(WiFiUDPPacketHandler handler, int maxPackets = 0);
+  // the current packet, valid until the next receive
+  const uint8_t * data();
+  size_t length();
+  // largest packet accepted, default 1460; longer datagrams are truncated
+  bool setRxBufferSize(size_t size);
   int available();
   int read();
   int read(unsigned char* buffer, size_t len);
   int read(char* buffer, size_t len);
   int peek();
+  // the rest of the current packet, in place
+  size_t peekAvailable();
+  const uint8_t * peekBuffer();
+  void peekConsume(size_t len);
   void flush();
   IPAddress remoteIP();
   uint16_t remotePort();
+  // the bound socket, -1 before begin()
+  int fd() const { return udp_server; }
+  // receive buffers come from pool when set and its blocks hold the buffer size
+  static bool setRxPool(pool_t * pool);
 };
 
 #endif /* _WIFIUDP_H_ */
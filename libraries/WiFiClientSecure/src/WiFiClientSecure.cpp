@@ -30,6 +30,7 @@ WiFiClientSecure::WiFiClientSecure()
     ssl_init(sslclient);
     sslclient->socket = -1;
     sslclient->handshake_timeout = 120000;
+    sslclient->session = NULL;
     _use_insecure = false;
     _CA_cert = NULL;
     _cert = NULL;
@@ -49,6 +50,7 @@ WiFiClientSecure::WiFiClientSecure(int sock)
     ssl_init(sslclient);
     sslclient->socket = sock;
     sslclient->handshake_timeout = 120000;
+    sslclient->session = NULL;
 
     if (sock >= 0) {
         _connected = true;
@@ -66,6 +68,7 @@ WiFiClientSecure::~WiFiClientSecure()
 {
     stop();
     delete sslclient;
+    free(_txBuffer);
 }
 
 WiFiClientSecure &WiFiClientSecure::operator=(const WiFiClientSecure &other)
@@ -78,6 +81,10 @@ WiFiClientSecure &WiFiClientSecure::operator=(const WiFiClientSecure &other)
 
 void WiFiClientSecure::stop()
 {
+    if (_txLen && _connected) {
+        _flushTx();
+    }
+    _txLen = 0;
     if (sslclient->socket >= 0) {
         close(sslclient->socket);
         sslclient->socket = -1;
@@ -113,7 +120,9 @@ int WiFiClientSecure::connect(const char *host, uint16_t port, int32_t timeout){
 
 int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char *CA_cert, const char *cert, const char *private_key)
 {
-    return connect(ip.toString().c_str(), port, CA_cert, cert, private_key);
+    char host[IPADDRESS_STR_LEN];
+    ip.toChars(host, sizeof(host));
+    return connect(host, port, CA_cert, cert, private_key);
 }
 
 int WiFiClientSecure::connect(const char *host, uint16_t port, const char *CA_cert, const char *cert, const char *private_key)
@@ -133,7 +142,9 @@ int WiFiClientSecure::connect(const char *host, uint16_t port, const char *CA_ce
 }
 
 int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char *pskIdent, const char *psKey) {
-    return connect(ip.toString().c_str(), port, pskIdent, psKey);
+    char host[IPADDRESS_STR_LEN];
+    ip.toChars(host, sizeof(host));
+    return connect(host, port, pskIdent, psKey);
 }
 
 int WiFiClientSecure::connect(const char *host, uint16_t port, const char *pskIdent, const char *psKey) {
@@ -180,6 +191,25 @@ size_t WiFiClientSecure::write(const uint8_t *buf, size_t size)
     if (!_connected) {
         return 0;
     }
+    if (_txSize && size < _txSize) {
+        _flushTxIfStale();
+        if (_txLen + size > _txSize && !_flushTx()) {
+            return 0;
+        }
+        if (!_txLen) {
+            _txSince = millis();
+        }
+        memcpy(_txBuffer + _txLen, buf, size);
+        _txLen += size;
+        if (_txLen == _txSize && !_flushTx()) {
+            return 0;
+        }
+        return size;
+    }
+    // a large write goes out as it is, after what was gathered before it
+    if (_txLen && !_flushTx()) {
+        return 0;
+    }
     int res = send_ssl_data(sslclient, buf, size);
     if (res < 0) {
         stop();
@@ -188,6 +218,51 @@ size_t WiFiClientSecure::write(const uint8_t *buf, size_t size)
     return res;
 }
 
+void WiFiClientSecure::flush()
+{
+    if (_txLen && _connected) {
+        _flushTx();
+    }
+}
+
+bool WiFiClientSecure::setWriteBuffer(size_t size)
+{
+    flush();
+    _txLen = 0;
+    if (!size) {
+        free(_txBuffer);
+        _txBuffer = nullptr;
+        _txSize = 0;
+        return true;
+    }
+    uint8_t *buffer = (uint8_t *)realloc(_txBuffer, size);
+    if (!buffer) {
+        return false;
+    }
+    _txBuffer = buffer;
+    _txSize = size;
+    return true;
+}
+
+// false, and the connection closed, if the buffered bytes could not be sent
+bool WiFiClientSecure::_flushTx()
+{
+    size_t len = _txLen;
+    _txLen = 0;
+    if (send_ssl_data(sslclient, _txBuffer, len) != (int)len) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void WiFiClientSecure::_flushTxIfStale()
+{
+    if (_txLen && millis() - _txSince >= WIFICLIENTSECURE_TX_FLUSH_TIMEOUT) {
+        _flushTx();
+    }
+}
+
 int WiFiClientSecure::read(uint8_t *buf, size_t size)
 {
     int peeked = 0;
@@ -224,6 +299,13 @@ int WiFiClientSecure::available()
     if (!_connected) {
         return peeked;
     }
+    // the peer answers what it has been sent
+    if (_txLen) {
+        _flushTx();
+        if (!_connected) {
+            return peeked;
+        }
+    }
     int res = data_to_read(sslclient);
     if (res < 0) {
         stop();
@@ -19,6 +19,10 @@
 #include <WiFi.h>
 #include "ssl_client.h"
 
+#ifndef WIFICLIENTSECURE_TX_FLUSH_TIMEOUT
+#define WIFICLIENTSECURE_TX_FLUSH_TIMEOUT 20 // ms buffered writes wait for more before the next call sends them
+#endif
+
 class WiFiClientSecure : public WiFiClient
 {
 protected:
@@ -33,6 +37,10 @@ protected:
     const char *_private_key;
     const char *_pskIdent; // identity for PSK cipher suites
     const char *_psKey; // key in hex for PSK cipher suites
+    uint8_t *_txBuffer = nullptr; // small writes gathered into one record, see setWriteBuffer()
+    size_t _txSize = 0;
+    size_t _txLen = 0;
+    unsigned long _txSince = 0;
 
 public:
     WiFiClientSecure *next;
@@ -48,12 +56,14 @@ public:
     int connect(IPAddress ip, uint16_t port, const char *pskIdent, const char *psKey);
     int connect(const char *host, uint16_t port, const char *pskIdent, const char *psKey);
 	int peek();
+	// decrypted data is not buffered in place, find() reads it one by one
+	size_t peekAvailable() { return 0; }
     size_t write(uint8_t data);
     size_t write(const uint8_t *buf, size_t size);
     int available();
     int read();
     int read(uint8_t *buf, size_t size);
-    void flush() {}
+    void flush();
     void stop();
     uint8_t connected();
     int lastError(char *buf, const size_t size);
@@ -67,6 +77,21 @@ public:
     bool loadPrivateKey(Stream& stream, size_t size);
     bool verify(const char* fingerprint, const char* domain_name);
     void setHandshakeTimeout(unsigned long handshake_timeout);
+    void setMaxFragmentLength(uint16_t len) { sslclient->max_frag_len = len; } // 512, 1024, 2048 or 4096, the server may ignore it
+    // Gathers writes smaller than size into one TLS record instead of one
+    // record, and its 29+ bytes of overhead, per print(). Buffered data goes
+    // out on flush(), once size is reached, when reading or checking the
+    // connection, and on the first call after WIFICLIENTSECURE_TX_FLUSH_TIMEOUT.
+    // Call flush() after the last write if nothing else follows. 0 turns it off.
+    bool setWriteBuffer(size_t size);
+    void setCiphersuites(const int *list) { sslclient->ciphersuites = list; } // MBEDTLS_TLS_* ids ending in 0, kept alive by the caller; NULL for the accelerated default order
+    const ssl_handshake_timing_t &handshakeTiming() { return sslclient->timing; } // of the last connect()
+    void setBuffersInPSRAM(bool psram) { sslclient->buffers_psram = psram; } // record buffers of the next connect(), the heap policy decides otherwise
+    void setSession(mbedtls_ssl_session *session) { sslclient->session = session; } // resumed by connect(), which stores the new one there; the caller keeps it alive
+
+    // sessions of the last SSL_SESSION_CACHE_SIZE servers, shared by all clients without setSession()
+    static void clearSessionCache() { ssl_session_cache_clear(); }
+    static ssl_session_stats_t sessionCacheStats() { return ssl_session_cache_stats(); }
 
     int setTimeout(uint32_t seconds){ return 0; }
 
@@ -96,6 +121,8 @@ public:
 
 private:
     char *_streamLoad(Stream& stream, size_t size);
+    bool _flushTx();
+    void _flushTxIfStale();
 
     //friend class WiFiServer;
     using Print::write;
@@ -42,12 +42,389 @@ static int _handle_error(int err, const char * file, int line)
 
 #define handle_error(e) _handle_error(e, __FUNCTION__, __LINE__)
 
+// the caches are used from any task, their locks are made by the first one
+static SemaphoreHandle_t create_lock_once(SemaphoreHandle_t *lock)
+{
+    if (*lock == NULL) {
+        static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+        SemaphoreHandle_t created = xSemaphoreCreateMutex();
+        portENTER_CRITICAL(&mux);
+        if (*lock == NULL) {
+            *lock = created;
+            created = NULL;
+        }
+        portEXIT_CRITICAL(&mux);
+        if (created) {
+            vSemaphoreDelete(created);
+        }
+    }
+    return *lock;
+}
+
+/*
+ * Sessions of the last servers connected to, least recently used first out.
+ * They are keyed by host, port and the trust settings, so a session verified
+ * against one CA is never resumed by a connection expecting another. Entries
+ * are copied in and out under the lock, a handshake never holds one.
+ */
+typedef struct ssl_cached_session {
+    String host;
+    uint16_t port;
+    uint32_t trust;
+    unsigned long last_used;
+    mbedtls_ssl_session session;
+} ssl_cached_session_t;
+
+static ssl_cached_session_t session_cache[SSL_SESSION_CACHE_SIZE ? SSL_SESSION_CACHE_SIZE : 1];
+static ssl_session_stats_t session_stats;
+static SemaphoreHandle_t session_lock = NULL;
+
+static void session_cache_lock()
+{
+    xSemaphoreTake(create_lock_once(&session_lock), portMAX_DELAY);
+}
+
+static void session_cache_unlock()
+{
+    xSemaphoreGive(session_lock);
+}
+
+static uint32_t trust_hash(uint32_t h, const char *s)
+{
+    if (s == NULL) {
+        return h * 16777619UL;
+    }
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619UL;
+    }
+    return (h ^ 0xff) * 16777619UL;
+}
+
+static ssl_cached_session_t *session_cache_find(const char *host, uint16_t port, uint32_t trust)
+{
+    for (int i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+        ssl_cached_session_t *e = &session_cache[i];
+        if (e->port == port && e->trust == trust && e->host == host) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// offers the cached session for an abbreviated handshake, keeps its master secret to tell if it was taken
+static bool session_cache_resume(mbedtls_ssl_context *ssl, const char *host, uint16_t port, uint32_t trust, unsigned char *master)
+{
+    bool offered = false;
+    session_cache_lock();
+    ssl_cached_session_t *e = session_cache_find(host, port, trust);
+    if (e && e->session.ciphersuite && mbedtls_ssl_set_session(ssl, &e->session) == 0) {
+        memcpy(master, e->session.master, sizeof(e->session.master));
+        e->last_used = millis();
+        offered = true;
+    }
+    session_cache_unlock();
+    return offered;
+}
+
+static void session_cache_store(mbedtls_ssl_context *ssl, const char *host, uint16_t port, uint32_t trust, const unsigned char *master)
+{
+    session_cache_lock();
+    if (master == NULL) {
+        session_stats.misses++;
+    } else if (memcmp(ssl->session->master, master, sizeof(ssl->session->master)) == 0) {
+        session_stats.hits++;
+    } else {
+        session_stats.rejected++;
+    }
+    ssl_cached_session_t *e = session_cache_find(host, port, trust);
+    if (e == NULL) {
+        e = &session_cache[0];
+        unsigned long now = millis();
+        for (int i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+            if (!session_cache[i].host.length()) {
+                e = &session_cache[i];
+                break;
+            }
+            if (now - session_cache[i].last_used > now - e->last_used) {
+                e = &session_cache[i];
+            }
+        }
+        e->host = host;
+        e->port = port;
+        e->trust = trust;
+    }
+    // a resumed session may come with a new ticket
+    mbedtls_ssl_session_free(&e->session);
+    if (mbedtls_ssl_get_session(ssl, &e->session) != 0) {
+        mbedtls_ssl_session_free(&e->session);
+        e->host = String();
+    }
+    e->last_used = millis();
+    session_cache_unlock();
+}
+
+static void session_cache_forget(const char *host, uint16_t port, uint32_t trust)
+{
+    session_cache_lock();
+    ssl_cached_session_t *e = session_cache_find(host, port, trust);
+    if (e) {
+        mbedtls_ssl_session_free(&e->session);
+        e->host = String();
+    }
+    session_cache_unlock();
+}
+
+void ssl_session_cache_clear()
+{
+    session_cache_lock();
+    for (int i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+        mbedtls_ssl_session_free(&session_cache[i].session);
+        session_cache[i].host = String();
+    }
+    session_cache_unlock();
+}
+
+ssl_session_stats_t ssl_session_cache_stats()
+{
+    session_cache_lock();
+    ssl_session_stats_t stats = session_stats;
+    session_cache_unlock();
+    return stats;
+}
+
+
+/*
+ * mbedTLS allocates through the heap policy (HEAP_USER_TLS), so with PSRAM
+ * the 16 KB record buffers and certificate parsing leave internal RAM. A
+ * client asking for a placement of its own gets it for the allocations of
+ * its mbedtls_ssl_setup(), where the record buffers are made.
+ */
+static SemaphoreHandle_t setup_lock = NULL;
+static TaskHandle_t setup_task = NULL;
+static int8_t setup_psram = -1;
+
+static void *ssl_calloc(size_t n, size_t size)
+{
+    if (setup_psram >= 0 && setup_task == xTaskGetCurrentTaskHandle() && n * size >= 1024) {
+        void *p = heap_caps_calloc(n, size, (setup_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT);
+        if (p) {
+            return p;
+        }
+    }
+    return heap_policy_calloc(HEAP_USER_TLS, n, size);
+}
+
+static int ssl_setup(sslclient_context *ssl_client)
+{
+    if (ssl_client->buffers_psram < 0) {
+        return mbedtls_ssl_setup(&ssl_client->ssl_ctx, &ssl_client->ssl_conf);
+    }
+    SemaphoreHandle_t lock = create_lock_once(&setup_lock);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    setup_task = xTaskGetCurrentTaskHandle();
+    setup_psram = ssl_client->buffers_psram;
+    int ret = mbedtls_ssl_setup(&ssl_client->ssl_ctx, &ssl_client->ssl_conf);
+    setup_psram = -1;
+    setup_task = NULL;
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+/*
+ * Parsed CA chains, shared by the handshakes that use the same PEM. Found by
+ * a hash of the text, so a buffer rewritten in place is parsed again. Idle
+ * ones stay until the slot is needed.
+ */
+typedef struct ssl_shared_ca {
+    uint32_t hash;
+    size_t len;
+    uint16_t refs;
+    unsigned long last_used;
+    mbedtls_x509_crt crt;
+} ssl_shared_ca_t;
+
+static ssl_shared_ca_t ca_cache[SSL_CA_CACHE_SIZE ? SSL_CA_CACHE_SIZE : 1];
+static SemaphoreHandle_t ca_lock = NULL;
+
+// the parsed chain of pem, ssl_client->ca_cert if the cache has no room; NULL after a parse error
+static mbedtls_x509_crt *ca_chain_acquire(sslclient_context *ssl_client, const char *pem, int *err)
+{
+    size_t len = strlen(pem);
+    uint32_t hash = trust_hash(2166136261UL, pem);
+    SemaphoreHandle_t lock = create_lock_once(&ca_lock);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ssl_shared_ca_t *slot = NULL;
+    unsigned long now = millis();
+    for (int i = 0; i < SSL_CA_CACHE_SIZE; i++) {
+        ssl_shared_ca_t *e = &ca_cache[i];
+        if (e->len == len && e->hash == hash) {
+            e->refs++;
+            e->last_used = now;
+            xSemaphoreGive(lock);
+            return &e->crt;
+        }
+        if (!e->refs && (!slot || !e->len || (slot->len && now - e->last_used > now - slot->last_used))) {
+            slot = e;
+        }
+    }
+    mbedtls_x509_crt *crt = &ssl_client->ca_cert;
+    if (slot) {
+        mbedtls_x509_crt_free(&slot->crt);
+        slot->len = 0;
+        crt = &slot->crt;
+    }
+    mbedtls_x509_crt_init(crt);
+    *err = mbedtls_x509_crt_parse(crt, (const unsigned char *)pem, len + 1);
+    if (*err < 0) {
+        // free the chain when the parse failed, otherwise it stays in the heap and leads to an "out of memory" crash
+        mbedtls_x509_crt_free(crt);
+        crt = NULL;
+    } else if (slot) {
+        slot->hash = hash;
+        slot->len = len;
+        slot->refs = 1;
+        slot->last_used = now;
+    }
+    xSemaphoreGive(lock);
+    return crt;
+}
+
+static void ca_chain_release(sslclient_context *ssl_client)
+{
+    mbedtls_x509_crt *crt = ssl_client->ca_chain;
+    if (crt == NULL) {
+        return;
+    }
+    ssl_client->ca_chain = NULL;
+    if (crt == &ssl_client->ca_cert) {
+        mbedtls_x509_crt_free(crt);
+        return;
+    }
+    xSemaphoreTake(ca_lock, portMAX_DELAY);
+    for (int i = 0; i < SSL_CA_CACHE_SIZE; i++) {
+        if (&ca_cache[i].crt == crt && ca_cache[i].refs) {
+            ca_cache[i].refs--;
+        }
+    }
+    xSemaphoreGive(ca_lock);
+}
+
+/*
+ * Offered first: ECDHE on P-256, whose point arithmetic runs on the MPI
+ * accelerator, and AES-128 GCM or SHA-256 CBC suites, which map to the AES
+ * and SHA engines. mbedTLS otherwise leads with the strongest options, AES-256
+ * and P-521 or brainpool curves done in software, which costs several times
+ * the handshake time. The rest of the built-in lists follow, so every server
+ * that worked before still does.
+ */
+static const int preferred_suites[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+};
+
+static const mbedtls_ecp_group_id preferred_curves[] = {
+    MBEDTLS_ECP_DP_SECP256R1,
+    MBEDTLS_ECP_DP_CURVE25519,
+    MBEDTLS_ECP_DP_SECP384R1,
+};
+
+template<typename T, size_t N>
+static T *ordered_list(const T (&first)[N], const T *all, T end)
+{
+    size_t count = 0;
+    while (all[count] != end) {
+        count++;
+    }
+    T *list = (T *)malloc((count + N + 1) * sizeof(T));
+    if (list == NULL) {
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < count; j++) {
+            if (all[j] == first[i]) {
+                list[n++] = first[i]; // only what the library was built with
+                break;
+            }
+        }
+    }
+    for (size_t j = 0; j < count; j++) {
+        size_t i = 0;
+        while (i < N && first[i] != all[j]) {
+            i++;
+        }
+        if (i == N) {
+            list[n++] = all[j];
+        }
+    }
+    list[n] = end;
+    return list;
+}
+
+// built once, mbedTLS keeps pointing at them; a client's own suites replace the preferred ones
+static void conf_preferred(mbedtls_ssl_config *conf, const int *own_suites)
+{
+    static const int *suites = NULL;
+    static const mbedtls_ecp_group_id *curves = NULL;
+    if (suites == NULL) {
+        suites = ordered_list(preferred_suites, mbedtls_ssl_list_ciphersuites(), 0);
+    }
+    if (curves == NULL) {
+        curves = ordered_list(preferred_curves, mbedtls_ecp_grp_id_list(), MBEDTLS_ECP_DP_NONE);
+    }
+    if (own_suites) {
+        mbedtls_ssl_conf_ciphersuites(conf, own_suites);
+    } else if (suites) {
+        mbedtls_ssl_conf_ciphersuites(conf, suites);
+    }
+    if (curves) {
+        mbedtls_ssl_conf_curves(conf, curves);
+    }
+}
+
+// the handshake state whose step took the time
+static void account_step(ssl_handshake_timing_t *timing, int state, uint32_t us)
+{
+    switch (state) {
+    case MBEDTLS_SSL_HELLO_REQUEST:
+    case MBEDTLS_SSL_CLIENT_HELLO:
+    case MBEDTLS_SSL_SERVER_HELLO:
+        timing->hello += us;
+        break;
+    case MBEDTLS_SSL_SERVER_CERTIFICATE:
+        timing->certificate += us;
+        break;
+    case MBEDTLS_SSL_SERVER_KEY_EXCHANGE:
+    case MBEDTLS_SSL_CERTIFICATE_REQUEST:
+    case MBEDTLS_SSL_SERVER_HELLO_DONE:
+    case MBEDTLS_SSL_CLIENT_CERTIFICATE:
+    case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+    case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+        timing->key_exchange += us;
+        break;
+    default:
+        timing->finish += us;
+        break;
+    }
+}
 
 void ssl_init(sslclient_context *ssl_client)
 {
+    static bool allocator_set = false;
+    if (!allocator_set) {
+        mbedtls_platform_set_calloc_free(ssl_calloc, free);
+        allocator_set = true;
+    }
     mbedtls_ssl_init(&ssl_client->ssl_ctx);
     mbedtls_ssl_config_init(&ssl_client->ssl_conf);
     mbedtls_ctr_drbg_init(&ssl_client->drbg_ctx);
+    ssl_client->ca_chain = NULL;
+    ssl_client->max_frag_len = 0;
+    ssl_client->buffers_psram = -1;
+    ssl_client->ciphersuites = NULL;
+    memset(&ssl_client->timing, 0, sizeof(ssl_client->timing));
 }
 
 
@@ -57,6 +434,10 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
     int ret, flags;
     int enable = 1;
     log_v("Free internal heap before TLS %u", ESP.getFreeHeap());
+    ssl_handshake_timing_t *timing = &ssl_client->timing;
+    memset(timing, 0, sizeof(*timing));
+    uint32_t started = micros();
+    uint32_t mark = started;
 
     if (rootCABuff == NULL && pskIdent == NULL && psKey == NULL && !insecure) {
         return -1;
@@ -75,6 +456,8 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
     if(!WiFiGenericClass::hostByName(host, srv)){
         return -1;
     }
+    timing->dns = micros() - mark;
+    mark = micros();
 
     struct sockaddr_in serv_addr;
     memset(&serv_addr, 0, sizeof(serv_addr));
@@ -99,6 +482,8 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
         return -1;
     }
 
+    timing->tcp = micros() - mark;
+
     fcntl( ssl_client->socket, F_SETFL, fcntl( ssl_client->socket, F_GETFL, 0 ) | O_NONBLOCK );
 
     log_v("Seeding the random number generator");
@@ -127,16 +512,14 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
         log_i("WARNING: Skipping SSL Verification. INSECURE!");
     } else if (rootCABuff != NULL) {
         log_v("Loading CA cert");
-        mbedtls_x509_crt_init(&ssl_client->ca_cert);
         mbedtls_ssl_conf_authmode(&ssl_client->ssl_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-        ret = mbedtls_x509_crt_parse(&ssl_client->ca_cert, (const unsigned char *)rootCABuff, strlen(rootCABuff) + 1);
-        mbedtls_ssl_conf_ca_chain(&ssl_client->ssl_conf, &ssl_client->ca_cert, NULL);
-        //mbedtls_ssl_conf_verify(&ssl_client->ssl_ctx, my_verify, NULL );
-        if (ret < 0) {
-            // free the ca_cert in the case parse failed, otherwise, the old ca_cert still in the heap memory, that lead to "out of memory" crash.
-            mbedtls_x509_crt_free(&ssl_client->ca_cert);
+        ca_chain_release(ssl_client);
+        ssl_client->ca_chain = ca_chain_acquire(ssl_client, rootCABuff, &ret);
+        if (ssl_client->ca_chain == NULL) {
             return handle_error(ret);
         }
+        mbedtls_ssl_conf_ca_chain(&ssl_client->ssl_conf, ssl_client->ca_chain, NULL);
+        //mbedtls_ssl_conf_verify(&ssl_client->ssl_ctx, my_verify, NULL );
     } else if (pskIdent != NULL && psKey != NULL) {
         log_v("Setting up PSK");
         // convert PSK from hex to binary
@@ -203,22 +586,69 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
 
     mbedtls_ssl_conf_rng(&ssl_client->ssl_conf, mbedtls_ctr_drbg_random, &ssl_client->drbg_ctx);
 
-    if ((ret = mbedtls_ssl_setup(&ssl_client->ssl_ctx, &ssl_client->ssl_conf)) != 0) {
+    conf_preferred(&ssl_client->ssl_conf, ssl_client->ciphersuites);
+
+    // smaller records from the server, if it supports the extension
+    if (ssl_client->max_frag_len) {
+        unsigned char mfl = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+        if (ssl_client->max_frag_len <= 512) {
+            mfl = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+        } else if (ssl_client->max_frag_len <= 1024) {
+            mfl = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+        } else if (ssl_client->max_frag_len <= 2048) {
+            mfl = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+        }
+        if ((ret = mbedtls_ssl_conf_max_frag_len(&ssl_client->ssl_conf, mfl)) != 0) {
+            return handle_error(ret);
+        }
+    }
+
+    if ((ret = ssl_setup(ssl_client)) != 0) {
         return handle_error(ret);
     }
 
     mbedtls_ssl_set_bio(&ssl_client->ssl_ctx, &ssl_client->socket, mbedtls_net_send, mbedtls_net_recv, NULL );
 
+    // an abbreviated handshake if the server still knows the session
+    bool use_cache = ssl_client->session == NULL && SSL_SESSION_CACHE_SIZE > 0;
+    uint32_t trust = 0;
+    unsigned char cached_master[48];
+    bool offered = false;
+    if (ssl_client->session && ssl_client->session->ciphersuite) {
+        if ((ret = mbedtls_ssl_set_session(&ssl_client->ssl_ctx, ssl_client->session)) != 0) {
+            log_d("TLS session not resumed: -0x%x", -ret);
+        }
+    } else if (use_cache) {
+        trust = trust_hash(2166136261UL, insecure ? NULL : rootCABuff);
+        trust = trust_hash(trust, pskIdent);
+        trust = trust_hash(trust, cli_cert);
+        trust = trust_hash(trust, insecure ? "insecure" : NULL);
+        offered = session_cache_resume(&ssl_client->ssl_ctx, host, port, trust, cached_master);
+    }
+
     log_v("Performing the SSL/TLS handshake...");
     unsigned long handshake_start_time=millis();
-    while ((ret = mbedtls_ssl_handshake(&ssl_client->ssl_ctx)) != 0) {
-        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    // step by step, as mbedtls_ssl_handshake() does, to time each state, waiting included
+    mark = micros();
+    while (ssl_client->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        int state = ssl_client->ssl_ctx.state;
+        ret = mbedtls_ssl_handshake_step(&ssl_client->ssl_ctx);
+        if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            if (offered) {
+                session_cache_forget(host, port, trust);
+            }
             return handle_error(ret);
         }
-        if((millis()-handshake_start_time)>ssl_client->handshake_timeout)
-			return -1;
-	    vTaskDelay(2);//2 ticks
+        if (ret != 0) {
+            if((millis()-handshake_start_time)>ssl_client->handshake_timeout)
+                return -1;
+            vTaskDelay(2);//2 ticks
+        }
+        uint32_t now = micros();
+        account_step(timing, state, now - mark);
+        mark = now;
     }
+    timing->resumed = timing->certificate == 0 && timing->key_exchange == 0;
 
 
     if (cli_cert != NULL && cli_key != NULL) {
@@ -241,10 +671,18 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
     } else {
         log_v("Certificate verified.");
     }
-    
-    if (rootCABuff != NULL) {
-        mbedtls_x509_crt_free(&ssl_client->ca_cert);
+
+    if (ssl_client->session) {
+        mbedtls_ssl_session_free(ssl_client->session);
+        if (mbedtls_ssl_get_session(&ssl_client->ssl_ctx, ssl_client->session) != 0) {
+            mbedtls_ssl_session_init(ssl_client->session);
+        }
+    } else if (use_cache) {
+        session_cache_store(&ssl_client->ssl_ctx, host, port, trust, offered ? cached_master : NULL);
     }
+    
+    // only the handshake needs the chain
+    ca_chain_release(ssl_client);
 
     if (cli_cert != NULL) {
         mbedtls_x509_crt_free(&ssl_client->client_cert);
@@ -255,6 +693,10 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
     }    
 
     log_v("Free internal heap after TLS %u", ESP.getFreeHeap());
+    timing->total = micros() - started;
+    log_d("TLS %s in %u us: dns %u, tcp %u, hello %u, certificate %u, key exchange %u, finish %u",
+          timing->resumed ? "resumed" : "handshake", timing->total, timing->dns, timing->tcp,
+          timing->hello, timing->certificate, timing->key_exchange, timing->finish);
 
     return ssl_client->socket;
 }
@@ -269,6 +711,7 @@ void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, cons
         ssl_client->socket = -1;
     }
 
+    ca_chain_release(ssl_client);
     mbedtls_ssl_free(&ssl_client->ssl_ctx);
     mbedtls_ssl_config_free(&ssl_client->ssl_conf);
     mbedtls_ctr_drbg_free(&ssl_client->drbg_ctx);
@@ -290,19 +733,32 @@ int data_to_read(sslclient_context *ssl_client)
     return res;
 }
 
-int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, uint16_t len)
+// all of data, in as many records as it takes; the socket does not block, so a full send buffer is waited out
+int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, size_t len)
 {
     log_v("Writing HTTP request with %d bytes...", len); //for low level debug
-    int ret = -1;
-
-    if ((ret = mbedtls_ssl_write(&ssl_client->ssl_ctx, data, len)) <= 0){
-        log_v("Handling error %d", ret); //for low level debug
-        return handle_error(ret);
-    } else{
-        log_v("Returning with %d bytes written", ret); //for low level debug
+    size_t written = 0;
+    unsigned long progress = millis();
+
+    while (written < len) {
+        int ret = mbedtls_ssl_write(&ssl_client->ssl_ctx, data + written, len - written);
+        if (ret > 0) {
+            written += ret;
+            progress = millis();
+            continue;
+        }
+        if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) {
+            log_v("Handling error %d", ret); //for low level debug
+            return handle_error(ret);
+        }
+        if (millis() - progress > SSL_CLIENT_WRITE_TIMEOUT) {
+            log_e("write timed out after %u of %u bytes", written, len);
+            return written ? (int)written : -1;
+        }
+        vTaskDelay(1);
     }
-
-    return ret;
+    log_v("Returning with %d bytes written", written); //for low level debug
+    return written;
 }
 
 int get_ssl_receive(sslclient_context *ssl_client, uint8_t *data, int length)
@@ -12,6 +12,36 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/error.h"
 
+#ifndef SSL_CA_CACHE_SIZE
+#define SSL_CA_CACHE_SIZE 2 // parsed CA chains kept for the next handshake, 0 parses each time
+#endif
+
+#ifndef SSL_CLIENT_WRITE_TIMEOUT
+#define SSL_CLIENT_WRITE_TIMEOUT 10000 // ms without progress before send_ssl_data() gives up
+#endif
+
+#ifndef SSL_SESSION_CACHE_SIZE
+#define SSL_SESSION_CACHE_SIZE 4 // servers whose session is kept for resumption, 0 disables the cache
+#endif
+
+typedef struct ssl_session_stats {
+    uint32_t hits;     // handshakes that resumed a cached session
+    uint32_t misses;   // full handshakes, no session was cached for the server
+    uint32_t rejected; // full handshakes, the server did not take the cached session
+} ssl_session_stats_t;
+
+// where the time of the last connect went, in microseconds
+typedef struct ssl_handshake_timing {
+    uint32_t dns;          // host name lookup
+    uint32_t tcp;          // TCP connect
+    uint32_t hello;        // ClientHello out to ServerHello in, about one round trip
+    uint32_t certificate;  // server certificate received, parsed and verified
+    uint32_t key_exchange; // ServerKeyExchange signature check, the client's ECDHE/RSA share, CertificateVerify
+    uint32_t finish;       // ChangeCipherSpec and Finished both ways, a session ticket
+    uint32_t total;        // the whole of start_ssl_client()
+    bool resumed;          // abbreviated handshake, no certificate or key exchange
+} ssl_handshake_timing_t;
+
 typedef struct sslclient_context {
     int socket;
     mbedtls_ssl_context ssl_ctx;
@@ -25,6 +55,12 @@ typedef struct sslclient_context {
     mbedtls_pk_context client_key;
 
     unsigned long handshake_timeout;
+    mbedtls_ssl_session *session; // resumed if it holds one, refreshed after each handshake; NULL uses the session cache
+    mbedtls_x509_crt *ca_chain;   // shared from the CA cache, or ca_cert; held during the handshake
+    uint16_t max_frag_len;        // asked of the server, 0 for none or 512, 1024, 2048, 4096
+    int8_t buffers_psram;         // record buffers: -1 heap policy, 0 internal RAM, 1 PSRAM
+    const int *ciphersuites;      // 0 terminated, offered instead of the accelerated preference; kept by the caller
+    ssl_handshake_timing_t timing;
 } sslclient_context;
 
 
@@ -32,9 +68,11 @@ void ssl_init(sslclient_context *ssl_client);
 int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, int timeout, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey, bool insecure);
 void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key);
 int data_to_read(sslclient_context *ssl_client);
-int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, uint16_t len);
+int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, size_t len);
 int get_ssl_receive(sslclient_context *ssl_client, uint8_t *data, int length);
 bool verify_ssl_fingerprint(sslclient_context *ssl_client, const char* fp, const char* domain_name);
 bool verify_ssl_dn(sslclient_context *ssl_client, const char* domain_name);
+void ssl_session_cache_clear();
+ssl_session_stats_t ssl_session_cache_stats();
 
 #endif
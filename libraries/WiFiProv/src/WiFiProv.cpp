@@ -19,6 +19,8 @@
 #include <esp_err.h>
 #include <esp_wifi.h>
 #include <esp_event_loop.h>
+#include <esp_timer.h>
+#include <nvs.h>
 #include <esp32-hal.h>
 
 #include <wifi_provisioning/scheme_ble.h>
@@ -37,6 +39,20 @@ static const uint8_t custom_service_uuid[16] = {  0xb4, 0xdf, 0x5a, 0x1c, 0x3f,
 
 #define SERV_NAME_PREFIX_PROV "PROV_"
 
+// the AP the credentials were tried on, so the next boot skips the scan
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} prov_ap_hint_t;
+
+static wifi_prov_timing_t prov_timing;
+static uint32_t prov_mark;          // millis() when the last phase ended
+static bool prov_running = false;   // the scheme is up and has to be torn down
+static bool hint_pending = false;   // connecting with the stored hint, not yet confirmed
+static bool hint_used = false;      // the STA config is locked to the hinted BSSID
+static bool events_registered = false;
+static esp_timer_handle_t stop_timer = NULL;
+
 void provSchemeBLE()
 {
     prov_scheme = WIFI_PROV_SCHEME_BLE;
@@ -88,6 +104,138 @@ static void prov_event_handler(void *user_data, wifi_prov_cb_event_t event, void
      }
 }
 
+static bool load_ap_hint(prov_ap_hint_t *hint)
+{
+    nvs_handle handle;
+    if(nvs_open("wifiprov", NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(prov_ap_hint_t);
+    esp_err_t err = nvs_get_blob(handle, "ap", hint, &len);
+    nvs_close(handle);
+    return err == ESP_OK && len == sizeof(prov_ap_hint_t) && hint->channel;
+}
+
+static void save_ap_hint(const prov_ap_hint_t *hint)
+{
+    nvs_handle handle;
+    if(nvs_open("wifiprov", NVS_READWRITE, &handle) != ESP_OK) {
+        log_e("nvs_open failed");
+        return;
+    }
+    if(hint) {
+        nvs_set_blob(handle, "ap", hint, sizeof(prov_ap_hint_t));
+    } else {
+        nvs_erase_key(handle, "ap");
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void remember_ap()
+{
+    wifi_ap_record_t ap;
+    if(esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    prov_ap_hint_t hint, stored;
+    memcpy(hint.bssid, ap.bssid, sizeof(hint.bssid));
+    hint.channel = ap.primary;
+    // flash is only written when the AP moved
+    if(!load_ap_hint(&stored) || memcmp(&stored, &hint, sizeof(hint))) {
+        save_ap_hint(&hint);
+    }
+}
+
+static void prov_phase(uint32_t *phase)
+{
+    uint32_t now = millis();
+    *phase = now - prov_mark;
+    prov_mark = now;
+}
+
+static void stop_timer_cb(void *arg)
+{
+    wifi_prov_mgr_stop_provisioning();
+}
+
+// runs on the WiFi event task, where tearing down the manager does not deadlock it
+static void prov_sys_event(system_event_t *sys_event, wifi_prov_event_t *prov_event)
+{
+    if(prov_event) {
+        switch (prov_event->event) {
+        case WIFI_PROV_START:
+            prov_phase(&prov_timing.start);
+            break;
+        case WIFI_PROV_CRED_RECV:
+            prov_phase(&prov_timing.credentials);
+            break;
+        case WIFI_PROV_CRED_SUCCESS:
+            prov_phase(&prov_timing.connected);
+            remember_ap();
+            // instead of the manager's own auto stop, which keeps BLE for half a minute
+            if(!stop_timer) {
+                esp_timer_create_args_t args = {
+                    .callback = stop_timer_cb,
+                    .arg = NULL,
+                    .dispatch_method = ESP_TIMER_TASK,
+                    .name = "prov_stop"
+                };
+                esp_timer_create(&args, &stop_timer);
+            }
+            if(!stop_timer || esp_timer_start_once(stop_timer, WIFI_PROV_STOP_DELAY * 1000ULL) != ESP_OK) {
+                wifi_prov_mgr_stop_provisioning();
+            }
+            break;
+        case WIFI_PROV_END: {
+            if(!prov_running) {
+                break;
+            }
+            prov_running = false;
+            uint32_t heap = esp_get_free_heap_size();
+            // releases the BT controller memory when the scheme handler was given for it
+            wifi_prov_mgr_deinit();
+            WiFi.enableProv(false);
+            if(WiFi.getMode() == WIFI_MODE_APSTA) {
+                WiFi.mode(WIFI_MODE_STA);
+            }
+            uint32_t freed = esp_get_free_heap_size();
+            prov_timing.heapFreed = freed > heap ? freed - heap : 0;
+            prov_phase(&prov_timing.end);
+            log_i("provisioning done, %u bytes freed", prov_timing.heapFreed);
+            break;
+        }
+        default:
+            break;
+        }
+        return;
+    }
+    if(!sys_event) {
+        return;
+    }
+    if(sys_event->event_id == SYSTEM_EVENT_STA_GOT_IP) {
+        hint_pending = false;
+        if(!prov_running) {
+            remember_ap();
+        }
+    } else if(sys_event->event_id == SYSTEM_EVENT_STA_DISCONNECTED && hint_used
+        && (hint_pending || sys_event->event_info.disconnected.reason == WIFI_REASON_NO_AP_FOUND)) {
+        // the stored AP is gone, forget it and scan all channels
+        log_w("stored AP did not answer (%u), scanning", sys_event->event_info.disconnected.reason);
+        hint_pending = false;
+        hint_used = false;
+        prov_timing.fallback = true;
+        save_ap_hint(NULL);
+        wifi_config_t conf;
+        if(esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK) {
+            conf.sta.bssid_set = 0;
+            conf.sta.channel = 0;
+            esp_wifi_set_config(WIFI_IF_STA, &conf);
+        }
+        esp_wifi_connect();
+    }
+}
+
 static void get_device_service_name(char *service_name, size_t max)
 {
     uint8_t eth_mac[6];
@@ -99,6 +247,12 @@ void WiFiProvClass :: beginProvision(void (*scheme_cb)(), wifi_prov_event_handle
 {
     WiFi.enableProv(true);
     bool provisioned = false;
+    memset(&prov_timing, 0, sizeof(prov_timing));
+    prov_mark = millis();
+    if(!events_registered) {
+        WiFi.onEvent(prov_sys_event);
+        events_registered = true;
+    }
     scheme_cb();
     config.scheme_event_handler = scheme_event_handler;
     config.app_event_handler = {
@@ -135,7 +289,11 @@ void WiFiProvClass :: beginProvision(void (*scheme_cb)(), wifi_prov_event_handle
             }
         }
            
-        wifi_prov_mgr_start_provisioning(security,pop,service_name,service_key);
+        prov_running = true;
+        if(wifi_prov_mgr_start_provisioning(security,pop,service_name,service_key) != ESP_OK) {
+            log_e("provisioning start failed");
+            prov_running = false;
+        }
 
     } else {
         wifi_prov_mgr_deinit();
@@ -147,7 +305,35 @@ void WiFiProvClass :: beginProvision(void (*scheme_cb)(), wifi_prov_event_handle
         log_i("SSID : %s\n",conf.sta.ssid);
 #endif
         log_i("CONNECTING TO THE ACCESS POINT : ");
-        WiFi.begin(); 
+        prov_ap_hint_t hint;
+        wifi_config_t conf;
+        if(load_ap_hint(&hint) && esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK) {
+            // the AP the credentials worked on, on its channel, without a scan of all of them
+            char ssid[33] = { 0 };
+            char password[65] = { 0 };
+            memcpy(ssid, conf.sta.ssid, sizeof(conf.sta.ssid));
+            memcpy(password, conf.sta.password, sizeof(conf.sta.password));
+            log_i("using channel %u", hint.channel);
+            prov_timing.fastConnect = true;
+            hint_pending = true;
+            hint_used = true;
+            if(WiFi.begin(ssid, password, hint.channel, hint.bssid) == WL_CONNECT_FAILED) {
+                hint_pending = false;
+                hint_used = false;
+                WiFi.begin();
+            }
+        } else {
+            WiFi.begin();
+        }
     }
 }
+
+/**
+ * Where the time of the last beginProvision() went
+ * @return wifi_prov_timing_t
+ */
+const wifi_prov_timing_t& WiFiProvClass :: timing()
+{
+    return prov_timing;
+}
 WiFiProvClass WiFiProv;
@@ -22,6 +22,21 @@ typedef enum
     WIFI_PROV_SCHEME_SOFTAP
 }scheme_t;
 
+#ifndef WIFI_PROV_STOP_DELAY
+#define WIFI_PROV_STOP_DELAY 1000 // ms the scheme stays up after success, the phone app reads the status once more
+#endif
+
+//Where the time of provisioning went, in ms
+typedef struct {
+    uint32_t start;        // beginProvision() to the scheme advertising
+    uint32_t credentials;  // advertising to credentials received
+    uint32_t connected;    // credentials to connected with them
+    uint32_t end;          // connected to the scheme torn down and its memory released
+    uint32_t heapFreed;    // bytes the free heap grew by with the teardown
+    bool fastConnect;      // already provisioned, connected with the stored BSSID and channel
+    bool fallback;         // that AP was not there and a full scan followed
+} wifi_prov_timing_t;
+
 extern void provSchemeSoftAP();
 extern void provSchemeBLE();
 
@@ -31,6 +46,7 @@ class WiFiProvClass
     public:
 
     void beginProvision(void (*scheme_cb)() = provSchemeSoftAP, wifi_prov_event_handler_t scheme_event_handler = WIFI_PROV_EVENT_HANDLER_NONE, wifi_prov_security_t security = WIFI_PROV_SECURITY_1, const char * pop = "abcd1234", const char * service_name = NULL, const char * service_key = NULL, uint8_t *uuid = NULL);
+    const wifi_prov_timing_t& timing();
 };
 extern WiFiProvClass WiFiProv;
 /*
@@ -37,25 +37,96 @@ TwoWire::TwoWire(uint8_t bus_num)
     ,sda(-1)
     ,scl(-1)
     ,i2c(NULL)
+    ,bufferSize(I2C_BUFFER_LENGTH)
+    ,rxBuffer(NULL)
     ,rxIndex(0)
     ,rxLength(0)
     ,rxQueued(0)
+    ,txBuffer(NULL)
     ,txIndex(0)
     ,txLength(0)
     ,txAddress(0)
     ,txQueued(0)
     ,transmitting(0)
+    ,is_slave(false)
+    ,_onRequest(NULL)
+    ,_onReceive(NULL)
     ,last_error(I2C_ERROR_OK)
     ,_timeOutMillis(50)
+    ,_transaction(NULL)
+    ,_asyncPending(false)
 {}
 
 TwoWire::~TwoWire()
 {
+    delete _transaction;
     flush();
+    if(is_slave) {
+        i2cSlaveDeinit(num);
+        is_slave = false;
+    }
     if(i2c) {
         i2cRelease(i2c);
         i2c=NULL;
     }
+    freeWireBuffer();
+}
+
+bool TwoWire::allocateWireBuffer()
+{
+    if(rxBuffer && txBuffer) {
+        return true;
+    }
+    freeWireBuffer();
+    rxBuffer = (uint8_t *)malloc(bufferSize);
+    txBuffer = (uint8_t *)malloc(bufferSize);
+    if(!rxBuffer || !txBuffer) {
+        log_e("Can't allocate Wire buffers of %u bytes", bufferSize);
+        freeWireBuffer();
+        return false;
+    }
+    return true;
+}
+
+void TwoWire::freeWireBuffer()
+{
+    free(rxBuffer);
+    rxBuffer = NULL;
+    free(txBuffer);
+    txBuffer = NULL;
+}
+
+size_t TwoWire::setBufferSize(size_t bSize)
+{
+    if(bSize == 0 || bSize > UINT16_MAX) { // indexes are 16 bit
+        log_e("invalid buffer size %u", bSize);
+        return 0;
+    }
+    finishAsync();
+    if(transmitting || rxQueued || txQueued) {
+        log_e("can not resize buffers while a transmission is pending");
+        return 0;
+    }
+    if(bSize == bufferSize) {
+        return bufferSize;
+    }
+    size_t oldSize = bufferSize;
+    bool allocated = rxBuffer != NULL;
+    freeWireBuffer();
+    bufferSize = bSize;
+    rxIndex = 0;
+    rxLength = 0;
+    if(allocated && !allocateWireBuffer()) { // keep the bus usable
+        bufferSize = oldSize;
+        allocateWireBuffer();
+        return 0;
+    }
+    return bufferSize;
+}
+
+size_t TwoWire::getBufferSize()
+{
+    return bufferSize;
 }
 
 bool TwoWire::setPins(int sdaPin, int sclPin)
@@ -105,6 +176,14 @@ bool TwoWire::begin(int sdaPin, int sclPin, uint32_t frequency)
         }
     }
 
+    if(!allocateWireBuffer()) {
+        return false;
+    }
+
+    if(is_slave) {
+        i2cSlaveDeinit(num);
+        is_slave = false;
+    }
     sda = sdaPin;
     scl = sclPin;
     i2c = i2cInit(num, sdaPin, sclPin, frequency);
@@ -117,6 +196,71 @@ bool TwoWire::begin(int sdaPin, int sclPin, uint32_t frequency)
 
 }
 
+bool TwoWire::begin(uint8_t slaveAddr, int sdaPin, int sclPin, uint32_t frequency)
+{
+    if(sdaPin < 0) {
+        sdaPin = (sda == -1 && num == 0) ? SDA : sda;
+    }
+    if(sclPin < 0) {
+        sclPin = (scl == -1 && num == 0) ? SCL : scl;
+    }
+    if(sdaPin < 0 || sclPin < 0) {
+        log_e("no Default SDA/SCL Pin for Second Peripheral");
+        return false;
+    }
+    if(!allocateWireBuffer()) {
+        return false;
+    }
+    flush();
+    if(i2c) { // the peripheral serves one role at a time
+        i2cRelease(i2c);
+        i2c = NULL;
+    }
+
+    sda = sdaPin;
+    scl = sclPin;
+    i2cSlaveAttachCallbacks(num, onRequestService, onReceiveService, this);
+    if(i2cSlaveInit(num, sda, scl, slaveAddr, frequency, bufferSize, bufferSize) != I2C_ERROR_OK) {
+        log_e("Slave Init ERROR");
+        return false;
+    }
+    is_slave = true;
+    return true;
+}
+
+void TwoWire::onReceive(void (*function)(int))
+{
+    _onReceive = function;
+}
+
+void TwoWire::onRequest(void (*function)(void))
+{
+    _onRequest = function;
+}
+
+void TwoWire::onReceiveService(uint8_t num, uint8_t * inBytes, size_t numBytes, bool stop, void * arg)
+{
+    TwoWire * wire = (TwoWire *)arg;
+    if(!wire->_onReceive) {
+        return;
+    }
+    if(numBytes > wire->bufferSize) {
+        numBytes = wire->bufferSize;
+    }
+    memcpy(wire->rxBuffer, inBytes, numBytes);
+    wire->rxIndex = 0;
+    wire->rxLength = numBytes;
+    wire->_onReceive(numBytes);
+}
+
+void TwoWire::onRequestService(uint8_t num, void * arg)
+{
+    TwoWire * wire = (TwoWire *)arg;
+    if(wire->_onRequest) {
+        wire->_onRequest();
+    }
+}
+
 void TwoWire::setTimeOut(uint16_t timeOutMillis)
 {
     _timeOutMillis = timeOutMillis;
@@ -139,20 +283,23 @@ size_t TwoWire::getClock()
 
 /* stickBreaker Nov 2017 ISR, and bigblock 64k-1
  */
-i2c_err_t TwoWire::writeTransmission(uint16_t address, uint8_t *buff, uint16_t size, bool sendStop)
+i2c_err_t TwoWire::writeTransmission(uint16_t address, const uint8_t *buff, uint16_t size, bool sendStop)
 {
-    last_error = i2cWrite(i2c, address, buff, size, sendStop, _timeOutMillis);
+    finishAsync();
+    last_error = i2cWrite(i2c, address, (uint8_t *)buff, size, sendStop, _timeOutMillis);
     return last_error;
 }
 
 i2c_err_t TwoWire::readTransmission(uint16_t address, uint8_t *buff, uint16_t size, bool sendStop, uint32_t *readCount)
 {
+    finishAsync();
     last_error = i2cRead(i2c, address, buff, size, sendStop, _timeOutMillis, readCount);
     return last_error;
 }
 
 void TwoWire::beginTransmission(uint16_t address)
 {
+    finishAsync();
     transmitting = 1;
     txAddress = address;
     txIndex = txQueued; // allow multiple beginTransmission(),write(),endTransmission(false) until endTransmission(true)
@@ -185,13 +332,90 @@ uint8_t TwoWire::endTransmission(bool sendStop)  // Assumes Wire.beginTransactio
     return (last_error == I2C_ERROR_CONTINUE)?I2C_ERROR_OK:last_error; // Don't return Continue for compatibility.
 }
 
+TwoWireTransaction & TwoWire::transaction()
+{
+    if(!_transaction) {
+        _transaction = new TwoWireTransaction(*this);
+    }
+    return _transaction->clear();
+}
+
+i2c_err_t TwoWire::runTransaction(i2c_batch_t * batch, uint32_t *readCount)
+{
+    finishAsync();
+    last_error = i2cBatchRun(i2c, batch, _timeOutMillis, readCount);
+    return last_error;
+}
+
+TwoWireTransaction::TwoWireTransaction(TwoWire & wire, uint16_t segments)
+    :_wire(wire)
+    ,_batch(i2cBatchCreate(segments))
+    ,_error(I2C_ERROR_OK)
+{
+    if(!_batch) {
+        _error = I2C_ERROR_MEMORY;
+    }
+}
+
+TwoWireTransaction::~TwoWireTransaction()
+{
+    i2cBatchFree(_batch);
+}
+
+TwoWireTransaction & TwoWireTransaction::write(uint16_t address, const uint8_t * buff, uint16_t size, bool sendStop)
+{
+    i2c_err_t err = i2cBatchAddWrite(_batch, address, (uint8_t *)buff, size, sendStop);
+    if(_error == I2C_ERROR_OK) {
+        _error = err;
+    }
+    return *this;
+}
+
+TwoWireTransaction & TwoWireTransaction::read(uint16_t address, uint8_t * buff, uint16_t size, bool sendStop)
+{
+    i2c_err_t err = i2cBatchAddRead(_batch, address, buff, size, sendStop);
+    if(_error == I2C_ERROR_OK) {
+        _error = err;
+    }
+    return *this;
+}
+
+TwoWireTransaction & TwoWireTransaction::writeRead(uint16_t address, const uint8_t * txBuff, uint16_t txSize, uint8_t * rxBuff, uint16_t rxSize)
+{
+    return write(address, txBuff, txSize, false).read(address, rxBuff, rxSize, true);
+}
+
+TwoWireTransaction & TwoWireTransaction::clear()
+{
+    i2cBatchClear(_batch);
+    _error = _batch ? I2C_ERROR_OK : I2C_ERROR_MEMORY;
+    return *this;
+}
+
+i2c_err_t TwoWireTransaction::run(uint32_t * readCount)
+{
+    if(_error != I2C_ERROR_OK) {
+        if(readCount) {
+            *readCount = 0;
+        }
+        return _error;
+    }
+    return _wire.runTransaction(_batch, readCount);
+}
+
+uint16_t TwoWireTransaction::errorSegment()
+{
+    return i2cBatchErrorSegment(_batch);
+}
+
 /* @stickBreaker 11/2017 fix for ReSTART timeout, ISR
  */
 uint8_t TwoWire::requestFrom(uint16_t address, uint8_t size, bool sendStop)
 {
+    finishAsync();
     //use internal Wire rxBuffer, multiple requestFrom()'s may be pending, try to share rxBuffer
     uint32_t cnt = rxQueued; // currently queued reads, next available position in rxBuffer
-    if(cnt < (I2C_BUFFER_LENGTH-1) && (size + cnt) <= I2C_BUFFER_LENGTH) { // any room left in rxBuffer
+    if(rxBuffer && cnt < (bufferSize-1) && (size + cnt) <= bufferSize) { // any room left in rxBuffer
         rxQueued += size;
     } else { // no room to receive more!
         log_e("rxBuff overflow %d", cnt + size);
@@ -219,10 +443,94 @@ uint8_t TwoWire::requestFrom(uint16_t address, uint8_t size, bool sendStop)
     return cnt;
 }
 
+size_t TwoWire::requestFrom(uint16_t address, uint8_t * buff, size_t size, bool sendStop)
+{
+    finishAsync();
+    if(size > UINT16_MAX) {
+        log_e("read of %u bytes too long", size);
+        last_error = I2C_ERROR_MEMORY;
+        flush();
+        return 0;
+    }
+    uint32_t queued = rxQueued; // earlier ReSTART reads still land in rxBuffer
+    uint32_t cnt = 0;
+    last_error = readTransmission(address, buff, size, sendStop, &cnt);
+    rxIndex = 0;
+    rxLength = 0;
+    if(last_error != I2C_ERROR_CONTINUE) {
+        rxQueued = 0;
+        txQueued = 0;
+    }
+    if(last_error != I2C_ERROR_OK) {
+        return 0;
+    }
+    rxLength = queued;
+    return (cnt > queued) ? (cnt - queued) : 0;
+}
+
+i2c_err_t TwoWire::requestFromAsync(uint16_t address, uint8_t size, i2c_async_cb_t callback, void * arg)
+{
+    finishAsync();
+    //same rxBuffer sharing as requestFrom(), queued ReSTART reads come first
+    uint32_t cnt = rxQueued;
+    if(!rxBuffer || cnt >= (bufferSize-1) || (size + cnt) > bufferSize) { // no room to receive more!
+        log_e("rxBuff overflow %d", cnt + size);
+        last_error = I2C_ERROR_MEMORY;
+        flush();
+        return last_error;
+    }
+    rxIndex = 0;
+    rxLength = 0;
+    last_error = i2cAddQueueRead(i2c, address, &rxBuffer[cnt], size, true, NULL);
+    if(last_error == I2C_ERROR_OK) {
+        rxQueued += size;
+        last_error = i2cProcQueueAsync(i2c, _timeOutMillis, callback, arg);
+        if(last_error == I2C_ERROR_BUSY) { // try to clear the bus
+            if(i2cInit(num, sda, scl, 0)) {
+                last_error = i2cProcQueueAsync(i2c, _timeOutMillis, callback, arg);
+            }
+        }
+    }
+    if(last_error == I2C_ERROR_OK) {
+        _asyncPending = true;
+    } else {
+        flush();
+    }
+    return last_error;
+}
+
+void TwoWire::finishAsync()
+{
+    if(!_asyncPending) {
+        return;
+    }
+    _asyncPending = false;
+    uint32_t cnt = 0;
+    last_error = i2cWaitAsync(i2c, &cnt);
+    rxIndex = 0;
+    rxLength = (last_error == I2C_ERROR_OK) ? cnt : 0;
+    rxQueued = 0;
+    txQueued = 0;
+}
+
+bool TwoWire::asyncBusy()
+{
+    return _asyncPending && i2cAsyncBusy(i2c);
+}
+
+i2c_err_t TwoWire::waitAsync()
+{
+    finishAsync();
+    return last_error;
+}
+
 size_t TwoWire::write(uint8_t data)
 {
+    if(is_slave) { // straight into the answer queue
+        return i2cSlaveWrite(num, &data, 1, _timeOutMillis);
+    }
     if(transmitting) {
-        if(txLength >= I2C_BUFFER_LENGTH) {
+        if(!txBuffer || txLength >= bufferSize) {
             last_error = I2C_ERROR_MEMORY;
             return 0;
         }
@@ -237,23 +545,36 @@ size_t TwoWire::write(uint8_t data)
 
 size_t TwoWire::write(const uint8_t *data, size_t quantity)
 {
-    for(size_t i = 0; i < quantity; ++i) {
-        if(!write(data[i])) {
-            return i;
-        }
+    if(is_slave) {
+        return i2cSlaveWrite(num, data, quantity, _timeOutMillis);
+    }
+    if(!transmitting) {
+        last_error = I2C_ERROR_NO_BEGIN; // no begin, not transmitting
+        return 0;
+    }
+    size_t room = txBuffer ? (bufferSize - txLength) : 0;
+    if(quantity > room) {
+        last_error = I2C_ERROR_MEMORY;
+        quantity = room;
+    }
+    if(quantity) {
+        memcpy(&txBuffer[txIndex], data, quantity);
+        txIndex += quantity;
+        txLength = txIndex;
     }
     return quantity;
-
 }
 
 int TwoWire::available(void)
 {
+    finishAsync();
     int result = rxLength - rxIndex;
     return result;
 }
 
 int TwoWire::read(void)
 {
+    finishAsync();
     int value = -1;
     if(rxIndex < rxLength) {
         value = rxBuffer[rxIndex];
@@ -264,6 +585,7 @@ int TwoWire::read(void)
 
 int TwoWire::peek(void)
 {
+    finishAsync();
     int value = -1;
     if(rxIndex < rxLength) {
         value = rxBuffer[rxIndex];
@@ -279,6 +601,7 @@ void TwoWire::flush(void)
     txLength = 0;
     rxQueued = 0;
     txQueued = 0;
+    _asyncPending = false;
     i2cFlush(i2c); // cleanup
 }
 
@@ -370,6 +693,16 @@ char * TwoWire::getErrorText(uint8_t err)
 /*stickbreaker Dump i2c Interrupt buffer, i2c isr Debugging
  */
  
+i2c_err_t TwoWire::getStats(i2c_stats_t * stats)
+{
+    return i2cGetStats(i2c, stats);
+}
+
+void TwoWire::resetStats()
+{
+    i2cResetStats(i2c);
+}
+
 uint32_t TwoWire::setDebugFlags( uint32_t setBits, uint32_t resetBits){
   return i2cDebug(i2c,setBits,resetBits);
 }
@@ -31,10 +31,39 @@
 #include "Stream.h"
 
 #define STICKBREAKER 'V1.1.0'
-#define I2C_BUFFER_LENGTH 128
+#ifndef I2C_BUFFER_LENGTH
+#define I2C_BUFFER_LENGTH 128 // default size of rxBuffer/txBuffer, see setBufferSize()
+#endif
 typedef void(*user_onRequest)(void);
 typedef void(*user_onReceive)(uint8_t*, int);
 
+class TwoWire;
+
+// Chain of write/read segments, built once and run in a single queue pass
+class TwoWireTransaction
+{
+public:
+    TwoWireTransaction(TwoWire & wire, uint16_t segments=4);
+    ~TwoWireTransaction();
+
+    TwoWireTransaction & write(uint16_t address, const uint8_t * buff, uint16_t size, bool sendStop=true);
+    TwoWireTransaction & read(uint16_t address, uint8_t * buff, uint16_t size, bool sendStop=true);
+    // write (usually a register address) then ReSTART and read
+    TwoWireTransaction & writeRead(uint16_t address, const uint8_t * txBuff, uint16_t txSize, uint8_t * rxBuff, uint16_t rxSize);
+    TwoWireTransaction & clear();
+
+    i2c_err_t run(uint32_t * readCount=NULL); // buffers passed above must still be valid
+    uint16_t errorSegment();
+
+private:
+    TwoWireTransaction(const TwoWireTransaction &);
+    TwoWireTransaction & operator=(const TwoWireTransaction &);
+
+    TwoWire & _wire;
+    i2c_batch_t * _batch;
+    i2c_err_t _error; // first error while building
+};
+
 class TwoWire: public Stream
 {
 protected:
@@ -43,26 +72,32 @@ protected:
     int8_t scl;
     i2c_t * i2c;
 
-    uint8_t rxBuffer[I2C_BUFFER_LENGTH];
+    size_t bufferSize;
+    uint8_t * rxBuffer;
     uint16_t rxIndex;
     uint16_t rxLength;
     uint16_t rxQueued; //@stickBreaker
 
-    uint8_t txBuffer[I2C_BUFFER_LENGTH];
+    uint8_t * txBuffer;
     uint16_t txIndex;
     uint16_t txLength;
     uint16_t txAddress;
     uint16_t txQueued; //@stickbreaker
 
     uint8_t transmitting;
-    /* slave Mode, not yet Stickbreaker
-            static user_onRequest uReq[2];
-            static user_onReceive uRcv[2];
-        void onRequestService(void);
-        void onReceiveService(uint8_t*, int);
-    */
+    // slave mode, callbacks run in the i2c slave task
+    bool is_slave;
+    void (*_onRequest)(void);
+    void (*_onReceive)(int);
+    static void onRequestService(uint8_t num, void * arg);
+    static void onReceiveService(uint8_t num, uint8_t * inBytes, size_t numBytes, bool stop, void * arg);
     i2c_err_t last_error; // @stickBreaker from esp32-hal-i2c.h
     uint16_t _timeOutMillis;
+    TwoWireTransaction * _transaction;
+    bool _asyncPending;
+    void finishAsync();
+    bool allocateWireBuffer();
+    void freeWireBuffer();
 
 public:
     TwoWire(uint8_t bus_num);
@@ -71,8 +106,22 @@ public:
     //call setPins() first, so that begin() can be called without arguments from libraries
     bool setPins(int sda, int scl);
     
-    bool begin(int sda=-1, int scl=-1, uint32_t frequency=0); // returns true, if successful init of i2c bus
+    bool begin(int sda, int scl, uint32_t frequency=0); // returns true, if successful init of i2c bus
       // calling will attemp to recover hung bus
+    // slave at slaveAddr, answers are queued with write() from onReceive()/onRequest()
+    bool begin(uint8_t slaveAddr, int sda, int scl, uint32_t frequency);
+    inline bool begin()
+    {
+        return begin(-1, -1, static_cast<uint32_t>(0));
+    }
+    inline bool begin(uint8_t slaveAddr)
+    {
+        return begin(slaveAddr, -1, -1, 0);
+    }
+    inline bool begin(int slaveAddr)
+    {
+        return begin(static_cast<uint8_t>(slaveAddr), -1, -1, 0);
+    }
 
     void setClock(uint32_t frequency); // change bus clock without initing hardware
     size_t getClock(); // current bus clock rate in hz
@@ -80,11 +129,15 @@ public:
     void setTimeOut(uint16_t timeOutMillis); // default timeout of i2c transactions is 50ms
     uint16_t getTimeOut();
 
+    // resize rxBuffer and txBuffer (each bSize bytes), returns the new size or 0 on failure
+    size_t setBufferSize(size_t bSize);
+    size_t getBufferSize();
+
     uint8_t lastError();
     char * getErrorText(uint8_t err);
 
-    //@stickBreaker for big blocks and ISR model
-    i2c_err_t writeTransmission(uint16_t address, uint8_t* buff, uint16_t size, bool sendStop=true);
+    //@stickBreaker for big blocks and ISR model, the hardware works directly on buff (no copy)
+    i2c_err_t writeTransmission(uint16_t address, const uint8_t* buff, uint16_t size, bool sendStop=true);
     i2c_err_t readTransmission(uint16_t address, uint8_t* buff, uint16_t size, bool sendStop=true, uint32_t *readCount=NULL);
 
     void beginTransmission(uint16_t address);
@@ -94,6 +147,9 @@ public:
     uint8_t endTransmission(bool sendStop);
     uint8_t endTransmission(void);
 
+    TwoWireTransaction & transaction(); // shared builder, cleared on every call
+    i2c_err_t runTransaction(i2c_batch_t * batch, uint32_t *readCount=NULL);
+
     uint8_t requestFrom(uint16_t address, uint8_t size, bool sendStop);
     uint8_t requestFrom(uint16_t address, uint8_t size, uint8_t sendStop);
     uint8_t requestFrom(uint16_t address, uint8_t size);
@@ -101,6 +157,14 @@ public:
     uint8_t requestFrom(uint8_t address, uint8_t size);
     uint8_t requestFrom(int address, int size, int sendStop);
     uint8_t requestFrom(int address, int size);
+    // read straight into buff, bypassing rxBuffer; returns the bytes stored in buff
+    size_t requestFrom(uint16_t address, uint8_t * buff, size_t size, bool sendStop=true);
+
+    // returns once the read is started, callback runs in the ISR (IRAM_ATTR) when it completes,
+    // without callback the calling task gets a notification. available()/read() wait for the data.
+    i2c_err_t requestFromAsync(uint16_t address, uint8_t size, i2c_async_cb_t callback=NULL, void * arg=NULL);
+    bool asyncBusy();
+    i2c_err_t waitAsync();
 
     size_t write(uint8_t);
     size_t write(const uint8_t *, size_t);
@@ -133,6 +197,9 @@ public:
     void onReceive( void (*)(int) );
     void onRequest( void (*)(void) );
 
+    i2c_err_t getStats(i2c_stats_t * stats); // see i2cGetStats()
+    void resetStats();
+
     uint32_t setDebugFlags( uint32_t setBits, uint32_t resetBits);
     bool busy();
 };
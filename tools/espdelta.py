@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+#
+# Makes a patch that Update.beginDelta() applies to the running firmware
+# use it like: python espdelta.py <running.bin> <new.bin> <patch.bin>
+# --gzip is for serving it with Content-Encoding, Update takes it plain.
+#
+# Format, little endian:
+#   "ESPD", version 1, 3 reserved bytes
+#   source size  (4), source MD5 (16)
+#   target size  (4), target MD5 (16)
+#   records: varint diff length, varint extra length, zigzag varint seek,
+#            diff bytes (added to the source), extra bytes (copied)
+# The seek moves the source position once both runs are written.
+
+from __future__ import print_function
+
+import argparse
+import gzip
+import hashlib
+import struct
+import sys
+
+MAGIC = b'ESPD'
+VERSION = 1
+KEY = 16        # bytes that have to match to align on the source
+STEP = 4        # source offsets indexed, every STEP bytes
+SLACK = 64      # mismatching bytes a diff run carries before it ends
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def index_source(source):
+    index = {}
+    for pos in range(0, len(source) - KEY + 1, STEP):
+        index.setdefault(source[pos:pos + KEY], pos)
+    return index
+
+
+def extend(source, spos, target, tpos):
+    """length of the diff run: the prefix with most matches over mismatches"""
+    best = 0
+    score = 0
+    best_score = 0
+    i = 0
+    limit = min(len(source) - spos, len(target) - tpos)
+    while i < limit:
+        if source[spos + i] == target[tpos + i]:
+            score += 1
+        else:
+            score -= 1
+        i += 1
+        if score > best_score:
+            best_score = score
+            best = i
+        elif i - best > SLACK:
+            break
+    return best
+
+
+def make_patch(source, target):
+    index = index_source(source)
+    out = bytearray()
+    out += MAGIC + struct.pack('<B3x', VERSION)
+    out += struct.pack('<I', len(source)) + hashlib.md5(source).digest()
+    out += struct.pack('<I', len(target)) + hashlib.md5(target).digest()
+
+    spos = 0
+    tpos = 0
+    while tpos < len(target):
+        diff = extend(source, spos, target, tpos) if spos < len(source) else 0
+        extra_start = tpos + diff
+        scan = extra_start
+        match = None
+        while scan < len(target):
+            match = index.get(target[scan:scan + KEY])
+            if match is not None:
+                break
+            scan += 1
+        next_spos = match if match is not None else spos + diff
+        out += varint(diff) + varint(scan - extra_start) + varint(zigzag(next_spos - spos - diff))
+        out += bytes(bytearray((target[tpos + i] - source[spos + i]) & 0xff for i in range(diff)))
+        out += target[extra_start:scan]
+        spos = next_spos
+        tpos = scan
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 delta OTA patch maker')
+    parser.add_argument('source', help='firmware the device runs now', type=argparse.FileType('rb'))
+    parser.add_argument('target', help='firmware to update to', type=argparse.FileType('rb'))
+    parser.add_argument('patch', help='patch to write', type=argparse.FileType('wb'))
+    parser.add_argument('--gzip', help='gzip the patch', action='store_true')
+    args = parser.parse_args()
+
+    source = args.source.read()
+    target = args.target.read()
+    patch = make_patch(source, target)
+    if args.gzip:
+        patch = gzip.compress(patch, 9)
+    args.patch.write(patch)
+    print('patch %d bytes for a %d byte image (%.1f%%)' % (len(patch), len(target), 100.0 * len(patch) / len(target)), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -69,7 +69,33 @@ def update_progress(progress):
     sys.stderr.write('.')
     sys.stderr.flush()
 
-def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, command = FLASH):
+def upload_windowed(connection, f, content_size, window):
+  # stream ahead up to window KB past the last "<received>\n" from the device,
+  # its closing "OK" (or error text) comes after the final count
+  pending = ''
+  sent = 0
+  acked = 0
+  while sent < content_size or 'OK' not in pending:
+    if sent < content_size and sent - acked < window * 1024:
+      chunk = f.read(4096)
+      if not chunk: break
+      connection.sendall(chunk)
+      sent += len(chunk)
+      continue
+    data = connection.recv(64).decode()
+    if not data:
+      raise IOError('connection closed')
+    pending += data
+    lines = pending.split('\n')
+    pending = lines.pop()
+    for line in lines:
+      if not line.isdigit():
+        raise IOError(line)
+      acked = int(line)
+      update_progress(acked/float(content_size))
+  return True
+
+def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, command = FLASH, window = 0):
   # Create a TCP/IP socket
   sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
   server_address = (localAddr, localPort)
@@ -87,6 +113,9 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
   f.close()
   logging.info('Upload size: %d', content_size)
   message = '%d %d %d %s\n' % (command, localPort, content_size, file_md5)
+  if window:
+    # older devices read the first line only and answer a plain OK
+    message += 'W%d\n' % (window)
 
   # Wait for a connection
   inv_trys = 0
@@ -119,7 +148,7 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
   if (inv_trys == 10):
     logging.error('No response from the ESP')
     return 1
-  if (data != "OK"):
+  if (data != "OK" and not data.startswith('OK ')):
     if(data.startswith('AUTH')):
       nonce = data.split()[1]
       cnonce_text = '%s%u%s%s' % (filename, content_size, file_md5, remoteAddr)
@@ -139,7 +168,7 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
         logging.error('No Answer to our Authentication')
         sock2.close()
         return 1
-      if (data != "OK"):
+      if (data != "OK" and not data.startswith('OK ')):
         sys.stderr.write('FAIL\n')
         logging.error('%s', data)
         sock2.close()
@@ -151,6 +180,11 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
       sock2.close()
       return 1
   sock2.close()
+  if not data.startswith('OK W'):
+    window = 0
+  else:
+    window = int(data[4:])
+    logging.info('Window: %d KB', window)
 
   logging.info('Waiting for device...')
   try:
@@ -169,6 +203,24 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
     else:
       sys.stderr.write('Uploading')
       sys.stderr.flush()
+    if window:
+      connection.settimeout(10)
+      try:
+        upload_windowed(connection, f, content_size, window)
+      except Exception as e:
+        sys.stderr.write('\n')
+        logging.error('Error Uploading: %s', str(e))
+        connection.close()
+        f.close()
+        sock.close()
+        return 1
+      sys.stderr.write('\n')
+      logging.info('Success')
+      connection.close()
+      f.close()
+      sock.close()
+      return 0
+
     offset = 0
     while True:
       chunk = f.read(1024)
@@ -285,6 +337,12 @@ def parser(unparsed_args):
     metavar="FILE",
     default = None
   )
+  group.add_option("-w", "--window",
+    dest = "window",
+    type = "int",
+    help = "KB sent ahead of the device's acknowledgements, 0 waits for each 1KB chunk. Default 64",
+    default = 64
+  )
   group.add_option("-s", "--spiffs",
     dest = "spiffs",
     action = "store_true",
@@ -345,7 +403,7 @@ def main(args):
   if (options.spiffs):
     command = SPIFFS
 
-  return serve(options.esp_ip, options.host_ip, options.esp_port, options.host_port, options.auth, options.image, command)
+  return serve(options.esp_ip, options.host_ip, options.esp_port, options.host_port, options.auth, options.image, command, options.window)
 # end main
 
 
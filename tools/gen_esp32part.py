@@ -34,6 +34,8 @@ import errno
 MAX_PARTITION_LENGTH = 0xC00   # 3K for partition data (96 entries) leaves 1K in a 4K sector for signature
 MD5_PARTITION_BEGIN = b"\xEB\xEB" + b"\xFF" * 14  # The first 2 bytes are like magic numbers for MD5 sum
 PARTITION_TABLE_SIZE  = 0x1000  # Size of partition table
+FLASH_SECTOR_SIZE = 0x1000  # smallest erase
+FLASH_BLOCK_SIZE = 0x10000  # fast erase, and the MMU page
 
 MIN_PARTITION_SUBTYPE_APP_OTA = 0x10
 NUM_PARTITION_SUBTYPE_APP_OTA = 16
@@ -71,6 +73,7 @@ quiet = False
 md5sum = True
 secure = False
 offset_part_table = 0
+data_align = 0x1000  # blank data offsets are padded to this, a multiple of the flash sector
 
 
 def status(msg):
@@ -124,7 +127,12 @@ class PartitionTable(list):
                     raise InputError("CSV Error: Partitions overlap. Partition at line %d sets offset 0x%x. Previous partition ends 0x%x"
                                      % (e.line_no, e.offset, last_end))
             if e.offset is None:
-                pad_to = 0x10000 if e.type == APP_TYPE else 4
+                if e.type == APP_TYPE:
+                    pad_to = 0x10000
+                elif e.size < 0 or e.size >= data_align:
+                    pad_to = data_align
+                else:
+                    pad_to = FLASH_SECTOR_SIZE
                 if last_end % pad_to != 0:
                     last_end += pad_to - (last_end % pad_to)
                 e.offset = last_end
@@ -201,6 +209,36 @@ class PartitionTable(list):
                 raise InputError("Partition at 0x%x overlaps 0x%x-0x%x" % (p.offset, last.offset, last.offset + last.size - 1))
             last = p
 
+    def verify_performance(self, app_size=None):
+        """ Warn about layouts that keep the flash from its fast paths:
+        sector and 64K block erases, whole MMU page mmaps, OTA images that
+        don't fit """
+        for p in self:
+            if p.type != DATA_TYPE:
+                continue
+            if p.offset % FLASH_SECTOR_SIZE or p.size % FLASH_SECTOR_SIZE:
+                critical("WARNING: Partition %s at 0x%x size 0x%x is not %dK sector aligned, its first or last sector "
+                         "can't be erased without touching its neighbour" % (p.name, p.offset, p.size, FLASH_SECTOR_SIZE // 1024))
+            elif p.size >= FLASH_BLOCK_SIZE and p.offset % FLASH_BLOCK_SIZE:
+                critical("WARNING: Partition %s at 0x%x is not 64K aligned, erases can't use 64K blocks and mmap "
+                         "takes an extra MMU page" % (p.name, p.offset))
+
+        slots = [p for p in self if p.type == APP_TYPE]
+        if not slots:
+            return
+        ota = [p for p in slots if p.subtype != SUBTYPES[APP_TYPE]["factory"]]
+        if len(set(p.size for p in ota)) > 1:
+            critical("WARNING: OTA slots differ in size (%s), images are bound by the smallest"
+                     % ", ".join("%s 0x%x" % (p.name, p.size) for p in ota))
+        if app_size is None:
+            return
+        smallest = min(slots, key=lambda p: p.size)
+        if app_size > smallest.size:
+            raise InputError("App image of %d bytes does not fit partition %s (%d bytes)" % (app_size, smallest.name, smallest.size))
+        if app_size > smallest.size * 9 // 10:
+            critical("WARNING: App image of %d bytes leaves %d bytes in partition %s, the next update may not fit"
+                     % (app_size, smallest.size - app_size, smallest.name))
+
     def flash_size(self):
         """ Return the size that partitions will occupy in flash
             (ie the offset the last partition ends at)
@@ -450,6 +488,7 @@ def main():
     global md5sum
     global offset_part_table
     global secure
+    global data_align
     parser = argparse.ArgumentParser(description='ESP32 partition table utility')
 
     parser.add_argument('--flash-size', help='Optional flash size limit, checks partition table fits in flash',
@@ -461,6 +500,9 @@ def main():
     parser.add_argument('--quiet', '-q', help="Don't print non-critical status messages to stderr", action='store_true')
     parser.add_argument('--offset', '-o', help='Set offset partition table', default='0x8000')
     parser.add_argument('--secure', help="Require app partitions to be suitable for secure boot", action='store_true')
+    parser.add_argument('--data-align', help='Alignment of data partitions without an offset and at least this large; 0x10000 lets '
+                                             'them use 64K block erases and whole page mmaps', default='0x1000')
+    parser.add_argument('--app-size', help='Size of the app image, or the path to it, checked against the app partitions')
     parser.add_argument('input', help='Path to CSV or binary file to parse.', type=argparse.FileType('rb'))
     parser.add_argument('output', help='Path to output converted binary or CSV file. Will use stdout if omitted.',
                         nargs='?', default='-')
@@ -471,6 +513,9 @@ def main():
     md5sum = not args.disable_md5sum
     secure = args.secure
     offset_part_table = int(args.offset, 0)
+    data_align = int(args.data_align, 0)
+    if data_align <= 0 or data_align % FLASH_SECTOR_SIZE:
+        raise InputError("--data-align 0x%x is not a multiple of the 0x%x flash sector" % (data_align, FLASH_SECTOR_SIZE))
     input = args.input.read()
     input_is_binary = input[0:2] == PartitionDefinition.MAGIC_BYTES
     if input_is_binary:
@@ -484,6 +529,10 @@ def main():
     if not args.no_verify:
         status("Verifying table...")
         table.verify()
+        app_size = None
+        if args.app_size:
+            app_size = os.path.getsize(args.app_size) if os.path.isfile(args.app_size) else parse_int(args.app_size)
+        table.verify_performance(app_size)
 
     if args.flash_size:
         size_mb = int(args.flash_size.replace("MB", ""))
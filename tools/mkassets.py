@@ -0,0 +1,117 @@
+#!/usr/bin/env python
+#
+# Builds a read-only asset image of a folder for the Assets library
+# use it like: python mkassets.py data/ assets.bin [--gzip] [--size 0x100000]
+# then flash it to the data partition it is meant for (label "assets" by default):
+#   esptool.py write_flash <partition offset> assets.bin
+# a partition table line for it can be: assets, data, 0x99, , 1M,
+#
+# Format, little endian:
+#   "ESPA", version 1, reserved byte, entry count (2), image size (4)
+#   entries sorted by path: path, content type, data offsets (4 each, from
+#   the start of the image), data size (4), flags (4, bit 0: gzip)
+#   NUL terminated strings, then each file's data 4 byte aligned
+
+from __future__ import print_function
+
+import argparse
+import gzip
+import mimetypes
+import os
+import struct
+import sys
+
+MAGIC = b'ESPA'
+VERSION = 1
+FLAG_GZIP = 0x01
+HEADER = 12
+ENTRY = 20
+# already compressed, gzip would only add a header
+NO_GZIP = ('.gz', '.png', '.jpg', '.jpeg', '.gif', '.webp', '.woff', '.woff2', '.zip', '.mp3', '.mp4')
+
+
+def parse_int(value):
+    value = value.strip()
+    for suffix, mult in (('K', 1024), ('M', 1024 * 1024)):
+        if value.upper().endswith(suffix):
+            return parse_int(value[:-1]) * mult
+    return int(value, 0)
+
+
+def collect(source, compress):
+    files = []
+    for root, dirs, names in os.walk(source):
+        dirs.sort()
+        for name in names:
+            full = os.path.join(root, name)
+            path = '/' + os.path.relpath(full, source).replace(os.sep, '/')
+            with open(full, 'rb') as f:
+                data = f.read()
+            flags = 0
+            if path.endswith('.gz'):
+                # a precompressed file is served under its plain name
+                path = path[:-3]
+                flags = FLAG_GZIP
+            elif compress and not path.lower().endswith(NO_GZIP):
+                packed = gzip.compress(data, 9)
+                if len(packed) < len(data):
+                    data = packed
+                    flags = FLAG_GZIP
+            ctype = mimetypes.guess_type(path)[0] or 'application/octet-stream'
+            files.append((path.encode('utf-8'), ctype.encode('ascii'), data, flags))
+    files.sort(key=lambda f: f[0])
+    return files
+
+
+def build(files):
+    strings = bytearray()
+    offsets = {}
+    table_end = HEADER + ENTRY * len(files)
+
+    def string(value):
+        if value not in offsets:
+            offsets[value] = table_end + len(strings)
+            strings.extend(value + b'\0')
+        return offsets[value]
+
+    refs = [(string(path), string(ctype)) for path, ctype, _, _ in files]
+    blob = bytearray()
+    base = table_end + len(strings)
+    base += -base % 4
+    entries = bytearray()
+    for (path_off, type_off), (_, _, data, flags) in zip(refs, files):
+        blob.extend(b'\0' * (-len(blob) % 4))
+        entries += struct.pack('<IIIII', path_off, type_off, base + len(blob), len(data), flags)
+        blob.extend(data)
+    size = base + len(blob)
+    image = bytearray(MAGIC + struct.pack('<BBHI', VERSION, 0, len(files), size))
+    image += entries + strings
+    image.extend(b'\0' * (base - len(image)))
+    image += blob
+    return bytes(image)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 asset image builder')
+    parser.add_argument('source', help='folder to put in the image')
+    parser.add_argument('image', help='image to write')
+    parser.add_argument('--gzip', help='gzip files that get smaller, served with Content-Encoding', action='store_true')
+    parser.add_argument('--size', help='partition size to check the image against', type=parse_int)
+    args = parser.parse_args()
+
+    files = collect(args.source, args.gzip)
+    if len(files) > 0xffff:
+        print('too many files: %d' % len(files), file=sys.stderr)
+        return 1
+    image = build(files)
+    if args.size and len(image) > args.size:
+        print('image of %d bytes does not fit the %d byte partition' % (len(image), args.size), file=sys.stderr)
+        return 1
+    with open(args.image, 'wb') as out:
+        out.write(image)
+    print('%d files, %d bytes written to %s' % (len(files), len(image), args.image), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,106 @@
+#!/usr/bin/env python
+#
+# Builds a LittleFS image of a folder for a data partition of a table in tools/partitions
+# use it like: python mklittlefs.py data/ littlefs.bin --partitions partitions/default.csv
+# then flash it with: esptool.py write_flash <offset printed> littlefs.bin
+#
+# The image takes the place of the SPIFFS one: the partition is found by name
+# (--label, "spiffs" like LittleFS.begin()) or else the first of subtype spiffs.
+# Needs littlefs-python (pip install littlefs-python); the geometry below is
+# the esp_littlefs default and has to match the one the firmware is built with.
+
+from __future__ import print_function
+
+import argparse
+import os
+import sys
+
+BLOCK_SIZE = 4096
+READ_SIZE = 128
+PROG_SIZE = 128
+CACHE_SIZE = 512
+LOOKAHEAD_SIZE = 128
+NAME_MAX = 64
+BLOCK_CYCLES = 512
+
+
+def parse_int(value):
+    value = value.strip()
+    for suffix, mult in (('K', 1024), ('M', 1024 * 1024)):
+        if value.upper().endswith(suffix):
+            return parse_int(value[:-1]) * mult
+    return int(value, 0)
+
+
+def find_partition(path, label):
+    """(offset, size) of the partition, offsets left blank are not filled in"""
+    fallback = None
+    with open(path) as table:
+        for line in table:
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            fields = [f.strip() for f in line.split(',')]
+            if len(fields) < 5 or fields[1] != 'data':
+                continue
+            entry = (parse_int(fields[3]) if fields[3] else None, parse_int(fields[4]))
+            if fields[0] == label:
+                return entry
+            if fallback is None and fields[2] == 'spiffs':
+                fallback = entry
+    return fallback
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 LittleFS image builder')
+    parser.add_argument('source', help='folder to put in the image')
+    parser.add_argument('image', help='image to write')
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument('--partitions', help='partition table CSV to take the size from')
+    group.add_argument('--size', help='image size in bytes, K or M', type=parse_int)
+    parser.add_argument('--label', help='partition name (default: %(default)s)', default='spiffs')
+    args = parser.parse_args()
+
+    try:
+        from littlefs import LittleFS
+    except ImportError:
+        print('littlefs-python is missing: pip install littlefs-python', file=sys.stderr)
+        return 1
+
+    offset = None
+    size = args.size
+    if args.partitions:
+        entry = find_partition(args.partitions, args.label)
+        if entry is None:
+            print('no data partition "%s" or of subtype spiffs in %s' % (args.label, args.partitions), file=sys.stderr)
+            return 1
+        offset, size = entry
+    if size % BLOCK_SIZE:
+        print('size 0x%x is not a multiple of the %d byte block' % (size, BLOCK_SIZE), file=sys.stderr)
+        return 1
+
+    fs = LittleFS(block_size=BLOCK_SIZE, block_count=size // BLOCK_SIZE, read_size=READ_SIZE,
+                  prog_size=PROG_SIZE, cache_size=CACHE_SIZE, lookahead_size=LOOKAHEAD_SIZE,
+                  name_max=NAME_MAX, block_cycles=BLOCK_CYCLES)
+    files = 0
+    for root, dirs, names in os.walk(args.source):
+        dirs.sort()
+        rel = os.path.relpath(root, args.source).replace(os.sep, '/')
+        target = '/' if rel == '.' else '/' + rel
+        if target != '/':
+            fs.mkdir(target)
+        for name in sorted(names):
+            with open(os.path.join(root, name), 'rb') as src:
+                with fs.open(target.rstrip('/') + '/' + name, 'wb') as dst:
+                    dst.write(src.read())
+            files += 1
+
+    with open(args.image, 'wb') as out:
+        out.write(fs.context.buffer)
+    where = ' for 0x%x' % offset if offset is not None else ''
+    print('%d files, %d of %d blocks used, image%s written to %s' % (files, fs.used_block_count, size // BLOCK_SIZE, where, args.image), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
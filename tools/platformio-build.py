@@ -24,6 +24,7 @@ http://arduino.cc/en/Reference/HomePage
 
 # Extends: https://github.com/platformio/platform-espressif32/blob/develop/builder/main.py
 
+from os import environ
 from os.path import abspath, isdir, isfile, join
 
 from SCons.Script import DefaultEnvironment
@@ -66,7 +67,7 @@ env.Append(
     CXXFLAGS=[
         "-fno-rtti",
         "-fno-exceptions",
-        "-std=gnu++11"
+        "-std=%s" % env.BoardConfig().get("build.arduino.cpp_std", "gnu++11")
     ],
 
     LINKFLAGS=[
@@ -185,6 +186,14 @@ env.Append(
     ]
 )
 
+#
+# Object cache shared between projects, keyed on the sources and the flags
+#
+
+cache_dir = environ.get("ARDUINO_ESP32_CACHE_DIR", env.BoardConfig().get("build.arduino.cache_dir", ""))
+if cache_dir:
+    env.CacheDir(env.subst(cache_dir))
+
 if not env.BoardConfig().get("build.ldscript", ""):
     env.Replace(LDSCRIPT_PATH=env.BoardConfig().get("build.arduino.ldscript", ""))
 
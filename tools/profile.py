@@ -0,0 +1,101 @@
+#!/usr/bin/env python
+#
+# Resolves a dump of the Profiler library to functions and source lines
+# use it like: python profile.py --elf sketch.elf dump.txt
+# The dump comes from a file ('-' for stdin), an URL the sketch serves it at,
+# or --port, read until "# end" (needs pyserial). addr2line is the one of the
+# toolchain: xtensa-esp32-elf-addr2line from the PATH or --addr2line.
+
+from __future__ import print_function
+
+import argparse
+import re
+import subprocess
+import sys
+
+LINE = re.compile(r'^(\d+)\s+0x([0-9a-fA-F]+)\s+(\d+)\s*$')
+
+
+def read_lines(args):
+    if args.port:
+        import serial
+        with serial.Serial(args.port, args.baud, timeout=args.timeout) as port:
+            started = False
+            while True:
+                line = port.readline().decode('utf-8', 'replace')
+                if not line:
+                    raise SystemExit('no dump within %d s' % args.timeout)
+                started = started or line.startswith('# profiler')
+                if started:
+                    yield line
+                    if line.startswith('# end'):
+                        return
+    elif args.dump.startswith('http://') or args.dump.startswith('https://'):
+        try:
+            from urllib.request import urlopen
+        except ImportError:
+            from urllib2 import urlopen
+        for line in urlopen(args.dump, timeout=args.timeout).read().decode('utf-8', 'replace').splitlines():
+            yield line
+    else:
+        with (sys.stdin if args.dump == '-' else open(args.dump)) as f:
+            for line in f:
+                yield line
+
+
+def resolve(args, addresses):
+    # two lines for each address: the function, demangled, and file:line
+    out = subprocess.check_output([args.addr2line, '-f', '-C', '-e', args.elf] +
+                                  ['0x%08x' % a for a in addresses]).decode('utf-8', 'replace').splitlines()
+    names = {}
+    for i, address in enumerate(addresses):
+        function = out[2 * i].strip()
+        location = out[2 * i + 1].strip()
+        names[address] = (function, location)
+    return names
+
+
+def main(args):
+    parser = argparse.ArgumentParser(description='Resolve a Profiler dump against the ELF of the sketch')
+    parser.add_argument('dump', nargs='?', default='-', help="file, '-' or URL of the dump")
+    parser.add_argument('--elf', required=True)
+    parser.add_argument('--addr2line', default='xtensa-esp32-elf-addr2line')
+    parser.add_argument('--port', help='serial port to read the dump from')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--timeout', type=int, default=30, help='seconds to wait for the dump')
+    parser.add_argument('--lines', action='store_true', help='by source line instead of function')
+    parser.add_argument('--core', type=int, help='only this core')
+    parser.add_argument('--top', type=int, default=30, help='entries printed')
+    args = parser.parse_args(args)
+
+    counts = {}
+    for line in read_lines(args):
+        if line.startswith('#'):
+            print(line.rstrip())
+            continue
+        match = LINE.match(line)
+        if not match:
+            continue
+        core, pc, count = int(match.group(1)), int(match.group(2), 16), int(match.group(3))
+        if args.core is not None and core != args.core:
+            continue
+        counts[pc] = counts.get(pc, 0) + count
+    if not counts:
+        raise SystemExit('no samples')
+
+    names = resolve(args, sorted(counts))
+    totals = {}
+    for pc, count in counts.items():
+        function, location = names[pc]
+        key = '%s (%s)' % (location, function) if args.lines else function
+        totals[key] = totals.get(key, 0) + count
+
+    samples = sum(counts.values())
+    print('%d samples, %d PCs' % (samples, len(counts)))
+    for key, count in sorted(totals.items(), key=lambda item: -item[1])[:args.top]:
+        print('%6.2f%% %7d  %s' % (100.0 * count / samples, count, key))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+#
+# Turns a traceDump() of the core into the JSON trace format of Chrome,
+# which ui.perfetto.dev and chrome://tracing open
+# use it like: python trace2json.py <dump> <trace.json>
+# The dump is the binary one, or a serial capture with it in hex between
+# the lines "# trace" and "# end".
+#
+# Each core is a process and each task a thread in it, the events recorded
+# in interrupts go to an "interrupts" thread of the core. Times come from the
+# CCOUNT of the core, counted from the sync event before them; events older
+# than the first sync left in the ring are dropped.
+
+from __future__ import print_function
+
+import binascii
+import json
+import struct
+import sys
+
+MAGIC = b'ESPT'
+EVENT = struct.Struct('<IHBBII')
+ID_SYNC = 0
+PHASES = {0: 'B', 1: 'E', 2: 'i'}
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data.startswith(MAGIC):
+        return data
+    hexed = []
+    inside = False
+    for line in data.decode('utf-8', 'replace').splitlines():
+        line = line.strip()
+        if line.startswith('# trace'):
+            inside = True
+        elif line.startswith('# end'):
+            break
+        elif inside:
+            hexed.append(line)
+    data = binascii.unhexlify(''.join(hexed))
+    if not data.startswith(MAGIC):
+        raise SystemExit('no trace in %s' % path)
+    return data
+
+
+class Reader(object):
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, fmt):
+        values = struct.unpack_from('<' + fmt, self.data, self.pos)
+        self.pos += struct.calcsize('<' + fmt)
+        return values
+
+    def string(self):
+        length, = self.take('B')
+        s = self.data[self.pos:self.pos + length].decode('utf-8', 'replace')
+        self.pos += length
+        return s
+
+
+def convert(data):
+    r = Reader(data)
+    _, version, cores, mhz, count = r.take('4sBBHH')
+    if version != 1:
+        raise SystemExit('trace version %d not supported' % version)
+    names = {}
+    for _ in range(count):
+        ident, = r.take('H')
+        names[ident] = r.string()
+
+    out = []
+    for core in range(cores):
+        events, tasks = r.take('IB')
+        out.append({'ph': 'M', 'name': 'process_name', 'pid': core, 'args': {'name': 'core %d' % core}})
+        out.append({'ph': 'M', 'name': 'thread_name', 'pid': core, 'tid': 0, 'args': {'name': 'interrupts'}})
+        for _ in range(tasks):
+            handle, = r.take('I')
+            out.append({'ph': 'M', 'name': 'thread_name', 'pid': core, 'tid': handle, 'args': {'name': r.string()}})
+
+        sync = None
+        dropped = 0
+        for _ in range(events):
+            ccount, ident, kind, isr, task, value = EVENT.unpack_from(r.data, r.pos)
+            r.pos += EVENT.size
+            if ident == ID_SYNC:
+                sync = (ccount, (task << 32) | value)
+                continue
+            if sync is None:
+                dropped += 1
+                continue
+            delta = (ccount - sync[0]) & 0xffffffff
+            if delta >= 0x80000000:
+                delta -= 0x100000000
+            event = {
+                'name': names.get(ident, 'id %d' % ident),
+                'ph': PHASES.get(kind, 'i'),
+                'ts': sync[1] + float(delta) / mhz,
+                'pid': core,
+                'tid': 0 if isr else task,
+            }
+            if kind == 2:
+                event['s'] = 't'
+                event['args'] = {'value': value}
+            out.append(event)
+        if dropped:
+            print('core %d: %d events before the first sync dropped' % (core, dropped), file=sys.stderr)
+    return {'traceEvents': out, 'displayTimeUnit': 'ns'}
+
+
+def main(args):
+    if len(args) != 2:
+        print('usage: trace2json.py <dump> <trace.json>', file=sys.stderr)
+        return 1
+    trace = convert(load(args[0]))
+    with open(args[1], 'w') as f:
+        json.dump(trace, f)
+    print('%d events' % len(trace['traceEvents']))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,119 @@
+#!/usr/bin/env python
+#
+# Load test for a WebServer on the board: N connections request the paths
+# back to back and the latency of each request is kept for the percentiles.
+# use it like: python webload.py 192.168.1.20 -c 4 -d 10 / /inline
+# --close opens a connection per request instead of keep-alive, --metrics
+# prints what the board reports at /metrics (WebServer::enableMetrics()) after the run.
+
+from __future__ import print_function
+
+import argparse
+import sys
+import threading
+import time
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+
+
+class Worker(threading.Thread):
+    def __init__(self, args, deadline):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.args = args
+        self.deadline = deadline
+        self.latencies = []
+        self.statuses = {}
+        self.errors = 0
+        self.bytes = 0
+
+    def connect(self):
+        return httplib.HTTPConnection(self.args.host, self.args.port, timeout=self.args.timeout)
+
+    def run(self):
+        conn = None
+        n = 0
+        while time.time() < self.deadline:
+            path = self.args.paths[n % len(self.args.paths)]
+            n += 1
+            if conn is None:
+                conn = self.connect()
+            start = time.time()
+            try:
+                conn.request('GET', path, headers={'Connection': 'close' if self.args.close else 'keep-alive'})
+                response = conn.getresponse()
+                body = response.read()
+            except Exception:
+                self.errors += 1
+                conn.close()
+                conn = None
+                continue
+            self.latencies.append(time.time() - start)
+            self.statuses[response.status] = self.statuses.get(response.status, 0) + 1
+            self.bytes += len(body)
+            if self.args.close or response.getheader('Connection', '').lower() == 'close':
+                conn.close()
+                conn = None
+        if conn is not None:
+            conn.close()
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def main(args):
+    parser = argparse.ArgumentParser(description='HTTP load test for the WebServer on the board')
+    parser.add_argument('host')
+    parser.add_argument('paths', nargs='*', default=['/'], help='requested in turn, / by default')
+    parser.add_argument('-p', '--port', type=int, default=80)
+    parser.add_argument('-c', '--connections', type=int, default=4, help='concurrent connections')
+    parser.add_argument('-d', '--duration', type=float, default=10, help='seconds')
+    parser.add_argument('-t', '--timeout', type=float, default=5, help='seconds a request may take')
+    parser.add_argument('--close', action='store_true', help='a new connection for every request')
+    parser.add_argument('--metrics', nargs='?', const='/metrics', help='path of the metrics to print after the run')
+    # paths after the options too, where argparse can
+    args = parser.parse_intermixed_args(args) if hasattr(parser, 'parse_intermixed_args') else parser.parse_args(args)
+
+    deadline = time.time() + args.duration
+    workers = [Worker(args, deadline) for _ in range(args.connections)]
+    start = time.time()
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    elapsed = time.time() - start
+
+    latencies = sorted(l for worker in workers for l in worker.latencies)
+    statuses = {}
+    for worker in workers:
+        for status, count in worker.statuses.items():
+            statuses[status] = statuses.get(status, 0) + count
+    errors = sum(worker.errors for worker in workers)
+    received = sum(worker.bytes for worker in workers)
+
+    print('%d requests in %.1f s, %.1f req/s, %.1f KB/s, %d errors' %
+          (len(latencies), elapsed, len(latencies) / elapsed, received / 1024.0 / elapsed, errors))
+    print('status: ' + ', '.join('%d: %d' % (status, statuses[status]) for status in sorted(statuses)))
+    if latencies:
+        print('latency ms: min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f' %
+              tuple(1000 * v for v in (latencies[0], percentile(latencies, 50), percentile(latencies, 90),
+                                       percentile(latencies, 99), latencies[-1])))
+
+    if args.metrics:
+        conn = httplib.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        conn.request('GET', args.metrics)
+        response = conn.getresponse()
+        print(response.read().decode('utf-8', 'replace'))
+        conn.close()
+    return 1 if errors or not latencies else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))